@@ -85,4 +85,9 @@
 #define SO_ATTACH_BPF		50
 #define SO_DETACH_BPF		SO_DETACH_FILTER
 
+#define SO_INCOMING_NAPI_ID	51
+
+#define SO_TXTIME		52
+#define SCM_TXTIME		SO_TXTIME
+
 #endif /* _UAPI__ASM_AVR32_SOCKET_H */
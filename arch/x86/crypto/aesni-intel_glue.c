@@ -153,6 +153,15 @@ asmlinkage void aesni_gcm_dec(void *ctx, u8 *out,
 			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
 			u8 *auth_tag, unsigned long auth_tag_len);
 
+/* asmlinkage void aesni_gcm_ghash()
+ * u8 *hash, running GHASH value, updated in place.
+ * const u8 *hash_subkey, the Hash sub key input.
+ * const u8 *in, data to be hashed.
+ * unsigned long len, Length of data in bytes, a multiple of 16.
+ */
+asmlinkage void aesni_gcm_ghash(u8 *hash, const u8 *hash_subkey,
+			const u8 *in, unsigned long len);
+
 
 #ifdef CONFIG_AS_AVX
 asmlinkage void aes_ctr_enc_128_avx_by8(const u8 *in, u8 *iv,
@@ -936,9 +945,138 @@ static int rfc4106_set_authsize(struct crypto_aead *parent,
 	return crypto_aead_setauthsize(&cryptd_tfm->base, authsize);
 }
 
+/*
+ * GCM for requests whose scatterlists are not a single mapped buffer
+ * each.  Rather than copying the whole request into a bounce buffer for
+ * aesni_gcm_enc/dec, CTR and GHASH are run over each mapped piece in
+ * place; a block split between two pieces is carried over in @block.
+ */
+struct gcm_sg_state {
+	u8 ctr[AES_BLOCK_SIZE];		/* next counter block */
+	u8 ks[AES_BLOCK_SIZE];		/* keystream of the split block */
+	u8 block[AES_BLOCK_SIZE];	/* ciphertext of the split block */
+	u8 ghash[AES_BLOCK_SIZE];
+	unsigned int partial;		/* bytes of the split block done */
+};
+
+static void gcm_sg_partial(void *aes_ctx, u8 *hash_subkey,
+			   struct gcm_sg_state *st, u8 *out, const u8 *in,
+			   unsigned int len, bool enc)
+{
+	unsigned int i;
+	u8 c;
+
+	if (!st->partial) {
+		aesni_enc(aes_ctx, st->ks, st->ctr);
+		crypto_inc(st->ctr, AES_BLOCK_SIZE);
+	}
+
+	for (i = 0; i < len; i++) {
+		c = in[i] ^ st->ks[st->partial];
+		st->block[st->partial++] = enc ? c : in[i];
+		out[i] = c;
+	}
+
+	if (st->partial == AES_BLOCK_SIZE) {
+		aesni_gcm_ghash(st->ghash, hash_subkey, st->block,
+				AES_BLOCK_SIZE);
+		st->partial = 0;
+	}
+}
+
+static void gcm_sg_crypt(void *aes_ctx, u8 *hash_subkey,
+			 struct gcm_sg_state *st, u8 *out, const u8 *in,
+			 unsigned int len, bool enc)
+{
+	unsigned int n;
+
+	if (st->partial) {
+		n = min_t(unsigned int, len, AES_BLOCK_SIZE - st->partial);
+		gcm_sg_partial(aes_ctx, hash_subkey, st, out, in, n, enc);
+		out += n;
+		in += n;
+		len -= n;
+	}
+
+	n = len & AES_BLOCK_MASK;
+	if (n) {
+		if (!enc)
+			aesni_gcm_ghash(st->ghash, hash_subkey, in, n);
+		aesni_ctr_enc_tfm(aes_ctx, out, in, n, st->ctr);
+		if (enc)
+			aesni_gcm_ghash(st->ghash, hash_subkey, out, n);
+		out += n;
+		in += n;
+		len -= n;
+	}
+
+	if (len)
+		gcm_sg_partial(aes_ctx, hash_subkey, st, out, in, len, enc);
+}
+
+/* Must be called between kernel_fpu_begin() and kernel_fpu_end() */
+static void gcmaes_crypt_sg(struct aead_request *req, void *aes_ctx,
+			    u8 *hash_subkey, u8 *iv, unsigned int assoclen,
+			    unsigned int cryptlen, u8 *auth_tag, bool enc)
+{
+	struct gcm_sg_state st __attribute__ ((__aligned__(AESNI_ALIGN)));
+	struct scatterlist src_start[2], dst_start[2];
+	struct scatterlist *src_sg, *dst_sg;
+	struct scatter_walk src_walk, dst_walk;
+	u8 aad[AES_BLOCK_SIZE] = {};
+	__be64 lens[2];
+	unsigned int len = cryptlen, n;
+	u8 *src, *dst;
+
+	memset(st.ghash, 0, AES_BLOCK_SIZE);
+	memcpy(st.ctr, iv, AES_BLOCK_SIZE);
+	crypto_inc(st.ctr, AES_BLOCK_SIZE);
+	st.partial = 0;
+
+	/* The rfc4106 AAD is at most 12 bytes, one zero padded block */
+	scatterwalk_map_and_copy(aad, req->src, 0, assoclen, 0);
+	aesni_gcm_ghash(st.ghash, hash_subkey, aad, AES_BLOCK_SIZE);
+
+	src_sg = scatterwalk_ffwd(src_start, req->src, req->assoclen);
+	dst_sg = src_sg;
+	if (req->src != req->dst)
+		dst_sg = scatterwalk_ffwd(dst_start, req->dst, req->assoclen);
+	scatterwalk_start(&src_walk, src_sg);
+	scatterwalk_start(&dst_walk, dst_sg);
+
+	while (len) {
+		n = scatterwalk_clamp(&src_walk, len);
+		n = scatterwalk_clamp(&dst_walk, n);
+		src = scatterwalk_map(&src_walk);
+		dst = scatterwalk_map(&dst_walk);
+
+		gcm_sg_crypt(aes_ctx, hash_subkey, &st, dst, src, n, enc);
+
+		scatterwalk_unmap(dst);
+		scatterwalk_unmap(src);
+		scatterwalk_advance(&src_walk, n);
+		scatterwalk_advance(&dst_walk, n);
+		len -= n;
+		scatterwalk_done(&src_walk, 0, len);
+		scatterwalk_done(&dst_walk, 1, len);
+	}
+
+	if (st.partial) {
+		memset(st.block + st.partial, 0, AES_BLOCK_SIZE - st.partial);
+		aesni_gcm_ghash(st.ghash, hash_subkey, st.block,
+				AES_BLOCK_SIZE);
+	}
+
+	lens[0] = cpu_to_be64((u64)assoclen * 8);
+	lens[1] = cpu_to_be64((u64)cryptlen * 8);
+	aesni_gcm_ghash(st.ghash, hash_subkey, (u8 *)lens, AES_BLOCK_SIZE);
+
+	aesni_enc(aes_ctx, auth_tag, iv);
+	crypto_xor(auth_tag, st.ghash, AES_BLOCK_SIZE);
+}
+
 static int helper_rfc4106_encrypt(struct aead_request *req)
 {
-	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
 	__be32 counter = cpu_to_be32(1);
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
@@ -946,6 +1084,7 @@ static int helper_rfc4106_encrypt(struct aead_request *req)
 	void *aes_ctx = &(ctx->aes_key_expanded);
 	unsigned long auth_tag_len = crypto_aead_authsize(tfm);
 	u8 iv[16] __attribute__ ((__aligned__(AESNI_ALIGN)));
+	u8 authTag[16];
 	struct scatter_walk src_sg_walk;
 	struct scatter_walk dst_sg_walk;
 	unsigned int i;
@@ -963,29 +1102,29 @@ static int helper_rfc4106_encrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if (sg_is_last(req->src) &&
-	    req->src->offset + req->src->length <= PAGE_SIZE &&
-	    sg_is_last(req->dst) &&
-	    req->dst->offset + req->dst->length <= PAGE_SIZE) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		assoc = scatterwalk_map(&src_sg_walk);
-		src = assoc + req->assoclen;
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
-		}
-	} else {
-		/* Allocate memory for src, dst, assoc */
-		assoc = kmalloc(req->cryptlen + auth_tag_len + req->assoclen,
-			GFP_ATOMIC);
-		if (unlikely(!assoc))
-			return -ENOMEM;
-		scatterwalk_map_and_copy(assoc, req->src, 0,
-					 req->assoclen + req->cryptlen, 0);
-		src = assoc + req->assoclen;
-		dst = src;
+	if (!sg_is_last(req->src) ||
+	    req->src->offset + req->src->length > PAGE_SIZE ||
+	    !sg_is_last(req->dst) ||
+	    req->dst->offset + req->dst->length > PAGE_SIZE) {
+		kernel_fpu_begin();
+		gcmaes_crypt_sg(req, aes_ctx, ctx->hash_subkey, iv,
+				req->assoclen - 8, req->cryptlen, authTag,
+				true);
+		kernel_fpu_end();
+
+		scatterwalk_map_and_copy(authTag, req->dst,
+					 req->assoclen + req->cryptlen,
+					 auth_tag_len, 1);
+		return 0;
+	}
+
+	scatterwalk_start(&src_sg_walk, req->src);
+	assoc = scatterwalk_map(&src_sg_walk);
+	src = assoc + req->assoclen;
+	dst = src;
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_start(&dst_sg_walk, req->dst);
+		dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
 	}
 
 	kernel_fpu_begin();
@@ -994,28 +1133,21 @@ static int helper_rfc4106_encrypt(struct aead_request *req)
 			  dst + req->cryptlen, auth_tag_len);
 	kernel_fpu_end();
 
-	/* The authTag (aka the Integrity Check Value) needs to be written
-	 * back to the packet. */
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst - req->assoclen);
-			scatterwalk_advance(&dst_sg_walk, req->dst->length);
-			scatterwalk_done(&dst_sg_walk, 1, 0);
-		}
-		scatterwalk_unmap(assoc);
-		scatterwalk_advance(&src_sg_walk, req->src->length);
-		scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
-	} else {
-		scatterwalk_map_and_copy(dst, req->dst, req->assoclen,
-					 req->cryptlen + auth_tag_len, 1);
-		kfree(assoc);
+	/* The authTag (aka the Integrity Check Value) was written
+	 * straight into the packet. */
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_unmap(dst - req->assoclen);
+		scatterwalk_advance(&dst_sg_walk, req->dst->length);
+		scatterwalk_done(&dst_sg_walk, 1, 0);
 	}
+	scatterwalk_unmap(assoc);
+	scatterwalk_advance(&src_sg_walk, req->src->length);
+	scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
 	return 0;
 }
 
 static int helper_rfc4106_decrypt(struct aead_request *req)
 {
-	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
 	unsigned long tempCipherLen = 0;
 	__be32 counter = cpu_to_be32(1);
@@ -1026,6 +1158,7 @@ static int helper_rfc4106_decrypt(struct aead_request *req)
 	unsigned long auth_tag_len = crypto_aead_authsize(tfm);
 	u8 iv[16] __attribute__ ((__aligned__(AESNI_ALIGN)));
 	u8 authTag[16];
+	u8 recvTag[16];
 	struct scatter_walk src_sg_walk;
 	struct scatter_walk dst_sg_walk;
 	unsigned int i;
@@ -1045,29 +1178,31 @@ static int helper_rfc4106_decrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	if (sg_is_last(req->src) &&
-	    req->src->offset + req->src->length <= PAGE_SIZE &&
-	    sg_is_last(req->dst) &&
-	    req->dst->offset + req->dst->length <= PAGE_SIZE) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		assoc = scatterwalk_map(&src_sg_walk);
-		src = assoc + req->assoclen;
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
-		}
+	if (!sg_is_last(req->src) ||
+	    req->src->offset + req->src->length > PAGE_SIZE ||
+	    !sg_is_last(req->dst) ||
+	    req->dst->offset + req->dst->length > PAGE_SIZE) {
+		scatterwalk_map_and_copy(recvTag, req->src,
+					 req->assoclen + tempCipherLen,
+					 auth_tag_len, 0);
 
-	} else {
-		/* Allocate memory for src, dst, assoc */
-		assoc = kmalloc(req->cryptlen + req->assoclen, GFP_ATOMIC);
-		if (!assoc)
-			return -ENOMEM;
-		scatterwalk_map_and_copy(assoc, req->src, 0,
-					 req->assoclen + req->cryptlen, 0);
-		src = assoc + req->assoclen;
-		dst = src;
+		kernel_fpu_begin();
+		gcmaes_crypt_sg(req, aes_ctx, ctx->hash_subkey, iv,
+				req->assoclen - 8, tempCipherLen, authTag,
+				false);
+		kernel_fpu_end();
+
+		return crypto_memneq(recvTag, authTag, auth_tag_len) ?
+			-EBADMSG : 0;
+	}
+
+	scatterwalk_start(&src_sg_walk, req->src);
+	assoc = scatterwalk_map(&src_sg_walk);
+	src = assoc + req->assoclen;
+	dst = src;
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_start(&dst_sg_walk, req->dst);
+		dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
 	}
 
 	kernel_fpu_begin();
@@ -1080,20 +1215,14 @@ static int helper_rfc4106_decrypt(struct aead_request *req)
 	retval = crypto_memneq(src + tempCipherLen, authTag, auth_tag_len) ?
 		-EBADMSG : 0;
 
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst - req->assoclen);
-			scatterwalk_advance(&dst_sg_walk, req->dst->length);
-			scatterwalk_done(&dst_sg_walk, 1, 0);
-		}
-		scatterwalk_unmap(assoc);
-		scatterwalk_advance(&src_sg_walk, req->src->length);
-		scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
-	} else {
-		scatterwalk_map_and_copy(dst, req->dst, req->assoclen,
-					 tempCipherLen, 1);
-		kfree(assoc);
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_unmap(dst - req->assoclen);
+		scatterwalk_advance(&dst_sg_walk, req->dst->length);
+		scatterwalk_done(&dst_sg_walk, 1, 0);
 	}
+	scatterwalk_unmap(assoc);
+	scatterwalk_advance(&src_sg_walk, req->src->length);
+	scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
 	return retval;
 }
 
@@ -136,6 +136,8 @@ extern __wsum csum_partial(const void *buff, int len, __wsum sum);
 extern __visible __wsum csum_partial_copy_generic(const void *src, const void *dst,
 					int len, __wsum sum,
 					int *src_err_ptr, int *dst_err_ptr);
+extern unsigned csum_copy_to_user_avx2(const void *src, void __user *dst,
+				       unsigned count64, __wsum *sum);
 
 
 extern __wsum csum_partial_copy_from_user(const void __user *src, void *dst,
@@ -43,6 +43,9 @@
 #define KVM_COALESCED_MMIO_PAGE_OFFSET 2
 #define KVM_HALT_POLL_NS_DEFAULT 400000
 
+/* mmu_lock is an rwlock; TDP faults take it for read */
+#define KVM_HAVE_MMU_RWLOCK
+
 #define KVM_IRQCHIP_NUM_PINS  KVM_IOAPIC_NUM_PINS
 
 #define CR0_RESERVED_BITS                                               \
@@ -87,6 +90,7 @@ static inline gfn_t gfn_to_index(gfn_t gfn, gfn_t base_gfn, int level)
 #define KVM_MIN_ALLOC_MMU_PAGES 64
 #define KVM_MMU_HASH_SHIFT 10
 #define KVM_NUM_MMU_PAGES (1 << KVM_MMU_HASH_SHIFT)
+#define KVM_MMU_RMAP_LOCKS 64
 #define KVM_MIN_FREE_MMU_PAGES 5
 #define KVM_REFILL_PAGES 25
 #define KVM_MAX_CPUID_ENTRIES 80
@@ -635,6 +639,11 @@ struct kvm_arch {
 	 */
 	struct list_head active_mmu_pages;
 	struct list_head zapped_obsolete_pages;
+	/*
+	 * Serialize rmap updates for a gfn (hashed) between faults that
+	 * hold mmu_lock for read; the write side needs none of these.
+	 */
+	spinlock_t mmu_rmap_locks[KVM_MMU_RMAP_LOCKS];
 
 	struct list_head assigned_dev_head;
 	struct iommu_domain *iommu_domain;
@@ -895,6 +904,11 @@ struct kvm_x86_ops {
 	void (*enable_log_dirty_pt_masked)(struct kvm *kvm,
 					   struct kvm_memory_slot *slot,
 					   gfn_t offset, unsigned long mask);
+	/*
+	 * Pages the hardware may log (e.g. a full PML buffer) that get
+	 * pushed to the dirty ring on a single exit.
+	 */
+	int cpu_dirty_log_size;
 	/* pmu operations of sub-arch */
 	const struct kvm_pmu_ops *pmu_ops;
 
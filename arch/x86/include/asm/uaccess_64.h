@@ -32,6 +32,9 @@ copy_user_generic(void *to, const void *from, unsigned len)
 	 * If CPU has ERMS feature, use copy_user_enhanced_fast_string.
 	 * Otherwise, if CPU has rep_good feature, use copy_user_generic_string.
 	 * Otherwise, use copy_user_generic_unrolled.
+	 *
+	 * The string variants pick their own strategy by size: short
+	 * copies avoid the REP startup cost, huge ones are not cached.
 	 */
 	alternative_call_2(copy_user_generic_unrolled,
 			 copy_user_generic_string,
@@ -45,6 +45,9 @@
 #define __KVM_HAVE_XCRS
 #define __KVM_HAVE_READONLY_MEM
 
+/* Page offset of the dirty ring in the vcpu mmap area */
+#define KVM_DIRTY_LOG_PAGE_OFFSET 64
+
 /* Architectural interrupt line count. */
 #define KVM_NR_INTERRUPTS 256
 
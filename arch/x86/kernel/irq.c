@@ -464,6 +464,16 @@ void fixup_irqs(void)
 		 */
 		irq_force_complete_move(desc);
 
+		/*
+		 * A managed interrupt whose cpus are all gone is shut down
+		 * rather than forced elsewhere, and restarted when one of
+		 * them comes back.
+		 */
+		if (irq_managed_offline(desc)) {
+			raw_spin_unlock(&desc->lock);
+			continue;
+		}
+
 		if (cpumask_any_and(affinity, cpu_online_mask) >= nr_cpu_ids) {
 			break_affinity = 1;
 			affinity = cpu_online_mask;
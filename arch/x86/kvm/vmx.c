@@ -1986,14 +1986,25 @@ static void vmx_load_host_state(struct vcpu_vmx *vmx)
 	preempt_enable();
 }
 
+/*
+ * Device interrupts can only be posted straight into the guest when the
+ * IOMMU supports it and the posted-interrupt descriptors are in use at
+ * all, i.e. APICv is on; otherwise they go through the host IRQ and the
+ * irqfd.
+ */
+static bool vmx_can_post_device_irqs(struct kvm *kvm)
+{
+	return enable_apicv && kvm_arch_has_assigned_device(kvm) &&
+	       irq_remapping_cap(IRQ_POSTING_CAP);
+}
+
 static void vmx_vcpu_pi_load(struct kvm_vcpu *vcpu, int cpu)
 {
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 	struct pi_desc old, new;
 	unsigned int dest;
 
-	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
 		return;
 
 	do {
@@ -2098,8 +2109,7 @@ static void vmx_vcpu_pi_put(struct kvm_vcpu *vcpu)
 {
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 
-	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
 		return;
 
 	/* Set SN when the vCPU is preempted */
@@ -6297,6 +6307,7 @@ static __init int hardware_setup(void)
 		kvm_x86_ops->slot_disable_log_dirty = NULL;
 		kvm_x86_ops->flush_log_dirty = NULL;
 		kvm_x86_ops->enable_log_dirty_pt_masked = NULL;
+		kvm_x86_ops->cpu_dirty_log_size = 0;
 	}
 
 	kvm_set_posted_intr_wakeup_handler(wakeup_handler);
@@ -10612,8 +10623,7 @@ static int vmx_pre_block(struct kvm_vcpu *vcpu)
 	struct pi_desc old, new;
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 
-	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
 		return 0;
 
 	vcpu->pre_pcpu = vcpu->cpu;
@@ -10678,8 +10688,7 @@ static void vmx_post_block(struct kvm_vcpu *vcpu)
 	unsigned int dest;
 	unsigned long flags;
 
-	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
 		return;
 
 	do {
@@ -10731,8 +10740,7 @@ static int vmx_update_pi_irte(struct kvm *kvm, unsigned int host_irq,
 	struct vcpu_data vcpu_info;
 	int idx, ret = -EINVAL;
 
-	if (!kvm_arch_has_assigned_device(kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	if (!vmx_can_post_device_irqs(kvm))
 		return 0;
 
 	idx = srcu_read_lock(&kvm->irq_srcu);
@@ -10756,8 +10764,20 @@ static int vmx_update_pi_irte(struct kvm *kvm, unsigned int host_irq,
 		 */
 
 		kvm_set_msi_irq(e, &irq);
-		if (!kvm_intr_is_single_vcpu(kvm, &irq, &vcpu))
+		if (!kvm_intr_is_single_vcpu(kvm, &irq, &vcpu)) {
+			/*
+			 * The guest may have retargeted a posted interrupt
+			 * to several vCPUs; don't leave it posted to the old
+			 * one, deliver it through remapping and the irqfd.
+			 */
+			ret = irq_set_vcpu_affinity(host_irq, NULL);
+			if (ret < 0) {
+				printk(KERN_INFO "%s: failed to back out to remapped mode\n",
+						__func__);
+				goto out;
+			}
 			continue;
+		}
 
 		vcpu_info.pi_desc_addr = __pa(vcpu_to_pi_desc(vcpu));
 		vcpu_info.vector = irq.vector;
@@ -10900,6 +10920,7 @@ static struct kvm_x86_ops vmx_x86_ops = {
 	.slot_disable_log_dirty = vmx_slot_disable_log_dirty,
 	.flush_log_dirty = vmx_flush_log_dirty,
 	.enable_log_dirty_pt_masked = vmx_enable_log_dirty_pt_masked,
+	.cpu_dirty_log_size = PML_ENTITY_NUM,
 
 	.pre_block = vmx_pre_block,
 	.post_block = vmx_post_block,
@@ -8,6 +8,10 @@
 #include <linux/compiler.h>
 #include <linux/module.h>
 #include <asm/checksum.h>
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#include <asm/asm.h>
+#include <linux/uaccess.h>
 
 static inline unsigned short from32to16(unsigned a) 
 {
@@ -19,6 +23,148 @@ static inline unsigned short from32to16(unsigned a)
 	return b;
 }
 
+/*
+ * Below this many 64-byte blocks saving and restoring the FPU state
+ * costs more than AVX2 saves.
+ */
+#define CSUM_AVX2_MIN_BLOCKS	16
+
+static inline bool csum_avx2_usable(unsigned count64)
+{
+	return count64 >= CSUM_AVX2_MIN_BLOCKS &&
+		boot_cpu_has(X86_FEATURE_AVX2) &&
+		boot_cpu_has(X86_FEATURE_AVX) && irq_fpu_usable();
+}
+
+static inline unsigned long add64_with_carry(unsigned long a, unsigned long b)
+{
+	asm("addq %2,%0\n\t"
+	    "adcq $0,%0"
+	    : "=r" (a)
+	    : "0" (a), "rm" (b));
+	return a;
+}
+
+/*
+ * The AVX2 loops zero extend the 32-bit words of each 64-byte block into
+ * the 64-bit lanes of four accumulators.  A lane cannot overflow before
+ * 2^32 blocks, so there is no carry chain to serialize on, and the lanes
+ * are only added up with end around carry at the end.
+ */
+#define CSUM_AVX2_ZERO							\
+	asm volatile("vpxor %ymm0,%ymm0,%ymm0\n\t"			\
+		     "vpxor %ymm1,%ymm1,%ymm1\n\t"			\
+		     "vpxor %ymm2,%ymm2,%ymm2\n\t"			\
+		     "vpxor %ymm3,%ymm3,%ymm3\n\t"			\
+		     "vpxor %ymm7,%ymm7,%ymm7")
+
+/* Sums ymm4 and ymm5 into the accumulators */
+#define CSUM_AVX2_ADD							\
+	"vpunpckldq %%ymm7,%%ymm4,%%ymm6\n\t"				\
+	"vpunpckhdq %%ymm7,%%ymm4,%%ymm4\n\t"				\
+	"vpaddq %%ymm6,%%ymm0,%%ymm0\n\t"				\
+	"vpaddq %%ymm4,%%ymm1,%%ymm1\n\t"				\
+	"vpunpckldq %%ymm7,%%ymm5,%%ymm6\n\t"				\
+	"vpunpckhdq %%ymm7,%%ymm5,%%ymm5\n\t"				\
+	"vpaddq %%ymm6,%%ymm2,%%ymm2\n\t"				\
+	"vpaddq %%ymm5,%%ymm3,%%ymm3\n\t"
+
+static unsigned long csum_avx2_fold(unsigned long result)
+{
+	unsigned long lo, hi;
+
+	asm volatile("vpaddq %%ymm1,%%ymm0,%%ymm0\n\t"
+		     "vpaddq %%ymm3,%%ymm2,%%ymm2\n\t"
+		     "vpaddq %%ymm2,%%ymm0,%%ymm0\n\t"
+		     "vextracti128 $1,%%ymm0,%%xmm1\n\t"
+		     "vpaddq %%xmm1,%%xmm0,%%xmm0\n\t"
+		     "vmovq %%xmm0,%0\n\t"
+		     "vpextrq $1,%%xmm0,%1"
+		     : "=r" (lo), "=r" (hi));
+
+	return add64_with_carry(add64_with_carry(result, lo), hi);
+}
+
+static unsigned long csum_blocks_avx2(const unsigned char *buff,
+				      unsigned count64, unsigned long result)
+{
+	kernel_fpu_begin();
+	CSUM_AVX2_ZERO;
+	while (count64) {
+		asm volatile("vmovdqu %0,%%ymm4\n\t"
+			     "vmovdqu %1,%%ymm5\n\t"
+			     CSUM_AVX2_ADD
+			     : : "m" (buff[0]), "m" (buff[32]));
+		buff += 64;
+		count64--;
+	}
+	result = csum_avx2_fold(result);
+	kernel_fpu_end();
+
+	return result;
+}
+
+/**
+ * csum_copy_to_user_avx2 - Copy and checksum 64-byte blocks to user space.
+ * @src: source address
+ * @dst: destination address (user space), already checked by access_ok()
+ * @count64: number of 64-byte blocks at @src
+ * @sum: checksum to add the blocks copied to
+ *
+ * Returns the number of blocks copied, which is 0 when AVX2 cannot be
+ * used or would not pay off, and less than @count64 when a store to
+ * @dst faulted.  The caller copies whatever is left the usual way.
+ */
+unsigned csum_copy_to_user_avx2(const void *src, void __user *dst,
+				unsigned count64, __wsum *sum)
+{
+	const unsigned char *s = src;
+	unsigned char __user *d = dst;
+	unsigned long result;
+	unsigned done;
+	int fault = 0;
+
+	if (!csum_avx2_usable(count64))
+		return 0;
+
+	/* Faults cannot be handled with the FPU held, just stop instead */
+	pagefault_disable();
+	kernel_fpu_begin();
+	CSUM_AVX2_ZERO;
+	stac();
+	for (done = 0; done < count64; done++) {
+		asm volatile("vmovdqu %[s0],%%ymm4\n\t"
+			     "vmovdqu %[s1],%%ymm5\n"
+			     "1:\tvmovdqu %%ymm4,%[d0]\n"
+			     "2:\tvmovdqu %%ymm5,%[d1]\n\t"
+			     CSUM_AVX2_ADD
+			     "3:\n"
+			     ".section .fixup,\"ax\"\n"
+			     "4:\tmovl $1,%[fault]\n\t"
+			     "jmp 3b\n"
+			     ".previous\n"
+			     _ASM_EXTABLE(1b, 4b)
+			     _ASM_EXTABLE(2b, 4b)
+			     : [fault] "+r" (fault),
+			       [d0] "=m" (*(unsigned char __force *)d),
+			       [d1] "=m" (*(unsigned char __force *)(d + 32))
+			     : [s0] "m" (s[0]), [s1] "m" (s[32]));
+		if (unlikely(fault))
+			break;
+		s += 64;
+		d += 64;
+	}
+	clac();
+	result = csum_avx2_fold((__force u32)*sum);
+	kernel_fpu_end();
+	pagefault_enable();
+
+	*sum = (__force __wsum)add32_with_carry(result >> 32,
+						result & 0xffffffff);
+
+	return done;
+}
+
 /*
  * Do a 64-bit checksum on an arbitrary memory area.
  * Returns a 32bit checksum.
@@ -67,6 +213,12 @@ static unsigned do_csum(const unsigned char *buff, unsigned len)
 			/* main loop using 64byte blocks */
 			zero = 0;
 			count64 = count >> 3;
+			if (csum_avx2_usable(count64)) {
+				result = csum_blocks_avx2(buff, count64,
+							  result);
+				buff += count64 * 64;
+				count64 = 0;
+			}
 			while (count64) { 
 				asm("addq 0*8(%[src]),%[res]\n\t"
 				    "adcq 1*8(%[src]),%[res]\n\t"
@@ -109,6 +109,17 @@ csum_partial_copy_to_user(const void *src, void __user *dst,
 	}
 
 	*errp = 0;
+
+	/* Large buffers copy and sum 64 bytes at a time with AVX2 */
+	if (len >= 64) {
+		unsigned done = csum_copy_to_user_avx2(src, dst, len / 64,
+						       &isum);
+
+		src += done * 64;
+		dst += done * 64;
+		len -= done * 64;
+	}
+
 	stac();
 	ret = csum_partial_copy_generic(src, (void __force *)dst,
 					len, isum, NULL, errp);
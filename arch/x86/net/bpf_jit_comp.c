@@ -11,7 +11,9 @@
 #include <linux/netdevice.h>
 #include <linux/filter.h>
 #include <linux/if_vlan.h>
+#include <linux/memory.h>
 #include <asm/cacheflush.h>
+#include <asm/alternative.h>
 #include <linux/bpf.h>
 
 int bpf_jit_enable __read_mostly;
@@ -182,8 +184,63 @@ static void jit_fill_hole(void *area, unsigned int size)
 struct jit_context {
 	int cleanup_addr; /* epilogue code offset */
 	bool seen_ld_abs;
+	unsigned long *jmp_targets; /* bitmap of insns that are jumped to */
 };
 
+/* x64 clears the upper half of a register on every 32-bit write. Is insn
+ * emitted as such a write to its dst_reg?
+ */
+static bool insn_is_zext(const struct bpf_insn *insn)
+{
+	switch (BPF_CLASS(insn->code)) {
+	case BPF_ALU:
+		/* all of them but the 64-bit byte swaps */
+		return BPF_OP(insn->code) != BPF_END || insn->imm != 64;
+	case BPF_ALU64:
+		/* JITed as 32-bit ops, see do_jit() */
+		return BPF_SRC(insn->code) == BPF_K && insn->imm >= 0 &&
+		       (BPF_OP(insn->code) == BPF_MOV ||
+			BPF_OP(insn->code) == BPF_AND);
+	case BPF_LDX:
+		return BPF_MODE(insn->code) == BPF_MEM &&
+		       BPF_SIZE(insn->code) != BPF_DW;
+	}
+	return false;
+}
+
+/* is the upper half of 'reg' known to be zero when insn 'i' starts?
+ * Only the previous insn is looked at, and only if nothing jumps to 'i'
+ */
+static bool upper_half_zero(const struct bpf_prog *bpf_prog, int i, u32 reg,
+			    const struct jit_context *ctx)
+{
+	const struct bpf_insn *prev;
+
+	if (i == 0 || test_bit(i, ctx->jmp_targets))
+		return false;
+
+	prev = &bpf_prog->insnsi[i - 1];
+	return prev->dst_reg == reg && insn_is_zext(prev);
+}
+
+/* 'dst <<= 32; dst >>= 32' is how LLVM zero-extends a u32 kept in a 64-bit
+ * register. Such a pair starting at insn 'i' is JITed as a single
+ * 'mov dst32, dst32', or as nothing when the upper half is already zero
+ */
+static bool is_zext_pair(const struct bpf_prog *bpf_prog, int i,
+			 const struct jit_context *ctx)
+{
+	const struct bpf_insn *insn = &bpf_prog->insnsi[i];
+
+	return i + 1 < bpf_prog->len &&
+	       insn[0].code == (BPF_ALU64 | BPF_LSH | BPF_K) &&
+	       insn[0].imm == 32 &&
+	       insn[1].code == (BPF_ALU64 | BPF_RSH | BPF_K) &&
+	       insn[1].imm == 32 &&
+	       insn[1].dst_reg == insn[0].dst_reg &&
+	       !test_bit(i + 1, ctx->jmp_targets);
+}
+
 /* maximum number of bytes emitted while JITing one eBPF insn */
 #define BPF_MAX_INSN_SIZE	128
 #define BPF_INSN_SAFETY		64
@@ -315,6 +372,119 @@ static void emit_bpf_tail_call(u8 **pprog)
 	*pprog = prog;
 }
 
+/* bpf_tail_call() site the verifier found to always use the same slot of
+ * the same prog_array (see struct bpf_jit_poke_descriptor). The index is
+ * known to be in range, and instead of loading the slot the code jumps
+ * through a patchable 'jmp rel32'. bpf_arch_poke_tail_call() points it at
+ * the body of the program in the slot, or at 'out' while the slot is
+ * empty. Until the program is tracked, and for cpus that hit the int3 of
+ * an update in progress, it jumps to the indirect sequence after it:
+ *
+ *   if (tail_call_cnt > MAX_TAIL_CALL_CNT)
+ *     goto out;
+ *   tail_call_cnt++;
+ *   goto slot;		// patched to 'goto target' or 'goto out'
+ * slot:
+ *   prog = array->ptrs[index];
+ *   if (prog == NULL)
+ *     goto out;
+ *   goto *(prog->bpf_func + prologue_size);
+ * out:
+ *
+ * 'ip' is where the code for this insn goes in the image, NULL while
+ * the image size is still being computed
+ */
+static void emit_bpf_tail_call_direct(u8 **pprog,
+				      struct bpf_jit_poke_descriptor *poke,
+				      u8 *ip)
+{
+	u8 *prog = *pprog;
+	int label1, label2, slot;
+	int cnt = 0;
+
+	/* if (tail_call_cnt > MAX_TAIL_CALL_CNT)
+	 *   goto out;
+	 */
+	EMIT2_off32(0x8B, 0x85, -STACKSIZE + 36); /* mov eax, dword ptr [rbp - 516] */
+	EMIT3(0x83, 0xF8, MAX_TAIL_CALL_CNT);     /* cmp eax, MAX_TAIL_CALL_CNT */
+#define OFFSET4 41
+	EMIT2(X86_JA, OFFSET4);                   /* ja out */
+	label1 = cnt;
+	EMIT3(0x83, 0xC0, 0x01);                  /* add eax, 1 */
+	EMIT2_off32(0x89, 0x85, -STACKSIZE + 36); /* mov dword ptr [rbp - 516], eax */
+
+	slot = cnt;
+	EMIT1_off32(0xE9, 0);                     /* jmp .+0, patched later */
+
+	/* prog = array->ptrs[index]; */
+	EMIT4_off32(0x48, 0x8D, 0x84, 0xD6,       /* lea rax, [rsi + rdx * 8 + offsetof(...)] */
+		    offsetof(struct bpf_array, ptrs));
+	EMIT3(0x48, 0x8B, 0x00);                  /* mov rax, qword ptr [rax] */
+
+	/* if (prog == NULL)
+	 *   goto out;
+	 */
+	EMIT4(0x48, 0x83, 0xF8, 0x00);            /* cmp rax, 0 */
+	EMIT2(X86_JE, OFFSET3);                   /* je out */
+	label2 = cnt;
+
+	/* goto *(prog->bpf_func + prologue_size); */
+	EMIT4(0x48, 0x8B, 0x40,                   /* mov rax, qword ptr [rax + 32] */
+	      offsetof(struct bpf_prog, bpf_func));
+	EMIT4(0x48, 0x83, 0xC0, PROLOGUE_SIZE);   /* add rax, prologue_size */
+	EMIT2(0xFF, 0xE0);                        /* jmp rax */
+
+	/* out: */
+	BUILD_BUG_ON(cnt - label1 != OFFSET4);
+	BUILD_BUG_ON(cnt - label2 != OFFSET3);
+
+	if (ip) {
+		poke->ip = ip + slot;
+		poke->bypass_addr = ip + cnt;
+	}
+	*pprog = prog;
+}
+
+/* called with the slot of a direct tail call site updated, see above.
+ * Entries of a prog_array are JITed whenever its users are, so the target
+ * always has a body to jump to
+ */
+void bpf_arch_poke_tail_call(struct bpf_jit_poke_descriptor *poke,
+			     struct bpf_prog *target)
+{
+	u8 *ip = poke->ip;
+	u8 *dest;
+	u8 insn[5];
+
+	if (target)
+		dest = (u8 *)target->bpf_func + PROLOGUE_SIZE;
+	else
+		dest = poke->bypass_addr;
+
+	insn[0] = 0xE9;
+	*(s32 *)(insn + 1) = dest - (ip + sizeof(insn));
+
+	/* the site may be running on other cpus. The ones that trap on the
+	 * temporary int3 resume at the indirect sequence behind it, which
+	 * sees either the old or the new slot content
+	 */
+	mutex_lock(&text_mutex);
+	text_poke_bp(ip, insn, sizeof(insn), ip + sizeof(insn));
+	mutex_unlock(&text_mutex);
+}
+
+static struct bpf_jit_poke_descriptor *
+find_poke_descriptor(const struct bpf_prog *bpf_prog, int insn_idx)
+{
+	const struct bpf_prog_aux *aux = bpf_prog->aux;
+	u32 i;
+
+	for (i = 0; i < aux->size_poke_tab; i++)
+		if (aux->poke_tab[i].insn_idx == insn_idx)
+			return &aux->poke_tab[i];
+	return NULL;
+}
+
 
 static void emit_load_skb_data_hlen(u8 **pprog)
 {
@@ -359,6 +529,7 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		u8 b1 = 0, b2 = 0, b3 = 0;
 		s64 jmp_offset;
 		u8 jmp_cond;
+		struct bpf_jit_poke_descriptor *poke;
 		bool reload_skb_data;
 		int ilen;
 		u8 *func;
@@ -421,7 +592,12 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		case BPF_ALU64 | BPF_AND | BPF_K:
 		case BPF_ALU64 | BPF_OR | BPF_K:
 		case BPF_ALU64 | BPF_XOR | BPF_K:
-			if (BPF_CLASS(insn->code) == BPF_ALU64)
+			/* optimization: 'and eax, imm32' clears the upper
+			 * half just like 'and rax, imm32' does for a positive
+			 * imm32, and needs no REX.W prefix
+			 */
+			if (BPF_CLASS(insn->code) == BPF_ALU64 &&
+			    !(BPF_OP(insn->code) == BPF_AND && imm32 >= 0))
 				EMIT1(add_1mod(0x48, dst_reg));
 			else if (is_ereg(dst_reg))
 				EMIT1(add_1mod(0x40, dst_reg));
@@ -455,6 +631,16 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 			}
 
 		case BPF_ALU | BPF_MOV | BPF_K:
+			/* 'xor eax, eax' is 3 bytes shorter and zero-extends
+			 * as well
+			 */
+			if (imm32 == 0) {
+				if (is_ereg(dst_reg))
+					EMIT1(add_2mod(0x40, dst_reg, dst_reg));
+				EMIT2(0x31, add_2reg(0xC0, dst_reg, dst_reg));
+				break;
+			}
+
 			/* mov %eax, imm32 */
 			if (is_ereg(dst_reg))
 				EMIT1(add_1mod(0x40, dst_reg));
@@ -493,6 +679,9 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 			if (BPF_SRC(insn->code) == BPF_X)
 				/* mov r11, src_reg */
 				EMIT_mov(AUX_REG, src_reg);
+			else if (BPF_CLASS(insn->code) == BPF_ALU)
+				/* mov r11d, imm32 */
+				EMIT2_off32(0x41, 0xBB, imm32);
 			else
 				/* mov r11, imm32 */
 				EMIT3_off32(0x49, 0xC7, 0xC3, imm32);
@@ -559,6 +748,9 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 			if (BPF_SRC(insn->code) == BPF_X)
 				/* mov rax, src_reg */
 				EMIT_mov(BPF_REG_0, src_reg);
+			else if (BPF_CLASS(insn->code) == BPF_ALU)
+				/* mov eax, imm32 */
+				EMIT1_off32(0xB8, imm32);
 			else
 				/* mov rax, imm32 */
 				EMIT3_off32(0x48, 0xC7, 0xC0, imm32);
@@ -587,6 +779,19 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		case BPF_ALU64 | BPF_LSH | BPF_K:
 		case BPF_ALU64 | BPF_RSH | BPF_K:
 		case BPF_ALU64 | BPF_ARSH | BPF_K:
+			if (is_zext_pair(bpf_prog, i, ctx)) {
+				/* mov dst32, dst32 */
+				if (upper_half_zero(bpf_prog, i, dst_reg, ctx))
+					break;
+				if (is_ereg(dst_reg))
+					EMIT1(add_2mod(0x40, dst_reg, dst_reg));
+				EMIT2(0x89, add_2reg(0xC0, dst_reg, dst_reg));
+				break;
+			}
+			if (i > 0 && is_zext_pair(bpf_prog, i - 1, ctx))
+				/* rsh half of the pair, already done */
+				break;
+
 			if (BPF_CLASS(insn->code) == BPF_ALU64)
 				EMIT1(add_1mod(0x48, dst_reg));
 			else if (is_ereg(dst_reg))
@@ -687,7 +892,11 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 				EMIT1(add_2reg(0xC0, dst_reg, dst_reg));
 				break;
 			case 32:
-				/* emit 'mov eax, eax' to clear upper 32-bits */
+				/* emit 'mov eax, eax' to clear upper 32-bits,
+				 * unless the previous insn did that already
+				 */
+				if (upper_half_zero(bpf_prog, i, dst_reg, ctx))
+					break;
 				if (is_ereg(dst_reg))
 					EMIT1(0x45);
 				EMIT2(0x89, add_2reg(0xC0, dst_reg, dst_reg));
@@ -842,7 +1051,13 @@ xadd:			if (is_imm8(insn->off))
 			break;
 
 		case BPF_JMP | BPF_CALL | BPF_X:
-			emit_bpf_tail_call(&prog);
+			poke = find_poke_descriptor(bpf_prog, i);
+			if (poke)
+				emit_bpf_tail_call_direct(&prog, poke,
+							  image ? image + proglen +
+							  (prog - temp) : NULL);
+			else
+				emit_bpf_tail_call(&prog);
 			break;
 
 			/* cond jump */
@@ -1063,6 +1278,23 @@ void bpf_int_jit_compile(struct bpf_prog *prog)
 	if (!addrs)
 		return;
 
+	ctx.jmp_targets = kcalloc(BITS_TO_LONGS(prog->len), sizeof(long),
+				  GFP_KERNEL);
+	if (!ctx.jmp_targets)
+		goto out;
+
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &prog->insnsi[i];
+		int target = i + insn->off + 1;
+
+		if (BPF_CLASS(insn->code) != BPF_JMP ||
+		    BPF_OP(insn->code) == BPF_CALL ||
+		    BPF_OP(insn->code) == BPF_EXIT)
+			continue;
+		if (target >= 0 && target < prog->len)
+			__set_bit(target, ctx.jmp_targets);
+	}
+
 	/* Before first pass, make a rough estimation of addrs[]
 	 * each bpf instruction is translated to less than 64 bytes
 	 */
@@ -1112,6 +1344,7 @@ void bpf_int_jit_compile(struct bpf_prog *prog)
 		prog->jited = 1;
 	}
 out:
+	kfree(ctx.jmp_targets);
 	kfree(addrs);
 }
 
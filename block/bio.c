@@ -28,6 +28,10 @@
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
 #include <linux/cgroup.h>
+#include <linux/blk-cgroup.h>
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <trace/events/block.h>
 
@@ -37,6 +41,12 @@
  */
 #define BIO_INLINE_VECS		4
 
+/*
+ * Upper bound on the number of freed bios each cpu keeps around for a
+ * bio_set with a per-cpu cache; anything beyond goes back to the mempool.
+ */
+#define BIO_ALLOC_CACHE_MAX	256
+
 /*
  * if you change this list, also change bvec_alloc or things will
  * break badly! cannot be bigger than what you can fit into an
@@ -242,6 +252,84 @@ static void __bio_free(struct bio *bio)
 		bio_integrity_free(bio);
 }
 
+/*
+ * Biosets with a per-cpu cache, so cpu hotplug can find caches to drain.
+ */
+static DEFINE_MUTEX(bio_cache_lock);
+static LIST_HEAD(bio_cache_sets);
+
+/*
+ * The cache is only touched by the local cpu, with interrupts disabled
+ * since bios complete from irq context, so no locking is needed.
+ */
+static void *bio_cache_get(struct bio_set *bs)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	struct bio *bio;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	bio = cache->free_list;
+	if (bio) {
+		cache->free_list = bio->bi_next;
+		cache->nr--;
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	local_irq_restore(flags);
+
+	return bio ? (void *)bio - bs->front_pad : NULL;
+}
+
+static bool bio_cache_put(struct bio_set *bs, struct bio *bio)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	bool cached = false;
+
+	/*
+	 * If the mempool had to dip into its reserve, refill that first so
+	 * we never hold on to the elements that guarantee forward progress.
+	 */
+	if (READ_ONCE(bs->bio_pool->curr_nr) < bs->bio_pool->min_nr)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (cache->nr < BIO_ALLOC_CACHE_MAX) {
+		bio->bi_next = cache->free_list;
+		cache->free_list = bio;
+		cache->nr++;
+		cache->recycled++;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	return cached;
+}
+
+static void bio_cache_drain(struct bio_set *bs, unsigned int cpu)
+{
+	struct bio_alloc_cache *cache = per_cpu_ptr(bs->cache, cpu);
+	unsigned long flags;
+	struct bio *bio;
+
+	local_irq_save(flags);
+	bio = cache->free_list;
+	cache->free_list = NULL;
+	cache->nr = 0;
+	local_irq_restore(flags);
+
+	while (bio) {
+		struct bio *next = bio->bi_next;
+
+		mempool_free((void *)bio - bs->front_pad, bs->bio_pool);
+		bio = next;
+	}
+}
+
 static void bio_free(struct bio *bio)
 {
 	struct bio_set *bs = bio->bi_pool;
@@ -253,6 +341,9 @@ static void bio_free(struct bio *bio)
 		if (bio_flagged(bio, BIO_OWNS_VEC))
 			bvec_free(bs->bvec_pool, bio->bi_io_vec, BIO_POOL_IDX(bio));
 
+		if (bs->cache && bio_cache_put(bs, bio))
+			return;
+
 		/*
 		 * If we have front padding, adjust the bio pointer before freeing
 		 */
@@ -467,7 +558,9 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, int nr_iovecs, struct bio_set *bs)
 		if (current->bio_list && !bio_list_empty(current->bio_list))
 			gfp_mask &= ~__GFP_DIRECT_RECLAIM;
 
-		p = mempool_alloc(bs->bio_pool, gfp_mask);
+		p = bs->cache ? bio_cache_get(bs) : NULL;
+		if (!p)
+			p = mempool_alloc(bs->bio_pool, gfp_mask);
 		if (!p && gfp_mask != saved_gfp) {
 			punt_bios_to_rescuer(bs);
 			gfp_mask = saved_gfp;
@@ -1750,6 +1843,8 @@ void bio_endio(struct bio *bio)
 		if (unlikely(!bio_remaining_done(bio)))
 			break;
 
+		blk_throtl_bio_endio(bio);
+
 		/*
 		 * Need to have a real endio function for chained bios,
 		 * otherwise various corner cases will break (like stacking
@@ -1854,6 +1949,18 @@ mempool_t *biovec_create_pool(int pool_entries)
 
 void bioset_free(struct bio_set *bs)
 {
+	if (bs->cache) {
+		unsigned int cpu;
+
+		mutex_lock(&bio_cache_lock);
+		list_del(&bs->cache_list);
+		mutex_unlock(&bio_cache_lock);
+
+		for_each_possible_cpu(cpu)
+			bio_cache_drain(bs, cpu);
+		free_percpu(bs->cache);
+	}
+
 	if (bs->rescue_workqueue)
 		destroy_workqueue(bs->rescue_workqueue);
 
@@ -1947,6 +2054,107 @@ struct bio_set *bioset_create_nobvec(unsigned int pool_size, unsigned int front_
 }
 EXPORT_SYMBOL(bioset_create_nobvec);
 
+/**
+ * bioset_enable_percpu_cache - recycle freed bios through per-cpu lists
+ * @bs:		bio_set to enable the cache for
+ *
+ * Description:
+ *    Freed bios of @bs are stashed on a per-cpu list instead of going back
+ *    through the mempool and slab, and bio_alloc_bioset() takes them from
+ *    there first. Meant for high rate users where most bios complete on the
+ *    cpu that submitted them. Must be called before @bs is used.
+ */
+int bioset_enable_percpu_cache(struct bio_set *bs)
+{
+	bs->cache = alloc_percpu(struct bio_alloc_cache);
+	if (!bs->cache)
+		return -ENOMEM;
+
+	mutex_lock(&bio_cache_lock);
+	list_add(&bs->cache_list, &bio_cache_sets);
+	mutex_unlock(&bio_cache_lock);
+	return 0;
+}
+EXPORT_SYMBOL(bioset_enable_percpu_cache);
+
+/**
+ * bioset_cache_stats - sum up the per-cpu cache counters of a bio_set
+ * @bs:		bio_set to report on
+ * @stats:	filled in with the number of cached bios, allocations served
+ *		from (hits) and missing (misses) the cache, and frees recycled
+ */
+void bioset_cache_stats(struct bio_set *bs, struct bio_cache_stats *stats)
+{
+	unsigned int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!bs->cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct bio_alloc_cache *cache = per_cpu_ptr(bs->cache, cpu);
+
+		stats->cached += READ_ONCE(cache->nr);
+		stats->hits += READ_ONCE(cache->hits);
+		stats->misses += READ_ONCE(cache->misses);
+		stats->recycled += READ_ONCE(cache->recycled);
+	}
+}
+EXPORT_SYMBOL(bioset_cache_stats);
+
+static int bio_cache_cpu_notify(struct notifier_block *self,
+				unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	struct bio_set *bs;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN) {
+		mutex_lock(&bio_cache_lock);
+		list_for_each_entry(bs, &bio_cache_sets, cache_list)
+			bio_cache_drain(bs, cpu);
+		mutex_unlock(&bio_cache_lock);
+	}
+
+	return NOTIFY_OK;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int bio_cache_show(struct seq_file *m, void *v)
+{
+	struct bio_cache_stats stats;
+	struct bio_set *bs;
+
+	mutex_lock(&bio_cache_lock);
+	list_for_each_entry(bs, &bio_cache_sets, cache_list) {
+		bioset_cache_stats(bs, &stats);
+		seq_printf(m, "%pK%s: cached %u hits %lu misses %lu recycled %lu\n",
+			   bs, bs == fs_bio_set ? " (fs)" : "", stats.cached,
+			   stats.hits, stats.misses, stats.recycled);
+	}
+	mutex_unlock(&bio_cache_lock);
+	return 0;
+}
+
+static int bio_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bio_cache_show, NULL);
+}
+
+static const struct file_operations bio_cache_fops = {
+	.open		= bio_cache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init bio_cache_debugfs(void)
+{
+	debugfs_create_file("bio_cache", S_IRUSR, NULL, NULL, &bio_cache_fops);
+	return 0;
+}
+late_initcall(bio_cache_debugfs);
+#endif /* CONFIG_DEBUG_FS */
+
 #ifdef CONFIG_BLK_CGROUP
 
 /**
@@ -2068,6 +2276,13 @@ static int __init init_bio(void)
 	if (bioset_integrity_create(fs_bio_set, BIO_POOL_SIZE))
 		panic("bio: can't create integrity pool\n");
 
+	/*
+	 * Direct IO and most filesystems allocate from fs_bio_set, so it's
+	 * where the cache pays off. Failing to set it up isn't fatal.
+	 */
+	bioset_enable_percpu_cache(fs_bio_set);
+	hotcpu_notifier(bio_cache_cpu_notify, 0);
+
 	return 0;
 }
 subsys_initcall(init_bio);
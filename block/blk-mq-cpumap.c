@@ -9,6 +9,7 @@
 #include <linux/mm.h>
 #include <linux/smp.h>
 #include <linux/cpu.h>
+#include <linux/interrupt.h>
 
 #include <linux/blk-mq.h>
 #include "blk.h"
@@ -86,6 +87,116 @@ int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues,
 	return 0;
 }
 
+/*
+ * Pick the least loaded queue whose interrupt is affine to @cpu, or failing
+ * that one whose interrupt lands on the same node, or failing that any.
+ */
+static unsigned int irq_map_pick_queue(unsigned int cpu, unsigned int nr_queues,
+				       struct cpumask *masks, unsigned int *load)
+{
+	int node = cpu_to_node(cpu);
+	int best = -1, best_node = -1, best_any = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_queues; i++) {
+		struct cpumask *mask = (void *)masks + i * cpumask_size();
+
+		if (cpumask_test_cpu(cpu, mask)) {
+			if (best < 0 || load[i] < load[best])
+				best = i;
+		} else if (cpumask_intersects(mask, cpumask_of_node(node))) {
+			if (best_node < 0 || load[i] < load[best_node])
+				best_node = i;
+		}
+		if (load[i] < load[best_any])
+			best_any = i;
+	}
+
+	if (best >= 0)
+		return best;
+	if (best_node >= 0)
+		return best_node;
+	return best_any;
+}
+
+/*
+ * Map each cpu to a hardware queue whose completion interrupt is affine to
+ * it, so the completion doesn't have to cross to another cpu or socket.
+ * With fewer vectors than cpus, the remaining cpus share the queues of
+ * their thread siblings or of their NUMA node. Fails if no interrupt has
+ * a usable affinity yet, e.g. they all still have the default mask.
+ */
+static int blk_mq_irq_update_queue_map(struct blk_mq_tag_set *set,
+				       unsigned int *map,
+				       const struct cpumask *online_mask)
+{
+	unsigned int nr_queues = set->nr_hw_queues;
+	unsigned int i, cpu, first_sibling;
+	struct cpumask *masks;
+	unsigned int *load;
+	bool useful = false;
+	int ret = -EINVAL;
+
+	masks = kcalloc(nr_queues, cpumask_size(), GFP_ATOMIC);
+	load = kcalloc(nr_queues, sizeof(*load), GFP_ATOMIC);
+	if (!masks || !load) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr_queues; i++) {
+		struct cpumask *mask = (void *)masks + i * cpumask_size();
+		int irq = set->ops->queue_irq(set, i);
+
+		if (irq < 0 || irq_get_affinity(irq, mask))
+			continue;
+		cpumask_and(mask, mask, online_mask);
+		if (!cpumask_empty(mask) && !cpumask_equal(mask, online_mask))
+			useful = true;
+	}
+	if (!useful)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		if (!cpumask_test_cpu(cpu, online_mask)) {
+			map[cpu] = 0;
+			continue;
+		}
+
+		map[cpu] = irq_map_pick_queue(cpu, nr_queues, masks, load);
+
+		/*
+		 * Not directly covered by any vector: prefer the queue of an
+		 * already mapped thread sibling, they share their caches.
+		 */
+		first_sibling = get_first_sibling(cpu);
+		if (first_sibling < cpu &&
+		    cpumask_test_cpu(first_sibling, online_mask)) {
+			struct cpumask *mask = (void *)masks +
+						map[cpu] * cpumask_size();
+
+			if (!cpumask_test_cpu(cpu, mask))
+				map[cpu] = map[first_sibling];
+		}
+		load[map[cpu]]++;
+	}
+	ret = 0;
+out:
+	kfree(load);
+	kfree(masks);
+	return ret;
+}
+
+int blk_mq_map_queues(struct blk_mq_tag_set *set, unsigned int *map,
+		      const struct cpumask *online_mask)
+{
+	if (set->ops->queue_irq &&
+	    !blk_mq_irq_update_queue_map(set, map, online_mask))
+		return 0;
+
+	return blk_mq_update_queue_map(map, set->nr_hw_queues, online_mask);
+}
+
 unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 {
 	unsigned int *map;
@@ -96,7 +207,7 @@ unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 	if (!map)
 		return NULL;
 
-	if (!blk_mq_update_queue_map(map, set->nr_hw_queues, cpu_online_mask))
+	if (!blk_mq_map_queues(set, map, cpu_online_mask))
 		return map;
 
 	kfree(map);
@@ -0,0 +1,273 @@
+/*
+ * Per hardware queue latency and dispatch statistics in debugfs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/blktrace_api.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include <linux/blk-mq.h>
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-debugfs.h"
+#include "blk-stat.h"
+
+static const char *const blk_mq_lat_names[BLK_MQ_LAT_NR] = {
+	[BLK_MQ_LAT_READ]	= "read",
+	[BLK_MQ_LAT_WRITE]	= "write",
+	[BLK_MQ_LAT_FLUSH]	= "flush",
+};
+
+static int blk_mq_lat_type(struct request *rq)
+{
+	if (rq->cmd_flags & REQ_FLUSH)
+		return BLK_MQ_LAT_FLUSH;
+	return rq_data_dir(rq) ? BLK_MQ_LAT_WRITE : BLK_MQ_LAT_READ;
+}
+
+static unsigned int blk_mq_lat_bucket(u64 nsecs)
+{
+	return min_t(unsigned int, fls64(div_u64(nsecs, NSEC_PER_USEC)),
+		     BLK_MQ_LAT_BUCKETS - 1);
+}
+
+void __blk_mq_debugfs_rq_issue(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	u64 issue = blk_stat_time(&rq->issue_stat);
+	u64 alloc = __blk_stat_time(rq->alloc_time_ns);
+
+	if (issue < alloc)
+		return;
+	this_cpu_inc(hctx->stats->queue_lat[blk_mq_lat_type(rq)]
+				[blk_mq_lat_bucket(issue - alloc)]);
+}
+
+void __blk_mq_debugfs_rq_done(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	u64 now = __blk_stat_time(ktime_get_ns());
+	u64 issue = blk_stat_time(&rq->issue_stat);
+
+	if (now < issue)
+		return;
+	this_cpu_inc(hctx->stats->issue_lat[blk_mq_lat_type(rq)]
+				[blk_mq_lat_bucket(now - issue)]);
+}
+
+static void blk_mq_lat_show(struct seq_file *m, struct blk_mq_hw_ctx *hctx,
+			    const char *what, size_t offset)
+{
+	unsigned long sum[BLK_MQ_LAT_BUCKETS];
+	int type, bucket, cpu;
+
+	for (type = 0; type < BLK_MQ_LAT_NR; type++) {
+		memset(sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			void *stats = per_cpu_ptr(hctx->stats, cpu);
+			unsigned long (*lat)[BLK_MQ_LAT_BUCKETS] = stats + offset;
+
+			for (bucket = 0; bucket < BLK_MQ_LAT_BUCKETS; bucket++)
+				sum[bucket] += lat[type][bucket];
+		}
+
+		seq_printf(m, "%s %s\n", what, blk_mq_lat_names[type]);
+		for (bucket = 0; bucket < BLK_MQ_LAT_BUCKETS; bucket++) {
+			if (!sum[bucket])
+				continue;
+			if (bucket == BLK_MQ_LAT_BUCKETS - 1)
+				seq_printf(m, "\t>=%luus\t%lu\n",
+					   1UL << (bucket - 1), sum[bucket]);
+			else
+				seq_printf(m, "\t<%luus\t%lu\n",
+					   1UL << bucket, sum[bucket]);
+		}
+	}
+}
+
+static int blk_mq_latency_show(struct seq_file *m, void *v)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+
+	blk_mq_lat_show(m, hctx, "queue_to_dispatch",
+			offsetof(struct blk_mq_hctx_stats, queue_lat));
+	blk_mq_lat_show(m, hctx, "dispatch_to_complete",
+			offsetof(struct blk_mq_hctx_stats, issue_lat));
+	return 0;
+}
+
+static int blk_mq_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, blk_mq_latency_show, inode->i_private);
+}
+
+/*
+ * Any write clears the histograms.
+ */
+static ssize_t blk_mq_latency_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct blk_mq_hw_ctx *hctx = m->private;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_hctx_stats *stats = per_cpu_ptr(hctx->stats, cpu);
+
+		memset(stats->queue_lat, 0, sizeof(stats->queue_lat));
+		memset(stats->issue_lat, 0, sizeof(stats->issue_lat));
+	}
+	return count;
+}
+
+static const struct file_operations blk_mq_latency_fops = {
+	.open		= blk_mq_latency_open,
+	.read		= seq_read,
+	.write		= blk_mq_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int blk_mq_dispatch_batch_show(struct seq_file *m, void *v)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+	int i;
+
+	seq_printf(m, "%8u\t%lu\n", 0U, hctx->dispatched[0]);
+	for (i = 1; i < BLK_MQ_MAX_DISPATCH_ORDER; i++)
+		seq_printf(m, "%8u\t%lu\n", 1U << (i - 1), hctx->dispatched[i]);
+	return 0;
+}
+
+static int blk_mq_dispatch_batch_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, blk_mq_dispatch_batch_show, inode->i_private);
+}
+
+static const struct file_operations blk_mq_dispatch_batch_fops = {
+	.open		= blk_mq_dispatch_batch_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int blk_mq_tag_waits_show(struct seq_file *m, void *v)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+	unsigned long waits = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		waits += per_cpu_ptr(hctx->stats, cpu)->tag_waits;
+	seq_printf(m, "%lu\n", waits);
+	return 0;
+}
+
+static int blk_mq_tag_waits_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, blk_mq_tag_waits_show, inode->i_private);
+}
+
+static const struct file_operations blk_mq_tag_waits_fops = {
+	.open		= blk_mq_tag_waits_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int blk_mq_debugfs_register_hctx(struct request_queue *q,
+					struct blk_mq_hw_ctx *hctx)
+{
+	char name[20];
+
+	/*
+	 * The stats outlive the debugfs files, requests may still complete
+	 * after the disk is unregistered. They're freed with the queue.
+	 */
+	if (!hctx->stats) {
+		hctx->stats = alloc_percpu(struct blk_mq_hctx_stats);
+		if (!hctx->stats)
+			return -ENOMEM;
+	}
+
+	snprintf(name, sizeof(name), "hctx%u", hctx->queue_num);
+	hctx->debugfs_dir = debugfs_create_dir(name, q->debugfs_dir);
+	if (!hctx->debugfs_dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency", S_IRUSR | S_IWUSR,
+				 hctx->debugfs_dir, hctx, &blk_mq_latency_fops) ||
+	    !debugfs_create_file("dispatch_batch", S_IRUSR, hctx->debugfs_dir,
+				 hctx, &blk_mq_dispatch_batch_fops) ||
+	    !debugfs_create_file("tag_waits", S_IRUSR, hctx->debugfs_dir,
+				 hctx, &blk_mq_tag_waits_fops))
+		return -ENOMEM;
+
+	return 0;
+}
+
+int blk_mq_debugfs_register(struct request_queue *q, const char *name)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	if (!blk_debugfs_root)
+		return -ENOENT;
+
+	q->debugfs_dir = debugfs_create_dir(name, blk_debugfs_root);
+	if (!q->debugfs_dir)
+		return -ENOMEM;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (blk_mq_debugfs_register_hctx(q, hctx))
+			goto err;
+	}
+
+	/* The histograms are built from the issue time stamps */
+	blk_stat_enable(q);
+	return 0;
+
+err:
+	blk_mq_debugfs_unregister(q);
+	return -ENOMEM;
+}
+
+void blk_mq_debugfs_unregister(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	/*
+	 * blktrace puts its files for the whole device in our directory,
+	 * so it has to go before the directory does.
+	 */
+	blk_trace_shutdown(q);
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		hctx->debugfs_dir = NULL;
+
+	debugfs_remove_recursive(q->debugfs_dir);
+	q->debugfs_dir = NULL;
+}
+
+void blk_mq_debugfs_free(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!hctx)
+			continue;
+		free_percpu(hctx->stats);
+		hctx->stats = NULL;
+	}
+}
@@ -0,0 +1,98 @@
+#ifndef INT_BLK_MQ_DEBUGFS_H
+#define INT_BLK_MQ_DEBUGFS_H
+
+#include <linux/blk-mq.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+
+#ifdef CONFIG_BLK_DEBUG_FS
+
+/*
+ * Latency buckets are log2 of the latency in usecs: bucket 0 is < 1us,
+ * bucket N is < 2^N us and the last one takes everything slower.
+ */
+#define BLK_MQ_LAT_BUCKETS	24
+
+enum {
+	BLK_MQ_LAT_READ,
+	BLK_MQ_LAT_WRITE,
+	BLK_MQ_LAT_FLUSH,
+	BLK_MQ_LAT_NR,
+};
+
+/*
+ * Kept per-cpu for each hardware queue, so accounting is a plain
+ * increment of a local cacheline.
+ */
+struct blk_mq_hctx_stats {
+	unsigned long	queue_lat[BLK_MQ_LAT_NR][BLK_MQ_LAT_BUCKETS];
+	unsigned long	issue_lat[BLK_MQ_LAT_NR][BLK_MQ_LAT_BUCKETS];
+	unsigned long	tag_waits;
+};
+
+int blk_mq_debugfs_register(struct request_queue *q, const char *name);
+void blk_mq_debugfs_unregister(struct request_queue *q);
+void blk_mq_debugfs_free(struct request_queue *q);
+
+void __blk_mq_debugfs_rq_issue(struct blk_mq_hw_ctx *hctx, struct request *rq);
+void __blk_mq_debugfs_rq_done(struct blk_mq_hw_ctx *hctx, struct request *rq);
+
+static inline void blk_mq_debugfs_rq_init(struct request *rq)
+{
+	rq->alloc_time_ns = ktime_get_ns();
+}
+
+/*
+ * Called with the issue time stamped in rq->issue_stat.
+ */
+static inline void blk_mq_debugfs_rq_issue(struct blk_mq_hw_ctx *hctx,
+					   struct request *rq)
+{
+	if (hctx->stats)
+		__blk_mq_debugfs_rq_issue(hctx, rq);
+}
+
+static inline void blk_mq_debugfs_rq_done(struct blk_mq_hw_ctx *hctx,
+					  struct request *rq)
+{
+	if (hctx->stats)
+		__blk_mq_debugfs_rq_done(hctx, rq);
+}
+
+static inline void blk_mq_debugfs_tag_wait(struct blk_mq_hw_ctx *hctx)
+{
+	if (hctx && hctx->stats)
+		this_cpu_inc(hctx->stats->tag_waits);
+}
+
+#else
+
+static inline int blk_mq_debugfs_register(struct request_queue *q,
+					  const char *name)
+{
+	return 0;
+}
+static inline void blk_mq_debugfs_unregister(struct request_queue *q)
+{
+}
+static inline void blk_mq_debugfs_free(struct request_queue *q)
+{
+}
+static inline void blk_mq_debugfs_rq_init(struct request *rq)
+{
+}
+static inline void blk_mq_debugfs_rq_issue(struct blk_mq_hw_ctx *hctx,
+					   struct request *rq)
+{
+}
+static inline void blk_mq_debugfs_rq_done(struct blk_mq_hw_ctx *hctx,
+					  struct request *rq)
+{
+}
+static inline void blk_mq_debugfs_tag_wait(struct blk_mq_hw_ctx *hctx)
+{
+}
+
+#endif /* CONFIG_BLK_DEBUG_FS */
+
+#endif
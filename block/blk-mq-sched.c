@@ -0,0 +1,129 @@
+/*
+ * blk-mq scheduler glue. Sits between the blk-mq submission path and an
+ * elevator_type with ->uses_mq set.
+ *
+ * Requests handed to the scheduler have already been assigned a driver
+ * tag. Flush, requeue and passthrough requests bypass the scheduler and
+ * are inserted straight into the software queues.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+
+/*
+ * q->elevator is cleared and an RCU grace period observed before a
+ * scheduler is torn down, so callers that are not covered by a queue
+ * usage reference (bio merging happens before we allocate a request)
+ * only need rcu_read_lock() to use it safely.
+ */
+bool blk_mq_sched_bio_merge(struct request_queue *q, struct bio *bio)
+{
+	struct elevator_queue *e;
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	bool ret = false;
+
+	if (!q->elevator || blk_queue_nomerges(q) || !bio_mergeable(bio))
+		return false;
+
+	rcu_read_lock();
+	e = READ_ONCE(q->elevator);
+	if (e && e->type->mq_ops.bio_merge) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+		if (hctx->flags & BLK_MQ_F_SHOULD_MERGE)
+			ret = e->type->mq_ops.bio_merge(hctx, bio);
+		blk_mq_put_ctx(ctx);
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Try to merge @bio into @rq, a candidate the scheduler looked up in its
+ * own data structures. Returns the kind of merge done, or
+ * ELEVATOR_NO_MERGE if @bio couldn't be merged.
+ */
+int blk_mq_sched_try_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	if (!blk_rq_merge_ok(rq, bio))
+		return ELEVATOR_NO_MERGE;
+
+	switch (blk_try_merge(rq, bio)) {
+	case ELEVATOR_BACK_MERGE:
+		if (bio_attempt_back_merge(q, rq, bio))
+			return ELEVATOR_BACK_MERGE;
+		break;
+	case ELEVATOR_FRONT_MERGE:
+		if (bio_attempt_front_merge(q, rq, bio))
+			return ELEVATOR_FRONT_MERGE;
+		break;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_try_merge);
+
+/*
+ * Only called with a queue usage reference held by every request on
+ * @list, so the elevator can't go away under us.
+ */
+void blk_mq_sched_insert_requests(struct blk_mq_hw_ctx *hctx,
+				  struct list_head *list)
+{
+	struct request_queue *q = hctx->queue;
+	struct elevator_queue *e = q->elevator;
+	struct request *rq;
+
+	list_for_each_entry(rq, list, queuelist)
+		trace_block_rq_insert(q, rq);
+
+	e->type->mq_ops.insert_requests(hctx, list);
+}
+
+unsigned int blk_mq_sched_move_to_dispatch(struct blk_mq_hw_ctx *hctx,
+					   struct list_head *list)
+{
+	struct elevator_queue *e;
+	struct request *rq;
+	unsigned int nr = 0;
+
+	rcu_read_lock();
+	e = READ_ONCE(hctx->queue->elevator);
+	if (e) {
+		while (nr < BLK_MQ_SCHED_DISPATCH_BATCH) {
+			rq = e->type->mq_ops.dispatch_request(hctx);
+			if (!rq)
+				break;
+			list_add_tail(&rq->queuelist, list);
+			nr++;
+		}
+	}
+	rcu_read_unlock();
+
+	return nr;
+}
+
+bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e;
+	bool ret = false;
+
+	rcu_read_lock();
+	e = READ_ONCE(hctx->queue->elevator);
+	if (e && e->type->mq_ops.has_work)
+		ret = e->type->mq_ops.has_work(hctx);
+	rcu_read_unlock();
+
+	return ret;
+}
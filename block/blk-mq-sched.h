@@ -0,0 +1,19 @@
+#ifndef BLK_MQ_SCHED_H
+#define BLK_MQ_SCHED_H
+
+/*
+ * Max number of requests pulled out of the scheduler in one go, before
+ * handing them to the driver.
+ */
+#define BLK_MQ_SCHED_DISPATCH_BATCH	32
+
+bool blk_mq_sched_bio_merge(struct request_queue *q, struct bio *bio);
+int blk_mq_sched_try_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio);
+void blk_mq_sched_insert_requests(struct blk_mq_hw_ctx *hctx,
+				  struct list_head *list);
+unsigned int blk_mq_sched_move_to_dispatch(struct blk_mq_hw_ctx *hctx,
+					   struct list_head *list);
+bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx);
+
+#endif
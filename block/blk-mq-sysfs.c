@@ -8,10 +8,13 @@
 #include <linux/slab.h>
 #include <linux/workqueue.h>
 #include <linux/smp.h>
+#include <linux/interrupt.h>
 
 #include <linux/blk-mq.h>
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-stat.h"
+#include "blk-mq-debugfs.h"
 
 static void blk_mq_sysfs_release(struct kobject *kobj)
 {
@@ -176,7 +179,54 @@ static ssize_t blk_mq_sysfs_rq_list_show(struct blk_mq_ctx *ctx, char *page)
 
 static ssize_t blk_mq_hw_sysfs_poll_show(struct blk_mq_hw_ctx *hctx, char *page)
 {
-	return sprintf(page, "invoked=%lu, success=%lu\n", hctx->poll_invoked, hctx->poll_success);
+	return sprintf(page, "considered=%lu, invoked=%lu, success=%lu, slept=%lu\n",
+		       hctx->poll_considered, hctx->poll_invoked,
+		       hctx->poll_success, hctx->poll_slept);
+}
+
+static ssize_t blk_mq_hw_sysfs_poll_store(struct blk_mq_hw_ctx *hctx,
+					  const char *page, size_t size)
+{
+	hctx->poll_considered = hctx->poll_invoked = hctx->poll_success = 0;
+	hctx->poll_slept = 0;
+
+	return size;
+}
+
+static ssize_t print_stat(char *page, struct blk_rq_stat *stat, const char *pre)
+{
+	return sprintf(page, "%s samples=%d, mean=%lld, min=%lld, max=%lld\n",
+			pre, stat->nr_samples,
+			(long long) stat->mean, (long long) stat->min,
+			(long long) stat->max);
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_show(struct blk_mq_hw_ctx *hctx, char *page)
+{
+	struct blk_rq_stat stat[2];
+	ssize_t ret;
+
+	blk_stat_init(&stat[BLK_STAT_READ]);
+	blk_stat_init(&stat[BLK_STAT_WRITE]);
+
+	blk_hctx_stat_get(hctx, stat);
+
+	ret = print_stat(page, &stat[BLK_STAT_READ], "read :");
+	ret += print_stat(page + ret, &stat[BLK_STAT_WRITE], "write:");
+	return ret;
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_store(struct blk_mq_hw_ctx *hctx,
+					  const char *page, size_t count)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	hctx_for_each_ctx(hctx, ctx, i) {
+		blk_stat_init(&ctx->stat[BLK_STAT_READ]);
+		blk_stat_init(&ctx->stat[BLK_STAT_WRITE]);
+	}
+	return count;
 }
 
 static ssize_t blk_mq_hw_sysfs_queued_show(struct blk_mq_hw_ctx *hctx,
@@ -247,6 +297,32 @@ static ssize_t blk_mq_hw_sysfs_cpus_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return ret;
 }
 
+/*
+ * Affinity of the interrupt completing this queue, to compare with cpu_list.
+ */
+static ssize_t blk_mq_hw_sysfs_irq_cpus_show(struct blk_mq_hw_ctx *hctx,
+					     char *page)
+{
+	struct blk_mq_tag_set *set = hctx->queue->tag_set;
+	cpumask_var_t mask;
+	ssize_t ret;
+	int irq;
+
+	if (!set->ops->queue_irq)
+		return -ENOENT;
+	irq = set->ops->queue_irq(set, hctx->queue_num);
+	if (irq < 0)
+		return -ENOENT;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+	ret = irq_get_affinity(irq, mask);
+	if (!ret)
+		ret = sprintf(page, "%*pbl\n", cpumask_pr_args(mask));
+	free_cpumask_var(mask);
+	return ret;
+}
+
 static struct blk_mq_ctx_sysfs_entry blk_mq_sysfs_dispatched = {
 	.attr = {.name = "dispatched", .mode = S_IRUGO },
 	.show = blk_mq_sysfs_dispatched_show,
@@ -300,9 +376,19 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_cpus = {
 	.attr = {.name = "cpu_list", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_cpus_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_irq_cpus = {
+	.attr = {.name = "irq_cpu_list", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_irq_cpus_show,
+};
 static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
-	.attr = {.name = "io_poll", .mode = S_IRUGO },
+	.attr = {.name = "io_poll", .mode = S_IWUSR | S_IRUGO },
 	.show = blk_mq_hw_sysfs_poll_show,
+	.store = blk_mq_hw_sysfs_poll_store,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_stat = {
+	.attr = {.name = "stats", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_mq_hw_sysfs_stat_show,
+	.store = blk_mq_hw_sysfs_stat_store,
 };
 
 static struct attribute *default_hw_ctx_attrs[] = {
@@ -312,8 +398,10 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_pending.attr,
 	&blk_mq_hw_sysfs_tags.attr,
 	&blk_mq_hw_sysfs_cpus.attr,
+	&blk_mq_hw_sysfs_irq_cpus.attr,
 	&blk_mq_hw_sysfs_active.attr,
 	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_stat.attr,
 	NULL,
 };
 
@@ -404,6 +492,8 @@ void blk_mq_unregister_disk(struct gendisk *disk)
 
 	kobject_put(&disk_to_dev(disk)->kobj);
 
+	blk_mq_debugfs_unregister(q);
+
 	q->mq_sysfs_init_done = false;
 	blk_mq_enable_hotplug();
 }
@@ -448,8 +538,11 @@ int blk_mq_register_disk(struct gendisk *disk)
 
 	if (ret)
 		blk_mq_unregister_disk(disk);
-	else
+	else {
 		q->mq_sysfs_init_done = true;
+		/* best effort, the disk works fine without */
+		blk_mq_debugfs_register(q, disk->disk_name);
+	}
 out:
 	blk_mq_enable_hotplug();
 
@@ -11,6 +11,7 @@
 #include <linux/blktrace_api.h>
 #include <linux/blk-cgroup.h>
 #include "blk.h"
+#include "blk-stat.h"
 
 /* Max dispatch from a group in 1 round */
 static int throtl_grp_quantum = 8;
@@ -21,6 +22,12 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/* Latency targets are checked against the mean latency of each window */
+static unsigned long throtl_lat_window = HZ/10;	/* 100 ms */
+
+/* log2 usec buckets, the last one catches everything above 32ms */
+#define THROTL_LAT_BUCKETS	16
+
 static struct blkcg_policy blkcg_policy_throtl;
 
 /* A workqueue to queue throttle related work */
@@ -133,6 +140,34 @@ struct throtl_grp {
 	/* When did we start a new slice */
 	unsigned long slice_start[2];
 	unsigned long slice_end[2];
+
+	/* target mean completion latency in usecs, -1 if not protected */
+	u64 latency_target;
+
+	/*
+	 * While any group on the queue has a latency target, bios are
+	 * accounted to the group they were issued from and their
+	 * completion latency is collected in the lat_* counters below.
+	 * Every throtl_lat_window the counters are folded into the
+	 * *_last fields and groups of lower priority than one that missed
+	 * its target get their number of bios in flight limited to
+	 * lat_depth.
+	 */
+	unsigned int lat_depth;			/* -1 if unlimited */
+	unsigned int lat_peak;			/* max in flight in window */
+	atomic_t lat_inflight;
+	atomic_t lat_nr;
+	atomic64_t lat_total;
+	atomic_t lat_buckets[THROTL_LAT_BUCKETS];
+
+	/* stats of the last completed window */
+	u64 lat_mean_last;
+	unsigned int lat_nr_last;
+	unsigned int lat_hist_last[THROTL_LAT_BUCKETS];
+
+	/* number of windows the target was missed / depth was limited in */
+	u64 lat_missed;
+	u64 lat_limited;
 };
 
 struct throtl_data
@@ -152,6 +187,12 @@ struct throtl_data
 
 	/* Work for dispatching throttled bios */
 	struct work_struct dispatch_work;
+
+	/* number of groups with a latency target */
+	unsigned int nr_lat_targets;
+
+	/* when the current latency window ends */
+	unsigned long lat_window_end;
 };
 
 static void throtl_pending_timer_fn(unsigned long arg);
@@ -344,6 +385,8 @@ static struct blkg_policy_data *throtl_pd_alloc(gfp_t gfp, int node)
 	tg->bps[WRITE] = -1;
 	tg->iops[READ] = -1;
 	tg->iops[WRITE] = -1;
+	tg->latency_target = -1;
+	tg->lat_depth = -1;
 
 	return &tg->pd;
 }
@@ -378,6 +421,10 @@ static void throtl_pd_init(struct blkg_policy_data *pd)
  * Set has_rules[] if @tg or any of its parents have limits configured.
  * This doesn't require walking up to the top of the hierarchy as the
  * parent's has_rules[] is guaranteed to be correct.
+ *
+ * While the queue has latency targets every group has rules: the groups
+ * a target may limit are the ones without one, and their bios have to be
+ * charged and tracked from the start for lat_peak to size that limit.
  */
 static void tg_update_has_rules(struct throtl_grp *tg)
 {
@@ -386,7 +433,8 @@ static void tg_update_has_rules(struct throtl_grp *tg)
 
 	for (rw = READ; rw <= WRITE; rw++)
 		tg->has_rules[rw] = (parent_tg && parent_tg->has_rules[rw]) ||
-				    (tg->bps[rw] != -1 || tg->iops[rw] != -1);
+				    (tg->bps[rw] != -1 || tg->iops[rw] != -1 ||
+				     tg->td->nr_lat_targets);
 }
 
 static void throtl_pd_online(struct blkg_policy_data *pd)
@@ -398,6 +446,18 @@ static void throtl_pd_online(struct blkg_policy_data *pd)
 	tg_update_has_rules(pd_to_tg(pd));
 }
 
+static void throtl_lat_targets_dec(struct throtl_data *td);
+
+static void throtl_pd_offline(struct blkg_policy_data *pd)
+{
+	struct throtl_grp *tg = pd_to_tg(pd);
+
+	if (tg->latency_target != -1) {
+		tg->latency_target = -1;
+		throtl_lat_targets_dec(tg->td);
+	}
+}
+
 static void throtl_pd_free(struct blkg_policy_data *pd)
 {
 	struct throtl_grp *tg = pd_to_tg(pd);
@@ -757,6 +817,20 @@ static bool tg_with_in_bps_limit(struct throtl_grp *tg, struct bio *bio,
 	return 0;
 }
 
+/* is @bio issued from @tg itself rather than one of its descendants? */
+static bool tg_own_bio(struct throtl_grp *tg, struct bio *bio)
+{
+	return bio_blkcg(bio) == tg_to_blkg(tg)->blkcg;
+}
+
+static bool tg_with_in_lat_depth(struct throtl_grp *tg, struct bio *bio)
+{
+	if (tg->lat_depth == -1 || !tg_own_bio(tg, bio))
+		return true;
+
+	return atomic_read(&tg->lat_inflight) < tg->lat_depth;
+}
+
 /*
  * Returns whether one can dispatch a bio or not. Also returns approx number
  * of jiffies to wait before this bio is with-in IO rate and can be dispatched
@@ -776,6 +850,16 @@ static bool tg_may_dispatch(struct throtl_grp *tg, struct bio *bio,
 	BUG_ON(tg->service_queue.nr_queued[rw] &&
 	       bio != throtl_peek_queued(&tg->service_queue.queued[rw]));
 
+	/*
+	 * Completions don't kick the dispatcher, so just check again on
+	 * the next tick when we're out of depth.
+	 */
+	if (!tg_with_in_lat_depth(tg, bio)) {
+		if (wait)
+			*wait = 1;
+		return false;
+	}
+
 	/* If tg->bps = -1, then BW is unlimited */
 	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
 		if (wait)
@@ -813,6 +897,24 @@ static bool tg_may_dispatch(struct throtl_grp *tg, struct bio *bio,
 	return 0;
 }
 
+/*
+ * Account @bio as in flight for @tg and have blk_throtl_bio_endio() record
+ * its completion latency.  The bio holds a reference on @tg's blkg until
+ * then.
+ */
+static void throtl_track_bio(struct throtl_grp *tg, struct bio *bio)
+{
+	unsigned int inflight;
+
+	bio->bi_cg_private = tg;
+	blkg_get(tg_to_blkg(tg));
+	blk_stat_set_issue_time(&bio->bi_issue_stat);
+
+	inflight = atomic_inc_return(&tg->lat_inflight);
+	if (inflight > tg->lat_peak)
+		tg->lat_peak = inflight;
+}
+
 static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 {
 	bool rw = bio_data_dir(bio);
@@ -821,6 +923,14 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	tg->bytes_disp[rw] += bio->bi_iter.bi_size;
 	tg->io_disp[rw]++;
 
+	/*
+	 * Start tracking as soon as the bio leaves its own group so that
+	 * the depth limit also covers bios still queued in the parents.
+	 */
+	if (tg->td->nr_lat_targets && !bio->bi_cg_private &&
+	    tg_own_bio(tg, bio))
+		throtl_track_bio(tg, bio);
+
 	/*
 	 * REQ_THROTTLED is used to prevent the same bio to be throttled
 	 * more than once as a throttled bio will go through blk-throtl the
@@ -1108,6 +1218,159 @@ static void blk_throtl_dispatch_work_fn(struct work_struct *work)
 	}
 }
 
+static void tg_set_lat_depth(struct throtl_grp *tg, unsigned int depth)
+{
+	unsigned int old = tg->lat_depth;
+
+	if (depth == old)
+		return;
+
+	throtl_log(&tg->service_queue, "latency depth=%d peak=%u mean=%llu",
+		   depth, tg->lat_peak, tg->lat_mean_last);
+	tg->lat_depth = depth;
+
+	/* if the limit went up, queued bios might be dispatchable now */
+	if (depth > old && (tg->flags & THROTL_TG_PENDING)) {
+		tg_update_disptime(tg);
+		throtl_schedule_next_dispatch(tg->service_queue.parent_sq, true);
+	}
+}
+
+/* Walk @td's groups and refresh has_rules[] as latency targets come and go. */
+static void throtl_update_all_has_rules(struct throtl_data *td)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+
+	blkg_for_each_descendant_pre(blkg, pos_css, td->queue->root_blkg)
+		tg_update_has_rules(blkg_to_tg(blkg));
+}
+
+/* Fold the window counters into *_last, returns whether anything completed */
+static bool tg_lat_fold_window(struct throtl_grp *tg)
+{
+	unsigned int nr = atomic_xchg(&tg->lat_nr, 0);
+	u64 total = atomic64_xchg(&tg->lat_total, 0);
+	int i;
+
+	for (i = 0; i < THROTL_LAT_BUCKETS; i++)
+		tg->lat_hist_last[i] = atomic_xchg(&tg->lat_buckets[i], 0);
+
+	tg->lat_nr_last = nr;
+	tg->lat_mean_last = nr ? div_u64(total, nr) : 0;
+	return nr;
+}
+
+/*
+ * Called at most once per throtl_lat_window from the issue path.  Find the
+ * tightest latency target which was missed in the window that just ended
+ * and halve the depth of every group with a looser or no target.  If no
+ * target was missed, limited groups get their depth doubled until it
+ * exceeds the queue depth and the limit is lifted.
+ */
+static void throtl_process_lat_window(struct throtl_data *td)
+{
+	struct request_queue *q = td->queue;
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+	u64 missed = -1;
+
+	spin_lock_irq(q->queue_lock);
+	if (!td->nr_lat_targets || time_before(jiffies, td->lat_window_end) ||
+	    unlikely(blk_queue_bypass(q)))
+		goto out_unlock;
+	td->lat_window_end = jiffies + throtl_lat_window;
+
+	blkg_for_each_descendant_pre(blkg, pos_css, q->root_blkg) {
+		struct throtl_grp *tg = blkg_to_tg(blkg);
+
+		if (!tg_lat_fold_window(tg) || tg->latency_target == -1)
+			continue;
+		if (tg->lat_mean_last > tg->latency_target * NSEC_PER_USEC) {
+			tg->lat_missed++;
+			missed = min(missed, tg->latency_target);
+		}
+	}
+
+	blkg_for_each_descendant_pre(blkg, pos_css, q->root_blkg) {
+		struct throtl_grp *tg = blkg_to_tg(blkg);
+		unsigned int depth = tg->lat_depth;
+
+		/* -1 sorts last, so unprotected groups are lowest priority */
+		if (tg->latency_target > missed) {
+			if (depth == -1)
+				depth = clamp_t(unsigned int, tg->lat_peak, 2,
+						q->nr_requests);
+			depth = max(depth / 2, 1U);
+			tg->lat_limited++;
+		} else if (depth != -1) {
+			depth *= 2;
+			if (depth >= q->nr_requests)
+				depth = -1;
+		}
+
+		tg->lat_peak = atomic_read(&tg->lat_inflight);
+		if (depth != tg->lat_depth)
+			tg_set_lat_depth(tg, depth);
+	}
+
+out_unlock:
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * The last latency target on @td went away, lift all depth limits.  Called
+ * with queue_lock held.
+ */
+static void throtl_lat_targets_dec(struct throtl_data *td)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+
+	if (--td->nr_lat_targets)
+		return;
+
+	rcu_read_lock();
+	blkg_for_each_descendant_pre(blkg, pos_css, td->queue->root_blkg)
+		tg_set_lat_depth(blkg_to_tg(blkg), -1);
+	throtl_update_all_has_rules(td);
+	rcu_read_unlock();
+}
+
+/**
+ * blk_throtl_bio_endio - record the completion latency of a tracked bio
+ * @bio: bio being completed
+ *
+ * Called from bio_endio(), possibly in irq context and with the queue_lock
+ * held, so only per-group atomics are touched here.
+ */
+void blk_throtl_bio_endio(struct bio *bio)
+{
+	struct throtl_grp *tg = bio->bi_cg_private;
+	u64 now, issue, lat = 0, lat_us;
+	int bucket;
+
+	if (!tg)
+		return;
+	bio->bi_cg_private = NULL;
+
+	now = __blk_stat_time(ktime_to_ns(ktime_get()));
+	issue = blk_stat_time(&bio->bi_issue_stat);
+	if (now > issue)
+		lat = now - issue;
+
+	lat_us = div_u64(lat, NSEC_PER_USEC);
+	bucket = lat_us < 2 ? 0 : min_t(int, ilog2(lat_us),
+					THROTL_LAT_BUCKETS - 1);
+
+	atomic_dec(&tg->lat_inflight);
+	atomic64_add(lat, &tg->lat_total);
+	atomic_inc(&tg->lat_buckets[bucket]);
+	atomic_inc(&tg->lat_nr);
+
+	blkg_put(tg_to_blkg(tg));
+}
+
 static u64 tg_prfill_conf_u64(struct seq_file *sf, struct blkg_policy_data *pd,
 			      int off)
 {
@@ -1227,6 +1490,79 @@ static ssize_t tg_set_conf_uint(struct kernfs_open_file *of,
 	return tg_set_conf(of, buf, nbytes, off, false);
 }
 
+static u64 tg_prfill_latency_stat(struct seq_file *sf,
+				  struct blkg_policy_data *pd, int off)
+{
+	struct throtl_grp *tg = pd_to_tg(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+	char target[21] = "none", depth[11] = "max";
+	int i;
+
+	if (!dname || !tg->td->nr_lat_targets)
+		return 0;
+
+	if (tg->latency_target != -1)
+		snprintf(target, sizeof(target), "%llu", tg->latency_target);
+	if (tg->lat_depth != -1)
+		snprintf(depth, sizeof(depth), "%u", tg->lat_depth);
+
+	seq_printf(sf, "%s target=%s mean=%llu nr=%u depth=%s missed=%llu limited=%llu hist=",
+		   dname, target, div_u64(tg->lat_mean_last, NSEC_PER_USEC),
+		   tg->lat_nr_last, depth, tg->lat_missed, tg->lat_limited);
+	for (i = 0; i < THROTL_LAT_BUCKETS; i++)
+		seq_printf(sf, "%s%u", i ? "," : "", tg->lat_hist_last[i]);
+	seq_putc(sf, '\n');
+	return 0;
+}
+
+static int tg_print_latency_stat(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), tg_prfill_latency_stat,
+			  &blkcg_policy_throtl, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t tg_set_latency_target(struct kernfs_open_file *of,
+				     char *buf, size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct throtl_grp *tg;
+	struct throtl_data *td;
+	int ret;
+	u64 v;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_throtl, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ret = -EINVAL;
+	if (sscanf(ctx.body, "%llu", &v) != 1)
+		goto out_finish;
+	if (!v)
+		v = -1;
+
+	tg = blkg_to_tg(ctx.blkg);
+	td = tg->td;
+
+	if (tg->latency_target == -1 && v != -1) {
+		if (!td->nr_lat_targets++) {
+			td->lat_window_end = jiffies + throtl_lat_window;
+			throtl_update_all_has_rules(td);
+		}
+	} else if (tg->latency_target != -1 && v == -1) {
+		throtl_lat_targets_dec(td);
+	}
+	tg->latency_target = v;
+
+	throtl_log(&tg->service_queue, "latency target=%llu targets=%u",
+		   tg->latency_target, td->nr_lat_targets);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
 static struct cftype throtl_legacy_files[] = {
 	{
 		.name = "throttle.read_bps_device",
@@ -1252,6 +1588,16 @@ static struct cftype throtl_legacy_files[] = {
 		.seq_show = tg_print_conf_uint,
 		.write = tg_set_conf_uint,
 	},
+	{
+		.name = "throttle.latency_target_device",
+		.private = offsetof(struct throtl_grp, latency_target),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_latency_target,
+	},
+	{
+		.name = "throttle.latency_stat",
+		.seq_show = tg_print_latency_stat,
+	},
 	{
 		.name = "throttle.io_service_bytes",
 		.private = (unsigned long)&blkcg_policy_throtl,
@@ -1373,6 +1719,18 @@ static struct cftype throtl_files[] = {
 		.seq_show = tg_print_max,
 		.write = tg_set_max,
 	},
+	{
+		.name = "latency_target",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.private = offsetof(struct throtl_grp, latency_target),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_latency_target,
+	},
+	{
+		.name = "latency_stat",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = tg_print_latency_stat,
+	},
 	{ }	/* terminate */
 };
 
@@ -1390,6 +1748,7 @@ static struct blkcg_policy blkcg_policy_throtl = {
 	.pd_alloc_fn		= throtl_pd_alloc,
 	.pd_init_fn		= throtl_pd_init,
 	.pd_online_fn		= throtl_pd_online,
+	.pd_offline_fn		= throtl_pd_offline,
 	.pd_free_fn		= throtl_pd_free,
 };
 
@@ -1404,6 +1763,10 @@ bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg,
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
+	if (tg->td->nr_lat_targets &&
+	    time_after_eq(jiffies, tg->td->lat_window_end))
+		throtl_process_lat_window(tg->td);
+
 	/* see throtl_charge_bio() */
 	if ((bio->bi_rw & REQ_THROTTLED) || !tg->has_rules[rw])
 		goto out;
@@ -1483,8 +1846,14 @@ out:
 	 * don't want bios to leave with the flag set.  Clear the flag if
 	 * being issued.
 	 */
-	if (!throttled)
+	if (!throttled) {
 		bio->bi_rw &= ~REQ_THROTTLED;
+
+		/* bios that were never charged to their group still count */
+		tg = blkg_to_tg(blkg ?: q->root_blkg);
+		if (tg->td->nr_lat_targets && !bio->bi_cg_private)
+			throtl_track_bio(tg, bio);
+	}
 	return throttled;
 }
 
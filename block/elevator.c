@@ -27,6 +27,7 @@
 #include <linux/blkdev.h>
 #include <linux/elevator.h>
 #include <linux/bio.h>
+#include <linux/blk-mq.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/init.h>
@@ -200,6 +201,10 @@ int elevator_init(struct request_queue *q, char *name)
 		e = elevator_get(name, true);
 		if (!e)
 			return -EINVAL;
+		if (e->uses_mq) {
+			elevator_put(e);
+			return -EINVAL;
+		}
 	}
 
 	/*
@@ -212,6 +217,10 @@ int elevator_init(struct request_queue *q, char *name)
 		if (!e)
 			printk(KERN_ERR "I/O scheduler %s not found\n",
 							chosen_elevator);
+		else if (e->uses_mq) {
+			elevator_put(e);
+			e = NULL;
+		}
 	}
 
 	if (!e) {
@@ -234,7 +243,10 @@ EXPORT_SYMBOL(elevator_init);
 void elevator_exit(struct elevator_queue *e)
 {
 	mutex_lock(&e->sysfs_lock);
-	if (e->type->ops.elevator_exit_fn)
+	if (e->type->uses_mq) {
+		if (e->type->mq_ops.exit_sched)
+			e->type->mq_ops.exit_sched(e);
+	} else if (e->type->ops.elevator_exit_fn)
 		e->type->ops.elevator_exit_fn(e);
 	mutex_unlock(&e->sysfs_lock);
 
@@ -944,6 +956,56 @@ fail_init:
 	return err;
 }
 
+/*
+ * blk-mq variant of elevator_switch(). A blk-mq queue may run without any
+ * scheduler, so either side of the switch can be NULL. The queue is frozen
+ * across the switch so no request is left inside the old scheduler, and an
+ * RCU grace period covers bio merging, which runs without a queue usage
+ * reference. If the new scheduler fails to initialize, the queue is left
+ * without one.
+ */
+static int elevator_switch_mq(struct request_queue *q,
+			      struct elevator_type *new_e)
+{
+	struct elevator_queue *old = q->elevator;
+	bool registered = old ? old->registered : q->kobj.state_in_sysfs;
+	int err = 0;
+
+	blk_mq_freeze_queue(q);
+
+	if (old) {
+		if (old->registered)
+			elv_unregister_queue(q);
+		q->elevator = NULL;
+		synchronize_rcu();
+		elevator_exit(old);
+	}
+
+	if (new_e) {
+		err = new_e->mq_ops.init_sched(q, new_e);
+		if (err)
+			goto out;
+
+		if (registered) {
+			err = elv_register_queue(q);
+			if (err) {
+				old = q->elevator;
+				q->elevator = NULL;
+				synchronize_rcu();
+				elevator_exit(old);
+				goto out;
+			}
+		}
+
+		blk_add_trace_msg(q, "elv switch: %s", new_e->elevator_name);
+	} else
+		blk_add_trace_msg(q, "elv switch: none");
+
+out:
+	blk_mq_unfreeze_queue(q);
+	return err;
+}
+
 /*
  * Switch this queue to the given IO scheduler.
  */
@@ -952,21 +1014,38 @@ static int __elevator_change(struct request_queue *q, const char *name)
 	char elevator_name[ELV_NAME_MAX];
 	struct elevator_type *e;
 
-	if (!q->elevator)
+	if (!q->elevator && !q->mq_ops)
 		return -ENXIO;
 
 	strlcpy(elevator_name, name, sizeof(elevator_name));
-	e = elevator_get(strstrip(elevator_name), true);
+	strstrip(elevator_name);
+
+	if (q->mq_ops && !strcmp(elevator_name, "none")) {
+		if (!q->elevator)
+			return 0;
+		return elevator_switch_mq(q, NULL);
+	}
+
+	e = elevator_get(elevator_name, true);
 	if (!e) {
 		printk(KERN_ERR "elevator: type %s not found\n", elevator_name);
 		return -EINVAL;
 	}
 
-	if (!strcmp(elevator_name, q->elevator->type->elevator_name)) {
+	if (q->elevator &&
+	    !strcmp(elevator_name, q->elevator->type->elevator_name)) {
 		elevator_put(e);
 		return 0;
 	}
 
+	if (e->uses_mq != !!q->mq_ops) {
+		elevator_put(e);
+		return -EINVAL;
+	}
+
+	if (q->mq_ops)
+		return elevator_switch_mq(q, e);
+
 	return elevator_switch(q, e);
 }
 
@@ -988,7 +1067,7 @@ ssize_t elv_iosched_store(struct request_queue *q, const char *name,
 {
 	int ret;
 
-	if (!q->elevator)
+	if (!q->elevator && !q->mq_ops)
 		return count;
 
 	ret = __elevator_change(q, name);
@@ -1002,24 +1081,30 @@ ssize_t elv_iosched_store(struct request_queue *q, const char *name,
 ssize_t elv_iosched_show(struct request_queue *q, char *name)
 {
 	struct elevator_queue *e = q->elevator;
-	struct elevator_type *elv;
+	struct elevator_type *elv = NULL;
 	struct elevator_type *__e;
 	int len = 0;
 
-	if (!q->elevator || !blk_queue_stackable(q))
+	if (!q->mq_ops && (!q->elevator || !blk_queue_stackable(q)))
 		return sprintf(name, "none\n");
 
-	elv = e->type;
+	if (e)
+		elv = e->type;
 
 	spin_lock(&elv_list_lock);
 	list_for_each_entry(__e, &elv_list, list) {
-		if (!strcmp(elv->elevator_name, __e->elevator_name))
+		if (__e->uses_mq != !!q->mq_ops)
+			continue;
+		if (elv && !strcmp(elv->elevator_name, __e->elevator_name))
 			len += sprintf(name+len, "[%s] ", elv->elevator_name);
 		else
 			len += sprintf(name+len, "%s ", __e->elevator_name);
 	}
 	spin_unlock(&elv_list_lock);
 
+	if (q->mq_ops)
+		len += sprintf(name+len, elv ? "none " : "[none] ");
+
 	len += sprintf(len+name, "\n");
 	return len;
 }
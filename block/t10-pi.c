@@ -26,19 +26,34 @@
 #include <linux/crc-t10dif.h>
 #include <net/checksum.h>
 
-typedef __be16 (csum_fn) (void *, unsigned int);
+/* Guard tags of @nr consecutive intervals of @len bytes at @data */
+typedef void (csum_fn) (void *data, unsigned int len, unsigned int nr,
+			__be16 *csums);
+
+/* Intervals checksummed per csum_fn call */
+#define T10_PI_BATCH	16
 
 static const __be16 APP_ESCAPE = (__force __be16) 0xffff;
 static const __be32 REF_ESCAPE = (__force __be32) 0xffffffff;
 
-static __be16 t10_pi_crc_fn(void *data, unsigned int len)
+static void t10_pi_crc_fn(void *data, unsigned int len, unsigned int nr,
+			  __be16 *csums)
 {
-	return cpu_to_be16(crc_t10dif(data, len));
+	u16 *crcs = (__force u16 *)csums;
+	unsigned int i;
+
+	crc_t10dif_batch(data, len, nr, crcs);
+	for (i = 0; i < nr; i++)
+		csums[i] = cpu_to_be16(crcs[i]);
 }
 
-static __be16 t10_pi_ip_fn(void *data, unsigned int len)
+static void t10_pi_ip_fn(void *data, unsigned int len, unsigned int nr,
+			 __be16 *csums)
 {
-	return (__force __be16)ip_compute_csum(data, len);
+	unsigned int i;
+
+	for (i = 0; i < nr; i++, data += len)
+		csums[i] = (__force __be16)ip_compute_csum(data, len);
 }
 
 /*
@@ -49,12 +64,21 @@ static __be16 t10_pi_ip_fn(void *data, unsigned int len)
 static int t10_pi_generate(struct blk_integrity_iter *iter, csum_fn *fn,
 			   unsigned int type)
 {
-	unsigned int i;
+	__be16 csums[T10_PI_BATCH];
+	unsigned int i, n = 0;
 
 	for (i = 0 ; i < iter->data_size ; i += iter->interval) {
 		struct t10_pi_tuple *pi = iter->prot_buf;
 
-		pi->guard_tag = fn(iter->data_buf, iter->interval);
+		if (n == T10_PI_BATCH || i == 0) {
+			fn(iter->data_buf, iter->interval,
+			   min_t(unsigned int, T10_PI_BATCH,
+				 (iter->data_size - i) / iter->interval),
+			   csums);
+			n = 0;
+		}
+
+		pi->guard_tag = csums[n++];
 		pi->app_tag = 0;
 
 		if (type == 1)
@@ -73,12 +97,23 @@ static int t10_pi_generate(struct blk_integrity_iter *iter, csum_fn *fn,
 static int t10_pi_verify(struct blk_integrity_iter *iter, csum_fn *fn,
 				unsigned int type)
 {
-	unsigned int i;
+	__be16 csums[T10_PI_BATCH];
+	unsigned int i, n = 0;
 
 	for (i = 0 ; i < iter->data_size ; i += iter->interval) {
 		struct t10_pi_tuple *pi = iter->prot_buf;
 		__be16 csum;
 
+		/* Escaped intervals get checksummed too, but not checked */
+		if (n == T10_PI_BATCH || i == 0) {
+			fn(iter->data_buf, iter->interval,
+			   min_t(unsigned int, T10_PI_BATCH,
+				 (iter->data_size - i) / iter->interval),
+			   csums);
+			n = 0;
+		}
+		csum = csums[n++];
+
 		switch (type) {
 		case 1:
 		case 2:
@@ -101,8 +136,6 @@ static int t10_pi_verify(struct blk_integrity_iter *iter, csum_fn *fn,
 			break;
 		}
 
-		csum = fn(iter->data_buf, iter->interval);
-
 		if (pi->guard_tag != csum) {
 			pr_err("%s: guard tag error at sector %llu " \
 			       "(rcvd %04x, want %04x)\n", iter->disk_name,
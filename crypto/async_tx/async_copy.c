@@ -0,0 +1,159 @@
+/*
+ * bulk copy offload for sleeping callers
+ *
+ * async_memcpy() is built to be chained into md's raid operations, which
+ * go on asynchronously to the end.  Most other bulk copies in the kernel
+ * have to be complete before their caller can go on, and can only leave
+ * the CPU free for something else if the caller sleeps while the engine
+ * works rather than polling it.  async_copy_page() queues a copy on the
+ * chain of its struct async_copy, and async_copy_wait() sleeps until the
+ * whole chain has completed.
+ *
+ * Copies that are not worth a descriptor, or whose destination is not on
+ * the node of the channel this CPU would use, are done with the CPU on
+ * the spot.  The per-CPU channel table already hands each CPU a channel
+ * of its own node where there is one; a remote one would only move the
+ * copy onto the interconnect.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#include <linux/kernel.h>
+#include <linux/highmem.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/async_tx.h>
+
+/*
+ * Below this many bytes a copy is cheaper on the CPU than the mapping,
+ * descriptor and completion work it takes to hand it to an engine.  NET_DMA
+ * used the same copybreak for I/OAT.
+ */
+unsigned int async_copy_threshold __read_mostly = 4096;
+module_param_named(threshold, async_copy_threshold, uint, 0644);
+MODULE_PARM_DESC(threshold, "Smallest copy to offload to a dma engine, 0 to never offload (default: 4096)");
+EXPORT_SYMBOL_GPL(async_copy_threshold);
+
+static struct dma_chan *async_copy_channel(struct async_copy *ac)
+{
+	/* as __async_tx_find_channel(), keep the chain on one channel */
+	if (ac->tx)
+		return ac->tx->chan;
+	return async_dma_find_channel(DMA_MEMCPY);
+}
+
+static bool async_copy_local(struct dma_chan *chan, struct page *page)
+{
+	int node = dev_to_node(chan->device->dev);
+
+	return node == NUMA_NO_NODE || node == page_to_nid(page);
+}
+
+/**
+ * async_copy_worthwhile - tell whether a copy of @len would be offloaded
+ * @len: length in bytes
+ *
+ * Lets callers keep their own copy loop for small copies, or when there is
+ * no channel to offload to, instead of setting up for async_copy_page().
+ */
+bool async_copy_worthwhile(size_t len)
+{
+	return async_copy_threshold && len >= async_copy_threshold &&
+	       async_dma_find_channel(DMA_MEMCPY);
+}
+EXPORT_SYMBOL_GPL(async_copy_worthwhile);
+
+/**
+ * async_copy_page - queue a copy on a chain
+ * @ac: chain to queue the copy on
+ * @dest: destination page
+ * @dest_offset: offset into @dest to copy to
+ * @src: source page
+ * @src_offset: offset into @src to copy from
+ * @len: length in bytes
+ *
+ * Neither page may be touched, nor released, until async_copy_wait() has
+ * returned for @ac.  The copy may also be done before this returns, see
+ * above.  Both ranges must be physically contiguous, as for async_memcpy(),
+ * and must not overlap any other copy queued on @ac.
+ */
+void async_copy_page(struct async_copy *ac, struct page *dest,
+		     unsigned int dest_offset, struct page *src,
+		     unsigned int src_offset, size_t len)
+{
+	struct dma_chan *chan = NULL;
+	struct async_submit_ctl submit;
+	void *dest_buf, *src_buf;
+
+	if (async_copy_threshold && len >= async_copy_threshold)
+		chan = async_copy_channel(ac);
+
+	if (chan && async_copy_local(chan, dest)) {
+		init_async_submit(&submit, 0, ac->tx, NULL, NULL, NULL);
+		/*
+		 * This acks the previous descriptor, now that the new one
+		 * depends on it.  If async_memcpy() fell back to a synchronous
+		 * copy, it has waited for the chain and we start over.
+		 */
+		ac->tx = async_memcpy(dest, src, dest_offset, src_offset, len,
+				      &submit);
+		/* keep the engine busy while the caller queues more */
+		async_tx_issue_pending(ac->tx);
+		return;
+	}
+
+	/* nothing queued on @ac overlaps this copy, so nothing to wait for */
+	dest_buf = kmap_atomic(dest) + dest_offset;
+	src_buf = kmap_atomic(src) + src_offset;
+
+	memcpy(dest_buf, src_buf, len);
+
+	kunmap_atomic(src_buf);
+	kunmap_atomic(dest_buf);
+}
+EXPORT_SYMBOL_GPL(async_copy_page);
+
+static void async_copy_done(void *param)
+{
+	struct async_copy *ac = param;
+
+	complete(&ac->done);
+}
+
+/**
+ * async_copy_wait - sleep until all copies queued on a chain are done
+ * @ac: chain to wait for
+ *
+ * Engines that cannot raise an interrupt for the end of the chain are
+ * polled instead, as async_trigger_callback() does.  @ac can be reused
+ * afterwards.
+ */
+void async_copy_wait(struct async_copy *ac)
+{
+	struct dma_async_tx_descriptor *tx;
+	struct async_submit_ctl submit;
+
+	might_sleep();
+
+	if (!ac->tx)
+		return;
+
+	init_completion(&ac->done);
+	init_async_submit(&submit, ASYNC_TX_ACK, ac->tx, async_copy_done, ac,
+			  NULL);
+	tx = async_trigger_callback(&submit);
+	async_tx_issue_pending(tx);
+
+	wait_for_completion(&ac->done);
+	ac->tx = NULL;
+}
+EXPORT_SYMBOL_GPL(async_copy_wait);
+
+MODULE_DESCRIPTION("asynchronous bulk copy api");
+MODULE_LICENSE("GPL");
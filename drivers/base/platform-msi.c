@@ -129,7 +129,7 @@ static int platform_msi_alloc_descs(struct device *dev, int nvec,
 	for (i = 0; i < nvec; i++) {
 		struct msi_desc *desc;
 
-		desc = alloc_msi_entry(dev);
+		desc = alloc_msi_entry(dev, 1, NULL);
 		if (!desc)
 			break;
 
@@ -641,6 +641,62 @@ static const struct file_operations connection_oldest_requests_fops = {
 	.release	= connection_oldest_requests_release,
 };
 
+static int connection_data_streams_show(struct seq_file *m, void *ignored)
+{
+	struct drbd_connection *connection = m->private;
+	unsigned int i;
+
+	/* BUMP me if you change the file format/content/presentation */
+	seq_printf(m, "v: %u\n\n", 0);
+
+	seq_printf(m, "agreed data streams: %u\n\n", connection->agreed_data_streams);
+	seq_puts(m, "stream\tsent\tsent_kB\trecv\trecv_kB\tbarriers\twaits\twait_ms\tunread\tunacked\n");
+
+	rcu_read_lock();
+	for (i = 0; i < connection->agreed_data_streams; i++) {
+		struct drbd_data_stream *stream = &connection->stream[i];
+		struct socket *socket = stream->sock->socket;
+		int unread = 0, unacked = 0;
+
+		if (socket) {
+			/* open coded SIOCINQ and SIOCOUTQ, as in_flight_summary does */
+			struct tcp_sock *tp = tcp_sk(socket->sk);
+			unread = tp->rcv_nxt - tp->copied_seq;
+			unacked = tp->write_seq - tp->snd_una;
+		}
+		seq_printf(m, "%u\t%lu\t%lu\t%lu\t%lu\t%u\t%lu\t%u\t%d\t%d\n",
+			   i, stream->sent_writes, stream->sent_sectors >> 1,
+			   stream->recv_writes, stream->recv_sectors >> 1,
+			   stream->barriers, stream->barrier_waits,
+			   jiffies_to_msecs(stream->barrier_wait_jif),
+			   unread, unacked);
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
+static int connection_data_streams_open(struct inode *inode, struct file *file)
+{
+	struct drbd_connection *connection = inode->i_private;
+	return drbd_single_open(file, connection_data_streams_show, connection,
+				&connection->kref, drbd_destroy_connection);
+}
+
+static int connection_data_streams_release(struct inode *inode, struct file *file)
+{
+	struct drbd_connection *connection = inode->i_private;
+	kref_put(&connection->kref, drbd_destroy_connection);
+	return single_release(inode, file);
+}
+
+static const struct file_operations connection_data_streams_fops = {
+	.owner		= THIS_MODULE,
+	.open		= connection_data_streams_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= connection_data_streams_release,
+};
+
 void drbd_debugfs_connection_add(struct drbd_connection *connection)
 {
 	struct dentry *conns_dir = connection->resource->debugfs_res_connections;
@@ -669,6 +725,13 @@ void drbd_debugfs_connection_add(struct drbd_connection *connection)
 	if (IS_ERR_OR_NULL(dentry))
 		goto fail;
 	connection->debugfs_conn_oldest_requests = dentry;
+
+	dentry = debugfs_create_file("data_streams", S_IRUSR|S_IRGRP,
+			connection->debugfs_conn, connection,
+			&connection_data_streams_fops);
+	if (IS_ERR_OR_NULL(dentry))
+		goto fail;
+	connection->debugfs_conn_data_streams = dentry;
 	return;
 
 fail:
@@ -680,6 +743,7 @@ void drbd_debugfs_connection_cleanup(struct drbd_connection *connection)
 {
 	drbd_debugfs_remove(&connection->debugfs_conn_callback_history);
 	drbd_debugfs_remove(&connection->debugfs_conn_oldest_requests);
+	drbd_debugfs_remove(&connection->debugfs_conn_data_streams);
 	drbd_debugfs_remove(&connection->debugfs_conn);
 }
 
@@ -46,6 +46,7 @@
 #include <linux/prefetch.h>
 #include <linux/drbd_genl_api.h>
 #include <linux/drbd.h>
+#include <linux/drbd_limits.h>
 #include "drbd_strings.h"
 #include "drbd_state.h"
 #include "drbd_protocol.h"
@@ -584,6 +585,27 @@ struct drbd_socket {
 	void *rbuf;
 };
 
+/* With FF_DATA_STREAMS, application writes are spread over several data
+ * sockets by activity log extent.  Stream 0 is connection->data, the
+ * others only ever carry P_DATA, P_TRIM and P_BARRIER.  Every stream
+ * sees every P_BARRIER, and the receivers meet there, so an epoch is only
+ * closed once the writes of all streams have been accounted to it. */
+struct drbd_data_stream {
+	struct drbd_socket *sock;	/* &connection->data for stream 0 */
+	struct drbd_socket extra;	/* own socket of the other streams */
+	struct drbd_thread receiver;	/* not used for stream 0 */
+	unsigned int nr;
+	unsigned int barriers;		/* P_BARRIERs received on this stream */
+
+	/* statistics, for debugfs */
+	unsigned long sent_writes;
+	unsigned long sent_sectors;
+	unsigned long recv_writes;
+	unsigned long recv_sectors;
+	unsigned long barrier_waits;
+	unsigned long barrier_wait_jif;
+};
+
 struct drbd_md {
 	u64 md_offset;		/* sector offset to 'super' block */
 
@@ -712,6 +734,7 @@ struct drbd_connection {
 	struct dentry *debugfs_conn;
 	struct dentry *debugfs_conn_callback_history;
 	struct dentry *debugfs_conn_oldest_requests;
+	struct dentry *debugfs_conn_data_streams;
 #endif
 	struct kref kref;
 	struct idr peer_devices;	/* volume number to peer device mapping */
@@ -735,6 +758,11 @@ struct drbd_connection {
 	unsigned long last_received;	/* in jiffies, either socket */
 	unsigned int ko_count;
 
+	unsigned int agreed_data_streams;	/* 1 unless FF_DATA_STREAMS */
+	unsigned int stream_epochs;	/* P_BARRIERs processed with all streams */
+	wait_queue_head_t stream_wait;
+	struct drbd_data_stream stream[DRBD_DATA_STREAMS_MAX];
+
 	struct list_head transfer_log;	/* all requests not yet fully processed */
 
 	struct crypto_hash *cram_hmac_tfm;
@@ -1075,6 +1103,7 @@ extern void tl_release(struct drbd_connection *, unsigned int barrier_nr,
 		       unsigned int set_size);
 extern void tl_clear(struct drbd_connection *);
 extern void drbd_free_sock(struct drbd_connection *connection);
+extern int drbd_alloc_data_streams(struct drbd_connection *connection);
 extern int drbd_send(struct drbd_connection *connection, struct socket *sock,
 		     void *buf, size_t size, unsigned msg_flags);
 extern int drbd_send_all(struct drbd_connection *, struct socket *, void *, size_t,
@@ -1185,6 +1214,15 @@ extern int drbd_bmio_clear_n_write(struct drbd_device *device) __must_hold(local
 #define AL_EXTENT_SHIFT 22
 #define AL_EXTENT_SIZE (1<<AL_EXTENT_SHIFT)
 
+/* All writes to one activity log extent go through the same data stream */
+static inline struct drbd_data_stream *
+drbd_data_stream_of(struct drbd_connection *connection, sector_t sector)
+{
+	unsigned int enr = sector >> (AL_EXTENT_SHIFT - 9);
+
+	return &connection->stream[enr % connection->agreed_data_streams];
+}
+
 /* We could make these currently hardcoded constants configurable
  * variables at create-md time (or even re-configurable at runtime?).
  * Which will require some more changes to the DRBD "super block"
@@ -1536,6 +1574,7 @@ extern void drbd_endio_write_sec_final(struct drbd_peer_request *peer_req);
 
 /* drbd_receiver.c */
 extern int drbd_receiver(struct drbd_thread *thi);
+extern int drbd_stream_receiver(struct drbd_thread *thi);
 extern int drbd_asender(struct drbd_thread *thi);
 extern bool drbd_rs_c_min_rate_throttle(struct drbd_device *device);
 extern bool drbd_rs_should_slow_down(struct drbd_device *device, sector_t sector,
@@ -1954,6 +1993,8 @@ extern void *drbd_prepare_command(struct drbd_peer_device *, struct drbd_socket
 extern int conn_send_command(struct drbd_connection *, struct drbd_socket *,
 			     enum drbd_packet, unsigned int, void *,
 			     unsigned int);
+extern int drbd_send_initial_stream(struct drbd_connection *, struct drbd_socket *,
+				    unsigned int);
 extern int drbd_send_command(struct drbd_peer_device *, struct drbd_socket *,
 			     enum drbd_packet, unsigned int, void *,
 			     unsigned int);
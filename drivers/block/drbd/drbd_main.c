@@ -701,6 +701,20 @@ int drbd_send_command(struct drbd_peer_device *peer_device, struct drbd_socket *
 	return err;
 }
 
+/* First packet on an additional data stream; the volume field of the
+ * header tells the peer which stream this socket is. */
+int drbd_send_initial_stream(struct drbd_connection *connection,
+			     struct drbd_socket *sock, unsigned int nr)
+{
+	int err;
+
+	if (!conn_prepare_command(connection, sock))
+		return -EIO;
+	err = __send_command(connection, nr, sock, P_INITIAL_STREAM, 0, NULL, 0);
+	mutex_unlock(&sock->mutex);
+	return err;
+}
+
 int drbd_send_ping(struct drbd_connection *connection)
 {
 	struct drbd_socket *sock;
@@ -1452,13 +1466,26 @@ static int we_should_drop_the_connection(struct drbd_connection *connection, str
 	return drop_it; /* && (device->state == R_PRIMARY) */;
 }
 
-static void drbd_update_congested(struct drbd_connection *connection)
+static void drbd_update_congested(struct drbd_connection *connection,
+				  struct socket *socket)
 {
-	struct sock *sk = connection->data.socket->sk;
+	struct sock *sk = socket->sk;
 	if (sk->sk_wmem_queued > sk->sk_sndbuf * 4 / 5)
 		set_bit(NET_CONGESTED, &connection->flags);
 }
 
+/* connection->data, or one of the additional data streams */
+static bool drbd_is_data_socket(struct drbd_connection *connection,
+				struct socket *sock)
+{
+	unsigned int i;
+
+	for (i = 0; i < connection->agreed_data_streams; i++)
+		if (connection->stream[i].sock->socket == sock)
+			return true;
+	return false;
+}
+
 /* The idea of sendpage seems to be to put some kind of reference
  * to the page into the skb, and to hand it over to the NIC. In
  * this process get_page() gets called.
@@ -1480,14 +1507,12 @@ static void drbd_update_congested(struct drbd_connection *connection)
  * As a workaround, we disable sendpage on pages
  * with page_count == 0 or PageSlab.
  */
-static int _drbd_no_send_page(struct drbd_peer_device *peer_device, struct page *page,
-			      int offset, size_t size, unsigned msg_flags)
+static int _drbd_no_send_page(struct drbd_peer_device *peer_device, struct socket *socket,
+			      struct page *page, int offset, size_t size, unsigned msg_flags)
 {
-	struct socket *socket;
 	void *addr;
 	int err;
 
-	socket = peer_device->connection->data.socket;
 	addr = kmap(page) + offset;
 	err = drbd_send_all(peer_device->connection, socket, addr, size, msg_flags);
 	kunmap(page);
@@ -1496,10 +1521,9 @@ static int _drbd_no_send_page(struct drbd_peer_device *peer_device, struct page
 	return err;
 }
 
-static int _drbd_send_page(struct drbd_peer_device *peer_device, struct page *page,
-		    int offset, size_t size, unsigned msg_flags)
+static int _drbd_send_page(struct drbd_peer_device *peer_device, struct socket *socket,
+			   struct page *page, int offset, size_t size, unsigned msg_flags)
 {
-	struct socket *socket = peer_device->connection->data.socket;
 	mm_segment_t oldfs = get_fs();
 	int len = size;
 	int err = -EIO;
@@ -1511,10 +1535,10 @@ static int _drbd_send_page(struct drbd_peer_device *peer_device, struct page *pa
 	 * __page_cache_release a page that would actually still be referenced
 	 * by someone, leading to some obscure delayed Oops somewhere else. */
 	if (disable_sendpage || (page_count(page) < 1) || PageSlab(page))
-		return _drbd_no_send_page(peer_device, page, offset, size, msg_flags);
+		return _drbd_no_send_page(peer_device, socket, page, offset, size, msg_flags);
 
 	msg_flags |= MSG_NOSIGNAL;
-	drbd_update_congested(peer_device->connection);
+	drbd_update_congested(peer_device->connection, socket);
 	set_fs(KERNEL_DS);
 	do {
 		int sent;
@@ -1545,7 +1569,8 @@ static int _drbd_send_page(struct drbd_peer_device *peer_device, struct page *pa
 	return err;
 }
 
-static int _drbd_send_bio(struct drbd_peer_device *peer_device, struct bio *bio)
+static int _drbd_send_bio(struct drbd_peer_device *peer_device, struct socket *socket,
+			  struct bio *bio)
 {
 	struct bio_vec bvec;
 	struct bvec_iter iter;
@@ -1554,7 +1579,7 @@ static int _drbd_send_bio(struct drbd_peer_device *peer_device, struct bio *bio)
 	bio_for_each_segment(bvec, bio, iter) {
 		int err;
 
-		err = _drbd_no_send_page(peer_device, bvec.bv_page,
+		err = _drbd_no_send_page(peer_device, socket, bvec.bv_page,
 					 bvec.bv_offset, bvec.bv_len,
 					 bio_iter_last(bvec, iter)
 					 ? 0 : MSG_MORE);
@@ -1564,7 +1589,8 @@ static int _drbd_send_bio(struct drbd_peer_device *peer_device, struct bio *bio)
 	return 0;
 }
 
-static int _drbd_send_zc_bio(struct drbd_peer_device *peer_device, struct bio *bio)
+static int _drbd_send_zc_bio(struct drbd_peer_device *peer_device, struct socket *socket,
+			     struct bio *bio)
 {
 	struct bio_vec bvec;
 	struct bvec_iter iter;
@@ -1573,7 +1599,7 @@ static int _drbd_send_zc_bio(struct drbd_peer_device *peer_device, struct bio *b
 	bio_for_each_segment(bvec, bio, iter) {
 		int err;
 
-		err = _drbd_send_page(peer_device, bvec.bv_page,
+		err = _drbd_send_page(peer_device, socket, bvec.bv_page,
 				      bvec.bv_offset, bvec.bv_len,
 				      bio_iter_last(bvec, iter) ? 0 : MSG_MORE);
 		if (err)
@@ -1593,7 +1619,8 @@ static int _drbd_send_zc_ee(struct drbd_peer_device *peer_device,
 	page_chain_for_each(page) {
 		unsigned l = min_t(unsigned, len, PAGE_SIZE);
 
-		err = _drbd_send_page(peer_device, page, 0, l,
+		err = _drbd_send_page(peer_device, peer_device->connection->data.socket,
+				      page, 0, l,
 				      page_chain_next(page) ? MSG_MORE : 0);
 		if (err)
 			return err;
@@ -1619,13 +1646,20 @@ static u32 bio_flags_to_wire(struct drbd_connection *connection, unsigned long b
 int drbd_send_dblock(struct drbd_peer_device *peer_device, struct drbd_request *req)
 {
 	struct drbd_device *device = peer_device->device;
+	struct drbd_data_stream *stream;
 	struct drbd_socket *sock;
 	struct p_data *p;
 	unsigned int dp_flags = 0;
 	int digest_size;
 	int err;
 
-	sock = &peer_device->connection->data;
+	/* Only plain replication is spread over the data streams.  While
+	 * resync or verify runs, writes stay ordered with the resync packets
+	 * on the main data socket. */
+	stream = &peer_device->connection->stream[0];
+	if (device->state.conn == C_CONNECTED)
+		stream = drbd_data_stream_of(peer_device->connection, req->i.sector);
+	sock = stream->sock;
 	p = drbd_prepare_command(peer_device, sock);
 	digest_size = peer_device->connection->integrity_tfm ?
 		      crypto_hash_digestsize(peer_device->connection->integrity_tfm) : 0;
@@ -1675,9 +1709,9 @@ int drbd_send_dblock(struct drbd_peer_device *peer_device, struct drbd_request *
 		 * receiving side, we sure have detected corruption elsewhere.
 		 */
 		if (!(req->rq_state & (RQ_EXP_RECEIVE_ACK | RQ_EXP_WRITE_ACK)) || digest_size)
-			err = _drbd_send_bio(peer_device, req->master_bio);
+			err = _drbd_send_bio(peer_device, sock->socket, req->master_bio);
 		else
-			err = _drbd_send_zc_bio(peer_device, req->master_bio);
+			err = _drbd_send_zc_bio(peer_device, sock->socket, req->master_bio);
 
 		/* double check digest, sometimes buffers have been modified in flight. */
 		if (digest_size > 0 && digest_size <= 64) {
@@ -1695,6 +1729,10 @@ int drbd_send_dblock(struct drbd_peer_device *peer_device, struct drbd_request *
 		} */
 	}
 out:
+	if (!err) {
+		stream->sent_writes++;
+		stream->sent_sectors += req->i.size >> 9;
+	}
 	mutex_unlock(&sock->mutex);  /* locked by drbd_prepare_command() */
 
 	return err;
@@ -1786,11 +1824,11 @@ int drbd_send(struct drbd_connection *connection, struct socket *sock,
 	msg.msg_controllen = 0;
 	msg.msg_flags      = msg_flags | MSG_NOSIGNAL;
 
-	if (sock == connection->data.socket) {
+	if (drbd_is_data_socket(connection, sock)) {
 		rcu_read_lock();
 		connection->ko_count = rcu_dereference(connection->net_conf)->ko_count;
 		rcu_read_unlock();
-		drbd_update_congested(connection);
+		drbd_update_congested(connection, sock);
 	}
 	do {
 		/* STRANGE
@@ -1820,7 +1858,7 @@ int drbd_send(struct drbd_connection *connection, struct socket *sock,
 		iov.iov_len  -= rv;
 	} while (sent < size);
 
-	if (sock == connection->data.socket)
+	if (drbd_is_data_socket(connection, sock))
 		clear_bit(NET_CONGESTED, &connection->flags);
 
 	if (rv <= 0) {
@@ -2502,6 +2540,23 @@ static void drbd_free_socket(struct drbd_socket *socket)
 	free_page((unsigned long) socket->rbuf);
 }
 
+/* The buffers of the additional data streams are only allocated once
+ * a connection agreed to use them, and kept until the connection goes. */
+int drbd_alloc_data_streams(struct drbd_connection *connection)
+{
+	unsigned int i;
+
+	for (i = 1; i < connection->agreed_data_streams; i++) {
+		struct drbd_socket *sock = &connection->stream[i].extra;
+
+		if (sock->rbuf && sock->sbuf)
+			continue;
+		if (drbd_alloc_socket(sock))
+			return -ENOMEM;
+	}
+	return 0;
+}
+
 void conn_free_crypto(struct drbd_connection *connection)
 {
 	drbd_free_sock(connection);
@@ -2611,6 +2666,7 @@ struct drbd_connection *conn_create(const char *name, struct res_opts *res_opts)
 {
 	struct drbd_resource *resource;
 	struct drbd_connection *connection;
+	int i;
 
 	connection = kzalloc(sizeof(struct drbd_connection), GFP_KERNEL);
 	if (!connection)
@@ -2648,6 +2704,18 @@ struct drbd_connection *conn_create(const char *name, struct res_opts *res_opts)
 	mutex_init(&connection->data.mutex);
 	mutex_init(&connection->meta.mutex);
 
+	connection->agreed_data_streams = 1;
+	init_waitqueue_head(&connection->stream_wait);
+	for (i = 0; i < DRBD_DATA_STREAMS_MAX; i++) {
+		struct drbd_data_stream *stream = &connection->stream[i];
+
+		stream->nr = i;
+		stream->sock = i ? &stream->extra : &connection->data;
+		mutex_init(&stream->extra.mutex);
+		drbd_thread_init(resource, &stream->receiver, drbd_stream_receiver, "stream");
+		stream->receiver.connection = connection;
+	}
+
 	drbd_thread_init(resource, &connection->receiver, drbd_receiver, "receiver");
 	connection->receiver.connection = connection;
 	drbd_thread_init(resource, &connection->worker, drbd_worker, "worker");
@@ -2682,6 +2750,7 @@ void drbd_destroy_connection(struct kref *kref)
 {
 	struct drbd_connection *connection = container_of(kref, struct drbd_connection, kref);
 	struct drbd_resource *resource = connection->resource;
+	int i;
 
 	if (atomic_read(&connection->current_epoch->epoch_size) !=  0)
 		drbd_err(connection, "epoch_size:%d\n", atomic_read(&connection->current_epoch->epoch_size));
@@ -2689,6 +2758,8 @@ void drbd_destroy_connection(struct kref *kref)
 
 	idr_destroy(&connection->peer_devices);
 
+	for (i = 1; i < DRBD_DATA_STREAMS_MAX; i++)
+		drbd_free_socket(&connection->stream[i].extra);
 	drbd_free_socket(&connection->meta);
 	drbd_free_socket(&connection->data);
 	kfree(connection->int_dig_in);
@@ -3000,10 +3071,15 @@ static void drbd_free_one_sock(struct drbd_socket *ds)
 
 void drbd_free_sock(struct drbd_connection *connection)
 {
+	int i;
+
 	if (connection->data.socket)
 		drbd_free_one_sock(&connection->data);
 	if (connection->meta.socket)
 		drbd_free_one_sock(&connection->meta);
+	for (i = 1; i < DRBD_DATA_STREAMS_MAX; i++)
+		if (connection->stream[i].extra.socket)
+			drbd_free_one_sock(&connection->stream[i].extra);
 }
 
 /* meta data management */
@@ -3704,6 +3780,8 @@ const char *cmdname(enum drbd_packet cmd)
 		return "InitialMeta";
 	if (cmd == P_INITIAL_DATA)
 		return "InitialData";
+	if (cmd == P_INITIAL_STREAM)
+		return "InitialStream";
 	if (cmd == P_CONNECTION_FEATURES)
 		return "ConnectionFeatures";
 	if (cmd >= ARRAY_SIZE(cmdnames))
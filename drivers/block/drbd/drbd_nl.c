@@ -2038,6 +2038,18 @@ _check_net_options(struct drbd_connection *connection, struct net_conf *old_net_
 	if (new_net_conf->on_congestion != OC_BLOCK && new_net_conf->wire_protocol != DRBD_PROT_A)
 		return ERR_CONG_NOT_PROTO_A;
 
+	if (new_net_conf->data_streams < DRBD_DATA_STREAMS_MIN ||
+	    new_net_conf->data_streams > DRBD_DATA_STREAMS_MAX)
+		return ERR_DATA_STREAMS;
+
+	/* The additional data streams are not authenticated, and their
+	 * receivers can not share one data integrity tfm. */
+	if ((new_net_conf->data_streams > 1 ||
+	     (connection->cstate >= C_WF_REPORT_PARAMS &&
+	      connection->agreed_data_streams > 1)) &&
+	    (new_net_conf->cram_hmac_alg[0] || new_net_conf->integrity_alg[0]))
+		return ERR_DATA_STREAMS;
+
 	return NO_ERROR;
 }
 
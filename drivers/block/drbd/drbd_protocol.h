@@ -67,6 +67,8 @@ enum drbd_packet {
 
 	P_INITIAL_META	      = 0xfff1, /* First Packet on the MetaSock */
 	P_INITIAL_DATA	      = 0xfff2, /* First Packet on the Socket */
+	P_INITIAL_STREAM      = 0xfff3, /* First Packet on an additional data stream,
+					 * the volume field holds the stream number */
 
 	P_CONNECTION_FEATURES = 0xfffe	/* FIXED for the next century! */
 };
@@ -161,6 +163,7 @@ struct p_block_req {
  */
 
 #define FF_TRIM      1
+#define FF_DATA_STREAMS 2
 
 struct p_connection_features {
 	u32 protocol_min;
@@ -168,10 +171,10 @@ struct p_connection_features {
 	u32 protocol_max;
 
 	/* should be more than enough for future enhancements
-	 * for now, feature_flags and the reserved array shall be zero.
+	 * for now, the reserved array shall be zero.
 	 */
 
-	u32 _pad;
+	u32 data_streams;	/* only valid with FF_DATA_STREAMS */
 	u64 reserved[7];
 } __packed;
 
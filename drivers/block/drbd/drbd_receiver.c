@@ -48,13 +48,14 @@
 #include "drbd_req.h"
 #include "drbd_vli.h"
 
-#define PRO_FEATURES (FF_TRIM)
+#define PRO_FEATURES (FF_TRIM | FF_DATA_STREAMS)
 
 struct packet_info {
 	enum drbd_packet cmd;
 	unsigned int size;
 	unsigned int vnr;
 	void *data;
+	struct socket *sock;	/* the payload is still to be read from */
 };
 
 enum finish_epoch {
@@ -490,11 +491,12 @@ static int drbd_recv_short(struct socket *sock, void *buf, size_t size, int flag
 	return kernel_recvmsg(sock, &msg, &iov, 1, size, msg.msg_flags);
 }
 
-static int drbd_recv(struct drbd_connection *connection, void *buf, size_t size)
+static int drbd_recv_sock(struct drbd_connection *connection, struct socket *sock,
+			  void *buf, size_t size)
 {
 	int rv;
 
-	rv = drbd_recv_short(connection->data.socket, buf, size, 0);
+	rv = drbd_recv_short(sock, buf, size, 0);
 
 	if (rv < 0) {
 		if (rv == -ECONNRESET)
@@ -523,11 +525,17 @@ out:
 	return rv;
 }
 
-static int drbd_recv_all(struct drbd_connection *connection, void *buf, size_t size)
+static int drbd_recv(struct drbd_connection *connection, void *buf, size_t size)
+{
+	return drbd_recv_sock(connection, connection->data.socket, buf, size);
+}
+
+static int drbd_recv_all_sock(struct drbd_connection *connection, struct socket *sock,
+			      void *buf, size_t size)
 {
 	int err;
 
-	err = drbd_recv(connection, buf, size);
+	err = drbd_recv_sock(connection, sock, buf, size);
 	if (err != size) {
 		if (err >= 0)
 			err = -EIO;
@@ -536,16 +544,27 @@ static int drbd_recv_all(struct drbd_connection *connection, void *buf, size_t s
 	return err;
 }
 
-static int drbd_recv_all_warn(struct drbd_connection *connection, void *buf, size_t size)
+static int drbd_recv_all(struct drbd_connection *connection, void *buf, size_t size)
+{
+	return drbd_recv_all_sock(connection, connection->data.socket, buf, size);
+}
+
+static int drbd_recv_all_warn_sock(struct drbd_connection *connection, struct socket *sock,
+				   void *buf, size_t size)
 {
 	int err;
 
-	err = drbd_recv_all(connection, buf, size);
+	err = drbd_recv_all_sock(connection, sock, buf, size);
 	if (err && !signal_pending(current))
 		drbd_warn(connection, "short read (expected size %d)\n", (int)size);
 	return err;
 }
 
+static int drbd_recv_all_warn(struct drbd_connection *connection, void *buf, size_t size)
+{
+	return drbd_recv_all_warn_sock(connection, connection->data.socket, buf, size);
+}
+
 /* quoting tcp(7):
  *   On individual connections, the socket buffer size must be set prior to the
  *   listen(2) or connect(2) calls in order to have it take effect.
@@ -790,7 +809,8 @@ static int send_first_packet(struct drbd_connection *connection, struct drbd_soc
 	return conn_send_command(connection, sock, cmd, 0, NULL, 0);
 }
 
-static int receive_first_packet(struct drbd_connection *connection, struct socket *sock)
+static int receive_first_packet(struct drbd_connection *connection, struct socket *sock,
+				unsigned int *vnr)
 {
 	unsigned int header_size = drbd_header_size(connection);
 	struct packet_info pi;
@@ -815,6 +835,8 @@ static int receive_first_packet(struct drbd_connection *connection, struct socke
 	err = decode_header(connection, connection->data.rbuf, &pi);
 	if (err)
 		return err;
+	if (vnr)
+		*vnr = pi.vnr;
 	return pi.cmd;
 }
 
@@ -892,6 +914,117 @@ int drbd_connected(struct drbd_peer_device *peer_device)
 	return err;
 }
 
+static int connect_data_streams(struct drbd_connection *connection)
+{
+	unsigned long deadline;
+	struct net_conf *nc;
+	unsigned int i;
+
+	rcu_read_lock();
+	nc = rcu_dereference(connection->net_conf);
+	if (!nc) {
+		rcu_read_unlock();
+		return -EIO;
+	}
+	deadline = jiffies + nc->connect_int * HZ;
+	rcu_read_unlock();
+
+	for (i = 1; i < connection->agreed_data_streams; i++) {
+		struct drbd_socket *sock = &connection->stream[i].extra;
+
+		/* The peer may not be listening yet */
+		while (!(sock->socket = drbd_try_connect(connection))) {
+			if (connection->cstate <= C_DISCONNECTING ||
+			    signal_pending(current) || time_after(jiffies, deadline))
+				return -EIO;
+			schedule_timeout_interruptible(HZ / 10);
+		}
+		if (drbd_send_initial_stream(connection, sock, i))
+			return -EIO;
+	}
+	return 0;
+}
+
+static int accept_data_streams(struct drbd_connection *connection)
+{
+	unsigned int missing = connection->agreed_data_streams - 1;
+	struct accept_wait_data ad = {
+		.connection = connection,
+		.door_bell = COMPLETION_INITIALIZER_ONSTACK(ad.door_bell),
+	};
+	int err = -EIO;
+
+	if (prepare_listen_socket(connection, &ad))
+		return -EIO;
+
+	while (missing) {
+		struct drbd_socket *sock;
+		unsigned int nr;
+		struct socket *s;
+		int fp;
+
+		s = drbd_wait_for_connect(connection, &ad);
+		if (!s)
+			goto out;
+
+		fp = receive_first_packet(connection, s, &nr);
+		if (fp != P_INITIAL_STREAM ||
+		    nr == 0 || nr >= connection->agreed_data_streams ||
+		    connection->stream[nr].extra.socket) {
+			drbd_warn(connection, "Error receiving initial stream packet\n");
+			sock_release(s);
+			goto out;
+		}
+		sock = &connection->stream[nr].extra;
+		sock->socket = s;
+		missing--;
+	}
+	err = 0;
+out:
+	sock_release(ad.s_listen);
+	return err;
+}
+
+/* The additional data streams are connected once the main handshake agreed
+ * to use them.  The side that resolves conflicts listens, the other one
+ * connects and names the stream in the volume field of P_INITIAL_STREAM. */
+static int conn_connect_data_streams(struct drbd_connection *connection)
+{
+	struct net_conf *nc;
+	unsigned int i;
+	int timeout, err;
+
+	if (drbd_alloc_data_streams(connection))
+		return -ENOMEM;
+
+	if (test_bit(RESOLVE_CONFLICTS, &connection->flags))
+		err = accept_data_streams(connection);
+	else
+		err = connect_data_streams(connection);
+	if (err)
+		return err;
+
+	rcu_read_lock();
+	nc = rcu_dereference(connection->net_conf);
+	timeout = nc->timeout * HZ / 10;
+	rcu_read_unlock();
+
+	for (i = 1; i < connection->agreed_data_streams; i++) {
+		struct socket *s = connection->stream[i].extra.socket;
+
+		s->sk->sk_reuse = SK_CAN_REUSE; /* SO_REUSEADDR */
+		s->sk->sk_allocation = GFP_NOIO;
+		s->sk->sk_priority = TC_PRIO_INTERACTIVE_BULK;
+		s->sk->sk_sndtimeo = timeout;
+		s->sk->sk_rcvtimeo = MAX_SCHEDULE_TIMEOUT;
+		drbd_tcp_nodelay(s);
+	}
+
+	drbd_info(connection, "Connected %u data streams\n",
+		  connection->agreed_data_streams);
+	return 0;
+}
+
 /*
  * return values:
  *   1 yes, we have a valid connection
@@ -905,7 +1038,7 @@ static int conn_connect(struct drbd_connection *connection)
 	struct drbd_socket sock, msock;
 	struct drbd_peer_device *peer_device;
 	struct net_conf *nc;
-	int vnr, timeout, h;
+	int vnr, timeout, h, i;
 	bool discard_my_data, ok;
 	enum drbd_state_rv rv;
 	struct accept_wait_data ad = {
@@ -956,7 +1089,7 @@ static int conn_connect(struct drbd_connection *connection)
 retry:
 		s = drbd_wait_for_connect(connection, &ad);
 		if (s) {
-			int fp = receive_first_packet(connection, s);
+			int fp = receive_first_packet(connection, s, NULL);
 			drbd_socket_okay(&sock.socket);
 			drbd_socket_okay(&msock.socket);
 			switch (fp) {
@@ -1055,6 +1188,10 @@ randomize:
 		}
 	}
 
+	if (connection->agreed_data_streams > 1 &&
+	    conn_connect_data_streams(connection))
+		return 0;
+
 	connection->data.socket->sk->sk_sndtimeo = timeout;
 	connection->data.socket->sk->sk_rcvtimeo = MAX_SCHEDULE_TIMEOUT;
 
@@ -1101,6 +1238,12 @@ randomize:
 
 	drbd_thread_start(&connection->asender);
 
+	connection->stream_epochs = 0;
+	for (i = 0; i < connection->agreed_data_streams; i++)
+		connection->stream[i].barriers = 0;
+	for (i = 1; i < connection->agreed_data_streams; i++)
+		drbd_thread_start(&connection->stream[i].receiver);
+
 	mutex_lock(&connection->resource->conf_update);
 	/* The discard_my_data flag is a single-shot modifier to the next
 	 * connection attempt, the handshake of which is now well underway.
@@ -1167,6 +1310,7 @@ static int drbd_recv_header(struct drbd_connection *connection, struct packet_in
 		return err;
 
 	err = decode_header(connection, buffer, pi);
+	pi->sock = connection->data.socket;
 	connection->last_received = jiffies;
 
 	return err;
@@ -1514,7 +1658,7 @@ conn_peer_device(struct drbd_connection *connection, int volume_number)
 	return idr_find(&connection->peer_devices, volume_number);
 }
 
-static int receive_Barrier(struct drbd_connection *connection, struct packet_info *pi)
+static int __receive_Barrier(struct drbd_connection *connection, struct packet_info *pi)
 {
 	int rv;
 	struct p_barrier *p = pi->data;
@@ -1582,6 +1726,68 @@ static int receive_Barrier(struct drbd_connection *connection, struct packet_inf
 	return 0;
 }
 
+static bool data_streams_at_barrier(struct drbd_connection *connection)
+{
+	unsigned int i;
+
+	for (i = 1; i < connection->agreed_data_streams; i++)
+		if (connection->stream[i].barriers <= connection->stream_epochs)
+			return false;
+	return true;
+}
+
+/* Called by the receiver of every data stream for each P_BARRIER.  The
+ * receiver of stream 0 waits for all others to get there, so the writes
+ * of all streams are in connection->current_epoch, then closes it.  The
+ * others wait for that before they read any write of the next epoch. */
+static int data_stream_barrier(struct drbd_connection *connection,
+			       struct drbd_data_stream *stream,
+			       struct packet_info *pi)
+{
+	unsigned long start = jiffies;
+	int err;
+
+	stream->barriers++;
+	if (stream->nr) {
+		wake_up(&connection->stream_wait);
+		if (connection->stream_epochs >= stream->barriers)
+			return 0;
+		stream->barrier_waits++;
+		err = wait_event_interruptible(connection->stream_wait,
+			connection->stream_epochs >= stream->barriers ||
+			connection->cstate < C_WF_REPORT_PARAMS);
+		stream->barrier_wait_jif += jiffies - start;
+		if (!err && connection->cstate < C_WF_REPORT_PARAMS)
+			err = -EIO;
+		return err;
+	}
+
+	if (!data_streams_at_barrier(connection)) {
+		stream->barrier_waits++;
+		err = wait_event_interruptible(connection->stream_wait,
+			data_streams_at_barrier(connection) ||
+			connection->cstate < C_WF_REPORT_PARAMS);
+		stream->barrier_wait_jif += jiffies - start;
+		if (err)
+			return err;
+		if (connection->cstate < C_WF_REPORT_PARAMS)
+			return -EIO;
+	}
+
+	err = __receive_Barrier(connection, pi);
+	connection->stream_epochs++;
+	wake_up(&connection->stream_wait);
+	return err;
+}
+
+static int receive_Barrier(struct drbd_connection *connection, struct packet_info *pi)
+{
+	if (connection->agreed_data_streams > 1)
+		return data_stream_barrier(connection, &connection->stream[0], pi);
+	connection->stream[0].barriers++;
+	return __receive_Barrier(connection, pi);
+}
+
 /* used from receive_RSDataReply (recv_resync_read)
  * and from receive_Data */
 static struct drbd_peer_request *
@@ -1606,7 +1812,8 @@ read_in_block(struct drbd_peer_device *peer_device, u64 id, sector_t sector,
 		 * FIXME: Receive the incoming digest into the receive buffer
 		 *	  here, together with its struct p_data?
 		 */
-		err = drbd_recv_all_warn(peer_device->connection, dig_in, digest_size);
+		err = drbd_recv_all_warn_sock(peer_device->connection, pi->sock,
+					      dig_in, digest_size);
 		if (err)
 			return NULL;
 		data_size -= digest_size;
@@ -1649,7 +1856,7 @@ read_in_block(struct drbd_peer_device *peer_device, u64 id, sector_t sector,
 	page_chain_for_each(page) {
 		unsigned len = min_t(int, ds, PAGE_SIZE);
 		data = kmap(page);
-		err = drbd_recv_all_warn(peer_device->connection, data, len);
+		err = drbd_recv_all_warn_sock(peer_device->connection, pi->sock, data, len);
 		if (drbd_insert_fault(device, DRBD_FAULT_RECEIVE)) {
 			drbd_err(device, "Fault injection: Corrupting data on receive\n");
 			data[0] = data[0] ^ (unsigned long)-1;
@@ -1678,8 +1885,9 @@ read_in_block(struct drbd_peer_device *peer_device, u64 id, sector_t sector,
 /* drbd_drain_block() just takes a data block
  * out of the socket input buffer, and discards it.
  */
-static int drbd_drain_block(struct drbd_peer_device *peer_device, int data_size)
+static int drbd_drain_block(struct drbd_peer_device *peer_device, struct packet_info *pi)
 {
+	int data_size = pi->size;
 	struct page *page;
 	int err = 0;
 	void *data;
@@ -1693,7 +1901,7 @@ static int drbd_drain_block(struct drbd_peer_device *peer_device, int data_size)
 	while (data_size) {
 		unsigned int len = min_t(int, data_size, PAGE_SIZE);
 
-		err = drbd_recv_all_warn(peer_device->connection, data, len);
+		err = drbd_recv_all_warn_sock(peer_device->connection, pi->sock, data, len);
 		if (err)
 			break;
 		data_size -= len;
@@ -1896,7 +2104,7 @@ static int receive_RSDataReply(struct drbd_connection *connection, struct packet
 		if (__ratelimit(&drbd_ratelimit_state))
 			drbd_err(device, "Can not write resync data to local disk.\n");
 
-		err = drbd_drain_block(peer_device, pi->size);
+		err = drbd_drain_block(peer_device, pi);
 
 		drbd_send_ack_dp(peer_device, P_NEG_ACK, p, pi->size);
 	}
@@ -2292,7 +2500,7 @@ static int receive_Data(struct drbd_connection *connection, struct packet_info *
 		err = wait_for_and_update_peer_seq(peer_device, peer_seq);
 		drbd_send_ack_dp(peer_device, P_NEG_ACK, p, pi->size);
 		atomic_inc(&connection->current_epoch->epoch_size);
-		err2 = drbd_drain_block(peer_device, pi->size);
+		err2 = drbd_drain_block(peer_device, pi);
 		if (!err)
 			err = err2;
 		return err;
@@ -2566,7 +2774,7 @@ static int receive_DataRequest(struct drbd_connection *connection, struct packet
 			    "no local data.\n");
 
 		/* drain possibly payload */
-		return drbd_drain_block(peer_device, pi->size);
+		return drbd_drain_block(peer_device, pi);
 	}
 
 	/* GFP_NOIO, because we must not cause arbitrary write-out: in a DRBD
@@ -3317,6 +3525,13 @@ static int receive_protocol(struct drbd_connection *connection, struct packet_in
 		integrity_alg[SHARED_SECRET_MAX - 1] = 0;
 	}
 
+	/* The receivers of the data streams would share the peer's tfm */
+	if (integrity_alg[0] && connection->agreed_data_streams > 1) {
+		drbd_err(connection, "data-integrity-alg not supported with %u data streams\n",
+			 connection->agreed_data_streams);
+		goto disconnect;
+	}
+
 	if (pi->cmd != P_PROTOCOL_UPDATE) {
 		clear_bit(CONN_DRY_RUN, &connection->flags);
 
@@ -4561,6 +4776,16 @@ static int receive_out_of_sync(struct drbd_connection *connection, struct packet
 	return 0;
 }
 
+static void data_stream_account(struct drbd_data_stream *stream, struct packet_info *pi)
+{
+	unsigned int size = pi->size;
+
+	if (pi->cmd == P_TRIM)
+		size = be32_to_cpu(((struct p_trim *)pi->data)->size);
+	stream->recv_writes++;
+	stream->recv_sectors += size >> 9;
+}
+
 struct data_cmd {
 	int expect_payload;
 	size_t pkt_size;
@@ -4631,6 +4856,9 @@ static void drbdd(struct drbd_connection *connection)
 			pi.size -= shs;
 		}
 
+		if (pi.cmd == P_DATA || pi.cmd == P_TRIM)
+			data_stream_account(&connection->stream[0], &pi);
+
 		update_receiver_timing_details(connection, cmd->fn);
 		err = cmd->fn(connection, &pi);
 		if (err) {
@@ -4645,11 +4873,74 @@ static void drbdd(struct drbd_connection *connection)
 	conn_request_state(connection, NS(conn, C_PROTOCOL_ERROR), CS_HARD);
 }
 
+/* Receiver of one of the additional data streams.  Nothing but writes and
+ * the barriers between them arrive here, see struct drbd_data_stream. */
+int drbd_stream_receiver(struct drbd_thread *thi)
+{
+	struct drbd_data_stream *stream =
+		container_of(thi, struct drbd_data_stream, receiver);
+	struct drbd_connection *connection = thi->connection;
+	struct drbd_socket *sock = stream->sock;
+	struct packet_info pi;
+	size_t shs;
+	int err;
+
+	while (get_t_state(thi) == RUNNING) {
+		err = drbd_recv_all_warn_sock(connection, sock->socket, sock->rbuf,
+					      drbd_header_size(connection));
+		if (err)
+			goto err_out;
+		err = decode_header(connection, sock->rbuf, &pi);
+		if (err)
+			goto err_out;
+		pi.sock = sock->socket;
+		connection->last_received = jiffies;
+
+		if (pi.cmd != P_DATA && pi.cmd != P_TRIM && pi.cmd != P_BARRIER) {
+			drbd_err(connection, "Unexpected packet %s (0x%04x) on data stream %u\n",
+				 cmdname(pi.cmd), pi.cmd, stream->nr);
+			err = -EINVAL;
+			goto err_out;
+		}
+
+		shs = drbd_cmd_handler[pi.cmd].pkt_size;
+		if (pi.size < shs ||
+		    (pi.size > shs && !drbd_cmd_handler[pi.cmd].expect_payload)) {
+			drbd_err(connection, "Wrong packet size %s l:%d\n",
+				 cmdname(pi.cmd), pi.size);
+			err = -EINVAL;
+			goto err_out;
+		}
+		err = drbd_recv_all_warn_sock(connection, pi.sock, pi.data, shs);
+		if (err)
+			goto err_out;
+		pi.size -= shs;
+
+		if (pi.cmd == P_BARRIER) {
+			err = data_stream_barrier(connection, stream, &pi);
+		} else {
+			data_stream_account(stream, &pi);
+			err = receive_Data(connection, &pi);
+		}
+		if (err) {
+			drbd_err(connection, "error receiving %s on data stream %u, e: %d l: %d!\n",
+				 cmdname(pi.cmd), stream->nr, err, pi.size);
+			goto err_out;
+		}
+	}
+	return 0;
+
+err_out:
+	if (get_t_state(thi) == RUNNING)
+		conn_request_state(connection, NS(conn, C_PROTOCOL_ERROR), CS_HARD);
+	return 0;
+}
+
 static void conn_disconnect(struct drbd_connection *connection)
 {
 	struct drbd_peer_device *peer_device;
 	enum drbd_conns oc;
-	int vnr;
+	int vnr, i;
 
 	if (connection->cstate == C_STANDALONE)
 		return;
@@ -4663,6 +4954,9 @@ static void conn_disconnect(struct drbd_connection *connection)
 
 	/* asender does not clean up anything. it must not interfere, either */
 	drbd_thread_stop(&connection->asender);
+	/* the data stream receivers submit peer requests, like we do */
+	for (i = 1; i < DRBD_DATA_STREAMS_MAX; i++)
+		drbd_thread_stop(&connection->stream[i].receiver);
 	drbd_free_sock(connection);
 
 	rcu_read_lock();
@@ -4791,6 +5085,24 @@ static int drbd_disconnected(struct drbd_peer_device *peer_device)
  *
  * for now, they are expected to be zero, but ignored.
  */
+/* How many data streams we are willing to use */
+static unsigned int conn_offered_data_streams(struct drbd_connection *connection)
+{
+	struct net_conf *nc;
+	unsigned int n = 1;
+
+	rcu_read_lock();
+	nc = rcu_dereference(connection->net_conf);
+	/* The additional sockets are not covered by the cram-hmac auth,
+	 * and read_in_block() is not reentrant with a data integrity alg. */
+	if (nc && !nc->cram_hmac_alg[0] && !nc->integrity_alg[0])
+		n = clamp_t(unsigned int, nc->data_streams,
+			    DRBD_DATA_STREAMS_MIN, DRBD_DATA_STREAMS_MAX);
+	rcu_read_unlock();
+
+	return n;
+}
+
 static int drbd_send_features(struct drbd_connection *connection)
 {
 	struct drbd_socket *sock;
@@ -4804,6 +5116,7 @@ static int drbd_send_features(struct drbd_connection *connection)
 	p->protocol_min = cpu_to_be32(PRO_VERSION_MIN);
 	p->protocol_max = cpu_to_be32(PRO_VERSION_MAX);
 	p->feature_flags = cpu_to_be32(PRO_FEATURES);
+	p->data_streams = cpu_to_be32(conn_offered_data_streams(connection));
 	return conn_send_command(connection, sock, P_CONNECTION_FEATURES, sizeof(*p), NULL, 0);
 }
 
@@ -4865,6 +5178,16 @@ static int drbd_do_features(struct drbd_connection *connection)
 	drbd_info(connection, "Agreed to%ssupport TRIM on protocol level\n",
 		  connection->agreed_features & FF_TRIM ? " " : " not ");
 
+	connection->agreed_data_streams = 1;
+	if (connection->agreed_features & FF_DATA_STREAMS &&
+	    connection->agreed_pro_version >= 100)
+		connection->agreed_data_streams =
+			clamp_t(unsigned int, be32_to_cpu(p->data_streams),
+				1, conn_offered_data_streams(connection));
+	if (connection->agreed_data_streams > 1)
+		drbd_info(connection, "Agreed to use %u data streams\n",
+			  connection->agreed_data_streams);
+
 	return 1;
 
  incompat:
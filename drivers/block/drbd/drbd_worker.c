@@ -1279,22 +1279,34 @@ int w_e_end_ov_reply(struct drbd_work *w, int cancel)
  * and to be able to wait for them.
  * See also comment in drbd_adm_attach before drbd_suspend_io.
  */
-static int drbd_send_barrier(struct drbd_connection *connection)
+static int __drbd_send_barrier(struct drbd_connection *connection,
+			       struct drbd_socket *sock)
 {
 	struct p_barrier *p;
-	struct drbd_socket *sock;
 
-	sock = &connection->data;
 	p = conn_prepare_command(connection, sock);
 	if (!p)
 		return -EIO;
 	p->barrier = connection->send.current_epoch_nr;
 	p->pad = 0;
-	connection->send.current_epoch_writes = 0;
 
 	return conn_send_command(connection, sock, P_BARRIER, sizeof(*p), NULL, 0);
 }
 
+/* Every data stream carries every barrier, so the receivers of all
+ * streams can agree on where the epoch ends. */
+static int drbd_send_barrier(struct drbd_connection *connection)
+{
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < connection->agreed_data_streams && !err; i++)
+		err = __drbd_send_barrier(connection, connection->stream[i].sock);
+	if (!err)
+		connection->send.current_epoch_writes = 0;
+	return err;
+}
+
 int w_send_write_hint(struct drbd_work *w, int cancel)
 {
 	struct drbd_device *device =
@@ -1975,6 +1987,24 @@ static bool dequeue_work_batch(struct drbd_work_queue *queue, struct list_head *
 	return !list_empty(work_list);
 }
 
+static void drbd_cork_data_streams(struct drbd_connection *connection, bool cork)
+{
+	unsigned int i;
+
+	for (i = 0; i < connection->agreed_data_streams; i++) {
+		struct drbd_socket *sock = connection->stream[i].sock;
+
+		mutex_lock(&sock->mutex);
+		if (sock->socket) {
+			if (cork)
+				drbd_tcp_cork(sock->socket);
+			else
+				drbd_tcp_uncork(sock->socket);
+		}
+		mutex_unlock(&sock->mutex);
+	}
+}
+
 static void wait_for_work(struct drbd_connection *connection, struct list_head *work_list)
 {
 	DEFINE_WAIT(wait);
@@ -1995,12 +2025,8 @@ static void wait_for_work(struct drbd_connection *connection, struct list_head *
 	nc = rcu_dereference(connection->net_conf);
 	uncork = nc ? nc->tcp_cork : 0;
 	rcu_read_unlock();
-	if (uncork) {
-		mutex_lock(&connection->data.mutex);
-		if (connection->data.socket)
-			drbd_tcp_uncork(connection->data.socket);
-		mutex_unlock(&connection->data.mutex);
-	}
+	if (uncork)
+		drbd_cork_data_streams(connection, false);
 
 	for (;;) {
 		int send_barrier;
@@ -2050,14 +2076,10 @@ static void wait_for_work(struct drbd_connection *connection, struct list_head *
 	nc = rcu_dereference(connection->net_conf);
 	cork = nc ? nc->tcp_cork : 0;
 	rcu_read_unlock();
-	mutex_lock(&connection->data.mutex);
-	if (connection->data.socket) {
-		if (cork)
-			drbd_tcp_cork(connection->data.socket);
-		else if (!uncork)
-			drbd_tcp_uncork(connection->data.socket);
-	}
-	mutex_unlock(&connection->data.mutex);
+	if (cork)
+		drbd_cork_data_streams(connection, true);
+	else if (!uncork)
+		drbd_cork_data_streams(connection, false);
 }
 
 int drbd_worker(struct drbd_thread *thi)
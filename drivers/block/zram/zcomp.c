@@ -19,6 +19,9 @@
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 #include "zcomp_lz4.h"
 #endif
+#ifdef CONFIG_ZRAM_DEFLATE_COMPRESS
+#include "zcomp_deflate.h"
+#endif
 
 /*
  * single zcomp_strm backend
@@ -47,6 +50,9 @@ static struct zcomp_backend *backends[] = {
 	&zcomp_lzo,
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 	&zcomp_lz4,
+#endif
+#ifdef CONFIG_ZRAM_DEFLATE_COMPRESS
+	&zcomp_deflate,
 #endif
 	NULL
 };
@@ -322,6 +328,8 @@ int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
 void zcomp_destroy(struct zcomp *comp)
 {
 	comp->destroy(comp);
+	if (comp->backend->exit)
+		comp->backend->exit();
 	kfree(comp);
 }
 
@@ -348,11 +356,21 @@ struct zcomp *zcomp_create(const char *compress, int max_strm)
 		return ERR_PTR(-ENOMEM);
 
 	comp->backend = backend;
+	if (backend->init) {
+		error = backend->init();
+		if (error) {
+			kfree(comp);
+			return ERR_PTR(error);
+		}
+	}
+
 	if (max_strm > 1)
 		error = zcomp_strm_multi_create(comp, max_strm);
 	else
 		error = zcomp_strm_single_create(comp);
 	if (error) {
+		if (backend->exit)
+			backend->exit();
 		kfree(comp);
 		return ERR_PTR(error);
 	}
@@ -36,6 +36,10 @@ struct zcomp_backend {
 	void *(*create)(void);
 	void (*destroy)(void *private);
 
+	/* optional, called once per zcomp instance */
+	int (*init)(void);
+	void (*exit)(void);
+
 	const char *name;
 };
 
@@ -0,0 +1,173 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/zlib.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+
+#include "zcomp_deflate.h"
+
+/* raw deflate, a page never needs more than a 4K window */
+#define DEFLATE_WINBITS		12
+#define DEFLATE_MEMLEVEL	MAX_MEM_LEVEL
+
+/*
+ * ->decompress() has no stream, so the inflate workspaces are per-cpu
+ * and shared by every device using deflate. Decompression runs with the
+ * zsmalloc object mapped, hence with preemption disabled.
+ */
+static DEFINE_MUTEX(inflate_ws_lock);
+static void * __percpu *inflate_ws;
+static int inflate_ws_users;
+
+static void inflate_ws_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		vfree(*per_cpu_ptr(inflate_ws, cpu));
+	free_percpu(inflate_ws);
+	inflate_ws = NULL;
+}
+
+static int zcomp_deflate_init(void)
+{
+	int cpu, ret = 0;
+
+	mutex_lock(&inflate_ws_lock);
+	if (inflate_ws_users++)
+		goto out;
+
+	inflate_ws = alloc_percpu(void *);
+	if (!inflate_ws) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+	for_each_possible_cpu(cpu) {
+		void *ws = vmalloc(zlib_inflate_workspacesize());
+
+		if (!ws) {
+			inflate_ws_free();
+			ret = -ENOMEM;
+			goto fail;
+		}
+		*per_cpu_ptr(inflate_ws, cpu) = ws;
+	}
+	goto out;
+fail:
+	inflate_ws_users--;
+out:
+	mutex_unlock(&inflate_ws_lock);
+	return ret;
+}
+
+static void zcomp_deflate_exit(void)
+{
+	mutex_lock(&inflate_ws_lock);
+	if (!--inflate_ws_users)
+		inflate_ws_free();
+	mutex_unlock(&inflate_ws_lock);
+}
+
+static void *zcomp_deflate_create(void)
+{
+	struct z_stream_s *stream;
+	size_t size;
+
+	/* same allocation rules as the lzo and lz4 streams */
+	stream = kzalloc(sizeof(*stream), GFP_NOIO | __GFP_NORETRY |
+					__GFP_NOWARN);
+	if (!stream)
+		return NULL;
+
+	size = zlib_deflate_workspacesize(-DEFLATE_WINBITS, DEFLATE_MEMLEVEL);
+	stream->workspace = __vmalloc(size, GFP_NOIO | __GFP_NORETRY |
+				      __GFP_NOWARN | __GFP_HIGHMEM,
+				      PAGE_KERNEL);
+	if (!stream->workspace)
+		goto out_free;
+
+	if (zlib_deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+			      -DEFLATE_WINBITS, DEFLATE_MEMLEVEL,
+			      Z_DEFAULT_STRATEGY) != Z_OK)
+		goto out_free;
+
+	return stream;
+
+out_free:
+	vfree(stream->workspace);
+	kfree(stream);
+	return NULL;
+}
+
+static void zcomp_deflate_destroy(void *private)
+{
+	struct z_stream_s *stream = private;
+
+	zlib_deflateEnd(stream);
+	vfree(stream->workspace);
+	kfree(stream);
+}
+
+static int zcomp_deflate_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	struct z_stream_s *stream = private;
+	int ret;
+
+	if (zlib_deflateReset(stream) != Z_OK)
+		return -EINVAL;
+
+	stream->next_in = src;
+	stream->avail_in = PAGE_SIZE;
+	stream->next_out = dst;
+	/* zcomp stream buffers are two pages */
+	stream->avail_out = 2 * PAGE_SIZE;
+
+	ret = zlib_deflate(stream, Z_FINISH);
+	if (ret != Z_STREAM_END)
+		return -EINVAL;
+
+	*dst_len = stream->total_out;
+	return 0;
+}
+
+static int zcomp_deflate_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst)
+{
+	struct z_stream_s stream;
+	int ret;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.workspace = *this_cpu_ptr(inflate_ws);
+	if (zlib_inflateInit2(&stream, -DEFLATE_WINBITS) != Z_OK)
+		return -EINVAL;
+
+	stream.next_in = src;
+	stream.avail_in = src_len;
+	stream.next_out = dst;
+	stream.avail_out = PAGE_SIZE;
+
+	ret = zlib_inflate(&stream, Z_FINISH);
+	if (ret != Z_STREAM_END || stream.total_out != PAGE_SIZE)
+		return -EINVAL;
+	return 0;
+}
+
+struct zcomp_backend zcomp_deflate = {
+	.compress = zcomp_deflate_compress,
+	.decompress = zcomp_deflate_decompress,
+	.create = zcomp_deflate_create,
+	.destroy = zcomp_deflate_destroy,
+	.init = zcomp_deflate_init,
+	.exit = zcomp_deflate_exit,
+	.name = "deflate",
+};
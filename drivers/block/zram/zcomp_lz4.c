@@ -8,6 +8,7 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/lz4.h>
 #include <linux/vmalloc.h>
@@ -15,6 +16,14 @@
 
 #include "zcomp_lz4.h"
 
+/*
+ * Higher values make the compressor skip ahead faster over data that
+ * does not match, trading compression ratio for swap-out latency.
+ */
+static int lz4_acceleration = LZ4_ACCELERATION_DEFAULT;
+module_param(lz4_acceleration, int, 0644);
+MODULE_PARM_DESC(lz4_acceleration, "lz4 acceleration (1 = best ratio)");
+
 static void *zcomp_lz4_create(void)
 {
 	void *ret;
@@ -45,8 +54,11 @@ static void zcomp_lz4_destroy(void *private)
 static int zcomp_lz4_compress(const unsigned char *src, unsigned char *dst,
 		size_t *dst_len, void *private)
 {
+	*dst_len = lz4_compressbound(PAGE_SIZE);
+
 	/* return  : Success if return 0 */
-	return lz4_compress(src, PAGE_SIZE, dst, dst_len, private);
+	return lz4_compress_fast(src, PAGE_SIZE, dst, dst_len, private,
+				 READ_ONCE(lz4_acceleration));
 }
 
 static int zcomp_lz4_decompress(const unsigned char *src, size_t src_len,
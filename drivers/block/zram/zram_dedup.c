@@ -0,0 +1,228 @@
+/*
+ * Content based deduplication of zram's compressed objects
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/*
+ * Identical pages compress to identical objects, so the hash is over the
+ * compressed bytes and a lookup is a memcmp() against the mapped object.
+ * Slots sharing an object point at its zram_entry instead of the handle.
+ */
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	/* protected by the bucket lock */
+	unsigned long refcount;
+	unsigned long handle;
+	size_t len;
+};
+
+/* one bucket per this many pages of disksize */
+#define ZRAM_HASH_PAGES_SHIFT	4
+
+static struct zram_hash *zram_dedup_bucket(struct zram_meta *meta,
+					   u32 checksum)
+{
+	return &meta->hash[checksum & (meta->hash_size - 1)];
+}
+
+unsigned long zram_dedup_handle(struct zram_entry *entry)
+{
+	return entry->handle;
+}
+
+/*
+ * Unlocked, only a hint for writeback and recompression.
+ */
+bool zram_dedup_shared(struct zram_entry *entry)
+{
+	return READ_ONCE(entry->refcount) > 1;
+}
+
+/*
+ * Returns the entry holding an object identical to @mem with a reference
+ * taken, or NULL with @checksum set for zram_dedup_insert().
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				   size_t len, u32 *checksum)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_entry *entry, *found = NULL;
+	struct zram_hash *hash;
+	struct rb_node *node;
+	unsigned char *cmem;
+
+	*checksum = jhash(mem, len, 0);
+	hash = zram_dedup_bucket(meta, *checksum);
+
+	spin_lock(&hash->lock);
+	node = hash->rb_root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (*checksum == entry->checksum)
+			break;
+		node = *checksum < entry->checksum ?
+			node->rb_left : node->rb_right;
+	}
+
+	/* equal checksums can sit on either side of the first match */
+	while (node) {
+		struct rb_node *prev = rb_prev(node);
+
+		if (!prev || rb_entry(prev, struct zram_entry,
+				      rb_node)->checksum != *checksum)
+			break;
+		node = prev;
+	}
+
+	for (; node; node = rb_next(node)) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (entry->checksum != *checksum)
+			break;
+		if (entry->len != len)
+			continue;
+
+		cmem = zs_map_object(meta->mem_pool, entry->handle, ZS_MM_RO);
+		if (!memcmp(cmem, mem, len))
+			found = entry;
+		zs_unmap_object(meta->mem_pool, entry->handle);
+		if (found) {
+			found->refcount++;
+			break;
+		}
+	}
+	spin_unlock(&hash->lock);
+
+	if (found)
+		atomic64_add(len, &zram->stats.dup_data_size);
+	return found;
+}
+
+/*
+ * Returns NULL if no entry could be allocated, the object then simply
+ * isn't shared.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				     size_t len, u32 checksum)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_entry *entry, *parent;
+	struct zram_hash *hash;
+	struct rb_node **link, *rb_parent = NULL;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NORETRY |
+			__GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->refcount = 1;
+	entry->handle = handle;
+	entry->len = len;
+
+	hash = zram_dedup_bucket(meta, checksum);
+	spin_lock(&hash->lock);
+	link = &hash->rb_root.rb_node;
+	while (*link) {
+		rb_parent = *link;
+		parent = rb_entry(rb_parent, struct zram_entry, rb_node);
+		if (checksum < parent->checksum)
+			link = &rb_parent->rb_left;
+		else
+			link = &rb_parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, rb_parent, link);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/*
+ * Drop a slot's reference and free the object with the last one. The
+ * object is only charged to compr_data_size once, the other slots
+ * sharing it are accounted as dup_data_size.
+ */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash;
+	unsigned long refcount;
+
+	hash = zram_dedup_bucket(meta, entry->checksum);
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return;
+	}
+
+	zs_free(meta->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+}
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t i;
+
+	meta->hash_size = roundup_pow_of_two(max_t(size_t,
+				num_pages >> ZRAM_HASH_PAGES_SHIFT, 1));
+	meta->hash = vzalloc(meta->hash_size * sizeof(struct zram_hash));
+	if (!meta->hash)
+		return -ENOMEM;
+
+	for (i = 0; i < meta->hash_size; i++) {
+		spin_lock_init(&meta->hash[i].lock);
+		meta->hash[i].rb_root = RB_ROOT;
+	}
+	return 0;
+}
+
+/*
+ * Called with the device quiesced, frees every object still shared.
+ */
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	struct zram_entry *entry;
+	struct rb_node *node;
+	size_t i;
+
+	if (!meta->hash)
+		return;
+
+	for (i = 0; i < meta->hash_size; i++) {
+		while ((node = rb_first(&meta->hash[i].rb_root))) {
+			entry = rb_entry(node, struct zram_entry, rb_node);
+			rb_erase(node, &meta->hash[i].rb_root);
+			zs_free(meta->mem_pool, entry->handle);
+			kfree(entry);
+		}
+	}
+	vfree(meta->hash);
+	meta->hash = NULL;
+}
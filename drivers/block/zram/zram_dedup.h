@@ -0,0 +1,48 @@
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+struct zram;
+struct zram_meta;
+struct zram_entry;
+
+#ifdef CONFIG_ZRAM_DEDUP
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				   size_t len, u32 *checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				     size_t len, u32 checksum);
+unsigned long zram_dedup_handle(struct zram_entry *entry);
+bool zram_dedup_shared(struct zram_entry *entry);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages);
+void zram_dedup_fini(struct zram_meta *meta);
+#else
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+		unsigned char *mem, size_t len, u32 *checksum)
+{
+	return NULL;
+}
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, size_t len, u32 checksum)
+{
+	return NULL;
+}
+static inline unsigned long zram_dedup_handle(struct zram_entry *entry)
+{
+	return 0;
+}
+static inline bool zram_dedup_shared(struct zram_entry *entry)
+{
+	return false;
+}
+static inline void zram_dedup_put(struct zram *zram,
+				  struct zram_entry *entry) {}
+
+static inline int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram_meta *meta) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -22,6 +22,7 @@
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/file.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
@@ -30,6 +31,7 @@
 #include <linux/err.h>
 #include <linux/idr.h>
 #include <linux/sysfs.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -39,6 +41,8 @@ static DEFINE_MUTEX(zram_index_mutex);
 
 static int zram_major;
 static const char *default_compressor = "lzo";
+/* per-cpu workers compressing pages for async_write devices */
+static struct workqueue_struct *zram_write_wq;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
@@ -106,6 +110,22 @@ static void zram_set_obj_size(struct zram_meta *meta,
 	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static void zram_set_idle(struct zram *zram, u32 index)
+{
+	if (!zram_test_flag(zram->meta, index, ZRAM_IDLE)) {
+		zram_set_flag(zram->meta, index, ZRAM_IDLE);
+		atomic64_inc(&zram->stats.idle_pages);
+	}
+}
+
+static void zram_clear_idle(struct zram *zram, u32 index)
+{
+	if (zram_test_flag(zram->meta, index, ZRAM_IDLE)) {
+		zram_clear_flag(zram->meta, index, ZRAM_IDLE);
+		atomic64_dec(&zram->stats.idle_pages);
+	}
+}
+
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
 	return bvec->bv_len != PAGE_SIZE;
@@ -157,31 +177,44 @@ static inline void update_used_max(struct zram *zram,
 	} while (old_max != cur_max);
 }
 
-static bool page_zero_filled(void *ptr)
+static bool page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*page) - 1; pos++) {
+		if (page[pos] != page[pos + 1])
 			return false;
 	}
 
+	*element = page[0];
 	return true;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_fill_page(void *ptr, unsigned long len,
+			   unsigned long element)
+{
+	unsigned long *page = ptr;
+	unsigned long pos;
+
+	if (!element) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (pos = 0; pos < len / sizeof(*page); pos++)
+		page[pos] = element;
+}
+
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -346,6 +379,64 @@ out:
 	return ret;
 }
 
+static ssize_t async_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(zram->async_write));
+}
+
+static ssize_t async_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+	int ret;
+
+	ret = strtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(zram->async_write, val);
+	return len;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -385,6 +476,56 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+/*
+ * The secondary algorithm is only used by the recompress attribute,
+ * writing "none" disables it.
+ */
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool none = sysfs_streq(buf, "none");
+	size_t sz;
+
+	if (!none && !zcomp_available_algorithm(buf))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+
+	if (none) {
+		zram->recomp_algorithm[0] = 0x00;
+	} else {
+		strlcpy(zram->recomp_algorithm, buf,
+			sizeof(zram->recomp_algorithm));
+
+		/* ignore trailing newline */
+		sz = strlen(zram->recomp_algorithm);
+		if (sz > 0 && zram->recomp_algorithm[sz - 1] == '\n')
+			zram->recomp_algorithm[sz - 1] = 0x00;
+	}
+
+	up_write(&zram->init_lock);
+	return len;
+}
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -427,7 +568,7 @@ static ssize_t mm_stat_show(struct device *dev,
 {
 	struct zram *zram = dev_to_zram(dev);
 	struct zs_pool_stats pool_stats;
-	u64 orig_size, mem_used = 0;
+	u64 orig_size, mem_used = 0, bd_count = 0;
 	long max_used;
 	ssize_t ret;
 
@@ -442,20 +583,50 @@ static ssize_t mm_stat_show(struct device *dev,
 	orig_size = atomic64_read(&zram->stats.pages_stored);
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	bd_count = atomic64_read(&zram->stats.bd_count);
+#endif
+
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
-			(u64)atomic64_read(&zram->stats.zero_pages),
-			pool_stats.pages_compacted);
+			(u64)atomic64_read(&zram->stats.same_pages),
+			pool_stats.pages_compacted,
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.idle_pages),
+			(u64)atomic64_read(&zram->stats.recomp_pages),
+			bd_count,
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count) << PAGE_SHIFT,
+			(u64)atomic64_read(&zram->stats.bd_reads) << PAGE_SHIFT,
+			(u64)atomic64_read(&zram->stats.bd_writes) << PAGE_SHIFT);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+static DEVICE_ATTR_RO(bd_stat);
+#endif
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
 ZRAM_ATTR_RO(num_reads);
@@ -464,9 +635,245 @@ ZRAM_ATTR_RO(failed_reads);
 ZRAM_ATTR_RO(failed_writes);
 ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
-ZRAM_ATTR_RO(zero_pages);
 ZRAM_ATTR_RO(compr_data_size);
 
+static ssize_t zero_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	/* same filled pages used to be zero pages only */
+	deprecated_attr_warn("zero_pages");
+	return scnprintf(buf, PAGE_SIZE, "%llu\n",
+		(u64)atomic64_read(&zram->stats.same_pages));
+}
+static DEVICE_ATTR_RO(zero_pages);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void reset_bdev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bitmap);
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->nr_pages = 0;
+	zram->bitmap = NULL;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file;
+	ssize_t ret;
+	char *p;
+
+	down_read(&zram->init_lock);
+	file = zram->backing_dev;
+	if (!file) {
+		ret = scnprintf(buf, PAGE_SIZE, "none\n");
+		goto out;
+	}
+
+	p = file_path(file, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct block_device *bdev;
+	struct file *file = NULL;
+	unsigned long nr_pages, *bitmap;
+	struct inode *inode;
+	char *file_name;
+	size_t sz;
+	int err;
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	file = filp_open(file_name, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		file = NULL;
+		goto out;
+	}
+
+	inode = file->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0)
+		goto out;
+
+	/* block 0 is reserved, see alloc_block_bdev() */
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		err = -EINVAL;
+		goto out_put;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+
+	reset_bdev(zram);
+
+	zram->backing_dev = file;
+	zram->bdev = bdev;
+	zram->nr_pages = nr_pages;
+	zram->bitmap = bitmap;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out:
+	if (file)
+		filp_close(file, NULL);
+	up_write(&zram->init_lock);
+	kfree(file_name);
+	return err;
+}
+
+/*
+ * Returns 0 if the backing device is full, block 0 is never handed out
+ * so that a zero handle keeps meaning "nothing stored".
+ */
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx = 1;
+retry:
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx >= zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+
+static int zram_bdev_rw_page(struct zram *zram, struct page *page,
+			     unsigned long blk_idx, int rw)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_iter.bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	ret = submit_bio_wait(rw, bio);
+	bio_put(bio);
+	return ret;
+}
+
+struct zram_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk_idx;
+	struct page *page;
+	int ret;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+
+	zw->ret = zram_bdev_rw_page(zw->zram, zw->page, zw->blk_idx, READ);
+}
+
+/*
+ * Reads can come from zram's own make_request, where a bio submitted to
+ * the backing device would only be issued after we return. Bounce the
+ * wait to a worker so it doesn't deadlock on current->bio_list.
+ */
+static int read_from_bdev(struct zram *zram, struct page *page,
+			  unsigned long blk_idx)
+{
+	struct zram_work work;
+
+	work.zram = zram;
+	work.page = page;
+	work.blk_idx = blk_idx;
+
+	INIT_WORK_ONSTACK(&work.work, zram_sync_read);
+	queue_work(system_unbound_wq, &work.work);
+	flush_work(&work.work);
+	destroy_work_on_stack(&work.work);
+
+	atomic64_inc(&zram->stats.bd_reads);
+	return work.ret;
+}
+#else
+static inline void reset_bdev(struct zram *zram) {}
+static inline void free_block_bdev(struct zram *zram,
+				   unsigned long blk_idx) {}
+static inline int read_from_bdev(struct zram *zram, struct page *page,
+				 unsigned long blk_idx)
+{
+	return -EIO;
+}
+#endif
+
 static inline bool zram_meta_get(struct zram *zram)
 {
 	if (atomic_inc_not_zero(&zram->refcount))
@@ -476,7 +883,8 @@ static inline bool zram_meta_get(struct zram *zram)
 
 static inline void zram_meta_put(struct zram *zram)
 {
-	atomic_dec(&zram->refcount);
+	if (atomic_dec_and_test(&zram->refcount))
+		wake_up(&zram->io_done);
 }
 
 static void zram_meta_free(struct zram_meta *meta, u64 disksize)
@@ -488,21 +896,29 @@ static void zram_meta_free(struct zram_meta *meta, u64 disksize)
 	for (index = 0; index < num_pages; index++) {
 		unsigned long handle = meta->table[index].handle;
 
-		if (!handle)
+		/*
+		 * The handle of a written back page is a block index, shared
+		 * objects are freed by zram_dedup_fini().
+		 */
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME) ||
+		    zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_DEDUP))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
 	}
 
+	zram_dedup_fini(meta);
 	zs_destroy_pool(meta->mem_pool);
 	vfree(meta->table);
 	kfree(meta);
 }
 
-static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
+static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize,
+					 bool use_dedup)
 {
 	size_t num_pages;
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 
 	if (!meta)
 		return NULL;
@@ -520,8 +936,15 @@ static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
 		goto out_error;
 	}
 
+	if (use_dedup && zram_dedup_init(meta, num_pages)) {
+		pr_err("Error allocating zram dedup table\n");
+		goto out_destroy_pool;
+	}
+
 	return meta;
 
+out_destroy_pool:
+	zs_destroy_pool(meta->mem_pool);
 out_error:
 	vfree(meta->table);
 	kfree(meta);
@@ -538,33 +961,111 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
-			atomic64_dec(&zram->stats.zero_pages);
-		}
+	zram_clear_idle(zram, index);
+	zram_clear_flag(meta, index, ZRAM_PENDING);
+	if (zram_test_flag(meta, index, ZRAM_HUGE)) {
+		zram_clear_flag(meta, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+	if (zram_test_flag(meta, index, ZRAM_RECOMP)) {
+		zram_clear_flag(meta, index, ZRAM_RECOMP);
+		atomic64_dec(&zram->stats.recomp_pages);
+	}
+
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		atomic64_dec(&zram->stats.pages_stored);
+		meta->table[index].handle = 0;
+		return;
+	}
+
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		atomic64_dec(&zram->stats.same_pages);
+		meta->table[index].element = 0;
 		return;
 	}
 
-	zs_free(meta->mem_pool, handle);
+	if (unlikely(!handle))
+		return;
 
-	atomic64_sub(zram_get_obj_size(meta, index),
-			&zram->stats.compr_data_size);
+	if (zram_test_flag(meta, index, ZRAM_DEDUP)) {
+		/* accounts the object size itself */
+		zram_clear_flag(meta, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_entry *)handle);
+	} else {
+		zs_free(meta->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(meta, index),
+				&zram->stats.compr_data_size);
+	}
 	atomic64_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
 	zram_set_obj_size(meta, index, 0);
 }
 
+/*
+ * Fetch a written back page into a kernel buffer, can sleep.
+ */
+static int zram_read_wb_page(struct zram *zram, char *mem,
+			     unsigned long blk_idx)
+{
+	struct page *page;
+	int ret;
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = read_from_bdev(zram, page, blk_idx);
+	if (!ret)
+		copy_page(mem, page_address(page));
+	__free_page(page);
+	return ret;
+}
+
+static int zram_bvec_read_wb(struct zram *zram, struct bio_vec *bvec,
+			     unsigned long blk_idx, int offset)
+{
+	struct page *page = bvec->bv_page;
+	unsigned char *user_mem;
+	char *uncmem;
+	int ret;
+
+	if (!is_partial_io(bvec)) {
+		ret = read_from_bdev(zram, page, blk_idx);
+		if (!ret)
+			flush_dcache_page(page);
+		return ret;
+	}
+
+	uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+	if (!uncmem)
+		return -ENOMEM;
+
+	ret = zram_read_wb_page(zram, uncmem, blk_idx);
+	if (!ret) {
+		user_mem = kmap_atomic(page);
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+		       bvec->bv_len);
+		kunmap_atomic(user_mem);
+		flush_dcache_page(page);
+	}
+	kfree(uncmem);
+	return ret;
+}
+
 static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 {
 	int ret = 0;
 	unsigned char *cmem;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp *comp = zram->comp;
 	unsigned long handle;
 	size_t size;
 
@@ -572,17 +1073,36 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_fill_page(mem, PAGE_SIZE, element);
+		return 0;
+	}
+
+	if (!handle) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 		clear_page(mem);
 		return 0;
 	}
 
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return zram_read_wb_page(zram, mem, handle);
+	}
+
+	if (zram_test_flag(meta, index, ZRAM_RECOMP))
+		comp = zram->recomp;
+	/* the slot's reference keeps the entry alive under the slot lock */
+	if (zram_test_flag(meta, index, ZRAM_DEDUP))
+		handle = zram_dedup_handle((struct zram_entry *)handle);
+
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE)
 		copy_page(mem, cmem);
 	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		ret = zcomp_decompress(comp, cmem, size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
@@ -605,12 +1125,21 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	page = bvec->bv_page;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_clear_idle(zram, index);
 	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
+			zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
+		handle_same_page(bvec, element);
 		return 0;
 	}
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		unsigned long blk_idx = meta->table[index].handle;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return zram_bvec_read_wb(zram, bvec, blk_idx, offset);
+	}
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
 	if (is_partial_io(bvec))
@@ -632,141 +1161,465 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	if (unlikely(ret))
 		goto out_cleanup;
 
-	if (is_partial_io(bvec))
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-				bvec->bv_len);
+	if (is_partial_io(bvec))
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+				bvec->bv_len);
+
+	flush_dcache_page(page);
+	ret = 0;
+out_cleanup:
+	kunmap_atomic(user_mem);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
+	return ret;
+}
+
+static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
+			   int offset)
+{
+	int ret = 0;
+	size_t clen;
+	unsigned long handle, element;
+	struct page *page;
+	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm = NULL;
+	struct zram_entry *entry = NULL;
+	unsigned long alloced_pages;
+	u32 checksum = 0;
+
+	page = bvec->bv_page;
+	if (is_partial_io(bvec)) {
+		/*
+		 * This is a partial IO. We need to read the full page
+		 * before to write the changes.
+		 */
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		if (!uncmem) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		ret = zram_decompress_page(zram, uncmem, index);
+		if (ret)
+			goto out;
+	}
+
+	zstrm = zcomp_strm_find(zram->comp);
+	user_mem = kmap_atomic(page);
+
+	if (is_partial_io(bvec)) {
+		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
+		       bvec->bv_len);
+		kunmap_atomic(user_mem);
+		user_mem = NULL;
+	} else {
+		uncmem = user_mem;
+	}
+
+	if (page_same_filled(uncmem, &element)) {
+		if (user_mem)
+			kunmap_atomic(user_mem);
+		/* Free memory associated with this sector now. */
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		atomic64_inc(&zram->stats.same_pages);
+		ret = 0;
+		goto out;
+	}
+
+	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
+	if (!is_partial_io(bvec)) {
+		kunmap_atomic(user_mem);
+		user_mem = NULL;
+		uncmem = NULL;
+	}
+
+	if (unlikely(ret)) {
+		pr_err("Compression failed! err=%d\n", ret);
+		goto out;
+	}
+	src = zstrm->buffer;
+	if (unlikely(clen > max_zpage_size)) {
+		clen = PAGE_SIZE;
+		if (is_partial_io(bvec))
+			src = uncmem;
+	}
+
+	/* incompressible pages aren't worth hashing */
+	if (zram->use_dedup && clen != PAGE_SIZE) {
+		entry = zram_dedup_find(zram, src, clen, &checksum);
+		if (entry) {
+			zcomp_strm_release(zram->comp, zstrm);
+			zstrm = NULL;
+
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			zram_free_page(zram, index);
+			meta->table[index].handle = (unsigned long)entry;
+			zram_set_flag(meta, index, ZRAM_DEDUP);
+			zram_set_obj_size(meta, index, clen);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+			atomic64_inc(&zram->stats.pages_stored);
+			goto out;
+		}
+	}
+
+	handle = zs_malloc(meta->mem_pool, clen);
+	if (!handle) {
+		pr_err("Error allocating memory for compressed page: %u, size=%zu\n",
+			index, clen);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	alloced_pages = zs_get_total_pages(meta->mem_pool);
+	update_used_max(zram, alloced_pages);
+
+	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		zs_free(meta->mem_pool, handle);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
+
+	if ((clen == PAGE_SIZE) && !is_partial_io(bvec)) {
+		src = kmap_atomic(page);
+		copy_page(cmem, src);
+		kunmap_atomic(src);
+	} else {
+		memcpy(cmem, src, clen);
+	}
+
+	zcomp_strm_release(zram->comp, zstrm);
+	zstrm = NULL;
+	zs_unmap_object(meta->mem_pool, handle);
+
+	if (zram->use_dedup && clen != PAGE_SIZE)
+		entry = zram_dedup_insert(zram, handle, clen, checksum);
+
+	/*
+	 * Free memory associated with this sector
+	 * before overwriting unused sectors.
+	 */
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_free_page(zram, index);
+
+	if (entry) {
+		meta->table[index].handle = (unsigned long)entry;
+		zram_set_flag(meta, index, ZRAM_DEDUP);
+	} else {
+		meta->table[index].handle = handle;
+	}
+	zram_set_obj_size(meta, index, clen);
+	if (clen == PAGE_SIZE) {
+		zram_set_flag(meta, index, ZRAM_HUGE);
+		atomic64_inc(&zram->stats.huge_pages);
+	}
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	/* Update stats */
+	atomic64_add(clen, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+out:
+	if (zstrm)
+		zcomp_strm_release(zram->comp, zstrm);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
+	return ret;
+}
+
+/*
+ * Writing "all" marks every page currently stored in memory idle. Any
+ * access clears the mark, so whatever is still idle at the next
+ * writeback or recompress has not been touched in between.
+ */
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (meta->table[index].handle &&
+				!zram_test_flag(meta, index, ZRAM_SAME) &&
+				!zram_test_flag(meta, index, ZRAM_WB))
+			zram_set_idle(zram, index);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		cond_resched();
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * Writeback and recompression walk the table for slots in memory which
+ * match @pageflag. A picked slot is flagged ZRAM_PENDING and any write or
+ * free clears that, which is how the caller notices that the data it
+ * worked on went stale while the slot lock was dropped.
+ */
+static bool zram_pick_slot(struct zram *zram, u32 index,
+			   enum zram_pageflags pageflag)
+{
+	struct zram_meta *meta = zram->meta;
+
+	if (!meta->table[index].handle ||
+	    zram_test_flag(meta, index, ZRAM_SAME) ||
+	    zram_test_flag(meta, index, ZRAM_WB) ||
+	    zram_test_flag(meta, index, ZRAM_PENDING) ||
+	    !zram_test_flag(meta, index, pageflag))
+		return false;
+
+	/* moving one user of a shared object frees nothing */
+	if (zram_test_flag(meta, index, ZRAM_DEDUP) &&
+	    zram_dedup_shared((struct zram_entry *)meta->table[index].handle))
+		return false;
+
+	zram_set_flag(meta, index, ZRAM_PENDING);
+	return true;
+}
+
+static int zram_parse_pageflag(const char *buf, enum zram_pageflags *flag)
+{
+	if (sysfs_streq(buf, "idle"))
+		*flag = ZRAM_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		*flag = ZRAM_HUGE;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static int zram_writeback_slot(struct zram *zram, u32 index, struct page *page)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long blk_idx;
+
+	blk_idx = alloc_block_bdev(zram);
+	if (!blk_idx)
+		return -ENOSPC;
+
+	if (zram_decompress_page(zram, page_address(page), index) ||
+	    zram_bdev_rw_page(zram, page, blk_idx, WRITE)) {
+		free_block_bdev(zram, blk_idx);
+		return -EIO;
+	}
+	atomic64_inc(&zram->stats.bd_writes);
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (!zram_test_flag(meta, index, ZRAM_PENDING)) {
+		/* rewritten or freed meanwhile */
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		free_block_bdev(zram, blk_idx);
+		return 0;
+	}
+
+	zram_free_page(zram, index);
+	zram_set_flag(meta, index, ZRAM_WB);
+	meta->table[index].handle = blk_idx;
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	flush_dcache_page(page);
-	ret = 0;
-out_cleanup:
-	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
-	return ret;
+	atomic64_inc(&zram->stats.pages_stored);
+	return 0;
 }
 
-static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
-			   int offset)
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
 {
-	int ret = 0;
-	size_t clen;
-	unsigned long handle;
+	struct zram *zram = dev_to_zram(dev);
+	enum zram_pageflags pageflag;
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
 	struct page *page;
-	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
-	struct zram_meta *meta = zram->meta;
-	struct zcomp_strm *zstrm = NULL;
-	unsigned long alloced_pages;
+	ssize_t ret;
 
-	page = bvec->bv_page;
-	if (is_partial_io(bvec)) {
-		/*
-		 * This is a partial IO. We need to read the full page
-		 * before to write the changes.
-		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-		if (!uncmem) {
-			ret = -ENOMEM;
-			goto out;
-		}
-		ret = zram_decompress_page(zram, uncmem, index);
-		if (ret)
-			goto out;
-	}
+	ret = zram_parse_pageflag(buf, &pageflag);
+	if (ret)
+		return ret;
 
-	zstrm = zcomp_strm_find(zram->comp);
-	user_mem = kmap_atomic(page);
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
 
-	if (is_partial_io(bvec)) {
-		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
-		       bvec->bv_len);
-		kunmap_atomic(user_mem);
-		user_mem = NULL;
-	} else {
-		uncmem = user_mem;
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->backing_dev) {
+		ret = -EINVAL;
+		goto out;
 	}
 
-	if (page_zero_filled(uncmem)) {
-		if (user_mem)
-			kunmap_atomic(user_mem);
-		/* Free memory associated with this sector now. */
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bool picked;
+		int err;
+
+		cond_resched();
+
 		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
+		picked = zram_pick_slot(zram, index, pageflag);
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!picked)
+			continue;
 
-		atomic64_inc(&zram->stats.zero_pages);
-		ret = 0;
-		goto out;
-	}
+		err = zram_writeback_slot(zram, index, page);
 
-	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
-	if (!is_partial_io(bvec)) {
-		kunmap_atomic(user_mem);
-		user_mem = NULL;
-		uncmem = NULL;
-	}
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_clear_flag(meta, index, ZRAM_PENDING);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	if (unlikely(ret)) {
-		pr_err("Compression failed! err=%d\n", ret);
-		goto out;
+		if (err) {
+			ret = err;
+			goto out;
+		}
 	}
-	src = zstrm->buffer;
-	if (unlikely(clen > max_zpage_size)) {
-		clen = PAGE_SIZE;
-		if (is_partial_io(bvec))
-			src = uncmem;
+	ret = len;
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+	return ret;
+}
+#endif
+
+/*
+ * Compress one picked slot again with the secondary algorithm and keep
+ * the result if it is smaller. Returns -ENOMEM once the pool is full.
+ */
+static int zram_recompress_slot(struct zram *zram, u32 index, char *uncmem)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	unsigned long handle, alloced_pages;
+	size_t old_clen, clen;
+	unsigned char *cmem;
+	bool was_idle;
+	int ret;
+
+	old_clen = zram_get_obj_size(meta, index);
+	ret = zram_decompress_page(zram, uncmem, index);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_strm_find(zram->recomp);
+	ret = zcomp_compress(zram->recomp, zstrm, uncmem, &clen);
+	if (ret || clen >= old_clen || clen > max_zpage_size) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		return ret;
 	}
 
 	handle = zs_malloc(meta->mem_pool, clen);
 	if (!handle) {
-		pr_err("Error allocating memory for compressed page: %u, size=%zu\n",
-			index, clen);
-		ret = -ENOMEM;
-		goto out;
+		zcomp_strm_release(zram->recomp, zstrm);
+		return -ENOMEM;
 	}
 
 	alloced_pages = zs_get_total_pages(meta->mem_pool);
 	update_used_max(zram, alloced_pages);
-
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		zcomp_strm_release(zram->recomp, zstrm);
 		zs_free(meta->mem_pool, handle);
-		ret = -ENOMEM;
-		goto out;
+		return -ENOMEM;
 	}
 
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
-
-	if ((clen == PAGE_SIZE) && !is_partial_io(bvec)) {
-		src = kmap_atomic(page);
-		copy_page(cmem, src);
-		kunmap_atomic(src);
-	} else {
-		memcpy(cmem, src, clen);
-	}
-
-	zcomp_strm_release(zram->comp, zstrm);
-	zstrm = NULL;
+	memcpy(cmem, zstrm->buffer, clen);
 	zs_unmap_object(meta->mem_pool, handle);
+	zcomp_strm_release(zram->recomp, zstrm);
 
-	/*
-	 * Free memory associated with this sector
-	 * before overwriting unused sectors.
-	 */
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	zram_free_page(zram, index);
+	if (!zram_test_flag(meta, index, ZRAM_PENDING)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zs_free(meta->mem_pool, handle);
+		return 0;
+	}
 
+	was_idle = zram_test_flag(meta, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
 	meta->table[index].handle = handle;
 	zram_set_obj_size(meta, index, clen);
+	zram_set_flag(meta, index, ZRAM_RECOMP);
+	if (was_idle)
+		zram_set_idle(zram, index);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	/* Update stats */
 	atomic64_add(clen, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.recomp_pages);
+	return 0;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	enum zram_pageflags pageflag;
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+	char *uncmem;
+	ssize_t ret;
+
+	ret = zram_parse_pageflag(buf, &pageflag);
+	if (ret)
+		return ret;
+
+	uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!uncmem)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bool picked;
+		int err;
+
+		cond_resched();
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		picked = !zram_test_flag(meta, index, ZRAM_RECOMP) &&
+			 zram_pick_slot(zram, index, pageflag);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!picked)
+			continue;
+
+		err = zram_recompress_slot(zram, index, uncmem);
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_clear_flag(meta, index, ZRAM_PENDING);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		if (err == -ENOMEM) {
+			ret = err;
+			goto out;
+		}
+	}
+	ret = len;
 out:
-	if (zstrm)
-		zcomp_strm_release(zram->comp, zstrm);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
+	up_read(&zram->init_lock);
+	kfree(uncmem);
 	return ret;
 }
 
@@ -838,6 +1691,175 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+/*
+ * Async writes: the pages of a write are handed out in batches of
+ * ZRAM_WRITE_BATCH to the write workers of consecutive online cpus, so
+ * a single submitter gets as many compressors as max_comp_streams
+ * allows. The bio (or rw_page page) completes when the last batch is
+ * stored. Only full page writes go async, partial ones need a read
+ * modify write of the slot and stay in the caller's context.
+ */
+#define ZRAM_WRITE_BATCH	8
+
+struct zram_write_req {
+	struct zram *zram;
+	struct bio *bio;
+	/* set instead of @bio for rw_page writes */
+	struct page *page;
+	atomic_t pending;
+	int error;
+};
+
+struct zram_write_batch {
+	struct work_struct work;
+	struct zram_write_req *req;
+	unsigned int nr;
+	u32 index[ZRAM_WRITE_BATCH];
+	struct page *pages[ZRAM_WRITE_BATCH];
+};
+
+static void zram_write_req_put(struct zram_write_req *req)
+{
+	if (!atomic_dec_and_test(&req->pending))
+		return;
+
+	if (req->bio) {
+		req->bio->bi_error = req->error;
+		bio_endio(req->bio);
+	} else {
+		page_endio(req->page, WRITE, req->error);
+	}
+	zram_meta_put(req->zram);
+	kfree(req);
+}
+
+static void zram_write_page(struct zram_write_req *req, struct page *page,
+			    u32 index)
+{
+	struct bio_vec bv;
+
+	bv.bv_page = page;
+	bv.bv_len = PAGE_SIZE;
+	bv.bv_offset = 0;
+
+	if (zram_bvec_rw(req->zram, &bv, index, 0, WRITE) < 0)
+		req->error = -EIO;
+}
+
+static void zram_write_batch_fn(struct work_struct *work)
+{
+	struct zram_write_batch *batch;
+	struct zram_write_req *req;
+	unsigned int i;
+
+	batch = container_of(work, struct zram_write_batch, work);
+	req = batch->req;
+	for (i = 0; i < batch->nr; i++)
+		zram_write_page(req, batch->pages[i], batch->index[i]);
+
+	kfree(batch);
+	zram_write_req_put(req);
+}
+
+static void zram_write_batch_queue(struct zram_write_batch *batch, int *cpu)
+{
+	*cpu = cpumask_next(*cpu, cpu_online_mask);
+	if (*cpu >= nr_cpu_ids)
+		*cpu = cpumask_first(cpu_online_mask);
+
+	atomic_inc(&batch->req->pending);
+	queue_work_on(*cpu, zram_write_wq, &batch->work);
+}
+
+/*
+ * Add a page to the batch being filled and queue the batch once full.
+ * Stores the page right away if no batch can be allocated.
+ */
+static void zram_write_async_page(struct zram_write_req *req,
+				  struct zram_write_batch **batchp,
+				  struct page *page, u32 index, int *cpu)
+{
+	struct zram_write_batch *batch = *batchp;
+
+	if (!batch) {
+		batch = kmalloc(sizeof(*batch), GFP_NOIO | __GFP_NORETRY |
+				__GFP_NOWARN);
+		if (!batch) {
+			zram_write_page(req, page, index);
+			return;
+		}
+		INIT_WORK(&batch->work, zram_write_batch_fn);
+		batch->req = req;
+		batch->nr = 0;
+	}
+
+	batch->pages[batch->nr] = page;
+	batch->index[batch->nr] = index;
+	if (++batch->nr == ZRAM_WRITE_BATCH) {
+		zram_write_batch_queue(batch, cpu);
+		batch = NULL;
+	}
+	*batchp = batch;
+}
+
+static struct zram_write_req *zram_write_req_alloc(struct zram *zram)
+{
+	struct zram_write_req *req;
+
+	req = kmalloc(sizeof(*req), GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!req)
+		return NULL;
+
+	/* pinned until the last page is stored, the caller holds a ref */
+	if (unlikely(!zram_meta_get(zram))) {
+		kfree(req);
+		return NULL;
+	}
+
+	req->zram = zram;
+	req->bio = NULL;
+	req->page = NULL;
+	/* submission holds one count so we can't finish under ourselves */
+	atomic_set(&req->pending, 1);
+	req->error = 0;
+	return req;
+}
+
+/*
+ * Returns false if the bio has to be handled synchronously.
+ */
+static bool zram_write_async(struct zram *zram, struct bio *bio)
+{
+	struct zram_write_batch *batch = NULL;
+	struct zram_write_req *req;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	u32 index;
+	int cpu;
+
+	if (bio->bi_iter.bi_sector & (SECTORS_PER_PAGE - 1))
+		return false;
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_len != PAGE_SIZE)
+			return false;
+	}
+
+	req = zram_write_req_alloc(zram);
+	if (!req)
+		return false;
+	req->bio = bio;
+
+	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	cpu = raw_smp_processor_id();
+	bio_for_each_segment(bvec, bio, iter)
+		zram_write_async_page(req, &batch, bvec.bv_page, index++, &cpu);
+	if (batch)
+		zram_write_batch_queue(batch, &cpu);
+
+	zram_write_req_put(req);
+	return true;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset, rw;
@@ -856,6 +1878,10 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	}
 
 	rw = bio_data_dir(bio);
+	if (rw == WRITE && READ_ONCE(zram->async_write) &&
+	    zram_write_async(zram, bio))
+		return;
+
 	bio_for_each_segment(bvec, bio, iter) {
 		int max_transfer_size = PAGE_SIZE - offset;
 
@@ -955,6 +1981,24 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	index = sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = sector & (SECTORS_PER_PAGE - 1) << SECTOR_SHIFT;
 
+	if (rw == WRITE && READ_ONCE(zram->async_write)) {
+		struct zram_write_batch *batch = NULL;
+		struct zram_write_req *req;
+		int cpu = raw_smp_processor_id();
+
+		req = zram_write_req_alloc(zram);
+		if (req) {
+			/* page_endio() is called on completion */
+			req->page = page;
+			zram_write_async_page(req, &batch, page, index, &cpu);
+			if (batch)
+				zram_write_batch_queue(batch, &cpu);
+			zram_write_req_put(req);
+			zram_meta_put(zram);
+			return 0;
+		}
+	}
+
 	bv.bv_page = page;
 	bv.bv_len = PAGE_SIZE;
 	bv.bv_offset = 0;
@@ -979,7 +2023,7 @@ out:
 static void zram_reset_device(struct zram *zram)
 {
 	struct zram_meta *meta;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -993,6 +2037,7 @@ static void zram_reset_device(struct zram *zram)
 
 	meta = zram->meta;
 	comp = zram->comp;
+	recomp = zram->recomp;
 	disksize = zram->disksize;
 	/*
 	 * Refcount will go down to 0 eventually and r/w handler
@@ -1010,21 +2055,26 @@ static void zram_reset_device(struct zram *zram)
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zram->disksize = 0;
 	zram->max_comp_streams = 1;
+	zram->recomp = NULL;
 
 	set_capacity(zram->disk, 0);
 	part_stat_set_all(&zram->disk->part0, 0);
 
+	/* Block indexes in the table die with the meta */
+	reset_bdev(zram);
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(meta, disksize);
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 }
 
 static ssize_t disksize_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	u64 disksize;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp = NULL;
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
@@ -1034,7 +2084,8 @@ static ssize_t disksize_store(struct device *dev,
 		return -EINVAL;
 
 	disksize = PAGE_ALIGN(disksize);
-	meta = zram_meta_alloc(zram->disk->disk_name, disksize);
+	meta = zram_meta_alloc(zram->disk->disk_name, disksize,
+			       zram->use_dedup);
 	if (!meta)
 		return -ENOMEM;
 
@@ -1046,6 +2097,17 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	if (zram->recomp_algorithm[0]) {
+		recomp = zcomp_create(zram->recomp_algorithm, 1);
+		if (IS_ERR(recomp)) {
+			pr_err("Cannot initialise %s recompressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			recomp = NULL;
+			goto out_destroy_comp_unlocked;
+		}
+	}
+
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
@@ -1057,6 +2119,7 @@ static ssize_t disksize_store(struct device *dev,
 	atomic_set(&zram->refcount, 1);
 	zram->meta = meta;
 	zram->comp = comp;
+	zram->recomp = recomp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	up_write(&zram->init_lock);
@@ -1072,6 +2135,9 @@ static ssize_t disksize_store(struct device *dev,
 
 out_destroy_comp:
 	up_write(&zram->init_lock);
+out_destroy_comp_unlocked:
+	if (recomp)
+		zcomp_destroy(recomp);
 	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(meta, disksize);
@@ -1155,6 +2221,19 @@ static DEVICE_ATTR_RW(mem_limit);
 static DEVICE_ATTR_RW(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(async_write);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#else
+static DEVICE_ATTR_RO(use_dedup);
+#endif
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(idle);
+static DEVICE_ATTR_WO(recompress);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1175,6 +2254,16 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_async_write.attr,
+	&dev_attr_use_dedup.attr,
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_recompress.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
 	NULL,
@@ -1401,15 +2490,23 @@ static void destroy_devices(void)
 	idr_for_each(&zram_index_idr, &zram_remove_cb, NULL);
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_write_wq);
 }
 
 static int __init zram_init(void)
 {
 	int ret;
 
+	/* writes are on the reclaim path */
+	zram_write_wq = alloc_workqueue("zram_write",
+					WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!zram_write_wq)
+		return -ENOMEM;
+
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
+		destroy_workqueue(zram_write_wq);
 		return ret;
 	}
 
@@ -1417,6 +2514,7 @@ static int __init zram_init(void)
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		destroy_workqueue(zram_write_wq);
 		return -EBUSY;
 	}
 
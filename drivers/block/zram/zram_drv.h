@@ -19,6 +19,7 @@
 #include <linux/zsmalloc.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 /*-- Configurable parameters */
 
@@ -59,9 +60,15 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
+	/* Page is one repeated word, stored in table.element */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_HUGE,	/* incompressible page, stored uncompressed */
+	ZRAM_IDLE,	/* not accessed since last marked idle */
+	ZRAM_WB,	/* page is on the backing device, handle is block index */
+	ZRAM_RECOMP,	/* compressed with the secondary algorithm */
+	ZRAM_PENDING,	/* being written back or recompressed */
+	ZRAM_DEDUP,	/* handle is a shared struct zram_entry */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -70,7 +77,10 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct zram_table_entry {
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long element;
+	};
 	unsigned long value;
 };
 
@@ -82,19 +92,35 @@ struct zram_stats {
 	atomic64_t failed_writes;	/* can happen when memory is too low */
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
-	atomic64_t zero_pages;		/* no. of zero filled pages */
+	atomic64_t same_pages;		/* no. of same element filled pages */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
+	atomic64_t huge_pages;		/* no. of pages stored uncompressed */
+	atomic64_t idle_pages;		/* no. of pages marked idle */
+	atomic64_t recomp_pages;	/* no. of pages recompressed */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t meta_data_size;	/* memory used by dedup entries */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in the backing device */
+	atomic64_t bd_reads;		/* no. of reads from the backing device */
+	atomic64_t bd_writes;		/* no. of writes to the backing device */
+#endif
 };
 
 struct zram_meta {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
+#ifdef CONFIG_ZRAM_DEDUP
+	struct zram_hash *hash;
+	size_t hash_size;
+#endif
 };
 
 struct zram {
 	struct zram_meta *meta;
 	struct zcomp *comp;
+	/* optional secondary compressor for idle and huge pages */
+	struct zcomp *recomp;
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -103,6 +129,10 @@ struct zram {
 	 */
 	unsigned long limit_pages;
 	int max_comp_streams;
+	/* compress full page writes on the per-cpu write workers */
+	bool async_write;
+	/* share identical compressed objects between slots */
+	bool use_dedup;
 
 	struct zram_stats stats;
 	atomic_t refcount; /* refcount for zram_meta */
@@ -114,6 +144,17 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[10];
+	char recomp_algorithm[10];
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/*
+	 * Backing device for pages written back by the writeback attribute.
+	 * Block 0 is never handed out so a zero handle still means "empty".
+	 */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long nr_pages;
+	unsigned long *bitmap;
+#endif
 	/*
 	 * zram is claimed so open request will be failed
 	 */
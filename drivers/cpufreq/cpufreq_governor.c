@@ -66,6 +66,7 @@ void dbs_check_cpu(struct dbs_data *dbs_data, int cpu)
 		u64 cur_wall_time, cur_idle_time;
 		unsigned int idle_time, wall_time;
 		unsigned int load;
+		unsigned long util, clamped;
 		int io_busy = 0;
 
 		j_cdbs = dbs_data->cdata->get_cpu_cdbs(j);
@@ -150,6 +151,12 @@ void dbs_check_cpu(struct dbs_data *dbs_data, int cpu)
 			j_cdbs->prev_load = load;
 		}
 
+		/* honour the utilization clamps of the tasks queued on j */
+		util = load * SCHED_CAPACITY_SCALE / 100;
+		clamped = uclamp_cpu_util(j, util);
+		if (clamped != util)
+			load = clamped * 100 / SCHED_CAPACITY_SCALE;
+
 		if (load > max_load)
 			max_load = load;
 	}
@@ -111,6 +111,10 @@ int fence_signal(struct fence *fence)
 	if (!fence)
 		return -EINVAL;
 
+	/* a fence signals only once, don't even look at the timestamp again */
+	if (test_bit(FENCE_FLAG_SIGNALED_BIT, &fence->flags))
+		return -EINVAL;
+
 	if (!ktime_to_ns(fence->timestamp)) {
 		fence->timestamp = ktime_get();
 		smp_mb__before_atomic();
@@ -162,6 +166,10 @@ fence_wait_timeout(struct fence *fence, bool intr, signed long timeout)
 	if (timeout == 0)
 		return fence_is_signaled(fence);
 
+	/* skip the tracepoints and the driver's wait when there's nothing to do */
+	if (test_bit(FENCE_FLAG_SIGNALED_BIT, &fence->flags))
+		return timeout;
+
 	trace_fence_wait_start(fence);
 	ret = fence->ops->wait(fence, intr, timeout);
 	trace_fence_wait_end(fence);
@@ -33,6 +33,7 @@
  */
 
 #include <linux/reservation.h>
+#include <linux/fence-array.h>
 #include <linux/export.h>
 
 DEFINE_WW_CLASS(reservation_ww_class);
@@ -398,6 +399,117 @@ unlock_retry:
 }
 EXPORT_SYMBOL_GPL(reservation_object_wait_timeout_rcu);
 
+static unsigned
+reservation_object_add_pending(struct fence **fences, unsigned nr,
+			       struct fence *fence)
+{
+	if (fence_is_signaled(fence)) {
+		fence_put(fence);
+		return nr;
+	}
+
+	fences[nr] = fence;
+	return nr + 1;
+}
+
+/**
+ * reservation_object_wait_batch_rcu - Wait on the fences of several
+ * reservation objects at once
+ * @objs:	[in]	the reservation objects
+ * @count:	[in]	number of objects in @objs
+ * @wait_all:	[in]	if true, wait on the shared fences too
+ * @intr:	[in]	if true, do an interruptible wait
+ * @timeout:	[in]	timeout value in jiffies, or zero to only test
+ *
+ * Takes a single snapshot of the fences of each object, drops those that
+ * have signaled already and sleeps once for all of the others through a
+ * fence_array, instead of waiting on each fence in turn and taking a fresh
+ * snapshot after every wakeup as reservation_object_wait_timeout_rcu()
+ * does.  Fences added to the objects after the snapshot are not waited on.
+ *
+ * Returns -ERESTARTSYS if interrupted, 0 if the wait timed out, or the
+ * remaining timeout in jiffies (1 when testing) on success.
+ */
+long reservation_object_wait_batch_rcu(struct reservation_object **objs,
+				       unsigned count, bool wait_all,
+				       bool intr, unsigned long timeout)
+{
+	struct fence **fences = NULL;
+	struct fence_array *array;
+	unsigned nr = 0, i, j;
+	long ret = timeout;
+
+	for (i = 0; i < count; ++i) {
+		struct fence *excl, **shared, **tmp;
+		unsigned shared_count;
+
+		ret = reservation_object_get_fences_rcu(objs[i], &excl,
+							&shared_count, &shared);
+		if (ret)
+			goto out_put;
+
+		tmp = krealloc(fences, sizeof(*fences) *
+			       (nr + (wait_all ? shared_count : 0) + 1),
+			       GFP_KERNEL);
+		if (!tmp) {
+			while (shared_count--)
+				fence_put(shared[shared_count]);
+			kfree(shared);
+			if (excl)
+				fence_put(excl);
+			ret = -ENOMEM;
+			goto out_put;
+		}
+		fences = tmp;
+
+		for (j = 0; j < shared_count; ++j) {
+			if (wait_all)
+				nr = reservation_object_add_pending(fences, nr,
+								    shared[j]);
+			else
+				fence_put(shared[j]);
+		}
+		kfree(shared);
+
+		if (excl)
+			nr = reservation_object_add_pending(fences, nr, excl);
+	}
+
+	if (!timeout) {
+		ret = !nr;
+		goto out_put;
+	}
+
+	ret = timeout;
+	if (nr == 1) {
+		ret = fence_wait_timeout(fences[0], intr, ret);
+		goto out_put;
+	}
+	if (!nr)
+		goto out_put;
+
+	array = fence_array_create(nr, fences, fence_context_alloc(1), 1,
+				   false);
+	if (!array) {
+		/* no memory for the callbacks, one at a time then */
+		for (i = 0; i < nr && ret > 0; ++i)
+			ret = fence_wait_timeout(fences[i], intr, ret);
+		goto out_put;
+	}
+
+	/* the array now owns fences[] and the references in it */
+	ret = fence_wait_timeout(&array->base, intr, ret);
+	fence_put(&array->base);
+	return ret;
+
+out_put:
+	while (nr--)
+		fence_put(fences[nr]);
+	kfree(fences);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(reservation_object_wait_batch_rcu);
+
 
 static inline int
 reservation_object_test_signaled_single(struct fence *passed_fence)
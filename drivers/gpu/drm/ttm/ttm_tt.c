@@ -38,6 +38,7 @@
 #include <linux/swap.h>
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/async_tx.h>
 #include <drm/drm_cache.h>
 #include <drm/drm_mem_util.h>
 #include <drm/ttm/ttm_module.h>
@@ -286,12 +287,36 @@ int ttm_tt_bind(struct ttm_tt *ttm, struct ttm_mem_reg *bo_mem)
 }
 EXPORT_SYMBOL(ttm_tt_bind);
 
+/*
+ * Swap pages are copied through async_copy_page(), and the shmem pages of
+ * a batch are only released, and dirtied on swapout, once the copies of the
+ * whole batch are done.
+ */
+#define TTM_SWAP_BATCH 32
+
+static void ttm_tt_swap_flush(struct async_copy *ac, struct page **pages,
+			      unsigned int nr, bool dirty)
+{
+	async_copy_wait(ac);
+
+	while (nr--) {
+		if (dirty) {
+			set_page_dirty(pages[nr]);
+			mark_page_accessed(pages[nr]);
+		}
+		page_cache_release(pages[nr]);
+	}
+}
+
 int ttm_tt_swapin(struct ttm_tt *ttm)
 {
 	struct address_space *swap_space;
 	struct file *swap_storage;
 	struct page *from_page;
 	struct page *to_page;
+	struct page *batch[TTM_SWAP_BATCH];
+	struct async_copy ac;
+	unsigned int nr = 0;
 	int i;
 	int ret = -ENOMEM;
 
@@ -299,6 +324,7 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 	BUG_ON(swap_storage == NULL);
 
 	swap_space = file_inode(swap_storage)->i_mapping;
+	async_copy_init(&ac);
 
 	for (i = 0; i < ttm->num_pages; ++i) {
 		from_page = shmem_read_mapping_page(swap_space, i);
@@ -307,12 +333,19 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 			goto out_err;
 		}
 		to_page = ttm->pages[i];
-		if (unlikely(to_page == NULL))
+		if (unlikely(to_page == NULL)) {
+			page_cache_release(from_page);
 			goto out_err;
+		}
 
-		copy_highpage(to_page, from_page);
-		page_cache_release(from_page);
+		async_copy_page(&ac, to_page, 0, from_page, 0, PAGE_SIZE);
+		batch[nr++] = from_page;
+		if (nr == TTM_SWAP_BATCH) {
+			ttm_tt_swap_flush(&ac, batch, nr, false);
+			nr = 0;
+		}
 	}
+	ttm_tt_swap_flush(&ac, batch, nr, false);
 
 	if (!(ttm->page_flags & TTM_PAGE_FLAG_PERSISTENT_SWAP))
 		fput(swap_storage);
@@ -321,6 +354,7 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 
 	return 0;
 out_err:
+	ttm_tt_swap_flush(&ac, batch, nr, false);
 	return ret;
 }
 
@@ -330,6 +364,9 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 	struct file *swap_storage;
 	struct page *from_page;
 	struct page *to_page;
+	struct page *batch[TTM_SWAP_BATCH];
+	struct async_copy ac;
+	unsigned int nr = 0;
 	int i;
 	int ret = -ENOMEM;
 
@@ -348,6 +385,7 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 		swap_storage = persistent_swap_storage;
 
 	swap_space = file_inode(swap_storage)->i_mapping;
+	async_copy_init(&ac);
 
 	for (i = 0; i < ttm->num_pages; ++i) {
 		from_page = ttm->pages[i];
@@ -358,11 +396,14 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 			ret = PTR_ERR(to_page);
 			goto out_err;
 		}
-		copy_highpage(to_page, from_page);
-		set_page_dirty(to_page);
-		mark_page_accessed(to_page);
-		page_cache_release(to_page);
+		async_copy_page(&ac, to_page, 0, from_page, 0, PAGE_SIZE);
+		batch[nr++] = to_page;
+		if (nr == TTM_SWAP_BATCH) {
+			ttm_tt_swap_flush(&ac, batch, nr, true);
+			nr = 0;
+		}
 	}
+	ttm_tt_swap_flush(&ac, batch, nr, true);
 
 	ttm_tt_unpopulate(ttm);
 	ttm->swap_storage = swap_storage;
@@ -372,6 +413,7 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 
 	return 0;
 out_err:
+	ttm_tt_swap_flush(&ac, batch, nr, true);
 	if (!persistent_swap_storage)
 		fput(swap_storage);
 
@@ -601,6 +601,40 @@ void vmbus_close(struct vmbus_channel *channel)
 }
 EXPORT_SYMBOL_GPL(vmbus_close);
 
+/*
+ * Apply the channel's signaling policy to a write that left the ring in
+ * state @signal (it went from empty to non-empty) with @kick_q telling
+ * whether this is the last packet of a batch.
+ *
+ * With HV_SIGNAL_POLICY_DEFERRED an empty to non-empty transition in the
+ * middle of a batch is only remembered, and the host is signaled once at
+ * the end of the batch; the host keeps draining the ring as long as it
+ * is not empty, so one signal covers every packet written in between.
+ * The flag is only ever set before the data it covers is visible to a
+ * later kick, so racing writers can at worst cause a spurious signal.
+ */
+static bool vmbus_need_kick(struct vmbus_channel *channel, bool signal,
+			    bool kick_q)
+{
+	switch (channel->signal_policy) {
+	case HV_SIGNAL_POLICY_EXPLICIT:
+		return kick_q;
+	case HV_SIGNAL_POLICY_DEFERRED:
+		if (!kick_q) {
+			if (signal)
+				WRITE_ONCE(channel->signal_deferred, true);
+			return false;
+		}
+		if (READ_ONCE(channel->signal_deferred)) {
+			WRITE_ONCE(channel->signal_deferred, false);
+			return true;
+		}
+		return signal;
+	default:
+		return signal;
+	}
+}
+
 int vmbus_sendpacket_ctl(struct vmbus_channel *channel, void *buffer,
 			   u32 bufferlen, u64 requestid,
 			   enum vmbus_packet_type type, u32 flags, bool kick_q)
@@ -649,12 +683,7 @@ int vmbus_sendpacket_ctl(struct vmbus_channel *channel, void *buffer,
 	 * enough condition that it should not matter.
 	 */
 
-	if (channel->signal_policy)
-		signal = true;
-	else
-		kick_q = true;
-
-	if (((ret == 0) && kick_q && signal) || (ret))
+	if (ret || vmbus_need_kick(channel, signal, kick_q))
 		vmbus_setevent(channel);
 
 	return ret;
@@ -761,12 +790,7 @@ int vmbus_sendpacket_pagebuffer_ctl(struct vmbus_channel *channel,
 	 * enough condition that it should not matter.
 	 */
 
-	if (channel->signal_policy)
-		signal = true;
-	else
-		kick_q = true;
-
-	if (((ret == 0) && kick_q && signal) || (ret))
+	if (ret || vmbus_need_kick(channel, signal, kick_q))
 		vmbus_setevent(channel);
 
 	return ret;
@@ -43,6 +43,8 @@ int  ib_device_register_sysfs(struct ib_device *device,
 						   u8, struct kobject *));
 void ib_device_unregister_sysfs(struct ib_device *device);
 
+void ib_cq_pool_cleanup(struct ib_device *dev);
+
 void ib_cache_setup(void);
 void ib_cache_cleanup(void);
 
@@ -210,6 +210,7 @@ static struct class ib_class = {
 struct ib_device *ib_alloc_device(size_t size)
 {
 	struct ib_device *device;
+	unsigned int i;
 
 	if (WARN_ON(size < sizeof(struct ib_device)))
 		return NULL;
@@ -228,6 +229,9 @@ struct ib_device *ib_alloc_device(size_t size)
 	spin_lock_init(&device->client_data_lock);
 	INIT_LIST_HEAD(&device->client_data_list);
 	INIT_LIST_HEAD(&device->port_list);
+	spin_lock_init(&device->cq_pools_lock);
+	for (i = 0; i < ARRAY_SIZE(device->cq_pools); i++)
+		INIT_LIST_HEAD(&device->cq_pools[i]);
 
 	return device;
 }
@@ -405,6 +409,9 @@ void ib_unregister_device(struct ib_device *device)
 
 	mutex_unlock(&device_mutex);
 
+	/* every client is gone, so are the users of the shared CQs */
+	ib_cq_pool_cleanup(device);
+
 	ib_device_unregister_sysfs(device);
 	ib_cache_cleanup_one(device);
 
@@ -3270,6 +3270,75 @@ int ib_uverbs_ex_destroy_flow(struct ib_uverbs_file *file,
 	return ret;
 }
 
+int ib_uverbs_ex_advise_mr(struct ib_uverbs_file *file,
+			   struct ib_device *ib_dev,
+			   struct ib_udata *ucore,
+			   struct ib_udata *uhw)
+{
+	struct ib_uverbs_advise_mr	cmd;
+	struct ib_uverbs_sge		usge;
+	struct ib_sge			*sg_list;
+	struct ib_pd			*pd;
+	enum ib_mr_advice		advice;
+	u32				flags;
+	int				ret;
+	u32				i;
+
+	if (ucore->inlen < sizeof(cmd))
+		return -EINVAL;
+
+	ret = ib_copy_from_udata(&cmd, ucore, sizeof(cmd));
+	if (ret)
+		return ret;
+
+	if (cmd.comp_mask || cmd.reserved)
+		return -EINVAL;
+
+	if (cmd.advice > IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH_WRITE ||
+	    cmd.flags & ~IB_UVERBS_ADVISE_MR_FLAG_FLUSH)
+		return -EINVAL;
+
+	if (!cmd.num_sge || cmd.num_sge > IB_UVERBS_ADVISE_MR_MAX_SGE)
+		return -EINVAL;
+
+	if (!ib_dev->advise_mr)
+		return -EOPNOTSUPP;
+
+	sg_list = kmalloc_array(cmd.num_sge, sizeof(*sg_list), GFP_KERNEL);
+	if (!sg_list)
+		return -ENOMEM;
+
+	for (i = 0; i < cmd.num_sge; i++) {
+		if (copy_from_user(&usge, (void __user *)(unsigned long)
+				   (cmd.sg_list + i * sizeof(usge)),
+				   sizeof(usge))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		sg_list[i].addr   = usge.addr;
+		sg_list[i].length = usge.length;
+		sg_list[i].lkey   = usge.lkey;
+	}
+
+	pd = idr_read_pd(cmd.pd_handle, file->ucontext);
+	if (!pd) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	advice = cmd.advice == IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH ?
+		 IB_MR_ADVICE_PREFETCH : IB_MR_ADVICE_PREFETCH_WRITE;
+	flags = cmd.flags & IB_UVERBS_ADVISE_MR_FLAG_FLUSH ?
+		IB_MR_ADVISE_FLUSH : 0;
+
+	ret = ib_dev->advise_mr(pd, advice, flags, sg_list, cmd.num_sge);
+
+	put_pd_read(pd);
+out:
+	kfree(sg_list);
+	return ret;
+}
+
 static int __uverbs_create_xsrq(struct ib_uverbs_file *file,
 				struct ib_device *ib_dev,
 				struct ib_uverbs_create_xsrq *cmd,
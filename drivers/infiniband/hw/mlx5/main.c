@@ -1427,6 +1427,11 @@ static void *mlx5_ib_add(struct mlx5_core_dev *mdev)
 	dev->ib_dev.get_port_immutable  = mlx5_port_immutable;
 
 	mlx5_ib_internal_fill_odp_caps(dev);
+	if (dev->odp_caps.general_caps & IB_ODP_SUPPORT) {
+		dev->ib_dev.advise_mr = mlx5_ib_advise_mr;
+		dev->ib_dev.uverbs_ex_cmd_mask |=
+			(1ull << IB_USER_VERBS_EX_CMD_ADVISE_MR);
+	}
 
 	if (MLX5_CAP_GEN(mdev, xrc)) {
 		dev->ib_dev.alloc_xrcd = mlx5_ib_alloc_xrcd;
@@ -1267,6 +1267,10 @@ int mlx5_ib_dereg_mr(struct ib_mr *ibmr)
 		mr->live = 0;
 		/* Wait for all running page-fault handlers to finish. */
 		synchronize_srcu(&dev->mr_srcu);
+		/* Queued prefetches find the MR dead and let go of it */
+		if (atomic_read(&mr->num_pending_prefetch))
+			flush_workqueue(mlx5_ib_prefetch_wq);
+		WARN_ON(atomic_read(&mr->num_pending_prefetch));
 		/* Destroy all page mappings */
 		mlx5_ib_invalidate_range(umem, ib_umem_start(umem),
 					 ib_umem_end(umem));
@@ -42,6 +42,7 @@
 #define MMU_NOTIFIER_TIMEOUT 1000
 
 struct workqueue_struct *mlx5_ib_page_fault_wq;
+struct workqueue_struct *mlx5_ib_prefetch_wq;
 
 void mlx5_ib_invalidate_range(struct ib_umem *umem, unsigned long start,
 			      unsigned long end)
@@ -175,45 +176,19 @@ static void mlx5_ib_page_fault_resume(struct mlx5_ib_qp *qp,
  *  abort the page fault handling and possibly move the QP to an error state.
  * On other errors the QP should also be closed with an error.
  */
-static int pagefault_single_data_segment(struct mlx5_ib_qp *qp,
-					 struct mlx5_ib_pfault *pfault,
-					 u32 key, u64 io_virt, size_t bcnt,
-					 u32 *bytes_mapped)
+/*
+ * Map [io_virt, io_virt + bcnt) of an ODP MR and update its page tables.
+ * Called within an mr_srcu read side section.
+ *
+ * Returns the number of pages mapped, -EAGAIN if the range was invalidated
+ * meanwhile (after waiting for the invalidation to finish), or -EFAULT.
+ */
+static int pagefault_mr(struct mlx5_ib_mr *mr, u64 io_virt, size_t bcnt,
+			u64 access_mask, u32 *bytes_mapped)
 {
-	struct mlx5_ib_dev *mib_dev = to_mdev(qp->ibqp.pd->device);
-	int srcu_key;
 	unsigned int current_seq;
 	u64 start_idx;
 	int npages = 0, ret = 0;
-	struct mlx5_ib_mr *mr;
-	u64 access_mask = ODP_READ_ALLOWED_BIT;
-
-	srcu_key = srcu_read_lock(&mib_dev->mr_srcu);
-	mr = mlx5_ib_odp_find_mr_lkey(mib_dev, key);
-	/*
-	 * If we didn't find the MR, it means the MR was closed while we were
-	 * handling the ODP event. In this case we return -EFAULT so that the
-	 * QP will be closed.
-	 */
-	if (!mr || !mr->ibmr.pd) {
-		pr_err("Failed to find relevant mr for lkey=0x%06x, probably the MR was destroyed\n",
-		       key);
-		ret = -EFAULT;
-		goto srcu_unlock;
-	}
-	if (!mr->umem->odp_data) {
-		pr_debug("skipping non ODP MR (lkey=0x%06x) in page fault handler.\n",
-			 key);
-		if (bytes_mapped)
-			*bytes_mapped +=
-				(bcnt - pfault->mpfault.bytes_committed);
-		goto srcu_unlock;
-	}
-	if (mr->ibmr.pd != qp->ibqp.pd) {
-		pr_err("Page-fault with different PDs for QP and MR.\n");
-		ret = -EFAULT;
-		goto srcu_unlock;
-	}
 
 	current_seq = ACCESS_ONCE(mr->umem->odp_data->notifiers_seq);
 	/*
@@ -222,23 +197,13 @@ static int pagefault_single_data_segment(struct mlx5_ib_qp *qp,
 	 */
 	smp_rmb();
 
-	/*
-	 * Avoid branches - this code will perform correctly
-	 * in all iterations (in iteration 2 and above,
-	 * bytes_committed == 0).
-	 */
-	io_virt += pfault->mpfault.bytes_committed;
-	bcnt -= pfault->mpfault.bytes_committed;
-
 	start_idx = (io_virt - (mr->mmr.iova & PAGE_MASK)) >> PAGE_SHIFT;
 
-	if (mr->umem->writable)
-		access_mask |= ODP_WRITE_ALLOWED_BIT;
 	npages = ib_umem_odp_map_dma_pages(mr->umem, io_virt, bcnt,
 					   access_mask, current_seq);
 	if (npages < 0) {
 		ret = npages;
-		goto srcu_unlock;
+		goto out;
 	}
 
 	if (npages > 0) {
@@ -257,7 +222,7 @@ static int pagefault_single_data_segment(struct mlx5_ib_qp *qp,
 		if (ret < 0) {
 			if (ret != -EAGAIN)
 				pr_err("Failed to update mkey page tables\n");
-			goto srcu_unlock;
+			goto out;
 		}
 
 		if (bytes_mapped) {
@@ -267,7 +232,7 @@ static int pagefault_single_data_segment(struct mlx5_ib_qp *qp,
 		}
 	}
 
-srcu_unlock:
+out:
 	if (ret == -EAGAIN) {
 		if (!mr->umem->odp_data->dying) {
 			struct ib_umem_odp *odp_data = mr->umem->odp_data;
@@ -284,9 +249,63 @@ srcu_unlock:
 			ret = -EFAULT;
 		}
 	}
+	return ret ? ret : npages;
+}
+
+static int pagefault_single_data_segment(struct mlx5_ib_qp *qp,
+					 struct mlx5_ib_pfault *pfault,
+					 u32 key, u64 io_virt, size_t bcnt,
+					 u32 *bytes_mapped)
+{
+	struct mlx5_ib_dev *mib_dev = to_mdev(qp->ibqp.pd->device);
+	int srcu_key;
+	int ret = 0;
+	struct mlx5_ib_mr *mr;
+	u64 access_mask = ODP_READ_ALLOWED_BIT;
+
+	srcu_key = srcu_read_lock(&mib_dev->mr_srcu);
+	mr = mlx5_ib_odp_find_mr_lkey(mib_dev, key);
+	/*
+	 * If we didn't find the MR, it means the MR was closed while we were
+	 * handling the ODP event. In this case we return -EFAULT so that the
+	 * QP will be closed.
+	 */
+	if (!mr || !mr->ibmr.pd) {
+		pr_err("Failed to find relevant mr for lkey=0x%06x, probably the MR was destroyed\n",
+		       key);
+		ret = -EFAULT;
+		goto srcu_unlock;
+	}
+	if (!mr->umem->odp_data) {
+		pr_debug("skipping non ODP MR (lkey=0x%06x) in page fault handler.\n",
+			 key);
+		if (bytes_mapped)
+			*bytes_mapped +=
+				(bcnt - pfault->mpfault.bytes_committed);
+		goto srcu_unlock;
+	}
+	if (mr->ibmr.pd != qp->ibqp.pd) {
+		pr_err("Page-fault with different PDs for QP and MR.\n");
+		ret = -EFAULT;
+		goto srcu_unlock;
+	}
+
+	/*
+	 * Avoid branches - this code will perform correctly
+	 * in all iterations (in iteration 2 and above,
+	 * bytes_committed == 0).
+	 */
+	io_virt += pfault->mpfault.bytes_committed;
+	bcnt -= pfault->mpfault.bytes_committed;
+
+	if (mr->umem->writable)
+		access_mask |= ODP_WRITE_ALLOWED_BIT;
+	ret = pagefault_mr(mr, io_virt, bcnt, access_mask, bytes_mapped);
+
+srcu_unlock:
 	srcu_read_unlock(&mib_dev->mr_srcu, srcu_key);
 	pfault->mpfault.bytes_committed = 0;
-	return ret ? ret : npages;
+	return ret;
 }
 
 /**
@@ -759,6 +778,148 @@ void mlx5_ib_odp_create_qp(struct mlx5_ib_qp *qp)
 		INIT_WORK(&qp->pagefaults[i].work, mlx5_ib_qp_pfault_action);
 }
 
+struct prefetch_mr_work {
+	struct work_struct	work;
+	struct mlx5_ib_dev     *dev;
+	u32			num_sge;
+	struct {
+		struct mlx5_ib_mr      *mr;
+		u64			io_virt;
+		size_t			length;
+		u64			access_mask;
+	} frags[0];
+};
+
+/*
+ * Populate a range of an ODP MR, MAX_PREFETCH_LEN at a time so that a huge
+ * prefetch neither hogs the CPU nor delays the deregistration of the MR
+ * for long. Called within an mr_srcu read side section.
+ */
+static int prefetch_mr_range(struct mlx5_ib_mr *mr, u64 io_virt,
+			     size_t bcnt, u64 access_mask)
+{
+	int ret;
+
+	while (bcnt) {
+		size_t len = min_t(size_t, bcnt, MAX_PREFETCH_LEN);
+
+		if (!ACCESS_ONCE(mr->live))
+			return -EFAULT;
+
+		ret = pagefault_mr(mr, io_virt, len, access_mask, NULL);
+		if (ret == -EAGAIN)
+			continue;
+		if (ret < 0)
+			return ret;
+
+		io_virt += len;
+		bcnt -= len;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* Called within an mr_srcu read side section, drops the MR references. */
+static int prefetch_mr_frags(struct prefetch_mr_work *w)
+{
+	int ret = 0;
+	u32 i;
+
+	for (i = 0; i < w->num_sge; i++) {
+		struct mlx5_ib_mr *mr = w->frags[i].mr;
+
+		if (!ret)
+			ret = prefetch_mr_range(mr, w->frags[i].io_virt,
+						w->frags[i].length,
+						w->frags[i].access_mask);
+		atomic_dec(&mr->num_pending_prefetch);
+	}
+
+	return ret;
+}
+
+static void mlx5_ib_prefetch_mr_work(struct work_struct *work)
+{
+	struct prefetch_mr_work *w =
+		container_of(work, struct prefetch_mr_work, work);
+	int srcu_key, ret;
+
+	srcu_key = srcu_read_lock(&w->dev->mr_srcu);
+	ret = prefetch_mr_frags(w);
+	srcu_read_unlock(&w->dev->mr_srcu, srcu_key);
+	if (ret)
+		pr_debug("prefetch failed: %d\n", ret);
+
+	kfree(w);
+}
+
+/**
+ * mlx5_ib_advise_mr - populate the page tables of ODP MRs ahead of use
+ *
+ * The ranges are looked up and checked against @pd right away, and are
+ * then mapped from mlx5_ib_prefetch_wq, or before returning when
+ * IB_MR_ADVISE_FLUSH is set, the same way a page fault would map them.
+ * A queued prefetch holds num_pending_prefetch of each MR, which
+ * mlx5_ib_dereg_mr() waits for.
+ */
+int mlx5_ib_advise_mr(struct ib_pd *pd, enum ib_mr_advice advice, u32 flags,
+		      struct ib_sge *sg_list, u32 num_sge)
+{
+	struct mlx5_ib_dev *dev = to_mdev(pd->device);
+	struct prefetch_mr_work *w;
+	int srcu_key, ret = 0;
+	u32 i;
+
+	if (advice != IB_MR_ADVICE_PREFETCH &&
+	    advice != IB_MR_ADVICE_PREFETCH_WRITE)
+		return -EOPNOTSUPP;
+
+	w = kzalloc(sizeof(*w) + num_sge * sizeof(w->frags[0]), GFP_KERNEL);
+	if (!w)
+		return -ENOMEM;
+	INIT_WORK(&w->work, mlx5_ib_prefetch_mr_work);
+	w->dev = dev;
+
+	srcu_key = srcu_read_lock(&dev->mr_srcu);
+	for (i = 0; i < num_sge; i++) {
+		struct mlx5_ib_mr *mr;
+
+		mr = mlx5_ib_odp_find_mr_lkey(dev, sg_list[i].lkey);
+		if (!mr || mr->ibmr.pd != pd || !mr->umem ||
+		    !mr->umem->odp_data) {
+			ret = -EINVAL;
+			goto out_put;
+		}
+
+		w->frags[i].mr = mr;
+		w->frags[i].io_virt = sg_list[i].addr;
+		w->frags[i].length = sg_list[i].length;
+		w->frags[i].access_mask = ODP_READ_ALLOWED_BIT;
+		if (advice == IB_MR_ADVICE_PREFETCH_WRITE &&
+		    mr->umem->writable)
+			w->frags[i].access_mask |= ODP_WRITE_ALLOWED_BIT;
+		atomic_inc(&mr->num_pending_prefetch);
+		w->num_sge++;
+	}
+
+	if (!(flags & IB_MR_ADVISE_FLUSH)) {
+		queue_work(mlx5_ib_prefetch_wq, &w->work);
+		srcu_read_unlock(&dev->mr_srcu, srcu_key);
+		return 0;
+	}
+
+	ret = prefetch_mr_frags(w);
+	w->num_sge = 0;
+
+out_put:
+	for (i = 0; i < w->num_sge; i++)
+		atomic_dec(&w->frags[i].mr->num_pending_prefetch);
+	srcu_read_unlock(&dev->mr_srcu, srcu_key);
+	kfree(w);
+	return ret;
+}
+
 int mlx5_ib_odp_init_one(struct mlx5_ib_dev *ibdev)
 {
 	int ret;
@@ -782,10 +943,18 @@ int __init mlx5_ib_odp_init(void)
 	if (!mlx5_ib_page_fault_wq)
 		return -ENOMEM;
 
+	mlx5_ib_prefetch_wq = alloc_workqueue("mlx5_ib_prefetch",
+					      WQ_UNBOUND, 0);
+	if (!mlx5_ib_prefetch_wq) {
+		destroy_workqueue(mlx5_ib_page_fault_wq);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
 void mlx5_ib_odp_cleanup(void)
 {
+	destroy_workqueue(mlx5_ib_prefetch_wq);
 	destroy_workqueue(mlx5_ib_page_fault_wq);
 }
@@ -151,16 +151,12 @@
 					 - ISER_MAX_RX_MISC_PDUS) /	\
 					 (1 + ISER_INFLIGHT_DATAOUTS))
 
-#define ISER_WC_BATCH_COUNT   16
 #define ISER_SIGNAL_CMD_COUNT 32
 
 #define ISER_VER			0x10
 #define ISER_WSV			0x08
 #define ISER_RSV			0x04
 
-#define ISER_FASTREG_LI_WRID		0xffffffffffffffffULL
-#define ISER_BEACON_WRID		0xfffffffffffffffeULL
-
 /**
  * struct iser_hdr - iSER header
  *
@@ -269,7 +265,7 @@ enum iser_desc_type {
 #define ISER_MAX_WRS 7
 
 /**
- * struct iser_tx_desc - iSER TX descriptor (for send wr_id)
+ * struct iser_tx_desc - iSER TX descriptor
  *
  * @iser_header:   iser header
  * @iscsi_header:  iscsi header
@@ -285,6 +281,7 @@ enum iser_desc_type {
  * @data_reg:      Data buffer registration details
  * @prot_reg:      Protection buffer registration details
  * @sig_attrs:     Signature attributes
+ * @cqe:           completion handler
  */
 struct iser_tx_desc {
 	struct iser_hdr              iser_header;
@@ -303,18 +300,21 @@ struct iser_tx_desc {
 	struct iser_mem_reg          data_reg;
 	struct iser_mem_reg          prot_reg;
 	struct ib_sig_attrs          sig_attrs;
+	struct ib_cqe		     cqe;
 };
 
 #define ISER_RX_PAD_SIZE	(256 - (ISER_RX_PAYLOAD_SIZE + \
-					sizeof(u64) + sizeof(struct ib_sge)))
+					sizeof(u64) + sizeof(struct ib_sge) + \
+					sizeof(struct ib_cqe)))
 /**
- * struct iser_rx_desc - iSER RX descriptor (for recv wr_id)
+ * struct iser_rx_desc - iSER RX descriptor
  *
  * @iser_header:   iser header
  * @iscsi_header:  iscsi header
  * @data:          received data segment
  * @dma_addr:      receive buffer dma address
  * @rx_sg:         ib_sge of receive buffer
+ * @cqe:           completion handler
  * @pad:           for sense data TODO: Modify to maximum sense length supported
  */
 struct iser_rx_desc {
@@ -323,6 +323,7 @@ struct iser_rx_desc {
 	char		             data[ISER_RECV_DATA_SEG_LEN];
 	u64		             dma_addr;
 	struct ib_sge		     rx_sg;
+	struct ib_cqe		     cqe;
 	char		             pad[ISER_RX_PAD_SIZE];
 } __attribute__((packed));
 
@@ -330,24 +331,6 @@ struct iser_conn;
 struct ib_conn;
 struct iscsi_iser_task;
 
-/**
- * struct iser_comp - iSER completion context
- *
- * @device:     pointer to device handle
- * @cq:         completion queue
- * @wcs:        work completion array
- * @tasklet:    Tasklet handle
- * @active_qps: Number of active QPs attached
- *              to completion context
- */
-struct iser_comp {
-	struct iser_device      *device;
-	struct ib_cq		*cq;
-	struct ib_wc		 wcs[ISER_WC_BATCH_COUNT];
-	struct tasklet_struct	 tasklet;
-	int                      active_qps;
-};
-
 /**
  * struct iser_device - Memory registration operations
  *     per-device registration schemes
@@ -385,9 +368,6 @@ struct iser_reg_ops {
  * @event_handler: IB events handle routine
  * @ig_list:	   entry in devices list
  * @refcount:      Reference counter, dominated by open iser connections
- * @comps_used:    Number of completion contexts used, Min between online
- *                 cpus and device max completion vectors
- * @comps:         Dinamically allocated array of completion handlers
  * @reg_ops:       Registration ops
  */
 struct iser_device {
@@ -398,8 +378,6 @@ struct iser_device {
 	struct ib_event_handler      event_handler;
 	struct list_head             ig_list;
 	int                          refcount;
-	int			     comps_used;
-	struct iser_comp	     *comps;
 	struct iser_reg_ops          *reg_ops;
 };
 
@@ -474,9 +452,13 @@ struct iser_fr_pool {
  * @sig_count:           send work request signal count
  * @rx_wr:               receive work request for batch posts
  * @device:              reference to iser device
- * @comp:                iser completion context
+ * @cq:                  completion queue, shared from the device CQ pool
+ * @cq_size:             entries of @cq claimed by this connection
  * @pi_support:          Indicate device T10-PI support
  * @beacon:              beacon send wr to signal all flush errors were drained
+ * @beacon_cqe:          completion handler of @beacon
+ * @reg_cqe:             completion handler of registration work requests
+ * @login_cqe:           completion handler of the login response receive
  * @flush_comp:          completes when all connection completions consumed
  * @fr_pool:             connection fast registration poool
  */
@@ -487,9 +469,13 @@ struct ib_conn {
 	u8                           sig_count;
 	struct ib_recv_wr	     rx_wr[ISER_MIN_POSTED_RX];
 	struct iser_device          *device;
-	struct iser_comp	    *comp;
+	struct ib_cq		    *cq;
+	u32			     cq_size;
 	bool			     pi_support;
 	struct ib_send_wr	     beacon;
+	struct ib_cqe		     beacon_cqe;
+	struct ib_cqe		     reg_cqe;
+	struct ib_cqe		     login_cqe;
 	struct completion	     flush_comp;
 	struct iser_fr_pool          fr_pool;
 };
@@ -633,12 +619,10 @@ int iser_conn_terminate(struct iser_conn *iser_conn);
 
 void iser_release_work(struct work_struct *work);
 
-void iser_rcv_completion(struct iser_rx_desc *desc,
-			 unsigned long dto_xfer_len,
-			 struct ib_conn *ib_conn);
-
-void iser_snd_completion(struct iser_tx_desc *desc,
-			 struct ib_conn *ib_conn);
+void iser_err_comp(struct ib_wc *wc, const char *type);
+void iser_login_rsp(struct ib_cq *cq, struct ib_wc *wc);
+void iser_task_rsp(struct ib_cq *cq, struct ib_wc *wc);
+void iser_snd_comp(struct ib_cq *cq, struct ib_wc *wc);
 
 void iser_task_rdma_init(struct iscsi_iser_task *task);
 
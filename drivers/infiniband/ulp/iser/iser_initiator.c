@@ -565,9 +565,9 @@ send_control_error:
 /**
  * iser_rcv_dto_completion - recv DTO completion
  */
-void iser_rcv_completion(struct iser_rx_desc *rx_desc,
-			 unsigned long rx_xfer_len,
-			 struct ib_conn *ib_conn)
+static void iser_rcv_completion(struct iser_rx_desc *rx_desc,
+				unsigned long rx_xfer_len,
+				struct ib_conn *ib_conn)
 {
 	struct iser_conn *iser_conn = container_of(ib_conn, struct iser_conn,
 						   ib_conn);
@@ -617,8 +617,8 @@ void iser_rcv_completion(struct iser_rx_desc *rx_desc,
 	}
 }
 
-void iser_snd_completion(struct iser_tx_desc *tx_desc,
-			struct ib_conn *ib_conn)
+static void iser_snd_completion(struct iser_tx_desc *tx_desc,
+				struct ib_conn *ib_conn)
 {
 	struct iscsi_task *task;
 	struct iser_device *device = ib_conn->device;
@@ -639,6 +639,52 @@ void iser_snd_completion(struct iser_tx_desc *tx_desc,
 	}
 }
 
+void iser_login_rsp(struct ib_cq *cq, struct ib_wc *wc)
+{
+	struct ib_conn *ib_conn = wc->qp->qp_context;
+	struct iser_conn *iser_conn = container_of(ib_conn, struct iser_conn,
+						   ib_conn);
+
+	if (unlikely(wc->status != IB_WC_SUCCESS)) {
+		iser_err_comp(wc, "login_rsp");
+		ib_conn->post_recv_buf_count--;
+		return;
+	}
+
+	iser_rcv_completion((struct iser_rx_desc *)iser_conn->login_resp_buf,
+			    wc->byte_len, ib_conn);
+}
+
+void iser_task_rsp(struct ib_cq *cq, struct ib_wc *wc)
+{
+	struct ib_conn *ib_conn = wc->qp->qp_context;
+	struct iser_rx_desc *rx_desc = container_of(wc->wr_cqe,
+						    struct iser_rx_desc, cqe);
+
+	if (unlikely(wc->status != IB_WC_SUCCESS)) {
+		iser_err_comp(wc, "task_rsp");
+		ib_conn->post_recv_buf_count--;
+		return;
+	}
+
+	iser_rcv_completion(rx_desc, wc->byte_len, ib_conn);
+}
+
+void iser_snd_comp(struct ib_cq *cq, struct ib_wc *wc)
+{
+	struct iser_tx_desc *tx_desc = container_of(wc->wr_cqe,
+						    struct iser_tx_desc, cqe);
+
+	if (unlikely(wc->status != IB_WC_SUCCESS)) {
+		iser_err_comp(wc, "send");
+		if (tx_desc->type == ISCSI_TX_DATAOUT)
+			kmem_cache_free(ig.desc_cache, tx_desc);
+		return;
+	}
+
+	iser_snd_completion(tx_desc, wc->qp->qp_context);
+}
+
 void iser_task_rdma_init(struct iscsi_iser_task *iser_task)
 
 {
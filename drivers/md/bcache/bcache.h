@@ -183,6 +183,7 @@
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/rbtree_latch.h>
 #include <linux/rwsem.h>
 #include <linux/types.h>
 #include <linux/workqueue.h>
@@ -332,6 +333,10 @@ struct cached_dev {
 
 	/* Limit number of writeback bios in flight */
 	struct semaphore	in_flight;
+
+	/* Writeback write latency, summed until update_writeback_rate() */
+	atomic64_t		writeback_lat_total;
+	atomic_t		writeback_lat_nr;
 	struct task_struct	*writeback_thread;
 
 	struct keybuf		writeback_keys;
@@ -356,13 +361,16 @@ struct cached_dev {
 	unsigned		partial_stripes_expensive:1;
 	unsigned		writeback_metadata:1;
 	unsigned		writeback_running:1;
+	unsigned		writeback_stripe_batch:1;
 	unsigned char		writeback_percent;
 	unsigned		writeback_delay;
+	unsigned		writeback_target_latency_us;
 
 	uint64_t		writeback_rate_target;
 	int64_t			writeback_rate_proportional;
 	int64_t			writeback_rate_derivative;
 	int64_t			writeback_rate_change;
+	uint64_t		writeback_latency_us;
 
 	unsigned		writeback_rate_update_seconds;
 	unsigned		writeback_rate_d_term;
@@ -547,6 +555,16 @@ struct cache_set {
 	wait_queue_head_t	btree_cache_wait;
 	struct task_struct	*btree_cache_alloc_lock;
 
+	/*
+	 * Leaf nodes by the range of keys they cover, so cache reads can find
+	 * the leaf for a key without taking the locks of every node on the
+	 * way down from the root. Readers only need RCU; inserts and removals
+	 * are serialized by leaf_index_lock. See bch_btree_map_keys_fast().
+	 */
+	struct latch_tree_root	leaf_index;
+	spinlock_t		leaf_index_lock;
+	struct btree_lookup_bench *lookup_bench;
+
 	/*
 	 * When we free a btree node, we increment the gen of the bucket the
 	 * node is in - but we can't rewrite the prios and gens until we
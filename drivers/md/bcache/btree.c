@@ -27,6 +27,7 @@
 
 #include <linux/slab.h>
 #include <linux/bitops.h>
+#include <linux/cpu.h>
 #include <linux/freezer.h>
 #include <linux/hash.h>
 #include <linux/kthread.h>
@@ -549,6 +550,97 @@ static void bch_btree_leaf_dirty(struct btree *b, atomic_t *journal_ref)
 		bch_btree_node_write(b, NULL);
 }
 
+/*
+ * Leaf node index
+ *
+ * Every leaf a lookup has walked down to gets added to c->leaf_index, keyed by
+ * the range of keys it covers, so later reads can go straight to the leaf and
+ * skip locking the root and interior nodes. The index is a latch tree: lookups
+ * only need RCU, and a node found there is reliable only once its own lock is
+ * held and it's still marked indexed. Nodes come out of the index, with their
+ * write lock held, before they're freed or reused for a different key.
+ */
+
+static int leaf_index_cmp(void *key, struct latch_tree_node *n)
+{
+	struct btree *b = container_of(n, struct btree, leaf_index);
+
+	if (bkey_cmp(key, &b->leaf_start) < 0)
+		return -1;
+	if (bkey_cmp(key, &b->key) >= 0)
+		return 1;
+	return 0;
+}
+
+static bool leaf_index_less(struct latch_tree_node *l,
+			    struct latch_tree_node *r)
+{
+	return bkey_cmp(&container_of(l, struct btree, leaf_index)->key,
+			&container_of(r, struct btree, leaf_index)->key) < 0;
+}
+
+static const struct latch_tree_ops leaf_index_ops = {
+	.less	= leaf_index_less,
+	.comp	= leaf_index_cmp,
+};
+
+static void leaf_index_rcu_done(struct rcu_head *rcu)
+{
+	struct btree *b = container_of(rcu, struct btree, leaf_rcu);
+
+	clear_bit(BTREE_NODE_index_rcu, &b->flags);
+}
+
+/*
+ * Called with b read locked. Every key in a leaf starts at or after the end of
+ * the previous leaf, so the start of any of them is a safe lower bound for the
+ * range b covers.
+ */
+static void leaf_index_add(struct btree *b)
+{
+	struct cache_set *c = b->c;
+	struct btree_iter iter;
+	struct bkey *k;
+
+	if (btree_node_indexed(b) || btree_node_index_rcu(b))
+		return;
+
+	bch_btree_iter_init(&b->keys, &iter, NULL);
+	k = bch_btree_iter_next(&iter);
+	if (!k)
+		return;
+
+	spin_lock(&c->leaf_index_lock);
+	if (!btree_node_indexed(b)) {
+		b->leaf_start = START_KEY(k);
+		latch_tree_insert(&b->leaf_index, &c->leaf_index,
+				  &leaf_index_ops);
+		smp_mb__before_atomic();
+		set_bit(BTREE_NODE_indexed, &b->flags);
+	}
+	spin_unlock(&c->leaf_index_lock);
+}
+
+/*
+ * Called with b write locked. Lockless lookups may still be walking through
+ * b's tree links, so it can't go back in the index until after a grace period.
+ */
+static void leaf_index_del(struct btree *b)
+{
+	struct cache_set *c = b->c;
+
+	if (!btree_node_indexed(b))
+		return;
+
+	spin_lock(&c->leaf_index_lock);
+	latch_tree_erase(&b->leaf_index, &c->leaf_index, &leaf_index_ops);
+	clear_bit(BTREE_NODE_indexed, &b->flags);
+	spin_unlock(&c->leaf_index_lock);
+
+	set_bit(BTREE_NODE_index_rcu, &b->flags);
+	call_rcu(&b->leaf_rcu, leaf_index_rcu_done);
+}
+
 /*
  * Btree in memory cache - allocation/freeing
  * mca -> memory cache
@@ -573,6 +665,7 @@ static void mca_bucket_free(struct btree *b)
 {
 	BUG_ON(btree_node_dirty(b));
 
+	leaf_index_del(b);
 	b->key.ptr[0] = 0;
 	hlist_del_init_rcu(&b->hash);
 	list_move(&b->list, &b->c->btree_cache_freeable);
@@ -767,6 +860,9 @@ void bch_btree_cache_free(struct cache_set *c)
 		mca_data_free(b);
 	}
 
+	/* Wait for leaf_index_rcu_done() before freeing the nodes */
+	rcu_barrier();
+
 	while (!list_empty(&c->btree_cache_freed)) {
 		b = list_first_entry(&c->btree_cache_freed,
 				     struct btree, list);
@@ -926,6 +1022,7 @@ static struct btree *mca_alloc(struct cache_set *c, struct btree_op *op,
 out:
 	BUG_ON(b->io_mutex.count != 1);
 
+	leaf_index_del(b);
 	bkey_copy(&b->key, k);
 	list_move(&b->list, &c->btree_cache);
 	hlist_del_init_rcu(&b->hash);
@@ -2308,6 +2405,9 @@ static int bch_btree_map_keys_recurse(struct btree *b, struct btree_op *op,
 	struct bkey *k;
 	struct btree_iter iter;
 
+	if (!b->level)
+		leaf_index_add(b);
+
 	bch_btree_iter_init(&b->keys, &iter, from);
 
 	while ((k = bch_btree_iter_next_filter(&iter, &b->keys, bch_ptr_bad))) {
@@ -2333,6 +2433,231 @@ int bch_btree_map_keys(struct btree_op *op, struct cache_set *c,
 	return btree_root(map_keys_recurse, c, op, from, fn, flags);
 }
 
+/*
+ * Like bch_btree_map_keys(), for lookups that usually finish in the leaf @from
+ * points into: that leaf is found in c->leaf_index and it's the only node we
+ * lock. Returns MAP_CONTINUE if the lookup wasn't finished, and the caller has
+ * to carry on with bch_btree_map_keys() from wherever @fn got to.
+ */
+int bch_btree_map_keys_fast(struct btree_op *op, struct cache_set *c,
+			    struct bkey *from, btree_map_keys_fn *fn, int flags)
+{
+	struct latch_tree_node *n;
+	struct btree *b;
+	int ret = MAP_CONTINUE;
+
+	rcu_read_lock();
+	n = latch_tree_find(from, &c->leaf_index, &leaf_index_ops);
+	rcu_read_unlock();
+
+	if (!n)
+		return MAP_CONTINUE;
+
+	/* struct btrees are only freed along with the cache set */
+	b = container_of(n, struct btree, leaf_index);
+
+	rw_lock(false, b, 0);
+
+	/*
+	 * Now it can't be freed or reused; if it's still indexed it's a live
+	 * leaf and its range is exact:
+	 */
+	if (btree_node_indexed(b)) {
+		smp_rmb();
+
+		if (!leaf_index_cmp(from, n) && !btree_node_io_error(b)) {
+			b->accessed = 1;
+			ret = bch_btree_map_keys_recurse(b, op, from, fn, flags);
+		}
+	}
+
+	rw_unlock(false, b);
+
+	/* Raced with a split or a write lock upgrade: take the slow path */
+	return ret == -EINTR ? MAP_CONTINUE : ret;
+}
+
+/* Lookup benchmark */
+
+struct btree_lookup_bench_dev {
+	unsigned		inode;
+	sector_t		sectors;
+};
+
+struct btree_lookup_bench_thread {
+	struct btree_lookup_bench *bench;
+	struct task_struct	*task;
+	unsigned		cpu;
+	unsigned long		fast;
+	u64			nsecs;
+};
+
+struct btree_lookup_bench {
+	struct cache_set	*c;
+	unsigned long		nr;
+	unsigned		nr_devs;
+	unsigned		nr_threads;
+	struct btree_lookup_bench_dev *devs;
+	struct btree_lookup_bench_thread thread[];
+};
+
+static int lookup_bench_fn(struct btree_op *op, struct btree *b,
+			   struct bkey *k)
+{
+	return MAP_DONE;
+}
+
+static int lookup_bench_thread(void *arg)
+{
+	struct btree_lookup_bench_thread *t = arg;
+	struct btree_lookup_bench *bench = t->bench;
+	struct cache_set *c = bench->c;
+	struct btree_op op;
+	unsigned long i;
+	ktime_t start;
+
+	start = ktime_get();
+
+	for (i = 0; i < bench->nr; i++) {
+		struct btree_lookup_bench_dev *d =
+			&bench->devs[prandom_u32_max(bench->nr_devs)];
+		u64 sector;
+		int ret;
+
+		div64_u64_rem((u64) prandom_u32() << 32 | prandom_u32(),
+			      d->sectors, &sector);
+
+		bch_btree_op_init(&op, -1);
+		ret = bch_btree_map_keys_fast(&op, c, &KEY(d->inode, sector, 0),
+					      lookup_bench_fn, MAP_END_KEY);
+		if (ret == MAP_CONTINUE)
+			bch_btree_map_keys(&op, c, &KEY(d->inode, sector, 0),
+					   lookup_bench_fn, MAP_END_KEY);
+		else
+			t->fast++;
+
+		cond_resched();
+	}
+
+	t->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+/*
+ * Runs @nr random lookups over the attached devices on each online cpu, the
+ * way cache reads do them, and keeps the results for
+ * bch_btree_lookup_bench_show(). Called with bch_register_lock held, so the
+ * devices stay put.
+ */
+int bch_btree_lookup_bench(struct cache_set *c, unsigned long nr)
+{
+	struct btree_lookup_bench *bench;
+	unsigned i, cpu;
+
+	if (!nr)
+		return -EINVAL;
+
+	if (!test_bit(CACHE_SET_RUNNING, &c->flags) ||
+	    test_bit(CACHE_SET_STOPPING, &c->flags))
+		return -EBUSY;
+
+	bench = kzalloc(sizeof(*bench) + nr_cpu_ids * sizeof(bench->thread[0]),
+			GFP_KERNEL);
+	if (!bench)
+		return -ENOMEM;
+
+	bench->devs = kcalloc(c->nr_uuids, sizeof(bench->devs[0]), GFP_KERNEL);
+	if (!bench->devs) {
+		kfree(bench);
+		return -ENOMEM;
+	}
+
+	bench->c = c;
+	bench->nr = nr;
+
+	for (i = 0; i < c->nr_uuids; i++) {
+		struct bcache_device *d = c->devices[i];
+
+		if (d && get_capacity(d->disk)) {
+			bench->devs[bench->nr_devs].inode = d->id;
+			bench->devs[bench->nr_devs].sectors =
+				get_capacity(d->disk);
+			bench->nr_devs++;
+		}
+	}
+
+	if (!bench->nr_devs) {
+		kfree(bench->devs);
+		kfree(bench);
+		return -ENODEV;
+	}
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct btree_lookup_bench_thread *t =
+			&bench->thread[bench->nr_threads];
+
+		t->bench = bench;
+		t->cpu = cpu;
+		t->task = kthread_create_on_node(lookup_bench_thread, t,
+						 cpu_to_node(cpu),
+						 "bcache_lookup/%u", cpu);
+		if (IS_ERR(t->task))
+			continue;
+
+		kthread_bind(t->task, cpu);
+		bench->nr_threads++;
+	}
+	put_online_cpus();
+
+	for (i = 0; i < bench->nr_threads; i++)
+		wake_up_process(bench->thread[i].task);
+
+	for (i = 0; i < bench->nr_threads; i++)
+		kthread_stop(bench->thread[i].task);
+
+	kfree(bench->devs);
+	bench->devs = NULL;
+
+	kfree(c->lookup_bench);
+	c->lookup_bench = bench;
+
+	return bench->nr_threads ? 0 : -ENOMEM;
+}
+
+ssize_t bch_btree_lookup_bench_show(struct cache_set *c, char *buf)
+{
+	struct btree_lookup_bench *bench = c->lookup_bench;
+	u64 total = 0;
+	size_t ret = 0;
+	unsigned i;
+
+	if (!bench)
+		return 0;
+
+	for (i = 0; i < bench->nr_threads; i++) {
+		struct btree_lookup_bench_thread *t = &bench->thread[i];
+		u64 usecs = max_t(u64, div_u64(t->nsecs, NSEC_PER_USEC), 1);
+		u64 rate = div64_u64((u64) bench->nr * USEC_PER_SEC, usecs);
+
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				 "cpu%u: %llu lookups/sec, %lu%% fast path\n",
+				 t->cpu, (unsigned long long) rate,
+				 t->fast * 100 / bench->nr);
+		total += rate;
+	}
+
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+			 "total: %llu lookups/sec\n", (unsigned long long) total);
+	return ret;
+}
+
 /* Keybuf code */
 
 static inline int keybuf_cmp(struct keybuf_key *l, struct keybuf_key *r)
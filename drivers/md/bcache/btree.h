@@ -144,6 +144,15 @@ struct btree {
 
 	struct btree_write	writes[2];
 	struct bio		*bio;
+
+	/*
+	 * Leaves are indexed in c->leaf_index by the range of keys they cover,
+	 * [leaf_start, key). leaf_start is only valid while the node is
+	 * indexed.
+	 */
+	struct latch_tree_node	leaf_index;
+	struct bkey		leaf_start;
+	struct rcu_head		leaf_rcu;
 };
 
 #define BTREE_FLAG(flag)						\
@@ -157,11 +166,15 @@ enum btree_flags {
 	BTREE_NODE_io_error,
 	BTREE_NODE_dirty,
 	BTREE_NODE_write_idx,
+	BTREE_NODE_indexed,
+	BTREE_NODE_index_rcu,
 };
 
 BTREE_FLAG(io_error);
 BTREE_FLAG(dirty);
 BTREE_FLAG(write_idx);
+BTREE_FLAG(indexed);
+BTREE_FLAG(index_rcu);
 
 static inline struct btree_write *btree_current_write(struct btree *b)
 {
@@ -294,6 +307,11 @@ typedef int (btree_map_keys_fn)(struct btree_op *, struct btree *,
 				struct bkey *);
 int bch_btree_map_keys(struct btree_op *, struct cache_set *,
 		       struct bkey *, btree_map_keys_fn *, int);
+int bch_btree_map_keys_fast(struct btree_op *, struct cache_set *,
+			    struct bkey *, btree_map_keys_fn *, int);
+
+int bch_btree_lookup_bench(struct cache_set *, unsigned long);
+ssize_t bch_btree_lookup_bench_show(struct cache_set *, char *);
 
 typedef bool (keybuf_pred_fn)(struct keybuf *, struct bkey *);
 
@@ -578,9 +578,13 @@ static void cache_lookup(struct closure *cl)
 
 	bch_btree_op_init(&s->op, -1);
 
-	ret = bch_btree_map_keys(&s->op, s->iop.c,
-				 &KEY(s->iop.inode, bio->bi_iter.bi_sector, 0),
-				 cache_lookup_fn, MAP_END_KEY);
+	ret = bch_btree_map_keys_fast(&s->op, s->iop.c,
+				&KEY(s->iop.inode, bio->bi_iter.bi_sector, 0),
+				cache_lookup_fn, MAP_END_KEY);
+	if (ret == MAP_CONTINUE)
+		ret = bch_btree_map_keys(&s->op, s->iop.c,
+				&KEY(s->iop.inode, bio->bi_iter.bi_sector, 0),
+				cache_lookup_fn, MAP_END_KEY);
 	if (ret == -EAGAIN) {
 		continue_at(cl, cache_lookup, bcache_wq);
 		return;
@@ -1354,6 +1354,7 @@ static void cache_set_free(struct closure *cl)
 	if (c->search)
 		mempool_destroy(c->search);
 	kfree(c->devices);
+	kfree(c->lookup_bench);
 
 	mutex_lock(&bch_register_lock);
 	list_del(&c->list);
@@ -1489,6 +1490,8 @@ struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 	mutex_init(&c->bucket_lock);
 	init_waitqueue_head(&c->btree_cache_wait);
 	init_waitqueue_head(&c->bucket_wait);
+	seqcount_init(&c->leaf_index.seq);
+	spin_lock_init(&c->leaf_index_lock);
 	sema_init(&c->uuid_write_mutex, 1);
 
 	spin_lock_init(&c->btree_gc_time.lock);
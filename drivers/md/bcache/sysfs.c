@@ -63,6 +63,7 @@ read_attribute(bset_tree_stats);
 
 read_attribute(state);
 read_attribute(cache_read_races);
+rw_attribute(lookup_bench);
 read_attribute(writeback_keys_done);
 read_attribute(writeback_keys_failed);
 read_attribute(io_errors);
@@ -75,6 +76,8 @@ rw_attribute(data_csum);
 rw_attribute(cache_mode);
 rw_attribute(writeback_metadata);
 rw_attribute(writeback_running);
+rw_attribute(writeback_stripe_batch);
+rw_attribute(writeback_target_latency_us);
 rw_attribute(writeback_percent);
 rw_attribute(writeback_delay);
 rw_attribute(writeback_rate);
@@ -124,7 +127,9 @@ SHOW(__bch_cached_dev)
 	var_printf(bypass_torture_test,	"%i");
 	var_printf(writeback_metadata,	"%i");
 	var_printf(writeback_running,	"%i");
+	var_printf(writeback_stripe_batch, "%i");
 	var_print(writeback_delay);
+	var_print(writeback_target_latency_us);
 	var_print(writeback_percent);
 	sysfs_hprint(writeback_rate,	dc->writeback_rate.rate << 9);
 
@@ -158,9 +163,11 @@ SHOW(__bch_cached_dev)
 			       "proportional:\t%s\n"
 			       "derivative:\t%s\n"
 			       "change:\t\t%s/sec\n"
-			       "next io:\t%llims\n",
+			       "next io:\t%llims\n"
+			       "write latency:\t%lluus\n",
 			       rate, dirty, target, proportional,
-			       derivative, change, next_io);
+			       derivative, change, next_io,
+			       (unsigned long long) dc->writeback_latency_us);
 	}
 
 	sysfs_hprint(dirty_data,
@@ -204,7 +211,9 @@ STORE(__cached_dev)
 	d_strtoul(bypass_torture_test);
 	d_strtoul(writeback_metadata);
 	d_strtoul(writeback_running);
+	d_strtoul(writeback_stripe_batch);
 	d_strtoul(writeback_delay);
+	d_strtoul(writeback_target_latency_us);
 
 	sysfs_strtoul_clamp(writeback_percent, dc->writeback_percent, 0, 40);
 
@@ -314,7 +323,9 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_cache_mode,
 	&sysfs_writeback_metadata,
 	&sysfs_writeback_running,
+	&sysfs_writeback_stripe_batch,
 	&sysfs_writeback_delay,
+	&sysfs_writeback_target_latency_us,
 	&sysfs_writeback_percent,
 	&sysfs_writeback_rate,
 	&sysfs_writeback_rate_update_seconds,
@@ -573,6 +584,9 @@ SHOW(__bch_cache_set)
 	if (attr == &sysfs_bset_tree_stats)
 		return bch_bset_print_stats(c, buf);
 
+	if (attr == &sysfs_lookup_bench)
+		return bch_btree_lookup_bench_show(c, buf);
+
 	return 0;
 }
 SHOW_LOCKED(bch_cache_set)
@@ -614,6 +628,13 @@ STORE(__bch_cache_set)
 		bch_cache_accounting_clear(&c->accounting);
 	}
 
+	if (attr == &sysfs_lookup_bench) {
+		int r = bch_btree_lookup_bench(c, strtoul_or_return(buf));
+
+		if (r)
+			return r;
+	}
+
 	if (attr == &sysfs_trigger_gc)
 		wake_up_gc(c);
 
@@ -714,6 +735,7 @@ static struct attribute *bch_cache_set_internal_files[] = {
 
 	&sysfs_bset_tree_stats,
 	&sysfs_cache_read_races,
+	&sysfs_lookup_bench,
 	&sysfs_writeback_keys_done,
 	&sysfs_writeback_keys_failed,
 
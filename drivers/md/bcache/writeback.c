@@ -18,6 +18,16 @@
 
 /* Rate limiting */
 
+static void update_writeback_latency(struct cached_dev *dc)
+{
+	unsigned nr = atomic_xchg(&dc->writeback_lat_nr, 0);
+	uint64_t total = atomic64_xchg(&dc->writeback_lat_total, 0);
+
+	if (nr)
+		dc->writeback_latency_us =
+			div_u64(div_u64(total, nr), NSEC_PER_USEC);
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	struct cache_set *c = dc->disk.c;
@@ -37,6 +47,8 @@ static void __update_writeback_rate(struct cached_dev *dc)
 
 	dc->disk.sectors_dirty_last = dirty;
 
+	update_writeback_latency(dc);
+
 	/* Scale to sectors per second */
 
 	proportional *= dc->writeback_rate_update_seconds;
@@ -59,6 +71,21 @@ static void __update_writeback_rate(struct cached_dev *dc)
 			 dc->writeback_rate.next + NSEC_PER_MSEC))
 		change = 0;
 
+	/*
+	 * If writes to the backing device are slower than the target, scale the
+	 * rate down in proportion - unless the cache is getting full, when
+	 * writeback has to keep going regardless:
+	 */
+	if (dc->writeback_target_latency_us &&
+	    dc->writeback_latency_us > dc->writeback_target_latency_us &&
+	    c->gc_stats.in_use <= CUTOFF_WRITEBACK) {
+		int64_t rate = dc->writeback_rate.rate;
+		int64_t scaled = div64_u64(rate * dc->writeback_target_latency_us,
+					   dc->writeback_latency_us);
+
+		change = min(change, scaled - rate);
+	}
+
 	dc->writeback_rate.rate =
 		clamp_t(int64_t, (int64_t) dc->writeback_rate.rate + change,
 			1, NSEC_PER_MSEC);
@@ -99,6 +126,7 @@ static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	uint64_t		start_time;
 	struct bio		bio;
 };
 
@@ -177,6 +205,18 @@ static void dirty_endio(struct bio *bio)
 	closure_put(&io->cl);
 }
 
+static void write_dirty_endio(struct bio *bio)
+{
+	struct keybuf_key *w = bio->bi_private;
+	struct dirty_io *io = w->private;
+
+	atomic64_add(local_clock() - io->start_time,
+		     &io->dc->writeback_lat_total);
+	atomic_inc(&io->dc->writeback_lat_nr);
+
+	dirty_endio(bio);
+}
+
 static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
@@ -186,7 +226,8 @@ static void write_dirty(struct closure *cl)
 	io->bio.bi_rw		= WRITE;
 	io->bio.bi_iter.bi_sector = KEY_START(&w->key);
 	io->bio.bi_bdev		= io->dc->bdev;
-	io->bio.bi_end_io	= dirty_endio;
+	io->bio.bi_end_io	= write_dirty_endio;
+	io->start_time		= local_clock();
 
 	closure_bio_submit(&io->bio, cl);
 
@@ -213,14 +254,64 @@ static void read_dirty_submit(struct closure *cl)
 	continue_at(cl, write_dirty, system_wq);
 }
 
+/*
+ * Stripe batching: the keys keybuf hands out are in backing device order, so
+ * consecutive keys in the same stripe are read from the cache together, and
+ * only once they've all been read are the writes issued, back to back under a
+ * plug. On a raid5/6 backing device the writes to a stripe then arrive
+ * together, instead of each one costing a read-modify-write of its own.
+ *
+ * A batch holds in_flight slots until its writes complete, so it has to stay
+ * well under the 64 in bch_cached_dev_writeback_init().
+ */
+#define WRITEBACK_BATCH_MAX	32
+
+struct dirty_batch {
+	struct closure		cl;
+	unsigned		stripe;
+	unsigned		nr;
+	struct dirty_io		*io[WRITEBACK_BATCH_MAX];
+};
+
+static void read_dirty_submit_batch(struct closure *cl)
+{
+	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
+
+	closure_bio_submit(&io->bio, cl);
+
+	closure_return(cl);
+}
+
+static void write_dirty_batch(struct dirty_batch *batch, struct closure *cl)
+{
+	struct blk_plug plug;
+	unsigned i;
+
+	if (!batch->nr)
+		return;
+
+	closure_sync(&batch->cl);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < batch->nr; i++)
+		closure_call(&batch->io[i]->cl, write_dirty, NULL, cl);
+	blk_finish_plug(&plug);
+
+	batch->nr = 0;
+}
+
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned delay = 0;
 	struct keybuf_key *w;
 	struct dirty_io *io;
 	struct closure cl;
+	struct dirty_batch batch;
+	bool batched = dc->writeback_stripe_batch;
 
 	closure_init_stack(&cl);
+	closure_init_stack(&batch.cl);
+	batch.nr = 0;
 
 	/*
 	 * XXX: if we error, background writeback just spins. Should use some
@@ -236,8 +327,23 @@ static void read_dirty(struct cached_dev *dc)
 
 		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
 
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
+		if (batched) {
+			unsigned stripe = offset_to_stripe(&dc->disk,
+							   KEY_START(&w->key));
+
+			if (batch.nr &&
+			    (stripe != batch.stripe ||
+			     batch.nr == WRITEBACK_BATCH_MAX))
+				write_dirty_batch(&batch, &cl);
+
+			/* Rate limit whole batches, not the keys in them */
+			if (!batch.nr)
+				while (!kthread_should_stop() && delay)
+					delay = schedule_timeout_interruptible(delay);
+
+			batch.stripe = stripe;
+		} else if (KEY_START(&w->key) != dc->last_read ||
+			   jiffies_to_msecs(delay) > 50)
 			while (!kthread_should_stop() && delay)
 				delay = schedule_timeout_interruptible(delay);
 
@@ -265,7 +371,13 @@ static void read_dirty(struct cached_dev *dc)
 		trace_bcache_writeback(&w->key);
 
 		down(&dc->in_flight);
-		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+
+		if (batched) {
+			batch.io[batch.nr++] = io;
+			closure_call(&io->cl, read_dirty_submit_batch, NULL,
+				     &batch.cl);
+		} else
+			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
 
 		delay = writeback_delay(dc, KEY_SIZE(&w->key));
 	}
@@ -277,6 +389,8 @@ err:
 		bch_keybuf_del(&dc->writeback_keys, w);
 	}
 
+	write_dirty_batch(&batch, &cl);
+
 	/*
 	 * Wait for outstanding writeback IOs to finish (and keybuf slots to be
 	 * freed) before refilling again
@@ -354,11 +468,13 @@ static void refill_full_stripes(struct cached_dev *dc)
 						 dc->disk.nr_stripes, stripe);
 
 		buf->last_scanned = KEY(dc->disk.id,
-					stripe * dc->disk.stripe_size, 0);
+					(uint64_t) stripe * dc->disk.stripe_size,
+					0);
 
 		bch_refill_keybuf(dc->disk.c, buf,
 				  &KEY(dc->disk.id,
-				       next_stripe * dc->disk.stripe_size, 0),
+				       (uint64_t) next_stripe *
+				       dc->disk.stripe_size, 0),
 				  dirty_pred);
 
 		if (array_freelist_empty(&buf->freelist))
@@ -395,7 +511,7 @@ static bool refill_dirty(struct cached_dev *dc)
 	    bkey_cmp(&buf->last_scanned, &end) > 0)
 		buf->last_scanned = start;
 
-	if (dc->partial_stripes_expensive) {
+	if (dc->partial_stripes_expensive || dc->writeback_stripe_batch) {
 		refill_full_stripes(dc);
 		if (array_freelist_empty(&buf->freelist))
 			return false;
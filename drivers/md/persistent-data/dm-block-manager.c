@@ -341,6 +341,16 @@ struct buffer_aux {
 	struct dm_block_validator *validator;
 	struct block_lock lock;
 	int write_locked;
+
+	/*
+	 * Hot tier.  hits and referenced are updated without any locking,
+	 * they're only hints.
+	 */
+	unsigned hits;
+	bool hot:1;
+	bool referenced:1;
+	struct list_head hot_list;
+	struct dm_buffer *buf;
 };
 
 static void dm_block_manager_alloc_callback(struct dm_buffer *buf)
@@ -348,6 +358,12 @@ static void dm_block_manager_alloc_callback(struct dm_buffer *buf)
 	struct buffer_aux *aux = dm_bufio_get_aux_data(buf);
 	aux->validator = NULL;
 	bl_init(&aux->lock);
+
+	aux->hits = 0;
+	aux->hot = false;
+	aux->referenced = false;
+	INIT_LIST_HEAD(&aux->hot_list);
+	aux->buf = buf;
 }
 
 static void dm_block_manager_write_callback(struct dm_buffer *buf)
@@ -365,8 +381,122 @@ static void dm_block_manager_write_callback(struct dm_buffer *buf)
 struct dm_block_manager {
 	struct dm_bufio_client *bufio;
 	bool read_only:1;
+
+	struct mutex hot_lock;
+	struct list_head hot;
+	unsigned nr_hot;
+	unsigned max_hot;
 };
 
+/*----------------------------------------------------------------
+ * Hot tier
+ *
+ * Metadata blocks that keep getting locked (the upper levels of the
+ * mapping btrees mostly) are pinned in memory by holding an extra bufio
+ * reference, so they can't be evicted by scans over the rest of the
+ * metadata.  Once the tier is full, entries are replaced using the clock
+ * algorithm.
+ *--------------------------------------------------------------*/
+#define HOT_THRESHOLD 8
+
+static unsigned hot_blocks;
+module_param(hot_blocks, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hot_blocks, "Default number of metadata blocks each block manager keeps pinned in memory");
+
+/*
+ * Takes a block out of the tier.  The caller drops the returned buffer
+ * with dm_bufio_release() once hot_lock is released.
+ */
+static struct dm_buffer *hot_evict(struct dm_block_manager *bm)
+{
+	struct buffer_aux *aux;
+	unsigned scanned = 0;
+
+	for (;;) {
+		aux = list_last_entry(&bm->hot, struct buffer_aux, hot_list);
+		if (!aux->referenced || ++scanned > 2 * bm->nr_hot)
+			break;
+
+		aux->referenced = false;
+		list_move(&aux->hot_list, &bm->hot);
+	}
+
+	list_del_init(&aux->hot_list);
+	aux->hot = false;
+	aux->hits = 0;
+	bm->nr_hot--;
+
+	return aux->buf;
+}
+
+static void hot_pin(struct dm_block_manager *bm, struct dm_buffer *buf,
+		    struct buffer_aux *aux)
+{
+	struct dm_buffer *victim = NULL, *pin;
+
+	mutex_lock(&bm->hot_lock);
+	if (aux->hot || !bm->max_hot) {
+		mutex_unlock(&bm->hot_lock);
+		return;
+	}
+
+	if (bm->nr_hot >= bm->max_hot)
+		victim = hot_evict(bm);
+
+	/*
+	 * The caller holds buf, so this can't miss; it takes the reference
+	 * that keeps the buffer pinned.
+	 */
+	if (dm_bufio_get(bm->bufio, dm_bufio_get_block_number(buf), &pin)) {
+		aux->hot = true;
+		aux->referenced = false;
+		list_add(&aux->hot_list, &bm->hot);
+		bm->nr_hot++;
+	}
+	mutex_unlock(&bm->hot_lock);
+
+	if (victim)
+		dm_bufio_release(victim);
+}
+
+/*
+ * Called for every successful lock.  Pinning needs to take a mutex, so
+ * only the blocking lock calls may promote a block.
+ */
+static void hot_access(struct dm_block_manager *bm, struct dm_buffer *buf,
+		       struct buffer_aux *aux, bool can_block)
+{
+	if (aux->hot) {
+		aux->referenced = true;
+		return;
+	}
+
+	if (!bm->max_hot || ++aux->hits < HOT_THRESHOLD || !can_block)
+		return;
+
+	hot_pin(bm, buf, aux);
+}
+
+void dm_bm_set_hot_blocks(struct dm_block_manager *bm, unsigned nr_blocks)
+{
+	struct dm_buffer *victim;
+
+	mutex_lock(&bm->hot_lock);
+	bm->max_hot = nr_blocks;
+	while (bm->nr_hot > bm->max_hot) {
+		victim = hot_evict(bm);
+		mutex_unlock(&bm->hot_lock);
+
+		dm_bufio_release(victim);
+
+		mutex_lock(&bm->hot_lock);
+	}
+	mutex_unlock(&bm->hot_lock);
+}
+EXPORT_SYMBOL_GPL(dm_bm_set_hot_blocks);
+
+/*----------------------------------------------------------------*/
+
 struct dm_block_manager *dm_block_manager_create(struct block_device *bdev,
 						 unsigned block_size,
 						 unsigned cache_size,
@@ -393,6 +523,11 @@ struct dm_block_manager *dm_block_manager_create(struct block_device *bdev,
 
 	bm->read_only = false;
 
+	mutex_init(&bm->hot_lock);
+	INIT_LIST_HEAD(&bm->hot);
+	bm->nr_hot = 0;
+	bm->max_hot = hot_blocks;
+
 	return bm;
 
 bad:
@@ -402,6 +537,7 @@ EXPORT_SYMBOL_GPL(dm_block_manager_create);
 
 void dm_block_manager_destroy(struct dm_block_manager *bm)
 {
+	dm_bm_set_hot_blocks(bm, 0);
 	dm_bufio_client_destroy(bm->bufio);
 	kfree(bm);
 }
@@ -474,6 +610,8 @@ int dm_bm_read_lock(struct dm_block_manager *bm, dm_block_t b,
 		return r;
 	}
 
+	hot_access(bm, to_buffer(*result), aux, true);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(dm_bm_read_lock);
@@ -510,6 +648,8 @@ int dm_bm_write_lock(struct dm_block_manager *bm,
 		return r;
 	}
 
+	hot_access(bm, to_buffer(*result), aux, true);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(dm_bm_write_lock);
@@ -544,6 +684,8 @@ int dm_bm_read_try_lock(struct dm_block_manager *bm,
 		return r;
 	}
 
+	hot_access(bm, to_buffer(*result), aux, false);
+
 	return 0;
 }
 
@@ -607,6 +749,12 @@ void dm_bm_prefetch(struct dm_block_manager *bm, dm_block_t b)
 	dm_bufio_prefetch(bm->bufio, b, 1);
 }
 
+void dm_bm_write_ahead(struct dm_block_manager *bm)
+{
+	if (!bm->read_only)
+		dm_bufio_write_dirty_buffers_async(bm->bufio);
+}
+
 bool dm_bm_is_read_only(struct dm_block_manager *bm)
 {
 	return bm->read_only;
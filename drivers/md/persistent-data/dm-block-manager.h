@@ -112,6 +112,19 @@ int dm_bm_flush(struct dm_block_manager *bm);
  */
 void dm_bm_prefetch(struct dm_block_manager *bm, dm_block_t b);
 
+/*
+ * Starts writing out dirty blocks without waiting for them, so that a
+ * later dm_bm_flush() has less to do.
+ */
+void dm_bm_write_ahead(struct dm_block_manager *bm);
+
+/*
+ * Sets how many frequently locked blocks are kept pinned in memory, so
+ * they're never evicted from the cache.  Defaults to the hot_blocks
+ * module parameter; 0 disables pinning.
+ */
+void dm_bm_set_hot_blocks(struct dm_block_manager *bm, unsigned nr_blocks);
+
 /*
  * Switches the bm to a read only mode.  Once read-only mode
  * has been entered the following functions will return -EPERM.
@@ -668,6 +668,9 @@ int dm_btree_remove_leaves(struct dm_btree_info *info, dm_block_t root,
 {
 	int r;
 
+	/* Best effort, a failure here shows up again in remove_one() */
+	dm_btree_prefetch_range(info, root, first_key, end_key);
+
 	*nr_removed = 0;
 	do {
 		r = remove_one(info, root, first_key, end_key, &root, nr_removed);
@@ -487,6 +487,76 @@ out:
 
 EXPORT_SYMBOL_GPL(dm_btree_lookup_next);
 
+/*
+ * Walks down the path to @begin, issuing reads for the siblings along the
+ * way that hold keys before @end.
+ */
+static int prefetch_range(struct ro_spine *s, dm_block_t block,
+			  uint64_t begin, uint64_t end)
+{
+	int r, i, last;
+	uint32_t nr_entries;
+	struct btree_node *n;
+	struct dm_block_manager *bm = dm_tm_get_bm(s->info->tm);
+
+	if (end <= begin)
+		return 0;
+
+	for (;;) {
+		r = ro_step(s, block);
+		if (r < 0)
+			return r;
+
+		n = ro_node(s);
+		nr_entries = le32_to_cpu(n->header.nr_entries);
+		if (!(le32_to_cpu(n->header.flags) & INTERNAL_NODE) ||
+		    !nr_entries)
+			return 0;
+
+		last = lower_bound(n, end - 1);
+		if (last < 0)
+			return 0;
+
+		i = max(lower_bound(n, begin), 0);
+		block = value64(n, i);
+
+		for (i++; i <= last && i < nr_entries; i++)
+			dm_bm_prefetch(bm, value64(n, i));
+	}
+}
+
+int dm_btree_prefetch_range(struct dm_btree_info *info, dm_block_t root,
+			    uint64_t *keys, uint64_t end_key)
+{
+	unsigned level;
+	int r = 0;
+	uint64_t rkey;
+	__le64 internal_value_le;
+	struct ro_spine spine;
+
+	init_ro_spine(&spine, info);
+	for (level = 0; level < info->levels - 1u; level++) {
+		r = btree_lookup_raw(&spine, root, keys[level],
+				     lower_bound, &rkey,
+				     &internal_value_le, sizeof(uint64_t));
+		if (r)
+			goto out;
+
+		if (rkey != keys[level]) {
+			r = -ENODATA;
+			goto out;
+		}
+
+		root = le64_to_cpu(internal_value_le);
+	}
+
+	r = prefetch_range(&spine, root, keys[level], end_key);
+out:
+	exit_ro_spine(&spine);
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_prefetch_range);
+
 /*
  * Splits a node by creating a sibling node and shifting half the nodes
  * contents across.  Assumes there is a parent node, and it has room for
@@ -958,6 +1028,10 @@ static int walk_node(struct dm_btree_info *info, dm_block_t block,
 	n = dm_block_data(node);
 
 	nr = le32_to_cpu(n->header.nr_entries);
+	if (le32_to_cpu(n->header.flags) & INTERNAL_NODE)
+		for (i = 0; i < nr; i++)
+			dm_bm_prefetch(dm_tm_get_bm(info->tm), value64(n, i));
+
 	for (i = 0; i < nr; i++) {
 		if (le32_to_cpu(n->header.flags) & INTERNAL_NODE) {
 			r = walk_node(info, value64(n, i), fn, context);
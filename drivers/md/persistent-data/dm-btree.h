@@ -116,6 +116,15 @@ int dm_btree_lookup(struct dm_btree_info *info, dm_block_t root,
 int dm_btree_lookup_next(struct dm_btree_info *info, dm_block_t root,
 			 uint64_t *keys, uint64_t *rkey, void *value_le);
 
+/*
+ * Issues reads for the nodes holding the bottom level keys from @keys up
+ * to, but not including, @end_key, so a following walk over the range
+ * doesn't stall on them one at a time.  Nothing is waited for, apart from
+ * the nodes on the path to the first key.
+ */
+int dm_btree_prefetch_range(struct dm_btree_info *info, dm_block_t root,
+			    uint64_t *keys, uint64_t end_key);
+
 /*
  * Insertion (or overwrite an existing value).  O(ln(n))
  */
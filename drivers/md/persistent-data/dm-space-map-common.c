@@ -9,6 +9,7 @@
 
 #include <linux/bitops.h>
 #include <linux/device-mapper.h>
+#include <linux/slab.h>
 
 #define DM_MSG_PREFIX "space map common"
 
@@ -508,6 +509,278 @@ int sm_ll_dec(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev)
 	return sm_ll_mutate(ll, b, dec_ref_count, NULL, ev);
 }
 
+/*----------------------------------------------------------------*/
+
+/*
+ * Batched reference count updates.
+ *
+ * Instead of every inc or dec immediately shadowing the bitmap block it
+ * lives in, and updating the index entry for that bitmap, updates are
+ * collected by block and applied in one sorted pass, usually at commit.
+ * Each bitmap touched is shadowed and its index entry written once, the
+ * ref count tree is updated in key order, and repeated updates to a
+ * block cancel out before touching the disk.
+ */
+struct sm_ll_delta {
+	struct rb_node node;
+	dm_block_t b;
+	int32_t delta;
+	uint32_t old;
+};
+
+void sm_ll_batch_init(struct sm_ll_batch *batch)
+{
+	batch->deltas = RB_ROOT;
+	batch->nr = 0;
+}
+
+void sm_ll_batch_destroy(struct sm_ll_batch *batch)
+{
+	struct sm_ll_delta *d, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(d, tmp, &batch->deltas, node)
+		kfree(d);
+
+	sm_ll_batch_init(batch);
+}
+
+static struct sm_ll_delta *batch_find(struct sm_ll_batch *batch, dm_block_t b,
+				      struct rb_node ***link, struct rb_node **parent)
+{
+	struct rb_node **n = &batch->deltas.rb_node;
+	struct sm_ll_delta *d;
+
+	*parent = NULL;
+	while (*n) {
+		d = rb_entry(*n, struct sm_ll_delta, node);
+
+		*parent = *n;
+		if (b < d->b)
+			n = &(*n)->rb_left;
+		else if (b > d->b)
+			n = &(*n)->rb_right;
+		else
+			return d;
+	}
+
+	if (link)
+		*link = n;
+
+	return NULL;
+}
+
+int sm_ll_batch_delta(struct sm_ll_batch *batch, dm_block_t b)
+{
+	struct rb_node *parent;
+	struct sm_ll_delta *d = batch_find(batch, b, NULL, &parent);
+
+	return d ? d->delta : 0;
+}
+
+int sm_ll_batch_add(struct sm_ll_batch *batch, dm_block_t b, int delta)
+{
+	struct rb_node **link, *parent;
+	struct sm_ll_delta *d = batch_find(batch, b, &link, &parent);
+
+	if (d) {
+		d->delta += delta;
+		return 0;
+	}
+
+	if (batch->nr >= SM_LL_BATCH_MAX)
+		return -ENOMEM;
+
+	d = kmalloc(sizeof(*d), GFP_NOIO);
+	if (!d)
+		return -ENOMEM;
+
+	d->b = b;
+	d->delta = delta;
+
+	rb_link_node(&d->node, parent, link);
+	rb_insert_color(&d->node, &batch->deltas);
+	batch->nr++;
+
+	return 0;
+}
+
+static dm_block_t delta_index(struct ll_disk *ll, struct sm_ll_delta *d,
+			      uint32_t *bit)
+{
+	dm_block_t index = d->b;
+
+	*bit = do_div(index, ll->entries_per_block);
+	return index;
+}
+
+/*
+ * Start reading every bitmap the batch touches, so the pass below only
+ * waits for the first.
+ */
+static int batch_prefetch(struct ll_disk *ll, struct sm_ll_batch *batch)
+{
+	int r;
+	uint32_t bit;
+	dm_block_t index, last = ~0ULL;
+	struct disk_index_entry ie_disk;
+	struct rb_node *n;
+
+	for (n = rb_first(&batch->deltas); n; n = rb_next(n)) {
+		index = delta_index(ll, rb_entry(n, struct sm_ll_delta, node), &bit);
+		if (index == last)
+			continue;
+
+		r = ll->load_ie(ll, index, &ie_disk);
+		if (r < 0)
+			return r;
+
+		dm_bm_prefetch(dm_tm_get_bm(ll->tm), le64_to_cpu(ie_disk.blocknr));
+		last = index;
+	}
+
+	return 0;
+}
+
+/*
+ * Applies the deltas for one bitmap, from @first up to the first delta
+ * in a different bitmap, which is returned through @next.
+ */
+static int batch_apply_bitmap(struct ll_disk *ll, struct rb_node *first,
+			      struct rb_node **next)
+{
+	int r;
+	uint32_t bit;
+	int64_t ref_count;
+	dm_block_t index;
+	struct disk_index_entry ie_disk;
+	struct dm_block *nb;
+	struct rb_node *n;
+	struct sm_ll_delta *d;
+	void *bm_le;
+	int inc;
+
+	index = delta_index(ll, rb_entry(first, struct sm_ll_delta, node), &bit);
+
+	r = ll->load_ie(ll, index, &ie_disk);
+	if (r < 0)
+		return r;
+
+	r = dm_tm_shadow_block(ll->tm, le64_to_cpu(ie_disk.blocknr),
+			       &dm_sm_bitmap_validator, &nb, &inc);
+	if (r < 0) {
+		DMERR("dm_tm_shadow_block() failed");
+		return r;
+	}
+	ie_disk.blocknr = cpu_to_le64(dm_block_location(nb));
+	bm_le = dm_bitmap_data(nb);
+
+	for (n = first; n; n = rb_next(n)) {
+		d = rb_entry(n, struct sm_ll_delta, node);
+		if (delta_index(ll, d, &bit) != index)
+			break;
+
+		d->old = sm_lookup_bitmap(bm_le, bit);
+		if (!d->delta)
+			continue;
+
+		if (d->old > 2) {
+			r = sm_ll_lookup_big_ref_count(ll, d->b, &d->old);
+			if (r < 0)
+				goto out;
+		}
+
+		ref_count = (int64_t) d->old + d->delta;
+		if (ref_count < 0 || ref_count > UINT_MAX) {
+			DMERR_LIMIT("reference count for block %llu out of range",
+				    (unsigned long long) d->b);
+			r = -EINVAL;
+			goto out;
+		}
+
+		sm_set_bitmap(bm_le, bit, min_t(int64_t, ref_count, 3));
+
+		if (ref_count && !d->old) {
+			ll->nr_allocated++;
+			le32_add_cpu(&ie_disk.nr_free, -1);
+			if (le32_to_cpu(ie_disk.none_free_before) == bit)
+				ie_disk.none_free_before = cpu_to_le32(bit + 1);
+
+		} else if (d->old && !ref_count) {
+			ll->nr_allocated--;
+			le32_add_cpu(&ie_disk.nr_free, 1);
+			ie_disk.none_free_before = cpu_to_le32(min(le32_to_cpu(ie_disk.none_free_before), bit));
+		}
+	}
+	*next = n;
+out:
+	dm_tm_unlock(ll->tm, nb);
+	if (r)
+		return r;
+
+	r = ll->save_ie(ll, index, &ie_disk);
+	if (r < 0)
+		return r;
+
+	/*
+	 * The ref count tree can only be changed once the bitmap is
+	 * unlocked, since that may allocate.
+	 */
+	for (n = first; n != *next; n = rb_next(n)) {
+		d = rb_entry(n, struct sm_ll_delta, node);
+		if (!d->delta)
+			continue;
+
+		ref_count = (int64_t) d->old + d->delta;
+		if (ref_count > 2) {
+			__le32 le_rc = cpu_to_le32(ref_count);
+
+			__dm_bless_for_disk(&le_rc);
+			r = dm_btree_insert(&ll->ref_count_info, ll->ref_count_root,
+					    &d->b, &le_rc, &ll->ref_count_root);
+			if (r < 0) {
+				DMERR("ref count insert failed");
+				return r;
+			}
+
+		} else if (d->old > 2) {
+			r = dm_btree_remove(&ll->ref_count_info,
+					    ll->ref_count_root,
+					    &d->b, &ll->ref_count_root);
+			if (r)
+				return r;
+		}
+	}
+
+	return 0;
+}
+
+int sm_ll_batch_apply(struct ll_disk *ll, struct sm_ll_batch *batch)
+{
+	int r;
+	struct rb_node *n;
+
+	if (!batch->nr)
+		return 0;
+
+	r = batch_prefetch(ll, batch);
+
+	for (n = rb_first(&batch->deltas); n && !r;)
+		r = batch_apply_bitmap(ll, n, &n);
+
+	sm_ll_batch_destroy(batch);
+
+	/*
+	 * Get the shadowed bitmaps heading for the disk now, rather than
+	 * leaving all of them to the flush at the end of the commit.
+	 */
+	if (!r)
+		dm_bm_write_ahead(dm_tm_get_bm(ll->tm));
+
+	return r;
+}
+
+/*----------------------------------------------------------------*/
+
 int sm_ll_commit(struct ll_disk *ll)
 {
 	int r = 0;
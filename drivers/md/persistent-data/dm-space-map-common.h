@@ -9,6 +9,8 @@
 
 #include "dm-btree.h"
 
+#include <linux/rbtree.h>
+
 /*----------------------------------------------------------------*/
 
 /*
@@ -114,6 +116,24 @@ int sm_ll_inc(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev);
 int sm_ll_dec(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev);
 int sm_ll_commit(struct ll_disk *ll);
 
+/*
+ * Ref count updates collected by block, to be applied in a single sorted
+ * pass.  Beyond SM_LL_BATCH_MAX blocks, sm_ll_batch_add() fails with
+ * -ENOMEM and the caller should apply the batch.
+ */
+#define SM_LL_BATCH_MAX 65536
+
+struct sm_ll_batch {
+	struct rb_root deltas;
+	unsigned nr;
+};
+
+void sm_ll_batch_init(struct sm_ll_batch *batch);
+void sm_ll_batch_destroy(struct sm_ll_batch *batch);
+int sm_ll_batch_add(struct sm_ll_batch *batch, dm_block_t b, int delta);
+int sm_ll_batch_delta(struct sm_ll_batch *batch, dm_block_t b);
+int sm_ll_batch_apply(struct ll_disk *ll, struct sm_ll_batch *batch);
+
 int sm_ll_new_metadata(struct ll_disk *ll, struct dm_transaction_manager *tm);
 int sm_ll_open_metadata(struct ll_disk *ll, struct dm_transaction_manager *tm,
 			void *root_le, size_t len);
@@ -29,19 +29,51 @@ struct sm_disk {
 
 	dm_block_t begin;
 	dm_block_t nr_allocated_this_transaction;
+
+	/*
+	 * Ref count changes not yet written to the bitmaps, applied
+	 * together at commit.
+	 */
+	struct sm_ll_batch pending;
 };
 
+/*
+ * Queues a ref count change.  If the batch is full, or we're out of
+ * memory, everything queued is applied and this change made directly.
+ */
+static int sm_disk_adjust(struct sm_disk *smd, dm_block_t b, int delta)
+{
+	int r;
+	enum allocation_event ev;
+
+	r = sm_ll_batch_add(&smd->pending, b, delta);
+	if (r != -ENOMEM)
+		return r;
+
+	r = sm_ll_batch_apply(&smd->ll, &smd->pending);
+	if (r)
+		return r;
+
+	return delta > 0 ? sm_ll_inc(&smd->ll, b, &ev) : sm_ll_dec(&smd->ll, b, &ev);
+}
+
 static void sm_disk_destroy(struct dm_space_map *sm)
 {
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
+	sm_ll_batch_destroy(&smd->pending);
 	kfree(smd);
 }
 
 static int sm_disk_extend(struct dm_space_map *sm, dm_block_t extra_blocks)
 {
+	int r;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
+	r = sm_ll_batch_apply(&smd->ll, &smd->pending);
+	if (r)
+		return r;
+
 	return sm_ll_extend(&smd->ll, extra_blocks);
 }
 
@@ -64,8 +96,16 @@ static int sm_disk_get_nr_free(struct dm_space_map *sm, dm_block_t *count)
 static int sm_disk_get_count(struct dm_space_map *sm, dm_block_t b,
 			     uint32_t *result)
 {
+	int r;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
-	return sm_ll_lookup(&smd->ll, b, result);
+
+	r = sm_ll_lookup(&smd->ll, b, result);
+	if (r)
+		return r;
+
+	*result += sm_ll_batch_delta(&smd->pending, b);
+
+	return 0;
 }
 
 static int sm_disk_count_is_more_than_one(struct dm_space_map *sm, dm_block_t b,
@@ -91,6 +131,10 @@ static int sm_disk_set_count(struct dm_space_map *sm, dm_block_t b,
 	enum allocation_event ev;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
+	r = sm_ll_batch_apply(&smd->ll, &smd->pending);
+	if (r)
+		return r;
+
 	r = sm_ll_insert(&smd->ll, b, count, &ev);
 	if (!r) {
 		switch (ev) {
@@ -126,11 +170,15 @@ static int sm_disk_set_count(struct dm_space_map *sm, dm_block_t b,
 static int sm_disk_inc_block(struct dm_space_map *sm, dm_block_t b)
 {
 	int r;
-	enum allocation_event ev;
+	uint32_t count;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
-	r = sm_ll_inc(&smd->ll, b, &ev);
-	if (!r && (ev == SM_ALLOC))
+	r = sm_disk_get_count(sm, b, &count);
+	if (r)
+		return r;
+
+	r = sm_disk_adjust(smd, b, 1);
+	if (!r && !count)
 		/*
 		 * This _must_ be free in the prior transaction
 		 * otherwise we've lost atomicity.
@@ -142,16 +190,25 @@ static int sm_disk_inc_block(struct dm_space_map *sm, dm_block_t b)
 
 static int sm_disk_dec_block(struct dm_space_map *sm, dm_block_t b)
 {
-	enum allocation_event ev;
+	int r;
+	uint32_t count;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
-	return sm_ll_dec(&smd->ll, b, &ev);
+	r = sm_disk_get_count(sm, b, &count);
+	if (r)
+		return r;
+
+	if (!count) {
+		DMERR_LIMIT("unable to decrement a reference count below 0");
+		return -EINVAL;
+	}
+
+	return sm_disk_adjust(smd, b, -1);
 }
 
 static int sm_disk_new_block(struct dm_space_map *sm, dm_block_t *b)
 {
 	int r;
-	enum allocation_event ev;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
 	/* FIXME: we should loop round a couple of times */
@@ -160,11 +217,9 @@ static int sm_disk_new_block(struct dm_space_map *sm, dm_block_t *b)
 		return r;
 
 	smd->begin = *b + 1;
-	r = sm_ll_inc(&smd->ll, *b, &ev);
-	if (!r) {
-		BUG_ON(ev != SM_ALLOC);
+	r = sm_disk_adjust(smd, *b, 1);
+	if (!r)
 		smd->nr_allocated_this_transaction++;
-	}
 
 	return r;
 }
@@ -175,6 +230,10 @@ static int sm_disk_commit(struct dm_space_map *sm)
 	dm_block_t nr_free;
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
+	r = sm_ll_batch_apply(&smd->ll, &smd->pending);
+	if (r)
+		return r;
+
 	r = sm_disk_get_nr_free(sm, &nr_free);
 	if (r)
 		return r;
@@ -250,6 +309,7 @@ struct dm_space_map *dm_sm_disk_create(struct dm_transaction_manager *tm,
 
 	smd->begin = 0;
 	smd->nr_allocated_this_transaction = 0;
+	sm_ll_batch_init(&smd->pending);
 	memcpy(&smd->sm, &ops, sizeof(smd->sm));
 
 	r = sm_ll_new_disk(&smd->ll, tm);
@@ -284,6 +344,7 @@ struct dm_space_map *dm_sm_disk_open(struct dm_transaction_manager *tm,
 
 	smd->begin = 0;
 	smd->nr_allocated_this_transaction = 0;
+	sm_ll_batch_init(&smd->pending);
 	memcpy(&smd->sm, &ops, sizeof(smd->sm));
 
 	r = sm_ll_open_disk(&smd->ll, tm, root_le, len);
@@ -758,9 +758,14 @@ static inline void __update_lacpdu_from_port(struct port *port)
 /* ================= main 802.3ad protocol code ========================= */
 
 /**
- * ad_lacpdu_send - send out a lacpdu packet on a given port
+ * ad_lacpdu_send - queue a lacpdu packet for a given port
  * @port: the port we're looking at
  *
+ * The packet is only handed to the slave by ad_lacpdu_flush(), once
+ * bond->mode_lock has been released, so that neither the other ports'
+ * state machines nor the LACPDU receive path wait behind the slave's
+ * qdisc.  A packet still queued is replaced by the newer one.
+ *
  * Returns:   0 on success
  *          < 0 on error
  */
@@ -792,11 +797,25 @@ static int ad_lacpdu_send(struct port *port)
 
 	lacpdu_header->lacpdu = port->lacpdu;
 
-	dev_queue_xmit(skb);
+	kfree_skb(xchg(&port->lacpdu_skb, skb));
 
 	return 0;
 }
 
+/**
+ * ad_lacpdu_flush - transmit the lacpdu queued on a given port, if any
+ * @port: the port we're looking at
+ *
+ * Must be called without bond->mode_lock held.
+ */
+static void ad_lacpdu_flush(struct port *port)
+{
+	struct sk_buff *skb = xchg(&port->lacpdu_skb, NULL);
+
+	if (skb)
+		dev_queue_xmit(skb);
+}
+
 /**
  * ad_marker_send - send marker information/response on a given port
  * @port: the port we're looking at
@@ -2136,6 +2155,7 @@ void bond_3ad_unbind_slave(struct slave *slave)
 
 out:
 	spin_unlock_bh(&bond->mode_lock);
+	ad_lacpdu_flush(port);
 }
 
 /**
@@ -2221,9 +2241,12 @@ re_arm:
 			break;
 		}
 	}
-	rcu_read_unlock();
 	spin_unlock_bh(&bond->mode_lock);
 
+	bond_for_each_slave_rcu(bond, slave, iter)
+		ad_lacpdu_flush(&(SLAVE_AD_INFO(slave)->port));
+	rcu_read_unlock();
+
 	if (update_slave_arr)
 		bond_slave_arr_work_rearm(bond, 0);
 
@@ -3148,9 +3148,11 @@ u32 bond_xmit_hash(struct bonding *bond, struct sk_buff *skb)
 	struct flow_keys flow;
 	u32 hash;
 
-	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34 &&
-	    skb->l4_hash)
-		return skb->hash;
+	/* The flow hash is kept in the skb, so the dissection is shared
+	 * with the slave's own queue selection and any later RPS steering.
+	 */
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34)
+		return skb_get_hash(skb);
 
 	if (bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER2 ||
 	    !bond_flow_dissect(bond, skb, &flow))
@@ -3292,6 +3294,7 @@ static struct rtnl_link_stats64 *bond_get_stats(struct net_device *bond_dev,
 	struct rtnl_link_stats64 temp;
 	struct list_head *iter;
 	struct slave *slave;
+	int cpu;
 
 	spin_lock(&bond->stats_lock);
 	memcpy(stats, &bond->bond_stats, sizeof(*stats));
@@ -3311,6 +3314,10 @@ static struct rtnl_link_stats64 *bond_get_stats(struct net_device *bond_dev,
 	memcpy(&bond->bond_stats, stats, sizeof(*stats));
 	spin_unlock(&bond->stats_lock);
 
+	/* the bond's own drops are not part of the folded slave stats */
+	for_each_possible_cpu(cpu)
+		stats->tx_dropped += *per_cpu_ptr(bond->tx_dropped, cpu);
+
 	return stats;
 }
 
@@ -4115,6 +4122,7 @@ static void bond_destructor(struct net_device *bond_dev)
 	struct bonding *bond = netdev_priv(bond_dev);
 	if (bond->wq)
 		destroy_workqueue(bond->wq);
+	free_percpu(bond->tx_dropped);
 	free_netdev(bond_dev);
 }
 
@@ -4600,6 +4608,13 @@ static int bond_init(struct net_device *bond_dev)
 	if (!bond->wq)
 		return -ENOMEM;
 
+	bond->tx_dropped = alloc_percpu(unsigned long);
+	if (!bond->tx_dropped) {
+		destroy_workqueue(bond->wq);
+		bond->wq = NULL;
+		return -ENOMEM;
+	}
+
 	bond_set_lockdep_class(bond_dev);
 
 	list_add_tail(&bond->bond_list, &bn->dev_list);
@@ -170,10 +170,14 @@ static const struct i40e_stats i40e_gstrings_fcoe_stats[] = {
 };
 
 #endif /* I40E_FCOE */
+/* tx_doorbells and tx_xmit_more, after each Tx ring's packets and bytes */
+#define I40E_TX_DOORBELL_STATS	2
 #define I40E_QUEUE_STATS_LEN(n) \
 	(((struct i40e_netdev_priv *)netdev_priv((n)))->vsi->num_queue_pairs \
 	    * 2 /* Tx and Rx together */                                     \
-	    * (sizeof(struct i40e_queue_stats) / sizeof(u64)))
+	    * (sizeof(struct i40e_queue_stats) / sizeof(u64))                \
+	  + ((struct i40e_netdev_priv *)netdev_priv((n)))->vsi->num_queue_pairs \
+	    * I40E_TX_DOORBELL_STATS)
 #define I40E_GLOBAL_STATS_LEN	ARRAY_SIZE(i40e_gstrings_stats)
 #define I40E_NETDEV_STATS_LEN   ARRAY_SIZE(i40e_gstrings_net_stats)
 #define I40E_MISC_STATS_LEN	ARRAY_SIZE(i40e_gstrings_misc_stats)
@@ -1380,8 +1384,10 @@ static void i40e_get_ethtool_stats(struct net_device *netdev,
 			start = u64_stats_fetch_begin_irq(&tx_ring->syncp);
 			data[i] = tx_ring->stats.packets;
 			data[i + 1] = tx_ring->stats.bytes;
+			data[i + 2] = tx_ring->tx_stats.tx_doorbells;
+			data[i + 3] = tx_ring->tx_stats.tx_xmit_more;
 		} while (u64_stats_fetch_retry_irq(&tx_ring->syncp, start));
-		i += 2;
+		i += 2 + I40E_TX_DOORBELL_STATS;
 
 		/* Rx ring is the 2nd half of the queue pair */
 		rx_ring = &tx_ring[1];
@@ -1469,6 +1475,10 @@ static void i40e_get_strings(struct net_device *netdev, u32 stringset,
 			p += ETH_GSTRING_LEN;
 			snprintf(p, ETH_GSTRING_LEN, "tx-%u.tx_bytes", i);
 			p += ETH_GSTRING_LEN;
+			snprintf(p, ETH_GSTRING_LEN, "tx-%u.tx_doorbells", i);
+			p += ETH_GSTRING_LEN;
+			snprintf(p, ETH_GSTRING_LEN, "tx-%u.tx_xmit_more", i);
+			p += ETH_GSTRING_LEN;
 			snprintf(p, ETH_GSTRING_LEN, "rx-%u.rx_packets", i);
 			p += ETH_GSTRING_LEN;
 			snprintf(p, ETH_GSTRING_LEN, "rx-%u.rx_bytes", i);
@@ -4124,8 +4124,10 @@ static void i40e_free_q_vector(struct i40e_vsi *vsi, int v_idx)
 		ring->q_vector = NULL;
 
 	/* only VSI w/ an associated netdev is set up w/ NAPI */
-	if (vsi->netdev)
+	if (vsi->netdev) {
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
+	}
 
 	vsi->q_vectors[v_idx] = NULL;
 
@@ -7677,9 +7679,11 @@ static int i40e_vsi_alloc_q_vector(struct i40e_vsi *vsi, int v_idx)
 	q_vector->vsi = vsi;
 	q_vector->v_idx = v_idx;
 	cpumask_set_cpu(v_idx, &q_vector->affinity_mask);
-	if (vsi->netdev)
+	if (vsi->netdev) {
 		netif_napi_add(vsi->netdev, &q_vector->napi,
 			       i40e_napi_poll, NAPI_POLL_WEIGHT);
+		napi_hash_add(&q_vector->napi);
+	}
 
 	q_vector->rx.latency_range = I40E_LOW_LATENCY;
 	q_vector->tx.latency_range = I40E_LOW_LATENCY;
@@ -637,10 +637,12 @@ u32 i40e_get_tx_pending(struct i40e_ring *ring)
  * i40e_clean_tx_irq - Reclaim resources after transmit completes
  * @tx_ring:  tx ring to clean
  * @budget:   how many cleans we're allowed
+ * @napi_budget: Used to determine if we are in netpoll
  *
  * Returns true if there's any budget left (e.g. the clean is finished)
  **/
-static bool i40e_clean_tx_irq(struct i40e_ring *tx_ring, int budget)
+static bool i40e_clean_tx_irq(struct i40e_ring *tx_ring, int budget,
+			      int napi_budget)
 {
 	u16 i = tx_ring->next_to_clean;
 	struct i40e_tx_buffer *tx_buf;
@@ -677,7 +679,7 @@ static bool i40e_clean_tx_irq(struct i40e_ring *tx_ring, int budget)
 		total_packets += tx_buf->gso_segs;
 
 		/* free the skb */
-		dev_consume_skb_any(tx_buf->skb);
+		napi_consume_skb(tx_buf->skb, napi_budget);
 
 		/* unmap skb header data */
 		dma_unmap_single(tx_ring->dev,
@@ -1302,16 +1304,24 @@ no_buffers:
  * @rx_ring:  rx ring in play
  * @skb: packet to send up
  * @vlan_tag: vlan tag for packet
+ * @rx_list: packets to be passed up together at the end of the poll
+ *
+ * Without GRO there is nothing to gain from handing packets to the stack
+ * one by one, so they are collected on @rx_list for netif_receive_skb_list.
  **/
 static void i40e_receive_skb(struct i40e_ring *rx_ring,
-			     struct sk_buff *skb, u16 vlan_tag)
+			     struct sk_buff *skb, u16 vlan_tag,
+			     struct sk_buff_head *rx_list)
 {
 	struct i40e_q_vector *q_vector = rx_ring->q_vector;
 
 	if (vlan_tag & VLAN_VID_MASK)
 		__vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q), vlan_tag);
 
-	napi_gro_receive(&q_vector->napi, skb);
+	if (rx_ring->netdev->features & NETIF_F_GRO)
+		napi_gro_receive(&q_vector->napi, skb);
+	else
+		__skb_queue_tail(rx_list, skb);
 }
 
 /**
@@ -1487,6 +1497,7 @@ static int i40e_clean_rx_irq_ps(struct i40e_ring *rx_ring, int budget)
 	struct i40e_vsi *vsi = rx_ring->vsi;
 	u16 i = rx_ring->next_to_clean;
 	union i40e_rx_desc *rx_desc;
+	struct sk_buff_head rx_list;
 	u32 rx_error, rx_status;
 	u8 rx_ptype;
 	u64 qword;
@@ -1494,6 +1505,8 @@ static int i40e_clean_rx_irq_ps(struct i40e_ring *rx_ring, int budget)
 	if (budget <= 0)
 		return 0;
 
+	__skb_queue_head_init(&rx_list);
+
 	do {
 		struct i40e_rx_buffer *rx_bi;
 		struct sk_buff *skb;
@@ -1647,12 +1660,14 @@ static int i40e_clean_rx_irq_ps(struct i40e_ring *rx_ring, int budget)
 		}
 #endif
 		skb_mark_napi_id(skb, &rx_ring->q_vector->napi);
-		i40e_receive_skb(rx_ring, skb, vlan_tag);
+		i40e_receive_skb(rx_ring, skb, vlan_tag, &rx_list);
 
 		rx_desc->wb.qword1.status_error_len = 0;
 
 	} while (likely(total_rx_packets < budget));
 
+	netif_receive_skb_list(&rx_list);
+
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
 	rx_ring->stats.bytes += total_rx_bytes;
@@ -1676,12 +1691,15 @@ static int i40e_clean_rx_irq_1buf(struct i40e_ring *rx_ring, int budget)
 	u16 cleaned_count = I40E_DESC_UNUSED(rx_ring);
 	struct i40e_vsi *vsi = rx_ring->vsi;
 	union i40e_rx_desc *rx_desc;
+	struct sk_buff_head rx_list;
 	u32 rx_error, rx_status;
 	u16 rx_packet_len;
 	u8 rx_ptype;
 	u64 qword;
 	u16 i;
 
+	__skb_queue_head_init(&rx_list);
+
 	do {
 		struct i40e_rx_buffer *rx_bi;
 		struct sk_buff *skb;
@@ -1775,11 +1793,13 @@ static int i40e_clean_rx_irq_1buf(struct i40e_ring *rx_ring, int budget)
 			continue;
 		}
 #endif
-		i40e_receive_skb(rx_ring, skb, vlan_tag);
+		i40e_receive_skb(rx_ring, skb, vlan_tag, &rx_list);
 
 		rx_desc->wb.qword1.status_error_len = 0;
 	} while (likely(total_rx_packets < budget));
 
+	netif_receive_skb_list(&rx_list);
+
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
 	rx_ring->stats.bytes += total_rx_bytes;
@@ -1909,7 +1929,8 @@ int i40e_napi_poll(struct napi_struct *napi, int budget)
 	 * budget and be more aggressive about cleaning up the Tx descriptors.
 	 */
 	i40e_for_each_ring(ring, q_vector->tx) {
-		clean_complete &= i40e_clean_tx_irq(ring, vsi->work_limit);
+		clean_complete &= i40e_clean_tx_irq(ring, vsi->work_limit,
+						    budget);
 		arm_wb |= ring->arm_wb;
 		ring->arm_wb = false;
 	}
@@ -1947,8 +1968,11 @@ tx_only:
 	if (vsi->back->flags & I40E_TXR_FLAGS_WB_ON_ITR)
 		q_vector->arm_wb_state = false;
 
-	/* Work is done so exit the polling mode and re-enable the interrupt */
-	napi_complete_done(napi, work_done);
+	/* Work is done so exit the polling mode and re-enable the interrupt,
+	 * unless a busy polling socket owns the context and keeps polling
+	 */
+	if (!napi_complete_done(napi, work_done))
+		return 0;
 	if (vsi->back->flags & I40E_FLAG_MSIX_ENABLED) {
 		i40e_update_enable_itr(vsi, q_vector);
 	} else { /* Legacy mode */
@@ -2559,6 +2583,32 @@ linearize_chk_done:
 	return linearize;
 }
 
+/**
+ * i40e_tx_kick - write the tail held back for earlier xmit_more packets
+ * @tx_ring: ring to notify
+ * @xmit_more: skb->xmit_more of a packet that did not make it onto the ring
+ *
+ * A packet dropped or bounced at the end of a batch would otherwise leave
+ * the descriptors queued before it unnoticed by the hardware until the
+ * next transmit on this ring.
+ **/
+static void i40e_tx_kick(struct i40e_ring *tx_ring, bool xmit_more)
+{
+	if (!(tx_ring->flags & I40E_TXR_FLAGS_LAST_XMIT_MORE_SET))
+		return;
+
+	if (xmit_more &&
+	    !netif_xmit_stopped(netdev_get_tx_queue(tx_ring->netdev,
+						    tx_ring->queue_index)))
+		return;
+
+	tx_ring->flags &= ~I40E_TXR_FLAGS_LAST_XMIT_MORE_SET;
+	tx_ring->packet_stride = 0;
+	wmb();
+	writel(tx_ring->next_to_use, tx_ring->tail);
+	tx_ring->tx_stats.tx_doorbells++;
+}
+
 /**
  * i40e_tx_map - Build the Tx descriptor
  * @tx_ring:  ring to send buffer on
@@ -2589,6 +2639,7 @@ static inline void i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 	dma_addr_t dma;
 	u16 gso_segs;
 	u16 desc_count = 0;
+	bool xmit_more = skb->xmit_more;
 	bool tail_bump = true;
 	bool do_rs = false;
 
@@ -2708,6 +2759,7 @@ static inline void i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 						    tx_ring->queue_index))) {
 		tx_ring->flags |= I40E_TXR_FLAGS_LAST_XMIT_MORE_SET;
 		tail_bump = false;
+		tx_ring->tx_stats.tx_xmit_more++;
 	} else if (!skb->xmit_more &&
 		   !netif_xmit_stopped(netdev_get_tx_queue(tx_ring->netdev,
 						       tx_ring->queue_index)) &&
@@ -2741,6 +2793,7 @@ static inline void i40e_tx_map(struct i40e_ring *tx_ring, struct sk_buff *skb,
 		 */
 		wmb();
 		writel(i, tx_ring->tail);
+		tx_ring->tx_stats.tx_doorbells++;
 	}
 
 	return;
@@ -2760,6 +2813,8 @@ dma_error:
 	}
 
 	tx_ring->next_to_use = i;
+
+	i40e_tx_kick(tx_ring, xmit_more);
 }
 
 /**
@@ -2820,8 +2875,11 @@ static netdev_tx_t i40e_xmit_frame_ring(struct sk_buff *skb,
 	int tsyn;
 	int tso;
 
-	if (0 == i40e_xmit_descriptor_count(skb, tx_ring))
+	if (0 == i40e_xmit_descriptor_count(skb, tx_ring)) {
+		/* the queue is stopped now, flush what is pending */
+		i40e_tx_kick(tx_ring, skb->xmit_more);
 		return NETDEV_TX_BUSY;
+	}
 
 	/* prepare the xmit flags */
 	if (i40e_tx_prepare_vlan_flags(skb, tx_ring, &tx_flags))
@@ -2885,6 +2943,7 @@ static netdev_tx_t i40e_xmit_frame_ring(struct sk_buff *skb,
 	return NETDEV_TX_OK;
 
 out_drop:
+	i40e_tx_kick(tx_ring, skb->xmit_more);
 	dev_kfree_skb_any(skb);
 	return NETDEV_TX_OK;
 }
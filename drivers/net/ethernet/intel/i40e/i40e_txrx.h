@@ -202,6 +202,8 @@ struct i40e_tx_queue_stats {
 	u64 tx_busy;
 	u64 tx_done_old;
 	u64 tx_linearize;
+	u64 tx_doorbells;
+	u64 tx_xmit_more;
 };
 
 struct i40e_rx_queue_stats {
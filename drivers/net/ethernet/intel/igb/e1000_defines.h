@@ -334,6 +334,29 @@
 #define I210_RXPBSIZE_DEFAULT		0x000000A2 /* RXPBSIZE default */
 #define I210_TXPBSIZE_DEFAULT		0x04000014 /* TXPBSIZE default */
 
+/* i210 packet buffers in Qav mode, see datasheet 7.2.7.7 */
+#define I210_RXPBSIZE_MASK		0x0000003F
+#define I210_RXPBSIZE_PB_32KB		0x00000020
+#define I210_TXPBSIZE_MASK		0xC0FFFFFF
+#define I210_TXPBSIZE_PB0_8KB		(8 << 0)
+#define I210_TXPBSIZE_PB1_8KB		(8 << 6)
+#define I210_TXPBSIZE_PB2_4KB		(4 << 12)
+#define I210_TXPBSIZE_PB3_4KB		(4 << 18)
+
+#define I210_DTXMXPKTSZ_DEFAULT		0x00000098
+#define I210_SR_QUEUES_NUM		2	/* queues with launch time */
+
+/* Qav Tx Control */
+#define E1000_TQAVCTRL_XMIT_MODE	0x00000001 /* Qav, not legacy */
+#define E1000_TQAVCTRL_DATAFETCHARB	0x00000010 /* fetch: most empty */
+#define E1000_TQAVCTRL_DATATRANARB	0x00000100
+#define E1000_TQAVCTRL_DATATRANTIM	0x00000200 /* honour launch time */
+#define E1000_TQAVCTRL_SP_WAIT_SR	0x00000400
+#define E1000_TQAVCTRL_FETCHTIME_DELTA	0xFFFF0000
+
+/* Tx Queue Control */
+#define E1000_TXQCTL_QUEUE_MODE_LAUNCHT	0x00000001
+
 /* SerDes Control */
 #define E1000_SCTL_DISABLE_SERDES_LOOPBACK 0x0400
 
@@ -200,6 +200,11 @@
 #define E1000_RXPBS	0x02404  /* Rx Packet Buffer Size - RW */
 #define E1000_TXPBS	0x03404  /* Tx Packet Buffer Size - RW */
 
+/* i210 Qav (time sensitive transmit) registers */
+#define E1000_I210_TQAVCTRL	0x3570		/* Qav Tx Control - RW */
+#define E1000_I210_TXQCTL(_n)	(0x0E344 + 0x40 * (_n)) /* Tx Queue Ctrl */
+#define E1000_I210_DTXMXPKTSZ	0x355C		/* Max Tx Packet Size - RW */
+
 #define E1000_TDFH     0x03410  /* TX Data FIFO Head - RW */
 #define E1000_TDFT     0x03418  /* TX Data FIFO Tail - RW */
 #define E1000_TDFHS    0x03420  /* TX Data FIFO Head Saved - RW */
@@ -2065,6 +2065,41 @@ static int igb_set_features(struct net_device *netdev,
 	return 0;
 }
 
+static int igb_setup_launchtime(struct net_device *netdev, int queue,
+				bool enable)
+{
+	struct igb_adapter *adapter = netdev_priv(netdev);
+	struct e1000_hw *hw = &adapter->hw;
+	struct igb_ring *ring;
+
+	/* only the two stream reservation queues of the i210 can do it */
+	if (hw->mac.type != e1000_i210)
+		return -EOPNOTSUPP;
+
+	if (queue < 0 || queue >= adapter->num_tx_queues)
+		return -EINVAL;
+
+	ring = adapter->tx_ring[queue];
+	if (ring->reg_idx >= I210_SR_QUEUES_NUM)
+		return -EINVAL;
+
+	if (enable == test_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &ring->flags))
+		return 0;
+
+	if (enable)
+		set_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &ring->flags);
+	else
+		clear_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &ring->flags);
+
+	/* the tx mode and packet buffers only change across a reset */
+	if (netif_running(netdev))
+		igb_reinit_locked(adapter);
+	else
+		igb_reset(adapter);
+
+	return 0;
+}
+
 static const struct net_device_ops igb_netdev_ops = {
 	.ndo_open		= igb_open,
 	.ndo_stop		= igb_close,
@@ -2083,6 +2118,7 @@ static const struct net_device_ops igb_netdev_ops = {
 	.ndo_set_vf_rate	= igb_ndo_set_vf_bw,
 	.ndo_set_vf_spoofchk	= igb_ndo_set_vf_spoofchk,
 	.ndo_get_vf_config	= igb_ndo_get_vf_config,
+	.ndo_setup_launchtime	= igb_setup_launchtime,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= igb_netpoll,
 #endif
@@ -3299,10 +3335,74 @@ void igb_configure_tx_ring(struct igb_adapter *adapter,
 	txdctl |= IGB_TX_HTHRESH << 8;
 	txdctl |= IGB_TX_WTHRESH << 16;
 
+	if (hw->mac.type == e1000_i210 && reg_idx < I210_SR_QUEUES_NUM)
+		wr32(E1000_I210_TXQCTL(reg_idx),
+		     test_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &ring->flags) ?
+		     E1000_TXQCTL_QUEUE_MODE_LAUNCHT : 0);
+
 	txdctl |= E1000_TXDCTL_QUEUE_ENABLE;
 	wr32(E1000_TXDCTL(reg_idx), txdctl);
 }
 
+static bool igb_launchtime_enabled(struct igb_adapter *adapter)
+{
+	int i;
+
+	for (i = 0; i < adapter->num_tx_queues; i++)
+		if (test_bit(IGB_RING_FLAG_TX_LAUNCHTIME,
+			     &adapter->tx_ring[i]->flags))
+			return true;
+
+	return false;
+}
+
+/**
+ *  igb_setup_tx_mode - switch the i210 between legacy and Qav transmit
+ *  @adapter: board private structure
+ *
+ *  Launch time is only honoured in Qav mode, which also wants the packet
+ *  buffers split between the queues as in datasheet section 7.2.7.7.
+ **/
+static void igb_setup_tx_mode(struct igb_adapter *adapter)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	u32 val;
+
+	if (hw->mac.type != e1000_i210)
+		return;
+
+	val = rd32(E1000_I210_TQAVCTRL);
+	if (igb_launchtime_enabled(adapter)) {
+		val |= E1000_TQAVCTRL_XMIT_MODE | E1000_TQAVCTRL_DATATRANTIM;
+		val &= ~(E1000_TQAVCTRL_DATAFETCHARB |
+			 E1000_TQAVCTRL_FETCHTIME_DELTA);
+		wr32(E1000_I210_TQAVCTRL, val);
+
+		val = rd32(E1000_TXPBS);
+		val &= ~I210_TXPBSIZE_MASK;
+		val |= I210_TXPBSIZE_PB0_8KB | I210_TXPBSIZE_PB1_8KB |
+		       I210_TXPBSIZE_PB2_4KB | I210_TXPBSIZE_PB3_4KB;
+		wr32(E1000_TXPBS, val);
+
+		val = rd32(E1000_RXPBS);
+		val &= ~I210_RXPBSIZE_MASK;
+		val |= I210_RXPBSIZE_PB_32KB;
+		wr32(E1000_RXPBS, val);
+
+		/* The largest frame must stay below the smallest tx buffer,
+		 * the hardware stalls queues 2 and 3 when it is equal to it.
+		 */
+		wr32(E1000_I210_DTXMXPKTSZ, (4096 - 1) / 64);
+	} else {
+		val &= ~(E1000_TQAVCTRL_XMIT_MODE | E1000_TQAVCTRL_DATATRANTIM);
+		wr32(E1000_I210_TQAVCTRL, val);
+
+		wr32(E1000_TXPBS, I210_TXPBSIZE_DEFAULT);
+		wr32(E1000_RXPBS, I210_RXPBSIZE_DEFAULT);
+		wr32(E1000_I210_DTXMXPKTSZ, I210_DTXMXPKTSZ_DEFAULT);
+	}
+}
+
 /**
  *  igb_configure_tx - Configure transmit Unit after Reset
  *  @adapter: board private structure
@@ -3313,6 +3413,8 @@ static void igb_configure_tx(struct igb_adapter *adapter)
 {
 	int i;
 
+	igb_setup_tx_mode(adapter);
+
 	for (i = 0; i < adapter->num_tx_queues; i++)
 		igb_configure_tx_ring(adapter, adapter->tx_ring[i]);
 }
@@ -4625,8 +4727,10 @@ set_itr_now:
 	}
 }
 
-static void igb_tx_ctxtdesc(struct igb_ring *tx_ring, u32 vlan_macip_lens,
-			    u32 type_tucmd, u32 mss_l4len_idx)
+static void igb_tx_ctxtdesc(struct igb_ring *tx_ring,
+			    struct igb_tx_buffer *first,
+			    u32 vlan_macip_lens, u32 type_tucmd,
+			    u32 mss_l4len_idx)
 {
 	struct e1000_adv_tx_context_desc *context_desc;
 	u16 i = tx_ring->next_to_use;
@@ -4644,9 +4748,21 @@ static void igb_tx_ctxtdesc(struct igb_ring *tx_ring, u32 vlan_macip_lens,
 		mss_l4len_idx |= tx_ring->reg_idx << 4;
 
 	context_desc->vlan_macip_lens	= cpu_to_le32(vlan_macip_lens);
-	context_desc->seqnum_seed	= 0;
 	context_desc->type_tucmd_mlhl	= cpu_to_le32(type_tucmd);
 	context_desc->mss_l4len_idx	= cpu_to_le32(mss_l4len_idx);
+
+	/* The launch time is the offset into the current second of SYSTIM,
+	 * in 32 ns units. The skb's txtime gets cleared, it is not a
+	 * timestamp the stack may report back.
+	 */
+	if (test_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &tx_ring->flags)) {
+		struct timespec64 ts = ktime_to_timespec64(first->skb->tstamp);
+
+		first->skb->tstamp = ktime_set(0, 0);
+		context_desc->seqnum_seed = cpu_to_le32(ts.tv_nsec / 32);
+	} else {
+		context_desc->seqnum_seed = 0;
+	}
 }
 
 static int igb_tso(struct igb_ring *tx_ring,
@@ -4709,7 +4825,8 @@ static int igb_tso(struct igb_ring *tx_ring,
 	vlan_macip_lens |= skb_network_offset(skb) << E1000_ADVTXD_MACLEN_SHIFT;
 	vlan_macip_lens |= first->tx_flags & IGB_TX_FLAGS_VLAN_MASK;
 
-	igb_tx_ctxtdesc(tx_ring, vlan_macip_lens, type_tucmd, mss_l4len_idx);
+	igb_tx_ctxtdesc(tx_ring, first, vlan_macip_lens,
+			type_tucmd, mss_l4len_idx);
 
 	return 1;
 }
@@ -4722,7 +4839,9 @@ static void igb_tx_csum(struct igb_ring *tx_ring, struct igb_tx_buffer *first)
 	u32 type_tucmd = 0;
 
 	if (skb->ip_summed != CHECKSUM_PARTIAL) {
-		if (!(first->tx_flags & IGB_TX_FLAGS_VLAN))
+		/* launch time needs a context descriptor for every packet */
+		if (!(first->tx_flags & IGB_TX_FLAGS_VLAN) &&
+		    !test_bit(IGB_RING_FLAG_TX_LAUNCHTIME, &tx_ring->flags))
 			return;
 	} else {
 		u8 l4_hdr = 0;
@@ -4777,7 +4896,8 @@ static void igb_tx_csum(struct igb_ring *tx_ring, struct igb_tx_buffer *first)
 	vlan_macip_lens |= skb_network_offset(skb) << E1000_ADVTXD_MACLEN_SHIFT;
 	vlan_macip_lens |= first->tx_flags & IGB_TX_FLAGS_VLAN_MASK;
 
-	igb_tx_ctxtdesc(tx_ring, vlan_macip_lens, type_tucmd, mss_l4len_idx);
+	igb_tx_ctxtdesc(tx_ring, first, vlan_macip_lens,
+			type_tucmd, mss_l4len_idx);
 }
 
 #define IGB_SET_FLAG(_input, _flag, _result) \
@@ -73,6 +73,15 @@ static const struct ixgbe_stats ixgbe_gstrings_stats[] = {
 	{"lsc_int", IXGBE_STAT(lsc_int)},
 	{"tx_busy", IXGBE_STAT(tx_busy)},
 	{"non_eop_descs", IXGBE_STAT(non_eop_descs)},
+	{"rx_xdp_drop", IXGBE_STAT(xdp_drop)},
+	{"rx_xdp_tx", IXGBE_STAT(xdp_tx)},
+	{"rx_pp_alloc_fast", IXGBE_STAT(pp_stats.alloc_fast)},
+	{"rx_pp_alloc_slow", IXGBE_STAT(pp_stats.alloc_slow)},
+	{"rx_pp_alloc_pages", IXGBE_STAT(pp_stats.alloc_pages)},
+	{"rx_pp_recycle_cached", IXGBE_STAT(pp_stats.recycle_cached)},
+	{"rx_pp_recycle_ring", IXGBE_STAT(pp_stats.recycle_ring)},
+	{"rx_pp_recycle_full", IXGBE_STAT(pp_stats.recycle_full)},
+	{"rx_pp_release", IXGBE_STAT(pp_stats.release)},
 	{"rx_errors", IXGBE_NETDEV_STAT(rx_errors)},
 	{"tx_errors", IXGBE_NETDEV_STAT(tx_errors)},
 	{"rx_dropped", IXGBE_NETDEV_STAT(rx_dropped)},
@@ -130,9 +139,12 @@ static const struct ixgbe_stats ixgbe_gstrings_stats[] = {
  */
 #define IXGBE_NUM_RX_QUEUES netdev->num_tx_queues
 
+/* tx_doorbells and tx_xmit_more on top of the common ring stats */
+#define IXGBE_TX_DOORBELL_STATS 2
 #define IXGBE_QUEUE_STATS_LEN ( \
 	(netdev->num_tx_queues + IXGBE_NUM_RX_QUEUES) * \
-	(sizeof(struct ixgbe_queue_stats) / sizeof(u64)))
+	(sizeof(struct ixgbe_queue_stats) / sizeof(u64)) + \
+	netdev->num_tx_queues * IXGBE_TX_DOORBELL_STATS)
 #define IXGBE_GLOBAL_STATS_LEN ARRAY_SIZE(ixgbe_gstrings_stats)
 #define IXGBE_PB_STATS_LEN ( \
 			(sizeof(((struct ixgbe_adapter *)0)->stats.pxonrxc) + \
@@ -1121,15 +1133,11 @@ static void ixgbe_get_ethtool_stats(struct net_device *netdev,
 	for (j = 0; j < netdev->num_tx_queues; j++) {
 		ring = adapter->tx_ring[j];
 		if (!ring) {
-			data[i] = 0;
-			data[i+1] = 0;
-			i += 2;
-#ifdef BP_EXTENDED_STATS
 			data[i] = 0;
 			data[i+1] = 0;
 			data[i+2] = 0;
-			i += 3;
-#endif
+			data[i+3] = 0;
+			i += 4;
 			continue;
 		}
 
@@ -1138,13 +1146,9 @@ static void ixgbe_get_ethtool_stats(struct net_device *netdev,
 			data[i]   = ring->stats.packets;
 			data[i+1] = ring->stats.bytes;
 		} while (u64_stats_fetch_retry_irq(&ring->syncp, start));
-		i += 2;
-#ifdef BP_EXTENDED_STATS
-		data[i] = ring->stats.yields;
-		data[i+1] = ring->stats.misses;
-		data[i+2] = ring->stats.cleaned;
-		i += 3;
-#endif
+		data[i+2] = ring->tx_stats.tx_doorbells;
+		data[i+3] = ring->tx_stats.tx_xmit_more;
+		i += 4;
 	}
 	for (j = 0; j < IXGBE_NUM_RX_QUEUES; j++) {
 		ring = adapter->rx_ring[j];
@@ -1152,12 +1156,6 @@ static void ixgbe_get_ethtool_stats(struct net_device *netdev,
 			data[i] = 0;
 			data[i+1] = 0;
 			i += 2;
-#ifdef BP_EXTENDED_STATS
-			data[i] = 0;
-			data[i+1] = 0;
-			data[i+2] = 0;
-			i += 3;
-#endif
 			continue;
 		}
 
@@ -1167,12 +1165,6 @@ static void ixgbe_get_ethtool_stats(struct net_device *netdev,
 			data[i+1] = ring->stats.bytes;
 		} while (u64_stats_fetch_retry_irq(&ring->syncp, start));
 		i += 2;
-#ifdef BP_EXTENDED_STATS
-		data[i] = ring->stats.yields;
-		data[i+1] = ring->stats.misses;
-		data[i+2] = ring->stats.cleaned;
-		i += 3;
-#endif
 	}
 
 	for (j = 0; j < IXGBE_MAX_PACKET_BUFFERS; j++) {
@@ -1209,28 +1201,16 @@ static void ixgbe_get_strings(struct net_device *netdev, u32 stringset,
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "tx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
-#ifdef BP_EXTENDED_STATS
-			sprintf(p, "tx_queue_%u_bp_napi_yield", i);
-			p += ETH_GSTRING_LEN;
-			sprintf(p, "tx_queue_%u_bp_misses", i);
+			sprintf(p, "tx_queue_%u_doorbells", i);
 			p += ETH_GSTRING_LEN;
-			sprintf(p, "tx_queue_%u_bp_cleaned", i);
+			sprintf(p, "tx_queue_%u_xmit_more", i);
 			p += ETH_GSTRING_LEN;
-#endif /* BP_EXTENDED_STATS */
 		}
 		for (i = 0; i < IXGBE_NUM_RX_QUEUES; i++) {
 			sprintf(p, "rx_queue_%u_packets", i);
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
-#ifdef BP_EXTENDED_STATS
-			sprintf(p, "rx_queue_%u_bp_poll_yield", i);
-			p += ETH_GSTRING_LEN;
-			sprintf(p, "rx_queue_%u_bp_misses", i);
-			p += ETH_GSTRING_LEN;
-			sprintf(p, "rx_queue_%u_bp_cleaned", i);
-			p += ETH_GSTRING_LEN;
-#endif /* BP_EXTENDED_STATS */
 		}
 		for (i = 0; i < IXGBE_MAX_PACKET_BUFFERS; i++) {
 			sprintf(p, "tx_pb_%u_pxon", i);
@@ -49,6 +49,8 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include <scsi/fc/fc_fcoe.h>
 #include <net/vxlan.h>
 
@@ -176,6 +178,9 @@ MODULE_LICENSE("GPL");
 MODULE_VERSION(DRV_VERSION);
 
 static bool ixgbe_check_cfg_remove(struct ixgbe_hw *hw, struct pci_dev *pdev);
+static netdev_tx_t __ixgbe_xmit_frame(struct sk_buff *skb,
+				      struct net_device *netdev,
+				      struct ixgbe_ring *ring);
 
 static int ixgbe_read_pci_cfg_word_parent(struct ixgbe_adapter *adapter,
 					  u32 reg, u16 *value)
@@ -1088,9 +1093,10 @@ static void ixgbe_tx_timeout_reset(struct ixgbe_adapter *adapter)
  * ixgbe_clean_tx_irq - Reclaim resources after transmit completes
  * @q_vector: structure containing interrupt and ring information
  * @tx_ring: tx ring to clean
+ * @napi_budget: Used to determine if we are in netpoll
  **/
 static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
-			       struct ixgbe_ring *tx_ring)
+			       struct ixgbe_ring *tx_ring, int napi_budget)
 {
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 	struct ixgbe_tx_buffer *tx_buffer;
@@ -1128,7 +1134,7 @@ static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
 		total_packets += tx_buffer->gso_segs;
 
 		/* free the skb */
-		dev_consume_skb_any(tx_buffer->skb);
+		napi_consume_skb(tx_buffer->skb, napi_budget);
 
 		/* unmap skb header data */
 		dma_unmap_single(tx_ring->dev,
@@ -1492,6 +1498,30 @@ static inline void ixgbe_rx_checksum(struct ixgbe_ring *ring,
 	}
 }
 
+/* Post the next free chunk from the fill ring of the ring's umem */
+static bool ixgbe_alloc_umem_frame(struct ixgbe_ring *rx_ring,
+				   struct ixgbe_rx_buffer *bi)
+{
+	struct packet_umem *umem = rx_ring->umem;
+	u64 addr;
+
+	if (!packet_umem_fill_get(umem, &addr))
+		return false;
+
+	addr += umem->headroom;
+	bi->umem_index = addr >> PAGE_SHIFT;
+	bi->page = umem->pages[bi->umem_index];
+	bi->page_offset = offset_in_page(addr);
+	bi->dma = umem->dma[bi->umem_index];
+
+	dma_sync_single_range_for_device(rx_ring->dev, bi->dma,
+					 bi->page_offset,
+					 ixgbe_rx_bufsz(rx_ring),
+					 DMA_FROM_DEVICE);
+
+	return true;
+}
+
 static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 				    struct ixgbe_rx_buffer *bi)
 {
@@ -1502,27 +1532,21 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 	if (likely(page))
 		return true;
 
-	/* alloc new page for storage */
-	page = dev_alloc_pages(ixgbe_rx_pg_order(rx_ring));
+	if (rx_ring->umem)
+		return ixgbe_alloc_umem_frame(rx_ring, bi);
+
+	/* get a mapped page from the ring's pool */
+	page = page_pool_dev_alloc_pages(rx_ring->page_pool);
 	if (unlikely(!page)) {
 		rx_ring->rx_stats.alloc_rx_page_failed++;
 		return false;
 	}
 
-	/* map page for use */
-	dma = dma_map_page(rx_ring->dev, page, 0,
-			   ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-
-	/*
-	 * if mapping failed free memory back to system since
-	 * there isn't much point in holding memory we can't use
-	 */
-	if (dma_mapping_error(rx_ring->dev, dma)) {
-		__free_pages(page, ixgbe_rx_pg_order(rx_ring));
-
-		rx_ring->rx_stats.alloc_rx_page_failed++;
-		return false;
-	}
+	/* recycled pages were last synced for the CPU */
+	dma = page_pool_get_dma_addr(page);
+	dma_sync_single_range_for_device(rx_ring->dev, dma, 0,
+					 ixgbe_rx_pg_size(rx_ring),
+					 DMA_FROM_DEVICE);
 
 	bi->dma = dma;
 	bi->page = page;
@@ -1659,10 +1683,7 @@ static void ixgbe_process_skb_fields(struct ixgbe_ring *rx_ring,
 static void ixgbe_rx_skb(struct ixgbe_q_vector *q_vector,
 			 struct sk_buff *skb)
 {
-	if (ixgbe_qv_busy_polling(q_vector))
-		netif_receive_skb(skb);
-	else
-		napi_gro_receive(&q_vector->napi, skb);
+	napi_gro_receive(&q_vector->napi, skb);
 }
 
 /**
@@ -1772,20 +1793,14 @@ static void ixgbe_pull_tail(struct ixgbe_ring *rx_ring,
 static void ixgbe_dma_sync_frag(struct ixgbe_ring *rx_ring,
 				struct sk_buff *skb)
 {
-	/* if the page was released unmap it, else just sync our portion */
-	if (unlikely(IXGBE_CB(skb)->page_released)) {
-		dma_unmap_page(rx_ring->dev, IXGBE_CB(skb)->dma,
-			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-		IXGBE_CB(skb)->page_released = false;
-	} else {
-		struct skb_frag_struct *frag = &skb_shinfo(skb)->frags[0];
+	struct skb_frag_struct *frag = &skb_shinfo(skb)->frags[0];
 
-		dma_sync_single_range_for_cpu(rx_ring->dev,
-					      IXGBE_CB(skb)->dma,
-					      frag->page_offset,
-					      ixgbe_rx_bufsz(rx_ring),
-					      DMA_FROM_DEVICE);
-	}
+	/* the page stays mapped by the pool even if it left the ring */
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      IXGBE_CB(skb)->dma,
+				      frag->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
 	IXGBE_CB(skb)->dma = 0;
 }
 
@@ -1912,12 +1927,13 @@ static bool ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 			return true;
 
 		/* this page cannot be reused so discard it */
-		__free_pages(page, ixgbe_rx_pg_order(rx_ring));
+		page_pool_put_page(rx_ring->page_pool, page, true);
 		return false;
 	}
 
 	skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
 			rx_buffer->page_offset, size, truesize);
+	skb_mark_for_recycle(skb);
 
 	/* avoid re-using remote pages */
 	if (unlikely(ixgbe_page_is_reserved(page)))
@@ -2009,18 +2025,12 @@ dma_sync:
 		rx_buffer->skb = NULL;
 	}
 
-	/* pull page into skb */
+	/* pull page into skb, if it is not reused it now belongs to the
+	 * skb and goes back to the page pool when the skb is freed
+	 */
 	if (ixgbe_add_rx_frag(rx_ring, rx_buffer, rx_desc, skb)) {
 		/* hand second half of page back to the ring */
 		ixgbe_reuse_rx_page(rx_ring, rx_buffer);
-	} else if (IXGBE_CB(skb)->dma == rx_buffer->dma) {
-		/* the page has been released from the ring */
-		IXGBE_CB(skb)->page_released = true;
-	} else {
-		/* we are not reusing the buffer so unmap it */
-		dma_unmap_page(rx_ring->dev, rx_buffer->dma,
-			       ixgbe_rx_pg_size(rx_ring),
-			       DMA_FROM_DEVICE);
 	}
 
 	/* clear contents of buffer_info */
@@ -2029,6 +2039,219 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_xmit_xdp - send a frame back out for XDP_TX
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @xdp: the frame as the XDP program left it
+ *
+ * The frame is copied into a new skb, so the rx page can go straight back
+ * to the ring, and queued on the tx queue paired with the rx ring.
+ * Returns true if the frame was queued.
+ **/
+static bool ixgbe_xmit_xdp(struct ixgbe_ring *rx_ring, struct xdp_buff *xdp)
+{
+	struct net_device *netdev = rx_ring->netdev;
+	unsigned int len = xdp->data_end - xdp->data;
+	struct netdev_queue *txq;
+	struct sk_buff *skb;
+	netdev_tx_t ret = NETDEV_TX_BUSY;
+
+	skb = napi_alloc_skb(&rx_ring->q_vector->napi, len);
+	if (unlikely(!skb))
+		return false;
+
+	memcpy(__skb_put(skb, len), xdp->data, len);
+	skb->protocol = eth_type_trans(skb, netdev);
+	skb_reset_network_header(skb);
+	__skb_push(skb, ETH_HLEN);
+	skb_set_queue_mapping(skb, rx_ring->queue_index %
+				   netdev->real_num_tx_queues);
+
+	txq = netdev_get_tx_queue(netdev, skb_get_queue_mapping(skb));
+	__netif_tx_lock(txq, smp_processor_id());
+	if (likely(!netif_xmit_frozen_or_stopped(txq)))
+		ret = __ixgbe_xmit_frame(skb, netdev, NULL);
+	__netif_tx_unlock(txq);
+
+	if (ret != NETDEV_TX_OK) {
+		dev_kfree_skb_any(skb);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * ixgbe_run_xdp - run the XDP program on a received buffer
+ * @rx_ring: rx descriptor ring the buffer was received on
+ * @rx_desc: descriptor of the buffer
+ * @prog: XDP program attached to the ring
+ *
+ * This runs before ixgbe_fetch_rx_buffer() builds an skb for the buffer.
+ * Only frames that fit in one buffer are seen by the program, which
+ * ixgbe_xdp_setup() makes sure covers every frame the MTU allows.
+ *
+ * Returns true if the buffer was consumed, in which case its page has
+ * already been handed back to the ring.
+ **/
+static bool ixgbe_run_xdp(struct ixgbe_ring *rx_ring,
+			  union ixgbe_adv_rx_desc *rx_desc,
+			  struct bpf_prog *prog)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	struct xdp_buff xdp;
+	u32 ntc, act;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+	if (rx_buffer->skb ||
+	    !ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP))
+		return false;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.data_end = xdp.data + le16_to_cpu(rx_desc->wb.upper.length);
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		if (likely(ixgbe_xmit_xdp(rx_ring, &xdp))) {
+			rx_ring->rx_stats.xdp_tx++;
+			break;
+		}
+		rx_ring->rx_stats.xdp_drop++;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+	case XDP_ABORTED:
+	case XDP_DROP:
+		rx_ring->rx_stats.xdp_drop++;
+		break;
+	}
+
+	/* nothing references the page, give this half back as it is */
+	ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+	rx_buffer->page = NULL;
+
+	ntc = rx_ring->next_to_clean + 1;
+	rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+	prefetch(IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean));
+
+	return true;
+}
+
+/**
+ * ixgbe_clean_rx_irq_umem - Clean completed descriptors from a umem ring
+ * @q_vector: structure containing interrupt and ring information
+ * @rx_ring: rx descriptor ring bound to a packet socket umem
+ * @budget: Total limit on number of packets to process
+ *
+ * The buffers of this ring are chunks of the umem, so a received frame is
+ * handed to the socket by posting its address on the umem's rx ring; no
+ * skb is built and nothing is copied.  Frames the socket has no room for,
+ * and errored ones, go back on the ring.  ixgbe_umem_setup() keeps every
+ * frame in one buffer.  Once no chunk is left on the ring, polling stops
+ * until user space kicks the queue through packet_umem_wakeup().
+ *
+ * Returns amount of work completed
+ **/
+static int ixgbe_clean_rx_irq_umem(struct ixgbe_q_vector *q_vector,
+				   struct ixgbe_ring *rx_ring,
+				   const int budget)
+{
+	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
+	struct packet_umem *umem = rx_ring->umem;
+	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
+	bool queued = false;
+
+	packet_umem_fill_awake(umem);
+
+	while (likely(total_rx_packets < budget)) {
+		union ixgbe_adv_rx_desc *rx_desc;
+		struct ixgbe_rx_buffer *rx_buffer;
+		unsigned int size;
+		u64 addr;
+		u32 ntc;
+
+		/* return some buffers to hardware, one at a time is too slow */
+		if (cleaned_count >= IXGBE_RX_BUFFER_WRITE) {
+			ixgbe_alloc_rx_buffers(rx_ring, cleaned_count);
+			cleaned_count = 0;
+		}
+
+		rx_desc = IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean);
+
+		if (!rx_desc->wb.upper.status_error)
+			break;
+
+		/* read the rest of the descriptor only once it is written */
+		dma_rmb();
+
+		rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+		size = le16_to_cpu(rx_desc->wb.upper.length);
+		addr = ((u64)rx_buffer->umem_index << PAGE_SHIFT) +
+		       rx_buffer->page_offset;
+
+		if (unlikely(!ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP))) {
+			rx_ring->rx_stats.non_eop_descs++;
+			ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		} else if (unlikely(ixgbe_test_staterr(rx_desc,
+					IXGBE_RXDADV_ERR_FRAME_ERR_MASK) &&
+				    !(rx_ring->netdev->features &
+				      NETIF_F_RXALL))) {
+			ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		} else {
+			dma_sync_single_range_for_cpu(rx_ring->dev,
+						      rx_buffer->dma,
+						      rx_buffer->page_offset,
+						      size, DMA_FROM_DEVICE);
+			if (packet_umem_rx_put(umem, addr, size)) {
+				/* the chunk belongs to user space now */
+				total_rx_bytes += size;
+				queued = true;
+			} else {
+				ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+			}
+		}
+		rx_buffer->page = NULL;
+
+		ntc = rx_ring->next_to_clean + 1;
+		rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+		prefetch(IXGBE_RX_DESC(rx_ring, rx_ring->next_to_clean));
+
+		cleaned_count++;
+		total_rx_packets++;
+	}
+
+	if (queued)
+		packet_umem_rx_flush(umem);
+
+	u64_stats_update_begin(&rx_ring->syncp);
+	rx_ring->stats.packets += total_rx_packets;
+	rx_ring->stats.bytes += total_rx_bytes;
+	u64_stats_update_end(&rx_ring->syncp);
+	q_vector->rx.total_packets += total_rx_packets;
+	q_vector->rx.total_bytes += total_rx_bytes;
+
+	if (cleaned_count)
+		ixgbe_alloc_rx_buffers(rx_ring, cleaned_count);
+
+	/*
+	 * With no buffer posted no interrupt comes either.  Have user space
+	 * kick us once it refills, unless it already did so meanwhile.
+	 */
+	if (ixgbe_desc_unused(rx_ring) == rx_ring->count - 1 &&
+	    !packet_umem_fill_sleep(umem))
+		return budget;
+
+	return total_rx_packets;
+}
+
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -2053,6 +2276,13 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	unsigned int mss = 0;
 #endif /* IXGBE_FCOE */
 	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
+	struct bpf_prog *xdp_prog;
+
+	if (rx_ring->umem)
+		return ixgbe_clean_rx_irq_umem(q_vector, rx_ring, budget);
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(rx_ring->xdp_prog);
 
 	while (likely(total_rx_packets < budget)) {
 		union ixgbe_adv_rx_desc *rx_desc;
@@ -2075,6 +2305,12 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		dma_rmb();
 
+		if (xdp_prog && ixgbe_run_xdp(rx_ring, rx_desc, xdp_prog)) {
+			cleaned_count++;
+			total_rx_packets++;
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -2130,6 +2366,8 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		total_rx_packets++;
 	}
 
+	rcu_read_unlock();
+
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
 	rx_ring->stats.bytes += total_rx_bytes;
@@ -2140,40 +2378,6 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	return total_rx_packets;
 }
 
-#ifdef CONFIG_NET_RX_BUSY_POLL
-/* must be called with local_bh_disable()d */
-static int ixgbe_low_latency_recv(struct napi_struct *napi)
-{
-	struct ixgbe_q_vector *q_vector =
-			container_of(napi, struct ixgbe_q_vector, napi);
-	struct ixgbe_adapter *adapter = q_vector->adapter;
-	struct ixgbe_ring  *ring;
-	int found = 0;
-
-	if (test_bit(__IXGBE_DOWN, &adapter->state))
-		return LL_FLUSH_FAILED;
-
-	if (!ixgbe_qv_lock_poll(q_vector))
-		return LL_FLUSH_BUSY;
-
-	ixgbe_for_each_ring(ring, q_vector->rx) {
-		found = ixgbe_clean_rx_irq(q_vector, ring, 4);
-#ifdef BP_EXTENDED_STATS
-		if (found)
-			ring->stats.cleaned += found;
-		else
-			ring->stats.misses++;
-#endif
-		if (found)
-			break;
-	}
-
-	ixgbe_qv_unlock_poll(q_vector);
-
-	return found;
-}
-#endif	/* CONFIG_NET_RX_BUSY_POLL */
-
 /**
  * ixgbe_configure_msix - Configure MSI-X hardware
  * @adapter: board private structure
@@ -2784,10 +2988,10 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 #endif
 
 	ixgbe_for_each_ring(ring, q_vector->tx)
-		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring);
+		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring, budget);
 
-	/* Exit if we are called by netpoll or busy polling is active */
-	if ((budget <= 0) || !ixgbe_qv_lock_napi(q_vector))
+	/* Exit if we are called by netpoll */
+	if (budget <= 0)
 		return budget;
 
 	/* attempt to distribute budget to each queue fairly, but don't allow
@@ -2805,19 +3009,22 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 		clean_complete &= (cleaned < per_ring_budget);
 	}
 
-	ixgbe_qv_unlock_napi(q_vector);
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
 		return budget;
 
-	/* all work done, exit the polling mode */
-	napi_complete_done(napi, work_done);
+	/* all work done, exit the polling mode, unless a busy poller
+	 * owns the context and will hand it back later
+	 */
+	if (!napi_complete_done(napi, work_done))
+		return min(work_done, budget - 1);
+
 	if (adapter->rx_itr_setting & 1)
 		ixgbe_set_itr(q_vector);
 	if (!test_bit(__IXGBE_DOWN, &adapter->state))
 		ixgbe_irq_enable_queues(adapter, ((u64)1 << q_vector->v_idx));
 
-	return 0;
+	return min(work_done, budget - 1);
 }
 
 /**
@@ -3629,6 +3836,14 @@ void ixgbe_configure_rx_ring(struct ixgbe_adapter *adapter,
 	ixgbe_configure_srrctl(adapter, ring);
 	ixgbe_configure_rscctl(adapter, ring);
 
+	/* macvlan offload rings belong to the upper device */
+	RCU_INIT_POINTER(ring->xdp_prog,
+			 ring->l2_accel_priv ? NULL : adapter->xdp_prog);
+	ring->umem = ring->l2_accel_priv ? NULL :
+		     adapter->umem[ring->queue_index];
+	if (ring->umem)
+		rcu_assign_pointer(ring->umem->napi, &ring->q_vector->napi);
+
 	if (hw->mac.type == ixgbe_mac_82598EB) {
 		/*
 		 * enable cache line friendly hardware writes:
@@ -4289,23 +4504,16 @@ static void ixgbe_napi_enable_all(struct ixgbe_adapter *adapter)
 {
 	int q_idx;
 
-	for (q_idx = 0; q_idx < adapter->num_q_vectors; q_idx++) {
-		ixgbe_qv_init_lock(adapter->q_vector[q_idx]);
+	for (q_idx = 0; q_idx < adapter->num_q_vectors; q_idx++)
 		napi_enable(&adapter->q_vector[q_idx]->napi);
-	}
 }
 
 static void ixgbe_napi_disable_all(struct ixgbe_adapter *adapter)
 {
 	int q_idx;
 
-	for (q_idx = 0; q_idx < adapter->num_q_vectors; q_idx++) {
+	for (q_idx = 0; q_idx < adapter->num_q_vectors; q_idx++)
 		napi_disable(&adapter->q_vector[q_idx]->napi);
-		while (!ixgbe_qv_disable(adapter->q_vector[q_idx])) {
-			pr_info("QV %d locked\n", q_idx);
-			usleep_range(1000, 20000);
-		}
-	}
 }
 
 static void ixgbe_clear_vxlan_port(struct ixgbe_adapter *adapter)
@@ -4603,10 +4811,13 @@ static void ixgbe_fwd_psrtype(struct ixgbe_fwd_adapter *vadapter)
  **/
 static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 {
-	struct device *dev = rx_ring->dev;
 	unsigned long size;
 	u16 i;
 
+	/* the q_vector is freed with kfree_rcu() once the ring is down */
+	if (rx_ring->umem)
+		RCU_INIT_POINTER(rx_ring->umem->napi, NULL);
+
 	/* ring already cleared, nothing to do */
 	if (!rx_ring->rx_buffer_info)
 		return;
@@ -4616,22 +4827,17 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 		struct ixgbe_rx_buffer *rx_buffer = &rx_ring->rx_buffer_info[i];
 
 		if (rx_buffer->skb) {
-			struct sk_buff *skb = rx_buffer->skb;
-			if (IXGBE_CB(skb)->page_released)
-				dma_unmap_page(dev,
-					       IXGBE_CB(skb)->dma,
-					       ixgbe_rx_bufsz(rx_ring),
-					       DMA_FROM_DEVICE);
-			dev_kfree_skb(skb);
+			dev_kfree_skb(rx_buffer->skb);
 			rx_buffer->skb = NULL;
 		}
 
 		if (!rx_buffer->page)
 			continue;
 
-		dma_unmap_page(dev, rx_buffer->dma,
-			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-		__free_pages(rx_buffer->page, ixgbe_rx_pg_order(rx_ring));
+		/* umem chunks just go back to user space with the umem */
+		if (!rx_ring->umem)
+			page_pool_put_page(rx_ring->page_pool, rx_buffer->page,
+					   false);
 
 		rx_buffer->page = NULL;
 	}
@@ -4953,7 +5159,7 @@ static void ixgbe_setup_gpie(struct ixgbe_adapter *adapter)
 static void ixgbe_up_complete(struct ixgbe_adapter *adapter)
 {
 	struct ixgbe_hw *hw = &adapter->hw;
-	int err;
+	int err, i;
 	u32 ctrl_ext;
 
 	ixgbe_get_hw_control(adapter);
@@ -4987,6 +5193,12 @@ static void ixgbe_up_complete(struct ixgbe_adapter *adapter)
 	IXGBE_READ_REG(hw, IXGBE_EICR);
 	ixgbe_irq_enable(adapter, true, true);
 
+	/* umem rings the fill ring had no chunk for get no interrupt */
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		if (adapter->rx_ring[i]->umem)
+			packet_umem_wakeup(adapter->rx_ring[i]->umem);
+	}
+
 	/*
 	 * If this adapter has a fan, check to see if we had a failure
 	 * before we enabled the interrupt.
@@ -5561,6 +5773,7 @@ err_setup_tx:
  **/
 int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 {
+	struct page_pool_params pp_params = { 0 };
 	struct device *dev = rx_ring->dev;
 	int orig_node = dev_to_node(dev);
 	int ring_node = -1;
@@ -5577,6 +5790,18 @@ int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 	if (!rx_ring->rx_buffer_info)
 		goto err;
 
+	pp_params.flags = PP_FLAG_DMA_MAP;
+	pp_params.order = ixgbe_rx_pg_order(rx_ring);
+	pp_params.pool_size = rx_ring->count;
+	pp_params.nid = NUMA_NO_NODE;
+	pp_params.dev = dev;
+	pp_params.dma_dir = DMA_FROM_DEVICE;
+	rx_ring->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(rx_ring->page_pool)) {
+		rx_ring->page_pool = NULL;
+		goto err;
+	}
+
 	u64_stats_init(&rx_ring->syncp);
 
 	/* Round up to nearest 4K */
@@ -5600,6 +5825,8 @@ int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 
 	return 0;
 err:
+	page_pool_destroy(rx_ring->page_pool);
+	rx_ring->page_pool = NULL;
 	vfree(rx_ring->rx_buffer_info);
 	rx_ring->rx_buffer_info = NULL;
 	dev_err(dev, "Unable to allocate memory for the Rx descriptor ring\n");
@@ -5689,6 +5916,10 @@ void ixgbe_free_rx_resources(struct ixgbe_ring *rx_ring)
 {
 	ixgbe_clean_rx_ring(rx_ring);
 
+	/* pages still held by the stack free the pool when they come back */
+	page_pool_destroy(rx_ring->page_pool);
+	rx_ring->page_pool = NULL;
+
 	vfree(rx_ring->rx_buffer_info);
 	rx_ring->rx_buffer_info = NULL;
 
@@ -5737,6 +5968,11 @@ static int ixgbe_change_mtu(struct net_device *netdev, int new_mtu)
 	if ((new_mtu < 68) || (max_frame > IXGBE_MAX_JUMBO_FRAME_SIZE))
 		return -EINVAL;
 
+	/* XDP programs and umems only see frames that fit in one rx buffer */
+	if ((adapter->xdp_prog || adapter->num_umems) &&
+	    max_frame + VLAN_HLEN > IXGBE_RXBUFFER_2K)
+		return -EINVAL;
+
 	/*
 	 * For 82599EB we cannot allow legacy VFs to enable their receive
 	 * paths when MTU greater than 1500 is configured.  So display a
@@ -6060,6 +6296,7 @@ void ixgbe_update_stats(struct ixgbe_adapter *adapter)
 	u64 non_eop_descs = 0, restart_queue = 0, tx_busy = 0;
 	u64 alloc_rx_page_failed = 0, alloc_rx_buff_failed = 0;
 	u64 bytes = 0, packets = 0, hw_csum_rx_error = 0;
+	u64 xdp_drop = 0, xdp_tx = 0;
 
 	if (test_bit(__IXGBE_DOWN, &adapter->state) ||
 	    test_bit(__IXGBE_RESETTING, &adapter->state))
@@ -6082,10 +6319,22 @@ void ixgbe_update_stats(struct ixgbe_adapter *adapter)
 		alloc_rx_page_failed += rx_ring->rx_stats.alloc_rx_page_failed;
 		alloc_rx_buff_failed += rx_ring->rx_stats.alloc_rx_buff_failed;
 		hw_csum_rx_error += rx_ring->rx_stats.csum_err;
+		xdp_drop += rx_ring->rx_stats.xdp_drop;
+		xdp_tx += rx_ring->rx_stats.xdp_tx;
 		bytes += rx_ring->stats.bytes;
 		packets += rx_ring->stats.packets;
 	}
 	adapter->non_eop_descs = non_eop_descs;
+	memset(&adapter->pp_stats, 0, sizeof(adapter->pp_stats));
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		struct ixgbe_ring *rx_ring = adapter->rx_ring[i];
+
+		if (rx_ring->page_pool)
+			page_pool_get_stats(rx_ring->page_pool,
+					    &adapter->pp_stats);
+	}
+	adapter->xdp_drop = xdp_drop;
+	adapter->xdp_tx = xdp_tx;
 	adapter->alloc_rx_page_failed = alloc_rx_page_failed;
 	adapter->alloc_rx_buff_failed = alloc_rx_buff_failed;
 	adapter->hw_csum_rx_error = hw_csum_rx_error;
@@ -7181,11 +7430,38 @@ static inline int ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
 #define IXGBE_TXD_CMD (IXGBE_TXD_CMD_EOP | \
 		       IXGBE_TXD_CMD_RS)
 
+/**
+ * ixgbe_tx_kick - let the hardware fetch the descriptors written so far
+ * @tx_ring: ring to notify
+ * @xmit_more: skb->xmit_more of the packet just queued or dropped
+ *
+ * The tail write is deferred while the stack has more packets for this
+ * ring and the queue is not stopped; the next write covers all of them.
+ * Also called for packets that never make it onto the ring, so that a
+ * drop at the end of a batch does not strand the packets before it.
+ **/
+static void ixgbe_tx_kick(struct ixgbe_ring *tx_ring, bool xmit_more)
+{
+	if (xmit_more && !netif_xmit_stopped(txring_txq(tx_ring))) {
+		tx_ring->tx_stats.tx_xmit_more++;
+		return;
+	}
+
+	writel(tx_ring->next_to_use, tx_ring->tail);
+
+	/* we need this if more than one processor can write to our tail
+	 * at a time, it synchronizes IO on IA64/Altix systems
+	 */
+	mmiowb();
+	tx_ring->tx_stats.tx_doorbells++;
+}
+
 static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 			 struct ixgbe_tx_buffer *first,
 			 const u8 hdr_len)
 {
 	struct sk_buff *skb = first->skb;
+	bool xmit_more = skb->xmit_more;
 	struct ixgbe_tx_buffer *tx_buffer;
 	union ixgbe_adv_tx_desc *tx_desc;
 	struct skb_frag_struct *frag;
@@ -7301,14 +7577,7 @@ static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 
 	ixgbe_maybe_stop_tx(tx_ring, DESC_NEEDED);
 
-	if (netif_xmit_stopped(txring_txq(tx_ring)) || !skb->xmit_more) {
-		writel(i, tx_ring->tail);
-
-		/* we need this if more than one processor can write to our tail
-		 * at a time, it synchronizes IO on IA64/Altix systems
-		 */
-		mmiowb();
-	}
+	ixgbe_tx_kick(tx_ring, xmit_more);
 
 	return;
 dma_error:
@@ -7326,6 +7595,8 @@ dma_error:
 	}
 
 	tx_ring->next_to_use = i;
+
+	ixgbe_tx_kick(tx_ring, xmit_more);
 }
 
 static void ixgbe_atr(struct ixgbe_ring *ring,
@@ -7513,6 +7784,8 @@ netdev_tx_t ixgbe_xmit_frame_ring(struct sk_buff *skb,
 
 	if (ixgbe_maybe_stop_tx(tx_ring, count + 3)) {
 		tx_ring->tx_stats.tx_busy++;
+		/* the queue is stopped now, flush what is pending */
+		ixgbe_tx_kick(tx_ring, skb->xmit_more);
 		return NETDEV_TX_BUSY;
 	}
 
@@ -7617,6 +7890,7 @@ xmit_fcoe:
 	return NETDEV_TX_OK;
 
 out_drop:
+	ixgbe_tx_kick(tx_ring, skb->xmit_more);
 	dev_kfree_skb_any(first->skb);
 	first->skb = NULL;
 
@@ -7994,6 +8268,10 @@ static netdev_features_t ixgbe_fix_features(struct net_device *netdev,
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE))
 		features &= ~NETIF_F_LRO;
 
+	/* XDP and umems look at single buffers, RSC would merge them first */
+	if (adapter->xdp_prog || adapter->num_umems)
+		features &= ~NETIF_F_LRO;
+
 	return features;
 }
 
@@ -8393,6 +8671,127 @@ ixgbe_features_check(struct sk_buff *skb, struct net_device *dev,
 	return features;
 }
 
+static int ixgbe_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+	int max_frame = dev->mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN;
+	struct bpf_prog *old_prog;
+	int i;
+
+	/* the program has to see the whole frame in one buffer */
+	if (prog && max_frame > IXGBE_RXBUFFER_2K)
+		return -EINVAL;
+
+	old_prog = adapter->xdp_prog;
+	adapter->xdp_prog = prog;
+
+	/* drops RSC while a program is attached */
+	netdev_update_features(dev);
+
+	for (i = 0; i < adapter->num_rx_queues; i++)
+		rcu_assign_pointer(adapter->rx_ring[i]->xdp_prog, prog);
+
+	if (old_prog)
+		bpf_prog_put_rcu(old_prog);
+
+	return 0;
+}
+
+/* Refill a running rx ring from what adapter->umem[] now says */
+static void ixgbe_umem_restart_ring(struct ixgbe_adapter *adapter,
+				    struct ixgbe_ring *rx_ring)
+{
+	if (!netif_running(adapter->netdev) ||
+	    test_bit(__IXGBE_DOWN, &adapter->state))
+		return;
+
+	napi_disable(&rx_ring->q_vector->napi);
+
+	/* shutdown the queue and wait for dma to settle */
+	ixgbe_disable_rx_queue(adapter, rx_ring);
+	usleep_range(10000, 20000);
+	ixgbe_clean_rx_ring(rx_ring);
+
+	ixgbe_configure_rx_ring(adapter, rx_ring);
+	napi_enable(&rx_ring->q_vector->napi);
+
+	/* a kick while napi was disabled is lost, poll once to be sure */
+	if (rx_ring->umem)
+		packet_umem_wakeup(rx_ring->umem);
+}
+
+static int ixgbe_umem_setup(struct net_device *dev, struct packet_umem *umem,
+			    u16 qid)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+	int max_frame = dev->mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN;
+	struct ixgbe_ring *rx_ring;
+	int err;
+
+	if (qid >= MAX_RX_QUEUES)
+		return -EINVAL;
+
+	if (!umem) {
+		umem = adapter->umem[qid];
+		if (!umem)
+			return 0;
+
+		adapter->umem[qid] = NULL;
+		adapter->num_umems--;
+		if (qid < adapter->num_rx_queues)
+			ixgbe_umem_restart_ring(adapter, adapter->rx_ring[qid]);
+		packet_umem_dma_unmap(umem);
+		netdev_update_features(dev);
+		return 0;
+	}
+
+	if (qid >= adapter->num_rx_queues)
+		return -EINVAL;
+	rx_ring = adapter->rx_ring[qid];
+	if (adapter->umem[qid] || rx_ring->l2_accel_priv)
+		return -EBUSY;
+#ifdef IXGBE_FCOE
+	if (test_bit(__IXGBE_RX_FCOE, &rx_ring->state))
+		return -EBUSY;
+#endif
+
+	/* every frame has to fit in one buffer, and every buffer in a chunk */
+	if (max_frame > IXGBE_RXBUFFER_2K ||
+	    umem->frame_size - umem->headroom < ixgbe_rx_bufsz(rx_ring))
+		return -EINVAL;
+
+	err = packet_umem_dma_map(umem, &adapter->pdev->dev);
+	if (err)
+		return err;
+
+	adapter->umem[qid] = umem;
+	adapter->num_umems++;
+
+	/* drops RSC while a umem is attached */
+	netdev_update_features(dev);
+	ixgbe_umem_restart_ring(adapter, rx_ring);
+
+	return 0;
+}
+
+static int ixgbe_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return ixgbe_xdp_setup(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!adapter->xdp_prog;
+		return 0;
+	case XDP_SETUP_UMEM:
+		return ixgbe_umem_setup(dev, xdp->umem.umem,
+					xdp->umem.queue_id);
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -8420,9 +8819,6 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= ixgbe_netpoll,
 #endif
-#ifdef CONFIG_NET_RX_BUSY_POLL
-	.ndo_busy_poll		= ixgbe_low_latency_recv,
-#endif
 #ifdef IXGBE_FCOE
 	.ndo_fcoe_ddp_setup = ixgbe_fcoe_ddp_get,
 	.ndo_fcoe_ddp_target = ixgbe_fcoe_ddp_target,
@@ -8444,6 +8840,7 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_del_vxlan_port	= ixgbe_del_vxlan_port,
 #endif /* CONFIG_IXGBE_VXLAN */
 	.ndo_features_check	= ixgbe_features_check,
+	.ndo_xdp		= ixgbe_xdp,
 };
 
 /**
@@ -9091,6 +9488,8 @@ static void ixgbe_remove(struct pci_dev *pdev)
 	e_dev_info("complete\n");
 
 	kfree(adapter->mac_table);
+	if (adapter->xdp_prog)
+		bpf_prog_put(adapter->xdp_prog);
 	disable_dev = !test_and_set_bit(__IXGBE_DISABLED, &adapter->state);
 	free_netdev(netdev);
 
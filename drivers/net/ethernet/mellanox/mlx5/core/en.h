@@ -32,6 +32,8 @@
 
 #include <linux/if_vlan.h>
 #include <linux/etherdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/net_dim.h>
 #include <linux/mlx5/driver.h>
 #include <linux/mlx5/qp.h>
 #include <linux/mlx5/cq.h>
@@ -50,12 +52,30 @@
 #define MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE                0xa
 #define MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE                0xd
 
+#define MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE_MPW            0x1
+#define MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE_MPW            0x3
+#define MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE_MPW            0x6
+
+#define MLX5_MPWRQ_LOG_NUM_STRIDES	11 /* >= 9, HW restriction */
+#define MLX5_MPWRQ_LOG_STRIDE_SIZE	6  /* >= 6, HW restriction */
+#define MLX5_MPWRQ_NUM_STRIDES		BIT(MLX5_MPWRQ_LOG_NUM_STRIDES)
+#define MLX5_MPWRQ_STRIDE_SIZE		BIT(MLX5_MPWRQ_LOG_STRIDE_SIZE)
+#define MLX5_MPWRQ_LOG_WQE_SZ		(MLX5_MPWRQ_LOG_NUM_STRIDES +\
+					 MLX5_MPWRQ_LOG_STRIDE_SIZE)
+#define MLX5_MPWRQ_WQE_PAGE_ORDER	(MLX5_MPWRQ_LOG_WQE_SZ > PAGE_SHIFT ? \
+					 MLX5_MPWRQ_LOG_WQE_SZ - PAGE_SHIFT : 0)
+#define MLX5_MPWRQ_PAGES_PER_WQE	BIT(MLX5_MPWRQ_WQE_PAGE_ORDER)
+#define MLX5_MPWRQ_STRIDES_PER_PAGE	(MLX5_MPWRQ_NUM_STRIDES >> \
+					 MLX5_MPWRQ_WQE_PAGE_ORDER)
+#define MLX5_MPWRQ_SMALL_PACKET_THRESHOLD	(128)
+
 #define MLX5E_PARAMS_DEFAULT_LRO_WQE_SZ                 (64 * 1024)
 #define MLX5E_PARAMS_DEFAULT_RX_CQ_MODERATION_USEC      0x10
 #define MLX5E_PARAMS_DEFAULT_RX_CQ_MODERATION_PKTS      0x20
 #define MLX5E_PARAMS_DEFAULT_TX_CQ_MODERATION_USEC      0x10
 #define MLX5E_PARAMS_DEFAULT_TX_CQ_MODERATION_PKTS      0x20
 #define MLX5E_PARAMS_DEFAULT_MIN_RX_WQES                0x80
+#define MLX5E_PARAMS_DEFAULT_MIN_RX_WQES_MPW            0x2
 
 #define MLX5E_LOG_INDIR_RQT_SIZE       0x7
 #define MLX5E_INDIR_RQT_SIZE           BIT(MLX5E_LOG_INDIR_RQT_SIZE)
@@ -218,21 +238,31 @@ struct mlx5e_pport_stats {
 
 static const char rq_stats_strings[][ETH_GSTRING_LEN] = {
 	"packets",
+	"bytes",
 	"csum_none",
 	"csum_sw",
 	"lro_packets",
 	"lro_bytes",
-	"wqe_err"
+	"wqe_err",
+	"xdp_drop",
+	"xdp_tx",
+	"mpwqe_filler",
+	"buff_alloc_err",
 };
 
 struct mlx5e_rq_stats {
 	u64 packets;
+	u64 bytes;
 	u64 csum_none;
 	u64 csum_sw;
 	u64 lro_packets;
 	u64 lro_bytes;
 	u64 wqe_err;
-#define NUM_RQ_STATS 6
+	u64 xdp_drop;
+	u64 xdp_tx;
+	u64 mpwqe_filler;
+	u64 buff_alloc_err;
+#define NUM_RQ_STATS 11
 };
 
 static const char sq_stats_strings[][ETH_GSTRING_LEN] = {
@@ -266,6 +296,7 @@ struct mlx5e_stats {
 struct mlx5e_params {
 	u8  log_sq_size;
 	u8  log_rq_size;
+	u8  rq_wq_type;
 	u16 num_channels;
 	u8  default_vlan_prio;
 	u8  num_tc;
@@ -276,6 +307,7 @@ struct mlx5e_params {
 	u16 min_rx_wqes;
 	bool lro_en;
 	u32 lro_wqe_sz;
+	bool rx_am_enabled;
 	u16 tx_max_inline;
 	u8  rss_hfunc;
 	u8  toeplitz_hash_key[40];
@@ -284,6 +316,7 @@ struct mlx5e_params {
 
 enum {
 	MLX5E_RQ_STATE_POST_WQES_ENABLE,
+	MLX5E_RQ_STATE_AM,
 };
 
 enum cq_flags {
@@ -298,6 +331,7 @@ struct mlx5e_cq {
 	/* data path - accessed per napi poll */
 	struct napi_struct        *napi;
 	struct mlx5_core_cq        mcq;
+	u16                        event_ctr;
 	struct mlx5e_channel      *channel;
 	struct mlx5e_priv         *priv;
 
@@ -305,16 +339,43 @@ struct mlx5e_cq {
 	struct mlx5_wq_ctrl        wq_ctrl;
 } ____cacheline_aligned_in_smp;
 
+/* rx buffers dropped by XDP, still DMA mapped, reused before allocating */
+#define MLX5E_XDP_CACHE_SIZE 64
+
+struct mlx5e_dma_info {
+	struct page	*page;
+	dma_addr_t	addr;
+};
+
+/* A striding RQ WQE is one high order allocation split into order-0 pages.
+ * Every page starts out with a reference per stride on top of its own, one
+ * for each skb frag it can end up in; the unused ones are dropped when the
+ * last stride is consumed.
+ */
+struct mlx5e_mpw_info {
+	struct mlx5e_dma_info dma_info;
+	u16 consumed_strides;
+	u16 skbs_frags[MLX5_MPWRQ_PAGES_PER_WQE];
+};
+
 struct mlx5e_rq {
 	/* data path */
 	struct mlx5_wq_ll      wq;
 	u32                    wqe_sz;
-	struct sk_buff       **skb;
+	u8                     wq_type;
+	union {
+		struct sk_buff       **skb;
+		struct mlx5e_mpw_info *wqe_info;
+	};
+	struct bpf_prog __rcu *xdp_prog;
+	u16                    xdp_cache_cnt;
+	struct sk_buff        *xdp_cache[MLX5E_XDP_CACHE_SIZE];
 
 	struct device         *pdev;
 	struct net_device     *netdev;
 	struct mlx5e_rq_stats  stats;
 	struct mlx5e_cq        cq;
+	struct net_dim         dim; /* adaptive moderation */
 
 	unsigned long          state;
 	int                    ix;
@@ -476,6 +537,22 @@ struct mlx5e_flow_table {
 	void *main;
 };
 
+#define MLX5E_TC_NUM_GROUPS	8	/* distinct flower masks */
+#define MLX5E_TC_GROUP_LOG_SZ	10	/* filters per mask */
+
+struct mlx5e_tc_group {
+	u8   match_criteria_enable;
+	u32  match_criteria[MLX5_ST_SZ_DW(fte_match_param)];
+	int  refcnt;
+};
+
+struct mlx5e_tc_table {
+	void                  *t;	/* in front of ft.vlan */
+	struct rhashtable      ht;	/* flows by cookie */
+	struct mlx5e_tc_group  groups[MLX5E_TC_NUM_GROUPS];
+	u32                    miss_ft_ix;
+};
+
 struct mlx5e_priv {
 	/* priv data path fields - start */
 	int                        default_vlan_prio;
@@ -497,6 +574,7 @@ struct mlx5e_priv {
 	u32                        tirn[MLX5E_NUM_TT];
 
 	struct mlx5e_flow_table    ft;
+	struct mlx5e_tc_table      tc;
 	struct mlx5e_eth_addr_db   eth_addr;
 	struct mlx5e_vlan_db       vlan;
 
@@ -509,6 +587,7 @@ struct mlx5e_priv {
 	struct mlx5_core_dev      *mdev;
 	struct net_device         *netdev;
 	struct mlx5e_stats         stats;
+	struct bpf_prog           *xdp_prog; /* protected by state_lock */
 };
 
 #define MLX5E_NET_IP_ALIGN 2
@@ -559,10 +638,12 @@ void mlx5e_send_nop(struct mlx5e_sq *sq, bool notify_hw);
 u16 mlx5e_select_queue(struct net_device *dev, struct sk_buff *skb,
 		       void *accel_priv, select_queue_fallback_t fallback);
 netdev_tx_t mlx5e_xmit(struct sk_buff *skb, struct net_device *dev);
+bool mlx5e_xmit_xdp(struct mlx5e_sq *sq, struct sk_buff *skb);
 
 void mlx5e_completion_event(struct mlx5_core_cq *mcq);
 void mlx5e_cq_error_event(struct mlx5_core_cq *mcq, enum mlx5_event event);
 int mlx5e_napi_poll(struct napi_struct *napi, int budget);
+void mlx5e_rx_am_work(struct work_struct *work);
 bool mlx5e_poll_tx_cq(struct mlx5e_cq *cq);
 bool mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget);
 bool mlx5e_post_rx_wqes(struct mlx5e_rq *rq);
@@ -631,3 +712,4 @@ static inline int mlx5e_get_max_num_channels(struct mlx5_core_dev *mdev)
 
 extern const struct ethtool_ops mlx5e_ethtool_ops;
 u16 mlx5e_get_max_inline_cap(struct mlx5_core_dev *mdev);
+void mlx5e_set_rq_type_params(struct mlx5e_priv *priv, u8 rq_type);
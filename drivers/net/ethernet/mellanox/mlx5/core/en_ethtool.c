@@ -257,12 +257,27 @@ static void mlx5e_get_ethtool_stats(struct net_device *dev,
 				((u64 *)&priv->channel[i]->sq[tc].stats)[j];
 }
 
+/* a striding RQ counts its ring in multi-packet WQEs */
+static u8 mlx5e_min_log_rq_size(struct mlx5e_priv *priv)
+{
+	return priv->params.rq_wq_type == MLX5_WQ_TYPE_STRQ ?
+	       MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE_MPW :
+	       MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE;
+}
+
+static u8 mlx5e_max_log_rq_size(struct mlx5e_priv *priv)
+{
+	return priv->params.rq_wq_type == MLX5_WQ_TYPE_STRQ ?
+	       MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE_MPW :
+	       MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE;
+}
+
 static void mlx5e_get_ringparam(struct net_device *dev,
 				struct ethtool_ringparam *param)
 {
 	struct mlx5e_priv *priv = netdev_priv(dev);
 
-	param->rx_max_pending = 1 << MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE;
+	param->rx_max_pending = 1 << mlx5e_max_log_rq_size(priv);
 	param->tx_max_pending = 1 << MLX5E_PARAMS_MAXIMUM_LOG_SQ_SIZE;
 	param->rx_pending     = 1 << priv->params.log_rq_size;
 	param->tx_pending     = 1 << priv->params.log_sq_size;
@@ -272,6 +287,9 @@ static int mlx5e_set_ringparam(struct net_device *dev,
 			       struct ethtool_ringparam *param)
 {
 	struct mlx5e_priv *priv = netdev_priv(dev);
+	u8 min_log_rq_size = mlx5e_min_log_rq_size(priv);
+	u8 max_log_rq_size = mlx5e_max_log_rq_size(priv);
+	u16 default_min_rx_wqes;
 	bool was_opened;
 	u16 min_rx_wqes;
 	u8 log_rq_size;
@@ -288,16 +306,16 @@ static int mlx5e_set_ringparam(struct net_device *dev,
 			    __func__);
 		return -EINVAL;
 	}
-	if (param->rx_pending < (1 << MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE)) {
+	if (param->rx_pending < (1 << min_log_rq_size)) {
 		netdev_info(dev, "%s: rx_pending (%d) < min (%d)\n",
 			    __func__, param->rx_pending,
-			    1 << MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE);
+			    1 << min_log_rq_size);
 		return -EINVAL;
 	}
-	if (param->rx_pending > (1 << MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE)) {
+	if (param->rx_pending > (1 << max_log_rq_size)) {
 		netdev_info(dev, "%s: rx_pending (%d) > max (%d)\n",
 			    __func__, param->rx_pending,
-			    1 << MLX5E_PARAMS_MAXIMUM_LOG_RQ_SIZE);
+			    1 << max_log_rq_size);
 		return -EINVAL;
 	}
 	if (param->tx_pending < (1 << MLX5E_PARAMS_MINIMUM_LOG_SQ_SIZE)) {
@@ -315,8 +333,10 @@ static int mlx5e_set_ringparam(struct net_device *dev,
 
 	log_rq_size = order_base_2(param->rx_pending);
 	log_sq_size = order_base_2(param->tx_pending);
-	min_rx_wqes = min_t(u16, param->rx_pending - 1,
-			    MLX5E_PARAMS_DEFAULT_MIN_RX_WQES);
+	default_min_rx_wqes = priv->params.rq_wq_type == MLX5_WQ_TYPE_STRQ ?
+			      MLX5E_PARAMS_DEFAULT_MIN_RX_WQES_MPW :
+			      MLX5E_PARAMS_DEFAULT_MIN_RX_WQES;
+	min_rx_wqes = min_t(u16, param->rx_pending - 1, default_min_rx_wqes);
 
 	if (log_rq_size == priv->params.log_rq_size &&
 	    log_sq_size == priv->params.log_sq_size &&
@@ -406,6 +426,7 @@ static int mlx5e_get_coalesce(struct net_device *netdev,
 	coal->rx_max_coalesced_frames = priv->params.rx_cq_moderation_pkts;
 	coal->tx_coalesce_usecs       = priv->params.tx_cq_moderation_usec;
 	coal->tx_max_coalesced_frames = priv->params.tx_cq_moderation_pkts;
+	coal->use_adaptive_rx_coalesce = priv->params.rx_am_enabled;
 
 	return 0;
 }
@@ -416,6 +437,8 @@ static int mlx5e_set_coalesce(struct net_device *netdev,
 	struct mlx5e_priv *priv    = netdev_priv(netdev);
 	struct mlx5_core_dev *mdev = priv->mdev;
 	struct mlx5e_channel *c;
+	bool reset_am;
+	int err = 0;
 	int tc;
 	int i;
 
@@ -423,14 +446,25 @@ static int mlx5e_set_coalesce(struct net_device *netdev,
 		return -ENOTSUPP;
 
 	mutex_lock(&priv->state_lock);
+	reset_am = !!coal->use_adaptive_rx_coalesce !=
+		   priv->params.rx_am_enabled;
+
 	priv->params.tx_cq_moderation_usec = coal->tx_coalesce_usecs;
 	priv->params.tx_cq_moderation_pkts = coal->tx_max_coalesced_frames;
 	priv->params.rx_cq_moderation_usec = coal->rx_coalesce_usecs;
 	priv->params.rx_cq_moderation_pkts = coal->rx_max_coalesced_frames;
+	priv->params.rx_am_enabled = !!coal->use_adaptive_rx_coalesce;
 
 	if (!test_bit(MLX5E_STATE_OPENED, &priv->state))
 		goto out;
 
+	/* the rx queues pick up or drop their adaptive state on open */
+	if (reset_am) {
+		mlx5e_close_locked(priv->netdev);
+		err = mlx5e_open_locked(priv->netdev);
+		goto out;
+	}
+
 	for (i = 0; i < priv->params.num_channels; ++i) {
 		c = priv->channel[i];
 
@@ -441,14 +475,16 @@ static int mlx5e_set_coalesce(struct net_device *netdev,
 						coal->tx_max_coalesced_frames);
 		}
 
-		mlx5_core_modify_cq_moderation(mdev, &c->rq.cq.mcq,
-					       coal->rx_coalesce_usecs,
-					       coal->rx_max_coalesced_frames);
+		/* left to the adaptive moderation otherwise */
+		if (!priv->params.rx_am_enabled)
+			mlx5_core_modify_cq_moderation(mdev, &c->rq.cq.mcq,
+						coal->rx_coalesce_usecs,
+						coal->rx_max_coalesced_frames);
 	}
 
 out:
 	mutex_unlock(&priv->state_lock);
-	return 0;
+	return err;
 }
 
 static u32 ptys2ethtool_supported_link(u32 eth_proto_cap)
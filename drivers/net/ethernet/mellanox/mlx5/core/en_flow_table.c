@@ -36,6 +36,7 @@
 #include <linux/tcp.h>
 #include <linux/mlx5/flow_table.h>
 #include "en.h"
+#include "en_tc.h"
 
 enum {
 	MLX5E_FULLMATCH = 0,
@@ -825,7 +826,7 @@ static int mlx5e_create_main_flow_table(struct mlx5e_priv *priv)
 	dmac = MLX5_ADDR_OF(fte_match_param, g[8].match_criteria,
 			    outer_headers.dmac_47_16);
 	dmac[0] = 0x01;
-	priv->ft.main = mlx5_create_flow_table(priv->mdev, 1,
+	priv->ft.main = mlx5_create_flow_table(priv->mdev, 2,
 					       MLX5_FLOW_TABLE_TYPE_NIC_RCV,
 					       9, g);
 	kfree(g);
@@ -859,7 +860,7 @@ static int mlx5e_create_vlan_flow_table(struct mlx5e_priv *priv)
 	MLX5_SET_TO_ONES(fte_match_param, g[1].match_criteria,
 			 outer_headers.vlan_tag);
 
-	priv->ft.vlan = mlx5_create_flow_table(priv->mdev, 0,
+	priv->ft.vlan = mlx5_create_flow_table(priv->mdev, 1,
 					       MLX5_FLOW_TABLE_TYPE_NIC_RCV,
 					       2, g);
 
@@ -888,8 +889,15 @@ int mlx5e_create_flow_tables(struct mlx5e_priv *priv)
 	if (err)
 		goto err_destroy_vlan_flow_table;
 
+	err = mlx5e_tc_init(priv);
+	if (err)
+		goto err_del_vlan_rule;
+
 	return 0;
 
+err_del_vlan_rule:
+	mlx5e_del_vlan_rule(priv, MLX5E_VLAN_RULE_TYPE_UNTAGGED, 0);
+
 err_destroy_vlan_flow_table:
 	mlx5e_destroy_vlan_flow_table(priv);
 
@@ -901,6 +909,7 @@ err_destroy_main_flow_table:
 
 void mlx5e_destroy_flow_tables(struct mlx5e_priv *priv)
 {
+	mlx5e_tc_cleanup(priv);
 	mlx5e_del_vlan_rule(priv, MLX5E_VLAN_RULE_TYPE_UNTAGGED, 0);
 	mlx5e_destroy_vlan_flow_table(priv);
 	mlx5e_destroy_main_flow_table(priv);
@@ -31,7 +31,10 @@
  */
 
 #include <linux/mlx5/flow_table.h>
+#include <linux/bpf.h>
+#include <net/pkt_cls.h>
 #include "en.h"
+#include "en_tc.h"
 
 struct mlx5e_rq_param {
 	u32                        rqc[MLX5_ST_SZ_DW(rqc)];
@@ -314,6 +317,7 @@ static int mlx5e_create_rq(struct mlx5e_channel *c,
 	struct mlx5_core_dev *mdev = priv->mdev;
 	void *rqc = param->rqc;
 	void *rqc_wq = MLX5_ADDR_OF(rqc, rqc, wq);
+	u32 byte_count;
 	int wq_sz;
 	int err;
 	int i;
@@ -328,24 +332,39 @@ static int mlx5e_create_rq(struct mlx5e_channel *c,
 	rq->wq.db = &rq->wq.db[MLX5_RCV_DBR];
 
 	wq_sz = mlx5_wq_ll_get_size(&rq->wq);
-	rq->skb = kzalloc_node(wq_sz * sizeof(*rq->skb), GFP_KERNEL,
-			       cpu_to_node(c->cpu));
-	if (!rq->skb) {
-		err = -ENOMEM;
-		goto err_rq_wq_destroy;
+	rq->wq_type = priv->params.rq_wq_type;
+
+	switch (rq->wq_type) {
+	case MLX5_WQ_TYPE_STRQ:
+		rq->wqe_info = kzalloc_node(wq_sz * sizeof(*rq->wqe_info),
+					    GFP_KERNEL, cpu_to_node(c->cpu));
+		if (!rq->wqe_info) {
+			err = -ENOMEM;
+			goto err_rq_wq_destroy;
+		}
+		rq->wqe_sz = MLX5_MPWRQ_NUM_STRIDES * MLX5_MPWRQ_STRIDE_SIZE;
+		byte_count = rq->wqe_sz;
+		break;
+	default: /* MLX5_WQ_TYPE_LINKED_LIST */
+		rq->skb = kzalloc_node(wq_sz * sizeof(*rq->skb), GFP_KERNEL,
+				       cpu_to_node(c->cpu));
+		if (!rq->skb) {
+			err = -ENOMEM;
+			goto err_rq_wq_destroy;
+		}
+		rq->wqe_sz = (priv->params.lro_en) ?
+				priv->params.lro_wqe_sz :
+				MLX5E_SW2HW_MTU(priv->netdev->mtu);
+		rq->wqe_sz = SKB_DATA_ALIGN(rq->wqe_sz + MLX5E_NET_IP_ALIGN);
+		byte_count = rq->wqe_sz - MLX5E_NET_IP_ALIGN;
+		byte_count |= MLX5_HW_START_PADDING;
 	}
 
-	rq->wqe_sz = (priv->params.lro_en) ? priv->params.lro_wqe_sz :
-					     MLX5E_SW2HW_MTU(priv->netdev->mtu);
-	rq->wqe_sz = SKB_DATA_ALIGN(rq->wqe_sz + MLX5E_NET_IP_ALIGN);
-
 	for (i = 0; i < wq_sz; i++) {
 		struct mlx5e_rx_wqe *wqe = mlx5_wq_ll_get_wqe(&rq->wq, i);
-		u32 byte_count = rq->wqe_sz - MLX5E_NET_IP_ALIGN;
 
 		wqe->data.lkey       = c->mkey_be;
-		wqe->data.byte_count =
-			cpu_to_be32(byte_count | MLX5_HW_START_PADDING);
+		wqe->data.byte_count = cpu_to_be32(byte_count);
 	}
 
 	rq->pdev    = c->pdev;
@@ -353,6 +372,7 @@ static int mlx5e_create_rq(struct mlx5e_channel *c,
 	rq->channel = c;
 	rq->ix      = c->ix;
 	rq->priv    = c->priv;
+	RCU_INIT_POINTER(rq->xdp_prog, priv->xdp_prog);
 
 	return 0;
 
@@ -364,7 +384,21 @@ err_rq_wq_destroy:
 
 static void mlx5e_destroy_rq(struct mlx5e_rq *rq)
 {
-	kfree(rq->skb);
+	while (rq->xdp_cache_cnt) {
+		struct sk_buff *skb = rq->xdp_cache[--rq->xdp_cache_cnt];
+
+		dma_unmap_single(rq->pdev, *((dma_addr_t *)skb->cb),
+				 rq->wqe_sz, DMA_FROM_DEVICE);
+		dev_kfree_skb(skb);
+	}
+
+	switch (rq->wq_type) {
+	case MLX5_WQ_TYPE_STRQ:
+		kfree(rq->wqe_info);
+		break;
+	default: /* MLX5_WQ_TYPE_LINKED_LIST */
+		kfree(rq->skb);
+	}
 	mlx5_wq_destroy(&rq->wq_ctrl);
 }
 
@@ -475,6 +509,10 @@ static int mlx5e_open_rq(struct mlx5e_channel *c,
 	if (err)
 		goto err_disable_rq;
 
+	net_dim_init(&rq->dim, mlx5e_rx_am_work);
+	if (c->priv->params.rx_am_enabled)
+		set_bit(MLX5E_RQ_STATE_AM, &rq->state);
+
 	set_bit(MLX5E_RQ_STATE_POST_WQES_ENABLE, &rq->state);
 	mlx5e_send_nop(&c->sq[0], true); /* trigger mlx5e_post_rx_wqes() */
 
@@ -491,7 +529,9 @@ err_destroy_rq:
 static void mlx5e_close_rq(struct mlx5e_rq *rq)
 {
 	clear_bit(MLX5E_RQ_STATE_POST_WQES_ENABLE, &rq->state);
+	clear_bit(MLX5E_RQ_STATE_AM, &rq->state);
 	napi_synchronize(&rq->channel->napi); /* prevent mlx5e_post_rx_wqes */
+	cancel_work_sync(&rq->dim.work);
 
 	mlx5e_modify_rq(rq, MLX5_RQC_STATE_RDY, MLX5_RQC_STATE_ERR);
 	while (!mlx5_wq_ll_is_empty(&rq->wq))
@@ -961,6 +1001,7 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 			      struct mlx5e_channel **cp)
 {
 	struct net_device *netdev = priv->netdev;
+	struct net_dim_cq_moder rx_moder;
 	int cpu = mlx5e_get_cpu(priv, ix);
 	struct mlx5e_channel *c;
 	int err;
@@ -985,9 +1026,13 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 	if (err)
 		goto err_napi_del;
 
+	rx_moder.usec = priv->params.rx_cq_moderation_usec;
+	rx_moder.pkts = priv->params.rx_cq_moderation_pkts;
+	if (priv->params.rx_am_enabled)
+		rx_moder = net_dim_get_profile(NET_DIM_DEFAULT_PROFILE_IX);
+
 	err = mlx5e_open_cq(c, &cparam->rx_cq, &c->rq.cq,
-			    priv->params.rx_cq_moderation_usec,
-			    priv->params.rx_cq_moderation_pkts);
+			    rx_moder.usec, rx_moder.pkts);
 	if (err)
 		goto err_close_tx_cqs;
 
@@ -1040,7 +1085,14 @@ static void mlx5e_build_rq_param(struct mlx5e_priv *priv,
 	void *rqc = param->rqc;
 	void *wq = MLX5_ADDR_OF(rqc, rqc, wq);
 
-	MLX5_SET(wq, wq, wq_type,          MLX5_WQ_TYPE_LINKED_LIST);
+	if (priv->params.rq_wq_type == MLX5_WQ_TYPE_STRQ) {
+		MLX5_SET(wq, wq, log_wqe_num_of_strides,
+			 MLX5_MPWRQ_LOG_NUM_STRIDES - 9);
+		MLX5_SET(wq, wq, log_wqe_stride_size,
+			 MLX5_MPWRQ_LOG_STRIDE_SIZE - 6);
+	}
+
+	MLX5_SET(wq, wq, wq_type,          priv->params.rq_wq_type);
 	MLX5_SET(wq, wq, end_padding_mode, MLX5_WQ_END_PAD_MODE_ALIGN);
 	MLX5_SET(wq, wq, log_wq_stride,    ilog2(sizeof(struct mlx5e_rx_wqe)));
 	MLX5_SET(wq, wq, log_wq_sz,        priv->params.log_rq_size);
@@ -1076,8 +1128,13 @@ static void mlx5e_build_rx_cq_param(struct mlx5e_priv *priv,
 				    struct mlx5e_cq_param *param)
 {
 	void *cqc = param->cqc;
+	u8 log_cq_size = priv->params.log_rq_size;
 
-	MLX5_SET(cqc, cqc, log_cq_size,  priv->params.log_rq_size);
+	/* a striding WQE completes up to one packet per stride */
+	if (priv->params.rq_wq_type == MLX5_WQ_TYPE_STRQ)
+		log_cq_size += MLX5_MPWRQ_LOG_NUM_STRIDES;
+
+	MLX5_SET(cqc, cqc, log_cq_size,  log_cq_size);
 
 	mlx5e_build_common_cq_param(priv, param);
 }
@@ -1863,9 +1920,24 @@ static int mlx5e_set_features(struct net_device *netdev,
 
 	mutex_lock(&priv->state_lock);
 
+	if ((changes & NETIF_F_HW_TC) && !(features & NETIF_F_HW_TC) &&
+	    mlx5e_tc_num_filters(priv)) {
+		netdev_err(netdev,
+			   "Active offloaded tc filters, can't turn hw_tc_offload off\n");
+		err = -EINVAL;
+		goto unlock;
+	}
+
 	if (changes & NETIF_F_LRO) {
 		bool was_opened = test_bit(MLX5E_STATE_OPENED, &priv->state);
 
+		/* one LRO session spans more than the buffer XDP sees */
+		if ((features & NETIF_F_LRO) && priv->xdp_prog) {
+			netdev_warn(netdev, "can't set LRO with an XDP program attached\n");
+			err = -EINVAL;
+			goto unlock;
+		}
+
 		if (was_opened)
 			mlx5e_close_locked(priv->netdev);
 
@@ -1877,6 +1949,7 @@ static int mlx5e_set_features(struct net_device *netdev,
 			err = mlx5e_open_locked(priv->netdev);
 	}
 
+unlock:
 	mutex_unlock(&priv->state_lock);
 
 	if (changes & NETIF_F_HW_VLAN_CTAG_FILTER) {
@@ -1929,6 +2002,89 @@ static int mlx5e_change_mtu(struct net_device *netdev, int new_mtu)
 	return err;
 }
 
+static int mlx5e_xdp_set(struct net_device *netdev, struct bpf_prog *prog)
+{
+	struct mlx5e_priv *priv = netdev_priv(netdev);
+	struct bpf_prog *old_prog;
+	bool was_opened;
+	bool reset;
+	int err = 0;
+	int i;
+
+	mutex_lock(&priv->state_lock);
+
+	if (prog && priv->params.lro_en) {
+		mutex_unlock(&priv->state_lock);
+		netdev_warn(netdev, "can't set XDP while LRO is on, disable LRO first\n");
+		return -EINVAL;
+	}
+
+	/* XDP needs a whole packet in one linear buffer, which the striding
+	 * RQ does not give it; attaching the first program or detaching the
+	 * last one switches the rx queue type and so reopens the channels.
+	 */
+	was_opened = test_bit(MLX5E_STATE_OPENED, &priv->state);
+	reset = MLX5_CAP_GEN(priv->mdev, striding_rq) &&
+		!!prog != !!priv->xdp_prog;
+
+	if (reset && was_opened)
+		mlx5e_close_locked(netdev);
+
+	/* the rx queues only borrow the reference held in priv, a new
+	 * program is picked up by the next napi poll
+	 */
+	old_prog = priv->xdp_prog;
+	priv->xdp_prog = prog;
+
+	if (reset) {
+		mlx5e_set_rq_type_params(priv, prog ? MLX5_WQ_TYPE_LINKED_LIST :
+						      MLX5_WQ_TYPE_STRQ);
+		if (was_opened)
+			err = mlx5e_open_locked(netdev);
+	} else if (was_opened) {
+		for (i = 0; i < priv->params.num_channels; i++)
+			rcu_assign_pointer(priv->channel[i]->rq.xdp_prog, prog);
+	}
+
+	mutex_unlock(&priv->state_lock);
+
+	if (old_prog)
+		bpf_prog_put_rcu(old_prog);
+
+	return err;
+}
+
+static int mlx5e_xdp(struct net_device *netdev, struct netdev_xdp *xdp)
+{
+	struct mlx5e_priv *priv = netdev_priv(netdev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return mlx5e_xdp_set(netdev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!priv->xdp_prog;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int mlx5e_setup_tc_flower(struct net_device *dev,
+				 struct tc_cls_flower_offload *f)
+{
+	struct mlx5e_priv *priv = netdev_priv(dev);
+
+	switch (f->command) {
+	case TC_CLSFLOWER_REPLACE:
+		return mlx5e_configure_flower(priv, f);
+	case TC_CLSFLOWER_DESTROY:
+		return mlx5e_delete_flower(priv, f);
+	default:
+		/* no flow counters in this command set */
+		return -EOPNOTSUPP;
+	}
+}
+
 static struct net_device_ops mlx5e_netdev_ops = {
 	.ndo_open                = mlx5e_open,
 	.ndo_stop                = mlx5e_close,
@@ -1940,6 +2096,8 @@ static struct net_device_ops mlx5e_netdev_ops = {
 	.ndo_vlan_rx_kill_vid	 = mlx5e_vlan_rx_kill_vid,
 	.ndo_set_features        = mlx5e_set_features,
 	.ndo_change_mtu		 = mlx5e_change_mtu,
+	.ndo_xdp		 = mlx5e_xdp,
+	.ndo_setup_tc_flower	 = mlx5e_setup_tc_flower,
 };
 
 static int mlx5e_check_required_hca_cap(struct mlx5_core_dev *mdev)
@@ -1967,6 +2125,20 @@ static int mlx5e_check_required_hca_cap(struct mlx5_core_dev *mdev)
 	return 0;
 }
 
+void mlx5e_set_rq_type_params(struct mlx5e_priv *priv, u8 rq_type)
+{
+	priv->params.rq_wq_type = rq_type;
+	switch (rq_type) {
+	case MLX5_WQ_TYPE_STRQ:
+		priv->params.log_rq_size = MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE_MPW;
+		priv->params.min_rx_wqes = MLX5E_PARAMS_DEFAULT_MIN_RX_WQES_MPW;
+		break;
+	default: /* MLX5_WQ_TYPE_LINKED_LIST */
+		priv->params.log_rq_size = MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE;
+		priv->params.min_rx_wqes = MLX5E_PARAMS_DEFAULT_MIN_RX_WQES;
+	}
+}
+
 u16 mlx5e_get_max_inline_cap(struct mlx5_core_dev *mdev)
 {
 	int bf_buf_size = (1 << MLX5_CAP_GEN(mdev, log_bf_reg_size)) / 2;
@@ -1985,8 +2157,9 @@ static void mlx5e_build_netdev_priv(struct mlx5_core_dev *mdev,
 
 	priv->params.log_sq_size           =
 		MLX5E_PARAMS_DEFAULT_LOG_SQ_SIZE;
-	priv->params.log_rq_size           =
-		MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE;
+	mlx5e_set_rq_type_params(priv, MLX5_CAP_GEN(mdev, striding_rq) ?
+				       MLX5_WQ_TYPE_STRQ :
+				       MLX5_WQ_TYPE_LINKED_LIST);
 	priv->params.rx_cq_moderation_usec =
 		MLX5E_PARAMS_DEFAULT_RX_CQ_MODERATION_USEC;
 	priv->params.rx_cq_moderation_pkts =
@@ -1996,8 +2169,7 @@ static void mlx5e_build_netdev_priv(struct mlx5_core_dev *mdev,
 	priv->params.tx_cq_moderation_pkts =
 		MLX5E_PARAMS_DEFAULT_TX_CQ_MODERATION_PKTS;
 	priv->params.tx_max_inline         = mlx5e_get_max_inline_cap(mdev);
-	priv->params.min_rx_wqes           =
-		MLX5E_PARAMS_DEFAULT_MIN_RX_WQES;
+	priv->params.rx_am_enabled         = MLX5_CAP_GEN(mdev, cq_moderation);
 	priv->params.num_tc                = 1;
 	priv->params.default_vlan_prio     = 0;
 	priv->params.rss_hfunc             = ETH_RSS_HASH_XOR;
@@ -2062,6 +2234,7 @@ static void mlx5e_build_netdev(struct net_device *netdev)
 	netdev->hw_features      |= NETIF_F_HW_VLAN_CTAG_TX;
 	netdev->hw_features      |= NETIF_F_HW_VLAN_CTAG_RX;
 	netdev->hw_features      |= NETIF_F_HW_VLAN_CTAG_FILTER;
+	netdev->hw_features      |= NETIF_F_HW_TC;
 
 	netdev->features          = netdev->hw_features;
 	if (!priv->params.lro_en)
@@ -2252,6 +2425,8 @@ static void mlx5e_destroy_netdev(struct mlx5_core_dev *mdev, void *vpriv)
 	mlx5_dealloc_transport_domain(priv->mdev, priv->tdn);
 	mlx5_core_dealloc_pd(priv->mdev, priv->pdn);
 	mlx5_unmap_free_uar(priv->mdev, &priv->cq_uar);
+	if (priv->xdp_prog)
+		bpf_prog_put(priv->xdp_prog);
 	free_netdev(netdev);
 }
 
@@ -33,6 +33,8 @@
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/tcp.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include "en.h"
 
 static inline int mlx5e_alloc_rx_wqe(struct mlx5e_rq *rq,
@@ -41,6 +43,13 @@ static inline int mlx5e_alloc_rx_wqe(struct mlx5e_rq *rq,
 	struct sk_buff *skb;
 	dma_addr_t dma_addr;
 
+	if (rq->xdp_cache_cnt) {
+		/* already mapped and reserved, see mlx5e_xdp_recycle() */
+		skb = rq->xdp_cache[--rq->xdp_cache_cnt];
+		dma_addr = *((dma_addr_t *)skb->cb);
+		goto post;
+	}
+
 	skb = netdev_alloc_skb(rq->netdev, rq->wqe_sz);
 	if (unlikely(!skb))
 		return -ENOMEM;
@@ -58,6 +67,7 @@ static inline int mlx5e_alloc_rx_wqe(struct mlx5e_rq *rq,
 	skb_reserve(skb, MLX5E_NET_IP_ALIGN);
 
 	*((dma_addr_t *)skb->cb) = dma_addr;
+post:
 	wqe->data.addr = cpu_to_be64(dma_addr + MLX5E_NET_IP_ALIGN);
 
 	rq->skb[ix] = skb;
@@ -70,6 +80,56 @@ err_free_skb:
 	return -ENOMEM;
 }
 
+static inline int mlx5e_alloc_rx_mpwqe(struct mlx5e_rq *rq,
+				       struct mlx5e_rx_wqe *wqe, u16 ix)
+{
+	struct mlx5e_mpw_info *wi = &rq->wqe_info[ix];
+	int i;
+
+	/* not compound: the pages are handed out to skbs one by one */
+	wi->dma_info.page = alloc_pages(GFP_ATOMIC | __GFP_COLD | __GFP_NOWARN,
+					MLX5_MPWRQ_WQE_PAGE_ORDER);
+	if (unlikely(!wi->dma_info.page)) {
+		rq->stats.buff_alloc_err++;
+		return -ENOMEM;
+	}
+
+	wi->dma_info.addr = dma_map_page(rq->pdev, wi->dma_info.page, 0,
+					 rq->wqe_sz, DMA_FROM_DEVICE);
+	if (unlikely(dma_mapping_error(rq->pdev, wi->dma_info.addr))) {
+		__free_pages(wi->dma_info.page, MLX5_MPWRQ_WQE_PAGE_ORDER);
+		return -ENOMEM;
+	}
+
+	split_page(wi->dma_info.page, MLX5_MPWRQ_WQE_PAGE_ORDER);
+	for (i = 0; i < MLX5_MPWRQ_PAGES_PER_WQE; i++) {
+		atomic_add(MLX5_MPWRQ_STRIDES_PER_PAGE,
+			   &wi->dma_info.page[i]._count);
+		wi->skbs_frags[i] = 0;
+	}
+	wi->consumed_strides = 0;
+
+	wqe->data.addr = cpu_to_be64(wi->dma_info.addr);
+
+	return 0;
+}
+
+static void mlx5e_free_rx_mpwqe(struct mlx5e_rq *rq,
+				struct mlx5e_mpw_info *wi)
+{
+	int i;
+
+	dma_unmap_page(rq->pdev, wi->dma_info.addr, rq->wqe_sz,
+		       DMA_FROM_DEVICE);
+	for (i = 0; i < MLX5_MPWRQ_PAGES_PER_WQE; i++) {
+		struct page *page = &wi->dma_info.page[i];
+
+		atomic_sub(MLX5_MPWRQ_STRIDES_PER_PAGE - wi->skbs_frags[i],
+			   &page->_count);
+		put_page(page);
+	}
+}
+
 bool mlx5e_post_rx_wqes(struct mlx5e_rq *rq)
 {
 	struct mlx5_wq_ll *wq = &rq->wq;
@@ -79,8 +139,13 @@ bool mlx5e_post_rx_wqes(struct mlx5e_rq *rq)
 
 	while (!mlx5_wq_ll_is_full(wq)) {
 		struct mlx5e_rx_wqe *wqe = mlx5_wq_ll_get_wqe(wq, wq->head);
+		int err;
 
-		if (unlikely(mlx5e_alloc_rx_wqe(rq, wqe, wq->head)))
+		if (rq->wq_type == MLX5_WQ_TYPE_STRQ)
+			err = mlx5e_alloc_rx_mpwqe(rq, wqe, wq->head);
+		else
+			err = mlx5e_alloc_rx_wqe(rq, wqe, wq->head);
+		if (unlikely(err))
 			break;
 
 		mlx5_wq_ll_push(wq, be16_to_cpu(wqe->next.next_wqe_index));
@@ -94,7 +159,8 @@ bool mlx5e_post_rx_wqes(struct mlx5e_rq *rq)
 	return !mlx5_wq_ll_is_full(wq);
 }
 
-static void mlx5e_lro_update_hdr(struct sk_buff *skb, struct mlx5_cqe64 *cqe)
+static void mlx5e_lro_update_hdr(struct sk_buff *skb, struct mlx5_cqe64 *cqe,
+				 u32 cqe_bcnt)
 {
 	struct ethhdr	*eth	= (struct ethhdr *)(skb->data);
 	struct iphdr	*ipv4	= (struct iphdr *)(skb->data + ETH_HLEN);
@@ -105,7 +171,7 @@ static void mlx5e_lro_update_hdr(struct sk_buff *skb, struct mlx5_cqe64 *cqe)
 	int tcp_ack = ((CQE_L4_HDR_TYPE_TCP_ACK_NO_DATA  == l4_hdr_type) ||
 		       (CQE_L4_HDR_TYPE_TCP_ACK_AND_DATA == l4_hdr_type));
 
-	u16 tot_len = be32_to_cpu(cqe->byte_cnt) - ETH_HLEN;
+	u16 tot_len = cqe_bcnt - ETH_HLEN;
 
 	if (eth->h_proto == htons(ETH_P_IP)) {
 		tcp = (struct tcphdr *)(skb->data + ETH_HLEN +
@@ -183,19 +249,18 @@ csum_none:
 	rq->stats.csum_none++;
 }
 
+/* The headers must be in the linear part, the payload may be in frags */
 static inline void mlx5e_build_rx_skb(struct mlx5_cqe64 *cqe,
+				      u32 cqe_bcnt,
 				      struct mlx5e_rq *rq,
 				      struct sk_buff *skb)
 {
 	struct net_device *netdev = rq->netdev;
-	u32 cqe_bcnt = be32_to_cpu(cqe->byte_cnt);
 	int lro_num_seg;
 
-	skb_put(skb, cqe_bcnt);
-
 	lro_num_seg = be32_to_cpu(cqe->srqn) >> 24;
 	if (lro_num_seg > 1) {
-		mlx5e_lro_update_hdr(skb, cqe);
+		mlx5e_lro_update_hdr(skb, cqe, cqe_bcnt);
 		skb_shinfo(skb)->gso_size = DIV_ROUND_UP(cqe_bcnt, lro_num_seg);
 		rq->stats.lro_packets++;
 		rq->stats.lro_bytes += cqe_bcnt;
@@ -215,21 +280,260 @@ static inline void mlx5e_build_rx_skb(struct mlx5_cqe64 *cqe,
 				       be16_to_cpu(cqe->vlan_info));
 }
 
+static inline void mlx5e_xdp_recycle(struct mlx5e_rq *rq,
+				     struct sk_buff *skb)
+{
+	dma_addr_t dma_addr = *((dma_addr_t *)skb->cb);
+
+	if (likely(rq->xdp_cache_cnt < MLX5E_XDP_CACHE_SIZE)) {
+		dma_sync_single_for_device(rq->pdev, dma_addr, rq->wqe_sz,
+					   DMA_FROM_DEVICE);
+		rq->xdp_cache[rq->xdp_cache_cnt++] = skb;
+		return;
+	}
+
+	dma_unmap_single(rq->pdev, dma_addr, rq->wqe_sz, DMA_FROM_DEVICE);
+	dev_kfree_skb(skb);
+}
+
+/* Run the XDP program on the raw rx buffer. The skb only serves as the
+ * buffer here, none of its fields are set up until mlx5e_build_rx_skb().
+ * Returns true if the buffer was consumed (dropped or sent back out).
+ */
+static inline bool mlx5e_xdp_handle(struct mlx5e_rq *rq,
+				    struct bpf_prog *prog,
+				    struct mlx5_cqe64 *cqe,
+				    struct sk_buff *skb)
+{
+	dma_addr_t dma_addr = *((dma_addr_t *)skb->cb);
+	u32 cqe_bcnt = be32_to_cpu(cqe->byte_cnt);
+	struct xdp_buff xdp;
+	u32 act;
+
+	dma_sync_single_for_cpu(rq->pdev, dma_addr, rq->wqe_sz,
+				DMA_FROM_DEVICE);
+
+	xdp.data = skb->data;
+	xdp.data_end = xdp.data + cqe_bcnt;
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		dma_unmap_single(rq->pdev, dma_addr, rq->wqe_sz,
+				 DMA_FROM_DEVICE);
+		skb_put(skb, cqe_bcnt);
+		if (likely(mlx5e_xmit_xdp(&rq->channel->sq[0], skb))) {
+			rq->stats.xdp_tx++;
+			return true;
+		}
+		rq->stats.xdp_drop++;
+		dev_kfree_skb(skb);
+		return true;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+	case XDP_ABORTED:
+	case XDP_DROP:
+		rq->stats.xdp_drop++;
+		mlx5e_xdp_recycle(rq, skb);
+		return true;
+	}
+}
+
+static inline void mlx5e_handle_rx_cqe(struct mlx5e_rq *rq,
+				       struct bpf_prog *xdp_prog,
+				       struct mlx5_cqe64 *cqe)
+{
+	struct mlx5e_rx_wqe *wqe;
+	struct sk_buff *skb;
+	__be16 wqe_counter_be;
+	u16 wqe_counter;
+	u32 cqe_bcnt;
+
+	wqe_counter_be = cqe->wqe_counter;
+	wqe_counter    = be16_to_cpu(wqe_counter_be);
+	wqe            = mlx5_wq_ll_get_wqe(&rq->wq, wqe_counter);
+	skb            = rq->skb[wqe_counter];
+	prefetch(skb->data);
+	rq->skb[wqe_counter] = NULL;
+
+	if (xdp_prog &&
+	    likely((cqe->op_own >> 4) == MLX5_CQE_RESP_SEND) &&
+	    mlx5e_xdp_handle(rq, xdp_prog, cqe, skb))
+		goto wq_ll_pop;
+
+	dma_unmap_single(rq->pdev,
+			 *((dma_addr_t *)skb->cb),
+			 rq->wqe_sz,
+			 DMA_FROM_DEVICE);
+
+	if (unlikely((cqe->op_own >> 4) != MLX5_CQE_RESP_SEND)) {
+		rq->stats.wqe_err++;
+		dev_kfree_skb(skb);
+		goto wq_ll_pop;
+	}
+
+	cqe_bcnt = be32_to_cpu(cqe->byte_cnt);
+	skb_put(skb, cqe_bcnt);
+	mlx5e_build_rx_skb(cqe, cqe_bcnt, rq, skb);
+	rq->stats.packets++;
+	rq->stats.bytes += cqe_bcnt;
+	napi_gro_receive(rq->cq.napi, skb);
+
+wq_ll_pop:
+	mlx5_wq_ll_pop(&rq->wq, wqe_counter_be,
+		       &wqe->next.next_wqe_index);
+}
+
+static inline void mlx5e_add_skb_frag_mpwqe(struct mlx5e_rq *rq,
+					    struct sk_buff *skb,
+					    struct mlx5e_mpw_info *wi,
+					    u32 page_idx, u32 frag_offset,
+					    u32 len)
+{
+	unsigned int truesize = ALIGN(len, MLX5_MPWRQ_STRIDE_SIZE);
+
+	dma_sync_single_range_for_cpu(rq->pdev, wi->dma_info.addr,
+				      (page_idx << PAGE_SHIFT) + frag_offset,
+				      len, DMA_FROM_DEVICE);
+	/* takes one of the references the page was biased with */
+	wi->skbs_frags[page_idx]++;
+	skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags,
+			&wi->dma_info.page[page_idx], frag_offset,
+			len, truesize);
+}
+
+static inline void mlx5e_copy_skb_header_mpwqe(struct mlx5e_rq *rq,
+					       struct sk_buff *skb,
+					       struct mlx5e_mpw_info *wi,
+					       u32 page_idx, u32 offset,
+					       u32 headlen)
+{
+	u32 headlen_pg = min_t(u32, headlen, PAGE_SIZE - offset);
+	struct page *page = &wi->dma_info.page[page_idx];
+
+	dma_sync_single_range_for_cpu(rq->pdev, wi->dma_info.addr,
+				      (page_idx << PAGE_SHIFT) + offset,
+				      headlen_pg, DMA_FROM_DEVICE);
+	skb_copy_to_linear_data(skb, page_address(page) + offset, headlen_pg);
+
+	/* the headers may straddle a page boundary */
+	if (unlikely(headlen_pg < headlen)) {
+		dma_sync_single_range_for_cpu(rq->pdev, wi->dma_info.addr,
+					      (page_idx + 1) << PAGE_SHIFT,
+					      headlen - headlen_pg,
+					      DMA_FROM_DEVICE);
+		skb_copy_to_linear_data_offset(skb, headlen_pg,
+					       page_address(page + 1),
+					       headlen - headlen_pg);
+	}
+}
+
+/* Copy the headers (or all of a small packet) into the linear part and
+ * attach the rest of the packet's strides as page frags.
+ */
+static inline void mlx5e_mpwqe_fill_rx_skb(struct mlx5e_rq *rq,
+					   struct mlx5_cqe64 *cqe,
+					   struct mlx5e_mpw_info *wi,
+					   u32 cqe_bcnt,
+					   struct sk_buff *skb)
+{
+	u32 wqe_offset  = mpwrq_get_cqe_stride_index(cqe) *
+			  MLX5_MPWRQ_STRIDE_SIZE;
+	u32 head_offset = wqe_offset & (PAGE_SIZE - 1);
+	u32 page_idx    = wqe_offset >> PAGE_SHIFT;
+	u32 headlen     = min_t(u32, MLX5_MPWRQ_SMALL_PACKET_THRESHOLD,
+				cqe_bcnt);
+	u32 frag_offset = head_offset + headlen;
+	u32 byte_cnt    = cqe_bcnt - headlen;
+
+	mlx5e_copy_skb_header_mpwqe(rq, skb, wi, page_idx, head_offset,
+				    headlen);
+	skb_put(skb, headlen);
+
+	if (unlikely(frag_offset >= PAGE_SIZE)) {
+		page_idx++;
+		frag_offset -= PAGE_SIZE;
+	}
+
+	while (byte_cnt) {
+		u32 pg_consumed_bytes = min_t(u32, PAGE_SIZE - frag_offset,
+					      byte_cnt);
+
+		mlx5e_add_skb_frag_mpwqe(rq, skb, wi, page_idx, frag_offset,
+					 pg_consumed_bytes);
+		byte_cnt -= pg_consumed_bytes;
+		frag_offset = 0;
+		page_idx++;
+	}
+}
+
+static inline void mlx5e_handle_rx_cqe_mpwrq(struct mlx5e_rq *rq,
+					     struct mlx5_cqe64 *cqe)
+{
+	u16 wqe_id = be16_to_cpu(cqe->wqe_id);
+	struct mlx5e_mpw_info *wi = &rq->wqe_info[wqe_id];
+	struct mlx5e_rx_wqe *wqe = mlx5_wq_ll_get_wqe(&rq->wq, wqe_id);
+	struct sk_buff *skb;
+	u32 cqe_bcnt;
+
+	wi->consumed_strides += mpwrq_get_cqe_consumed_strides(cqe);
+
+	if (unlikely((cqe->op_own >> 4) != MLX5_CQE_RESP_SEND)) {
+		rq->stats.wqe_err++;
+		/* the RQ is in error or being flushed, nothing else will
+		 * complete on this WQE
+		 */
+		wi->consumed_strides = MLX5_MPWRQ_NUM_STRIDES;
+		goto mpwrq_cqe_out;
+	}
+
+	/* the strides left at the end of the WQE, too few for the packet */
+	if (unlikely(mpwrq_is_filler_cqe(cqe))) {
+		rq->stats.mpwqe_filler++;
+		goto mpwrq_cqe_out;
+	}
+
+	skb = napi_alloc_skb(rq->cq.napi,
+			     ALIGN(MLX5_MPWRQ_SMALL_PACKET_THRESHOLD,
+				   sizeof(long)));
+	if (unlikely(!skb)) {
+		rq->stats.buff_alloc_err++;
+		goto mpwrq_cqe_out;
+	}
+
+	prefetchw(skb->data);
+	cqe_bcnt = mpwrq_get_cqe_byte_cnt(cqe);
+
+	mlx5e_mpwqe_fill_rx_skb(rq, cqe, wi, cqe_bcnt, skb);
+	mlx5e_build_rx_skb(cqe, cqe_bcnt, rq, skb);
+	rq->stats.packets++;
+	rq->stats.bytes += cqe_bcnt;
+	napi_gro_receive(rq->cq.napi, skb);
+
+mpwrq_cqe_out:
+	if (likely(wi->consumed_strides < MLX5_MPWRQ_NUM_STRIDES))
+		return;
+
+	mlx5e_free_rx_mpwqe(rq, wi);
+	mlx5_wq_ll_pop(&rq->wq, cqe->wqe_id, &wqe->next.next_wqe_index);
+}
+
 bool mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 {
 	struct mlx5e_rq *rq = container_of(cq, struct mlx5e_rq, cq);
+	struct bpf_prog *xdp_prog;
 	int i;
 
 	/* avoid accessing cq (dma coherent memory) if not needed */
 	if (!test_and_clear_bit(MLX5E_CQ_HAS_CQES, &cq->flags))
 		return false;
 
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(rq->xdp_prog);
+
 	for (i = 0; i < budget; i++) {
-		struct mlx5e_rx_wqe *wqe;
 		struct mlx5_cqe64 *cqe;
-		struct sk_buff *skb;
-		__be16 wqe_counter_be;
-		u16 wqe_counter;
 
 		cqe = mlx5e_get_cqe(cq);
 		if (!cqe)
@@ -237,33 +541,14 @@ bool mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 
 		mlx5_cqwq_pop(&cq->wq);
 
-		wqe_counter_be = cqe->wqe_counter;
-		wqe_counter    = be16_to_cpu(wqe_counter_be);
-		wqe            = mlx5_wq_ll_get_wqe(&rq->wq, wqe_counter);
-		skb            = rq->skb[wqe_counter];
-		prefetch(skb->data);
-		rq->skb[wqe_counter] = NULL;
-
-		dma_unmap_single(rq->pdev,
-				 *((dma_addr_t *)skb->cb),
-				 rq->wqe_sz,
-				 DMA_FROM_DEVICE);
-
-		if (unlikely((cqe->op_own >> 4) != MLX5_CQE_RESP_SEND)) {
-			rq->stats.wqe_err++;
-			dev_kfree_skb(skb);
-			goto wq_ll_pop;
-		}
-
-		mlx5e_build_rx_skb(cqe, rq, skb);
-		rq->stats.packets++;
-		napi_gro_receive(cq->napi, skb);
-
-wq_ll_pop:
-		mlx5_wq_ll_pop(&rq->wq, wqe_counter_be,
-			       &wqe->next.next_wqe_index);
+		if (rq->wq_type == MLX5_WQ_TYPE_STRQ)
+			mlx5e_handle_rx_cqe_mpwrq(rq, cqe);
+		else
+			mlx5e_handle_rx_cqe(rq, xdp_prog, cqe);
 	}
 
+	rcu_read_unlock();
+
 	mlx5_cqwq_update_db_record(&cq->wq);
 
 	/* ensure cq space is freed before enabling more cqes */
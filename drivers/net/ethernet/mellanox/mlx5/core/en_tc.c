@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2016, Mellanox Technologies. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <net/flow_dissector.h>
+#include <net/pkt_cls.h>
+#include <net/tc_act/tc_gact.h>
+#include <linux/mlx5/flow_table.h>
+#include "en.h"
+#include "en_tc.h"
+
+/*
+ * Flower filters go into a flow table of their own, which packets see
+ * before the vlan table. Each group of the table holds the filters of one
+ * mask: a group gets its criteria when the first filter with a new mask
+ * comes, and keeps them once empty in case the mask comes back. Packets
+ * that match no filter go on to the vlan table through the last group,
+ * which matches everything.
+ */
+#define MLX5E_TC_MISS_GROUP	MLX5E_TC_NUM_GROUPS
+
+struct mlx5e_tc_flow {
+	struct rhash_head	node;
+	unsigned long		cookie;
+	u32			ft_ix;
+	int			group;
+};
+
+static const struct rhashtable_params mlx5e_tc_flow_ht_params = {
+	.head_offset = offsetof(struct mlx5e_tc_flow, node),
+	.key_offset = offsetof(struct mlx5e_tc_flow, cookie),
+	.key_len = sizeof(((struct mlx5e_tc_flow *)0)->cookie),
+	.automatic_shrinking = true,
+};
+
+static int mlx5e_tc_get_group(struct mlx5e_priv *priv, u32 *match_criteria)
+{
+	struct mlx5e_tc_table *tc = &priv->tc;
+	int free_ix = -1;
+	int err;
+	int i;
+
+	for (i = 0; i < MLX5E_TC_NUM_GROUPS; i++) {
+		struct mlx5e_tc_group *g = &tc->groups[i];
+
+		if (!memcmp(g->match_criteria, match_criteria,
+			    sizeof(g->match_criteria))) {
+			g->refcnt++;
+			return i;
+		}
+		if (!g->refcnt && free_ix < 0)
+			free_ix = i;
+	}
+
+	if (free_ix < 0)
+		return -ENOSPC;
+
+	err = mlx5_modify_flow_table_group(tc->t, free_ix,
+					   MLX5_MATCH_OUTER_HEADERS,
+					   match_criteria);
+	if (err)
+		return err;
+
+	memcpy(tc->groups[free_ix].match_criteria, match_criteria,
+	       sizeof(tc->groups[free_ix].match_criteria));
+	tc->groups[free_ix].refcnt = 1;
+
+	return free_ix;
+}
+
+static void mlx5e_tc_del_flow(struct mlx5e_priv *priv,
+			      struct mlx5e_tc_flow *flow)
+{
+	mlx5_del_flow_table_entry(priv->tc.t, flow->ft_ix);
+	priv->tc.groups[flow->group].refcnt--;
+	kfree(flow);
+}
+
+static int parse_cls_flower(struct mlx5e_priv *priv, u32 *match_c,
+			    u32 *match_v, struct tc_cls_flower_offload *f)
+{
+	void *headers_c = MLX5_ADDR_OF(fte_match_param, match_c,
+				       outer_headers);
+	void *headers_v = MLX5_ADDR_OF(fte_match_param, match_v,
+				       outer_headers);
+	u16 addr_type = 0;
+	u8 ip_proto = 0;
+
+	if (f->dissector->used_keys &
+	    ~(BIT(FLOW_DISSECTOR_KEY_CONTROL) |
+	      BIT(FLOW_DISSECTOR_KEY_BASIC) |
+	      BIT(FLOW_DISSECTOR_KEY_ETH_ADDRS) |
+	      BIT(FLOW_DISSECTOR_KEY_IPV4_ADDRS) |
+	      BIT(FLOW_DISSECTOR_KEY_IPV6_ADDRS) |
+	      BIT(FLOW_DISSECTOR_KEY_PORTS))) {
+		netdev_warn(priv->netdev, "Unsupported key used: 0x%x\n",
+			    f->dissector->used_keys);
+		return -EOPNOTSUPP;
+	}
+
+	if (dissector_uses_key(f->dissector, FLOW_DISSECTOR_KEY_CONTROL)) {
+		struct flow_dissector_key_control *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_CONTROL,
+						  f->key);
+		addr_type = key->addr_type;
+	}
+
+	if (dissector_uses_key(f->dissector, FLOW_DISSECTOR_KEY_BASIC)) {
+		struct flow_dissector_key_basic *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_BASIC,
+						  f->key);
+		struct flow_dissector_key_basic *mask =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_BASIC,
+						  f->mask);
+		ip_proto = key->ip_proto;
+
+		MLX5_SET(fte_match_set_lyr_2_4, headers_c, ethertype,
+			 ntohs(mask->n_proto));
+		MLX5_SET(fte_match_set_lyr_2_4, headers_v, ethertype,
+			 ntohs(key->n_proto));
+
+		MLX5_SET(fte_match_set_lyr_2_4, headers_c, ip_protocol,
+			 mask->ip_proto);
+		MLX5_SET(fte_match_set_lyr_2_4, headers_v, ip_protocol,
+			 key->ip_proto);
+	}
+
+	if (dissector_uses_key(f->dissector, FLOW_DISSECTOR_KEY_ETH_ADDRS)) {
+		struct flow_dissector_key_eth_addrs *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_ETH_ADDRS,
+						  f->key);
+		struct flow_dissector_key_eth_addrs *mask =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_ETH_ADDRS,
+						  f->mask);
+
+		ether_addr_copy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c,
+					     dmac_47_16),
+				mask->dst);
+		ether_addr_copy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v,
+					     dmac_47_16),
+				key->dst);
+
+		ether_addr_copy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c,
+					     smac_47_16),
+				mask->src);
+		ether_addr_copy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v,
+					     smac_47_16),
+				key->src);
+	}
+
+	/* IPv4 addresses are the last four bytes of the IPv6 sized fields */
+	if (addr_type == FLOW_DISSECTOR_KEY_IPV4_ADDRS) {
+		struct flow_dissector_key_ipv4_addrs *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_IPV4_ADDRS,
+						  f->key);
+		struct flow_dissector_key_ipv4_addrs *mask =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_IPV4_ADDRS,
+						  f->mask);
+
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c,
+				    src_ip[3]),
+		       &mask->src, sizeof(mask->src));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v,
+				    src_ip[3]),
+		       &key->src, sizeof(key->src));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c,
+				    dst_ip[3]),
+		       &mask->dst, sizeof(mask->dst));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v,
+				    dst_ip[3]),
+		       &key->dst, sizeof(key->dst));
+	}
+
+	if (addr_type == FLOW_DISSECTOR_KEY_IPV6_ADDRS) {
+		struct flow_dissector_key_ipv6_addrs *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_IPV6_ADDRS,
+						  f->key);
+		struct flow_dissector_key_ipv6_addrs *mask =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_IPV6_ADDRS,
+						  f->mask);
+
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c, src_ip),
+		       &mask->src, sizeof(mask->src));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v, src_ip),
+		       &key->src, sizeof(key->src));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_c, dst_ip),
+		       &mask->dst, sizeof(mask->dst));
+		memcpy(MLX5_ADDR_OF(fte_match_set_lyr_2_4, headers_v, dst_ip),
+		       &key->dst, sizeof(key->dst));
+	}
+
+	if (dissector_uses_key(f->dissector, FLOW_DISSECTOR_KEY_PORTS)) {
+		struct flow_dissector_key_ports *key =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_PORTS,
+						  f->key);
+		struct flow_dissector_key_ports *mask =
+			skb_flow_dissector_target(f->dissector,
+						  FLOW_DISSECTOR_KEY_PORTS,
+						  f->mask);
+		switch (ip_proto) {
+		case IPPROTO_TCP:
+			MLX5_SET(fte_match_set_lyr_2_4, headers_c,
+				 tcp_sport, ntohs(mask->src));
+			MLX5_SET(fte_match_set_lyr_2_4, headers_v,
+				 tcp_sport, ntohs(key->src));
+
+			MLX5_SET(fte_match_set_lyr_2_4, headers_c,
+				 tcp_dport, ntohs(mask->dst));
+			MLX5_SET(fte_match_set_lyr_2_4, headers_v,
+				 tcp_dport, ntohs(key->dst));
+			break;
+
+		case IPPROTO_UDP:
+			MLX5_SET(fte_match_set_lyr_2_4, headers_c,
+				 udp_sport, ntohs(mask->src));
+			MLX5_SET(fte_match_set_lyr_2_4, headers_v,
+				 udp_sport, ntohs(key->src));
+
+			MLX5_SET(fte_match_set_lyr_2_4, headers_c,
+				 udp_dport, ntohs(mask->dst));
+			MLX5_SET(fte_match_set_lyr_2_4, headers_v,
+				 udp_dport, ntohs(key->dst));
+			break;
+
+		default:
+			if (mask->ports) {
+				netdev_warn(priv->netdev,
+					    "Only UDP and TCP transport are supported\n");
+				return -EINVAL;
+			}
+			break;
+		}
+	}
+
+	/* the unused groups of the table match on nothing */
+	if (!memchr_inv(headers_c, 0, MLX5_ST_SZ_BYTES(fte_match_set_lyr_2_4)))
+		return -EOPNOTSUPP;
+
+	return 0;
+}
+
+/*
+ * Only dropping is done in hardware. There is no eswitch to redirect to
+ * here, and in front of the vlan table a filter that passes the packet
+ * would change nothing.
+ */
+static int parse_tc_actions(struct mlx5e_priv *priv, struct tcf_exts *exts,
+			    u32 *action)
+{
+#ifdef CONFIG_NET_CLS_ACT
+	const struct tc_action *a;
+
+	if (list_empty(&exts->actions))
+		return -EINVAL;
+
+	*action = 0;
+
+	list_for_each_entry(a, &exts->actions, list) {
+		/* Only support a single action per rule */
+		if (*action)
+			return -EINVAL;
+
+		if (is_tcf_gact_shot(a)) {
+			*action |= MLX5_FLOW_CONTEXT_ACTION_DROP;
+			continue;
+		}
+
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+int mlx5e_configure_flower(struct mlx5e_priv *priv,
+			   struct tc_cls_flower_offload *f)
+{
+	struct mlx5e_tc_table *tc = &priv->tc;
+	struct mlx5e_tc_flow *flow, *old;
+	u32 *match_criteria;
+	u32 *flow_context;
+	void *match_value;
+	u32 action;
+	int err;
+
+	flow = kzalloc(sizeof(*flow), GFP_KERNEL);
+	flow_context   = mlx5_vzalloc(MLX5_ST_SZ_BYTES(flow_context));
+	match_criteria = mlx5_vzalloc(MLX5_ST_SZ_BYTES(fte_match_param));
+	if (!flow || !flow_context || !match_criteria) {
+		err = -ENOMEM;
+		goto err_free;
+	}
+	match_value = MLX5_ADDR_OF(flow_context, flow_context, match_value);
+
+	err = parse_cls_flower(priv, match_criteria, match_value, f);
+	if (err)
+		goto err_free;
+
+	err = parse_tc_actions(priv, f->exts, &action);
+	if (err)
+		goto err_free;
+
+	MLX5_SET(flow_context, flow_context, action, action);
+
+	/* the old entry may have the same key in the same group */
+	old = rhashtable_lookup_fast(&tc->ht, &f->cookie,
+				     mlx5e_tc_flow_ht_params);
+	if (old) {
+		rhashtable_remove_fast(&tc->ht, &old->node,
+				       mlx5e_tc_flow_ht_params);
+		mlx5e_tc_del_flow(priv, old);
+	}
+
+	flow->group = mlx5e_tc_get_group(priv, match_criteria);
+	if (flow->group < 0) {
+		err = flow->group;
+		goto err_free;
+	}
+
+	err = mlx5_add_flow_table_entry(tc->t, MLX5_MATCH_OUTER_HEADERS,
+					match_criteria, flow_context,
+					&flow->ft_ix);
+	if (err)
+		goto err_put_group;
+
+	flow->cookie = f->cookie;
+	err = rhashtable_insert_fast(&tc->ht, &flow->node,
+				     mlx5e_tc_flow_ht_params);
+	if (err)
+		goto err_del_entry;
+
+	goto out;
+
+err_del_entry:
+	mlx5_del_flow_table_entry(tc->t, flow->ft_ix);
+
+err_put_group:
+	tc->groups[flow->group].refcnt--;
+
+err_free:
+	kfree(flow);
+
+out:
+	kvfree(match_criteria);
+	kvfree(flow_context);
+	return err;
+}
+
+int mlx5e_delete_flower(struct mlx5e_priv *priv,
+			struct tc_cls_flower_offload *f)
+{
+	struct mlx5e_tc_table *tc = &priv->tc;
+	struct mlx5e_tc_flow *flow;
+
+	flow = rhashtable_lookup_fast(&tc->ht, &f->cookie,
+				      mlx5e_tc_flow_ht_params);
+	if (!flow)
+		return -EINVAL;
+
+	rhashtable_remove_fast(&tc->ht, &flow->node, mlx5e_tc_flow_ht_params);
+	mlx5e_tc_del_flow(priv, flow);
+
+	return 0;
+}
+
+int mlx5e_tc_init(struct mlx5e_priv *priv)
+{
+	struct mlx5e_tc_table *tc = &priv->tc;
+	struct mlx5_flow_table_group *g;
+	u32 *match_criteria;
+	u32 *flow_context;
+	void *dest;
+	int err;
+	int i;
+
+	err = rhashtable_init(&tc->ht, &mlx5e_tc_flow_ht_params);
+	if (err)
+		return err;
+
+	g = kcalloc(MLX5E_TC_NUM_GROUPS + 1, sizeof(*g), GFP_KERNEL);
+	flow_context   = mlx5_vzalloc(MLX5_ST_SZ_BYTES(flow_context) +
+				      MLX5_ST_SZ_BYTES(dest_format_struct));
+	match_criteria = mlx5_vzalloc(MLX5_ST_SZ_BYTES(fte_match_param));
+	if (!g || !flow_context || !match_criteria) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < MLX5E_TC_NUM_GROUPS; i++) {
+		g[i].log_sz = MLX5E_TC_GROUP_LOG_SZ;
+		g[i].match_criteria_enable = MLX5_MATCH_OUTER_HEADERS;
+		memset(&tc->groups[i], 0, sizeof(tc->groups[i]));
+	}
+	g[MLX5E_TC_MISS_GROUP].log_sz = 0;
+
+	tc->t = mlx5_create_flow_table(priv->mdev, 0,
+				       MLX5_FLOW_TABLE_TYPE_NIC_RCV,
+				       MLX5E_TC_NUM_GROUPS + 1, g);
+	if (!tc->t) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	dest = MLX5_ADDR_OF(flow_context, flow_context, destination);
+
+	MLX5_SET(flow_context, flow_context, action,
+		 MLX5_FLOW_CONTEXT_ACTION_FWD_DEST);
+	MLX5_SET(flow_context, flow_context, destination_list_size, 1);
+	MLX5_SET(dest_format_struct, dest, destination_type,
+		 MLX5_FLOW_CONTEXT_DEST_TYPE_FLOW_TABLE);
+	MLX5_SET(dest_format_struct, dest, destination_id,
+		 mlx5_get_flow_table_id(priv->ft.vlan));
+
+	err = mlx5_add_flow_table_entry(tc->t, 0, match_criteria,
+					flow_context, &tc->miss_ft_ix);
+	if (err) {
+		mlx5_destroy_flow_table(tc->t);
+		tc->t = NULL;
+	}
+
+out:
+	kvfree(match_criteria);
+	kvfree(flow_context);
+	kfree(g);
+	if (err)
+		rhashtable_destroy(&tc->ht);
+	return err;
+}
+
+static void mlx5e_tc_del_flow_cb(void *ptr, void *arg)
+{
+	struct mlx5e_priv *priv = arg;
+
+	mlx5e_tc_del_flow(priv, ptr);
+}
+
+void mlx5e_tc_cleanup(struct mlx5e_priv *priv)
+{
+	struct mlx5e_tc_table *tc = &priv->tc;
+
+	rhashtable_free_and_destroy(&tc->ht, mlx5e_tc_del_flow_cb, priv);
+	mlx5_del_flow_table_entry(tc->t, tc->miss_ft_ix);
+	mlx5_destroy_flow_table(tc->t);
+	tc->t = NULL;
+}
@@ -312,6 +312,24 @@ netdev_tx_t mlx5e_xmit(struct sk_buff *skb, struct net_device *dev)
 	return mlx5e_sq_xmit(sq, skb);
 }
 
+/* Send back out a buffer that an XDP program returned XDP_TX for. Runs
+ * from the rx napi, so the sq is shared with the stack and needs the txq
+ * lock. On false the caller still owns the skb.
+ */
+bool mlx5e_xmit_xdp(struct mlx5e_sq *sq, struct sk_buff *skb)
+{
+	bool sent = false;
+
+	__netif_tx_lock(sq->txq, smp_processor_id());
+	if (likely(!netif_xmit_frozen_or_stopped(sq->txq))) {
+		mlx5e_sq_xmit(sq, skb);
+		sent = true;
+	}
+	__netif_tx_unlock(sq->txq);
+
+	return sent;
+}
+
 bool mlx5e_poll_tx_cq(struct mlx5e_cq *cq)
 {
 	struct mlx5e_sq *sq;
@@ -342,6 +342,42 @@ void mlx5_del_flow_table_entry(void *flow_table, u32 flow_index)
 }
 EXPORT_SYMBOL(mlx5_del_flow_table_entry);
 
+/*
+ * Give empty group @group_ix new match criteria. Entries are still added
+ * by criteria, so no two groups of a table should end up with the same.
+ */
+int mlx5_modify_flow_table_group(void *flow_table, int group_ix,
+				 u8 match_criteria_enable,
+				 void *match_criteria)
+{
+	struct mlx5_flow_table *ft = flow_table;
+	struct mlx5_ftg *g = &ft->group[group_ix];
+	u32 end_ix = g->start_ix + (1 << g->g.log_sz);
+	int err;
+
+	mutex_lock(&ft->mutex);
+
+	if (find_next_bit(ft->bitmap, end_ix, g->start_ix) < end_ix) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	mlx5_destroy_flow_group_cmd(ft, group_ix);
+	g->g.match_criteria_enable = match_criteria_enable;
+	memcpy(g->g.match_criteria, match_criteria,
+	       MLX5_ST_SZ_BYTES(fte_match_param));
+	err = mlx5_create_flow_group_cmd(ft, group_ix);
+	if (err)
+		mlx5_core_warn(ft->dev, "failed to recreate flow group %d\n",
+			       group_ix);
+
+out:
+	mutex_unlock(&ft->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(mlx5_modify_flow_table_group);
+
 void *mlx5_create_flow_table(struct mlx5_core_dev *dev, u8 level, u8 table_type,
 			     u16 num_groups,
 			     struct mlx5_flow_table_group *group)
@@ -184,6 +184,9 @@ struct rndis_device {
 	struct list_head req_list;
 
 	unsigned char hw_mac_adr[ETH_ALEN];
+
+	/* RSS indirection table sent to the host, owned by the guest */
+	u32 rx_table[ITAB_NUM];
 };
 
 
@@ -209,6 +212,7 @@ int rndis_filter_receive(struct hv_device *dev,
 
 int rndis_filter_set_packet_filter(struct rndis_device *dev, u32 new_filter);
 int rndis_filter_set_device_mac(struct hv_device *hdev, char *mac);
+int rndis_filter_set_rss_param(struct rndis_device *rdev, int num_queue);
 
 
 #define NVSP_INVALID_PROTOCOL_VERSION	((u32)0xFFFFFFFF)
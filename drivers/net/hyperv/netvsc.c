@@ -1237,6 +1237,12 @@ int netvsc_device_add(struct hv_device *device, void *additional_info)
 
 	set_per_channel_state(device->channel, net_device->cb_buffer);
 
+	/*
+	 * Packets sent with xmit_more set are only written to the ring;
+	 * the host is signaled once when the batch is complete.
+	 */
+	set_channel_signal_state(device->channel, HV_SIGNAL_POLICY_DEFERRED);
+
 	/* Open the channel */
 	ret = vmbus_open(device->channel, ring_size * PAGE_SIZE,
 			 ring_size * PAGE_SIZE, NULL, 0,
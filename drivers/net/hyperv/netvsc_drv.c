@@ -868,6 +868,78 @@ static int netvsc_set_channels(struct net_device *net,
 	goto do_set;
 }
 
+static u32 netvsc_get_rxfh_key_size(struct net_device *dev)
+{
+	return HASH_KEYLEN;
+}
+
+static u32 netvsc_rss_indir_size(struct net_device *dev)
+{
+	return ITAB_NUM;
+}
+
+static int netvsc_get_rxfh(struct net_device *dev, u32 *indir, u8 *key,
+			   u8 *hfunc)
+{
+	struct net_device_context *ndc = netdev_priv(dev);
+	struct netvsc_device *ndev = hv_get_drvdata(ndc->device_ctx);
+	struct rndis_device *rndis_dev;
+	int i;
+
+	if (!ndev || ndev->destroy)
+		return -ENODEV;
+
+	rndis_dev = ndev->extension;
+
+	if (hfunc)
+		*hfunc = ETH_RSS_HASH_TOP;	/* Toeplitz */
+
+	if (indir) {
+		for (i = 0; i < ITAB_NUM; i++)
+			indir[i] = rndis_dev->rx_table[i];
+	}
+
+	if (key)
+		memcpy(key, netvsc_hash_key, HASH_KEYLEN);
+
+	return 0;
+}
+
+static int netvsc_set_rxfh(struct net_device *dev, const u32 *indir,
+			   const u8 *key, const u8 hfunc)
+{
+	struct net_device_context *ndc = netdev_priv(dev);
+	struct netvsc_device *ndev = hv_get_drvdata(ndc->device_ctx);
+	struct rndis_device *rndis_dev;
+	int i;
+
+	if (!ndev || ndev->destroy)
+		return -ENODEV;
+
+	if (hfunc != ETH_RSS_HASH_NO_CHANGE && hfunc != ETH_RSS_HASH_TOP)
+		return -EOPNOTSUPP;
+
+	/* The transmit path hashes flows with the same fixed key */
+	if (key)
+		return -EOPNOTSUPP;
+
+	if (!indir)
+		return 0;
+
+	if (ndev->num_chn < 2)
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < ITAB_NUM; i++)
+		if (indir[i] >= ndev->num_chn)
+			return -EINVAL;
+
+	rndis_dev = ndev->extension;
+	for (i = 0; i < ITAB_NUM; i++)
+		rndis_dev->rx_table[i] = indir[i];
+
+	return rndis_filter_set_rss_param(rndis_dev, ndev->num_chn);
+}
+
 static int netvsc_change_mtu(struct net_device *ndev, int mtu)
 {
 	struct net_device_context *ndevctx = netdev_priv(ndev);
@@ -991,6 +1063,10 @@ static const struct ethtool_ops ethtool_ops = {
 	.get_link	= ethtool_op_get_link,
 	.get_channels   = netvsc_get_channels,
 	.set_channels   = netvsc_set_channels,
+	.get_rxfh_key_size = netvsc_get_rxfh_key_size,
+	.get_rxfh_indir_size = netvsc_rss_indir_size,
+	.get_rxfh	= netvsc_get_rxfh,
+	.set_rxfh	= netvsc_set_rxfh,
 };
 
 static const struct net_device_ops device_ops = {
@@ -703,7 +703,7 @@ u8 netvsc_hash_key[HASH_KEYLEN] = {
 	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
 };
 
-static int rndis_filter_set_rss_param(struct rndis_device *rdev, int num_queue)
+int rndis_filter_set_rss_param(struct rndis_device *rdev, int num_queue)
 {
 	struct net_device *ndev = rdev->net_dev->ndev;
 	struct rndis_request *request;
@@ -746,7 +746,7 @@ static int rndis_filter_set_rss_param(struct rndis_device *rdev, int num_queue)
 	/* Set indirection table entries */
 	itab = (u32 *)(rssp + 1);
 	for (i = 0; i < ITAB_NUM; i++)
-		itab[i] = i % num_queue;
+		itab[i] = rdev->rx_table[i];
 
 	/* Set hask key values */
 	keyp = (u8 *)((unsigned long)rssp + rssp->kashkey_offset);
@@ -1000,6 +1000,9 @@ static void netvsc_sc_open(struct vmbus_channel *new_sc)
 	set_per_channel_state(new_sc, nvscdev->sub_cb_buf + (chn_index - 1) *
 			      NETVSC_PACKET_SIZE);
 
+	/* Signal the host once per batch of packets, see netvsc_send() */
+	set_channel_signal_state(new_sc, HV_SIGNAL_POLICY_DEFERRED);
+
 	ret = vmbus_open(new_sc, nvscdev->ring_size * PAGE_SIZE,
 			 nvscdev->ring_size * PAGE_SIZE, NULL, 0,
 			 netvsc_channel_cb, new_sc);
@@ -1026,6 +1029,7 @@ int rndis_filter_device_add(struct hv_device *dev,
 	const struct cpumask *node_cpu_mask;
 	u32 num_possible_rss_qs;
 	unsigned long flags;
+	int i;
 
 	rndis_device = get_rndis_device();
 	if (!rndis_device)
@@ -1174,6 +1178,14 @@ int rndis_filter_device_add(struct hv_device *dev,
 	net_device->num_chn = 1 +
 		init_packet->msg.v5_msg.subchn_comp.num_subchannels;
 
+	/*
+	 * Spread the flows evenly over the channels until the indirection
+	 * table is changed through ethtool.
+	 */
+	for (i = 0; i < ITAB_NUM; i++)
+		rndis_device->rx_table[i] =
+			ethtool_rxfh_indir_default(i, net_device->num_chn);
+
 	ret = rndis_filter_set_rss_param(rndis_device, net_device->num_chn);
 
 	/*
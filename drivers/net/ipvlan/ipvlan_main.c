@@ -476,6 +476,16 @@ static int ipvlan_link_new(struct net *src_net, struct net_device *dev,
 	 */
 	memcpy(dev->dev_addr, phy_dev->dev_addr, ETH_ALEN);
 
+	/* No more queues than the master, so that the queue picked here and
+	 * cached in the socket is also a valid one down there.
+	 */
+	netif_set_real_num_tx_queues(dev, min(dev->num_tx_queues,
+					      phy_dev->real_num_tx_queues));
+#ifdef CONFIG_SYSFS
+	netif_set_real_num_rx_queues(dev, min(dev->num_rx_queues,
+					      phy_dev->real_num_rx_queues));
+#endif
+
 	dev->priv_flags |= IFF_IPVLAN_SLAVE;
 
 	port->count += 1;
@@ -532,6 +542,12 @@ static const struct nla_policy ipvlan_nl_policy[IFLA_IPVLAN_MAX + 1] =
 	[IFLA_IPVLAN_MODE] = { .type = NLA_U16 },
 };
 
+/* The master is not known yet; ipvlan_link_new() trims to what it has */
+static unsigned int ipvlan_get_num_queues(void)
+{
+	return netif_get_num_default_rss_queues();
+}
+
 static struct rtnl_link_ops ipvlan_link_ops = {
 	.kind		= "ipvlan",
 	.priv_size	= sizeof(struct ipvl_dev),
@@ -546,6 +562,9 @@ static struct rtnl_link_ops ipvlan_link_ops = {
 	.setup		= ipvlan_link_setup,
 	.newlink	= ipvlan_link_new,
 	.dellink	= ipvlan_link_delete,
+
+	.get_num_tx_queues = ipvlan_get_num_queues,
+	.get_num_rx_queues = ipvlan_get_num_queues,
 };
 
 static int ipvlan_link_register(struct rtnl_link_ops *ops)
@@ -39,13 +39,22 @@
 #define MACVLAN_HASH_SIZE	(1<<MACVLAN_HASH_BITS)
 #define MACVLAN_BC_QUEUE_LEN	1000
 
+/* Broadcast/multicast frames are queued on the CPU that received them and
+ * delivered by a work item bound to that CPU, so that a flood towards
+ * many macvlans is spread over the CPUs the lower device steers it to.
+ */
+struct macvlan_bc_queue {
+	struct sk_buff_head	queue;
+	struct work_struct	work;
+	struct macvlan_port	*port;
+};
+
 struct macvlan_port {
 	struct net_device	*dev;
 	struct hlist_head	vlan_hash[MACVLAN_HASH_SIZE];
 	struct list_head	vlans;
 	struct rcu_head		rcu;
-	struct sk_buff_head	bc_queue;
-	struct work_struct	bc_work;
+	struct macvlan_bc_queue __percpu *bc_queues;
 	bool 			passthru;
 	int			count;
 	struct hlist_head	vlan_source_hash[MACVLAN_HASH_SIZE];
@@ -267,16 +276,17 @@ static void macvlan_broadcast(struct sk_buff *skb,
 
 static void macvlan_process_broadcast(struct work_struct *w)
 {
-	struct macvlan_port *port = container_of(w, struct macvlan_port,
-						 bc_work);
+	struct macvlan_bc_queue *bcq = container_of(w, struct macvlan_bc_queue,
+						    work);
+	struct macvlan_port *port = bcq->port;
 	struct sk_buff *skb;
 	struct sk_buff_head list;
 
 	__skb_queue_head_init(&list);
 
-	spin_lock_bh(&port->bc_queue.lock);
-	skb_queue_splice_tail_init(&port->bc_queue, &list);
-	spin_unlock_bh(&port->bc_queue.lock);
+	spin_lock_bh(&bcq->queue.lock);
+	skb_queue_splice_tail_init(&bcq->queue, &list);
+	spin_unlock_bh(&bcq->queue.lock);
 
 	while ((skb = __skb_dequeue(&list))) {
 		const struct macvlan_dev *src = MACVLAN_SKB_CB(skb)->src;
@@ -306,12 +316,14 @@ static void macvlan_process_broadcast(struct work_struct *w)
 		rcu_read_unlock();
 
 		kfree_skb(skb);
+		cond_resched();
 	}
 }
 
 static void macvlan_broadcast_enqueue(struct macvlan_port *port,
 				      struct sk_buff *skb)
 {
+	struct macvlan_bc_queue *bcq = this_cpu_ptr(port->bc_queues);
 	struct sk_buff *nskb;
 	int err = -ENOMEM;
 
@@ -319,17 +331,17 @@ static void macvlan_broadcast_enqueue(struct macvlan_port *port,
 	if (!nskb)
 		goto err;
 
-	spin_lock(&port->bc_queue.lock);
-	if (skb_queue_len(&port->bc_queue) < MACVLAN_BC_QUEUE_LEN) {
-		__skb_queue_tail(&port->bc_queue, nskb);
+	spin_lock(&bcq->queue.lock);
+	if (skb_queue_len(&bcq->queue) < MACVLAN_BC_QUEUE_LEN) {
+		__skb_queue_tail(&bcq->queue, nskb);
 		err = 0;
 	}
-	spin_unlock(&port->bc_queue.lock);
+	spin_unlock(&bcq->queue.lock);
 
 	if (err)
 		goto free_nskb;
 
-	schedule_work(&port->bc_work);
+	schedule_work_on(smp_processor_id(), &bcq->work);
 	return;
 
 free_nskb:
@@ -1077,6 +1089,7 @@ static int macvlan_port_create(struct net_device *dev)
 	struct macvlan_port *port;
 	unsigned int i;
 	int err;
+	int cpu;
 
 	if (dev->type != ARPHRD_ETHER || dev->flags & IFF_LOOPBACK)
 		return -EINVAL;
@@ -1096,20 +1109,33 @@ static int macvlan_port_create(struct net_device *dev)
 	for (i = 0; i < MACVLAN_HASH_SIZE; i++)
 		INIT_HLIST_HEAD(&port->vlan_source_hash[i]);
 
-	skb_queue_head_init(&port->bc_queue);
-	INIT_WORK(&port->bc_work, macvlan_process_broadcast);
+	port->bc_queues = alloc_percpu(struct macvlan_bc_queue);
+	if (!port->bc_queues) {
+		kfree(port);
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu) {
+		struct macvlan_bc_queue *bcq = per_cpu_ptr(port->bc_queues, cpu);
+
+		skb_queue_head_init(&bcq->queue);
+		INIT_WORK(&bcq->work, macvlan_process_broadcast);
+		bcq->port = port;
+	}
 
 	err = netdev_rx_handler_register(dev, macvlan_handle_frame, port);
-	if (err)
+	if (err) {
+		free_percpu(port->bc_queues);
 		kfree(port);
-	else
+	} else {
 		dev->priv_flags |= IFF_MACVLAN_PORT;
+	}
 	return err;
 }
 
 static void macvlan_port_destroy(struct net_device *dev)
 {
 	struct macvlan_port *port = macvlan_port_get_rtnl(dev);
+	int cpu;
 
 	dev->priv_flags &= ~IFF_MACVLAN_PORT;
 	netdev_rx_handler_unregister(dev);
@@ -1117,8 +1143,13 @@ static void macvlan_port_destroy(struct net_device *dev)
 	/* After this point, no packet can schedule bc_work anymore,
 	 * but we need to cancel it and purge left skbs if any.
 	 */
-	cancel_work_sync(&port->bc_work);
-	__skb_queue_purge(&port->bc_queue);
+	for_each_possible_cpu(cpu) {
+		struct macvlan_bc_queue *bcq = per_cpu_ptr(port->bc_queues, cpu);
+
+		cancel_work_sync(&bcq->work);
+		__skb_queue_purge(&bcq->queue);
+	}
+	free_percpu(port->bc_queues);
 
 	kfree_rcu(port, rcu);
 }
@@ -1268,6 +1299,16 @@ int macvlan_common_newlink(struct net *src_net, struct net_device *dev,
 	else if (dev->mtu > lowerdev->mtu)
 		return -EINVAL;
 
+	/* No more queues than the lower device has, so that the queue picked
+	 * here and cached in the socket is also a valid one down there.
+	 */
+	netif_set_real_num_tx_queues(dev, min(dev->num_tx_queues,
+					      lowerdev->real_num_tx_queues));
+#ifdef CONFIG_SYSFS
+	netif_set_real_num_rx_queues(dev, min(dev->num_rx_queues,
+					      lowerdev->real_num_rx_queues));
+#endif
+
 	if (!tb[IFLA_ADDRESS])
 		eth_hw_addr_random(dev);
 
@@ -1500,12 +1541,20 @@ static struct net *macvlan_get_link_net(const struct net_device *dev)
 	return dev_net(macvlan_dev_real_dev(dev));
 }
 
+/* The lower device is not known yet; newlink trims to what it has */
+static unsigned int macvlan_get_num_queues(void)
+{
+	return netif_get_num_default_rss_queues();
+}
+
 static struct rtnl_link_ops macvlan_link_ops = {
-	.kind		= "macvlan",
-	.setup		= macvlan_setup,
-	.newlink	= macvlan_newlink,
-	.dellink	= macvlan_dellink,
-	.get_link_net	= macvlan_get_link_net,
+	.kind			= "macvlan",
+	.setup			= macvlan_setup,
+	.newlink		= macvlan_newlink,
+	.dellink		= macvlan_dellink,
+	.get_link_net		= macvlan_get_link_net,
+	.get_num_tx_queues	= macvlan_get_num_queues,
+	.get_num_rx_queues	= macvlan_get_num_queues,
 };
 
 static int macvlan_device_event(struct notifier_block *unused,
@@ -204,6 +204,7 @@ struct tun_struct {
 	struct list_head disabled;
 	void *security;
 	u32 flow_count;
+	u32 rx_batched;
 };
 
 #ifdef CONFIG_TUN_VNET_CROSS_LE
@@ -502,6 +503,7 @@ static struct tun_struct *tun_enable_queue(struct tun_file *tfile)
 
 static void tun_queue_purge(struct tun_file *tfile)
 {
+	skb_queue_purge(&tfile->sk.sk_write_queue);
 	skb_queue_purge(&tfile->sk.sk_receive_queue);
 	skb_queue_purge(&tfile->sk.sk_error_queue);
 }
@@ -1080,10 +1082,100 @@ static struct sk_buff *tun_alloc_skb(struct tun_file *tfile,
 	return skb;
 }
 
+/*
+ * Small frames written from userspace are copied into a page fragment of
+ * the writer's task_frag and wrapped with build_skb() instead of getting a
+ * freshly allocated linear skb.  Such skbs are not charged to the socket,
+ * so this is only done while its sndbuf is unlimited (the default).
+ */
+static bool tun_can_build_skb(struct tun_file *tfile, void *msg_control,
+			      size_t pad, size_t len)
+{
+	if (msg_control)
+		return false;
+	if (tfile->socket.sk->sk_sndbuf != INT_MAX)
+		return false;
+	return SKB_DATA_ALIGN(pad + len) +
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) <= PAGE_SIZE;
+}
+
+static struct sk_buff *tun_build_skb(struct iov_iter *from, size_t pad,
+				     size_t len)
+{
+	struct page_frag *alloc_frag = &current->task_frag;
+	unsigned int buflen = SKB_DATA_ALIGN(pad + len) +
+			      SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	struct sk_buff *skb;
+	char *buf;
+
+	if (unlikely(!skb_page_frag_refill(buflen, alloc_frag, GFP_KERNEL)))
+		return ERR_PTR(-ENOMEM);
+
+	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
+	if (copy_from_iter(buf + pad, len, from) != len)
+		return ERR_PTR(-EFAULT);
+
+	skb = build_skb(buf, buflen);
+	if (unlikely(!skb))
+		return ERR_PTR(-ENOMEM);
+
+	skb_reserve(skb, pad);
+	skb_put(skb, len);
+
+	get_page(alloc_frag->page);
+	alloc_frag->offset += buflen;
+
+	return skb;
+}
+
+/* The largest batch of sent frames handed to the stack in one go */
+#define TUN_RX_BATCH_MAX	64
+
+/*
+ * Hand a frame written by userspace to the stack.  While the writer says
+ * more are coming (vhost-net sets MSG_MORE), frames are parked on the
+ * socket's otherwise unused write queue and passed up together once the
+ * last one arrives or the batch is full, so that the stack is entered
+ * with bottom halves disabled once per batch instead of once per frame.
+ */
+static void tun_rx_batched(struct tun_struct *tun, struct tun_file *tfile,
+			   struct sk_buff *skb, bool more)
+{
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	u32 rx_batched = READ_ONCE(tun->rx_batched);
+	bool rcv = false;
+
+	if (!rx_batched || (!more && skb_queue_empty(queue))) {
+		netif_rx_ni(skb);
+		return;
+	}
+
+	spin_lock(&queue->lock);
+	if (!more || skb_queue_len(queue) >= rx_batched) {
+		__skb_queue_head_init(&process_queue);
+		skb_queue_splice_tail_init(queue, &process_queue);
+		rcv = true;
+	} else {
+		__skb_queue_tail(queue, skb);
+	}
+	spin_unlock(&queue->lock);
+
+	if (rcv) {
+		struct sk_buff *nskb;
+
+		local_bh_disable();
+		while ((nskb = __skb_dequeue(&process_queue)))
+			netif_receive_skb(nskb);
+		netif_receive_skb(skb);
+		local_bh_enable();
+	}
+}
+
 /* Get packet from user space buffer */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, struct iov_iter *from,
-			    int noblock)
+			    int noblock, bool more)
 {
 	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
 	struct sk_buff *skb;
@@ -1158,27 +1250,35 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			linear = tun16_to_cpu(tun, gso.hdr_len);
 	}
 
-	skb = tun_alloc_skb(tfile, align, copylen, linear, noblock);
-	if (IS_ERR(skb)) {
-		if (PTR_ERR(skb) != -EAGAIN)
+	if (tun_can_build_skb(tfile, msg_control, align, len)) {
+		skb = tun_build_skb(from, align, len);
+		if (IS_ERR(skb)) {
 			tun->dev->stats.rx_dropped++;
-		return PTR_ERR(skb);
-	}
+			return PTR_ERR(skb);
+		}
+	} else {
+		skb = tun_alloc_skb(tfile, align, copylen, linear, noblock);
+		if (IS_ERR(skb)) {
+			if (PTR_ERR(skb) != -EAGAIN)
+				tun->dev->stats.rx_dropped++;
+			return PTR_ERR(skb);
+		}
 
-	if (zerocopy)
-		err = zerocopy_sg_from_iter(skb, from);
-	else {
-		err = skb_copy_datagram_from_iter(skb, 0, from, len);
-		if (!err && msg_control) {
-			struct ubuf_info *uarg = msg_control;
-			uarg->callback(uarg, false);
+		if (zerocopy)
+			err = zerocopy_sg_from_iter(skb, from);
+		else {
+			err = skb_copy_datagram_from_iter(skb, 0, from, len);
+			if (!err && msg_control) {
+				struct ubuf_info *uarg = msg_control;
+				uarg->callback(uarg, false);
+			}
 		}
-	}
 
-	if (err) {
-		tun->dev->stats.rx_dropped++;
-		kfree_skb(skb);
-		return -EFAULT;
+		if (err) {
+			tun->dev->stats.rx_dropped++;
+			kfree_skb(skb);
+			return -EFAULT;
+		}
 	}
 
 	if (gso.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
@@ -1260,7 +1360,7 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	skb_probe_transport_header(skb, 0);
 
 	rxhash = skb_get_hash(skb);
-	netif_rx_ni(skb);
+	tun_rx_batched(tun, tfile, skb, more);
 
 	tun->dev->stats.rx_packets++;
 	tun->dev->stats.rx_bytes += len;
@@ -1279,7 +1379,8 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from, file->f_flags & O_NONBLOCK);
+	result = tun_get_user(tun, tfile, NULL, from,
+			      file->f_flags & O_NONBLOCK, false);
 
 	tun_put(tun);
 	return result;
@@ -1398,24 +1499,33 @@ done:
 	return total;
 }
 
+/*
+ * Copy a frame to @to.  If @skb is NULL the frame is taken off the queue,
+ * otherwise it is one the caller already dequeued (vhost-net takes them off
+ * in batches) and is consumed here in any case.
+ */
 static ssize_t tun_do_read(struct tun_struct *tun, struct tun_file *tfile,
 			   struct iov_iter *to,
-			   int noblock)
+			   int noblock, struct sk_buff *skb)
 {
-	struct sk_buff *skb;
 	ssize_t ret;
 	int peeked, err, off = 0;
 
 	tun_debug(KERN_INFO, tun, "tun_do_read\n");
 
-	if (!iov_iter_count(to))
+	if (!iov_iter_count(to)) {
+		kfree_skb(skb);
 		return 0;
+	}
 
-	/* Read frames from queue */
-	skb = __skb_recv_datagram(tfile->socket.sk, noblock ? MSG_DONTWAIT : 0,
-				  &peeked, &off, &err);
-	if (!skb)
-		return err;
+	if (!skb) {
+		/* Read frames from queue */
+		skb = __skb_recv_datagram(tfile->socket.sk,
+					  noblock ? MSG_DONTWAIT : 0,
+					  &peeked, &off, &err);
+		if (!skb)
+			return err;
+	}
 
 	ret = tun_put_user(tun, tfile, skb, to);
 	if (unlikely(ret < 0))
@@ -1435,7 +1545,7 @@ static ssize_t tun_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
 
 	if (!tun)
 		return -EBADFD;
-	ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK);
+	ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK, NULL);
 	ret = min_t(ssize_t, ret, len);
 	if (ret > 0)
 		iocb->ki_pos = ret;
@@ -1443,6 +1553,102 @@ static ssize_t tun_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
 	return ret;
 }
 
+/* The most packets one TUNSENDMMSG/TUNRECVMMSG call processes */
+#define TUN_MMSG_MAX	UIO_MAXIOV
+
+/* Hand frames still parked by tun_rx_batched() to the stack */
+static void tun_rx_flush(struct tun_file *tfile)
+{
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&process_queue);
+
+	spin_lock(&queue->lock);
+	skb_queue_splice_tail_init(queue, &process_queue);
+	spin_unlock(&queue->lock);
+
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&process_queue)))
+		netif_receive_skb(skb);
+	local_bh_enable();
+}
+
+/*
+ * TUNSENDMMSG/TUNRECVMMSG: several packets per system call.  Written
+ * packets are handed to the stack as one tun_rx_batched() batch; reads
+ * stop at the first packet that is not there yet.
+ */
+static long tun_chr_mmsg(struct file *file, unsigned int cmd,
+			 void __user *argp)
+{
+	struct tun_file *tfile = file->private_data;
+	int noblock = file->f_flags & O_NONBLOCK;
+	struct tun_msg __user *umsgs;
+	struct tun_struct *tun;
+	struct tun_mmsg mmsg;
+	struct iov_iter iter;
+	struct iovec iov;
+	ssize_t ret = 0;
+	u32 i;
+
+	if (copy_from_user(&mmsg, argp, sizeof(mmsg)))
+		return -EFAULT;
+	if (mmsg.flags)
+		return -EINVAL;
+	mmsg.vlen = min_t(u32, mmsg.vlen, TUN_MMSG_MAX);
+	umsgs = (struct tun_msg __user *)(unsigned long)mmsg.msgs;
+
+	tun = tun_get(file);
+	if (!tun)
+		return -EBADFD;
+
+	for (i = 0; i < mmsg.vlen; i++) {
+		struct tun_msg msg;
+		void __user *buf;
+
+		if (copy_from_user(&msg, &umsgs[i], sizeof(msg))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (msg.flags) {
+			ret = -EINVAL;
+			break;
+		}
+		buf = (void __user *)(unsigned long)msg.buf;
+
+		if (cmd == TUNSENDMMSG) {
+			ret = import_single_range(WRITE, buf, msg.len, &iov,
+						  &iter);
+			if (!ret)
+				ret = tun_get_user(tun, tfile, NULL, &iter,
+						   noblock, i + 1 < mmsg.vlen);
+		} else {
+			ret = import_single_range(READ, buf, msg.len, &iov,
+						  &iter);
+			if (!ret)
+				ret = tun_do_read(tun, tfile, &iter,
+						  noblock || i, NULL);
+			ret = min_t(ssize_t, ret, msg.len);
+		}
+		if (ret < 0)
+			break;
+
+		if (put_user((u32)ret, &umsgs[i].len)) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	/* a failed packet must not strand the batch queued before it */
+	if (cmd == TUNSENDMMSG && i < mmsg.vlen)
+		tun_rx_flush(tfile);
+
+	tun_put(tun);
+	return i ? i : ret;
+}
+
 static void tun_free_netdev(struct net_device *dev)
 {
 	struct tun_struct *tun = netdev_priv(dev);
@@ -1511,7 +1717,8 @@ static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 		return -EBADFD;
 
 	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
-			   m->msg_flags & MSG_DONTWAIT);
+			   m->msg_flags & MSG_DONTWAIT,
+			   m->msg_flags & MSG_MORE);
 	tun_put(tun);
 	return ret;
 }
@@ -1521,21 +1728,25 @@ static int tun_recvmsg(struct socket *sock, struct msghdr *m, size_t total_len,
 {
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	/* A frame the caller already took off the receive queue */
+	struct sk_buff *skb = m->msg_control;
 	int ret;
 
-	if (!tun)
-		return -EBADFD;
+	if (!tun) {
+		ret = -EBADFD;
+		goto out_free;
+	}
 
 	if (flags & ~(MSG_DONTWAIT|MSG_TRUNC|MSG_ERRQUEUE)) {
 		ret = -EINVAL;
-		goto out;
+		goto out_put;
 	}
 	if (flags & MSG_ERRQUEUE) {
 		ret = sock_recv_errqueue(sock->sk, m, total_len,
 					 SOL_PACKET, TUN_TX_TIMESTAMP);
-		goto out;
+		goto out_put;
 	}
-	ret = tun_do_read(tun, tfile, &m->msg_iter, flags & MSG_DONTWAIT);
+	ret = tun_do_read(tun, tfile, &m->msg_iter, flags & MSG_DONTWAIT, skb);
 	if (ret > (ssize_t)total_len) {
 		m->msg_flags |= MSG_TRUNC;
 		ret = flags & MSG_TRUNC ? ret : total_len;
@@ -1543,6 +1754,12 @@ static int tun_recvmsg(struct socket *sock, struct msghdr *m, size_t total_len,
 out:
 	tun_put(tun);
 	return ret;
+
+out_put:
+	tun_put(tun);
+out_free:
+	kfree_skb(skb);
+	return ret;
 }
 
 /* Ops structure to mimic raw sockets with tun */
@@ -1903,6 +2120,8 @@ static long __tun_chr_ioctl(struct file *file, unsigned int cmd,
 				(unsigned int __user*)argp);
 	} else if (cmd == TUNSETQUEUE)
 		return tun_set_queue(file, &ifr);
+	else if (cmd == TUNSENDMMSG || cmd == TUNRECVMMSG)
+		return tun_chr_mmsg(file, cmd, argp);
 
 	ret = 0;
 	rtnl_lock();
@@ -2169,6 +2388,8 @@ static long tun_chr_compat_ioctl(struct file *file,
 	case TUNSETTXFILTER:
 	case TUNGETSNDBUF:
 	case TUNSETSNDBUF:
+	case TUNSENDMMSG:
+	case TUNRECVMMSG:
 	case SIOCGIFHWADDR:
 	case SIOCSIFHWADDR:
 		arg = (unsigned long)compat_ptr(arg);
@@ -2347,6 +2568,29 @@ static void tun_set_msglevel(struct net_device *dev, u32 value)
 #endif
 }
 
+static int tun_get_coalesce(struct net_device *dev,
+			    struct ethtool_coalesce *ec)
+{
+	struct tun_struct *tun = netdev_priv(dev);
+
+	ec->rx_max_coalesced_frames = tun->rx_batched;
+
+	return 0;
+}
+
+static int tun_set_coalesce(struct net_device *dev,
+			    struct ethtool_coalesce *ec)
+{
+	struct tun_struct *tun = netdev_priv(dev);
+
+	if (ec->rx_max_coalesced_frames > TUN_RX_BATCH_MAX)
+		tun->rx_batched = TUN_RX_BATCH_MAX;
+	else
+		tun->rx_batched = ec->rx_max_coalesced_frames;
+
+	return 0;
+}
+
 static const struct ethtool_ops tun_ethtool_ops = {
 	.get_settings	= tun_get_settings,
 	.get_drvinfo	= tun_get_drvinfo,
@@ -2354,6 +2598,8 @@ static const struct ethtool_ops tun_ethtool_ops = {
 	.set_msglevel	= tun_set_msglevel,
 	.get_link	= ethtool_op_get_link,
 	.get_ts_info	= ethtool_op_get_ts_info,
+	.get_coalesce	= tun_get_coalesce,
+	.set_coalesce	= tun_set_coalesce,
 };
 
 
@@ -67,6 +67,7 @@ struct nvme_dev {
 	dma_addr_t cmb_dma_addr;
 	u64 cmb_size;
 	u32 cmbsz;
+	u32 sgls;
 	u16 oncs;
 	u16 abort_limit;
 	u8 event_limit;
@@ -106,6 +107,7 @@ struct nvme_iod {
 	int offset;		/* Of PRP list */
 	int nents;		/* Used in scatterlist */
 	int length;		/* Of data, in bytes */
+	bool use_sgl;		/* Data described by SGL segments, not PRPs */
 	dma_addr_t first_dma;
 	struct scatterlist meta_sg[1]; /* metadata requires single contiguous buffer */
 	struct scatterlist sg[0];
@@ -36,6 +36,7 @@
 #include <linux/poison.h>
 #include <linux/ptrace.h>
 #include <linux/sched.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/t10-pi.h>
 #include <linux/types.h>
@@ -80,6 +81,12 @@ static bool use_cmb_sqes = true;
 module_param(use_cmb_sqes, bool, 0644);
 MODULE_PARM_DESC(use_cmb_sqes, "use controller's memory buffer for I/O SQes");
 
+static unsigned int sgl_threshold = SZ_32K;
+module_param(sgl_threshold, uint, 0644);
+MODULE_PARM_DESC(sgl_threshold,
+		"use SGLs when average request segment size is larger or equal to "
+		"this size. Use 0 to disable SGLs.");
+
 static DEFINE_SPINLOCK(dev_list_lock);
 static LIST_HEAD(dev_list);
 static struct task_struct *nvme_thread;
@@ -122,6 +129,7 @@ struct nvme_queue {
 	s16 cq_vector;
 	u16 sq_head;
 	u16 sq_tail;
+	u16 last_sq_tail;
 	u16 cq_head;
 	u16 qid;
 	u8 cq_phase;
@@ -177,12 +185,34 @@ static int nvme_npages(unsigned size, struct nvme_dev *dev)
 	return DIV_ROUND_UP(8 * nprps, PAGE_SIZE - 8);
 }
 
+#define SGES_PER_PAGE	(PAGE_SIZE / sizeof(struct nvme_sgl_desc))
+
+/*
+ * Same as nvme_npages(), but for an SGL segment list describing @nseg
+ * segments: the last descriptor of each page chains to the next one.
+ */
+static int nvme_npages_sgl(unsigned nseg)
+{
+	return DIV_ROUND_UP(nseg * sizeof(struct nvme_sgl_desc),
+			PAGE_SIZE - sizeof(struct nvme_sgl_desc));
+}
+
+/*
+ * We don't know yet whether the I/O will be mapped with PRPs or SGLs,
+ * so size the list array for whichever needs more pages.
+ */
+static int nvme_iod_npages(unsigned size, unsigned nseg, struct nvme_dev *dev)
+{
+	return max(nvme_npages(size, dev), nvme_npages_sgl(nseg));
+}
+
 static unsigned int nvme_cmd_size(struct nvme_dev *dev)
 {
 	unsigned int ret = sizeof(struct nvme_cmd_info);
 
 	ret += sizeof(struct nvme_iod);
-	ret += sizeof(__le64 *) * nvme_npages(NVME_INT_BYTES(dev), dev);
+	ret += sizeof(__le64 *) *
+		nvme_iod_npages(NVME_INT_BYTES(dev), NVME_INT_PAGES, dev);
 	ret += sizeof(struct scatterlist) * NVME_INT_PAGES;
 
 	return ret;
@@ -237,6 +267,19 @@ static int nvme_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 	return 0;
 }
 
+static int nvme_queue_irq(struct blk_mq_tag_set *set, unsigned int hctx_idx)
+{
+	struct nvme_dev *dev = set->driver_data;
+	struct nvme_queue *nvmeq;
+
+	if (hctx_idx + 1 >= dev->queue_count)
+		return -1;
+	nvmeq = dev->queues[hctx_idx + 1];
+	if (!nvmeq || nvmeq->cq_vector < 0)
+		return -1;
+	return dev->entry[nvmeq->cq_vector].vector;
+}
+
 static int nvme_init_request(void *data, struct request *req,
 				unsigned int hctx_idx, unsigned int rq_idx,
 				unsigned int numa_node)
@@ -382,14 +425,23 @@ static void *nvme_finish_cmd(struct nvme_queue *nvmeq, int tag,
 	return ctx;
 }
 
-/**
- * nvme_submit_cmd() - Copy a command into a queue and ring the doorbell
- * @nvmeq: The queue to use
- * @cmd: The command to send
- *
- * Safe to use from interrupt context
+/*
+ * Write the SQ tail doorbell, unless nothing was queued since it was last
+ * written. Called with q_lock held.
  */
-static void __nvme_submit_cmd(struct nvme_queue *nvmeq,
+static inline void nvme_write_sq_db(struct nvme_queue *nvmeq)
+{
+	if (nvmeq->sq_tail == nvmeq->last_sq_tail)
+		return;
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+	nvmeq->last_sq_tail = nvmeq->sq_tail;
+}
+
+/*
+ * Copy a command into the submission queue without ringing the doorbell;
+ * the caller must call nvme_write_sq_db() once it is done queueing.
+ */
+static void __nvme_queue_cmd(struct nvme_queue *nvmeq,
 						struct nvme_command *cmd)
 {
 	u16 tail = nvmeq->sq_tail;
@@ -401,10 +453,23 @@ static void __nvme_submit_cmd(struct nvme_queue *nvmeq,
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
 }
 
+/**
+ * nvme_submit_cmd() - Copy a command into a queue and ring the doorbell
+ * @nvmeq: The queue to use
+ * @cmd: The command to send
+ *
+ * Safe to use from interrupt context
+ */
+static void __nvme_submit_cmd(struct nvme_queue *nvmeq,
+						struct nvme_command *cmd)
+{
+	__nvme_queue_cmd(nvmeq, cmd);
+	nvme_write_sq_db(nvmeq);
+}
+
 static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 {
 	unsigned long flags;
@@ -426,6 +491,7 @@ static inline void iod_init(struct nvme_iod *iod, unsigned nbytes,
 	iod->npages = -1;
 	iod->length = nbytes;
 	iod->nents = 0;
+	iod->use_sgl = false;
 }
 
 static struct nvme_iod *
@@ -433,7 +499,7 @@ __nvme_alloc_iod(unsigned nseg, unsigned bytes, struct nvme_dev *dev,
 		 unsigned long priv, gfp_t gfp)
 {
 	struct nvme_iod *iod = kmalloc(sizeof(struct nvme_iod) +
-				sizeof(__le64 *) * nvme_npages(bytes, dev) +
+				sizeof(__le64 *) * nvme_iod_npages(bytes, nseg, dev) +
 				sizeof(struct scatterlist) * nseg, gfp);
 
 	if (iod)
@@ -474,7 +540,15 @@ static void nvme_free_iod(struct nvme_dev *dev, struct nvme_iod *iod)
 		dma_pool_free(dev->prp_small_pool, list[0], prp_dma);
 	for (i = 0; i < iod->npages; i++) {
 		__le64 *prp_list = list[i];
-		dma_addr_t next_prp_dma = le64_to_cpu(prp_list[last_prp]);
+		dma_addr_t next_prp_dma;
+
+		if (iod->use_sgl) {
+			struct nvme_sgl_desc *sg_list = (void *)prp_list;
+
+			next_prp_dma = le64_to_cpu(sg_list[SGES_PER_PAGE - 1].addr);
+		} else {
+			next_prp_dma = le64_to_cpu(prp_list[last_prp]);
+		}
 		dma_pool_free(dev->prp_page_pool, prp_list, prp_dma);
 		prp_dma = next_prp_dma;
 	}
@@ -727,6 +801,106 @@ static int nvme_setup_prps(struct nvme_dev *dev, struct nvme_iod *iod,
 	return total_len;
 }
 
+static void nvme_sgl_set_data(struct nvme_sgl_desc *sge,
+		struct scatterlist *sg)
+{
+	sge->addr = cpu_to_le64(sg_dma_address(sg));
+	sge->length = cpu_to_le32(sg_dma_len(sg));
+	sge->type = NVME_SGL_FMT_DATA_DESC << 4;
+}
+
+/*
+ * Point @sge at a segment list holding the remaining @entries descriptors.
+ * A list that doesn't fit in one page ends with a link to the next page.
+ */
+static void nvme_sgl_set_seg(struct nvme_sgl_desc *sge, dma_addr_t dma_addr,
+		int entries)
+{
+	sge->addr = cpu_to_le64(dma_addr);
+	if (entries <= SGES_PER_PAGE) {
+		sge->length = cpu_to_le32(entries * sizeof(*sge));
+		sge->type = NVME_SGL_FMT_LAST_SEG_DESC << 4;
+	} else {
+		sge->length = cpu_to_le32(PAGE_SIZE);
+		sge->type = NVME_SGL_FMT_SEG_DESC << 4;
+	}
+}
+
+/*
+ * Build the SGL segment list for an I/O.  Unlike PRPs, each descriptor
+ * covers a whole scatterlist element, so big physically contiguous
+ * segments cost one 16-byte entry instead of one 8-byte entry per page.
+ * A single segment is described directly in the command and needs no
+ * list at all.
+ */
+static bool nvme_setup_sgls(struct nvme_dev *dev, struct nvme_iod *iod,
+		gfp_t gfp)
+{
+	struct dma_pool *pool;
+	struct nvme_sgl_desc *sg_list;
+	struct scatterlist *sg = iod->sg;
+	void **list = (void **)iod_list(iod);
+	int entries = iod->nents, i = 0;
+	dma_addr_t sgl_dma;
+
+	iod->use_sgl = true;
+	if (entries == 1)
+		return true;
+
+	if (entries <= (256 / sizeof(struct nvme_sgl_desc))) {
+		pool = dev->prp_small_pool;
+		iod->npages = 0;
+	} else {
+		pool = dev->prp_page_pool;
+		iod->npages = 1;
+	}
+
+	sg_list = dma_pool_alloc(pool, gfp, &sgl_dma);
+	if (!sg_list) {
+		iod->npages = -1;
+		return false;
+	}
+	list[0] = sg_list;
+	iod->first_dma = sgl_dma;
+
+	do {
+		if (i == SGES_PER_PAGE) {
+			struct nvme_sgl_desc *link = &sg_list[i - 1];
+
+			sg_list = dma_pool_alloc(pool, gfp, &sgl_dma);
+			if (!sg_list)
+				return false;
+			list[iod->npages++] = sg_list;
+			sg_list[0] = *link;
+			nvme_sgl_set_seg(link, sgl_dma, entries + 1);
+			i = 1;
+		}
+		nvme_sgl_set_data(&sg_list[i++], sg);
+		sg = sg_next(sg);
+	} while (--entries > 0);
+
+	return true;
+}
+
+/*
+ * SGLs are only used for I/O queue read/write commands, and only when the
+ * average segment is big enough that PRPs would need a list anyway.
+ * Admin commands over PCIe must use PRPs.
+ */
+static bool nvme_queue_sgls(struct nvme_queue *nvmeq)
+{
+	return nvmeq->qid && sgl_threshold &&
+		(nvmeq->dev->sgls & NVME_CTRL_SGLS_SUPPORTED);
+}
+
+static bool nvme_use_sgls(struct nvme_queue *nvmeq, struct request *req,
+		int nents)
+{
+	if (!nvme_queue_sgls(nvmeq) || req->cmd_type != REQ_TYPE_FS)
+		return false;
+	return DIV_ROUND_UP(blk_rq_bytes(req), nents) >= sgl_threshold;
+}
+
 static void nvme_submit_priv(struct nvme_queue *nvmeq, struct request *req,
 		struct nvme_iod *iod)
 {
@@ -739,7 +913,7 @@ static void nvme_submit_priv(struct nvme_queue *nvmeq, struct request *req,
 		cmnd.rw.prp2 = cpu_to_le64(iod->first_dma);
 	}
 
-	__nvme_submit_cmd(nvmeq, &cmnd);
+	__nvme_queue_cmd(nvmeq, &cmnd);
 }
 
 /*
@@ -766,7 +940,7 @@ static void nvme_submit_discard(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 	cmnd.dsm.nr = 0;
 	cmnd.dsm.attributes = cpu_to_le32(NVME_DSMGMT_AD);
 
-	__nvme_submit_cmd(nvmeq, &cmnd);
+	__nvme_queue_cmd(nvmeq, &cmnd);
 }
 
 static void nvme_submit_flush(struct nvme_queue *nvmeq, struct nvme_ns *ns,
@@ -779,7 +953,7 @@ static void nvme_submit_flush(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 	cmnd.common.command_id = cmdid;
 	cmnd.common.nsid = cpu_to_le32(ns->ns_id);
 
-	__nvme_submit_cmd(nvmeq, &cmnd);
+	__nvme_queue_cmd(nvmeq, &cmnd);
 }
 
 static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod,
@@ -802,8 +976,17 @@ static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod,
 	cmnd.rw.opcode = (rq_data_dir(req) ? nvme_cmd_write : nvme_cmd_read);
 	cmnd.rw.command_id = req->tag;
 	cmnd.rw.nsid = cpu_to_le32(ns->ns_id);
-	cmnd.rw.prp1 = cpu_to_le64(sg_dma_address(iod->sg));
-	cmnd.rw.prp2 = cpu_to_le64(iod->first_dma);
+	if (iod->use_sgl) {
+		cmnd.rw.flags = NVME_CMD_SGL_METABUF;
+		if (iod->nents == 1)
+			nvme_sgl_set_data(&cmnd.rw.sgl, iod->sg);
+		else
+			nvme_sgl_set_seg(&cmnd.rw.sgl, iod->first_dma,
+					iod->nents);
+	} else {
+		cmnd.rw.prp1 = cpu_to_le64(sg_dma_address(iod->sg));
+		cmnd.rw.prp2 = cpu_to_le64(iod->first_dma);
+	}
 	cmnd.rw.slba = cpu_to_le64(nvme_block_nr(ns, blk_rq_pos(req)));
 	cmnd.rw.length = cpu_to_le16((blk_rq_bytes(req) >> ns->lba_shift) - 1);
 
@@ -830,11 +1013,20 @@ static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod,
 	cmnd.rw.control = cpu_to_le16(control);
 	cmnd.rw.dsmgmt = cpu_to_le32(dsmgmt);
 
-	__nvme_submit_cmd(nvmeq, &cmnd);
+	__nvme_queue_cmd(nvmeq, &cmnd);
 
 	return 0;
 }
 
+static void nvme_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	struct nvme_queue *nvmeq = hctx->driver_data;
+
+	spin_lock_irq(&nvmeq->q_lock);
+	nvme_write_sq_db(nvmeq);
+	spin_unlock_irq(&nvmeq->q_lock);
+}
+
 /*
  * NOTE: ns is NULL when called on the admin queue.
  */
@@ -858,6 +1050,8 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 		if (!(ns->pi_type && ns->ms == 8) &&
 					req->cmd_type != REQ_TYPE_DRV_PRIV) {
 			blk_mq_complete_request(req, -EFAULT);
+			if (bd->last)
+				nvme_commit_rqs(hctx);
 			return BLK_MQ_RQ_QUEUE_OK;
 		}
 	}
@@ -890,7 +1084,13 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 		if (!dma_map_sg(nvmeq->q_dmadev, iod->sg, iod->nents, dma_dir))
 			goto retry_cmd;
 
-		if (blk_rq_bytes(req) !=
+		if (nvme_use_sgls(nvmeq, req, iod->nents)) {
+			if (!nvme_setup_sgls(dev, iod, GFP_ATOMIC)) {
+				dma_unmap_sg(dev->dev, iod->sg, iod->nents,
+						dma_dir);
+				goto retry_cmd;
+			}
+		} else if (blk_rq_bytes(req) !=
                     nvme_setup_prps(dev, iod, blk_rq_bytes(req), GFP_ATOMIC)) {
 			dma_unmap_sg(dev->dev, iod->sg, iod->nents, dma_dir);
 			goto retry_cmd;
@@ -932,6 +1132,12 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	else
 		nvme_submit_iod(nvmeq, iod, ns);
 
+	/*
+	 * blk-mq tells us when this is the last request of a dispatch run,
+	 * so a plugged batch costs a single doorbell write.
+	 */
+	if (bd->last)
+		nvme_write_sq_db(nvmeq);
 	nvme_process_cq(nvmeq);
 	spin_unlock_irq(&nvmeq->q_lock);
 	return BLK_MQ_RQ_QUEUE_OK;
@@ -944,6 +1150,13 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_MQ_RQ_QUEUE_BUSY;
 }
 
+/* We read the CQE phase first to check if the rest of the entry is valid */
+static inline bool nvme_cqe_valid(struct nvme_queue *nvmeq, u16 head,
+		u16 phase)
+{
+	return (le16_to_cpu(nvmeq->cqes[head].status) & 1) == phase;
+}
+
 static void __nvme_process_cq(struct nvme_queue *nvmeq, unsigned int *tag)
 {
 	u16 head, phase;
@@ -951,12 +1164,11 @@ static void __nvme_process_cq(struct nvme_queue *nvmeq, unsigned int *tag)
 	head = nvmeq->cq_head;
 	phase = nvmeq->cq_phase;
 
-	for (;;) {
+	while (nvme_cqe_valid(nvmeq, head, phase)) {
 		void *ctx;
 		nvme_completion_fn fn;
 		struct nvme_completion cqe = nvmeq->cqes[head];
-		if ((le16_to_cpu(cqe.status) & 1) != phase)
-			break;
+
 		nvmeq->sq_head = le16_to_cpu(cqe.sq_head);
 		if (++head == nvmeq->q_depth) {
 			head = 0;
@@ -1005,8 +1217,8 @@ static irqreturn_t nvme_irq(int irq, void *data)
 static irqreturn_t nvme_irq_check(int irq, void *data)
 {
 	struct nvme_queue *nvmeq = data;
-	struct nvme_completion cqe = nvmeq->cqes[nvmeq->cq_head];
-	if ((le16_to_cpu(cqe.status) & 1) != nvmeq->cq_phase)
+
+	if (!nvme_cqe_valid(nvmeq, nvmeq->cq_head, nvmeq->cq_phase))
 		return IRQ_NONE;
 	return IRQ_WAKE_THREAD;
 }
@@ -1015,8 +1227,7 @@ static int nvme_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
 {
 	struct nvme_queue *nvmeq = hctx->driver_data;
 
-	if ((le16_to_cpu(nvmeq->cqes[nvmeq->cq_head].status) & 1) ==
-	    nvmeq->cq_phase) {
+	if (nvme_cqe_valid(nvmeq, nvmeq->cq_head, nvmeq->cq_phase)) {
 		spin_lock_irq(&nvmeq->q_lock);
 		__nvme_process_cq(nvmeq, &tag);
 		spin_unlock_irq(&nvmeq->q_lock);
@@ -1567,6 +1778,7 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 
 	spin_lock_irq(&nvmeq->q_lock);
 	nvmeq->sq_tail = 0;
+	nvmeq->last_sq_tail = 0;
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
@@ -1676,6 +1888,7 @@ static int nvme_shutdown_ctrl(struct nvme_dev *dev)
 
 static struct blk_mq_ops nvme_mq_admin_ops = {
 	.queue_rq	= nvme_queue_rq,
+	.commit_rqs	= nvme_commit_rqs,
 	.map_queue	= blk_mq_map_queue,
 	.init_hctx	= nvme_admin_init_hctx,
 	.exit_hctx      = nvme_admin_exit_hctx,
@@ -1685,7 +1898,9 @@ static struct blk_mq_ops nvme_mq_admin_ops = {
 
 static struct blk_mq_ops nvme_mq_ops = {
 	.queue_rq	= nvme_queue_rq,
+	.commit_rqs	= nvme_commit_rqs,
 	.map_queue	= blk_mq_map_queue,
+	.queue_irq	= nvme_queue_irq,
 	.init_hctx	= nvme_init_hctx,
 	.init_request	= nvme_init_request,
 	.timeout	= nvme_timeout,
@@ -2633,6 +2848,7 @@ static int nvme_dev_add(struct nvme_dev *dev)
 	dev->oncs = le16_to_cpup(&ctrl->oncs);
 	dev->abort_limit = ctrl->acl + 1;
 	dev->vwc = ctrl->vwc;
+	dev->sgls = le32_to_cpu(ctrl->sgls);
 	memcpy(dev->serial, ctrl->sn, sizeof(ctrl->sn));
 	memcpy(dev->model, ctrl->mn, sizeof(ctrl->mn));
 	memcpy(dev->firmware_rev, ctrl->fr, sizeof(ctrl->fr));
@@ -3279,6 +3495,31 @@ static ssize_t nvme_sysfs_reset(struct device *dev,
 }
 static DEVICE_ATTR(reset_controller, S_IWUSR, NULL, nvme_sysfs_reset);
 
+/*
+ * One line per queue: where its submission queue entries live (controller
+ * memory buffer or host memory) and how read/write data gets described.
+ */
+static ssize_t nvme_sysfs_show_queues(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct nvme_dev *ndev = dev_get_drvdata(dev);
+	ssize_t len = 0;
+	unsigned i;
+
+	for (i = 0; i < ndev->queue_count; i++) {
+		struct nvme_queue *nvmeq = ndev->queues[i];
+
+		if (!nvmeq)
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%u sq=%s data=%s\n", nvmeq->qid,
+				nvmeq->sq_cmds_io ? "cmb" : "host",
+				nvme_queue_sgls(nvmeq) ? "sgl" : "prp");
+	}
+	return len;
+}
+static DEVICE_ATTR(queues, S_IRUGO, nvme_sysfs_show_queues, NULL);
+
 static int nvme_dev_map(struct nvme_dev *dev)
 {
 	int bars;
@@ -3352,6 +3593,9 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	result = device_create_file(dev->device, &dev_attr_reset_controller);
 	if (result)
 		goto put_dev;
+	result = device_create_file(dev->device, &dev_attr_queues);
+	if (result)
+		goto remove_reset;
 
 	INIT_LIST_HEAD(&dev->node);
 	INIT_WORK(&dev->scan_work, nvme_dev_scan);
@@ -3359,6 +3603,8 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	schedule_work(&dev->probe_work);
 	return 0;
 
+ remove_reset:
+	device_remove_file(dev->device, &dev_attr_reset_controller);
  put_dev:
 	device_destroy(nvme_class, MKDEV(nvme_char_major, dev->instance));
 	put_device(dev->device);
@@ -3404,6 +3650,7 @@ static void nvme_remove(struct pci_dev *pdev)
 	flush_work(&dev->probe_work);
 	flush_work(&dev->reset_work);
 	flush_work(&dev->scan_work);
+	device_remove_file(dev->device, &dev_attr_queues);
 	device_remove_file(dev->device, &dev_attr_reset_controller);
 	nvme_dev_remove(dev);
 	nvme_dev_shutdown(dev);
@@ -770,6 +770,7 @@ static void iscsit_unmap_iovec(struct iscsi_cmd *cmd)
 
 	for (i = 0; i < cmd->kmapped_nents; i++)
 		kunmap(sg_page(&sg[i]));
+	cmd->kmapped_nents = 0;
 }
 
 static void iscsit_ack_from_expstatsn(struct iscsi_conn *conn, u32 exp_statsn)
@@ -985,6 +986,14 @@ int iscsit_setup_scsi_cmd(struct iscsi_conn *conn, struct iscsi_cmd *cmd,
 			conn->sess->se_sess, be32_to_cpu(hdr->data_length),
 			cmd->data_direction, sam_task_attr,
 			cmd->sense_buffer + 2);
+	/*
+	 * Handle the command on the CPU this connection's RX/TX threads
+	 * are bound to, see iscsit_thread_get_cpumask().
+	 */
+	if (cpumask_weight(conn->conn_cpumask) == 1) {
+		cmd->se_cmd.cpuid = cpumask_first(conn->conn_cpumask);
+		cmd->se_cmd.se_cmd_flags |= SCF_USE_CPUID;
+	}
 
 	pr_debug("Got SCSI Command, ITT: 0x%08x, CmdSN: 0x%08x,"
 		" ExpXferLen: %u, Length: %u, CID: %hu\n", hdr->itt,
@@ -2634,7 +2643,7 @@ static int iscsit_send_datain(struct iscsi_cmd *cmd, struct iscsi_conn *conn)
 	struct iscsi_datain_req *dr;
 	struct kvec *iov;
 	u32 iov_count = 0, tx_size = 0;
-	int eodr = 0, ret, iov_ret;
+	int eodr = 0, ret;
 	bool set_statsn = false;
 
 	memset(&datain, 0, sizeof(struct iscsi_datain));
@@ -2694,12 +2703,13 @@ static int iscsit_send_datain(struct iscsi_cmd *cmd, struct iscsi_conn *conn)
 			" for DataIN PDU 0x%08x\n", *header_digest);
 	}
 
-	iov_ret = iscsit_map_iovec(cmd, &cmd->iov_data[1],
-				datain.offset, datain.length);
-	if (iov_ret < 0)
-		return -1;
-
-	iov_count += iov_ret;
+	/*
+	 * The payload goes out with ->sendpage() straight from the se_cmd
+	 * pages, and the data digest is computed over the scatterlist, so
+	 * there is no need to kmap() it into cmd->iov_data[].
+	 */
+	cmd->first_data_sg = &cmd->se_cmd.t_data_sg[datain.offset / PAGE_SIZE];
+	cmd->first_data_sg_off = datain.offset % PAGE_SIZE;
 	tx_size += datain.length;
 
 	cmd->padding = ((-datain.length) & 3);
@@ -2727,9 +2737,6 @@ static int iscsit_send_datain(struct iscsi_cmd *cmd, struct iscsi_conn *conn)
 	cmd->tx_size = tx_size;
 
 	ret = iscsit_fe_sendpage_sg(cmd, conn);
-
-	iscsit_unmap_iovec(cmd);
-
 	if (ret < 0) {
 		iscsit_tx_thread_wait_for_tcp(conn);
 		return ret;
@@ -3701,11 +3708,25 @@ static int iscsit_send_reject(
 void iscsit_thread_get_cpumask(struct iscsi_conn *conn)
 {
 	int ord, cpu;
+	/*
+	 * Follow the CPU the network stack delivers this connection's
+	 * segments on, as recorded by the login PDUs received over it, so
+	 * that the RX thread consumes them while they are cache hot and
+	 * each connection of a multi-connection session runs where RSS
+	 * steered it.
+	 */
+	if (conn->sock && conn->sock->sk) {
+		cpu = READ_ONCE(conn->sock->sk->sk_incoming_cpu);
+		if (cpu >= 0 && cpu < nr_cpu_ids && cpu_online(cpu)) {
+			cpumask_set_cpu(cpu, conn->conn_cpumask);
+			return;
+		}
+	}
 	/*
 	 * bitmap_id is assigned from iscsit_global->ts_bitmap from
 	 * within iscsit_start_kthreads()
 	 *
-	 * Here we use bitmap_id to determine which CPU that this
+	 * Otherwise use bitmap_id to determine which CPU that this
 	 * iSCSI connection's RX/TX threads will be scheduled to
 	 * execute upon.
 	 */
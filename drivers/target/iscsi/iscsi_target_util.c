@@ -55,6 +55,8 @@
 extern struct list_head g_tiqn_list;
 extern spinlock_t tiqn_lock;
 
+static int __tx_data(struct iscsi_conn *, struct kvec *, int, int, int);
+
 /*
  *	Called with cmd->r2t_lock held.
  */
@@ -1138,6 +1140,7 @@ int iscsit_fe_sendpage_sg(
 	struct kvec iov;
 	u32 tx_hdr_size, data_len;
 	u32 offset = cmd->first_data_sg_off;
+	bool trailer = cmd->padding || conn->conn_ops->DataDigest;
 	int tx_sent, iov_off;
 
 send_hdr:
@@ -1148,7 +1151,17 @@ send_hdr:
 	iov.iov_base = cmd->pdu;
 	iov.iov_len = tx_hdr_size;
 
-	tx_sent = tx_data(conn, &iov, 1, tx_hdr_size);
+	data_len = cmd->tx_size - tx_hdr_size - cmd->padding;
+	if (conn->conn_ops->DataDigest)
+		data_len -= ISCSI_CRC_LEN;
+
+	/*
+	 * Everything up to the last piece of the PDU is sent with MSG_MORE,
+	 * so that TCP builds full segments out of the header, the pages and
+	 * the trailer instead of pushing each of them on its own.
+	 */
+	tx_sent = __tx_data(conn, &iov, 1, tx_hdr_size,
+			    (data_len || trailer) ? MSG_MORE : 0);
 	if (tx_hdr_size != tx_sent) {
 		if (tx_sent == -EAGAIN) {
 			pr_err("tx_data() returned -EAGAIN\n");
@@ -1157,13 +1170,11 @@ send_hdr:
 		return -1;
 	}
 
-	data_len = cmd->tx_size - tx_hdr_size - cmd->padding;
 	/*
 	 * Set iov_off used by padding and data digest tx_data() calls below
 	 * in order to determine proper offset into cmd->iov_data[]
 	 */
 	if (conn->conn_ops->DataDigest) {
-		data_len -= ISCSI_CRC_LEN;
 		if (cmd->padding)
 			iov_off = (cmd->iov_data_count - 2);
 		else
@@ -1177,9 +1188,11 @@ send_hdr:
 	while (data_len) {
 		u32 space = (sg->length - offset);
 		u32 sub_len = min_t(u32, data_len, space);
+		int flags = (data_len > sub_len || trailer) ? MSG_MORE : 0;
 send_pg:
 		tx_sent = conn->sock->ops->sendpage(conn->sock,
-					sg_page(sg), sg->offset + offset, sub_len, 0);
+					sg_page(sg), sg->offset + offset, sub_len,
+					flags);
 		if (tx_sent != sub_len) {
 			if (tx_sent == -EAGAIN) {
 				pr_err("tcp_sendpage() returned"
@@ -1201,7 +1214,8 @@ send_padding:
 	if (cmd->padding) {
 		struct kvec *iov_p = &cmd->iov_data[iov_off++];
 
-		tx_sent = tx_data(conn, iov_p, 1, cmd->padding);
+		tx_sent = __tx_data(conn, iov_p, 1, cmd->padding,
+				    conn->conn_ops->DataDigest ? MSG_MORE : 0);
 		if (cmd->padding != tx_sent) {
 			if (tx_sent == -EAGAIN) {
 				pr_err("tx_data() returned -EAGAIN\n");
@@ -1316,6 +1330,7 @@ static int iscsit_do_tx_data(
 	}
 
 	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_flags = count->msg_flags;
 
 	iov_p = count->iov;
 	iov_len = count->iov_count;
@@ -1352,11 +1367,12 @@ int rx_data(
 	return iscsit_do_rx_data(conn, &c);
 }
 
-int tx_data(
+static int __tx_data(
 	struct iscsi_conn *conn,
 	struct kvec *iov,
 	int iov_count,
-	int data)
+	int data,
+	int msg_flags)
 {
 	struct iscsi_data_count c;
 
@@ -1368,10 +1384,20 @@ int tx_data(
 	c.iov_count = iov_count;
 	c.data_length = data;
 	c.type = ISCSI_TX_DATA;
+	c.msg_flags = msg_flags;
 
 	return iscsit_do_tx_data(conn, &c);
 }
 
+int tx_data(
+	struct iscsi_conn *conn,
+	struct kvec *iov,
+	int iov_count,
+	int data)
+{
+	return __tx_data(conn, iov, iov_count, data, 0);
+}
+
 static bool sockaddr_equal(struct sockaddr_storage *x, struct sockaddr_storage *y)
 {
 	switch (x->ss_family) {
@@ -162,10 +162,12 @@ static void tcm_loop_submission_work(struct work_struct *work)
 	}
 
 	se_cmd->tag = tl_cmd->sc_cmd_tag;
+	/* We run on the CPU the command was queued from, complete there */
+	se_cmd->cpuid = smp_processor_id();
 	rc = target_submit_cmd_map_sgls(se_cmd, tl_nexus->se_sess, sc->cmnd,
 			&tl_cmd->tl_sense_buf[0], tl_cmd->sc->device->lun,
 			transfer_length, TCM_SIMPLE_TAG,
-			sc->sc_data_direction, 0,
+			sc->sc_data_direction, TARGET_SCF_USE_CPUID,
 			scsi_sglist(sc), scsi_sg_count(sc),
 			sgl_bidi, sgl_bidi_count,
 			scsi_prot_sglist(sc), scsi_prot_sg_count(sc));
@@ -126,6 +126,11 @@ static int fd_configure_device(struct se_device *dev)
 	 * to write-out the entire device cache.
 	 */
 	if (fd_dev->fbd_flags & FDBD_HAS_BUFFERED_IO_WCE) {
+		if (fd_dev->fbd_flags & FDBD_HAS_ASYNC_IO) {
+			pr_err("FILEIO: fd_async_io=1 does not work with"
+				" fd_buffered_io=1\n");
+			return -EINVAL;
+		}
 		pr_debug("FILEIO: Disabling O_DSYNC, using buffered FILEIO\n");
 		flags &= ~O_DSYNC;
 	}
@@ -137,6 +142,14 @@ static int fd_configure_device(struct se_device *dev)
 		goto fail;
 	}
 	fd_dev->fd_file = file;
+
+	if ((fd_dev->fbd_flags & FDBD_HAS_ASYNC_IO) &&
+	    (!file->f_op->read_iter || !file->f_op->write_iter ||
+	     !file->f_mapping->a_ops || !file->f_mapping->a_ops->direct_IO)) {
+		pr_err("FILEIO: %s does not support direct I/O, needed for"
+			" fd_async_io=1\n", fd_dev->fd_dev_name);
+		goto fail;
+	}
 	/*
 	 * If using a block backend with this struct file, we extract
 	 * fd_dev->fd_[block,dev]_size from struct block_device.
@@ -172,6 +185,8 @@ static int fd_configure_device(struct se_device *dev)
 
 		if (blk_queue_nonrot(q))
 			dev->dev_attrib.is_nonrot = 1;
+
+		fd_dev->fd_dio_align = fd_dev->fd_block_size;
 	} else {
 		if (!(fd_dev->fbd_flags & FBDF_HAS_SIZE)) {
 			pr_err("FILEIO: Missing fd_dev_size="
@@ -197,6 +212,12 @@ static int fd_configure_device(struct se_device *dev)
 		 * based upon struct iovec limit for vfs_writev()
 		 */
 		dev->dev_attrib.max_write_same_len = 0x1000;
+
+		if (inode->i_sb->s_bdev)
+			fd_dev->fd_dio_align =
+				bdev_logical_block_size(inode->i_sb->s_bdev);
+		else
+			fd_dev->fd_dio_align = FD_BLOCKSIZE;
 	}
 
 	dev->dev_attrib.hw_block_size = fd_dev->fd_block_size;
@@ -245,6 +266,38 @@ static void fd_free_device(struct se_device *dev)
 	call_rcu(&dev->rcu_head, fd_dev_call_rcu);
 }
 
+static int fd_check_rw(struct file *fd, ssize_t ret, u32 data_length,
+		       int is_write)
+{
+	if (is_write) {
+		if (ret < 0 || ret != data_length) {
+			pr_err("%s() write returned %zd\n", __func__, ret);
+			return (ret < 0 ? ret : -EINVAL);
+		}
+	} else {
+		/*
+		 * Return zeros and GOOD status even if the READ did not return
+		 * the expected virt_size for struct file w/o a backing struct
+		 * block_device.
+		 */
+		if (S_ISBLK(file_inode(fd)->i_mode)) {
+			if (ret < 0 || ret != data_length) {
+				pr_err("%s() returned %zd, expecting %u for "
+						"S_ISBLK\n", __func__, ret,
+						data_length);
+				return (ret < 0 ? ret : -EINVAL);
+			}
+		} else {
+			if (ret < 0) {
+				pr_err("%s() returned %zd for non S_ISBLK\n",
+						__func__, ret);
+				return ret;
+			}
+		}
+	}
+	return 1;
+}
+
 static int fd_do_rw(struct se_cmd *cmd, struct file *fd,
 		    u32 block_size, struct scatterlist *sgl,
 		    u32 sgl_nents, u32 data_length, int is_write)
@@ -278,33 +331,106 @@ static int fd_do_rw(struct se_cmd *cmd, struct file *fd,
 
 	kfree(bvec);
 
-	if (is_write) {
-		if (ret < 0 || ret != data_length) {
-			pr_err("%s() write returned %d\n", __func__, ret);
-			return (ret < 0 ? ret : -EINVAL);
-		}
-	} else {
-		/*
-		 * Return zeros and GOOD status even if the READ did not return
-		 * the expected virt_size for struct file w/o a backing struct
-		 * block_device.
-		 */
-		if (S_ISBLK(file_inode(fd)->i_mode)) {
-			if (ret < 0 || ret != data_length) {
-				pr_err("%s() returned %d, expecting %u for "
-						"S_ISBLK\n", __func__, ret,
-						data_length);
-				return (ret < 0 ? ret : -EINVAL);
-			}
-		} else {
-			if (ret < 0) {
-				pr_err("%s() returned %d for non S_ISBLK\n",
-						__func__, ret);
-				return ret;
-			}
-		}
+	return fd_check_rw(fd, ret, data_length, is_write);
+}
+
+struct fd_aio_cmd {
+	struct se_cmd	*cmd;
+	struct kiocb	iocb;
+	u32		len;
+	struct bio_vec	bvecs[];
+};
+
+static void fd_aio_complete(struct kiocb *iocb, long ret, long ret2)
+{
+	struct fd_aio_cmd *aio_cmd = container_of(iocb, struct fd_aio_cmd,
+						  iocb);
+	struct se_cmd *cmd = aio_cmd->cmd;
+
+	if (fd_check_rw(iocb->ki_filp, ret, aio_cmd->len,
+			cmd->data_direction != DMA_FROM_DEVICE) < 0)
+		target_complete_cmd(cmd, SAM_STAT_CHECK_CONDITION);
+	else
+		target_complete_cmd(cmd, SAM_STAT_GOOD);
+
+	kfree(aio_cmd);
+}
+
+/*
+ * Direct I/O needs the file offset and every segment aligned to the
+ * underlying logical block size, anything else goes through the page
+ * cache and completes before ->read_iter/->write_iter return.
+ */
+static bool fd_aio_can_direct(struct fd_dev *fd_dev, loff_t pos,
+			      struct scatterlist *sgl, u32 sgl_nents)
+{
+	u32 mask = fd_dev->fd_dio_align - 1;
+	struct scatterlist *sg;
+	int i;
+
+	if (pos & mask)
+		return false;
+	for_each_sg(sgl, sg, sgl_nents, i)
+		if ((sg->offset | sg->length) & mask)
+			return false;
+	return true;
+}
+
+/*
+ * Submit the I/O with a kiocb of our own and complete the command from
+ * its ->ki_complete, so the submitting thread does not wait for it.
+ * The file is opened with O_DSYNC, which direct I/O honours before
+ * calling ->ki_complete, so FUA needs no extra work here.
+ */
+static sense_reason_t
+fd_execute_rw_aio(struct se_cmd *cmd, struct scatterlist *sgl, u32 sgl_nents,
+		  enum dma_data_direction data_direction)
+{
+	int is_write = !(data_direction == DMA_FROM_DEVICE);
+	struct se_device *dev = cmd->se_dev;
+	struct fd_dev *fd_dev = FD_DEV(dev);
+	struct file *file = fd_dev->fd_file;
+	struct fd_aio_cmd *aio_cmd;
+	struct scatterlist *sg;
+	struct iov_iter iter;
+	ssize_t len = 0, ret;
+	int i;
+
+	aio_cmd = kmalloc(sizeof(*aio_cmd) +
+			  sgl_nents * sizeof(struct bio_vec), GFP_KERNEL);
+	if (!aio_cmd)
+		return TCM_LOGICAL_UNIT_COMMUNICATION_FAILURE;
+
+	for_each_sg(sgl, sg, sgl_nents, i) {
+		aio_cmd->bvecs[i].bv_page = sg_page(sg);
+		aio_cmd->bvecs[i].bv_len = sg->length;
+		aio_cmd->bvecs[i].bv_offset = sg->offset;
+
+		len += sg->length;
 	}
-	return 1;
+
+	iov_iter_bvec(&iter, ITER_BVEC | (is_write ? WRITE : READ),
+		      aio_cmd->bvecs, sgl_nents, len);
+
+	aio_cmd->cmd = cmd;
+	aio_cmd->len = len;
+	aio_cmd->iocb.ki_filp = file;
+	aio_cmd->iocb.ki_pos = cmd->t_task_lba * dev->dev_attrib.block_size;
+	aio_cmd->iocb.ki_complete = fd_aio_complete;
+	aio_cmd->iocb.private = NULL;
+	aio_cmd->iocb.ki_flags = iocb_flags(file);
+	if (fd_aio_can_direct(fd_dev, aio_cmd->iocb.ki_pos, sgl, sgl_nents))
+		aio_cmd->iocb.ki_flags |= IOCB_DIRECT;
+
+	if (is_write)
+		ret = file->f_op->write_iter(&aio_cmd->iocb, &iter);
+	else
+		ret = file->f_op->read_iter(&aio_cmd->iocb, &iter);
+
+	if (ret != -EIOCBQUEUED)
+		fd_aio_complete(&aio_cmd->iocb, ret, 0);
+
+	return 0;
 }
 
 static sense_reason_t
@@ -526,6 +652,13 @@ fd_execute_rw(struct se_cmd *cmd, struct scatterlist *sgl, u32 sgl_nents,
 			cmd->data_length, FD_MAX_BYTES);
 		return TCM_LOGICAL_UNIT_COMMUNICATION_FAILURE;
 	}
+	/*
+	 * Protection information is only read and written around the data
+	 * by the synchronous path.
+	 */
+	if ((fd_dev->fbd_flags & FDBD_HAS_ASYNC_IO) &&
+	    !(cmd->prot_type && dev->dev_attrib.pi_prot_type))
+		return fd_execute_rw_aio(cmd, sgl, sgl_nents, data_direction);
 	/*
 	 * Call vectorized fileio functions to map struct scatterlist
 	 * physical memory addresses to struct iovec virtual memory.
@@ -600,13 +733,15 @@ fd_execute_rw(struct se_cmd *cmd, struct scatterlist *sgl, u32 sgl_nents,
 }
 
 enum {
-	Opt_fd_dev_name, Opt_fd_dev_size, Opt_fd_buffered_io, Opt_err
+	Opt_fd_dev_name, Opt_fd_dev_size, Opt_fd_buffered_io, Opt_fd_async_io,
+	Opt_err
 };
 
 static match_table_t tokens = {
 	{Opt_fd_dev_name, "fd_dev_name=%s"},
 	{Opt_fd_dev_size, "fd_dev_size=%s"},
 	{Opt_fd_buffered_io, "fd_buffered_io=%d"},
+	{Opt_fd_async_io, "fd_async_io=%d"},
 	{Opt_err, NULL}
 };
 
@@ -672,6 +807,21 @@ static ssize_t fd_set_configfs_dev_params(struct se_device *dev,
 
 			fd_dev->fbd_flags |= FDBD_HAS_BUFFERED_IO_WCE;
 			break;
+		case Opt_fd_async_io:
+			ret = match_int(args, &arg);
+			if (ret)
+				goto out;
+			if (arg != 1) {
+				pr_err("bogus fd_async_io=%d value\n", arg);
+				ret = -EINVAL;
+				goto out;
+			}
+
+			pr_debug("FILEIO: Using async I/O"
+				" operations for struct fd_dev\n");
+
+			fd_dev->fbd_flags |= FDBD_HAS_ASYNC_IO;
+			break;
 		default:
 			break;
 		}
@@ -688,10 +838,11 @@ static ssize_t fd_show_configfs_dev_params(struct se_device *dev, char *b)
 	ssize_t bl = 0;
 
 	bl = sprintf(b + bl, "TCM FILEIO ID: %u", fd_dev->fd_dev_id);
-	bl += sprintf(b + bl, "        File: %s  Size: %llu  Mode: %s\n",
+	bl += sprintf(b + bl, "        File: %s  Size: %llu  Mode: %s%s\n",
 		fd_dev->fd_dev_name, fd_dev->fd_dev_size,
 		(fd_dev->fbd_flags & FDBD_HAS_BUFFERED_IO_WCE) ?
-		"Buffered-WCE" : "O_DSYNC");
+		"Buffered-WCE" : "O_DSYNC",
+		(fd_dev->fbd_flags & FDBD_HAS_ASYNC_IO) ? " Async" : "");
 	return bl;
 }
 
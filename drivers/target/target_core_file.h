@@ -19,6 +19,7 @@
 #define FBDF_HAS_PATH		0x01
 #define FBDF_HAS_SIZE		0x02
 #define FDBD_HAS_BUFFERED_IO_WCE 0x04
+#define FDBD_HAS_ASYNC_IO	0x08
 #define FDBD_FORMAT_UNIT_SIZE	2048
 
 struct fd_dev {
@@ -32,6 +33,8 @@ struct fd_dev {
 	u32		fd_table_count;
 	u32		fd_queue_depth;
 	u32		fd_block_size;
+	/* Alignment IOCB_DIRECT needs for fd_async_io */
+	u32		fd_dio_align;
 	unsigned long long fd_dev_size;
 	struct file	*fd_file;
 	struct file	*fd_prot_file;
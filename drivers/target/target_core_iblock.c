@@ -46,6 +46,8 @@
 #define IBLOCK_MAX_BIO_PER_TASK	 32	/* max # of bios to submit at a time */
 #define IBLOCK_BIO_POOL_SIZE	128
 
+static struct workqueue_struct *iblock_submit_wq;
+
 static inline struct iblock_dev *IBLOCK_DEV(struct se_device *dev)
 {
 	return container_of(dev, struct iblock_dev, dev);
@@ -64,6 +66,57 @@ static void iblock_detach_hba(struct se_hba *hba)
 {
 }
 
+static void iblock_submit_work(struct work_struct *work)
+{
+	struct iblock_dev_queue *ibq = container_of(work,
+					struct iblock_dev_queue, work);
+	struct blk_plug plug;
+	struct bio_list list;
+	struct bio *bio;
+
+	spin_lock_irq(&ibq->lock);
+	list = ibq->bios;
+	bio_list_init(&ibq->bios);
+	spin_unlock_irq(&ibq->lock);
+
+	blk_start_plug(&plug);
+	while ((bio = bio_list_pop(&list)))
+		submit_bio(bio->bi_rw, bio);
+	blk_finish_plug(&plug);
+}
+
+static int iblock_alloc_queues(struct iblock_dev *ib_dev)
+{
+	int cpu;
+
+	ib_dev->ibd_queues = alloc_percpu(struct iblock_dev_queue);
+	if (!ib_dev->ibd_queues)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct iblock_dev_queue *ibq = per_cpu_ptr(ib_dev->ibd_queues,
+							   cpu);
+
+		spin_lock_init(&ibq->lock);
+		bio_list_init(&ibq->bios);
+		INIT_WORK(&ibq->work, iblock_submit_work);
+	}
+	return 0;
+}
+
+static void iblock_free_queues(struct iblock_dev *ib_dev)
+{
+	int cpu;
+
+	if (!ib_dev->ibd_queues)
+		return;
+
+	for_each_possible_cpu(cpu)
+		flush_work(&per_cpu_ptr(ib_dev->ibd_queues, cpu)->work);
+	free_percpu(ib_dev->ibd_queues);
+	ib_dev->ibd_queues = NULL;
+}
+
 static struct se_device *iblock_alloc_device(struct se_hba *hba, const char *name)
 {
 	struct iblock_dev *ib_dev = NULL;
@@ -99,6 +152,12 @@ static int iblock_configure_device(struct se_device *dev)
 		goto out;
 	}
 
+	if ((ib_dev->ibd_flags & IBDF_PERCPU_SUBMIT) &&
+	    iblock_alloc_queues(ib_dev)) {
+		pr_err("IBLOCK: Unable to allocate submission queues\n");
+		goto out_free_bioset;
+	}
+
 	pr_debug( "IBLOCK: Claiming struct block_device: %s\n",
 			ib_dev->ibd_udev_path);
 
@@ -169,6 +228,7 @@ static int iblock_configure_device(struct se_device *dev)
 out_blkdev_put:
 	blkdev_put(ib_dev->ibd_bd, FMODE_WRITE|FMODE_READ|FMODE_EXCL);
 out_free_bioset:
+	iblock_free_queues(ib_dev);
 	bioset_free(ib_dev->ibd_bio_set);
 	ib_dev->ibd_bio_set = NULL;
 out:
@@ -187,6 +247,7 @@ static void iblock_free_device(struct se_device *dev)
 {
 	struct iblock_dev *ib_dev = IBLOCK_DEV(dev);
 
+	iblock_free_queues(ib_dev);
 	if (ib_dev->ibd_bd != NULL)
 		blkdev_put(ib_dev->ibd_bd, FMODE_WRITE|FMODE_READ|FMODE_EXCL);
 	if (ib_dev->ibd_bio_set != NULL)
@@ -337,11 +398,47 @@ iblock_get_bio(struct se_cmd *cmd, sector_t lba, u32 sg_num)
 	return bio;
 }
 
-static void iblock_submit_bios(struct bio_list *list, int rw)
+/*
+ * Hand the bios to the submission queue of the command's CPU, which is
+ * the session's CPU when the fabric asked for SCF_USE_CPUID.
+ */
+static void iblock_queue_bios(struct iblock_dev *ib_dev, struct se_cmd *cmd,
+			      struct bio_list *list, int rw)
 {
+	struct iblock_dev_queue *ibq;
+	unsigned long flags;
+	struct bio *bio;
+	int cpu;
+
+	if (cmd->se_cmd_flags & SCF_USE_CPUID)
+		cpu = cmd->cpuid;
+	else
+		cpu = raw_smp_processor_id();
+
+	bio_list_for_each(bio, list)
+		bio->bi_rw |= rw;
+
+	ibq = per_cpu_ptr(ib_dev->ibd_queues, cpu);
+	spin_lock_irqsave(&ibq->lock, flags);
+	bio_list_merge(&ibq->bios, list);
+	spin_unlock_irqrestore(&ibq->lock, flags);
+	bio_list_init(list);
+
+	queue_work_on(cpu, iblock_submit_wq, &ibq->work);
+}
+
+static void iblock_submit_bios(struct se_cmd *cmd, struct bio_list *list,
+			       int rw)
+{
+	struct iblock_dev *ib_dev = IBLOCK_DEV(cmd->se_dev);
 	struct blk_plug plug;
 	struct bio *bio;
 
+	if (ib_dev->ibd_queues) {
+		iblock_queue_bios(ib_dev, cmd, list, rw);
+		return;
+	}
+
 	blk_start_plug(&plug);
 	while ((bio = bio_list_pop(list)))
 		submit_bio(rw, bio);
@@ -469,7 +566,7 @@ iblock_execute_write_same(struct se_cmd *cmd)
 		sectors -= 1;
 	}
 
-	iblock_submit_bios(&list, WRITE);
+	iblock_submit_bios(cmd, &list, WRITE);
 	return 0;
 
 fail_put_bios:
@@ -482,13 +579,14 @@ fail:
 }
 
 enum {
-	Opt_udev_path, Opt_readonly, Opt_force, Opt_err
+	Opt_udev_path, Opt_readonly, Opt_force, Opt_percpu_submit, Opt_err
 };
 
 static match_table_t tokens = {
 	{Opt_udev_path, "udev_path=%s"},
 	{Opt_readonly, "readonly=%d"},
 	{Opt_force, "force=%d"},
+	{Opt_percpu_submit, "percpu_submit=%d"},
 	{Opt_err, NULL}
 };
 
@@ -498,7 +596,7 @@ static ssize_t iblock_set_configfs_dev_params(struct se_device *dev,
 	struct iblock_dev *ib_dev = IBLOCK_DEV(dev);
 	char *orig, *ptr, *arg_p, *opts;
 	substring_t args[MAX_OPT_ARGS];
-	int ret = 0, token;
+	int ret = 0, token, arg;
 	unsigned long tmp_readonly;
 
 	opts = kstrdup(page, GFP_KERNEL);
@@ -547,6 +645,22 @@ static ssize_t iblock_set_configfs_dev_params(struct se_device *dev,
 			break;
 		case Opt_force:
 			break;
+		case Opt_percpu_submit:
+			if (ib_dev->ibd_bd) {
+				pr_err("Unable to set percpu_submit= while"
+					" ib_dev->ibd_bd exists\n");
+				ret = -EEXIST;
+				goto out;
+			}
+			ret = match_int(args, &arg);
+			if (ret)
+				goto out;
+			if (arg)
+				ib_dev->ibd_flags |= IBDF_PERCPU_SUBMIT;
+			else
+				ib_dev->ibd_flags &= ~IBDF_PERCPU_SUBMIT;
+			pr_debug("IBLOCK: percpu_submit: %d\n", !!arg);
+			break;
 		default:
 			break;
 		}
@@ -570,7 +684,9 @@ static ssize_t iblock_show_configfs_dev_params(struct se_device *dev, char *b)
 	if (ib_dev->ibd_flags & IBDF_HAS_UDEV_PATH)
 		bl += sprintf(b + bl, "  UDEV PATH: %s",
 				ib_dev->ibd_udev_path);
-	bl += sprintf(b + bl, "  readonly: %d\n", ib_dev->ibd_readonly);
+	bl += sprintf(b + bl, "  readonly: %d", ib_dev->ibd_readonly);
+	bl += sprintf(b + bl, "  percpu_submit: %d\n",
+		      !!(ib_dev->ibd_flags & IBDF_PERCPU_SUBMIT));
 
 	bl += sprintf(b + bl, "        ");
 	if (bd) {
@@ -697,7 +813,7 @@ iblock_execute_rw(struct se_cmd *cmd, struct scatterlist *sgl, u32 sgl_nents,
 		while (bio_add_page(bio, sg_page(sg), sg->length, sg->offset)
 				!= sg->length) {
 			if (bio_cnt >= IBLOCK_MAX_BIO_PER_TASK) {
-				iblock_submit_bios(&list, rw);
+				iblock_submit_bios(cmd, &list, rw);
 				bio_cnt = 0;
 			}
 
@@ -721,7 +837,7 @@ iblock_execute_rw(struct se_cmd *cmd, struct scatterlist *sgl, u32 sgl_nents,
 			goto fail_put_bios;
 	}
 
-	iblock_submit_bios(&list, rw);
+	iblock_submit_bios(cmd, &list, rw);
 	iblock_complete_cmd(cmd);
 	return 0;
 
@@ -829,12 +945,23 @@ static const struct target_backend_ops iblock_ops = {
 
 static int __init iblock_module_init(void)
 {
-	return transport_backend_register(&iblock_ops);
+	int ret;
+
+	iblock_submit_wq = alloc_workqueue("iblock_submit",
+					   WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!iblock_submit_wq)
+		return -ENOMEM;
+
+	ret = transport_backend_register(&iblock_ops);
+	if (ret)
+		destroy_workqueue(iblock_submit_wq);
+	return ret;
 }
 
 static void __exit iblock_module_exit(void)
 {
 	target_backend_unregister(&iblock_ops);
+	destroy_workqueue(iblock_submit_wq);
 }
 
 MODULE_DESCRIPTION("TCM IBLOCK subsystem plugin");
@@ -11,7 +11,18 @@ struct iblock_req {
 	atomic_t ib_bio_err_cnt;
 } ____cacheline_aligned;
 
+/*
+ * Per-cpu submission context. Bios queued on a CPU are submitted by a
+ * worker bound to that CPU, under one plug for all that piled up.
+ */
+struct iblock_dev_queue {
+	spinlock_t		lock;
+	struct bio_list		bios;
+	struct work_struct	work;
+};
+
 #define IBDF_HAS_UDEV_PATH		0x01
+#define IBDF_PERCPU_SUBMIT		0x02
 
 struct iblock_dev {
 	struct se_device dev;
@@ -20,6 +31,7 @@ struct iblock_dev {
 	struct bio_set	*ibd_bio_set;
 	struct block_device *ibd_bd;
 	bool ibd_readonly;
+	struct iblock_dev_queue __percpu *ibd_queues;
 } ____cacheline_aligned;
 
 #endif /* TARGET_CORE_IBLOCK_H */
@@ -24,6 +24,10 @@
 #include <linux/timer.h>
 #include <linux/parser.h>
 #include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
 #include <linux/uio_driver.h>
 #include <linux/stringify.h>
 #include <net/genetlink.h>
@@ -64,9 +68,21 @@
 #define TCMU_TIME_OUT (30 * MSEC_PER_SEC)
 
 #define CMDR_SIZE (16 * 4096)
-#define DATA_SIZE (257 * 4096)
 
-#define TCMU_RING_SIZE (CMDR_SIZE + DATA_SIZE)
+/*
+ * The data area is handed out in page sized blocks, tracked by a bitmap.
+ * A block is only backed by a page the first time it is used, so the
+ * area grows to what userspace actually keeps in flight, up to
+ * max_data_area_mb.
+ *
+ * With zero_copy, a second window of the same size follows the data
+ * area. Its blocks are backed by the command's own pages for as long
+ * as the command is in userspace.
+ */
+#define DATA_BLOCK_SIZE PAGE_SIZE
+#define DATA_BLOCK_SHIFT PAGE_SHIFT
+#define TCMU_DEF_MAX_DATA_AREA_MB 8
+#define TCMU_MAX_DATA_AREA_MB 1024
 
 static struct device *tcmu_root_device;
 
@@ -92,13 +108,34 @@ struct tcmu_dev {
 	size_t dev_size;
 	u32 cmdr_size;
 	u32 cmdr_last_cleaned;
-	/* Offset of data ring from start of mb */
+	/* Offset of data area from start of mb */
 	size_t data_off;
 	size_t data_size;
-	/* Ring head + tail values. */
-	/* Must add data_off and mb_addr to get the address */
-	size_t data_head;
-	size_t data_tail;
+	/* Size of the whole mmap()ed region */
+	size_t ring_size;
+
+	/* Blocks in the data area, and again in the zero copy window */
+	u32 max_blocks;
+	u32 nr_blocks;
+	/* Free block counts and the block bitmap, protected by cmdr_lock */
+	u32 free_blocks;
+	u32 free_zc_blocks;
+	unsigned long *data_bitmap;
+
+	/*
+	 * Page backing each block, protected by data_lock. The pages of
+	 * the data area are kept once allocated.
+	 */
+	struct page **data_blocks;
+	u32 nr_data_pages;
+	struct mutex data_lock;
+	/* Userspace mappings of the ring, protected by data_lock */
+	struct address_space *mapping;
+	unsigned int nr_vmas;
+
+	/* Zero copy commands waiting for their pages to be unmapped */
+	struct llist_head zc_done;
+	struct work_struct zc_work;
 
 	wait_queue_head_t wait_cmdr;
 	/* TODO should this be a mutex? */
@@ -109,6 +146,9 @@ struct tcmu_dev {
 
 	struct timer_list timeout;
 
+	u32 max_data_area_mb;
+	bool zero_copy;
+
 	char dev_config[TCMU_CONFIG_LEN];
 };
 
@@ -128,7 +168,19 @@ struct tcmu_cmd {
 
 	unsigned long deadline;
 
+	/* Data area blocks, those of the bidi Data-In buffer from dbi_bidi on */
+	u32 *dbi;
+	u32 dbi_cnt;
+	u32 dbi_bidi;
+
+	/* Status from userspace, kept until the command is completed */
+	u8 scsi_status;
+	struct list_head done_entry;
+	struct llist_node zc_node;
+
 #define TCMU_CMD_BIT_EXPIRED 0
+#define TCMU_CMD_BIT_ZERO_COPY 1
+#define TCMU_CMD_BIT_REAPED 2
 	unsigned long flags;
 };
 
@@ -154,6 +206,57 @@ static struct genl_family tcmu_genl_family = {
 	.n_mcgrps = ARRAY_SIZE(tcmu_mcgrps),
 };
 
+static size_t tcmu_sgl_len(struct scatterlist *data_sg, unsigned int data_nents)
+{
+	struct scatterlist *sg;
+	size_t len = 0;
+	int i;
+
+	for_each_sg(data_sg, sg, data_nents, i)
+		len += sg->length;
+	return len;
+}
+
+static u32 tcmu_sgl_blocks(struct scatterlist *data_sg, unsigned int data_nents)
+{
+	return DIV_ROUND_UP(tcmu_sgl_len(data_sg, data_nents), DATA_BLOCK_SIZE);
+}
+
+static bool tcmu_sgl_zero_copy(struct scatterlist *data_sg, unsigned int data_nents)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(data_sg, sg, data_nents, i)
+		if (sg->offset || sg->length != PAGE_SIZE)
+			return false;
+	return true;
+}
+
+static bool tcmu_cmd_zero_copy(struct tcmu_dev *udev, struct se_cmd *se_cmd)
+{
+	if (!udev->zero_copy || se_cmd->data_direction == DMA_NONE)
+		return false;
+
+	/*
+	 * Only pages the target core allocated for this command can be
+	 * handed to userspace. Fabric memory may be page cache or in use
+	 * elsewhere, and a partial page would expose whatever else is in it.
+	 */
+	if (se_cmd->se_cmd_flags & SCF_PASSTHROUGH_SG_TO_MEM_NOALLOC)
+		return false;
+
+	return tcmu_sgl_zero_copy(se_cmd->t_data_sg, se_cmd->t_data_nents) &&
+	       tcmu_sgl_zero_copy(se_cmd->t_bidi_data_sg,
+				  se_cmd->t_bidi_data_nents);
+}
+
+static void tcmu_free_cmd(struct tcmu_cmd *tcmu_cmd)
+{
+	kfree(tcmu_cmd->dbi);
+	kmem_cache_free(tcmu_cmd_cache, tcmu_cmd);
+}
+
 static struct tcmu_cmd *tcmu_alloc_cmd(struct se_cmd *se_cmd)
 {
 	struct se_device *se_dev = se_cmd->se_dev;
@@ -174,6 +277,23 @@ static struct tcmu_cmd *tcmu_alloc_cmd(struct se_cmd *se_cmd)
 		tcmu_cmd->data_length += se_cmd->t_bidi_data_sg->length;
 	}
 
+	tcmu_cmd->dbi_bidi = tcmu_sgl_blocks(se_cmd->t_data_sg,
+					     se_cmd->t_data_nents);
+	tcmu_cmd->dbi_cnt = tcmu_cmd->dbi_bidi +
+		tcmu_sgl_blocks(se_cmd->t_bidi_data_sg,
+				se_cmd->t_bidi_data_nents);
+	if (tcmu_cmd->dbi_cnt) {
+		tcmu_cmd->dbi = kcalloc(tcmu_cmd->dbi_cnt, sizeof(u32),
+					GFP_KERNEL);
+		if (!tcmu_cmd->dbi) {
+			kmem_cache_free(tcmu_cmd_cache, tcmu_cmd);
+			return NULL;
+		}
+	}
+
+	if (tcmu_cmd_zero_copy(udev, se_cmd))
+		set_bit(TCMU_CMD_BIT_ZERO_COPY, &tcmu_cmd->flags);
+
 	tcmu_cmd->deadline = jiffies + msecs_to_jiffies(TCMU_TIME_OUT);
 
 	idr_preload(GFP_KERNEL);
@@ -184,7 +304,7 @@ static struct tcmu_cmd *tcmu_alloc_cmd(struct se_cmd *se_cmd)
 	idr_preload_end();
 
 	if (cmd_id < 0) {
-		kmem_cache_free(tcmu_cmd_cache, tcmu_cmd);
+		tcmu_free_cmd(tcmu_cmd);
 		return NULL;
 	}
 	tcmu_cmd->cmd_id = cmd_id;
@@ -232,110 +352,209 @@ static inline size_t head_to_end(size_t head, size_t size)
 
 #define UPDATE_HEAD(head, used, size) smp_store_release(&head, ((head % size) + used) % size)
 
-static void alloc_and_scatter_data_area(struct tcmu_dev *udev,
-	struct scatterlist *data_sg, unsigned int data_nents,
-	struct iovec **iov, int *iov_cnt, bool copy_data)
+/*
+ * The blocks of a command are picked lowest first, so they are mostly
+ * contiguous and the area only grows when everything below is in use.
+ *
+ * Called with ring lock held.
+ */
+static void tcmu_reserve_blocks(struct tcmu_dev *udev, struct tcmu_cmd *cmd)
 {
-	int i;
-	void *from, *to;
-	size_t copy_bytes;
+	bool zc = test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags);
+	u32 dbi = zc ? udev->max_blocks : 0;
+	u32 end = dbi + udev->max_blocks;
+	u32 i;
+
+	for (i = 0; i < cmd->dbi_cnt; i++) {
+		dbi = find_next_zero_bit(udev->data_bitmap, end, dbi);
+		__set_bit(dbi, udev->data_bitmap);
+		cmd->dbi[i] = dbi;
+	}
+
+	if (zc)
+		udev->free_zc_blocks -= cmd->dbi_cnt;
+	else
+		udev->free_blocks -= cmd->dbi_cnt;
+}
+
+/* Called with ring lock held. */
+static void tcmu_release_blocks(struct tcmu_dev *udev, struct tcmu_cmd *cmd)
+{
+	u32 i;
+
+	for (i = 0; i < cmd->dbi_cnt; i++)
+		__clear_bit(cmd->dbi[i], udev->data_bitmap);
+
+	if (test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags))
+		udev->free_zc_blocks += cmd->dbi_cnt;
+	else
+		udev->free_blocks += cmd->dbi_cnt;
+	cmd->dbi_cnt = 0;
+}
+
+/*
+ * Back the command's blocks with pages. Data area blocks get a page of
+ * their own the first time they are used, zero copy blocks get the
+ * command's pages.
+ */
+static int tcmu_map_blocks(struct tcmu_dev *udev, struct tcmu_cmd *cmd)
+{
+	struct se_cmd *se_cmd = cmd->se_cmd;
 	struct scatterlist *sg;
+	struct page *page;
+	int i;
 
-	for_each_sg(data_sg, sg, data_nents, i) {
-		copy_bytes = min_t(size_t, sg->length,
-				 head_to_end(udev->data_head, udev->data_size));
-		from = kmap_atomic(sg_page(sg)) + sg->offset;
-		to = (void *) udev->mb_addr + udev->data_off + udev->data_head;
-
-		if (copy_data) {
-			memcpy(to, from, copy_bytes);
-			tcmu_flush_dcache_range(to, copy_bytes);
+	mutex_lock(&udev->data_lock);
+
+	if (!test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags)) {
+		for (i = 0; i < cmd->dbi_cnt; i++) {
+			if (udev->data_blocks[cmd->dbi[i]])
+				continue;
+
+			page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+			if (!page) {
+				mutex_unlock(&udev->data_lock);
+				return -ENOMEM;
+			}
+			udev->data_blocks[cmd->dbi[i]] = page;
+			udev->nr_data_pages++;
 		}
+		mutex_unlock(&udev->data_lock);
+		return 0;
+	}
 
-		/* Even iov_base is relative to mb_addr */
-		(*iov)->iov_len = copy_bytes;
-		(*iov)->iov_base = (void __user *) udev->data_off +
-						udev->data_head;
-		(*iov_cnt)++;
-		(*iov)++;
+	/*
+	 * Data-In pages are not cleared by the target core, don't let
+	 * userspace see what was in them before.
+	 */
+	for_each_sg(se_cmd->t_data_sg, sg, se_cmd->t_data_nents, i) {
+		if (se_cmd->data_direction == DMA_FROM_DEVICE)
+			clear_highpage(sg_page(sg));
+		flush_dcache_page(sg_page(sg));
+		udev->data_blocks[cmd->dbi[i]] = sg_page(sg);
+	}
+	for_each_sg(se_cmd->t_bidi_data_sg, sg, se_cmd->t_bidi_data_nents, i) {
+		clear_highpage(sg_page(sg));
+		flush_dcache_page(sg_page(sg));
+		udev->data_blocks[cmd->dbi[cmd->dbi_bidi + i]] = sg_page(sg);
+	}
 
-		UPDATE_HEAD(udev->data_head, copy_bytes, udev->data_size);
+	mutex_unlock(&udev->data_lock);
+	return 0;
+}
 
-		/* Uh oh, we wrapped the buffer. Must split sg across 2 iovs. */
-		if (sg->length != copy_bytes) {
-			void *from_skip = from + copy_bytes;
+/*
+ * Take the command's pages back out of the zero copy window and out of
+ * userspace's page tables, before the target core may reuse them.
+ */
+static void tcmu_unmap_zc_blocks(struct tcmu_dev *udev, struct tcmu_cmd *cmd)
+{
+	u32 i, start = 0;
 
-			copy_bytes = sg->length - copy_bytes;
+	mutex_lock(&udev->data_lock);
 
-			(*iov)->iov_len = copy_bytes;
-			(*iov)->iov_base = (void __user *) udev->data_off +
-							udev->data_head;
+	for (i = 0; i < cmd->dbi_cnt; i++) {
+		struct page *page = udev->data_blocks[cmd->dbi[i]];
 
-			if (copy_data) {
-				to = (void *) udev->mb_addr +
-					udev->data_off + udev->data_head;
-				memcpy(to, from_skip, copy_bytes);
-				tcmu_flush_dcache_range(to, copy_bytes);
-			}
+		if (!page)
+			continue;
+		udev->data_blocks[cmd->dbi[i]] = NULL;
 
-			(*iov_cnt)++;
-			(*iov)++;
+		/* A fault that found the page holds its lock until the pte is set */
+		lock_page(page);
+		unlock_page(page);
+		flush_dcache_page(page);
+	}
 
-			UPDATE_HEAD(udev->data_head,
-				copy_bytes, udev->data_size);
-		}
+	for (i = 1; udev->nr_vmas && i <= cmd->dbi_cnt; i++) {
+		if (i < cmd->dbi_cnt && cmd->dbi[i] == cmd->dbi[i - 1] + 1)
+			continue;
 
-		kunmap_atomic(from - sg->offset);
+		unmap_mapping_range(udev->mapping, udev->data_off +
+				    ((loff_t)cmd->dbi[start] << DATA_BLOCK_SHIFT),
+				    (loff_t)(i - start) << DATA_BLOCK_SHIFT, 1);
+		start = i;
 	}
+
+	mutex_unlock(&udev->data_lock);
 }
 
-static void gather_and_free_data_area(struct tcmu_dev *udev,
-	struct scatterlist *data_sg, unsigned int data_nents)
+/*
+ * Copy between an sg list and the data area. The data is packed into
+ * the command's blocks back to back, so an sg entry may straddle two.
+ */
+static void tcmu_copy_data(struct tcmu_dev *udev, u32 *dbi,
+	struct scatterlist *data_sg, unsigned int data_nents, bool to_area)
 {
-	int i;
-	void *from, *to;
-	size_t copy_bytes;
 	struct scatterlist *sg;
+	size_t block_off = 0;
+	int i;
 
-	/* It'd be easier to look at entry's iovec again, but UAM */
 	for_each_sg(data_sg, sg, data_nents, i) {
-		copy_bytes = min_t(size_t, sg->length,
-				 head_to_end(udev->data_tail, udev->data_size));
+		void *sg_addr = kmap_atomic(sg_page(sg)) + sg->offset;
+		size_t sg_off = 0;
 
-		to = kmap_atomic(sg_page(sg)) + sg->offset;
 		WARN_ON(sg->length + sg->offset > PAGE_SIZE);
-		from = (void *) udev->mb_addr +
-			udev->data_off + udev->data_tail;
-		tcmu_flush_dcache_range(from, copy_bytes);
-		memcpy(to, from, copy_bytes);
-
-		UPDATE_HEAD(udev->data_tail, copy_bytes, udev->data_size);
-
-		/* Uh oh, wrapped the data buffer for this sg's data */
-		if (sg->length != copy_bytes) {
-			void *to_skip = to + copy_bytes;
-
-			from = (void *) udev->mb_addr +
-				udev->data_off + udev->data_tail;
-			WARN_ON(udev->data_tail);
-			copy_bytes = sg->length - copy_bytes;
-			tcmu_flush_dcache_range(from, copy_bytes);
-			memcpy(to_skip, from, copy_bytes);
-
-			UPDATE_HEAD(udev->data_tail,
-				copy_bytes, udev->data_size);
+		while (sg_off < sg->length) {
+			struct page *page = udev->data_blocks[*dbi];
+			size_t copy_bytes = min_t(size_t, sg->length - sg_off,
+						  DATA_BLOCK_SIZE - block_off);
+			void *addr = kmap_atomic(page);
+
+			if (to_area) {
+				memcpy(addr + block_off, sg_addr + sg_off,
+				       copy_bytes);
+				flush_dcache_page(page);
+			} else {
+				flush_dcache_page(page);
+				memcpy(sg_addr + sg_off, addr + block_off,
+				       copy_bytes);
+			}
+			kunmap_atomic(addr);
+
+			sg_off += copy_bytes;
+			block_off += copy_bytes;
+			if (block_off == DATA_BLOCK_SIZE) {
+				dbi++;
+				block_off = 0;
+			}
+		}
+		kunmap_atomic(sg_addr - sg->offset);
+	}
+}
+
+/* Fill in iovs for len bytes of data, merging contiguous blocks. */
+static void tcmu_setup_iovs(struct tcmu_dev *udev, u32 *dbi, u32 dbi_cnt,
+	size_t len, struct iovec **iov, int *iov_cnt)
+{
+	u32 i;
+
+	for (i = 0; i < dbi_cnt; i++) {
+		size_t iov_len = min_t(size_t, len, DATA_BLOCK_SIZE);
+
+		len -= iov_len;
+		if (i && dbi[i] == dbi[i - 1] + 1) {
+			(*iov - 1)->iov_len += iov_len;
+			continue;
 		}
-		kunmap_atomic(to - sg->offset);
+
+		/* Even iov_base is relative to mb_addr */
+		(*iov)->iov_len = iov_len;
+		(*iov)->iov_base = (void __user *) udev->data_off +
+			((size_t)dbi[i] << DATA_BLOCK_SHIFT);
+		(*iov_cnt)++;
+		(*iov)++;
 	}
 }
 
 /*
  * We can't queue a command until we have space available on the cmd ring *and*
- * space available on the data ring.
+ * space available in the data area.
  *
  * Called with ring lock held.
  */
-static bool is_ring_space_avail(struct tcmu_dev *udev, size_t cmd_size, size_t data_needed)
+static bool is_ring_space_avail(struct tcmu_dev *udev, size_t cmd_size,
+				u32 blocks_needed, bool zc)
 {
 	struct tcmu_mailbox *mb = udev->mb_addr;
 	size_t space;
@@ -362,28 +581,53 @@ static bool is_ring_space_avail(struct tcmu_dev *udev, size_t cmd_size, size_t d
 		return false;
 	}
 
-	space = spc_free(udev->data_head, udev->data_tail, udev->data_size);
-	if (space < data_needed) {
-		pr_debug("no data space: %zu %zu %zu\n", udev->data_head,
-		       udev->data_tail, udev->data_size);
+	if ((zc ? udev->free_zc_blocks : udev->free_blocks) < blocks_needed) {
+		pr_debug("no data space: %u %u %u\n", udev->free_blocks,
+			 udev->free_zc_blocks, blocks_needed);
 		return false;
 	}
 
 	return true;
 }
 
+/*
+ * Called and returns with ring lock held, also on timeout.
+ */
+static int tcmu_wait_ring_space(struct tcmu_dev *udev, size_t cmd_size,
+				u32 blocks_needed, bool zc)
+{
+	while (!is_ring_space_avail(udev, cmd_size, blocks_needed, zc)) {
+		int ret;
+		DEFINE_WAIT(__wait);
+
+		prepare_to_wait(&udev->wait_cmdr, &__wait, TASK_INTERRUPTIBLE);
+
+		pr_debug("sleeping for ring space\n");
+		spin_unlock_irq(&udev->cmdr_lock);
+		ret = schedule_timeout(msecs_to_jiffies(TCMU_TIME_OUT));
+		finish_wait(&udev->wait_cmdr, &__wait);
+		spin_lock_irq(&udev->cmdr_lock);
+		if (!ret) {
+			pr_warn("tcmu: command timed out\n");
+			return -ETIMEDOUT;
+		}
+	}
+
+	return 0;
+}
+
 static int tcmu_queue_cmd_ring(struct tcmu_cmd *tcmu_cmd)
 {
 	struct tcmu_dev *udev = tcmu_cmd->tcmu_dev;
 	struct se_cmd *se_cmd = tcmu_cmd->se_cmd;
+	bool zc = test_bit(TCMU_CMD_BIT_ZERO_COPY, &tcmu_cmd->flags);
 	size_t base_command_size, command_size;
 	struct tcmu_mailbox *mb;
 	struct tcmu_cmd_entry *entry;
 	struct iovec *iov;
-	int iov_cnt;
+	int iov_cnt, ret;
 	uint32_t cmd_head;
 	uint64_t cdb_off;
-	bool copy_to_data_area;
 
 	if (test_bit(TCMU_DEV_BIT_BROKEN, &udev->flags))
 		return -EINVAL;
@@ -392,49 +636,54 @@ static int tcmu_queue_cmd_ring(struct tcmu_cmd *tcmu_cmd)
 	 * Must be a certain minimum size for response sense info, but
 	 * also may be larger if the iov array is large.
 	 *
-	 * iovs = sgl_nents+1, for end-of-ring case, plus another 1
-	 * b/c size == offsetof one-past-element.
+	 * iovs = at most one per block, plus another 1 b/c size ==
+	 * offsetof one-past-element.
 	*/
 	base_command_size = max(offsetof(struct tcmu_cmd_entry,
-					 req.iov[se_cmd->t_bidi_data_nents +
-						 se_cmd->t_data_nents + 2]),
+					 req.iov[tcmu_cmd->dbi_cnt + 1]),
 				sizeof(struct tcmu_cmd_entry));
 	command_size = base_command_size
 		+ round_up(scsi_command_size(se_cmd->t_task_cdb), TCMU_OP_ALIGN_SIZE);
 
 	WARN_ON(command_size & (TCMU_OP_ALIGN_SIZE-1));
 
-	spin_lock_irq(&udev->cmdr_lock);
-
-	mb = udev->mb_addr;
-	cmd_head = mb->cmd_head % udev->cmdr_size; /* UAM */
 	if ((command_size > (udev->cmdr_size / 2))
-	    || tcmu_cmd->data_length > (udev->data_size - 1))
+	    || tcmu_cmd->dbi_cnt > udev->max_blocks)
 		pr_warn("TCMU: Request of size %zu/%zu may be too big for %u/%zu "
 			"cmd/data ring buffers\n", command_size, tcmu_cmd->data_length,
 			udev->cmdr_size, udev->data_size);
 
-	while (!is_ring_space_avail(udev, command_size, tcmu_cmd->data_length)) {
-		int ret;
-		DEFINE_WAIT(__wait);
-
-		prepare_to_wait(&udev->wait_cmdr, &__wait, TASK_INTERRUPTIBLE);
+	/*
+	 * Get the data blocks first and fill them without the ring lock,
+	 * the command ring space is only waited for once the data is in.
+	 */
+	spin_lock_irq(&udev->cmdr_lock);
+	ret = tcmu_wait_ring_space(udev, 0, tcmu_cmd->dbi_cnt, zc);
+	if (!ret)
+		tcmu_reserve_blocks(udev, tcmu_cmd);
+	spin_unlock_irq(&udev->cmdr_lock);
+	if (ret)
+		return ret;
 
-		pr_debug("sleeping for ring space\n");
-		spin_unlock_irq(&udev->cmdr_lock);
-		ret = schedule_timeout(msecs_to_jiffies(TCMU_TIME_OUT));
-		finish_wait(&udev->wait_cmdr, &__wait);
-		if (!ret) {
-			pr_warn("tcmu: command timed out\n");
-			return -ETIMEDOUT;
-		}
+	ret = tcmu_map_blocks(udev, tcmu_cmd);
+	if (ret)
+		goto release_blocks;
 
-		spin_lock_irq(&udev->cmdr_lock);
+	if (!zc && (se_cmd->data_direction == DMA_TO_DEVICE
+		    || se_cmd->se_cmd_flags & SCF_BIDI))
+		tcmu_copy_data(udev, tcmu_cmd->dbi, se_cmd->t_data_sg,
+			       se_cmd->t_data_nents, true);
 
-		/* We dropped cmdr_lock, cmd_head is stale */
-		cmd_head = mb->cmd_head % udev->cmdr_size; /* UAM */
+	spin_lock_irq(&udev->cmdr_lock);
+	ret = tcmu_wait_ring_space(udev, command_size, 0, false);
+	if (ret) {
+		spin_unlock_irq(&udev->cmdr_lock);
+		goto unmap_blocks;
 	}
 
+	mb = udev->mb_addr;
+	cmd_head = mb->cmd_head % udev->cmdr_size; /* UAM */
+
 	/* Insert a PAD if end-of-ring space is too small */
 	if (head_to_end(cmd_head, udev->cmdr_size) < command_size) {
 		size_t pad_size = head_to_end(cmd_head, udev->cmdr_size);
@@ -461,22 +710,21 @@ static int tcmu_queue_cmd_ring(struct tcmu_cmd *tcmu_cmd)
 	entry->hdr.kflags = 0;
 	entry->hdr.uflags = 0;
 
-	/*
-	 * Fix up iovecs, and handle if allocation in data ring wrapped.
-	 */
 	iov = &entry->req.iov[0];
 	iov_cnt = 0;
-	copy_to_data_area = (se_cmd->data_direction == DMA_TO_DEVICE
-		|| se_cmd->se_cmd_flags & SCF_BIDI);
-	alloc_and_scatter_data_area(udev, se_cmd->t_data_sg,
-		se_cmd->t_data_nents, &iov, &iov_cnt, copy_to_data_area);
+	tcmu_setup_iovs(udev, tcmu_cmd->dbi, tcmu_cmd->dbi_bidi,
+			tcmu_sgl_len(se_cmd->t_data_sg, se_cmd->t_data_nents),
+			&iov, &iov_cnt);
 	entry->req.iov_cnt = iov_cnt;
 	entry->req.iov_dif_cnt = 0;
 
 	/* Handle BIDI commands */
 	iov_cnt = 0;
-	alloc_and_scatter_data_area(udev, se_cmd->t_bidi_data_sg,
-		se_cmd->t_bidi_data_nents, &iov, &iov_cnt, false);
+	tcmu_setup_iovs(udev, tcmu_cmd->dbi + tcmu_cmd->dbi_bidi,
+			tcmu_cmd->dbi_cnt - tcmu_cmd->dbi_bidi,
+			tcmu_sgl_len(se_cmd->t_bidi_data_sg,
+				     se_cmd->t_bidi_data_nents),
+			&iov, &iov_cnt);
 	entry->req.iov_bidi_cnt = iov_cnt;
 
 	/* All offsets relative to mb_addr, not start of entry! */
@@ -497,6 +745,16 @@ static int tcmu_queue_cmd_ring(struct tcmu_cmd *tcmu_cmd)
 		round_jiffies_up(jiffies + msecs_to_jiffies(TCMU_TIME_OUT)));
 
 	return 0;
+
+unmap_blocks:
+	if (zc)
+		tcmu_unmap_zc_blocks(udev, tcmu_cmd);
+release_blocks:
+	spin_lock_irq(&udev->cmdr_lock);
+	tcmu_release_blocks(udev, tcmu_cmd);
+	spin_unlock_irq(&udev->cmdr_lock);
+	wake_up(&udev->wait_cmdr);
+	return ret;
 }
 
 static int tcmu_queue_cmd(struct se_cmd *se_cmd)
@@ -517,62 +775,111 @@ static int tcmu_queue_cmd(struct se_cmd *se_cmd)
 		idr_remove(&udev->commands, tcmu_cmd->cmd_id);
 		spin_unlock_irq(&udev->commands_lock);
 
-		kmem_cache_free(tcmu_cmd_cache, tcmu_cmd);
+		tcmu_free_cmd(tcmu_cmd);
 	}
 
 	return ret;
 }
 
-static void tcmu_handle_completion(struct tcmu_cmd *cmd, struct tcmu_cmd_entry *entry)
+/*
+ * Pick up the status of a command from its ring entry. The rest is done
+ * by tcmu_complete_cmds() after the ring lock is dropped, or for zero
+ * copy commands by tcmu_zc_work() once the pages are unmapped.
+ *
+ * Called with ring lock held. Returns true if zc_work needs to run.
+ */
+static bool tcmu_handle_completion(struct tcmu_cmd *cmd,
+	struct tcmu_cmd_entry *entry, struct list_head *done)
 {
 	struct se_cmd *se_cmd = cmd->se_cmd;
 	struct tcmu_dev *udev = cmd->tcmu_dev;
 
 	if (test_bit(TCMU_CMD_BIT_EXPIRED, &cmd->flags)) {
-		/* cmd has been completed already from timeout, just reclaim data
-		   ring space */
-		UPDATE_HEAD(udev->data_tail, cmd->data_length, udev->data_size);
-		return;
+		/*
+		 * cmd has been completed already from timeout, just reclaim
+		 * data area space. A zero copy cmd may still be on its way
+		 * through zc_work, whichever of us is last frees it.
+		 */
+		if (test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags) &&
+		    !test_and_set_bit(TCMU_CMD_BIT_REAPED, &cmd->flags))
+			return false;
+
+		tcmu_release_blocks(udev, cmd);
+		tcmu_free_cmd(cmd);
+		return false;
 	}
 
 	if (entry->hdr.uflags & TCMU_UFLAG_UNKNOWN_OP) {
-		UPDATE_HEAD(udev->data_tail, cmd->data_length, udev->data_size);
 		pr_warn("TCMU: Userspace set UNKNOWN_OP flag on se_cmd %p\n",
 			cmd->se_cmd);
-		entry->rsp.scsi_status = SAM_STAT_CHECK_CONDITION;
-	} else if (entry->rsp.scsi_status == SAM_STAT_CHECK_CONDITION) {
-		memcpy(se_cmd->sense_buffer, entry->rsp.sense_buffer,
+		cmd->scsi_status = SAM_STAT_CHECK_CONDITION;
+	} else {
+		cmd->scsi_status = entry->rsp.scsi_status;
+		if (cmd->scsi_status == SAM_STAT_CHECK_CONDITION)
+			memcpy(se_cmd->sense_buffer, entry->rsp.sense_buffer,
 			       se_cmd->scsi_sense_length);
+	}
 
-		UPDATE_HEAD(udev->data_tail, cmd->data_length, udev->data_size);
-	} else if (se_cmd->se_cmd_flags & SCF_BIDI) {
-		/* Discard data_out buffer */
-		UPDATE_HEAD(udev->data_tail,
-			(size_t)se_cmd->t_data_sg->length, udev->data_size);
-
-		/* Get Data-In buffer */
-		gather_and_free_data_area(udev,
-			se_cmd->t_bidi_data_sg, se_cmd->t_bidi_data_nents);
-	} else if (se_cmd->data_direction == DMA_FROM_DEVICE) {
-		gather_and_free_data_area(udev,
-			se_cmd->t_data_sg, se_cmd->t_data_nents);
-	} else if (se_cmd->data_direction == DMA_TO_DEVICE) {
-		UPDATE_HEAD(udev->data_tail, cmd->data_length, udev->data_size);
-	} else if (se_cmd->data_direction != DMA_NONE) {
-		pr_warn("TCMU: data direction was %d!\n",
-			se_cmd->data_direction);
+	if (test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags)) {
+		llist_add(&cmd->zc_node, &udev->zc_done);
+		return true;
 	}
 
-	target_complete_cmd(cmd->se_cmd, entry->rsp.scsi_status);
-	cmd->se_cmd = NULL;
+	list_add_tail(&cmd->done_entry, done);
+	return false;
+}
+
+/*
+ * Complete a batch of commands reaped from the ring: copy out their
+ * Data-In buffers and complete them without the ring lock, then give
+ * back all of their blocks in one go.
+ */
+static void tcmu_complete_cmds(struct tcmu_dev *udev, struct list_head *done)
+{
+	struct tcmu_cmd *cmd, *tmp;
+	unsigned long flags;
+
+	if (list_empty(done))
+		return;
+
+	list_for_each_entry(cmd, done, done_entry) {
+		struct se_cmd *se_cmd = cmd->se_cmd;
+
+		if (cmd->scsi_status == SAM_STAT_CHECK_CONDITION) {
+			/* No data to return */
+		} else if (se_cmd->se_cmd_flags & SCF_BIDI) {
+			/* Skip the data_out buffer, get Data-In buffer */
+			tcmu_copy_data(udev, cmd->dbi + cmd->dbi_bidi,
+				se_cmd->t_bidi_data_sg,
+				se_cmd->t_bidi_data_nents, false);
+		} else if (se_cmd->data_direction == DMA_FROM_DEVICE) {
+			tcmu_copy_data(udev, cmd->dbi, se_cmd->t_data_sg,
+				se_cmd->t_data_nents, false);
+		} else if (se_cmd->data_direction != DMA_TO_DEVICE &&
+			   se_cmd->data_direction != DMA_NONE) {
+			pr_warn("TCMU: data direction was %d!\n",
+				se_cmd->data_direction);
+		}
+
+		target_complete_cmd(se_cmd, cmd->scsi_status);
+		cmd->se_cmd = NULL;
+	}
 
-	kmem_cache_free(tcmu_cmd_cache, cmd);
+	spin_lock_irqsave(&udev->cmdr_lock, flags);
+	list_for_each_entry(cmd, done, done_entry)
+		tcmu_release_blocks(udev, cmd);
+	spin_unlock_irqrestore(&udev->cmdr_lock, flags);
+
+	list_for_each_entry_safe(cmd, tmp, done, done_entry)
+		tcmu_free_cmd(cmd);
 }
 
 static unsigned int tcmu_handle_completions(struct tcmu_dev *udev)
 {
 	struct tcmu_mailbox *mb;
 	unsigned long flags;
+	LIST_HEAD(done);
+	bool zc = false;
 	int handled = 0;
 
 	if (test_bit(TCMU_DEV_BIT_BROKEN, &udev->flags)) {
@@ -612,7 +919,7 @@ static unsigned int tcmu_handle_completions(struct tcmu_dev *udev)
 			break;
 		}
 
-		tcmu_handle_completion(cmd, entry);
+		zc |= tcmu_handle_completion(cmd, entry, &done);
 
 		UPDATE_HEAD(udev->cmdr_last_cleaned,
 			    tcmu_hdr_get_len(entry->hdr.len_op),
@@ -626,14 +933,50 @@ static unsigned int tcmu_handle_completions(struct tcmu_dev *udev)
 
 	spin_unlock_irqrestore(&udev->cmdr_lock, flags);
 
+	if (zc)
+		schedule_work(&udev->zc_work);
+
+	tcmu_complete_cmds(udev, &done);
+
 	wake_up(&udev->wait_cmdr);
 
 	return handled;
 }
 
+static void tcmu_zc_work(struct work_struct *work)
+{
+	struct tcmu_dev *udev = container_of(work, struct tcmu_dev, zc_work);
+	struct llist_node *node = llist_del_all(&udev->zc_done);
+	struct tcmu_cmd *cmd, *tmp;
+	bool released = false;
+
+	node = llist_reverse_order(node);
+	llist_for_each_entry_safe(cmd, tmp, node, zc_node) {
+		tcmu_unmap_zc_blocks(udev, cmd);
+
+		target_complete_cmd(cmd->se_cmd, cmd->scsi_status);
+		cmd->se_cmd = NULL;
+
+		/* Expired, its blocks are ours only once userspace is done */
+		if (test_bit(TCMU_CMD_BIT_EXPIRED, &cmd->flags) &&
+		    !test_and_set_bit(TCMU_CMD_BIT_REAPED, &cmd->flags))
+			continue;
+
+		spin_lock_irq(&udev->cmdr_lock);
+		tcmu_release_blocks(udev, cmd);
+		spin_unlock_irq(&udev->cmdr_lock);
+		tcmu_free_cmd(cmd);
+		released = true;
+	}
+
+	if (released)
+		wake_up(&udev->wait_cmdr);
+}
+
 static int tcmu_check_expired_cmd(int id, void *p, void *data)
 {
 	struct tcmu_cmd *cmd = p;
+	struct tcmu_dev *udev = cmd->tcmu_dev;
 
 	if (test_bit(TCMU_CMD_BIT_EXPIRED, &cmd->flags))
 		return 0;
@@ -641,12 +984,23 @@ static int tcmu_check_expired_cmd(int id, void *p, void *data)
 	if (!time_after(jiffies, cmd->deadline))
 		return 0;
 
+	/*
+	 * The cmd stays in the idr until userspace completes it, its data
+	 * blocks can't be reused before that.
+	 */
 	set_bit(TCMU_CMD_BIT_EXPIRED, &cmd->flags);
+
+	if (test_bit(TCMU_CMD_BIT_ZERO_COPY, &cmd->flags)) {
+		/* The pages have to be taken back from userspace first */
+		cmd->scsi_status = SAM_STAT_CHECK_CONDITION;
+		llist_add(&cmd->zc_node, &udev->zc_done);
+		schedule_work(&udev->zc_work);
+		return 0;
+	}
+
 	target_complete_cmd(cmd->se_cmd, SAM_STAT_CHECK_CONDITION);
 	cmd->se_cmd = NULL;
 
-	kmem_cache_free(tcmu_cmd_cache, cmd);
-
 	return 0;
 }
 
@@ -706,6 +1060,12 @@ static struct se_device *tcmu_alloc_device(struct se_hba *hba, const char *name)
 
 	udev->hba = hba;
 
+	udev->max_data_area_mb = TCMU_DEF_MAX_DATA_AREA_MB;
+
+	mutex_init(&udev->data_lock);
+	init_llist_head(&udev->zc_done);
+	INIT_WORK(&udev->zc_work, tcmu_zc_work);
+
 	init_waitqueue_head(&udev->wait_cmdr);
 	spin_lock_init(&udev->cmdr_lock);
 
@@ -750,7 +1110,8 @@ static int tcmu_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	struct uio_info *info = &udev->uio_info;
 	struct page *page;
 	unsigned long offset;
-	void *addr;
+	u32 dbi;
+	int ret = 0;
 
 	int mi = tcmu_find_mem_index(vma);
 	if (mi < 0)
@@ -762,23 +1123,69 @@ static int tcmu_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	 */
 	offset = (vmf->pgoff - mi) << PAGE_SHIFT;
 
-	addr = (void *)(unsigned long)info->mem[mi].addr + offset;
-	if (info->mem[mi].memtype == UIO_MEM_LOGICAL)
-		page = virt_to_page(addr);
-	else
-		page = vmalloc_to_page(addr);
+	if (offset < udev->data_off) {
+		/* The mailbox and command ring */
+		page = vmalloc_to_page((void *)(unsigned long)info->mem[mi].addr
+				       + offset);
+		get_page(page);
+		vmf->page = page;
+		return 0;
+	}
+
+	dbi = (offset - udev->data_off) >> DATA_BLOCK_SHIFT;
+	if (dbi >= udev->nr_blocks)
+		return VM_FAULT_SIGBUS;
+
+	mutex_lock(&udev->data_lock);
+	page = udev->data_blocks[dbi];
+	if (!page) {
+		mutex_unlock(&udev->data_lock);
+		return VM_FAULT_SIGBUS;
+	}
 	get_page(page);
+	/*
+	 * Zero copy pages go back to the command on completion. Keep the
+	 * page locked until its pte is in, so tcmu_unmap_zc_blocks() can
+	 * wait for us before zapping.
+	 */
+	if (dbi >= udev->max_blocks) {
+		lock_page(page);
+		ret = VM_FAULT_LOCKED;
+	}
+	mutex_unlock(&udev->data_lock);
+
 	vmf->page = page;
-	return 0;
+	return ret;
+}
+
+static void tcmu_vma_open(struct vm_area_struct *vma)
+{
+	struct tcmu_dev *udev = vma->vm_private_data;
+
+	mutex_lock(&udev->data_lock);
+	udev->nr_vmas++;
+	mutex_unlock(&udev->data_lock);
+}
+
+static void tcmu_vma_close(struct vm_area_struct *vma)
+{
+	struct tcmu_dev *udev = vma->vm_private_data;
+
+	mutex_lock(&udev->data_lock);
+	udev->nr_vmas--;
+	mutex_unlock(&udev->data_lock);
 }
 
 static const struct vm_operations_struct tcmu_vm_ops = {
+	.open = tcmu_vma_open,
+	.close = tcmu_vma_close,
 	.fault = tcmu_vma_fault,
 };
 
 static int tcmu_mmap(struct uio_info *info, struct vm_area_struct *vma)
 {
 	struct tcmu_dev *udev = container_of(info, struct tcmu_dev, uio_info);
+	int ret = 0;
 
 	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
 	vma->vm_ops = &tcmu_vm_ops;
@@ -786,10 +1193,23 @@ static int tcmu_mmap(struct uio_info *info, struct vm_area_struct *vma)
 	vma->vm_private_data = udev;
 
 	/* Ensure the mmap is exactly the right size */
-	if (vma_pages(vma) != (TCMU_RING_SIZE >> PAGE_SHIFT))
+	if (vma_pages(vma) != (udev->ring_size >> PAGE_SHIFT))
 		return -EINVAL;
 
-	return 0;
+	/*
+	 * Zero copy pages are taken back through the file mapping, all
+	 * mappings of the ring must share it.
+	 */
+	mutex_lock(&udev->data_lock);
+	if (udev->nr_vmas && udev->mapping != vma->vm_file->f_mapping) {
+		ret = -EBUSY;
+	} else {
+		udev->mapping = vma->vm_file->f_mapping;
+		udev->nr_vmas++;
+	}
+	mutex_unlock(&udev->data_lock);
+
+	return ret;
 }
 
 static int tcmu_open(struct uio_info *info, struct inode *inode)
@@ -880,19 +1300,37 @@ static int tcmu_configure_device(struct se_device *dev)
 
 	info->name = str;
 
-	udev->mb_addr = vzalloc(TCMU_RING_SIZE);
+	udev->max_blocks = (udev->max_data_area_mb << 20) >> DATA_BLOCK_SHIFT;
+	udev->nr_blocks = udev->max_blocks;
+	if (udev->zero_copy)
+		udev->nr_blocks += udev->max_blocks;
+	udev->free_blocks = udev->max_blocks;
+	udev->free_zc_blocks = udev->nr_blocks - udev->max_blocks;
+
+	udev->data_bitmap = kcalloc(BITS_TO_LONGS(udev->nr_blocks),
+				    sizeof(unsigned long), GFP_KERNEL);
+	udev->data_blocks = vzalloc(udev->nr_blocks * sizeof(struct page *));
+	if (!udev->data_bitmap || !udev->data_blocks) {
+		ret = -ENOMEM;
+		goto err_blocks;
+	}
+
+	udev->mb_addr = vzalloc(CMDR_SIZE);
 	if (!udev->mb_addr) {
 		ret = -ENOMEM;
-		goto err_vzalloc;
+		goto err_blocks;
 	}
 
 	/* mailbox fits in first part of CMDR space */
 	udev->cmdr_size = CMDR_SIZE - CMDR_OFF;
 	udev->data_off = CMDR_SIZE;
-	udev->data_size = TCMU_RING_SIZE - CMDR_SIZE;
+	udev->data_size = (size_t)udev->max_blocks << DATA_BLOCK_SHIFT;
+	udev->ring_size = CMDR_SIZE +
+		((size_t)udev->nr_blocks << DATA_BLOCK_SHIFT);
 
 	mb = udev->mb_addr;
 	mb->version = TCMU_MAILBOX_VERSION;
+	mb->flags = udev->zero_copy ? TCMU_MAILBOX_FLAG_ZERO_COPY : 0;
 	mb->cmdr_off = CMDR_OFF;
 	mb->cmdr_size = udev->cmdr_size;
 
@@ -903,7 +1341,7 @@ static int tcmu_configure_device(struct se_device *dev)
 
 	info->mem[0].name = "tcm-user command & data buffer";
 	info->mem[0].addr = (phys_addr_t) udev->mb_addr;
-	info->mem[0].size = TCMU_RING_SIZE;
+	info->mem[0].size = udev->ring_size;
 	info->mem[0].memtype = UIO_MEM_VIRTUAL;
 
 	info->irqcontrol = tcmu_irqcontrol;
@@ -933,7 +1371,12 @@ err_netlink:
 	uio_unregister_device(&udev->uio_info);
 err_register:
 	vfree(udev->mb_addr);
-err_vzalloc:
+	udev->mb_addr = NULL;
+err_blocks:
+	vfree(udev->data_blocks);
+	udev->data_blocks = NULL;
+	kfree(udev->data_bitmap);
+	udev->data_bitmap = NULL;
 	kfree(info->name);
 
 	return ret;
@@ -948,6 +1391,15 @@ static int tcmu_check_pending_cmd(int id, void *p, void *data)
 	return -EINVAL;
 }
 
+static int tcmu_free_expired_cmd(int id, void *p, void *data)
+{
+	struct tcmu_cmd *cmd = p;
+
+	if (test_bit(TCMU_CMD_BIT_EXPIRED, &cmd->flags))
+		tcmu_free_cmd(cmd);
+	return 0;
+}
+
 static void tcmu_dev_call_rcu(struct rcu_head *p)
 {
 	struct se_device *dev = container_of(p, struct se_device, rcu_head);
@@ -960,18 +1412,28 @@ static void tcmu_free_device(struct se_device *dev)
 {
 	struct tcmu_dev *udev = TCMU_DEV(dev);
 	int i;
+	u32 dbi;
 
 	del_timer_sync(&udev->timeout);
+	flush_work(&udev->zc_work);
 
 	vfree(udev->mb_addr);
 
 	/* Upper layer should drain all requests before calling this */
 	spin_lock_irq(&udev->commands_lock);
 	i = idr_for_each(&udev->commands, tcmu_check_pending_cmd, NULL);
+	idr_for_each(&udev->commands, tcmu_free_expired_cmd, NULL);
 	idr_destroy(&udev->commands);
 	spin_unlock_irq(&udev->commands_lock);
 	WARN_ON(i);
 
+	/* Only the data area owns its pages, the zero copy window is empty */
+	for (dbi = 0; udev->data_blocks && dbi < udev->max_blocks; dbi++)
+		if (udev->data_blocks[dbi])
+			__free_page(udev->data_blocks[dbi]);
+	vfree(udev->data_blocks);
+	kfree(udev->data_bitmap);
+
 	/* Device was configured */
 	if (udev->uio_info.uio_dev) {
 		tcmu_netlink_event(TCMU_CMD_REMOVED_DEVICE, udev->uio_info.name,
@@ -985,13 +1447,16 @@ static void tcmu_free_device(struct se_device *dev)
 }
 
 enum {
-	Opt_dev_config, Opt_dev_size, Opt_hw_block_size, Opt_err,
+	Opt_dev_config, Opt_dev_size, Opt_hw_block_size, Opt_max_data_area_mb,
+	Opt_zero_copy, Opt_err,
 };
 
 static match_table_t tokens = {
 	{Opt_dev_config, "dev_config=%s"},
 	{Opt_dev_size, "dev_size=%u"},
 	{Opt_hw_block_size, "hw_block_size=%u"},
+	{Opt_max_data_area_mb, "max_data_area_mb=%u"},
+	{Opt_zero_copy, "zero_copy=%d"},
 	{Opt_err, NULL}
 };
 
@@ -1001,7 +1466,7 @@ static ssize_t tcmu_set_configfs_dev_params(struct se_device *dev,
 	struct tcmu_dev *udev = TCMU_DEV(dev);
 	char *orig, *ptr, *opts, *arg_p;
 	substring_t args[MAX_OPT_ARGS];
-	int ret = 0, token;
+	int ret = 0, token, arg;
 	unsigned long tmp_ul;
 
 	opts = kstrdup(page, GFP_KERNEL);
@@ -1053,6 +1518,38 @@ static ssize_t tcmu_set_configfs_dev_params(struct se_device *dev,
 			}
 			dev->dev_attrib.hw_block_size = tmp_ul;
 			break;
+		case Opt_max_data_area_mb:
+			if (dev->dev_flags & DF_CONFIGURED) {
+				pr_err("Unable to change max_data_area_mb after device is configured\n");
+				ret = -EBUSY;
+				break;
+			}
+			ret = match_int(&args[0], &arg);
+			if (ret < 0) {
+				pr_err("match_int() failed for max_data_area_mb=\n");
+				break;
+			}
+			if (arg <= 0 || arg > TCMU_MAX_DATA_AREA_MB) {
+				pr_err("max_data_area_mb must be between 1 and %d\n",
+				       TCMU_MAX_DATA_AREA_MB);
+				ret = -EINVAL;
+				break;
+			}
+			udev->max_data_area_mb = arg;
+			break;
+		case Opt_zero_copy:
+			if (dev->dev_flags & DF_CONFIGURED) {
+				pr_err("Unable to change zero_copy after device is configured\n");
+				ret = -EBUSY;
+				break;
+			}
+			ret = match_int(&args[0], &arg);
+			if (ret < 0) {
+				pr_err("match_int() failed for zero_copy=\n");
+				break;
+			}
+			udev->zero_copy = arg;
+			break;
 		default:
 			break;
 		}
@@ -1069,7 +1566,10 @@ static ssize_t tcmu_show_configfs_dev_params(struct se_device *dev, char *b)
 
 	bl = sprintf(b + bl, "Config: %s ",
 		     udev->dev_config[0] ? udev->dev_config : "NULL");
-	bl += sprintf(b + bl, "Size: %zu\n", udev->dev_size);
+	bl += sprintf(b + bl, "Size: %zu ", udev->dev_size);
+	bl += sprintf(b + bl, "MaxDataAreaMB: %u ZeroCopy: %d ",
+		      udev->max_data_area_mb, udev->zero_copy);
+	bl += sprintf(b + bl, "DataPages: %u\n", udev->nr_data_pages);
 
 	return bl;
 }
@@ -14,6 +14,7 @@
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
 #include <linux/workqueue.h>
 #include <linux/file.h>
 #include <linux/slab.h>
@@ -39,6 +40,10 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
 
+/* Max number of packets handled as one batch: TX used entries written
+ * back together, RX frames taken off a tun backend in one go. */
+#define VHOST_NET_BATCH 64
+
 /* MAX number of TX used buffers for outstanding zerocopy */
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
@@ -95,6 +100,11 @@ struct vhost_net_virtqueue {
 	/* Reference counting for outstanding ubufs.
 	 * Protected by vq mutex. Writers must also take device mutex. */
 	struct vhost_net_ubuf_ref *ubufs;
+	/* RX frames already taken off a tun backend's receive queue.
+	 * Protected by vq mutex. */
+	struct sk_buff_head rxq;
+	/* Backend is tun: RX frames are dequeued here in batches. */
+	bool rx_batch;
 };
 
 struct vhost_net {
@@ -287,6 +297,55 @@ static void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool success)
 	rcu_read_unlock_bh();
 }
 
+static unsigned long busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_dev *dev,
+				unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_has_work(dev);
+}
+
+static bool vhost_exceeds_maxpend(struct vhost_net *net)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
+
+	/* Handle upend_idx wrap around */
+	return (nvq->upend_idx + nvq->vq.num - VHOST_MAX_PEND) % UIO_MAXIOV ==
+	       nvq->done_idx;
+}
+
+/* Like vhost_get_vq_desc(), but if the ring is empty keep polling it for
+ * up to the busy loop timeout before giving up, as long as nothing else
+ * wants the worker or the CPU. */
+static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
+				    struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num)
+{
+	unsigned long uninitialized_var(endtime);
+	int r = vhost_get_vq_desc(vq, iov, iov_size, out_num, in_num,
+				  NULL, NULL);
+
+	if (r == vq->num && vq->busyloop_timeout) {
+		preempt_disable();
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(vq->dev, endtime) &&
+		       vhost_vq_avail_empty(vq->dev, vq))
+			cpu_relax_lowlatency();
+		preempt_enable();
+		r = vhost_get_vq_desc(vq, iov, iov_size, out_num, in_num,
+				      NULL, NULL);
+	}
+
+	return r;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -308,6 +367,8 @@ static void handle_tx(struct vhost_net *net)
 	struct socket *sock;
 	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
 	bool zcopy, zcopy_used;
+	/* Used entries of the copy path not yet written back, in vq->heads */
+	int batched = 0;
 
 	mutex_lock(&vq->mutex);
 	sock = vq->private_data;
@@ -324,17 +385,13 @@ static void handle_tx(struct vhost_net *net)
 		if (zcopy)
 			vhost_zerocopy_signal_used(net, vq);
 
-		/* If more outstanding DMAs, queue the work.
-		 * Handle upend_idx wrap around
-		 */
-		if (unlikely((nvq->upend_idx + vq->num - VHOST_MAX_PEND)
-			      % UIO_MAXIOV == nvq->done_idx))
+		/* If more outstanding DMAs, queue the work. */
+		if (unlikely(vhost_exceeds_maxpend(net)))
 			break;
 
-		head = vhost_get_vq_desc(vq, vq->iov,
-					 ARRAY_SIZE(vq->iov),
-					 &out, &in,
-					 NULL, NULL);
+		head = vhost_net_tx_get_vq_desc(net, vq, vq->iov,
+						ARRAY_SIZE(vq->iov),
+						&out, &in);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -388,6 +445,15 @@ static void handle_tx(struct vhost_net *net)
 			msg.msg_control = NULL;
 			ubufs = NULL;
 		}
+
+		/* Let the backend hold on to the packet if more follow */
+		if (total_len + len < VHOST_NET_WEIGHT &&
+		    !vhost_vq_avail_empty(&net->dev, vq) &&
+		    likely(!vhost_exceeds_maxpend(net)))
+			msg.msg_flags |= MSG_MORE;
+		else
+			msg.msg_flags &= ~MSG_MORE;
+
 		/* TODO: Check specific error and bomb out unless ENOBUFS? */
 		err = sock->ops->sendmsg(sock, &msg, len);
 		if (unlikely(err < 0)) {
@@ -402,10 +468,20 @@ static void handle_tx(struct vhost_net *net)
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
+		if (zcopy_used) {
 			vhost_zerocopy_signal_used(net, vq);
+		} else if (zcopy) {
+			/* vq->heads is in use for pending zerocopy DMAs */
+			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		} else {
+			vq->heads[batched].id = cpu_to_vhost32(vq, head);
+			vq->heads[batched].len = 0;
+			if (++batched == VHOST_NET_BATCH) {
+				vhost_add_used_and_signal_n(&net->dev, vq,
+							    vq->heads, batched);
+				batched = 0;
+			}
+		}
 		total_len += len;
 		vhost_net_tx_packet(net);
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
@@ -413,6 +489,8 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	if (batched)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads, batched);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -435,6 +513,109 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+/* Take up to a batch of frames off the backend's receive queue under a
+ * single acquisition of its lock. */
+static void vhost_net_rxq_fill(struct vhost_net_virtqueue *nvq,
+			       struct sock *sk)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&sk->sk_receive_queue.lock, flags);
+	for (i = 0; i < VHOST_NET_BATCH; i++) {
+		skb = __skb_dequeue(&sk->sk_receive_queue);
+		if (!skb)
+			break;
+		__skb_queue_tail(&nvq->rxq, skb);
+	}
+	spin_unlock_irqrestore(&sk->sk_receive_queue.lock, flags);
+}
+
+/* Give frames not passed to the guest yet back to the backend, in order,
+ * before it is detached. */
+static void vhost_net_rxq_unconsume(struct vhost_net_virtqueue *nvq,
+				    struct sock *sk)
+{
+	unsigned long flags;
+
+	if (skb_queue_empty(&nvq->rxq))
+		return;
+
+	spin_lock_irqsave(&sk->sk_receive_queue.lock, flags);
+	skb_queue_splice_init(&nvq->rxq, &sk->sk_receive_queue);
+	spin_unlock_irqrestore(&sk->sk_receive_queue.lock, flags);
+}
+
+static int vhost_net_rxq_head_len(struct vhost_net_virtqueue *nvq,
+				  struct sock *sk)
+{
+	struct sk_buff *head;
+	int len;
+
+	if (!nvq->rx_batch)
+		return peek_head_len(sk);
+
+	if (skb_queue_empty(&nvq->rxq))
+		vhost_net_rxq_fill(nvq, sk);
+	head = skb_peek(&nvq->rxq);
+	if (!head)
+		return 0;
+
+	len = head->len;
+	if (skb_vlan_tag_present(head))
+		len += VLAN_HLEN;
+	return len;
+}
+
+/* The frame recvmsg() is to consume: handed to tun through msg_control, or
+ * NULL to have the backend dequeue it itself. */
+static struct sk_buff *vhost_net_rxq_consume(struct vhost_net_virtqueue *nvq)
+{
+	if (!nvq->rx_batch)
+		return NULL;
+	return __skb_dequeue(&nvq->rxq);
+}
+
+static bool vhost_net_rx_empty(struct vhost_net_virtqueue *nvq,
+			       struct sock *sk)
+{
+	return skb_queue_empty(&nvq->rxq) &&
+	       skb_queue_empty(&sk->sk_receive_queue);
+}
+
+/* If the backend has nothing for us, keep polling it, and the TX ring that
+ * the same worker serves, for up to the busy loop timeout. */
+static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_RX];
+	struct vhost_virtqueue *tvq = &net->vqs[VHOST_NET_VQ_TX].vq;
+	unsigned long uninitialized_var(endtime);
+	int len = vhost_net_rxq_head_len(nvq, sk);
+
+	if (!len && nvq->vq.busyloop_timeout) {
+		/* Nests inside the RX vq mutex, never the other way round */
+		mutex_lock_nested(&tvq->mutex, 1);
+		vhost_disable_notify(&net->dev, tvq);
+
+		preempt_disable();
+		endtime = busy_clock() + nvq->vq.busyloop_timeout;
+		while (vhost_can_busy_poll(&net->dev, endtime) &&
+		       vhost_net_rx_empty(nvq, sk) &&
+		       vhost_vq_avail_empty(&net->dev, tvq))
+			cpu_relax_lowlatency();
+		preempt_enable();
+
+		if (vhost_enable_notify(&net->dev, tvq))
+			vhost_poll_queue(&tvq->poll);
+		mutex_unlock(&tvq->mutex);
+
+		len = vhost_net_rxq_head_len(nvq, sk);
+	}
+
+	return len;
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -523,7 +704,7 @@ static void handle_rx(struct vhost_net *net)
 	struct msghdr msg = {
 		.msg_name = NULL,
 		.msg_namelen = 0,
-		.msg_control = NULL, /* FIXME: get and handle RX aux data. */
+		.msg_control = NULL, /* Frame taken off the tun backend, if any */
 		.msg_controllen = 0,
 		.msg_flags = MSG_DONTWAIT,
 	};
@@ -553,7 +734,7 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(vq, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(net, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
 		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
@@ -565,6 +746,7 @@ static void handle_rx(struct vhost_net *net)
 		/* On overrun, truncate and discard */
 		if (unlikely(headcount > UIO_MAXIOV)) {
 			iov_iter_init(&msg.msg_iter, READ, vq->iov, 1, 1);
+			msg.msg_control = vhost_net_rxq_consume(nvq);
 			err = sock->ops->recvmsg(sock, &msg,
 						 1, MSG_DONTWAIT | MSG_TRUNC);
 			pr_debug("Discarded rx packet: len %zd\n", sock_len);
@@ -591,6 +773,7 @@ static void handle_rx(struct vhost_net *net)
 			 */
 			iov_iter_advance(&msg.msg_iter, vhost_hlen);
 		}
+		msg.msg_control = vhost_net_rxq_consume(nvq);
 		err = sock->ops->recvmsg(sock, &msg,
 					 sock_len, MSG_DONTWAIT | MSG_TRUNC);
 		/* Userspace might have consumed the packet meanwhile:
@@ -703,6 +886,8 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].rx_batch = false;
+		skb_queue_head_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
 
@@ -743,12 +928,17 @@ static int vhost_net_enable_vq(struct vhost_net *n,
 static struct socket *vhost_net_stop_vq(struct vhost_net *n,
 					struct vhost_virtqueue *vq)
 {
+	struct vhost_net_virtqueue *nvq =
+		container_of(vq, struct vhost_net_virtqueue, vq);
 	struct socket *sock;
 
 	mutex_lock(&vq->mutex);
 	sock = vq->private_data;
 	vhost_net_disable_vq(n, vq);
+	if (sock)
+		vhost_net_rxq_unconsume(nvq, sock->sk);
 	vq->private_data = NULL;
+	nvq->rx_batch = false;
 	mutex_unlock(&vq->mutex);
 	return sock;
 }
@@ -916,7 +1106,11 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 		}
 
 		vhost_net_disable_vq(n, vq);
+		if (oldsock)
+			vhost_net_rxq_unconsume(nvq, oldsock->sk);
 		vq->private_data = sock;
+		nvq->rx_batch = sock && index == VHOST_NET_VQ_RX &&
+				!IS_ERR(tun_get_socket(sock->file));
 		r = vhost_init_used(vq);
 		if (r)
 			goto err_used;
@@ -951,6 +1145,8 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 
 err_used:
 	vq->private_data = oldsock;
+	nvq->rx_batch = oldsock && index == VHOST_NET_VQ_RX &&
+			!IS_ERR(tun_get_socket(oldsock->file));
 	vhost_net_enable_vq(n, vq);
 	if (ubufs)
 		vhost_net_ubuf_put_wait_and_free(ubufs);
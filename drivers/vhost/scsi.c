@@ -184,6 +184,9 @@ struct vhost_scsi_virtqueue {
 	 * Writers must also take dev mutex and flush under it.
 	 */
 	int inflight_idx;
+	/* Completed commands, written back on this queue's worker */
+	struct llist_head completion_list;
+	struct vhost_work completion_work;
 };
 
 struct vhost_scsi {
@@ -194,9 +197,6 @@ struct vhost_scsi {
 	struct vhost_dev dev;
 	struct vhost_scsi_virtqueue vqs[VHOST_SCSI_MAX_VQ];
 
-	struct vhost_work vs_completion_work; /* cmd completion work item */
-	struct llist_head vs_completion_list; /* cmd completion queue */
-
 	struct vhost_work vs_event_work; /* evt injection work item */
 	struct llist_head vs_event_list; /* evt injection queue */
 
@@ -372,11 +372,12 @@ static int vhost_scsi_get_cmd_state(struct se_cmd *se_cmd)
 
 static void vhost_scsi_complete_cmd(struct vhost_scsi_cmd *cmd)
 {
-	struct vhost_scsi *vs = cmd->tvc_vhost;
+	struct vhost_scsi_virtqueue *q = container_of(cmd->tvc_vq,
+					struct vhost_scsi_virtqueue, vq);
 
-	llist_add(&cmd->tvc_completion_list, &vs->vs_completion_list);
+	llist_add(&cmd->tvc_completion_list, &q->completion_list);
 
-	vhost_work_queue(&vs->dev, &vs->vs_completion_work);
+	vhost_vq_work_queue(&q->vq, &q->completion_work);
 }
 
 static int vhost_scsi_queue_data_in(struct se_cmd *se_cmd)
@@ -520,25 +521,28 @@ static void vhost_scsi_evt_work(struct vhost_work *work)
 	mutex_unlock(&vq->mutex);
 }
 
-/* Fill in status and signal that we are done processing this command
+/* Fill in status and signal that we are done processing these commands
  *
- * This is scheduled in the vhost work queue so we are called with the owner
- * process mm and can access the vring.
+ * This is scheduled on the worker of the virtqueue the commands came from,
+ * so we are called with the owner process mm, can access the vring, and
+ * are serialized with the queue's kick handler.  Used entries are written
+ * back together and the guest is signalled once per batch, subject to
+ * event index suppression.
  */
 static void vhost_scsi_complete_cmd_work(struct vhost_work *work)
 {
-	struct vhost_scsi *vs = container_of(work, struct vhost_scsi,
-					vs_completion_work);
-	DECLARE_BITMAP(signal, VHOST_SCSI_MAX_VQ);
+	struct vhost_scsi_virtqueue *q = container_of(work,
+				struct vhost_scsi_virtqueue, completion_work);
+	struct vhost_virtqueue *vq = &q->vq;
 	struct virtio_scsi_cmd_resp v_rsp;
 	struct vhost_scsi_cmd *cmd;
 	struct llist_node *llnode;
 	struct se_cmd *se_cmd;
 	struct iov_iter iov_iter;
-	int ret, vq;
+	bool signal = false;
+	int ret, batched = 0;
 
-	bitmap_zero(signal, VHOST_SCSI_MAX_VQ);
-	llnode = llist_del_all(&vs->vs_completion_list);
+	llnode = llist_del_all(&q->completion_list);
 	while (llnode) {
 		cmd = llist_entry(llnode, struct vhost_scsi_cmd,
 				     tvc_completion_list);
@@ -561,21 +565,24 @@ static void vhost_scsi_complete_cmd_work(struct vhost_work *work)
 			      cmd->tvc_in_iovs, sizeof(v_rsp));
 		ret = copy_to_iter(&v_rsp, sizeof(v_rsp), &iov_iter);
 		if (likely(ret == sizeof(v_rsp))) {
-			struct vhost_scsi_virtqueue *q;
-			vhost_add_used(cmd->tvc_vq, cmd->tvc_vq_desc, 0);
-			q = container_of(cmd->tvc_vq, struct vhost_scsi_virtqueue, vq);
-			vq = q - vs->vqs;
-			__set_bit(vq, signal);
+			vq->heads[batched].id = cpu_to_vhost32(vq,
+							cmd->tvc_vq_desc);
+			vq->heads[batched].len = 0;
+			if (++batched == UIO_MAXIOV) {
+				vhost_add_used_n(vq, vq->heads, batched);
+				batched = 0;
+			}
+			signal = true;
 		} else
 			pr_err("Faulted on virtio_scsi_cmd_resp\n");
 
 		vhost_scsi_free_cmd(cmd);
 	}
 
-	vq = -1;
-	while ((vq = find_next_bit(signal, VHOST_SCSI_MAX_VQ, vq + 1))
-		< VHOST_SCSI_MAX_VQ)
-		vhost_signal(&vs->dev, &vs->vqs[vq].vq);
+	if (batched)
+		vhost_add_used_n(vq, vq->heads, batched);
+	if (signal)
+		vhost_signal(vq->dev, vq);
 }
 
 static struct vhost_scsi_cmd *
@@ -1175,9 +1182,11 @@ static void vhost_scsi_flush(struct vhost_scsi *vs)
 		kref_put(&old_inflight[i]->kref, vhost_scsi_done_inflight);
 
 	/* Flush both the vhost poll and vhost work */
-	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++)
+	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++) {
 		vhost_scsi_flush_vq(vs, i);
-	vhost_work_flush(&vs->dev, &vs->vs_completion_work);
+		vhost_vq_work_flush(&vs->vqs[i].vq,
+				    &vs->vqs[i].completion_work);
+	}
 	vhost_work_flush(&vs->dev, &vs->vs_event_work);
 
 	/* Wait for all reqs issued before the flush to be finished */
@@ -1426,7 +1435,6 @@ static int vhost_scsi_open(struct inode *inode, struct file *f)
 	if (!vqs)
 		goto err_vqs;
 
-	vhost_work_init(&vs->vs_completion_work, vhost_scsi_complete_cmd_work);
 	vhost_work_init(&vs->vs_event_work, vhost_scsi_evt_work);
 
 	vs->vs_events_nr = 0;
@@ -1439,6 +1447,13 @@ static int vhost_scsi_open(struct inode *inode, struct file *f)
 	for (i = VHOST_SCSI_VQ_IO; i < VHOST_SCSI_MAX_VQ; i++) {
 		vqs[i] = &vs->vqs[i].vq;
 		vs->vqs[i].vq.handle_kick = vhost_scsi_handle_kick;
+		/* Keep guest multiqueue from serializing on one host core */
+		vs->vqs[i].vq.own_worker = true;
+	}
+	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++) {
+		init_llist_head(&vs->vqs[i].completion_list);
+		vhost_work_init(&vs->vqs[i].completion_work,
+				vhost_scsi_complete_cmd_work);
 	}
 	vhost_dev_init(&vs->dev, vqs, VHOST_SCSI_MAX_VQ);
 
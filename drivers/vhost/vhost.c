@@ -145,6 +145,15 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 }
 EXPORT_SYMBOL_GPL(vhost_work_init);
 
+static void vhost_worker_init(struct vhost_worker *worker,
+			      struct vhost_dev *dev)
+{
+	spin_lock_init(&worker->work_lock);
+	INIT_LIST_HEAD(&worker->work_list);
+	worker->task = NULL;
+	worker->dev = dev;
+}
+
 /* Init poll structure */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
 		     unsigned long mask, struct vhost_dev *dev)
@@ -153,6 +162,7 @@ void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = NULL;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -193,61 +203,102 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-static bool vhost_work_seq_done(struct vhost_dev *dev, struct vhost_work *work,
-				unsigned seq)
+/* Kick polls of virtqueues run on the virtqueue's worker, which is the
+ * device's unless the driver asked for one per virtqueue. */
+static struct vhost_worker *vhost_poll_worker(struct vhost_poll *poll)
+{
+	return poll->vq ? poll->vq->worker : &poll->dev->worker;
+}
+
+static bool vhost_work_seq_done(struct vhost_worker *worker,
+				struct vhost_work *work, unsigned seq)
 {
 	int left;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	left = seq - work->done_seq;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	return left <= 0;
 }
 
-void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void __vhost_work_flush(struct vhost_worker *worker,
+			       struct vhost_work *work)
 {
 	unsigned seq;
 	int flushing;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	seq = work->queue_seq;
 	work->flushing++;
-	spin_unlock_irq(&dev->work_lock);
-	wait_event(work->done, vhost_work_seq_done(dev, work, seq));
-	spin_lock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
+	wait_event(work->done, vhost_work_seq_done(worker, work, seq));
+	spin_lock_irq(&worker->work_lock);
 	flushing = --work->flushing;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	BUG_ON(flushing < 0);
 }
+
+void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+{
+	__vhost_work_flush(&dev->worker, work);
+}
 EXPORT_SYMBOL_GPL(vhost_work_flush);
 
+/* Flush work queued with vhost_vq_work_queue() */
+void vhost_vq_work_flush(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	__vhost_work_flush(vq->worker, work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_flush);
+
 /* Flush any work that has been scheduled. When calling this, don't hold any
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	__vhost_work_flush(vhost_poll_worker(poll), &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
-void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+static void __vhost_work_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->work_lock, flags);
+	spin_lock_irqsave(&worker->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		spin_unlock_irqrestore(&dev->work_lock, flags);
-		wake_up_process(dev->worker);
+		spin_unlock_irqrestore(&worker->work_lock, flags);
+		wake_up_process(worker->task);
 	} else {
-		spin_unlock_irqrestore(&dev->work_lock, flags);
+		spin_unlock_irqrestore(&worker->work_lock, flags);
 	}
 }
+
+void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+{
+	__vhost_work_queue(&dev->worker, work);
+}
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+/* Queue work that touches @vq's rings on the thread that serves its kicks,
+ * so that it is serialized with them. */
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	__vhost_work_queue(vq->worker, work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
+/* A lockless hint for busy polling code to exit the loop */
+bool vhost_has_work(struct vhost_dev *dev)
+{
+	return !list_empty(&dev->worker.work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	__vhost_work_queue(vhost_poll_worker(poll), &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -278,11 +329,13 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->memory = NULL;
 	vq->is_le = virtio_legacy_is_little_endian();
 	vhost_vq_reset_user_be(vq);
+	vq->busyloop_timeout = 0;
 }
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 	mm_segment_t oldfs = get_fs();
@@ -294,7 +347,7 @@ static int vhost_worker(void *data)
 		/* mb paired w/ kthread_stop */
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		spin_lock_irq(&dev->work_lock);
+		spin_lock_irq(&worker->work_lock);
 		if (work) {
 			work->done_seq = seq;
 			if (work->flushing)
@@ -302,18 +355,18 @@ static int vhost_worker(void *data)
 		}
 
 		if (kthread_should_stop()) {
-			spin_unlock_irq(&dev->work_lock);
+			spin_unlock_irq(&worker->work_lock);
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
 		} else
 			work = NULL;
-		spin_unlock_irq(&dev->work_lock);
+		spin_unlock_irq(&worker->work_lock);
 
 		if (work) {
 			__set_current_state(TASK_RUNNING);
@@ -383,9 +436,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->log_file = NULL;
 	dev->memory = NULL;
 	dev->mm = NULL;
-	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
-	dev->worker = NULL;
+	vhost_worker_init(&dev->worker, dev);
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		vq = dev->vqs[i];
@@ -393,11 +444,14 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->indirect = NULL;
 		vq->heads = NULL;
 		vq->dev = dev;
+		vq->worker = &dev->worker;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
-		if (vq->handle_kick)
+		if (vq->handle_kick) {
 			vhost_poll_init(&vq->poll, vq->handle_kick,
 					POLLIN, dev);
+			vq->poll.vq = vq;
+		}
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -424,17 +478,66 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	__vhost_work_queue(worker, &attach.work);
+	__vhost_work_flush(worker, &attach.work);
 	return attach.ret;
 }
 
+/* Give @vq a worker thread of its own, in the owner's cgroups like the
+ * device's.  Called with the vq mutex held and its kick poll stopped. */
+static int vhost_vq_worker_create(struct vhost_virtqueue *vq, int idx)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int err;
+
+	worker = kmalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return -ENOMEM;
+	vhost_worker_init(worker, vq->dev);
+
+	task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+			      current->pid, idx);
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto err_task;
+	}
+	worker->task = task;
+	wake_up_process(task);		/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_cgroup;
+
+	vq->worker = worker;
+	return 0;
+
+err_cgroup:
+	kthread_stop(task);
+err_task:
+	kfree(worker);
+	return err;
+}
+
+static void vhost_vq_worker_destroy(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = vq->worker;
+
+	if (worker == &vq->dev->worker)
+		return;
+
+	WARN_ON(!list_empty(&worker->work_list));
+	kthread_stop(worker->task);
+	kfree(worker);
+	vq->worker = &vq->dev->worker;
+}
+
 /* Caller should have device mutex */
 bool vhost_dev_has_owner(struct vhost_dev *dev)
 {
@@ -456,16 +559,17 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
+	worker = kthread_create(vhost_worker, &dev->worker, "vhost-%d",
+				current->pid);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
 		goto err_worker;
 	}
 
-	dev->worker = worker;
+	dev->worker.task = worker;
 	wake_up_process(worker);	/* avoid contributing to loadavg */
 
-	err = vhost_attach_cgroups(dev);
+	err = vhost_attach_cgroups(&dev->worker);
 	if (err)
 		goto err_cgroup;
 
@@ -476,7 +580,7 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 	return 0;
 err_cgroup:
 	kthread_stop(worker);
-	dev->worker = NULL;
+	dev->worker.task = NULL;
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -551,10 +655,12 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 	/* No one will access memory at this point */
 	kvfree(dev->memory);
 	dev->memory = NULL;
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
+	for (i = 0; i < dev->nvqs; ++i)
+		vhost_vq_worker_destroy(dev->vqs[i]);
+	WARN_ON(!list_empty(&dev->worker.work_list));
+	if (dev->worker.task) {
+		kthread_stop(dev->worker.task);
+		dev->worker.task = NULL;
 	}
 	if (dev->mm)
 		mmput(dev->mm);
@@ -912,6 +1018,19 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 	case VHOST_GET_VRING_ENDIAN:
 		r = vhost_get_vring_endian(vq, idx, argp);
 		break;
+	case VHOST_SET_VRING_BUSYLOOP_TIMEOUT:
+		if (copy_from_user(&s, argp, sizeof(s))) {
+			r = -EFAULT;
+			break;
+		}
+		vq->busyloop_timeout = s.num;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
+		s.index = idx;
+		s.num = vq->busyloop_timeout;
+		if (copy_to_user(argp, &s, sizeof(s)))
+			r = -EFAULT;
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 	}
@@ -924,6 +1043,12 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 	if (filep)
 		fput(filep);
 
+	/* Queues that want a worker of their own get it once they are first
+	 * started; if that fails they simply stay on the device's. */
+	if (pollstart && vq->handle_kick && vq->own_worker &&
+	    vq->worker == &d->worker)
+		vhost_vq_worker_create(vq, idx);
+
 	if (pollstart && vq->handle_kick)
 		r = vhost_poll_start(&vq->poll, vq->kick);
 
@@ -1664,6 +1789,23 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(vhost_enable_notify);
 
+/* Cheap check for whether the guest made new buffers available.  Does not
+ * update the cached avail index, and reports "not empty" on a fault so that
+ * the caller goes on to vhost_get_vq_desc() and sees the error there. */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	__virtio16 avail_idx;
+
+	if (vq->avail_idx != vq->last_avail_idx)
+		return false;
+
+	if (__get_user(avail_idx, &vq->avail->idx))
+		return false;
+
+	return vhost16_to_cpu(vq, avail_idx) == vq->avail_idx;
+}
+EXPORT_SYMBOL_GPL(vhost_vq_avail_empty);
+
 /* We don't need to be notified again. */
 void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
@@ -30,6 +30,9 @@
 #include <linux/balloon_compaction.h>
 #include <linux/oom.h>
 #include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/workqueue.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -37,17 +40,41 @@
  * page units.
  */
 #define VIRTIO_BALLOON_PAGES_PER_PAGE (unsigned)(PAGE_SIZE >> VIRTIO_BALLOON_PFN_SHIFT)
-#define VIRTIO_BALLOON_ARRAY_PFNS_MAX 256
+/* 16MB worth of 4K pages per inflate/deflate message */
+#define VIRTIO_BALLOON_ARRAY_PFNS_MAX 4096
 #define OOM_VBALLOON_DEFAULT_PAGES 256
 #define VIRTBALLOON_OOM_NOTIFY_PRIORITY 80
 
+/*
+ * Free page reporting: every so often, take up to REPORT_CAPACITY free
+ * blocks of pageblock order (2MB on x86) out of the allocator and tell the
+ * host it may discard them.  They are kept aside afterwards so that the
+ * same blocks are not reported over and over, and handed back as soon as
+ * the guest needs memory, through the shrinker.
+ */
+#define VIRTIO_BALLOON_REPORT_CAPACITY 32
+#define VIRTIO_BALLOON_REPORT_DELAY (2 * HZ)
+#define VIRTIO_BALLOON_REPORT_BACKOFF (30 * HZ)
+#define VIRTIO_BALLOON_REPORT_GFP (__GFP_HIGHMEM | __GFP_MOVABLE | \
+				   __GFP_NOWARN | __GFP_NORETRY | \
+				   __GFP_NOMEMALLOC)
+
+enum virtio_balloon_vq {
+	VIRTIO_BALLOON_VQ_INFLATE,
+	VIRTIO_BALLOON_VQ_DEFLATE,
+	VIRTIO_BALLOON_VQ_STATS,
+	VIRTIO_BALLOON_VQ_FREE_PAGE,	/* reserved, not used by this driver */
+	VIRTIO_BALLOON_VQ_REPORTING,
+	VIRTIO_BALLOON_VQ_MAX
+};
+
 static int oom_pages = OOM_VBALLOON_DEFAULT_PAGES;
 module_param(oom_pages, int, S_IRUSR | S_IWUSR);
 MODULE_PARM_DESC(oom_pages, "pages to free on OOM");
 
 struct virtio_balloon {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* Where the ballooning thread waits for config to change. */
 	wait_queue_head_t config_change;
@@ -81,6 +108,18 @@ struct virtio_balloon {
 
 	/* To register callback in oom notifier call chain */
 	struct notifier_block nb;
+
+	/* Free page reporting */
+	struct delayed_work report_work;
+	struct shrinker shrinker;
+	/* Protects reported_pages and num_reported */
+	spinlock_t report_lock;
+	/* Blocks the host was told about, linked through page->lru */
+	struct list_head reported_pages;
+	/* In pages */
+	unsigned long num_reported;
+	/* The shrinker took blocks back since the last report */
+	int report_pressure;
 };
 
 static struct virtio_device_id id_table[] = {
@@ -340,10 +379,17 @@ static int virtballoon_oom_notify(struct notifier_block *self,
 	unsigned num_freed_pages;
 
 	vb = container_of(self, struct virtio_balloon, nb);
+	freed = parm;
+
+	/* Reported blocks are the guest's own, whatever was negotiated */
+	if (vb->reporting_vq) {
+		*freed += return_reported_pages(vb, oom_pages);
+		WRITE_ONCE(vb->report_pressure, 1);
+	}
+
 	if (!virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
 		return NOTIFY_OK;
 
-	freed = parm;
 	num_freed_pages = leak_balloon(vb, oom_pages);
 	update_balloon_size(vb);
 	*freed += num_freed_pages;
@@ -351,6 +397,136 @@ static int virtballoon_oom_notify(struct notifier_block *self,
 	return NOTIFY_OK;
 }
 
+static unsigned int report_order(void)
+{
+	return min_t(unsigned int, pageblock_order, MAX_ORDER - 1);
+}
+
+/* Only report while the guest keeps well above its watermarks */
+static bool report_has_headroom(void)
+{
+	unsigned long reserve = 0;
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		reserve += high_wmark_pages(zone);
+
+	return global_page_state(NR_FREE_PAGES) >
+	       2 * reserve + (1UL << report_order());
+}
+
+/* Hand up to @nr_pages worth of reported blocks back to the allocator */
+static unsigned long return_reported_pages(struct virtio_balloon *vb,
+					   unsigned long nr_pages)
+{
+	unsigned int order = report_order();
+	unsigned long freed = 0;
+	struct page *page;
+	LIST_HEAD(pages);
+
+	spin_lock(&vb->report_lock);
+	while (freed < nr_pages && !list_empty(&vb->reported_pages)) {
+		page = list_first_entry(&vb->reported_pages, struct page, lru);
+		list_move(&page->lru, &pages);
+		vb->num_reported -= 1UL << order;
+		freed += 1UL << order;
+	}
+	spin_unlock(&vb->report_lock);
+
+	while (!list_empty(&pages)) {
+		page = list_first_entry(&pages, struct page, lru);
+		list_del(&page->lru);
+		__free_pages(page, order);
+	}
+
+	return freed;
+}
+
+static void report_free_pages_func(struct work_struct *work)
+{
+	struct virtio_balloon *vb = container_of(to_delayed_work(work),
+					struct virtio_balloon, report_work);
+	struct scatterlist sg[VIRTIO_BALLOON_REPORT_CAPACITY];
+	unsigned int order = report_order();
+	struct virtqueue *vq = vb->reporting_vq;
+	unsigned int nents = 0, i, unused;
+	struct page *page;
+
+	if (xchg(&vb->report_pressure, 0)) {
+		queue_delayed_work(system_freezable_wq, &vb->report_work,
+				   VIRTIO_BALLOON_REPORT_BACKOFF);
+		return;
+	}
+
+	sg_init_table(sg, VIRTIO_BALLOON_REPORT_CAPACITY);
+	while (nents < VIRTIO_BALLOON_REPORT_CAPACITY &&
+	       report_has_headroom()) {
+		page = alloc_pages(VIRTIO_BALLOON_REPORT_GFP, order);
+		if (!page)
+			break;
+		sg_set_page(&sg[nents++], page, PAGE_SIZE << order, 0);
+	}
+
+	if (nents) {
+		sg_mark_end(&sg[nents - 1]);
+		/* We should always be able to add one buffer to an empty queue */
+		virtqueue_add_inbuf(vq, sg, nents, vb, GFP_KERNEL);
+		virtqueue_kick(vq);
+		/* The host is done with the blocks once it hands them back */
+		wait_event(vb->acked, virtqueue_get_buf(vq, &unused));
+
+		spin_lock(&vb->report_lock);
+		for (i = 0; i < nents; i++)
+			list_add_tail(&sg_page(&sg[i])->lru,
+				      &vb->reported_pages);
+		vb->num_reported += (unsigned long)nents << order;
+		spin_unlock(&vb->report_lock);
+	}
+
+	/* Keep going right away while there is more to report */
+	queue_delayed_work(system_freezable_wq, &vb->report_work,
+			   nents == VIRTIO_BALLOON_REPORT_CAPACITY ?
+			   0 : VIRTIO_BALLOON_REPORT_DELAY);
+}
+
+static unsigned long virtio_balloon_shrinker_count(struct shrinker *shrinker,
+						   struct shrink_control *sc)
+{
+	struct virtio_balloon *vb = container_of(shrinker,
+					struct virtio_balloon, shrinker);
+
+	return READ_ONCE(vb->num_reported);
+}
+
+static unsigned long virtio_balloon_shrinker_scan(struct shrinker *shrinker,
+						  struct shrink_control *sc)
+{
+	struct virtio_balloon *vb = container_of(shrinker,
+					struct virtio_balloon, shrinker);
+	unsigned long freed;
+
+	freed = return_reported_pages(vb, sc->nr_to_scan);
+	if (freed)
+		WRITE_ONCE(vb->report_pressure, 1);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static void start_reporting(struct virtio_balloon *vb)
+{
+	if (vb->reporting_vq)
+		queue_delayed_work(system_freezable_wq, &vb->report_work,
+				   VIRTIO_BALLOON_REPORT_DELAY);
+}
+
+static void stop_reporting(struct virtio_balloon *vb)
+{
+	if (!vb->reporting_vq)
+		return;
+	cancel_delayed_work_sync(&vb->report_work);
+	return_reported_pages(vb, ULONG_MAX);
+}
+
 static int balloon(void *_vballoon)
 {
 	struct virtio_balloon *vb = _vballoon;
@@ -392,25 +568,51 @@ static int balloon(void *_vballoon)
 
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	const char *names[] = { "inflate", "deflate", "stats" };
+	struct virtqueue *vqs[VIRTIO_BALLOON_VQ_MAX];
+	vq_callback_t *callbacks[VIRTIO_BALLOON_VQ_MAX];
+	const char *names[VIRTIO_BALLOON_VQ_MAX];
 	int err, nvqs;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and reporting.  Queues of features that were not
+	 * negotiated keep their index but get no name, so they are skipped.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	callbacks[VIRTIO_BALLOON_VQ_INFLATE] = balloon_ack;
+	names[VIRTIO_BALLOON_VQ_INFLATE] = "inflate";
+	callbacks[VIRTIO_BALLOON_VQ_DEFLATE] = balloon_ack;
+	names[VIRTIO_BALLOON_VQ_DEFLATE] = "deflate";
+	callbacks[VIRTIO_BALLOON_VQ_STATS] = NULL;
+	names[VIRTIO_BALLOON_VQ_STATS] = NULL;
+	callbacks[VIRTIO_BALLOON_VQ_FREE_PAGE] = NULL;
+	names[VIRTIO_BALLOON_VQ_FREE_PAGE] = NULL;
+	callbacks[VIRTIO_BALLOON_VQ_REPORTING] = NULL;
+	names[VIRTIO_BALLOON_VQ_REPORTING] = NULL;
+	nvqs = VIRTIO_BALLOON_VQ_STATS;
+
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+		callbacks[VIRTIO_BALLOON_VQ_STATS] = stats_request;
+		names[VIRTIO_BALLOON_VQ_STATS] = "stats";
+		nvqs = VIRTIO_BALLOON_VQ_STATS + 1;
+	}
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING)) {
+		callbacks[VIRTIO_BALLOON_VQ_REPORTING] = balloon_ack;
+		names[VIRTIO_BALLOON_VQ_REPORTING] = "reporting_vq";
+		nvqs = VIRTIO_BALLOON_VQ_MAX;
+	}
+
 	err = vb->vdev->config->find_vqs(vb->vdev, nvqs, vqs, callbacks, names);
 	if (err)
 		return err;
 
-	vb->inflate_vq = vqs[0];
-	vb->deflate_vq = vqs[1];
+	vb->inflate_vq = vqs[VIRTIO_BALLOON_VQ_INFLATE];
+	vb->deflate_vq = vqs[VIRTIO_BALLOON_VQ_DEFLATE];
+	vb->reporting_vq = NULL;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		vb->reporting_vq = vqs[VIRTIO_BALLOON_VQ_REPORTING];
 	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
 		struct scatterlist sg;
-		vb->stats_vq = vqs[2];
+		vb->stats_vq = vqs[VIRTIO_BALLOON_VQ_STATS];
 
 		/*
 		 * Prime this virtqueue with one buffer so the hypervisor can
@@ -499,7 +701,7 @@ static int virtballoon_probe(struct virtio_device *vdev)
 		return -EINVAL;
 	}
 
-	vdev->priv = vb = kmalloc(sizeof(*vb), GFP_KERNEL);
+	vdev->priv = vb = kzalloc(sizeof(*vb), GFP_KERNEL);
 	if (!vb) {
 		err = -ENOMEM;
 		goto out;
@@ -511,6 +713,9 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	init_waitqueue_head(&vb->acked);
 	vb->vdev = vdev;
 	vb->need_stats_update = 0;
+	spin_lock_init(&vb->report_lock);
+	INIT_LIST_HEAD(&vb->reported_pages);
+	INIT_DELAYED_WORK(&vb->report_work, report_free_pages_func);
 
 	balloon_devinfo_init(&vb->vb_dev_info);
 #ifdef CONFIG_BALLOON_COMPACTION
@@ -527,6 +732,15 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	if (err < 0)
 		goto out_oom_notify;
 
+	if (vb->reporting_vq) {
+		vb->shrinker.count_objects = virtio_balloon_shrinker_count;
+		vb->shrinker.scan_objects = virtio_balloon_shrinker_scan;
+		vb->shrinker.seeks = DEFAULT_SEEKS;
+		err = register_shrinker(&vb->shrinker);
+		if (err)
+			goto out_unregister_oom;
+	}
+
 	virtio_device_ready(vdev);
 
 	vb->thread = kthread_run(balloon, vb, "vballoon");
@@ -535,9 +749,13 @@ static int virtballoon_probe(struct virtio_device *vdev)
 		goto out_del_vqs;
 	}
 
+	start_reporting(vb);
 	return 0;
 
 out_del_vqs:
+	if (vb->reporting_vq)
+		unregister_shrinker(&vb->shrinker);
+out_unregister_oom:
 	unregister_oom_notifier(&vb->nb);
 out_oom_notify:
 	vdev->config->del_vqs(vdev);
@@ -549,6 +767,8 @@ out:
 
 static void remove_common(struct virtio_balloon *vb)
 {
+	stop_reporting(vb);
+
 	/* There might be pages left in the balloon: free them. */
 	while (vb->num_pages)
 		leak_balloon(vb, vb->num_pages);
@@ -567,6 +787,8 @@ static void virtballoon_remove(struct virtio_device *vdev)
 	unregister_oom_notifier(&vb->nb);
 	kthread_stop(vb->thread);
 	remove_common(vb);
+	if (vb->reporting_vq)
+		unregister_shrinker(&vb->shrinker);
 	kfree(vb);
 }
 
@@ -597,6 +819,7 @@ static int virtballoon_restore(struct virtio_device *vdev)
 
 	fill_balloon(vb, towards_target(vb));
 	update_balloon_size(vb);
+	start_reporting(vb);
 	return 0;
 }
 #endif
@@ -605,6 +828,7 @@ static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
 	VIRTIO_BALLOON_F_DEFLATE_ON_OOM,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
@@ -157,10 +157,21 @@ static u64 vp_get_features(struct virtio_device *vdev)
 static int vp_finalize_features(struct virtio_device *vdev)
 {
 	struct virtio_pci_device *vp_dev = to_vp_device(vdev);
+	u64 features = vdev->features;
 
 	/* Give virtio_ring a chance to accept features. */
 	vring_transport_features(vdev);
 
+	/*
+	 * setup_vq() can lay out a packed ring, and in-order completion is
+	 * only made use of with one.
+	 */
+	if (features & BIT_ULL(VIRTIO_F_RING_PACKED)) {
+		__virtio_set_bit(vdev, VIRTIO_F_RING_PACKED);
+		if (features & BIT_ULL(VIRTIO_F_IN_ORDER))
+			__virtio_set_bit(vdev, VIRTIO_F_IN_ORDER);
+	}
+
 	if (!__virtio_test_bit(vdev, VIRTIO_F_VERSION_1)) {
 		dev_err(&vdev->dev, "virtio: device uses modern interface "
 			"but does not have VIRTIO_F_VERSION_1\n");
@@ -294,7 +305,8 @@ static u16 vp_config_vector(struct virtio_pci_device *vp_dev, u16 vector)
 
 static size_t vring_pci_size(u16 num)
 {
-	/* We only need a cacheline separation. */
+	/* We only need a cacheline separation.  A packed ring takes up
+	 * less than the split layout of the same size. */
 	return PAGE_ALIGN(vring_size(num, SMP_CACHE_BYTES));
 }
 
@@ -340,7 +352,9 @@ static struct virtqueue *setup_vq(struct virtio_pci_device *vp_dev,
 	if (!num || vp_ioread16(&cfg->queue_enable))
 		return ERR_PTR(-ENOENT);
 
-	if (num & (num - 1)) {
+	/* Only a split ring needs a power of 2 */
+	if (!virtio_has_feature(&vp_dev->vdev, VIRTIO_F_RING_PACKED) &&
+	    (num & (num - 1))) {
 		dev_warn(&vp_dev->pci_dev->dev, "bad queue size %u", num);
 		return ERR_PTR(-EINVAL);
 	}
@@ -54,12 +54,61 @@
 #define END_USE(vq)
 #endif
 
+/* No in-order batch is being completed */
+#define VRING_NO_BATCH		U16_MAX
+
+struct vring_desc_state_packed {
+	u16 num;			/* Descriptors the buffer takes up */
+	u16 next;			/* Next free buffer id */
+	u32 len;			/* Device-writable length */
+	struct vring_packed_desc *indir_desc;	/* Indirect table, if any */
+};
+
 struct vring_virtqueue {
 	struct virtqueue vq;
 
-	/* Actual memory layout for this queue */
+	/* Is this a packed ring? */
+	bool packed_ring;
+
+	/* Does the device use buffers in the order they were added? */
+	bool in_order;
+
+	/* Actual memory layout for this queue (split ring) */
 	struct vring vring;
 
+	/* Packed ring layout and state */
+	struct {
+		unsigned int num;
+		struct vring_packed_desc *desc;
+		struct vring_packed_desc_event *driver;
+		struct vring_packed_desc_event *device;
+
+		/* Per buffer id */
+		struct vring_desc_state_packed *desc_state;
+
+		/* Next ring slot to make available and its wrap counter */
+		u16 next_avail_idx;
+		bool avail_wrap_counter;
+
+		/* Wrap counter of last_used_idx */
+		bool used_wrap_counter;
+
+		/* AVAIL/USED flag bits for the current avail wrap */
+		u16 avail_used_flags;
+
+		/* Last written value to driver->flags */
+		u16 event_flags_shadow;
+
+		/*
+		 * With in-order completion the device may report a whole
+		 * batch with one used descriptor carrying the id of the
+		 * batch's last buffer; it is kept here until every buffer
+		 * up to it has been returned.
+		 */
+		u16 batch_last_id;
+		u32 batch_last_len;
+	} packed;
+
 	/* Can we use weak barriers? */
 	bool weak_barriers;
 
@@ -72,7 +121,7 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
-	/* Head of free buffer list. */
+	/* Head of free buffer list (of buffer ids in a packed ring). */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
 	unsigned int num_added;
@@ -126,13 +175,13 @@ static struct vring_desc *alloc_indirect(struct virtqueue *_vq,
 	return desc;
 }
 
-static inline int virtqueue_add(struct virtqueue *_vq,
-				struct scatterlist *sgs[],
-				unsigned int total_sg,
-				unsigned int out_sgs,
-				unsigned int in_sgs,
-				void *data,
-				gfp_t gfp)
+static inline int virtqueue_add_split(struct virtqueue *_vq,
+				      struct scatterlist *sgs[],
+				      unsigned int total_sg,
+				      unsigned int out_sgs,
+				      unsigned int in_sgs,
+				      void *data,
+				      gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	struct scatterlist *sg;
@@ -264,6 +313,183 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 	return 0;
 }
 
+static struct vring_packed_desc *alloc_indirect_packed(unsigned int total_sg,
+							gfp_t gfp)
+{
+	/* Same lowmem requirement as for the split ring */
+	gfp &= ~__GFP_HIGHMEM;
+
+	return kmalloc(total_sg * sizeof(struct vring_packed_desc), gfp);
+}
+
+/* Step past ring slot @i, flipping the avail wrap counter on wrap around */
+static inline u16 packed_next_avail(struct vring_virtqueue *vq, u16 i)
+{
+	if (++i < vq->packed.num)
+		return i;
+
+	vq->packed.avail_wrap_counter ^= 1;
+	vq->packed.avail_used_flags ^= 1 << VRING_PACKED_DESC_F_AVAIL |
+				       1 << VRING_PACKED_DESC_F_USED;
+	return 0;
+}
+
+static inline int virtqueue_add_packed(struct virtqueue *_vq,
+				       struct scatterlist *sgs[],
+				       unsigned int total_sg,
+				       unsigned int out_sgs,
+				       unsigned int in_sgs,
+				       void *data,
+				       gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	struct vring_packed_desc *desc, *indir = NULL;
+	struct vring_desc_state_packed *state;
+	struct scatterlist *sg;
+	unsigned int n, descs_used;
+	u16 i, id, head, head_flags = 0, uninitialized_var(prev);
+	u32 in_len = 0;
+
+	START_USE(vq);
+
+	BUG_ON(data == NULL);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return -EIO;
+	}
+
+#ifdef DEBUG
+	{
+		ktime_t now = ktime_get();
+
+		/* No kick or get, with .1 second between?  Warn. */
+		if (vq->last_add_time_valid)
+			WARN_ON(ktime_to_ms(ktime_sub(now, vq->last_add_time))
+					    > 100);
+		vq->last_add_time = now;
+		vq->last_add_time_valid = true;
+	}
+#endif
+
+	BUG_ON(total_sg > vq->packed.num);
+	BUG_ON(total_sg == 0);
+
+	head = vq->packed.next_avail_idx;
+
+	if (vq->indirect && total_sg > 1 && vq->vq.num_free)
+		indir = alloc_indirect_packed(total_sg, gfp);
+	descs_used = indir ? 1 : total_sg;
+
+	if (vq->vq.num_free < descs_used) {
+		pr_debug("Can't add buf len %i - avail = %i\n",
+			 descs_used, vq->vq.num_free);
+		/* Same historical forced notify as for the split ring */
+		if (out_sgs)
+			vq->notify(&vq->vq);
+		kfree(indir);
+		END_USE(vq);
+		return -ENOSPC;
+	}
+
+	/*
+	 * Buffers used in order come back in the order of their first ring
+	 * slot, so that slot doubles as the id and no free list is needed.
+	 */
+	id = vq->in_order ? head : vq->free_head;
+	BUG_ON(id >= vq->packed.num);
+
+	desc = indir ? indir : vq->packed.desc;
+	i = indir ? 0 : head;
+	for (n = 0; n < out_sgs + in_sgs; n++) {
+		for (sg = sgs[n]; sg; sg = sg_next(sg)) {
+			u16 flags = n < out_sgs ? 0 : VRING_DESC_F_WRITE;
+
+			if (n >= out_sgs)
+				in_len += sg->length;
+
+			desc[i].addr = cpu_to_le64(sg_phys(sg));
+			desc[i].len = cpu_to_le32(sg->length);
+			prev = i;
+
+			/* An indirect table is sequential, no flags needed */
+			if (indir) {
+				desc[i++].flags = cpu_to_le16(flags);
+				continue;
+			}
+
+			flags |= VRING_DESC_F_NEXT |
+				 vq->packed.avail_used_flags;
+			desc[i].id = cpu_to_le16(id);
+			/* The head is written last, it publishes the rest */
+			if (i == head)
+				head_flags = flags;
+			else
+				desc[i].flags = cpu_to_le16(flags);
+			i = packed_next_avail(vq, i);
+		}
+	}
+
+	if (indir) {
+		/* avoid kmemleak false positive (hidden by virt_to_phys) */
+		kmemleak_ignore(indir);
+		desc = vq->packed.desc;
+		desc[head].addr = cpu_to_le64(virt_to_phys(indir));
+		desc[head].len = cpu_to_le32(total_sg * sizeof(*indir));
+		desc[head].id = cpu_to_le16(id);
+		head_flags = VRING_DESC_F_INDIRECT |
+			     vq->packed.avail_used_flags;
+		i = packed_next_avail(vq, head);
+	} else if (prev == head) {
+		/* Last one doesn't continue. */
+		head_flags &= ~VRING_DESC_F_NEXT;
+	} else {
+		desc[prev].flags &= cpu_to_le16(~VRING_DESC_F_NEXT);
+	}
+
+	/* We're about to use some buffers from the free list. */
+	vq->vq.num_free -= descs_used;
+	vq->packed.next_avail_idx = i;
+
+	state = &vq->packed.desc_state[id];
+	if (!vq->in_order)
+		vq->free_head = state->next;
+	state->num = descs_used;
+	state->len = in_len;
+	state->indir_desc = indir;
+
+	/* Set token. */
+	vq->data[id] = data;
+
+	/* The rest of the chain needs to be set before the head flags make
+	 * the whole buffer available. */
+	virtio_wmb(vq->weak_barriers);
+	vq->packed.desc[head].flags = cpu_to_le16(head_flags);
+	vq->num_added += descs_used;
+
+	pr_debug("Added buffer id %i at %i to %p\n", id, head, vq);
+	END_USE(vq);
+
+	return 0;
+}
+
+static inline int virtqueue_add(struct virtqueue *_vq,
+				struct scatterlist *sgs[],
+				unsigned int total_sg,
+				unsigned int out_sgs,
+				unsigned int in_sgs,
+				void *data,
+				gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ?
+		virtqueue_add_packed(_vq, sgs, total_sg, out_sgs, in_sgs,
+				     data, gfp) :
+		virtqueue_add_split(_vq, sgs, total_sg, out_sgs, in_sgs,
+				    data, gfp);
+}
+
 /**
  * virtqueue_add_sgs - expose buffers to other end
  * @vq: the struct virtqueue we're talking about.
@@ -341,18 +567,7 @@ int virtqueue_add_inbuf(struct virtqueue *vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf);
 
-/**
- * virtqueue_kick_prepare - first half of split virtqueue_kick call.
- * @vq: the struct virtqueue
- *
- * Instead of virtqueue_kick(), you can do:
- *	if (virtqueue_kick_prepare(vq))
- *		virtqueue_notify(vq);
- *
- * This is sometimes useful because the virtqueue_kick_prepare() needs
- * to be serialized, but the actual virtqueue_notify() call does not.
- */
-bool virtqueue_kick_prepare(struct virtqueue *_vq)
+static bool virtqueue_kick_prepare_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 new, old;
@@ -384,6 +599,77 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 	END_USE(vq);
 	return needs_kick;
 }
+
+static bool virtqueue_kick_prepare_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 new, old, off_wrap, flags, event_idx;
+	bool needs_kick;
+	union {
+		struct {
+			__le16 off_wrap;
+			__le16 flags;
+		};
+		u32 u32;
+	} snapshot;
+
+	START_USE(vq);
+	/* We need to expose the new descriptors before checking the
+	 * device event. */
+	virtio_mb(vq->weak_barriers);
+
+	old = vq->packed.next_avail_idx - vq->num_added;
+	new = vq->packed.next_avail_idx;
+	vq->num_added = 0;
+
+	/* Read the offset and the flags in one go so they match */
+	snapshot.u32 = READ_ONCE(*(u32 *)vq->packed.device);
+	flags = le16_to_cpu(snapshot.flags);
+
+#ifdef DEBUG
+	if (vq->last_add_time_valid) {
+		WARN_ON(ktime_to_ms(ktime_sub(ktime_get(),
+					      vq->last_add_time)) > 100);
+	}
+	vq->last_add_time_valid = false;
+#endif
+
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC) {
+		needs_kick = flags != VRING_PACKED_EVENT_FLAG_DISABLE;
+		goto out;
+	}
+
+	/* An event index from the previous wrap is a ring size behind */
+	off_wrap = le16_to_cpu(snapshot.off_wrap);
+	event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) !=
+	    vq->packed.avail_wrap_counter)
+		event_idx -= vq->packed.num;
+
+	needs_kick = vring_need_event(event_idx, new, old);
+out:
+	END_USE(vq);
+	return needs_kick;
+}
+
+/**
+ * virtqueue_kick_prepare - first half of split virtqueue_kick call.
+ * @vq: the struct virtqueue
+ *
+ * Instead of virtqueue_kick(), you can do:
+ *	if (virtqueue_kick_prepare(vq))
+ *		virtqueue_notify(vq);
+ *
+ * This is sometimes useful because the virtqueue_kick_prepare() needs
+ * to be serialized, but the actual virtqueue_notify() call does not.
+ */
+bool virtqueue_kick_prepare(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_kick_prepare_packed(_vq) :
+				 virtqueue_kick_prepare_split(_vq);
+}
 EXPORT_SYMBOL_GPL(virtqueue_kick_prepare);
 
 /**
@@ -430,7 +716,7 @@ bool virtqueue_kick(struct virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(virtqueue_kick);
 
-static void detach_buf(struct vring_virtqueue *vq, unsigned int head)
+static void detach_buf_split(struct vring_virtqueue *vq, unsigned int head)
 {
 	unsigned int i;
 
@@ -455,28 +741,53 @@ static void detach_buf(struct vring_virtqueue *vq, unsigned int head)
 	vq->vq.num_free++;
 }
 
-static inline bool more_used(const struct vring_virtqueue *vq)
+static inline bool more_used_split(const struct vring_virtqueue *vq)
 {
 	return vq->last_used_idx != virtio16_to_cpu(vq->vq.vdev, vq->vring.used->idx);
 }
 
-/**
- * virtqueue_get_buf - get the next used buffer
- * @vq: the struct virtqueue we're talking about.
- * @len: the length written into the buffer
- *
- * If the driver wrote data into the buffer, @len will be set to the
- * amount written.  This means you don't need to clear the buffer
- * beforehand to ensure there's no data leakage in the case of short
- * writes.
- *
- * Caller must ensure we don't call this with other virtqueue
- * operations at the same time (except where noted).
- *
- * Returns NULL if there are no used buffers, or the "data" token
- * handed to virtqueue_add_*().
- */
-void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
+static void detach_buf_packed(struct vring_virtqueue *vq, unsigned int id)
+{
+	struct vring_desc_state_packed *state = &vq->packed.desc_state[id];
+
+	/* Clear data ptr. */
+	vq->data[id] = NULL;
+	vq->vq.num_free += state->num;
+
+	/* Free the indirect table */
+	kfree(state->indir_desc);
+	state->indir_desc = NULL;
+
+	/* Put the id back on the free list */
+	if (!vq->in_order) {
+		state->next = vq->free_head;
+		vq->free_head = id;
+	}
+}
+
+static inline bool is_used_desc_packed(const struct vring_virtqueue *vq,
+				       u16 idx, bool used_wrap_counter)
+{
+	u16 flags = le16_to_cpu(READ_ONCE(vq->packed.desc[idx].flags));
+	bool avail = flags & (1 << VRING_PACKED_DESC_F_AVAIL);
+	bool used = flags & (1 << VRING_PACKED_DESC_F_USED);
+
+	return avail == used && used == used_wrap_counter;
+}
+
+static inline bool more_used_packed(const struct vring_virtqueue *vq)
+{
+	return vq->packed.batch_last_id != VRING_NO_BATCH ||
+	       is_used_desc_packed(vq, vq->last_used_idx,
+				   vq->packed.used_wrap_counter);
+}
+
+static inline bool more_used(const struct vring_virtqueue *vq)
+{
+	return vq->packed_ring ? more_used_packed(vq) : more_used_split(vq);
+}
+
+static void *virtqueue_get_buf_split(struct virtqueue *_vq, unsigned int *len)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	void *ret;
@@ -490,7 +801,7 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 		return NULL;
 	}
 
-	if (!more_used(vq)) {
+	if (!more_used_split(vq)) {
 		pr_debug("No more buffers in queue\n");
 		END_USE(vq);
 		return NULL;
@@ -514,7 +825,7 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 
 	/* detach_buf clears data, so grab it now. */
 	ret = vq->data[i];
-	detach_buf(vq, i);
+	detach_buf_split(vq, i);
 	vq->last_used_idx++;
 	/* If we expect an interrupt for the next entry, tell host
 	 * by writing event index and flush out the write before
@@ -531,18 +842,125 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	END_USE(vq);
 	return ret;
 }
-EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+static void *virtqueue_get_buf_packed(struct virtqueue *_vq, unsigned int *len)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	struct vring_packed_desc *desc = vq->packed.desc;
+	unsigned int last_used;
+	void *ret;
+	u16 id;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (!more_used_packed(vq)) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return NULL;
+	}
+
+	last_used = vq->last_used_idx;
+	if (vq->in_order) {
+		if (vq->packed.batch_last_id == VRING_NO_BATCH) {
+			/* Only read the used descriptor after the device
+			 * marked it used. */
+			virtio_rmb(vq->weak_barriers);
+			id = le16_to_cpu(desc[last_used].id);
+			if (unlikely(id >= vq->packed.num || !vq->data[id])) {
+				BAD_RING(vq, "id %u is not a head!\n", id);
+				return NULL;
+			}
+			vq->packed.batch_last_id = id;
+			vq->packed.batch_last_len = le32_to_cpu(desc[last_used].len);
+		}
+
+		/* Everything up to the batch's last buffer has been used,
+		 * oldest first, and the oldest one's id is its slot. */
+		id = last_used;
+		if (id == vq->packed.batch_last_id) {
+			*len = vq->packed.batch_last_len;
+			vq->packed.batch_last_id = VRING_NO_BATCH;
+		} else {
+			*len = vq->packed.desc_state[id].len;
+		}
+	} else {
+		/* Only read the used descriptor after the device marked it
+		 * used. */
+		virtio_rmb(vq->weak_barriers);
+		id = le16_to_cpu(desc[last_used].id);
+		*len = le32_to_cpu(desc[last_used].len);
+	}
+
+	if (unlikely(id >= vq->packed.num)) {
+		BAD_RING(vq, "id %u out of range\n", id);
+		return NULL;
+	}
+	if (unlikely(!vq->data[id])) {
+		BAD_RING(vq, "id %u is not a head!\n", id);
+		return NULL;
+	}
+
+	/* The device skips as many slots as the buffer took up */
+	last_used += vq->packed.desc_state[id].num;
+	if (last_used >= vq->packed.num) {
+		last_used -= vq->packed.num;
+		vq->packed.used_wrap_counter ^= 1;
+	}
+	vq->last_used_idx = last_used;
+
+	/* detach_buf_packed clears data, so grab it now. */
+	ret = vq->data[id];
+	detach_buf_packed(vq, id);
+
+	/* If we expect an interrupt for the next entry, tell host
+	 * by writing event index and flush out the write before
+	 * the read in the next get_buf call. */
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DESC) {
+		vq->packed.driver->off_wrap = cpu_to_le16(vq->last_used_idx |
+			(vq->packed.used_wrap_counter <<
+			 VRING_PACKED_EVENT_F_WRAP_CTR));
+		virtio_mb(vq->weak_barriers);
+	}
+
+#ifdef DEBUG
+	vq->last_add_time_valid = false;
+#endif
+
+	END_USE(vq);
+	return ret;
+}
 
 /**
- * virtqueue_disable_cb - disable callbacks
+ * virtqueue_get_buf - get the next used buffer
  * @vq: the struct virtqueue we're talking about.
+ * @len: the length written into the buffer
  *
- * Note that this is not necessarily synchronous, hence unreliable and only
- * useful as an optimization.
+ * If the driver wrote data into the buffer, @len will be set to the
+ * amount written.  This means you don't need to clear the buffer
+ * beforehand to ensure there's no data leakage in the case of short
+ * writes.
  *
- * Unlike other operations, this need not be serialized.
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ *
+ * Returns NULL if there are no used buffers, or the "data" token
+ * handed to virtqueue_add_*().
  */
-void virtqueue_disable_cb(struct virtqueue *_vq)
+void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_get_buf_packed(_vq, len) :
+				 virtqueue_get_buf_split(_vq, len);
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+static void virtqueue_disable_cb_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
@@ -552,21 +970,39 @@ void virtqueue_disable_cb(struct virtqueue *_vq)
 	}
 
 }
-EXPORT_SYMBOL_GPL(virtqueue_disable_cb);
+
+static void virtqueue_disable_cb_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	if (vq->packed.event_flags_shadow != VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+}
 
 /**
- * virtqueue_enable_cb_prepare - restart callbacks after disable_cb
+ * virtqueue_disable_cb - disable callbacks
  * @vq: the struct virtqueue we're talking about.
  *
- * This re-enables callbacks; it returns current queue state
- * in an opaque unsigned value. This value should be later tested by
- * virtqueue_poll, to detect a possible race between the driver checking for
- * more work, and enabling callbacks.
+ * Note that this is not necessarily synchronous, hence unreliable and only
+ * useful as an optimization.
  *
- * Caller must ensure we don't call this with other virtqueue
- * operations at the same time (except where noted).
+ * Unlike other operations, this need not be serialized.
  */
-unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
+void virtqueue_disable_cb(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	if (vq->packed_ring)
+		virtqueue_disable_cb_packed(_vq);
+	else
+		virtqueue_disable_cb_split(_vq);
+}
+EXPORT_SYMBOL_GPL(virtqueue_disable_cb);
+
+static unsigned virtqueue_enable_cb_prepare_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 last_used_idx;
@@ -586,8 +1022,76 @@ unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
 	END_USE(vq);
 	return last_used_idx;
 }
+
+static unsigned virtqueue_enable_cb_prepare_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 off_wrap;
+
+	START_USE(vq);
+
+	off_wrap = vq->last_used_idx |
+		   (vq->packed.used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+	/* With VIRTIO_RING_F_EVENT_IDX, ask for an event at the next used
+	 * descriptor; the offset has to be visible before the flags. */
+	if (vq->event) {
+		vq->packed.driver->off_wrap = cpu_to_le16(off_wrap);
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = vq->event ?
+			VRING_PACKED_EVENT_FLAG_DESC :
+			VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+
+	END_USE(vq);
+	return off_wrap;
+}
+
+/**
+ * virtqueue_enable_cb_prepare - restart callbacks after disable_cb
+ * @vq: the struct virtqueue we're talking about.
+ *
+ * This re-enables callbacks; it returns current queue state
+ * in an opaque unsigned value. This value should be later tested by
+ * virtqueue_poll, to detect a possible race between the driver checking for
+ * more work, and enabling callbacks.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ */
+unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_enable_cb_prepare_packed(_vq) :
+				 virtqueue_enable_cb_prepare_split(_vq);
+}
 EXPORT_SYMBOL_GPL(virtqueue_enable_cb_prepare);
 
+static bool virtqueue_poll_split(struct virtqueue *_vq, u16 last_used_idx)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	virtio_mb(vq->weak_barriers);
+	return (u16)last_used_idx != virtio16_to_cpu(_vq->vdev, vq->vring.used->idx);
+}
+
+static bool virtqueue_poll_packed(struct virtqueue *_vq, u16 off_wrap)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	bool wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	u16 used_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+	virtio_mb(vq->weak_barriers);
+	return vq->packed.batch_last_id != VRING_NO_BATCH ||
+	       is_used_desc_packed(vq, used_idx, wrap_counter);
+}
+
 /**
  * virtqueue_poll - query pending used buffers
  * @vq: the struct virtqueue we're talking about.
@@ -601,8 +1105,8 @@ bool virtqueue_poll(struct virtqueue *_vq, unsigned last_used_idx)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
-	virtio_mb(vq->weak_barriers);
-	return (u16)last_used_idx != virtio16_to_cpu(_vq->vdev, vq->vring.used->idx);
+	return vq->packed_ring ? virtqueue_poll_packed(_vq, last_used_idx) :
+				 virtqueue_poll_split(_vq, last_used_idx);
 }
 EXPORT_SYMBOL_GPL(virtqueue_poll);
 
@@ -624,20 +1128,7 @@ bool virtqueue_enable_cb(struct virtqueue *_vq)
 }
 EXPORT_SYMBOL_GPL(virtqueue_enable_cb);
 
-/**
- * virtqueue_enable_cb_delayed - restart callbacks after disable_cb.
- * @vq: the struct virtqueue we're talking about.
- *
- * This re-enables callbacks but hints to the other side to delay
- * interrupts until most of the available buffers have been processed;
- * it returns "false" if there are many pending buffers in the queue,
- * to detect a possible race between the driver checking for more work,
- * and enabling callbacks.
- *
- * Caller must ensure we don't call this with other virtqueue
- * operations at the same time (except where noted).
- */
-bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
+static bool virtqueue_enable_cb_delayed_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 bufs;
@@ -665,17 +1156,83 @@ bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
 	END_USE(vq);
 	return true;
 }
-EXPORT_SYMBOL_GPL(virtqueue_enable_cb_delayed);
+
+static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int used_idx, bufs;
+	bool wrap_counter;
+
+	START_USE(vq);
+
+	if (vq->event) {
+		/*
+		 * As for the split ring, ask for an interrupt once 3/4 of
+		 * what is outstanding has been used: late enough to batch
+		 * completions, early enough that the ring does not run dry
+		 * before we get to refill it.  The event offset is a ring
+		 * position, and the device steps over a whole chain at a
+		 * time, so outstanding descriptors are the right unit here.
+		 */
+		bufs = (vq->packed.num - vq->vq.num_free) * 3 / 4;
+		wrap_counter = vq->packed.used_wrap_counter;
+
+		used_idx = vq->last_used_idx + bufs;
+		if (used_idx >= vq->packed.num) {
+			used_idx -= vq->packed.num;
+			wrap_counter ^= 1;
+		}
+
+		vq->packed.driver->off_wrap = cpu_to_le16(used_idx |
+			(wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR));
+		/* The offset has to be visible before the flags. */
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = vq->event ?
+			VRING_PACKED_EVENT_FLAG_DESC :
+			VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+
+	/* We need to update the event before checking for used buffers,
+	 * or the device might not notify us about them. */
+	virtio_mb(vq->weak_barriers);
+
+	if (more_used_packed(vq)) {
+		END_USE(vq);
+		return false;
+	}
+
+	END_USE(vq);
+	return true;
+}
 
 /**
- * virtqueue_detach_unused_buf - detach first unused buffer
+ * virtqueue_enable_cb_delayed - restart callbacks after disable_cb.
  * @vq: the struct virtqueue we're talking about.
  *
- * Returns NULL or the "data" token handed to virtqueue_add_*().
- * This is not valid on an active queue; it is useful only for device
- * shutdown.
+ * This re-enables callbacks but hints to the other side to delay
+ * interrupts until most of the available buffers have been processed;
+ * it returns "false" if there are many pending buffers in the queue,
+ * to detect a possible race between the driver checking for more work,
+ * and enabling callbacks.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
  */
-void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
+bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_enable_cb_delayed_packed(_vq) :
+				 virtqueue_enable_cb_delayed_split(_vq);
+}
+EXPORT_SYMBOL_GPL(virtqueue_enable_cb_delayed);
+
+static void *virtqueue_detach_unused_buf_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	unsigned int i;
@@ -688,7 +1245,7 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 			continue;
 		/* detach_buf clears data, so grab it now. */
 		buf = vq->data[i];
-		detach_buf(vq, i);
+		detach_buf_split(vq, i);
 		vq->avail_idx_shadow--;
 		vq->vring.avail->idx = cpu_to_virtio16(_vq->vdev, vq->avail_idx_shadow);
 		END_USE(vq);
@@ -700,6 +1257,46 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 	END_USE(vq);
 	return NULL;
 }
+
+static void *virtqueue_detach_unused_buf_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int i;
+	void *buf;
+
+	START_USE(vq);
+
+	for (i = 0; i < vq->packed.num; i++) {
+		if (!vq->data[i])
+			continue;
+		/* detach_buf_packed clears data, so grab it now. */
+		buf = vq->data[i];
+		detach_buf_packed(vq, i);
+		END_USE(vq);
+		return buf;
+	}
+	/* That should have freed everything. */
+	BUG_ON(vq->vq.num_free != vq->packed.num);
+
+	END_USE(vq);
+	return NULL;
+}
+
+/**
+ * virtqueue_detach_unused_buf - detach first unused buffer
+ * @vq: the struct virtqueue we're talking about.
+ *
+ * Returns NULL or the "data" token handed to virtqueue_add_*().
+ * This is not valid on an active queue; it is useful only for device
+ * shutdown.
+ */
+void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	return vq->packed_ring ? virtqueue_detach_unused_buf_packed(_vq) :
+				 virtqueue_detach_unused_buf_split(_vq);
+}
 EXPORT_SYMBOL_GPL(virtqueue_detach_unused_buf);
 
 irqreturn_t vring_interrupt(int irq, void *_vq)
@@ -722,6 +1319,35 @@ irqreturn_t vring_interrupt(int irq, void *_vq)
 }
 EXPORT_SYMBOL_GPL(vring_interrupt);
 
+/*
+ * The packed layout fits in the memory a transport sizes with
+ * vring_size(): the descriptors, then the driver event structure, then
+ * the device one, which gets a new @align boundary like the used ring.
+ */
+static int vring_init_packed(struct vring_virtqueue *vq, unsigned int num,
+			     void *pages, unsigned long align)
+{
+	vq->packed.num = num;
+	vq->packed.desc = pages;
+	vq->packed.driver = pages + num * sizeof(struct vring_packed_desc);
+	vq->packed.device = (void *)ALIGN((unsigned long)(vq->packed.driver + 1),
+					  align);
+
+	vq->packed.desc_state = kcalloc(num, sizeof(*vq->packed.desc_state),
+					GFP_KERNEL);
+	if (!vq->packed.desc_state)
+		return -ENOMEM;
+
+	/* Both sides start out on wrap 1 */
+	vq->packed.next_avail_idx = 0;
+	vq->packed.avail_wrap_counter = 1;
+	vq->packed.used_wrap_counter = 1;
+	vq->packed.avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+	vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_ENABLE;
+	vq->packed.batch_last_id = VRING_NO_BATCH;
+	return 0;
+}
+
 struct virtqueue *vring_new_virtqueue(unsigned int index,
 				      unsigned int num,
 				      unsigned int vring_align,
@@ -732,11 +1358,13 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 				      void (*callback)(struct virtqueue *),
 				      const char *name)
 {
+	bool packed = virtio_has_feature(vdev, VIRTIO_F_RING_PACKED);
 	struct vring_virtqueue *vq;
 	unsigned int i;
 
-	/* We assume num is a power of 2. */
-	if (num & (num - 1)) {
+	/* We assume num is a power of 2 for a split ring; a packed ring
+	 * can have any size its 15 bit indices can address. */
+	if (packed ? !num || num > (1 << 15) : num & (num - 1)) {
 		dev_warn(&vdev->dev, "Bad virtqueue length %u\n", num);
 		return NULL;
 	}
@@ -745,7 +1373,15 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 	if (!vq)
 		return NULL;
 
-	vring_init(&vq->vring, num, pages, vring_align);
+	vq->packed_ring = packed;
+	if (packed) {
+		if (vring_init_packed(vq, num, pages, vring_align)) {
+			kfree(vq);
+			return NULL;
+		}
+	} else
+		vring_init(&vq->vring, num, pages, vring_align);
+
 	vq->vq.callback = callback;
 	vq->vq.vdev = vdev;
 	vq->vq.name = name;
@@ -766,15 +1402,28 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC);
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = packed && virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
 
 	/* No callback?  Tell other side not to bother us. */
-	if (!callback) {
+	if (!callback && packed) {
+		vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	} else if (!callback) {
 		vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
 		vq->vring.avail->flags = cpu_to_virtio16(vdev, vq->avail_flags_shadow);
 	}
 
 	/* Put everything in free lists. */
 	vq->free_head = 0;
+	if (packed) {
+		/* Free buffer ids; the ring itself needs no list */
+		for (i = 0; i < num; i++) {
+			vq->packed.desc_state[i].next = i + 1;
+			vq->data[i] = NULL;
+		}
+		return &vq->vq;
+	}
 	for (i = 0; i < num-1; i++) {
 		vq->vring.desc[i].next = cpu_to_virtio16(vdev, i + 1);
 		vq->data[i] = NULL;
@@ -788,6 +1437,8 @@ EXPORT_SYMBOL_GPL(vring_new_virtqueue);
 void vring_del_virtqueue(struct virtqueue *vq)
 {
 	list_del(&vq->list);
+	if (to_vvq(vq)->packed_ring)
+		kfree(to_vvq(vq)->packed.desc_state);
 	kfree(to_vvq(vq));
 }
 EXPORT_SYMBOL_GPL(vring_del_virtqueue);
@@ -805,6 +1456,10 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_VERSION_1:
 			break;
+		/*
+		 * VIRTIO_F_RING_PACKED and VIRTIO_F_IN_ORDER are left to
+		 * the transports that can set up a packed ring to accept.
+		 */
 		default:
 			/* We don't understand this bit. */
 			__virtio_clear_bit(vdev, i);
@@ -825,7 +1480,7 @@ unsigned int virtqueue_get_vring_size(struct virtqueue *_vq)
 
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
-	return vq->vring.num;
+	return vq->packed_ring ? vq->packed.num : vq->vring.num;
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_vring_size);
 
@@ -856,6 +1511,9 @@ void *virtqueue_get_avail(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
+	/* The driver event structure for a packed ring */
+	if (vq->packed_ring)
+		return vq->packed.driver;
 	return vq->vring.avail;
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_avail);
@@ -864,6 +1522,9 @@ void *virtqueue_get_used(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
+	/* The device event structure for a packed ring */
+	if (vq->packed_ring)
+		return vq->packed.device;
 	return vq->vring.used;
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_used);
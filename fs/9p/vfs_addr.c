@@ -34,6 +34,7 @@
 #include <linux/idr.h>
 #include <linux/sched.h>
 #include <linux/uio.h>
+#include <linux/slab.h>
 #include <net/9p/9p.h>
 #include <net/9p/client.h>
 
@@ -98,6 +99,43 @@ static int v9fs_vfs_readpage(struct file *filp, struct page *page)
 	return v9fs_fid_readpage(filp->private_data, page);
 }
 
+/*
+ * Readahead pages with consecutive indices are read with a single
+ * p9_client_read() over a bio_vec array, which the client splits into
+ * concurrent iounit-sized TREADs, instead of one synchronous TREAD per
+ * page.
+ */
+#define V9FS_READPAGES_BATCH	256
+
+static void v9fs_read_run(struct p9_fid *fid, struct inode *inode,
+			  struct bio_vec *bvec, int nr)
+{
+	struct iov_iter to;
+	int i, err, retval;
+
+	iov_iter_bvec(&to, ITER_BVEC | READ, bvec, nr, nr * PAGE_SIZE);
+	retval = p9_client_read(fid, page_offset(bvec[0].bv_page), &to, &err);
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = bvec[i].bv_page;
+		int done = retval - i * PAGE_SIZE;
+
+		if (err) {
+			v9fs_uncache_page(inode, page);
+		} else {
+			if (done < 0)
+				done = 0;
+			if (done < PAGE_SIZE)
+				zero_user(page, done, PAGE_SIZE - done);
+			flush_dcache_page(page);
+			SetPageUptodate(page);
+			v9fs_readpage_to_fscache(inode, page);
+		}
+		unlock_page(page);
+		page_cache_release(page);
+	}
+}
+
 /**
  * v9fs_vfs_readpages - read a set of pages from 9P
  *
@@ -113,6 +151,10 @@ static int v9fs_vfs_readpages(struct file *filp, struct address_space *mapping,
 {
 	int ret = 0;
 	struct inode *inode;
+	struct bio_vec *bvec;
+	unsigned batch;
+	gfp_t gfp = mapping_gfp_constraint(mapping, GFP_KERNEL);
+	int nr = 0;
 
 	inode = mapping->host;
 	p9_debug(P9_DEBUG_VFS, "inode: %p file: %p\n", inode, filp);
@@ -121,9 +163,39 @@ static int v9fs_vfs_readpages(struct file *filp, struct address_space *mapping,
 	if (ret == 0)
 		return ret;
 
-	ret = read_cache_pages(mapping, pages, (void *)v9fs_vfs_readpage, filp);
-	p9_debug(P9_DEBUG_VFS, "  = %d\n", ret);
-	return ret;
+	batch = min_t(unsigned, nr_pages, V9FS_READPAGES_BATCH);
+	bvec = batch ? kmalloc_array(batch, sizeof(*bvec), GFP_KERNEL) : NULL;
+	if (!bvec) {
+		ret = read_cache_pages(mapping, pages,
+				       (void *)v9fs_vfs_readpage, filp);
+		p9_debug(P9_DEBUG_VFS, "  = %d\n", ret);
+		return ret;
+	}
+
+	/* the list holds the pages in descending index order, take the tail */
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index, gfp)) {
+			page_cache_release(page);
+			continue;
+		}
+		if (nr && (nr == batch ||
+			   page->index != bvec[nr - 1].bv_page->index + 1)) {
+			v9fs_read_run(filp->private_data, inode, bvec, nr);
+			nr = 0;
+		}
+		bvec[nr].bv_page = page;
+		bvec[nr].bv_len = PAGE_SIZE;
+		bvec[nr].bv_offset = 0;
+		nr++;
+	}
+	if (nr)
+		v9fs_read_run(filp->private_data, inode, bvec, nr);
+	kfree(bvec);
+	p9_debug(P9_DEBUG_VFS, "  = 0\n");
+	return 0;
 }
 
 /**
@@ -17,6 +17,7 @@
 
 
 #include <linux/fscache-cache.h>
+#include <linux/blk_types.h>
 #include <linux/timer.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
@@ -40,12 +41,14 @@ struct cachefiles_object {
 	struct cachefiles_lookup_data	*lookup_data;	/* cached lookup data */
 	struct dentry			*dentry;	/* the file/dir representing this object */
 	struct dentry			*backer;	/* backing file */
+	struct file			*backing_file;	/* backer opened for direct reads */
 	loff_t				i_size;		/* object size */
 	unsigned long			flags;
 #define CACHEFILES_OBJECT_ACTIVE	0		/* T if marked active */
 	atomic_t			usage;		/* object usage count */
 	uint8_t				type;		/* object type */
 	uint8_t				new;		/* T if object new */
+	uint8_t				seek_data;	/* T if backer reports holes to SEEK_DATA */
 	spinlock_t			work_lock;
 	struct rb_node			active_node;	/* link in active tree (dentry is key) */
 };
@@ -94,11 +97,12 @@ struct cachefiles_cache {
  * backing file read tracking
  */
 struct cachefiles_one_read {
-	wait_queue_t			monitor;	/* link into monitored waitqueue */
-	struct page			*back_page;	/* backing file page we're waiting for */
+	struct kiocb			iocb;		/* direct read from the backing file */
+	struct bio_vec			bvec;		/* netfs page as the read target */
 	struct page			*netfs_page;	/* netfs page we're going to fill */
 	struct fscache_retrieval	*op;		/* retrieval op covering this */
 	struct list_head		op_link;	/* link in op's todo list */
+	long				ret;		/* result of the read */
 };
 
 /*
@@ -201,6 +205,8 @@ void cachefiles_hist(atomic_t histogram[], unsigned long start_jif)
 /*
  * rdwr.c
  */
+extern int cachefiles_open_backing_file(struct cachefiles_cache *,
+				       struct cachefiles_object *);
 extern int cachefiles_read_or_alloc_page(struct fscache_retrieval *,
 					 struct page *, gfp_t);
 extern int cachefiles_read_or_alloc_pages(struct fscache_retrieval *,
@@ -653,11 +653,15 @@ lookup_again:
 
 			ret = -EPERM;
 			aops = d_backing_inode(object->dentry)->i_mapping->a_ops;
-			if (!aops->bmap)
+			if (!aops->direct_IO)
 				goto check_error;
 			if (object->dentry->d_sb->s_blocksize > PAGE_SIZE)
 				goto check_error;
 
+			ret = cachefiles_open_backing_file(cache, object);
+			if (ret < 0)
+				goto check_error;
+
 			object->backer = object->dentry;
 		} else {
 			BUG(); // TODO: open file in data-class subdir
@@ -13,42 +13,25 @@
 #include <linux/slab.h>
 #include <linux/file.h>
 #include <linux/swap.h>
+#include <linux/uio.h>
 #include "internal.h"
 
 /*
- * detect wake up events generated by the unlocking of pages in which we're
- * interested
- * - we use this to detect read completion of backing pages
- * - the caller holds the waitqueue lock
+ * note the completion of a direct read from the backing file into a netfs
+ * page
+ * - this may be called from the backing device's completion interrupt, so
+ *   the rest of the work is handed to FS-Cache's thread pool
  */
-static int cachefiles_read_waiter(wait_queue_t *wait, unsigned mode,
-				  int sync, void *_key)
+static void cachefiles_read_complete(struct kiocb *iocb, long ret, long ret2)
 {
 	struct cachefiles_one_read *monitor =
-		container_of(wait, struct cachefiles_one_read, monitor);
+		container_of(iocb, struct cachefiles_one_read, iocb);
 	struct cachefiles_object *object;
-	struct wait_bit_key *key = _key;
-	struct page *page = wait->private;
+	unsigned long flags;
 
-	ASSERT(key);
+	_enter("{%lu},%ld", monitor->netfs_page->index, ret);
 
-	_enter("{%lu},%u,%d,{%p,%u}",
-	       monitor->netfs_page->index, mode, sync,
-	       key->flags, key->bit_nr);
-
-	if (key->flags != &page->flags ||
-	    key->bit_nr != PG_locked)
-		return 0;
-
-	_debug("--- monitor %p %lx ---", page, page->flags);
-
-	if (!PageUptodate(page) && !PageError(page)) {
-		/* unlocked, not uptodate and not erronous? */
-		_debug("page probably truncated");
-	}
-
-	/* remove from the waitqueue */
-	list_del(&wait->task_list);
+	monitor->ret = ret;
 
 	/* move onto the action list and queue for FS-Cache thread pool */
 	ASSERT(monitor->op);
@@ -56,97 +39,18 @@ static int cachefiles_read_waiter(wait_queue_t *wait, unsigned mode,
 	object = container_of(monitor->op->op.object,
 			      struct cachefiles_object, fscache);
 
-	spin_lock(&object->work_lock);
+	spin_lock_irqsave(&object->work_lock, flags);
 	list_add_tail(&monitor->op_link, &monitor->op->to_do);
-	spin_unlock(&object->work_lock);
+	spin_unlock_irqrestore(&object->work_lock, flags);
 
 	fscache_enqueue_retrieval(monitor->op);
-	return 0;
 }
 
 /*
- * handle a probably truncated page
- * - check to see if the page is still relevant and reissue the read if
- *   possible
- * - return -EIO on error, -ENODATA if the page is gone, -EINPROGRESS if we
- *   must wait again and 0 if successful
- */
-static int cachefiles_read_reissue(struct cachefiles_object *object,
-				   struct cachefiles_one_read *monitor)
-{
-	struct address_space *bmapping = d_backing_inode(object->backer)->i_mapping;
-	struct page *backpage = monitor->back_page, *backpage2;
-	int ret;
-
-	_enter("{ino=%lx},{%lx,%lx}",
-	       d_backing_inode(object->backer)->i_ino,
-	       backpage->index, backpage->flags);
-
-	/* skip if the page was truncated away completely */
-	if (backpage->mapping != bmapping) {
-		_leave(" = -ENODATA [mapping]");
-		return -ENODATA;
-	}
-
-	backpage2 = find_get_page(bmapping, backpage->index);
-	if (!backpage2) {
-		_leave(" = -ENODATA [gone]");
-		return -ENODATA;
-	}
-
-	if (backpage != backpage2) {
-		put_page(backpage2);
-		_leave(" = -ENODATA [different]");
-		return -ENODATA;
-	}
-
-	/* the page is still there and we already have a ref on it, so we don't
-	 * need a second */
-	put_page(backpage2);
-
-	INIT_LIST_HEAD(&monitor->op_link);
-	add_page_wait_queue(backpage, &monitor->monitor);
-
-	if (trylock_page(backpage)) {
-		ret = -EIO;
-		if (PageError(backpage))
-			goto unlock_discard;
-		ret = 0;
-		if (PageUptodate(backpage))
-			goto unlock_discard;
-
-		_debug("reissue read");
-		ret = bmapping->a_ops->readpage(NULL, backpage);
-		if (ret < 0)
-			goto unlock_discard;
-	}
-
-	/* but the page may have been read before the monitor was installed, so
-	 * the monitor may miss the event - so we have to ensure that we do get
-	 * one in such a case */
-	if (trylock_page(backpage)) {
-		_debug("jumpstart %p {%lx}", backpage, backpage->flags);
-		unlock_page(backpage);
-	}
-
-	/* it'll reappear on the todo list */
-	_leave(" = -EINPROGRESS");
-	return -EINPROGRESS;
-
-unlock_discard:
-	unlock_page(backpage);
-	spin_lock_irq(&object->work_lock);
-	list_del(&monitor->op_link);
-	spin_unlock_irq(&object->work_lock);
-	_leave(" = %d", ret);
-	return ret;
-}
-
-/*
- * copy data from backing pages to netfs pages to complete a read operation
+ * finish off reads of netfs pages that have completed
  * - driven by FS-Cache's thread pool
  */
-static void cachefiles_read_copier(struct fscache_operation *_op)
+static void cachefiles_read_finish(struct fscache_operation *_op)
 {
 	struct cachefiles_one_read *monitor;
 	struct cachefiles_object *object;
@@ -169,32 +73,28 @@ static void cachefiles_read_copier(struct fscache_operation *_op)
 
 		spin_unlock_irq(&object->work_lock);
 
-		_debug("- copy {%lu}", monitor->back_page->index);
+		_debug("- finish {%lu}", monitor->netfs_page->index);
 
-	recheck:
 		if (test_bit(FSCACHE_COOKIE_INVALIDATING,
 			     &object->fscache.cookie->flags)) {
 			error = -ESTALE;
-		} else if (PageUptodate(monitor->back_page)) {
-			copy_highpage(monitor->netfs_page, monitor->back_page);
+		} else if (monitor->ret >= 0) {
+			/* a short read means the page straddles the EOF */
+			if (monitor->ret < PAGE_SIZE)
+				zero_user_segment(monitor->netfs_page,
+						  monitor->ret, PAGE_SIZE);
 			fscache_mark_page_cached(monitor->op,
 						 monitor->netfs_page);
 			error = 0;
-		} else if (!PageError(monitor->back_page)) {
-			/* the page has probably been truncated */
-			error = cachefiles_read_reissue(object, monitor);
-			if (error == -EINPROGRESS)
-				goto next;
-			goto recheck;
 		} else {
 			cachefiles_io_error_obj(
 				object,
-				"Readpage failed on backing file %lx",
-				(unsigned long) monitor->back_page->flags);
+				"Read failed on backing file %ld",
+				monitor->ret);
 			error = -EIO;
 		}
 
-		page_cache_release(monitor->back_page);
+		fput(monitor->iocb.ki_filp);
 
 		fscache_end_io(op, monitor->netfs_page, error);
 		page_cache_release(monitor->netfs_page);
@@ -202,7 +102,6 @@ static void cachefiles_read_copier(struct fscache_operation *_op)
 		fscache_put_retrieval(op);
 		kfree(monitor);
 
-	next:
 		/* let the thread pool have some air occasionally */
 		max--;
 		if (max < 0 || need_resched()) {
@@ -220,157 +119,120 @@ static void cachefiles_read_copier(struct fscache_operation *_op)
 }
 
 /*
- * read the corresponding page to the given set from the backing file
- * - an uncertain page is simply discarded, to be tried again another time
+ * open the backing file of a data object for direct reads, once, when the
+ * object is looked up
+ * - the generic llseek implementations report the whole file as data, so
+ *   on backing filesystems that use them presence is checked with bmap
+ *   instead, and a filesystem with neither can't back the cache
  */
-static int cachefiles_read_backing_file_one(struct cachefiles_object *object,
-					    struct fscache_retrieval *op,
-					    struct page *netpage)
+int cachefiles_open_backing_file(struct cachefiles_cache *cache,
+				 struct cachefiles_object *object)
 {
-	struct cachefiles_one_read *monitor;
-	struct address_space *bmapping;
-	struct page *newpage, *backpage;
-	int ret;
-
-	_enter("");
-
-	_debug("read back %p{%lu,%d}",
-	       netpage, netpage->index, page_count(netpage));
-
-	monitor = kzalloc(sizeof(*monitor), cachefiles_gfp);
-	if (!monitor)
-		goto nomem;
+	loff_t (*llseek)(struct file *, loff_t, int);
+	struct file *file;
+	struct path path;
 
-	monitor->netfs_page = netpage;
-	monitor->op = fscache_get_retrieval(op);
+	path.mnt = cache->mnt;
+	path.dentry = object->dentry;
+	file = dentry_open(&path, O_RDONLY | O_LARGEFILE | O_DIRECT,
+			   cache->cache_cred);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	llseek = file->f_op->llseek;
+	object->seek_data = llseek && llseek != generic_file_llseek &&
+		llseek != default_llseek && llseek != noop_llseek &&
+		llseek != no_llseek;
+	if (!object->seek_data && !file->f_mapping->a_ops->bmap) {
+		fput(file);
+		return -EPERM;
+	}
 
-	init_waitqueue_func_entry(&monitor->monitor, cachefiles_read_waiter);
+	object->backing_file = file;
+	return 0;
+}
 
-	/* attempt to get hold of the backing page */
-	bmapping = d_backing_inode(object->backer)->i_mapping;
-	newpage = NULL;
+/*
+ * see whether the backing file holds data for a netfs page
+ * - we assume the presence of data at the start of the page is a good enough
+ *   indication for the page as a whole, as pages are only ever written whole
+ * - the data extent found is remembered in *data and *hole so that a run of
+ *   pages doesn't need a lookup for each page
+ */
+static bool cachefiles_page_present(struct cachefiles_object *object,
+				    pgoff_t index, loff_t *data, loff_t *hole)
+{
+	struct file *file = object->backing_file;
+	loff_t pos = (loff_t)index << PAGE_SHIFT;
 
-	for (;;) {
-		backpage = find_get_page(bmapping, netpage->index);
-		if (backpage)
-			goto backing_page_already_present;
+	if (pos >= *data && pos < *hole)
+		return true;
 
-		if (!newpage) {
-			newpage = __page_cache_alloc(cachefiles_gfp |
-						     __GFP_COLD);
-			if (!newpage)
-				goto nomem_monitor;
-		}
+	if (!object->seek_data) {
+		struct inode *inode = file_inode(file);
+		sector_t block;
 
-		ret = add_to_page_cache_lru(newpage, bmapping,
-					    netpage->index, cachefiles_gfp);
-		if (ret == 0)
-			goto installed_new_backing_page;
-		if (ret != -EEXIST)
-			goto nomem_page;
+		block = (sector_t)index <<
+			(PAGE_SHIFT - inode->i_sb->s_blocksize_bits);
+		return file->f_mapping->a_ops->bmap(file->f_mapping, block) != 0;
 	}
 
-	/* we've installed a new backing page, so now we need to start
-	 * it reading */
-installed_new_backing_page:
-	_debug("- new %p", newpage);
-
-	backpage = newpage;
-	newpage = NULL;
-
-read_backing_page:
-	ret = bmapping->a_ops->readpage(NULL, backpage);
-	if (ret < 0)
-		goto read_error;
-
-	/* set the monitor to transfer the data across */
-monitor_backing_page:
-	_debug("- monitor add");
-
-	/* install the monitor */
-	page_cache_get(monitor->netfs_page);
-	page_cache_get(backpage);
-	monitor->back_page = backpage;
-	monitor->monitor.private = backpage;
-	add_page_wait_queue(backpage, &monitor->monitor);
-	monitor = NULL;
-
-	/* but the page may have been read before the monitor was installed, so
-	 * the monitor may miss the event - so we have to ensure that we do get
-	 * one in such a case */
-	if (trylock_page(backpage)) {
-		_debug("jumpstart %p {%lx}", backpage, backpage->flags);
-		unlock_page(backpage);
+	*data = vfs_llseek(file, pos, SEEK_DATA);
+	if (*data != pos) {
+		/* a hole, or -ENXIO if there's no data at all beyond pos */
+		*data = *hole = 0;
+		return false;
 	}
-	goto success;
-
-	/* if the backing page is already present, it can be in one of
-	 * three states: read in progress, read failed or read okay */
-backing_page_already_present:
-	_debug("- present");
 
-	if (newpage) {
-		page_cache_release(newpage);
-		newpage = NULL;
-	}
+	*hole = vfs_llseek(file, pos, SEEK_HOLE);
+	if (*hole <= pos)
+		*hole = pos + PAGE_SIZE;
+	return true;
+}
 
-	if (PageError(backpage))
-		goto io_error;
+/*
+ * start a direct read of one netfs page from the backing file
+ * - the data goes straight into the netfs page, so the backing file's page
+ *   cache isn't populated and nothing needs to be copied
+ * - completion is reported through cachefiles_read_complete(), whether the
+ *   read was queued or finished synchronously
+ */
+static int cachefiles_read_backing_page(struct fscache_retrieval *op,
+					struct file *file,
+					struct page *netpage)
+{
+	struct cachefiles_one_read *monitor;
+	struct iov_iter iter;
+	ssize_t ret;
 
-	if (PageUptodate(backpage))
-		goto backing_page_already_uptodate;
+	_enter("{%lu}", netpage->index);
 
-	if (!trylock_page(backpage))
-		goto monitor_backing_page;
-	_debug("read %p {%lx}", backpage, backpage->flags);
-	goto read_backing_page;
+	monitor = kzalloc(sizeof(*monitor), cachefiles_gfp);
+	if (!monitor) {
+		fscache_retrieval_complete(op, 1);
+		_leave(" = -ENOMEM");
+		return -ENOMEM;
+	}
 
-	/* the backing page is already up to date, attach the netfs
-	 * page to the pagecache and LRU and copy the data across */
-backing_page_already_uptodate:
-	_debug("- uptodate");
+	page_cache_get(netpage);
+	monitor->netfs_page = netpage;
+	monitor->op = fscache_get_retrieval(op);
 
-	fscache_mark_page_cached(op, netpage);
+	monitor->bvec.bv_page = netpage;
+	monitor->bvec.bv_len = PAGE_SIZE;
+	monitor->bvec.bv_offset = 0;
+	iov_iter_bvec(&iter, ITER_BVEC | READ, &monitor->bvec, 1, PAGE_SIZE);
 
-	copy_highpage(netpage, backpage);
-	fscache_end_io(op, netpage, 0);
-	fscache_retrieval_complete(op, 1);
+	init_sync_kiocb(&monitor->iocb, get_file(file));
+	monitor->iocb.ki_pos = (loff_t)netpage->index << PAGE_SHIFT;
+	monitor->iocb.ki_complete = cachefiles_read_complete;
 
-success:
-	_debug("success");
-	ret = 0;
+	ret = file->f_op->read_iter(&monitor->iocb, &iter);
+	if (ret != -EIOCBQUEUED)
+		cachefiles_read_complete(&monitor->iocb, ret, 0);
 
-out:
-	if (backpage)
-		page_cache_release(backpage);
-	if (monitor) {
-		fscache_put_retrieval(monitor->op);
-		kfree(monitor);
-	}
-	_leave(" = %d", ret);
-	return ret;
-
-read_error:
-	_debug("read error %d", ret);
-	if (ret == -ENOMEM) {
-		fscache_retrieval_complete(op, 1);
-		goto out;
-	}
-io_error:
-	cachefiles_io_error_obj(object, "Page read error on backing file");
-	fscache_retrieval_complete(op, 1);
-	ret = -ENOBUFS;
-	goto out;
-
-nomem_page:
-	page_cache_release(newpage);
-nomem_monitor:
-	fscache_put_retrieval(monitor->op);
-	kfree(monitor);
-nomem:
-	fscache_retrieval_complete(op, 1);
-	_leave(" = -ENOMEM");
-	return -ENOMEM;
+	_leave(" = 0");
+	return 0;
 }
 
 /*
@@ -394,8 +256,7 @@ int cachefiles_read_or_alloc_page(struct fscache_retrieval *op,
 	struct cachefiles_object *object;
 	struct cachefiles_cache *cache;
 	struct inode *inode;
-	sector_t block0, block;
-	unsigned shift;
+	loff_t data = 0, hole = 0;
 	int ret;
 
 	object = container_of(op->op.object,
@@ -410,34 +271,17 @@ int cachefiles_read_or_alloc_page(struct fscache_retrieval *op,
 
 	inode = d_backing_inode(object->backer);
 	ASSERT(S_ISREG(inode->i_mode));
-	ASSERT(inode->i_mapping->a_ops->bmap);
-	ASSERT(inode->i_mapping->a_ops->readpages);
-
-	/* calculate the shift required to use bmap */
-	shift = PAGE_SHIFT - inode->i_sb->s_blocksize_bits;
+	ASSERT(inode->i_mapping->a_ops->direct_IO);
 
 	op->op.flags &= FSCACHE_OP_KEEP_FLAGS;
 	op->op.flags |= FSCACHE_OP_ASYNC;
-	op->op.processor = cachefiles_read_copier;
+	op->op.processor = cachefiles_read_finish;
 
-	/* we assume the absence or presence of the first block is a good
-	 * enough indication for the page as a whole
-	 * - TODO: don't use bmap() for this as it is _not_ actually good
-	 *   enough for this as it doesn't indicate errors, but it's all we've
-	 *   got for the moment
-	 */
-	block0 = page->index;
-	block0 <<= shift;
-
-	block = inode->i_mapping->a_ops->bmap(inode->i_mapping, block0);
-	_debug("%llx -> %llx",
-	       (unsigned long long) block0,
-	       (unsigned long long) block);
-
-	if (block) {
+	if (cachefiles_page_present(object, page->index, &data, &hole)) {
 		/* submit the apparently valid page to the backing fs to be
 		 * read from disk */
-		ret = cachefiles_read_backing_file_one(object, op, page);
+		ret = cachefiles_read_backing_page(op, object->backing_file,
+						   page);
 	} else if (cachefiles_has_space(cache, 0, 1) == 0) {
 		/* there's space in the cache we can use */
 		fscache_mark_page_cached(op, page);
@@ -460,13 +304,11 @@ enobufs:
  * read the corresponding pages to the given set from the backing file
  * - any uncertain pages are simply discarded, to be tried again another time
  */
-static int cachefiles_read_backing_file(struct cachefiles_object *object,
-					struct fscache_retrieval *op,
+static int cachefiles_read_backing_file(struct fscache_retrieval *op,
+					struct file *file,
 					struct list_head *list)
 {
-	struct cachefiles_one_read *monitor = NULL;
-	struct address_space *bmapping = d_backing_inode(object->backer)->i_mapping;
-	struct page *newpage = NULL, *netpage, *_n, *backpage = NULL;
+	struct page *netpage, *_n;
 	int ret = 0;
 
 	_enter("");
@@ -477,171 +319,28 @@ static int cachefiles_read_backing_file(struct cachefiles_object *object,
 		_debug("read back %p{%lu,%d}",
 		       netpage, netpage->index, page_count(netpage));
 
-		if (!monitor) {
-			monitor = kzalloc(sizeof(*monitor), cachefiles_gfp);
-			if (!monitor)
-				goto nomem;
-
-			monitor->op = fscache_get_retrieval(op);
-			init_waitqueue_func_entry(&monitor->monitor,
-						  cachefiles_read_waiter);
-		}
-
-		for (;;) {
-			backpage = find_get_page(bmapping, netpage->index);
-			if (backpage)
-				goto backing_page_already_present;
-
-			if (!newpage) {
-				newpage = __page_cache_alloc(cachefiles_gfp |
-							     __GFP_COLD);
-				if (!newpage)
-					goto nomem;
-			}
-
-			ret = add_to_page_cache_lru(newpage, bmapping,
-						    netpage->index,
-						    cachefiles_gfp);
-			if (ret == 0)
-				goto installed_new_backing_page;
-			if (ret != -EEXIST)
-				goto nomem;
-		}
-
-		/* we've installed a new backing page, so now we need
-		 * to start it reading */
-	installed_new_backing_page:
-		_debug("- new %p", newpage);
-
-		backpage = newpage;
-		newpage = NULL;
-
-	reread_backing_page:
-		ret = bmapping->a_ops->readpage(NULL, backpage);
-		if (ret < 0)
-			goto read_error;
-
-		/* add the netfs page to the pagecache and LRU, and set the
-		 * monitor to transfer the data across */
-	monitor_backing_page:
-		_debug("- monitor add");
-
-		ret = add_to_page_cache_lru(netpage, op->mapping,
-					    netpage->index, cachefiles_gfp);
-		if (ret < 0) {
-			if (ret == -EEXIST) {
-				page_cache_release(netpage);
-				fscache_retrieval_complete(op, 1);
-				continue;
-			}
-			goto nomem;
-		}
-
-		/* install a monitor */
-		page_cache_get(netpage);
-		monitor->netfs_page = netpage;
-
-		page_cache_get(backpage);
-		monitor->back_page = backpage;
-		monitor->monitor.private = backpage;
-		add_page_wait_queue(backpage, &monitor->monitor);
-		monitor = NULL;
-
-		/* but the page may have been read before the monitor was
-		 * installed, so the monitor may miss the event - so we have to
-		 * ensure that we do get one in such a case */
-		if (trylock_page(backpage)) {
-			_debug("2unlock %p {%lx}", backpage, backpage->flags);
-			unlock_page(backpage);
-		}
-
-		page_cache_release(backpage);
-		backpage = NULL;
-
-		page_cache_release(netpage);
-		netpage = NULL;
-		continue;
-
-		/* if the backing page is already present, it can be in one of
-		 * three states: read in progress, read failed or read okay */
-	backing_page_already_present:
-		_debug("- present %p", backpage);
-
-		if (PageError(backpage))
-			goto io_error;
-
-		if (PageUptodate(backpage))
-			goto backing_page_already_uptodate;
-
-		_debug("- not ready %p{%lx}", backpage, backpage->flags);
-
-		if (!trylock_page(backpage))
-			goto monitor_backing_page;
-
-		if (PageError(backpage)) {
-			_debug("error %lx", backpage->flags);
-			unlock_page(backpage);
-			goto io_error;
-		}
-
-		if (PageUptodate(backpage))
-			goto backing_page_already_uptodate_unlock;
-
-		/* we've locked a page that's neither up to date nor erroneous,
-		 * so we need to attempt to read it again */
-		goto reread_backing_page;
-
-		/* the backing page is already up to date, attach the netfs
-		 * page to the pagecache and LRU and copy the data across */
-	backing_page_already_uptodate_unlock:
-		_debug("uptodate %lx", backpage->flags);
-		unlock_page(backpage);
-	backing_page_already_uptodate:
-		_debug("- uptodate");
-
+		/* add the netfs page to the pagecache and LRU; it comes back
+		 * locked for the read */
 		ret = add_to_page_cache_lru(netpage, op->mapping,
 					    netpage->index, cachefiles_gfp);
 		if (ret < 0) {
+			page_cache_release(netpage);
+			fscache_retrieval_complete(op, 1);
 			if (ret == -EEXIST) {
-				page_cache_release(netpage);
-				fscache_retrieval_complete(op, 1);
+				ret = 0;
 				continue;
 			}
 			goto nomem;
 		}
 
-		copy_highpage(netpage, backpage);
-
-		page_cache_release(backpage);
-		backpage = NULL;
-
-		fscache_mark_page_cached(op, netpage);
-
-		/* the netpage is unlocked and marked up to date here */
-		fscache_end_io(op, netpage, 0);
+		ret = cachefiles_read_backing_page(op, file, netpage);
 		page_cache_release(netpage);
-		netpage = NULL;
-		fscache_retrieval_complete(op, 1);
-		continue;
+		if (ret < 0)
+			goto out;
 	}
 
-	netpage = NULL;
-
-	_debug("out");
-
 out:
 	/* tidy up */
-	if (newpage)
-		page_cache_release(newpage);
-	if (netpage)
-		page_cache_release(netpage);
-	if (backpage)
-		page_cache_release(backpage);
-	if (monitor) {
-		fscache_put_retrieval(op);
-		kfree(monitor);
-	}
-
 	list_for_each_entry_safe(netpage, _n, list, lru) {
 		list_del(&netpage->lru);
 		page_cache_release(netpage);
@@ -654,17 +353,6 @@ out:
 nomem:
 	_debug("nomem");
 	ret = -ENOMEM;
-	goto record_page_complete;
-
-read_error:
-	_debug("read error %d", ret);
-	if (ret == -ENOMEM)
-		goto record_page_complete;
-io_error:
-	cachefiles_io_error_obj(object, "Page read error on backing file");
-	ret = -ENOBUFS;
-record_page_complete:
-	fscache_retrieval_complete(op, 1);
 	goto out;
 }
 
@@ -682,8 +370,10 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	struct list_head backpages;
 	struct pagevec pagevec;
 	struct inode *inode;
+	struct file *file;
 	struct page *page, *_n;
-	unsigned shift, nrbackpages;
+	loff_t data = 0, hole = 0;
+	unsigned nrbackpages;
 	int ret, ret2, space;
 
 	object = container_of(op->op.object,
@@ -704,41 +394,21 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 
 	inode = d_backing_inode(object->backer);
 	ASSERT(S_ISREG(inode->i_mode));
-	ASSERT(inode->i_mapping->a_ops->bmap);
-	ASSERT(inode->i_mapping->a_ops->readpages);
-
-	/* calculate the shift required to use bmap */
-	shift = PAGE_SHIFT - inode->i_sb->s_blocksize_bits;
+	ASSERT(inode->i_mapping->a_ops->direct_IO);
 
+	file = object->backing_file;
 	pagevec_init(&pagevec, 0);
 
 	op->op.flags &= FSCACHE_OP_KEEP_FLAGS;
 	op->op.flags |= FSCACHE_OP_ASYNC;
-	op->op.processor = cachefiles_read_copier;
+	op->op.processor = cachefiles_read_finish;
 
 	INIT_LIST_HEAD(&backpages);
 	nrbackpages = 0;
 
 	ret = space ? -ENODATA : -ENOBUFS;
 	list_for_each_entry_safe(page, _n, pages, lru) {
-		sector_t block0, block;
-
-		/* we assume the absence or presence of the first block is a
-		 * good enough indication for the page as a whole
-		 * - TODO: don't use bmap() for this as it is _not_ actually
-		 *   good enough for this as it doesn't indicate errors, but
-		 *   it's all we've got for the moment
-		 */
-		block0 = page->index;
-		block0 <<= shift;
-
-		block = inode->i_mapping->a_ops->bmap(inode->i_mapping,
-						      block0);
-		_debug("%llx -> %llx",
-		       (unsigned long long) block0,
-		       (unsigned long long) block);
-
-		if (block) {
+		if (cachefiles_page_present(object, page->index, &data, &hole)) {
 			/* we have data - add it to the list to give to the
 			 * backing fs */
 			list_move(&page->lru, &backpages);
@@ -762,7 +432,7 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	/* submit the apparently valid pages to the backing fs to be read from
 	 * disk */
 	if (nrbackpages > 0) {
-		ret2 = cachefiles_read_backing_file(object, op, &backpages);
+		ret2 = cachefiles_read_backing_file(op, file, &backpages);
 		if (ret2 == -ENOMEM || ret2 == -EINTR)
 			ret = ret2;
 	}
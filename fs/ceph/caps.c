@@ -949,9 +949,7 @@ void __ceph_remove_cap(struct ceph_cap *cap, bool queue_release)
 	    (!session->s_cap_reconnect || cap->cap_gen == session->s_cap_gen)) {
 		cap->queue_release = 1;
 		if (removed) {
-			list_add_tail(&cap->session_caps,
-				      &session->s_cap_releases);
-			session->s_num_cap_releases++;
+			__ceph_queue_cap_release(session, cap);
 			removed = 0;
 		}
 	} else {
@@ -3485,9 +3483,7 @@ void ceph_handle_caps(struct ceph_mds_session *session,
 			cap->mseq = mseq;
 			cap->seq = seq;
 			spin_lock(&session->s_cap_lock);
-			list_add_tail(&cap->session_caps,
-					&session->s_cap_releases);
-			session->s_num_cap_releases++;
+			__ceph_queue_cap_release(session, cap);
 			spin_unlock(&session->s_cap_lock);
 		}
 		goto flush_cap_releases;
@@ -3565,9 +3561,10 @@ flush_cap_releases:
 	/*
 	 * send any cap release message to try to move things
 	 * along for the mds (who clearly thinks we still have this
-	 * cap).
+	 * cap).  Let the work item do it, so that a burst of these
+	 * goes out as one message.
 	 */
-	ceph_send_cap_releases(mdsc, session);
+	ceph_flush_cap_releases(mdsc, session);
 
 done:
 	mutex_unlock(&session->s_mutex);
@@ -53,6 +53,7 @@ struct ceph_reconnect_state {
 
 static void __wake_requests(struct ceph_mds_client *mdsc,
 			    struct list_head *head);
+static void ceph_cap_release_work(struct work_struct *work);
 
 static const struct ceph_connection_operations mds_con_ops;
 
@@ -459,6 +460,7 @@ static struct ceph_mds_session *register_session(struct ceph_mds_client *mdsc,
 	s->s_cap_reconnect = 0;
 	s->s_cap_iterator = NULL;
 	INIT_LIST_HEAD(&s->s_cap_releases);
+	INIT_WORK(&s->s_cap_release_work, ceph_cap_release_work);
 	INIT_LIST_HEAD(&s->s_cap_flushing);
 	INIT_LIST_HEAD(&s->s_cap_snaps_flushing);
 
@@ -1118,9 +1120,7 @@ static int iterate_session_caps(struct ceph_mds_session *session,
 			list_del_init(&cap->session_caps);
 			session->s_nr_caps--;
 			if (cap->queue_release) {
-				list_add_tail(&cap->session_caps,
-					      &session->s_cap_releases);
-				session->s_num_cap_releases++;
+				__ceph_queue_cap_release(session, cap);
 			} else {
 				old_cap = cap;  /* put_cap it w/o locks held */
 			}
@@ -1655,6 +1655,57 @@ out_err:
 	spin_unlock(&session->s_cap_lock);
 }
 
+static void ceph_cap_release_work(struct work_struct *work)
+{
+	struct ceph_mds_session *session =
+		container_of(work, struct ceph_mds_session, s_cap_release_work);
+
+	mutex_lock(&session->s_mutex);
+	if (session->s_state == CEPH_MDS_SESSION_OPEN ||
+	    session->s_state == CEPH_MDS_SESSION_HUNG)
+		ceph_send_cap_releases(session->s_mdsc, session);
+	mutex_unlock(&session->s_mutex);
+	ceph_put_mds_session(session);
+}
+
+/*
+ * Send queued cap releases from process context, without waiting for
+ * the next delayed_work tick.
+ */
+void ceph_flush_cap_releases(struct ceph_mds_client *mdsc,
+			     struct ceph_mds_session *session)
+{
+	if (mdsc->stopping)
+		return;
+
+	get_session(session);
+	if (queue_work(mdsc->fsc->cap_wq, &session->s_cap_release_work)) {
+		dout("cap release work queued mds%d\n", session->s_mds);
+	} else {
+		ceph_put_mds_session(session);
+		dout("cap release work already queued mds%d\n",
+		     session->s_mds);
+	}
+}
+
+/*
+ * Queue a cap for release.  Releases are normally sent in bulk by
+ * delayed_work; as soon as a full message's worth has built up (e.g.
+ * while a large tree is being removed), send it right away rather than
+ * letting the list grow until the next tick.
+ *
+ * caller holds s_cap_lock
+ */
+void __ceph_queue_cap_release(struct ceph_mds_session *session,
+			      struct ceph_cap *cap)
+{
+	list_add_tail(&cap->session_caps, &session->s_cap_releases);
+	session->s_num_cap_releases++;
+
+	if (!(session->s_num_cap_releases % CEPH_CAPS_PER_RELEASE))
+		ceph_flush_cap_releases(session->s_mdsc, session);
+}
+
 /*
  * requests
  */
@@ -3521,6 +3572,7 @@ void ceph_mdsc_pre_umount(struct ceph_mds_client *mdsc)
 {
 	dout("pre_umount\n");
 	mdsc->stopping = 1;
+	flush_workqueue(mdsc->fsc->cap_wq);
 
 	drop_leases(mdsc);
 	ceph_flush_dirty_caps(mdsc);
@@ -139,6 +139,7 @@ struct ceph_mds_session {
 	int		  s_cap_reconnect;
 	int		  s_readonly;
 	struct list_head  s_cap_releases; /* waiting cap_release messages */
+	struct work_struct s_cap_release_work;
 	struct ceph_cap  *s_cap_iterator;
 
 	/* protected by mutex */
@@ -400,6 +401,10 @@ static inline void ceph_mdsc_put_request(struct ceph_mds_request *req)
 
 extern void ceph_send_cap_releases(struct ceph_mds_client *mdsc,
 				   struct ceph_mds_session *session);
+extern void ceph_flush_cap_releases(struct ceph_mds_client *mdsc,
+				    struct ceph_mds_session *session);
+extern void __ceph_queue_cap_release(struct ceph_mds_session *session,
+				     struct ceph_cap *cap);
 
 extern void ceph_mdsc_pre_umount(struct ceph_mds_client *mdsc);
 
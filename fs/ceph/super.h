@@ -88,6 +88,7 @@ struct ceph_fs_client {
 	struct workqueue_struct *wb_wq;
 	struct workqueue_struct *pg_inv_wq;
 	struct workqueue_struct *trunc_wq;
+	struct workqueue_struct *cap_wq;
 	atomic_long_t writeback_count;
 
 	struct backing_dev_info backing_dev_info;
@@ -19,12 +19,14 @@
 
 #include "dlm_internal.h"
 #include "lock.h"
+#include "lowcomms.h"
 
 #define DLM_DEBUG_BUF_LEN 4096
 static char debug_buf[DLM_DEBUG_BUF_LEN];
 static struct mutex debug_buf_lock;
 
 static struct dentry *dlm_root;
+static struct dentry *dlm_comms_latency_dentry;
 
 static char *print_lockmode(int mode)
 {
@@ -697,6 +699,40 @@ static const struct file_operations waiters_fops = {
 	.llseek  = default_llseek,
 };
 
+/*
+ * histograms of the time connections wait for the dlm_recv and dlm_send
+ * workqueues, shared by all lockspaces
+ */
+static int comms_latency_show(struct seq_file *s, void *ignored)
+{
+	unsigned long recv[DLM_COMMS_LAT_BUCKETS];
+	unsigned long send[DLM_COMMS_LAT_BUCKETS];
+	int i;
+
+	dlm_lowcomms_latency(DLM_COMMS_RECV, recv);
+	dlm_lowcomms_latency(DLM_COMMS_SEND, send);
+
+	seq_printf(s, "%-12s %12s %12s\n", "usecs", "recv", "send");
+	for (i = 0; i < DLM_COMMS_LAT_BUCKETS - 1; i++)
+		seq_printf(s, "< %-10lu %12lu %12lu\n", 1UL << i,
+			   recv[i], send[i]);
+	seq_printf(s, ">= %-9lu %12lu %12lu\n", 1UL << i, recv[i], send[i]);
+	return 0;
+}
+
+static int comms_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, comms_latency_show, NULL);
+}
+
+static const struct file_operations comms_latency_fops = {
+	.owner   = THIS_MODULE,
+	.open    = comms_latency_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 void dlm_delete_debug_file(struct dlm_ls *ls)
 {
 	debugfs_remove(ls->ls_debug_rsb_dentry);
@@ -781,11 +817,18 @@ int __init dlm_register_debugfs(void)
 {
 	mutex_init(&debug_buf_lock);
 	dlm_root = debugfs_create_dir("dlm", NULL);
-	return dlm_root ? 0 : -ENOMEM;
+	if (!dlm_root)
+		return -ENOMEM;
+	dlm_comms_latency_dentry = debugfs_create_file("comms_latency",
+						       S_IFREG | S_IRUGO,
+						       dlm_root, NULL,
+						       &comms_latency_fops);
+	return 0;
 }
 
 void dlm_unregister_debugfs(void)
 {
+	debugfs_remove(dlm_comms_latency_dentry);
 	debugfs_remove(dlm_root);
 }
 
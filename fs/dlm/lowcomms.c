@@ -124,6 +124,8 @@ struct connection {
 	struct connection *othercon;
 	struct work_struct rwork; /* Receive workqueue */
 	struct work_struct swork; /* Send workqueue */
+	ktime_t rwork_queued;	/* For the queue latency histograms */
+	ktime_t swork_queued;
 	void (*orig_error_report)(struct sock *sk);
 };
 #define sock2con(x) ((struct connection *)(x)->sk_user_data)
@@ -165,6 +167,52 @@ static struct kmem_cache *con_cache;
 static void process_recv_sockets(struct work_struct *work);
 static void process_send_sockets(struct work_struct *work);
 
+/* Time from queueing a connection's work to it running, log2 usecs */
+static DEFINE_PER_CPU(unsigned long [DLM_COMMS_NR][DLM_COMMS_LAT_BUCKETS],
+		      comms_latency);
+
+/*
+ * The receive workqueue is bound, so a connection's receive work runs on
+ * the CPU that took the socket callback, i.e. the one the network stack
+ * steered the flow to.  Different connections are processed in parallel.
+ */
+static void queue_rwork(struct connection *con)
+{
+	con->rwork_queued = ktime_get();
+	queue_work(recv_workqueue, &con->rwork);
+}
+
+static void queue_swork(struct connection *con)
+{
+	con->swork_queued = ktime_get();
+	queue_work(send_workqueue, &con->swork);
+}
+
+static void account_latency(int dir, ktime_t queued)
+{
+	s64 us = ktime_us_delta(ktime_get(), queued);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, fls64(us), DLM_COMMS_LAT_BUCKETS - 1);
+	this_cpu_inc(comms_latency[dir][bucket]);
+}
+
+/*
+ * Sum the latency histogram of one direction over all CPUs.  Bucket 0
+ * counts work that ran within a microsecond, bucket n latencies below
+ * 2^n usecs and the last bucket everything longer.
+ */
+void dlm_lowcomms_latency(int dir, unsigned long *hist)
+{
+	int cpu, i;
+
+	memset(hist, 0, DLM_COMMS_LAT_BUCKETS * sizeof(*hist));
+	for_each_possible_cpu(cpu)
+		for (i = 0; i < DLM_COMMS_LAT_BUCKETS; i++)
+			hist[i] += per_cpu(comms_latency, cpu)[dir][i];
+}
+
 
 /* This is deliberately very simple because most clusters have simple
    sequential nodeids, so we should be able to go straight to a connection
@@ -407,7 +455,7 @@ static void lowcomms_data_ready(struct sock *sk)
 {
 	struct connection *con = sock2con(sk);
 	if (con && !test_and_set_bit(CF_READ_PENDING, &con->flags))
-		queue_work(recv_workqueue, &con->rwork);
+		queue_rwork(con);
 }
 
 static void lowcomms_write_space(struct sock *sk)
@@ -425,7 +473,7 @@ static void lowcomms_write_space(struct sock *sk)
 	}
 
 	if (!test_and_set_bit(CF_WRITE_PENDING, &con->flags))
-		queue_work(send_workqueue, &con->swork);
+		queue_swork(con);
 }
 
 static inline void lowcomms_connect_sock(struct connection *con)
@@ -433,7 +481,7 @@ static inline void lowcomms_connect_sock(struct connection *con)
 	if (test_bit(CF_CLOSE, &con->flags))
 		return;
 	if (!test_and_set_bit(CF_CONNECT_PENDING, &con->flags))
-		queue_work(send_workqueue, &con->swork);
+		queue_swork(con);
 }
 
 static void lowcomms_state_change(struct sock *sk)
@@ -652,7 +700,7 @@ static int receive_from_sock(struct connection *con)
 
 out_resched:
 	if (!test_and_set_bit(CF_READ_PENDING, &con->flags))
-		queue_work(recv_workqueue, &con->rwork);
+		queue_rwork(con);
 	mutex_unlock(&con->sock_mutex);
 	return -EAGAIN;
 
@@ -786,7 +834,7 @@ static int tcp_accept_from_sock(struct connection *con)
 	 * to the read_sockets list
 	 */
 	if (!test_and_set_bit(CF_READ_PENDING, &addcon->flags))
-		queue_work(recv_workqueue, &addcon->rwork);
+		queue_rwork(addcon);
 	mutex_unlock(&con->sock_mutex);
 
 	return 0;
@@ -899,7 +947,7 @@ static int sctp_accept_from_sock(struct connection *con)
 	 * to the read_sockets list
 	 */
 	if (!test_and_set_bit(CF_READ_PENDING, &addcon->flags))
-		queue_work(recv_workqueue, &addcon->rwork);
+		queue_rwork(addcon);
 	mutex_unlock(&con->sock_mutex);
 
 	return 0;
@@ -1408,7 +1456,7 @@ void dlm_lowcomms_commit_buffer(void *mh)
 	spin_unlock(&con->writequeue_lock);
 
 	if (!test_and_set_bit(CF_WRITE_PENDING, &con->flags)) {
-		queue_work(send_workqueue, &con->swork);
+		queue_swork(con);
 	}
 	return;
 
@@ -1423,7 +1471,7 @@ static void send_to_sock(struct connection *con)
 	int ret = 0;
 	const int msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
 	struct writequeue_entry *e;
-	int len, offset;
+	int len, offset, flags;
 	int count = 0;
 
 	mutex_lock(&con->sock_mutex);
@@ -1440,12 +1488,22 @@ static void send_to_sock(struct connection *con)
 		len = e->len;
 		offset = e->offset;
 		BUG_ON(len == 0 && e->users == 0);
+		/*
+		 * Let the transport coalesce this page with the next one if
+		 * that is ready to go too, rather than push a short segment
+		 * per page.
+		 */
+		flags = msg_flags;
+		if (e->list.next != &con->writequeue &&
+		    list_entry(e->list.next, struct writequeue_entry,
+			       list)->len)
+			flags |= MSG_MORE;
 		spin_unlock(&con->writequeue_lock);
 
 		ret = 0;
 		if (len) {
 			ret = kernel_sendpage(con->sock, e->page, offset, len,
-					      msg_flags);
+					      flags);
 			if (ret == -EAGAIN || ret == 0) {
 				if (ret == -EAGAIN &&
 				    test_bit(SOCKWQ_ASYNC_NOSPACE, &con->sock->flags) &&
@@ -1533,6 +1591,7 @@ static void process_recv_sockets(struct work_struct *work)
 	struct connection *con = container_of(work, struct connection, rwork);
 	int err;
 
+	account_latency(DLM_COMMS_RECV, con->rwork_queued);
 	clear_bit(CF_READ_PENDING, &con->flags);
 	do {
 		err = con->rx_action(con);
@@ -1544,6 +1603,7 @@ static void process_send_sockets(struct work_struct *work)
 {
 	struct connection *con = container_of(work, struct connection, swork);
 
+	account_latency(DLM_COMMS_SEND, con->swork_queued);
 	if (test_and_clear_bit(CF_CONNECT_PENDING, &con->flags))
 		con->connect_action(con);
 	if (test_and_clear_bit(CF_WRITE_PENDING, &con->flags))
@@ -1566,14 +1626,14 @@ static void work_stop(void)
 static int work_start(void)
 {
 	recv_workqueue = alloc_workqueue("dlm_recv",
-					 WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+					 WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
 	if (!recv_workqueue) {
 		log_print("can't start dlm_recv");
 		return -ENOMEM;
 	}
 
 	send_workqueue = alloc_workqueue("dlm_send",
-					 WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+					 WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
 	if (!send_workqueue) {
 		log_print("can't start dlm_send");
 		destroy_workqueue(recv_workqueue);
@@ -14,6 +14,11 @@
 #ifndef __LOWCOMMS_DOT_H__
 #define __LOWCOMMS_DOT_H__
 
+#define DLM_COMMS_RECV		0
+#define DLM_COMMS_SEND		1
+#define DLM_COMMS_NR		2
+#define DLM_COMMS_LAT_BUCKETS	24
+
 int dlm_lowcomms_start(void);
 void dlm_lowcomms_stop(void);
 void dlm_lowcomms_exit(void);
@@ -22,6 +27,7 @@ void *dlm_lowcomms_get_buffer(int nodeid, int len, gfp_t allocation, char **ppc)
 void dlm_lowcomms_commit_buffer(void *mh);
 int dlm_lowcomms_connect_node(int nodeid);
 int dlm_lowcomms_addr(int nodeid, struct sockaddr_storage *addr, int len);
+void dlm_lowcomms_latency(int dir, unsigned long *hist);
 
 #endif				/* __LOWCOMMS_DOT_H__ */
 
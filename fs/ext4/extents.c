@@ -2820,6 +2820,7 @@ int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start,
 	handle = ext4_journal_start(inode, EXT4_HT_TRUNCATE, depth + 1);
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_track_range(handle, inode, start, end);
 
 again:
 	trace_ext4_ext_remove_space(inode, start, end, depth);
@@ -5571,6 +5572,7 @@ int ext4_collapse_range(struct inode *inode, loff_t offset, loff_t len)
 		goto out_stop;
 	}
 	ext4_discard_preallocations(inode);
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	ret = ext4_ext_shift_extents(inode, handle, punch_stop,
 				     punch_stop - punch_start, SHIFT_LEFT);
@@ -5751,6 +5753,7 @@ int ext4_insert_range(struct inode *inode, loff_t offset, loff_t len)
 	 * if offset_lblk lies in a hole which is at start of file, use
 	 * ee_start_lblk to shift extents
 	 */
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 	ret = ext4_ext_shift_extents(inode, handle,
 		ee_start_lblk > offset_lblk ? ee_start_lblk : offset_lblk,
 		len_lblk, SHIFT_RIGHT);
@@ -5803,6 +5806,7 @@ ext4_swap_extents(handle_t *handle, struct inode *inode1,
 	BUG_ON(!mutex_is_locked(&inode1->i_mutex));
 	BUG_ON(!mutex_is_locked(&inode2->i_mutex));
 
+	ext4_fc_mark_ineligible(inode1->i_sb, handle);
 	*erp = ext4_es_remove_extent(inode1, lblk1, count);
 	if (unlikely(*erp))
 		return 0;
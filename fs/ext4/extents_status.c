@@ -10,6 +10,7 @@
  * Ext4 extents status tree core functions.
  */
 #include <linux/list_sort.h>
+#include <linux/hash.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include "ext4.h"
@@ -112,7 +113,11 @@
  *	next extent, adding a extent(a range of blocks) and removing a extent.
  *
  *   --	race on a extent status tree
- *	Extent status tree is protected by inode->i_es_lock.
+ *	Extent status tree is protected by inode->i_es_lock.  Changes are
+ *	also made inside a write section of i_es_tree.seq, which lets
+ *	ext4_es_lookup_extent() walk the tree under RCU and only take the
+ *	lock when it races with a writer.  The extent cache is
+ *	SLAB_DESTROY_BY_RCU so that such a walk never touches freed memory.
  *
  *   --	memory consumption
  *      Fragmented extent tree will make extent status tree cost too much
@@ -153,7 +158,8 @@ int __init ext4_init_es(void)
 {
 	ext4_es_cachep = kmem_cache_create("ext4_extent_status",
 					   sizeof(struct extent_status),
-					   0, (SLAB_RECLAIM_ACCOUNT), NULL);
+					   0, (SLAB_RECLAIM_ACCOUNT |
+					       SLAB_DESTROY_BY_RCU), NULL);
 	if (ext4_es_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -169,6 +175,26 @@ void ext4_es_init_tree(struct ext4_es_tree *tree)
 {
 	tree->root = RB_ROOT;
 	tree->cache_es = NULL;
+	seqcount_init(&tree->seq);
+}
+
+static inline void es_write_lock(struct ext4_inode_info *ei)
+{
+	write_lock(&ei->i_es_lock);
+	write_seqcount_begin(&ei->i_es_tree.seq);
+}
+
+static inline void es_write_unlock(struct ext4_inode_info *ei)
+{
+	write_seqcount_end(&ei->i_es_tree.seq);
+	write_unlock(&ei->i_es_lock);
+}
+
+static inline struct ext4_es_shard *ext4_es_shard(struct ext4_sb_info *sbi,
+						  struct ext4_inode_info *ei)
+{
+	return &sbi->s_es_shards[hash_long(ei->vfs_inode.i_ino,
+					   EXT4_ES_SHARD_BITS)];
 }
 
 #ifdef ES_DEBUG__
@@ -298,31 +324,31 @@ out:
 static void ext4_es_list_add(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_shard *shard = ext4_es_shard(EXT4_SB(inode->i_sb), ei);
 
 	if (!list_empty(&ei->i_es_list))
 		return;
 
-	spin_lock(&sbi->s_es_lock);
+	spin_lock(&shard->lock);
 	if (list_empty(&ei->i_es_list)) {
-		list_add_tail(&ei->i_es_list, &sbi->s_es_list);
-		sbi->s_es_nr_inode++;
+		list_add_tail(&ei->i_es_list, &shard->list);
+		shard->nr_inode++;
 	}
-	spin_unlock(&sbi->s_es_lock);
+	spin_unlock(&shard->lock);
 }
 
 static void ext4_es_list_del(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_shard *shard = ext4_es_shard(EXT4_SB(inode->i_sb), ei);
 
-	spin_lock(&sbi->s_es_lock);
+	spin_lock(&shard->lock);
 	if (!list_empty(&ei->i_es_list)) {
 		list_del_init(&ei->i_es_list);
-		sbi->s_es_nr_inode--;
-		WARN_ON_ONCE(sbi->s_es_nr_inode < 0);
+		shard->nr_inode--;
+		WARN_ON_ONCE(shard->nr_inode < 0);
 	}
-	spin_unlock(&sbi->s_es_lock);
+	spin_unlock(&shard->lock);
 }
 
 static struct extent_status *
@@ -673,7 +699,8 @@ static int __es_insert_extent(struct inode *inode, struct extent_status *newes)
 				  newes->es_pblk);
 	if (!es)
 		return -ENOMEM;
-	rb_link_node(&es->rb_node, parent, p);
+	/* lockless lookups must see es initialised once it is reachable */
+	rb_link_node_rcu(&es->rb_node, parent, p);
 	rb_insert_color(&es->rb_node, &tree->root);
 
 out:
@@ -718,7 +745,7 @@ int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	ext4_es_insert_extent_check(inode, &newes);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end);
 	if (err != 0)
 		goto error;
@@ -731,7 +758,7 @@ retry:
 		err = 0;
 
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	es_write_unlock(EXT4_I(inode));
 
 	ext4_es_print_tree(inode);
 
@@ -761,12 +788,75 @@ void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	BUG_ON(end < lblk);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	es_write_lock(EXT4_I(inode));
 
 	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
 	if (!es || es->es_lblk > end)
 		__es_insert_extent(inode, &newes);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	es_write_unlock(EXT4_I(inode));
+}
+
+/*
+ * A balanced tree of 2^32 extents is less than 64 levels deep.  A walk
+ * that goes further has followed a node reused for another tree.
+ */
+#define ES_RCU_MAX_DEPTH	64
+
+/*
+ * Look up @lblk without i_es_lock.  Nodes may be changed or freed and
+ * reused under us, so nothing read is trusted until tree->seq says no
+ * writer ran meanwhile.
+ *
+ * Return: 1 on found, 0 on not, -EAGAIN if the caller must take the lock
+ */
+static int __es_lookup_extent_rcu(struct ext4_es_tree *tree,
+				  ext4_lblk_t lblk, struct extent_status *es)
+{
+	struct extent_status *es1;
+	struct rb_node *node;
+	unsigned int seq;
+	int depth, found = 0;
+
+	rcu_read_lock();
+	seq = raw_read_seqcount(&tree->seq);
+	if (seq & 1)
+		goto busy;
+
+	es1 = READ_ONCE(tree->cache_es);
+	if (es1 && lblk >= es1->es_lblk && lblk - es1->es_lblk < es1->es_len) {
+		found = 1;
+		goto out;
+	}
+
+	node = READ_ONCE(tree->root.rb_node);
+	for (depth = 0; node; depth++) {
+		if (depth == ES_RCU_MAX_DEPTH)
+			goto busy;
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es1->es_lblk)
+			node = READ_ONCE(node->rb_left);
+		else if (lblk - es1->es_lblk >= es1->es_len)
+			node = READ_ONCE(node->rb_right);
+		else {
+			found = 1;
+			break;
+		}
+	}
+
+out:
+	if (found) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+	}
+	if (read_seqcount_retry(&tree->seq, seq))
+		goto busy;
+	rcu_read_unlock();
+	return found;
+
+busy:
+	rcu_read_unlock();
+	return -EAGAIN;
 }
 
 /*
@@ -789,10 +879,15 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	es_debug("lookup extent in block %u\n", lblk);
 
 	tree = &EXT4_I(inode)->i_es_tree;
+	es->es_lblk = es->es_len = es->es_pblk = 0;
+	found = __es_lookup_extent_rcu(tree, lblk, es);
+	if (found >= 0)
+		goto stats;
+
+	found = 0;
 	read_lock(&EXT4_I(inode)->i_es_lock);
 
 	/* find extent in cache firstly */
-	es->es_lblk = es->es_len = es->es_pblk = 0;
 	if (tree->cache_es) {
 		es1 = tree->cache_es;
 		if (in_range(lblk, es1->es_lblk, es1->es_len)) {
@@ -817,12 +912,17 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	}
 
 out:
-	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
 	if (found) {
 		BUG_ON(!es1);
 		es->es_lblk = es1->es_lblk;
 		es->es_len = es1->es_len;
 		es->es_pblk = es1->es_pblk;
+	}
+	read_unlock(&EXT4_I(inode)->i_es_lock);
+
+stats:
+	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+	if (found) {
 		if (!ext4_es_is_referenced(es))
 			ext4_es_set_referenced(es);
 		stats->es_stats_cache_hits++;
@@ -830,8 +930,6 @@ out:
 		stats->es_stats_cache_misses++;
 	}
 
-	read_unlock(&EXT4_I(inode)->i_es_lock);
-
 	trace_ext4_es_lookup_extent_exit(inode, es, found);
 	return found;
 }
@@ -962,39 +1060,34 @@ int ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	 * so that we are sure __es_shrink() is done with the inode before it
 	 * is reclaimed.
 	 */
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	es_write_unlock(EXT4_I(inode));
 	ext4_es_print_tree(inode);
 	return err;
 }
 
-static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
-		       struct ext4_inode_info *locked_ei)
+/*
+ * Walk one shard's inodes once, shrinking those we can lock.  Returns the
+ * number of extents reclaimed.
+ */
+static int es_shrink_shard(struct ext4_es_shard *shard, int *nr_to_scan,
+			   struct ext4_inode_info *locked_ei, int retried,
+			   int *nr_skipped)
 {
 	struct ext4_inode_info *ei;
-	struct ext4_es_stats *es_stats;
-	ktime_t start_time;
-	u64 scan_time;
 	int nr_to_walk;
 	int nr_shrunk = 0;
-	int retried = 0, nr_skipped = 0;
 
-	es_stats = &sbi->s_es_stats;
-	start_time = ktime_get();
-
-retry:
-	spin_lock(&sbi->s_es_lock);
-	nr_to_walk = sbi->s_es_nr_inode;
+	spin_lock(&shard->lock);
+	nr_to_walk = shard->nr_inode;
 	while (nr_to_walk-- > 0) {
-		if (list_empty(&sbi->s_es_list)) {
-			spin_unlock(&sbi->s_es_lock);
-			goto out;
-		}
-		ei = list_first_entry(&sbi->s_es_list, struct ext4_inode_info,
+		if (list_empty(&shard->list))
+			break;
+		ei = list_first_entry(&shard->list, struct ext4_inode_info,
 				      i_es_list);
 		/* Move the inode to the tail */
-		list_move_tail(&ei->i_es_list, &sbi->s_es_list);
+		list_move_tail(&ei->i_es_list, &shard->list);
 
 		/*
 		 * Normally we try hard to avoid shrinking precached inodes,
@@ -1002,28 +1095,58 @@ retry:
 		 */
 		if (!retried && ext4_test_inode_state(&ei->vfs_inode,
 						EXT4_STATE_EXT_PRECACHED)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 
 		if (ei == locked_ei || !write_trylock(&ei->i_es_lock)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 		/*
 		 * Now we hold i_es_lock which protects us from inode reclaim
 		 * freeing inode under us
 		 */
-		spin_unlock(&sbi->s_es_lock);
+		spin_unlock(&shard->lock);
+
+		write_seqcount_begin(&ei->i_es_tree.seq);
+		nr_shrunk += es_reclaim_extents(ei, nr_to_scan);
+		es_write_unlock(ei);
 
-		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
-		write_unlock(&ei->i_es_lock);
+		if (*nr_to_scan <= 0)
+			return nr_shrunk;
+		spin_lock(&shard->lock);
+	}
+	spin_unlock(&shard->lock);
+	return nr_shrunk;
+}
 
+static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
+		       struct ext4_inode_info *locked_ei)
+{
+	struct ext4_es_stats *es_stats;
+	ktime_t start_time;
+	u64 scan_time;
+	unsigned int start, i;
+	int nr_shrunk = 0;
+	int retried = 0, nr_skipped = 0;
+
+	es_stats = &sbi->s_es_stats;
+	start_time = ktime_get();
+
+retry:
+	/* start each pass on a different shard to spread the reclaim */
+	start = READ_ONCE(sbi->s_es_shard_cursor);
+	WRITE_ONCE(sbi->s_es_shard_cursor, start + 1);
+	for (i = 0; i < EXT4_ES_SHARDS; i++) {
+		struct ext4_es_shard *shard;
+
+		shard = &sbi->s_es_shards[(start + i) & (EXT4_ES_SHARDS - 1)];
+		nr_shrunk += es_shrink_shard(shard, &nr_to_scan, locked_ei,
+					     retried, &nr_skipped);
 		if (nr_to_scan <= 0)
 			goto out;
-		spin_lock(&sbi->s_es_lock);
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	/*
 	 * If we skipped any inodes, and we weren't able to make any
@@ -1095,20 +1218,25 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 	struct ext4_es_stats *es_stats = &sbi->s_es_stats;
 	struct ext4_inode_info *ei, *max = NULL;
 	unsigned int inode_cnt = 0;
+	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
 
 	/* here we just find an inode that has the max nr. of objects */
-	spin_lock(&sbi->s_es_lock);
-	list_for_each_entry(ei, &sbi->s_es_list, i_es_list) {
-		inode_cnt++;
-		if (max && max->i_es_all_nr < ei->i_es_all_nr)
-			max = ei;
-		else if (!max)
-			max = ei;
+	for (i = 0; i < EXT4_ES_SHARDS; i++) {
+		struct ext4_es_shard *shard = &sbi->s_es_shards[i];
+
+		spin_lock(&shard->lock);
+		list_for_each_entry(ei, &shard->list, i_es_list) {
+			inode_cnt++;
+			if (max && max->i_es_all_nr < ei->i_es_all_nr)
+				max = ei;
+			else if (!max)
+				max = ei;
+		}
+		spin_unlock(&shard->lock);
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	seq_printf(seq, "stats:\n  %lld objects\n  %lld reclaimable objects\n",
 		   percpu_counter_sum_positive(&es_stats->es_stats_all_cnt),
@@ -1134,13 +1262,16 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 
 int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 {
-	int err;
+	int err, i;
 
 	/* Make sure we have enough bits for physical block number */
 	BUILD_BUG_ON(ES_SHIFT < 48);
-	INIT_LIST_HEAD(&sbi->s_es_list);
-	sbi->s_es_nr_inode = 0;
-	spin_lock_init(&sbi->s_es_lock);
+	for (i = 0; i < EXT4_ES_SHARDS; i++) {
+		INIT_LIST_HEAD(&sbi->s_es_shards[i].list);
+		sbi->s_es_shards[i].nr_inode = 0;
+		spin_lock_init(&sbi->s_es_shards[i].lock);
+	}
+	sbi->s_es_shard_cursor = 0;
 	sbi->s_es_stats.es_stats_shrunk = 0;
 	sbi->s_es_stats.es_stats_cache_hits = 0;
 	sbi->s_es_stats.es_stats_cache_misses = 0;
@@ -65,8 +65,22 @@ struct extent_status {
 struct ext4_es_tree {
 	struct rb_root root;
 	struct extent_status *cache_es;	/* recently accessed extent */
+	seqcount_t seq;			/* bumped around every change */
 };
 
+/*
+ * Inodes with reclaimable extents are spread over several lists so that
+ * adding and removing them does not serialise on a single lock.
+ */
+#define EXT4_ES_SHARD_BITS	4
+#define EXT4_ES_SHARDS		(1 << EXT4_ES_SHARD_BITS)
+
+struct ext4_es_shard {
+	spinlock_t lock;
+	struct list_head list;		/* inodes with reclaimable extents */
+	long nr_inode;
+} ____cacheline_aligned_in_smp;
+
 struct ext4_es_stats {
 	unsigned long es_stats_shrunk;
 	unsigned long es_stats_cache_hits;
@@ -0,0 +1,882 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: make fsync durable without committing the whole running
+ * transaction.
+ *
+ * While a transaction runs, every regular file whose block mapping or
+ * attributes change is queued on the superblock together with the range of
+ * logical blocks that changed.  fsync then writes the current mapping of
+ * those ranges and the inode attributes to the journal's fast commit area
+ * (see fast_commit.h for the format) and waits for that, rather than for a
+ * full commit.  Operations that change anything else the fast commit
+ * cannot describe (directory entries, inode allocation, xattrs, ...) mark
+ * the transaction ineligible, and fsync falls back to a full commit.
+ *
+ * After a crash the fast commits of the transaction that did not make it
+ * to the log are replayed at mount time, as ordinary journaled updates.
+ */
+
+#include <linux/fs.h>
+#include <linux/quotaops.h>
+#include <linux/blkdev.h>
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+/* An inode picked for a fast commit and the blocks to describe */
+struct ext4_fc_snap {
+	struct inode *inode;
+	ext4_lblk_t start;
+	ext4_lblk_t end;
+};
+
+/* The fast commit block being filled */
+struct ext4_fc_buf {
+	journal_t *journal;
+	struct buffer_head *bh;
+	unsigned int off;
+	int nblks;
+	u32 crc;
+};
+
+static u32 ext4_fc_crc_seed(struct super_block *sb)
+{
+	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
+
+	return crc32_le(~0, es->s_uuid, sizeof(es->s_uuid));
+}
+
+/*
+ * Only extent mapped regular files whose data does not go through the
+ * journal can be described by a fast commit.
+ */
+static bool ext4_fc_eligible(struct inode *inode)
+{
+	return S_ISREG(inode->i_mode) &&
+	       ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	       !ext4_has_inline_data(inode) &&
+	       !ext4_should_journal_data(inode) &&
+	       !IS_NOQUOTA(inode);
+}
+
+void ext4_fc_init_inode(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_tid = 0;
+}
+
+/* Called with s_fc_lock held */
+static void __ext4_fc_set_ineligible(struct ext4_sb_info *sbi, tid_t tid)
+{
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid)) {
+		sbi->s_fc_ineligible_tid = tid;
+		sbi->s_fc_ineligible = true;
+	}
+}
+
+/*
+ * The transaction @handle belongs to changes something a fast commit
+ * cannot describe, so fsync has to wait for the full commit.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_handle_valid(handle) || !test_opt2(sb, JOURNAL_FAST_COMMIT))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	__ext4_fc_set_ineligible(sbi, handle->h_transaction->t_tid);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static void ext4_fc_track(handle_t *handle, struct inode *inode,
+			  ext4_lblk_t start, ext4_lblk_t end)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	tid_t tid;
+
+	if (!ext4_handle_valid(handle) ||
+	    !test_opt2(inode->i_sb, JOURNAL_FAST_COMMIT) ||
+	    !ext4_fc_eligible(inode))
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	spin_lock(&sbi->s_fc_lock);
+	if (list_empty(&ei->i_fc_list) || ei->i_fc_tid != tid) {
+		/* anything tracked earlier is in a fast or full commit */
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_start = EXT_MAX_BLOCKS;
+		ei->i_fc_lblk_end = 0;
+		list_move_tail(&ei->i_fc_list, &sbi->s_fc_q);
+	}
+	if (start <= end) {
+		ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+		ei->i_fc_lblk_end = max(ei->i_fc_lblk_end, end);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* The mapping of blocks @start..@end of @inode changed under @handle */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t end)
+{
+	ext4_fc_track(handle, inode, start, end);
+}
+
+/* Attributes of @inode changed under @handle */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	/*
+	 * Once queued for this transaction only a fast commit can take the
+	 * inode off the queue again, and that does not run while there are
+	 * handles, so there is no need for the lock here.
+	 */
+	if (ext4_handle_valid(handle) &&
+	    ei->i_fc_tid == handle->h_transaction->t_tid &&
+	    !list_empty(&ei->i_fc_list))
+		return;
+	ext4_fc_track(handle, inode, EXT_MAX_BLOCKS, 0);
+}
+
+/* @inode is being evicted: its changes are left to the full commit */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!list_empty(&ei->i_fc_list)) {
+		__ext4_fc_set_ineligible(sbi, ei->i_fc_tid);
+		list_del_init(&ei->i_fc_list);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* Transaction @tid has been committed, forget what it changed */
+void ext4_fc_cleanup(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *tmp;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_fc_q, i_fc_list) {
+		if (!tid_gt(ei->i_fc_tid, tid))
+			list_del_init(&ei->i_fc_list);
+	}
+	if (sbi->s_fc_ineligible && !tid_gt(sbi->s_fc_ineligible_tid, tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Look up @lblk.  Returns 1 if it is mapped, with the mapping of the rest of
+ * its extent, or 0 with the length of the hole starting at @lblk.  Called
+ * with i_data_sem held.
+ */
+static int ext4_fc_map(struct inode *inode, ext4_lblk_t lblk,
+		       ext4_lblk_t *len, ext4_fsblk_t *pblk, bool *unwritten)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex;
+	ext4_lblk_t ee_block = 0, next;
+	unsigned int ee_len = 0;
+	int ret = 0;
+
+	path = ext4_find_extent(inode, lblk, NULL, 0);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	ex = path[ext_depth(inode)].p_ext;
+	if (ex) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_len = ext4_ext_get_actual_len(ex);
+	}
+	if (ex && lblk >= ee_block && lblk < ee_block + ee_len) {
+		*len = ee_block + ee_len - lblk;
+		*pblk = ext4_ext_pblock(ex) + lblk - ee_block;
+		*unwritten = ext4_ext_is_unwritten(ex);
+		ret = 1;
+	} else {
+		if (ex && lblk < ee_block)
+			next = ee_block;
+		else
+			next = ext4_ext_next_allocated_block(path);
+		if (next > lblk)
+			*len = next - lblk;
+		else
+			ret = -EFSCORRUPTED;
+	}
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	return ret;
+}
+
+/*
+ * Get room for a @len byte record in the current fast commit block, or pad
+ * it out and start a new one.
+ */
+static int ext4_fc_reserve(struct ext4_fc_buf *fb, unsigned int len,
+			   void **dst)
+{
+	unsigned int bsize = fb->journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (!fb->bh || fb->off + len > bsize) {
+		if (fb->bh && fb->off < bsize) {
+			tl = (void *)fb->bh->b_data + fb->off;
+			tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl->fc_len = cpu_to_le16(bsize - fb->off - sizeof(*tl));
+			fb->crc = crc32_le(fb->crc, (u8 *)tl, bsize - fb->off);
+		}
+		ret = jbd2_fc_get_buf(fb->journal, &fb->bh);
+		if (ret)
+			return ret;
+		memset(fb->bh->b_data, 0, bsize);
+		fb->off = 0;
+		fb->nblks++;
+	}
+	*dst = fb->bh->b_data + fb->off;
+	fb->off += len;
+	return 0;
+}
+
+static int ext4_fc_add_tlv(struct ext4_fc_buf *fb, u16 tag, u16 len,
+			   void *val)
+{
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	ret = ext4_fc_reserve(fb, sizeof(*tl) + len, (void **)&tl);
+	if (ret)
+		return ret;
+	tl->fc_tag = cpu_to_le16(tag);
+	tl->fc_len = cpu_to_le16(len);
+	memcpy(tl + 1, val, len);
+	fb->crc = crc32_le(fb->crc, (u8 *)tl, sizeof(*tl) + len);
+	return 0;
+}
+
+static int ext4_fc_write_tail(struct ext4_fc_buf *fb, tid_t tid)
+{
+	struct ext4_fc_tl *tl;
+	struct ext4_fc_tail *tail;
+	int ret;
+
+	ret = ext4_fc_reserve(fb, sizeof(*tl) + sizeof(*tail), (void **)&tl);
+	if (ret)
+		return ret;
+	tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl->fc_len = cpu_to_le16(sizeof(*tail));
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	tail->fc_tid = cpu_to_le32(tid);
+	fb->crc = crc32_le(fb->crc, (u8 *)tl,
+			   sizeof(*tl) + offsetof(struct ext4_fc_tail, fc_crc));
+	tail->fc_crc = cpu_to_le32(fb->crc);
+	/* the commit ends with this block */
+	fb->off = fb->journal->j_blocksize;
+	return 0;
+}
+
+/* Describe the current mapping of blocks @start..@end of @inode */
+static int ext4_fc_write_ranges(struct ext4_fc_buf *fb, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t end)
+{
+	struct ext4_fc_add_range add;
+	struct ext4_fc_del_range del;
+	ext4_lblk_t lblk = start, len;
+	ext4_fsblk_t pblk;
+	bool unwritten;
+	int ret = 0;
+
+	down_read(&EXT4_I(inode)->i_data_sem);
+	while (lblk <= end) {
+		ret = ext4_fc_map(inode, lblk, &len, &pblk, &unwritten);
+		if (ret < 0)
+			break;
+		len = min_t(ext4_lblk_t, len, end - lblk + 1);
+		if (ret) {
+			add.fc_ino = cpu_to_le32(inode->i_ino);
+			add.fc_lblk = cpu_to_le32(lblk);
+			add.fc_len = cpu_to_le32(len);
+			add.fc_flags = cpu_to_le32(unwritten ?
+						   EXT4_FC_ADD_UNWRITTEN : 0);
+			add.fc_pblk = cpu_to_le64(pblk);
+			ret = ext4_fc_add_tlv(fb, EXT4_FC_TAG_ADD_RANGE,
+					      sizeof(add), &add);
+		} else {
+			del.fc_ino = cpu_to_le32(inode->i_ino);
+			del.fc_lblk = cpu_to_le32(lblk);
+			del.fc_len = cpu_to_le32(len);
+			ret = ext4_fc_add_tlv(fb, EXT4_FC_TAG_DEL_RANGE,
+					      sizeof(del), &del);
+		}
+		if (ret)
+			break;
+		lblk += len;
+	}
+	up_read(&EXT4_I(inode)->i_data_sem);
+	return ret;
+}
+
+static int ext4_fc_write_inode(struct ext4_fc_buf *fb, struct inode *inode)
+{
+	struct ext4_fc_inode fi;
+
+	memset(&fi, 0, sizeof(fi));
+	fi.fc_ino = cpu_to_le32(inode->i_ino);
+	fi.fc_mode = cpu_to_le32(inode->i_mode);
+	fi.fc_uid = cpu_to_le32(i_uid_read(inode));
+	fi.fc_gid = cpu_to_le32(i_gid_read(inode));
+	fi.fc_size = cpu_to_le64(EXT4_I(inode)->i_disksize);
+	fi.fc_atime = cpu_to_le64(inode->i_atime.tv_sec);
+	fi.fc_mtime = cpu_to_le64(inode->i_mtime.tv_sec);
+	fi.fc_ctime = cpu_to_le64(inode->i_ctime.tv_sec);
+	fi.fc_atime_nsec = cpu_to_le32(inode->i_atime.tv_nsec);
+	fi.fc_mtime_nsec = cpu_to_le32(inode->i_mtime.tv_nsec);
+	fi.fc_ctime_nsec = cpu_to_le32(inode->i_ctime.tv_nsec);
+	return ext4_fc_add_tlv(fb, EXT4_FC_TAG_INODE, sizeof(fi), &fi);
+}
+
+/*
+ * In data=ordered mode newly mapped blocks may only be fast committed once
+ * their data is on disk, i.e. when the inode has no dirty pages or I/O in
+ * flight.
+ */
+static bool ext4_fc_data_pending(struct inode *inode)
+{
+	if (test_opt(inode->i_sb, DATA_FLAGS) != EXT4_MOUNT_ORDERED_DATA)
+		return false;
+	return mapping_tagged(inode->i_mapping, PAGECACHE_TAG_DIRTY) ||
+	       mapping_tagged(inode->i_mapping, PAGECACHE_TAG_WRITEBACK) ||
+	       atomic_read(&inode->i_dio_count);
+}
+
+/*
+ * Write out the fast commit.  The blocks before the one with the tail have
+ * to be on disk before the tail is, so they go first.
+ */
+static int ext4_fc_submit(struct ext4_fc_buf *fb)
+{
+	journal_t *journal = fb->journal;
+	bool barrier = journal->j_flags & JBD2_BARRIER;
+	unsigned long first = journal->j_fc_off - fb->nblks;
+	struct buffer_head *bh;
+	int i, j, ret = 0, err;
+
+	/* file data must be stable before the commit that maps it */
+	if (barrier && journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+
+	for (i = 0; i < fb->nblks; i++) {
+		bh = journal->j_fc_wbuf[first + i];
+		if (i == fb->nblks - 1) {
+			for (j = 0; j < i; j++) {
+				wait_on_buffer(journal->j_fc_wbuf[first + j]);
+				if (!buffer_uptodate(journal->j_fc_wbuf[first + j]))
+					ret = -EIO;
+			}
+			if (ret)
+				break;
+		}
+		lock_buffer(bh);
+		clear_buffer_dirty(bh);
+		set_buffer_uptodate(bh);
+		bh->b_end_io = end_buffer_write_sync;
+		get_bh(bh);
+		submit_bh(i == fb->nblks - 1 && barrier ?
+			  WRITE_SYNC | WRITE_FLUSH_FUA : WRITE_SYNC, bh);
+	}
+	err = jbd2_fc_wait_bufs(journal, fb->nblks);
+	return ret ? ret : err;
+}
+
+/**
+ * ext4_fc_commit() - make the changes fsync of @inode needs durable
+ * @inode: inode being synced, with its data already written out
+ * @commit_tid: transaction holding the inode's changes
+ *
+ * Returns -EAGAIN if the caller has to wait for a full commit of
+ * @commit_tid instead: because the transaction is ineligible, it is
+ * already being committed, or anything about the fast commit failed.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_buf fb = { .journal = sbi->s_journal };
+	struct ext4_inode_info *ei, *tmp;
+	struct ext4_fc_snap *snap = NULL;
+	struct inode *cur;
+	bool found = false;
+	int nr = 0, max = 0, i, ret;
+
+	if (!ext4_fc_eligible(inode))
+		return -EAGAIN;
+	if (jbd2_fc_begin_commit(fb.journal, commit_tid))
+		return -EAGAIN;
+
+	/* no handles from here on, so everything is consistent */
+	jbd2_journal_lock_updates(fb.journal);
+	ret = -EAGAIN;
+	if (ext4_fc_data_pending(inode))
+		goto out_unlock;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible &&
+	    !tid_gt(commit_tid, sbi->s_fc_ineligible_tid)) {
+		spin_unlock(&sbi->s_fc_lock);
+		goto out_unlock;
+	}
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list)
+		max++;
+	spin_unlock(&sbi->s_fc_lock);
+
+	snap = kmalloc_array(max + 1, sizeof(*snap), GFP_NOFS);
+	if (!snap)
+		goto out_unlock;
+
+	/*
+	 * Inodes with data still on its way are left for a later fast
+	 * commit or the full one: leaving out an inode's changes entirely
+	 * keeps the filesystem consistent, as blocks freed in a transaction
+	 * are not reused before it commits.
+	 */
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_fc_q, i_fc_list) {
+		cur = &ei->vfs_inode;
+		if (nr == max)
+			break;
+		if (cur != inode && ext4_fc_data_pending(cur))
+			continue;
+		if (!igrab(cur))
+			continue;
+		snap[nr].inode = cur;
+		snap[nr].start = ei->i_fc_lblk_start;
+		snap[nr].end = ei->i_fc_lblk_end;
+		nr++;
+		list_del_init(&ei->i_fc_list);
+		if (cur == inode)
+			found = true;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	/* its blocks are in an earlier fast commit, but write it anyway */
+	if (!found) {
+		ihold(inode);
+		snap[nr].inode = inode;
+		snap[nr].start = EXT_MAX_BLOCKS;
+		snap[nr].end = 0;
+		nr++;
+	}
+
+	fb.crc = ext4_fc_crc_seed(sb);
+	for (i = 0; i < nr; i++) {
+		ret = ext4_fc_write_ranges(&fb, snap[i].inode,
+					   snap[i].start, snap[i].end);
+		if (!ret)
+			ret = ext4_fc_write_inode(&fb, snap[i].inode);
+		if (ret)
+			break;
+	}
+	if (!ret)
+		ret = ext4_fc_write_tail(&fb, commit_tid);
+	jbd2_journal_unlock_updates(fb.journal);
+
+	if (ret) {
+		if (fb.nblks)
+			jbd2_fc_release_bufs(fb.journal, fb.nblks);
+		ret = -EAGAIN;
+	} else if (ext4_fc_submit(&fb)) {
+		ret = -EAGAIN;
+	}
+	goto out;
+
+out_unlock:
+	jbd2_journal_unlock_updates(fb.journal);
+out:
+	jbd2_fc_end_commit(fb.journal);
+	for (i = 0; i < nr; i++)
+		iput(snap[i].inode);
+	kfree(snap);
+	return ret;
+}
+
+/* Replay */
+
+static bool ext4_fc_tl_valid(struct ext4_fc_tl *tl)
+{
+	unsigned int len = le16_to_cpu(tl->fc_len);
+
+	switch (le16_to_cpu(tl->fc_tag)) {
+	case EXT4_FC_TAG_ADD_RANGE:
+		return len == sizeof(struct ext4_fc_add_range);
+	case EXT4_FC_TAG_DEL_RANGE:
+		return len == sizeof(struct ext4_fc_del_range);
+	case EXT4_FC_TAG_INODE:
+		return len == sizeof(struct ext4_fc_inode);
+	case EXT4_FC_TAG_TAIL:
+		return len == sizeof(struct ext4_fc_tail);
+	case EXT4_FC_TAG_PAD:
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Returns the number of fast commit blocks holding complete fast commits
+ * of the transaction that did not make it to the log.
+ */
+static int ext4_fc_replay_scan(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned long blk, nr = journal->j_fc_last - journal->j_fc_first;
+	unsigned int off, len, bsize = journal->j_blocksize;
+	u32 seed = ext4_fc_crc_seed(sb), crc = seed;
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+	struct buffer_head *bh;
+	int valid = 0;
+
+	for (blk = 0; blk < nr; blk++) {
+		bh = jbd2_fc_read_block(journal, blk);
+		if (!bh)
+			break;
+		for (off = 0; off + sizeof(*tl) <= bsize;
+		     off += sizeof(*tl) + len) {
+			tl = (struct ext4_fc_tl *)(bh->b_data + off);
+			len = le16_to_cpu(tl->fc_len);
+			if (off + sizeof(*tl) + len > bsize ||
+			    !ext4_fc_tl_valid(tl))
+				goto out_brelse;
+			if (le16_to_cpu(tl->fc_tag) != EXT4_FC_TAG_TAIL) {
+				crc = crc32_le(crc, (u8 *)tl, sizeof(*tl) + len);
+				continue;
+			}
+			tail = (struct ext4_fc_tail *)(tl + 1);
+			crc = crc32_le(crc, (u8 *)tl, sizeof(*tl) +
+				       offsetof(struct ext4_fc_tail, fc_crc));
+			if (le32_to_cpu(tail->fc_tid) != journal->j_fc_replay_tid ||
+			    le32_to_cpu(tail->fc_crc) != crc)
+				goto out_brelse;
+			valid = blk + 1;
+			crc = seed;
+			break;
+		}
+		brelse(bh);
+	}
+	return valid;
+
+out_brelse:
+	brelse(bh);
+	return valid;
+}
+
+/* Blocks a fast commit maps must not be handed out while replaying */
+static int ext4_fc_replay_mark(struct super_block *sb,
+			       struct ext4_fc_add_range *ar)
+{
+	ext4_fsblk_t pblk = le64_to_cpu(ar->fc_pblk);
+	unsigned long len = le32_to_cpu(ar->fc_len), n;
+	ext4_group_t group;
+	ext4_grpblk_t bit;
+	handle_t *handle;
+	int ret;
+
+	while (len) {
+		ext4_get_group_no_and_offset(sb, pblk, &group, &bit);
+		n = min_t(unsigned long, len, EXT4_BLOCKS_PER_GROUP(sb) - bit);
+		handle = ext4_journal_start_sb(sb, EXT4_HT_MISC, 2);
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+		ret = ext4_mb_mark_used_range(handle, sb, pblk, n);
+		ext4_journal_stop(handle);
+		if (ret)
+			return ret;
+		pblk += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_remove(struct inode *inode, ext4_lblk_t lblk,
+				 ext4_lblk_t len)
+{
+	handle_t *handle;
+	int ret, ret2;
+
+	handle = ext4_journal_start(inode, EXT4_HT_TRUNCATE,
+				    ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ret = ext4_es_remove_extent(inode, lblk, len);
+	if (!ret)
+		ret = ext4_ext_remove_space(inode, lblk, lblk + len - 1);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!ret)
+		ret = ext4_mark_inode_dirty(handle, inode);
+	ret2 = ext4_journal_stop(handle);
+	return ret ? ret : ret2;
+}
+
+static int ext4_fc_replay_insert(struct inode *inode, ext4_lblk_t lblk,
+				 ext4_lblk_t len, ext4_fsblk_t pblk,
+				 bool unwritten)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent newex;
+	handle_t *handle;
+	int ret, ret2;
+
+	if (len > (unwritten ? EXT_UNWRITTEN_MAX_LEN : EXT_INIT_MAX_LEN))
+		return -EFSCORRUPTED;
+
+	handle = ext4_journal_start(inode, EXT4_HT_MAP_BLOCKS,
+				    ext4_chunk_trans_blocks(inode, len));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ret = ext4_es_remove_extent(inode, lblk, len);
+	if (ret)
+		goto out_sem;
+	path = ext4_find_extent(inode, lblk, NULL, 0);
+	if (IS_ERR(path)) {
+		ret = PTR_ERR(path);
+		goto out_sem;
+	}
+	newex.ee_block = cpu_to_le32(lblk);
+	ext4_ext_store_pblock(&newex, pblk);
+	newex.ee_len = cpu_to_le16(len);
+	if (unwritten)
+		ext4_ext_mark_unwritten(&newex);
+	ret = ext4_ext_insert_extent(handle, inode, &path, &newex, 0);
+	ext4_ext_drop_refs(path);
+	kfree(path);
+out_sem:
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!ret) {
+		dquot_alloc_block_nofail(inode,
+					 EXT4_C2B(EXT4_SB(inode->i_sb), len));
+		ret = ext4_mark_inode_dirty(handle, inode);
+	}
+	ret2 = ext4_journal_stop(handle);
+	return ret ? ret : ret2;
+}
+
+static int ext4_fc_replay_add(struct super_block *sb,
+			      struct ext4_fc_add_range *ar)
+{
+	ext4_lblk_t lblk = le32_to_cpu(ar->fc_lblk);
+	ext4_lblk_t remaining = le32_to_cpu(ar->fc_len), len;
+	ext4_fsblk_t pblk = le64_to_cpu(ar->fc_pblk), cur_pblk;
+	bool unwritten = le32_to_cpu(ar->fc_flags) & EXT4_FC_ADD_UNWRITTEN;
+	bool cur_unwritten;
+	struct inode *inode;
+	int ret = 0;
+
+	inode = ext4_iget(sb, le32_to_cpu(ar->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+	if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		ret = -EFSCORRUPTED;
+		goto out;
+	}
+
+	while (remaining) {
+		down_read(&EXT4_I(inode)->i_data_sem);
+		ret = ext4_fc_map(inode, lblk, &len, &cur_pblk, &cur_unwritten);
+		up_read(&EXT4_I(inode)->i_data_sem);
+		if (ret < 0)
+			break;
+		len = min(len, remaining);
+
+		if (ret && cur_pblk != pblk) {
+			/* mapped elsewhere before: unmap, then insert */
+			ret = ext4_fc_replay_remove(inode, lblk, len);
+			if (ret)
+				break;
+			continue;
+		}
+		if (!ret)
+			ret = ext4_fc_replay_insert(inode, lblk, len, pblk,
+						    unwritten);
+		else if (cur_unwritten && !unwritten)
+			ret = ext4_convert_unwritten_extents(NULL, inode,
+					(loff_t)lblk << inode->i_blkbits,
+					(ssize_t)len << inode->i_blkbits);
+		else
+			ret = 0;
+		if (ret)
+			break;
+		lblk += len;
+		pblk += len;
+		remaining -= len;
+	}
+out:
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_del(struct super_block *sb,
+			      struct ext4_fc_del_range *dr)
+{
+	ext4_lblk_t lblk = le32_to_cpu(dr->fc_lblk);
+	ext4_lblk_t len = le32_to_cpu(dr->fc_len);
+	struct inode *inode;
+	int ret;
+
+	if (!len || lblk + len - 1 < lblk)
+		return -EFSCORRUPTED;
+
+	inode = ext4_iget(sb, le32_to_cpu(dr->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
+		ret = ext4_fc_replay_remove(inode, lblk, len);
+	else
+		ret = -EFSCORRUPTED;
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fi)
+{
+	struct inode *inode;
+	handle_t *handle;
+	loff_t size = le64_to_cpu(fi->fc_size);
+	int ret, ret2;
+
+	inode = ext4_iget(sb, le32_to_cpu(fi->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+
+	handle = ext4_journal_start(inode, EXT4_HT_INODE, 1);
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out;
+	}
+	inode->i_mode = (inode->i_mode & S_IFMT) |
+			(le32_to_cpu(fi->fc_mode) & ~S_IFMT);
+	i_uid_write(inode, le32_to_cpu(fi->fc_uid));
+	i_gid_write(inode, le32_to_cpu(fi->fc_gid));
+	i_size_write(inode, size);
+	EXT4_I(inode)->i_disksize = size;
+	inode->i_atime.tv_sec = le64_to_cpu(fi->fc_atime);
+	inode->i_mtime.tv_sec = le64_to_cpu(fi->fc_mtime);
+	inode->i_ctime.tv_sec = le64_to_cpu(fi->fc_ctime);
+	inode->i_atime.tv_nsec = le32_to_cpu(fi->fc_atime_nsec);
+	inode->i_mtime.tv_nsec = le32_to_cpu(fi->fc_mtime_nsec);
+	inode->i_ctime.tv_nsec = le32_to_cpu(fi->fc_ctime_nsec);
+	ret = ext4_mark_inode_dirty(handle, inode);
+	ret2 = ext4_journal_stop(handle);
+	if (!ret)
+		ret = ret2;
+out:
+	iput(inode);
+	return ret;
+}
+
+/*
+ * Apply the records of the first @nblks fast commit blocks.  The first
+ * pass only claims the blocks the fast commits map, so that unmapping or
+ * extent tree changes in the second pass cannot allocate them.
+ */
+static int ext4_fc_replay_pass(struct super_block *sb, int nblks, bool mark)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int off, len, bsize = journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	struct buffer_head *bh;
+	int blk, ret = 0;
+
+	for (blk = 0; blk < nblks && !ret; blk++) {
+		bh = jbd2_fc_read_block(journal, blk);
+		if (!bh)
+			return -EIO;
+		for (off = 0; off + sizeof(*tl) <= bsize && !ret;
+		     off += sizeof(*tl) + len) {
+			tl = (struct ext4_fc_tl *)(bh->b_data + off);
+			len = le16_to_cpu(tl->fc_len);
+			switch (le16_to_cpu(tl->fc_tag)) {
+			case EXT4_FC_TAG_ADD_RANGE:
+				if (mark)
+					ret = ext4_fc_replay_mark(sb,
+						(struct ext4_fc_add_range *)(tl + 1));
+				else
+					ret = ext4_fc_replay_add(sb,
+						(struct ext4_fc_add_range *)(tl + 1));
+				break;
+			case EXT4_FC_TAG_DEL_RANGE:
+				if (!mark)
+					ret = ext4_fc_replay_del(sb,
+						(struct ext4_fc_del_range *)(tl + 1));
+				break;
+			case EXT4_FC_TAG_INODE:
+				if (!mark)
+					ret = ext4_fc_replay_inode(sb,
+						(struct ext4_fc_inode *)(tl + 1));
+				break;
+			}
+			if (le16_to_cpu(tl->fc_tag) == EXT4_FC_TAG_TAIL)
+				break;
+		}
+		brelse(bh);
+	}
+	return ret;
+}
+
+/*
+ * Replay the fast commits left behind by a crash.  Called at mount time,
+ * once the journal has been recovered and the allocator is set up.  The
+ * result is committed right away: the fast commit area then no longer
+ * matches the log and is not replayed again.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned long s_flags = sb->s_flags;
+	int nblks, ret;
+
+	if (!journal || !jbd2_has_feature_fast_commit(journal))
+		return 0;
+
+	nblks = ext4_fc_replay_scan(sb);
+	if (!nblks)
+		return 0;
+
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access unavailable, "
+			 "skipping fast commit replay");
+		return 0;
+	}
+
+	ext4_msg(sb, KERN_INFO, "replaying fast commits of transaction %u",
+		 journal->j_fc_replay_tid);
+	sb->s_flags &= ~MS_RDONLY;
+	ret = ext4_fc_replay_pass(sb, nblks, true);
+	if (!ret)
+		ret = ext4_fc_replay_pass(sb, nblks, false);
+	if (!ret)
+		ret = jbd2_journal_force_commit(journal);
+	sb->s_flags = s_flags;
+	if (ret)
+		ext4_error(sb, "fast commit replay failed: %d", ret);
+	return ret;
+}
@@ -0,0 +1,67 @@
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * On-disk format of ext4 fast commits.
+ *
+ * A fast commit is a run of tag-length-value records in the journal's fast
+ * commit area, describing the state of the inodes fsync needs at the time
+ * of the commit, and ending with a tail record.  A record never crosses a
+ * block boundary: whatever does not fit is covered by a PAD record, and a
+ * commit always ends its last block.  The tail's CRC covers every byte of
+ * the commit up to and including fc_tid.  All records are multiples of
+ * four bytes long.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+#define EXT4_FC_TAG_ADD_RANGE	0x0001	/* blocks mapped */
+#define EXT4_FC_TAG_DEL_RANGE	0x0002	/* blocks unmapped */
+#define EXT4_FC_TAG_INODE	0x0003	/* inode attributes */
+#define EXT4_FC_TAG_PAD		0x0004	/* rest of the block is unused */
+#define EXT4_FC_TAG_TAIL	0x0005	/* end of a fast commit */
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;		/* length of the value that follows */
+};
+
+/* logical blocks fc_lblk..fc_lblk+fc_len-1 are mapped to fc_pblk... */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+	__le32 fc_flags;
+	__le64 fc_pblk;
+};
+
+#define EXT4_FC_ADD_UNWRITTEN	0x0001
+
+/* ...or not mapped at all */
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__le32 fc_mode;
+	__le32 fc_uid;
+	__le32 fc_gid;
+	__le64 fc_size;		/* i_disksize */
+	__le64 fc_atime;
+	__le64 fc_mtime;
+	__le64 fc_ctime;
+	__le32 fc_atime_nsec;
+	__le32 fc_mtime_nsec;
+	__le32 fc_ctime_nsec;
+	__le32 fc_reserved;
+};
+
+struct ext4_fc_tail {
+	__le32 fc_tid;		/* transaction the commit belongs to */
+	__le32 fc_crc;
+};
+
+#endif /* _EXT4_FAST_COMMIT_H */
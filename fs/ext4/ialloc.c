@@ -282,6 +282,7 @@ void ext4_free_inode(handle_t *handle, struct inode *inode)
 		return;
 	}
 	sbi = EXT4_SB(sb);
+	ext4_fc_mark_ineligible(sb, handle);
 
 	ino = inode->i_ino;
 	ext4_debug("freeing inode %lu\n", ino);
@@ -916,6 +917,7 @@ next_group:
 	goto out;
 
 got:
+	ext4_fc_mark_ineligible(sb, handle);
 	BUFFER_TRACE(inode_bitmap_bh, "call ext4_handle_dirty_metadata");
 	err = ext4_handle_dirty_metadata(handle, NULL, inode_bitmap_bh);
 	if (err) {
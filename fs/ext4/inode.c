@@ -655,6 +655,13 @@ found:
 
 has_zeroout:
 	up_write((&EXT4_I(inode)->i_data_sem));
+	if (retval > 0) {
+		ext4_fc_track_range(handle, inode, map->m_lblk,
+				    map->m_lblk + map->m_len - 1);
+		/* replay does not turn written blocks back into unwritten */
+		if (flags & EXT4_GET_BLOCKS_CONVERT_UNWRITTEN)
+			ext4_fc_mark_ineligible(inode->i_sb, handle);
+	}
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -4826,6 +4833,8 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 			ext4_journal_stop(handle);
 			return error;
 		}
+		/* fast commit replay does not transfer quota */
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
 		/* Update corresponding info in inode so that everything is in
 		 * one transaction */
 		if (attr->ia_valid & ATTR_UID)
@@ -5084,6 +5093,7 @@ int ext4_mark_iloc_dirty(handle_t *handle,
 
 	if (IS_I_VERSION(inode))
 		inode_inc_iversion(inode);
+	ext4_fc_track_inode(handle, inode);
 
 	/* the do_update_inode consumes one bh->b_count */
 	get_bh(iloc->bh);
@@ -131,6 +131,7 @@ static long swap_inode_boot_loader(struct super_block *sb,
 		err = -EINVAL;
 		goto journal_err_out;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	/* Protect extent tree against block allocations via delalloc */
 	ext4_double_down_write_data_sem(inode, inode_bl);
@@ -282,6 +283,7 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			err = PTR_ERR(handle);
 			goto flags_out;
 		}
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
 		if (IS_SYNC(inode))
 			ext4_handle_sync(handle);
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
@@ -355,6 +357,7 @@ flags_out:
 			err = PTR_ERR(handle);
 			goto unlock_out;
 		}
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
 		if (err == 0) {
 			inode->i_ctime = ext4_current_time(inode);
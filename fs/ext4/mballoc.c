@@ -699,23 +699,44 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the matching s_mb_largest_free_orders list so
+ * the allocator can find groups with a big enough extent without scanning.
+ * Must be called under group lock.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
+	int order = -1; /* uninit */
 	int i;
 	int bits;
 
-	grp->bb_largest_free_order = -1; /* uninit */
-
 	bits = sb->s_blocksize_bits + 1;
 	for (i = bits; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			order = i;
 			break;
 		}
 	}
+
+	if (order == old && !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (!list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+
+	grp->bb_largest_free_order = order;
+
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[order]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
 }
 
 static noinline_for_stack
@@ -2098,11 +2119,140 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Check @group against criteria @cr and scan it if it qualifies.  Returns
+ * an error only if the buddy could not be loaded; the first error seen by
+ * ext4_mb_good_group() is kept in @first_err.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr, int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int ret, err;
+
+	/* This now checks without needing the buddy page */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+	return 0;
+}
+
+/*
+ * For criteria 0 and 1 a group can only qualify if its largest free extent
+ * is at least 2^order, so instead of walking all groups take candidates
+ * from the largest free order lists, smallest sufficient order first.
+ * Returns the number of groups put into @groups; fewer than @max means
+ * every initialized group that could qualify has been offered.
+ *
+ * For criterion 1 the group needs a free extent of fe_len blocks, which
+ * need not be aligned: an extent of 6 blocks from block 1 holds no
+ * aligned 4-block buddy.  An extent of at least 2^k blocks always holds
+ * an aligned buddy of order k - 1, so the search starts one order below
+ * that of fe_len.
+ */
+static int ext4_mb_find_order_groups(struct ext4_allocation_context *ac,
+				     int cr, ext4_group_t ngroups,
+				     ext4_group_t *groups, int max)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	int order, n = 0;
+
+	if (cr == 0)
+		order = ac->ac_2order;
+	else
+		order = max(fls(ac->ac_g_ex.fe_len) - 2, 0);
+	for (; order < MB_NUM_ORDERS(sb) && n < max; order++) {
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			if (grp->bb_group >= ngroups ||
+			    EXT4_MB_GRP_NEED_INIT(grp))
+				continue;
+			if (ext4_mb_good_group(ac, grp->bb_group, cr) <= 0)
+				continue;
+			groups[n++] = grp->bb_group;
+			if (n == max)
+				break;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+	return n;
+}
+
+/*
+ * Start reading the block bitmaps of the @nr groups from @group on that
+ * still need their buddy initialized, so that the scan does not stall on
+ * them one by one.
+ */
+static void ext4_mb_prefetch(struct super_block *sb, ext4_group_t group,
+			     unsigned int nr, ext4_group_t ngroups)
+{
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	while (nr--) {
+		struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+
+		if (EXT4_MB_GRP_NEED_INIT(grp) && grp->bb_free > 0 &&
+		    !EXT4_MB_GRP_BBITMAP_CORRUPT(grp)) {
+			struct buffer_head *bh;
+
+			bh = ext4_read_block_bitmap_nowait(sb, group);
+			if (!IS_ERR_OR_NULL(bh))
+				brelse(bh);
+		}
+		if (++group >= ngroups)
+			group = 0;
+	}
+	blk_finish_plug(&plug);
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
-	int cr;
+	ext4_group_t groups[MB_ORDER_CANDIDATES];
+	unsigned int prefetched;
+	int cr, n;
+	bool skip_init;
 	int err = 0, first_err = 0;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
@@ -2163,14 +2313,39 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		/*
+		 * Initialized groups are indexed by their largest free
+		 * extent; if the lists were exhausted the linear scan below
+		 * only needs to look at groups not initialized yet.
+		 */
+		skip_init = false;
+		if (cr < 2 && ac->ac_2order < MB_NUM_ORDERS(sb)) {
+			n = ext4_mb_find_order_groups(ac, cr, ngroups, groups,
+						      MB_ORDER_CANDIDATES);
+			for (i = 0; i < n; i++) {
+				err = ext4_mb_scan_group(ac, groups[i], cr,
+							 &first_err);
+				if (err)
+					goto out;
+				if (ac->ac_status != AC_STATUS_CONTINUE)
+					break;
+			}
+			if (ac->ac_status != AC_STATUS_CONTINUE)
+				break;
+			skip_init = n < MB_ORDER_CANDIDATES;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		prefetched = 0;
 
 		for (i = 0; i < ngroups; group++, i++) {
-			int ret = 0;
+			struct ext4_group_info *grp;
+
 			cond_resched();
 			/*
 			 * Artificially restricted ngroups for non-extent
@@ -2179,45 +2354,25 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				if (!first_err)
-					first_err = ret;
+			grp = ext4_get_group_info(sb, group);
+			if (skip_init && !EXT4_MB_GRP_NEED_INIT(grp))
 				continue;
+
+			/* read ahead the bitmaps the next groups will need */
+			if (prefetched) {
+				prefetched--;
+			} else if (EXT4_MB_GRP_NEED_INIT(grp) &&
+				   sbi->s_mb_prefetch) {
+				n = min_t(ext4_group_t, sbi->s_mb_prefetch,
+					  ngroups - i);
+				ext4_mb_prefetch(sb, group, n, ngroups);
+				prefetched = n - 1;
 			}
 
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &first_err);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2452,9 +2607,11 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2604,6 +2761,21 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	i = MB_NUM_ORDERS(sb);
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(i, sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(i, sizeof(rwlock_t), GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL ||
+	    sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2633,6 +2805,12 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	/*
+	 * The bitmaps of a flex group are next to each other on disk, so
+	 * reading a whole flex group's worth ahead is about one I/O.
+	 */
+	sbi->s_mb_prefetch = max_t(unsigned int, ext4_flex_bg_size(sbi),
+				   MB_DEFAULT_PREFETCH);
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2685,6 +2863,10 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2737,6 +2919,8 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -5035,6 +5219,117 @@ error_return:
 	return err;
 }
 
+/**
+ * ext4_mb_mark_used_range() -- Mark given blocks as in use
+ * @handle:			handle to this transaction
+ * @sb:				super block
+ * @block:			start physical block
+ * @count:			number of blocks
+ *
+ * Used by fast commit replay for blocks that were allocated in a
+ * transaction that never reached the log.  Blocks already in use are left
+ * alone, so replaying the same range twice is harmless.  The range must
+ * not cross a group boundary.
+ */
+int ext4_mb_mark_used_range(handle_t *handle, struct super_block *sb,
+			    ext4_fsblk_t block, unsigned long count)
+{
+	struct buffer_head *bitmap_bh = NULL;
+	struct buffer_head *gd_bh;
+	ext4_group_t block_group;
+	ext4_grpblk_t bit, start, end, max;
+	struct ext4_group_desc *desc;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	int err, ret, blocks_used = 0;
+
+	if (count == 0)
+		return 0;
+
+	ext4_get_group_no_and_offset(sb, block, &block_group, &bit);
+	if (bit + count > EXT4_BLOCKS_PER_GROUP(sb) ||
+	    !ext4_data_block_valid(sbi, block, count)) {
+		ext4_error(sb, "Marking invalid blocks in use - "
+			   "Block = %llu, count = %lu", block, count);
+		return -EFSCORRUPTED;
+	}
+
+	bitmap_bh = ext4_read_block_bitmap(sb, block_group);
+	if (IS_ERR(bitmap_bh)) {
+		err = PTR_ERR(bitmap_bh);
+		bitmap_bh = NULL;
+		goto error_return;
+	}
+
+	err = -EIO;
+	desc = ext4_get_group_desc(sb, block_group, &gd_bh);
+	if (!desc)
+		goto error_return;
+
+	BUFFER_TRACE(bitmap_bh, "getting write access");
+	err = ext4_journal_get_write_access(handle, bitmap_bh);
+	if (err)
+		goto error_return;
+
+	BUFFER_TRACE(gd_bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, gd_bh);
+	if (err)
+		goto error_return;
+
+	err = ext4_mb_load_buddy(sb, block_group, &e4b);
+	if (err)
+		goto error_return;
+
+	ext4_lock_group(sb, block_group);
+	if (desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+		desc->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+		ext4_free_group_clusters_set(sb, desc,
+			ext4_free_clusters_after_init(sb, block_group, desc));
+	}
+	/* only the runs that are still free need marking */
+	max = bit + count;
+	start = mb_find_next_zero_bit(bitmap_bh->b_data, max, bit);
+	while (start < max) {
+		end = mb_find_next_bit(bitmap_bh->b_data, max, start);
+		ex.fe_group = block_group;
+		ex.fe_start = start;
+		ex.fe_len = end - start;
+		ex.fe_logical = 0;
+		ext4_set_bits(bitmap_bh->b_data, start, end - start);
+		mb_mark_used(&e4b, &ex);
+		blocks_used += end - start;
+		start = mb_find_next_zero_bit(bitmap_bh->b_data, max, end);
+	}
+	ext4_free_group_clusters_set(sb, desc,
+			ext4_free_group_clusters(sb, desc) - blocks_used);
+	ext4_block_bitmap_csum_set(sb, block_group, desc, bitmap_bh);
+	ext4_group_desc_csum_set(sb, block_group, desc);
+	ext4_unlock_group(sb, block_group);
+	percpu_counter_sub(&sbi->s_freeclusters_counter, blocks_used);
+
+	if (sbi->s_log_groups_per_flex) {
+		ext4_group_t flex_group = ext4_flex_group(sbi, block_group);
+		atomic64_sub(blocks_used,
+			     &sbi->s_flex_groups[flex_group].free_clusters);
+	}
+
+	ext4_mb_unload_buddy(&e4b);
+
+	BUFFER_TRACE(bitmap_bh, "dirtied bitmap block");
+	err = ext4_handle_dirty_metadata(handle, NULL, bitmap_bh);
+
+	BUFFER_TRACE(gd_bh, "dirtied group descriptor block");
+	ret = ext4_handle_dirty_metadata(handle, NULL, gd_bh);
+	if (!err)
+		err = ret;
+
+error_return:
+	brelse(bitmap_bh);
+	ext4_std_error(sb, err);
+	return err;
+}
+
 /**
  * ext4_trim_extent -- function to TRIM one single free extent in the group
  * @sb:		super block for the file system
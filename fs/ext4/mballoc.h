@@ -89,6 +89,20 @@ extern ushort ext4_mballoc_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * minimum number of block bitmaps read ahead while scanning groups that
+ * have not been initialized yet; at least a flex group's worth is used
+ */
+#define MB_DEFAULT_PREFETCH		16
+
+/*
+ * number of groups taken from the free order lists per criteria pass
+ */
+#define MB_ORDER_CANDIDATES		8
+
+/* number of buddy orders, i.e. the size of bb_counters[] */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
@@ -331,6 +331,7 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 		if (retval)
 			goto err_out;
 	}
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	i_data[0] = ei->i_data[EXT4_IND_BLOCK];
 	i_data[1] = ei->i_data[EXT4_DIND_BLOCK];
@@ -642,6 +643,7 @@ int ext4_ind_migrate(struct inode *inode)
 	handle = ext4_journal_start(inode, EXT4_HT_MIGRATE, 1);
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	down_write(&EXT4_I(inode)->i_data_sem);
 	ret = ext4_ext_check_inode(inode);
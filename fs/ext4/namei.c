@@ -2076,6 +2076,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 		csum_size = sizeof(struct ext4_dir_entry_tail);
 
 	sb = dir->i_sb;
+	ext4_fc_mark_ineligible(sb, handle);
 	blocksize = sb->s_blocksize;
 	if (!dentry->d_name.len)
 		return -EINVAL;
@@ -2342,6 +2343,7 @@ static int ext4_delete_entry(handle_t *handle,
 {
 	int err, csum_size = 0;
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	if (ext4_has_inline_data(dir)) {
 		int has_inline_data = 1;
 		err = ext4_delete_inline_entry(handle, dir, de_del, bh,
@@ -3342,6 +3344,7 @@ static int ext4_setent(handle_t *handle, struct ext4_renament *ent,
 {
 	int retval;
 
+	ext4_fc_mark_ineligible(ent->dir->i_sb, handle);
 	BUFFER_TRACE(ent->bh, "get write access");
 	retval = ext4_journal_get_write_access(handle, ent->bh);
 	if (retval)
@@ -92,6 +92,19 @@ static void ext4_finish_bio(struct bio *bio)
 			set_bit(AS_EIO, &page->mapping->flags);
 		}
 		bh = head = page_buffers(page);
+		/*
+		 * A bio segment covering the whole page carries every buffer
+		 * of it that was written, so no other end io can be looking
+		 * at them and the page can be finished without the lock.
+		 */
+		if (bio_start == 0 && bio_end == PAGE_CACHE_SIZE) {
+			do {
+				clear_buffer_async_write(bh);
+				if (bio->bi_error)
+					buffer_io_error(bh);
+			} while ((bh = bh->b_this_page) != head);
+			goto end_page;
+		}
 		/*
 		 * We check all buffers in the page under BH_Uptodate_Lock
 		 * to avoid races with other end io clearing async_write flags
@@ -111,6 +124,7 @@ static void ext4_finish_bio(struct bio *bio)
 		} while ((bh = bh->b_this_page) != head);
 		bit_spin_unlock(BH_Uptodate_Lock, &head->b_state);
 		local_irq_restore(flags);
+end_page:
 		if (!under_io) {
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 			if (ctx)
@@ -389,11 +403,17 @@ static int io_submit_init_bio(struct ext4_io_submit *io,
 	return 0;
 }
 
+/*
+ * Add @nr buffers of @page, starting at @bh, to the bio.  The buffers must
+ * be adjacent in the page and on disk, so they go in as one segment.
+ */
 static int io_submit_add_bh(struct ext4_io_submit *io,
 			    struct inode *inode,
 			    struct page *page,
-			    struct buffer_head *bh)
+			    struct buffer_head *bh,
+			    unsigned int nr)
 {
+	unsigned int len = nr * bh->b_size;
 	int ret;
 
 	if (io->io_bio && bh->b_blocknr != io->io_next_block) {
@@ -405,11 +425,11 @@ submit_and_retry:
 		if (ret)
 			return ret;
 	}
-	ret = bio_add_page(io->io_bio, page, bh->b_size, bh_offset(bh));
-	if (ret != bh->b_size)
+	ret = bio_add_page(io->io_bio, page, len, bh_offset(bh));
+	if (ret != len)
 		goto submit_and_retry;
-	wbc_account_io(io->io_wbc, page, bh->b_size);
-	io->io_next_block++;
+	wbc_account_io(io->io_wbc, page, len);
+	io->io_next_block += nr;
 	return 0;
 }
 
@@ -493,22 +513,36 @@ int ext4_bio_write_page(struct ext4_io_submit *io,
 		}
 	}
 
-	/* Now submit buffers to write */
+	/*
+	 * Now submit buffers to write, each run of buffers that are
+	 * contiguous on disk as a single bio segment.
+	 */
 	do {
+		struct buffer_head *run = bh;
+		unsigned int nr = 1;
+
 		if (!buffer_async_write(bh))
 			continue;
+		while (bh->b_this_page != head &&
+		       buffer_async_write(bh->b_this_page) &&
+		       bh->b_this_page->b_blocknr == bh->b_blocknr + 1) {
+			bh = bh->b_this_page;
+			nr++;
+		}
 		ret = io_submit_add_bh(io, inode,
-				       data_page ? data_page : page, bh);
+				       data_page ? data_page : page, run, nr);
 		if (ret) {
 			/*
 			 * We only get here on ENOMEM.  Not much else
 			 * we can do but mark the page as dirty, and
 			 * better luck next time.
 			 */
+			bh = run;
 			break;
 		}
-		nr_submitted++;
-		clear_buffer_dirty(bh);
+		nr_submitted += nr;
+		for (; nr; nr--, run = run->b_this_page)
+			clear_buffer_dirty(run);
 	} while ((bh = bh->b_this_page) != head);
 
 	/* Error stopped previous loop? Clean up buffers... */
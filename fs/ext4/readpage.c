@@ -180,6 +180,24 @@ int ext4_mpage_readpages(struct address_space *mapping,
 			last_block = last_block_in_file;
 		page_block = 0;
 
+		/*
+		 * Fast path for sequential reads: the whole page lies inside
+		 * the extent mapped for the previous pages and below EOF, so
+		 * its blocks are contiguous and need no per-block lookup.
+		 */
+		if ((map.m_flags & EXT4_MAP_MAPPED) &&
+		    block_in_file >= map.m_lblk &&
+		    block_in_file + blocks_per_page <= map.m_lblk + map.m_len &&
+		    block_in_file + blocks_per_page <= last_block_in_file) {
+			blocks[0] = map.m_pblk + (block_in_file - map.m_lblk);
+			blocks[blocks_per_page - 1] = blocks[0] +
+							blocks_per_page - 1;
+			relative_block = block_in_file + blocks_per_page -
+								map.m_lblk;
+			SetPageMappedToDisk(page);
+			goto page_mapped;
+		}
+
 		/*
 		 * Map blocks using the previous result first.
 		 */
@@ -259,6 +277,7 @@ int ext4_mpage_readpages(struct address_space *mapping,
 		} else if (fully_mapped) {
 			SetPageMappedToDisk(page);
 		}
+	page_mapped:
 		if (fully_mapped && blocks_per_page == 1 &&
 		    !PageUptodate(page) && cleancache_get_page(page) == 0) {
 			SetPageUptodate(page);
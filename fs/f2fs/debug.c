@@ -69,6 +69,8 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->dirty_sits = SIT_I(sbi)->dirty_sentries;
 	si->fnids = NM_I(sbi)->fcnt;
 	si->bg_gc = sbi->bg_gc;
+	for (i = 0; i < NR_GC_TEMP; i++)
+		si->victim_secs[i] = DIRTY_I(sbi)->nr_victims[i];
 	si->util_free = (int)(free_user_blocks(sbi) >> sbi->log_blocks_per_seg)
 		* 100 / (int)(sbi->user_block_count >> sbi->log_blocks_per_seg)
 		/ 2;
@@ -167,6 +169,7 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 	si->base_mem += sizeof(struct dirty_seglist_info);
 	si->base_mem += NR_DIRTY_TYPE * f2fs_bitmap_size(MAIN_SEGS(sbi));
 	si->base_mem += f2fs_bitmap_size(MAIN_SECS(sbi));
+	si->base_mem += MAIN_SECS(sbi) * sizeof(struct victim_entry);
 
 	/* build nm */
 	si->base_mem += sizeof(struct f2fs_nm_info);
@@ -282,6 +285,15 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_data_blks);
 		seq_printf(s, "  - node blocks : %d (%d)\n", si->node_blks,
 				si->bg_node_blks);
+		seq_puts(s, "GC by temperature: dirty secs, segments (BG), "
+				"blocks (BG)\n");
+		for (j = 0; j < NR_GC_TEMP; j++)
+			seq_printf(s, "  - %-4s : %d, %d (%d), %d (%d)\n",
+				j == GC_TEMP_HOT ? "hot" :
+				j == GC_TEMP_WARM ? "warm" : "cold",
+				si->victim_secs[j],
+				si->temp_segs[j], si->bg_temp_segs[j],
+				si->temp_blks[j], si->bg_temp_blks[j]);
 		seq_puts(s, "\nExtent Cache:\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached,
@@ -125,6 +125,7 @@ enum {
 #define BATCHED_TRIM_BLOCKS(sbi)	\
 		(BATCHED_TRIM_SEGMENTS(sbi) << (sbi)->log_blocks_per_seg)
 #define DEF_CP_INTERVAL			60	/* 60 secs */
+#define DEF_ATOMIC_COMMIT_WINDOW	100	/* 100 usecs */
 
 struct cp_control {
 	int reason;
@@ -585,6 +586,18 @@ enum {
 	CURSEG_DIRECT_IO,	/* to use for the direct IO path */
 };
 
+/*
+ * Segment temperatures for victim selection and the background GC threads.
+ * Data and node logs of the same temperature share one.
+ */
+enum {
+	GC_TEMP_HOT = 0,
+	GC_TEMP_WARM,
+	GC_TEMP_COLD,
+	NR_GC_TEMP,
+};
+#define GC_TEMP_ANY	NR_GC_TEMP	/* victims of any temperature */
+
 struct flush_cmd {
 	struct completion wait;
 	struct llist_node llnode;
@@ -792,6 +805,13 @@ struct f2fs_sb_info {
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 
+	/* for batching atomic write commits */
+	struct mutex atomic_commit_mutex;	/* held by the batch leader */
+	spinlock_t atomic_commit_lock;		/* protects atomic_commit_list */
+	struct list_head atomic_commit_list;	/* commits waiting for a batch */
+	atomic_t nr_atomic_commits;		/* commits still writing data */
+	unsigned int atomic_commit_window;	/* usecs to wait for others */
+
 	/*
 	 * for stat information.
 	 * one is for the LFS mode, and the other is for the SSR mode.
@@ -1857,7 +1877,7 @@ int f2fs_release_page(struct page *, gfp_t);
 int start_gc_thread(struct f2fs_sb_info *);
 void stop_gc_thread(struct f2fs_sb_info *);
 block_t start_bidx_of_node(unsigned int, struct f2fs_inode_info *);
-int f2fs_gc(struct f2fs_sb_info *, bool);
+int f2fs_gc(struct f2fs_sb_info *, bool, int);
 void build_gc_manager(struct f2fs_sb_info *);
 
 /*
@@ -1893,6 +1913,9 @@ struct f2fs_stat_info {
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
 	int bg_data_blks, bg_node_blks;
+	int victim_secs[NR_GC_TEMP];
+	int temp_segs[NR_GC_TEMP], bg_temp_segs[NR_GC_TEMP];
+	int temp_blks[NR_GC_TEMP], bg_temp_blks[NR_GC_TEMP];
 	int curseg[NR_CURSEG_TYPE];
 	int cursec[NR_CURSEG_TYPE];
 	int curzone[NR_CURSEG_TYPE];
@@ -1966,6 +1989,17 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 		}							\
 	} while (0)
 
+#define stat_inc_temp_seg_count(sbi, temp, blks, gc_type)		\
+	do {								\
+		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
+		si->temp_segs[temp]++;					\
+		si->temp_blks[temp] += (blks);				\
+		if (gc_type == BG_GC) {					\
+			si->bg_temp_segs[temp]++;			\
+			si->bg_temp_blks[temp] += (blks);		\
+		}							\
+	} while (0)
+
 #define stat_inc_tot_blk_count(si, blks)				\
 	(si->tot_blks += (blks))
 
@@ -2009,6 +2043,7 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_block_count(sbi, curseg)
 #define stat_inc_inplace_blocks(sbi)
 #define stat_inc_seg_count(sbi, type, gc_type)
+#define stat_inc_temp_seg_count(sbi, temp, blks, gc_type)
 #define stat_inc_tot_blk_count(si, blks)
 #define stat_inc_data_blk_count(sbi, blks, gc_type)
 #define stat_inc_node_blk_count(sbi, blks, gc_type)
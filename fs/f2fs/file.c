@@ -21,6 +21,7 @@
 #include <linux/mount.h>
 #include <linux/pagevec.h>
 #include <linux/random.h>
+#include <linux/delay.h>
 
 #include "f2fs.h"
 #include "node.h"
@@ -181,9 +182,14 @@ static void try_to_fix_pino(struct inode *inode)
 	}
 }
 
-int f2fs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
+/*
+ * With @deferred set, waiting for the node pages and the cache flush are
+ * left to the caller, which finishes with f2fs_sync_file_finish() and
+ * issues the flush itself if *deferred comes back true.
+ */
+static int f2fs_do_sync_file(struct inode *inode, loff_t start, loff_t end,
+					int datasync, bool *deferred)
 {
-	struct inode *inode = file->f_mapping->host;
 	struct f2fs_inode_info *fi = F2FS_I(inode);
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	nid_t ino = inode->i_ino;
@@ -270,6 +276,11 @@ sync_nodes:
 		goto sync_nodes;
 	}
 
+	if (deferred) {
+		*deferred = true;
+		goto out;
+	}
+
 	ret = wait_on_node_pages_writeback(sbi, ino);
 	if (ret)
 		goto out;
@@ -278,6 +289,10 @@ sync_nodes:
 	remove_dirty_inode(sbi, ino, APPEND_INO);
 	clear_inode_flag(fi, FI_APPEND_WRITE);
 flush_out:
+	if (deferred) {
+		*deferred = true;
+		goto out;
+	}
 	remove_dirty_inode(sbi, ino, UPDATE_INO);
 	clear_inode_flag(fi, FI_UPDATE_WRITE);
 	ret = f2fs_issue_flush(sbi);
@@ -287,6 +302,31 @@ out:
 	return ret;
 }
 
+int f2fs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
+{
+	return f2fs_do_sync_file(file->f_mapping->host, start, end,
+							datasync, NULL);
+}
+
+/* the rest of a deferred f2fs_do_sync_file(), bar the cache flush */
+static int f2fs_sync_file_finish(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	nid_t ino = inode->i_ino;
+	int ret;
+
+	ret = wait_on_node_pages_writeback(sbi, ino);
+	if (ret)
+		return ret;
+
+	remove_dirty_inode(sbi, ino, APPEND_INO);
+	clear_inode_flag(fi, FI_APPEND_WRITE);
+	remove_dirty_inode(sbi, ino, UPDATE_INO);
+	clear_inode_flag(fi, FI_UPDATE_WRITE);
+	return 0;
+}
+
 static pgoff_t __get_first_dirty_index(struct address_space *mapping,
 						pgoff_t pgofs, int whence)
 {
@@ -1366,9 +1406,84 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	return 0;
 }
 
+struct atomic_commit {
+	struct list_head list;
+	struct inode *inode;
+	bool deferred;			/* nodes and flush left to the batch */
+	bool done;			/* ret is valid */
+	int ret;
+};
+
+/*
+ * Commits of atomic files are batched, so that concurrent database
+ * transactions share one node write and one cache flush instead of paying
+ * for a flush each.  Every committer queues itself and takes
+ * atomic_commit_mutex; whoever gets it first commits everything queued so
+ * far, so commits arriving while a batch is being written make up the next
+ * one.  A leader that knows of other commits still writing their data
+ * gives them up to atomic_commit_window usecs to join.  Each committer only
+ * gets back the result for its own inode.
+ */
+static int f2fs_commit_atomic_batch(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct atomic_commit ac = { .inode = inode };
+	struct atomic_commit *cur, *tmp;
+	struct blk_plug plug;
+	LIST_HEAD(batch);
+	bool need_flush = false;
+	int err = 0;
+
+	spin_lock(&sbi->atomic_commit_lock);
+	list_add_tail(&ac.list, &sbi->atomic_commit_list);
+	spin_unlock(&sbi->atomic_commit_lock);
+	atomic_dec(&sbi->nr_atomic_commits);
+
+	mutex_lock(&sbi->atomic_commit_mutex);
+	if (ac.done)
+		goto out;
+
+	if (sbi->atomic_commit_window && atomic_read(&sbi->nr_atomic_commits))
+		usleep_range(sbi->atomic_commit_window,
+					2 * sbi->atomic_commit_window);
+
+	spin_lock(&sbi->atomic_commit_lock);
+	list_splice_init(&sbi->atomic_commit_list, &batch);
+	spin_unlock(&sbi->atomic_commit_lock);
+
+	/* let the node pages of the whole batch merge into few requests */
+	blk_start_plug(&plug);
+	list_for_each_entry(cur, &batch, list)
+		cur->ret = f2fs_do_sync_file(cur->inode, 0, LLONG_MAX, 0,
+							&cur->deferred);
+	blk_finish_plug(&plug);
+
+	list_for_each_entry(cur, &batch, list) {
+		if (!cur->deferred || cur->ret)
+			continue;
+		cur->ret = f2fs_sync_file_finish(cur->inode);
+		if (!cur->ret)
+			need_flush = true;
+	}
+
+	if (need_flush)
+		err = f2fs_issue_flush(sbi);
+
+	list_for_each_entry_safe(cur, tmp, &batch, list) {
+		if (cur->deferred && !cur->ret)
+			cur->ret = err;
+		list_del(&cur->list);
+		cur->done = true;
+	}
+out:
+	mutex_unlock(&sbi->atomic_commit_mutex);
+	return ac.ret;
+}
+
 static int f2fs_ioc_commit_atomic_write(struct file *filp)
 {
 	struct inode *inode = file_inode(filp);
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	int ret;
 
 	if (!inode_owner_or_capable(inode))
@@ -1383,9 +1498,14 @@ static int f2fs_ioc_commit_atomic_write(struct file *filp)
 
 	if (f2fs_is_atomic_file(inode)) {
 		clear_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
+		atomic_inc(&sbi->nr_atomic_commits);
 		ret = commit_inmem_pages(inode, false);
-		if (ret)
+		if (ret) {
+			atomic_dec(&sbi->nr_atomic_commits);
 			goto err_out;
+		}
+		ret = f2fs_commit_atomic_batch(inode);
+		goto err_out;
 	}
 
 	ret = f2fs_sync_file(filp, 0, LLONG_MAX, 0);
@@ -1622,7 +1742,7 @@ static int f2fs_ioc_gc(struct file *filp, unsigned long arg)
 		mutex_lock(&sbi->gc_mutex);
 	}
 
-	return f2fs_gc(sbi, sync);
+	return f2fs_gc(sbi, sync, GC_TEMP_ANY);
 }
 
 static int f2fs_ioc_write_checkpoint(struct file *filp, unsigned long arg)
@@ -26,7 +26,8 @@
 
 static int gc_thread_func(void *data)
 {
-	struct f2fs_sb_info *sbi = data;
+	struct f2fs_gc_worker *worker = data;
+	struct f2fs_sb_info *sbi = worker->sbi;
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
 	long wait_ms;
@@ -34,12 +35,17 @@ static int gc_thread_func(void *data)
 	wait_ms = gc_th->min_sleep_time;
 
 	do {
+		/*
+		 * Hot sections tend to invalidate themselves if left alone,
+		 * so the hot thread waits twice as long between passes.
+		 */
 		if (try_to_freeze())
 			continue;
 		else
 			wait_event_interruptible_timeout(*wq,
-						kthread_should_stop(),
-						msecs_to_jiffies(wait_ms));
+				kthread_should_stop(),
+				msecs_to_jiffies(worker->temp == GC_TEMP_HOT ?
+						 2 * wait_ms : wait_ms));
 		if (kthread_should_stop())
 			break;
 
@@ -78,7 +84,7 @@ static int gc_thread_func(void *data)
 		stat_inc_bggc_count(sbi);
 
 		/* if return value is not zero, no victim was selected */
-		if (f2fs_gc(sbi, test_opt(sbi, FORCE_FG_GC)))
+		if (f2fs_gc(sbi, test_opt(sbi, FORCE_FG_GC), worker->temp))
 			wait_ms = gc_th->no_gc_sleep_time;
 
 		trace_f2fs_background_gc(sbi->sb, wait_ms,
@@ -91,13 +97,34 @@ static int gc_thread_func(void *data)
 	return 0;
 }
 
+static const char * const gc_temp_names[NR_GC_TEMP] = {
+	[GC_TEMP_HOT]	= "hot",
+	[GC_TEMP_WARM]	= "warm",
+	[GC_TEMP_COLD]	= "cold",
+};
+
+static void stop_gc_workers(struct f2fs_gc_kthread *gc_th)
+{
+	int i;
+
+	for (i = 0; i < NR_GC_TEMP; i++)
+		if (gc_th->workers[i].f2fs_gc_task)
+			kthread_stop(gc_th->workers[i].f2fs_gc_task);
+}
+
+/*
+ * Start one background GC thread per segment temperature.  Each picks its
+ * victims among sections of its own temperature only; they still take
+ * turns through gc_mutex to move blocks.
+ */
 int start_gc_thread(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_gc_kthread *gc_th;
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
 	int err = 0;
+	int i;
 
-	gc_th = kmalloc(sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
+	gc_th = kzalloc(sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
 	if (!gc_th) {
 		err = -ENOMEM;
 		goto out;
@@ -111,12 +138,22 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
-	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
-			"f2fs_gc-%u:%u", MAJOR(dev), MINOR(dev));
-	if (IS_ERR(gc_th->f2fs_gc_task)) {
-		err = PTR_ERR(gc_th->f2fs_gc_task);
-		kfree(gc_th);
-		sbi->gc_thread = NULL;
+	for (i = 0; i < NR_GC_TEMP; i++) {
+		struct f2fs_gc_worker *worker = &gc_th->workers[i];
+		struct task_struct *task;
+
+		worker->sbi = sbi;
+		worker->temp = i;
+		task = kthread_run(gc_thread_func, worker, "f2fs_gc-%u:%u-%s",
+				MAJOR(dev), MINOR(dev), gc_temp_names[i]);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			stop_gc_workers(gc_th);
+			kfree(gc_th);
+			sbi->gc_thread = NULL;
+			break;
+		}
+		worker->f2fs_gc_task = task;
 	}
 out:
 	return err;
@@ -127,7 +164,7 @@ void stop_gc_thread(struct f2fs_sb_info *sbi)
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	if (!gc_th)
 		return;
-	kthread_stop(gc_th->f2fs_gc_task);
+	stop_gc_workers(gc_th);
 	kfree(gc_th);
 	sbi->gc_thread = NULL;
 }
@@ -246,6 +283,54 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 		return get_cb_cost(sbi, segno);
 }
 
+/*
+ * Pick an LFS victim section of temperature @temp off the victim index.
+ * Buckets are walked from the emptiest one up; within a bucket the least
+ * recently modified section comes first, so greedy stops at the first
+ * bucket holding a usable section, and cost-benefit compares one head per
+ * bucket.  Sections in use or already taken by background GC are skipped.
+ */
+static void get_victim_from_index(struct f2fs_sb_info *sbi,
+		struct victim_sel_policy *p, int gc_type, int temp)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nsearched = 0;
+	int b, t;
+
+	for (b = 0; b < NR_VICTIM_BUCKETS; b++) {
+		for (t = 0; t < NR_GC_TEMP; t++) {
+			struct victim_entry *ve;
+
+			if (temp != GC_TEMP_ANY && t != temp)
+				continue;
+
+			list_for_each_entry(ve, &dirty_i->victim_list[t][b],
+									list) {
+				unsigned int secno = ve - dirty_i->victim_entries;
+				unsigned int segno = secno * sbi->segs_per_sec;
+				unsigned int cost;
+
+				if (nsearched++ >= p->max_search)
+					return;
+				if (sec_usage_check(sbi, secno))
+					continue;
+				if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+					continue;
+
+				cost = get_gc_cost(sbi, segno, p);
+				if (cost < p->min_cost) {
+					p->min_segno = segno;
+					p->min_cost = cost;
+				}
+				break;
+			}
+		}
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			return;
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -253,9 +338,12 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
  * and it does not remove it from dirty seglist.
  * When it is called from SSR segment selection, it finds a segment
  * which has minimum valid blocks and removes it from dirty seglist.
+ * GC victims come from the victim index, SSR still scans the per-type
+ * dirty bitmap.
  */
 static int get_victim_by_default(struct f2fs_sb_info *sbi,
-		unsigned int *result, int gc_type, int type, char alloc_mode)
+		unsigned int *result, int gc_type, int type, char alloc_mode,
+		int temp)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 	struct victim_sel_policy p;
@@ -280,6 +368,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		get_victim_from_index(sbi, &p, gc_type, temp);
+		goto found;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -320,6 +413,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+found:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -760,14 +854,14 @@ next_step:
 }
 
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
-			int gc_type)
+			int gc_type, int temp)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
 	int ret;
 
 	mutex_lock(&sit_i->sentry_lock);
 	ret = DIRTY_I(sbi)->v_ops->get_victim(sbi, victim, gc_type,
-					      NO_CHECK_TYPE, LFS);
+					      NO_CHECK_TYPE, LFS, temp);
 	mutex_unlock(&sit_i->sentry_lock);
 	return ret;
 }
@@ -780,6 +874,10 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
 	struct blk_plug plug;
 	int nfree = 0;
 
+	stat_inc_temp_seg_count(sbi,
+			seg_type_temp(get_seg_entry(sbi, segno)->type),
+			get_valid_blocks(sbi, segno, 0), gc_type);
+
 	/* read segment summary of victim */
 	sum_page = get_sum_page(sbi, segno);
 
@@ -814,7 +912,11 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi, unsigned int segno,
 	return nfree;
 }
 
-int f2fs_gc(struct f2fs_sb_info *sbi, bool sync)
+/*
+ * Background GC of @temp only cleans sections of that temperature; once
+ * free sections run short it turns into foreground GC of any temperature.
+ */
+int f2fs_gc(struct f2fs_sb_info *sbi, bool sync, int temp)
 {
 	unsigned int segno, i;
 	int gc_type = sync ? FG_GC : BG_GC;
@@ -837,11 +939,13 @@ gc_more:
 
 	if (gc_type == BG_GC && has_not_enough_free_secs(sbi, sec_freed)) {
 		gc_type = FG_GC;
-		if (__get_victim(sbi, &segno, gc_type) || prefree_segments(sbi))
+		temp = GC_TEMP_ANY;
+		if (__get_victim(sbi, &segno, gc_type, temp) ||
+						prefree_segments(sbi))
 			write_checkpoint(sbi, &cpc);
 	}
 
-	if (segno == NULL_SEGNO && !__get_victim(sbi, &segno, gc_type))
+	if (segno == NULL_SEGNO && !__get_victim(sbi, &segno, gc_type, temp))
 		goto stop;
 	ret = 0;
 
@@ -22,8 +22,15 @@
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
-struct f2fs_gc_kthread {
+/* background GC thread cleaning sections of one temperature */
+struct f2fs_gc_worker {
 	struct task_struct *f2fs_gc_task;
+	struct f2fs_sb_info *sbi;
+	int temp;			/* GC_TEMP_XXX */
+};
+
+struct f2fs_gc_kthread {
+	struct f2fs_gc_worker workers[NR_GC_TEMP];
 	wait_queue_head_t gc_wait_queue_head;
 
 	/* for gc sleep time */
@@ -289,7 +289,7 @@ void f2fs_balance_fs(struct f2fs_sb_info *sbi)
 	 */
 	if (has_not_enough_free_secs(sbi, 0)) {
 		mutex_lock(&sbi->gc_mutex);
-		f2fs_gc(sbi, false);
+		f2fs_gc(sbi, false, GC_TEMP_ANY);
 	}
 }
 
@@ -417,6 +417,40 @@ void destroy_flush_cmd_control(struct f2fs_sb_info *sbi)
 	SM_I(sbi)->cmd_control_info = NULL;
 }
 
+/*
+ * Move the section of @segno to the tail of the victim list matching its
+ * current temperature and valid blocks, or drop it from the index once none
+ * of its segments is dirty.  Called with seglist_lock held whenever a
+ * segment's DIRTY state or valid block count changes.
+ */
+static void __update_victim_entry(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SECNO(sbi, segno);
+	unsigned int start = secno * sbi->segs_per_sec;
+	struct victim_entry *ve = &dirty_i->victim_entries[secno];
+	unsigned int valid, i;
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		if (test_bit(start + i, dirty_i->dirty_segmap[DIRTY]))
+			break;
+
+	if (!list_empty(&ve->list)) {
+		list_del_init(&ve->list);
+		dirty_i->nr_victims[ve->temp]--;
+	}
+	if (i == sbi->segs_per_sec)
+		return;
+
+	valid = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
+	ve->temp = seg_type_temp(get_seg_entry(sbi, segno)->type);
+	ve->bucket = min_t(unsigned int, NR_VICTIM_BUCKETS - 1,
+			(valid * NR_VICTIM_BUCKETS) /
+			(sbi->blocks_per_seg * sbi->segs_per_sec));
+	list_add_tail(&ve->list, &dirty_i->victim_list[ve->temp][ve->bucket]);
+	dirty_i->nr_victims[ve->temp]++;
+}
+
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		enum dirty_type dirty_type)
 {
@@ -439,6 +473,8 @@ static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		}
 		if (!test_and_set_bit(segno, dirty_i->dirty_segmap[t]))
 			dirty_i->nr_dirty[t]++;
+
+		__update_victim_entry(sbi, segno);
 	}
 }
 
@@ -460,6 +496,8 @@ static void __remove_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		if (get_valid_blocks(sbi, segno, sbi->segs_per_sec) == 0)
 			clear_bit(GET_SECNO(sbi, segno),
 						dirty_i->victim_secmap);
+
+		__update_victim_entry(sbi, segno);
 	}
 }
 
@@ -1072,13 +1110,13 @@ static int get_ssr_segment(struct f2fs_sb_info *sbi, int type)
 	const struct victim_selection *v_ops = DIRTY_I(sbi)->v_ops;
 
 	if (IS_NODESEG(type) || !has_not_enough_free_secs(sbi, 0))
-		return v_ops->get_victim(sbi,
-				&(curseg)->next_segno, BG_GC, type, SSR);
+		return v_ops->get_victim(sbi, &(curseg)->next_segno,
+					BG_GC, type, SSR, GC_TEMP_ANY);
 
 	/* For data segments, let's do SSR more intensively */
 	for (; type >= CURSEG_HOT_DATA; type--)
 		if (v_ops->get_victim(sbi, &(curseg)->next_segno,
-						BG_GC, type, SSR))
+					BG_GC, type, SSR, GC_TEMP_ANY))
 			return 1;
 	return 0;
 }
@@ -2226,10 +2264,29 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+static int init_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int i, j;
+
+	dirty_i->victim_entries = f2fs_kvzalloc(MAIN_SECS(sbi) *
+				sizeof(struct victim_entry), GFP_KERNEL);
+	if (!dirty_i->victim_entries)
+		return -ENOMEM;
+
+	for (i = 0; i < MAIN_SECS(sbi); i++)
+		INIT_LIST_HEAD(&dirty_i->victim_entries[i].list);
+	for (i = 0; i < NR_GC_TEMP; i++)
+		for (j = 0; j < NR_VICTIM_BUCKETS; j++)
+			INIT_LIST_HEAD(&dirty_i->victim_list[i][j]);
+	return 0;
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -2247,6 +2304,10 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 			return -ENOMEM;
 	}
 
+	err = init_victim_index(sbi);
+	if (err)
+		return err;
+
 	init_dirty_segmap(sbi);
 	return init_victim_secmap(sbi);
 }
@@ -2371,6 +2432,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	kvfree(dirty_i->victim_entries);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
@@ -23,6 +23,8 @@
 
 #define IS_DATASEG(t)	(t <= CURSEG_COLD_DATA)
 #define IS_NODESEG(t)	(t >= CURSEG_HOT_NODE)
+#define seg_type_temp(t)						\
+	(IS_DATASEG(t) ? (t) - CURSEG_HOT_DATA : (t) - CURSEG_HOT_NODE)
 
 #define IS_CURSEG(sbi, seg)						\
 	((seg == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno) ||	\
@@ -239,18 +241,35 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Dirty sections are indexed by temperature and valid blocks for LFS victim
+ * selection.  Each list holds the sections whose valid blocks fall into one
+ * of NR_VICTIM_BUCKETS equal ranges, least recently modified first, so the
+ * greedy and cost-benefit victims are found among the list heads alone.
+ */
+#define NR_VICTIM_BUCKETS	16
+
+struct victim_entry {
+	struct list_head list;		/* in victim_list[temp][bucket] */
+	unsigned char temp;		/* GC_TEMP_XXX */
+	unsigned char bucket;		/* valid blocks range */
+};
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	struct victim_entry *victim_entries;	/* one per section */
+	struct list_head victim_list[NR_GC_TEMP][NR_VICTIM_BUCKETS];
+	int nr_victims[NR_GC_TEMP];		/* # of indexed sections */
 };
 
 /* victim selection function for cleaning and SSR */
 struct victim_selection {
 	int (*get_victim)(struct f2fs_sb_info *, unsigned int *,
-							int, int, char);
+						int, int, char, int);
 };
 
 /* for active log information */
@@ -320,16 +320,127 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fiq->reqctr);
 }
 
-static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
+static void set_request_len(struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+}
+
+static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	set_request_len(req);
+	req->ichan = NULL;
 	list_add_tail(&req->list, &fiq->pending);
-	wake_up_locked(&fiq->waitq);
-	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
+/* Called under rcu_read_lock() */
+static struct fuse_ichan *fuse_local_ichan(struct fuse_conn *fc)
+{
+	struct fuse_ichan * __percpu *map = READ_ONCE(fc->ichan_map);
+
+	if (!map)
+		return NULL;
+	return READ_ONCE(*raw_cpu_ptr(map));
+}
+
+/*
+ * Wake a reader for newly queued work: one waiting on @ichan if there is
+ * one, otherwise any idle reader, which will take the work from wherever
+ * it was queued.
+ */
+static void fuse_kick_reader(struct fuse_conn *fc, struct fuse_ichan *ichan)
+{
+	struct fuse_ichan *c;
+
+	/* pairs with prepare_to_wait_exclusive() in fuse_ichan_wait() */
+	smp_mb();
+	rcu_read_lock();
+	if (ichan && waitqueue_active(&ichan->waitq)) {
+		wake_up(&ichan->waitq);
+		goto out;
+	}
+	list_for_each_entry_rcu(c, &fc->ichans, entry) {
+		if (waitqueue_active(&c->waitq)) {
+			wake_up(&c->waitq);
+			break;
+		}
+	}
+out:
+	rcu_read_unlock();
+	kill_fasync(&fc->iq.fasync, SIGIO, POLL_IN);
+}
+
+/*
+ * Queue a request for userspace on the channel last read from on this
+ * CPU, falling back to fc->iq.  Returns false if the connection is gone.
+ */
+static bool fuse_queue_request(struct fuse_conn *fc, struct fuse_req *req,
+			       bool set_unique)
+{
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_ichan *ichan;
+	bool queued = false;
+
+	rcu_read_lock();
+	ichan = fuse_local_ichan(fc);
+	if (ichan) {
+		spin_lock(&ichan->waitq.lock);
+		if (ichan->alive && fiq->connected) {
+			if (set_unique)
+				req->in.h.unique = fuse_get_unique(fiq);
+			set_request_len(req);
+			list_add_tail(&req->list, &ichan->pending);
+			req->ichan = ichan;
+			queued = true;
+		}
+		spin_unlock(&ichan->waitq.lock);
+	}
+	if (!queued) {
+		spin_lock(&fiq->waitq.lock);
+		if (fiq->connected) {
+			if (set_unique)
+				req->in.h.unique = fuse_get_unique(fiq);
+			queue_request(fiq, req);
+			queued = true;
+		}
+		spin_unlock(&fiq->waitq.lock);
+	}
+	if (queued)
+		fuse_kick_reader(fc, ichan);
+	rcu_read_unlock();
+
+	return queued;
+}
+
+/*
+ * Take back a request that no reader has picked up yet.  Returns false
+ * if it is already on its way to userspace.
+ */
+static bool fuse_unqueue_request(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_ichan *ichan;
+	spinlock_t *lock;
+	bool pending;
+
+	rcu_read_lock();
+	for (;;) {
+		ichan = READ_ONCE(req->ichan);
+		lock = ichan ? &ichan->waitq.lock : &fc->iq.waitq.lock;
+		spin_lock(lock);
+		if (READ_ONCE(req->ichan) == ichan)
+			break;
+		spin_unlock(lock);
+	}
+	pending = test_bit(FR_PENDING, &req->flags);
+	if (pending)
+		list_del(&req->list);
+	spin_unlock(lock);
+	rcu_read_unlock();
+
+	return pending;
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -344,12 +455,14 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fiq->connected) {
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
-		wake_up_locked(&fiq->waitq);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
-	} else {
-		kfree(forget);
+		spin_unlock(&fiq->waitq.lock);
+		rcu_read_lock();
+		fuse_kick_reader(fc, fuse_local_ichan(fc));
+		rcu_read_unlock();
+		return;
 	}
 	spin_unlock(&fiq->waitq.lock);
+	kfree(forget);
 }
 
 static void flush_bg_queue(struct fuse_conn *fc)
@@ -357,15 +470,16 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
-		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		spin_unlock(&fiq->waitq.lock);
+		if (!fuse_queue_request(fc, req, true)) {
+			/* only after fuse_abort_conn(), nobody would read it */
+			list_add(&req->list, &fc->bg_queue);
+			fc->active_background--;
+			break;
+		}
 	}
 }
 
@@ -417,13 +531,13 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 
 static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
+	struct fuse_conn *fc = container_of(fiq, struct fuse_conn, iq);
+
 	spin_lock(&fiq->waitq.lock);
-	if (list_empty(&req->intr_entry)) {
+	if (list_empty(&req->intr_entry))
 		list_add_tail(&req->intr_entry, &fiq->interrupts);
-		wake_up_locked(&fiq->waitq);
-	}
 	spin_unlock(&fiq->waitq.lock);
-	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+	fuse_kick_reader(fc, NULL);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
@@ -457,16 +571,12 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
 		/* Request is not yet in userspace, bail out */
-		if (test_bit(FR_PENDING, &req->flags)) {
-			list_del(&req->list);
-			spin_unlock(&fiq->waitq.lock);
+		if (fuse_unqueue_request(fc, req)) {
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->waitq.lock);
 	}
 
 	/*
@@ -478,21 +588,14 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->waitq.lock);
+	/* acquire extra reference, since request is still needed
+	   after request_end() */
+	__fuse_get_request(req);
+	if (!fuse_queue_request(fc, req, true)) {
+		__fuse_put_request(req);
 		req->out.h.error = -ENOTCONN;
 	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		/* acquire extra reference, since request is still needed
-		   after request_end() */
-		__fuse_get_request(req);
-		spin_unlock(&fiq->waitq.lock);
-
 		request_wait_answer(fc, req);
 		/* Pairs with smp_wmb() in request_end() */
 		smp_rmb();
@@ -621,16 +724,11 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
 	int err = -ENODEV;
-	struct fuse_iqueue *fiq = &fc->iq;
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
-	if (fiq->connected) {
-		queue_request(fiq, req);
+	if (fuse_queue_request(fc, req, false))
 		err = 0;
-	}
-	spin_unlock(&fiq->waitq.lock);
 
 	return err;
 }
@@ -1223,6 +1321,77 @@ __releases(fiq->waitq.lock)
 		return fuse_read_batch_forget(fiq, cs, nbytes);
 }
 
+static struct fuse_req *fuse_ichan_dequeue(struct fuse_ichan *ichan)
+{
+	struct fuse_req *req = NULL;
+
+	spin_lock(&ichan->waitq.lock);
+	if (!list_empty(&ichan->pending)) {
+		req = list_first_entry(&ichan->pending, struct fuse_req, list);
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+		req->ichan = NULL;
+	}
+	spin_unlock(&ichan->waitq.lock);
+
+	return req;
+}
+
+/* Take a request queued to another device whose readers are all busy */
+static struct fuse_req *fuse_ichan_steal(struct fuse_conn *fc,
+					 struct fuse_ichan *self)
+{
+	struct fuse_req *req = NULL;
+	struct fuse_ichan *ichan;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ichan, &fc->ichans, entry) {
+		if (ichan == self || list_empty_careful(&ichan->pending))
+			continue;
+		req = fuse_ichan_dequeue(ichan);
+		if (req)
+			break;
+	}
+	rcu_read_unlock();
+
+	return req;
+}
+
+static bool fuse_ichans_pending(struct fuse_conn *fc)
+{
+	struct fuse_ichan *ichan;
+	bool pending = false;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ichan, &fc->ichans, entry) {
+		if (!list_empty_careful(&ichan->pending)) {
+			pending = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return pending;
+}
+
+static int fuse_ichan_wait(struct fuse_conn *fc, struct fuse_ichan *ichan)
+{
+	struct fuse_iqueue *fiq = &fc->iq;
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	prepare_to_wait_exclusive(&ichan->waitq, &wait, TASK_INTERRUPTIBLE);
+	if (fiq->connected && !request_pending(fiq) &&
+	    !fuse_ichans_pending(fc)) {
+		schedule();
+		if (signal_pending(current))
+			err = -ERESTARTSYS;
+	}
+	finish_wait(&ichan->waitq, &wait);
+
+	return err;
+}
+
 /*
  * Read a single request into the userspace filesystem's buffer.  This
  * function waits until a request is available, then removes it from
@@ -1239,44 +1408,65 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	struct fuse_conn *fc = fud->fc;
 	struct fuse_iqueue *fiq = &fc->iq;
 	struct fuse_pqueue *fpq = &fud->pq;
+	struct fuse_ichan *ichan = fud->ichan;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
+	/* Requests submitted on this CPU come to us from now on */
+	if (fc->ichan_map && raw_cpu_read(*fc->ichan_map) != ichan)
+		raw_cpu_write(*fc->ichan_map, ichan);
+
  restart:
-	spin_lock(&fiq->waitq.lock);
-	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
-	    !request_pending(fiq))
-		goto err_unlock;
+	for (;;) {
+		err = -ENODEV;
+		if (!fiq->connected)
+			return err;
 
-	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
-	if (err)
-		goto err_unlock;
+		if (request_pending(fiq)) {
+			spin_lock(&fiq->waitq.lock);
+			if (!list_empty(&fiq->interrupts)) {
+				req = list_entry(fiq->interrupts.next,
+						 struct fuse_req, intr_entry);
+				return fuse_read_interrupt(fiq, cs, nbytes, req);
+			}
 
-	err = -ENODEV;
-	if (!fiq->connected)
-		goto err_unlock;
+			if (forget_pending(fiq)) {
+				if ((list_empty(&fiq->pending) &&
+				     list_empty_careful(&ichan->pending)) ||
+				    fiq->forget_batch-- > 0)
+					return fuse_read_forget(fc, fiq, cs,
+								nbytes);
 
-	if (!list_empty(&fiq->interrupts)) {
-		req = list_entry(fiq->interrupts.next, struct fuse_req,
-				 intr_entry);
-		return fuse_read_interrupt(fiq, cs, nbytes, req);
-	}
+				if (fiq->forget_batch <= -8)
+					fiq->forget_batch = 16;
+			}
 
-	if (forget_pending(fiq)) {
-		if (list_empty(&fiq->pending) || fiq->forget_batch-- > 0)
-			return fuse_read_forget(fc, fiq, cs, nbytes);
+			if (!list_empty(&fiq->pending)) {
+				req = list_entry(fiq->pending.next,
+						 struct fuse_req, list);
+				clear_bit(FR_PENDING, &req->flags);
+				list_del_init(&req->list);
+				spin_unlock(&fiq->waitq.lock);
+				break;
+			}
+			spin_unlock(&fiq->waitq.lock);
+		}
 
-		if (fiq->forget_batch <= -8)
-			fiq->forget_batch = 16;
-	}
+		req = fuse_ichan_dequeue(ichan);
+		if (req)
+			break;
+		req = fuse_ichan_steal(fc, ichan);
+		if (req)
+			break;
 
-	req = list_entry(fiq->pending.next, struct fuse_req, list);
-	clear_bit(FR_PENDING, &req->flags);
-	list_del_init(&req->list);
-	spin_unlock(&fiq->waitq.lock);
+		err = -EAGAIN;
+		if (file->f_flags & O_NONBLOCK)
+			return err;
+		err = fuse_ichan_wait(fc, ichan);
+		if (err)
+			return err;
+	}
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1328,10 +1518,6 @@ out_end:
 	spin_unlock(&fpq->lock);
 	request_end(fc, req);
 	return err;
-
- err_unlock:
-	spin_unlock(&fiq->waitq.lock);
-	return err;
 }
 
 static int fuse_dev_open(struct inode *inode, struct file *file)
@@ -2060,14 +2246,12 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 		return POLLERR;
 
 	fiq = &fud->fc->iq;
-	poll_wait(file, &fiq->waitq, wait);
+	poll_wait(file, &fud->ichan->waitq, wait);
 
-	spin_lock(&fiq->waitq.lock);
 	if (!fiq->connected)
 		mask = POLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) || fuse_ichans_pending(fud->fc))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fiq->waitq.lock);
 
 	return mask;
 }
@@ -2130,6 +2314,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
+		struct fuse_ichan *ichan;
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end1);
 		LIST_HEAD(to_end2);
@@ -2165,6 +2350,14 @@ void fuse_abort_conn(struct fuse_conn *fc)
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all_locked(&fiq->waitq);
 		spin_unlock(&fiq->waitq.lock);
+		list_for_each_entry(ichan, &fc->ichans, entry) {
+			spin_lock(&ichan->waitq.lock);
+			list_for_each_entry(req, &ichan->pending, list)
+				req->ichan = NULL;
+			list_splice_tail_init(&ichan->pending, &to_end2);
+			wake_up_all_locked(&ichan->waitq);
+			spin_unlock(&ichan->waitq.lock);
+		}
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2183,6 +2376,42 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+void fuse_ichan_shutdown(struct fuse_dev *fud)
+{
+	struct fuse_ichan *ichan = fud->ichan;
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_req *req;
+	LIST_HEAD(to_end);
+	int cpu;
+
+	spin_lock(&fc->lock);
+	list_del_rcu(&ichan->entry);
+	spin_unlock(&fc->lock);
+
+	if (fc->ichan_map) {
+		for_each_possible_cpu(cpu)
+			cmpxchg(per_cpu_ptr(fc->ichan_map, cpu), ichan, NULL);
+	}
+
+	/* Lock order: ichan, then fiq; see fuse_unqueue_request() */
+	spin_lock(&ichan->waitq.lock);
+	ichan->alive = 0;
+	spin_lock(&fiq->waitq.lock);
+	list_for_each_entry(req, &ichan->pending, list)
+		req->ichan = NULL;
+	/* fuse_abort_conn() no longer sees this channel */
+	if (fiq->connected)
+		list_splice_tail_init(&ichan->pending, &fiq->pending);
+	else
+		list_splice_init(&ichan->pending, &to_end);
+	spin_unlock(&fiq->waitq.lock);
+	spin_unlock(&ichan->waitq.lock);
+
+	end_requests(fc, &to_end);
+	fuse_kick_reader(fc, NULL);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2264,6 +2493,16 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EFAULT;
+		if (!copy_from_user(&pto, (void __user *) arg, sizeof(pto))) {
+			err = -EINVAL;
+			if (fud && !pto.flags)
+				err = fuse_passthrough_open(fud, pto.fd);
+		}
 	}
 	return err;
 }
@@ -23,6 +23,9 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 #include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/idr.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -124,6 +127,14 @@ enum {
 
 struct fuse_conn;
 
+/** Backing file that read, write and mmap are passed through to */
+struct fuse_passthrough {
+	struct file *filp;
+
+	/** Credentials of the daemon that registered the file */
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -158,6 +169,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file, if opened with FOPEN_PASSTHROUGH */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -309,6 +323,9 @@ struct fuse_req {
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
+	/** Input channel the request is pending on, NULL for fc->iq */
+	struct fuse_ichan *ichan;
+
 	/** refcount */
 	atomic_t count;
 
@@ -393,7 +410,7 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -426,6 +443,28 @@ struct fuse_pqueue {
 	struct list_head io;
 };
 
+/**
+ * Input channel of a fuse device.  Every device, including those made
+ * with FUSE_DEV_IOC_CLONE, has its own, so that server threads reading
+ * different devices don't all serialize on fc->iq.  Interrupts, forgets
+ * and requests queued before any channel was used still go to fc->iq.
+ */
+struct fuse_ichan {
+	/** Readers of the device wait here, the lock protects @pending */
+	wait_queue_head_t waitq;
+
+	/** Requests routed to this channel */
+	struct list_head pending;
+
+	/** Cleared when the device goes away */
+	unsigned alive;
+
+	/** Entry on fc->ichans */
+	struct list_head entry;
+
+	struct rcu_head rcu;
+};
+
 /**
  * Fuse device instance
  */
@@ -436,6 +475,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input channel */
+	struct fuse_ichan *ichan;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -614,6 +656,9 @@ struct fuse_conn {
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
+	/** May open replies name a backing file for passthrough? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -655,6 +700,15 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Input channels of the devices (RCU, updated under fc->lock) */
+	struct list_head ichans;
+
+	/** Channel last read from on each CPU, new requests go there */
+	struct fuse_ichan * __percpu *ichan_map;
+
+	/** Backing files registered for passthrough but not yet opened */
+	struct idr passthrough_req;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -843,6 +897,9 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/* Hand requests pending on a device's input channel to the others */
+void fuse_ichan_shutdown(struct fuse_dev *fud);
+
 /**
  * Invalidate inode attributes
  */
@@ -953,4 +1010,13 @@ int fuse_do_setattr(struct inode *inode, struct iattr *attr,
 
 void fuse_set_initialized(struct fuse_conn *fc);
 
+int fuse_passthrough_open(struct fuse_dev *fud, u32 fd);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg, unsigned int flags);
+void fuse_passthrough_release(struct fuse_passthrough *pt);
+void fuse_passthrough_cleanup(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -599,6 +599,8 @@ void fuse_conn_init(struct fuse_conn *fc)
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	INIT_LIST_HEAD(&fc->devices);
+	INIT_LIST_HEAD(&fc->ichans);
+	idr_init(&fc->passthrough_req);
 	atomic_set(&fc->num_waiting, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
@@ -617,6 +619,8 @@ void fuse_conn_put(struct fuse_conn *fc)
 	if (atomic_dec_and_test(&fc->count)) {
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
+		free_percpu(fc->ichan_map);
+		fuse_passthrough_cleanup(fc);
 		fc->release(fc);
 	}
 }
@@ -898,6 +902,11 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_req *req)
 				fc->async_dio = 1;
 			if (arg->flags & FUSE_WRITEBACK_CACHE)
 				fc->writeback_cache = 1;
+			if (arg->flags & FUSE_PASSTHROUGH) {
+				fc->passthrough = 1;
+				/* backing files must not be stacked below us */
+				fc->sb->s_stack_depth = FILESYSTEM_MAX_STACK_DEPTH;
+			}
 			if (arg->time_gran && arg->time_gran <= 1000000000)
 				fc->sb->s_time_gran = arg->time_gran;
 		} else {
@@ -928,7 +937,7 @@ static void fuse_send_init(struct fuse_conn *fc, struct fuse_req *req)
 		FUSE_SPLICE_WRITE | FUSE_SPLICE_MOVE | FUSE_SPLICE_READ |
 		FUSE_FLOCK_LOCKS | FUSE_HAS_IOCTL_DIR | FUSE_AUTO_INVAL_DATA |
 		FUSE_DO_READDIRPLUS | FUSE_READDIRPLUS_AUTO | FUSE_ASYNC_DIO |
-		FUSE_WRITEBACK_CACHE | FUSE_NO_OPEN_SUPPORT;
+		FUSE_WRITEBACK_CACHE | FUSE_NO_OPEN_SUPPORT | FUSE_PASSTHROUGH;
 	req->in.h.opcode = FUSE_INIT;
 	req->in.numargs = 1;
 	req->in.args[0].size = sizeof(*arg);
@@ -994,19 +1003,48 @@ static int fuse_bdi_init(struct fuse_conn *fc, struct super_block *sb)
 
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
 {
+	struct fuse_ichan * __percpu *map = NULL;
+	struct fuse_ichan *ichan;
 	struct fuse_dev *fud;
 
 	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
-	if (fud) {
-		fud->fc = fuse_conn_get(fc);
-		fuse_pqueue_init(&fud->pq);
+	if (!fud)
+		return NULL;
 
-		spin_lock(&fc->lock);
-		list_add_tail(&fud->entry, &fc->devices);
-		spin_unlock(&fc->lock);
+	ichan = kzalloc(sizeof(struct fuse_ichan), GFP_KERNEL);
+	if (!ichan)
+		goto out_free_fud;
+	init_waitqueue_head(&ichan->waitq);
+	INIT_LIST_HEAD(&ichan->pending);
+	ichan->alive = 1;
+
+	if (!fc->ichan_map) {
+		map = alloc_percpu(struct fuse_ichan *);
+		if (!map)
+			goto out_free_ichan;
 	}
 
+	fud->fc = fuse_conn_get(fc);
+	fuse_pqueue_init(&fud->pq);
+	fud->ichan = ichan;
+
+	spin_lock(&fc->lock);
+	if (map && !fc->ichan_map) {
+		fc->ichan_map = map;
+		map = NULL;
+	}
+	list_add_tail(&fud->entry, &fc->devices);
+	list_add_tail_rcu(&ichan->entry, &fc->ichans);
+	spin_unlock(&fc->lock);
+	free_percpu(map);
+
 	return fud;
+
+out_free_ichan:
+	kfree(ichan);
+out_free_fud:
+	kfree(fud);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(fuse_dev_alloc);
 
@@ -1015,11 +1053,14 @@ void fuse_dev_free(struct fuse_dev *fud)
 	struct fuse_conn *fc = fud->fc;
 
 	if (fc) {
+		fuse_ichan_shutdown(fud);
+
 		spin_lock(&fc->lock);
 		list_del(&fud->entry);
 		spin_unlock(&fc->lock);
 
 		fuse_conn_put(fc);
+		kfree_rcu(fud->ichan, rcu);
 	}
 	kfree(fud);
 }
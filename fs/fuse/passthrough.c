@@ -0,0 +1,233 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of read, write and mmap to a backing file supplied by the
+  filesystem daemon.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs_stack.h>
+#include <linux/slab.h>
+#include <linux/cred.h>
+#include <linux/idr.h>
+#include <linux/uio.h>
+
+static void fuse_passthrough_put(struct fuse_passthrough *pt)
+{
+	fput(pt->filp);
+	put_cred(pt->cred);
+}
+
+/*
+ * Register the daemon's open file @fd as a passthrough candidate.  The
+ * returned id is handed back to the kernel in fuse_open_out.passthrough_fh
+ * of the OPEN or CREATE reply that wants to use it.
+ */
+int fuse_passthrough_open(struct fuse_dev *fud, u32 fd)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_passthrough *pt;
+	struct file *filp;
+	int res;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	filp = fget(fd);
+	if (!filp)
+		return -EBADF;
+
+	res = -EINVAL;
+	if (!filp->f_op->read_iter || !filp->f_op->write_iter)
+		goto out_fput;
+
+	/* fuse itself counts as a stacking level once passthrough is on */
+	if (file_inode(filp)->i_sb->s_stack_depth >= FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	res = -ENOMEM;
+	pt = kmalloc(sizeof(*pt), GFP_KERNEL);
+	if (!pt)
+		goto out_fput;
+
+	pt->filp = filp;
+	pt->cred = prepare_creds();
+	if (!pt->cred)
+		goto out_free;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc(&fc->passthrough_req, pt, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (res > 0)
+		return res;
+
+	put_cred(pt->cred);
+out_free:
+	kfree(pt);
+out_fput:
+	fput(filp);
+	return res;
+}
+
+/*
+ * Attach the backing file named by an OPEN/CREATE reply to @ff.  If the id
+ * is unknown or the backing file was not opened with the access the fuse
+ * file needs, the flag is dropped and I/O goes through the daemon as usual.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg, unsigned int flags)
+{
+	struct fuse_passthrough *pt;
+	unsigned int accmode = flags & O_ACCMODE;
+	int id = openarg->passthrough_fh;
+
+	ff->open_flags &= ~FOPEN_PASSTHROUGH;
+	if (!fc->passthrough || id <= 0)
+		return;
+
+	spin_lock(&fc->lock);
+	pt = idr_find(&fc->passthrough_req, id);
+	if (pt)
+		idr_remove(&fc->passthrough_req, id);
+	spin_unlock(&fc->lock);
+	if (!pt)
+		return;
+
+	if ((accmode != O_WRONLY && !(pt->filp->f_mode & FMODE_READ)) ||
+	    (accmode != O_RDONLY && !(pt->filp->f_mode & FMODE_WRITE))) {
+		fuse_passthrough_put(pt);
+		kfree(pt);
+		return;
+	}
+
+	ff->passthrough = *pt;
+	kfree(pt);
+	ff->open_flags |= FOPEN_PASSTHROUGH;
+	/* page cache and direct_io handling are both the backing file's job */
+	ff->open_flags &= ~FOPEN_DIRECT_IO;
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *pt)
+{
+	if (pt->filp) {
+		fuse_passthrough_put(pt);
+		pt->filp = NULL;
+	}
+}
+
+static int fuse_passthrough_free_req(int id, void *p, void *data)
+{
+	fuse_passthrough_put(p);
+	kfree(p);
+	return 0;
+}
+
+/* Drop backing files that were registered but never claimed by an open */
+void fuse_passthrough_cleanup(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_req, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(backing, to, &iocb->ki_pos);
+	revert_creds(old_cred);
+
+	fsstack_copy_attr_atime(file_inode(file), file_inode(backing));
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	struct inode *backing_inode = file_inode(backing);
+	const struct cred *old_cred;
+	loff_t pos;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	mutex_lock(&inode->i_mutex);
+	if (iocb->ki_flags & IOCB_APPEND)
+		iocb->ki_pos = i_size_read(backing_inode);
+	pos = iocb->ki_pos;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, from, &iocb->ki_pos);
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		fsstack_copy_inode_size(inode, backing_inode);
+		fsstack_copy_attr_times(inode, backing_inode);
+		/* pages cached by non-passthrough opens are now stale */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					pos >> PAGE_CACHE_SHIFT,
+					(iocb->ki_pos - 1) >> PAGE_CACHE_SHIFT);
+		fuse_invalidate_attr(inode);
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	if (ret > 0 && ((file->f_flags & O_DSYNC) || IS_SYNC(inode))) {
+		int err = vfs_fsync_range(backing, pos, pos + ret - 1,
+					  (file->f_flags & __O_SYNC) ? 0 : 1);
+		if (err)
+			ret = err;
+	}
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = backing->f_op->mmap(backing, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* mmap_region() still owns the reference on the fuse file */
+		vma->vm_file = file;
+		fput(backing);
+	} else {
+		fput(file);
+	}
+
+	fsstack_copy_attr_atime(file_inode(file), file_inode(backing));
+	return ret;
+}
@@ -35,6 +35,7 @@
 #include <linux/list_sort.h>
 #include <linux/lockref.h>
 #include <linux/rhashtable.h>
+#include <linux/list_lru.h>
 
 #include "gfs2.h"
 #include "incore.h"
@@ -64,9 +65,12 @@ static void do_xmote(struct gfs2_glock *gl, struct gfs2_holder *gh, unsigned int
 static struct dentry *gfs2_root;
 static struct workqueue_struct *glock_workqueue;
 struct workqueue_struct *gfs2_delete_workqueue;
-static LIST_HEAD(lru_list);
-static atomic_t lru_count = ATOMIC_INIT(0);
-static DEFINE_SPINLOCK(lru_lock);
+
+/*
+ * Lock order: gl_lockref.lock -> lru lock.  GLF_LRU is set exactly when
+ * the glock is on gfs2_glock_lru and only changes under gl_lockref.lock.
+ */
+static struct list_lru gfs2_glock_lru;
 
 #define GFS2_GL_HASH_SHIFT      15
 #define GFS2_GL_HASH_SIZE       (1 << GFS2_GL_HASH_SHIFT)
@@ -80,9 +84,9 @@ static struct rhashtable_params ht_parms = {
 
 static struct rhashtable gl_hash_table;
 
-void gfs2_glock_free(struct gfs2_glock *gl)
+static void gfs2_glock_dealloc(struct rcu_head *rcu)
 {
-	struct gfs2_sbd *sdp = gl->gl_name.ln_sbd;
+	struct gfs2_glock *gl = container_of(rcu, struct gfs2_glock, gl_rcu);
 
 	if (gl->gl_ops->go_flags & GLOF_ASPACE) {
 		kmem_cache_free(gfs2_glock_aspace_cachep, gl);
@@ -90,6 +94,17 @@ void gfs2_glock_free(struct gfs2_glock *gl)
 		kfree(gl->gl_lksb.sb_lvbptr);
 		kmem_cache_free(gfs2_glock_cachep, gl);
 	}
+}
+
+/*
+ * Lookups find glocks under rcu_read_lock() and then try to take a
+ * reference, so the memory must stay around until they are done.
+ */
+void gfs2_glock_free(struct gfs2_glock *gl)
+{
+	struct gfs2_sbd *sdp = gl->gl_name.ln_sbd;
+
+	call_rcu(&gl->gl_rcu, gfs2_glock_dealloc);
 	if (atomic_dec_and_test(&sdp->sd_glock_disposal))
 		wake_up(&sdp->sd_glock_wait);
 }
@@ -127,29 +142,33 @@ static int demote_ok(const struct gfs2_glock *gl)
 }
 
 
-void gfs2_glock_add_to_lru(struct gfs2_glock *gl)
+/*
+ * Must be called under gl_lockref.lock.  A glock that the shrinker has
+ * already taken off the LRU for disposal is left to the shrinker.
+ */
+static void __gfs2_glock_add_to_lru(struct gfs2_glock *gl)
 {
-	spin_lock(&lru_lock);
+	if (test_bit(GLF_LRU, &gl->gl_flags))
+		list_lru_del(&gfs2_glock_lru, &gl->gl_lru);
 
-	if (!list_empty(&gl->gl_lru))
-		list_del_init(&gl->gl_lru);
+	if (list_lru_add(&gfs2_glock_lru, &gl->gl_lru))
+		set_bit(GLF_LRU, &gl->gl_flags);
 	else
-		atomic_inc(&lru_count);
+		clear_bit(GLF_LRU, &gl->gl_flags);
+}
 
-	list_add_tail(&gl->gl_lru, &lru_list);
-	set_bit(GLF_LRU, &gl->gl_flags);
-	spin_unlock(&lru_lock);
+void gfs2_glock_add_to_lru(struct gfs2_glock *gl)
+{
+	spin_lock(&gl->gl_lockref.lock);
+	__gfs2_glock_add_to_lru(gl);
+	spin_unlock(&gl->gl_lockref.lock);
 }
 
-static void gfs2_glock_remove_from_lru(struct gfs2_glock *gl)
+/* Must be called under gl_lockref.lock */
+static void __gfs2_glock_remove_from_lru(struct gfs2_glock *gl)
 {
-	spin_lock(&lru_lock);
-	if (!list_empty(&gl->gl_lru)) {
-		list_del_init(&gl->gl_lru);
-		atomic_dec(&lru_count);
-		clear_bit(GLF_LRU, &gl->gl_flags);
-	}
-	spin_unlock(&lru_lock);
+	if (test_and_clear_bit(GLF_LRU, &gl->gl_flags))
+		list_lru_del(&gfs2_glock_lru, &gl->gl_lru);
 }
 
 /**
@@ -168,7 +187,7 @@ void gfs2_glock_put(struct gfs2_glock *gl)
 
 	lockref_mark_dead(&gl->gl_lockref);
 
-	gfs2_glock_remove_from_lru(gl);
+	__gfs2_glock_remove_from_lru(gl);
 	spin_unlock(&gl->gl_lockref.lock);
 	rhashtable_remove_fast(&gl_hash_table, &gl->gl_node, ht_parms);
 	GLOCK_BUG_ON(gl, !list_empty(&gl->gl_holders));
@@ -651,9 +670,11 @@ int gfs2_glock_get(struct gfs2_sbd *sdp, u64 number,
 	struct kmem_cache *cachep;
 	int ret, tries = 0;
 
+	rcu_read_lock();
 	gl = rhashtable_lookup_fast(&gl_hash_table, &name, ht_parms);
 	if (gl && !lockref_get_not_dead(&gl->gl_lockref))
 		gl = NULL;
+	rcu_read_unlock();
 
 	*glp = gl;
 	if (gl)
@@ -721,8 +742,12 @@ again:
 
 	if (ret == -EEXIST) {
 		ret = 0;
+		rcu_read_lock();
 		tmp = rhashtable_lookup_fast(&gl_hash_table, &name, ht_parms);
-		if (tmp == NULL || !lockref_get_not_dead(&tmp->gl_lockref)) {
+		if (tmp && !lockref_get_not_dead(&tmp->gl_lockref))
+			tmp = NULL;
+		rcu_read_unlock();
+		if (tmp == NULL) {
 			if (++tries < 100) {
 				cond_resched();
 				goto again;
@@ -964,10 +989,8 @@ int gfs2_glock_nq(struct gfs2_holder *gh)
 	if (unlikely(test_bit(SDF_SHUTDOWN, &sdp->sd_flags)))
 		return -EIO;
 
-	if (test_bit(GLF_LRU, &gl->gl_flags))
-		gfs2_glock_remove_from_lru(gl);
-
 	spin_lock(&gl->gl_lockref.lock);
+	__gfs2_glock_remove_from_lru(gl);
 	add_to_queue(gh);
 	if (unlikely((LM_FLAG_NOEXP & gh->gh_flags) &&
 		     test_and_clear_bit(GLF_FROZEN, &gl->gl_flags))) {
@@ -1030,7 +1053,7 @@ void gfs2_glock_dq(struct gfs2_holder *gh)
 	}
 	if (!test_bit(GLF_LFLUSH, &gl->gl_flags) && demote_ok(gl) &&
 	    (glops->go_flags & GLOF_LRU))
-		gfs2_glock_add_to_lru(gl);
+		__gfs2_glock_add_to_lru(gl);
 
 	trace_gfs2_glock_queue(gh, 0);
 	spin_unlock(&gl->gl_lockref.lock);
@@ -1309,15 +1332,11 @@ static int glock_cmp(void *priv, struct list_head *a, struct list_head *b)
  * the glocks by number (i.e. disk location of the inodes) so that if
  * there are any such accesses, they'll be sent in order (mostly).
  *
- * Must be called under the lru_lock, but may drop and retake this
- * lock. While the lru_lock is dropped, entries may vanish from the
- * list, but no new entries will appear on the list (since it is
- * private)
+ * The list is private and each glock on it holds a reference taken by
+ * gfs2_glock_isolate(), so no lru lock is needed here.
  */
 
 static void gfs2_dispose_glock_lru(struct list_head *list)
-__releases(&lru_lock)
-__acquires(&lru_lock)
 {
 	struct gfs2_glock *gl;
 
@@ -1325,85 +1344,92 @@ __acquires(&lru_lock)
 
 	while(!list_empty(list)) {
 		gl = list_entry(list->next, struct gfs2_glock, gl_lru);
+		spin_lock(&gl->gl_lockref.lock);
 		list_del_init(&gl->gl_lru);
-		if (!spin_trylock(&gl->gl_lockref.lock)) {
-add_back_to_lru:
-			list_add(&gl->gl_lru, &lru_list);
-			atomic_inc(&lru_count);
-			continue;
-		}
 		if (test_and_set_bit(GLF_LOCK, &gl->gl_flags)) {
+			/* Busy again since it was isolated, keep it cached */
+			__gfs2_glock_add_to_lru(gl);
 			spin_unlock(&gl->gl_lockref.lock);
-			goto add_back_to_lru;
+			gfs2_glock_put(gl);
+			continue;
 		}
-		clear_bit(GLF_LRU, &gl->gl_flags);
-		gl->gl_lockref.count++;
 		if (demote_ok(gl))
 			handle_callback(gl, LM_ST_UNLOCKED, 0, false);
 		WARN_ON(!test_and_clear_bit(GLF_LOCK, &gl->gl_flags));
-		if (queue_delayed_work(glock_workqueue, &gl->gl_work, 0) == 0)
-			gl->gl_lockref.count--;
-		spin_unlock(&gl->gl_lockref.lock);
-		cond_resched_lock(&lru_lock);
+		if (queue_delayed_work(glock_workqueue, &gl->gl_work, 0)) {
+			/* The work inherits our reference */
+			spin_unlock(&gl->gl_lockref.lock);
+		} else {
+			spin_unlock(&gl->gl_lockref.lock);
+			gfs2_glock_put(gl);
+		}
+		cond_resched();
 	}
 }
 
-/**
- * gfs2_scan_glock_lru - Scan the LRU looking for locks to demote
- * @nr: The number of entries to scan
- *
- * This function selects the entries on the LRU which are able to
- * be demoted, and then kicks off the process by calling
- * gfs2_dispose_glock_lru() above.
+/*
+ * Called with the lru lock of one node held.  The lock order is the
+ * other way round, so the glock can only be trylocked here; glocks that
+ * are busy are left where they are for the next scan.
  */
-
-static long gfs2_scan_glock_lru(int nr)
+static enum lru_status gfs2_glock_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
-	struct gfs2_glock *gl;
-	LIST_HEAD(skipped);
-	LIST_HEAD(dispose);
-	long freed = 0;
-
-	spin_lock(&lru_lock);
-	while ((nr-- >= 0) && !list_empty(&lru_list)) {
-		gl = list_entry(lru_list.next, struct gfs2_glock, gl_lru);
+	struct list_head *dispose = arg;
+	struct gfs2_glock *gl = list_entry(item, struct gfs2_glock, gl_lru);
 
-		/* Test for being demotable */
-		if (!test_bit(GLF_LOCK, &gl->gl_flags)) {
-			list_move(&gl->gl_lru, &dispose);
-			atomic_dec(&lru_count);
-			freed++;
-			continue;
-		}
+	if (!spin_trylock(&gl->gl_lockref.lock))
+		return LRU_SKIP;
 
-		list_move(&gl->gl_lru, &skipped);
+	/* Test for being demotable */
+	if (test_bit(GLF_LOCK, &gl->gl_flags)) {
+		spin_unlock(&gl->gl_lockref.lock);
+		return LRU_SKIP;
 	}
-	list_splice(&skipped, &lru_list);
-	if (!list_empty(&dispose))
-		gfs2_dispose_glock_lru(&dispose);
-	spin_unlock(&lru_lock);
 
-	return freed;
+	list_lru_isolate_move(lru, &gl->gl_lru, dispose);
+	clear_bit(GLF_LRU, &gl->gl_flags);
+	gl->gl_lockref.count++;
+	spin_unlock(&gl->gl_lockref.lock);
+	return LRU_REMOVED;
 }
 
+/**
+ * gfs2_glock_shrink_scan - Scan the LRU looking for locks to demote
+ *
+ * The LRU is split per NUMA node, so reclaim on one node only contends
+ * with glocks being cached and used on that node.  The demotable
+ * entries are collected first and then handed to gfs2_dispose_glock_lru()
+ * in one sorted batch.
+ */
+
 static unsigned long gfs2_glock_shrink_scan(struct shrinker *shrink,
 					    struct shrink_control *sc)
 {
+	LIST_HEAD(dispose);
+	unsigned long freed;
+
 	if (!(sc->gfp_mask & __GFP_FS))
 		return SHRINK_STOP;
-	return gfs2_scan_glock_lru(sc->nr_to_scan);
+
+	freed = list_lru_shrink_walk(&gfs2_glock_lru, sc,
+				     gfs2_glock_isolate, &dispose);
+	gfs2_dispose_glock_lru(&dispose);
+
+	return freed;
 }
 
 static unsigned long gfs2_glock_shrink_count(struct shrinker *shrink,
 					     struct shrink_control *sc)
 {
-	return vfs_pressure_ratio(atomic_read(&lru_count));
+	return vfs_pressure_ratio(list_lru_shrink_count(&gfs2_glock_lru, sc));
 }
 
 static struct shrinker glock_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 	.count_objects = gfs2_glock_shrink_count,
 	.scan_objects = gfs2_glock_shrink_scan,
+	.flags = SHRINKER_NUMA_AWARE,
 };
 
 /**
@@ -1459,9 +1485,8 @@ out:
 
 static void clear_glock(struct gfs2_glock *gl)
 {
-	gfs2_glock_remove_from_lru(gl);
-
 	spin_lock(&gl->gl_lockref.lock);
+	__gfs2_glock_remove_from_lru(gl);
 	if (gl->gl_state != LM_ST_UNLOCKED)
 		handle_callback(gl, LM_ST_UNLOCKED, 0, false);
 	spin_unlock(&gl->gl_lockref.lock);
@@ -1756,9 +1781,16 @@ int __init gfs2_glock_init(void)
 	if (ret < 0)
 		return ret;
 
+	ret = list_lru_init(&gfs2_glock_lru);
+	if (ret) {
+		rhashtable_destroy(&gl_hash_table);
+		return ret;
+	}
+
 	glock_workqueue = alloc_workqueue("glock_workqueue", WQ_MEM_RECLAIM |
 					  WQ_HIGHPRI | WQ_FREEZABLE, 0);
 	if (!glock_workqueue) {
+		list_lru_destroy(&gfs2_glock_lru);
 		rhashtable_destroy(&gl_hash_table);
 		return -ENOMEM;
 	}
@@ -1767,6 +1799,7 @@ int __init gfs2_glock_init(void)
 						0);
 	if (!gfs2_delete_workqueue) {
 		destroy_workqueue(glock_workqueue);
+		list_lru_destroy(&gfs2_glock_lru);
 		rhashtable_destroy(&gl_hash_table);
 		return -ENOMEM;
 	}
@@ -1782,6 +1815,7 @@ void gfs2_glock_exit(void)
 	rhashtable_destroy(&gl_hash_table);
 	destroy_workqueue(glock_workqueue);
 	destroy_workqueue(gfs2_delete_workqueue);
+	list_lru_destroy(&gfs2_glock_lru);
 }
 
 static void gfs2_glock_iter_next(struct gfs2_glock_iter *gi)
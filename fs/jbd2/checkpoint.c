@@ -23,6 +23,9 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/sort.h>
 #include <trace/events/jbd2.h>
 
 /*
@@ -111,10 +114,13 @@ static int __try_to_free_cp_buf(struct journal_head *jh)
 void __jbd2_log_wait_for_space(journal_t *journal)
 {
 	int nblocks, space_left;
+	unsigned long stall_start = 0;
 	/* assert_spin_locked(&journal->j_state_lock); */
 
 	nblocks = jbd2_space_needed(journal);
 	while (jbd2_log_space_left(journal) < nblocks) {
+		if (!stall_start)
+			stall_start = jiffies;
 		write_unlock(&journal->j_state_lock);
 		mutex_lock(&journal->j_checkpoint_mutex);
 
@@ -176,6 +182,24 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 		}
 		mutex_unlock(&journal->j_checkpoint_mutex);
 	}
+
+	if (stall_start) {
+		spin_lock(&journal->j_history_lock);
+		journal->j_stats.ts_checkpoint_stalls++;
+		journal->j_stats.ts_checkpoint_stall_time +=
+			jbd2_time_diff(stall_start, jiffies);
+		spin_unlock(&journal->j_history_lock);
+	}
+}
+
+static int cmp_chkpt_bh(const void *a, const void *b)
+{
+	sector_t blk_a = (*(struct buffer_head **)a)->b_blocknr;
+	sector_t blk_b = (*(struct buffer_head **)b)->b_blocknr;
+
+	if (blk_a < blk_b)
+		return -1;
+	return blk_a > blk_b;
 }
 
 static void
@@ -184,6 +208,9 @@ __flush_batch(journal_t *journal, int *batch_count)
 	int i;
 	struct blk_plug plug;
 
+	/* buffers come in list order; hand them to the disk in block order */
+	sort(journal->j_chkpt_bhs, *batch_count, sizeof(struct buffer_head *),
+	     cmp_chkpt_bh, NULL);
 	blk_start_plug(&plug);
 	for (i = 0; i < *batch_count; i++)
 		write_dirty_buffer(journal->j_chkpt_bhs[i], WRITE_SYNC);
@@ -366,6 +393,94 @@ out:
 	return (result < 0) ? result : 0;
 }
 
+/*
+ * Is the log full enough that the checkpoint thread should write back
+ * old transactions?  Only a hint, so no locks are taken for the list.
+ */
+static bool jbd2_checkpoint_wanted(journal_t *journal)
+{
+	unsigned long size, used;
+
+	if (!journal->j_checkpoint_watermark || is_journal_aborted(journal) ||
+	    !journal->j_checkpoint_transactions)
+		return false;
+
+	read_lock(&journal->j_state_lock);
+	size = journal->j_last - journal->j_first;
+	used = size - journal->j_free;
+	read_unlock(&journal->j_state_lock);
+
+	return used * 100 >= size * journal->j_checkpoint_watermark;
+}
+
+/*
+ * Kick the checkpoint thread if the log has filled up past the watermark.
+ * Called after every commit, which is the only thing that uses up log space.
+ */
+void jbd2_log_checkpoint_wakeup(journal_t *journal)
+{
+	if (journal->j_checkpoint_task && jbd2_checkpoint_wanted(journal))
+		wake_up(&journal->j_wait_checkpoint);
+}
+
+/*
+ * jbd2_checkpoint_thread: write back checkpoint buffers in the background.
+ *
+ * Without it the handle that runs out of log space does the checkpoint
+ * itself in __jbd2_log_wait_for_space() while every other handle queues
+ * up behind it.  Starting early keeps the log below the point where that
+ * happens.  j_checkpoint_mutex is dropped after each transaction so that
+ * a handle which does run short still gets in quickly.
+ */
+static int jbd2_checkpoint_thread(void *arg)
+{
+	journal_t *journal = arg;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable(journal->j_wait_checkpoint,
+				     kthread_should_stop() ||
+				     jbd2_checkpoint_wanted(journal));
+
+		while (!kthread_should_stop() &&
+		       jbd2_checkpoint_wanted(journal)) {
+			int err;
+
+			mutex_lock(&journal->j_checkpoint_mutex);
+			err = jbd2_log_do_checkpoint(journal);
+			mutex_unlock(&journal->j_checkpoint_mutex);
+			if (err < 0)
+				break;
+			cond_resched();
+		}
+	}
+	jbd_debug(1, "Checkpoint thread exiting.\n");
+	return 0;
+}
+
+int jbd2_checkpoint_start_thread(journal_t *journal)
+{
+	struct task_struct *t;
+
+	if (!journal->j_checkpoint_watermark)
+		return 0;
+
+	t = kthread_run(jbd2_checkpoint_thread, journal, "jbd2-ckpt/%s",
+			journal->j_devname);
+	if (IS_ERR(t))
+		return PTR_ERR(t);
+	journal->j_checkpoint_task = t;
+	return 0;
+}
+
+void jbd2_checkpoint_stop_thread(journal_t *journal)
+{
+	if (journal->j_checkpoint_task) {
+		kthread_stop(journal->j_checkpoint_task);
+		journal->j_checkpoint_task = NULL;
+	}
+}
+
 /*
  * Check the list of checkpoint transactions for the journal to see if
  * we have already got rid of any since the last update of the log tail
@@ -58,6 +58,11 @@ module_param_named(jbd2_debug, jbd2_journal_enable_debug, ushort, 0644);
 MODULE_PARM_DESC(jbd2_debug, "Debugging level for jbd2");
 #endif
 
+static unsigned int jbd2_checkpoint_watermark = 50;
+module_param_named(checkpoint_watermark, jbd2_checkpoint_watermark, uint, 0644);
+MODULE_PARM_DESC(checkpoint_watermark,
+		 "Percentage of the log in use at which background checkpointing starts (0 disables it)");
+
 EXPORT_SYMBOL(jbd2_journal_extend);
 EXPORT_SYMBOL(jbd2_journal_stop);
 EXPORT_SYMBOL(jbd2_journal_lock_updates);
@@ -94,6 +99,13 @@ EXPORT_SYMBOL(jbd2_journal_blocks_per_page);
 EXPORT_SYMBOL(jbd2_journal_invalidatepage);
 EXPORT_SYMBOL(jbd2_journal_try_to_free_buffers);
 EXPORT_SYMBOL(jbd2_journal_force_commit);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+EXPORT_SYMBOL(jbd2_fc_release_bufs);
+EXPORT_SYMBOL(jbd2_fc_read_block);
 EXPORT_SYMBOL(jbd2_journal_file_inode);
 EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
@@ -102,6 +114,7 @@ EXPORT_SYMBOL(jbd2_inode_cache);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
 static int jbd2_journal_create_slab(size_t slab_size);
+static int jbd2_write_superblock(journal_t *journal, int write_op);
 
 #ifdef CONFIG_JBD2_DEBUG
 void __jbd2_debug(int level, const char *file, const char *func,
@@ -293,11 +306,18 @@ static int jbd2_journal_start_thread(journal_t *journal)
 		return PTR_ERR(t);
 
 	wait_event(journal->j_wait_done_commit, journal->j_task != NULL);
+
+	/* handles still checkpoint for themselves without the thread */
+	if (jbd2_checkpoint_start_thread(journal))
+		printk(KERN_WARNING "JBD2: %s: unable to start checkpoint "
+		       "thread\n", journal->j_devname);
 	return 0;
 }
 
 static void journal_kill_thread(journal_t *journal)
 {
+	jbd2_checkpoint_stop_thread(journal);
+
 	write_lock(&journal->j_state_lock);
 	journal->j_flags |= JBD2_UNMOUNT;
 
@@ -827,6 +847,207 @@ struct buffer_head *jbd2_journal_get_descriptor_buffer(journal_t *journal)
 	return bh;
 }
 
+/*
+ * Fast commits
+ *
+ * A fast commit writes a filesystem-defined record of what changed in the
+ * running transaction to the fast commit area, instead of committing the
+ * whole transaction to the log.  Fast and full commits exclude each other;
+ * a full commit makes every earlier fast commit obsolete, so the area is
+ * reused from its start after each one.  Recovery only finds out which
+ * transaction the area may belong to (j_fc_replay_tid): validating and
+ * replaying its contents is up to the filesystem.
+ */
+
+/*
+ * The last blocks of a journal with fast commits are set aside for them
+ * and taken off the end of the log.
+ */
+static void journal_fc_reserve(journal_t *journal)
+{
+	if (!jbd2_has_feature_fast_commit(journal))
+		return;
+
+	journal->j_fc_last = journal->j_last;
+	journal->j_last -= jbd2_journal_get_num_fc_blks(journal->j_superblock);
+	journal->j_fc_first = journal->j_last;
+}
+
+/**
+ * int jbd2_fc_init() - Enable fast commits on a journal
+ * @journal: Journal to act on, loaded and not yet in use.
+ * @num_fc_blks: Size of the fast commit area if it has to be created.
+ *
+ * If the journal does not have a fast commit area yet it is carved off the
+ * end of the (empty) log and the superblock is written out, so recovery
+ * knows about the area before anything is written to it.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err;
+
+	if (!jbd2_has_feature_fast_commit(journal)) {
+		if (!jbd2_journal_check_available_features(journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT) ||
+		    journal->j_last - journal->j_first <
+		    JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks)
+			return -EINVAL;
+
+		write_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_head != journal->j_tail) {
+			write_unlock(&journal->j_state_lock);
+			return -EBUSY;
+		}
+		sb->s_num_fc_blks = cpu_to_be32(num_fc_blks);
+		jbd2_set_feature_fast_commit(journal);
+		journal_fc_reserve(journal);
+		journal->j_free = journal->j_last - journal->j_first;
+		write_unlock(&journal->j_state_lock);
+
+		mutex_lock(&journal->j_checkpoint_mutex);
+		err = jbd2_write_superblock(journal, WRITE_FUA);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+		if (err)
+			return err;
+	}
+
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kcalloc(journal->j_fc_last -
+					     journal->j_fc_first,
+					     sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+/**
+ * int jbd2_fc_begin_commit() - Start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit is for.
+ *
+ * Waits for any fast or full commit in progress.  Returns -EALREADY if
+ * @tid is no longer the running transaction or somebody already asked for
+ * it to be committed in full: waiting for that commit is all the caller
+ * can do then.  On success the caller must call jbd2_fc_end_commit().
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (is_journal_aborted(journal))
+		return -EIO;
+	if (!journal->j_fc_wbuf)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	while (journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+				   JBD2_FULL_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	if (!journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid ||
+	    journal->j_commit_request == tid) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/*
+ * Get a buffer for the next fast commit block.  Returns -ENOSPC once the
+ * area is full; a full commit is needed to make room again.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bhp)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int err;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal,
+				journal->j_fc_first + journal->j_fc_off, &pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	*bhp = bh;
+	return 0;
+}
+
+/*
+ * Wait for the last @num_blks fast commit blocks to be written and release
+ * them.  If any of them failed they are given back, so that the next fast
+ * commit overwrites them rather than landing behind a broken one.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	unsigned long i, off = journal->j_fc_off;
+	struct buffer_head *bh;
+	int err = 0;
+
+	for (i = off - num_blks; i < off; i++) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+	if (err)
+		journal->j_fc_off -= num_blks;
+	return err;
+}
+
+/* Give back the last @num_blks fast commit blocks without writing them */
+void jbd2_fc_release_bufs(journal_t *journal, int num_blks)
+{
+	unsigned long i, off = journal->j_fc_off;
+
+	for (i = off - num_blks; i < off; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+	journal->j_fc_off -= num_blks;
+}
+
+/* Read block @off of the fast commit area, for replay */
+struct buffer_head *jbd2_fc_read_block(journal_t *journal, unsigned long off)
+{
+	unsigned long long pblock;
+
+	if (journal->j_fc_first + off >= journal->j_fc_last)
+		return NULL;
+	if (jbd2_journal_bmap(journal, journal->j_fc_first + off, &pblock))
+		return NULL;
+	return __bread(journal->j_dev, pblock, journal->j_blocksize);
+}
+
 /*
  * Return tid of the oldest transaction in the journal and block in the journal
  * where the transaction starts.
@@ -953,6 +1174,9 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 		   "each up to %u blocks\n",
 		   s->stats->ts_tid, s->stats->ts_requested,
 		   s->journal->j_max_transaction_buffers);
+	seq_printf(seq, "%lu checkpoint stalls, %ums stalled in total\n",
+		   s->stats->ts_checkpoint_stalls,
+		   jiffies_to_msecs(s->stats->ts_checkpoint_stall_time));
 	if (s->stats->ts_tid == 0)
 		return 0;
 	seq_printf(seq, "average: \n  %ums waiting for transaction\n",
@@ -1080,6 +1304,8 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
+	init_waitqueue_head(&journal->j_wait_checkpoint);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1089,6 +1315,7 @@ static journal_t * journal_init_common (void)
 	journal->j_commit_interval = (HZ * JBD2_DEFAULT_MAX_COMMIT_AGE);
 	journal->j_min_batch_time = 0;
 	journal->j_max_batch_time = 15000; /* 15ms */
+	journal->j_checkpoint_watermark = min(jbd2_checkpoint_watermark, 100U);
 	atomic_set(&journal->j_reserved_credits, 0);
 
 	/* The journal is marked for error until we succeed with recovery! */
@@ -1282,10 +1509,11 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	journal_fc_reserve(journal);
 
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
@@ -1524,6 +1752,15 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (jbd2_has_feature_fast_commit(journal) &&
+	    be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS +
+	    jbd2_journal_get_num_fc_blks(sb) > journal->j_maxlen) {
+		printk(KERN_WARNING
+			"JBD2: Journal too short for %u fast commit blocks\n",
+			jbd2_journal_get_num_fc_blks(sb));
+		goto out;
+	}
+
 	if (jbd2_has_feature_csum2(journal) &&
 	    jbd2_has_feature_csum3(journal)) {
 		/* Can't have checksum v2 and v3 at the same time! */
@@ -1597,6 +1834,7 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal_fc_reserve(journal);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
@@ -1737,6 +1975,7 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 
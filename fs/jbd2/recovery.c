@@ -265,6 +265,7 @@ int jbd2_journal_recover(journal_t *journal)
 		jbd_debug(1, "No recovery required, last transaction %d\n",
 			  be32_to_cpu(sb->s_sequence));
 		journal->j_transaction_sequence = be32_to_cpu(sb->s_sequence) + 1;
+		journal->j_fc_replay_tid = be32_to_cpu(sb->s_sequence);
 		return 0;
 	}
 
@@ -280,6 +281,10 @@ int jbd2_journal_recover(journal_t *journal)
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
 
+	/* Fast commits can only be valid for the transaction that did not
+	 * make it to the log. */
+	journal->j_fc_replay_tid = info.end_transaction;
+
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
@@ -846,6 +846,61 @@ static const struct nfs_pgio_completion_ops nfs_direct_write_completion_ops = {
 };
 
 
+/*
+ * Pinned user pages can only be coalesced into one WRITE where they meet
+ * on page boundaries, so a vector of small, unaligned segments (typical
+ * of database log writes) goes out as one RPC per segment.  For those,
+ * copying the data into private pages is much cheaper than the extra
+ * round trips.
+ */
+static bool nfs_direct_write_want_bounce(struct iov_iter *iter, size_t wsize)
+{
+	if (!iter_is_iovec(iter) || iter->nr_segs < 2)
+		return false;
+	if (!(iov_iter_alignment(iter) & ~PAGE_MASK))
+		return false;
+	return iov_iter_count(iter) / iter->nr_segs < wsize;
+}
+
+/*
+ * Copy up to a page of user data into a private page and queue it.
+ * Returns the number of bytes queued or a negative errno.
+ */
+static ssize_t nfs_direct_write_bounce_page(struct nfs_direct_req *dreq,
+					    struct nfs_pageio_descriptor *desc,
+					    struct iov_iter *iter,
+					    loff_t pos)
+{
+	size_t len = min_t(size_t, iov_iter_count(iter), PAGE_SIZE);
+	struct nfs_page *req;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+	if (copy_page_from_iter(page, 0, len, iter) != len) {
+		put_page(page);
+		return -EFAULT;
+	}
+
+	req = nfs_create_request(dreq->ctx, page, NULL, 0, len);
+	/* the request holds its own reference to the page */
+	put_page(page);
+	if (IS_ERR(req))
+		return PTR_ERR(req);
+
+	nfs_direct_setup_mirroring(dreq, desc, req);
+
+	nfs_lock_request(req);
+	req->wb_index = pos >> PAGE_SHIFT;
+	req->wb_offset = pos & ~PAGE_MASK;
+	if (!nfs_pageio_add_request(desc, req)) {
+		nfs_unlock_and_release_request(req);
+		return desc->pg_error;
+	}
+	return len;
+}
+
 /*
  * NB: Return the value of the first error return code.  Subsequent
  *     errors after the first one are ignored.
@@ -866,6 +921,7 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 	ssize_t result = 0;
 	size_t requested_bytes = 0;
 	size_t wsize = max_t(size_t, NFS_SERVER(inode)->wsize, PAGE_SIZE);
+	bool bounce = nfs_direct_write_want_bounce(iter, wsize);
 
 	nfs_pageio_init_write(&desc, inode, FLUSH_COND_STABLE, false,
 			      &nfs_direct_write_completion_ops);
@@ -880,6 +936,17 @@ static ssize_t nfs_direct_write_schedule_iovec(struct nfs_direct_req *dreq,
 		size_t pgbase;
 		unsigned npages, i;
 
+		if (bounce) {
+			result = nfs_direct_write_bounce_page(dreq, &desc,
+							      iter, pos);
+			if (result <= 0)
+				break;
+			requested_bytes += result;
+			pos += result;
+			dreq->bytes_left -= result;
+			continue;
+		}
+
 		result = iov_iter_get_pages_alloc(iter, &pagevec, 
 						  wsize, &pgbase);
 		if (result < 0)
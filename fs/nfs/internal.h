@@ -64,6 +64,11 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_READDIR_PAGES 8
 
+/*
+ * Upper limit for the nconnect mount option.
+ */
+#define NFS_MAX_CONNECTIONS 16
+
 struct nfs_client_initdata {
 	unsigned long init_flags;
 	const char *hostname;
@@ -72,6 +77,7 @@ struct nfs_client_initdata {
 	struct nfs_subversion *nfs_mod;
 	int proto;
 	u32 minorversion;
+	unsigned int nconnect;
 	struct net *net;
 };
 
@@ -82,6 +88,7 @@ struct nfs_parsed_mount_data {
 	int			flags;
 	unsigned int		rsize, wsize;
 	unsigned int		timeo, retrans;
+	unsigned int		nconnect;
 	unsigned int		acregmin, acregmax,
 				acdirmin, acdirmax;
 	unsigned int		namlen;
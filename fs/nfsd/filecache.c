@@ -0,0 +1,357 @@
+/*
+ * Open file cache.
+ *
+ * NFSv2/v3 and NFSv4 I/O with special stateids carry no open state, so
+ * every READ, WRITE and COMMIT used to open the file, do the I/O and close
+ * it again.  Keep those struct files around instead, keyed by inode and
+ * access mode, and close them once they have sat idle for a while, memory
+ * gets tight or the file is removed through nfsd.
+ */
+
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/file.h>
+#include <linux/workqueue.h>
+
+#include "nfsd.h"
+#include "vfs.h"
+#include "filecache.h"
+
+#define NFSDDBG_FACILITY	NFSDDBG_FH
+
+#define NFSD_FILE_HASH_BITS	9
+#define NFSD_FILE_HASH_SIZE	(1 << NFSD_FILE_HASH_BITS)
+
+/* Entries not used since the previous pass get closed */
+#define NFSD_FILE_LAUNDRETTE_DELAY	(2 * HZ)
+
+/* Only the access mode matters for the struct file we hand out */
+#define NFSD_FILE_MAY_MASK	(NFSD_MAY_READ | NFSD_MAY_WRITE)
+
+struct nfsd_fcache_bucket {
+	struct hlist_head	nfb_head;
+	spinlock_t		nfb_lock;
+};
+
+static struct nfsd_fcache_bucket	*nfsd_file_hashtbl;
+static struct kmem_cache		*nfsd_file_slab;
+static atomic_long_t			nfsd_filecache_count;
+static unsigned int			nfsd_file_prune_cursor;
+
+static void nfsd_file_laundrette(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nfsd_filecache_laundrette, nfsd_file_laundrette);
+
+static void
+nfsd_file_free_rcu(struct rcu_head *rcu)
+{
+	kmem_cache_free(nfsd_file_slab,
+			container_of(rcu, struct nfsd_file, nf_rcu));
+}
+
+static void
+nfsd_file_free(struct nfsd_file *nf)
+{
+	dprintk("%s: closing file %p for inode %p\n", __func__,
+		nf->nf_file, nf->nf_inode);
+	fput(nf->nf_file);
+	/* lockless lookups may still be looking at it */
+	call_rcu(&nf->nf_rcu, nfsd_file_free_rcu);
+}
+
+void
+nfsd_file_put(struct nfsd_file *nf)
+{
+	set_bit(NFSD_FILE_REFERENCED, &nf->nf_flags);
+	if (atomic_dec_and_test(&nf->nf_ref))
+		nfsd_file_free(nf);
+}
+
+/* Called with the bucket lock held */
+static bool
+nfsd_file_unhash(struct nfsd_file *nf)
+{
+	if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+		return false;
+	hlist_del_rcu(&nf->nf_node);
+	atomic_long_dec(&nfsd_filecache_count);
+	return true;
+}
+
+static void
+nfsd_file_dispose_list(struct list_head *dispose)
+{
+	struct nfsd_file *nf, *tmp;
+
+	list_for_each_entry_safe(nf, tmp, dispose, nf_lru) {
+		list_del(&nf->nf_lru);
+		nfsd_file_free(nf);
+	}
+}
+
+/*
+ * Close up to @nr_to_scan idle entries.  An entry is idle when the hash
+ * holds the only reference; with @second_chance an idle entry that was
+ * used since the last pass is only aged rather than closed.
+ */
+static unsigned long
+nfsd_file_prune(unsigned long nr_to_scan, bool second_chance)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf;
+	struct hlist_node *tmp;
+	unsigned long freed = 0;
+	unsigned int i, idx;
+	LIST_HEAD(dispose);
+
+	for (i = 0; i < NFSD_FILE_HASH_SIZE && nr_to_scan; i++) {
+		idx = nfsd_file_prune_cursor++ & (NFSD_FILE_HASH_SIZE - 1);
+		b = &nfsd_file_hashtbl[idx];
+		if (hlist_empty(&b->nfb_head))
+			continue;
+
+		spin_lock(&b->nfb_lock);
+		hlist_for_each_entry_safe(nf, tmp, &b->nfb_head, nf_node) {
+			if (!nr_to_scan)
+				break;
+			nr_to_scan--;
+			if (atomic_read(&nf->nf_ref) > 1)
+				continue;
+			if (second_chance &&
+			    test_and_clear_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
+				continue;
+			/* lookups take a reference with atomic_inc_not_zero */
+			if (atomic_cmpxchg(&nf->nf_ref, 1, 0) != 1)
+				continue;
+			nfsd_file_unhash(nf);
+			list_add(&nf->nf_lru, &dispose);
+			freed++;
+		}
+		spin_unlock(&b->nfb_lock);
+	}
+
+	nfsdstats.fc_evictions += freed;
+	nfsd_file_dispose_list(&dispose);
+	return freed;
+}
+
+static void
+nfsd_file_laundrette(struct work_struct *work)
+{
+	nfsd_file_prune(ULONG_MAX, true);
+	if (atomic_long_read(&nfsd_filecache_count))
+		schedule_delayed_work(&nfsd_filecache_laundrette,
+				      NFSD_FILE_LAUNDRETTE_DELAY);
+}
+
+static unsigned long
+nfsd_file_cache_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	return atomic_long_read(&nfsd_filecache_count);
+}
+
+static unsigned long
+nfsd_file_cache_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	return nfsd_file_prune(sc->nr_to_scan, true);
+}
+
+static struct shrinker nfsd_file_shrinker = {
+	.count_objects = nfsd_file_cache_count,
+	.scan_objects = nfsd_file_cache_scan,
+	.seeks = 1,
+};
+
+/*
+ * Close every cached file for @inode.  Used when nfsd removes or renames
+ * over a file, so that the last link going away actually frees it.
+ */
+void
+nfsd_file_close_inode(struct inode *inode)
+{
+	unsigned int hashval = hash_ptr(inode, NFSD_FILE_HASH_BITS);
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf;
+	struct hlist_node *tmp;
+	LIST_HEAD(dispose);
+
+	if (!nfsd_file_hashtbl)
+		return;
+
+	b = &nfsd_file_hashtbl[hashval];
+	spin_lock(&b->nfb_lock);
+	hlist_for_each_entry_safe(nf, tmp, &b->nfb_head, nf_node) {
+		if (nf->nf_inode != inode)
+			continue;
+		if (nfsd_file_unhash(nf) && atomic_dec_and_test(&nf->nf_ref))
+			list_add(&nf->nf_lru, &dispose);
+	}
+	spin_unlock(&b->nfb_lock);
+
+	nfsd_file_dispose_list(&dispose);
+}
+
+/* Called under rcu_read_lock() or with the bucket lock held */
+static struct nfsd_file *
+nfsd_file_find(struct inode *inode, unsigned int may_flags,
+	       unsigned int hashval)
+{
+	struct nfsd_file *nf;
+
+	hlist_for_each_entry_rcu(nf, &nfsd_file_hashtbl[hashval].nfb_head,
+				 nf_node) {
+		if (nf->nf_inode == inode && nf->nf_may == may_flags &&
+		    atomic_inc_not_zero(&nf->nf_ref))
+			return nf;
+	}
+	return NULL;
+}
+
+/*
+ * Get an open file for @fhp.  Permission is still checked against the
+ * caller on every request; only the open itself is shared.
+ * On success the caller must drop the file with nfsd_file_put().
+ */
+__be32
+nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+		  unsigned int may_flags, struct nfsd_file **nfp)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf, *new;
+	unsigned int hashval, may;
+	struct inode *inode;
+	struct file *file;
+	__be32 status;
+	int host_err;
+
+	status = fh_verify(rqstp, fhp, S_IFREG,
+			   may_flags | NFSD_MAY_OWNER_OVERRIDE);
+	if (status)
+		return status;
+
+	inode = d_inode(fhp->fh_dentry);
+	hashval = hash_ptr(inode, NFSD_FILE_HASH_BITS);
+	may = may_flags & NFSD_FILE_MAY_MASK;
+
+	rcu_read_lock();
+	nf = nfsd_file_find(inode, may, hashval);
+	rcu_read_unlock();
+	if (nf) {
+		host_err = nfsd_open_break_lease(inode, may_flags);
+		if (host_err) {
+			nfsd_file_put(nf);
+			return nfserrno(host_err);
+		}
+		nfsdstats.fc_hits++;
+		goto out;
+	}
+
+	nfsdstats.fc_misses++;
+	status = nfsd_open(rqstp, fhp, S_IFREG, may_flags, &file);
+	if (status)
+		return status;
+
+	new = kmem_cache_alloc(nfsd_file_slab, GFP_KERNEL);
+	if (!new) {
+		fput(file);
+		return nfserr_jukebox;
+	}
+	new->nf_file = file;
+	new->nf_inode = inode;
+	new->nf_may = may;
+	new->nf_flags = BIT(NFSD_FILE_HASHED) | BIT(NFSD_FILE_REFERENCED);
+	atomic_set(&new->nf_ref, 2);
+
+	b = &nfsd_file_hashtbl[hashval];
+	spin_lock(&b->nfb_lock);
+	nf = nfsd_file_find(inode, may, hashval);
+	if (unlikely(nf)) {
+		/* someone else opened it in the meantime */
+		spin_unlock(&b->nfb_lock);
+		fput(file);
+		kmem_cache_free(nfsd_file_slab, new);
+		goto out;
+	}
+	hlist_add_head_rcu(&new->nf_node, &b->nfb_head);
+	spin_unlock(&b->nfb_lock);
+
+	atomic_long_inc(&nfsd_filecache_count);
+	schedule_delayed_work(&nfsd_filecache_laundrette,
+			      NFSD_FILE_LAUNDRETTE_DELAY);
+	nf = new;
+out:
+	*nfp = nf;
+	return nfs_ok;
+}
+
+int
+nfsd_file_cache_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (nfsd_file_hashtbl)
+		return 0;
+
+	nfsd_file_hashtbl = kcalloc(NFSD_FILE_HASH_SIZE,
+				    sizeof(*nfsd_file_hashtbl), GFP_KERNEL);
+	if (!nfsd_file_hashtbl)
+		return -ENOMEM;
+	for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&nfsd_file_hashtbl[i].nfb_head);
+		spin_lock_init(&nfsd_file_hashtbl[i].nfb_lock);
+	}
+
+	ret = -ENOMEM;
+	nfsd_file_slab = kmem_cache_create("nfsd_file", sizeof(struct nfsd_file),
+					   0, 0, NULL);
+	if (!nfsd_file_slab)
+		goto out_free_hash;
+
+	ret = register_shrinker(&nfsd_file_shrinker);
+	if (ret)
+		goto out_free_slab;
+	return 0;
+
+out_free_slab:
+	kmem_cache_destroy(nfsd_file_slab);
+	nfsd_file_slab = NULL;
+out_free_hash:
+	kfree(nfsd_file_hashtbl);
+	nfsd_file_hashtbl = NULL;
+	return ret;
+}
+
+void
+nfsd_file_cache_shutdown(void)
+{
+	struct nfsd_file *nf;
+	struct hlist_node *tmp;
+	unsigned int i;
+	LIST_HEAD(dispose);
+
+	if (!nfsd_file_hashtbl)
+		return;
+
+	unregister_shrinker(&nfsd_file_shrinker);
+	cancel_delayed_work_sync(&nfsd_filecache_laundrette);
+
+	for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+		spin_lock(&nfsd_file_hashtbl[i].nfb_lock);
+		hlist_for_each_entry_safe(nf, tmp,
+					  &nfsd_file_hashtbl[i].nfb_head,
+					  nf_node) {
+			if (nfsd_file_unhash(nf) &&
+			    atomic_dec_and_test(&nf->nf_ref))
+				list_add(&nf->nf_lru, &dispose);
+		}
+		spin_unlock(&nfsd_file_hashtbl[i].nfb_lock);
+	}
+	nfsd_file_dispose_list(&dispose);
+
+	/* wait for nfsd_file_free_rcu() before the slab goes away */
+	rcu_barrier();
+	kmem_cache_destroy(nfsd_file_slab);
+	nfsd_file_slab = NULL;
+	kfree(nfsd_file_hashtbl);
+	nfsd_file_hashtbl = NULL;
+}
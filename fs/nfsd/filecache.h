@@ -0,0 +1,33 @@
+#ifndef _FS_NFSD_FILECACHE_H
+#define _FS_NFSD_FILECACHE_H
+
+#include <linux/fs.h>
+
+struct svc_rqst;
+struct svc_fh;
+
+/*
+ * A cached open file.  The hash table holds one reference for as long as
+ * the entry is hashed; everyone using nf_file holds another.
+ */
+struct nfsd_file {
+	struct hlist_node	nf_node;
+	struct list_head	nf_lru;		/* only used while disposing */
+	struct rcu_head		nf_rcu;
+	struct file		*nf_file;
+	struct inode		*nf_inode;
+	unsigned int		nf_may;
+	unsigned long		nf_flags;
+#define NFSD_FILE_HASHED	(0)
+#define NFSD_FILE_REFERENCED	(1)
+	atomic_t		nf_ref;
+};
+
+int		nfsd_file_cache_init(void);
+void		nfsd_file_cache_shutdown(void);
+void		nfsd_file_put(struct nfsd_file *nf);
+void		nfsd_file_close_inode(struct inode *inode);
+__be32		nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+				  unsigned int may_flags, struct nfsd_file **nfp);
+
+#endif /* _FS_NFSD_FILECACHE_H */
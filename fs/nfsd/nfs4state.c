@@ -46,6 +46,7 @@
 #include "xdr4cb.h"
 #include "vfs.h"
 #include "current_stateid.h"
+#include "filecache.h"
 
 #include "netns.h"
 #include "pnfs.h"
@@ -4770,9 +4771,13 @@ nfs4_check_file(struct svc_rqst *rqstp, struct svc_fh *fhp, struct nfs4_stid *s,
 
 		*filpp = file;
 	} else {
-		status = nfsd_open(rqstp, fhp, S_IFREG, acc, filpp);
+		struct nfsd_file *nf;
+
+		status = nfsd_file_acquire(rqstp, fhp, acc, &nf);
 		if (status)
 			return status;
+		*filpp = get_file(nf->nf_file);
+		nfsd_file_put(nf);
 
 		if (tmp_file)
 			*tmp_file = true;
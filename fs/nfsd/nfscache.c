@@ -13,6 +13,8 @@
 #include <linux/highmem.h>
 #include <linux/log2.h>
 #include <linux/hash.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu-rwsem.h>
 #include <net/checksum.h>
 
 #include "nfsd.h"
@@ -27,20 +29,46 @@
  */
 #define TARGET_BUCKET_SIZE	64
 
+/* The table starts this small and follows the number of entries */
+#define MIN_DRC_HASHSIZE	16
+
 struct nfsd_drc_bucket {
 	struct list_head lru_head;
 	spinlock_t cache_lock;
+
+	/* lock statistics, updated under cache_lock */
+	u64		lock_count;
+	u64		lock_contended;
+	u64		lock_hold_ns;
+	u64		lock_start;
+};
+
+struct nfsd_drc_table {
+	unsigned int		maskbits;	/* significant bits of the hash */
+	unsigned int		hashsize;
+	struct nfsd_drc_bucket	buckets[];
 };
 
-static struct nfsd_drc_bucket	*drc_hashtbl;
+/*
+ * The table is only ever replaced by nfsd_reply_cache_resize(), which
+ * takes drc_resize_sem for write.  Everything else that touches a bucket
+ * holds it for read, which costs no more than a per-cpu increment.
+ */
+static struct nfsd_drc_table	*drc_table;
+static struct percpu_rw_semaphore drc_resize_sem;
+static struct work_struct	drc_resize_work;
 static struct kmem_cache	*drc_slab;
 
 /* max number of entries allowed in the cache */
 static unsigned int		max_drc_entries;
 
-/* number of significant bits in the hash value */
-static unsigned int		maskbits;
-static unsigned int		drc_hashsize;
+/* largest table we'll grow to, sized from max_drc_entries */
+static unsigned int		max_drc_hashsize;
+
+/* lock statistics of tables that have been resized away */
+static u64			retired_lock_count;
+static u64			retired_lock_contended;
+static u64			retired_lock_hold_ns;
 
 /*
  * Stats and other tracking of on the duplicate reply cache. All of these and
@@ -112,10 +140,126 @@ nfsd_hashsize(unsigned int limit)
 	return roundup_pow_of_two(limit / TARGET_BUCKET_SIZE);
 }
 
-static u32
-nfsd_cache_hash(__be32 xid)
+static struct nfsd_drc_bucket *
+nfsd_cache_bucket(struct nfsd_drc_table *t, __be32 xid)
+{
+	return &t->buckets[hash_32(be32_to_cpu(xid), t->maskbits)];
+}
+
+static void
+nfsd_cache_lock(struct nfsd_drc_bucket *b)
+{
+	if (!spin_trylock(&b->cache_lock)) {
+		spin_lock(&b->cache_lock);
+		b->lock_contended++;
+	}
+	b->lock_count++;
+	b->lock_start = local_clock();
+}
+
+static void
+nfsd_cache_unlock(struct nfsd_drc_bucket *b)
+{
+	b->lock_hold_ns += local_clock() - b->lock_start;
+	spin_unlock(&b->cache_lock);
+}
+
+static struct nfsd_drc_table *
+nfsd_drc_table_alloc(unsigned int hashsize)
 {
-	return hash_32(be32_to_cpu(xid), maskbits);
+	struct nfsd_drc_table *t;
+	unsigned int i;
+
+	t = vzalloc(sizeof(*t) + hashsize * sizeof(t->buckets[0]));
+	if (!t)
+		return NULL;
+	t->hashsize = hashsize;
+	t->maskbits = ilog2(hashsize);
+	for (i = 0; i < hashsize; i++) {
+		INIT_LIST_HEAD(&t->buckets[i].lru_head);
+		spin_lock_init(&t->buckets[i].cache_lock);
+	}
+	return t;
+}
+
+/*
+ * Size the table for the current number of entries, so the average chain
+ * stays around TARGET_BUCKET_SIZE.
+ */
+static unsigned int
+nfsd_drc_wanted_hashsize(void)
+{
+	unsigned int entries = atomic_read(&num_drc_entries);
+	unsigned int hashsize;
+
+	hashsize = roundup_pow_of_two(entries / TARGET_BUCKET_SIZE + 1);
+	return clamp_t(unsigned int, hashsize, MIN_DRC_HASHSIZE,
+		       max_drc_hashsize);
+}
+
+/*
+ * Kick off a resize when chains get twice as long as we'd like, or the
+ * table is more than eight times bigger than it needs to be.  The gap
+ * keeps a steady load from flapping between two sizes.
+ */
+static void
+nfsd_drc_check_size(struct nfsd_drc_table *t)
+{
+	unsigned int entries = atomic_read(&num_drc_entries);
+
+	if ((entries > 2 * t->hashsize * TARGET_BUCKET_SIZE &&
+	     t->hashsize < max_drc_hashsize) ||
+	    (entries < t->hashsize * TARGET_BUCKET_SIZE / 8 &&
+	     t->hashsize > MIN_DRC_HASHSIZE))
+		schedule_work(&drc_resize_work);
+}
+
+/* Keep each LRU list ordered by c_timestamp, prune_bucket() relies on it */
+static void
+nfsd_drc_insert_sorted(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
+{
+	struct list_head *pos = b->lru_head.prev;
+
+	while (pos != &b->lru_head &&
+	       time_after(list_entry(pos, struct svc_cacherep, c_lru)->c_timestamp,
+			  rp->c_timestamp))
+		pos = pos->prev;
+	list_move(&rp->c_lru, pos);
+}
+
+static void
+nfsd_reply_cache_resize(struct work_struct *work)
+{
+	struct nfsd_drc_table *old, *new;
+	struct svc_cacherep *rp, *tmp;
+	unsigned int i, hashsize;
+
+	hashsize = nfsd_drc_wanted_hashsize();
+	if (hashsize == drc_table->hashsize)
+		return;
+
+	new = nfsd_drc_table_alloc(hashsize);
+	if (!new)
+		return;
+
+	percpu_down_write(&drc_resize_sem);
+	old = drc_table;
+	for (i = 0; i < old->hashsize; i++) {
+		struct nfsd_drc_bucket *b = &old->buckets[i];
+
+		list_for_each_entry_safe(rp, tmp, &b->lru_head, c_lru)
+			nfsd_drc_insert_sorted(nfsd_cache_bucket(new, rp->c_xid),
+					       rp);
+		retired_lock_count += b->lock_count;
+		retired_lock_contended += b->lock_contended;
+		retired_lock_hold_ns += b->lock_hold_ns;
+	}
+	drc_table = new;
+	percpu_up_write(&drc_resize_sem);
+
+	dprintk("nfsd: DRC resized from %u to %u buckets\n",
+		old->hashsize, new->hashsize);
+	vfree(old);
 }
 
 static struct svc_cacherep *
@@ -146,47 +290,53 @@ nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
 }
 
 static void
-nfsd_reply_cache_free(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
+nfsd_reply_cache_free(struct svc_cacherep *rp)
 {
-	spin_lock(&b->cache_lock);
+	struct nfsd_drc_bucket *b;
+
+	percpu_down_read(&drc_resize_sem);
+	b = nfsd_cache_bucket(drc_table, rp->c_xid);
+	nfsd_cache_lock(b);
 	nfsd_reply_cache_free_locked(rp);
-	spin_unlock(&b->cache_lock);
+	nfsd_cache_unlock(b);
+	percpu_up_read(&drc_resize_sem);
 }
 
 int nfsd_reply_cache_init(void)
 {
-	unsigned int hashsize;
-	unsigned int i;
 	int status = 0;
 
 	max_drc_entries = nfsd_cache_size_limit();
 	atomic_set(&num_drc_entries, 0);
-	hashsize = nfsd_hashsize(max_drc_entries);
-	maskbits = ilog2(hashsize);
+	max_drc_hashsize = max_t(unsigned int, nfsd_hashsize(max_drc_entries),
+				 MIN_DRC_HASHSIZE);
 
-	status = register_shrinker(&nfsd_reply_cache_shrinker);
+	status = percpu_init_rwsem(&drc_resize_sem);
 	if (status)
 		return status;
+	INIT_WORK(&drc_resize_work, nfsd_reply_cache_resize);
+
+	status = register_shrinker(&nfsd_reply_cache_shrinker);
+	if (status)
+		goto out_rwsem;
 
 	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
 					0, 0, NULL);
 	if (!drc_slab)
 		goto out_nomem;
 
-	drc_hashtbl = kcalloc(hashsize, sizeof(*drc_hashtbl), GFP_KERNEL);
-	if (!drc_hashtbl)
+	drc_table = nfsd_drc_table_alloc(MIN_DRC_HASHSIZE);
+	if (!drc_table)
 		goto out_nomem;
-	for (i = 0; i < hashsize; i++) {
-		INIT_LIST_HEAD(&drc_hashtbl[i].lru_head);
-		spin_lock_init(&drc_hashtbl[i].cache_lock);
-	}
-	drc_hashsize = hashsize;
 
 	return 0;
 out_nomem:
 	printk(KERN_ERR "nfsd: failed to allocate reply cache\n");
 	nfsd_reply_cache_shutdown();
 	return -ENOMEM;
+out_rwsem:
+	percpu_free_rwsem(&drc_resize_sem);
+	return status;
 }
 
 void nfsd_reply_cache_shutdown(void)
@@ -195,18 +345,19 @@ void nfsd_reply_cache_shutdown(void)
 	unsigned int i;
 
 	unregister_shrinker(&nfsd_reply_cache_shrinker);
+	cancel_work_sync(&drc_resize_work);
 
-	for (i = 0; i < drc_hashsize; i++) {
-		struct list_head *head = &drc_hashtbl[i].lru_head;
+	for (i = 0; drc_table && i < drc_table->hashsize; i++) {
+		struct list_head *head = &drc_table->buckets[i].lru_head;
 		while (!list_empty(head)) {
 			rp = list_first_entry(head, struct svc_cacherep, c_lru);
 			nfsd_reply_cache_free_locked(rp);
 		}
 	}
 
-	kfree (drc_hashtbl);
-	drc_hashtbl = NULL;
-	drc_hashsize = 0;
+	vfree(drc_table);
+	drc_table = NULL;
+	percpu_free_rwsem(&drc_resize_sem);
 
 	kmem_cache_destroy(drc_slab);
 	drc_slab = NULL;
@@ -252,18 +403,25 @@ prune_bucket(struct nfsd_drc_bucket *b)
 static long
 prune_cache_entries(void)
 {
+	struct nfsd_drc_table *t;
 	unsigned int i;
 	long freed = 0;
 
-	for (i = 0; i < drc_hashsize; i++) {
-		struct nfsd_drc_bucket *b = &drc_hashtbl[i];
+	percpu_down_read(&drc_resize_sem);
+	t = drc_table;
+	/* the shrinker is registered before the table is allocated */
+	for (i = 0; t && i < t->hashsize; i++) {
+		struct nfsd_drc_bucket *b = &t->buckets[i];
 
 		if (list_empty(&b->lru_head))
 			continue;
-		spin_lock(&b->cache_lock);
+		nfsd_cache_lock(b);
 		freed += prune_bucket(b);
-		spin_unlock(&b->cache_lock);
+		nfsd_cache_unlock(b);
 	}
+	if (t)
+		nfsd_drc_check_size(t);
+	percpu_up_read(&drc_resize_sem);
 	return freed;
 }
 
@@ -386,8 +544,8 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 				vers = rqstp->rq_vers,
 				proc = rqstp->rq_proc;
 	__wsum			csum;
-	u32 hash = nfsd_cache_hash(xid);
-	struct nfsd_drc_bucket *b = &drc_hashtbl[hash];
+	struct nfsd_drc_table	*t;
+	struct nfsd_drc_bucket	*b;
 	unsigned long		age;
 	int type = rqstp->rq_cachetype;
 	int rtn = RC_DOIT;
@@ -405,7 +563,11 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	 * preallocate an entry.
 	 */
 	rp = nfsd_reply_cache_alloc();
-	spin_lock(&b->cache_lock);
+
+	percpu_down_read(&drc_resize_sem);
+	t = drc_table;
+	b = nfsd_cache_bucket(t, xid);
+	nfsd_cache_lock(b);
 	if (likely(rp)) {
 		atomic_inc(&num_drc_entries);
 		drc_mem_usage += sizeof(*rp);
@@ -449,7 +611,9 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	}
 	rp->c_type = RC_NOCACHE;
  out:
-	spin_unlock(&b->cache_lock);
+	nfsd_cache_unlock(b);
+	nfsd_drc_check_size(t);
+	percpu_up_read(&drc_resize_sem);
 	return rtn;
 
 found_entry:
@@ -511,7 +675,6 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 {
 	struct svc_cacherep *rp = rqstp->rq_cacherep;
 	struct kvec	*resv = &rqstp->rq_res.head[0], *cachv;
-	u32		hash;
 	struct nfsd_drc_bucket *b;
 	int		len;
 	size_t		bufsize = 0;
@@ -519,15 +682,12 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 	if (!rp)
 		return;
 
-	hash = nfsd_cache_hash(rp->c_xid);
-	b = &drc_hashtbl[hash];
-
 	len = resv->iov_len - ((char*)statp - (char*)resv->iov_base);
 	len >>= 2;
 
 	/* Don't cache excessive amounts of data and XDR failures */
 	if (!statp || len > (256 >> 2)) {
-		nfsd_reply_cache_free(b, rp);
+		nfsd_reply_cache_free(rp);
 		return;
 	}
 
@@ -542,24 +702,32 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		bufsize = len << 2;
 		cachv->iov_base = kmalloc(bufsize, GFP_KERNEL);
 		if (!cachv->iov_base) {
-			nfsd_reply_cache_free(b, rp);
+			nfsd_reply_cache_free(rp);
 			return;
 		}
 		cachv->iov_len = bufsize;
 		memcpy(cachv->iov_base, statp, bufsize);
 		break;
 	case RC_NOCACHE:
-		nfsd_reply_cache_free(b, rp);
+		nfsd_reply_cache_free(rp);
 		return;
 	}
-	spin_lock(&b->cache_lock);
+
+	/*
+	 * The entry may have moved to a new table since nfsd_cache_lookup().
+	 * Don't allocate while holding drc_resize_sem: reclaim can end up in
+	 * our shrinker, which takes it as well.
+	 */
+	percpu_down_read(&drc_resize_sem);
+	b = nfsd_cache_bucket(drc_table, rp->c_xid);
+	nfsd_cache_lock(b);
 	drc_mem_usage += bufsize;
 	lru_put_end(b, rp);
 	rp->c_secure = test_bit(RQ_SECURE, &rqstp->rq_flags);
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
-	spin_unlock(&b->cache_lock);
-	return;
+	nfsd_cache_unlock(b);
+	percpu_up_read(&drc_resize_sem);
 }
 
 /*
@@ -589,10 +757,26 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
  */
 static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 {
+	u64 lock_count = retired_lock_count;
+	u64 lock_contended = retired_lock_contended;
+	u64 lock_hold_ns = retired_lock_hold_ns;
+	struct nfsd_drc_bucket *b;
+	struct nfsd_drc_table *t;
+	unsigned int i;
+
+	percpu_down_read(&drc_resize_sem);
+	t = drc_table;
+	for (i = 0; i < t->hashsize; i++) {
+		b = &t->buckets[i];
+		lock_count += b->lock_count;
+		lock_contended += b->lock_contended;
+		lock_hold_ns += b->lock_hold_ns;
+	}
+
 	seq_printf(m, "max entries:           %u\n", max_drc_entries);
 	seq_printf(m, "num entries:           %u\n",
 			atomic_read(&num_drc_entries));
-	seq_printf(m, "hash buckets:          %u\n", 1 << maskbits);
+	seq_printf(m, "hash buckets:          %u\n", t->hashsize);
 	seq_printf(m, "mem usage:             %u\n", drc_mem_usage);
 	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
 	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
@@ -600,6 +784,20 @@ static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 	seq_printf(m, "payload misses:        %u\n", payload_misses);
 	seq_printf(m, "longest chain len:     %u\n", longest_chain);
 	seq_printf(m, "cachesize at longest:  %u\n", longest_chain_cachesize);
+	seq_printf(m, "lock acquisitions:     %llu\n", lock_count);
+	seq_printf(m, "lock contended:        %llu\n", lock_contended);
+	seq_printf(m, "lock hold ns:          %llu\n", lock_hold_ns);
+
+	/* per-bucket breakdown, only for buckets that have seen contention */
+	seq_puts(m, "contended buckets:     # bucket acquisitions contended hold-ns\n");
+	for (i = 0; i < t->hashsize; i++) {
+		b = &t->buckets[i];
+		if (!b->lock_contended)
+			continue;
+		seq_printf(m, "%u %llu %llu %llu\n", i, b->lock_count,
+			   b->lock_contended, b->lock_hold_ns);
+	}
+	percpu_up_read(&drc_resize_sem);
 	return 0;
 }
 
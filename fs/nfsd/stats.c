@@ -61,6 +61,10 @@ static int nfsd_proc_show(struct seq_file *seq, void *v)
 	for (i=0; i<11; i++)
 		seq_printf(seq, " %u", nfsdstats.ra_depth[i]);
 	seq_putc(seq, '\n');
+
+	/* open file cache */
+	seq_printf(seq, "fc %u %u %u\n", nfsdstats.fc_hits,
+		   nfsdstats.fc_misses, nfsdstats.fc_evictions);
 	
 	/* show my rpc info */
 	svc_seq_show(seq, &nfsd_svcstats);
@@ -27,6 +27,9 @@ struct nfsd_stats {
 	unsigned int	ra_size;	/* size of ra cache */
 	unsigned int	ra_depth[11];	/* number of times ra entry was found that deep
 					 * in the cache (10percentiles). [10] = not found */
+	unsigned int	fc_hits;	/* open file cache hits */
+	unsigned int	fc_misses;	/* open file cache misses */
+	unsigned int	fc_evictions;	/* idle open files closed */
 #ifdef CONFIG_NFSD_V4
 	unsigned int	nfs4_opcount[LAST_NFS4_OP + 1];	/* count of individual nfsv4 operations */
 #endif
@@ -104,6 +104,7 @@ __be32		nfsd_statfs(struct svc_rqst *, struct svc_fh *,
 __be32		nfsd_permission(struct svc_rqst *, struct svc_export *,
 				struct dentry *, int);
 
+int		nfsd_open_break_lease(struct inode *, int);
 struct raparms *nfsd_init_raparms(struct file *file);
 void		nfsd_put_raparams(struct file *file, struct raparms *ra);
 
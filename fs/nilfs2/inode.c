@@ -33,6 +33,7 @@
 #include "page.h"
 #include "mdt.h"
 #include "cpfile.h"
+#include "sufile.h"
 #include "ifile.h"
 
 /**
@@ -770,6 +771,9 @@ static void nilfs_clear_inode(struct inode *inode)
 	if (mdi && mdi->mi_palloc_cache)
 		nilfs_palloc_destroy_cache(inode);
 
+	if (mdi && inode->i_ino == NILFS_SUFILE_INO)
+		nilfs_sufile_free_index(inode);
+
 	if (test_bit(NILFS_I_BMAP, &ii->i_state))
 		nilfs_bmap_clear(ii->i_bmap);
 
@@ -1292,6 +1292,74 @@ out:
 	return ret;
 }
 
+/**
+ * nilfs_ioctl_get_victims - pick segments for the cleaner
+ * @inode: inode object
+ * @argp: pointer on argument from userspace
+ *
+ * Description: Expects an array of segment numbers (__u64) encapsulated
+ * in nilfs_argv, fills it with up to v_nmembs reclaimable segments,
+ * fewest live blocks first, and sets v_nmembs to the number found.  A
+ * nonzero v_flags skips segments with that many live blocks or more.
+ * nilfs_cleanerd can hand the whole batch to one
+ * NILFS_IOCTL_CLEAN_SEGMENTS call instead of scanning the segment usage
+ * file with NILFS_IOCTL_GET_SUINFO for every pass.
+ *
+ * Return Value: On success, 0 is returned. On error, one of the
+ * following negative error codes is returned.
+ *
+ * %-EFAULT - Error copying input or output data
+ *
+ * %-EINVAL - Invalid member size
+ *
+ * %-EIO - I/O error.
+ *
+ * %-ENOMEM - Insufficient amount of memory available.
+ */
+static int nilfs_ioctl_get_victims(struct inode *inode, void __user *argp)
+{
+	struct the_nilfs *nilfs = inode->i_sb->s_fs_info;
+	struct nilfs_argv argv;
+	__u64 *segnumv;
+	size_t nmembs;
+	ssize_t nr;
+	int ret = 0;
+
+	if (copy_from_user(&argv, argp, sizeof(argv)))
+		return -EFAULT;
+
+	if (argv.v_size != sizeof(__u64))
+		return -EINVAL;
+
+	nmembs = min_t(size_t, argv.v_nmembs, nilfs->ns_nsegments);
+	if (!nmembs)
+		goto out;
+
+	segnumv = vmalloc(nmembs * sizeof(__u64));
+	if (!segnumv)
+		return -ENOMEM;
+
+	down_read(&nilfs->ns_segctor_sem);
+	nr = nilfs_sufile_get_victims(nilfs->ns_sufile, segnumv, nmembs,
+				      argv.v_flags ? : UINT_MAX);
+	up_read(&nilfs->ns_segctor_sem);
+
+	if (nr < 0)
+		ret = nr;
+	else if (copy_to_user((void __user *)(unsigned long)argv.v_base,
+			      segnumv, nr * sizeof(__u64)))
+		ret = -EFAULT;
+	vfree(segnumv);
+	if (ret)
+		return ret;
+	nmembs = nr;
+ out:
+	argv.v_nmembs = nmembs;
+	if (copy_to_user(argp, &argv, sizeof(argv)))
+		ret = -EFAULT;
+	return ret;
+}
+
 long nilfs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -1336,6 +1404,8 @@ long nilfs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		return nilfs_ioctl_resize(inode, filp, argp);
 	case NILFS_IOCTL_SET_ALLOC_RANGE:
 		return nilfs_ioctl_set_alloc_range(inode, argp);
+	case NILFS_IOCTL_GET_VICTIMS:
+		return nilfs_ioctl_get_victims(inode, argp);
 	case FITRIM:
 		return nilfs_ioctl_trim_fs(inode, argp);
 	default:
@@ -1369,6 +1439,7 @@ long nilfs_compat_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case NILFS_IOCTL_SYNC:
 	case NILFS_IOCTL_RESIZE:
 	case NILFS_IOCTL_SET_ALLOC_RANGE:
+	case NILFS_IOCTL_GET_VICTIMS:
 		break;
 	default:
 		return -ENOIOCTLCMD;
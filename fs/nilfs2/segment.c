@@ -1924,35 +1924,58 @@ static int nilfs_segctor_wait(struct nilfs_sc_info *sci)
 	return ret;
 }
 
+/*
+ * Files dirtied since the last construction have no inode block buffer
+ * yet.  Rather than reading those blocks one file at a time, rescanning
+ * the dirty list after each, gather a batch of such files, read their
+ * inode blocks concurrently and attach the buffers in one go.  The reads
+ * run on nilfs_ibh_wq, which has a rescuer: this is the writeback path,
+ * and the memory a worker would wait for may only be freed by it.
+ */
+#define NILFS_SC_IBH_BATCH	32
+
+struct nilfs_ibh_read {
+	struct work_struct work;
+	struct inode *ifile;
+	struct nilfs_inode_info *ii;
+	struct buffer_head *ibh;
+	int err;
+};
+
+static void nilfs_ibh_read(struct nilfs_ibh_read *rd)
+{
+	rd->err = nilfs_ifile_get_inode_block(rd->ifile, rd->ii->vfs_inode.i_ino,
+					      &rd->ibh);
+}
+
+static void nilfs_ibh_read_work(struct work_struct *work)
+{
+	nilfs_ibh_read(container_of(work, struct nilfs_ibh_read, work));
+}
+
 static int nilfs_segctor_collect_dirty_files(struct nilfs_sc_info *sci,
 					     struct the_nilfs *nilfs)
 {
 	struct nilfs_inode_info *ii, *n;
 	struct inode *ifile = sci->sc_root->ifile;
+	struct nilfs_ibh_read one, *rd;
+	int i, nr, batch = NILFS_SC_IBH_BATCH;
+	int err = 0;
+
+	rd = kcalloc(batch, sizeof(*rd), GFP_NOFS);
+	if (unlikely(!rd)) {
+		rd = &one;
+		batch = 1;
+	}
 
 	spin_lock(&nilfs->ns_inode_lock);
  retry:
+	nr = 0;
 	list_for_each_entry_safe(ii, n, &nilfs->ns_dirty_files, i_dirty) {
 		if (!ii->i_bh) {
-			struct buffer_head *ibh;
-			int err;
-
-			spin_unlock(&nilfs->ns_inode_lock);
-			err = nilfs_ifile_get_inode_block(
-				ifile, ii->vfs_inode.i_ino, &ibh);
-			if (unlikely(err)) {
-				nilfs_warning(sci->sc_super, __func__,
-					      "failed to get inode block.\n");
-				return err;
-			}
-			mark_buffer_dirty(ibh);
-			nilfs_mdt_mark_dirty(ifile);
-			spin_lock(&nilfs->ns_inode_lock);
-			if (likely(!ii->i_bh))
-				ii->i_bh = ibh;
-			else
-				brelse(ibh);
-			goto retry;
+			if (nr < batch)
+				rd[nr++].ii = ii;
+			continue;
 		}
 
 		clear_bit(NILFS_I_QUEUED, &ii->i_state);
@@ -1960,8 +1983,52 @@ static int nilfs_segctor_collect_dirty_files(struct nilfs_sc_info *sci,
 		list_move_tail(&ii->i_dirty, &sci->sc_dirty_files);
 	}
 	spin_unlock(&nilfs->ns_inode_lock);
+	if (!nr)
+		goto out;
 
-	return 0;
+	for (i = 0; i < nr; i++) {
+		rd[i].ifile = ifile;
+		rd[i].ibh = NULL;
+		rd[i].err = 0;
+		/* the first one is read from this context */
+		if (i) {
+			INIT_WORK(&rd[i].work, nilfs_ibh_read_work);
+			queue_work(nilfs_ibh_wq, &rd[i].work);
+		}
+	}
+	nilfs_ibh_read(&rd[0]);
+	for (i = 1; i < nr; i++)
+		flush_work(&rd[i].work);
+
+	for (i = 0; i < nr; i++) {
+		if (unlikely(rd[i].err) && !err)
+			err = rd[i].err;
+	}
+	if (unlikely(err)) {
+		for (i = 0; i < nr; i++)
+			brelse(rd[i].ibh);
+		nilfs_warning(sci->sc_super, __func__,
+			      "failed to get inode block.\n");
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		mark_buffer_dirty(rd[i].ibh);
+		nilfs_mdt_mark_dirty(ifile);
+	}
+	spin_lock(&nilfs->ns_inode_lock);
+	for (i = 0; i < nr; i++) {
+		if (likely(!rd[i].ii->i_bh))
+			rd[i].ii->i_bh = rd[i].ibh;
+		else
+			brelse(rd[i].ibh);
+	}
+	goto retry;
+
+ out:
+	if (rd != &one)
+		kfree(rd);
+	return err;
 }
 
 static void nilfs_segctor_drop_written_files(struct nilfs_sc_info *sci,
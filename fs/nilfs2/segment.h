@@ -226,6 +226,7 @@ enum {
 
 /* super.c */
 extern struct kmem_cache *nilfs_transaction_cachep;
+extern struct workqueue_struct *nilfs_ibh_wq;
 
 /* segment.c */
 extern void nilfs_relax_pressure_in_lock(struct super_block *);
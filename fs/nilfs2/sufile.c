@@ -26,6 +26,8 @@
 #include <linux/string.h>
 #include <linux/buffer_head.h>
 #include <linux/errno.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
 #include <linux/nilfs2_fs.h>
 #include "mdt.h"
 #include "sufile.h"
@@ -38,12 +40,18 @@
  * @ncleansegs: number of clean segments
  * @allocmin: lower limit of allocatable segment range
  * @allocmax: upper limit of allocatable segment range
+ * @su_nblocks: cached live block count of each segment, NULL until built
+ * @su_reclaimable: bitmap of segments worth cleaning (dirty, no error)
+ * @su_index_nsegs: number of segments covered by the two above
  */
 struct nilfs_sufile_info {
 	struct nilfs_mdt_info mi;
 	unsigned long ncleansegs;/* number of clean segments */
 	__u64 allocmin;		/* lower limit of allocatable segment range */
 	__u64 allocmax;		/* upper limit of allocatable segment range */
+	__u32 *su_nblocks;
+	unsigned long *su_reclaimable;
+	unsigned long su_index_nsegs;
 };
 
 static inline struct nilfs_sufile_info *NILFS_SUI(struct inode *sufile)
@@ -128,6 +136,94 @@ static void nilfs_sufile_mod_counter(struct buffer_head *header_bh,
 	mark_buffer_dirty(header_bh);
 }
 
+/*
+ * Usage index.  A cleaner choosing victims would otherwise read the
+ * whole sufile through NILFS_IOCTL_GET_SUINFO on every pass.  The index
+ * is built on first use and then kept in step by every routine that
+ * changes a segment usage; all of them, like the build itself, run with
+ * mi_sem held for writing.
+ */
+static void nilfs_sufile_index_update(struct inode *sufile, __u64 segnum,
+				      const struct nilfs_segment_usage *su)
+{
+	struct nilfs_sufile_info *sui = NILFS_SUI(sufile);
+
+	if (!sui->su_nblocks || segnum >= sui->su_index_nsegs)
+		return;
+	sui->su_nblocks[segnum] = le32_to_cpu(su->su_nblocks);
+	if (nilfs_segment_usage_dirty(su) && !nilfs_segment_usage_error(su))
+		__set_bit(segnum, sui->su_reclaimable);
+	else
+		__clear_bit(segnum, sui->su_reclaimable);
+}
+
+static int nilfs_sufile_build_index(struct inode *sufile)
+{
+	struct nilfs_sufile_info *sui = NILFS_SUI(sufile);
+	size_t susz = NILFS_MDT(sufile)->mi_entry_size;
+	unsigned long nsegs = nilfs_sufile_get_nsegments(sufile);
+	struct nilfs_segment_usage *su;
+	struct buffer_head *su_bh;
+	unsigned long *reclaimable;
+	unsigned long segnum, n, j;
+	__u32 *nblocks;
+	void *kaddr;
+	int ret = -ENOMEM;
+
+	nblocks = vzalloc(nsegs * sizeof(*nblocks));
+	reclaimable = vzalloc(BITS_TO_LONGS(nsegs) * sizeof(unsigned long));
+	if (!nblocks || !reclaimable)
+		goto failed;
+
+	for (segnum = 0; segnum < nsegs; segnum += n) {
+		n = nilfs_sufile_segment_usages_in_block(sufile, segnum,
+							 nsegs - 1);
+		ret = nilfs_sufile_get_segment_usage_block(sufile, segnum, 0,
+							   &su_bh);
+		if (ret < 0) {
+			if (ret != -ENOENT)
+				goto failed;
+			continue;	/* hole, all clean */
+		}
+		kaddr = kmap_atomic(su_bh->b_page);
+		su = nilfs_sufile_block_get_segment_usage(
+			sufile, segnum, su_bh, kaddr);
+		for (j = 0; j < n; j++, su = (void *)su + susz) {
+			nblocks[segnum + j] = le32_to_cpu(su->su_nblocks);
+			if (nilfs_segment_usage_dirty(su) &&
+			    !nilfs_segment_usage_error(su))
+				__set_bit(segnum + j, reclaimable);
+		}
+		kunmap_atomic(kaddr);
+		brelse(su_bh);
+	}
+
+	sui->su_nblocks = nblocks;
+	sui->su_reclaimable = reclaimable;
+	sui->su_index_nsegs = nsegs;
+	return 0;
+
+ failed:
+	vfree(reclaimable);
+	vfree(nblocks);
+	return ret;
+}
+
+/**
+ * nilfs_sufile_free_index - drop the usage index
+ * @sufile: inode of segment usage file
+ */
+void nilfs_sufile_free_index(struct inode *sufile)
+{
+	struct nilfs_sufile_info *sui = NILFS_SUI(sufile);
+
+	vfree(sui->su_reclaimable);
+	vfree(sui->su_nblocks);
+	sui->su_reclaimable = NULL;
+	sui->su_nblocks = NULL;
+	sui->su_index_nsegs = 0;
+}
+
 /**
  * nilfs_sufile_get_ncleansegs - return the number of clean segments
  * @sufile: inode of segment usage file
@@ -375,6 +471,7 @@ int nilfs_sufile_alloc(struct inode *sufile, __u64 *segnump)
 				continue;
 			/* found a clean segment */
 			nilfs_segment_usage_set_dirty(su);
+			nilfs_sufile_index_update(sufile, segnum, su);
 			kunmap_atomic(kaddr);
 
 			kaddr = kmap_atomic(header_bh->b_page);
@@ -427,6 +524,7 @@ void nilfs_sufile_do_cancel_free(struct inode *sufile, __u64 segnum,
 		return;
 	}
 	nilfs_segment_usage_set_dirty(su);
+	nilfs_sufile_index_update(sufile, segnum, su);
 	kunmap_atomic(kaddr);
 
 	nilfs_sufile_mod_counter(header_bh, -1, 1);
@@ -458,6 +556,7 @@ void nilfs_sufile_do_scrap(struct inode *sufile, __u64 segnum,
 	su->su_lastmod = cpu_to_le64(0);
 	su->su_nblocks = cpu_to_le32(0);
 	su->su_flags = cpu_to_le32(1UL << NILFS_SEGMENT_USAGE_DIRTY);
+	nilfs_sufile_index_update(sufile, segnum, su);
 	kunmap_atomic(kaddr);
 
 	nilfs_sufile_mod_counter(header_bh, clean ? (u64)-1 : 0, dirty ? 0 : 1);
@@ -488,6 +587,7 @@ void nilfs_sufile_do_free(struct inode *sufile, __u64 segnum,
 
 	sudirty = nilfs_segment_usage_dirty(su);
 	nilfs_segment_usage_set_clean(su);
+	nilfs_sufile_index_update(sufile, segnum, su);
 	kunmap_atomic(kaddr);
 	mark_buffer_dirty(su_bh);
 
@@ -544,6 +644,7 @@ int nilfs_sufile_set_segment_usage(struct inode *sufile, __u64 segnum,
 	if (modtime)
 		su->su_lastmod = cpu_to_le64(modtime);
 	su->su_nblocks = cpu_to_le32(nblocks);
+	nilfs_sufile_index_update(sufile, segnum, su);
 	kunmap_atomic(kaddr);
 
 	mark_buffer_dirty(bh);
@@ -619,6 +720,7 @@ void nilfs_sufile_do_set_error(struct inode *sufile, __u64 segnum,
 	}
 	suclean = nilfs_segment_usage_clean(su);
 	nilfs_segment_usage_set_error(su);
+	nilfs_sufile_index_update(sufile, segnum, su);
 	kunmap_atomic(kaddr);
 
 	if (suclean) {
@@ -706,6 +808,8 @@ static int nilfs_sufile_truncate_range(struct inode *sufile,
 		for (su = su2, j = 0; j < n; j++, su = (void *)su + susz) {
 			if (nilfs_segment_usage_error(su)) {
 				nilfs_segment_usage_set_clean(su);
+				nilfs_sufile_index_update(sufile, segnum + j,
+							  su);
 				nc++;
 			}
 		}
@@ -793,6 +897,8 @@ int nilfs_sufile_resize(struct inode *sufile, __u64 newnsegs)
 	mark_buffer_dirty(header_bh);
 	nilfs_mdt_mark_dirty(sufile);
 	nilfs_set_nsegments(nilfs, newnsegs);
+	/* rebuilt for the new size on next use */
+	nilfs_sufile_free_index(sufile);
 
 out_header:
 	brelse(header_bh);
@@ -971,6 +1077,7 @@ ssize_t nilfs_sufile_set_suinfo(struct inode *sufile, void *buf,
 
 			su->su_flags = cpu_to_le32(sup->sup_sui.sui_flags);
 		}
+		nilfs_sufile_index_update(sufile, sup->sup_segnum, su);
 
 		kunmap_atomic(kaddr);
 
@@ -1159,6 +1266,115 @@ out_sem:
 	return ret;
 }
 
+struct nilfs_sufile_victim {
+	__u32 nblocks;
+	__u64 segnum;
+};
+
+static int nilfs_sufile_victim_cmp(const void *a, const void *b)
+{
+	const struct nilfs_sufile_victim *va = a, *vb = b;
+
+	if (va->nblocks != vb->nblocks)
+		return va->nblocks < vb->nblocks ? -1 : 1;
+	if (va->segnum != vb->segnum)
+		return va->segnum < vb->segnum ? -1 : 1;
+	return 0;
+}
+
+/* restore the max-heap on nblocks below @i */
+static void nilfs_sufile_victim_sift(struct nilfs_sufile_victim *v, size_t n,
+				     size_t i)
+{
+	for (;;) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+
+		if (l < n && v[l].nblocks > v[m].nblocks)
+			m = l;
+		if (r < n && v[r].nblocks > v[m].nblocks)
+			m = r;
+		if (m == i)
+			break;
+		swap(v[i], v[m]);
+		i = m;
+	}
+}
+
+/**
+ * nilfs_sufile_get_victims - pick the segments cheapest to clean
+ * @sufile: inode of segment usage file
+ * @segnumv: array to store segment numbers
+ * @nsegs: size of @segnumv array
+ * @maxblocks: skip segments with this many live blocks or more
+ *
+ * Description: nilfs_sufile_get_victims() stores in @segnumv up to @nsegs
+ * reclaimable segments not in use by the log writer, fewest live blocks
+ * first.  It works from the in-memory usage index and only reads the
+ * sufile the first time, to build that index.
+ *
+ * Return Value: On success, the number of segments stored is returned.
+ * On error, one of the following negative error codes is returned.
+ *
+ * %-EIO - I/O error.
+ *
+ * %-ENOMEM - Insufficient amount of memory available.
+ */
+ssize_t nilfs_sufile_get_victims(struct inode *sufile, __u64 *segnumv,
+				 size_t nsegs, __u32 maxblocks)
+{
+	struct the_nilfs *nilfs = sufile->i_sb->s_fs_info;
+	struct nilfs_sufile_info *sui = NILFS_SUI(sufile);
+	struct nilfs_sufile_victim *v;
+	unsigned long segnum;
+	size_t i, n = 0;
+	ssize_t ret = 0;
+
+	if (!nsegs)
+		return 0;
+	v = vmalloc(nsegs * sizeof(*v));
+	if (!v)
+		return -ENOMEM;
+
+	down_read(&NILFS_MDT(sufile)->mi_sem);
+	if (!sui->su_nblocks) {
+		up_read(&NILFS_MDT(sufile)->mi_sem);
+		down_write(&NILFS_MDT(sufile)->mi_sem);
+		if (!sui->su_nblocks)
+			ret = nilfs_sufile_build_index(sufile);
+		downgrade_write(&NILFS_MDT(sufile)->mi_sem);
+		if (ret < 0)
+			goto out_sem;
+	}
+
+	for_each_set_bit(segnum, sui->su_reclaimable, sui->su_index_nsegs) {
+		__u32 nb = sui->su_nblocks[segnum];
+
+		if (nb >= maxblocks || nilfs_segment_is_active(nilfs, segnum))
+			continue;
+		if (n < nsegs) {
+			v[n].nblocks = nb;
+			v[n].segnum = segnum;
+			if (++n == nsegs)
+				for (i = n / 2; i-- > 0; )
+					nilfs_sufile_victim_sift(v, n, i);
+		} else if (nb < v[0].nblocks) {
+			v[0].nblocks = nb;
+			v[0].segnum = segnum;
+			nilfs_sufile_victim_sift(v, n, 0);
+		}
+	}
+
+	sort(v, n, sizeof(*v), nilfs_sufile_victim_cmp, NULL);
+	for (i = 0; i < n; i++)
+		segnumv[i] = v[i].segnum;
+	ret = n;
+
+ out_sem:
+	up_read(&NILFS_MDT(sufile)->mi_sem);
+	vfree(v);
+	return ret;
+}
+
 /**
  * nilfs_sufile_read - read or get sufile inode
  * @sb: super block instance
@@ -45,6 +45,9 @@ int nilfs_sufile_get_stat(struct inode *, struct nilfs_sustat *);
 ssize_t nilfs_sufile_get_suinfo(struct inode *, __u64, void *, unsigned,
 				size_t);
 ssize_t nilfs_sufile_set_suinfo(struct inode *, void *, unsigned , size_t);
+ssize_t nilfs_sufile_get_victims(struct inode *sufile, __u64 *segnumv,
+				 size_t nsegs, __u32 maxblocks);
+void nilfs_sufile_free_index(struct inode *sufile);
 
 int nilfs_sufile_updatev(struct inode *, __u64 *, size_t, int, size_t *,
 			 void (*dofunc)(struct inode *, __u64,
@@ -71,6 +71,7 @@ static struct kmem_cache *nilfs_inode_cachep;
 struct kmem_cache *nilfs_transaction_cachep;
 struct kmem_cache *nilfs_segbuf_cachep;
 struct kmem_cache *nilfs_btree_path_cache;
+struct workqueue_struct *nilfs_ibh_wq;
 
 static int nilfs_setup_super(struct super_block *sb, int is_mount);
 static int nilfs_remount(struct super_block *sb, int *flags, char *data);
@@ -1455,9 +1456,17 @@ static int __init init_nilfs_fs(void)
 	if (err)
 		goto fail;
 
+	/* the segment constructor waits for it, so it must not need memory */
+	nilfs_ibh_wq = alloc_workqueue("nilfs_ibh", WQ_MEM_RECLAIM | WQ_UNBOUND,
+				       0);
+	if (!nilfs_ibh_wq) {
+		err = -ENOMEM;
+		goto free_cachep;
+	}
+
 	err = nilfs_sysfs_init();
 	if (err)
-		goto free_cachep;
+		goto free_wq;
 
 	err = register_filesystem(&nilfs_fs_type);
 	if (err)
@@ -1468,6 +1477,8 @@ static int __init init_nilfs_fs(void)
 
 deinit_sysfs_entry:
 	nilfs_sysfs_exit();
+free_wq:
+	destroy_workqueue(nilfs_ibh_wq);
 free_cachep:
 	nilfs_destroy_cachep();
 fail:
@@ -1477,6 +1488,7 @@ fail:
 static void __exit exit_nilfs_fs(void)
 {
 	nilfs_destroy_cachep();
+	destroy_workqueue(nilfs_ibh_wq);
 	nilfs_sysfs_exit();
 	unregister_filesystem(&nilfs_fs_type);
 }
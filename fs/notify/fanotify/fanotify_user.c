@@ -3,6 +3,8 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
+#include <linux/exportfs.h>
+#include <linux/statfs.h>
 #include <linux/fsnotify_backend.h>
 #include <linux/init.h>
 #include <linux/mount.h>
@@ -25,6 +27,21 @@
 #define FANOTIFY_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_LISTENERS	128
 
+/* events taken off the notification queue per notification_mutex hold */
+#define FANOTIFY_READ_BATCH		32
+
+#define FANOTIFY_FID_INFO_LEN(handle_bytes)				\
+	round_up(sizeof(struct fanotify_event_info_fid) +		\
+		 sizeof(struct file_handle) + (handle_bytes), 4)
+#define FANOTIFY_FID_EVENT_MAX_LEN					\
+	(FAN_EVENT_METADATA_LEN + 2 * FANOTIFY_FID_INFO_LEN(MAX_HANDLE_SZ))
+
+/* fsid of the last filesystem reported on, so statfs runs once per batch */
+struct fanotify_fsid_cache {
+	struct super_block *sb;
+	__kernel_fsid_t fsid;
+};
+
 /*
  * All flags that may be specified in parameter event_f_flags of fanotify_init.
  *
@@ -44,29 +61,45 @@ static struct kmem_cache *fanotify_mark_cache __read_mostly;
 struct kmem_cache *fanotify_event_cachep __read_mostly;
 struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
+static size_t fanotify_event_max_len(struct fsnotify_group *group)
+{
+	if (group->fanotify_data.flags & FAN_REPORT_FID)
+		return FANOTIFY_FID_EVENT_MAX_LEN;
+	return FAN_EVENT_METADATA_LEN;
+}
+
 /*
- * Get an fsnotify notification event if one exists and is small
- * enough to fit in "count". Return an error pointer if the count
- * is not large enough.
+ * Move the events that surely fit in "count" off the notification queue
+ * onto @batch, at most FANOTIFY_READ_BATCH of them.  Return the number of
+ * events moved, or -EINVAL if the count is not large enough for even one.
  *
  * Called with the group->notification_mutex held.
  */
-static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
-					    size_t count)
+static int get_events(struct fsnotify_group *group, size_t count,
+		      struct list_head *batch)
 {
+	size_t event_len = fanotify_event_max_len(group);
+	int nr = 0;
+
 	BUG_ON(!mutex_is_locked(&group->notification_mutex));
 
 	pr_debug("%s: group=%p count=%zd\n", __func__, group, count);
 
 	if (fsnotify_notify_queue_is_empty(group))
-		return NULL;
+		return 0;
+
+	if (event_len > count)
+		return -EINVAL;
 
-	if (FAN_EVENT_METADATA_LEN > count)
-		return ERR_PTR(-EINVAL);
+	do {
+		list_add_tail(&fsnotify_remove_first_event(group)->list,
+			      batch);
+		count -= event_len;
+		nr++;
+	} while (nr < FANOTIFY_READ_BATCH && count >= event_len &&
+		 !fsnotify_notify_queue_is_empty(group));
 
-	/* held the notification_mutex the whole time, so this is the
-	 * same event we peeked above */
-	return fsnotify_remove_first_event(group);
+	return nr;
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -130,7 +163,8 @@ static int fill_event_metadata(struct fsnotify_group *group,
 	metadata->reserved = 0;
 	metadata->mask = fsn_event->mask & FAN_ALL_OUTGOING_EVENTS;
 	metadata->pid = pid_vnr(event->tgid);
-	if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW))
+	if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW) ||
+	    (group->fanotify_data.flags & FAN_REPORT_FID))
 		metadata->fd = FAN_NOFD;
 	else {
 		metadata->fd = create_fd(group, event, file);
@@ -200,24 +234,96 @@ static int process_access_response(struct fsnotify_group *group,
 }
 #endif
 
+/*
+ * Encode a file handle for @inode as an info record of @type at @buf, which
+ * has room for a handle of MAX_HANDLE_SZ and is zeroed.  Returns the length
+ * of the record, or 0 if the inode cannot be encoded.
+ */
+static int fanotify_encode_fid(char *buf, int type, struct inode *inode,
+			       __kernel_fsid_t *fsid)
+{
+	struct fanotify_event_info_fid *info = (void *)buf;
+	struct file_handle *handle = (void *)info->handle;
+	int dwords = MAX_HANDLE_SZ >> 2;
+	int fh_type, len;
+
+	fh_type = exportfs_encode_inode_fh(inode, (struct fid *)handle->f_handle,
+					   &dwords, NULL);
+	if (fh_type <= 0 || fh_type == FILEID_INVALID ||
+	    dwords > MAX_HANDLE_SZ >> 2)
+		return 0;
+
+	handle->handle_type = fh_type;
+	handle->handle_bytes = dwords << 2;
+	len = FANOTIFY_FID_INFO_LEN(handle->handle_bytes);
+	info->hdr.info_type = type;
+	info->hdr.len = len;
+	info->fsid = *fsid;
+	return len;
+}
+
+/*
+ * Append the handles of the event's object and of its parent directory to
+ * the metadata at @buf.  No file is opened, so this costs no more than the
+ * encoding itself.
+ */
+static void fill_event_fids(struct fanotify_event_info *event, char *buf,
+			    struct fanotify_fsid_cache *fsid_cache)
+{
+	struct fanotify_event_metadata *metadata = (void *)buf;
+	struct dentry *dentry = event->path.dentry;
+	struct dentry *parent;
+	struct kstatfs st;
+
+	if (!dentry)
+		return;
+
+	if (fsid_cache->sb != dentry->d_sb) {
+		memset(&fsid_cache->fsid, 0, sizeof(fsid_cache->fsid));
+		if (!vfs_statfs(&event->path, &st))
+			fsid_cache->fsid = st.f_fsid;
+		fsid_cache->sb = dentry->d_sb;
+	}
+
+	metadata->event_len += fanotify_encode_fid(buf + metadata->event_len,
+						   FAN_EVENT_INFO_TYPE_FID,
+						   d_inode(dentry),
+						   &fsid_cache->fsid);
+
+	parent = dget_parent(dentry);
+	metadata->event_len += fanotify_encode_fid(buf + metadata->event_len,
+						   FAN_EVENT_INFO_TYPE_DFID,
+						   d_inode(parent),
+						   &fsid_cache->fsid);
+	dput(parent);
+}
+
 static ssize_t copy_event_to_user(struct fsnotify_group *group,
 				  struct fsnotify_event *event,
-				  char __user *buf)
+				  char __user *buf,
+				  struct fanotify_fsid_cache *fsid_cache)
 {
-	struct fanotify_event_metadata fanotify_event_metadata;
+	char kbuf[FANOTIFY_FID_EVENT_MAX_LEN] __aligned(8);
+	struct fanotify_event_metadata *metadata = (void *)kbuf;
 	struct file *f;
 	int fd, ret;
 
 	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
-	ret = fill_event_metadata(group, &fanotify_event_metadata, event, &f);
+	ret = fill_event_metadata(group, metadata, event, &f);
 	if (ret < 0)
 		return ret;
 
-	fd = fanotify_event_metadata.fd;
+	if ((group->fanotify_data.flags & FAN_REPORT_FID) &&
+	    !(event->mask & FAN_Q_OVERFLOW)) {
+		memset(kbuf + FAN_EVENT_METADATA_LEN, 0,
+		       sizeof(kbuf) - FAN_EVENT_METADATA_LEN);
+		fill_event_fids(FANOTIFY_E(event), kbuf, fsid_cache);
+	}
+
+	fd = metadata->fd;
 	ret = -EFAULT;
-	if (copy_to_user(buf, &fanotify_event_metadata,
-			 fanotify_event_metadata.event_len))
+	if (copy_to_user(buf, kbuf, metadata->event_len))
 		goto out_close_fd;
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
@@ -227,7 +333,7 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 
 	if (fd != FAN_NOFD)
 		fd_install(fd, f);
-	return fanotify_event_metadata.event_len;
+	return metadata->event_len;
 
 out_close_fd:
 	if (fd != FAN_NOFD) {
@@ -257,7 +363,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 {
 	struct fsnotify_group *group;
 	struct fsnotify_event *kevent;
+	struct fanotify_fsid_cache fsid_cache = { .sb = NULL };
 	char __user *start;
+	LIST_HEAD(batch);
 	int ret;
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
@@ -268,16 +376,15 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 
 	add_wait_queue(&group->notification_waitq, &wait);
 	while (1) {
-		mutex_lock(&group->notification_mutex);
-		kevent = get_one_event(group, count);
-		mutex_unlock(&group->notification_mutex);
-
-		if (IS_ERR(kevent)) {
-			ret = PTR_ERR(kevent);
-			break;
+		if (list_empty(&batch)) {
+			mutex_lock(&group->notification_mutex);
+			ret = get_events(group, count, &batch);
+			mutex_unlock(&group->notification_mutex);
+			if (ret < 0)
+				break;
 		}
 
-		if (!kevent) {
+		if (list_empty(&batch)) {
 			ret = -EAGAIN;
 			if (file->f_flags & O_NONBLOCK)
 				break;
@@ -293,7 +400,10 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 			continue;
 		}
 
-		ret = copy_event_to_user(group, kevent, buf);
+		kevent = list_first_entry(&batch, struct fsnotify_event, list);
+		list_del_init(&kevent->list);
+
+		ret = copy_event_to_user(group, kevent, buf, &fsid_cache);
 		/*
 		 * Permission events get queued to wait for response.  Other
 		 * events can be destroyed now.
@@ -320,6 +430,10 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	}
 	remove_wait_queue(&group->notification_waitq, &wait);
 
+	/* whatever was taken off the queue but not read goes back */
+	if (!list_empty(&batch))
+		fsnotify_requeue_events(group, &batch);
+
 	if (start != buf && ret != -EFAULT)
 		ret = buf - start;
 	return ret;
@@ -554,6 +668,36 @@ static int fanotify_remove_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_remove_sb_mark(struct fsnotify_group *group,
+				   struct super_block *sb, __u32 mask,
+				   unsigned int flags)
+{
+	struct fsnotify_mark *fsn_mark = NULL;
+	__u32 removed;
+	int destroy_mark;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_sb_mark(group, sb);
+	if (!fsn_mark) {
+		mutex_unlock(&group->mark_mutex);
+		return -ENOENT;
+	}
+
+	removed = fanotify_mark_remove_from_mask(fsn_mark, mask, flags,
+						 &destroy_mark);
+	if (destroy_mark)
+		fsnotify_detach_mark(fsn_mark);
+	mutex_unlock(&group->mark_mutex);
+	if (destroy_mark)
+		fsnotify_free_mark(fsn_mark);
+
+	fsnotify_put_mark(fsn_mark);
+	if (removed & sb->s_fsnotify_mask)
+		fsnotify_recalc_sb_mask(sb);
+
+	return 0;
+}
+
 static int fanotify_remove_inode_mark(struct fsnotify_group *group,
 				      struct inode *inode, __u32 mask,
 				      unsigned int flags)
@@ -616,7 +760,8 @@ static __u32 fanotify_mark_add_to_mask(struct fsnotify_mark *fsn_mark,
 
 static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 						   struct inode *inode,
-						   struct vfsmount *mnt)
+						   struct vfsmount *mnt,
+						   struct super_block *sb)
 {
 	struct fsnotify_mark *mark;
 	int ret;
@@ -629,7 +774,10 @@ static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 		return ERR_PTR(-ENOMEM);
 
 	fsnotify_init_mark(mark, fanotify_free_mark);
-	ret = fsnotify_add_mark_locked(mark, group, inode, mnt, 0);
+	if (sb)
+		ret = fsnotify_add_sb_mark_locked(mark, group, sb, 0);
+	else
+		ret = fsnotify_add_mark_locked(mark, group, inode, mnt, 0);
 	if (ret) {
 		fsnotify_put_mark(mark);
 		return ERR_PTR(ret);
@@ -649,7 +797,7 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	mutex_lock(&group->mark_mutex);
 	fsn_mark = fsnotify_find_vfsmount_mark(group, mnt);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, NULL, mnt);
+		fsn_mark = fanotify_add_new_mark(group, NULL, mnt, NULL);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -665,6 +813,32 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_add_sb_mark(struct fsnotify_group *group,
+				struct super_block *sb, __u32 mask,
+				unsigned int flags)
+{
+	struct fsnotify_mark *fsn_mark;
+	__u32 added;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_sb_mark(group, sb);
+	if (!fsn_mark) {
+		fsn_mark = fanotify_add_new_mark(group, NULL, NULL, sb);
+		if (IS_ERR(fsn_mark)) {
+			mutex_unlock(&group->mark_mutex);
+			return PTR_ERR(fsn_mark);
+		}
+	}
+	added = fanotify_mark_add_to_mask(fsn_mark, mask, flags);
+	mutex_unlock(&group->mark_mutex);
+
+	if (added & ~sb->s_fsnotify_mask)
+		fsnotify_recalc_sb_mask(sb);
+
+	fsnotify_put_mark(fsn_mark);
+	return 0;
+}
+
 static int fanotify_add_inode_mark(struct fsnotify_group *group,
 				   struct inode *inode, __u32 mask,
 				   unsigned int flags)
@@ -687,7 +861,7 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 	mutex_lock(&group->mark_mutex);
 	fsn_mark = fsnotify_find_inode_mark(group, inode);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, inode, NULL);
+		fsn_mark = fanotify_add_new_mark(group, inode, NULL, NULL);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -784,6 +958,14 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 		goto out_destroy_group;
 	}
 
+	/* permission events need an fd for the listener to inspect */
+	if (flags & FAN_REPORT_FID) {
+		fd = -EINVAL;
+		if ((flags & FAN_ALL_CLASS_BITS) != FAN_CLASS_NOTIF)
+			goto out_destroy_group;
+		group->fanotify_data.flags |= FAN_REPORT_FID;
+	}
+
 	if (flags & FAN_UNLIMITED_QUEUE) {
 		fd = -EPERM;
 		if (!capable(CAP_SYS_ADMIN))
@@ -819,6 +1001,7 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 {
 	struct inode *inode = NULL;
 	struct vfsmount *mnt = NULL;
+	struct super_block *sb = NULL;
 	struct fsnotify_group *group;
 	struct fd f;
 	struct path path;
@@ -833,6 +1016,8 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 
 	if (flags & ~FAN_ALL_MARK_FLAGS)
 		return -EINVAL;
+	if ((flags & FAN_MARK_MOUNT) && (flags & FAN_MARK_FILESYSTEM))
+		return -EINVAL;
 	switch (flags & (FAN_MARK_ADD | FAN_MARK_REMOVE | FAN_MARK_FLUSH)) {
 	case FAN_MARK_ADD:		/* fallthrough */
 	case FAN_MARK_REMOVE:
@@ -840,7 +1025,8 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 			return -EINVAL;
 		break;
 	case FAN_MARK_FLUSH:
-		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FLUSH))
+		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FILESYSTEM |
+			      FAN_MARK_FLUSH))
 			return -EINVAL;
 		break;
 	default:
@@ -882,6 +1068,8 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 		ret = 0;
 		if (flags & FAN_MARK_MOUNT)
 			fsnotify_clear_vfsmount_marks_by_group(group);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			fsnotify_clear_sb_marks_by_group(group);
 		else
 			fsnotify_clear_inode_marks_by_group(group);
 		goto fput_and_out;
@@ -892,22 +1080,28 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 		goto fput_and_out;
 
 	/* inode held in place by reference to path; group by fget on fd */
-	if (!(flags & FAN_MARK_MOUNT))
-		inode = path.dentry->d_inode;
-	else
+	if (flags & FAN_MARK_MOUNT)
 		mnt = path.mnt;
+	else if (flags & FAN_MARK_FILESYSTEM)
+		sb = path.mnt->mnt_sb;
+	else
+		inode = path.dentry->d_inode;
 
 	/* create/update an inode mark */
 	switch (flags & (FAN_MARK_ADD | FAN_MARK_REMOVE)) {
 	case FAN_MARK_ADD:
 		if (flags & FAN_MARK_MOUNT)
 			ret = fanotify_add_vfsmount_mark(group, mnt, mask, flags);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_add_sb_mark(group, sb, mask, flags);
 		else
 			ret = fanotify_add_inode_mark(group, inode, mask, flags);
 		break;
 	case FAN_MARK_REMOVE:
 		if (flags & FAN_MARK_MOUNT)
 			ret = fanotify_remove_vfsmount_mark(group, mnt, mask, flags);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_remove_sb_mark(group, sb, mask, flags);
 		else
 			ret = fanotify_remove_inode_mark(group, inode, mask, flags);
 		break;
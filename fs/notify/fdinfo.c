@@ -134,6 +134,10 @@ static void fanotify_fdinfo(struct seq_file *m, struct fsnotify_mark *mark)
 
 		seq_printf(m, "fanotify mnt_id:%x mflags:%x mask:%x ignored_mask:%x\n",
 			   mnt->mnt_id, mflags, mark->mask, mark->ignored_mask);
+	} else if (mark->flags & FSNOTIFY_MARK_FLAG_SB) {
+		seq_printf(m, "fanotify sdev:%x mflags:%x mask:%x ignored_mask:%x\n",
+			   mark->sb->s_dev, mflags, mark->mask,
+			   mark->ignored_mask);
 	}
 }
 
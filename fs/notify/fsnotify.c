@@ -191,8 +191,12 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 	     const unsigned char *file_name, u32 cookie)
 {
 	struct hlist_node *inode_node = NULL, *vfsmount_node = NULL;
+	struct hlist_node *sb_node = NULL;
 	struct fsnotify_mark *inode_mark = NULL, *vfsmount_mark = NULL;
-	struct fsnotify_group *inode_group, *vfsmount_group;
+	struct fsnotify_mark *sb_mark = NULL;
+	struct fsnotify_group *inode_group, *vfsmount_group, *sb_group;
+	struct fsnotify_group *group;
+	struct super_block *sb = to_tell->i_sb;
 	struct mount *mnt;
 	int idx, ret = 0;
 	/* global tests shouldn't care about events on child only the specific event */
@@ -211,7 +215,8 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 	 * need SRCU to keep them "alive".
 	 */
 	if (hlist_empty(&to_tell->i_fsnotify_marks) &&
-	    (!mnt || hlist_empty(&mnt->mnt_fsnotify_marks)))
+	    (!mnt || hlist_empty(&mnt->mnt_fsnotify_marks)) &&
+	    hlist_empty(&sb->s_fsnotify_marks))
 		return 0;
 	/*
 	 * if this is a modify event we may need to clear the ignored masks
@@ -220,7 +225,8 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 	 */
 	if (!(mask & FS_MODIFY) &&
 	    !(test_mask & to_tell->i_fsnotify_mask) &&
-	    !(mnt && test_mask & mnt->mnt_fsnotify_mask))
+	    !(mnt && test_mask & mnt->mnt_fsnotify_mask) &&
+	    !(test_mask & sb->s_fsnotify_mask))
 		return 0;
 
 	idx = srcu_read_lock(&fsnotify_mark_srcu);
@@ -238,16 +244,25 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 					      &fsnotify_mark_srcu);
 	}
 
+	if ((mask & FS_MODIFY) || (test_mask & sb->s_fsnotify_mask)) {
+		sb_node = srcu_dereference(sb->s_fsnotify_marks.first,
+					   &fsnotify_mark_srcu);
+		inode_node = srcu_dereference(to_tell->i_fsnotify_marks.first,
+					      &fsnotify_mark_srcu);
+	}
+
 	/*
-	 * We need to merge inode & vfsmount mark lists so that inode mark
-	 * ignore masks are properly reflected for mount mark notifications.
-	 * That's why this traversal is so complicated...
+	 * We need to merge inode, vfsmount & sb mark lists so that inode mark
+	 * ignore masks are properly reflected for mount and sb mark
+	 * notifications.  That's why this traversal is so complicated...
 	 */
-	while (inode_node || vfsmount_node) {
+	while (inode_node || vfsmount_node || sb_node) {
 		inode_group = NULL;
 		inode_mark = NULL;
 		vfsmount_group = NULL;
 		vfsmount_mark = NULL;
+		sb_group = NULL;
+		sb_mark = NULL;
 
 		if (inode_node) {
 			inode_mark = hlist_entry(srcu_dereference(inode_node, &fsnotify_mark_srcu),
@@ -261,19 +276,43 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 			vfsmount_group = vfsmount_mark->group;
 		}
 
-		if (inode_group && vfsmount_group) {
-			int cmp = fsnotify_compare_groups(inode_group,
-							  vfsmount_group);
-			if (cmp > 0) {
-				inode_group = NULL;
-				inode_mark = NULL;
-			} else if (cmp < 0) {
-				vfsmount_group = NULL;
-				vfsmount_mark = NULL;
-			}
+		if (sb_node) {
+			sb_mark = hlist_entry(srcu_dereference(sb_node, &fsnotify_mark_srcu),
+					      struct fsnotify_mark, obj_list);
+			sb_group = sb_mark->group;
 		}
-		ret = send_to_group(to_tell, inode_mark, vfsmount_mark, mask,
-				    data, data_is, cookie, file_name);
+
+		/* only the marks of the group that sorts first are used */
+		group = inode_group;
+		if (fsnotify_compare_groups(group, vfsmount_group) > 0)
+			group = vfsmount_group;
+		if (fsnotify_compare_groups(group, sb_group) > 0)
+			group = sb_group;
+		if (inode_group != group) {
+			inode_group = NULL;
+			inode_mark = NULL;
+		}
+		if (vfsmount_group != group) {
+			vfsmount_group = NULL;
+			vfsmount_mark = NULL;
+		}
+		if (sb_group != group) {
+			sb_group = NULL;
+			sb_mark = NULL;
+		}
+
+		/*
+		 * Backends see an sb mark in place of a vfsmount mark.  A group
+		 * with both gets the event once for each.
+		 */
+		if (vfsmount_mark || !sb_mark)
+			ret = send_to_group(to_tell, inode_mark, vfsmount_mark,
+					    mask, data, data_is, cookie,
+					    file_name);
+		if (sb_mark && !(ret && (mask & ALL_FSNOTIFY_PERM_EVENTS)))
+			ret = send_to_group(to_tell, inode_mark, sb_mark,
+					    mask, data, data_is, cookie,
+					    file_name);
 
 		if (ret && (mask & ALL_FSNOTIFY_PERM_EVENTS))
 			goto out;
@@ -284,6 +323,9 @@ int fsnotify(struct inode *to_tell, __u32 mask, void *data, int data_is,
 		if (vfsmount_group)
 			vfsmount_node = srcu_dereference(vfsmount_node->next,
 							 &fsnotify_mark_srcu);
+		if (sb_group)
+			sb_node = srcu_dereference(sb_node->next,
+						   &fsnotify_mark_srcu);
 	}
 	ret = 0;
 out:
@@ -142,7 +142,8 @@ int fsnotify_add_inode_mark(struct fsnotify_mark *mark,
 }
 
 /**
- * fsnotify_unmount_inodes - an sb is unmounting.  handle any watched inodes.
+ * fsnotify_unmount_inodes - an sb is unmounting.  handle any watched inodes
+ * and drop the marks on the sb itself.
  * @sb: superblock being unmounted.
  *
  * Called during unmount with no locks held, so needs to be safe against
@@ -224,4 +225,6 @@ void fsnotify_unmount_inodes(struct super_block *sb)
 		spin_lock(&sb->s_inode_list_lock);
 	}
 	spin_unlock(&sb->s_inode_list_lock);
+
+	fsnotify_clear_marks_by_sb(sb);
 }
@@ -155,6 +155,22 @@ struct fsnotify_event *fsnotify_remove_first_event(struct fsnotify_group *group)
 	return event;
 }
 
+/*
+ * Put events that were taken off with fsnotify_remove_first_event() but not
+ * consumed back at the head of the queue, keeping their order.
+ */
+void fsnotify_requeue_events(struct fsnotify_group *group,
+			     struct list_head *list)
+{
+	struct fsnotify_event *event;
+
+	mutex_lock(&group->notification_mutex);
+	list_for_each_entry(event, list, list)
+		group->q_len++;
+	list_splice_init(list, &group->notification_list);
+	mutex_unlock(&group->notification_mutex);
+}
+
 /*
  * This will not remove the event, that must be done with
  * fsnotify_remove_first_event()
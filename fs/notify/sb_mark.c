@@ -0,0 +1,98 @@
+/*
+ *  Superblock marks: one mark covers every inode of a filesystem, whichever
+ *  mount it is reached through.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+#include <linux/atomic.h>
+
+#include <linux/fsnotify_backend.h>
+#include "fsnotify.h"
+
+void fsnotify_clear_sb_marks_by_group(struct fsnotify_group *group)
+{
+	fsnotify_clear_marks_by_group_flags(group, FSNOTIFY_MARK_FLAG_SB);
+}
+
+/*
+ * Recalculate the sb->s_fsnotify_mask, or the mask of all FS_* event types
+ * any notifier is interested in hearing for this filesystem
+ */
+void fsnotify_recalc_sb_mask(struct super_block *sb)
+{
+	spin_lock(&sb->s_inode_list_lock);
+	sb->s_fsnotify_mask = fsnotify_recalc_mask(&sb->s_fsnotify_marks);
+	spin_unlock(&sb->s_inode_list_lock);
+}
+
+void fsnotify_destroy_sb_mark(struct fsnotify_mark *mark)
+{
+	struct super_block *sb = mark->sb;
+
+	BUG_ON(!mutex_is_locked(&mark->group->mark_mutex));
+	assert_spin_locked(&mark->lock);
+
+	spin_lock(&sb->s_inode_list_lock);
+
+	hlist_del_init_rcu(&mark->obj_list);
+	mark->sb = NULL;
+
+	sb->s_fsnotify_mask = fsnotify_recalc_mask(&sb->s_fsnotify_marks);
+	spin_unlock(&sb->s_inode_list_lock);
+}
+
+/*
+ * given a group and superblock, find the mark associated with that
+ * combination.  if found take a reference to that mark and return it, else
+ * return NULL
+ */
+struct fsnotify_mark *fsnotify_find_sb_mark(struct fsnotify_group *group,
+					    struct super_block *sb)
+{
+	struct fsnotify_mark *mark;
+
+	spin_lock(&sb->s_inode_list_lock);
+	mark = fsnotify_find_mark(&sb->s_fsnotify_marks, group);
+	spin_unlock(&sb->s_inode_list_lock);
+
+	return mark;
+}
+
+/*
+ * Attach an initialized mark to a given group and superblock.
+ */
+int fsnotify_add_sb_mark(struct fsnotify_mark *mark,
+			 struct fsnotify_group *group, struct super_block *sb,
+			 int allow_dups)
+{
+	int ret;
+
+	mark->flags |= FSNOTIFY_MARK_FLAG_SB;
+
+	BUG_ON(!mutex_is_locked(&group->mark_mutex));
+	assert_spin_locked(&mark->lock);
+
+	spin_lock(&sb->s_inode_list_lock);
+	mark->sb = sb;
+	ret = fsnotify_add_mark_list(&sb->s_fsnotify_marks, mark, allow_dups);
+	sb->s_fsnotify_mask = fsnotify_recalc_mask(&sb->s_fsnotify_marks);
+	spin_unlock(&sb->s_inode_list_lock);
+
+	return ret;
+}
@@ -208,7 +208,8 @@ int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 
 static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 			      struct dentry *dentry, struct path *lowerpath,
-			      struct kstat *stat, const char *link)
+			      struct kstat *stat, const char *link,
+			      bool metacopy)
 {
 	struct inode *wdir = workdir->d_inode;
 	struct inode *udir = upperdir->d_inode;
@@ -235,7 +236,12 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out2;
 
-	if (S_ISREG(stat->mode)) {
+	if (metacopy) {
+		/* data is copied later, see ovl_copy_up_meta_data() */
+		err = ovl_do_setxattr(newdentry, OVL_XATTR_METACOPY, "", 0, 0);
+		if (err)
+			goto out_cleanup;
+	} else if (S_ISREG(stat->mode)) {
 		struct path upperpath;
 		ovl_path_upper(dentry, &upperpath);
 		BUG_ON(upperpath.dentry != NULL);
@@ -260,6 +266,7 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	ovl_dentry_set_metacopy(dentry, metacopy);
 	ovl_dentry_update(dentry, newdentry);
 	newdentry = NULL;
 
@@ -294,9 +301,13 @@ out_cleanup:
  * up uses upper parent i_mutex for exclusion.  Since rename can change
  * d_parent it is possible that the copy up will lock the old parent.  At
  * that point the file will have already been copied up anyway.
+ *
+ * With @metacopy a regular file gets its upper inode and metadata only;
+ * reads keep going to the lower file until ovl_copy_up() fills in the data.
  */
 int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
-		    struct path *lowerpath, struct kstat *stat)
+		    struct path *lowerpath, struct kstat *stat,
+		    bool metacopy)
 {
 	struct dentry *workdir = ovl_workdir(dentry);
 	int err;
@@ -360,7 +371,7 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 
 	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
-				 stat, link);
+				 stat, link, metacopy);
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
@@ -377,7 +388,92 @@ out_free_link:
 	return err;
 }
 
-int ovl_copy_up(struct dentry *dentry)
+/*
+ * Copy the data of a metacopy file into its upper inode and clear the
+ * metacopy xattr.  The copy is done in place: until the xattr is removed
+ * the lower file stays authoritative, so an interrupted copy is simply
+ * redone next time.
+ */
+static int ovl_copy_up_meta_data(struct dentry *dentry)
+{
+	struct dentry *workdir = ovl_workdir(dentry);
+	struct dentry *parent;
+	struct dentry *upperdir;
+	struct path lowerpath;
+	struct path upperpath;
+	struct kstat stat;
+	struct kstat ustat;
+	const struct cred *old_cred;
+	struct cred *override_cred;
+	int err;
+
+	if (WARN_ON(!workdir))
+		return -EROFS;
+
+	ovl_path_lower(dentry, &lowerpath);
+	ovl_path_upper(dentry, &upperpath);
+
+	err = vfs_getattr(&lowerpath, &stat);
+	if (err)
+		return err;
+
+	err = vfs_getattr(&upperpath, &ustat);
+	if (err)
+		return err;
+
+	err = -ENOMEM;
+	override_cred = prepare_creds();
+	if (!override_cred)
+		return err;
+
+	/*
+	 * CAP_DAC_OVERRIDE for opening the files
+	 * CAP_SYS_ADMIN for removing the metacopy xattr
+	 * CAP_FOWNER for restoring timestamps
+	 */
+	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
+	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
+	cap_raise(override_cred->cap_effective, CAP_FOWNER);
+	old_cred = override_creds(override_cred);
+
+	parent = dget_parent(dentry);
+	upperdir = ovl_dentry_upper(parent);
+
+	err = -EIO;
+	if (lock_rename(workdir, upperdir) != NULL) {
+		pr_err("overlayfs: failed to lock workdir+upperdir\n");
+		goto out_unlock;
+	}
+
+	/* Raced with another data copy-up? */
+	err = 0;
+	if (!ovl_dentry_is_metacopy(dentry))
+		goto out_unlock;
+
+	err = ovl_copy_up_data(&lowerpath, &upperpath, stat.size);
+	if (err)
+		goto out_unlock;
+
+	err = ovl_do_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	if (err)
+		goto out_unlock;
+
+	ovl_dentry_set_metacopy(dentry, false);
+
+	/* Writing the data must not show up as a modification (best effort) */
+	mutex_lock(&upperpath.dentry->d_inode->i_mutex);
+	ovl_set_timestamps(upperpath.dentry, &ustat);
+	mutex_unlock(&upperpath.dentry->d_inode->i_mutex);
+out_unlock:
+	unlock_rename(workdir, upperdir);
+	dput(parent);
+	revert_creds(old_cred);
+	put_cred(override_cred);
+
+	return err;
+}
+
+static int __ovl_copy_up(struct dentry *dentry, bool metacopy)
 {
 	int err;
 
@@ -389,8 +485,11 @@ int ovl_copy_up(struct dentry *dentry)
 		struct kstat stat;
 		enum ovl_path_type type = ovl_path_type(dentry);
 
-		if (OVL_TYPE_UPPER(type))
+		if (OVL_TYPE_UPPER(type)) {
+			if (!metacopy && ovl_dentry_is_metacopy(dentry))
+				err = ovl_copy_up_meta_data(dentry);
 			break;
+		}
 
 		next = dget(dentry);
 		/* find the topmost dentry not yet copied up */
@@ -408,7 +507,9 @@ int ovl_copy_up(struct dentry *dentry)
 		ovl_path_lower(next, &lowerpath);
 		err = vfs_getattr(&lowerpath, &stat);
 		if (!err)
-			err = ovl_copy_up_one(parent, next, &lowerpath, &stat);
+			err = ovl_copy_up_one(parent, next, &lowerpath, &stat,
+					      metacopy && S_ISREG(stat.mode) &&
+					      stat.size);
 
 		dput(parent);
 		dput(next);
@@ -416,3 +517,18 @@ int ovl_copy_up(struct dentry *dentry)
 
 	return err;
 }
+
+/* Copy up @dentry and its ancestors, including all file data */
+int ovl_copy_up(struct dentry *dentry)
+{
+	return __ovl_copy_up(dentry, false);
+}
+
+/*
+ * Copy up for a metadata change.  With metacopy=on a regular file's data
+ * is left on the lower layer until it is opened for write.
+ */
+int ovl_copy_up_meta(struct dentry *dentry)
+{
+	return __ovl_copy_up(dentry, ovl_metacopy_enabled(dentry));
+}
@@ -30,7 +30,7 @@ static int ovl_copy_up_truncate(struct dentry *dentry)
 		goto out_dput_parent;
 
 	stat.size = 0;
-	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat);
+	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat, false);
 
 out_dput_parent:
 	dput(parent);
@@ -59,7 +59,11 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	/* Only a size change needs the data */
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up(dentry);
+	else
+		err = ovl_copy_up_meta(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
@@ -81,9 +85,22 @@ static int ovl_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
 	struct path realpath;
+	struct kstat lowerstat;
+	int err;
 
 	ovl_path_real(dentry, &realpath);
-	return vfs_getattr(&realpath, stat);
+	err = vfs_getattr(&realpath, stat);
+	if (err || !ovl_dentry_is_metacopy(dentry))
+		return err;
+
+	/* Size and allocation come from where the data is */
+	ovl_path_lower(dentry, &realpath);
+	err = vfs_getattr(&realpath, &lowerstat);
+	if (!err) {
+		stat->size = lowerstat.size;
+		stat->blocks = lowerstat.blocks;
+	}
+	return err;
 }
 
 int ovl_permission(struct inode *inode, int mask)
@@ -238,7 +255,7 @@ int ovl_setxattr(struct dentry *dentry, const char *name,
 	if (ovl_is_private_xattr(name))
 		goto out_drop_write;
 
-	err = ovl_copy_up(dentry);
+	err = ovl_copy_up_meta(dentry);
 	if (err)
 		goto out_drop_write;
 
@@ -255,7 +272,8 @@ static bool ovl_need_xattr_filter(struct dentry *dentry,
 				  enum ovl_path_type type)
 {
 	if ((type & (__OVL_PATH_PURE | __OVL_PATH_UPPER)) == __OVL_PATH_UPPER)
-		return S_ISDIR(dentry->d_inode->i_mode);
+		return S_ISDIR(dentry->d_inode->i_mode) ||
+		       S_ISREG(dentry->d_inode->i_mode);
 	else
 		return false;
 }
@@ -326,7 +344,7 @@ int ovl_removexattr(struct dentry *dentry, const char *name)
 		if (err < 0)
 			goto out_drop_write;
 
-		err = ovl_copy_up(dentry);
+		err = ovl_copy_up_meta(dentry);
 		if (err)
 			goto out_drop_write;
 
@@ -340,10 +358,11 @@ out:
 	return err;
 }
 
-static bool ovl_open_need_copy_up(int flags, enum ovl_path_type type,
+static bool ovl_open_need_copy_up(struct dentry *dentry, int flags,
+				  enum ovl_path_type type,
 				  struct dentry *realdentry)
 {
-	if (OVL_TYPE_UPPER(type))
+	if (OVL_TYPE_UPPER(type) && !ovl_dentry_is_metacopy(dentry))
 		return false;
 
 	if (special_file(realdentry->d_inode->i_mode))
@@ -365,12 +384,12 @@ struct inode *ovl_d_select_inode(struct dentry *dentry, unsigned file_flags)
 		return d_backing_inode(dentry);
 
 	type = ovl_path_real(dentry, &realpath);
-	if (ovl_open_need_copy_up(file_flags, type, realpath.dentry)) {
+	if (ovl_open_need_copy_up(dentry, file_flags, type, realpath.dentry)) {
 		err = ovl_want_write(dentry);
 		if (err)
 			return ERR_PTR(err);
 
-		if (file_flags & O_TRUNC)
+		if ((file_flags & O_TRUNC) && !OVL_TYPE_UPPER(type))
 			err = ovl_copy_up_truncate(dentry);
 		else
 			err = ovl_copy_up(dentry);
@@ -379,6 +398,9 @@ struct inode *ovl_d_select_inode(struct dentry *dentry, unsigned file_flags)
 			return ERR_PTR(err);
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (OVL_TYPE_UPPER(type) && ovl_dentry_is_metacopy(dentry)) {
+		/* read-only open of a metacopy file: data is still below */
+		ovl_path_lower(dentry, &realpath);
 	}
 
 	if (realpath.dentry->d_flags & DCACHE_OP_SELECT_INODE)
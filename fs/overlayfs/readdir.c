@@ -170,16 +170,16 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
-static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
+/*
+ * The dentry holds a reference on its current cache, so a merged directory
+ * is read only once until it is modified, not once per open.  Open files
+ * hold another reference while they iterate it.
+ */
+void ovl_cache_put(struct ovl_dir_cache *cache)
 {
-	struct ovl_dir_cache *cache = od->cache;
-
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(dentry) == cache)
-			ovl_set_dir_cache(dentry, NULL);
-
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
 	}
@@ -272,7 +272,7 @@ static void ovl_dir_reset(struct file *file)
 	enum ovl_path_type type = ovl_path_type(dentry);
 
 	if (cache && ovl_dentry_version_get(dentry) != cache->version) {
-		ovl_cache_put(od, dentry);
+		ovl_cache_put(cache);
 		od->cache = NULL;
 		od->cursor = NULL;
 	}
@@ -338,13 +338,17 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 		cache->refcount++;
 		return cache;
 	}
-	ovl_set_dir_cache(dentry, NULL);
+	if (cache) {
+		ovl_set_dir_cache(dentry, NULL);
+		ovl_cache_put(cache);
+	}
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
-	cache->refcount = 1;
+	/* one for the caller, one for the dentry */
+	cache->refcount = 2;
 	INIT_LIST_HEAD(&cache->entries);
 
 	res = ovl_dir_read_merged(dentry, &cache->entries);
@@ -480,7 +484,7 @@ static int ovl_dir_release(struct inode *inode, struct file *file)
 
 	if (od->cache) {
 		mutex_lock(&inode->i_mutex);
-		ovl_cache_put(od, file->f_path.dentry);
+		ovl_cache_put(od->cache);
 		mutex_unlock(&inode->i_mutex);
 	}
 	fput(od->realfile);
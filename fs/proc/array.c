@@ -83,6 +83,7 @@
 #include <linux/tracehook.h>
 #include <linux/string_helpers.h>
 #include <linux/user_namespace.h>
+#include <linux/proc_pidstats.h>
 
 #include <asm/pgtable.h>
 #include <asm/processor.h>
@@ -592,6 +593,60 @@ int proc_pid_statm(struct seq_file *m, struct pid_namespace *ns,
 	return 0;
 }
 
+/*
+ * Fill in the /proc/pidstats record for the thread group led by @task with
+ * the same values its stat and status files would show, minus the text.
+ * The io counters are left to the caller.
+ */
+void proc_fill_pidstats(struct pid_namespace *ns, struct task_struct *task,
+			struct proc_pidstats *ps)
+{
+	struct user_namespace *user_ns = current_user_ns();
+	cputime_t utime = 0, stime = 0;
+	const struct cred *cred;
+	struct mm_struct *mm;
+	unsigned long flags;
+
+	memset(ps, 0, sizeof(*ps));
+	ps->ps_size = sizeof(*ps);
+	ps->ps_pid = task_tgid_nr_ns(task, ns);
+	ps->ps_state = *get_task_state(task);
+
+	rcu_read_lock();
+	cred = __task_cred(task);
+	ps->ps_uid = from_kuid_munged(user_ns, cred->uid);
+	ps->ps_gid = from_kgid_munged(user_ns, cred->gid);
+	rcu_read_unlock();
+
+	if (lock_task_sighand(task, &flags)) {
+		struct signal_struct *sig = task->signal;
+		struct task_struct *t = task;
+
+		ps->ps_ppid = task_tgid_nr_ns(task->real_parent, ns);
+		ps->ps_num_threads = get_nr_threads(task);
+		ps->ps_min_flt = sig->min_flt;
+		ps->ps_maj_flt = sig->maj_flt;
+		do {
+			ps->ps_min_flt += t->min_flt;
+			ps->ps_maj_flt += t->maj_flt;
+		} while_each_thread(task, t);
+		thread_group_cputime_adjusted(task, &utime, &stime);
+
+		unlock_task_sighand(task, &flags);
+	}
+
+	ps->ps_utime_ns = cputime_to_nsecs(utime);
+	ps->ps_stime_ns = cputime_to_nsecs(stime);
+	ps->ps_start_time_ns = task->real_start_time;
+
+	mm = get_task_mm(task);
+	if (mm) {
+		ps->ps_vsize = task_vsize(mm);
+		ps->ps_rss = (u64)get_mm_rss(mm) << PAGE_SHIFT;
+		mmput(mm);
+	}
+}
+
 #ifdef CONFIG_PROC_CHILDREN
 static struct pid *
 get_children_pid(struct inode *inode, struct pid *pid_prev, loff_t pos)
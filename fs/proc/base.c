@@ -87,6 +87,7 @@
 #include <linux/slab.h>
 #include <linux/flex_array.h>
 #include <linux/posix-timers.h>
+#include <linux/proc_pidstats.h>
 #ifdef CONFIG_HARDWALL
 #include <asm/hardwall.h>
 #endif
@@ -2517,9 +2518,9 @@ static const struct file_operations proc_coredump_filter_operations = {
 #endif
 
 #ifdef CONFIG_TASK_IO_ACCOUNTING
-static int do_io_accounting(struct task_struct *task, struct seq_file *m, int whole)
+static int get_io_accounting(struct task_struct *task,
+			     struct task_io_accounting *acct, int whole)
 {
-	struct task_io_accounting acct = task->ioac;
 	unsigned long flags;
 	int result;
 
@@ -2532,15 +2533,31 @@ static int do_io_accounting(struct task_struct *task, struct seq_file *m, int wh
 		goto out_unlock;
 	}
 
+	*acct = task->ioac;
 	if (whole && lock_task_sighand(task, &flags)) {
 		struct task_struct *t = task;
 
-		task_io_accounting_add(&acct, &task->signal->ioac);
+		task_io_accounting_add(acct, &task->signal->ioac);
 		while_each_thread(task, t)
-			task_io_accounting_add(&acct, &t->ioac);
+			task_io_accounting_add(acct, &t->ioac);
 
 		unlock_task_sighand(task, &flags);
 	}
+
+out_unlock:
+	mutex_unlock(&task->signal->cred_guard_mutex);
+	return result;
+}
+
+static int do_io_accounting(struct task_struct *task, struct seq_file *m, int whole)
+{
+	struct task_io_accounting acct;
+	int result;
+
+	result = get_io_accounting(task, &acct, whole);
+	if (result)
+		return result;
+
 	seq_printf(m,
 		   "rchar: %llu\n"
 		   "wchar: %llu\n"
@@ -2556,11 +2573,7 @@ static int do_io_accounting(struct task_struct *task, struct seq_file *m, int wh
 		   (unsigned long long)acct.read_bytes,
 		   (unsigned long long)acct.write_bytes,
 		   (unsigned long long)acct.cancelled_write_bytes);
-	result = 0;
-
-out_unlock:
-	mutex_unlock(&task->signal->cred_guard_mutex);
-	return result;
+	return 0;
 }
 
 static int proc_tid_io_accounting(struct seq_file *m, struct pid_namespace *ns,
@@ -2766,6 +2779,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_PROC_PAGE_MONITOR
 	REG("clear_refs", S_IWUSR, proc_clear_refs_operations),
 	REG("smaps",      S_IRUGO, proc_pid_smaps_operations),
+	REG("smaps_rollup", S_IRUGO, proc_pid_smaps_rollup_operations),
 	REG("pagemap",    S_IRUSR, proc_pagemap_operations),
 #endif
 #ifdef CONFIG_SECURITY
@@ -3073,6 +3087,80 @@ int proc_pid_readdir(struct file *file, struct dir_context *ctx)
 	return 0;
 }
 
+/*
+ * /proc/pidstats: a binary record per visible thread group, so that a
+ * monitor can sample every process with a handful of reads instead of
+ * opening and parsing several text files per pid.  The file position is
+ * the next tgid to report.
+ */
+static ssize_t proc_pidstats_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct pid_namespace *ns = file_inode(file)->i_sb->s_fs_info;
+	struct proc_pidstats ps;
+	struct tgid_iter iter;
+	size_t done = 0;
+	int err = 0;
+
+	if (count < sizeof(ps))
+		return -EINVAL;
+	if (*ppos < 0 || *ppos >= PID_MAX_LIMIT)
+		return 0;
+
+	iter.tgid = *ppos;
+	iter.task = NULL;
+	for (iter = next_tgid(ns, iter);
+	     iter.task;
+	     iter.tgid += 1, iter = next_tgid(ns, iter)) {
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+		struct task_io_accounting acct;
+#endif
+
+		if (count - done < sizeof(ps) || fatal_signal_pending(current))
+			break;
+		if (!has_pid_permissions(ns, iter.task, 2))
+			continue;
+
+		proc_fill_pidstats(ns, iter.task, &ps);
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+		err = get_io_accounting(iter.task, &acct, 1);
+		if (!err) {
+			ps.ps_flags |= PROC_PIDSTATS_IO;
+			ps.ps_rchar = acct.rchar;
+			ps.ps_wchar = acct.wchar;
+			ps.ps_syscr = acct.syscr;
+			ps.ps_syscw = acct.syscw;
+			ps.ps_read_bytes = acct.read_bytes;
+			ps.ps_write_bytes = acct.write_bytes;
+			ps.ps_cancelled_write_bytes = acct.cancelled_write_bytes;
+		} else if (err == -EACCES) {
+			err = 0;
+		} else {
+			break;
+		}
+#endif
+		if (copy_to_user(buf + done, &ps, sizeof(ps))) {
+			err = -EFAULT;
+			break;
+		}
+		done += sizeof(ps);
+		*ppos = iter.tgid + 1;
+		cond_resched();
+	}
+
+	if (iter.task)
+		put_task_struct(iter.task);
+	else
+		*ppos = PID_MAX_LIMIT;
+
+	return done ? done : err;
+}
+
+const struct file_operations proc_pidstats_operations = {
+	.read		= proc_pidstats_read,
+	.llseek		= default_llseek,
+};
+
 /*
  * Tasks
  */
@@ -180,6 +180,7 @@ void __init proc_root_init(void)
 	proc_self_init();
 	proc_thread_self_init();
 	proc_symlink("mounts", NULL, "self/mounts");
+	proc_create("pidstats", S_IRUGO, NULL, &proc_pidstats_operations);
 
 	proc_net_init();
 
@@ -29,6 +29,7 @@
 #include <linux/module.h>
 #include <linux/pstore.h>
 #include <linux/zlib.h>
+#include <linux/lz4.h>
 #include <linux/string.h>
 #include <linux/timer.h>
 #include <linux/slab.h>
@@ -68,11 +69,14 @@ struct pstore_info *psinfo;
 
 static char *backend;
 
-/* Compression parameters */
-#define COMPR_LEVEL 6
-#define WINDOW_BITS 12
-#define MEM_LEVEL 4
-static struct z_stream_s stream;
+struct pstore_zbackend {
+	int (*compress)(const void *in, void *out, size_t inlen, size_t outlen);
+	int (*decompress)(void *in, void *out, size_t inlen, size_t outlen);
+	void (*allocate)(void);
+	void (*free)(void);
+
+	const char *name;
+};
 
 static char *big_oops_buf;
 static size_t big_oops_buf_sz;
@@ -129,9 +133,16 @@ bool pstore_cannot_block_path(enum kmsg_dump_reason reason)
 }
 EXPORT_SYMBOL_GPL(pstore_cannot_block_path);
 
+#ifdef CONFIG_PSTORE_ZLIB_COMPRESS
+/* zlib parameters */
+#define COMPR_LEVEL 6
+#define WINDOW_BITS 12
+#define MEM_LEVEL 4
+static struct z_stream_s stream;
+
 /* Derived from logfs_compress() */
-static int pstore_compress(const void *in, void *out, size_t inlen,
-							size_t outlen)
+static int compress_zlib(const void *in, void *out, size_t inlen,
+			 size_t outlen)
 {
 	int err, ret;
 
@@ -165,7 +176,7 @@ error:
 }
 
 /* Derived from logfs_uncompress */
-static int pstore_decompress(void *in, void *out, size_t inlen, size_t outlen)
+static int decompress_zlib(void *in, void *out, size_t inlen, size_t outlen)
 {
 	int err, ret;
 
@@ -194,7 +205,7 @@ error:
 	return ret;
 }
 
-static void allocate_buf_for_compression(void)
+static void allocate_zlib(void)
 {
 	size_t size;
 	size_t cmpr;
@@ -237,12 +248,137 @@ static void allocate_buf_for_compression(void)
 
 }
 
-static void free_buf_for_compression(void)
+static void free_zlib(void)
 {
 	kfree(stream.workspace);
 	stream.workspace = NULL;
 	kfree(big_oops_buf);
 	big_oops_buf = NULL;
+	big_oops_buf_sz = 0;
+}
+
+static const struct pstore_zbackend backend_zlib = {
+	.compress	= compress_zlib,
+	.decompress	= decompress_zlib,
+	.allocate	= allocate_zlib,
+	.free		= free_zlib,
+	.name		= "zlib",
+};
+#endif
+
+#ifdef CONFIG_PSTORE_LZ4_COMPRESS
+/*
+ * lz4 trades ratio for speed: the dump is compressed in a fraction of the
+ * time zlib takes, which matters when the records are written from the
+ * panic path.  Expect about half the ratio zlib gets on kernel logs.
+ */
+#define LZ4_RATIO 2
+
+static unsigned char *lz4_workspace;
+
+static int compress_lz4(const void *in, void *out, size_t inlen,
+			size_t outlen)
+{
+	size_t dst_len = min(outlen, inlen - 1);
+	int ret;
+
+	/*
+	 * Compress straight into the record; output that does not fit, or
+	 * would be no smaller than the input, fails and the caller falls
+	 * back to storing the dump uncompressed.
+	 */
+	ret = lz4_compress_fast(in, inlen, out, &dst_len, lz4_workspace,
+				LZ4_ACCELERATION_DEFAULT);
+	if (ret)
+		return -EIO;
+
+	return dst_len;
+}
+
+static int decompress_lz4(void *in, void *out, size_t inlen, size_t outlen)
+{
+	int ret;
+
+	ret = lz4_decompress_unknownoutputsize(in, inlen, out, &outlen);
+	if (ret) {
+		pr_err("lz4_decompress error, ret = %d!\n", ret);
+		return -EIO;
+	}
+
+	return outlen;
+}
+
+static void allocate_lz4(void)
+{
+	big_oops_buf_sz = psinfo->bufsize * LZ4_RATIO;
+
+	big_oops_buf = kmalloc(big_oops_buf_sz, GFP_KERNEL);
+	lz4_workspace = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	if (!big_oops_buf || !lz4_workspace) {
+		pr_err("No memory for compression buffers; skipping compression\n");
+		kfree(lz4_workspace);
+		lz4_workspace = NULL;
+		kfree(big_oops_buf);
+		big_oops_buf = NULL;
+	}
+}
+
+static void free_lz4(void)
+{
+	kfree(lz4_workspace);
+	lz4_workspace = NULL;
+	kfree(big_oops_buf);
+	big_oops_buf = NULL;
+	big_oops_buf_sz = 0;
+}
+
+static const struct pstore_zbackend backend_lz4 = {
+	.compress	= compress_lz4,
+	.decompress	= decompress_lz4,
+	.allocate	= allocate_lz4,
+	.free		= free_lz4,
+	.name		= "lz4",
+};
+#endif
+
+static const struct pstore_zbackend *zbackend =
+#if defined(CONFIG_PSTORE_ZLIB_COMPRESS)
+	&backend_zlib;
+#elif defined(CONFIG_PSTORE_LZ4_COMPRESS)
+	&backend_lz4;
+#else
+	NULL;
+#endif
+
+static int pstore_compress(const void *in, void *out,
+			   size_t inlen, size_t outlen)
+{
+	if (zbackend)
+		return zbackend->compress(in, out, inlen, outlen);
+
+	return -EIO;
+}
+
+static int pstore_decompress(void *in, void *out, size_t inlen, size_t outlen)
+{
+	if (zbackend)
+		return zbackend->decompress(in, out, inlen, outlen);
+
+	return -EIO;
+}
+
+static void allocate_buf_for_compression(void)
+{
+	if (zbackend) {
+		pr_info("using %s compression\n", zbackend->name);
+		zbackend->allocate();
+	}
+}
+
+static void free_buf_for_compression(void)
+{
+	if (zbackend)
+		zbackend->free();
 }
 
 /*
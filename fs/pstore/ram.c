@@ -34,6 +34,7 @@
 #include <linux/slab.h>
 #include <linux/compiler.h>
 #include <linux/pstore_ram.h>
+#include "internal.h"
 
 #define RAMOOPS_KERNMSG_HDR "===="
 #define MIN_MEM_SIZE 4096UL
@@ -55,6 +56,11 @@ static ulong ramoops_pmsg_size = MIN_MEM_SIZE;
 module_param_named(pmsg_size, ramoops_pmsg_size, ulong, 0400);
 MODULE_PARM_DESC(pmsg_size, "size of user space message log");
 
+static bool ramoops_ftrace_per_cpu;
+module_param_named(ftrace_per_cpu, ramoops_ftrace_per_cpu, bool, 0400);
+MODULE_PARM_DESC(ftrace_per_cpu,
+		"split the ftrace log into lockless per-CPU zones (default 0)");
+
 static ulong mem_address;
 module_param(mem_address, ulong, 0400);
 MODULE_PARM_DESC(mem_address,
@@ -85,7 +91,7 @@ MODULE_PARM_DESC(ramoops_ecc,
 struct ramoops_context {
 	struct persistent_ram_zone **przs;
 	struct persistent_ram_zone *cprz;
-	struct persistent_ram_zone *fprz;
+	struct persistent_ram_zone **fprzs;
 	struct persistent_ram_zone *mprz;
 	phys_addr_t phys_addr;
 	unsigned long size;
@@ -95,8 +101,10 @@ struct ramoops_context {
 	size_t ftrace_size;
 	size_t pmsg_size;
 	int dump_oops;
+	u32 flags;
 	struct persistent_ram_ecc_info ecc_info;
 	unsigned int max_dump_cnt;
+	unsigned int max_ftrace_cnt;
 	unsigned int dump_write_cnt;
 	/* _read_cnt need clear on ramoops_pstore_open */
 	unsigned int dump_read_cnt;
@@ -217,9 +225,10 @@ static ssize_t ramoops_pstore_read(u64 *id, enum pstore_type_id *type,
 	if (!prz_ok(prz))
 		prz = ramoops_get_next_prz(&cxt->cprz, &cxt->console_read_cnt,
 					   1, id, type, PSTORE_TYPE_CONSOLE, 0);
-	if (!prz_ok(prz))
-		prz = ramoops_get_next_prz(&cxt->fprz, &cxt->ftrace_read_cnt,
-					   1, id, type, PSTORE_TYPE_FTRACE, 0);
+	while (cxt->ftrace_read_cnt < cxt->max_ftrace_cnt && !prz_ok(prz))
+		prz = ramoops_get_next_prz(cxt->fprzs, &cxt->ftrace_read_cnt,
+					   cxt->max_ftrace_cnt, id, type,
+					   PSTORE_TYPE_FTRACE, 0);
 	if (!prz_ok(prz))
 		prz = ramoops_get_next_prz(&cxt->mprz, &cxt->pmsg_read_cnt,
 					   1, id, type, PSTORE_TYPE_PMSG, 0);
@@ -281,9 +290,12 @@ static int notrace ramoops_pstore_write_buf(enum pstore_type_id type,
 		persistent_ram_write(cxt->cprz, buf, size);
 		return 0;
 	} else if (type == PSTORE_TYPE_FTRACE) {
-		if (!cxt->fprz)
+		if (!cxt->max_ftrace_cnt)
 			return -ENOMEM;
-		persistent_ram_write(cxt->fprz, buf, size);
+		/* the tracer calls us with interrupts disabled */
+		prz = cxt->fprzs[cxt->max_ftrace_cnt > 1 ?
+				 smp_processor_id() : 0];
+		persistent_ram_write(prz, buf, size);
 		return 0;
 	} else if (type == PSTORE_TYPE_PMSG) {
 		if (!cxt->mprz)
@@ -345,7 +357,9 @@ static int ramoops_pstore_erase(enum pstore_type_id type, u64 id, int count,
 		prz = cxt->cprz;
 		break;
 	case PSTORE_TYPE_FTRACE:
-		prz = cxt->fprz;
+		if (id >= cxt->max_ftrace_cnt)
+			return -EINVAL;
+		prz = cxt->fprzs[id];
 		break;
 	case PSTORE_TYPE_PMSG:
 		prz = cxt->mprz;
@@ -412,7 +426,7 @@ static int ramoops_init_przs(struct device *dev, struct ramoops_context *cxt,
 	for (i = 0; i < cxt->max_dump_cnt; i++) {
 		cxt->przs[i] = persistent_ram_new(*paddr, cxt->record_size, 0,
 						  &cxt->ecc_info,
-						  cxt->memtype);
+						  cxt->memtype, 0);
 		if (IS_ERR(cxt->przs[i])) {
 			err = PTR_ERR(cxt->przs[i]);
 			dev_err(dev, "failed to request mem region (0x%zx@0x%llx): %d\n",
@@ -430,7 +444,7 @@ fail_prz:
 
 static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 			    struct persistent_ram_zone **prz,
-			    phys_addr_t *paddr, size_t sz, u32 sig)
+			    phys_addr_t *paddr, size_t sz, u32 sig, u32 flags)
 {
 	if (!sz)
 		return 0;
@@ -442,7 +456,8 @@ static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 		return -ENOMEM;
 	}
 
-	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info, cxt->memtype);
+	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info, cxt->memtype,
+				 flags);
 	if (IS_ERR(*prz)) {
 		int err = PTR_ERR(*prz);
 
@@ -458,6 +473,71 @@ static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 	return 0;
 }
 
+static void ramoops_free_fprzs(struct ramoops_context *cxt)
+{
+	int i;
+
+	if (!cxt->fprzs)
+		return;
+
+	for (i = 0; i < cxt->max_ftrace_cnt; i++)
+		persistent_ram_free(cxt->fprzs[i]);
+	kfree(cxt->fprzs);
+	cxt->fprzs = NULL;
+	cxt->max_ftrace_cnt = 0;
+}
+
+/*
+ * The ftrace log is either one zone shared by all CPUs, or, with
+ * RAMOOPS_FLAG_FTRACE_PER_CPU, one zone per possible CPU.  Each CPU then
+ * appends to its own zone with interrupts off, so the zones need no lock
+ * and function tracing does not bounce a cache line between CPUs.
+ */
+static int ramoops_init_fprzs(struct device *dev, struct ramoops_context *cxt,
+			      phys_addr_t *paddr)
+{
+	phys_addr_t end = *paddr + cxt->ftrace_size;
+	unsigned int i, cnt = 1;
+	u32 flags = 0;
+	size_t sz;
+	int err;
+
+	if (!cxt->ftrace_size)
+		return 0;
+
+	if (cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU) {
+		cnt = nr_cpu_ids;
+		flags = PRZ_FLAG_NO_LOCK;
+	}
+
+	sz = cxt->ftrace_size / cnt;
+	if (sz <= sizeof(struct pstore_ftrace_record) * 2) {
+		dev_err(dev, "ftrace_size 0x%zx too small for %u zones\n",
+			cxt->ftrace_size, cnt);
+		return -EINVAL;
+	}
+
+	cxt->fprzs = kcalloc(cnt, sizeof(*cxt->fprzs), GFP_KERNEL);
+	if (!cxt->fprzs)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		err = ramoops_init_prz(dev, cxt, &cxt->fprzs[i], paddr, sz,
+				       LINUX_VERSION_CODE, flags);
+		if (err)
+			goto fail;
+		cxt->max_ftrace_cnt = i + 1;
+	}
+
+	/* leave the rounding slack where it was */
+	*paddr = end;
+	return 0;
+
+fail:
+	ramoops_free_fprzs(cxt);
+	return err;
+}
+
 static int ramoops_probe(struct platform_device *pdev)
 {
 	struct device *dev = &pdev->dev;
@@ -497,6 +577,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	cxt->ftrace_size = pdata->ftrace_size;
 	cxt->pmsg_size = pdata->pmsg_size;
 	cxt->dump_oops = pdata->dump_oops;
+	cxt->flags = pdata->flags;
 	cxt->ecc_info = pdata->ecc_info;
 
 	paddr = cxt->phys_addr;
@@ -508,16 +589,16 @@ static int ramoops_probe(struct platform_device *pdev)
 		goto fail_out;
 
 	err = ramoops_init_prz(dev, cxt, &cxt->cprz, &paddr,
-			       cxt->console_size, 0);
+			       cxt->console_size, 0, 0);
 	if (err)
 		goto fail_init_cprz;
 
-	err = ramoops_init_prz(dev, cxt, &cxt->fprz, &paddr, cxt->ftrace_size,
-			       LINUX_VERSION_CODE);
+	err = ramoops_init_fprzs(dev, cxt, &paddr);
 	if (err)
 		goto fail_init_fprz;
 
-	err = ramoops_init_prz(dev, cxt, &cxt->mprz, &paddr, cxt->pmsg_size, 0);
+	err = ramoops_init_prz(dev, cxt, &cxt->mprz, &paddr, cxt->pmsg_size,
+			       0, 0);
 	if (err)
 		goto fail_init_mprz;
 
@@ -556,6 +637,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	ramoops_console_size = pdata->console_size;
 	ramoops_pmsg_size = pdata->pmsg_size;
 	ramoops_ftrace_size = pdata->ftrace_size;
+	ramoops_ftrace_per_cpu = !!(pdata->flags & RAMOOPS_FLAG_FTRACE_PER_CPU);
 
 	pr_info("attached 0x%lx@0x%llx, ecc: %d/%d\n",
 		cxt->size, (unsigned long long)cxt->phys_addr,
@@ -569,7 +651,7 @@ fail_clear:
 	cxt->pstore.bufsize = 0;
 	kfree(cxt->mprz);
 fail_init_mprz:
-	kfree(cxt->fprz);
+	ramoops_free_fprzs(cxt);
 fail_init_fprz:
 	kfree(cxt->cprz);
 fail_init_cprz:
@@ -589,7 +671,7 @@ static int ramoops_remove(struct platform_device *pdev)
 	cxt->pstore.bufsize = 0;
 
 	persistent_ram_free(cxt->mprz);
-	persistent_ram_free(cxt->fprz);
+	ramoops_free_fprzs(cxt);
 	persistent_ram_free(cxt->cprz);
 	ramoops_free_przs(cxt);
 
@@ -625,6 +707,8 @@ static void ramoops_register_dummy(void)
 	dummy_data->ftrace_size = ramoops_ftrace_size;
 	dummy_data->pmsg_size = ramoops_pmsg_size;
 	dummy_data->dump_oops = dump_oops;
+	if (ramoops_ftrace_per_cpu)
+		dummy_data->flags |= RAMOOPS_FLAG_FTRACE_PER_CPU;
 	/*
 	 * For backwards compatibility ramoops.ecc=1 means 16 bytes ECC
 	 * (using 1 byte for ECC isn't much of use anyway).
@@ -78,6 +78,28 @@ static struct buffer_head *get_block_length(struct super_block *sb,
 }
 
 
+/*
+ * Start reading the device blocks holding a datablock without waiting for
+ * them, so that several datablocks can be in flight before the first one
+ * is decompressed.  squashfs_read_data() later finds the buffers either
+ * uptodate or still locked for I/O.  READA may be dropped under
+ * congestion, in which case squashfs_read_data() simply issues the read.
+ */
+void squashfs_readahead_data(struct super_block *sb, u64 index, int length)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	u64 cur_index = index >> msblk->devblksize_log2;
+	int bytes = -(index & ((1 << msblk->devblksize_log2) - 1));
+
+	length = SQUASHFS_COMPRESSED_SIZE_BLOCK(length);
+	if (length < 0 || (index + length) > msblk->bytes_used)
+		return;
+
+	for (; bytes < length; cur_index++, bytes += msblk->devblksize)
+		sb_breadahead(sb, cur_index);
+}
+
+
 /*
  * Read and decompress a metadata block or datablock.  Length is non-zero
  * if a datablock is being read (the size is stored elsewhere in the
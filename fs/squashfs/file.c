@@ -47,6 +47,8 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/blkdev.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -497,7 +499,157 @@ out:
 	return 0;
 }
 
+/* A datablock whose pages are all part of the readahead window */
+struct squashfs_ra_block {
+	struct work_struct work;
+	struct super_block *sb;
+	struct page **page;
+	int pages;
+	u64 block;
+	int bsize;
+	int res;
+};
+
+static void squashfs_ra_block_work(struct work_struct *work)
+{
+	struct squashfs_ra_block *blk = container_of(work,
+		struct squashfs_ra_block, work);
+
+	blk->res = squashfs_readahead_block(blk->sb, blk->page, blk->pages,
+		blk->block, blk->bsize);
+}
+
+/*
+ * Read a batch of datablocks.  The device reads for all of them are issued
+ * under one plug before anything is decompressed, then the blocks are
+ * decompressed in parallel when there is more than one decompressor: all
+ * but the first are handed to unbound workers, each of which uses the
+ * decompressor of the CPU it runs on.
+ */
+static void squashfs_read_blocks(struct squashfs_ra_block *blk, int nr)
+{
+	struct blk_plug plug;
+	int i, n, inline_nr = nr;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++)
+		squashfs_readahead_data(blk[i].sb, blk[i].block, blk[i].bsize);
+	blk_finish_plug(&plug);
+
+	if (nr > 1 && squashfs_max_decompressors() > 1)
+		inline_nr = 1;
+
+	for (i = inline_nr; i < nr; i++) {
+		INIT_WORK(&blk[i].work, squashfs_ra_block_work);
+		queue_work(system_unbound_wq, &blk[i].work);
+	}
+
+	for (i = 0; i < inline_nr; i++)
+		squashfs_ra_block_work(&blk[i].work);
+
+	for (i = inline_nr; i < nr; i++)
+		flush_work(&blk[i].work);
+
+	for (i = 0; i < nr; i++) {
+		if (blk[i].res)
+			ERROR("Unable to read page, block %llx, size %x\n",
+				blk[i].block, blk[i].bsize);
+
+		for (n = 0; n < blk[i].pages; n++) {
+			struct page *page = blk[i].page[n];
+
+			flush_dcache_page(page);
+			if (blk[i].res)
+				SetPageError(page);
+			else
+				SetPageUptodate(page);
+			unlock_page(page);
+		}
+	}
+}
+
+/*
+ * Readahead.  Datablocks entirely covered by the readahead window are read
+ * as a batch by squashfs_read_blocks().  Everything else - blocks cut by
+ * the edges of the window or by pages already cached, sparse blocks and
+ * the fragment - goes through squashfs_readpage() as before.
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int mask = (1 << shift) - 1;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	pgoff_t last_page = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	gfp_t gfp = mapping_gfp_constraint(mapping, GFP_KERNEL);
+	struct squashfs_ra_block *blk;
+	struct page **page, *p, *tmp;
+	int i, j, k, n = 0, nr_blk = 0;
+
+	page = kmalloc_array(nr_pages, sizeof(*page), GFP_KERNEL);
+	blk = kmalloc_array(nr_pages, sizeof(*blk), GFP_KERNEL);
+	if (page == NULL || blk == NULL)
+		goto out;
+
+	/* Readahead queues pages at the head, walk back for ascending order */
+	list_for_each_entry_safe_reverse(p, tmp, pages, lru) {
+		list_del(&p->lru);
+		if (add_to_page_cache_lru(p, mapping, p->index, gfp)) {
+			page_cache_release(p);
+			continue;
+		}
+		page[n++] = p;
+	}
+
+	for (i = 0; i < n; i = j) {
+		int index = page[i]->index >> shift;
+		pgoff_t first = (pgoff_t) index << shift;
+		pgoff_t last = min_t(pgoff_t, first | mask, last_page);
+		u64 block = 0;
+		int bsize = 0;
+
+		for (j = i + 1; j < n && page[j]->index ==
+				page[i]->index + (j - i) &&
+				(page[j]->index >> shift) == index; j++)
+			;
+
+		if (page[i]->index == first && j - i == last - first + 1 &&
+				(index < file_end || squashfs_i(inode)->fragment_block
+					== SQUASHFS_INVALID_BLK))
+			bsize = read_blocklist(inode, index, &block);
+
+		if (bsize > 0) {
+			blk[nr_blk].sb = inode->i_sb;
+			blk[nr_blk].page = page + i;
+			blk[nr_blk].pages = j - i;
+			blk[nr_blk].block = block;
+			blk[nr_blk].bsize = bsize;
+			nr_blk++;
+			continue;
+		}
+
+		/* readpage grabs the rest of the block itself */
+		for (k = i + 1; k < j; k++)
+			unlock_page(page[k]);
+		squashfs_readpage(file, page[i]);
+	}
+
+	if (nr_blk)
+		squashfs_read_blocks(blk, nr_blk);
+
+	for (i = 0; i < n; i++)
+		page_cache_release(page[i]);
+
+out:
+	kfree(blk);
+	kfree(page);
+	return 0;
+}
+
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
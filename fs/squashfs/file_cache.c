@@ -36,3 +36,37 @@ int squashfs_readpage_block(struct page *page, u64 block, int bsize)
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+/*
+ * Read separately compressed datablock and memcopy into the complete,
+ * locked set of page cache pages readahead gathered for it.  The pages
+ * are left locked.
+ */
+int squashfs_readahead_block(struct super_block *sb, struct page **page,
+	int pages, u64 block, int bsize)
+{
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(sb,
+		block, bsize);
+	int bytes = buffer->length, res = buffer->error, n, offset = 0;
+	void *pageaddr;
+
+	if (res) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		goto out;
+	}
+
+	for (n = 0; n < pages; n++, bytes -= PAGE_CACHE_SIZE,
+			offset += PAGE_CACHE_SIZE) {
+		int avail = clamp_t(int, bytes, 0, PAGE_CACHE_SIZE);
+
+		pageaddr = kmap_atomic(page[n]);
+		squashfs_copy_data(pageaddr, buffer, offset, avail);
+		memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
+		kunmap_atomic(pageaddr);
+	}
+
+out:
+	squashfs_cache_put(buffer);
+	return res;
+}
@@ -137,6 +137,38 @@ out:
 }
 
 
+/*
+ * Decompress a datablock directly into the complete, locked set of page
+ * cache pages readahead gathered for it.  The pages are left locked.
+ */
+int squashfs_readahead_block(struct super_block *sb, struct page **page,
+	int pages, u64 block, int bsize)
+{
+	struct squashfs_page_actor *actor;
+	void *pageaddr;
+	int res, bytes;
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		return -ENOMEM;
+
+	res = squashfs_read_data(sb, block, bsize, NULL, actor);
+	kfree(actor);
+	if (res < 0)
+		return res;
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_CACHE_SIZE;
+	if (bytes) {
+		pageaddr = kmap_atomic(page[pages - 1]);
+		memset(pageaddr + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+
+	return 0;
+}
+
+
 static int squashfs_read_cache(struct page *target_page, u64 block, int bsize,
 	int pages, struct page **page)
 {
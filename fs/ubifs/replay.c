@@ -30,10 +30,20 @@
  * faster I/O speed because it writes the index less frequently. So this is a
  * trade-off. Also, the journal is indexed by the in-memory index (TNC), so the
  * larger is the journal, the more memory its index may consume.
+ *
+ * Scanning the buds is what takes the time, and the buds can be scanned
+ * independently of each other: every bud collects its nodes on a list of its
+ * own, and the lists are only merged and sorted by sequence number once all
+ * buds are scanned. So buds are scanned by several workers in parallel, each
+ * with a scan buffer of its own.
  */
 
 #include "ubifs.h"
 #include <linux/list_sort.h>
+#include <linux/workqueue.h>
+
+/* Maximum number of workers scanning buds at mount time */
+#define UBIFS_REPLAY_WORKERS 8
 
 /**
  * struct replay_entry - replay list entry.
@@ -76,6 +86,10 @@ struct replay_entry {
  * @sqnum: reference node sequence number
  * @free: free bytes in the bud
  * @dirty: dirty bytes in the bud
+ * @is_last: this is the last bud of its journal head
+ * @replay_list: replay entries of the nodes in this bud
+ * @max_sqnum: highest node sequence number in this bud
+ * @highest_inum: highest inode number in this bud
  */
 struct bud_entry {
 	struct list_head list;
@@ -83,6 +97,36 @@ struct bud_entry {
 	unsigned long long sqnum;
 	int free;
 	int dirty;
+	int is_last;
+	struct list_head replay_list;
+	unsigned long long max_sqnum;
+	ino_t highest_inum;
+};
+
+/**
+ * struct replay_scanner - state shared by the bud scanning workers.
+ * @c: UBIFS file-system description object
+ * @lock: protects @next and @err
+ * @next: next bud to scan, the list head once all buds are taken
+ * @err: first error a worker hit
+ */
+struct replay_scanner {
+	struct ubifs_info *c;
+	spinlock_t lock;
+	struct list_head *next;
+	int err;
+};
+
+/**
+ * struct replay_worker - a bud scanning worker.
+ * @work: the work item
+ * @scanner: state shared with the other workers
+ * @sbuf: LEB-sized scan buffer of this worker
+ */
+struct replay_worker {
+	struct work_struct work;
+	struct replay_scanner *scanner;
+	void *sbuf;
 };
 
 /**
@@ -336,6 +380,7 @@ static void destroy_replay_list(struct ubifs_info *c)
 /**
  * insert_node - insert a node to the replay list
  * @c: UBIFS file-system description object
+ * @b: the bud the node belongs to
  * @lnum: node logical eraseblock number
  * @offs: node offset
  * @len: node length
@@ -346,24 +391,24 @@ static void destroy_replay_list(struct ubifs_info *c)
  * @old_size: truncation old size
  * @new_size: truncation new size
  *
- * This function inserts a scanned non-direntry node to the replay list. The
- * replay list contains @struct replay_entry elements, and we sort this list in
- * sequence number order before applying it. The replay list is applied at the
- * very end of the replay process. Since the list is sorted in sequence number
- * order, the older modifications are applied first. This function returns zero
- * in case of success and a negative error code in case of failure.
+ * This function inserts a scanned non-direntry node to the replay list of bud
+ * @b. The replay lists contain @struct replay_entry elements; they are merged
+ * and sorted in sequence number order before being applied at the very end of
+ * the replay process. Since the list is sorted in sequence number order, the
+ * older modifications are applied first. This function returns zero in case of
+ * success and a negative error code in case of failure.
  */
-static int insert_node(struct ubifs_info *c, int lnum, int offs, int len,
-		       union ubifs_key *key, unsigned long long sqnum,
-		       int deletion, int *used, loff_t old_size,
-		       loff_t new_size)
+static int insert_node(struct ubifs_info *c, struct bud_entry *b, int lnum,
+		       int offs, int len, union ubifs_key *key,
+		       unsigned long long sqnum, int deletion, int *used,
+		       loff_t old_size, loff_t new_size)
 {
 	struct replay_entry *r;
 
 	dbg_mntk(key, "add LEB %d:%d, key ", lnum, offs);
 
-	if (key_inum(c, key) >= c->highest_inum)
-		c->highest_inum = key_inum(c, key);
+	if (key_inum(c, key) >= b->highest_inum)
+		b->highest_inum = key_inum(c, key);
 
 	r = kzalloc(sizeof(struct replay_entry), GFP_KERNEL);
 	if (!r)
@@ -380,13 +425,14 @@ static int insert_node(struct ubifs_info *c, int lnum, int offs, int len,
 	r->old_size = old_size;
 	r->new_size = new_size;
 
-	list_add_tail(&r->list, &c->replay_list);
+	list_add_tail(&r->list, &b->replay_list);
 	return 0;
 }
 
 /**
  * insert_dent - insert a directory entry node into the replay list.
  * @c: UBIFS file-system description object
+ * @b: the bud the node belongs to
  * @lnum: node logical eraseblock number
  * @offs: node offset
  * @len: node length
@@ -398,19 +444,20 @@ static int insert_node(struct ubifs_info *c, int lnum, int offs, int len,
  * @used: number of bytes in use in a LEB
  *
  * This function inserts a scanned directory entry node or an extended
- * attribute entry to the replay list. Returns zero in case of success and a
- * negative error code in case of failure.
+ * attribute entry to the replay list of bud @b. Returns zero in case of
+ * success and a negative error code in case of failure.
  */
-static int insert_dent(struct ubifs_info *c, int lnum, int offs, int len,
-		       union ubifs_key *key, const char *name, int nlen,
-		       unsigned long long sqnum, int deletion, int *used)
+static int insert_dent(struct ubifs_info *c, struct bud_entry *b, int lnum,
+		       int offs, int len, union ubifs_key *key,
+		       const char *name, int nlen, unsigned long long sqnum,
+		       int deletion, int *used)
 {
 	struct replay_entry *r;
 	char *nbuf;
 
 	dbg_mntk(key, "add LEB %d:%d, key ", lnum, offs);
-	if (key_inum(c, key) >= c->highest_inum)
-		c->highest_inum = key_inum(c, key);
+	if (key_inum(c, key) >= b->highest_inum)
+		b->highest_inum = key_inum(c, key);
 
 	r = kzalloc(sizeof(struct replay_entry), GFP_KERNEL);
 	if (!r)
@@ -435,7 +482,7 @@ static int insert_dent(struct ubifs_info *c, int lnum, int offs, int len,
 	nbuf[nlen] = '\0';
 	r->nm.name = nbuf;
 
-	list_add_tail(&r->list, &c->replay_list);
+	list_add_tail(&r->list, &b->replay_list);
 	return 0;
 }
 
@@ -533,14 +580,17 @@ static int is_last_bud(struct ubifs_info *c, struct ubifs_bud *bud)
  * replay_bud - replay a bud logical eraseblock.
  * @c: UBIFS file-system description object
  * @b: bud entry which describes the bud
+ * @sbuf: LEB-sized buffer to scan the bud into
  *
  * This function replays bud @bud, recovers it if needed, and adds all nodes
- * from this bud to the replay list. Returns zero in case of success and a
- * negative error code in case of failure.
+ * from this bud to its replay list. It touches nothing shared with other buds
+ * unless the bud needs recovery, so buds which do not may be replayed in
+ * parallel. Returns zero in case of success and a negative error code in case
+ * of failure.
  */
-static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
+static int replay_bud(struct ubifs_info *c, struct bud_entry *b, void *sbuf)
 {
-	int is_last = is_last_bud(c, b->bud);
+	int is_last = b->is_last;
 	int err = 0, used = 0, lnum = b->bud->lnum, offs = b->bud->start;
 	struct ubifs_scan_leb *sleb;
 	struct ubifs_scan_node *snod;
@@ -555,9 +605,9 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 		 * these LEBs could possibly be written to at the power cut
 		 * time.
 		 */
-		sleb = ubifs_recover_leb(c, lnum, offs, c->sbuf, b->bud->jhead);
+		sleb = ubifs_recover_leb(c, lnum, offs, sbuf, b->bud->jhead);
 	else
-		sleb = ubifs_scan(c, lnum, offs, c->sbuf, 0);
+		sleb = ubifs_scan(c, lnum, offs, sbuf, 0);
 	if (IS_ERR(sleb))
 		return PTR_ERR(sleb);
 
@@ -593,8 +643,8 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 			goto out_dump;
 		}
 
-		if (snod->sqnum > c->max_sqnum)
-			c->max_sqnum = snod->sqnum;
+		if (snod->sqnum > b->max_sqnum)
+			b->max_sqnum = snod->sqnum;
 
 		switch (snod->type) {
 		case UBIFS_INO_NODE:
@@ -604,7 +654,7 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 
 			if (le32_to_cpu(ino->nlink) == 0)
 				deletion = 1;
-			err = insert_node(c, lnum, snod->offs, snod->len,
+			err = insert_node(c, b, lnum, snod->offs, snod->len,
 					  &snod->key, snod->sqnum, deletion,
 					  &used, 0, new_size);
 			break;
@@ -616,7 +666,7 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 					  key_block(c, &snod->key) *
 					  UBIFS_BLOCK_SIZE;
 
-			err = insert_node(c, lnum, snod->offs, snod->len,
+			err = insert_node(c, b, lnum, snod->offs, snod->len,
 					  &snod->key, snod->sqnum, deletion,
 					  &used, 0, new_size);
 			break;
@@ -630,7 +680,7 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 			if (err)
 				goto out_dump;
 
-			err = insert_dent(c, lnum, snod->offs, snod->len,
+			err = insert_dent(c, b, lnum, snod->offs, snod->len,
 					  &snod->key, dent->name,
 					  le16_to_cpu(dent->nlen), snod->sqnum,
 					  !le64_to_cpu(dent->inum), &used);
@@ -656,7 +706,7 @@ static int replay_bud(struct ubifs_info *c, struct bud_entry *b)
 			 * functions which expect nodes to have keys.
 			 */
 			trun_key_init(c, &key, le32_to_cpu(trun->inum));
-			err = insert_node(c, lnum, snod->offs, snod->len,
+			err = insert_node(c, b, lnum, snod->offs, snod->len,
 					  &key, snod->sqnum, 1, &used,
 					  old_size, new_size);
 			break;
@@ -691,29 +741,149 @@ out_dump:
 	return -EINVAL;
 }
 
+/**
+ * replay_worker_fn - scan buds until there are none left.
+ * @work: the work item of a &struct replay_worker
+ *
+ * Buds which need recovery are skipped, they are replayed afterwards by
+ * 'replay_buds()' alone.
+ */
+static void replay_worker_fn(struct work_struct *work)
+{
+	struct replay_worker *w = container_of(work, struct replay_worker,
+					       work);
+	struct replay_scanner *s = w->scanner;
+	struct ubifs_info *c = s->c;
+	struct bud_entry *b;
+	int err;
+
+	while (1) {
+		spin_lock(&s->lock);
+		if (s->err || s->next == &c->replay_buds) {
+			spin_unlock(&s->lock);
+			return;
+		}
+		b = list_entry(s->next, struct bud_entry, list);
+		s->next = s->next->next;
+		spin_unlock(&s->lock);
+
+		if (c->need_recovery && b->is_last)
+			continue;
+
+		err = replay_bud(c, b, w->sbuf);
+		if (err) {
+			spin_lock(&s->lock);
+			if (!s->err)
+				s->err = err;
+			spin_unlock(&s->lock);
+			return;
+		}
+	}
+}
+
+/**
+ * scan_buds - scan the buds with several workers in parallel.
+ * @c: UBIFS file-system description object
+ * @nr_buds: number of buds to replay
+ *
+ * The calling thread is one of the workers and uses @c->sbuf; the others get
+ * a buffer of their own for as long as memory allows. This function returns
+ * zero in case of success and a negative error code in case of failure.
+ */
+static int scan_buds(struct ubifs_info *c, int nr_buds)
+{
+	struct replay_scanner scanner;
+	struct replay_worker *workers;
+	int i, nr_workers;
+
+	nr_workers = min3(nr_buds, (int)num_online_cpus(),
+			  UBIFS_REPLAY_WORKERS);
+	workers = kcalloc(nr_workers, sizeof(struct replay_worker),
+			  GFP_KERNEL);
+	if (!workers)
+		nr_workers = 0;
+
+	spin_lock_init(&scanner.lock);
+	scanner.c = c;
+	scanner.next = c->replay_buds.next;
+	scanner.err = 0;
+
+	for (i = 1; i < nr_workers; i++) {
+		workers[i].sbuf = vmalloc(c->leb_size);
+		if (!workers[i].sbuf)
+			break;
+		workers[i].scanner = &scanner;
+		INIT_WORK(&workers[i].work, replay_worker_fn);
+		queue_work(system_unbound_wq, &workers[i].work);
+	}
+	nr_workers = i;
+	dbg_mnt("scanning %d buds with %d workers", nr_buds,
+		max(nr_workers, 1));
+
+	{
+		struct replay_worker self = {
+			.scanner = &scanner,
+			.sbuf = c->sbuf,
+		};
+
+		replay_worker_fn(&self.work);
+	}
+
+	for (i = 1; i < nr_workers; i++) {
+		flush_work(&workers[i].work);
+		vfree(workers[i].sbuf);
+	}
+	kfree(workers);
+
+	return scanner.err;
+}
+
 /**
  * replay_buds - replay all buds.
  * @c: UBIFS file-system description object
  *
+ * Buds are scanned in parallel by 'scan_buds()', except for those which need
+ * recovery: these are few, may be written to, and are replayed one by one
+ * afterwards. The per-bud replay lists are then merged into @c->replay_list.
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  */
 static int replay_buds(struct ubifs_info *c)
 {
 	struct bud_entry *b;
-	int err;
+	int err, nr_buds = 0;
 	unsigned long long prev_sqnum = 0;
 
 	list_for_each_entry(b, &c->replay_buds, list) {
-		err = replay_bud(c, b);
-		if (err)
-			return err;
-
 		ubifs_assert(b->sqnum > prev_sqnum);
 		prev_sqnum = b->sqnum;
+		b->is_last = is_last_bud(c, b->bud);
+		nr_buds += 1;
 	}
 
-	return 0;
+	err = scan_buds(c, nr_buds);
+	if (err)
+		goto out;
+
+	if (c->need_recovery) {
+		list_for_each_entry(b, &c->replay_buds, list) {
+			if (!b->is_last)
+				continue;
+			err = replay_bud(c, b, c->sbuf);
+			if (err)
+				goto out;
+		}
+	}
+
+out:
+	list_for_each_entry(b, &c->replay_buds, list) {
+		list_splice_tail_init(&b->replay_list, &c->replay_list);
+		if (b->max_sqnum > c->max_sqnum)
+			c->max_sqnum = b->max_sqnum;
+		if (b->highest_inum > c->highest_inum)
+			c->highest_inum = b->highest_inum;
+	}
+	return err;
 }
 
 /**
@@ -754,11 +924,12 @@ static int add_replay_bud(struct ubifs_info *c, int lnum, int offs, int jhead,
 	if (!bud)
 		return -ENOMEM;
 
-	b = kmalloc(sizeof(struct bud_entry), GFP_KERNEL);
+	b = kzalloc(sizeof(struct bud_entry), GFP_KERNEL);
 	if (!b) {
 		kfree(bud);
 		return -ENOMEM;
 	}
+	INIT_LIST_HEAD(&b->replay_list);
 
 	bud->lnum = lnum;
 	bud->start = offs;
@@ -145,7 +145,7 @@ typedef struct xfs_buf {
 	 * which is the only bit that is touched if we hit the semaphore
 	 * fast-path on locking.
 	 */
-	struct rb_node		b_rbnode;	/* rbtree node */
+	struct rhash_head	b_rhash_head;	/* pag buffer hash node */
 	xfs_daddr_t		b_bn;		/* block number of buffer */
 	int			b_length;	/* size of buffer in BBs */
 	atomic_t		b_hold;		/* reference count */
@@ -163,7 +163,7 @@ typedef struct xfs_buf {
 	int			b_io_error;	/* internal IO error state */
 	wait_queue_head_t	b_waiters;	/* unpin waiters */
 	struct list_head	b_list;
-	struct xfs_perag	*b_pag;		/* contains rbtree root */
+	struct xfs_perag	*b_pag;		/* contains buffer hash */
 	xfs_buftarg_t		*b_target;	/* buffer target (device) */
 	void			*b_addr;	/* virtual address of buffer */
 	struct work_struct	b_ioend_work;
@@ -184,6 +184,7 @@ typedef struct xfs_buf {
 	unsigned int		b_offset;	/* page offset in first page */
 	int			b_error;	/* error code on I/O */
 	const struct xfs_buf_ops	*b_ops;
+	struct rcu_head		b_rcu;		/* lockless lookups may see us */
 
 #ifdef XFS_BUF_LOCK_TRACKING
 	int			b_last_holder;
@@ -859,6 +859,7 @@ write_retry:
 
 		enospc = 1;
 		xfs_flush_inodes(ip->i_mount);
+		xfs_inactive_flush(ip->i_mount);
 		eofb.eof_scan_owner = ip->i_ino; /* for locking */
 		eofb.eof_flags = XFS_EOF_FLAGS_SYNC;
 		xfs_icache_free_eofblocks(ip->i_mount, &eofb);
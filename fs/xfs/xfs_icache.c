@@ -182,6 +182,19 @@ xfs_iget_cache_hit(
 		goto out_error;
 	}
 
+	/*
+	 * Inodes waiting for or going through background inactivation are
+	 * unlinked and as good as gone.  The only lookup that can legitimately
+	 * find one is a create reusing the inode number after the worker has
+	 * freed it, and that has to wait until the inode is handed over to
+	 * reclaim and can be recycled below.
+	 */
+	if (ip->i_flags & (XFS_NEED_INACTIVE | XFS_INACTIVATING)) {
+		trace_xfs_iget_skip(ip);
+		error = (flags & XFS_IGET_CREATE) ? -EAGAIN : -ENOENT;
+		goto out_error;
+	}
+
 	/*
 	 * If lookup is racing with unlink return an error immediately.
 	 */
@@ -777,6 +790,107 @@ xfs_inode_set_reclaim_tag(
 	xfs_perag_put(pag);
 }
 
+/*
+ * Queue an unlinked inode for background inactivation.  The inode stays in
+ * the cache, tagged so the per-AG worker can find it, until it has been
+ * freed and handed over to reclaim.
+ */
+void
+xfs_inode_set_inactive_tag(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_perag	*pag;
+
+	pag = xfs_perag_get(mp, XFS_INO_TO_AGNO(mp, ip->i_ino));
+	spin_lock(&pag->pag_ici_lock);
+	spin_lock(&ip->i_flags_lock);
+	radix_tree_tag_set(&pag->pag_ici_root, XFS_INO_TO_AGINO(mp, ip->i_ino),
+			   XFS_ICI_INACTIVE_TAG);
+	__xfs_iflags_set(ip, XFS_NEED_INACTIVE);
+	spin_unlock(&ip->i_flags_lock);
+	spin_unlock(&pag->pag_ici_lock);
+
+	queue_work(mp->m_inactive_workqueue, &pag->pag_inactive_work);
+	xfs_perag_put(pag);
+}
+
+/*
+ * Inactivate every inode queued on this AG.  Inodes are pulled off the
+ * tag in batches under pag_ici_lock, which also keeps them from being
+ * removed from the tree under us, and inactivated without it.  Anything
+ * queued while a batch is being processed is picked up by the next lookup,
+ * so a busy unlinker keeps the worker going rather than requeueing it.
+ */
+void
+xfs_inactive_worker(
+	struct work_struct	*work)
+{
+	struct xfs_perag	*pag = container_of(work, struct xfs_perag,
+						    pag_inactive_work);
+	struct xfs_mount	*mp = pag->pag_mount;
+	int			nr_found;
+
+	do {
+		struct xfs_inode *batch[XFS_LOOKUP_BATCH];
+		int	i;
+
+		spin_lock(&pag->pag_ici_lock);
+		nr_found = radix_tree_gang_lookup_tag(&pag->pag_ici_root,
+					(void **)batch, 0, XFS_LOOKUP_BATCH,
+					XFS_ICI_INACTIVE_TAG);
+		for (i = 0; i < nr_found; i++) {
+			struct xfs_inode *ip = batch[i];
+
+			radix_tree_tag_clear(&pag->pag_ici_root,
+					XFS_INO_TO_AGINO(mp, ip->i_ino),
+					XFS_ICI_INACTIVE_TAG);
+			spin_lock(&ip->i_flags_lock);
+			ASSERT(__xfs_iflags_test(ip, XFS_NEED_INACTIVE));
+			ip->i_flags &= ~XFS_NEED_INACTIVE;
+			ip->i_flags |= XFS_INACTIVATING;
+			spin_unlock(&ip->i_flags_lock);
+		}
+		spin_unlock(&pag->pag_ici_lock);
+
+		for (i = 0; i < nr_found; i++) {
+			struct xfs_inode *ip = batch[i];
+
+			xfs_inactive(ip);
+			ASSERT(XFS_FORCED_SHUTDOWN(mp) ||
+			       ip->i_delayed_blks == 0);
+
+			spin_lock(&pag->pag_ici_lock);
+			spin_lock(&ip->i_flags_lock);
+			__xfs_inode_set_reclaim_tag(pag, ip);
+			ip->i_flags &= ~XFS_INACTIVATING;
+			__xfs_iflags_set(ip, XFS_IRECLAIMABLE);
+			spin_unlock(&ip->i_flags_lock);
+			spin_unlock(&pag->pag_ici_lock);
+		}
+
+		cond_resched();
+	} while (nr_found);
+}
+
+/*
+ * Wait for all queued inactivation to finish, so that the space and inodes
+ * of files that have already been unlinked are really free.
+ */
+void
+xfs_inactive_flush(
+	struct xfs_mount	*mp)
+{
+	struct xfs_perag	*pag;
+	xfs_agnumber_t		agno;
+
+	for (agno = 0; agno < mp->m_sb.sb_agcount; agno++) {
+		pag = xfs_perag_get(mp, agno);
+		flush_work(&pag->pag_inactive_work);
+		xfs_perag_put(pag);
+	}
+}
+
 STATIC void
 __xfs_inode_clear_reclaim(
 	xfs_perag_t	*pag,
@@ -77,6 +77,7 @@ typedef __u32			xfs_nlink_t;
 #include <linux/kthread.h>
 #include <linux/freezer.h>
 #include <linux/list_sort.h>
+#include <linux/rhashtable.h>
 #include <linux/ratelimit.h>
 
 #include <asm/page.h>
@@ -257,6 +257,16 @@ struct xfs_cil_ctx {
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct xfs_log_callback	log_cb;		/* completion callback hook. */
 	struct list_head	committing;	/* ctx committing list */
+	atomic_t		order_id;	/* commit order of items */
+	struct work_struct	push_work;	/* writes the checkpoint */
+};
+
+/*
+ * Log items are added to the CIL on the CPU that commits them and only
+ * gathered into one list, in commit order, when the CIL is pushed.
+ */
+struct xlog_cil_pcp {
+	struct list_head	log_items;
 };
 
 /*
@@ -277,8 +287,9 @@ struct xfs_cil_ctx {
  */
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xlog_cil_pcp __percpu *xc_pcp;
+	spinlock_t		xc_cil_lock;	/* context space accounting */
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
 	struct xfs_cil_ctx	*xc_ctx;
@@ -288,9 +299,12 @@ struct xfs_cil {
 	struct list_head	xc_committing;
 	wait_queue_head_t	xc_commit_wait;
 	xfs_lsn_t		xc_current_sequence;
-	struct work_struct	xc_push_work;
+	struct work_struct	xc_push_work;	/* switches the context */
 } ____cacheline_aligned_in_smp;
 
+/* xc_flags bits */
+#define XLOG_CIL_EMPTY		0	/* nothing committed to xc_ctx yet */
+
 /*
  * The amount of log space we allow the CIL to aggregate is difficult to size.
  * Whatever we choose, we have to make sure we can get a reservation for the
@@ -4120,6 +4120,9 @@ xlog_recover_process_iunlinks(
 		xfs_buf_rele(agibp);
 	}
 
+	/* the inodes released above are freed in the background */
+	xfs_inactive_flush(mp);
+
 	mp->m_dmevmask = mp_dmevmask;
 }
 
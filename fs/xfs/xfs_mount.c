@@ -154,6 +154,7 @@ xfs_free_perag(
 		spin_unlock(&mp->m_perag_lock);
 		ASSERT(pag);
 		ASSERT(atomic_read(&pag->pag_ref) == 0);
+		xfs_buf_hash_destroy(pag);
 		call_rcu(&pag->rcu_head, __xfs_free_perag);
 	}
 }
@@ -211,12 +212,14 @@ xfs_initialize_perag(
 		pag->pag_mount = mp;
 		spin_lock_init(&pag->pag_ici_lock);
 		mutex_init(&pag->pag_ici_reclaim_lock);
+		INIT_WORK(&pag->pag_inactive_work, xfs_inactive_worker);
 		INIT_RADIX_TREE(&pag->pag_ici_root, GFP_ATOMIC);
 		spin_lock_init(&pag->pag_buf_lock);
-		pag->pag_buf_tree = RB_ROOT;
+		if (xfs_buf_hash_init(pag))
+			goto out_free_pag;
 
 		if (radix_tree_preload(GFP_NOFS))
-			goto out_unwind;
+			goto out_hash_destroy;
 
 		spin_lock(&mp->m_perag_lock);
 		if (radix_tree_insert(&mp->m_perag_tree, index, pag)) {
@@ -224,7 +227,7 @@ xfs_initialize_perag(
 			spin_unlock(&mp->m_perag_lock);
 			radix_tree_preload_end();
 			error = -EEXIST;
-			goto out_unwind;
+			goto out_hash_destroy;
 		}
 		spin_unlock(&mp->m_perag_lock);
 		radix_tree_preload_end();
@@ -251,10 +254,16 @@ xfs_initialize_perag(
 		*maxagi = index;
 	return 0;
 
-out_unwind:
+out_hash_destroy:
+	xfs_buf_hash_destroy(pag);
+out_free_pag:
 	kmem_free(pag);
+out_unwind:
 	for (; index > first_initialised; index--) {
 		pag = radix_tree_delete(&mp->m_perag_tree, index);
+		if (!pag)
+			continue;
+		xfs_buf_hash_destroy(pag);
 		kmem_free(pag);
 	}
 	return error;
@@ -1006,6 +1015,7 @@ xfs_unmountfs(
 	int			error;
 
 	cancel_delayed_work_sync(&mp->m_eofblocks_work);
+	xfs_inactive_flush(mp);
 
 	xfs_qm_unmount_quotas(mp);
 	xfs_rtunmount_inodes(mp);
@@ -1162,6 +1172,8 @@ xfs_mod_ifree(
  * allocation path for buffered writes (page a time updates). Hence we set
  * a large batch count (1024) to minimise global counter updates except when
  * we get near to ENOSPC and we have to be very accurate with our updates.
+ * The batch shrinks with the distance to the set aside blocks, see
+ * percpu_counter_tuned_batch().
  */
 #define XFS_FDBLOCKS_BATCH	1024
 int
@@ -1200,21 +1212,20 @@ xfs_mod_fdblocks(
 
 	/*
 	 * Taking blocks away, need to be more accurate the closer we
-	 * are to zero.
-	 *
-	 * If the counter has a value of less than 2 * max batch size,
-	 * then make everything serialise as we are real close to
-	 * ENOSPC.
+	 * are to zero, down to serialising everything as we get real
+	 * close to ENOSPC.  Deciding that only needs the rough count.
+	 * Close in, the per-cpu counts are added up without the counter
+	 * lock; the tuned batch keeps what races with that walk smaller
+	 * than the distance to the set aside blocks.
 	 */
-	if (__percpu_counter_compare(&mp->m_fdblocks, 2 * XFS_FDBLOCKS_BATCH,
-				     XFS_FDBLOCKS_BATCH) < 0)
-		batch = 1;
-	else
-		batch = XFS_FDBLOCKS_BATCH;
+	batch = __percpu_counter_tuned_batch(&mp->m_fdblocks,
+					     XFS_ALLOC_SET_ASIDE(mp),
+					     XFS_FDBLOCKS_BATCH);
 
 	__percpu_counter_add(&mp->m_fdblocks, delta, batch);
-	if (__percpu_counter_compare(&mp->m_fdblocks, XFS_ALLOC_SET_ASIDE(mp),
-				     XFS_FDBLOCKS_BATCH) >= 0) {
+	if (__percpu_counter_compare_approx(&mp->m_fdblocks,
+					    XFS_ALLOC_SET_ASIDE(mp),
+					    XFS_FDBLOCKS_BATCH) >= 0) {
 		/* we had space! */
 		return 0;
 	}
@@ -136,6 +136,7 @@ typedef struct xfs_mount {
 	struct workqueue_struct	*m_reclaim_workqueue;
 	struct workqueue_struct	*m_log_workqueue;
 	struct workqueue_struct *m_eofblocks_workqueue;
+	struct workqueue_struct	*m_inactive_workqueue;
 
 	/*
 	 * Generation of the filesysyem layout.  This is incremented by each
@@ -303,10 +304,11 @@ typedef struct xfs_perag {
 	int		pag_ici_reclaimable;	/* reclaimable inodes */
 	struct mutex	pag_ici_reclaim_lock;	/* serialisation point */
 	unsigned long	pag_ici_reclaim_cursor;	/* reclaim restart point */
+	struct work_struct pag_inactive_work;	/* background inactivation */
 
 	/* buffer cache index */
-	spinlock_t	pag_buf_lock;	/* lock for pag_buf_tree */
-	struct rb_root	pag_buf_tree;	/* ordered tree of active buffers */
+	spinlock_t	pag_buf_lock;	/* lock for pag_buf_hash inserts */
+	struct rhashtable pag_buf_hash;	/* active buffers, RCU lookups */
 
 	/* for rcu-safe freeing */
 	struct rcu_head	rcu_head;
@@ -317,6 +319,8 @@ extern void	xfs_uuid_table_free(void);
 extern int	xfs_log_sbcount(xfs_mount_t *);
 extern __uint64_t xfs_default_resblks(xfs_mount_t *mp);
 extern int	xfs_mountfs(xfs_mount_t *mp);
+extern int	xfs_buf_hash_init(xfs_perag_t *pag);
+extern void	xfs_buf_hash_destroy(xfs_perag_t *pag);
 extern int	xfs_initialize_perag(xfs_mount_t *mp, xfs_agnumber_t agcount,
 				     xfs_agnumber_t *maxagi);
 extern void	xfs_unmountfs(xfs_mount_t *);
@@ -153,8 +153,10 @@ xfs_qm_scall_quotaoff(
 	 * that quotas will not be turned off. This is handy because in a
 	 * transaction once we lock the inode(s) and check for quotaon, we can
 	 * depend on the quota inodes (and other things) being valid as long as
-	 * we keep the lock(s).
+	 * we keep the lock(s).  Inodes still queued for inactivation hold
+	 * dquot references too, so let them finish first.
 	 */
+	xfs_inactive_flush(mp);
 	xfs_qm_dqrele_all_inodes(mp, flags);
 
 	/*
@@ -63,6 +63,7 @@ int xfs_stats_format(struct xfsstats __percpu *stats, char *buf)
 		{ "fibt2",		XFSSTAT_END_FIBT_V2		},
 		/* we print both series of quota information together */
 		{ "qm",			XFSSTAT_END_QM			},
+		{ "buf_lookup",		XFSSTAT_END_BUF_LOOKUP		},
 	};
 
 	/* Loop over all stats groups */
@@ -207,6 +207,9 @@ struct xfsstats {
 #define XFSSTAT_END_QM			(XFSSTAT_END_XQMSTAT+2)
 	__uint32_t		xs_qm_dquot;
 	__uint32_t		xs_qm_dquot_unused;
+#define XFSSTAT_END_BUF_LOOKUP		(XFSSTAT_END_QM+2)
+	__uint32_t		xb_lookup_rcu;	/* hits without pag_buf_lock */
+	__uint32_t		xb_lookup_locked;
 /* Extra precision counters */
 	__uint64_t		xs_xstrat_bytes;
 	__uint64_t		xs_write_bytes;
@@ -853,8 +853,15 @@ xfs_init_mount_workqueues(
 	if (!mp->m_eofblocks_workqueue)
 		goto out_destroy_log;
 
+	mp->m_inactive_workqueue = alloc_workqueue("xfs-inactive/%s",
+			WQ_MEM_RECLAIM|WQ_FREEZABLE, 0, mp->m_fsname);
+	if (!mp->m_inactive_workqueue)
+		goto out_destroy_eofb;
+
 	return 0;
 
+out_destroy_eofb:
+	destroy_workqueue(mp->m_eofblocks_workqueue);
 out_destroy_log:
 	destroy_workqueue(mp->m_log_workqueue);
 out_destroy_reclaim:
@@ -875,6 +882,7 @@ STATIC void
 xfs_destroy_mount_workqueues(
 	struct xfs_mount	*mp)
 {
+	destroy_workqueue(mp->m_inactive_workqueue);
 	destroy_workqueue(mp->m_eofblocks_workqueue);
 	destroy_workqueue(mp->m_log_workqueue);
 	destroy_workqueue(mp->m_reclaim_workqueue);
@@ -911,6 +919,23 @@ xfs_fs_alloc_inode(
 	return NULL;
 }
 
+/*
+ * Only unlinked inodes that still have to be freed are worth deferring;
+ * anything else is at most an EOF block trim.
+ */
+STATIC bool
+xfs_inode_needs_inactive(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+
+	if (ip->i_d.di_mode == 0 || ip->i_d.di_nlink != 0)
+		return false;
+	if (mp->m_flags & XFS_MOUNT_RDONLY)
+		return false;
+	return !XFS_FORCED_SHUTDOWN(mp);
+}
+
 /*
  * Now that the generic code is guaranteed not to be accessing
  * the linux inode, we can reclaim the inode.
@@ -925,14 +950,27 @@ xfs_fs_destroy_inode(
 
 	XFS_STATS_INC(ip->i_mount, vn_reclaim);
 
-	ASSERT(XFS_FORCED_SHUTDOWN(ip->i_mount) || ip->i_delayed_blks == 0);
-
 	/*
 	 * We should never get here with one of the reclaim flags already set.
 	 */
 	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIMABLE));
 	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIM));
 
+	/*
+	 * Freeing an unlinked inode means truncating it and freeing the
+	 * inode itself, which takes several transactions.  Leave that to the
+	 * background inactivation worker rather than making whoever dropped
+	 * the last reference wait for it.  The worker hands the inode over to
+	 * reclaim once it is done.
+	 */
+	if (xfs_inode_needs_inactive(ip)) {
+		xfs_inode_set_inactive_tag(ip);
+		return;
+	}
+
+	xfs_inactive(ip);
+	ASSERT(XFS_FORCED_SHUTDOWN(ip->i_mount) || ip->i_delayed_blks == 0);
+
 	/*
 	 * We always use background reclaim here because even if the
 	 * inode is clean, it still may be under IO and hence we have
@@ -986,8 +1024,6 @@ xfs_fs_evict_inode(
 	clear_inode(inode);
 	XFS_STATS_INC(ip->i_mount, vn_rele);
 	XFS_STATS_INC(ip->i_mount, vn_remove);
-
-	xfs_inactive(ip);
 }
 
 /*
@@ -1028,6 +1064,7 @@ xfs_fs_sync_fs(
 	if (!wait)
 		return 0;
 
+	xfs_inactive_flush(mp);
 	xfs_log_force(mp, XFS_LOG_SYNC);
 	if (laptop_mode) {
 		/*
@@ -1275,6 +1312,7 @@ xfs_fs_remount(
 		 * reserve pool size so that if we get remounted rw, we can
 		 * return it to the same size.
 		 */
+		xfs_inactive_flush(mp);
 		xfs_save_resvblks(mp);
 		xfs_quiesce_attr(mp);
 		mp->m_flags |= XFS_MOUNT_RDONLY;
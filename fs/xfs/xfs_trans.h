@@ -51,6 +51,7 @@ typedef struct xfs_log_item {
 
 	/* delayed logging */
 	struct list_head		li_cil;		/* CIL pointers */
+	__uint32_t			li_order_id;	/* CIL commit order */
 	struct xfs_log_vec		*li_lv;		/* active log vector */
 	xfs_lsn_t			li_seq;		/* CIL commit seq */
 } xfs_log_item_t;
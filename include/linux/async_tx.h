@@ -20,6 +20,8 @@
 #include <linux/dmaengine.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/highmem.h>
 
 /* on architectures without dma-mapping capabilities we need to ensure
  * that the asynchronous path compiles away
@@ -205,4 +207,51 @@ async_raid6_datap_recov(int src_num, size_t bytes, int faila,
 			struct page **ptrs, struct async_submit_ctl *submit);
 
 void async_tx_quiesce(struct dma_async_tx_descriptor **tx);
+
+/**
+ * struct async_copy - chain of copies a caller sleeps on as a whole
+ * @tx: last descriptor queued, NULL when nothing is in flight
+ * @done: completed from the interrupt that ends the chain
+ */
+struct async_copy {
+	struct dma_async_tx_descriptor *tx;
+	struct completion done;
+};
+
+static inline void async_copy_init(struct async_copy *ac)
+{
+	ac->tx = NULL;
+}
+
+#ifdef CONFIG_ASYNC_COPY
+extern unsigned int async_copy_threshold;
+
+bool async_copy_worthwhile(size_t len);
+void async_copy_page(struct async_copy *ac, struct page *dest,
+		     unsigned int dest_offset, struct page *src,
+		     unsigned int src_offset, size_t len);
+void async_copy_wait(struct async_copy *ac);
+#else
+static inline bool async_copy_worthwhile(size_t len)
+{
+	return false;
+}
+
+static inline void async_copy_page(struct async_copy *ac, struct page *dest,
+				   unsigned int dest_offset, struct page *src,
+				   unsigned int src_offset, size_t len)
+{
+	void *dest_buf = kmap_atomic(dest) + dest_offset;
+	void *src_buf = kmap_atomic(src) + src_offset;
+
+	memcpy(dest_buf, src_buf, len);
+
+	kunmap_atomic(src_buf);
+	kunmap_atomic(dest_buf);
+}
+
+static inline void async_copy_wait(struct async_copy *ac)
+{
+}
+#endif /* CONFIG_ASYNC_COPY */
 #endif /* _ASYNC_TX_H_ */
@@ -427,8 +427,12 @@ static inline struct bio *bio_next_split(struct bio *bio, int sectors,
 	return bio_split(bio, sectors, gfp, bs);
 }
 
+struct bio_cache_stats;
+
 extern struct bio_set *bioset_create(unsigned int, unsigned int);
 extern struct bio_set *bioset_create_nobvec(unsigned int, unsigned int);
+extern int bioset_enable_percpu_cache(struct bio_set *);
+extern void bioset_cache_stats(struct bio_set *, struct bio_cache_stats *);
 extern void bioset_free(struct bio_set *);
 extern mempool_t *biovec_create_pool(int pool_entries);
 
@@ -715,10 +719,31 @@ static inline struct bio *bio_list_get(struct bio_list *bl)
 #define BIOVEC_NR_POOLS 6
 #define BIOVEC_MAX_IDX	(BIOVEC_NR_POOLS - 1)
 
+/*
+ * Per-cpu stash of freed bios, see bioset_enable_percpu_cache().
+ */
+struct bio_alloc_cache {
+	struct bio		*free_list;
+	unsigned int		nr;
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		recycled;
+};
+
+struct bio_cache_stats {
+	unsigned int		cached;
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		recycled;
+};
+
 struct bio_set {
 	struct kmem_cache *bio_slab;
 	unsigned int front_pad;
 
+	struct bio_alloc_cache __percpu *cache;
+	struct list_head	cache_list;
+
 	mempool_t *bio_pool;
 	mempool_t *bvec_pool;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
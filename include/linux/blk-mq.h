@@ -5,6 +5,7 @@
 
 struct blk_mq_tags;
 struct blk_flush_queue;
+struct blk_mq_hctx_stats;
 
 struct blk_mq_cpu_notifier {
 	struct list_head list;
@@ -60,8 +61,15 @@ struct blk_mq_hw_ctx {
 	struct blk_mq_cpu_notifier	cpu_notifier;
 	struct kobject		kobj;
 
+	unsigned long		poll_considered;
 	unsigned long		poll_invoked;
 	unsigned long		poll_success;
+	unsigned long		poll_slept;
+
+#ifdef CONFIG_BLK_DEBUG_FS
+	struct blk_mq_hctx_stats __percpu *stats;
+	struct dentry		*debugfs_dir;
+#endif
 };
 
 struct blk_mq_tag_set {
@@ -88,6 +96,7 @@ struct blk_mq_queue_data {
 };
 
 typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, const struct blk_mq_queue_data *);
+typedef void (commit_rqs_fn)(struct blk_mq_hw_ctx *);
 typedef struct blk_mq_hw_ctx *(map_queue_fn)(struct request_queue *, const int);
 typedef enum blk_eh_timer_return (timeout_fn)(struct request *, bool);
 typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
@@ -101,6 +110,7 @@ typedef void (busy_iter_fn)(struct blk_mq_hw_ctx *, struct request *, void *,
 		bool);
 typedef void (busy_tag_iter_fn)(struct request *, void *, bool);
 typedef int (poll_fn)(struct blk_mq_hw_ctx *, unsigned int);
+typedef int (queue_irq_fn)(struct blk_mq_tag_set *, unsigned int);
 
 
 struct blk_mq_ops {
@@ -109,11 +119,26 @@ struct blk_mq_ops {
 	 */
 	queue_rq_fn		*queue_rq;
 
+	/*
+	 * If a driver defers work (e.g. ringing a doorbell) until it sees
+	 * a request with ->last set, blk-mq calls this whenever it stops
+	 * dispatching before it could pass such a request, so the driver
+	 * can kick off what it has already queued.
+	 */
+	commit_rqs_fn		*commit_rqs;
+
 	/*
 	 * Map to specific hardware queue
 	 */
 	map_queue_fn		*map_queue;
 
+	/*
+	 * Return the interrupt that completes the given hardware queue, or
+	 * a negative value if none. If provided, cpus are mapped to the
+	 * queue whose interrupt is affine to them.
+	 */
+	queue_irq_fn		*queue_irq;
+
 	/*
 	 * Called on request timeout
 	 */
@@ -33,6 +33,7 @@ struct blk_trace;
 struct request;
 struct sg_io_hdr;
 struct bsg_job;
+struct rq_wb;
 struct blkcg_gq;
 struct blk_flush_queue;
 struct pr_ops;
@@ -152,6 +153,10 @@ struct request {
 	struct gendisk *rq_disk;
 	struct hd_struct *part;
 	unsigned long start_time;
+	struct blk_issue_stat issue_stat;
+#ifdef CONFIG_BLK_DEBUG_FS
+	u64 alloc_time_ns;	/* for blk-mq queue latency histograms */
+#endif
 #ifdef CONFIG_BLK_CGROUP
 	struct request_list *rl;		/* rl this rq is alloced from */
 	unsigned long long start_time_ns;
@@ -427,6 +432,9 @@ struct request_queue {
 	int			node;
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	struct blk_trace	*blk_trace;
+#endif
+#ifdef CONFIG_BLK_DEBUG_FS
+	struct dentry		*debugfs_dir;
 #endif
 	/*
 	 * for flush operations
@@ -464,6 +472,19 @@ struct request_queue {
 	struct bio_set		*bio_split;
 
 	bool			mq_sysfs_init_done;
+
+	/*
+	 * Hybrid polling: -1 means classic busy polling, 0 derives the
+	 * pre-poll sleep from completion latency stats, > 0 is a fixed
+	 * sleep in nanoseconds.
+	 */
+	int			poll_nsec;
+
+	/* completion latency stats for !mq queues, mq keeps them per ctx */
+	struct blk_rq_stat	rq_stats[2];
+
+	/* buffered writeback throttling, see block/blk-wbt.c */
+	struct rq_wb		*rq_wb;
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -489,6 +510,7 @@ struct request_queue {
 #define QUEUE_FLAG_INIT_DONE   20	/* queue is initialized */
 #define QUEUE_FLAG_NO_SG_MERGE 21	/* don't attempt to merge SG segments*/
 #define QUEUE_FLAG_POLL	       22	/* IO polling enabled if set */
+#define QUEUE_FLAG_STATS       23	/* track rq completion times */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -10,6 +10,8 @@
 #include <uapi/linux/bpf.h>
 #include <linux/workqueue.h>
 #include <linux/file.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
 
 struct bpf_map;
 
@@ -36,6 +38,7 @@ struct bpf_map {
 	u32 key_size;
 	u32 value_size;
 	u32 max_entries;
+	u32 map_flags;
 	u32 pages;
 	struct user_struct *user;
 	const struct bpf_map_ops *ops;
@@ -103,6 +106,27 @@ enum bpf_access_type {
 	BPF_WRITE = 2
 };
 
+/* types of values stored in eBPF registers */
+enum bpf_reg_type {
+	NOT_INIT = 0,		 /* nothing was written into register */
+	UNKNOWN_VALUE,		 /* reg doesn't contain a valid pointer */
+	PTR_TO_CTX,		 /* reg points to bpf_context */
+	CONST_PTR_TO_MAP,	 /* reg points to struct bpf_map */
+	PTR_TO_MAP_VALUE,	 /* reg points to map element value */
+	PTR_TO_MAP_VALUE_OR_NULL,/* points to map elem value or NULL */
+	FRAME_PTR,		 /* reg == frame_pointer */
+	PTR_TO_STACK,		 /* reg == frame_pointer + imm */
+	CONST_IMM,		 /* constant integer value */
+
+	/* PTR_TO_PACKET is the start of packet data plus a constant offset,
+	 * PTR_TO_PACKET_END is one past the last byte. Both are loaded from
+	 * the context, and a packet pointer can only be dereferenced after
+	 * the program compared it against PTR_TO_PACKET_END.
+	 */
+	PTR_TO_PACKET,		 /* reg points to packet data + off */
+	PTR_TO_PACKET_END,	 /* reg points to end of packet data */
+};
+
 struct bpf_prog;
 
 struct bpf_verifier_ops {
@@ -110,9 +134,11 @@ struct bpf_verifier_ops {
 	const struct bpf_func_proto *(*get_func_proto)(enum bpf_func_id func_id);
 
 	/* return true if 'size' wide access at offset 'off' within bpf_context
-	 * with 'type' (read or write) is allowed
+	 * with 'type' (read or write) is allowed. For fields that hold
+	 * pointers the loaded register type is returned in 'reg_type'.
 	 */
-	bool (*is_valid_access)(int off, int size, enum bpf_access_type type);
+	bool (*is_valid_access)(int off, int size, enum bpf_access_type type,
+				enum bpf_reg_type *reg_type);
 
 	u32 (*convert_ctx_access)(enum bpf_access_type type, int dst_reg,
 				  int src_reg, int ctx_off,
@@ -125,6 +151,20 @@ struct bpf_prog_type_list {
 	enum bpf_prog_type type;
 };
 
+/* A bpf_tail_call() site whose prog_array and index the verifier found to
+ * be the same constants on every path. A JIT may emit a patchable direct
+ * jump there; updates of that array slot then repoint the jump, so the
+ * call no longer loads the target from the array each time.
+ */
+struct bpf_jit_poke_descriptor {
+	struct list_head list;	/* on the prog_array's poke_list */
+	struct bpf_map *map;
+	u32 key;
+	u32 insn_idx;
+	void *ip;		/* patchable jump, set by the JIT */
+	void *bypass_addr;	/* where the jump goes while the slot is empty */
+};
+
 struct bpf_prog_aux {
 	atomic_t refcnt;
 	u32 used_map_cnt;
@@ -132,6 +172,11 @@ struct bpf_prog_aux {
 	struct bpf_map **used_maps;
 	struct bpf_prog *prog;
 	struct user_struct *user;
+	u32 max_ctx_offset;	/* end of the furthest ctx access, see
+				 * the tracepoint attach checks
+				 */
+	struct bpf_jit_poke_descriptor *poke_tab;
+	u32 size_poke_tab;
 	union {
 		struct work_struct work;
 		struct rcu_head	rcu;
@@ -148,9 +193,15 @@ struct bpf_array {
 	 */
 	enum bpf_prog_type owner_prog_type;
 	bool owner_jited;
+	/* prog_array only: direct tail call sites of the programs that jump
+	 * through this array, repointed under poke_mutex on every update
+	 */
+	struct mutex poke_mutex;
+	struct list_head poke_list;
 	union {
 		char value[0] __aligned(8);
 		void *ptrs[0] __aligned(8);
+		void __percpu *pptrs[0] __aligned(8);
 	};
 };
 #define MAX_TAIL_CALL_CNT 32
@@ -158,6 +209,8 @@ struct bpf_array {
 u64 bpf_tail_call(u64 ctx, u64 r2, u64 index, u64 r4, u64 r5);
 void bpf_fd_array_map_clear(struct bpf_map *map);
 bool bpf_prog_array_compatible(struct bpf_array *array, const struct bpf_prog *fp);
+void bpf_arch_poke_tail_call(struct bpf_jit_poke_descriptor *poke,
+			     struct bpf_prog *target);
 const struct bpf_func_proto *bpf_get_trace_printk_proto(void);
 
 #ifdef CONFIG_BPF_SYSCALL
@@ -175,8 +228,21 @@ struct bpf_map *bpf_map_inc(struct bpf_map *map, bool uref);
 void bpf_map_put_with_uref(struct bpf_map *map);
 void bpf_map_put(struct bpf_map *map);
 
+int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value);
+int bpf_percpu_array_copy(struct bpf_map *map, void *key, void *value);
+int bpf_percpu_hash_update(struct bpf_map *map, void *key, void *value,
+			   u64 flags);
+int bpf_percpu_array_update(struct bpf_map *map, void *key, void *value,
+			    u64 flags);
+int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value);
+
 extern int sysctl_unprivileged_bpf_disabled;
 
+/* set while a tracing program runs on this cpu, to keep programs from
+ * recursing through the probes they hit
+ */
+DECLARE_PER_CPU(int, bpf_prog_active);
+
 int bpf_map_new_fd(struct bpf_map *map);
 int bpf_prog_new_fd(struct bpf_prog *prog);
 
@@ -185,6 +251,9 @@ int bpf_obj_get_user(const char __user *pathname);
 
 /* verify correctness of eBPF program */
 int bpf_check(struct bpf_prog **fp, union bpf_attr *attr);
+
+void bpf_prog_poke_track(struct bpf_prog *prog);
+void bpf_prog_poke_untrack(struct bpf_prog *prog);
 #else
 static inline void bpf_register_prog_type(struct bpf_prog_type_list *tl)
 {
@@ -202,6 +271,10 @@ static inline void bpf_prog_put(struct bpf_prog *prog)
 static inline void bpf_prog_put_rcu(struct bpf_prog *prog)
 {
 }
+
+static inline void bpf_prog_poke_untrack(struct bpf_prog *prog)
+{
+}
 #endif /* CONFIG_BPF_SYSCALL */
 
 /* verifier prototypes for helper functions called from eBPF programs */
@@ -218,6 +291,9 @@ extern const struct bpf_func_proto bpf_get_current_uid_gid_proto;
 extern const struct bpf_func_proto bpf_get_current_comm_proto;
 extern const struct bpf_func_proto bpf_skb_vlan_push_proto;
 extern const struct bpf_func_proto bpf_skb_vlan_pop_proto;
+extern const struct bpf_func_proto bpf_get_stackid_proto;
+
+u64 bpf_get_stackid(u64 r1, u64 r2, u64 flags, u64 r4, u64 r5);
 
 /* Shared helpers among cBPF and eBPF. */
 void bpf_user_rnd_init_once(void);
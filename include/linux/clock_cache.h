@@ -0,0 +1,91 @@
+/*
+ * Sharded object cache with CLOCK replacement
+ *
+ * Tracks a bounded set of objects keyed by a u64.  The key space is split
+ * over a power-of-two number of shards, each with its own lock, hash
+ * buckets and clock ring, so inserts and evictions on different shards do
+ * not contend.  Lookups take no lock at all: they walk the shard's hash
+ * chain under RCU and take a reference with atomic_inc_not_zero().  A hit
+ * only sets the entry's referenced bit (and only if it is not set yet),
+ * which is all the recency information CLOCK needs; nothing is moved on a
+ * list, so hot entries do not bounce a cache line between CPUs.
+ *
+ * Reference counting: the cache itself holds one reference on every entry
+ * it tracks.  An entry whose count is exactly one is idle and may be
+ * evicted; it is claimed for eviction by moving the count from one to
+ * zero, which makes concurrent lookups miss.  Once the count drops to
+ * zero the release callback given to clock_cache_create() is called, and
+ * it must not reuse the memory before an RCU grace period has elapsed
+ * (kfree_rcu() is the usual way).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_CLOCK_CACHE_H
+#define _LINUX_CLOCK_CACHE_H
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct clock_cache;
+
+enum {
+	__CC_LINKED,		/* on the hash chain and in the clock ring */
+	__CC_REFERENCED,	/* hit since the clock hand last passed */
+};
+
+struct cc_entry {
+	struct hlist_node	hash;
+	u64			key;
+	atomic_t		refcnt;
+	unsigned long		flags;
+	unsigned int		slot;	/* index in the shard's clock ring */
+	struct rcu_head		rcu;	/* for the owner's kfree_rcu() */
+};
+
+struct cc_shard {
+	spinlock_t		lock;
+	unsigned int		nr;	/* entries in ring[0..nr) */
+	unsigned int		hand;
+	struct cc_entry		**ring;
+	struct hlist_head	*buckets;
+	unsigned long		evictions;
+	unsigned long		starving;
+} ____cacheline_aligned_in_smp;
+
+struct clock_cache {
+	unsigned int		shard_bits;
+	unsigned int		bucket_bits;
+	unsigned int		shard_capacity;
+	void			(*release)(struct cc_entry *e);
+	struct cc_shard		*shards;
+};
+
+struct clock_cache *clock_cache_create(unsigned int nr_entries,
+				       unsigned int nr_shards,
+				       void (*release)(struct cc_entry *e));
+void clock_cache_destroy(struct clock_cache *cc);
+
+struct cc_entry *clock_cache_lookup(struct clock_cache *cc, u64 key);
+struct cc_entry *clock_cache_insert(struct clock_cache *cc,
+				    struct cc_entry *new, u64 key);
+void clock_cache_remove(struct clock_cache *cc, struct cc_entry *e);
+
+/**
+ * clock_cache_put - drop a reference taken by lookup or insert
+ * @cc: the cache @e was obtained from
+ * @e: the entry
+ */
+static inline void clock_cache_put(struct clock_cache *cc, struct cc_entry *e)
+{
+	if (atomic_dec_and_test(&e->refcnt))
+		cc->release(e);
+}
+
+#endif /* _LINUX_CLOCK_CACHE_H */
@@ -10,5 +10,11 @@ extern __u16 crc_t10dif_generic(__u16 crc, const unsigned char *buffer,
 				size_t len);
 extern __u16 crc_t10dif(unsigned char const *, size_t);
 extern __u16 crc_t10dif_update(__u16 crc, unsigned char const *, size_t);
+extern void crc_t10dif_batch(const unsigned char *buffer, size_t len,
+			     unsigned int nr, __u16 *crcs);
+
+/* Optionally provided by an accelerated crct10dif driver */
+extern void crc_t10dif_accel_batch(const unsigned char *buffer, size_t len,
+				   unsigned int nr, __u16 *crcs);
 
 #endif
@@ -182,6 +182,7 @@ enum drbd_ret_code {
 	ERR_MD_LAYOUT_TOO_SMALL = 168,
 	ERR_MD_LAYOUT_NO_FIT    = 169,
 	ERR_IMPLICIT_SHRINK     = 170,
+	ERR_DATA_STREAMS        = 171,
 	/* insert new ones above this line */
 	AFTER_LAST_ERR_CODE
 };
@@ -230,4 +230,9 @@
 #define DRBD_SOCKET_CHECK_TIMEO_MAX DRBD_PING_TIMEO_MAX
 #define DRBD_SOCKET_CHECK_TIMEO_DEF 0
 #define DRBD_SOCKET_CHECK_TIMEO_SCALE '1'
+
+#define DRBD_DATA_STREAMS_MIN 1
+#define DRBD_DATA_STREAMS_MAX 8
+#define DRBD_DATA_STREAMS_DEF 1
+#define DRBD_DATA_STREAMS_SCALE '1'
 #endif
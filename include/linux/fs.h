@@ -1408,6 +1408,12 @@ struct super_block {
 	/* s_inode_list_lock protects s_inodes */
 	spinlock_t		s_inode_list_lock ____cacheline_aligned_in_smp;
 	struct list_head	s_inodes;	/* all inodes */
+
+#ifdef CONFIG_FSNOTIFY
+	/* s_inode_list_lock also protects the superblock marks */
+	__u32			s_fsnotify_mask; /* all events sb marks care about */
+	struct hlist_head	s_fsnotify_marks;
+#endif
 };
 
 extern struct timespec current_fs_time(struct super_block *sb);
@@ -182,6 +182,7 @@ struct fsnotify_group {
 			wait_queue_head_t access_waitq;
 #endif /* CONFIG_FANOTIFY_ACCESS_PERMISSIONS */
 			int f_flags;
+			unsigned int flags;	/* FAN_REPORT_* init flags */
 			unsigned int max_marks;
 			struct user_struct *user;
 		} fanotify_data;
@@ -205,8 +206,8 @@ struct fsnotify_group {
  * at inode eviction or modification.
  *
  * Text in brackets is showing the lock(s) protecting modifications of a
- * particular entry. obj_lock means either inode->i_lock or
- * mnt->mnt_root->d_lock depending on the mark type.
+ * particular entry. obj_lock means either inode->i_lock,
+ * mnt->mnt_root->d_lock or sb->s_inode_list_lock depending on the mark type.
  */
 struct fsnotify_mark {
 	/* Mask this mark is for [mark->lock, group->mark_mutex] */
@@ -223,11 +224,12 @@ struct fsnotify_mark {
 	struct list_head g_list;
 	/* Protects inode / mnt pointers, flags, masks */
 	spinlock_t lock;
-	/* List of marks for inode / vfsmount [obj_lock] */
+	/* List of marks for inode / vfsmount / superblock [obj_lock] */
 	struct hlist_node obj_list;
 	union {	/* Object pointer [mark->lock, group->mark_mutex] */
 		struct inode *inode;	/* inode this mark is associated with */
 		struct vfsmount *mnt;	/* vfsmount this mark is associated with */
+		struct super_block *sb;	/* filesystem this mark is associated with */
 	};
 	/* Events types to ignore [mark->lock, group->mark_mutex] */
 	__u32 ignored_mask;
@@ -237,6 +239,7 @@ struct fsnotify_mark {
 #define FSNOTIFY_MARK_FLAG_IGNORED_SURV_MODIFY	0x08
 #define FSNOTIFY_MARK_FLAG_ALIVE		0x10
 #define FSNOTIFY_MARK_FLAG_ATTACHED		0x20
+#define FSNOTIFY_MARK_FLAG_SB			0x40
 	unsigned int flags;		/* flags [mark->lock] */
 	void (*free_mark)(struct fsnotify_mark *mark); /* called on final put+free */
 };
@@ -328,6 +331,9 @@ extern bool fsnotify_notify_queue_is_empty(struct fsnotify_group *group);
 extern struct fsnotify_event *fsnotify_peek_first_event(struct fsnotify_group *group);
 /* return AND dequeue the first event on the notification queue */
 extern struct fsnotify_event *fsnotify_remove_first_event(struct fsnotify_group *group);
+/* return unconsumed events to the head of the queue */
+extern void fsnotify_requeue_events(struct fsnotify_group *group,
+				    struct list_head *list);
 
 /* functions used to manipulate the marks attached to inodes */
 
@@ -335,11 +341,15 @@ extern struct fsnotify_event *fsnotify_remove_first_event(struct fsnotify_group
 extern void fsnotify_recalc_vfsmount_mask(struct vfsmount *mnt);
 /* run all marks associated with an inode and update inode->i_fsnotify_mask */
 extern void fsnotify_recalc_inode_mask(struct inode *inode);
+/* run all marks associated with a superblock and update sb->s_fsnotify_mask */
+extern void fsnotify_recalc_sb_mask(struct super_block *sb);
 extern void fsnotify_init_mark(struct fsnotify_mark *mark, void (*free_mark)(struct fsnotify_mark *mark));
 /* find (and take a reference) to a mark associated with group and inode */
 extern struct fsnotify_mark *fsnotify_find_inode_mark(struct fsnotify_group *group, struct inode *inode);
 /* find (and take a reference) to a mark associated with group and vfsmount */
 extern struct fsnotify_mark *fsnotify_find_vfsmount_mark(struct fsnotify_group *group, struct vfsmount *mnt);
+/* find (and take a reference) to a mark associated with group and superblock */
+extern struct fsnotify_mark *fsnotify_find_sb_mark(struct fsnotify_group *group, struct super_block *sb);
 /* copy the values from old into new */
 extern void fsnotify_duplicate_mark(struct fsnotify_mark *new, struct fsnotify_mark *old);
 /* set the ignored_mask of a mark */
@@ -351,6 +361,9 @@ extern int fsnotify_add_mark(struct fsnotify_mark *mark, struct fsnotify_group *
 			     struct inode *inode, struct vfsmount *mnt, int allow_dups);
 extern int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct fsnotify_group *group,
 				    struct inode *inode, struct vfsmount *mnt, int allow_dups);
+/* attach the mark to both the group and the superblock */
+extern int fsnotify_add_sb_mark_locked(struct fsnotify_mark *mark, struct fsnotify_group *group,
+				       struct super_block *sb, int allow_dups);
 /* given a group and a mark, flag mark to be freed when all references are dropped */
 extern void fsnotify_destroy_mark(struct fsnotify_mark *mark,
 				  struct fsnotify_group *group);
@@ -362,6 +375,8 @@ extern void fsnotify_free_mark(struct fsnotify_mark *mark);
 extern void fsnotify_clear_vfsmount_marks_by_group(struct fsnotify_group *group);
 /* run all the marks in a group, and clear all of the inode marks */
 extern void fsnotify_clear_inode_marks_by_group(struct fsnotify_group *group);
+/* run all the marks in a group, and clear all of the superblock marks */
+extern void fsnotify_clear_sb_marks_by_group(struct fsnotify_group *group);
 /* run all the marks in a group, and clear all of the marks where mark->flags & flags is true*/
 extern void fsnotify_clear_marks_by_group_flags(struct fsnotify_group *group, unsigned int flags);
 /* run all the marks in a group, and flag them to be freed */
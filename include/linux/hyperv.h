@@ -633,6 +633,7 @@ struct hv_input_signal_event_buffer {
 enum hv_signal_policy {
 	HV_SIGNAL_POLICY_DEFAULT = 0,
 	HV_SIGNAL_POLICY_EXPLICIT,
+	HV_SIGNAL_POLICY_DEFERRED,
 };
 
 struct vmbus_channel {
@@ -766,9 +767,11 @@ struct vmbus_channel {
 	 * Host signaling policy: The default policy will be
 	 * based on the ring buffer state. We will also support
 	 * a policy where the client driver can have explicit
-	 * signaling control.
+	 * signaling control, and a policy where a signal owed in the
+	 * middle of a batch is deferred to the end of the batch.
 	 */
 	enum hv_signal_policy  signal_policy;
+	bool signal_deferred;
 };
 
 static inline void set_channel_signal_state(struct vmbus_channel *c,
@@ -70,6 +70,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -270,7 +271,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -296,6 +299,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -306,7 +310,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -712,6 +717,9 @@ struct transaction_stats_s {
 	unsigned long		ts_tid;
 	unsigned long		ts_requested;
 	struct transaction_run_stats_s run;
+	/* handles that had to wait for a checkpoint to free log space */
+	unsigned long		ts_checkpoint_stalls;
+	unsigned long		ts_checkpoint_stall_time;
 };
 
 static inline unsigned long
@@ -748,12 +756,22 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wait_updates: Wait queue to wait for updates to complete
  * @j_wait_reserved: Wait queue to wait for reserved buffer credits to drop
  * @j_checkpoint_mutex: Mutex for locking against concurrent checkpoints
+ * @j_wait_checkpoint: Wait queue to trigger background checkpointing
+ * @j_checkpoint_task: Background checkpoint thread for this journal
+ * @j_checkpoint_watermark: Percentage of the log in use at which the
+ *  background checkpoint thread starts writing back, 0 to disable it
  * @j_head: Journal head - identifies the first unused block in the journal
  * @j_tail: Journal tail - identifies the oldest still-used block in the
  *  journal.
  * @j_free: Journal free - how many free blocks are there in the journal?
  * @j_first: The block number of the first usable block
  * @j_last: The block number one beyond the last usable block
+ * @j_fc_first: The block number of the first fast commit block
+ * @j_fc_last: The block number one beyond the last fast commit block
+ * @j_fc_off: Number of fast commit blocks used since the last full commit
+ * @j_fc_wbuf: Buffers of the fast commit blocks being written
+ * @j_fc_wait: Wait queue for fast and full commits to exclude each other
+ * @j_fc_replay_tid: Transaction whose fast commits recovery should replay
  * @j_dev: Device where we store the journal
  * @j_blocksize: blocksize for the location where we store the journal.
  * @j_blk_offset: starting block offset for into the device where we store the
@@ -872,6 +890,18 @@ struct journal_s
 	 * j_checkpoint_mutex.  [j_checkpoint_mutex]
 	 */
 	struct buffer_head	*j_chkpt_bhs[JBD2_NR_BATCH];
+
+	/* Wait queue to trigger background checkpointing */
+	wait_queue_head_t	j_wait_checkpoint;
+
+	/* Background checkpoint thread, NULL if it is not running */
+	struct task_struct	*j_checkpoint_task;
+
+	/*
+	 * Percentage of the log in use above which the checkpoint thread
+	 * writes back old transactions, so that handles rarely have to.
+	 */
+	unsigned int		j_checkpoint_watermark;
 	
 	/*
 	 * Journal head: identifies the first unused block in the journal.
@@ -898,6 +928,26 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * Fast commit area: the blocks from j_fc_first up to j_fc_last sit
+	 * past j_last and are never used for the log.  j_fc_off counts the
+	 * ones written since the last full commit.  [j_state_lock, and the
+	 * JBD2_FAST_COMMIT_ONGOING owner for j_fc_off and j_fc_wbuf]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	struct buffer_head	**j_fc_wbuf;
+
+	/* Wait queue for JBD2_{FAST,FULL}_COMMIT_ONGOING to clear */
+	wait_queue_head_t	j_fc_wait;
+
+	/*
+	 * Transaction following the last one recovery found in the log: the
+	 * only one whose fast commits may still be valid.
+	 */
+	tid_t			j_fc_replay_tid;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -1099,6 +1149,16 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
+
+/* Size of the fast commit area, valid when the feature is set */
+static inline unsigned int
+jbd2_journal_get_num_fc_blks(journal_superblock_t *jsb)
+{
+	unsigned int num = be32_to_cpu(jsb->s_num_fc_blks);
+
+	return num ? num : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
 
 /*
  * Journal flag definitions
@@ -1113,6 +1173,10 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* A fast commit is being
+						 * written */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* A full commit is being
+						 * written */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1280,6 +1344,16 @@ extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
 extern void	   jbd2_journal_init_jbd_inode(struct jbd2_inode *jinode, struct inode *inode);
 extern void	   jbd2_journal_release_jbd_inode(journal_t *journal, struct jbd2_inode *jinode);
 
+/* Fast commits */
+extern int	   jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks);
+extern int	   jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+extern void	   jbd2_fc_end_commit(journal_t *journal);
+extern int	   jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bhp);
+extern int	   jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
+extern void	   jbd2_fc_release_bufs(journal_t *journal, int num_blks);
+extern struct buffer_head *jbd2_fc_read_block(journal_t *journal,
+					      unsigned long off);
+
 /*
  * journal_head management
  */
@@ -1355,6 +1429,9 @@ int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
+void jbd2_log_checkpoint_wakeup(journal_t *journal);
+int jbd2_checkpoint_start_thread(journal_t *journal);
+void jbd2_checkpoint_stop_thread(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
 
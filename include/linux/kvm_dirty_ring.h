@@ -0,0 +1,101 @@
+#ifndef KVM_DIRTY_RING_H
+#define KVM_DIRTY_RING_H
+
+#include <linux/kvm.h>
+
+struct kvm;
+struct page;
+
+/**
+ * kvm_dirty_ring: per-vcpu ring of dirtied guest pages, shared with userspace
+ *
+ * The vcpu is the only producer.  Userspace harvests entries from
+ * reset_index on, marks each one KVM_DIRTY_GFN_F_RESET, and calls
+ * KVM_RESET_DIRTY_RINGS to have the pages write-protected again and the
+ * entries handed back to the producer.
+ *
+ * @dirty_index: free running counter of pushed entries
+ * @reset_index: free running counter of entries handed back by a reset
+ * @size: number of entries, a power of two
+ * @soft_limit: number of entries at which the vcpu exits to userspace
+ *	with KVM_EXIT_DIRTY_RING_FULL, leaving room for what the vcpu may
+ *	still push before it gets there (e.g. a whole PML buffer)
+ * @dirty_gfns: the entries, vmalloc()ed and mmap()ed through the vcpu fd
+ */
+struct kvm_dirty_ring {
+	u32 dirty_index;
+	u32 reset_index;
+	u32 size;
+	u32 soft_limit;
+	struct kvm_dirty_gfn *dirty_gfns;
+};
+
+#ifndef KVM_DIRTY_LOG_PAGE_OFFSET
+#define KVM_DIRTY_LOG_PAGE_OFFSET 0
+#endif
+
+/* Entries always kept free on top of what the architecture reports */
+#define KVM_DIRTY_RING_RSVD_ENTRIES	64
+#define KVM_DIRTY_RING_MAX_ENTRIES	65536
+
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+
+u32 kvm_dirty_ring_get_rsvd_entries(void);
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return ring->size &&
+	       ring->dirty_index - READ_ONCE(ring->reset_index) >=
+	       ring->soft_limit;
+}
+
+/* Architectures may reserve room for entries pushed in bulk on exit */
+int kvm_cpu_dirty_log_size(void);
+
+#else /* !CONFIG_HAVE_KVM_DIRTY_RING */
+
+static inline u32 kvm_dirty_ring_get_rsvd_entries(void)
+{
+	return 0;
+}
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	return 0;
+}
+
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+}
+
+static inline bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring,
+				       u32 slot, u64 offset)
+{
+	return false;
+}
+
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return false;
+}
+
+#endif /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+#endif /* KVM_DIRTY_RING_H */
@@ -33,6 +33,7 @@
 #include <linux/kvm_types.h>
 
 #include <asm/kvm_host.h>
+#include <linux/kvm_dirty_ring.h>
 
 /*
  * The bit 16 ~ bit 31 of kvm_memory_region::flags are internally used
@@ -222,6 +223,20 @@ struct kvm_mmio_fragment {
 	unsigned len;
 };
 
+#define KVM_HALT_HIST_BUCKETS	32	/* log2(ns), the last one open ended */
+
+/*
+ * Per-vcpu halt polling histograms, read through debugfs: how long
+ * successful and unsuccessful polls took, and how long halts that ended
+ * up sleeping lasted until the wakeup.
+ */
+struct kvm_halt_hist {
+	u64 poll_success[KVM_HALT_HIST_BUCKETS];
+	u64 poll_fail[KVM_HALT_HIST_BUCKETS];
+	u64 wakeup[KVM_HALT_HIST_BUCKETS];
+	u64 poll_skipped;	/* not polled, the cpu was overcommitted */
+};
+
 struct kvm_vcpu {
 	struct kvm *kvm;
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -249,6 +264,7 @@ struct kvm_vcpu {
 	sigset_t sigset;
 	struct kvm_vcpu_stat stat;
 	unsigned int halt_poll_ns;
+	struct kvm_halt_hist halt_hist;
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -282,6 +298,7 @@ struct kvm_vcpu {
 #endif
 	bool preempted;
 	struct kvm_vcpu_arch arch;
+	struct kvm_dirty_ring dirty_ring;
 };
 
 static inline int kvm_vcpu_exiting_guest_mode(struct kvm_vcpu *vcpu)
@@ -303,6 +320,7 @@ struct kvm_memory_slot {
 	unsigned long userspace_addr;
 	u32 flags;
 	short id;
+	u16 as_id;
 };
 
 static inline unsigned long kvm_dirty_bitmap_bytes(struct kvm_memory_slot *memslot)
@@ -376,8 +394,27 @@ struct kvm_memslots {
 	int used_slots;
 };
 
+/*
+ * Architectures defining KVM_HAVE_MMU_RWLOCK make mmu_lock an rwlock so
+ * their page fault paths can share it; everything else, including all of
+ * the generic code below, takes it exclusively through these.
+ */
+#ifdef KVM_HAVE_MMU_RWLOCK
+#define KVM_MMU_LOCK_INIT(kvm)	rwlock_init(&(kvm)->mmu_lock)
+#define KVM_MMU_LOCK(kvm)	write_lock(&(kvm)->mmu_lock)
+#define KVM_MMU_UNLOCK(kvm)	write_unlock(&(kvm)->mmu_lock)
+#else
+#define KVM_MMU_LOCK_INIT(kvm)	spin_lock_init(&(kvm)->mmu_lock)
+#define KVM_MMU_LOCK(kvm)	spin_lock(&(kvm)->mmu_lock)
+#define KVM_MMU_UNLOCK(kvm)	spin_unlock(&(kvm)->mmu_lock)
+#endif
+
 struct kvm {
+#ifdef KVM_HAVE_MMU_RWLOCK
+	rwlock_t mmu_lock;
+#else
 	spinlock_t mmu_lock;
+#endif
 	struct mutex slots_lock;
 	struct mm_struct *mm; /* userspace tied to this vm */
 	struct kvm_memslots *memslots[KVM_ADDRESS_SPACE_NUM];
@@ -425,6 +462,11 @@ struct kvm {
 #endif
 	long tlbs_dirty;
 	struct list_head devices;
+	u32 dirty_ring_size;
+	/* KVM_CAP_HALT_POLL: per-VM limit instead of the module parameter */
+	unsigned int max_halt_poll_ns;
+	bool override_halt_poll_ns;
+	pid_t userspace_pid;
 };
 
 #define kvm_err(fmt, ...) \
@@ -12,6 +12,13 @@
 #define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned char *))
 #define LZ4HC_MEM_COMPRESS	(65538 * sizeof(unsigned char *))
 
+#define LZ4_ACCELERATION_DEFAULT	1
+#define LZ4_ACCELERATION_MAX		65537
+
+#define LZ4HC_LEVEL_MIN		1
+#define LZ4HC_LEVEL_DEFAULT	9
+#define LZ4HC_LEVEL_MAX		16
+
 /*
  * lz4_compressbound()
  * Provides the maximum size that LZ4 may output in a "worst case" scenario
@@ -39,6 +46,24 @@ static inline size_t lz4_compressbound(size_t isize)
 int lz4_compress(const unsigned char *src, size_t src_len,
 		unsigned char *dst, size_t *dst_len, void *wrkmem);
 
+/*
+ * lz4_compress_fast()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : is the size of 'dst', which is returned with the output
+ *		size after compress done.  It need not be LZ4_COMPRESSBOUND.
+ *	workmem : address of the working memory.
+ *		This requires 'workmem' of size LZ4_MEM_COMPRESS.
+ *	acceleration : LZ4_ACCELERATION_DEFAULT is lz4_compress(); higher
+ *		values up to LZ4_ACCELERATION_MAX give up ratio for speed.
+ *	return  : Success if return 0
+ *		  Error if return (< 0), also when the output does not fit
+ */
+int lz4_compress_fast(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem,
+		int acceleration);
+
  /*
   * lz4hc_compress()
   *	 src	 : source address of the original data
@@ -56,6 +81,15 @@ int lz4_compress(const unsigned char *src, size_t src_len,
 int lz4hc_compress(const unsigned char *src, size_t src_len,
 		unsigned char *dst, size_t *dst_len, void *wrkmem);
 
+/*
+ * lz4hc_compress_level()
+ *	As lz4hc_compress(), at 'level' from LZ4HC_LEVEL_MIN to
+ *	LZ4HC_LEVEL_MAX.  lz4hc_compress() is LZ4HC_LEVEL_DEFAULT; every
+ *	level up doubles the match search effort.
+ */
+int lz4hc_compress_level(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem, int level);
+
 /*
  * lz4_decompress()
  *	src     : source address of the compressed data
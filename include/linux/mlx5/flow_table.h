@@ -49,6 +49,9 @@ int mlx5_add_flow_table_entry(void *flow_table, u8 match_criteria_enable,
 			      void *match_criteria, void *flow_context,
 			      u32 *flow_index);
 void mlx5_del_flow_table_entry(void *flow_table, u32 flow_index);
+int mlx5_modify_flow_table_group(void *flow_table, int group_ix,
+				 u8 match_criteria_enable,
+				 void *match_criteria);
 u32 mlx5_get_flow_table_id(void *flow_table);
 
 #endif /* MLX5_FLOW_TABLE_H */
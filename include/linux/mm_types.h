@@ -138,6 +138,10 @@ struct page {
 		struct rcu_head rcu_head;	/* Used by SLAB
 						 * when destroying via RCU
 						 */
+		struct {		/* page_pool used by netstack */
+			unsigned long pp_magic;	/* PP_SIGNATURE, bit 0 clear */
+			struct page_pool *pp;
+		};
 		/* Tail pages of compound page */
 		struct {
 			unsigned long compound_head; /* If bit zero is set */
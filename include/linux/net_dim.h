@@ -0,0 +1,99 @@
+/*
+ * Dynamic interrupt moderation for network devices
+ *
+ * A driver feeds net_dim() a sample of its per-queue packet, byte and
+ * interrupt counters from the napi poll.  Every NET_DIM_NEVENTS interrupts
+ * the rates since the last decision are compared with the previous ones,
+ * and the algorithm steps through a small table of moderation profiles in
+ * whichever direction improved the byte (then packet) rate, parking once
+ * it has found the top.  Traffic averaging fewer than
+ * NET_DIM_SPARSE_PKTS_PER_EVENT packets per interrupt gains nothing from
+ * being held back, so it is moved straight to the lowest delay profile.
+ *
+ * When a new profile is picked, dim->state becomes NET_DIM_APPLY_NEW_PROFILE
+ * and dim->work is scheduled; the driver's work function programs
+ * net_dim_get_profile(dim->profile_ix) into the hardware and sets the state
+ * back to NET_DIM_START_MEASURE.  Samples taken in between are ignored.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_NET_DIM_H
+#define _LINUX_NET_DIM_H
+
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#define NET_DIM_NEVENTS			64
+#define NET_DIM_NUM_PROFILES		5
+#define NET_DIM_DEFAULT_PROFILE_IX	(NET_DIM_NUM_PROFILES - 1)
+#define NET_DIM_SPARSE_PKTS_PER_EVENT	2
+
+enum {
+	NET_DIM_START_MEASURE,
+	NET_DIM_MEASURE_IN_PROGRESS,
+	NET_DIM_APPLY_NEW_PROFILE,
+};
+
+struct net_dim_cq_moder {
+	u16 usec;
+	u16 pkts;
+};
+
+struct net_dim_sample {
+	ktime_t time;
+	u32 pkt_ctr;
+	u32 byte_ctr;
+	u16 event_ctr;
+};
+
+/* rates per millisecond */
+struct net_dim_stats {
+	int ppms;
+	int bpms;
+	int epms;
+};
+
+struct net_dim {
+	u8 state;
+	struct net_dim_stats prev_stats;
+	struct net_dim_sample start_sample;
+	struct work_struct work;
+	u8 profile_ix;
+	u8 tune_state;
+	u8 steps_right;
+	u8 steps_left;
+	u8 tired;
+};
+
+static inline void net_dim_sample(u16 event_ctr, u64 packets, u64 bytes,
+				  struct net_dim_sample *s)
+{
+	s->time	     = ktime_get();
+	s->pkt_ctr   = packets;
+	s->byte_ctr  = bytes;
+	s->event_ctr = event_ctr;
+}
+
+/**
+ * net_dim_init - set up a queue's moderation state
+ * @dim: the state, usually embedded in the driver's rx queue
+ * @work_fn: applies net_dim_get_profile(dim->profile_ix) to the queue
+ *
+ * The queue starts out on the NET_DIM_DEFAULT_PROFILE_IX profile.
+ */
+static inline void net_dim_init(struct net_dim *dim, work_func_t work_fn)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->profile_ix = NET_DIM_DEFAULT_PROFILE_IX;
+	INIT_WORK(&dim->work, work_fn);
+}
+
+struct net_dim_cq_moder net_dim_get_profile(u8 ix);
+void net_dim(struct net_dim *dim, struct net_dim_sample *end_sample);
+
+#endif /* _LINUX_NET_DIM_H */
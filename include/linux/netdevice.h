@@ -328,6 +328,7 @@ enum {
 	NAPI_STATE_DISABLE,	/* Disable pending */
 	NAPI_STATE_NPSVC,	/* Netpoll - don't dequeue from poll_list */
 	NAPI_STATE_HASHED,	/* In NAPI hash */
+	NAPI_STATE_IN_BUSY_POLL,/* Owned by napi_busy_loop() */
 };
 
 enum gro_result {
@@ -448,15 +449,16 @@ static inline bool napi_reschedule(struct napi_struct *napi)
 }
 
 void __napi_complete(struct napi_struct *n);
-void napi_complete_done(struct napi_struct *n, int work_done);
+bool napi_complete_done(struct napi_struct *n, int work_done);
 /**
  *	napi_complete - NAPI processing complete
  *	@n: napi context
  *
  * Mark NAPI processing as complete.
  * Consider using napi_complete_done() instead.
+ * Return false if device should avoid rearming interrupts.
  */
-static inline void napi_complete(struct napi_struct *n)
+static inline bool napi_complete(struct napi_struct *n)
 {
 	return napi_complete_done(n, 0);
 }
@@ -645,23 +647,32 @@ struct rps_dev_flow_table {
 /*
  * The rps_sock_flow_table contains mappings of flows to the last CPU
  * on which they were processed by the application (set in recvmsg).
- * Each entry is a 32bit value. Upper part is the high order bits
- * of flow hash, lower part is cpu number.
- * rps_cpu_mask is used to partition the space, depending on number of
- * possible cpus : rps_cpu_mask = roundup_pow_of_two(nr_cpu_ids) - 1
- * For example, if 64 cpus are possible, rps_cpu_mask = 0x3f,
- * meaning we use 32-6=26 bits for the hash.
+ * Each entry is a 64bit value: the full flow hash in the upper half,
+ * then the generation of the table it was written in and the cpu number.
+ * Entries of another generation never match, so the table is flushed by
+ * bumping its generation; generation 0 is never used, so a zeroed table
+ * is empty. Entries are read and written without locks, they are hints.
+ * On 32bit a read can even see halves of two writes of the same
+ * generation, the hash of one flow with the cpu of another, and match;
+ * that only steers the flow to a cpu some other flow recvmsg'd on, and
+ * get_rps_cpu() checks that cpu before using it.
  */
 struct rps_sock_flow_table {
 	u32	mask;
+	u16	gen;
 
-	u32	ents[0] ____cacheline_aligned_in_smp;
+	u64	ents[0] ____cacheline_aligned_in_smp;
 };
 #define	RPS_SOCK_FLOW_TABLE_SIZE(_num) (offsetof(struct rps_sock_flow_table, ents[_num]))
 
 #define RPS_NO_CPU 0xffff
 
-extern u32 rps_cpu_mask;
+#define RPS_SOCK_FLOW_ENT(hash, gen, cpu) \
+	(((u64)(hash) << 32) | ((u32)(u16)(gen) << 16) | (u16)(cpu))
+#define RPS_SOCK_FLOW_ENT_HASH(ent)	((u32)((ent) >> 32))
+#define RPS_SOCK_FLOW_ENT_GEN(ent)	((u16)((ent) >> 16))
+#define RPS_SOCK_FLOW_ENT_CPU(ent)	((u16)(ent))
+
 extern struct rps_sock_flow_table __rcu *rps_sock_flow_table;
 
 static inline void rps_record_sock_flow(struct rps_sock_flow_table *table,
@@ -669,13 +680,14 @@ static inline void rps_record_sock_flow(struct rps_sock_flow_table *table,
 {
 	if (table && hash) {
 		unsigned int index = hash & table->mask;
-		u32 val = hash & ~rps_cpu_mask;
+		u64 val;
 
 		/* We only give a hint, preemption can change cpu under us */
-		val |= raw_smp_processor_id();
+		val = RPS_SOCK_FLOW_ENT(hash, READ_ONCE(table->gen),
+					raw_smp_processor_id());
 
-		if (table->ents[index] != val)
-			table->ents[index] = val;
+		if (READ_ONCE(table->ents[index]) != val)
+			WRITE_ONCE(table->ents[index], val);
 	}
 }
 
@@ -774,6 +786,50 @@ static inline bool netdev_phys_item_id_same(struct netdev_phys_item_id *a,
 	       memcmp(a->id, b->id, a->id_len) == 0;
 }
 
+/* These structures hold the attributes of xdp state that are being passed
+ * to the netdevice through the xdp op.
+ */
+enum xdp_netdev_command {
+	/* Set or clear a bpf program used in the earliest stages of packet
+	 * rx. The prog will have been loaded as BPF_PROG_TYPE_XDP. The callee
+	 * is responsible for calling bpf_prog_put on any old progs that are
+	 * stored. In case of error, the callee need not release the new prog
+	 * reference, but on success it takes ownership and must bpf_prog_put
+	 * when it is no longer used.
+	 */
+	XDP_SETUP_PROG,
+	/* Check if a bpf program is set on the device. The callee should
+	 * return true if a program is currently attached and running.
+	 */
+	XDP_QUERY_PROG,
+	/* Receive rx queue queue_id straight into the chunks of a packet
+	 * socket umem, see include/net/packet_umem.h, or go back to normal
+	 * receive if umem is NULL, which must not fail. Frames of that queue
+	 * then bypass the stack. Drivers that cannot do it return an error
+	 * and the socket copies from the stack instead.
+	 */
+	XDP_SETUP_UMEM,
+};
+
+struct bpf_prog;
+struct packet_umem;
+struct tc_cls_flower_offload;
+
+struct netdev_xdp {
+	enum xdp_netdev_command command;
+	union {
+		/* XDP_SETUP_PROG */
+		struct bpf_prog *prog;
+		/* XDP_QUERY_PROG */
+		bool prog_attached;
+		/* XDP_SETUP_UMEM */
+		struct {
+			struct packet_umem *umem;
+			u16 queue_id;
+		} umem;
+	};
+};
+
 typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
 				       struct sk_buff *skb);
 
@@ -898,6 +954,16 @@ typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
  * 	is always called from the stack with the rtnl lock held and netif tx
  * 	queues stopped. This allows the netdevice to perform queue management
  * 	safely.
+ * int (*ndo_setup_launchtime)(struct net_device *dev, int queue, bool enable);
+ *	Called to make tx queue @queue hold every packet until the time in
+ *	its skb->tstamp, or to stop doing so. The time is in the clock domain
+ *	of the device's PHC. Called with the rtnl lock held.
+ * int (*ndo_setup_tc_flower)(struct net_device *dev,
+ *			      struct tc_cls_flower_offload *f);
+ *	Called to add, replace or remove a flower filter in the device's
+ *	own classification tables, or to read back its hardware counters,
+ *	as selected by f->command. Only used while NETIF_F_HW_TC is enabled.
+ *	Called with the rtnl lock held.
  *
  *	Fiber Channel over Ethernet (FCoE) offload functions.
  * int (*ndo_fcoe_enable)(struct net_device *dev);
@@ -1059,6 +1125,9 @@ typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
  *	This function is used to get egress tunnel information for given skb.
  *	This is useful for retrieving outer tunnel header parameters while
  *	sampling packet.
+ * int (*ndo_xdp)(struct net_device *dev, struct netdev_xdp *xdp);
+ *	This function is used to set or query state related to XDP on the
+ *	netdevice. See definition of enum xdp_netdev_command for details.
  *
  */
 struct net_device_ops {
@@ -1134,6 +1203,10 @@ struct net_device_ops {
 						   struct net_device *dev,
 						   int vf, bool setting);
 	int			(*ndo_setup_tc)(struct net_device *dev, u8 tc);
+	int			(*ndo_setup_launchtime)(struct net_device *dev,
+							int queue, bool enable);
+	int			(*ndo_setup_tc_flower)(struct net_device *dev,
+						       struct tc_cls_flower_offload *f);
 #if IS_ENABLED(CONFIG_FCOE)
 	int			(*ndo_fcoe_enable)(struct net_device *dev);
 	int			(*ndo_fcoe_disable)(struct net_device *dev);
@@ -1236,6 +1309,8 @@ struct net_device_ops {
 							 bool proto_down);
 	int			(*ndo_fill_metadata_dst)(struct net_device *dev,
 						       struct sk_buff *skb);
+	int			(*ndo_xdp)(struct net_device *dev,
+					   struct netdev_xdp *xdp);
 };
 
 /**
@@ -1469,6 +1544,8 @@ enum netdev_priv_flags {
  *	@tx_global_lock: 	XXX: need comments on this one
  *
  *	@xps_maps:	XXX: need comments on this one
+ *	@xps_symmetric:	Transmit on the queue with the index of the rx queue
+ *			the flow arrives on, before consulting @xps_maps
  *
  *	@offload_fwd_mark:	Offload device fwding mark
  *
@@ -1714,6 +1791,7 @@ struct net_device {
 
 #ifdef CONFIG_XPS
 	struct xps_dev_maps __rcu *xps_maps;
+	bool			xps_symmetric;
 #endif
 
 #ifdef CONFIG_NET_SWITCHDEV
@@ -2003,7 +2081,10 @@ struct napi_gro_cb {
 	/* Used in foo-over-udp, set in udp[46]_gro_receive */
 	u8	is_ipv6:1;
 
-	/* 7 bit hole */
+	/* Held skb aggregates plain UDP datagrams, see udp_gro_receive_segment */
+	u8	is_udp_l4:1;
+
+	/* 6 bit hole */
 
 	/* used to support CHECKSUM_COMPLETE for tunneling protocols */
 	__wsum	csum;
@@ -2021,6 +2102,9 @@ struct packet_type {
 					 struct net_device *,
 					 struct packet_type *,
 					 struct net_device *);
+	void			(*list_func) (struct sk_buff_head *,
+					      struct packet_type *,
+					      struct net_device *);
 	bool			(*id_match)(struct packet_type *ptype,
 					    struct sock *sk);
 	void			*af_packet_priv;
@@ -3023,6 +3107,7 @@ static inline void dev_consume_skb_any(struct sk_buff *skb)
 int netif_rx(struct sk_buff *skb);
 int netif_rx_ni(struct sk_buff *skb);
 int netif_receive_skb(struct sk_buff *skb);
+void netif_receive_skb_list(struct sk_buff_head *head);
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb);
 void napi_gro_flush(struct napi_struct *napi, bool flush_old);
 struct sk_buff *napi_get_frags(struct napi_struct *napi);
@@ -3054,6 +3139,7 @@ int dev_change_name(struct net_device *, const char *);
 int dev_set_alias(struct net_device *, const char *, size_t);
 int dev_change_net_namespace(struct net_device *, struct net *, const char *);
 int dev_set_mtu(struct net_device *, int);
+int dev_change_tx_queue_len(struct net_device *, unsigned long);
 void dev_set_group(struct net_device *, int);
 int dev_set_mac_address(struct net_device *, struct sockaddr *);
 int dev_change_carrier(struct net_device *, bool new_carrier);
@@ -3062,6 +3148,7 @@ int dev_get_phys_port_id(struct net_device *dev,
 int dev_get_phys_port_name(struct net_device *dev,
 			   char *name, size_t len);
 int dev_change_proto_down(struct net_device *dev, bool proto_down);
+int dev_change_xdp_fd(struct net_device *dev, int fd);
 struct sk_buff *validate_xmit_skb_list(struct sk_buff *skb, struct net_device *dev);
 struct sk_buff *dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 				    struct netdev_queue *txq, int *ret);
@@ -3789,6 +3876,7 @@ static inline bool net_gso_ok(netdev_features_t features, int gso_type)
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL != (NETIF_F_GSO_UDP_TUNNEL >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL_CSUM != (NETIF_F_GSO_UDP_TUNNEL_CSUM >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_TUNNEL_REMCSUM != (NETIF_F_GSO_TUNNEL_REMCSUM >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_UDP_L4 != (NETIF_F_GSO_UDP_L4 >> NETIF_F_GSO_SHIFT));
 
 	return (features & feature) == feature;
 }
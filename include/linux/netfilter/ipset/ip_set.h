@@ -15,6 +15,9 @@
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/x_tables.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
 #include <linux/stringify.h>
 #include <linux/vmalloc.h>
 #include <net/netlink.h>
@@ -69,6 +72,8 @@ enum ip_set_extension {
 #define SET_WITH_COMMENT(s)	((s)->extensions & IPSET_EXT_COMMENT)
 #define SET_WITH_SKBINFO(s)	((s)->extensions & IPSET_EXT_SKBINFO)
 #define SET_WITH_FORCEADD(s)	((s)->flags & IPSET_CREATE_FLAG_FORCEADD)
+#define SET_WITH_PCPU_COUNTERS(s)	\
+	((s)->flags & IPSET_CREATE_FLAG_PCPU_COUNTERS)
 
 /* Extension id, in size order */
 enum ip_set_ext_id {
@@ -103,9 +108,24 @@ struct ip_set_ext {
 	char *comment;
 };
 
+struct ip_set_counter_pcpu {
+	u64 bytes;
+	u64 packets;
+};
+
+struct ip_set_counter_rcu {
+	struct rcu_head rcu;
+	struct ip_set_counter_pcpu __percpu *pcpu;
+};
+
+/* With IPSET_CREATE_FLAG_PCPU_COUNTERS, matches are accounted in @pcpu and
+ * summed on read. The atomics hold the values set from userspace and are
+ * the fallback when the per-cpu area could not be allocated.
+ */
 struct ip_set_counter {
 	atomic64_t bytes;
 	atomic64_t packets;
+	struct ip_set_counter_rcu __rcu *pcpu;
 };
 
 struct ip_set_comment_rcu {
@@ -262,6 +282,9 @@ ip_set_ext_destroy(struct ip_set *set, void *data)
 	/* Check that the extension is enabled for the set and
 	 * call it's destroy function for its extension part in data.
 	 */
+	if (SET_WITH_COUNTER(set) && SET_WITH_PCPU_COUNTERS(set))
+		ip_set_extensions[IPSET_EXT_ID_COUNTER].destroy(
+			ext_counter(data, set));
 	if (SET_WITH_COMMENT(set))
 		ip_set_extensions[IPSET_EXT_ID_COMMENT].destroy(
 			ext_comment(data, set));
@@ -284,34 +307,53 @@ ip_set_put_flags(struct sk_buff *skb, struct ip_set *set)
 		cadt_flags |= IPSET_FLAG_WITH_SKBINFO;
 	if (SET_WITH_FORCEADD(set))
 		cadt_flags |= IPSET_FLAG_WITH_FORCEADD;
+	if (SET_WITH_PCPU_COUNTERS(set))
+		cadt_flags |= IPSET_FLAG_PCPU_COUNTERS;
 
 	if (!cadt_flags)
 		return 0;
 	return nla_put_net32(skb, IPSET_ATTR_CADT_FLAGS, htonl(cadt_flags));
 }
 
+/* Readers hold rcu_read_lock_bh(), writers the set lock */
 static inline void
-ip_set_add_bytes(u64 bytes, struct ip_set_counter *counter)
+ip_set_add_counter(u64 bytes, u64 packets, struct ip_set_counter *counter)
 {
-	atomic64_add((long long)bytes, &(counter)->bytes);
-}
+	struct ip_set_counter_rcu *c = rcu_dereference_bh_check(counter->pcpu, 1);
 
-static inline void
-ip_set_add_packets(u64 packets, struct ip_set_counter *counter)
-{
+	if (c) {
+		this_cpu_add(c->pcpu->bytes, bytes);
+		this_cpu_add(c->pcpu->packets, packets);
+		return;
+	}
+	atomic64_add((long long)bytes, &(counter)->bytes);
 	atomic64_add((long long)packets, &(counter)->packets);
 }
 
 static inline u64
 ip_set_get_bytes(const struct ip_set_counter *counter)
 {
-	return (u64)atomic64_read(&(counter)->bytes);
+	struct ip_set_counter_rcu *c = rcu_dereference_bh_check(counter->pcpu, 1);
+	u64 bytes = (u64)atomic64_read(&(counter)->bytes);
+	int cpu;
+
+	if (c)
+		for_each_possible_cpu(cpu)
+			bytes += per_cpu_ptr(c->pcpu, cpu)->bytes;
+	return bytes;
 }
 
 static inline u64
 ip_set_get_packets(const struct ip_set_counter *counter)
 {
-	return (u64)atomic64_read(&(counter)->packets);
+	struct ip_set_counter_rcu *c = rcu_dereference_bh_check(counter->pcpu, 1);
+	u64 packets = (u64)atomic64_read(&(counter)->packets);
+	int cpu;
+
+	if (c)
+		for_each_possible_cpu(cpu)
+			packets += per_cpu_ptr(c->pcpu, cpu)->packets;
+	return packets;
 }
 
 static inline void
@@ -320,10 +362,8 @@ ip_set_update_counter(struct ip_set_counter *counter,
 		      struct ip_set_ext *mext, u32 flags)
 {
 	if (ext->packets != ULLONG_MAX &&
-	    !(flags & IPSET_FLAG_SKIP_COUNTER_UPDATE)) {
-		ip_set_add_bytes(ext->bytes, counter);
-		ip_set_add_packets(ext->packets, counter);
-	}
+	    !(flags & IPSET_FLAG_SKIP_COUNTER_UPDATE))
+		ip_set_add_counter(ext->bytes, ext->packets, counter);
 	if (flags & IPSET_FLAG_MATCH_COUNTERS) {
 		mext->packets = ip_set_get_packets(counter);
 		mext->bytes = ip_set_get_bytes(counter);
@@ -376,13 +416,63 @@ ip_set_put_counter(struct sk_buff *skb, struct ip_set_counter *counter)
 }
 
 static inline void
-ip_set_init_counter(struct ip_set_counter *counter,
+ip_set_counter_free_rcu(struct rcu_head *head)
+{
+	struct ip_set_counter_rcu *c;
+
+	c = container_of(head, struct ip_set_counter_rcu, rcu);
+	free_percpu(c->pcpu);
+	kfree(c);
+}
+
+static inline void
+ip_set_counter_free(struct ip_set_counter *counter)
+{
+	struct ip_set_counter_rcu *c;
+
+	c = rcu_dereference_protected(counter->pcpu, 1);
+	if (unlikely(!c))
+		return;
+	rcu_assign_pointer(counter->pcpu, NULL);
+	call_rcu(&c->rcu, ip_set_counter_free_rcu);
+}
+
+/* Called with the set lock held. A failed per-cpu allocation is not an
+ * error: the element is then accounted in the shared atomics.
+ */
+static inline void
+ip_set_init_counter(struct ip_set *set, struct ip_set_counter *counter,
 		    const struct ip_set_ext *ext)
 {
+	struct ip_set_counter_rcu *c = rcu_dereference_protected(counter->pcpu, 1);
+	int cpu;
+
+	if (c && (ext->bytes != ULLONG_MAX || ext->packets != ULLONG_MAX)) {
+		/* Fold what has been accounted so far, then restart */
+		for_each_possible_cpu(cpu) {
+			struct ip_set_counter_pcpu *p = per_cpu_ptr(c->pcpu, cpu);
+
+			atomic64_add(p->bytes, &(counter)->bytes);
+			atomic64_add(p->packets, &(counter)->packets);
+			p->bytes = p->packets = 0;
+		}
+	}
 	if (ext->bytes != ULLONG_MAX)
 		atomic64_set(&(counter)->bytes, (long long)(ext->bytes));
 	if (ext->packets != ULLONG_MAX)
 		atomic64_set(&(counter)->packets, (long long)(ext->packets));
+
+	if (c || !SET_WITH_PCPU_COUNTERS(set))
+		return;
+	c = kmalloc(sizeof(*c), GFP_ATOMIC);
+	if (unlikely(!c))
+		return;
+	c->pcpu = alloc_percpu_gfp(struct ip_set_counter_pcpu, GFP_ATOMIC);
+	if (unlikely(!c->pcpu)) {
+		kfree(c);
+		return;
+	}
+	rcu_assign_pointer(counter->pcpu, c);
 }
 
 /* Netlink CB args */
@@ -226,6 +226,11 @@ struct xt_table_info {
 	unsigned int stacksize;
 	void ***jumpstack;
 
+	/* Optional rule lookup index built by the family at translate time,
+	 * a single allocation released with kvfree().
+	 */
+	void *index;
+
 	unsigned char entries[0] __aligned(8);
 };
 
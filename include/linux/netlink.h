@@ -158,6 +158,8 @@ struct netlink_dump_control {
 	void *data;
 	struct module *module;
 	u16 min_dump_alloc;
+	/* dump does its own locking and must not run under cb_mutex */
+	bool unlocked;
 };
 
 extern int __netlink_dump_start(struct sock *ssk, struct sk_buff *skb,
@@ -915,5 +915,7 @@ struct nilfs_bdesc {
 	_IOW(NILFS_IOCTL_IDENT, 0x8C, __u64[2])
 #define NILFS_IOCTL_SET_SUINFO  \
 	_IOW(NILFS_IOCTL_IDENT, 0x8D, struct nilfs_argv)
+#define NILFS_IOCTL_GET_VICTIMS  \
+	_IOWR(NILFS_IOCTL_IDENT, 0x8E, struct nilfs_argv)
 
 #endif	/* _LINUX_NILFS_FS_H */
@@ -7,6 +7,7 @@
  */
 
 #include <linux/spinlock.h>
+#include <linux/seqlock.h>
 #include <linux/smp.h>
 #include <linux/list.h>
 #include <linux/threads.h>
@@ -18,6 +19,7 @@
 
 struct percpu_counter {
 	raw_spinlock_t lock;
+	seqcount_t fold_seq;	/* written under lock whenever count changes */
 	s64 count;
 #ifdef CONFIG_HOTPLUG_CPU
 	struct list_head list;	/* All percpu_counters are on a list */
@@ -42,12 +44,29 @@ void percpu_counter_set(struct percpu_counter *fbc, s64 amount);
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch);
 s64 __percpu_counter_sum(struct percpu_counter *fbc);
 int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch);
+int __percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs,
+				    s32 batch);
+s32 __percpu_counter_tuned_batch(struct percpu_counter *fbc, s64 threshold,
+				 s32 max_batch);
 
 static inline int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
 	return __percpu_counter_compare(fbc, rhs, percpu_counter_batch);
 }
 
+static inline int percpu_counter_compare_approx(struct percpu_counter *fbc,
+						s64 rhs)
+{
+	return __percpu_counter_compare_approx(fbc, rhs, percpu_counter_batch);
+}
+
+static inline s32 percpu_counter_tuned_batch(struct percpu_counter *fbc,
+					     s64 threshold)
+{
+	return __percpu_counter_tuned_batch(fbc, threshold,
+					    percpu_counter_batch);
+}
+
 static inline void percpu_counter_add(struct percpu_counter *fbc, s64 amount)
 {
 	__percpu_counter_add(fbc, amount, percpu_counter_batch);
@@ -127,6 +146,31 @@ __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch)
 	return percpu_counter_compare(fbc, rhs);
 }
 
+static inline int
+percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs)
+{
+	return percpu_counter_compare(fbc, rhs);
+}
+
+static inline int
+__percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs, s32 batch)
+{
+	return percpu_counter_compare(fbc, rhs);
+}
+
+static inline s32
+percpu_counter_tuned_batch(struct percpu_counter *fbc, s64 threshold)
+{
+	return 1;
+}
+
+static inline s32
+__percpu_counter_tuned_batch(struct percpu_counter *fbc, s64 threshold,
+			     s32 max_batch)
+{
+	return 1;
+}
+
 static inline void
 percpu_counter_add(struct percpu_counter *fbc, s64 amount)
 {
@@ -569,6 +569,10 @@ struct perf_event {
 	u64				(*clock)(void);
 	perf_overflow_handler_t		overflow_handler;
 	void				*overflow_handler_context;
+#ifdef CONFIG_BPF_SYSCALL
+	perf_overflow_handler_t		orig_overflow_handler;
+	struct bpf_prog			*prog;
+#endif
 
 #ifdef CONFIG_EVENT_TRACING
 	struct trace_event_call		*tp_event;
@@ -581,6 +585,7 @@ struct perf_event {
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp; /* cgroup event is attach to */
 	int				cgrp_defer_enabled;
+	struct rb_node			cgrp_node; /* in ctx->cgrp_groups */
 #endif
 
 #endif /* CONFIG_PERF_EVENTS */
@@ -633,6 +638,7 @@ struct perf_event_context {
 	u64				generation;
 	int				pin_count;
 	int				nr_cgroups;	 /* cgroup evts */
+	struct rb_root			cgrp_groups;	 /* cgroup leaders by cgrp */
 	void				*task_ctx_data; /* pmu specific data */
 	struct rcu_head			rcu_head;
 
@@ -798,6 +804,15 @@ struct perf_sample_data {
 	u64				stack_user_size;
 } ____cacheline_aligned;
 
+/*
+ * What a BPF_PROG_TYPE_PERF_EVENT program really runs on; the verifier
+ * rewrites its struct bpf_perf_event_data accesses into loads from here.
+ */
+struct bpf_perf_event_data_kern {
+	struct pt_regs *regs;
+	struct perf_sample_data *data;
+};
+
 /* default value for data source */
 #define PERF_MEM_NA (PERF_MEM_S(OP, NA)   |\
 		    PERF_MEM_S(LVL, NA)   |\
@@ -968,6 +983,11 @@ DECLARE_PER_CPU(struct perf_callchain_entry, perf_callchain_entry);
 
 extern void perf_callchain_user(struct perf_callchain_entry *entry, struct pt_regs *regs);
 extern void perf_callchain_kernel(struct perf_callchain_entry *entry, struct pt_regs *regs);
+extern struct perf_callchain_entry *
+get_perf_callchain(struct pt_regs *regs, u32 init_nr, bool kernel, bool user,
+		   bool crosstask, bool add_mark);
+extern int get_callchain_buffers(void);
+extern void put_callchain_buffers(void);
 
 static inline void perf_callchain_store(struct perf_callchain_entry *entry, u64 ip)
 {
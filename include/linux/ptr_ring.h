@@ -0,0 +1,186 @@
+/*
+ *	Definitions for a fixed size ring of pointers
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ *
+ * The ring is an array of pointers, an empty slot holds NULL. Producers
+ * and consumers serialize on separate locks and only meet on the slots,
+ * so a producer and a consumer never contend unless the ring is close to
+ * empty or full. NULL pointers can't be queued.
+ *
+ * The __ versions expect the caller to hold the matching lock. The others
+ * take it, in the context the caller runs in: users on the packet path run
+ * with BH disabled.
+ */
+#ifndef _LINUX_PTR_RING_H
+#define _LINUX_PTR_RING_H
+
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <asm/barrier.h>
+
+struct ptr_ring {
+	int		producer ____cacheline_aligned_in_smp;
+	spinlock_t	producer_lock;
+	int		consumer ____cacheline_aligned_in_smp;
+	spinlock_t	consumer_lock;
+	/* Shared, read-mostly */
+	int		size ____cacheline_aligned_in_smp;
+	void		**queue;
+};
+
+/* Racy without the producer lock: the answer may be stale on return */
+static inline bool __ptr_ring_full(struct ptr_ring *r)
+{
+	return r->queue[r->producer];
+}
+
+/* Returns -ENOSPC if the ring is full */
+static inline int __ptr_ring_produce(struct ptr_ring *r, void *ptr)
+{
+	if (unlikely(!r->size) || r->queue[r->producer])
+		return -ENOSPC;
+
+	/* make the data @ptr points to visible before @ptr itself */
+	smp_wmb();
+
+	WRITE_ONCE(r->queue[r->producer++], ptr);
+	if (unlikely(r->producer >= r->size))
+		r->producer = 0;
+	return 0;
+}
+
+static inline int ptr_ring_produce(struct ptr_ring *r, void *ptr)
+{
+	int ret;
+
+	spin_lock(&r->producer_lock);
+	ret = __ptr_ring_produce(r, ptr);
+	spin_unlock(&r->producer_lock);
+
+	return ret;
+}
+
+/*
+ * Safe without the consumer lock when a false answer only costs a retry:
+ * a non-empty ring may be seen as empty, never the other way round.
+ */
+static inline bool __ptr_ring_empty(struct ptr_ring *r)
+{
+	if (likely(r->size))
+		return !READ_ONCE(r->queue[READ_ONCE(r->consumer)]);
+	return true;
+}
+
+static inline void *__ptr_ring_peek(struct ptr_ring *r)
+{
+	if (likely(r->size))
+		return READ_ONCE(r->queue[r->consumer]);
+	return NULL;
+}
+
+static inline void *__ptr_ring_consume(struct ptr_ring *r)
+{
+	void *ptr;
+
+	ptr = __ptr_ring_peek(r);
+	if (ptr) {
+		/* pairs with smp_wmb() in __ptr_ring_produce() */
+		smp_read_barrier_depends();
+		WRITE_ONCE(r->queue[r->consumer++], NULL);
+		if (unlikely(r->consumer >= r->size))
+			r->consumer = 0;
+	}
+	return ptr;
+}
+
+static inline void *ptr_ring_consume(struct ptr_ring *r)
+{
+	void *ptr;
+
+	spin_lock(&r->consumer_lock);
+	ptr = __ptr_ring_consume(r);
+	spin_unlock(&r->consumer_lock);
+
+	return ptr;
+}
+
+static inline int ptr_ring_init(struct ptr_ring *r, int size, gfp_t gfp)
+{
+	r->queue = kcalloc(size, sizeof(void *), gfp);
+	if (!r->queue)
+		return -ENOMEM;
+
+	r->size = size;
+	r->producer = r->consumer = 0;
+	spin_lock_init(&r->producer_lock);
+	spin_lock_init(&r->consumer_lock);
+
+	return 0;
+}
+
+/*
+ * No producers or consumers may be left. @destroy, if given, is called on
+ * every pointer still queued.
+ */
+static inline void ptr_ring_cleanup(struct ptr_ring *r, void (*destroy)(void *))
+{
+	void *ptr;
+
+	if (destroy)
+		while ((ptr = __ptr_ring_consume(r)))
+			destroy(ptr);
+	kfree(r->queue);
+	r->queue = NULL;
+	r->size = 0;
+}
+
+/*
+ * Moves the queued pointers, oldest first, to a new ring of @size. @destroy,
+ * if given, is called on those that no longer fit. Takes both locks, from
+ * process context.
+ */
+static inline int ptr_ring_resize(struct ptr_ring *r, int size, gfp_t gfp,
+				  void (*destroy)(void *))
+{
+	void **queue = kcalloc(size, sizeof(void *), gfp);
+	void **old;
+	int producer = 0;
+	void *ptr;
+
+	if (!queue)
+		return -ENOMEM;
+
+	spin_lock_bh(&r->consumer_lock);
+	spin_lock(&r->producer_lock);
+
+	while ((ptr = __ptr_ring_consume(r))) {
+		if (producer < size)
+			queue[producer++] = ptr;
+		else if (destroy)
+			destroy(ptr);
+	}
+	if (producer >= size)
+		producer = 0;
+
+	old = r->queue;
+	r->queue = queue;
+	r->size = size;
+	r->producer = producer;
+	r->consumer = 0;
+
+	spin_unlock(&r->producer_lock);
+	spin_unlock_bh(&r->consumer_lock);
+
+	kfree(old);
+	return 0;
+}
+
+#endif /* _LINUX_PTR_RING_H */
@@ -40,6 +40,13 @@
  * Indirect pointer in fact is also used to tag the last pointer of a node
  * when it is shrunk, before we rcu free the node. See shrink code for
  * details.
+ *
+ * Inside the tree, slots of interior nodes hold indirect pointers to their
+ * child nodes too, so that a data item can sit at any level: a multi-order
+ * entry covering an aligned range of 2^order indices is stored once in the
+ * level whose slots are closest in size, and the remaining slots it covers
+ * in that node hold sibling entries, indirect pointers back to the
+ * canonical slot.  Lookups and iteration never return a sibling entry.
  */
 #define RADIX_TREE_INDIRECT_PTR		1
 /*
@@ -72,6 +79,18 @@ static inline int radix_tree_is_indirect_ptr(void *ptr)
 #define RADIX_TREE_TAG_LONGS	\
 	((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
+/*
+ * Sibling entries always follow their canonical slot within the same node,
+ * which is what tells them apart from child nodes and retry entries.
+ */
+static inline bool radix_tree_is_sibling_entry(void **slot, void *entry)
+{
+	void **canon = (void **)((unsigned long)entry & ~RADIX_TREE_INDIRECT_PTR);
+
+	return radix_tree_is_indirect_ptr(entry) &&
+		canon < slot && canon >= slot - (RADIX_TREE_MAP_SIZE - 1);
+}
+
 #define RADIX_TREE_INDEX_BITS  (8 /* CHAR_BIT */ * sizeof(unsigned long))
 #define RADIX_TREE_MAX_PATH (DIV_ROUND_UP(RADIX_TREE_INDEX_BITS, \
 					  RADIX_TREE_MAP_SHIFT))
@@ -261,8 +280,15 @@ static inline void radix_tree_replace_slot(void **pslot, void *item)
 }
 
 int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
-			struct radix_tree_node **nodep, void ***slotp);
-int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
+			unsigned int order, struct radix_tree_node **nodep,
+			void ***slotp);
+int __radix_tree_insert(struct radix_tree_root *, unsigned long index,
+			unsigned int order, void *);
+static inline int radix_tree_insert(struct radix_tree_root *root,
+			unsigned long index, void *entry)
+{
+	return __radix_tree_insert(root, index, 0, entry);
+}
 void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
 			  struct radix_tree_node **nodep, void ***slotp);
 void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
@@ -312,6 +338,7 @@ static inline void radix_tree_preload_end(void)
  * @index:	index of current slot
  * @next_index:	next-to-last index for this chunk
  * @tags:	bit-mask for tag-iterating
+ * @shift:	log2 of the number of indices each slot of the chunk covers
  *
  * This radix tree iterator works in terms of "chunks" of slots.  A chunk is a
  * subinterval of slots contained within one radix tree leaf node.  It is
@@ -319,17 +346,26 @@ static inline void radix_tree_preload_end(void)
  * which holds the chunk's position in the tree and its size.  For tagged
  * iteration radix_tree_iter also holds the slots' bit-mask for one chosen
  * radix tree tag.
+ *
+ * A multi-order entry stored above the leaves is returned as a chunk of its
+ * own, with @index set to the first index it covers and @shift to its size.
  */
 struct radix_tree_iter {
 	unsigned long	index;
 	unsigned long	next_index;
 	unsigned long	tags;
+	unsigned int	shift;
 };
 
 #define RADIX_TREE_ITER_TAG_MASK	0x00FF	/* tag index in lower byte */
 #define RADIX_TREE_ITER_TAGGED		0x0100	/* lookup tagged slots */
 #define RADIX_TREE_ITER_CONTIG		0x0200	/* stop at first hole */
 
+unsigned int
+radix_tree_gang_lookup_tag_iter(struct radix_tree_root *root, void ***results,
+		struct radix_tree_iter *iter, void ***cursor,
+		unsigned int max_items, unsigned int tag);
+
 /**
  * radix_tree_iter_init - initialize radix tree iterator
  *
@@ -350,6 +386,7 @@ radix_tree_iter_init(struct radix_tree_iter *iter, unsigned long start)
 	 */
 	iter->index = 0;
 	iter->next_index = start;
+	iter->shift = 0;
 	return NULL;
 }
 
@@ -394,7 +431,7 @@ void **radix_tree_iter_retry(struct radix_tree_iter *iter)
 static __always_inline long
 radix_tree_chunk_size(struct radix_tree_iter *iter)
 {
-	return iter->next_index - iter->index;
+	return (iter->next_index - iter->index) >> iter->shift;
 }
 
 /**
@@ -430,8 +467,13 @@ radix_tree_next_slot(void **slot, struct radix_tree_iter *iter, unsigned flags)
 		while (--size > 0) {
 			slot++;
 			iter->index++;
-			if (likely(*slot))
+			if (likely(*slot)) {
+				/* covered by the entry we returned before */
+				if (unlikely(radix_tree_is_sibling_entry(slot,
+								*slot)))
+					continue;
 				return slot;
+			}
 			if (flags & RADIX_TREE_ITER_CONTIG) {
 				/* forbid switching to the next chunk */
 				iter->next_index = 0;
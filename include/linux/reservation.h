@@ -136,6 +136,10 @@ long reservation_object_wait_timeout_rcu(struct reservation_object *obj,
 					 bool wait_all, bool intr,
 					 unsigned long timeout);
 
+long reservation_object_wait_batch_rcu(struct reservation_object **objs,
+				       unsigned count, bool wait_all,
+				       bool intr, unsigned long timeout);
+
 bool reservation_object_test_signaled_rcu(struct reservation_object *obj,
 					  bool test_all);
 
@@ -18,6 +18,7 @@
 #define _LINUX_RHASHTABLE_H
 
 #include <linux/atomic.h>
+#include <linux/bit_spinlock.h>
 #include <linux/compiler.h>
 #include <linux/err.h>
 #include <linux/errno.h>
@@ -28,26 +29,18 @@
 #include <linux/rcupdate.h>
 
 /*
- * The end of the chain is marked with a special nulls marks which has
- * the following format:
+ * Each bucket is a single pointer to the first entry of its chain, and
+ * bit 0 of that pointer is a bit spinlock protecting the chain.  There
+ * is no separate lock array, and writers only ever contend when they
+ * hash to the same bucket.
  *
- * +-------+-----------------------------------------------------+-+
- * | Base  |                      Hash                           |1|
- * +-------+-----------------------------------------------------+-+
- *
- * Base (4 bits) : Reserved to distinguish between multiple tables.
- *                 Specified via &struct rhashtable_params.nulls_base.
- * Hash (27 bits): Full hash (unmasked) of first element added to bucket
- * 1 (1 bit)     : Nulls marker (always set)
- *
- * The remaining bits of the next pointer remain unused for now.
+ * An empty bucket holds NULL.  The last entry of a chain points to a
+ * nulls marker made from the address of its bucket, and readers see
+ * that marker for an empty bucket too, so chains are always walked
+ * until rht_is_a_nulls().
  */
-#define RHT_BASE_BITS		4
-#define RHT_HASH_BITS		27
-#define RHT_BASE_SHIFT		RHT_HASH_BITS
-
-/* Base bits plus 1 bit for nulls marker */
-#define RHT_HASH_RESERVED_SPACE	(RHT_BASE_BITS + 1)
+#define RHT_NULLS_MARKER(ptr)	\
+	((void *)NULLS_MARKER(((unsigned long) (ptr)) >> 1))
 
 struct rhash_head {
 	struct rhash_head __rcu		*next;
@@ -56,21 +49,23 @@ struct rhash_head {
 /**
  * struct bucket_table - Table of hash buckets
  * @size: Number of hash buckets
+ * @nest: Number of buckets per page, as a shift, if the table is nested
  * @rehash: Current bucket being rehashed
  * @hash_rnd: Random seed to fold into hash
- * @locks_mask: Mask to apply before accessing locks[]
- * @locks: Array of spinlocks protecting individual buckets
  * @walkers: List of active walkers
  * @rcu: RCU structure for freeing the table
  * @future_tbl: Table under construction during rehashing
- * @buckets: size * hash buckets
+ * @buckets: size * hash buckets, or size >> nest pages of buckets
+ *
+ * A table too large to be allocated in one piece is nested: @buckets
+ * then holds pointers to pages of buckets instead of the buckets
+ * themselves.  Use rht_bucket() rather than @buckets directly.
  */
 struct bucket_table {
 	unsigned int		size;
+	unsigned int		nest;
 	unsigned int		rehash;
 	u32			hash_rnd;
-	unsigned int		locks_mask;
-	spinlock_t		*locks;
 	struct list_head	walkers;
 	struct rcu_head		rcu;
 
@@ -105,10 +100,8 @@ struct rhashtable;
  * @insecure_max_entries: Maximum number of entries (may be exceeded)
  * @max_size: Maximum size while expanding
  * @min_size: Minimum size while shrinking
- * @nulls_base: Base value to generate nulls marker
  * @insecure_elasticity: Set to true to disable chain length checks
  * @automatic_shrinking: Enable automatic shrinking of tables
- * @locks_mul: Number of bucket locks to allocate per cpu (default: 128)
  * @hashfn: Hash function (default: jhash2 if !(key_len % 4), or jhash)
  * @obj_hashfn: Function to hash object
  * @obj_cmpfn: Function to compare key with object
@@ -121,10 +114,8 @@ struct rhashtable_params {
 	unsigned int		insecure_max_entries;
 	unsigned int		max_size;
 	unsigned int		min_size;
-	u32			nulls_base;
 	bool			insecure_elasticity;
 	bool			automatic_shrinking;
-	size_t			locks_mul;
 	rht_hashfn_t		hashfn;
 	rht_obj_hashfn_t	obj_hashfn;
 	rht_obj_cmpfn_t		obj_cmpfn;
@@ -178,14 +169,6 @@ struct rhashtable_iter {
 	unsigned int skip;
 };
 
-static inline unsigned long rht_marker(const struct rhashtable *ht, u32 hash)
-{
-	return NULLS_MARKER(ht->p.nulls_base + hash);
-}
-
-#define INIT_RHT_NULLS_HEAD(ptr, ht, hash) \
-	((ptr) = (typeof(ptr)) rht_marker(ht, hash))
-
 static inline bool rht_is_a_nulls(const struct rhash_head *ptr)
 {
 	return ((unsigned long) ptr & 1);
@@ -205,7 +188,7 @@ static inline void *rht_obj(const struct rhashtable *ht,
 static inline unsigned int rht_bucket_index(const struct bucket_table *tbl,
 					    unsigned int hash)
 {
-	return (hash >> RHT_HASH_RESERVED_SPACE) & (tbl->size - 1);
+	return hash & (tbl->size - 1);
 }
 
 static inline unsigned int rht_key_hashfn(
@@ -302,25 +285,6 @@ static inline bool rht_grow_above_max(const struct rhashtable *ht,
 	       atomic_read(&ht->nelems) >= ht->p.insecure_max_entries;
 }
 
-/* The bucket lock is selected based on the hash and protects mutations
- * on a group of hash buckets.
- *
- * A maximum of tbl->size/2 bucket locks is allocated. This ensures that
- * a single lock always covers both buckets which may both contains
- * entries which link to the same bucket of the old table during resizing.
- * This allows to simplify the locking as locking the bucket in both
- * tables during resize always guarantee protection.
- *
- * IMPORTANT: When holding the bucket lock of both the old and new table
- * during expansions and shrinking, the old bucket lock must always be
- * acquired first.
- */
-static inline spinlock_t *rht_bucket_lock(const struct bucket_table *tbl,
-					  unsigned int hash)
-{
-	return &tbl->locks[hash & tbl->locks_mask];
-}
-
 #ifdef CONFIG_PROVE_LOCKING
 int lockdep_rht_mutex_is_held(struct rhashtable *ht);
 int lockdep_rht_bucket_is_held(const struct bucket_table *tbl, u32 hash);
@@ -337,6 +301,91 @@ static inline int lockdep_rht_bucket_is_held(const struct bucket_table *tbl,
 }
 #endif /* CONFIG_PROVE_LOCKING */
 
+struct rhash_head __rcu **rht_bucket_nested(const struct bucket_table *tbl,
+					    unsigned int hash);
+
+/* Returns the bucket @hash of @tbl, nested or not */
+static inline struct rhash_head __rcu **rht_bucket(
+	const struct bucket_table *tbl, unsigned int hash)
+{
+	return unlikely(tbl->nest) ? rht_bucket_nested(tbl, hash) :
+				     (struct rhash_head __rcu **)
+				     &tbl->buckets[hash];
+}
+
+/*
+ * The bucket lock is bit 0 of the bucket itself and protects mutations
+ * of its chain.  Like a spinlock taken with spin_lock_bh() it disables
+ * bottom halves while held.
+ *
+ * IMPORTANT: When holding the bucket lock of both the old and new table
+ * during expansions and shrinking, the old bucket lock must always be
+ * acquired first.
+ */
+static inline void rht_lock(struct rhash_head __rcu **bkt)
+{
+	local_bh_disable();
+	bit_spin_lock(0, (unsigned long *)bkt);
+}
+
+static inline void rht_unlock(struct rhash_head __rcu **bkt)
+{
+	bit_spin_unlock(0, (unsigned long *)bkt);
+	local_bh_enable();
+}
+
+/* Nested inside another bucket lock, bottom halves are already off */
+static inline void rht_lock_nested(struct rhash_head __rcu **bkt)
+{
+	bit_spin_lock(0, (unsigned long *)bkt);
+}
+
+static inline void rht_unlock_nested(struct rhash_head __rcu **bkt)
+{
+	bit_spin_unlock(0, (unsigned long *)bkt);
+}
+
+static inline struct rhash_head *__rht_ptr(struct rhash_head *p,
+					   struct rhash_head __rcu **bkt)
+{
+	return (struct rhash_head *)
+		((unsigned long)p & ~1UL ?: (unsigned long)RHT_NULLS_MARKER(bkt));
+}
+
+/*
+ * rht_ptr() returns the first entry of a bucket, or its nulls marker,
+ * with the lock bit masked off.  rht_ptr_rcu() is for readers under
+ * rcu_read_lock(), rht_ptr() for writers holding the bucket lock and
+ * rht_ptr_exclusive() for when nobody else can access the table.
+ */
+static inline struct rhash_head *rht_ptr_rcu(struct rhash_head __rcu **bkt)
+{
+	return __rht_ptr(rcu_dereference_raw(*bkt), bkt);
+}
+
+static inline struct rhash_head *rht_ptr(struct rhash_head __rcu **bkt,
+					 struct bucket_table *tbl,
+					 unsigned int hash)
+{
+	return __rht_ptr(rcu_dereference_protected(*bkt,
+			 lockdep_rht_bucket_is_held(tbl, hash)), bkt);
+}
+
+static inline struct rhash_head *rht_ptr_exclusive(
+	struct rhash_head __rcu **bkt)
+{
+	return __rht_ptr(rcu_dereference_protected(*bkt, 1), bkt);
+}
+
+/* Makes @obj the first entry of a bucket whose lock is held */
+static inline void rht_assign_locked(struct rhash_head __rcu **bkt,
+				     struct rhash_head *obj)
+{
+	if (rht_is_a_nulls(obj))
+		obj = NULL;
+	rcu_assign_pointer(*bkt, (void *)((unsigned long)obj | 1UL));
+}
+
 int rhashtable_init(struct rhashtable *ht,
 		    const struct rhashtable_params *params);
 
@@ -345,6 +394,8 @@ struct bucket_table *rhashtable_insert_slow(struct rhashtable *ht,
 					    struct rhash_head *obj,
 					    struct bucket_table *old_tbl);
 int rhashtable_insert_rehash(struct rhashtable *ht, struct bucket_table *tbl);
+int rhashtable_insert_bulk(struct rhashtable *ht, struct rhash_head **objs,
+			   unsigned int nr);
 
 int rhashtable_walk_init(struct rhashtable *ht, struct rhashtable_iter *iter);
 void rhashtable_walk_exit(struct rhashtable_iter *iter);
@@ -373,14 +424,14 @@ void rhashtable_destroy(struct rhashtable *ht);
 	({ tpos = container_of(pos, typeof(*tpos), member); 1; })
 
 /**
- * rht_for_each_continue - continue iterating over hash chain
+ * rht_for_each_from - iterate over hash chain from given head
  * @pos:	the &struct rhash_head to use as a loop cursor.
- * @head:	the previous &struct rhash_head to continue from
+ * @head:	the &struct rhash_head to start from
  * @tbl:	the &struct bucket_table
  * @hash:	the hash value / bucket index
  */
-#define rht_for_each_continue(pos, head, tbl, hash) \
-	for (pos = rht_dereference_bucket(head, tbl, hash); \
+#define rht_for_each_from(pos, head, tbl, hash) \
+	for (pos = head; \
 	     !rht_is_a_nulls(pos); \
 	     pos = rht_dereference_bucket((pos)->next, tbl, hash))
 
@@ -391,19 +442,20 @@ void rhashtable_destroy(struct rhashtable *ht);
  * @hash:	the hash value / bucket index
  */
 #define rht_for_each(pos, tbl, hash) \
-	rht_for_each_continue(pos, (tbl)->buckets[hash], tbl, hash)
+	rht_for_each_from(pos, rht_ptr(rht_bucket(tbl, hash), tbl, hash), \
+			  tbl, hash)
 
 /**
- * rht_for_each_entry_continue - continue iterating over hash chain
+ * rht_for_each_entry_from - iterate over hash chain from given head
  * @tpos:	the type * to use as a loop cursor.
  * @pos:	the &struct rhash_head to use as a loop cursor.
- * @head:	the previous &struct rhash_head to continue from
+ * @head:	the &struct rhash_head to start from
  * @tbl:	the &struct bucket_table
  * @hash:	the hash value / bucket index
  * @member:	name of the &struct rhash_head within the hashable struct.
  */
-#define rht_for_each_entry_continue(tpos, pos, head, tbl, hash, member)	\
-	for (pos = rht_dereference_bucket(head, tbl, hash);		\
+#define rht_for_each_entry_from(tpos, pos, head, tbl, hash, member)	\
+	for (pos = head;						\
 	     (!rht_is_a_nulls(pos)) && rht_entry(tpos, pos, member);	\
 	     pos = rht_dereference_bucket((pos)->next, tbl, hash))
 
@@ -416,8 +468,9 @@ void rhashtable_destroy(struct rhashtable *ht);
  * @member:	name of the &struct rhash_head within the hashable struct.
  */
 #define rht_for_each_entry(tpos, pos, tbl, hash, member)		\
-	rht_for_each_entry_continue(tpos, pos, (tbl)->buckets[hash],	\
-				    tbl, hash, member)
+	rht_for_each_entry_from(tpos, pos,				\
+				rht_ptr(rht_bucket(tbl, hash), tbl, hash), \
+				tbl, hash, member)
 
 /**
  * rht_for_each_entry_safe - safely iterate over hash chain of given type
@@ -432,7 +485,7 @@ void rhashtable_destroy(struct rhashtable *ht);
  * remove the loop cursor from the list.
  */
 #define rht_for_each_entry_safe(tpos, pos, next, tbl, hash, member)	    \
-	for (pos = rht_dereference_bucket((tbl)->buckets[hash], tbl, hash), \
+	for (pos = rht_ptr(rht_bucket(tbl, hash), tbl, hash),		    \
 	     next = !rht_is_a_nulls(pos) ?				    \
 		       rht_dereference_bucket(pos->next, tbl, hash) : NULL; \
 	     (!rht_is_a_nulls(pos)) && rht_entry(tpos, pos, member);	    \
@@ -441,9 +494,9 @@ void rhashtable_destroy(struct rhashtable *ht);
 		       rht_dereference_bucket(pos->next, tbl, hash) : NULL)
 
 /**
- * rht_for_each_rcu_continue - continue iterating over rcu hash chain
+ * rht_for_each_rcu_from - iterate over rcu hash chain from given head
  * @pos:	the &struct rhash_head to use as a loop cursor.
- * @head:	the previous &struct rhash_head to continue from
+ * @head:	the &struct rhash_head to start from
  * @tbl:	the &struct bucket_table
  * @hash:	the hash value / bucket index
  *
@@ -451,9 +504,9 @@ void rhashtable_destroy(struct rhashtable *ht);
  * the _rcu mutation primitives such as rhashtable_insert() as long as the
  * traversal is guarded by rcu_read_lock().
  */
-#define rht_for_each_rcu_continue(pos, head, tbl, hash)			\
+#define rht_for_each_rcu_from(pos, head, tbl, hash)			\
 	for (({barrier(); }),						\
-	     pos = rht_dereference_bucket_rcu(head, tbl, hash);		\
+	     pos = head;						\
 	     !rht_is_a_nulls(pos);					\
 	     pos = rcu_dereference_raw(pos->next))
 
@@ -468,13 +521,14 @@ void rhashtable_destroy(struct rhashtable *ht);
  * traversal is guarded by rcu_read_lock().
  */
 #define rht_for_each_rcu(pos, tbl, hash)				\
-	rht_for_each_rcu_continue(pos, (tbl)->buckets[hash], tbl, hash)
+	rht_for_each_rcu_from(pos, rht_ptr_rcu(rht_bucket(tbl, hash)),	\
+			      tbl, hash)
 
 /**
- * rht_for_each_entry_rcu_continue - continue iterating over rcu hash chain
+ * rht_for_each_entry_rcu_from - iterate over rcu hash chain from given head
  * @tpos:	the type * to use as a loop cursor.
  * @pos:	the &struct rhash_head to use as a loop cursor.
- * @head:	the previous &struct rhash_head to continue from
+ * @head:	the &struct rhash_head to start from
  * @tbl:	the &struct bucket_table
  * @hash:	the hash value / bucket index
  * @member:	name of the &struct rhash_head within the hashable struct.
@@ -483,9 +537,9 @@ void rhashtable_destroy(struct rhashtable *ht);
  * the _rcu mutation primitives such as rhashtable_insert() as long as the
  * traversal is guarded by rcu_read_lock().
  */
-#define rht_for_each_entry_rcu_continue(tpos, pos, head, tbl, hash, member) \
+#define rht_for_each_entry_rcu_from(tpos, pos, head, tbl, hash, member)    \
 	for (({barrier(); }),						    \
-	     pos = rht_dereference_bucket_rcu(head, tbl, hash);		    \
+	     pos = head;						    \
 	     (!rht_is_a_nulls(pos)) && rht_entry(tpos, pos, member);	    \
 	     pos = rht_dereference_bucket_rcu(pos->next, tbl, hash))
 
@@ -502,8 +556,9 @@ void rhashtable_destroy(struct rhashtable *ht);
  * traversal is guarded by rcu_read_lock().
  */
 #define rht_for_each_entry_rcu(tpos, pos, tbl, hash, member)		\
-	rht_for_each_entry_rcu_continue(tpos, pos, (tbl)->buckets[hash],\
-					tbl, hash, member)
+	rht_for_each_entry_rcu_from(tpos, pos,				\
+				    rht_ptr_rcu(rht_bucket(tbl, hash)),	\
+				    tbl, hash, member)
 
 static inline int rhashtable_compare(struct rhashtable_compare_arg *arg,
 				     const void *obj)
@@ -572,8 +627,8 @@ static inline int __rhashtable_insert_fast(
 		.key = key,
 	};
 	struct bucket_table *tbl, *new_tbl;
+	struct rhash_head __rcu **bkt;
 	struct rhash_head *head;
-	spinlock_t *lock;
 	unsigned int elasticity;
 	unsigned int hash;
 	int err;
@@ -588,13 +643,13 @@ restart:
 	 */
 	for (;;) {
 		hash = rht_head_hashfn(ht, tbl, obj, params);
-		lock = rht_bucket_lock(tbl, hash);
-		spin_lock_bh(lock);
+		bkt = rht_bucket(tbl, hash);
+		rht_lock(bkt);
 
 		if (tbl->rehash <= hash)
 			break;
 
-		spin_unlock_bh(lock);
+		rht_unlock(bkt);
 		tbl = rht_dereference_rcu(tbl->future_tbl, ht);
 	}
 
@@ -614,7 +669,7 @@ restart:
 
 	if (unlikely(rht_grow_above_100(ht, tbl))) {
 slow_path:
-		spin_unlock_bh(lock);
+		rht_unlock(bkt);
 		err = rhashtable_insert_rehash(ht, tbl);
 		rcu_read_unlock();
 		if (err)
@@ -637,18 +692,18 @@ slow_path:
 
 	err = 0;
 
-	head = rht_dereference_bucket(tbl->buckets[hash], tbl, hash);
+	head = rht_ptr(bkt, tbl, hash);
 
 	RCU_INIT_POINTER(obj->next, head);
 
-	rcu_assign_pointer(tbl->buckets[hash], obj);
+	rht_assign_locked(bkt, obj);
 
 	atomic_inc(&ht->nelems);
 	if (rht_grow_above_75(ht, tbl))
 		schedule_work(&ht->run_work);
 
 out:
-	spin_unlock_bh(lock);
+	rht_unlock(bkt);
 	rcu_read_unlock();
 
 	return err;
@@ -662,7 +717,7 @@ out:
  *
  * Will take a per bucket spinlock to protect against mutual mutations
  * on the same bucket. Multiple insertions may occur in parallel unless
- * they map to the same bucket lock.
+ * they map to the same bucket.
  *
  * It is safe to call this function from atomic context.
  *
@@ -746,30 +801,35 @@ static inline int __rhashtable_remove_fast(
 	struct rhashtable *ht, struct bucket_table *tbl,
 	struct rhash_head *obj, const struct rhashtable_params params)
 {
-	struct rhash_head __rcu **pprev;
+	struct rhash_head __rcu **pprev = NULL;
+	struct rhash_head __rcu **bkt;
 	struct rhash_head *he;
-	spinlock_t * lock;
 	unsigned int hash;
 	int err = -ENOENT;
 
 	hash = rht_head_hashfn(ht, tbl, obj, params);
-	lock = rht_bucket_lock(tbl, hash);
+	bkt = rht_bucket(tbl, hash);
 
-	spin_lock_bh(lock);
+	rht_lock(bkt);
 
-	pprev = &tbl->buckets[hash];
 	rht_for_each(he, tbl, hash) {
 		if (he != obj) {
 			pprev = &he->next;
 			continue;
 		}
 
-		rcu_assign_pointer(*pprev, obj->next);
+		/* The bucket itself keeps its lock bit */
+		if (pprev)
+			rcu_assign_pointer(*pprev, obj->next);
+		else
+			rht_assign_locked(bkt, rht_dereference_bucket(obj->next,
+								      tbl,
+								      hash));
 		err = 0;
 		break;
 	}
 
-	spin_unlock_bh(lock);
+	rht_unlock(bkt);
 
 	return err;
 }
@@ -63,6 +63,7 @@ struct sched_param {
 #include <asm/processor.h>
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
 
 /*
  * Extended scheduling parameters data structure.
@@ -124,8 +125,38 @@ struct sched_attr {
 	u64 sched_runtime;
 	u64 sched_deadline;
 	u64 sched_period;
+
+	/* Utilization hints, see SCHED_FLAG_UTIL_CLAMP */
+	u32 sched_util_min;
+	u32 sched_util_max;
+};
+
+#ifdef CONFIG_UCLAMP_TASK
+enum uclamp_id {
+	UCLAMP_MIN = 0,
+	UCLAMP_MAX,
+	UCLAMP_CNT
+};
+
+/*
+ * A utilization clamp value on the SCHED_CAPACITY_SCALE range, and the
+ * rq->uclamp[] bucket it is (or will be) accounted in.
+ */
+struct uclamp_se {
+	unsigned int value;
+	unsigned int bucket_id;
+	unsigned int active;
+	unsigned int user_defined;
 };
 
+extern unsigned long uclamp_cpu_util(int cpu, unsigned long util);
+#else
+static inline unsigned long uclamp_cpu_util(int cpu, unsigned long util)
+{
+	return util;
+}
+#endif
+
 struct futex_pi_state;
 struct robust_list_head;
 struct bio_list;
@@ -1055,6 +1086,9 @@ struct sched_domain {
 	u64 max_newidle_lb_cost;
 	unsigned long next_decay_max_lb_cost;
 
+	/* select_idle_cpu() stats */
+	u64 avg_scan_cost;
+
 #ifdef CONFIG_SCHEDSTATS
 	/* load_balance() stats */
 	unsigned int lb_count[CPU_MAX_IDLE_TYPES];
@@ -1405,6 +1439,13 @@ struct task_struct {
 #endif
 	struct sched_dl_entity dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* clamp values asked for through sched_setattr() */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* clamp values in effect, accounted to the rq while enqueued */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* list of struct preempt_notifier: */
 	struct hlist_head preempt_notifiers;
@@ -402,6 +402,9 @@ enum {
 	SKB_GSO_UDP_TUNNEL_CSUM = 1 << 11,
 
 	SKB_GSO_TUNNEL_REMCSUM = 1 << 12,
+
+	/* UDP datagrams of gso_size each, built by UDP GRO */
+	SKB_GSO_UDP_L4 = 1 << 13,
 };
 
 #if BITS_PER_LONG > 32
@@ -501,6 +504,7 @@ static inline bool skb_mstamp_after(const struct skb_mstamp *t1,
  *	@pkt_type: Packet class
  *	@fclone: skbuff clone status
  *	@ipvs_property: skbuff is owned by ipvs
+ *	@pp_recycle: head and frag pages may belong to a page_pool
  *	@peeked: this packet has been seen already, so stats have been
  *		done for it, don't do them again
  *	@nf_trace: netfilter packet trace flag
@@ -535,6 +539,7 @@ static inline bool skb_mstamp_after(const struct skb_mstamp *t1,
  *	@transport_header: Transport layer header
  *	@network_header: Network layer header
  *	@mac_header: Link layer header
+ *	@flow_cache: Header walk of the last flow dissection
  *	@tail: Tail pointer
  *	@end: End pointer
  *	@head: Head of buffer
@@ -642,7 +647,8 @@ struct sk_buff {
 	__u8			ipvs_property:1;
 	__u8			inner_protocol_type:1;
 	__u8			remcsum_offload:1;
-	/* 3 or 5 bit hole */
+	__u8			pp_recycle:1;
+	/* 2 or 4 bit hole */
 
 #ifdef CONFIG_NET_SCHED
 	__u16			tc_index;	/* traffic control index */
@@ -697,6 +703,8 @@ struct sk_buff {
 	__u16			network_header;
 	__u16			mac_header;
 
+	struct flow_dissector_cache flow_cache;
+
 	/* private: */
 	__u32			headers_end[0];
 	/* public: */
@@ -798,6 +806,8 @@ void kfree_skb(struct sk_buff *skb);
 void kfree_skb_list(struct sk_buff *segs);
 void skb_tx_error(struct sk_buff *skb);
 void consume_skb(struct sk_buff *skb);
+void napi_consume_skb(struct sk_buff *skb, int budget);
+void __kfree_skb_defer(struct sk_buff *skb);
 void  __kfree_skb(struct sk_buff *skb);
 extern struct kmem_cache *skbuff_head_cache;
 
@@ -809,6 +819,7 @@ struct sk_buff *__alloc_skb(unsigned int size, gfp_t priority, int flags,
 			    int node);
 struct sk_buff *__build_skb(void *data, unsigned int frag_size);
 struct sk_buff *build_skb(void *data, unsigned int frag_size);
+struct sk_buff *napi_build_skb(void *data, unsigned int frag_size);
 static inline struct sk_buff *alloc_skb(unsigned int size,
 					gfp_t priority)
 {
@@ -954,6 +965,15 @@ static inline void skb_clear_hash(struct sk_buff *skb)
 	skb->l4_hash = 0;
 }
 
+/*
+ * Must be called by whoever changes the headers in a way that moves the
+ * transport header without changing skb->protocol or the network header.
+ */
+static inline void skb_clear_flow_cache(struct sk_buff *skb)
+{
+	skb->flow_cache.valid = 0;
+}
+
 static inline void skb_clear_hash_if_not_l4(struct sk_buff *skb)
 {
 	if (!skb->l4_hash)
@@ -2392,6 +2412,17 @@ static inline struct page *dev_alloc_page(void)
 	return __dev_alloc_page(GFP_ATOMIC);
 }
 
+/**
+ * skb_mark_for_recycle - hand the skb's page_pool pages back on free
+ * @skb: skb whose head or frags come from a page_pool
+ *
+ * Pages that do not belong to a pool are still freed the normal way.
+ */
+static inline void skb_mark_for_recycle(struct sk_buff *skb)
+{
+	skb->pp_recycle = 1;
+}
+
 /**
  *	skb_propagate_pfmemalloc - Propagate pfmemalloc if skb is allocated after RX page
  *	@page: The page that was allocated from skb_alloc_page
@@ -41,6 +41,7 @@
 #define _LINUX_SUNRPC_RPC_RDMA_H
 
 #include <linux/types.h>
+#include <linux/kernel.h>
 
 #define RPCRDMA_VERSION		1
 #define rpcrdma_version		cpu_to_be32(RPCRDMA_VERSION)
@@ -127,4 +128,34 @@ enum rpcrdma_proc {
 #define rdma_done	cpu_to_be32(RDMA_DONE)
 #define rdma_error	cpu_to_be32(RDMA_ERROR)
 
+/*
+ * Private data carried in the RDMA-CM connect request and accept, so
+ * that each side can learn the size of the other's inline buffers.
+ * Peers that send nothing are assumed to use the protocol default of
+ * 1KB in each direction.
+ */
+struct rpcrdma_connect_private {
+	__be32	cp_magic;
+	u8	cp_version;
+	u8	cp_flags;
+	u8	cp_send_size;	/* in 1KB units, less one */
+	u8	cp_recv_size;
+} __packed;
+
+#define rpcrdma_cmp_magic	cpu_to_be32(0xf6ab0e18)
+
+enum {
+	RPCRDMA_CMP_VERSION	= 1,
+};
+
+static inline u8 rpcrdma_encode_buffer_size(unsigned int size)
+{
+	return (clamp_t(unsigned int, size, 1 << 10, 256 << 10) >> 10) - 1;
+}
+
+static inline unsigned int rpcrdma_decode_buffer_size(u8 val)
+{
+	return ((unsigned int)val + 1) << 10;
+}
+
 #endif				/* _LINUX_SUNRPC_RPC_RDMA_H */
@@ -7,6 +7,7 @@
 #ifndef SUNRPC_SVC_XPRT_H
 #define SUNRPC_SVC_XPRT_H
 
+#include <linux/ktime.h>
 #include <linux/sunrpc/svc.h>
 
 struct module;
@@ -53,6 +54,8 @@ struct svc_xprt {
 	struct kref		xpt_ref;
 	struct list_head	xpt_list;
 	struct list_head	xpt_ready;
+	struct llist_node	xpt_ready_node;	/* on sp_xprts_new */
+	ktime_t			xpt_qtime;	/* time enqueued */
 	unsigned long		xpt_flags;
 #define	XPT_BUSY	0		/* enqueued/receiving */
 #define	XPT_CONN	1		/* conn pending */
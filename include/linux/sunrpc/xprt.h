@@ -233,6 +233,15 @@ struct rpc_xprt {
 #endif /* CONFIG_SUNRPC_BACKCHANNEL */
 	struct list_head	recv;
 
+	/*
+	 * Additional connections to the same server (nconnect).  They
+	 * are owned by this transport and new requests are spread
+	 * round-robin across it and them.
+	 */
+	struct rpc_xprt		**extra_xprts;
+	unsigned int		nr_extra_xprts;
+	atomic_t		next_xprt;
+
 	struct {
 		unsigned long		bind_count,	/* total number of binds */
 					connect_count,	/* total number of connects */
@@ -304,6 +313,9 @@ struct xprt_class {
  * Generic internal transport functions
  */
 struct rpc_xprt		*xprt_create_transport(struct xprt_create *args);
+int			xprt_create_extra_transports(struct rpc_xprt *xprt,
+					struct xprt_create *args,
+					unsigned int nr);
 void			xprt_connect(struct rpc_task *task);
 void			xprt_reserve(struct rpc_task *task);
 void			xprt_retry_reserve(struct rpc_task *task);
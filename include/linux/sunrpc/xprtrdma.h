@@ -52,7 +52,8 @@
 #define RPCRDMA_DEF_SLOT_TABLE	(128U)
 #define RPCRDMA_MAX_SLOT_TABLE	(256U)
 
-#define RPCRDMA_DEF_INLINE  (1024)	/* default inline max */
+#define RPCRDMA_DEF_INLINE  (4096)	/* default inline max */
+#define RPCRDMA_V1_DEF_INLINE_SIZE  (1024)	/* peer didn't say */
 
 #define RPCRDMA_INLINE_PAD_THRESH  (512)/* payload threshold to pad (bytes) */
 
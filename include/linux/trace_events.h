@@ -417,6 +417,7 @@ enum event_trigger_type {
 	ETT_SNAPSHOT		= (1 << 1),
 	ETT_STACKTRACE		= (1 << 2),
 	ETT_EVENT_ENABLE	= (1 << 3),
+	ETT_EVENT_HIST		= (1 << 4),
 };
 
 extern int filter_match_preds(struct event_filter *filter, void *rec);
@@ -555,13 +556,86 @@ event_trigger_unlock_commit_regs(struct trace_event_file *file,
 
 #ifdef CONFIG_BPF_EVENTS
 unsigned int trace_call_bpf(struct bpf_prog *prog, void *ctx);
+struct bpf_raw_event_map *bpf_find_raw_tracepoint(const char *name);
+int bpf_probe_register(struct bpf_raw_event_map *btp, struct bpf_prog *prog);
+int bpf_probe_unregister(struct bpf_raw_event_map *btp, struct bpf_prog *prog);
 #else
 static inline unsigned int trace_call_bpf(struct bpf_prog *prog, void *ctx)
 {
 	return 1;
 }
+
+static inline struct bpf_raw_event_map *
+bpf_find_raw_tracepoint(const char *name)
+{
+	return NULL;
+}
+
+static inline int bpf_probe_register(struct bpf_raw_event_map *btp,
+				     struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int bpf_probe_unregister(struct bpf_raw_event_map *btp,
+				       struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
 #endif
 
+void bpf_trace_run1(struct bpf_prog *prog, u64 arg1);
+void bpf_trace_run2(struct bpf_prog *prog, u64 arg1, u64 arg2);
+void bpf_trace_run3(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3);
+void bpf_trace_run4(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4);
+void bpf_trace_run5(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4, u64 arg5);
+void bpf_trace_run6(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4, u64 arg5, u64 arg6);
+void bpf_trace_run7(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7);
+void bpf_trace_run8(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7,
+		    u64 arg8);
+void bpf_trace_run9(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		    u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7,
+		    u64 arg8, u64 arg9);
+void bpf_trace_run10(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		     u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7,
+		     u64 arg8, u64 arg9, u64 arg10);
+void bpf_trace_run11(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		     u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7,
+		     u64 arg8, u64 arg9, u64 arg10, u64 arg11);
+void bpf_trace_run12(struct bpf_prog *prog, u64 arg1, u64 arg2,
+		     u64 arg3, u64 arg4, u64 arg5, u64 arg6, u64 arg7,
+		     u64 arg8, u64 arg9, u64 arg10, u64 arg11, u64 arg12);
+
+/*
+ * Run a BPF_PROG_TYPE_TRACEPOINT program on the perf record of a
+ * tracepoint.  The program cannot see the common fields; for the
+ * duration of the run they hold the pt_regs pointer that helpers such
+ * as bpf_get_stackid() want, and they are put back afterwards for the
+ * perf events that still consume the record.
+ */
+static inline unsigned int perf_trace_run_bpf(struct bpf_prog *prog,
+					      void *entry,
+					      struct pt_regs *regs)
+{
+	struct trace_entry hdr = *(struct trace_entry *)entry;
+	unsigned int ret;
+
+	BUILD_BUG_ON(sizeof(regs) > sizeof(struct trace_entry));
+	*(struct pt_regs **)entry = regs;
+	ret = trace_call_bpf(prog, entry);
+	*(struct trace_entry *)entry = hdr;
+
+	return ret;
+}
+
+int trace_event_get_offsets(struct trace_event_call *call);
+
 enum {
 	FILTER_OTHER = 0,
 	FILTER_STATIC_STRING,
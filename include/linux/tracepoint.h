@@ -39,6 +39,16 @@ struct tracepoint {
 	struct tracepoint_func __rcu *funcs;
 };
 
+/*
+ * Emitted by include/trace/bpf_probe.h for every built-in tracepoint, so
+ * that BPF programs can be attached to its raw arguments.
+ */
+struct bpf_raw_event_map {
+	struct tracepoint	*tp;
+	void			*bpf_func;
+	u32			num_args;
+} __aligned(32);
+
 struct trace_enum_map {
 	const char		*system;
 	const char		*enum_string;
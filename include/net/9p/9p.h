@@ -574,4 +574,6 @@ int p9_idpool_check(int id, struct p9_idpool *p);
 int p9_error_init(void);
 int p9_trans_fd_init(void);
 void p9_trans_fd_exit(void);
+int p9_client_init(void);
+void p9_client_exit(void);
 #endif /* NET_9P_H */
@@ -140,5 +140,7 @@ int tcf_action_dump(struct sk_buff *skb, struct list_head *, int, int);
 int tcf_action_dump_old(struct sk_buff *skb, struct tc_action *a, int, int);
 int tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a, int, int);
 int tcf_action_copy_stats(struct sk_buff *, struct tc_action *, int);
+void tcf_action_stats_update(struct tc_action *a, u64 bytes, u32 packets,
+			     unsigned long lastuse);
 #endif /* CONFIG_NET_CLS_ACT */
 #endif
@@ -247,6 +247,7 @@ typedef struct port {
 	struct port *next_port_in_aggregator;	/* Next port on the linked list of the parent aggregator */
 	u32 transaction_id;		/* continuous number for identification of Marker PDU's; */
 	struct lacpdu lacpdu;		/* the lacpdu that will be sent for this port */
+	struct sk_buff *lacpdu_skb;	/* built under mode_lock, sent after it is dropped */
 } port_t;
 
 /* system structure */
@@ -223,6 +223,7 @@ struct bonding {
 #endif /* CONFIG_PROC_FS */
 	struct   list_head bond_list;
 	u32      rr_tx_counter;
+	unsigned long __percpu *tx_dropped; /* folded in by bond_get_stats() */
 	struct   ad_bond_info ad_info;
 	struct   alb_bond_info alb_info;
 	struct   bond_params params;
@@ -669,7 +670,9 @@ extern struct rtnl_link_ops bond_link_ops;
 
 static inline void bond_tx_drop(struct net_device *dev, struct sk_buff *skb)
 {
-	atomic_long_inc(&dev->tx_dropped);
+	struct bonding *bond = netdev_priv(dev);
+
+	this_cpu_inc(*bond->tx_dropped);
 	dev_kfree_skb_any(skb);
 }
 
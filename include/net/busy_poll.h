@@ -72,49 +72,28 @@ static inline bool busy_loop_timeout(unsigned long end_time)
 	return time_after(now, end_time);
 }
 
+int napi_busy_loop(unsigned int napi_id, unsigned long end_time,
+		   unsigned int budget, bool (*loop_end)(void *),
+		   void *loop_end_arg);
+
+static inline bool sk_busy_loop_end(void *p)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
 /* when used in sock_poll() nonblock is known at compile time to be true
  * so the loop and end_time will be optimized out
  */
 static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 {
 	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
-	const struct net_device_ops *ops;
-	struct napi_struct *napi;
-	int rc = false;
-
-	/*
-	 * rcu read lock for napi hash
-	 * bh so we don't race with net_rx_action
-	 */
-	rcu_read_lock_bh();
-
-	napi = napi_by_id(sk->sk_napi_id);
-	if (!napi)
-		goto out;
-
-	ops = napi->dev->netdev_ops;
-	if (!ops->ndo_busy_poll)
-		goto out;
 
-	do {
-		rc = ops->ndo_busy_poll(napi);
+	napi_busy_loop(sk->sk_napi_id, end_time, 0,
+		       nonblock ? NULL : sk_busy_loop_end, sk);
 
-		if (rc == LL_FLUSH_FAILED)
-			break; /* permanent failure */
-
-		if (rc > 0)
-			/* local bh are disabled so it is ok to use _BH */
-			NET_ADD_STATS_BH(sock_net(sk),
-					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
-		cpu_relax();
-
-	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
-		 !need_resched() && !busy_loop_timeout(end_time));
-
-	rc = !skb_queue_empty(&sk->sk_receive_queue);
-out:
-	rcu_read_unlock_bh();
-	return rc;
+	return !skb_queue_empty(&sk->sk_receive_queue);
 }
 
 /* used in the NIC receive handler to mark the skb */
@@ -128,6 +107,7 @@ static inline void skb_mark_napi_id(struct sk_buff *skb,
 static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
 {
 	sk->sk_napi_id = skb->napi_id;
+	sk_rx_queue_set(sk, skb);
 }
 
 #else /* CONFIG_NET_RX_BUSY_POLL */
@@ -153,6 +133,7 @@ static inline void skb_mark_napi_id(struct sk_buff *skb,
 
 static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
 {
+	sk_rx_queue_set(sk, skb);
 }
 
 static inline bool busy_loop_timeout(unsigned long end_time)
@@ -165,5 +146,12 @@ static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 	return false;
 }
 
+static inline int napi_busy_loop(unsigned int napi_id, unsigned long end_time,
+				 unsigned int budget, bool (*loop_end)(void *),
+				 void *loop_end_arg)
+{
+	return 0;
+}
+
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 #endif /* _LINUX_NET_BUSY_POLL_H */
@@ -32,6 +32,8 @@ struct fib_rule {
 	struct rcu_head		rcu;
 };
 
+struct fib_rules_index;
+
 struct fib_lookup_arg {
 	void			*lookup_ptr;
 	void			*result;
@@ -56,6 +58,12 @@ struct fib_rules_ops {
 					    struct fib_lookup_arg *);
 	int			(*match)(struct fib_rule *,
 					 struct flowi *, int);
+	/* Optional, lets the rules be indexed by source prefix: the prefix
+	 * a rule requires the source to be in, with 0 as the length if it
+	 * does not look at the source, and the source of a flow, NULL if it
+	 * is not known. Both are addr_size bytes long. */
+	const void *		(*rule_src)(struct fib_rule *, int *plen);
+	const void *		(*flow_src)(struct flowi *, int);
 	int			(*configure)(struct fib_rule *,
 					     struct sk_buff *,
 					     struct fib_rule_hdr *,
@@ -75,6 +83,7 @@ struct fib_rules_ops {
 	int			nlgroup;
 	const struct nla_policy	*policy;
 	struct list_head	rules_list;
+	struct fib_rules_index __rcu *index;
 	struct module		*owner;
 	struct net		*fro_net;
 	struct rcu_head		rcu;
@@ -131,6 +131,32 @@ enum flow_dissector_key_id {
 #define FLOW_DISSECTOR_F_STOP_AT_L3		BIT(1)
 #define FLOW_DISSECTOR_F_STOP_AT_FLOW_LABEL	BIT(2)
 #define FLOW_DISSECTOR_F_STOP_AT_ENCAP		BIT(3)
+#define FLOW_DISSECTOR_F_ALL			(BIT(4) - 1)
+
+/**
+ * struct flow_dissector_cache - header walk of the last dissection of an skb
+ * @nhoff: network header the walk started at, relative to skb->head
+ * @thoff: transport header the walk ended at, relative to skb->head
+ * @proto: skb->protocol the walk started with
+ * @ip_proto: transport protocol
+ * @flags: FLOW_DISSECTOR_F_* the walk was done with
+ * @frag: FLOW_DIS_IS_FRAGMENT and FLOW_DIS_FIRST_FRAG as found by the walk
+ * @l4: the walk went on to the transport ports
+ * @valid: the rest is valid
+ *
+ * Only plain IPv4 and IPv6 walks are kept, they are by far the common case
+ * and everything but the offsets can be read straight from the headers.
+ */
+struct flow_dissector_cache {
+	u16	nhoff;
+	u16	thoff;
+	__be16	proto;
+	u8	ip_proto;
+	u8	flags:4,
+		frag:2,
+		l4:1,
+		valid:1;
+};
 
 struct flow_dissector_key {
 	enum flow_dissector_key_id key_id;
@@ -177,6 +203,19 @@ struct flow_keys_digest {
 void make_flow_keys_digest(struct flow_keys_digest *digest,
 			   const struct flow_keys *flow);
 
+static inline bool dissector_uses_key(const struct flow_dissector *flow_dissector,
+				      enum flow_dissector_key_id key_id)
+{
+	return flow_dissector->used_keys & (1 << key_id);
+}
+
+static inline void *skb_flow_dissector_target(struct flow_dissector *flow_dissector,
+					      enum flow_dissector_key_id key_id,
+					      void *target_container)
+{
+	return ((char *)target_container) + flow_dissector->offset[key_id];
+}
+
 static inline bool flow_keys_have_l4(struct flow_keys *keys)
 {
 	return (keys->ports.ports || keys->tags.flow_label);
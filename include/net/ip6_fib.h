@@ -15,7 +15,9 @@
 
 #include <linux/ipv6_route.h>
 #include <linux/rtnetlink.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <net/dst.h>
 #include <net/flow.h>
 #include <net/netlink.h>
@@ -68,6 +70,7 @@ struct fib6_node {
 	__u16			fn_flags;
 	int			fn_sernum;
 	struct rt6_info		*rr_ptr;
+	struct rcu_head		rcu;
 };
 
 #ifndef CONFIG_IPV6_SUBTREES
@@ -228,10 +231,32 @@ struct fib6_table {
 	struct hlist_node	tb6_hlist;
 	u32			tb6_id;
 	rwlock_t		tb6_lock;
+	seqcount_t		tb6_seq;	/* bumped by tree writers */
 	struct fib6_node	tb6_root;
 	struct inet_peer_base	tb6_peers;
+
+	/* Main table only: tree node to start the descent from, indexed
+	 * by the leading FIB6_STRIDE_BITS of the destination.
+	 */
+	struct fib6_node	* __rcu *tb6_stride;
+	struct work_struct	tb6_stride_work;
 };
 
+/* Writers hold tb6_lock and bump tb6_seq so that lockless readers under
+ * rcu_read_lock() can tell their lookup raced with a change.
+ */
+static inline void fib6_table_write_lock(struct fib6_table *table)
+{
+	write_lock_bh(&table->tb6_lock);
+	write_seqcount_begin(&table->tb6_seq);
+}
+
+static inline void fib6_table_write_unlock(struct fib6_table *table)
+{
+	write_seqcount_end(&table->tb6_seq);
+	write_unlock_bh(&table->tb6_lock);
+}
+
 #define RT6_TABLE_UNSPEC	RT_TABLE_UNSPEC
 #define RT6_TABLE_MAIN		RT_TABLE_MAIN
 #define RT6_TABLE_DFLT		RT6_TABLE_MAIN
@@ -10,6 +10,7 @@
 #include <asm/types.h>                  /* for __uXX types */
 
 #include <linux/list.h>                 /* for struct list_head */
+#include <linux/list_nulls.h>
 #include <linux/spinlock.h>             /* for struct rwlock_t */
 #include <linux/atomic.h>               /* for struct atomic_t */
 #include <linux/compiler.h>
@@ -510,7 +511,7 @@ struct ip_vs_conn_param {
 
 /* IP_VS structure allocated for each dynamically scheduled connection */
 struct ip_vs_conn {
-	struct hlist_node	c_list;         /* hashed list heads */
+	struct hlist_nulls_node	c_list;         /* hashed list heads */
 	/* Protocol, addresses and port numbers */
 	__be16                  cport;
 	__be16                  dport;
@@ -806,6 +807,16 @@ struct ipvs_master_sync_state {
 	struct task_struct	*master_thread;
 	struct delayed_work	master_wakeup_work;
 	struct netns_ipvs	*ipvs;
+	/* statistics, see /proc/net/ip_vs_sync_stats */
+	unsigned long		sync_conns;	/* conns added to messages */
+	unsigned long		sync_sent;	/* messages sent */
+	unsigned long		sync_dropped;	/* messages dropped, queue full */
+};
+
+struct ipvs_backup_sync_state {
+	unsigned long		recv_mesgs;
+	unsigned long		recv_bytes;
+	unsigned long		recv_errors;
 };
 
 /* How much time to keep dests in trash */
@@ -938,7 +949,10 @@ struct netns_ipvs {
 	struct ipvs_master_sync_state *ms;
 	spinlock_t		sync_buff_lock;
 	struct task_struct	**backup_threads;
+	struct ipvs_backup_sync_state *bs;
 	int			threads_mask;
+	struct delayed_work	sync_resync_work;
+	unsigned int		sync_resync_pos;
 	volatile int		sync_state;
 	struct mutex		sync_mutex;
 	struct ipvs_sync_daemon_cfg	mcfg;	/* Master Configuration */
@@ -964,6 +978,7 @@ struct netns_ipvs {
 #define IPVS_SYNC_CHECK_PERIOD	HZ
 #define IPVS_SYNC_FLUSH_TIME	(HZ * 2)
 #define IPVS_SYNC_PORTS_MAX	(1 << 6)
+#define IPVS_SYNC_RESYNC_BUCKETS	256	/* buckets per resync step */
 
 #ifdef CONFIG_SYSCTL
 
@@ -1221,6 +1236,10 @@ const char *ip_vs_state_name(__u16 proto, int state);
 void ip_vs_tcp_conn_listen(struct ip_vs_conn *cp);
 int ip_vs_check_template(struct ip_vs_conn *ct);
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs);
+int ip_vs_conn_tab_resize(unsigned int size);
+bool ip_vs_conn_walk(struct netns_ipvs *ipvs, unsigned int *pos,
+		     unsigned int count,
+		     void (*fn)(struct netns_ipvs *ipvs, struct ip_vs_conn *cp));
 int ip_vs_conn_init(void);
 void ip_vs_conn_cleanup(void);
 
@@ -1415,6 +1434,7 @@ int start_sync_thread(struct netns_ipvs *ipvs, struct ipvs_sync_daemon_cfg *cfg,
 		      int state);
 int stop_sync_thread(struct netns_ipvs *ipvs, int state);
 void ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp, int pkts);
+int ip_vs_sync_resync(struct netns_ipvs *ipvs);
 
 /* IPVS rate estimator prototypes (from ip_vs_est.c) */
 void ip_vs_start_estimator(struct netns_ipvs *ipvs, struct ip_vs_stats *stats);
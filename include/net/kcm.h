@@ -11,6 +11,7 @@
 #ifndef __NET_KCM_H_
 #define __NET_KCM_H_
 
+#include <linux/llist.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
 #include <uapi/linux/kcm.h>
@@ -54,6 +55,8 @@ struct kcm_sock {
 	/* Receive */
 	struct kcm_psock *rx_psock;
 	struct list_head wait_rx_list; /* KCMs waiting for receiving */
+	struct llist_node rx_ready_node; /* Ready, not yet on wait_rx_list */
+	unsigned long rx_ready_pending;
 	bool rx_wait;
 	u32 rx_disabled : 1;
 };
@@ -86,6 +89,7 @@ struct kcm_psock {
 	struct delayed_work rx_delayed_work;
 	struct bpf_prog *bpf_prog;
 	struct kcm_sock *rx_kcm;
+	int rx_cpu;			/* CPU that last received data */
 
 	/* Transmit */
 	struct kcm_sock *tx_kcm;
@@ -99,6 +103,13 @@ struct kcm_net {
 	int count;
 };
 
+/* Receive side mux statistics, updated with the RX mux lock held */
+struct kcm_mux_stats {
+	unsigned long long rx_lock_acquired;
+	unsigned long long rx_lock_contended;
+	unsigned long long rx_ready_deferred;
+};
+
 /* Structure for a MUX */
 struct kcm_mux {
 	struct list_head kcm_mux_list;
@@ -115,6 +126,10 @@ struct kcm_mux {
 	struct list_head kcm_rx_waiters; /* KCMs waiting for receiving */
 	struct list_head psocks_ready;	/* List of psocks with a msg ready */
 	struct sk_buff_head rx_hold_queue;
+	struct kcm_mux_stats rx_stats;
+
+	/* KCMs that became ready in kcm_rfree, pushed without the RX lock */
+	struct llist_head rx_ready_list ____cacheline_aligned_in_smp;
 
 	/* Transmit */
 	spinlock_t  lock ____cacheline_aligned_in_smp;	/* TX and mux locking */
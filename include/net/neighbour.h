@@ -52,7 +52,8 @@ enum {
 	NEIGH_VAR_ANYCAST_DELAY,
 	NEIGH_VAR_PROXY_DELAY,
 	NEIGH_VAR_LOCKTIME,
-#define NEIGH_VAR_DATA_MAX (NEIGH_VAR_LOCKTIME + 1)
+	NEIGH_VAR_MAX_ENTRIES,
+#define NEIGH_VAR_DATA_MAX (NEIGH_VAR_MAX_ENTRIES + 1)
 	/* Following are used as a second way to access one of the above */
 	NEIGH_VAR_QUEUE_LEN, /* same data as NEIGH_VAR_QUEUE_LEN_BYTES */
 	NEIGH_VAR_RETRANS_TIME_MS, /* same data as NEIGH_VAR_RETRANS_TIME */
@@ -77,6 +78,7 @@ struct neigh_parms {
 
 	int dead;
 	atomic_t refcnt;
+	atomic_t entries;	/* hashed neighbours with these parms */
 	struct rcu_head rcu_head;
 
 	int	reachable_time;
@@ -209,6 +211,8 @@ struct neigh_table {
 	int			gc_thresh3;
 	unsigned long		last_flush;
 	struct delayed_work	gc_work;
+	unsigned int		gc_bucket;	/* where gc_work goes on */
+	struct work_struct	grow_work;
 	struct timer_list 	proxy_timer;
 	struct sk_buff_head	proxy_queue;
 	atomic_t		entries;
@@ -0,0 +1,74 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/netdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/netfilter/nf_conntrack_tuple_common.h>
+#include <net/dst.h>
+
+struct nf_conn;
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+/* Everything up to @dir is the lookup key, see flow_offload_hash(). */
+struct flow_offload_tuple {
+	struct in_addr		src_v4;
+	struct in_addr		dst_v4;
+	__be16			src_port;
+	__be16			dst_port;
+	int			iifidx;
+	u8			l3proto;
+	u8			l4proto;
+
+	u8			dir;
+	int			oifidx;
+	struct dst_entry	*dst_cache;
+};
+
+struct flow_offload_tuple_rhash {
+	struct rhash_head		node;
+	struct flow_offload_tuple	tuple;
+};
+
+#define FLOW_OFFLOAD_SNAT	0x1
+#define FLOW_OFFLOAD_DNAT	0x2
+#define FLOW_OFFLOAD_TEARDOWN	0x4
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash		tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn				*ct;
+	u32					flags;
+	u32					timeout;
+	struct rcu_head				rcu_head;
+};
+
+/* Idle time after which a flow goes back to the conntrack slow path */
+#define NF_FLOW_TIMEOUT		(30 * HZ)
+
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+		int			ifindex;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct net *net, struct flow_offload *flow);
+struct flow_offload_tuple_rhash *flow_offload_lookup(struct net *net,
+						     struct flow_offload_tuple *tuple);
+
+static inline void flow_offload_teardown(struct flow_offload *flow)
+{
+	flow->flags |= FLOW_OFFLOAD_TEARDOWN;
+}
+
+#endif /* _NF_FLOW_TABLE_H */
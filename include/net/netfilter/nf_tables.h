@@ -196,11 +196,13 @@ struct nft_set_desc {
  *
  *	@NFT_LOOKUP_O_1: constant, O(1)
  *	@NFT_LOOKUP_O_LOG_N: logarithmic, O(log N)
+ *	@NFT_LOOKUP_O_LOG_N_LOCKED: logarithmic, O(log N), lookups serialized
  *	@NFT_LOOKUP_O_N: linear, O(N)
  */
 enum nft_set_class {
 	NFT_SET_CLASS_O_1,
 	NFT_SET_CLASS_O_LOG_N,
+	NFT_SET_CLASS_O_LOG_N_LOCKED,
 	NFT_SET_CLASS_O_N,
 };
 
@@ -227,6 +229,7 @@ struct nft_expr;
  *	@activate: activate new element in the next generation
  *	@deactivate: deactivate element in the next generation
  *	@remove: remove element from set
+ *	@commit: make the elements of the new generation visible to lookups
  *	@walk: iterate over all set elemeennts
  *	@privsize: function to return size of set private data
  *	@init: initialize private data of new set instance
@@ -257,6 +260,7 @@ struct nft_set_ops {
 						      const struct nft_set_elem *elem);
 	void				(*remove)(const struct nft_set *set,
 						  const struct nft_set_elem *elem);
+	void				(*commit)(const struct nft_set *set);
 	void				(*walk)(const struct nft_ctx *ctx,
 						const struct nft_set *set,
 						struct nft_set_iter *iter);
@@ -77,6 +77,10 @@ struct netns_ct {
 	struct delayed_work ecache_dwork;
 	bool ecache_dwork_pending;
 #endif
+	struct delayed_work	gc_dwork;
+	unsigned int		gc_bucket;
+	unsigned long		gc_interval;
+	bool			gc_exiting;
 #ifdef CONFIG_SYSCTL
 	struct ctl_table_header	*sysctl_header;
 	struct ctl_table_header	*acct_sysctl_header;
@@ -97,6 +101,9 @@ struct netns_ct {
 	seqcount_t		generation;
 	struct kmem_cache	*nf_conntrack_cachep;
 	struct hlist_nulls_head	*hash;
+	/* table a resize is moving entries into, NULL otherwise */
+	struct hlist_nulls_head __rcu *resize_hash;
+	unsigned int		resize_size;
 	struct hlist_head	*expect_hash;
 	struct ct_pcpu __percpu *pcpu_lists;
 	struct ip_conntrack_stat __percpu *stat;
@@ -0,0 +1,233 @@
+/*
+ * packet_umem.h	User memory rx area of a packet socket
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A umem is a pinned area of user memory cut into frame_size chunks, and
+ * two single producer, single consumer rings shared with user space: the
+ * fill ring, on which user space posts free chunks, and the rx ring, on
+ * which the kernel returns them holding a frame.
+ *
+ * A packet socket in UMEM mode copies the frames of one rx queue into the
+ * area itself. A driver that implements XDP_SETUP_UMEM instead posts the
+ * chunks as the queue's rx buffers, and the frames of that queue go to the
+ * socket without a copy and without entering the stack. Either way, only
+ * one context at a time produces on the rx ring and consumes from the fill
+ * ring: the driver's NAPI poll, or the socket under umem->lock.
+ */
+#ifndef _NET_PACKET_UMEM_H
+#define _NET_PACKET_UMEM_H
+
+#include <linux/err.h>
+#include <linux/if_packet.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <net/sock.h>
+
+#define PACKET_UMEM_RING_MAX	(1 << 18)	/* entries */
+
+struct packet_umem_queue {
+	struct tpacket_umem_ring *ring;	/* shared with user space */
+	void		*entries;
+	u32		mask;
+	u32		cached_prod;
+	u32		cached_cons;
+	size_t		size;		/* of the mapping */
+};
+
+struct packet_umem {
+	struct page	**pages;
+	dma_addr_t	*dma;		/* per page, for dma_dev */
+	struct device	*dma_dev;
+	unsigned int	nr_pages;
+	u64		size;
+	u32		frame_size;
+	u32		headroom;
+	u32		flags;		/* TP_UMEM_* */
+
+	struct packet_umem_queue fill;
+	struct packet_umem_queue rx;
+	spinlock_t	lock;		/* copy mode producer */
+
+	struct sock	*sk;		/* woken for new frames */
+	struct net_device *dev;		/* bound to, protected by rtnl */
+	u16		queue_id;
+	bool		zerocopy;	/* dev fills the area itself */
+	bool		need_wakeup;	/* TP_UMEM_NEED_WAKEUP is set */
+	struct napi_struct __rcu *napi;	/* zero copy, scheduled on a kick */
+
+	u64		rx_packets;
+	u64		rx_dropped;
+	u64		fill_invalid;
+
+	struct mm_struct *mm;		/* charged for the pinned pages */
+};
+
+#ifdef CONFIG_PACKET_UMEM
+struct packet_umem *packet_umem_create(const struct tpacket_umem_reg *reg);
+void packet_umem_destroy(struct packet_umem *umem);
+int packet_umem_set_ring(struct packet_umem *umem, bool rx,
+			 unsigned int entries);
+int packet_umem_mmap(struct packet_umem *umem, struct vm_area_struct *vma);
+int packet_umem_dma_map(struct packet_umem *umem, struct device *dev);
+void packet_umem_dma_unmap(struct packet_umem *umem);
+void packet_umem_wakeup(struct packet_umem *umem);
+#else
+static inline struct packet_umem *
+packet_umem_create(const struct tpacket_umem_reg *reg)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static inline void packet_umem_destroy(struct packet_umem *umem)
+{
+}
+
+static inline int packet_umem_set_ring(struct packet_umem *umem, bool rx,
+				       unsigned int entries)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int packet_umem_mmap(struct packet_umem *umem,
+				   struct vm_area_struct *vma)
+{
+	return -EINVAL;
+}
+
+static inline int packet_umem_dma_map(struct packet_umem *umem,
+				      struct device *dev)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void packet_umem_dma_unmap(struct packet_umem *umem)
+{
+}
+
+static inline void packet_umem_wakeup(struct packet_umem *umem)
+{
+}
+#endif
+
+/**
+ * packet_umem_fill_get - take a free chunk off the fill ring
+ * @umem: umem to take it from
+ * @addr: offset of the chunk into the area
+ *
+ * Returns false if the ring is empty, or if the entry user space posted
+ * does not name a chunk; such an entry is consumed and counted.
+ */
+static inline bool packet_umem_fill_get(struct packet_umem *umem, u64 *addr)
+{
+	struct packet_umem_queue *q = &umem->fill;
+
+	if (q->cached_cons == q->cached_prod) {
+		/* pairs with the release of producer by user space */
+		q->cached_prod = smp_load_acquire(&q->ring->producer);
+		if (q->cached_cons == q->cached_prod)
+			return false;
+	}
+
+	*addr = READ_ONCE(((u64 *)q->entries)[q->cached_cons & q->mask]);
+	/* the entry has been read before user space may reuse its slot */
+	smp_store_release(&q->ring->consumer, ++q->cached_cons);
+
+	if (unlikely(*addr >= umem->size || *addr & (umem->frame_size - 1))) {
+		umem->fill_invalid++;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * packet_umem_fill_sleep - ask user space for a kick on the next refill
+ * @umem: umem whose fill ring ran dry
+ *
+ * For a driver that has no chunk left posted to its queue, and so will
+ * not get another interrupt for it.  Returns false if chunks showed up on
+ * the fill ring meanwhile: the driver must keep polling then, rather than
+ * wait for a kick that may never come.
+ */
+static inline bool packet_umem_fill_sleep(struct packet_umem *umem)
+{
+	struct packet_umem_queue *q = &umem->fill;
+
+	if (!umem->need_wakeup) {
+		WRITE_ONCE(q->ring->flags, TP_UMEM_NEED_WAKEUP);
+		umem->need_wakeup = true;
+	}
+	/* pairs with the barrier between producer and flags in user space */
+	smp_mb();
+	return READ_ONCE(q->ring->producer) == q->cached_cons;
+}
+
+/* Called by the driver whenever it polls, clears TP_UMEM_NEED_WAKEUP */
+static inline void packet_umem_fill_awake(struct packet_umem *umem)
+{
+	if (umem->need_wakeup) {
+		WRITE_ONCE(umem->fill.ring->flags, 0);
+		umem->need_wakeup = false;
+	}
+}
+
+/* Tells whether packet_umem_rx_put() would find room */
+static inline bool packet_umem_rx_has_room(struct packet_umem *umem)
+{
+	struct packet_umem_queue *q = &umem->rx;
+
+	if (q->cached_prod - q->cached_cons <= q->mask)
+		return true;
+	/* pairs with the release of consumer by user space */
+	q->cached_cons = smp_load_acquire(&q->ring->consumer);
+	return q->cached_prod - q->cached_cons <= q->mask;
+}
+
+/**
+ * packet_umem_rx_put - queue a received frame on the rx ring
+ * @umem: umem the frame is in
+ * @addr: offset of the frame data into the area
+ * @len: length of the frame
+ *
+ * The frame only becomes visible to user space with packet_umem_rx_flush().
+ * Returns false, and counts a drop, if the ring is full.
+ */
+static inline bool packet_umem_rx_put(struct packet_umem *umem, u64 addr,
+				      u32 len)
+{
+	struct packet_umem_queue *q = &umem->rx;
+	struct tpacket_umem_desc *desc;
+
+	if (!packet_umem_rx_has_room(umem)) {
+		umem->rx_dropped++;
+		return false;
+	}
+
+	desc = (struct tpacket_umem_desc *)q->entries +
+	       (q->cached_prod++ & q->mask);
+	desc->addr = addr;
+	desc->len = len;
+	desc->flags = 0;
+	umem->rx_packets++;
+	return true;
+}
+
+/* Publishes the frames queued so far and wakes up the socket */
+static inline void packet_umem_rx_flush(struct packet_umem *umem)
+{
+	/* the descriptors and frame data are visible before the index */
+	smp_store_release(&umem->rx.ring->producer, umem->rx.cached_prod);
+	umem->sk->sk_data_ready(umem->sk);
+}
+
+static inline bool packet_umem_rx_pending(const struct packet_umem *umem)
+{
+	return umem->rx.ring &&
+	       READ_ONCE(umem->rx.ring->producer) !=
+	       READ_ONCE(umem->rx.ring->consumer);
+}
+
+#endif /* _NET_PACKET_UMEM_H */
@@ -0,0 +1,107 @@
+/*
+ * page_pool.h	Recycling pool of DMA mapped pages for driver rx rings
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A page_pool belongs to one rx queue. Pages are handed out already DMA
+ * mapped and stay mapped while they circulate between the ring, the stack
+ * and the pool, so the steady state does neither page allocation nor DMA
+ * map/unmap.
+ *
+ * Pages come back either straight from the driver's NAPI poll, into a
+ * small lockless cache only that poll touches, or from wherever the skb
+ * they were attached to is freed, into a locked ring. Only the last user
+ * of a page may recycle it; everybody else just drops a reference.
+ *
+ * Pages must leave the pool's world through the pool: skbs carrying pool
+ * pages are marked with skb->pp_recycle, and a pool page that is freed
+ * with a bare put_page() leaks its DMA mapping and pins the pool.
+ */
+#ifndef _NET_PAGE_POOL_H
+#define _NET_PAGE_POOL_H
+
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/dma-direction.h>
+#include <linux/poison.h>
+
+#define PP_FLAG_DMA_MAP		BIT(0)	/* pool maps and unmaps the pages */
+
+#define PP_ALLOC_CACHE_SIZE	128
+#define PP_ALLOC_CACHE_REFILL	64
+
+/* stored in page->pp_magic, bit 0 must stay clear, see PageTail() */
+#define PP_SIGNATURE		(0x40 + POISON_POINTER_DELTA)
+
+struct page_pool_params {
+	unsigned int	flags;
+	unsigned int	order;
+	unsigned int	pool_size;	/* slots in the recycle ring */
+	int		nid;		/* NUMA_NO_NODE: node of the poll */
+	struct device	*dev;		/* for PP_FLAG_DMA_MAP */
+	enum dma_data_direction dma_dir;
+};
+
+struct page_pool_stats {
+	u64	alloc_fast;		/* from the NAPI cache */
+	u64	alloc_slow;		/* refilled from the recycle ring */
+	u64	alloc_pages;		/* from the page allocator */
+	u64	recycle_cached;		/* returned into the NAPI cache */
+	u64	recycle_ring;		/* returned into the recycle ring */
+	u64	recycle_full;		/* recycle ring was full */
+	u64	release;		/* unmapped and given back */
+};
+
+struct page_pool {
+	struct page_pool_params p;
+
+	/* only touched from the NAPI poll of the owning queue */
+	struct {
+		unsigned int	count;
+		struct page	*cache[PP_ALLOC_CACHE_SIZE];
+	} alloc ____cacheline_aligned_in_smp;
+
+	spinlock_t	ring_lock ____cacheline_aligned_in_smp;
+	unsigned int	ring_count;
+	bool		destroyed;
+	struct page	**ring;
+
+	/* one for the driver plus one per page out of the pool */
+	atomic_t	refcnt;
+	struct page_pool_stats __percpu *stats;
+};
+
+struct page_pool *page_pool_create(const struct page_pool_params *params);
+void page_pool_destroy(struct page_pool *pool);
+
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct);
+void page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats);
+
+static inline struct page *page_pool_dev_alloc_pages(struct page_pool *pool)
+{
+	return page_pool_alloc_pages(pool, GFP_ATOMIC | __GFP_NOWARN |
+					   __GFP_COLD | __GFP_MEMALLOC);
+}
+
+/* Only valid for pools created with PP_FLAG_DMA_MAP */
+static inline dma_addr_t page_pool_get_dma_addr(struct page *page)
+{
+	return (dma_addr_t)page_private(page);
+}
+
+#ifdef CONFIG_PAGE_POOL
+bool page_pool_return_skb_page(struct page *page);
+#else
+static inline bool page_pool_return_skb_page(struct page *page)
+{
+	return false;
+}
+#endif
+
+#endif /* _NET_PAGE_POOL_H */
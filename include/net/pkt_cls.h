@@ -139,6 +139,71 @@ void tcf_exts_change(struct tcf_proto *tp, struct tcf_exts *dst,
 int tcf_exts_dump(struct sk_buff *skb, struct tcf_exts *exts);
 int tcf_exts_dump_stats(struct sk_buff *skb, struct tcf_exts *exts);
 
+/**
+ * tcf_exts_stats_update - fold hardware counters into the actions
+ * @exts: tc filter extensions handle
+ * @bytes: bytes matched since the last update
+ * @packets: packets matched since the last update
+ * @lastuse: jiffies of the last match, 0 when unknown
+ */
+static inline void
+tcf_exts_stats_update(const struct tcf_exts *exts,
+		      u64 bytes, u32 packets, unsigned long lastuse)
+{
+#ifdef CONFIG_NET_CLS_ACT
+	struct tc_action *a;
+
+	list_for_each_entry(a, &exts->actions, list)
+		tcf_action_stats_update(a, bytes, packets, lastuse);
+#endif
+}
+
+static inline bool tc_skip_sw(u32 flags)
+{
+	return flags & TCA_CLS_FLAGS_SKIP_SW;
+}
+
+/* SKIP_HW and SKIP_SW are mutually exclusive flags. */
+static inline bool tc_flags_valid(u32 flags)
+{
+	if (flags & ~(TCA_CLS_FLAGS_SKIP_HW | TCA_CLS_FLAGS_SKIP_SW))
+		return false;
+
+	return !((flags & TCA_CLS_FLAGS_SKIP_HW) &&
+		 (flags & TCA_CLS_FLAGS_SKIP_SW));
+}
+
+enum tc_fl_command {
+	TC_CLSFLOWER_REPLACE,
+	TC_CLSFLOWER_DESTROY,
+	TC_CLSFLOWER_STATS,
+};
+
+/*
+ * What cls_flower hands to ndo_setup_tc_flower. @key and @mask are opaque,
+ * drivers look into them through skb_flow_dissector_target() with
+ * @dissector, which only has the keys the filter's mask really uses.
+ * @cookie identifies the filter across REPLACE, STATS and DESTROY. For
+ * STATS the driver adds its counters to @exts with tcf_exts_stats_update().
+ */
+struct tc_cls_flower_offload {
+	enum tc_fl_command command;
+	unsigned long cookie;
+	struct flow_dissector *dissector;
+	void *mask;
+	void *key;
+	struct tcf_exts *exts;
+};
+
+static inline bool tc_should_offload(const struct net_device *dev, u32 flags)
+{
+	if (!(dev->features & NETIF_F_HW_TC))
+		return false;
+	if (flags & TCA_CLS_FLAGS_SKIP_HW)
+		return false;
+	return dev->netdev_ops->ndo_setup_tc_flower;
+}
+
 /**
  * struct tcf_pkt_info - packet information
  */
@@ -27,6 +27,8 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_RUNNING,	/* TCQ_F_NOLOCK qdiscs */
+	__QDISC_STATE_MISSED,	/* TCQ_F_NOLOCK qdisc has work for the runner */
 };
 
 /*
@@ -64,6 +66,10 @@ struct Qdisc {
 #define TCQ_F_NOPARENT		0x40 /* root of its hierarchy :
 				      * qdisc_tree_decrease_qlen() should stop.
 				      */
+#define TCQ_F_NOLOCK		0x80 /* enqueue/dequeue without qdisc lock,
+				      * counted in the percpu statistics
+				      * (TCQ_F_CPUSTATS), qlen included.
+				      */
 	u32			limit;
 	const struct Qdisc_ops	*ops;
 	struct qdisc_size_table	__rcu *stab;
@@ -104,11 +110,28 @@ struct Qdisc {
 
 static inline bool qdisc_is_running(const struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return test_bit(__QDISC_STATE_RUNNING, &qdisc->state);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
+/*
+ * Without the qdisc lock, a CPU that failed to become the runner may have
+ * queued a packet just after the runner found the queue empty. It leaves
+ * __QDISC_STATE_MISSED behind, the runner clears it before dequeueing and
+ * reschedules the qdisc if it finds it set on the way out.
+ */
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (!test_and_set_bit_lock(__QDISC_STATE_RUNNING, &qdisc->state))
+			return true;
+		set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		smp_mb__after_atomic();
+		/* the runner may have left before it could see the bit */
+		return !test_and_set_bit_lock(__QDISC_STATE_RUNNING,
+					      &qdisc->state);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -117,6 +140,13 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		clear_bit_unlock(__QDISC_STATE_RUNNING, &qdisc->state);
+		smp_mb__after_atomic();
+		if (unlikely(test_bit(__QDISC_STATE_MISSED, &qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -195,10 +225,16 @@ struct Qdisc_ops {
 	void			(*destroy)(struct Qdisc *);
 	int			(*change)(struct Qdisc *, struct nlattr *arg);
 	void			(*attach)(struct Qdisc *);
+	/* called with the device deactivated, see dev_qdisc_change_tx_queue_len() */
+	int			(*change_tx_queue_len)(struct Qdisc *,
+						       unsigned int);
 
 	int			(*dump)(struct Qdisc *, struct sk_buff *);
 	int			(*dump_stats)(struct Qdisc *, struct gnet_dump *);
 
+	/* TCQ_F_NOLOCK if the qdisc can run lockless at the root of a txq */
+	unsigned int		root_flags;
+
 	struct module		*owner;
 };
 
@@ -272,6 +308,20 @@ static inline int qdisc_qlen(const struct Qdisc *q)
 	return q->q.qlen;
 }
 
+/* Unlike qdisc_qlen(), also right for TCQ_F_NOLOCK qdiscs, but slow */
+static inline u32 qdisc_qlen_sum(const struct Qdisc *q)
+{
+	u32 qlen = 0;
+	int i;
+
+	if (!(q->flags & TCQ_F_NOLOCK))
+		return q->q.qlen;
+
+	for_each_possible_cpu(i)
+		qlen += per_cpu_ptr(q->cpu_qstats, i)->qlen;
+	return qlen;
+}
+
 static inline struct qdisc_skb_cb *qdisc_skb_cb(const struct sk_buff *skb)
 {
 	return (struct qdisc_skb_cb *)skb->cb;
@@ -392,6 +442,7 @@ void dev_shutdown(struct net_device *dev);
 void dev_activate(struct net_device *dev);
 void dev_deactivate(struct net_device *dev);
 void dev_deactivate_many(struct list_head *head);
+int dev_qdisc_change_tx_queue_len(struct net_device *dev);
 struct Qdisc *dev_graft_qdisc(struct netdev_queue *dev_queue,
 			      struct Qdisc *qdisc);
 void qdisc_reset(struct Qdisc *qdisc);
@@ -402,6 +453,10 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 			  const struct Qdisc_ops *ops);
 struct Qdisc *qdisc_create_dflt(struct netdev_queue *dev_queue,
 				const struct Qdisc_ops *ops, u32 parentid);
+void qdisc_root_nolock(struct Qdisc *qdisc);
+void qdisc_stats_add(const struct Qdisc *qdisc,
+		     struct gnet_stats_basic_packed *bstats,
+		     struct gnet_stats_queue *qstats);
 void __qdisc_calculate_pkt_len(struct sk_buff *skb,
 			       const struct qdisc_size_table *stab);
 bool tcf_destroy(struct tcf_proto *tp, bool force);
@@ -512,11 +567,26 @@ static inline bool qdisc_is_percpu_stats(const struct Qdisc *q)
 	return q->flags & TCQ_F_CPUSTATS;
 }
 
+static inline void _bstats_update(struct gnet_stats_basic_packed *bstats,
+				  __u64 bytes, __u32 packets)
+{
+	bstats->bytes += bytes;
+	bstats->packets += packets;
+}
+
 static inline void bstats_update(struct gnet_stats_basic_packed *bstats,
 				 const struct sk_buff *skb)
 {
-	bstats->bytes += qdisc_pkt_len(skb);
-	bstats->packets += skb_is_gso(skb) ? skb_shinfo(skb)->gso_segs : 1;
+	_bstats_update(bstats, qdisc_pkt_len(skb),
+		       skb_is_gso(skb) ? skb_shinfo(skb)->gso_segs : 1);
+}
+
+static inline void _bstats_cpu_update(struct gnet_stats_basic_cpu *bstats,
+				      __u64 bytes, __u32 packets)
+{
+	u64_stats_update_begin(&bstats->syncp);
+	_bstats_update(&bstats->bstats, bytes, packets);
+	u64_stats_update_end(&bstats->syncp);
 }
 
 static inline void bstats_cpu_update(struct gnet_stats_basic_cpu *bstats,
@@ -551,6 +621,33 @@ static inline void qdisc_qstats_backlog_inc(struct Qdisc *sch,
 	sch->qstats.backlog += qdisc_pkt_len(skb);
 }
 
+static inline void qdisc_qstats_cpu_backlog_dec(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_sub(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+static inline void qdisc_qstats_cpu_backlog_inc(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_add(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+static inline void qdisc_qstats_cpu_qlen_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_qlen_dec(struct Qdisc *sch)
+{
+	this_cpu_dec(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_requeues_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->requeues);
+}
+
 static inline void __qdisc_qstats_drop(struct Qdisc *sch, int count)
 {
 	sch->qstats.drops += count;
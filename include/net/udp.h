@@ -162,6 +162,9 @@ struct sk_buff **udp_gro_receive(struct sk_buff **head, struct sk_buff *skb,
 				 struct udphdr *uh);
 int udp_gro_complete(struct sk_buff *skb, int nhoff);
 
+/* Datagrams aggregated into one UDP GRO packet at most */
+#define UDP_GRO_CNT_MAX 64
+
 static inline struct udphdr *udp_gro_udphdr(struct sk_buff *skb)
 {
 	struct udphdr *uh;
@@ -282,6 +285,10 @@ struct sock *__udp6_lib_lookup(struct net *net,
 	if (is_udplite) SNMP_INC_STATS_BH((net)->mib.udplite_stats_in6, field);\
 	else		SNMP_INC_STATS_BH((net)->mib.udp_stats_in6, field);  \
 } while(0)
+#define UDP6_ADD_STATS_BH(net, field, is_udplite, val)	    do { \
+	if (is_udplite) SNMP_ADD_STATS_BH((net)->mib.udplite_stats_in6, field, val);\
+	else		SNMP_ADD_STATS_BH((net)->mib.udp_stats_in6, field, val);  \
+} while(0)
 #define UDP6_INC_STATS_USER(net, field, __lite)		    do { \
 	if (__lite) SNMP_INC_STATS_USER((net)->mib.udplite_stats_in6, field);  \
 	else	    SNMP_INC_STATS_USER((net)->mib.udp_stats_in6, field);      \
@@ -332,5 +339,18 @@ void udp_init(void);
 void udp_encap_enable(void);
 #if IS_ENABLED(CONFIG_IPV6)
 void udpv6_encap_enable(void);
+void udpv6_gro_enable(void);
 #endif
+
+/* Tell a UDP_GRO socket the size of the datagrams in a GRO packet. */
+static inline void udp_cmsg_recv(struct msghdr *msg, struct sock *sk,
+				 struct sk_buff *skb)
+{
+	int gso_size;
+
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		gso_size = skb_shinfo(skb)->gso_size;
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
+}
 #endif	/* _UDP_H */
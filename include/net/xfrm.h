@@ -186,6 +186,9 @@ struct xfrm_state {
 	struct xfrm_replay_state replay;
 	struct xfrm_replay_state_esn *replay_esn;
 
+	/* Bumped around replay advances so input can check without x->lock */
+	seqcount_t		replay_seq;
+
 	/* Replay detection state at the time we sent the last notification */
 	struct xfrm_replay_state preplay;
 	struct xfrm_replay_state_esn *preplay_esn;
@@ -525,6 +528,8 @@ struct xfrm_policy {
 	possible_net_t		xp_net;
 	struct hlist_node	bydst;
 	struct hlist_node	byidx;
+	struct hlist_node	bybin;
+	u64			pos;
 
 	/* This lock only affects elements except for entry. */
 	rwlock_t		lock;
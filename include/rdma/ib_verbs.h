@@ -48,6 +48,7 @@
 #include <linux/rwsem.h>
 #include <linux/scatterlist.h>
 #include <linux/workqueue.h>
+#include <linux/blk-iopoll.h>
 #include <linux/socket.h>
 #include <uapi/linux/if_ether.h>
 
@@ -579,6 +580,19 @@ enum ib_mr_type {
 	IB_MR_TYPE_SIGNATURE,
 };
 
+/**
+ * enum ib_mr_advice - hints given to the device about ODP MR ranges
+ * @IB_MR_ADVICE_PREFETCH:       populate the page tables for local reads
+ * @IB_MR_ADVICE_PREFETCH_WRITE: populate them for writes as well
+ */
+enum ib_mr_advice {
+	IB_MR_ADVICE_PREFETCH,
+	IB_MR_ADVICE_PREFETCH_WRITE,
+};
+
+/* Return only once the advice has been acted upon */
+#define IB_MR_ADVISE_FLUSH	(1 << 0)
+
 /**
  * Signature types
  * IB_SIG_TYPE_NONE: Unprotected.
@@ -757,8 +771,25 @@ enum ib_wc_flags {
 	IB_WC_WITH_VLAN		= (1<<5),
 };
 
+struct ib_cq;
+struct ib_wc;
+
+/**
+ * struct ib_cqe - completion context of a work request
+ * @done: called with the work completion by the ib_alloc_cq() poll loop
+ *
+ * Consumers embed this in their per-request context and set it as the
+ * wr_cqe of the work request instead of a wr_id.
+ */
+struct ib_cqe {
+	void (*done)(struct ib_cq *cq, struct ib_wc *wc);
+};
+
 struct ib_wc {
-	u64			wr_id;
+	union {
+		u64		wr_id;
+		struct ib_cqe	*wr_cqe;
+	};
 	enum ib_wc_status	status;
 	enum ib_wc_opcode	opcode;
 	u32			vendor_err;
@@ -1081,7 +1112,10 @@ struct ib_mw_bind_info {
 
 struct ib_send_wr {
 	struct ib_send_wr      *next;
-	u64			wr_id;
+	union {
+		u64		wr_id;
+		struct ib_cqe	*wr_cqe;
+	};
 	struct ib_sge	       *sg_list;
 	int			num_sge;
 	enum ib_wr_opcode	opcode;
@@ -1175,7 +1209,10 @@ static inline struct ib_sig_handover_wr *sig_handover_wr(struct ib_send_wr *wr)
 
 struct ib_recv_wr {
 	struct ib_recv_wr      *next;
-	u64			wr_id;
+	union {
+		u64		wr_id;
+		struct ib_cqe	*wr_cqe;
+	};
 	struct ib_sge	       *sg_list;
 	int			num_sge;
 };
@@ -1307,6 +1344,13 @@ struct ib_ah {
 
 typedef void (*ib_comp_handler)(struct ib_cq *cq, void *cq_context);
 
+enum ib_poll_context {
+	IB_POLL_DIRECT,		/* caller context, no hw completions */
+	IB_POLL_SOFTIRQ,	/* poll from softirq context */
+	IB_POLL_WORKQUEUE,	/* poll from workqueue */
+	IB_POLL_LAST = IB_POLL_WORKQUEUE,
+};
+
 struct ib_cq {
 	struct ib_device       *device;
 	struct ib_uobject      *uobject;
@@ -1315,6 +1359,17 @@ struct ib_cq {
 	void                   *cq_context;
 	int               	cqe;
 	atomic_t          	usecnt; /* count number of work queues */
+	enum ib_poll_context	poll_ctx;
+	struct ib_wc	       *wc;
+	union {
+		struct blk_iopoll	iop;
+		struct work_struct	work;
+	};
+	/* shared CQ pool state, see ib_cq_pool_get() */
+	struct list_head	pool_entry;
+	int			cqe_used;
+	int			comp_vector;
+	bool			shared;
 };
 
 struct ib_srq {
@@ -1598,6 +1653,10 @@ struct ib_device {
 
 	int			      num_comp_vectors;
 
+	/* Shared CQs handed out by ib_cq_pool_get(), per poll context */
+	spinlock_t		      cq_pools_lock;
+	struct list_head	      cq_pools[IB_POLL_LAST + 1];
+
 	struct iw_cm_verbs	     *iwcm;
 
 	int		           (*get_protocol_stats)(struct ib_device *device,
@@ -1744,6 +1803,11 @@ struct ib_device {
 	int                        (*query_mr)(struct ib_mr *mr,
 					       struct ib_mr_attr *mr_attr);
 	int                        (*dereg_mr)(struct ib_mr *mr);
+	int			   (*advise_mr)(struct ib_pd *pd,
+						enum ib_mr_advice advice,
+						u32 flags,
+						struct ib_sge *sg_list,
+						u32 num_sge);
 	struct ib_mr *		   (*alloc_mr)(struct ib_pd *pd,
 					       enum ib_mr_type mr_type,
 					       u32 max_num_sg);
@@ -2497,6 +2561,17 @@ int ib_modify_cq(struct ib_cq *cq, u16 cq_count, u16 cq_period);
  */
 int ib_destroy_cq(struct ib_cq *cq);
 
+struct ib_cq *ib_alloc_cq(struct ib_device *dev, void *private,
+			  int nr_cqe, int comp_vector,
+			  enum ib_poll_context poll_ctx);
+void ib_free_cq(struct ib_cq *cq);
+int ib_process_cq_direct(struct ib_cq *cq, int budget);
+
+struct ib_cq *ib_cq_pool_get(struct ib_device *dev, unsigned int nr_cqe,
+			     int comp_vector_hint,
+			     enum ib_poll_context poll_ctx);
+void ib_cq_pool_put(struct ib_cq *cq, unsigned int nr_cqe);
+
 /**
  * ib_poll_cq - poll a CQ for completion(s)
  * @cq:the CQ being polled
@@ -295,6 +295,7 @@ struct iscsi_data_count {
 	u32			ss_iov_count;
 	u32			ss_marker_count;
 	struct kvec		*iov;
+	int			msg_flags;
 };
 
 struct iscsi_param_list {
@@ -56,6 +56,11 @@ struct sockaddr_ll {
 #define PACKET_QDISC_BYPASS		20
 #define PACKET_ROLLOVER_STATS		21
 #define PACKET_FANOUT_DATA		22
+#define PACKET_UMEM_REG			23
+#define PACKET_UMEM_FILL_RING		24
+#define PACKET_UMEM_RX_RING		25
+#define PACKET_UMEM_QUEUE		26
+#define PACKET_UMEM_STATISTICS		27
 
 #define PACKET_FANOUT_HASH		0
 #define PACKET_FANOUT_LB		1
@@ -298,4 +303,58 @@ struct packet_mreq {
 #define PACKET_MR_ALLMULTI	2
 #define PACKET_MR_UNICAST	3
 
+/*
+ * UMEM receive mode: frames are written straight into user memory
+ * registered with PACKET_UMEM_REG, one frame per frame_size chunk.  User
+ * space hands free chunks to the kernel on the fill ring and gets received
+ * frames back on the rx ring; both are set up with PACKET_UMEM_FILL_RING
+ * and PACKET_UMEM_RX_RING and mmap()ed at the offsets below.
+ */
+struct tpacket_umem_reg {
+	__u64	addr;		/* page aligned start of the area */
+	__u64	len;		/* page aligned length */
+	__u32	frame_size;	/* power of 2, from 2048 to the page size */
+	__u32	frame_headroom;	/* left free in front of each frame */
+	__u32	flags;
+};
+
+#define TP_UMEM_ZEROCOPY	(1 << 0)	/* fail bind() without driver support */
+#define TP_UMEM_COPY		(1 << 1)	/* never ask the driver */
+
+/*
+ * Each ring starts with this header, followed by the entries: __u64 chunk
+ * offsets into the area on the fill ring, struct tpacket_umem_desc on the
+ * rx ring.  Entries from consumer up to producer are valid; the producer
+ * only ever writes producer and the consumer only consumer.
+ *
+ * The kernel sets TP_UMEM_NEED_WAKEUP in flags of the fill ring when a
+ * zero copy queue ran out of chunks and stopped polling.  User space then
+ * has to kick it with a sendmsg() of length 0 after posting more, checking
+ * flags only after a full barrier following the update of producer.
+ */
+struct tpacket_umem_ring {
+	__u32	producer;
+	__u32	flags;
+	__u32	__pad1[14];
+	__u32	consumer;
+	__u32	__pad2[15];
+};
+
+struct tpacket_umem_desc {
+	__u64	addr;		/* offset of the frame data into the area */
+	__u32	len;
+	__u32	flags;
+};
+
+struct tpacket_umem_stats {
+	__u64	rx_packets;
+	__u64	rx_dropped;	/* no room on the rx ring, or no fill entry */
+	__u64	fill_invalid;	/* bad offsets found on the fill ring */
+};
+
+#define TP_UMEM_NEED_WAKEUP	(1 << 0)
+
+#define PACKET_UMEM_PGOFF_FILL_RING	0
+#define PACKET_UMEM_PGOFF_RX_RING	0x10000000
+
 #endif
@@ -56,6 +56,12 @@
  */
 #define TUNSETVNETBE _IOW('T', 222, int)
 #define TUNGETVNETBE _IOR('T', 223, int)
+/* Write or read up to vlen packets in one call, see struct tun_mmsg.  The
+ * return value is the number of packets processed, or an error if the
+ * first one failed.  TUNRECVMMSG only blocks for the first packet.
+ */
+#define TUNSENDMMSG _IOW('T', 224, struct tun_mmsg)
+#define TUNRECVMMSG _IOW('T', 225, struct tun_mmsg)
 
 /* TUNSETIFF ifr flags */
 #define IFF_TUN		0x0001
@@ -72,6 +78,21 @@
 #define IFF_PERSIST	0x0800
 #define IFF_NOFILTER	0x1000
 
+/* One packet of a TUNSENDMMSG/TUNRECVMMSG batch, laid out as for write()
+ * and read(); @len is updated with the bytes written or read.
+ */
+struct tun_msg {
+	__u64	buf;
+	__u32	len;
+	__u32	flags;		/* must be 0 */
+};
+
+struct tun_mmsg {
+	__u64	msgs;		/* array of vlen struct tun_msg */
+	__u32	vlen;
+	__u32	flags;		/* must be 0 */
+};
+
 /* Socket options */
 #define TUN_TX_TIMESTAMP 1
 
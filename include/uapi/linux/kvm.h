@@ -184,6 +184,7 @@ struct kvm_s390_skeys {
 #define KVM_EXIT_SYSTEM_EVENT     24
 #define KVM_EXIT_S390_STSI        25
 #define KVM_EXIT_IOAPIC_EOI       26
+#define KVM_EXIT_DIRTY_RING_FULL  27
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -831,6 +832,8 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_GUEST_DEBUG_HW_WPS 120
 #define KVM_CAP_SPLIT_IRQCHIP 121
 #define KVM_CAP_IOEVENTFD_ANY_LENGTH 122
+#define KVM_CAP_DIRTY_LOG_RING 123
+#define KVM_CAP_HALT_POLL 124
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1218,6 +1221,35 @@ struct kvm_s390_ucas_mapping {
 #define KVM_S390_GET_IRQ_STATE	  _IOW(KVMIO, 0xb6, struct kvm_s390_irq_state)
 /* Available with KVM_CAP_X86_SMM */
 #define KVM_SMI                   _IO(KVMIO,   0xb7)
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS     _IO(KVMIO,   0xc7)
+
+/*
+ * Entry of a dirty ring, enabled with KVM_ENABLE_CAP(KVM_CAP_DIRTY_LOG_RING)
+ * on the VM fd (args[0] is the ring size in bytes) before any vcpu is
+ * created, and mmap()ed from each vcpu fd at page offset
+ * KVM_DIRTY_LOG_PAGE_OFFSET.
+ *
+ * KVM pushes an entry with KVM_DIRTY_GFN_F_DIRTY set for every page a
+ * vcpu dirties in a slot with KVM_MEM_LOG_DIRTY_PAGES; @slot is encoded
+ * like kvm_dirty_log.slot ((as_id << 16) | id) and @offset is the page
+ * index within the slot.  Userspace collects entries in order, sets
+ * KVM_DIRTY_GFN_F_RESET on each one it is done with, and calls
+ * KVM_RESET_DIRTY_RINGS to write-protect those pages again and recycle
+ * the entries.  A vcpu whose ring is nearly full exits with
+ * KVM_EXIT_DIRTY_RING_FULL until that happens.
+ *
+ * Pages dirtied outside of vcpu context still go to the dirty bitmap.
+ */
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;
+	__u64 offset;
+};
+
+#define KVM_DIRTY_GFN_F_DIRTY		(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET		(1 << 1)
+#define KVM_DIRTY_GFN_F_MASK		0x3
 
 #define KVM_DEV_ASSIGN_ENABLE_IOMMU	(1 << 0)
 #define KVM_DEV_ASSIGN_PCI_2_3		(1 << 1)
@@ -9,6 +9,7 @@
 #ifndef _NET_TIMESTAMPING_H
 #define _NET_TIMESTAMPING_H
 
+#include <linux/types.h>
 #include <linux/socket.h>   /* for SO_TIMESTAMPING */
 
 /* SO_TIMESTAMPING gets an integer bit field comprised of these values */
@@ -116,4 +117,25 @@ enum hwtstamp_rx_filters {
 	HWTSTAMP_FILTER_PTP_V2_DELAY_REQ,
 };
 
+/* SO_TXTIME gets a struct sock_txtime with flags being an integer bit
+ * field comprised of these values.
+ */
+enum txtime_flags {
+	SOF_TXTIME_DEADLINE_MODE = (1 << 0),
+
+	SOF_TXTIME_FLAGS_LAST = SOF_TXTIME_DEADLINE_MODE,
+	SOF_TXTIME_FLAGS_MASK = (SOF_TXTIME_FLAGS_LAST - 1) |
+				 SOF_TXTIME_FLAGS_LAST
+};
+
+/*
+ * Packets sent with an SCM_TXTIME control message carry a __u64 time in
+ * nanoseconds of @clockid at which they should leave, or with
+ * SOF_TXTIME_DEADLINE_MODE, by which they must have left.
+ */
+struct sock_txtime {
+	__kernel_clockid_t	clockid;
+	__u32			flags;
+};
+
 #endif /* _NET_TIMESTAMPING_H */
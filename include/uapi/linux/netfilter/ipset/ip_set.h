@@ -199,6 +199,8 @@ enum ipset_cadt_flags {
 	IPSET_FLAG_WITH_FORCEADD = (1 << IPSET_FLAG_BIT_WITH_FORCEADD),
 	IPSET_FLAG_BIT_WITH_SKBINFO = 6,
 	IPSET_FLAG_WITH_SKBINFO = (1 << IPSET_FLAG_BIT_WITH_SKBINFO),
+	IPSET_FLAG_BIT_PCPU_COUNTERS = 7,
+	IPSET_FLAG_PCPU_COUNTERS = (1 << IPSET_FLAG_BIT_PCPU_COUNTERS),
 	IPSET_FLAG_CADT_MAX	= 15,
 };
 
@@ -206,6 +208,9 @@ enum ipset_cadt_flags {
 enum ipset_create_flags {
 	IPSET_CREATE_FLAG_BIT_FORCEADD = 0,
 	IPSET_CREATE_FLAG_FORCEADD = (1 << IPSET_CREATE_FLAG_BIT_FORCEADD),
+	IPSET_CREATE_FLAG_BIT_PCPU_COUNTERS = 1,
+	IPSET_CREATE_FLAG_PCPU_COUNTERS =
+		(1 << IPSET_CREATE_FLAG_BIT_PCPU_COUNTERS),
 	IPSET_CREATE_FLAG_BIT_MAX = 7,
 };
 
@@ -958,6 +958,18 @@ enum nft_dup_attributes {
 };
 #define NFTA_DUP_MAX		(__NFTA_DUP_MAX - 1)
 
+/**
+ * enum nft_flow_attributes - nf_tables flow offload expression attributes
+ *
+ * The expression takes no attributes: flows are added to the per-netns
+ * flow table.
+ */
+enum nft_flow_attributes {
+	NFTA_FLOW_UNSPEC,
+	__NFTA_FLOW_MAX
+};
+#define NFTA_FLOW_MAX		(__NFTA_FLOW_MAX - 1)
+
 /**
  * enum nft_gen_attributes - nf_tables ruleset generation attributes
  *
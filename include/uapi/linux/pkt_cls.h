@@ -150,6 +150,11 @@ enum {
 
 #define TCA_POLICE_MAX (__TCA_POLICE_MAX - 1)
 
+/* tca flags definitions */
+#define TCA_CLS_FLAGS_SKIP_HW	(1 << 0) /* don't offload filter to HW */
+#define TCA_CLS_FLAGS_SKIP_SW	(1 << 1) /* don't use filter in SW */
+#define TCA_CLS_FLAGS_IN_HW	(1 << 2) /* dump only: filter is in HW */
+
 /* U32 filters */
 
 #define TC_U32_HTID(h) ((h)&0xFFF00000)
@@ -172,6 +177,7 @@ enum {
 	TCA_U32_INDEV,
 	TCA_U32_PCNT,
 	TCA_U32_MARK,
+	TCA_U32_FLAGS,
 	__TCA_U32_MAX
 };
 
@@ -219,6 +225,10 @@ struct tc_u32_pcnt {
 
 #define TC_U32_MAXDEPTH 8
 
+/* TCA_U32_FLAGS */
+#define TCA_U32_FLAGS_COMPILE	(1 << 0) /* match the keys with a BPF program */
+#define TCA_U32_FLAGS_COMPILED	(1 << 1) /* dump only: the program exists */
+
 
 /* RSVP filter */
 
@@ -416,6 +426,9 @@ enum {
 	TCA_FLOWER_KEY_TCP_DST,		/* be16 */
 	TCA_FLOWER_KEY_UDP_SRC,		/* be16 */
 	TCA_FLOWER_KEY_UDP_DST,		/* be16 */
+
+	TCA_FLOWER_MASK_HITS,		/* u64, packets matched by the mask */
+	TCA_FLOWER_FLAGS,		/* u32, TCA_CLS_FLAGS_* */
 	__TCA_FLOWER_MAX,
 };
 
@@ -364,6 +364,7 @@ enum {
 	TCA_HTB_DIRECT_QLEN,
 	TCA_HTB_RATE64,
 	TCA_HTB_CEIL64,
+	TCA_HTB_SHARED,		/* flag: share class rates across mq queues */
 	__TCA_HTB_MAX,
 };
 
@@ -711,6 +712,8 @@ enum {
 	TCA_FQ_CODEL_FLOWS,
 	TCA_FQ_CODEL_QUANTUM,
 	TCA_FQ_CODEL_CE_THRESHOLD,
+	TCA_FQ_CODEL_DROP_BATCH_SIZE,
+	TCA_FQ_CODEL_MEMORY_LIMIT,
 	__TCA_FQ_CODEL_MAX
 };
 
@@ -735,6 +738,8 @@ struct tc_fq_codel_qd_stats {
 	__u32	new_flows_len;	/* count of flows in new list */
 	__u32	old_flows_len;	/* count of flows in old list */
 	__u32	ce_mark;	/* packets above ce_threshold */
+	__u32	memory_usage;	/* in bytes */
+	__u32	drop_overmemory;
 };
 
 struct tc_fq_codel_cl_stats {
@@ -850,4 +855,26 @@ struct tc_pie_xstats {
 	__u32 maxq;             /* maximum queue size */
 	__u32 ecn_mark;         /* packets marked with ecn*/
 };
+
+/* ETF */
+struct tc_etf_qopt {
+	__s32 delta;		/* ns to dequeue ahead of the txtime */
+	__s32 clockid;		/* clock of the txtimes, e.g. CLOCK_TAI */
+	__u32 flags;
+#define TC_ETF_DEADLINE_MODE_ON	(1 << 0)
+#define TC_ETF_OFFLOAD_ON	(1 << 1)
+#define TC_ETF_SKIP_SOCK_CHECK	(1 << 2)
+};
+
+enum {
+	TCA_ETF_UNSPEC,
+	TCA_ETF_PARMS,
+	__TCA_ETF_MAX
+};
+#define TCA_ETF_MAX   (__TCA_ETF_MAX - 1)
+
+struct tc_etf_xstats {
+	__u32 late;		/* dropped, txtime already passed */
+	__u32 invalid;		/* dropped, txtime or its socket not usable */
+};
 #endif
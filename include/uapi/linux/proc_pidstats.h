@@ -0,0 +1,41 @@
+#ifndef _UAPI_LINUX_PROC_PIDSTATS_H
+#define _UAPI_LINUX_PROC_PIDSTATS_H
+
+#include <linux/types.h>
+
+/*
+ * Records read from /proc/pidstats, one per visible thread group.  A read
+ * returns as many whole records as fit in the buffer; the file position is
+ * the pid to resume from, so lseek() to a pid restarts the walk there.
+ * New fields are only ever added at the end: use ps_size to step from one
+ * record to the next.
+ */
+struct proc_pidstats {
+	__u32	ps_size;		/* sizeof(struct proc_pidstats) */
+	__u32	ps_flags;		/* PROC_PIDSTATS_* */
+	__s32	ps_pid;
+	__s32	ps_ppid;
+	__u32	ps_uid;
+	__u32	ps_gid;
+	__u32	ps_state;		/* state letter, as in /proc/<pid>/stat */
+	__u32	ps_num_threads;
+	__u64	ps_utime_ns;
+	__u64	ps_stime_ns;
+	__u64	ps_start_time_ns;	/* since boot */
+	__u64	ps_min_flt;
+	__u64	ps_maj_flt;
+	__u64	ps_vsize;		/* bytes */
+	__u64	ps_rss;			/* bytes */
+	/* valid if PROC_PIDSTATS_IO is set, as in /proc/<pid>/io */
+	__u64	ps_rchar;
+	__u64	ps_wchar;
+	__u64	ps_syscr;
+	__u64	ps_syscw;
+	__u64	ps_read_bytes;
+	__u64	ps_write_bytes;
+	__u64	ps_cancelled_write_bytes;
+};
+
+#define PROC_PIDSTATS_IO	0x0001	/* io counters filled in */
+
+#endif /* _UAPI_LINUX_PROC_PIDSTATS_H */
@@ -32,6 +32,13 @@
  * contain the cdb and data buffers -- the latter accessible via the
  * iov array. iov addresses are also offsets into the shared area.
  *
+ * The data area is only backed by memory where the kernel has placed
+ * command data, so userspace must not touch it outside of the iovs of
+ * the commands it is processing. If TCMU_MAILBOX_FLAG_ZERO_COPY is set
+ * in mailbox->flags, iovs may point at the command's own pages rather
+ * than a copy. Those are unmapped again once the command is completed,
+ * so no reference to them may be kept past setting cmd_tail.
+ *
  * When userspace is completed handling the command, set
  * entry->rsp.scsi_status, fill in rsp.sense_buffer if appropriate,
  * and also set mailbox->cmd_tail equal to the old cmd_tail plus
@@ -42,6 +49,8 @@
 #define TCMU_MAILBOX_VERSION 2
 #define ALIGN_SIZE 64 /* Should be enough for most CPUs */
 
+#define TCMU_MAILBOX_FLAG_ZERO_COPY (1 << 0)
+
 struct tcmu_mailbox {
 	__u16 version;
 	__u16 flags;
@@ -0,0 +1,52 @@
+#ifndef _UAPI_LINUX_TRACE_MMAP_H_
+#define _UAPI_LINUX_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - first page of a mapped per-cpu ring buffer
+ * @meta_page_size:	size of this page
+ * @meta_struct_len:	size of this structure
+ * @subbuf_size:	size of each sub-buffer
+ * @nr_subbufs:		number of sub-buffers, including the reader one
+ * @reader.lost_events:	events overwritten before the reader got to them
+ * @reader.id:		id of the sub-buffer currently owned by the reader
+ * @reader.read:	bytes of the reader sub-buffer consumed by the kernel
+ * @flags:		reserved, 0 for now
+ * @entries:		events written to the cpu buffer
+ * @overrun:		events overwritten in the cpu buffer
+ * @read:		events consumed from the cpu buffer
+ *
+ * The mapping of a per_cpu/cpuN/trace_pipe_raw file is this page followed
+ * by the sub-buffers in order of their id, so sub-buffer N starts at
+ * (N + 1) * meta_page_size. Each sub-buffer starts with the same header
+ * as the pages read from trace_pipe_raw.
+ *
+ * TRACE_MMAP_IOCTL_GET_READER marks the current reader sub-buffer as
+ * consumed and swaps in the next one that holds data, if any. Userspace
+ * then reads events from sub-buffer @reader.id; if the id did not change,
+ * it resumes where it stopped in that sub-buffer.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64	flags;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER		_IO('R', 0x20)
+
+#endif /* _UAPI_LINUX_TRACE_MMAP_H_ */
@@ -53,6 +53,23 @@
  * optimization.  */
 #define VRING_AVAIL_F_NO_INTERRUPT	1
 
+/*
+ * Mark a descriptor as available or used in a packed ring.
+ * Notice: they are defined as shifts instead of shifted values.
+ */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Enable events in a packed ring. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+/* Disable events in a packed ring. */
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/* Enable events for a specific descriptor (as given by off_wrap). */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/* Wrap counter bit shift in the event suppression structure. */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
 /* We support indirect buffer descriptors */
 #define VIRTIO_RING_F_INDIRECT_DESC	28
 
@@ -157,6 +174,31 @@ static inline unsigned vring_size(unsigned int num, unsigned long align)
 		+ sizeof(__virtio16) * 3 + sizeof(struct vring_used_elem) * num;
 }
 
+/*
+ * The packed layout is a single ring of descriptors which the driver
+ * marks available and the device overwrites in place once used, followed
+ * by the driver and the device event suppression structures.  Whether a
+ * descriptor is available or used is told by its AVAIL/USED flag bits
+ * relative to a wrap counter each side flips whenever it wraps around.
+ */
+struct vring_packed_desc_event {
+	/* Descriptor ring change event offset and wrap counter. */
+	__le16 off_wrap;
+	/* Descriptor ring change event flags. */
+	__le16 flags;
+};
+
+struct vring_packed_desc {
+	/* Buffer address. */
+	__le64 addr;
+	/* Buffer length. */
+	__le32 len;
+	/* Buffer ID. */
+	__le16 id;
+	/* The flags depending on descriptor type. */
+	__le16 flags;
+};
+
 /* The following is used with USED_EVENT_IDX and AVAIL_EVENT_IDX */
 /* Assuming a given event_idx value from the other side, if
  * we have just incremented index from old to new_idx,
@@ -95,6 +95,7 @@ enum {
 	IB_USER_VERBS_EX_CMD_CREATE_QP = IB_USER_VERBS_CMD_CREATE_QP,
 	IB_USER_VERBS_EX_CMD_CREATE_FLOW = IB_USER_VERBS_CMD_THRESHOLD,
 	IB_USER_VERBS_EX_CMD_DESTROY_FLOW,
+	IB_USER_VERBS_EX_CMD_ADVISE_MR,
 };
 
 /*
@@ -882,6 +883,32 @@ struct ib_uverbs_destroy_flow  {
 	__u32 flow_handle;
 };
 
+enum ib_uverbs_advise_mr_advice {
+	IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH,
+	IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH_WRITE,
+};
+
+enum ib_uverbs_advise_mr_flag {
+	IB_UVERBS_ADVISE_MR_FLAG_FLUSH = 1 << 0,
+};
+
+#define IB_UVERBS_ADVISE_MR_MAX_SGE	32
+
+/*
+ * Populate the page tables of on-demand paging MRs for the ranges in
+ * sg_list (an array of num_sge struct ib_uverbs_sge), asynchronously
+ * unless IB_UVERBS_ADVISE_MR_FLAG_FLUSH is set.
+ */
+struct ib_uverbs_advise_mr {
+	__u32 comp_mask;
+	__u32 pd_handle;
+	__u32 advice;
+	__u32 flags;
+	__u32 num_sge;
+	__u32 reserved;
+	__u64 sg_list;
+};
+
 struct ib_uverbs_create_srq {
 	__u64 response;
 	__u64 user_handle;
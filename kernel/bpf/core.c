@@ -719,6 +719,7 @@ static void bpf_prog_free_deferred(struct work_struct *work)
 	struct bpf_prog_aux *aux;
 
 	aux = container_of(work, struct bpf_prog_aux, work);
+	bpf_prog_poke_untrack(aux->prog);
 	bpf_jit_free(aux->prog);
 }
 
@@ -789,6 +790,14 @@ void __weak bpf_int_jit_compile(struct bpf_prog *prog)
 {
 }
 
+/* JITs that emit direct tail calls repoint them here. Others never set
+ * poke->ip, so this is not called for them.
+ */
+void __weak bpf_arch_poke_tail_call(struct bpf_jit_poke_descriptor *poke,
+				    struct bpf_prog *target)
+{
+}
+
 /* To execute LD_ABS/LD_IND instructions __bpf_prog_run() may call
  * skb_copy_bits(), so provide a weak definition of it for NET-less config.
  */
@@ -123,19 +123,39 @@
  *
  * After the call R0 is set to return type of the function and registers R1-R5
  * are set to NOT_INIT to indicate that they are no longer readable.
+ *
+ * Programs that see raw packet data load PTR_TO_PACKET and PTR_TO_PACKET_END
+ * from their context. A packet pointer may be moved forward by a constant,
+ * which is tracked in reg->off, and it can be dereferenced only within
+ * reg->range bytes from the start of the packet. The range is learned from
+ * 'if (R + off > pkt_end) goto' style compares: in the branch where the
+ * compare is false [0, off) bytes are known to be there, and since all packet
+ * pointers are derived from the same start, every packet pointer in the state
+ * learns it. See find_good_pkt_pointers().
+ *
+ * To keep the number of explored paths down, the verifier remembers the
+ * state at branch targets and after calls and stops exploring a path whose
+ * state is no worse than one already proven safe at the same insn. Only
+ * registers and spilled stack slots that the proven continuation actually
+ * read before overwriting them take part in the comparison, see
+ * mark_reg_read() and states_equal().
+ */
+
+#define MAX_PACKET_OFF 0xffff
+
+/* max number of insns the verifier walks, summed over all explored paths,
+ * and max number of branches it keeps pending
  */
+#define BPF_COMPLEXITY_LIMIT_INSNS	131072
+#define BPF_COMPLEXITY_LIMIT_STACK	1024
 
-/* types of values stored in eBPF registers */
-enum bpf_reg_type {
-	NOT_INIT = 0,		 /* nothing was written into register */
-	UNKNOWN_VALUE,		 /* reg doesn't contain a valid pointer */
-	PTR_TO_CTX,		 /* reg points to bpf_context */
-	CONST_PTR_TO_MAP,	 /* reg points to struct bpf_map */
-	PTR_TO_MAP_VALUE,	 /* reg points to map element value */
-	PTR_TO_MAP_VALUE_OR_NULL,/* points to map elem value or NULL */
-	FRAME_PTR,		 /* reg == frame_pointer */
-	PTR_TO_STACK,		 /* reg == frame_pointer + imm */
-	CONST_IMM,		 /* constant integer value */
+/* liveness of a register or spilled stack slot, relative to the last
+ * pruning checkpoint of the path
+ */
+enum reg_liveness {
+	REG_LIVE_NONE = 0,	/* neither read nor written since */
+	REG_LIVE_READ = 1,	/* a later insn depends on the value here */
+	REG_LIVE_WRITTEN = 2,	/* overwritten, screening later reads off */
 };
 
 struct reg_state {
@@ -144,11 +164,19 @@ struct reg_state {
 		/* valid when type == CONST_IMM | PTR_TO_STACK */
 		int imm;
 
+		/* valid when type == PTR_TO_PACKET */
+		struct {
+			u16 off;	/* constant offset from packet start */
+			u16 range;	/* [0, range) bytes are accessible */
+		};
+
 		/* valid when type == CONST_PTR_TO_MAP | PTR_TO_MAP_VALUE |
 		 *   PTR_TO_MAP_VALUE_OR_NULL
 		 */
 		struct bpf_map *map_ptr;
 	};
+	/* must stay last, states_equal() doesn't compare it */
+	enum reg_liveness live;
 };
 
 enum bpf_stack_slot_type {
@@ -166,6 +194,8 @@ struct verifier_state {
 	struct reg_state regs[MAX_BPF_REG];
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
+	/* last checkpoint on this path, which collects the read marks */
+	struct verifier_state *parent;
 };
 
 /* linked list of verifier states used to prune search */
@@ -199,7 +229,14 @@ struct verifier_env {
 	struct verifier_state_list **explored_states; /* search pruning optimization */
 	struct bpf_map *used_maps[MAX_USED_MAPS]; /* array of map's used by eBPF program */
 	u32 used_map_cnt;		/* number of used maps */
+	struct bpf_jit_poke_descriptor *poke_tab; /* bpf_tail_call() sites */
+	u32 poke_cnt;
 	bool allow_ptr_leaks;
+	/* verification statistics, printed to the log at the end */
+	u32 insn_processed;		/* insns walked over all paths */
+	u32 states_stored;		/* checkpoints kept for pruning */
+	u32 states_pruned;		/* paths cut short by a checkpoint */
+	u32 peak_stack_size;		/* max number of pending branches */
 };
 
 /* verbose verifier prints what it's seeing
@@ -237,6 +274,8 @@ static const char * const reg_type_str[] = {
 	[FRAME_PTR]		= "fp",
 	[PTR_TO_STACK]		= "fp",
 	[CONST_IMM]		= "imm",
+	[PTR_TO_PACKET]		= "pkt",
+	[PTR_TO_PACKET_END]	= "pkt_end",
 };
 
 static void print_verifier_state(struct verifier_env *env)
@@ -256,6 +295,9 @@ static void print_verifier_state(struct verifier_env *env)
 			verbose("(ks=%d,vs=%d)",
 				env->cur_state.regs[i].map_ptr->key_size,
 				env->cur_state.regs[i].map_ptr->value_size);
+		else if (t == PTR_TO_PACKET)
+			verbose("(off=%d,r=%d)", env->cur_state.regs[i].off,
+				env->cur_state.regs[i].range);
 	}
 	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
 		if (env->cur_state.stack_slot_type[i] == STACK_SPILL)
@@ -444,7 +486,9 @@ static struct verifier_state *push_stack(struct verifier_env *env, int insn_idx,
 	elem->next = env->head;
 	env->head = elem;
 	env->stack_size++;
-	if (env->stack_size > 1024) {
+	if (env->stack_size > env->peak_stack_size)
+		env->peak_stack_size = env->stack_size;
+	if (env->stack_size > BPF_COMPLEXITY_LIMIT_STACK) {
 		verbose("BPF program is too complex\n");
 		goto err;
 	}
@@ -468,6 +512,7 @@ static void init_reg_state(struct reg_state *regs)
 		regs[i].type = NOT_INIT;
 		regs[i].imm = 0;
 		regs[i].map_ptr = NULL;
+		regs[i].live = REG_LIVE_NONE;
 	}
 
 	/* frame pointer */
@@ -491,9 +536,48 @@ enum reg_arg_type {
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
 
-static int check_reg_arg(struct reg_state *regs, u32 regno,
+/* the current path reads the register: every checkpoint back to the one
+ * where the path last wrote it depends on its value
+ */
+static void mark_reg_read(const struct verifier_state *state, u32 regno)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		/* if read wasn't screened by an earlier write ... */
+		if (state->regs[regno].live & REG_LIVE_WRITTEN)
+			break;
+		/* ... and isn't recorded further up already ... */
+		if (parent->regs[regno].live & REG_LIVE_READ)
+			break;
+		/* ... then we depend on parent's value */
+		parent->regs[regno].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+/* same for a register spilled into the stack slot */
+static void mark_stack_slot_read(const struct verifier_state *state, int slot)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		if (state->spilled_regs[slot].live & REG_LIVE_WRITTEN)
+			break;
+		if (parent->spilled_regs[slot].live & REG_LIVE_READ)
+			break;
+		parent->spilled_regs[slot].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static int check_reg_arg(struct verifier_env *env, u32 regno,
 			 enum reg_arg_type t)
 {
+	struct reg_state *regs = env->cur_state.regs;
+
 	if (regno >= MAX_BPF_REG) {
 		verbose("R%d is invalid\n", regno);
 		return -EINVAL;
@@ -505,12 +589,14 @@ static int check_reg_arg(struct reg_state *regs, u32 regno,
 			verbose("R%d !read_ok\n", regno);
 			return -EACCES;
 		}
+		mark_reg_read(&env->cur_state, regno);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
 			verbose("frame pointer is read only\n");
 			return -EACCES;
 		}
+		regs[regno].live |= REG_LIVE_WRITTEN;
 		if (t == DST_OP)
 			mark_reg_unknown_value(regs, regno);
 	}
@@ -538,6 +624,8 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 	case PTR_TO_MAP_VALUE_OR_NULL:
 	case PTR_TO_STACK:
 	case PTR_TO_CTX:
+	case PTR_TO_PACKET:
+	case PTR_TO_PACKET_END:
 	case FRAME_PTR:
 	case CONST_PTR_TO_MAP:
 		return true;
@@ -569,6 +657,8 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 		/* save register state */
 		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
 			state->regs[value_regno];
+		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE].live |=
+			REG_LIVE_WRITTEN;
 
 		for (i = 0; i < BPF_REG_SIZE; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
@@ -603,10 +693,13 @@ static int check_stack_read(struct verifier_state *state, int off, int size,
 			}
 		}
 
-		if (value_regno >= 0)
+		if (value_regno >= 0) {
 			/* restore register state from stack */
 			state->regs[value_regno] =
 				state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE];
+			state->regs[value_regno].live |= REG_LIVE_WRITTEN;
+		}
+		mark_stack_slot_read(state, (MAX_BPF_STACK + off) / BPF_REG_SIZE);
 		return 0;
 	} else {
 		for (i = 0; i < size; i++) {
@@ -637,13 +730,44 @@ static int check_map_access(struct verifier_env *env, u32 regno, int off,
 	return 0;
 }
 
+static bool may_write_pkt_data(enum bpf_prog_type type)
+{
+	switch (type) {
+	case BPF_PROG_TYPE_XDP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* check read/write into packet data, 'off' already includes the insn offset */
+static int check_packet_access(struct verifier_env *env, u32 regno, int off,
+			       int size)
+{
+	struct reg_state *reg = &env->cur_state.regs[regno];
+
+	off += reg->off;
+	if (off < 0 || off + size > reg->range) {
+		verbose("invalid access to packet, off=%d size=%d, R%d(off=%d,r=%d)\n",
+			off, size, regno, reg->off, reg->range);
+		return -EACCES;
+	}
+	return 0;
+}
+
 /* check access to 'struct bpf_context' fields */
 static int check_ctx_access(struct verifier_env *env, int off, int size,
-			    enum bpf_access_type t)
+			    enum bpf_access_type t, enum bpf_reg_type *reg_type)
 {
 	if (env->prog->aux->ops->is_valid_access &&
-	    env->prog->aux->ops->is_valid_access(off, size, t))
+	    env->prog->aux->ops->is_valid_access(off, size, t, reg_type)) {
+		/* remember the offset of last byte accessed in ctx, tracepoint
+		 * attach checks it against the size of the event
+		 */
+		if (env->prog->aux->max_ctx_offset < off + size)
+			env->prog->aux->max_ctx_offset = off + size;
 		return 0;
+	}
 
 	verbose("invalid bpf_context access off=%d size=%d\n", off, size);
 	return -EACCES;
@@ -683,7 +807,10 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 	if (size < 0)
 		return size;
 
-	if (off % size != 0) {
+	/* packet data has no alignment guarantees, the start of the
+	 * headers is usually NET_IP_ALIGN off
+	 */
+	if (state->regs[regno].type != PTR_TO_PACKET && off % size != 0) {
 		verbose("misaligned access off %d size %d\n", off, size);
 		return -EACCES;
 	}
@@ -699,12 +826,34 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			mark_reg_unknown_value(state->regs, value_regno);
 
 	} else if (state->regs[regno].type == PTR_TO_CTX) {
+		enum bpf_reg_type reg_type = UNKNOWN_VALUE;
+
 		if (t == BPF_WRITE && value_regno >= 0 &&
 		    is_pointer_value(env, value_regno)) {
 			verbose("R%d leaks addr into ctx\n", value_regno);
 			return -EACCES;
 		}
-		err = check_ctx_access(env, off, size, t);
+		err = check_ctx_access(env, off, size, t, &reg_type);
+		if (!err && t == BPF_READ && value_regno >= 0) {
+			mark_reg_unknown_value(state->regs, value_regno);
+			/* off and range start out as zero */
+			state->regs[value_regno].type = reg_type;
+		}
+
+	} else if (state->regs[regno].type == PTR_TO_PACKET) {
+		if (t == BPF_WRITE) {
+			if (!may_write_pkt_data(env->prog->type)) {
+				verbose("cannot write into packet\n");
+				return -EACCES;
+			}
+			if (value_regno >= 0 &&
+			    is_pointer_value(env, value_regno)) {
+				verbose("R%d leaks addr into packet\n",
+					value_regno);
+				return -EACCES;
+			}
+		}
+		err = check_packet_access(env, regno, off, size);
 		if (!err && t == BPF_READ && value_regno >= 0)
 			mark_reg_unknown_value(state->regs, value_regno);
 
@@ -735,7 +884,6 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 
 static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 {
-	struct reg_state *regs = env->cur_state.regs;
 	int err;
 
 	if ((BPF_SIZE(insn->code) != BPF_W && BPF_SIZE(insn->code) != BPF_DW) ||
@@ -745,12 +893,12 @@ static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check src1 operand */
-	err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+	err = check_reg_arg(env, insn->src_reg, SRC_OP);
 	if (err)
 		return err;
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -807,10 +955,9 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 	if (arg_type == ARG_DONTCARE)
 		return 0;
 
-	if (reg->type == NOT_INIT) {
-		verbose("R%d !read_ok\n", regno);
-		return -EACCES;
-	}
+	err = check_reg_arg(env, regno, SRC_OP);
+	if (err)
+		return err;
 
 	if (arg_type == ARG_ANYTHING) {
 		if (is_pointer_value(env, regno)) {
@@ -903,6 +1050,10 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		    func_id != BPF_FUNC_perf_event_output)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_STACK_TRACE:
+		if (func_id != BPF_FUNC_get_stackid)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -918,6 +1069,10 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_PERF_EVENT_ARRAY)
 			goto error;
 		break;
+	case BPF_FUNC_get_stackid:
+		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -929,7 +1084,47 @@ error:
 	return -EINVAL;
 }
 
-static int check_call(struct verifier_env *env, int func_id)
+/* remember the prog_array and index of a bpf_tail_call() site, so the JIT
+ * can turn it into a direct jump. A site reached with another map or a
+ * non-constant index on some path is poisoned by clearing its map
+ */
+static int record_tail_call(struct verifier_env *env, struct bpf_map *map,
+			    int insn_idx)
+{
+	struct reg_state *key = &env->cur_state.regs[BPF_REG_3];
+	struct bpf_jit_poke_descriptor *poke;
+	bool const_key;
+	int i;
+
+	const_key = key->type == CONST_IMM && key->imm >= 0 &&
+		    key->imm < map->max_entries;
+
+	for (i = 0; i < env->poke_cnt; i++) {
+		poke = &env->poke_tab[i];
+		if (poke->insn_idx != insn_idx)
+			continue;
+		if (!const_key || poke->map != map || poke->key != key->imm)
+			poke->map = NULL;
+		return 0;
+	}
+
+	poke = krealloc(env->poke_tab, (env->poke_cnt + 1) * sizeof(*poke),
+			GFP_KERNEL);
+	if (!poke)
+		return -ENOMEM;
+	env->poke_tab = poke;
+
+	poke = &env->poke_tab[env->poke_cnt++];
+	memset(poke, 0, sizeof(*poke));
+	poke->insn_idx = insn_idx;
+	if (const_key) {
+		poke->map = map;
+		poke->key = key->imm;
+	}
+	return 0;
+}
+
+static int check_call(struct verifier_env *env, int func_id, int insn_idx)
 {
 	struct verifier_state *state = &env->cur_state;
 	const struct bpf_func_proto *fn = NULL;
@@ -975,11 +1170,18 @@ static int check_call(struct verifier_env *env, int func_id)
 	if (err)
 		return err;
 
+	if (func_id == BPF_FUNC_tail_call && map) {
+		err = record_tail_call(env, map, insn_idx);
+		if (err)
+			return err;
+	}
+
 	/* reset caller saved regs */
 	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* update return register */
@@ -1011,6 +1213,31 @@ static int check_call(struct verifier_env *env, int func_id)
 	return 0;
 }
 
+/* move a packet pointer forward by a known constant, either imm or the
+ * value of a CONST_IMM register. The range learned so far stays valid,
+ * since it is relative to the start of the packet.
+ */
+static int check_packet_ptr_add(struct verifier_env *env,
+				struct bpf_insn *insn)
+{
+	struct reg_state *regs = env->cur_state.regs;
+	struct reg_state *dst_reg = &regs[insn->dst_reg];
+	int imm;
+
+	if (BPF_SRC(insn->code) == BPF_K)
+		imm = insn->imm;
+	else
+		imm = regs[insn->src_reg].imm;
+
+	if (imm < 0 || dst_reg->off + imm > MAX_PACKET_OFF) {
+		verbose("cannot add integer value %d to packet pointer R%d(off=%d)\n",
+			imm, insn->dst_reg, dst_reg->off);
+		return -EACCES;
+	}
+	dst_reg->off += imm;
+	return 0;
+}
+
 /* check validity of 32-bit and 64-bit arithmetic operations */
 static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 {
@@ -1035,7 +1262,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1046,7 +1273,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1059,7 +1286,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 			}
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1070,7 +1297,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1080,6 +1307,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				 * copy register state to dest reg
 				 */
 				regs[insn->dst_reg] = regs[insn->src_reg];
+				regs[insn->dst_reg].live |= REG_LIVE_WRITTEN;
 			} else {
 				if (is_pointer_value(env, insn->src_reg)) {
 					verbose("R%d partial copy of pointer\n",
@@ -1111,7 +1339,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				return -EINVAL;
 			}
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1122,7 +1350,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src2 operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1147,6 +1375,12 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		    regs[insn->dst_reg].type == FRAME_PTR &&
 		    BPF_SRC(insn->code) == BPF_K) {
 			stack_relative = true;
+		} else if (opcode == BPF_ADD &&
+			   BPF_CLASS(insn->code) == BPF_ALU64 &&
+			   regs[insn->dst_reg].type == PTR_TO_PACKET &&
+			   (BPF_SRC(insn->code) == BPF_K ||
+			    regs[insn->src_reg].type == CONST_IMM)) {
+			return check_packet_ptr_add(env, insn);
 		} else if (is_pointer_value(env, insn->dst_reg)) {
 			verbose("R%d pointer arithmetic prohibited\n",
 				insn->dst_reg);
@@ -1159,7 +1393,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1172,6 +1406,47 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 	return 0;
 }
 
+/* the program checked that 'reg->off' bytes from the packet start are
+ * within the packet: every packet pointer in 'state', including the ones
+ * spilled on the stack, can access that many bytes
+ */
+static void find_good_pkt_pointers(struct verifier_state *state,
+				   const struct reg_state *reg)
+{
+	struct reg_state *r;
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++) {
+		r = &state->regs[i];
+		if (r->type == PTR_TO_PACKET && r->range < reg->off)
+			r->range = reg->off;
+	}
+
+	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
+		if (state->stack_slot_type[i] != STACK_SPILL)
+			continue;
+		r = &state->spilled_regs[i / BPF_REG_SIZE];
+		if (r->type == PTR_TO_PACKET && r->range < reg->off)
+			r->range = reg->off;
+	}
+}
+
+/* 'if (pkt > pkt_end) goto' or 'if (pkt_end >= pkt) goto' */
+static bool is_pkt_end_cmp(struct reg_state *regs, struct bpf_insn *insn)
+{
+	u8 opcode = BPF_OP(insn->code);
+
+	if (BPF_SRC(insn->code) != BPF_X)
+		return false;
+	if (opcode == BPF_JGT)
+		return regs[insn->dst_reg].type == PTR_TO_PACKET &&
+		       regs[insn->src_reg].type == PTR_TO_PACKET_END;
+	if (opcode == BPF_JGE)
+		return regs[insn->dst_reg].type == PTR_TO_PACKET_END &&
+		       regs[insn->src_reg].type == PTR_TO_PACKET;
+	return false;
+}
+
 static int check_cond_jmp_op(struct verifier_env *env,
 			     struct bpf_insn *insn, int *insn_idx)
 {
@@ -1192,11 +1467,12 @@ static int check_cond_jmp_op(struct verifier_env *env,
 		}
 
 		/* check src1 operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 
-		if (is_pointer_value(env, insn->src_reg)) {
+		if (is_pointer_value(env, insn->src_reg) &&
+		    !is_pkt_end_cmp(regs, insn)) {
 			verbose("R%d pointer comparison prohibited\n",
 				insn->src_reg);
 			return -EACCES;
@@ -1209,7 +1485,7 @@ static int check_cond_jmp_op(struct verifier_env *env,
 	}
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -1255,6 +1531,15 @@ static int check_cond_jmp_op(struct verifier_env *env,
 			regs[insn->dst_reg].type = CONST_IMM;
 			regs[insn->dst_reg].imm = 0;
 		}
+	} else if (is_pkt_end_cmp(regs, insn)) {
+		if (opcode == BPF_JGT)
+			/* pkt + off <= pkt_end in the fall-through branch */
+			find_good_pkt_pointers(&env->cur_state,
+					       &regs[insn->dst_reg]);
+		else
+			/* and in the branch target for pkt_end >= pkt + off */
+			find_good_pkt_pointers(other_branch,
+					       &regs[insn->src_reg]);
 	} else if (is_pointer_value(env, insn->dst_reg)) {
 		verbose("R%d pointer comparison prohibited\n", insn->dst_reg);
 		return -EACCES;
@@ -1303,7 +1588,7 @@ static int check_ld_imm(struct verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
-	err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+	err = check_reg_arg(env, insn->dst_reg, DST_OP);
 	if (err)
 		return err;
 
@@ -1366,7 +1651,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check whether implicit source operand (register R6) is readable */
-	err = check_reg_arg(regs, BPF_REG_6, SRC_OP);
+	err = check_reg_arg(env, BPF_REG_6, SRC_OP);
 	if (err)
 		return err;
 
@@ -1377,7 +1662,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 
 	if (mode == BPF_IND) {
 		/* check explicit source operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 	}
@@ -1387,6 +1672,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* mark destination R0 register as readable, since it contains
@@ -1525,6 +1811,11 @@ peek_stack:
 				goto peek_stack;
 			else if (ret < 0)
 				goto err_free;
+			/* helpers clobber R1-R5, so states tend to
+			 * converge right after a call
+			 */
+			if (t + 1 < insn_cnt)
+				env->explored_states[t + 1] = STATE_LIST_MARK;
 		} else if (opcode == BPF_JA) {
 			if (BPF_SRC(insns[t].code) != BPF_K) {
 				ret = -EINVAL;
@@ -1543,7 +1834,10 @@ peek_stack:
 			if (t + 1 < insn_cnt)
 				env->explored_states[t + 1] = STATE_LIST_MARK;
 		} else {
-			/* conditional jump with two edges */
+			/* conditional jump with two edges, check the state
+			 * before it splits, once for both of them
+			 */
+			env->explored_states[t] = STATE_LIST_MARK;
 			ret = push_insn(t, t + 1, FALLTHROUGH, env);
 			if (ret == 1)
 				goto peek_stack;
@@ -1617,17 +1911,42 @@ err_free:
  * Similarly with registers. If explored state has register type as invalid
  * whereas register type in current state is meaningful, it means that
  * the current state will reach 'bpf_exit' instruction safely
+ *
+ * Registers and spilled registers that the explored continuation never
+ * read before overwriting them (no REG_LIVE_READ mark) can hold anything
+ * in the current state. Since the program has no loops and the verifier
+ * explores paths depth-first, all continuations of an explored state are
+ * done, and its read marks complete, by the time another path reaches it.
  */
+static bool reg_state_equal(const struct reg_state *rold,
+			    const struct reg_state *rcur)
+{
+	return memcmp(rold, rcur, offsetof(struct reg_state, live)) == 0;
+}
+
 static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 {
 	int i;
 
 	for (i = 0; i < MAX_BPF_REG; i++) {
-		if (memcmp(&old->regs[i], &cur->regs[i],
-			   sizeof(old->regs[0])) != 0) {
-			if (old->regs[i].type == NOT_INIT ||
-			    (old->regs[i].type == UNKNOWN_VALUE &&
-			     cur->regs[i].type != NOT_INIT))
+		struct reg_state *rold = &old->regs[i];
+		struct reg_state *rcur = &cur->regs[i];
+
+		if (!(rold->live & REG_LIVE_READ))
+			continue;
+
+		if (!reg_state_equal(rold, rcur)) {
+			if (rold->type == NOT_INIT ||
+			    (rold->type == UNKNOWN_VALUE &&
+			     rcur->type != NOT_INIT))
+				continue;
+			/* a packet pointer that may access more than the
+			 * one old state was verified with is safe as well
+			 */
+			if (rold->type == PTR_TO_PACKET &&
+			    rcur->type == PTR_TO_PACKET &&
+			    rold->off == rcur->off &&
+			    rold->range <= rcur->range)
 				continue;
 			return false;
 		}
@@ -1645,9 +1964,11 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 			return false;
 		if (i % BPF_REG_SIZE)
 			continue;
-		if (memcmp(&old->spilled_regs[i / BPF_REG_SIZE],
-			   &cur->spilled_regs[i / BPF_REG_SIZE],
-			   sizeof(old->spilled_regs[0])))
+		if (old->stack_slot_type[i] != STACK_SPILL ||
+		    !(old->spilled_regs[i / BPF_REG_SIZE].live & REG_LIVE_READ))
+			continue;
+		if (!reg_state_equal(&old->spilled_regs[i / BPF_REG_SIZE],
+				     &cur->spilled_regs[i / BPF_REG_SIZE]))
 			/* when explored and current stack slot types are
 			 * the same, check that stored pointers types
 			 * are the same as well.
@@ -1665,10 +1986,29 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 	return true;
 }
 
+/* the current path is pruned since @old was proven safe from here on: what
+ * the continuation of @old reads, the current path would read as well
+ */
+static void propagate_liveness(const struct verifier_state *old,
+			       const struct verifier_state *cur)
+{
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if (old->regs[i].live & REG_LIVE_READ)
+			mark_reg_read(cur, i);
+
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		if (old->stack_slot_type[i * BPF_REG_SIZE] == STACK_SPILL &&
+		    (old->spilled_regs[i].live & REG_LIVE_READ))
+			mark_stack_slot_read(cur, i);
+}
+
 static int is_state_visited(struct verifier_env *env, int insn_idx)
 {
 	struct verifier_state_list *new_sl;
 	struct verifier_state_list *sl;
+	int i;
 
 	sl = env->explored_states[insn_idx];
 	if (!sl)
@@ -1678,11 +2018,14 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 		return 0;
 
 	while (sl != STATE_LIST_MARK) {
-		if (states_equal(&sl->state, &env->cur_state))
+		if (states_equal(&sl->state, &env->cur_state)) {
 			/* reached equivalent register/stack state,
 			 * prune the search
 			 */
+			propagate_liveness(&sl->state, &env->cur_state);
+			env->states_pruned++;
 			return 1;
+		}
 		sl = sl->next;
 	}
 
@@ -1700,6 +2043,14 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+	env->states_stored++;
+
+	/* the new state collects the read marks of the path from here on */
+	env->cur_state.parent = &new_sl->state;
+	for (i = 0; i < MAX_BPF_REG; i++)
+		env->cur_state.regs[i].live = REG_LIVE_NONE;
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		env->cur_state.spilled_regs[i].live = REG_LIVE_NONE;
 	return 0;
 }
 
@@ -1710,7 +2061,6 @@ static int do_check(struct verifier_env *env)
 	struct reg_state *regs = state->regs;
 	int insn_cnt = env->prog->len;
 	int insn_idx, prev_insn_idx = 0;
-	int insn_processed = 0;
 	bool do_print_state = false;
 
 	init_reg_state(regs);
@@ -1729,9 +2079,9 @@ static int do_check(struct verifier_env *env)
 		insn = &insns[insn_idx];
 		class = BPF_CLASS(insn->code);
 
-		if (++insn_processed > 32768) {
+		if (++env->insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
 			verbose("BPF program is too large. Proccessed %d insn\n",
-				insn_processed);
+				env->insn_processed);
 			return -E2BIG;
 		}
 
@@ -1772,11 +2122,11 @@ static int do_check(struct verifier_env *env)
 			/* check for reserved fields is already done */
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 
-			err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+			err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 			if (err)
 				return err;
 
@@ -1791,14 +2141,9 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
-			if (BPF_SIZE(insn->code) != BPF_W) {
-				insn_idx++;
-				continue;
-			}
-
 			if (insn->imm == 0) {
 				/* saw a valid insn
-				 * dst_reg = *(u32 *)(src_reg + off)
+				 * dst_reg = *(size *)(src_reg + off)
 				 * use reserved 'imm' field to mark this insn
 				 */
 				insn->imm = src_reg_type;
@@ -1829,11 +2174,11 @@ static int do_check(struct verifier_env *env)
 			}
 
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 			/* check src2 operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -1862,7 +2207,7 @@ static int do_check(struct verifier_env *env)
 				return -EINVAL;
 			}
 			/* check src operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -1885,7 +2230,7 @@ static int do_check(struct verifier_env *env)
 					return -EINVAL;
 				}
 
-				err = check_call(env, insn->imm);
+				err = check_call(env, insn->imm, insn_idx);
 				if (err)
 					return err;
 
@@ -1916,7 +2261,7 @@ static int do_check(struct verifier_env *env)
 				 * of bpf_exit, which means that program wrote
 				 * something into it earlier
 				 */
-				err = check_reg_arg(regs, BPF_REG_0, SRC_OP);
+				err = check_reg_arg(env, BPF_REG_0, SRC_OP);
 				if (err)
 					return err;
 
@@ -2101,8 +2446,46 @@ static void adjust_branches(struct bpf_prog *prog, int pos, int delta)
 	}
 }
 
-/* convert load instructions that access fields of 'struct __sk_buff'
- * into sequence of instructions that access fields of 'struct sk_buff'
+/* keep the tail call sites in step with insns inserted at 'pos' */
+static void adjust_poke_tab(struct verifier_env *env, int pos, int delta)
+{
+	int i;
+
+	for (i = 0; i < env->poke_cnt; i++)
+		if (env->poke_tab[i].insn_idx > pos)
+			env->poke_tab[i].insn_idx += delta;
+}
+
+/* hand the tail call sites with a constant map and index to the JIT */
+static int copy_poke_tab(struct verifier_env *env)
+{
+	struct bpf_prog_aux *aux = env->prog->aux;
+	struct bpf_jit_poke_descriptor *poke;
+	u32 i, cnt = 0;
+
+	for (i = 0; i < env->poke_cnt; i++)
+		if (env->poke_tab[i].map)
+			cnt++;
+	if (!cnt)
+		return 0;
+
+	aux->poke_tab = kcalloc(cnt, sizeof(*poke), GFP_KERNEL);
+	if (!aux->poke_tab)
+		return -ENOMEM;
+
+	for (i = 0; i < env->poke_cnt; i++) {
+		if (!env->poke_tab[i].map)
+			continue;
+		poke = &aux->poke_tab[aux->size_poke_tab++];
+		*poke = env->poke_tab[i];
+		INIT_LIST_HEAD(&poke->list);
+	}
+	return 0;
+}
+
+/* convert load instructions that access fields of the program context,
+ * e.g. 'struct __sk_buff', into sequence of instructions that access
+ * fields of the kernel structure behind it, e.g. 'struct sk_buff'
  */
 static int convert_ctx_accesses(struct verifier_env *env)
 {
@@ -2118,9 +2501,15 @@ static int convert_ctx_accesses(struct verifier_env *env)
 		return 0;
 
 	for (i = 0; i < insn_cnt; i++, insn++) {
-		if (insn->code == (BPF_LDX | BPF_MEM | BPF_W))
+		if (insn->code == (BPF_LDX | BPF_MEM | BPF_B) ||
+		    insn->code == (BPF_LDX | BPF_MEM | BPF_H) ||
+		    insn->code == (BPF_LDX | BPF_MEM | BPF_W) ||
+		    insn->code == (BPF_LDX | BPF_MEM | BPF_DW))
 			type = BPF_READ;
-		else if (insn->code == (BPF_STX | BPF_MEM | BPF_W))
+		else if (insn->code == (BPF_STX | BPF_MEM | BPF_B) ||
+			 insn->code == (BPF_STX | BPF_MEM | BPF_H) ||
+			 insn->code == (BPF_STX | BPF_MEM | BPF_W) ||
+			 insn->code == (BPF_STX | BPF_MEM | BPF_DW))
 			type = BPF_WRITE;
 		else
 			continue;
@@ -2162,6 +2551,7 @@ static int convert_ctx_accesses(struct verifier_env *env)
 
 		/* adjust branches in the whole program */
 		adjust_branches(new_prog, i, cnt - 1);
+		adjust_poke_tab(env, i, cnt - 1);
 
 		/* keep walking new program and skip insns we just inserted */
 		env->prog = new_prog;
@@ -2256,6 +2646,11 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
 
 	ret = do_check(env);
+	if (log_level)
+		verbose("processed %u insns (limit %d), stored %u states, pruned %u, peak %u pending branches\n",
+			env->insn_processed, BPF_COMPLEXITY_LIMIT_INSNS,
+			env->states_stored, env->states_pruned,
+			env->peak_stack_size);
 
 skip_full_check:
 	while (pop_stack(env, NULL) >= 0);
@@ -2297,6 +2692,11 @@ skip_full_check:
 		 * bpf_ld_imm64 instructions
 		 */
 		convert_pseudo_ld_imm64(env);
+
+		/* the maps of tail call sites are among used_maps, so
+		 * the program keeps them alive
+		 */
+		ret = copy_poke_tab(env);
 	}
 
 free_log_buf:
@@ -2309,6 +2709,7 @@ free_env:
 		 */
 		release_maps(env);
 	*prog = env->prog;
+	kfree(env->poke_tab);
 	kfree(env);
 	mutex_unlock(&bpf_verifier_lock);
 	return ret;
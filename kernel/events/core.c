@@ -463,14 +463,106 @@ perf_cgroup_set_timestamp(struct task_struct *task,
 	info->timestamp = ctx->timestamp;
 }
 
+static inline struct perf_cgroup *perf_cgroup_parent(struct perf_cgroup *cgrp)
+{
+	struct cgroup_subsys_state *css = cgrp->css.parent;
+
+	return css ? container_of(css, struct perf_cgroup, css) : NULL;
+}
+
+/*
+ * Cgroup group leaders are also kept in ctx->cgrp_groups, sorted by
+ * cgroup, so that a cgroup switch only has to visit the groups of the
+ * cgroups going out and coming in rather than every group in the
+ * context.  Groups of the same cgroup stay in insertion order.
+ */
+static void perf_cgroup_tree_add(struct perf_event *event,
+				 struct perf_event_context *ctx)
+{
+	struct rb_node **node = &ctx->cgrp_groups.rb_node;
+	struct rb_node *parent = NULL;
+	struct perf_event *pos;
+
+	while (*node) {
+		parent = *node;
+		pos = rb_entry(parent, struct perf_event, cgrp_node);
+		if ((unsigned long)event->cgrp < (unsigned long)pos->cgrp)
+			node = &parent->rb_left;
+		else
+			node = &parent->rb_right;
+	}
+
+	rb_link_node(&event->cgrp_node, parent, node);
+	rb_insert_color(&event->cgrp_node, &ctx->cgrp_groups);
+}
+
+static void perf_cgroup_tree_del(struct perf_event *event,
+				 struct perf_event_context *ctx)
+{
+	if (RB_EMPTY_NODE(&event->cgrp_node))
+		return;
+
+	rb_erase(&event->cgrp_node, &ctx->cgrp_groups);
+	RB_CLEAR_NODE(&event->cgrp_node);
+}
+
+static struct perf_event *
+perf_cgroup_tree_first(struct perf_event_context *ctx, struct perf_cgroup *cgrp)
+{
+	struct rb_node *node = ctx->cgrp_groups.rb_node;
+	struct perf_event *pos, *match = NULL;
+
+	while (node) {
+		pos = rb_entry(node, struct perf_event, cgrp_node);
+		if ((unsigned long)cgrp < (unsigned long)pos->cgrp) {
+			node = node->rb_left;
+		} else if ((unsigned long)cgrp > (unsigned long)pos->cgrp) {
+			node = node->rb_right;
+		} else {
+			match = pos;
+			node = node->rb_left;
+		}
+	}
+
+	return match;
+}
+
+static struct perf_event *perf_cgroup_tree_next(struct perf_event *event)
+{
+	struct rb_node *next = rb_next(&event->cgrp_node);
+	struct perf_event *pos;
+
+	if (!next)
+		return NULL;
+
+	pos = rb_entry(next, struct perf_event, cgrp_node);
+	return pos->cgrp == event->cgrp ? pos : NULL;
+}
+
+/*
+ * Iterate the groups of @cgrp and of all its ancestors, which are the
+ * groups perf_cgroup_match() accepts while @cgrp is the cpuctx cgroup.
+ */
+#define for_each_cgroup_group(event, cgrp, pos, ctx)			\
+	for (pos = (cgrp); pos; pos = perf_cgroup_parent(pos))		\
+		for (event = perf_cgroup_tree_first(ctx, pos); event;	\
+		     event = perf_cgroup_tree_next(event))
+
+static void perf_cgroup_sched_out_groups(struct perf_cpu_context *cpuctx);
+static bool perf_cgroup_sched_in_groups(struct perf_cpu_context *cpuctx,
+					struct task_struct *task);
+
 #define PERF_CGROUP_SWOUT	0x1 /* cgroup switch out every event */
 #define PERF_CGROUP_SWIN	0x2 /* cgroup switch in events based on task */
 
 /*
  * reschedule events based on the cgroup constraint of task.
  *
- * mode SWOUT : schedule out everything
+ * mode SWOUT : schedule out the events of the current cgroup
  * mode SWIN : schedule in based on cgroup for next
+ *
+ * Events that are not cgroup constrained stay scheduled, only the
+ * groups of the two cgroups involved are looked at.
  */
 static void perf_cgroup_switch(struct task_struct *task, int mode)
 {
@@ -507,7 +599,7 @@ static void perf_cgroup_switch(struct task_struct *task, int mode)
 			perf_pmu_disable(cpuctx->ctx.pmu);
 
 			if (mode & PERF_CGROUP_SWOUT) {
-				cpu_ctx_sched_out(cpuctx, EVENT_ALL);
+				perf_cgroup_sched_out_groups(cpuctx);
 				/*
 				 * must not be done before ctxswout due
 				 * to event_filter_match() in event_sched_out()
@@ -525,7 +617,15 @@ static void perf_cgroup_switch(struct task_struct *task, int mode)
 				 * because cgorup events are only per-cpu
 				 */
 				cpuctx->cgrp = perf_cgroup_from_task(task, &cpuctx->ctx);
-				cpu_ctx_sched_in(cpuctx, EVENT_ALL, task);
+				/*
+				 * A pinned group that did not fit behind the
+				 * flexible groups left on gets its usual
+				 * priority back from a full reschedule.
+				 */
+				if (!perf_cgroup_sched_in_groups(cpuctx, task)) {
+					cpu_ctx_sched_out(cpuctx, EVENT_ALL);
+					cpu_ctx_sched_in(cpuctx, EVENT_ALL, task);
+				}
 			}
 			perf_pmu_enable(cpuctx->ctx.pmu);
 			perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
@@ -616,6 +716,7 @@ static inline int perf_cgroup_connect(int fd, struct perf_event *event,
 
 	cgrp = container_of(css, struct perf_cgroup, css);
 	event->cgrp = cgrp;
+	RB_CLEAR_NODE(&event->cgrp_node);
 
 	/*
 	 * all events in a group must monitor
@@ -701,6 +802,16 @@ static inline void update_cgrp_time_from_cpuctx(struct perf_cpu_context *cpuctx)
 {
 }
 
+static inline void perf_cgroup_tree_add(struct perf_event *event,
+					struct perf_event_context *ctx)
+{
+}
+
+static inline void perf_cgroup_tree_del(struct perf_event *event,
+					struct perf_event_context *ctx)
+{
+}
+
 static inline void perf_cgroup_sched_out(struct task_struct *task,
 					 struct task_struct *next)
 {
@@ -1232,6 +1343,9 @@ list_add_event(struct perf_event *event, struct perf_event_context *ctx)
 
 		list = ctx_group_list(event, ctx);
 		list_add_tail(&event->group_entry, list);
+
+		if (is_cgroup_event(event))
+			perf_cgroup_tree_add(event, ctx);
 	}
 
 	if (is_cgroup_event(event))
@@ -1417,6 +1531,7 @@ list_del_event(struct perf_event *event, struct perf_event_context *ctx)
 	event->attach_state &= ~PERF_ATTACH_CONTEXT;
 
 	if (is_cgroup_event(event)) {
+		perf_cgroup_tree_del(event, ctx);
 		ctx->nr_cgroups--;
 		cpuctx = __get_cpu_context(ctx);
 		/*
@@ -1483,8 +1598,11 @@ static void perf_group_detach(struct perf_event *event)
 	 * to whatever list we are on.
 	 */
 	list_for_each_entry_safe(sibling, tmp, &event->sibling_list, group_entry) {
-		if (list)
+		if (list) {
 			list_move_tail(&sibling->group_entry, list);
+			if (is_cgroup_event(sibling))
+				perf_cgroup_tree_add(sibling, event->ctx);
+		}
 		sibling->group_leader = sibling;
 
 		/* Inherit group flags from the previous leader */
@@ -2778,6 +2896,79 @@ ctx_flexible_sched_in(struct perf_event_context *ctx,
 	}
 }
 
+#ifdef CONFIG_CGROUP_PERF
+/*
+ * Schedule out the groups of cpuctx->cgrp and its ancestors, leaving
+ * the rest of the cpu context running.
+ */
+static void perf_cgroup_sched_out_groups(struct perf_cpu_context *cpuctx)
+{
+	struct perf_event_context *ctx = &cpuctx->ctx;
+	struct perf_cgroup *pos;
+	struct perf_event *event;
+
+	update_context_time(ctx);
+	update_cgrp_time_from_cpuctx(cpuctx);
+
+	for_each_cgroup_group(event, cpuctx->cgrp, pos, ctx)
+		group_sched_out(event, cpuctx, ctx);
+}
+
+/*
+ * Schedule in the groups of the new cpuctx->cgrp and its ancestors,
+ * pinned ones first.  Returns false if a pinned group could not go on,
+ * in which case the caller reschedules the whole context.
+ */
+static bool perf_cgroup_sched_in_groups(struct perf_cpu_context *cpuctx,
+					struct task_struct *task)
+{
+	struct perf_event_context *ctx = &cpuctx->ctx;
+	struct perf_cgroup *pos;
+	struct perf_event *event;
+	int can_add_hw = 1;
+
+	update_context_time(ctx);
+	perf_cgroup_set_timestamp(task, ctx);
+
+	if (ctx->is_active & EVENT_PINNED) {
+		for_each_cgroup_group(event, cpuctx->cgrp, pos, ctx) {
+			if (!event->attr.pinned ||
+			    event->state <= PERF_EVENT_STATE_OFF)
+				continue;
+			if (!event_filter_match(event))
+				continue;
+
+			perf_cgroup_mark_enabled(event, ctx);
+
+			if (group_can_go_on(event, cpuctx, 1))
+				group_sched_in(event, cpuctx, ctx);
+
+			if (event->state == PERF_EVENT_STATE_INACTIVE)
+				return false;
+		}
+	}
+
+	if (ctx->is_active & EVENT_FLEXIBLE) {
+		for_each_cgroup_group(event, cpuctx->cgrp, pos, ctx) {
+			if (event->attr.pinned ||
+			    event->state <= PERF_EVENT_STATE_OFF)
+				continue;
+			if (!event_filter_match(event))
+				continue;
+
+			perf_cgroup_mark_enabled(event, ctx);
+
+			if (group_can_go_on(event, cpuctx, can_add_hw)) {
+				if (group_sched_in(event, cpuctx, ctx))
+					can_add_hw = 0;
+			}
+		}
+	}
+
+	return true;
+}
+#endif
+
 static void
 ctx_sched_in(struct perf_event_context *ctx,
 	     struct perf_cpu_context *cpuctx,
@@ -3392,6 +3583,7 @@ static void __perf_event_init_context(struct perf_event_context *ctx)
 	INIT_LIST_HEAD(&ctx->pinned_groups);
 	INIT_LIST_HEAD(&ctx->flexible_groups);
 	INIT_LIST_HEAD(&ctx->event_list);
+	ctx->cgrp_groups = RB_ROOT;
 	atomic_set(&ctx->refcount, 1);
 	INIT_DELAYED_WORK(&ctx->orphans_remove, orphans_remove_work);
 }
@@ -6913,6 +7105,89 @@ static struct pmu perf_swevent = {
 	.read		= perf_swevent_read,
 };
 
+#ifdef CONFIG_BPF_SYSCALL
+/*
+ * Sampling events with a BPF_PROG_TYPE_PERF_EVENT program run it on
+ * every overflow; the sample is only emitted if the program returns
+ * non-zero.
+ */
+static void bpf_overflow_handler(struct perf_event *event,
+				 struct perf_sample_data *data,
+				 struct pt_regs *regs)
+{
+	struct bpf_perf_event_data_kern ctx = {
+		.data = data,
+		.regs = regs,
+	};
+	int ret = 0;
+
+	preempt_disable();
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		goto out;
+	rcu_read_lock();
+	ret = BPF_PROG_RUN(event->prog, (void *)&ctx);
+	rcu_read_unlock();
+out:
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+	if (!ret)
+		return;
+
+	if (event->orig_overflow_handler)
+		event->orig_overflow_handler(event, data, regs);
+	else
+		perf_event_output(event, data, regs);
+}
+
+static int perf_event_set_bpf_handler(struct perf_event *event, u32 prog_fd)
+{
+	struct bpf_prog *prog;
+
+	if (event->overflow_handler)
+		/* in-kernel counter or hw breakpoint */
+		return -EINVAL;
+
+	if (event->prog)
+		return -EEXIST;
+
+	prog = bpf_prog_get(prog_fd);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	if (prog->type != BPF_PROG_TYPE_PERF_EVENT) {
+		/* valid fd, but invalid bpf program type */
+		bpf_prog_put(prog);
+		return -EINVAL;
+	}
+
+	event->prog = prog;
+	event->orig_overflow_handler = READ_ONCE(event->overflow_handler);
+	WRITE_ONCE(event->overflow_handler, bpf_overflow_handler);
+	return 0;
+}
+
+static void perf_event_free_bpf_handler(struct perf_event *event)
+{
+	struct bpf_prog *prog = event->prog;
+
+	if (!prog)
+		return;
+
+	WRITE_ONCE(event->overflow_handler, event->orig_overflow_handler);
+	event->prog = NULL;
+	bpf_prog_put_rcu(prog);
+}
+#else
+static int perf_event_set_bpf_handler(struct perf_event *event, u32 prog_fd)
+{
+	return -EOPNOTSUPP;
+}
+
+static void perf_event_free_bpf_handler(struct perf_event *event)
+{
+}
+#endif
+
 #ifdef CONFIG_EVENT_TRACING
 
 static int perf_tp_filter_match(struct perf_event *event,
@@ -7064,28 +7339,45 @@ static void perf_event_free_filter(struct perf_event *event)
 
 static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
 {
+	bool is_kprobe, is_tracepoint;
 	struct bpf_prog *prog;
 
+	if (event->attr.type == PERF_TYPE_HARDWARE ||
+	    event->attr.type == PERF_TYPE_SOFTWARE)
+		return perf_event_set_bpf_handler(event, prog_fd);
+
 	if (event->attr.type != PERF_TYPE_TRACEPOINT)
 		return -EINVAL;
 
 	if (event->tp_event->prog)
 		return -EEXIST;
 
-	if (!(event->tp_event->flags & TRACE_EVENT_FL_UKPROBE))
-		/* bpf programs can only be attached to u/kprobes */
+	is_kprobe = event->tp_event->flags & TRACE_EVENT_FL_UKPROBE;
+	is_tracepoint = event->tp_event->flags & TRACE_EVENT_FL_TRACEPOINT;
+	if (!is_kprobe && !is_tracepoint)
+		/* bpf programs can only be attached to u/kprobe or tracepoint */
 		return -EINVAL;
 
 	prog = bpf_prog_get(prog_fd);
 	if (IS_ERR(prog))
 		return PTR_ERR(prog);
 
-	if (prog->type != BPF_PROG_TYPE_KPROBE) {
+	if ((is_kprobe && prog->type != BPF_PROG_TYPE_KPROBE) ||
+	    (is_tracepoint && prog->type != BPF_PROG_TYPE_TRACEPOINT)) {
 		/* valid fd, but invalid bpf program type */
 		bpf_prog_put(prog);
 		return -EINVAL;
 	}
 
+	if (is_tracepoint) {
+		int off = trace_event_get_offsets(event->tp_event);
+
+		if (prog->aux->max_ctx_offset > off) {
+			/* the program reads past the end of this event */
+			bpf_prog_put(prog);
+			return -EACCES;
+		}
+	}
 	event->tp_event->prog = prog;
 
 	return 0;
@@ -7095,6 +7387,8 @@ static void perf_event_free_bpf_prog(struct perf_event *event)
 {
 	struct bpf_prog *prog;
 
+	perf_event_free_bpf_handler(event);
+
 	if (!event->tp_event)
 		return;
 
@@ -7122,11 +7416,16 @@ static void perf_event_free_filter(struct perf_event *event)
 
 static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
 {
+	if (event->attr.type == PERF_TYPE_HARDWARE ||
+	    event->attr.type == PERF_TYPE_SOFTWARE)
+		return perf_event_set_bpf_handler(event, prog_fd);
+
 	return -ENOENT;
 }
 
 static void perf_event_free_bpf_prog(struct perf_event *event)
 {
+	perf_event_free_bpf_handler(event);
 }
 #endif /* CONFIG_EVENT_TRACING */
 
@@ -7918,6 +8217,19 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 	if (!overflow_handler && parent_event) {
 		overflow_handler = parent_event->overflow_handler;
 		context = parent_event->overflow_handler_context;
+#ifdef CONFIG_BPF_SYSCALL
+		if (overflow_handler == bpf_overflow_handler) {
+			struct bpf_prog *prog = bpf_prog_inc(parent_event->prog);
+
+			if (IS_ERR(prog)) {
+				err = PTR_ERR(prog);
+				goto err_ns;
+			}
+			event->prog = prog;
+			event->orig_overflow_handler =
+				parent_event->orig_overflow_handler;
+		}
+#endif
 	}
 
 	event->overflow_handler	= overflow_handler;
@@ -7983,6 +8295,10 @@ err_pmu:
 		event->destroy(event);
 	module_put(pmu->module);
 err_ns:
+#ifdef CONFIG_BPF_SYSCALL
+	if (event->prog)
+		bpf_prog_put(event->prog);
+#endif
 	if (is_cgroup_event(event))
 		perf_detach_cgroup(event);
 	if (event->ns)
@@ -0,0 +1,245 @@
+/*
+ * Automatic affinity spreading for multiqueue device interrupts, and
+ * cpu hotplug handling of the resulting "managed" interrupts.
+ *
+ * A managed interrupt gets its affinity from the kernel when it is
+ * allocated and keeps it for its lifetime: userspace cannot change it,
+ * and instead of being forced onto some other cpu when the last cpu in
+ * its mask goes offline it is shut down, to be restarted when one of
+ * its cpus comes back.
+ */
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/irq.h>
+
+#include "internals.h"
+
+static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
+				int cpus_per_vec)
+{
+	const struct cpumask *siblmsk;
+	int cpu, sibl;
+
+	for ( ; cpus_per_vec > 0; ) {
+		cpu = cpumask_first(nmsk);
+
+		/* nmsk ran out of cpus before cpus_per_vec did */
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus_per_vec--;
+
+		/* If the cpu has siblings, use them first */
+		siblmsk = topology_sibling_cpumask(cpu);
+		for (sibl = -1; cpus_per_vec > 0; ) {
+			sibl = cpumask_next(sibl, siblmsk);
+			if (sibl >= nr_cpu_ids)
+				break;
+			if (!cpumask_test_and_clear_cpu(sibl, nmsk))
+				continue;
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus_per_vec--;
+		}
+	}
+}
+
+static int get_nodes_in_cpumask(const struct cpumask *mask, nodemask_t *nodemsk)
+{
+	int n, nodes = 0;
+
+	/* Calculate the number of nodes in the supplied affinity mask */
+	for_each_node(n) {
+		if (cpumask_intersects(mask, cpumask_of_node(n))) {
+			node_set(n, *nodemsk);
+			nodes++;
+		}
+	}
+	return nodes;
+}
+
+/**
+ * irq_create_affinity_masks - Create affinity masks for multiqueue spreading
+ * @nvecs:	The total number of vectors
+ * @affd:	Description of the affinity requirements
+ *
+ * The vectors between @affd->pre_vectors and @nvecs - @affd->post_vectors
+ * are spread over all possible cpus, node by node, so that each vector
+ * serves cpus of a single node and hyperthread siblings share a vector.
+ * The remaining vectors get the default affinity.
+ *
+ * Returns the masks pointer, or NULL if allocation failed or there are
+ * no vectors to spread.  The caller must kfree() it.
+ */
+struct cpumask *
+irq_create_affinity_masks(int nvecs, const struct irq_affinity *affd)
+{
+	int n, nodes, cpus_per_vec, extra_vecs, curvec;
+	int affv = nvecs - affd->pre_vectors - affd->post_vectors;
+	int last_affv = affv + affd->pre_vectors;
+	nodemask_t nodemsk = NODE_MASK_NONE;
+	struct cpumask *masks;
+	cpumask_var_t nmsk;
+
+	/* Nothing left to spread once the pre/post vectors are set aside */
+	if (affv <= 0)
+		return NULL;
+
+	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
+		return NULL;
+
+	masks = kcalloc(nvecs, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		goto out;
+
+	/* Fill out vectors at the beginning that don't need affinity */
+	for (curvec = 0; curvec < affd->pre_vectors; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+
+	nodes = get_nodes_in_cpumask(cpu_possible_mask, &nodemsk);
+
+	/*
+	 * If the number of nodes in the mask is greater than or equal the
+	 * number of vectors we just spread the vectors across the nodes.
+	 */
+	if (affv <= nodes) {
+		for_each_node_mask(n, nodemsk) {
+			cpumask_and(masks + curvec, cpu_possible_mask,
+				    cpumask_of_node(n));
+			if (++curvec == last_affv)
+				break;
+		}
+		goto done;
+	}
+
+	for_each_node_mask(n, nodemsk) {
+		int ncpus, v, vecs_to_assign, vecs_per_node;
+
+		/* Spread the vectors per node */
+		vecs_per_node = (affv - (curvec - affd->pre_vectors)) / nodes;
+
+		/* Get the cpus on this node which are in the mask */
+		cpumask_and(nmsk, cpu_possible_mask, cpumask_of_node(n));
+
+		/* Calculate the number of cpus per vector */
+		ncpus = cpumask_weight(nmsk);
+		vecs_to_assign = min(vecs_per_node, ncpus);
+
+		/* Account for rounding errors */
+		extra_vecs = ncpus - vecs_to_assign * (ncpus / vecs_to_assign);
+
+		for (v = 0; curvec < last_affv && v < vecs_to_assign;
+		     curvec++, v++) {
+			cpus_per_vec = ncpus / vecs_to_assign;
+
+			/* Account for extra vectors to compensate rounding errors */
+			if (extra_vecs) {
+				cpus_per_vec++;
+				--extra_vecs;
+			}
+			irq_spread_init_one(masks + curvec, nmsk, cpus_per_vec);
+		}
+
+		if (curvec >= last_affv)
+			break;
+		--nodes;
+	}
+
+done:
+	/* Fill out vectors at the end that don't need affinity */
+	for (; curvec < nvecs; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+out:
+	free_cpumask_var(nmsk);
+	return masks;
+}
+
+/**
+ * irq_calc_affinity_vectors - Calculate the optimal number of vectors
+ * @maxvec:	The maximum number of vectors available
+ * @affd:	Description of the affinity requirements
+ *
+ * There is no point in spreading more vectors than there are cpus.
+ */
+int irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd)
+{
+	int resv = affd->pre_vectors + affd->post_vectors;
+	int vecs = maxvec - resv;
+
+	return min_t(int, num_possible_cpus(), vecs) + resv;
+}
+
+/**
+ * irq_managed_offline - Shut down a managed interrupt without online cpus
+ * @desc:	Interrupt descriptor, locked by the caller
+ *
+ * Called by the cpu hotplug migration code for an interrupt whose
+ * affinity mask no longer contains an online cpu.  A managed interrupt
+ * is shut down instead of being moved; irq_affinity_online_cpu() starts
+ * it again.  Returns true if the interrupt was shut down.
+ */
+bool irq_managed_offline(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	if (!irqd_affinity_is_managed(d) || !desc->action)
+		return false;
+	if (cpumask_intersects(irq_data_get_affinity_mask(d), cpu_online_mask))
+		return false;
+
+	irqd_set(d, IRQD_MANAGED_SHUTDOWN);
+	irq_shutdown(desc);
+	return true;
+}
+
+static void irq_restore_managed(struct irq_desc *desc, unsigned int cpu)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+	const struct cpumask *affinity = irq_data_get_affinity_mask(d);
+
+	if (!irqd_is_managed_and_shutdown(d) ||
+	    !cpumask_test_cpu(cpu, affinity))
+		return;
+
+	irqd_clear(d, IRQD_MANAGED_SHUTDOWN);
+	if (!desc->action)
+		return;
+	irq_do_set_affinity(d, affinity, false);
+	irq_startup(desc, true);
+}
+
+/*
+ * A cpu came up: restart the managed interrupts that were shut down
+ * because all the cpus in their affinity mask were offline.
+ */
+static int irq_affinity_online_cpu(struct notifier_block *nb,
+				   unsigned long action, void *hcpu)
+{
+	unsigned int irq, cpu = (unsigned long)hcpu;
+	struct irq_desc *desc;
+
+	if ((action & ~CPU_TASKS_FROZEN) != CPU_ONLINE)
+		return NOTIFY_OK;
+
+	irq_lock_sparse();
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+		raw_spin_lock_irq(&desc->lock);
+		irq_restore_managed(desc, cpu);
+		raw_spin_unlock_irq(&desc->lock);
+	}
+	irq_unlock_sparse();
+	return NOTIFY_OK;
+}
+
+static int __init irq_affinity_init(void)
+{
+	hotcpu_notifier(irq_affinity_online_cpu, 0);
+	return 0;
+}
+core_initcall(irq_affinity_init);
@@ -190,6 +190,19 @@ int irq_startup(struct irq_desc *desc, bool resend)
 {
 	int ret = 0;
 
+#ifdef CONFIG_SMP
+	/*
+	 * A managed interrupt none of whose cpus is online stays shut
+	 * down until irq_affinity_online_cpu() starts it.
+	 */
+	if (irqd_affinity_is_managed(&desc->irq_data) &&
+	    !cpumask_intersects(desc->irq_common_data.affinity,
+				cpu_online_mask)) {
+		irqd_set(&desc->irq_data, IRQD_MANAGED_SHUTDOWN);
+		return 0;
+	}
+#endif
+
 	irq_state_clr_disabled(desc);
 	desc->depth = 0;
 
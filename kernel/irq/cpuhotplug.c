@@ -30,6 +30,9 @@ static bool migrate_one_irq(struct irq_desc *desc)
 		return false;
 
 	if (cpumask_any_and(affinity, cpu_online_mask) >= nr_cpu_ids) {
+		/* A managed interrupt waits for its cpus to come back */
+		if (irq_managed_offline(desc))
+			return false;
 		affinity = cpu_online_mask;
 		ret = true;
 	}
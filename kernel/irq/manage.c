@@ -133,6 +133,21 @@ int irq_can_set_affinity(unsigned int irq)
 	return __irq_can_set_affinity(irq_to_desc(irq));
 }
 
+/**
+ *	irq_can_set_affinity_usr - Check if affinity of an irq can be set from user space
+ *	@irq:		Interrupt to check
+ *
+ *	Like irq_can_set_affinity() above, but additionally checks for the
+ *	AFFINITY_MANAGED flag.
+ */
+bool irq_can_set_affinity_usr(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return __irq_can_set_affinity(desc) &&
+		!irqd_affinity_is_managed(&desc->irq_data);
+}
+
 /**
  *	irq_set_thread_affinity - Notify irq threads to adjust affinity
  *	@desc:		irq descriptor which has affitnity changed
@@ -258,6 +273,27 @@ int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 }
 EXPORT_SYMBOL_GPL(irq_set_affinity_hint);
 
+/**
+ *	irq_get_affinity - Snapshot the affinity mask of an interrupt
+ *	@irq:	Interrupt to query
+ *	@mask:	Filled in with the cpus @irq is currently affine to
+ *
+ *	Lets drivers and the block layer line their per-cpu queue mappings up
+ *	with where the interrupts actually get delivered.
+ */
+int irq_get_affinity(unsigned int irq, struct cpumask *mask)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags, IRQ_GET_DESC_CHECK_GLOBAL);
+
+	if (!desc)
+		return -EINVAL;
+	cpumask_copy(mask, desc->irq_common_data.affinity);
+	irq_put_desc_unlock(desc, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_get_affinity);
+
 static void irq_affinity_notify(struct work_struct *work)
 {
 	struct irq_affinity_notify *notify =
@@ -339,6 +375,18 @@ static int setup_affinity(struct irq_desc *desc, struct cpumask *mask)
 	if (!__irq_can_set_affinity(desc))
 		return 0;
 
+	/*
+	 * A managed interrupt keeps the mask it was allocated with; its
+	 * online part is what irq_startup() checked to be non-empty.
+	 */
+	if (irqd_affinity_is_managed(&desc->irq_data)) {
+		cpumask_and(mask, desc->irq_common_data.affinity,
+			    cpu_online_mask);
+		if (!cpumask_empty(mask))
+			irq_do_set_affinity(&desc->irq_data, mask, false);
+		return 0;
+	}
+
 	/*
 	 * Preserve an userspace affinity setup, but make sure that
 	 * one of the targets is online.
@@ -0,0 +1,96 @@
+/*
+ * Lock event counters in debugfs.
+ *
+ * Every event in lock_events_list.h gets a read-only file under
+ * <debugfs>/lock_event_counts/ holding the sum of its per-cpu counts.
+ * Writing anything to the "reset_counts" file clears all of them.
+ */
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/uaccess.h>
+
+#include "lock_events.h"
+
+#undef  LOCK_EVENT
+#define LOCK_EVENT(name)	[LOCKEVENT_ ## name] = #name,
+
+static const char * const lockevent_names[lockevent_num + 1] = {
+
+#include "lock_events_list.h"
+
+	[lockevent_num] = "reset_counts",
+};
+
+DEFINE_PER_CPU(unsigned long, lockevents[lockevent_num]);
+
+static ssize_t lockevent_read(struct file *file, char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	int id = (long)file_inode(file)->i_private;
+	unsigned long sum = 0;
+	char buf[32];
+	int cpu, len;
+
+	if (id >= lockevent_num)
+		return -EBADF;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu(lockevents[id], cpu);
+	len = snprintf(buf, sizeof(buf), "%lu\n", sum);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t lockevent_write(struct file *file, const char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	int cpu, i;
+
+	if ((long)file_inode(file)->i_private != lockevent_num)
+		return count;
+
+	for_each_possible_cpu(cpu) {
+		unsigned long *ptr = per_cpu_ptr(lockevents, cpu);
+
+		for (i = 0; i < lockevent_num; i++)
+			WRITE_ONCE(ptr[i], 0);
+	}
+	return count;
+}
+
+static const struct file_operations fops_lockevent = {
+	.read	= lockevent_read,
+	.write	= lockevent_write,
+	.llseek	= default_llseek,
+};
+
+static int __init init_lockevent_counts(void)
+{
+	struct dentry *d_counts = debugfs_create_dir("lock_event_counts", NULL);
+	long i;
+
+	if (!d_counts)
+		goto out;
+
+	for (i = 0; i < lockevent_num; i++) {
+		if (!debugfs_create_file(lockevent_names[i], 0400, d_counts,
+					 (void *)i, &fops_lockevent))
+			goto fail_undo;
+	}
+	if (!debugfs_create_file(lockevent_names[lockevent_num], 0200,
+				 d_counts, (void *)lockevent_num,
+				 &fops_lockevent))
+		goto fail_undo;
+
+	return 0;
+
+fail_undo:
+	debugfs_remove_recursive(d_counts);
+out:
+	pr_warn("Could not create 'lock_event_counts' directory\n");
+	return 0;
+}
+fs_initcall(init_lockevent_counts);
@@ -0,0 +1,45 @@
+/*
+ * Per-cpu counters of interesting lock slowpath events.
+ *
+ * The events themselves are listed in lock_events_list.h.  Without
+ * CONFIG_LOCK_EVENT_COUNTS the counting compiles away entirely.
+ */
+#ifndef __LOCKING_LOCK_EVENTS_H
+#define __LOCKING_LOCK_EVENTS_H
+
+#define LOCK_EVENT(name)	LOCKEVENT_ ## name,
+
+enum lock_events {
+
+#include "lock_events_list.h"
+
+	lockevent_num,	/* Total number of lock event counts */
+#undef LOCK_EVENT
+};
+
+#ifdef CONFIG_LOCK_EVENT_COUNTS
+
+#include <linux/percpu.h>
+
+DECLARE_PER_CPU(unsigned long, lockevents[lockevent_num]);
+
+/*
+ * The counters are only statistics, a lost update on preemption is
+ * harmless, so the cheaper raw_cpu ops are good enough.
+ */
+static inline void __lockevent_inc(enum lock_events event, bool cond)
+{
+	if (cond)
+		raw_cpu_inc(lockevents[event]);
+}
+
+#define lockevent_inc(ev)	  __lockevent_inc(LOCKEVENT_ ##ev, true)
+#define lockevent_cond_inc(ev, c) __lockevent_inc(LOCKEVENT_ ##ev, c)
+
+#else /* CONFIG_LOCK_EVENT_COUNTS */
+
+#define lockevent_inc(ev)
+#define lockevent_cond_inc(ev, c)
+
+#endif /* CONFIG_LOCK_EVENT_COUNTS */
+#endif /* __LOCKING_LOCK_EVENTS_H */
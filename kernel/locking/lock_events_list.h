@@ -0,0 +1,18 @@
+/*
+ * Lock event counters, see lock_events.h.
+ *
+ * Each LOCK_EVENT(name) below becomes a per-cpu counter and, with
+ * CONFIG_LOCK_EVENT_COUNTS, a file of the same name under
+ * <debugfs>/lock_event_counts/.
+ */
+
+LOCK_EVENT(rwsem_sleep_reader)	/* # of reader sleeps			*/
+LOCK_EVENT(rwsem_sleep_writer)	/* # of writer sleeps			*/
+LOCK_EVENT(rwsem_wake_reader)	/* # of reader wakeups			*/
+LOCK_EVENT(rwsem_wake_writer)	/* # of writer wakeups			*/
+LOCK_EVENT(rwsem_opt_rlock)	/* # of read locks opt-spin acquired	*/
+LOCK_EVENT(rwsem_opt_wlock)	/* # of write locks opt-spin acquired	*/
+LOCK_EVENT(rwsem_opt_fail)	/* # of failed opt-spinnings		*/
+LOCK_EVENT(rwsem_rlock)		/* # of read locks acquired after sleep	*/
+LOCK_EVENT(rwsem_wlock)		/* # of write locks acquired after sleep */
+LOCK_EVENT(rwsem_wlock_handoff)	/* # of write lock handoffs		*/
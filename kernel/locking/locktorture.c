@@ -37,6 +37,7 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/topology.h>
 #include <linux/torture.h>
 
 MODULE_LICENSE("GPL");
@@ -57,6 +58,8 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(bool, verbose, true,
 	     "Enable verbose debugging printk()s");
+torture_param(bool, measure_locality, false,
+	     "Count write-lock handoffs that stay on a NUMA node");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -73,8 +76,13 @@ static bool lock_is_read_held;
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	long n_handoff_local;	/* previous writer ran on the same node */
+	long n_handoff_remote;
 };
 
+/* Node of the last writer, protected by the write lock itself. */
+static int last_writer_node = NUMA_NO_NODE;
+
 #if defined(MODULE)
 #define LOCKTORTURE_RUNNABLE_INIT 1
 #else
@@ -594,6 +602,15 @@ static int lock_torture_writer(void *arg)
 			lwsp->n_lock_fail++; /* rare, but... */
 
 		lwsp->n_lock_acquired++;
+		if (measure_locality) {
+			int node = numa_node_id();
+
+			if (last_writer_node == node)
+				lwsp->n_handoff_local++;
+			else if (last_writer_node != NUMA_NO_NODE)
+				lwsp->n_handoff_remote++;
+			last_writer_node = node;
+		}
 		cxt.cur_ops->write_delay(&rand);
 		lock_is_write_held = 0;
 		cxt.cur_ops->writeunlock();
@@ -648,13 +665,15 @@ static void __torture_print_stats(char *page,
 	int i, n_stress;
 	long max = 0;
 	long min = statp[0].n_lock_acquired;
-	long long sum = 0;
+	long long sum = 0, local = 0, remote = 0;
 
 	n_stress = write ? cxt.nrealwriters_stress : cxt.nrealreaders_stress;
 	for (i = 0; i < n_stress; i++) {
 		if (statp[i].n_lock_fail)
 			fail = true;
 		sum += statp[i].n_lock_acquired;
+		local += statp[i].n_handoff_local;
+		remote += statp[i].n_handoff_remote;
 		if (max < statp[i].n_lock_fail)
 			max = statp[i].n_lock_fail;
 		if (min > statp[i].n_lock_fail)
@@ -665,6 +684,11 @@ static void __torture_print_stats(char *page,
 			write ? "Writes" : "Reads ",
 			sum, max, min, max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
+	if (write && measure_locality)
+		page += sprintf(page,
+				"Handoffs:  Local: %lld  Remote: %lld  (%lld%% local)\n",
+				local, remote,
+				local + remote ? local * 100 / (local + remote) : 0);
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
@@ -734,11 +758,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d measure_locality=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, measure_locality);
 }
 
 static void lock_torture_cleanup(void)
@@ -16,8 +16,14 @@
 
 struct mcs_spinlock {
 	struct mcs_spinlock *next;
-	int locked; /* 1 if lock acquired */
+	int locked; /* 1 if lock acquired, see qspinlock.c for > 1 */
 	int count;  /* nesting count, see qspinlock.c */
+#ifdef CONFIG_NUMA
+	/* NUMA-aware handoff state, see qspinlock.c */
+	int numa_node;
+	u32 encoded_tail;
+	unsigned int intra_count;
+#endif
 };
 
 #ifndef arch_mcs_spin_lock_contended
@@ -27,6 +27,9 @@
 #include <linux/percpu.h>
 #include <linux/hardirq.h>
 #include <linux/mutex.h>
+#include <linux/init.h>
+#include <linux/jump_label.h>
+#include <linux/topology.h>
 #include <asm/byteorder.h>
 #include <asm/qspinlock.h>
 
@@ -78,7 +81,8 @@
  * Per-CPU queue node structures; we can never have more than 4 nested
  * contexts: task, softirq, hardirq, nmi.
  *
- * Exactly fits one 64-byte cacheline on a 64-bit architecture.
+ * Exactly fits one 64-byte cacheline on a 64-bit architecture, without
+ * the NUMA handoff state.
  *
  * PV doubles the storage and uses the second cacheline for PV state.
  */
@@ -231,6 +235,162 @@ static __always_inline void set_locked(struct qspinlock *lock)
 	WRITE_ONCE(l->locked, _Q_LOCKED_VAL);
 }
 
+#ifdef CONFIG_NUMA
+/*
+ * NUMA-aware MCS handoff, after the compact NUMA-aware (CNA) lock of Dice
+ * and Kogan:
+ *
+ * https://arxiv.org/abs/1810.05600
+ *
+ * The FIFO handoff of the MCS queue moves the lock, and the data it
+ * protects, across the interconnect whenever consecutive waiters sit on
+ * different nodes.  With numa_spinlock=on the queue head instead passes
+ * the lock to the first waiter on its own node, and moves the waiters it
+ * skipped to a secondary queue.  That queue is a circular list; the
+ * encoded tail of its last node travels along with the lock in
+ * node->locked, which is 1 when there is no secondary queue.  The
+ * secondary queue goes back in front of the main queue when no local
+ * waiter is left, or after numa_spinlock_threshold consecutive handoffs
+ * within one node, which bounds how long remote waiters can starve.
+ */
+static DEFINE_STATIC_KEY_FALSE(numa_spinlock);
+static unsigned int numa_spinlock_threshold __read_mostly = 256;
+static bool numa_spinlock_on __initdata;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	numa_spinlock_on = !strcmp(str, "on");
+	return 1;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	return !kstrtouint(str, 0, &numa_spinlock_threshold);
+}
+__setup("numa_spinlock_threshold=", numa_spinlock_threshold_setup);
+
+static int __init numa_spinlock_init(void)
+{
+	if (!numa_spinlock_on || nr_node_ids < 2)
+		return 0;
+
+	static_branch_enable(&numa_spinlock);
+	pr_info("qspinlock: NUMA-aware handoff, threshold %u\n",
+		numa_spinlock_threshold);
+	return 0;
+}
+early_initcall(numa_spinlock_init);
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node, u32 tail)
+{
+	node->numa_node = numa_node_id();
+	node->encoded_tail = tail;
+	node->intra_count = 0;
+}
+
+/* The secondary queue @node got the lock with, if any. */
+static inline u32 cna_secondary(struct mcs_spinlock *node)
+{
+	u32 val = node->locked;
+
+	return val > 1 ? val : 0;
+}
+
+/*
+ * Put the secondary queue @sec in front of @next; returns the new head.
+ */
+static inline struct mcs_spinlock *
+cna_splice(u32 sec, struct mcs_spinlock *next)
+{
+	struct mcs_spinlock *sec_tail = decode_tail(sec);
+	struct mcs_spinlock *sec_head = sec_tail->next;
+
+	sec_tail->next = next;
+	return sec_head;
+}
+
+/*
+ * Choose the waiter the queue head @node passes the MCS lock to, given
+ * its successor @next, and the value for that waiter's ->locked.
+ */
+static struct mcs_spinlock *cna_pass(struct mcs_spinlock *node,
+				     struct mcs_spinlock *next, int *valp)
+{
+	u32 sec = cna_secondary(node);
+	struct mcs_spinlock *cur, *last = NULL;
+
+	if (node->intra_count < numa_spinlock_threshold) {
+		for (cur = next; cur; last = cur, cur = READ_ONCE(cur->next)) {
+			if (cur->numa_node != node->numa_node)
+				continue;
+
+			/* move next..last to the end of the secondary queue */
+			if (last) {
+				if (sec)
+					last->next = cna_splice(sec, next);
+				else
+					last->next = next;
+				sec = last->encoded_tail;
+			}
+			cur->intra_count = node->intra_count + 1;
+			*valp = sec ? sec : 1;
+			return cur;
+		}
+	}
+
+	if (sec)
+		next = cna_splice(sec, next);
+	next->intra_count = 0;
+	*valp = 1;
+	return next;
+}
+
+/*
+ * The queue head found itself alone in the main queue; if there is a
+ * secondary queue, make it the main queue and pass it the MCS lock while
+ * taking the lock.  Returns true if so.
+ */
+static bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+			       struct mcs_spinlock *node)
+{
+	u32 sec = cna_secondary(node);
+	struct mcs_spinlock *sec_tail, *sec_head;
+
+	if (!sec)
+		return false;
+
+	sec_tail = decode_tail(sec);
+	sec_head = sec_tail->next;
+	sec_tail->next = NULL;
+	if (atomic_cmpxchg(&lock->val, val, sec | _Q_LOCKED_VAL) != val) {
+		sec_tail->next = sec_head;
+		return false;
+	}
+
+	sec_head->intra_count = 0;
+	arch_mcs_spin_unlock_contended(&sec_head->locked);
+	return true;
+}
+
+#define cna_enabled()	static_branch_unlikely(&numa_spinlock)
+#else
+static __always_inline void cna_init_node(struct mcs_spinlock *node, u32 tail) { }
+static inline struct mcs_spinlock *cna_pass(struct mcs_spinlock *node,
+					    struct mcs_spinlock *next, int *valp)
+{
+	*valp = 1;
+	return next;
+}
+static inline bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+				      struct mcs_spinlock *node)
+{
+	return false;
+}
+
+#define cna_enabled()	false
+#endif /* CONFIG_NUMA */
+
 
 /*
  * Generate the native code for queued_spin_unlock_slowpath(); provide NOPs for
@@ -425,6 +585,7 @@ queue:
 	node += idx;
 	node->locked = 0;
 	node->next = NULL;
+	cna_init_node(node, tail);
 	pv_init_node(node);
 
 	/*
@@ -486,6 +647,9 @@ queue:
 			set_locked(lock);
 			break;
 		}
+		if (!pv_enabled() && cna_enabled() &&
+		    cna_try_clear_tail(lock, val, node))
+			goto release;
 		old = atomic_cmpxchg(&lock->val, val, _Q_LOCKED_VAL);
 		if (old == val)
 			goto release;	/* No contention */
@@ -499,7 +663,14 @@ queue:
 	while (!(next = READ_ONCE(node->next)))
 		cpu_relax();
 
-	arch_mcs_spin_unlock_contended(&next->locked);
+	if (!pv_enabled() && cna_enabled()) {
+		int locked;
+
+		next = cna_pass(node, next, &locked);
+		smp_store_release(&next->locked, locked);
+	} else {
+		arch_mcs_spin_unlock_contended(&next->locked);
+	}
 	pv_kick_node(lock, next);
 
 release:
@@ -8,15 +8,19 @@
  *
  * Optimistic spinning by Tim Chen <tim.c.chen@intel.com>
  * and Davidlohr Bueso <davidlohr@hp.com>. Based on mutexes.
+ *
+ * Reader optimistic spinning and writer handoff follow the same model.
  */
 #include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/export.h>
+#include <linux/jiffies.h>
 #include <linux/sched/rt.h>
 #include <linux/osq_lock.h>
 
 #include "rwsem.h"
+#include "lock_events.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -65,6 +69,14 @@
  *	 are only waiters but none active (5th case above), and attempt to
  *	 steal the lock.
  *
+ *	 Readers that find the lock write-owned by a running task give their
+ *	 ACTIVE_READ_BIAS back and spin, and take the lock once count is no
+ *	 longer negative, i.e. there is neither a writer nor a waiter.
+ *
+ *	 A writer at the head of the queue that has been passed over for
+ *	 RWSEM_WAIT_TIMEOUT sets sem->handoff.  Spinners and queued writers
+ *	 behind it then leave the lock alone until the head writer has it.
+ *
  */
 
 /*
@@ -85,6 +97,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = 0;
 	osq_lock_init(&sem->osq);
 #endif
 }
@@ -100,8 +113,57 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;
 };
 
+/*
+ * How long a writer at the head of the queue may see the lock stolen
+ * from under it before it asks for a handoff; about 4ms.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->handoff);
+}
+
+/*
+ * Called with wait_lock held by a writer that failed to get the lock.
+ */
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter)
+{
+	if (sem->handoff || time_before(jiffies, waiter->timeout))
+		return;
+	if (list_first_entry(&sem->wait_list, struct rwsem_waiter,
+			     list) != waiter)
+		return;
+	WRITE_ONCE(sem->handoff, 1);
+	lockevent_inc(rwsem_wlock_handoff);
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	if (sem->handoff)
+		WRITE_ONCE(sem->handoff, 0);
+}
+#else
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter)
+{
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
+#endif
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -135,6 +197,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 			 * will block as they will notice the queued writer.
 			 */
 			wake_up_process(waiter->task);
+		lockevent_cond_inc(rwsem_wake_writer,
+				   wake_type == RWSEM_WAKE_ANY);
 		goto out;
 	}
 
@@ -198,6 +262,7 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 		waiter->task = NULL;
 		wake_up_process(tsk);
 		put_task_struct(tsk);
+		lockevent_inc(rwsem_wake_reader);
 	} while (--loop);
 
 	sem->wait_list.next = next;
@@ -207,56 +272,26 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
-/*
- * Wait for the read lock to be granted
- */
-__visible
-struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
 {
-	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
-	struct rwsem_waiter waiter;
-	struct task_struct *tsk = current;
-
-	/* set up my own style of waitqueue */
-	waiter.task = tsk;
-	waiter.type = RWSEM_WAITING_FOR_READ;
-	get_task_struct(tsk);
-
-	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
-		adjustment += RWSEM_WAITING_BIAS;
-	list_add_tail(&waiter.list, &sem->wait_list);
-
-	/* we're now waiting on the lock, but no longer actively locking */
-	count = rwsem_atomic_update(adjustment, sem);
-
-	/* If there are no active locks, wake the front queued process(es).
-	 *
-	 * If there are no writers and we are first in the queue,
-	 * wake our own waiter to join the existing active readers !
-	 */
-	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
-
-	raw_spin_unlock_irq(&sem->wait_lock);
-
-	/* wait to be given the lock */
-	while (true) {
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
-		if (!waiter.task)
-			break;
-		schedule();
+	/* Once a handoff is pending, only the head writer may take it. */
+	if (rwsem_handoff_pending(sem)) {
+		struct rwsem_waiter *first;
+
+		first = list_first_entry(&sem->wait_list, struct rwsem_waiter,
+					 list);
+		if (first != waiter) {
+			/*
+			 * rwsem_wake() may have left the wakeup to us as a
+			 * former spinner; pass it on if the lock is free.
+			 */
+			if (count == RWSEM_WAITING_BIAS)
+				wake_up_process(first->task);
+			return false;
+		}
 	}
 
-	__set_task_state(tsk, TASK_RUNNING);
-	return sem;
-}
-EXPORT_SYMBOL(rwsem_down_read_failed);
-
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
-{
 	/*
 	 * Try acquiring the write lock. Check count first in order
 	 * to reduce unnecessary expensive cmpxchg() operations.
@@ -267,6 +302,7 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 		if (!list_is_singular(&sem->wait_list))
 			rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
 		rwsem_set_owner(sem);
+		rwsem_clear_handoff(sem);
 		return true;
 	}
 
@@ -296,12 +332,32 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * A negative count means a writer holds the lock or tasks are queued, and
+ * in either case a reader must not barge in.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = READ_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+	return false;
+}
+
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
 	bool ret = true;
 
-	if (need_resched())
+	if (need_resched() || rwsem_handoff_pending(sem))
 		return false;
 
 	rcu_read_lock();
@@ -325,8 +381,17 @@ done:
 	return ret;
 }
 
+/*
+ * Only a running writer is worth spinning on for a reader.
+ */
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->owner) && rwsem_can_spin_on_owner(sem);
+}
+
 static noinline
-bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
+bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner,
+			 bool wlock)
 {
 	long count;
 
@@ -359,10 +424,12 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 	 * state.
 	 */
 	count = READ_ONCE(sem->count);
+	if (!wlock)
+		return count >= 0;	/* free, or readers we can join */
 	return (count == 0 || count == RWSEM_WAITING_BIAS);
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
 	bool taken = false;
@@ -378,15 +445,27 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 
 	while (true) {
 		owner = READ_ONCE(sem->owner);
-		if (owner && !rwsem_spin_on_owner(sem, owner))
+		if (owner && !rwsem_spin_on_owner(sem, owner, wlock))
+			break;
+
+		/* A queued writer has waited long enough, let it have the lock */
+		if (rwsem_handoff_pending(sem))
 			break;
 
 		/* wait_lock will be acquired if write_lock is obtained */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		/*
+		 * Readers only spin on a writer owner; if the lock went to a
+		 * writer that has not set sem->owner yet, go and queue.
+		 */
+		if (!owner && !wlock)
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -407,6 +486,7 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	osq_unlock(&sem->osq);
 done:
 	preempt_enable();
+	lockevent_cond_inc(rwsem_opt_fail, !taken);
 	return taken;
 }
 
@@ -419,7 +499,12 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	return false;
 }
@@ -430,6 +515,69 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 #endif
 
+/*
+ * Wait for the read lock to be granted
+ */
+__visible
+struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+{
+	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	struct rwsem_waiter waiter;
+	struct task_struct *tsk = current;
+
+	/*
+	 * Rather than sleeping behind a running writer, give our read bias
+	 * back and spin until it releases the lock.
+	 */
+	if (rwsem_reader_can_spin(sem)) {
+		rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		adjustment = 0;
+		if (rwsem_optimistic_spin(sem, false)) {
+			lockevent_inc(rwsem_opt_rlock);
+			return sem;
+		}
+	}
+
+	/* set up my own style of waitqueue */
+	waiter.task = tsk;
+	waiter.type = RWSEM_WAITING_FOR_READ;
+	get_task_struct(tsk);
+
+	raw_spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list))
+		adjustment += RWSEM_WAITING_BIAS;
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	/* we're now waiting on the lock, but no longer actively locking */
+	count = rwsem_atomic_update(adjustment, sem);
+
+	/* If there are no active locks, wake the front queued process(es).
+	 *
+	 * If there are no writers and we are first in the queue,
+	 * wake our own waiter to join the existing active readers !
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS &&
+	     list_is_singular(&sem->wait_list)))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+
+	raw_spin_unlock_irq(&sem->wait_lock);
+
+	/* wait to be given the lock */
+	while (true) {
+		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
+			break;
+		schedule();
+		lockevent_inc(rwsem_sleep_reader);
+	}
+
+	__set_task_state(tsk, TASK_RUNNING);
+	lockevent_inc(rwsem_rlock);
+	return sem;
+}
+EXPORT_SYMBOL(rwsem_down_read_failed);
+
 /*
  * Wait until we successfully acquire the write lock
  */
@@ -444,8 +592,10 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true)) {
+		lockevent_inc(rwsem_opt_wlock);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -453,6 +603,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -480,13 +631,15 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	/* wait until we successfully acquire the lock */
 	set_current_state(TASK_UNINTERRUPTIBLE);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+		rwsem_check_handoff(sem, &waiter);
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
 		do {
 			schedule();
+			lockevent_inc(rwsem_sleep_writer);
 			set_current_state(TASK_UNINTERRUPTIBLE);
 		} while ((count = sem->count) & RWSEM_ACTIVE_MASK);
 
@@ -496,6 +649,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lockevent_inc(rwsem_wlock);
 
 	return sem;
 }
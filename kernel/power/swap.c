@@ -25,6 +25,7 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
@@ -218,6 +219,8 @@ struct hib_bio_batch {
 	atomic_t		count;
 	wait_queue_head_t	wait;
 	int			error;
+	struct bio		*bio;	/* being filled, not yet submitted */
+	int			rw;
 };
 
 static void hib_init_batch(struct hib_bio_batch *hb)
@@ -225,12 +228,14 @@ static void hib_init_batch(struct hib_bio_batch *hb)
 	atomic_set(&hb->count, 0);
 	init_waitqueue_head(&hb->wait);
 	hb->error = 0;
+	hb->bio = NULL;
 }
 
 static void hib_end_io(struct bio *bio)
 {
 	struct hib_bio_batch *hb = bio->bi_private;
-	struct page *page = bio->bi_io_vec[0].bv_page;
+	struct bio_vec *bvec;
+	int i;
 
 	if (bio->bi_error) {
 		printk(KERN_ALERT "Read-error on swap-device (%u:%u:%Lu)\n",
@@ -240,7 +245,8 @@ static void hib_end_io(struct bio *bio)
 	}
 
 	if (bio_data_dir(bio) == WRITE)
-		put_page(page);
+		bio_for_each_segment_all(bvec, bio, i)
+			put_page(bvec->bv_page);
 
 	if (bio->bi_error && !hb->error)
 		hb->error = bio->bi_error;
@@ -250,15 +256,38 @@ static void hib_end_io(struct bio *bio)
 	bio_put(bio);
 }
 
+static void hib_flush_batch(struct hib_bio_batch *hb)
+{
+	if (hb->bio) {
+		atomic_inc(&hb->count);
+		submit_bio(hb->rw, hb->bio);
+		hb->bio = NULL;
+	}
+}
+
 static int hib_submit_io(int rw, pgoff_t page_off, void *addr,
 		struct hib_bio_batch *hb)
 {
 	struct page *page = virt_to_page(addr);
+	sector_t sector = page_off * (PAGE_SIZE >> 9);
 	struct bio *bio;
 	int error = 0;
 
-	bio = bio_alloc(__GFP_RECLAIM | __GFP_HIGH, 1);
-	bio->bi_iter.bi_sector = page_off * (PAGE_SIZE >> 9);
+	/*
+	 * Swap pages are mostly handed out in order, so batched I/O is
+	 * gathered into bios of up to BIO_MAX_PAGES pages.  The bio being
+	 * filled is submitted when the next page doesn't follow it on disk
+	 * or doesn't fit, or by hib_wait_io().
+	 */
+	if (hb && hb->bio) {
+		if (hb->rw == rw && bio_end_sector(hb->bio) == sector &&
+		    bio_add_page(hb->bio, page, PAGE_SIZE, 0) == PAGE_SIZE)
+			return 0;
+		hib_flush_batch(hb);
+	}
+
+	bio = bio_alloc(__GFP_RECLAIM | __GFP_HIGH, hb ? BIO_MAX_PAGES : 1);
+	bio->bi_iter.bi_sector = sector;
 	bio->bi_bdev = hib_resume_bdev;
 
 	if (bio_add_page(bio, page, PAGE_SIZE, 0) < PAGE_SIZE) {
@@ -271,8 +300,8 @@ static int hib_submit_io(int rw, pgoff_t page_off, void *addr,
 	if (hb) {
 		bio->bi_end_io = hib_end_io;
 		bio->bi_private = hb;
-		atomic_inc(&hb->count);
-		submit_bio(rw, bio);
+		hb->bio = bio;
+		hb->rw = rw;
 	} else {
 		error = submit_bio_wait(rw, bio);
 		bio_put(bio);
@@ -283,6 +312,7 @@ static int hib_submit_io(int rw, pgoff_t page_off, void *addr,
 
 static int hib_wait_io(struct hib_bio_batch *hb)
 {
+	hib_flush_batch(hb);
 	wait_event(hb->wait, atomic_read(&hb->count) == 0);
 	return hb->error;
 }
@@ -493,13 +523,20 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 #define LZO_UNC_PAGES	32
 #define LZO_UNC_SIZE	(LZO_UNC_PAGES * PAGE_SIZE)
 
-/* Number of pages/bytes we need for compressed data (worst case). */
+/*
+ * Number of pages/bytes we need for compressed data (worst case).  LZO's
+ * bound also covers LZ4's.
+ */
 #define LZO_CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(LZO_UNC_SIZE) + \
 			             LZO_HEADER, PAGE_SIZE)
 #define LZO_CMP_SIZE	(LZO_CMP_PAGES * PAGE_SIZE)
 
-/* Maximum number of threads for compression/decompression. */
-#define LZO_THREADS	3
+/*
+ * Maximum number of threads for compression/decompression.  Each one needs
+ * about 300k of buffers; up to this many, one less than the online CPUs
+ * are used.
+ */
+#define LZO_THREADS	16
 
 /* Minimum/maximum number of pages for read buffering. */
 #define LZO_MIN_RD_PAGES	1024
@@ -554,68 +591,35 @@ static int save_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for CRC32.
- */
-struct crc_data {
-	struct task_struct *thr;                  /* thread */
-	atomic_t ready;                           /* ready to start flag */
-	atomic_t stop;                            /* ready to stop flag */
-	unsigned run_threads;                     /* nr current threads */
-	wait_queue_head_t go;                     /* start crc update */
-	wait_queue_head_t done;                   /* crc update done */
-	u32 *crc32;                               /* points to handle's crc32 */
-	size_t *unc_len[LZO_THREADS];             /* uncompressed lengths */
-	unsigned char *unc[LZO_THREADS];          /* uncompressed data */
-};
-
-/**
- * CRC32 update function that runs in its own thread.
- */
-static int crc32_threadfn(void *data)
-{
-	struct crc_data *d = data;
-	unsigned i;
-
-	while (1) {
-		wait_event(d->go, atomic_read(&d->ready) ||
-		                  kthread_should_stop());
-		if (kthread_should_stop()) {
-			d->thr = NULL;
-			atomic_set(&d->stop, 1);
-			wake_up(&d->done);
-			break;
-		}
-		atomic_set(&d->ready, 0);
-
-		for (i = 0; i < d->run_threads; i++)
-			*d->crc32 = crc32_le(*d->crc32,
-			                     d->unc[i], *d->unc_len[i]);
-		atomic_set(&d->stop, 1);
-		wake_up(&d->done);
-	}
-	return 0;
-}
-/**
- * Structure used for LZO data compression.
+ * Structure used for LZO/LZ4 data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	bool lz4;                                 /* LZ4 instead of LZO */
 	wait_queue_head_t go;                     /* start compression */
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
+	u32 crc32;                                /* crc32 of unc, 0 seeded */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
+	union {                                   /* compression workspace */
+		unsigned char lzo[LZO1X_1_MEM_COMPRESS];
+		unsigned char lz4[LZ4_MEM_COMPRESS];
+	} wrk;
 };
 
 /**
  * Compression function that runs in its own thread.
+ *
+ * The CRC32 of each block is computed here too, and folded into the image
+ * CRC32 in order by the caller with crc32_le_combine(), so that it scales
+ * with the number of threads as well.
  */
-static int lzo_compress_threadfn(void *data)
+static int compress_threadfn(void *data)
 {
 	struct cmp_data *d = data;
 
@@ -631,9 +635,15 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		d->crc32 = crc32_le(0, d->unc, d->unc_len);
+		if (d->lz4)
+			d->ret = lz4_compress(d->unc, d->unc_len,
+			                      d->cmp + LZO_HEADER, &d->cmp_len,
+			                      &d->wrk);
+		else
+			d->ret = lzo1x_1_compress(d->unc, d->unc_len,
+			                          d->cmp + LZO_HEADER,
+			                          &d->cmp_len, &d->wrk);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -641,14 +651,16 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_compressed_image - Save the suspend image data compressed.
  * @handle: Swap map handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
+ * @flags: Image flags; SF_LZ4_MODE selects LZ4 rather than LZO.
  */
-static int save_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+static int save_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_write,
+                                 unsigned int flags)
 {
 	unsigned int m;
 	int ret = 0;
@@ -661,7 +673,8 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	unsigned thr, run_threads, nr_threads;
 	unsigned char *page = NULL;
 	struct cmp_data *data = NULL;
-	struct crc_data *crc = NULL;
+	bool lz4 = flags & SF_LZ4_MODE;
+	const char *alg = lz4 ? "LZ4" : "LZO";
 
 	hib_init_batch(&hb);
 
@@ -674,27 +687,21 @@ static int save_image_lzo(struct swap_map_handle *handle,
 
 	page = (void *)__get_free_page(__GFP_RECLAIM | __GFP_HIGH);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate %s page\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate %s data\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct cmp_data, go));
-
-	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
-	if (!crc) {
-		printk(KERN_ERR "PM: Failed to allocate crc\n");
-		ret = -ENOMEM;
-		goto out_clean;
+		data[thr].lz4 = lz4;
 	}
-	memset(crc, 0, offsetof(struct crc_data, go));
 
 	/*
 	 * Start the compression threads.
@@ -703,7 +710,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_compress_threadfn,
+		data[thr].thr = kthread_run(compress_threadfn,
 		                            &data[thr],
 		                            "image_compress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -715,26 +722,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 
-	/*
-	 * Start the CRC32 thread.
-	 */
-	init_waitqueue_head(&crc->go);
-	init_waitqueue_head(&crc->done);
-
 	handle->crc32 = 0;
-	crc->crc32 = &handle->crc32;
-	for (thr = 0; thr < nr_threads; thr++) {
-		crc->unc[thr] = data[thr].unc;
-		crc->unc_len[thr] = &data[thr].unc_len;
-	}
-
-	crc->thr = kthread_run(crc32_threadfn, crc, "image_crc32");
-	if (IS_ERR(crc->thr)) {
-		crc->thr = NULL;
-		printk(KERN_ERR "PM: Cannot start CRC32 thread\n");
-		ret = -ENOMEM;
-		goto out_clean;
-	}
 
 	/*
 	 * Adjust the number of required free pages after all allocations have
@@ -743,9 +731,9 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	handle->reqd_free_pages = reqd_free_pages();
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for compression.\n"
+		"PM: Using %u thread(s) for %s compression.\n"
 		"PM: Compressing and saving image data (%u pages)...\n",
-		nr_threads, nr_to_write);
+		nr_threads, alg, nr_to_write);
 	m = nr_to_write / 10;
 	if (!m)
 		m = 1;
@@ -783,10 +771,6 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		if (!thr)
 			break;
 
-		crc->run_threads = thr;
-		atomic_set(&crc->ready, 1);
-		wake_up(&crc->go);
-
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
@@ -795,7 +779,8 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				printk(KERN_ERR "PM: LZO compression failed\n");
+				printk(KERN_ERR "PM: %s compression failed\n",
+				       alg);
 				goto out_finish;
 			}
 
@@ -803,11 +788,16 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			             data[thr].cmp_len >
 			             lzo1x_worst_compress(data[thr].unc_len))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       alg);
 				ret = -1;
 				goto out_finish;
 			}
 
+			handle->crc32 = crc32_le_combine(handle->crc32,
+			                                 data[thr].crc32,
+			                                 data[thr].unc_len);
+
 			*(size_t *)data[thr].cmp = data[thr].cmp_len;
 
 			/*
@@ -828,9 +818,6 @@ static int save_image_lzo(struct swap_map_handle *handle,
 					goto out_finish;
 			}
 		}
-
-		wait_event(crc->done, atomic_read(&crc->stop));
-		atomic_set(&crc->stop, 0);
 	}
 
 out_finish:
@@ -842,11 +829,6 @@ out_finish:
 		printk(KERN_INFO "PM: Image saving done.\n");
 	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
 out_clean:
-	if (crc) {
-		if (crc->thr)
-			kthread_stop(crc->thr);
-		kfree(crc);
-	}
 	if (data) {
 		for (thr = 0; thr < nr_threads; thr++)
 			if (data[thr].thr)
@@ -920,7 +902,8 @@ int swsusp_write(unsigned int flags)
 	if (!error) {
 		error = (flags & SF_NOCOMPRESS_MODE) ?
 			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+			save_compressed_image(&handle, &snapshot, pages - 1,
+					      flags);
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1087,25 +1070,28 @@ static int load_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for LZO/LZ4 data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	bool lz4;                                 /* LZ4 instead of LZO */
 	wait_queue_head_t go;                     /* start decompression */
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
+	u32 crc32;                                /* crc32 of unc, 0 seeded */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
 };
 
 /**
- * Deompression function that runs in its own thread.
+ * Decompression function that runs in its own thread, see
+ * compress_threadfn() for the CRC32.
  */
-static int lzo_decompress_threadfn(void *data)
+static int decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
 
@@ -1122,8 +1108,16 @@ static int lzo_decompress_threadfn(void *data)
 		atomic_set(&d->ready, 0);
 
 		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		if (d->lz4)
+			d->ret = lz4_decompress_unknownoutputsize(
+					d->cmp + LZO_HEADER, d->cmp_len,
+					d->unc, &d->unc_len);
+		else
+			d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER,
+			                               d->cmp_len,
+			                               d->unc, &d->unc_len);
+		if (!d->ret)
+			d->crc32 = crc32_le(0, d->unc, d->unc_len);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -1131,14 +1125,16 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_compressed_image - Load compressed image data and decompress them.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
+ *
+ * The algorithm, LZO or LZ4, is the one recorded in the image header.
  */
-static int load_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_read)
+static int load_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_read)
 {
 	unsigned int m;
 	int ret = 0;
@@ -1154,7 +1150,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	unsigned long read_pages = 0;
 	unsigned char **page = NULL;
 	struct dec_data *data = NULL;
-	struct crc_data *crc = NULL;
+	bool lz4 = swsusp_header->flags & SF_LZ4_MODE;
+	const char *alg = lz4 ? "LZ4" : "LZO";
 
 	hib_init_batch(&hb);
 
@@ -1167,27 +1164,21 @@ static int load_image_lzo(struct swap_map_handle *handle,
 
 	page = vmalloc(sizeof(*page) * LZO_MAX_RD_PAGES);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate %s page\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate %s data\n", alg);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct dec_data, go));
-
-	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
-	if (!crc) {
-		printk(KERN_ERR "PM: Failed to allocate crc\n");
-		ret = -ENOMEM;
-		goto out_clean;
+		data[thr].lz4 = lz4;
 	}
-	memset(crc, 0, offsetof(struct crc_data, go));
 
 	/*
 	 * Start the decompression threads.
@@ -1196,7 +1187,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_decompress_threadfn,
+		data[thr].thr = kthread_run(decompress_threadfn,
 		                            &data[thr],
 		                            "image_decompress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -1208,26 +1199,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 
-	/*
-	 * Start the CRC32 thread.
-	 */
-	init_waitqueue_head(&crc->go);
-	init_waitqueue_head(&crc->done);
-
 	handle->crc32 = 0;
-	crc->crc32 = &handle->crc32;
-	for (thr = 0; thr < nr_threads; thr++) {
-		crc->unc[thr] = data[thr].unc;
-		crc->unc_len[thr] = &data[thr].unc_len;
-	}
-
-	crc->thr = kthread_run(crc32_threadfn, crc, "image_crc32");
-	if (IS_ERR(crc->thr)) {
-		crc->thr = NULL;
-		printk(KERN_ERR "PM: Cannot start CRC32 thread\n");
-		ret = -ENOMEM;
-		goto out_clean;
-	}
 
 	/*
 	 * Set the number of pages for read buffering.
@@ -1250,7 +1222,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			if (i < LZO_CMP_PAGES) {
 				ring_size = i;
 				printk(KERN_ERR
-				       "PM: Failed to allocate LZO pages\n");
+				       "PM: Failed to allocate %s pages\n",
+				       alg);
 				ret = -ENOMEM;
 				goto out_clean;
 			} else {
@@ -1261,9 +1234,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	want = ring_size = i;
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for decompression.\n"
+		"PM: Using %u thread(s) for %s decompression.\n"
 		"PM: Loading and decompressing image data (%u pages)...\n",
-		nr_threads, nr_to_read);
+		nr_threads, alg, nr_to_read);
 	m = nr_to_read / 10;
 	if (!m)
 		m = 1;
@@ -1312,19 +1285,14 @@ static int load_image_lzo(struct swap_map_handle *handle,
 				eof = 2;
 		}
 
-		if (crc->run_threads) {
-			wait_event(crc->done, atomic_read(&crc->stop));
-			atomic_set(&crc->stop, 0);
-			crc->run_threads = 0;
-		}
-
 		for (thr = 0; have && thr < nr_threads; thr++) {
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
 			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       alg);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1376,7 +1344,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 
 			if (ret < 0) {
 				printk(KERN_ERR
-				       "PM: LZO decompression failed\n");
+				       "PM: %s decompression failed\n", alg);
 				goto out_finish;
 			}
 
@@ -1384,11 +1352,16 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			             data[thr].unc_len > LZO_UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO uncompressed length\n");
+				       "PM: Invalid %s uncompressed length\n",
+				       alg);
 				ret = -1;
 				goto out_finish;
 			}
 
+			handle->crc32 = crc32_le_combine(handle->crc32,
+			                                 data[thr].crc32,
+			                                 data[thr].unc_len);
+
 			for (off = 0;
 			     off < data[thr].unc_len; off += PAGE_SIZE) {
 				memcpy(data_of(*snapshot),
@@ -1402,25 +1375,15 @@ static int load_image_lzo(struct swap_map_handle *handle,
 				nr_pages++;
 
 				ret = snapshot_write_next(snapshot);
-				if (ret <= 0) {
-					crc->run_threads = thr + 1;
-					atomic_set(&crc->ready, 1);
-					wake_up(&crc->go);
+				if (ret <= 0)
 					goto out_finish;
-				}
 			}
 		}
-
-		crc->run_threads = thr;
-		atomic_set(&crc->ready, 1);
-		wake_up(&crc->go);
 	}
 
 out_finish:
-	if (crc->run_threads) {
-		wait_event(crc->done, atomic_read(&crc->stop));
-		atomic_set(&crc->stop, 0);
-	}
+	/* don't free the ring or the batch under reads still in flight */
+	hib_wait_io(&hb);
 	stop = ktime_get();
 	if (!ret) {
 		printk(KERN_INFO "PM: Image loading done.\n");
@@ -1441,11 +1404,6 @@ out_finish:
 out_clean:
 	for (i = 0; i < ring_size; i++)
 		free_page((unsigned long)page[i]);
-	if (crc) {
-		if (crc->thr)
-			kthread_stop(crc->thr);
-		kfree(crc);
-	}
 	if (data) {
 		for (thr = 0; thr < nr_threads; thr++)
 			if (data[thr].thr)
@@ -1483,7 +1441,8 @@ int swsusp_read(unsigned int *flags_p)
 	if (!error) {
 		error = (*flags_p & SF_NOCOMPRESS_MODE) ?
 			load_image(&handle, &snapshot, header->pages - 1) :
-			load_image_lzo(&handle, &snapshot, header->pages - 1);
+			load_compressed_image(&handle, &snapshot,
+					      header->pages - 1);
 	}
 	swap_reader_finish(&handle);
 end:
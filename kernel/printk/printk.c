@@ -43,6 +43,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -1534,6 +1535,37 @@ static int console_trylock_for_printk(void)
 	return 1;
 }
 
+/*
+ * Unless printk.synchronous is set, printk() only stores the message and
+ * leaves printing it on the consoles to printk_kthread, so that whoever
+ * calls printk() is not stuck behind a slow console while other CPUs keep
+ * adding messages.  Oopses and panics, and anything before the kthread is
+ * up or once the system is going down, are still printed right away.  So
+ * are critical messages, and messages from NMI or with interrupts off: the
+ * CPU may be about to hang, and neither the kthread nor the irq_work that
+ * wakes it can be relied on to run.
+ */
+static bool __read_mostly printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(synchronous, "make printing to console synchronous");
+
+static struct task_struct *printk_kthread;
+static bool printk_kthread_need_flush;
+
+static bool printk_offload(void)
+{
+	return !printk_sync && printk_kthread && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+static bool printk_offload_emit(int level)
+{
+	return printk_offload() && level > LOGLEVEL_CRIT &&
+	       !in_nmi() && !irqs_disabled();
+}
+
+static void printk_queue_output(void);
+
 int printk_delay_msec __read_mostly;
 
 static inline void printk_delay(void)
@@ -1805,8 +1837,14 @@ asmlinkage int vprintk_emit(int facility, int level,
 	lockdep_on();
 	local_irq_restore(flags);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	/*
+	 * If called from the scheduler, we can not call up().  The printk
+	 * kthread is woken through irq_work, as the caller may hold
+	 * scheduler locks without being marked in_sched.
+	 */
+	if (!in_sched && printk_offload_emit(level)) {
+		printk_queue_output();
+	} else if (!in_sched) {
 		lockdep_off();
 		/*
 		 * Disable preemption to avoid being preempted while holding
@@ -2719,9 +2757,13 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
-		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_offload()) {
+			printk_kthread_need_flush = true;
+			wake_up_process(printk_kthread);
+		} else if (console_trylock()) {
+			/* If trylock fails, someone else is doing the printing */
 			console_unlock();
+		}
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
@@ -2753,12 +2795,51 @@ int printk_deferred(const char *fmt, ...)
 	r = vprintk_emit(0, LOGLEVEL_SCHED, NULL, 0, fmt, args);
 	va_end(args);
 
+	printk_queue_output();
+	preempt_enable();
+
+	return r;
+}
+
+static void printk_queue_output(void)
+{
+	preempt_disable();
 	__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
 	irq_work_queue(this_cpu_ptr(&wake_up_klogd_work));
 	preempt_enable();
+}
 
-	return r;
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_kthread_need_flush)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* anything stored after this is printed below or wakes us again */
+		printk_kthread_need_flush = false;
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init init_printk_kthread(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(task)) {
+		pr_err("printk: unable to create printing thread\n");
+		return PTR_ERR(task);
+	}
+	printk_kthread = task;
+
+	return 0;
 }
+late_initcall(init_printk_kthread);
 
 /*
  * printk rate limiting, lifted from the networking subsystem.
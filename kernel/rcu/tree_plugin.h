@@ -27,6 +27,7 @@
 #include <linux/delay.h>
 #include <linux/gfp.h>
 #include <linux/oom.h>
+#include <linux/shrinker.h>
 #include <linux/smpboot.h>
 #include "../time/tick-internal.h"
 
@@ -59,6 +60,7 @@ DEFINE_PER_CPU(char, rcu_cpu_has_work);
 static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
 static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
 static bool __read_mostly rcu_nocb_poll;    /* Offload kthread are to poll. */
+static bool rcu_nocb_leader_per_node;	    /* Group rcuo kthreads by node. */
 #endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 
 /*
@@ -1818,6 +1820,18 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/*
+ * A no-CBs CPU that has queued only lazy (kfree_rcu()) callbacks does
+ * not wake its rcuo kthreads for up to this many jiffies, so that the
+ * callbacks can be handled in bulk with the next non-lazy callback.
+ * Memory pressure flushes them early, see rcu_nocb_lazy_shrink_scan().
+ * Zero disables the deferral.
+ */
+#define RCU_NOCB_LAZY_DELAY (10 * HZ)	/* Roughly ten seconds. */
+
+static int rcu_nocb_lazy_delay = RCU_NOCB_LAZY_DELAY;
+module_param(rcu_nocb_lazy_delay, int, 0644);
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -1933,6 +1947,7 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 				    unsigned long flags)
 {
 	int len;
+	bool lazy = rhcount == rhcount_lazy;
 	struct rcu_head **old_rhpp;
 	struct task_struct *t;
 
@@ -1952,7 +1967,18 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 		return;
 	}
 	len = atomic_long_read(&rdp->nocb_q_count);
-	if (old_rhpp == &rdp->nocb_head) {
+	if (old_rhpp == &rdp->nocb_head && lazy && rcu_nocb_lazy_delay > 0) {
+		/* ... unless the queue holds only lazy callbacks ... */
+		WRITE_ONCE(rdp->nocb_lazy_pending, true);
+		if (!timer_pending(&rdp->nocb_lazy_timer))
+			mod_timer(&rdp->nocb_lazy_timer,
+				  jiffies + rcu_nocb_lazy_delay);
+		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+				    TPS("WakeLazy"));
+		rdp->qlen_last_fqs_check = 0;
+	} else if (old_rhpp == &rdp->nocb_head ||
+		   (!lazy && READ_ONCE(rdp->nocb_lazy_pending))) {
+		WRITE_ONCE(rdp->nocb_lazy_pending, false);
 		if (!irqs_disabled_flags(flags)) {
 			/* ... if queue was empty ... */
 			wake_nocb_leader(rdp, false);
@@ -2305,6 +2331,67 @@ static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("DeferredWake"));
 }
 
+/*
+ * Wake the rcuo kthreads for a no-CBs CPU whose lazy callbacks have
+ * been held back, returning the number of lazy callbacks so released.
+ */
+static unsigned long rcu_nocb_flush_lazy(struct rcu_data *rdp)
+{
+	if (!READ_ONCE(rdp->nocb_lazy_pending))
+		return 0;
+	WRITE_ONCE(rdp->nocb_lazy_pending, false);
+	wake_nocb_leader(rdp, false);
+	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("LazyWake"));
+	return atomic_long_read(&rdp->nocb_q_count_lazy);
+}
+
+/* The lazy-callback delay for this no-CBs CPU has expired. */
+static void do_nocb_lazy_timer(unsigned long x)
+{
+	rcu_nocb_flush_lazy((struct rcu_data *)x);
+}
+
+/*
+ * Report held-back lazy callbacks to the shrinker, and flush them all
+ * when asked to.  Each lazy callback typically frees memory via
+ * kfree_rcu(), so there is no point in sitting on them under pressure.
+ */
+static unsigned long
+rcu_nocb_lazy_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long count = 0;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+
+	for_each_rcu_flavor(rsp)
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (READ_ONCE(rdp->nocb_lazy_pending))
+				count += atomic_long_read(&rdp->nocb_q_count_lazy);
+		}
+	return count;
+}
+
+static unsigned long
+rcu_nocb_lazy_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long count = 0;
+	struct rcu_state *rsp;
+
+	for_each_rcu_flavor(rsp)
+		for_each_cpu(cpu, rcu_nocb_mask)
+			count += rcu_nocb_flush_lazy(per_cpu_ptr(rsp->rda, cpu));
+	return count ? count : SHRINK_STOP;
+}
+
+static struct shrinker rcu_nocb_lazy_shrinker = {
+	.count_objects = rcu_nocb_lazy_shrink_count,
+	.scan_objects = rcu_nocb_lazy_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 void __init rcu_init_nohz(void)
 {
 	int cpu;
@@ -2366,6 +2453,24 @@ static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
 	rdp->nocb_tail = &rdp->nocb_head;
 	init_waitqueue_head(&rdp->nocb_wq);
 	rdp->nocb_follower_tail = &rdp->nocb_follower_head;
+	setup_timer(&rdp->nocb_lazy_timer, do_nocb_lazy_timer,
+		    (unsigned long)rdp);
+}
+
+/*
+ * With rcu_nocb_leader_per_node, keep the rcuo kthreads serving a node's
+ * no-CBs CPUs on that node's remaining (housekeeping) CPUs, if it has any.
+ */
+static void rcu_nocb_affine_node(struct task_struct *t, int cpu)
+{
+	cpumask_var_t cm;
+
+	if (!rcu_nocb_leader_per_node || !zalloc_cpumask_var(&cm, GFP_KERNEL))
+		return;
+	cpumask_andnot(cm, cpumask_of_node(cpu_to_node(cpu)), rcu_nocb_mask);
+	if (cpumask_intersects(cm, cpu_online_mask))
+		set_cpus_allowed_ptr(t, cm);
+	free_cpumask_var(cm);
 }
 
 /*
@@ -2413,6 +2518,7 @@ static void rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu)
 	t = kthread_run(rcu_nocb_kthread, rdp_spawn,
 			"rcuo%c/%d", rsp->abbr, cpu);
 	BUG_ON(IS_ERR(t));
+	rcu_nocb_affine_node(t, cpu);
 	WRITE_ONCE(rdp_spawn->nocb_kthread, t);
 }
 
@@ -2441,38 +2547,44 @@ static void __init rcu_spawn_nocb_kthreads(void)
 
 	for_each_online_cpu(cpu)
 		rcu_spawn_all_nocb_kthreads(cpu);
+	if (have_rcu_nocb_mask)
+		register_shrinker(&rcu_nocb_lazy_shrinker);
 }
 
 /* How many follower CPU IDs per leader?  Default of -1 for sqrt(nr_cpu_ids). */
 static int rcu_nocb_leader_stride = -1;
 module_param(rcu_nocb_leader_stride, int, 0444);
+module_param(rcu_nocb_leader_per_node, bool, 0444);
 
 /*
- * Initialize leader-follower relationships for all no-CBs CPU.
+ * Initialize leader-follower relationships for the no-CBs CPUs on the
+ * specified node, or for all of them if node is NUMA_NO_NODE.  Within a
+ * node, every ls-th no-CBs CPU becomes a leader.
  */
-static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
+static void __init rcu_organize_nocb_group(struct rcu_state *rsp,
+					   int node, int ls)
 {
 	int cpu;
-	int ls = rcu_nocb_leader_stride;
+	int n = 0;
 	int nl = 0;  /* Next leader. */
+	bool leader;
 	struct rcu_data *rdp;
 	struct rcu_data *rdp_leader = NULL;  /* Suppress misguided gcc warn. */
 	struct rcu_data *rdp_prev = NULL;
 
-	if (!have_rcu_nocb_mask)
-		return;
-	if (ls == -1) {
-		ls = int_sqrt(nr_cpu_ids);
-		rcu_nocb_leader_stride = ls;
-	}
-
 	/*
 	 * Each pass through this loop sets up one rcu_data structure and
 	 * spawns one rcu_nocb_kthread().
 	 */
 	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (node != NUMA_NO_NODE && cpu_to_node(cpu) != node)
+			continue;
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (rdp->cpu >= nl) {
+		if (node == NUMA_NO_NODE)
+			leader = rdp->cpu >= nl;
+		else
+			leader = !(n++ % ls);
+		if (leader) {
 			/* New leader, set up for followers & next leader. */
 			nl = DIV_ROUND_UP(rdp->cpu + 1, ls) * ls;
 			rdp->nocb_leader = rdp;
@@ -2486,6 +2598,33 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 	}
 }
 
+/*
+ * Initialize leader-follower relationships for all no-CBs CPU.  With
+ * rcu_nocb_leader_per_node, groups never span NUMA nodes, and unless
+ * rcu_nocb_leader_stride says otherwise each node gets a single leader,
+ * which waits for grace periods on behalf of that whole node.
+ */
+static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
+{
+	int node;
+	int ls = rcu_nocb_leader_stride;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	if (rcu_nocb_leader_per_node) {
+		if (ls <= 0)
+			ls = nr_cpu_ids;
+		for_each_node(node)
+			rcu_organize_nocb_group(rsp, node, ls);
+		return;
+	}
+	if (ls == -1) {
+		ls = int_sqrt(nr_cpu_ids);
+		rcu_nocb_leader_stride = ls;
+	}
+	rcu_organize_nocb_group(rsp, NUMA_NO_NODE, ls);
+}
+
 /* Prevent __call_rcu() from enqueuing callbacks on no-CBs CPUs */
 static bool init_nocb_callback_list(struct rcu_data *rdp)
 {
@@ -768,7 +768,8 @@ void sched_avg_update(struct rq *rq)
 #endif /* CONFIG_SMP */
 
 #if defined(CONFIG_RT_GROUP_SCHED) || (defined(CONFIG_FAIR_GROUP_SCHED) && \
-			(defined(CONFIG_SMP) || defined(CONFIG_CFS_BANDWIDTH)))
+			(defined(CONFIG_SMP) || defined(CONFIG_CFS_BANDWIDTH))) || \
+	defined(CONFIG_SCHED_CORE)
 /*
  * Iterate task_group tree rooted at *from, calling @down when first entering a
  * node and @up when leaving it for the final time.
@@ -830,11 +831,246 @@ static void set_load_weight(struct task_struct *p)
 	load->inv_weight = prio_to_wmult[prio];
 }
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Utilization clamping.  Each task has a min and a max clamp, asked for
+ * with sched_setattr() and bounded by its task group's effective clamps;
+ * the clamps of the tasks enqueued on a rq, of any class, are aggregated
+ * as the largest value per clamp in rq->uclamp[].  uclamp_cpu_util()
+ * applies the aggregate to a utilization, for cpufreq governors to use.
+ */
+static DEFINE_MUTEX(uclamp_mutex);
+
+static inline unsigned int uclamp_none(enum uclamp_id clamp_id)
+{
+	return clamp_id == UCLAMP_MIN ? 0 : SCHED_CAPACITY_SCALE;
+}
+
+static inline unsigned int uclamp_bucket_id(unsigned int value)
+{
+	return min_t(unsigned int, value / UCLAMP_BUCKET_DELTA,
+		     UCLAMP_BUCKETS - 1);
+}
+
+static inline void uclamp_se_set(struct uclamp_se *uc_se, unsigned int value,
+				 bool user_defined)
+{
+	uc_se->value = value;
+	uc_se->bucket_id = uclamp_bucket_id(value);
+	uc_se->user_defined = user_defined;
+}
+
+static unsigned int uclamp_tg_restrict(struct task_struct *p,
+				       enum uclamp_id clamp_id)
+{
+	unsigned int value = p->uclamp_req[clamp_id].value;
+#ifdef CONFIG_CGROUP_SCHED
+	struct task_group *tg = task_group(p);
+
+	/* the root group and autogroups do not restrict their tasks */
+	if (tg != &root_task_group && !task_group_is_autogroup(tg))
+		value = clamp(value, tg->uclamp[UCLAMP_MIN].value,
+			      tg->uclamp[UCLAMP_MAX].value);
+#endif
+	return value;
+}
+
+unsigned int uclamp_eff_value(struct task_struct *p, enum uclamp_id clamp_id)
+{
+	if (p->uclamp[clamp_id].active)
+		return p->uclamp[clamp_id].value;
+
+	return uclamp_tg_restrict(p, clamp_id);
+}
+
+static unsigned int uclamp_rq_max_value(struct rq *rq, enum uclamp_id clamp_id)
+{
+	struct uclamp_bucket *bucket = rq->uclamp[clamp_id].bucket;
+	int bucket_id;
+
+	for (bucket_id = UCLAMP_BUCKETS - 1; bucket_id >= 0; bucket_id--) {
+		if (bucket[bucket_id].tasks)
+			return bucket[bucket_id].value;
+	}
+
+	return 0;
+}
+
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+		struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+		struct uclamp_bucket *bucket;
+
+		uclamp_se_set(uc_se, uclamp_tg_restrict(p, clamp_id),
+			      p->uclamp_req[clamp_id].user_defined);
+		uc_se->active = 1;
+
+		bucket = &uc_rq->bucket[uc_se->bucket_id];
+		if (!bucket->tasks++ || uc_se->value > bucket->value)
+			bucket->value = uc_se->value;
+		if (uc_se->value > uc_rq->value)
+			WRITE_ONCE(uc_rq->value, uc_se->value);
+	}
+}
+
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+		struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+		struct uclamp_bucket *bucket;
+
+		if (!uc_se->active)
+			continue;
+		uc_se->active = 0;
+
+		bucket = &uc_rq->bucket[uc_se->bucket_id];
+		WARN_ON_ONCE(!bucket->tasks);
+		if (--bucket->tasks)
+			continue;
+		if (bucket->value >= uc_rq->value)
+			WRITE_ONCE(uc_rq->value,
+				   uclamp_rq_max_value(rq, clamp_id));
+	}
+}
+
+/**
+ * uclamp_cpu_util - apply a cpu's utilization clamps
+ * @cpu: the cpu @util was measured on
+ * @util: a utilization on the SCHED_CAPACITY_SCALE range
+ *
+ * Return: @util, raised to the largest min clamp and capped at the
+ * largest max clamp of the tasks currently enqueued on @cpu.  @util is
+ * returned unchanged while nothing is enqueued.
+ */
+unsigned long uclamp_cpu_util(int cpu, unsigned long util)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long min = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned long max = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	if (!max)
+		return util;
+
+	return clamp(util, min, max);
+}
+EXPORT_SYMBOL_GPL(uclamp_cpu_util);
+
+static int uclamp_validate(struct task_struct *p, const struct sched_attr *attr)
+{
+	unsigned int lower = p->uclamp_req[UCLAMP_MIN].value;
+	unsigned int upper = p->uclamp_req[UCLAMP_MAX].value;
+
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		lower = attr->sched_util_min;
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		upper = attr->sched_util_max;
+
+	if (upper > SCHED_CAPACITY_SCALE || lower > upper)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void __setscheduler_uclamp(struct task_struct *p,
+				  const struct sched_attr *attr)
+{
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		uclamp_se_set(&p->uclamp_req[UCLAMP_MIN],
+			      attr->sched_util_min, true);
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		uclamp_se_set(&p->uclamp_req[UCLAMP_MAX],
+			      attr->sched_util_max, true);
+}
+
+static void uclamp_fork(struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		p->uclamp[clamp_id].active = 0;
+		if (unlikely(p->sched_reset_on_fork))
+			uclamp_se_set(&p->uclamp_req[clamp_id],
+				      uclamp_none(clamp_id), false);
+	}
+}
+
+#ifdef CONFIG_CGROUP_SCHED
+static void tg_uclamp_init(struct task_group *tg)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		uclamp_se_set(&tg->uclamp_req[clamp_id],
+			      uclamp_none(clamp_id), false);
+		tg->uclamp[clamp_id] = tg->uclamp_req[clamp_id];
+	}
+}
+
+/*
+ * A group can neither boost nor allow more than its parent does.
+ * Called with uclamp_mutex held.
+ */
+static void tg_uclamp_update_eff(struct task_group *tg,
+				 struct task_group *parent)
+{
+	unsigned int max = min(tg->uclamp_req[UCLAMP_MAX].value,
+			       parent->uclamp[UCLAMP_MAX].value);
+	unsigned int min = min3(tg->uclamp_req[UCLAMP_MIN].value,
+				parent->uclamp[UCLAMP_MIN].value, max);
+
+	uclamp_se_set(&tg->uclamp[UCLAMP_MIN], min, false);
+	uclamp_se_set(&tg->uclamp[UCLAMP_MAX], max, false);
+}
+#endif
+
+static void __init init_uclamp(void)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		uclamp_se_set(&init_task.uclamp_req[clamp_id],
+			      uclamp_none(clamp_id), false);
+#ifdef CONFIG_CGROUP_SCHED
+		/* the root group allows any clamp its descendants ask for */
+		uclamp_se_set(&root_task_group.uclamp_req[clamp_id],
+			      uclamp_none(UCLAMP_MAX), false);
+		root_task_group.uclamp[clamp_id] =
+			root_task_group.uclamp_req[clamp_id];
+#endif
+	}
+}
+#else
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p) { }
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p) { }
+
+static inline int uclamp_validate(struct task_struct *p,
+				  const struct sched_attr *attr)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void __setscheduler_uclamp(struct task_struct *p,
+					 const struct sched_attr *attr) { }
+static inline void uclamp_fork(struct task_struct *p) { }
+static inline void init_uclamp(void) { }
+#ifdef CONFIG_CGROUP_SCHED
+static inline void tg_uclamp_init(struct task_group *tg) { }
+#endif
+#endif /* CONFIG_UCLAMP_TASK */
+
 static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	if (!(flags & ENQUEUE_RESTORE))
 		sched_info_queued(rq, p);
+	uclamp_rq_inc(rq, p);
 	p->sched_class->enqueue_task(rq, p, flags);
 }
 
@@ -843,6 +1079,7 @@ static inline void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 	update_rq_clock(rq);
 	if (!(flags & DEQUEUE_SAVE))
 		sched_info_dequeued(rq, p);
+	uclamp_rq_dec(rq, p);
 	p->sched_class->dequeue_task(rq, p, flags);
 }
 
@@ -1789,24 +2026,38 @@ static int ttwu_remote(struct task_struct *p, int wake_flags)
 void sched_ttwu_pending(void)
 {
 	struct rq *rq = this_rq();
-	struct llist_node *llist = llist_del_all(&rq->wake_list);
+	struct llist_node *llist;
 	struct task_struct *p;
 	unsigned long flags;
 
-	if (!llist)
-		return;
+	for (;;) {
+		llist = llist_del_all(&rq->wake_list);
+		if (!llist) {
+			if (!READ_ONCE(rq->wake_ipi_pending))
+				return;
+			/*
+			 * Wakers that found wake_ipi_pending set relied on
+			 * us to see their entries; clear it and look again.
+			 * Pairs with the xchg() in ttwu_queue_remote().
+			 */
+			WRITE_ONCE(rq->wake_ipi_pending, 0);
+			smp_mb();
+			continue;
+		}
 
-	raw_spin_lock_irqsave(&rq->lock, flags);
-	lockdep_pin_lock(&rq->lock);
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		lockdep_pin_lock(&rq->lock);
 
-	while (llist) {
-		p = llist_entry(llist, struct task_struct, wake_entry);
-		llist = llist_next(llist);
-		ttwu_do_activate(rq, p, 0);
-	}
+		while (llist) {
+			p = llist_entry(llist, struct task_struct, wake_entry);
+			llist = llist_next(llist);
+			ttwu_do_activate(rq, p, 0);
+			schedstat_inc(rq, ttwu_wake_list);
+		}
 
-	lockdep_unpin_lock(&rq->lock);
-	raw_spin_unlock_irqrestore(&rq->lock, flags);
+		lockdep_unpin_lock(&rq->lock);
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
 }
 
 void scheduler_ipi(void)
@@ -1818,7 +2069,8 @@ void scheduler_ipi(void)
 	 */
 	preempt_fold_need_resched();
 
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	if (llist_empty(&this_rq()->wake_list) &&
+	    !READ_ONCE(this_rq()->wake_ipi_pending) && !got_nohz_idle_kick())
 		return;
 
 	/*
@@ -1847,16 +2099,31 @@ void scheduler_ipi(void)
 	irq_exit();
 }
 
+/*
+ * Only the waker that finds the wake_list empty has to notify @cpu, and
+ * not even that one if @cpu polls for need_resched or already has an IPI
+ * pending: wake_ipi_pending stays set until the target has drained its
+ * list and looked at it once more, so a burst of wakeups aimed at one
+ * cpu costs one IPI however its entries interleave with the draining.
+ */
 static void ttwu_queue_remote(struct task_struct *p, int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
 
-	if (llist_add(&p->wake_entry, &cpu_rq(cpu)->wake_list)) {
-		if (!set_nr_if_polling(rq->idle))
-			smp_send_reschedule(cpu);
-		else
-			trace_sched_wake_idle_without_ipi(cpu);
+	if (!llist_add(&p->wake_entry, &rq->wake_list))
+		return;
+
+	if (set_nr_if_polling(rq->idle)) {
+		trace_sched_wake_idle_without_ipi(cpu);
+		return;
 	}
+
+	/* llist_add() is a full barrier; pairs with sched_ttwu_pending() */
+	if (sched_feat(TTWU_COALESCE) && xchg(&rq->wake_ipi_pending, 1))
+		return;
+
+	smp_send_reschedule(cpu);
+	schedstat_inc(this_rq(), ttwu_ipi_sent);
 }
 
 void wake_up_if_idle(int cpu)
@@ -2227,6 +2494,8 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 	 */
 	p->prio = current->normal_prio;
 
+	uclamp_fork(p);
+
 	/*
 	 * Revert to default priority/policy on fork if requested.
 	 */
@@ -2894,6 +3163,7 @@ void scheduler_tick(void)
 	raw_spin_lock(&rq->lock);
 	update_rq_clock(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	sched_core_tick(rq);
 	update_cpu_load_active(rq);
 	calc_global_load_tick(rq);
 	raw_spin_unlock(&rq->lock);
@@ -3087,6 +3357,165 @@ again:
 	BUG(); /* the idle class will always have a runnable task */
 }
 
+#ifdef CONFIG_SCHED_CORE
+/*
+ * Core scheduling.  Tasks of a cpu cgroup with cpu.core_tag set carry
+ * that group's cookie, all other tasks carry cookie 0.  SMT siblings
+ * only run CFS tasks with equal cookies at the same time: when the task
+ * a cpu picked does not match what a sibling is running, the cpu runs
+ * its idle task instead ("forced idle") until the sibling switches.  To
+ * keep one tag from starving another, a sibling that has been forced
+ * idle for longer than sched_core_forceidle_ns makes the others yield
+ * the core at their next pick; scheduler_tick() makes sure that pick
+ * comes.
+ *
+ * Decisions for a core are serialized by the core_lock of its first
+ * sibling, nested inside the deciding cpu's own rq->lock.  Sibling rqs
+ * are never locked; a forced idle cpu is prodded by setting need_resched
+ * on its idle task.
+ */
+DEFINE_STATIC_KEY_FALSE(__sched_core_enabled);
+static DEFINE_MUTEX(sched_core_mutex);
+static int sched_core_count;	/* tagged groups */
+
+static const u64 sched_core_forceidle_ns = 4 * NSEC_PER_MSEC;
+
+static inline bool sched_core_enabled(void)
+{
+	return static_branch_unlikely(&__sched_core_enabled);
+}
+
+static inline unsigned long sched_core_cookie(struct task_struct *p)
+{
+	return READ_ONCE(task_group(p)->core_cookie);
+}
+
+static void sched_core_kick(struct rq *srq)
+{
+	if (set_nr_and_not_polling(srq->idle))
+		smp_send_reschedule(cpu_of(srq));
+}
+
+/* Is some sibling kept idle too long by a cookie other than @cookie? */
+static bool sched_core_starving(int cpu, unsigned long cookie, u64 now)
+{
+	int sibling;
+
+	for_each_cpu(sibling, cpu_smt_mask(cpu)) {
+		struct rq *srq = cpu_rq(sibling);
+
+		if (sibling == cpu || !READ_ONCE(srq->core_wait))
+			continue;
+		if (READ_ONCE(srq->core_wait_cookie) != cookie &&
+		    now - READ_ONCE(srq->core_wait_start) >
+		    sched_core_forceidle_ns)
+			return true;
+	}
+	return false;
+}
+
+static struct task_struct *sched_core_pick(struct rq *rq,
+					   struct task_struct *next)
+{
+	int cpu = cpu_of(rq), sibling;
+	struct rq *core;
+	unsigned long cookie;
+	bool idle, force = false;
+	u64 now;
+
+	if (!sched_core_enabled())
+		return next;
+
+	core = cpu_rq(cpumask_first(cpu_smt_mask(cpu)));
+	idle = next == rq->idle;
+	cookie = idle ? 0 : sched_core_cookie(next);
+	now = local_clock();
+
+	raw_spin_lock(&core->core_lock);
+	if (!idle && next->sched_class == &fair_sched_class) {
+		for_each_cpu(sibling, cpu_smt_mask(cpu)) {
+			struct rq *srq = cpu_rq(sibling);
+
+			if (sibling != cpu && srq->core_running &&
+			    srq->core_cookie != cookie) {
+				force = true;
+				break;
+			}
+		}
+		if (!force)
+			force = sched_core_starving(cpu, cookie, now);
+	}
+
+	if (force) {
+		if (!rq->core_wait || rq->core_wait_cookie != cookie) {
+			rq->core_wait = 1;
+			rq->core_wait_cookie = cookie;
+			rq->core_wait_start = now;
+		}
+		/* puts @next back on its runqueue */
+		next = idle_sched_class.pick_next_task(rq, next);
+		idle = true;
+	} else {
+		rq->core_wait = 0;
+	}
+	rq->core_running = !idle;
+	rq->core_cookie = cookie;
+
+	/* siblings kept idle by what this cpu ran may be able to go now */
+	for_each_cpu(sibling, cpu_smt_mask(cpu)) {
+		struct rq *srq = cpu_rq(sibling);
+
+		if (sibling != cpu && srq->core_wait &&
+		    (idle || srq->core_wait_cookie == cookie))
+			sched_core_kick(srq);
+	}
+	raw_spin_unlock(&core->core_lock);
+
+	return next;
+}
+
+static void sched_core_tick(struct rq *rq)
+{
+	if (!sched_core_enabled() || !rq->core_running)
+		return;
+
+	if (sched_core_starving(cpu_of(rq), rq->core_cookie, local_clock()))
+		resched_curr(rq);
+}
+
+static int sched_core_update_cookie(struct task_group *tg, void *data)
+{
+	unsigned long cookie = 0;
+
+	if (tg->core_tagged)
+		cookie = (unsigned long)tg;
+	else if (tg->parent)
+		cookie = tg->parent->core_cookie;
+	WRITE_ONCE(tg->core_cookie, cookie);
+	return 0;
+}
+
+static void sched_core_get(void)
+{
+	if (!sched_core_count++)
+		static_branch_enable(&__sched_core_enabled);
+}
+
+static void sched_core_put(void)
+{
+	if (!--sched_core_count)
+		static_branch_disable(&__sched_core_enabled);
+}
+#else
+static inline struct task_struct *sched_core_pick(struct rq *rq,
+						  struct task_struct *next)
+{
+	return next;
+}
+
+static inline void sched_core_tick(struct rq *rq) { }
+#endif /* CONFIG_SCHED_CORE */
+
 /*
  * __schedule() is the main scheduler function.
  *
@@ -3193,6 +3622,7 @@ static void __sched notrace __schedule(bool preempt)
 		update_rq_clock(rq);
 
 	next = pick_next_task(rq, prev);
+	next = sched_core_pick(rq, next);
 	clear_tsk_need_resched(prev);
 	clear_preempt_need_resched();
 	rq->clock_skip_update = 0;
@@ -3699,6 +4129,7 @@ static void __setscheduler_params(struct task_struct *p,
 	p->rt_priority = attr->sched_priority;
 	p->normal_prio = normal_prio(p);
 	set_load_weight(p);
+	__setscheduler_uclamp(p, attr);
 }
 
 /* Actually do priority change: must hold pi & rq lock. */
@@ -3834,9 +4265,16 @@ recheck:
 			return -EINVAL;
 	}
 
-	if (attr->sched_flags & ~(SCHED_FLAG_RESET_ON_FORK))
+	if (attr->sched_flags &
+	    ~(SCHED_FLAG_RESET_ON_FORK | SCHED_FLAG_UTIL_CLAMP))
 		return -EINVAL;
 
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP) {
+		retval = uclamp_validate(p, attr);
+		if (retval)
+			return retval;
+	}
+
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
 	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL,
@@ -3934,6 +4372,8 @@ recheck:
 			goto change;
 		if (dl_policy(policy) && dl_param_changed(p, attr))
 			goto change;
+		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &flags);
@@ -4412,6 +4852,14 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	else
 		attr.sched_nice = task_nice(p);
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* callers that predate the clamps keep getting a VER0 struct */
+	if (size >= SCHED_ATTR_SIZE_VER1) {
+		attr.sched_util_min = p->uclamp_req[UCLAMP_MIN].value;
+		attr.sched_util_max = p->uclamp_req[UCLAMP_MAX].value;
+	}
+#endif
+
 	rcu_read_unlock();
 
 	retval = sched_read_attr(uattr, &attr, size);
@@ -6020,6 +6468,11 @@ DEFINE_PER_CPU(int, sd_llc_id);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_busy);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
+/*
+ * Set when some core in the LLC may be entirely idle; only the instance
+ * of the first cpu of each LLC (sd_llc_id) is used.
+ */
+DEFINE_PER_CPU(int, sd_llc_idle_cores);
 
 static void update_top_cache_domain(int cpu)
 {
@@ -7327,6 +7780,28 @@ static int cpuset_cpu_inactive(struct notifier_block *nfb, unsigned long action,
 	return NOTIFY_OK;
 }
 
+#ifdef CONFIG_SCHED_SMT
+DEFINE_STATIC_KEY_FALSE(sched_smt_present);
+
+static void __init sched_init_smt(void)
+{
+	int cpu;
+
+	/*
+	 * Only track idle cores when some core actually has more than one
+	 * thread; otherwise every idle cpu is an idle core.
+	 */
+	for_each_online_cpu(cpu) {
+		if (cpumask_weight(cpu_smt_mask(cpu)) > 1) {
+			static_branch_enable(&sched_smt_present);
+			break;
+		}
+	}
+}
+#else
+static inline void sched_init_smt(void) { }
+#endif
+
 void __init sched_init_smp(void)
 {
 	cpumask_var_t non_isolated_cpus;
@@ -7362,6 +7837,7 @@ void __init sched_init_smp(void)
 
 	init_sched_rt_class();
 	init_sched_dl_class();
+	sched_init_smt();
 }
 #else
 void __init sched_init_smp(void)
@@ -7387,6 +7863,7 @@ LIST_HEAD(task_groups);
 #endif
 
 DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
+DECLARE_PER_CPU(cpumask_var_t, select_idle_mask);
 
 void __init sched_init(void)
 {
@@ -7423,6 +7900,8 @@ void __init sched_init(void)
 	for_each_possible_cpu(i) {
 		per_cpu(load_balance_mask, i) = (cpumask_var_t)kzalloc_node(
 			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
+		per_cpu(select_idle_mask, i) = (cpumask_var_t)kzalloc_node(
+			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
 	}
 #endif /* CONFIG_CPUMASK_OFFSTACK */
 
@@ -7440,6 +7919,8 @@ void __init sched_init(void)
 			global_rt_period(), global_rt_runtime());
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+	init_uclamp();
+
 #ifdef CONFIG_CGROUP_SCHED
 	list_add(&root_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&root_task_group.children);
@@ -7453,6 +7934,9 @@ void __init sched_init(void)
 
 		rq = cpu_rq(i);
 		raw_spin_lock_init(&rq->lock);
+#ifdef CONFIG_SCHED_CORE
+		raw_spin_lock_init(&rq->core_lock);
+#endif
 		rq->nr_running = 0;
 		rq->calc_load_active = 0;
 		rq->calc_load_update = jiffies + LOAD_FREQ;
@@ -7744,6 +8228,8 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+	tg_uclamp_init(tg);
+
 	return tg;
 
 err:
@@ -7755,6 +8241,16 @@ void sched_online_group(struct task_group *tg, struct task_group *parent)
 {
 	unsigned long flags;
 
+#ifdef CONFIG_SCHED_CORE
+	/* a tag written to an ancestor must not miss this group */
+	mutex_lock(&sched_core_mutex);
+	tg->core_cookie = parent->core_cookie;
+#endif
+#ifdef CONFIG_UCLAMP_TASK
+	mutex_lock(&uclamp_mutex);
+	tg_uclamp_update_eff(tg, parent);
+	mutex_unlock(&uclamp_mutex);
+#endif
 	spin_lock_irqsave(&task_group_lock, flags);
 	list_add_rcu(&tg->list, &task_groups);
 
@@ -7764,6 +8260,9 @@ void sched_online_group(struct task_group *tg, struct task_group *parent)
 	INIT_LIST_HEAD(&tg->children);
 	list_add_rcu(&tg->siblings, &parent->children);
 	spin_unlock_irqrestore(&task_group_lock, flags);
+#ifdef CONFIG_SCHED_CORE
+	mutex_unlock(&sched_core_mutex);
+#endif
 }
 
 /* rcu callback to free various structures associated with a task group */
@@ -7788,6 +8287,13 @@ void sched_offline_group(struct task_group *tg)
 	for_each_possible_cpu(i)
 		unregister_fair_sched_group(tg, i);
 
+#ifdef CONFIG_SCHED_CORE
+	mutex_lock(&sched_core_mutex);
+	if (tg->core_tagged)
+		sched_core_put();
+	mutex_unlock(&sched_core_mutex);
+#endif
+
 	spin_lock_irqsave(&task_group_lock, flags);
 	list_del_rcu(&tg->list);
 	list_del_rcu(&tg->siblings);
@@ -8575,6 +9081,115 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_UCLAMP_TASK
+static void uclamp_update_active(struct task_struct *p)
+{
+	unsigned long flags;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &flags);
+	/* re-account an enqueued task under its new effective clamps */
+	if (p->uclamp[UCLAMP_MIN].active) {
+		uclamp_rq_dec(rq, p);
+		uclamp_rq_inc(rq, p);
+	}
+	task_rq_unlock(rq, p, &flags);
+}
+
+static void uclamp_update_active_tasks(struct cgroup_subsys_state *css)
+{
+	struct css_task_iter it;
+	struct task_struct *p;
+
+	css_task_iter_start(css, &it);
+	while ((p = css_task_iter_next(&it)))
+		uclamp_update_active(p);
+	css_task_iter_end(&it);
+}
+
+static u64 cpu_uclamp_read_u64(struct cgroup_subsys_state *css,
+			       struct cftype *cft)
+{
+	return css_tg(css)->uclamp_req[cft->private].value;
+}
+
+static int cpu_uclamp_write_u64(struct cgroup_subsys_state *css,
+				struct cftype *cft, u64 val)
+{
+	struct task_group *tg = css_tg(css);
+	enum uclamp_id clamp_id = cft->private;
+	struct cgroup_subsys_state *pos;
+	int ret = 0;
+
+	if (val > SCHED_CAPACITY_SCALE)
+		return -ERANGE;
+
+	mutex_lock(&uclamp_mutex);
+	if ((clamp_id == UCLAMP_MIN &&
+	     val > tg->uclamp_req[UCLAMP_MAX].value) ||
+	    (clamp_id == UCLAMP_MAX &&
+	     val < tg->uclamp_req[UCLAMP_MIN].value)) {
+		ret = -EINVAL;
+		goto unlock;
+	}
+	uclamp_se_set(&tg->uclamp_req[clamp_id], val, true);
+
+	/*
+	 * Refresh the effective clamps of the subtree top down, then move
+	 * the enqueued tasks over to them; css_task_iter_start() may sleep.
+	 */
+	rcu_read_lock();
+	css_for_each_descendant_pre(pos, css)
+		tg_uclamp_update_eff(css_tg(pos), css_tg(pos)->parent);
+	css_for_each_descendant_pre(pos, css) {
+		if (!css_tryget_online(pos))
+			continue;
+		rcu_read_unlock();
+		uclamp_update_active_tasks(pos);
+		rcu_read_lock();
+		css_put(pos);
+	}
+	rcu_read_unlock();
+unlock:
+	mutex_unlock(&uclamp_mutex);
+	return ret;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
+#ifdef CONFIG_SCHED_CORE
+static u64 cpu_core_tag_read_u64(struct cgroup_subsys_state *css,
+				 struct cftype *cft)
+{
+	return css_tg(css)->core_tagged;
+}
+
+static int cpu_core_tag_write_u64(struct cgroup_subsys_state *css,
+				  struct cftype *cft, u64 val)
+{
+	struct task_group *tg = css_tg(css);
+
+	if (val > 1)
+		return -ERANGE;
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	mutex_lock(&sched_core_mutex);
+	if (tg->core_tagged != val) {
+		tg->core_tagged = val;
+		if (val)
+			sched_core_get();
+		else
+			sched_core_put();
+		/* running tasks pick the new cookie up at their next switch */
+		rcu_read_lock();
+		walk_tg_tree_from(tg, sched_core_update_cookie, tg_nop, NULL);
+		rcu_read_unlock();
+	}
+	mutex_unlock(&sched_core_mutex);
+	return 0;
+}
+#endif /* CONFIG_SCHED_CORE */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -8610,6 +9225,30 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+#endif
+#ifdef CONFIG_UCLAMP_TASK
+	{
+		.name = "uclamp.min",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.private = UCLAMP_MIN,
+		.read_u64 = cpu_uclamp_read_u64,
+		.write_u64 = cpu_uclamp_write_u64,
+	},
+	{
+		.name = "uclamp.max",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.private = UCLAMP_MAX,
+		.read_u64 = cpu_uclamp_read_u64,
+		.write_u64 = cpu_uclamp_write_u64,
+	},
+#endif
+#ifdef CONFIG_SCHED_CORE
+	{
+		.name = "core_tag",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_core_tag_read_u64,
+		.write_u64 = cpu_core_tag_write_u64,
+	},
 #endif
 	{ }	/* terminate */
 };
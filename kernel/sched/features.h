@@ -51,6 +51,12 @@ SCHED_FEAT(NONTASK_CAPACITY, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * Don't send a wake_list IPI to a cpu that already has one pending or
+ * is still draining its list; it rechecks the list before it is done.
+ */
+SCHED_FEAT(TTWU_COALESCE, true)
+
 #ifdef HAVE_RT_PUSH_IPI
 /*
  * In order to avoid a thundering herd attack of CPUs that are
@@ -69,3 +75,11 @@ SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
 SCHED_FEAT(ATTACH_AGE_LOAD, true)
 
+/*
+ * Bound the select_idle_cpu() scan: SIS_AVG_CPU skips it entirely when
+ * the waking cpu is not expected to stay idle long enough to pay for it,
+ * SIS_PROP scans a number of cpus proportional to that expected idle time.
+ */
+SCHED_FEAT(SIS_AVG_CPU, false)
+SCHED_FEAT(SIS_PROP, true)
+
@@ -271,6 +271,19 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_SCHED_CORE
+	/* cookie shared by this group's tasks: nearest tagged ancestor, or 0 */
+	unsigned long core_cookie;
+	int core_tagged;
+#endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	/* clamps written to cpu.uclamp.{min,max} */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* the same, restricted by the ancestors' effective clamps */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -288,6 +301,30 @@ struct task_group {
 #define MAX_SHARES	(1UL << 18)
 #endif
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Enqueued tasks are counted in one of UCLAMP_BUCKETS buckets per clamp
+ * by value.  A bucket remembers the largest value it was handed since it
+ * last ran empty, and the rq value is the largest of the busy buckets,
+ * so both enqueue and dequeue are O(UCLAMP_BUCKETS) at worst.
+ */
+#define UCLAMP_BUCKETS		5
+#define UCLAMP_BUCKET_DELTA	DIV_ROUND_CLOSEST(SCHED_CAPACITY_SCALE, UCLAMP_BUCKETS)
+
+struct uclamp_bucket {
+	unsigned int value;
+	unsigned int tasks;
+};
+
+struct uclamp_rq {
+	unsigned int value;	/* 0 while no task is enqueued */
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+
+extern unsigned int uclamp_eff_value(struct task_struct *p,
+				     enum uclamp_id clamp_id);
+#endif
+
 typedef int (*tg_visitor)(struct task_group *, void *);
 
 extern int walk_tg_tree_from(struct task_group *from,
@@ -678,16 +715,38 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* wake_list stats: IPIs this cpu sent, wakeups it took off its list */
+	unsigned int ttwu_ipi_sent;
+	unsigned int ttwu_wake_list;
 #endif
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
+	/* a wake_list IPI is on its way or being handled, see ttwu_queue_remote() */
+	unsigned int wake_ipi_pending;
 #endif
 
 #ifdef CONFIG_CPU_IDLE
 	/* Must be inspected within a rcu lock section */
 	struct cpuidle_state *idle_state;
 #endif
+
+#ifdef CONFIG_SCHED_CORE
+	/* only the first SMT sibling's lock is used, see sched_core_pick() */
+	raw_spinlock_t core_lock;
+	/* what this cpu runs, and what it is kept idle from running */
+	unsigned int core_running;
+	unsigned int core_wait;
+	unsigned long core_cookie;
+	unsigned long core_wait_cookie;
+	u64 core_wait_start;
+#endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	/* clamps of the enqueued tasks, aggregated by rq->lock holders */
+	struct uclamp_rq uclamp[UCLAMP_CNT];
+#endif
 };
 
 static inline int cpu_of(struct rq *rq)
@@ -836,6 +895,21 @@ DECLARE_PER_CPU(int, sd_llc_id);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
+DECLARE_PER_CPU(int, sd_llc_idle_cores);
+
+#ifdef CONFIG_SCHED_SMT
+extern struct static_key_false sched_smt_present;
+
+extern void __update_idle_core(struct rq *rq);
+
+static inline void update_idle_core(struct rq *rq)
+{
+	if (static_branch_unlikely(&sched_smt_present))
+		__update_idle_core(rq);
+}
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
 
 struct sched_group_capacity {
 	atomic_t ref;
@@ -30,6 +30,8 @@
 
 #include <trace/events/block.h>
 
+#include "../../block/blk.h"
+
 #include "trace_output.h"
 
 #ifdef CONFIG_BLK_DEV_IO_TRACE
@@ -286,14 +288,12 @@ record_it:
 	local_irq_restore(flags);
 }
 
-static struct dentry *blk_tree_root;
-static DEFINE_MUTEX(blk_tree_mutex);
-
 static void blk_trace_free(struct blk_trace *bt)
 {
 	debugfs_remove(bt->msg_file);
 	debugfs_remove(bt->dropped_file);
 	relay_close(bt->rchan);
+	/* a directory owned by the block layer stays */
 	debugfs_remove(bt->dir);
 	free_percpu(bt->sequence);
 	free_percpu(bt->msg_data);
@@ -468,22 +468,24 @@ int do_blk_trace_setup(struct request_queue *q, char *name, dev_t dev,
 
 	ret = -ENOENT;
 
-	mutex_lock(&blk_tree_mutex);
-	if (!blk_tree_root) {
-		blk_tree_root = debugfs_create_dir("block", NULL);
-		if (!blk_tree_root) {
-			mutex_unlock(&blk_tree_mutex);
+	if (!blk_debugfs_root)
+		goto err;
+
+	/*
+	 * When tracing a whole blk-mq device, reuse the directory the block
+	 * layer created for it at registration time.
+	 */
+#ifdef CONFIG_BLK_DEBUG_FS
+	if (bdev && bdev == bdev->bd_contains)
+		dir = q->debugfs_dir;
+#endif
+	if (!dir) {
+		dir = debugfs_create_dir(buts->name, blk_debugfs_root);
+		if (!dir)
 			goto err;
-		}
+		bt->dir = dir;
 	}
-	mutex_unlock(&blk_tree_mutex);
-
-	dir = debugfs_create_dir(buts->name, blk_tree_root);
-
-	if (!dir)
-		goto err;
 
-	bt->dir = dir;
 	bt->dev = dev;
 	atomic_set(&bt->dropped, 0);
 	INIT_LIST_HEAD(&bt->running_list);
@@ -5,6 +5,7 @@
  */
 #include <linux/trace_events.h>
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <linux/trace_clock.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
@@ -22,7 +23,9 @@
 #include <linux/hash.h>
 #include <linux/list.h>
 #include <linux/cpu.h>
+#include <linux/mm.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -300,6 +303,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* position in a user mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -464,6 +468,12 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping of the pages, see ring_buffer_map() */
+	struct mutex			mapping_lock;
+	unsigned int			mapped;		/* number of vmas */
+	unsigned long			*subbuf_ids;	/* id -> page address */
+	struct trace_buffer_meta	*meta_page;
 };
 
 struct ring_buffer {
@@ -1224,6 +1234,7 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 	init_irq_work(&cpu_buffer->irq_work.work, rb_wake_up_waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.full_waiters);
+	mutex_init(&cpu_buffer->mapping_lock);
 
 	bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 			    GFP_KERNEL, cpu_to_node(cpu));
@@ -1418,6 +1429,7 @@ void ring_buffer_set_clock(struct ring_buffer *buffer,
 }
 
 static void rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer);
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer);
 
 static inline unsigned long rb_page_entries(struct buffer_page *bpage)
 {
@@ -1685,6 +1697,16 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	/* the pages of a mapped cpu buffer must stay the same */
+	for_each_buffer_cpu(buffer, cpu) {
+		if (cpu_id != RING_BUFFER_ALL_CPUS && cpu != cpu_id)
+			continue;
+		if (buffer->buffers[cpu]->mapped) {
+			mutex_unlock(&buffer->mutex);
+			return -EBUSY;
+		}
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -4243,6 +4265,9 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer);
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4348,6 +4373,11 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* a user mapping would keep pointing at the old pages */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -4472,6 +4502,7 @@ EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
  *
  * Returns:
  *  >=0 if data has been transferred, returns the offset of consumed data.
+ *  -EBUSY if the cpu buffer is mapped to user space (see ring_buffer_map()).
  *  <0 if no data has been transferred.
  */
 int ring_buffer_read_page(struct ring_buffer *buffer,
@@ -4509,6 +4540,12 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* swapping @data_page in would take a page away from the mapping */
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -4638,6 +4675,289 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+}
+
+/*
+ * Number the pages for the mapping: the reader page is 0, the pages in
+ * the ring follow from the head page on. Called with the buffer mutex
+ * held, so the set of pages can't change.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   unsigned long *subbuf_ids)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	struct buffer_page *first, *bpage;
+	unsigned int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first = bpage = rb_set_head_page(cpu_buffer);
+	do {
+		if (RB_WARN_ON(cpu_buffer, !bpage || id >= nr_subbufs))
+			break;
+
+		subbuf_ids[id] = (unsigned long)bpage->page;
+		bpage->id = id++;
+
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (bpage != first);
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = nr_subbufs;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_subbufs = cpu_buffer->nr_pages + 1;
+	unsigned long pgoff = vma->vm_pgoff;
+	unsigned long i, nr_pages = vma_pages(vma);
+	void *addr;
+	int err;
+
+	/* user space only reads, and the pages are not its to keep */
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+
+	/* the meta page plus the sub-buffers */
+	if (!nr_pages || pgoff > nr_subbufs ||
+	    nr_pages > nr_subbufs + 1 - pgoff)
+		return -EINVAL;
+
+	for (i = 0; i < nr_pages; i++, pgoff++) {
+		if (pgoff == 0)
+			addr = cpu_buffer->meta_page;
+		else
+			addr = (void *)cpu_buffer->subbuf_ids[pgoff - 1];
+
+		err = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE,
+				     virt_to_page(addr));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a per cpu buffer into user space
+ * @buffer: the ring buffer
+ * @cpu: the cpu buffer to map
+ * @vma: the vma to fill, from an ->mmap() handler
+ *
+ * The first page of the mapping is a struct trace_buffer_meta, followed by
+ * the pages of the cpu buffer in the order of their id. The consumer
+ * moves through them with ring_buffer_map_get_reader(), without copies
+ * and without a syscall per event.
+ *
+ * While mapped, the cpu buffer can't be resized or swapped, and
+ * ring_buffer_read_page() returns -EBUSY, as all of them would change
+ * the pages it is made of.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags, *subbuf_ids;
+	int err;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (cpu_buffer->mapped) {
+		err = __rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		goto out;
+	}
+
+	/* prevent another thread from changing the buffer size */
+	mutex_lock(&buffer->mutex);
+
+	err = -ENOMEM;
+	cpu_buffer->meta_page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!cpu_buffer->meta_page)
+		goto out_unlock;
+
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids)
+		goto out_free_meta;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids_meta_page(cpu_buffer, subbuf_ids);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	err = __rb_map_vma(cpu_buffer, vma);
+	if (err) {
+		kfree(cpu_buffer->subbuf_ids);
+		cpu_buffer->subbuf_ids = NULL;
+		goto out_free_meta;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+	goto out_unlock;
+
+ out_free_meta:
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+ out_unlock:
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of a mapping's vma
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * For the ->open() of the vma operations: splitting or moving a mapping
+ * gives it another vma, which ring_buffer_unmap() is called for as well.
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	mutex_unlock(&cpu_buffer->mapping_lock);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - drop a vma mapping a per cpu buffer
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * For the ->close() of the vma operations. The meta page goes away with
+ * the last mapping.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	} else if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	mutex_lock(&buffer->mutex);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+	kfree(cpu_buffer->subbuf_ids);
+	cpu_buffer->subbuf_ids = NULL;
+
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next page to a mapped consumer
+ * @buffer: the ring buffer
+ * @cpu: the mapped cpu buffer
+ *
+ * The consumer is done with the current reader page: consume what is on
+ * it, swap in the next page holding data if the writer moved on, and
+ * publish the result in the meta page.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	/*
+	 * Walk the events instead of setting 'read' to the end of the page,
+	 * to keep the entry accounting right. The writer may be on this
+	 * page still, anything it adds later is left for the next call.
+	 */
+	reader = cpu_buffer->reader_page;
+	while (reader->read < rb_page_size(reader))
+		rb_advance_reader(cpu_buffer);
+
+	rb_get_reader_page(cpu_buffer);
+
+	rb_update_meta_page(cpu_buffer);
+	cpu_buffer->lost_events = 0;
+
+	/* some archs do not have data cache coherency with user space */
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
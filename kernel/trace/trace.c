@@ -12,6 +12,7 @@
  *  Copyright (C) 2004 Nadia Yvette Chambers
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <generated/utsrelease.h>
 #include <linux/stacktrace.h>
 #include <linux/writeback.h>
@@ -674,19 +675,35 @@ static int resize_buffer_duplicate_size(struct trace_buffer *trace_buf,
 					struct trace_buffer *size_buf, int cpu_id);
 static void set_buffer_entries(struct trace_buffer *buf, unsigned long val);
 
+/*
+ * Serializes tr->mapped against snapshot allocation. The mmap handlers run
+ * with mmap_sem held, so they can't take trace_types_lock, which is held
+ * across copies from user space.
+ */
+static DEFINE_MUTEX(trace_map_lock);
+
 static int alloc_snapshot(struct trace_array *tr)
 {
 	int ret;
 
 	if (!tr->allocated_snapshot) {
+		mutex_lock(&trace_map_lock);
+
+		/* a snapshot swaps pages out from under a user mapping */
+		if (tr->mapped) {
+			mutex_unlock(&trace_map_lock);
+			return -EBUSY;
+		}
 
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->trace_buffer, RING_BUFFER_ALL_CPUS);
+		if (ret >= 0)
+			tr->allocated_snapshot = true;
+
+		mutex_unlock(&trace_map_lock);
 		if (ret < 0)
 			return ret;
-
-		tr->allocated_snapshot = true;
 	}
 
 	return 0;
@@ -3767,6 +3784,7 @@ static const char readme_msg[] =
 	"  set_graph_function\t- Trace the nested calls of a function (function_graph)\n"
 	"  set_graph_notrace\t- Do not trace the nested calls of a function (function_graph)\n"
 	"  max_graph_depth\t- Trace a limited depth of nested calls (0 is unlimited)\n"
+	"  graph_sample_rate\t- Only trace one in N graphs started on a cpu (0 is all)\n"
 #endif
 #ifdef CONFIG_TRACER_SNAPSHOT
 	"\n  snapshot\t\t- Like 'trace' but shows the content of the static\n"
@@ -5637,6 +5655,9 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 	trace_access_unlock(iter->cpu_file);
 
 	if (ret < 0) {
+		/* the cpu buffer is mapped, read it from there */
+		if (ret == -EBUSY)
+			return ret;
 		if (trace_empty(iter)) {
 			if ((filp->f_flags & O_NONBLOCK))
 				return -EAGAIN;
@@ -5807,6 +5828,8 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		if (r < 0) {
 			ring_buffer_free_read_page(ref->buffer, ref->page);
 			kfree(ref);
+			if (r == -EBUSY)
+				ret = r;
 			break;
 		}
 
@@ -5856,12 +5879,112 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int err;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	if (!(file->f_flags & O_NONBLOCK)) {
+		err = wait_on_pipe(iter, false);
+		if (err)
+			return err;
+	}
+
+	return ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					  iter->cpu_file);
+}
+
+#ifdef CONFIG_TRACER_SNAPSHOT
+static int get_snapshot_map(struct trace_array *tr)
+{
+	int err = 0;
+
+	mutex_lock(&trace_map_lock);
+	if (tr->allocated_snapshot)
+		err = -EBUSY;
+	else
+		tr->mapped++;
+	mutex_unlock(&trace_map_lock);
+
+	return err;
+}
+
+static void put_snapshot_map(struct trace_array *tr)
+{
+	mutex_lock(&trace_map_lock);
+	if (!WARN_ON(!tr->mapped))
+		tr->mapped--;
+	mutex_unlock(&trace_map_lock);
+}
+#else
+static inline int get_snapshot_map(struct trace_array *tr) { return 0; }
+static inline void put_snapshot_map(struct trace_array *tr) { }
+#endif
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	/* a split or moved mapping; the snapshot can't exist meanwhile */
+	WARN_ON(get_snapshot_map(iter->tr));
+	ring_buffer_map_dup(iter->trace_buffer->buffer, iter->cpu_file);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->trace_buffer->buffer, iter->cpu_file));
+	put_snapshot_map(iter->tr);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+/*
+ * Map the pages of a cpu buffer, for consumers that can't afford a copy
+ * and a syscall per page. See include/uapi/linux/trace_mmap.h.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	ret = get_snapshot_map(iter->tr);
+	if (ret)
+		return ret;
+
+	ret = ring_buffer_map(iter->trace_buffer->buffer, iter->cpu_file, vma);
+	if (ret) {
+		put_snapshot_map(iter->tr);
+		return ret;
+	}
+
+	vma->vm_ops = &tracing_buffers_vmops;
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
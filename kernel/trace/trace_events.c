@@ -204,6 +204,26 @@ static void trace_destroy_fields(struct trace_event_call *call)
 	}
 }
 
+/*
+ * Size of the tracepoint record up to the end of its last field, the
+ * bound for BPF programs reading it.
+ */
+int trace_event_get_offsets(struct trace_event_call *call)
+{
+	struct ftrace_event_field *tail;
+	struct list_head *head;
+
+	head = trace_get_fields(call);
+	if (list_empty(head))
+		return sizeof(struct trace_entry);
+	/*
+	 * head->next points to the last field with the largest offset,
+	 * since it was added last by trace_define_field()
+	 */
+	tail = list_first_entry(head, struct ftrace_event_field, link);
+	return tail->offset + tail->size;
+}
+
 int trace_event_raw_init(struct trace_event_call *call)
 {
 	int id;
@@ -2111,9 +2131,14 @@ event_create_dir(struct dentry *parent, struct trace_event_file *file)
 	 * Only event directories that can be enabled should have
 	 * triggers.
 	 */
-	if (!(call->flags & TRACE_EVENT_FL_IGNORE_ENABLE))
+	if (!(call->flags & TRACE_EVENT_FL_IGNORE_ENABLE)) {
 		trace_create_file("trigger", 0644, file->dir, file,
 				  &event_trigger_fops);
+#ifdef CONFIG_HIST_TRIGGERS
+		trace_create_file("hist", 0444, file->dir, file,
+				  &event_hist_fops);
+#endif
+	}
 
 	trace_create_file("format", 0444, file->dir, call,
 			  &ftrace_event_format_fops);
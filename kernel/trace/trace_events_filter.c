@@ -22,6 +22,7 @@
 #include <linux/ctype.h>
 #include <linux/mutex.h>
 #include <linux/perf_event.h>
+#include <linux/filter.h>
 #include <linux/slab.h>
 
 #include "trace.h"
@@ -595,6 +596,7 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 		.match = -1,
 		.rec   = rec,
 	};
+	struct bpf_prog *prog;
 	int n_preds, ret;
 
 	/* no filter is considered a match */
@@ -612,6 +614,11 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 	if (!root)
 		return 1;
 
+	/* The compiled form of the tree, if we have one, gives the same answer */
+	prog = rcu_dereference_sched(filter->prog);
+	if (prog)
+		return BPF_PROG_RUN(prog, rec);
+
 	data.preds = preds = rcu_dereference_sched(filter->preds);
 	ret = walk_pred_tree(preds, root, filter_match_preds_cb, &data);
 	WARN_ON(ret);
@@ -619,6 +626,241 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 }
 EXPORT_SYMBOL_GPL(filter_match_preds);
 
+#ifdef CONFIG_BPF
+/*
+ * Once the tree is built and folded it is also compiled into an eBPF
+ * program, which the JIT turns into native code where there is one, so
+ * that matching an event does not cost an indirect call per predicate.
+ * Integer field comparisons are open coded; string, comm and cpu
+ * predicates call their filter_pred_fn_t.  The program short circuits
+ * exactly the way filter_match_preds_cb() and process_ops() do, so it
+ * returns the same answer as the tree walk for every record.
+ *
+ * R6 holds the record, R0 the result of the last predicate or op.
+ */
+struct filter_prog_state {
+	struct filter_pred	*preds;
+	struct bpf_insn		*insns;
+	int			len;
+	int			*jumps;		/* per op node, see MOVE_UP */
+	int			*group;		/* for the ops of a folded node */
+	int			err;
+};
+
+static const struct {
+	filter_pred_fn_t	fn;
+	u8			size;
+	u8			bytes;
+	u8			is_signed;
+} filter_prog_fns[] = {
+	{ filter_pred_64,  BPF_DW, 8, 0 },
+	{ filter_pred_s64, BPF_DW, 8, 1 },
+	{ filter_pred_u64, BPF_DW, 8, 0 },
+	{ filter_pred_32,  BPF_W,  4, 0 },
+	{ filter_pred_s32, BPF_W,  4, 1 },
+	{ filter_pred_u32, BPF_W,  4, 0 },
+	{ filter_pred_16,  BPF_H,  2, 0 },
+	{ filter_pred_s16, BPF_H,  2, 1 },
+	{ filter_pred_u16, BPF_H,  2, 0 },
+	{ filter_pred_8,   BPF_B,  1, 0 },
+	{ filter_pred_s8,  BPF_B,  1, 1 },
+	{ filter_pred_u8,  BPF_B,  1, 0 },
+};
+
+static u64 filter_pred_call(u64 pred, u64 rec, u64 r3, u64 r4, u64 r5)
+{
+	struct filter_pred *p = (struct filter_pred *)(long)pred;
+
+	return !!p->fn(p, (void *)(long)rec);
+}
+
+static void filter_prog_emit(struct filter_prog_state *s, struct bpf_insn insn)
+{
+	if (s->len >= BPF_MAXINSNS) {
+		s->err = -E2BIG;
+		return;
+	}
+	s->insns[s->len++] = insn;
+}
+
+static void filter_prog_ld_imm64(struct filter_prog_state *s, int reg, u64 val)
+{
+	struct bpf_insn ld[] = { BPF_LD_IMM64(reg, val) };
+
+	filter_prog_emit(s, ld[0]);
+	filter_prog_emit(s, ld[1]);
+}
+
+/* Point the forward jump at @at to the next instruction emitted */
+static void filter_prog_fixup(struct filter_prog_state *s, int at)
+{
+	if (!s->err)
+		s->insns[at].off = s->len - at - 1;
+}
+
+static void filter_prog_leaf(struct filter_prog_state *s,
+			     struct filter_pred *pred)
+{
+	int not = !!pred->not, invert = 0;
+	int i, op, shift;
+	u64 val;
+
+	for (i = 0; i < ARRAY_SIZE(filter_prog_fns); i++)
+		if (filter_prog_fns[i].fn == pred->fn)
+			break;
+
+	switch (i < ARRAY_SIZE(filter_prog_fns) ? pred->op : OP_NONE) {
+	case OP_EQ:
+	case OP_NE:
+		/* OP_NE is already folded into pred->not */
+		op = BPF_JEQ;
+		break;
+	case OP_LT:
+		invert = 1;
+		/* fall through */
+	case OP_GE:
+		op = filter_prog_fns[i].is_signed ? BPF_JSGE : BPF_JGE;
+		break;
+	case OP_LE:
+		invert = 1;
+		/* fall through */
+	case OP_GT:
+		op = filter_prog_fns[i].is_signed ? BPF_JSGT : BPF_JGT;
+		break;
+	case OP_BAND:
+		op = BPF_JSET;
+		break;
+	default:
+		filter_prog_ld_imm64(s, BPF_REG_1, (unsigned long)pred);
+		filter_prog_emit(s, BPF_MOV64_REG(BPF_REG_2, BPF_REG_6));
+		filter_prog_emit(s, BPF_EMIT_CALL(filter_pred_call));
+		return;
+	}
+
+	/* Widen the field and the constant to 64 bits the same way */
+	shift = 64 - filter_prog_fns[i].bytes * 8;
+	val = pred->val;
+	if (shift) {
+		val &= (1ULL << (64 - shift)) - 1;
+		if (filter_prog_fns[i].is_signed)
+			val = (s64)(val << shift) >> shift;
+	}
+
+	filter_prog_emit(s, BPF_LDX_MEM(filter_prog_fns[i].size, BPF_REG_1,
+					BPF_REG_6, pred->offset));
+	if (shift && filter_prog_fns[i].is_signed) {
+		filter_prog_emit(s, BPF_ALU64_IMM(BPF_LSH, BPF_REG_1, shift));
+		filter_prog_emit(s, BPF_ALU64_IMM(BPF_ARSH, BPF_REG_1, shift));
+	}
+	filter_prog_emit(s, BPF_MOV64_IMM(BPF_REG_0, !invert ^ not));
+	if ((s64)val == (s32)val) {
+		filter_prog_emit(s, BPF_JMP_IMM(op, BPF_REG_1, (s32)val, 1));
+	} else {
+		filter_prog_ld_imm64(s, BPF_REG_2, val);
+		filter_prog_emit(s, BPF_JMP_REG(op, BPF_REG_1, BPF_REG_2, 1));
+	}
+	filter_prog_emit(s, BPF_MOV64_IMM(BPF_REG_0, invert ^ not));
+}
+
+static int filter_prog_cb(enum move_type move, struct filter_pred *pred,
+			  int *err, void *data)
+{
+	struct filter_prog_state *s = data;
+	int idx = pred - s->preds;
+	int i;
+
+	switch (move) {
+	case MOVE_DOWN:
+		if (pred->left == FILTER_PRED_INVALID) {
+			filter_prog_leaf(s, pred);
+			break;
+		}
+		if (!pred->ops)
+			return WALK_PRED_DEFAULT;
+		/* A folded node, as process_ops() */
+		for (i = 0; i < pred->val; i++) {
+			filter_prog_leaf(s, &s->preds[pred->ops[i]]);
+			if (i == pred->val - 1)
+				break;
+			s->group[i] = s->len;
+			filter_prog_emit(s, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0,
+							pred->op == OP_OR, 0));
+		}
+		while (--i >= 0)
+			filter_prog_fixup(s, s->group[i]);
+		if (pred->not)
+			filter_prog_emit(s, BPF_ALU64_IMM(BPF_XOR, BPF_REG_0, 1));
+		break;
+	case MOVE_UP_FROM_LEFT:
+		/* Short circuit the right branch, see filter_match_preds_cb() */
+		s->jumps[idx] = s->len;
+		filter_prog_emit(s, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0,
+						pred->op == OP_OR, 0));
+		return WALK_PRED_DEFAULT;
+	case MOVE_UP_FROM_RIGHT:
+		filter_prog_fixup(s, s->jumps[idx]);
+		return WALK_PRED_DEFAULT;
+	}
+
+	if (s->err) {
+		*err = s->err;
+		return WALK_PRED_ABORT;
+	}
+	return WALK_PRED_PARENT;
+}
+
+/*
+ * Failing to compile is not an error: filter_match_preds() walks the
+ * tree when there is no program.
+ */
+static void filter_compile(struct event_filter *filter,
+			   struct filter_pred *root)
+{
+	struct filter_prog_state s = { .preds = filter->preds };
+	struct bpf_prog *prog;
+	int err;
+
+	s.insns = kmalloc_array(BPF_MAXINSNS, sizeof(*s.insns), GFP_KERNEL);
+	s.jumps = kmalloc_array(2 * filter->n_preds, sizeof(*s.jumps),
+				GFP_KERNEL);
+	if (!s.insns || !s.jumps)
+		goto out;
+	s.group = s.jumps + filter->n_preds;
+
+	filter_prog_emit(&s, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	err = walk_pred_tree(filter->preds, root, filter_prog_cb, &s);
+	filter_prog_emit(&s, BPF_EXIT_INSN());
+	if (err || s.err)
+		goto out;
+
+	prog = bpf_prog_alloc(bpf_prog_size(s.len), 0);
+	if (!prog)
+		goto out;
+	memcpy(prog->insnsi, s.insns, s.len * sizeof(*s.insns));
+	prog->len = s.len;
+	if (bpf_prog_select_runtime(prog)) {
+		bpf_prog_free(prog);
+		goto out;
+	}
+	filter->prog = prog;
+ out:
+	kfree(s.jumps);
+	kfree(s.insns);
+}
+
+static void filter_free_prog(struct event_filter *filter)
+{
+	if (filter->prog) {
+		bpf_prog_free(filter->prog);
+		filter->prog = NULL;
+	}
+}
+#else
+static inline void filter_compile(struct event_filter *filter,
+				  struct filter_pred *root) { }
+static inline void filter_free_prog(struct event_filter *filter) { }
+#endif /* CONFIG_BPF */
+
 static void parse_error(struct filter_parse_state *ps, int err, int pos)
 {
 	ps->lasterr = err;
@@ -700,9 +942,14 @@ void print_event_filter(struct trace_event_file *file, struct trace_seq *s)
 {
 	struct event_filter *filter = event_filter(file);
 
-	if (filter && filter->filter_string)
+	if (filter && filter->filter_string) {
 		trace_seq_printf(s, "%s\n", filter->filter_string);
-	else
+		if (filter->prog)
+			trace_seq_printf(s, "# compiled: %u insns, %s\n",
+					 filter->prog->len,
+					 filter->prog->jited ? "jited" :
+					 "interpreted");
+	} else
 		trace_seq_puts(s, "none\n");
 }
 
@@ -814,6 +1061,7 @@ static void __free_preds(struct event_filter *filter)
 {
 	int i;
 
+	filter_free_prog(filter);
 	if (filter->preds) {
 		for (i = 0; i < filter->n_preds; i++)
 			kfree(filter->preds[i].ops);
@@ -1717,6 +1965,9 @@ static int replace_preds(struct trace_event_call *call,
 		if (err)
 			goto fail;
 
+		/* And compile it, falling back to the walk if that fails */
+		filter_compile(filter, root);
+
 		/* We don't set root until we know it works */
 		barrier();
 		filter->root = root;
@@ -0,0 +1,896 @@
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A hist trigger aggregates the events it sees into a tracing_map,
+ * keyed on one or two event fields and summing up to two more, plus a
+ * hitcount, e.g.:
+ *
+ *   echo 'hist:keys=common_pid:vals=bytes_req:sort=bytes_req.descending' \
+ *	> events/kmem/kmalloc/trigger
+ *   cat events/kmem/kmalloc/hist
+ *
+ * Keys can be printed as hex (.hex) or as kernel symbols (.sym), and
+ * the table is sorted on at most two keys or values, ascending unless
+ * .descending is given.  size= sets the number of entries, rounded up
+ * to a power of 2.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+#include "tracing_map.h"
+#include "trace.h"
+
+/* Room for one string key plus a comm or a numeric key */
+#define HIST_KEY_SIZE_MAX	(MAX_FILTER_STR_VAL + TASK_COMM_LEN)
+
+struct hist_field;
+
+typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event);
+
+enum hist_field_flags {
+	HIST_FIELD_FL_HITCOUNT		= 1,
+	HIST_FIELD_FL_KEY		= 2,
+	HIST_FIELD_FL_STRING		= 4,
+	HIST_FIELD_FL_HEX		= 8,
+	HIST_FIELD_FL_SYM		= 16,
+};
+
+struct hist_field {
+	struct ftrace_event_field	*field;
+	unsigned long			flags;
+	hist_field_fn_t			fn;
+	unsigned int			size;		/* in the key */
+	unsigned int			offset;		/* in the key */
+	unsigned int			str_len;	/* for string keys */
+};
+
+/*
+ * The fields are the hitcount, the other values and then the keys, in
+ * that order, which is also the order they are added to the map in: a
+ * field's index in fields[] is its index in the tracing_map.
+ */
+struct hist_trigger_data {
+	struct hist_field		*fields[TRACING_MAP_FIELDS_MAX];
+	unsigned int			n_vals;
+	unsigned int			n_keys;
+	unsigned int			n_fields;
+	unsigned int			key_size;
+	struct tracing_map_sort_key	sort_keys[TRACING_MAP_SORT_KEYS_MAX];
+	unsigned int			n_sort_keys;
+	struct tracing_map		*map;
+};
+
+struct hist_trigger_attrs {
+	char		*keys_str;
+	char		*vals_str;
+	char		*sort_key_str;
+	unsigned int	map_bits;
+};
+
+#define for_each_hist_val_field(i, hist_data)			\
+	for ((i) = 0; (i) < (hist_data)->n_vals; (i)++)
+
+#define for_each_hist_key_field(i, hist_data)			\
+	for ((i) = (hist_data)->n_vals; (i) < (hist_data)->n_fields; (i)++)
+
+static u64 hist_field_counter(struct hist_field *field, void *event)
+{
+	return 1;
+}
+
+static u64 hist_field_string(struct hist_field *hist_field, void *event)
+{
+	char *addr = (char *)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
+{
+	u32 str_item = *(u32 *)(event + hist_field->field->offset);
+	int str_loc = str_item & 0xffff;
+	char *addr = (char *)(event + str_loc);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_pstring(struct hist_field *hist_field, void *event)
+{
+	char **addr = (char **)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)*addr;
+}
+
+static u64 hist_field_comm(struct hist_field *hist_field, void *event)
+{
+	return (u64)(unsigned long)current->comm;
+}
+
+static u64 hist_field_cpu(struct hist_field *hist_field, void *event)
+{
+	return raw_smp_processor_id();
+}
+
+#define DEFINE_HIST_FIELD_FN(type)					\
+static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
+{									\
+	type *addr = (type *)(event + hist_field->field->offset);	\
+									\
+	return (u64)*addr;						\
+}
+
+DEFINE_HIST_FIELD_FN(s64);
+DEFINE_HIST_FIELD_FN(u64);
+DEFINE_HIST_FIELD_FN(s32);
+DEFINE_HIST_FIELD_FN(u32);
+DEFINE_HIST_FIELD_FN(s16);
+DEFINE_HIST_FIELD_FN(u16);
+DEFINE_HIST_FIELD_FN(s8);
+DEFINE_HIST_FIELD_FN(u8);
+
+static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
+{
+	hist_field_fn_t fn = NULL;
+
+	switch (field_size) {
+	case 8:
+		fn = field_is_signed ? hist_field_s64 : hist_field_u64;
+		break;
+	case 4:
+		fn = field_is_signed ? hist_field_s32 : hist_field_u32;
+		break;
+	case 2:
+		fn = field_is_signed ? hist_field_s16 : hist_field_u16;
+		break;
+	case 1:
+		fn = field_is_signed ? hist_field_s8 : hist_field_u8;
+		break;
+	}
+
+	return fn;
+}
+
+static const char *hist_field_name(struct hist_field *hist_field)
+{
+	if (hist_field->flags & HIST_FIELD_FL_HITCOUNT)
+		return "hitcount";
+
+	return hist_field->field->name;
+}
+
+static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+{
+	if (!attrs)
+		return;
+
+	kfree(attrs->sort_key_str);
+	kfree(attrs->keys_str);
+	kfree(attrs->vals_str);
+	kfree(attrs);
+}
+
+static int parse_map_size(char *str)
+{
+	unsigned long size, map_bits;
+	int ret;
+
+	ret = kstrtoul(str, 0, &size);
+	if (ret)
+		return ret;
+
+	map_bits = ilog2(roundup_pow_of_two(size));
+	if (map_bits < TRACING_MAP_BITS_MIN ||
+	    map_bits > TRACING_MAP_BITS_MAX)
+		return -EINVAL;
+
+	return map_bits;
+}
+
+static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+{
+	struct hist_trigger_attrs *attrs;
+	char **dest;
+	int ret = 0;
+
+	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
+	if (!attrs)
+		return ERR_PTR(-ENOMEM);
+
+	attrs->map_bits = TRACING_MAP_BITS_DEFAULT;
+
+	while (trigger_str) {
+		char *str = strsep(&trigger_str, ":");
+
+		if (!strncmp(str, "keys=", strlen("keys=")) ||
+		    !strncmp(str, "key=", strlen("key=")))
+			dest = &attrs->keys_str;
+		else if (!strncmp(str, "vals=", strlen("vals=")) ||
+			 !strncmp(str, "values=", strlen("values=")))
+			dest = &attrs->vals_str;
+		else if (!strncmp(str, "sort=", strlen("sort=")))
+			dest = &attrs->sort_key_str;
+		else if (!strncmp(str, "size=", strlen("size="))) {
+			ret = parse_map_size(str + strlen("size="));
+			if (ret < 0)
+				goto free;
+			attrs->map_bits = ret;
+			continue;
+		} else {
+			ret = -EINVAL;
+			goto free;
+		}
+
+		kfree(*dest);
+		*dest = kstrdup(strchr(str, '=') + 1, GFP_KERNEL);
+		if (!*dest) {
+			ret = -ENOMEM;
+			goto free;
+		}
+	}
+
+	if (!attrs->keys_str) {
+		ret = -EINVAL;
+		goto free;
+	}
+
+	return attrs;
+ free:
+	destroy_hist_trigger_attrs(attrs);
+
+	return ERR_PTR(ret);
+}
+
+static void destroy_hist_data(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_fields; i++)
+		kfree(hist_data->fields[i]);
+
+	tracing_map_destroy(hist_data->map);
+	kfree(hist_data);
+}
+
+static struct hist_field *create_hist_field(struct ftrace_event_field *field,
+					    unsigned long flags)
+{
+	struct hist_field *hist_field;
+
+	hist_field = kzalloc(sizeof(*hist_field), GFP_KERNEL);
+	if (!hist_field)
+		return NULL;
+
+	hist_field->field = field;
+	hist_field->flags = flags;
+	hist_field->size = sizeof(u64);
+
+	if (flags & HIST_FIELD_FL_HITCOUNT) {
+		hist_field->fn = hist_field_counter;
+		return hist_field;
+	}
+
+	switch (field->filter_type) {
+	case FILTER_STATIC_STRING:
+		hist_field->fn = hist_field_string;
+		hist_field->str_len = field->size;
+		break;
+	case FILTER_DYN_STRING:
+		hist_field->fn = hist_field_dynstring;
+		hist_field->str_len = MAX_FILTER_STR_VAL - 1;
+		break;
+	case FILTER_PTR_STRING:
+		hist_field->fn = hist_field_pstring;
+		hist_field->str_len = MAX_FILTER_STR_VAL - 1;
+		break;
+	case FILTER_COMM:
+		hist_field->fn = hist_field_comm;
+		hist_field->str_len = TASK_COMM_LEN - 1;
+		break;
+	case FILTER_CPU:
+		hist_field->fn = hist_field_cpu;
+		break;
+	default:
+		hist_field->fn = select_value_fn(field->size,
+						 field->is_signed);
+		if (!hist_field->fn) {
+			kfree(hist_field);
+			return NULL;
+		}
+		break;
+	}
+
+	if (hist_field->str_len) {
+		hist_field->flags |= HIST_FIELD_FL_STRING;
+		hist_field->size = ALIGN(hist_field->str_len + 1, sizeof(u64));
+	}
+
+	return hist_field;
+}
+
+static int create_val_field(struct hist_trigger_data *hist_data,
+			    struct trace_event_file *file, char *field_name)
+{
+	struct ftrace_event_field *field;
+	unsigned int i = hist_data->n_vals;
+
+	if (!strcmp(field_name, "hitcount"))
+		return 0;
+
+	if (i >= TRACING_MAP_VALS_MAX)
+		return -EINVAL;
+
+	field = trace_find_event_field(file->event_call, field_name);
+	if (!field)
+		return -EINVAL;
+
+	hist_data->fields[i] = create_hist_field(field, 0);
+	if (!hist_data->fields[i])
+		return -EINVAL;
+
+	/* Strings can be keys, but there is nothing to add up */
+	if (hist_data->fields[i]->flags & HIST_FIELD_FL_STRING) {
+		kfree(hist_data->fields[i]);
+		hist_data->fields[i] = NULL;
+		return -EINVAL;
+	}
+
+	hist_data->n_vals++;
+	hist_data->n_fields++;
+
+	return 0;
+}
+
+static int create_val_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file,
+			     char *vals_str)
+{
+	char *field_str;
+	int ret;
+
+	/* The hitcount is always there */
+	hist_data->fields[0] = create_hist_field(NULL, HIST_FIELD_FL_HITCOUNT);
+	if (!hist_data->fields[0])
+		return -ENOMEM;
+	hist_data->n_vals = hist_data->n_fields = 1;
+
+	while (vals_str) {
+		field_str = strsep(&vals_str, ",");
+		ret = create_val_field(hist_data, file, field_str);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int create_key_field(struct hist_trigger_data *hist_data,
+			    struct trace_event_file *file, char *field_str)
+{
+	struct ftrace_event_field *field;
+	struct hist_field *hist_field;
+	unsigned long flags = HIST_FIELD_FL_KEY;
+	char *field_name;
+	unsigned int i = hist_data->n_fields;
+
+	if (hist_data->n_keys >= TRACING_MAP_KEYS_MAX)
+		return -EINVAL;
+
+	field_name = strsep(&field_str, ".");
+	if (field_str) {
+		if (!strcmp(field_str, "hex"))
+			flags |= HIST_FIELD_FL_HEX;
+		else if (!strcmp(field_str, "sym"))
+			flags |= HIST_FIELD_FL_SYM;
+		else
+			return -EINVAL;
+	}
+
+	field = trace_find_event_field(file->event_call, field_name);
+	if (!field)
+		return -EINVAL;
+
+	hist_field = create_hist_field(field, flags);
+	if (!hist_field)
+		return -EINVAL;
+	hist_data->fields[i] = hist_field;
+	hist_data->n_keys++;
+	hist_data->n_fields++;
+
+	if ((flags & (HIST_FIELD_FL_HEX | HIST_FIELD_FL_SYM)) &&
+	    (hist_field->flags & HIST_FIELD_FL_STRING))
+		return -EINVAL;
+
+	if (hist_data->key_size + hist_field->size > HIST_KEY_SIZE_MAX)
+		return -EINVAL;
+
+	hist_field->offset = hist_data->key_size;
+	hist_data->key_size += hist_field->size;
+
+	return 0;
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file,
+			     char *keys_str)
+{
+	char *field_str;
+	int ret;
+
+	while (keys_str) {
+		field_str = strsep(&keys_str, ",");
+		ret = create_key_field(hist_data, file, field_str);
+		if (ret)
+			return ret;
+	}
+
+	return hist_data->n_keys ? 0 : -EINVAL;
+}
+
+static int create_sort_keys(struct hist_trigger_data *hist_data,
+			    char *sort_str)
+{
+	struct tracing_map_sort_key *sort_key;
+	char *field_str, *field_name;
+	unsigned int i, j;
+
+	/* By default, sort on the hitcount, ascending */
+	hist_data->n_sort_keys = 1;
+	if (!sort_str)
+		return 0;
+
+	for (i = 0; sort_str; i++) {
+		if (i >= TRACING_MAP_SORT_KEYS_MAX)
+			return -EINVAL;
+
+		sort_key = &hist_data->sort_keys[i];
+		field_str = strsep(&sort_str, ",");
+		field_name = strsep(&field_str, ".");
+		if (field_str) {
+			if (!strcmp(field_str, "descending"))
+				sort_key->descending = true;
+			else if (strcmp(field_str, "ascending"))
+				return -EINVAL;
+		}
+
+		for (j = 0; j < hist_data->n_fields; j++)
+			if (!strcmp(field_name,
+				    hist_field_name(hist_data->fields[j])))
+				break;
+		if (j == hist_data->n_fields)
+			return -EINVAL;
+
+		sort_key->field_idx = j;
+	}
+	hist_data->n_sort_keys = i;
+
+	return 0;
+}
+
+static int create_tracing_map_fields(struct hist_trigger_data *hist_data)
+{
+	struct tracing_map *map = hist_data->map;
+	struct hist_field *hist_field;
+	tracing_map_cmp_fn_t cmp_fn;
+	unsigned int i;
+	int idx;
+
+	for (i = 0; i < hist_data->n_fields; i++) {
+		hist_field = hist_data->fields[i];
+		if (hist_field->flags & HIST_FIELD_FL_KEY) {
+			if (hist_field->flags & HIST_FIELD_FL_STRING)
+				cmp_fn = tracing_map_cmp_string;
+			else
+				cmp_fn = tracing_map_cmp_num(sizeof(u64),
+						hist_field->field->is_signed);
+			idx = tracing_map_add_key_field(map,
+							hist_field->offset,
+							cmp_fn);
+		} else
+			idx = tracing_map_add_sum_field(map);
+
+		if (WARN_ON_ONCE(idx != i))
+			return idx < 0 ? idx : -EINVAL;
+	}
+
+	return 0;
+}
+
+static struct hist_trigger_data *
+create_hist_data(struct hist_trigger_attrs *attrs,
+		 struct trace_event_file *file)
+{
+	struct hist_trigger_data *hist_data;
+	int ret;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	ret = create_val_fields(hist_data, file, attrs->vals_str);
+	if (ret)
+		goto free;
+
+	ret = create_key_fields(hist_data, file, attrs->keys_str);
+	if (ret)
+		goto free;
+
+	ret = create_sort_keys(hist_data, attrs->sort_key_str);
+	if (ret)
+		goto free;
+
+	hist_data->map = tracing_map_create(attrs->map_bits,
+					    hist_data->key_size);
+	if (IS_ERR(hist_data->map)) {
+		ret = PTR_ERR(hist_data->map);
+		hist_data->map = NULL;
+		goto free;
+	}
+
+	ret = create_tracing_map_fields(hist_data);
+	if (ret)
+		goto free;
+
+	ret = tracing_map_init(hist_data->map);
+	if (ret)
+		goto free;
+
+	return hist_data;
+ free:
+	destroy_hist_data(hist_data);
+
+	return ERR_PTR(ret);
+}
+
+static void event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	char compound_key[HIST_KEY_SIZE_MAX];
+	struct hist_field *hist_field;
+	struct tracing_map_elt *elt;
+	u64 field_contents;
+	char *str;
+	unsigned int i;
+
+	if (WARN_ON_ONCE(!rec))
+		return;
+
+	memset(compound_key, 0, hist_data->key_size);
+
+	for_each_hist_key_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		field_contents = hist_field->fn(hist_field, rec);
+
+		if (hist_field->flags & HIST_FIELD_FL_STRING) {
+			str = (char *)(unsigned long)field_contents;
+			if (str)
+				strncpy(compound_key + hist_field->offset, str,
+					hist_field->str_len);
+		} else
+			memcpy(compound_key + hist_field->offset,
+			       &field_contents, sizeof(u64));
+	}
+
+	elt = tracing_map_insert(hist_data->map, compound_key);
+	if (!elt)
+		return;
+
+	for_each_hist_val_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		tracing_map_update_sum(elt, i, hist_field->fn(hist_field, rec));
+	}
+}
+
+static void hist_trigger_print_key(struct seq_file *m,
+				   struct hist_trigger_data *hist_data,
+				   void *key)
+{
+	char str[KSYM_SYMBOL_LEN];
+	struct hist_field *key_field;
+	const char *name;
+	unsigned int i;
+	u64 uval;
+
+	seq_puts(m, "{ ");
+
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+		name = hist_field_name(key_field);
+
+		if (i > hist_data->n_vals)
+			seq_puts(m, ", ");
+
+		if (key_field->flags & HIST_FIELD_FL_STRING) {
+			seq_printf(m, "%s: %-50s", name,
+				   (char *)(key + key_field->offset));
+			continue;
+		}
+
+		uval = *(u64 *)(key + key_field->offset);
+		if (key_field->flags & HIST_FIELD_FL_HEX) {
+			seq_printf(m, "%s: %llx", name, uval);
+		} else if (key_field->flags & HIST_FIELD_FL_SYM) {
+			sprint_symbol_no_offset(str, uval);
+			seq_printf(m, "%s: [%llx] %-45s", name, uval, str);
+		} else if (key_field->field->is_signed) {
+			seq_printf(m, "%s: %10lld", name, (s64)uval);
+		} else {
+			seq_printf(m, "%s: %10llu", name, uval);
+		}
+	}
+
+	seq_puts(m, " }");
+}
+
+static void hist_trigger_show(struct seq_file *m,
+			      struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct tracing_map_sort_entry *entries;
+	unsigned int i, j;
+	int n_entries;
+
+	seq_puts(m, "# event histogram\n#\n# trigger info: ");
+	data->ops->print(m, data->ops, data);
+	seq_puts(m, "#\n\n");
+
+	n_entries = tracing_map_sort_entries(hist_data->map,
+					     hist_data->sort_keys,
+					     hist_data->n_sort_keys,
+					     &entries);
+	if (n_entries < 0) {
+		seq_printf(m, "# error sorting entries: %d\n", n_entries);
+		return;
+	}
+
+	for (i = 0; i < n_entries; i++) {
+		hist_trigger_print_key(m, hist_data, entries[i].key);
+
+		for_each_hist_val_field(j, hist_data)
+			seq_printf(m, " %s: %10llu",
+				   hist_field_name(hist_data->fields[j]),
+				   tracing_map_read_sum(entries[i].elt, j));
+		seq_putc(m, '\n');
+	}
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %d\n    Dropped: %llu\n",
+		   (u64)atomic64_read(&hist_data->map->hits),
+		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+
+	tracing_map_destroy_sort_entries(entries);
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct event_trigger_data *data;
+	struct trace_event_file *event_file;
+	int ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	event_file = event_file_data(m->private);
+	if (unlikely(!event_file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	list_for_each_entry_rcu(data, &event_file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			hist_trigger_show(m, data);
+	}
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
+{
+	seq_puts(m, hist_field_name(hist_field));
+
+	if (hist_field->flags & HIST_FIELD_FL_HEX)
+		seq_puts(m, ".hex");
+	else if (hist_field->flags & HIST_FIELD_FL_SYM)
+		seq_puts(m, ".sym");
+}
+
+static int event_hist_trigger_print(struct seq_file *m,
+				    struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct tracing_map_sort_key *sort_key;
+	unsigned int i;
+
+	seq_puts(m, "hist:keys=");
+
+	for_each_hist_key_field(i, hist_data) {
+		if (i > hist_data->n_vals)
+			seq_puts(m, ",");
+		hist_field_print(m, hist_data->fields[i]);
+	}
+
+	seq_puts(m, ":vals=");
+
+	for_each_hist_val_field(i, hist_data) {
+		if (i)
+			seq_puts(m, ",");
+		hist_field_print(m, hist_data->fields[i]);
+	}
+
+	seq_puts(m, ":sort=");
+
+	for (i = 0; i < hist_data->n_sort_keys; i++) {
+		sort_key = &hist_data->sort_keys[i];
+		if (i)
+			seq_puts(m, ",");
+		seq_puts(m,
+			 hist_field_name(hist_data->fields[sort_key->field_idx]));
+		if (sort_key->descending)
+			seq_puts(m, ".descending");
+	}
+
+	seq_printf(m, ":size=%u", hist_data->map->max_elts);
+
+	if (data->filter_str)
+		seq_printf(m, " if %s", data->filter_str);
+
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static void event_hist_trigger_free(struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		/* This waits for the event to be done with the map too */
+		trigger_data_free(data);
+		destroy_hist_data(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *event_hist_get_trigger_ops(char *cmd,
+							    char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static int event_hist_trigger_func(struct event_command *cmd_ops,
+				   struct trace_event_file *file,
+				   char *glob, char *cmd, char *param)
+{
+	struct event_trigger_data *trigger_data;
+	struct hist_trigger_data *hist_data = NULL;
+	struct event_trigger_ops *trigger_ops;
+	struct hist_trigger_attrs *attrs;
+	char *trigger;
+	int ret;
+
+	trigger_ops = cmd_ops->get_trigger_ops(cmd, param);
+
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		return -ENOMEM;
+
+	trigger_data->count = -1;
+	trigger_data->ops = trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	INIT_LIST_HEAD(&trigger_data->list);
+
+	/* There is only one hist trigger per event, no need to parse it */
+	if (glob[0] == '!') {
+		cmd_ops->unreg(glob+1, trigger_ops, trigger_data, file);
+		kfree(trigger_data);
+		return 0;
+	}
+
+	ret = -EINVAL;
+	if (!param)
+		goto out_free;
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+
+	attrs = parse_hist_trigger_attrs(trigger);
+	if (IS_ERR(attrs)) {
+		ret = PTR_ERR(attrs);
+		goto out_free;
+	}
+
+	hist_data = create_hist_data(attrs, file);
+	destroy_hist_trigger_attrs(attrs);
+	if (IS_ERR(hist_data)) {
+		ret = PTR_ERR(hist_data);
+		hist_data = NULL;
+		goto out_free;
+	}
+
+	trigger_data->private_data = hist_data;
+
+	if (param) { /* if param is non-empty, it's supposed to be a filter */
+		ret = cmd_ops->set_filter(param, trigger_data, file);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = cmd_ops->reg(glob, trigger_ops, trigger_data, file);
+	/*
+	 * The above returns on success the # of triggers registered,
+	 * but if it didn't register any it returns zero.  Consider no
+	 * triggers registered a failure too.
+	 */
+	if (!ret) {
+		ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+
+	return 0;
+ out_free:
+	cmd_ops->set_filter(NULL, trigger_data, NULL);
+	kfree(trigger_data);
+	if (hist_data)
+		destroy_hist_data(hist_data);
+
+	return ret;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
@@ -66,6 +66,17 @@ struct fgraph_data {
 
 static unsigned int max_depth;
 
+/*
+ * With graph_sample_rate set to N > 1, only one in N calls that would
+ * start a new graph on a cpu (depth 0) is hooked, along with what it
+ * calls.  This bounds the overhead enough to leave running in production.
+ */
+static unsigned int graph_sample_rate;
+static DEFINE_PER_CPU(unsigned int, graph_sample_count);
+
+/* Mirrors TRACE_GRAPH_DURATION_ONLY, which set_flag sees before it is set */
+static bool graph_duration_only;
+
 static struct tracer_opt trace_opts[] = {
 	/* Display overruns? (for self-debug purpose) */
 	{ TRACER_OPT(funcgraph-overrun, TRACE_GRAPH_PRINT_OVERRUN) },
@@ -87,6 +98,8 @@ static struct tracer_opt trace_opts[] = {
 	{ TRACER_OPT(sleep-time, TRACE_GRAPH_SLEEP_TIME) },
 	/* Include time within nested functions */
 	{ TRACER_OPT(graph-time, TRACE_GRAPH_GRAPH_TIME) },
+	/* Only record returns, with their duration */
+	{ TRACER_OPT(funcgraph-duration-only, TRACE_GRAPH_DURATION_ONLY) },
 	{ } /* Empty entry */
 };
 
@@ -308,6 +321,16 @@ static inline int ftrace_graph_ignore_irqs(void)
 	return in_irq();
 }
 
+static inline bool ftrace_graph_sample_skip(struct ftrace_graph_ent *trace)
+{
+	unsigned int rate = READ_ONCE(graph_sample_rate);
+
+	if (rate <= 1 || trace->depth)
+		return false;
+
+	return this_cpu_inc_return(graph_sample_count) % rate != 0;
+}
+
 int trace_graph_entry(struct ftrace_graph_ent *trace)
 {
 	struct trace_array *tr = graph_array;
@@ -327,6 +350,9 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	    (max_depth && trace->depth >= max_depth))
 		return 0;
 
+	if (ftrace_graph_sample_skip(trace))
+		return 0;
+
 	/*
 	 * Do not trace a function if it's filtered by set_graph_notrace.
 	 * Make the index of ret stack negative to indicate that it should
@@ -354,12 +380,28 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	return ret;
 }
 
-static int trace_graph_thresh_entry(struct ftrace_graph_ent *trace)
+/*
+ * Entry handler used when only durations are recorded, either because
+ * tracing_thresh is set or funcgraph-duration-only is.  Nothing is
+ * written at entry, the return is only hooked for the functions that
+ * pass the filters below: with set_graph_function set that is just the
+ * listed functions, not everything they call.
+ */
+static int trace_graph_duration_entry(struct ftrace_graph_ent *trace)
 {
-	if (tracing_thresh)
-		return 1;
-	else
-		return trace_graph_entry(trace);
+	if (!ftrace_trace_task(current))
+		return 0;
+
+	if (!ftrace_graph_addr(trace->func) ||
+	    ftrace_graph_notrace_addr(trace->func) ||
+	    ftrace_graph_ignore_irqs() || (trace->depth < 0) ||
+	    (max_depth && trace->depth >= max_depth))
+		return 0;
+
+	if (ftrace_graph_sample_skip(trace))
+		return 0;
+
+	return 1;
 }
 
 static void
@@ -440,7 +482,8 @@ void set_graph_array(struct trace_array *tr)
 	smp_mb();
 }
 
-static void trace_graph_thresh_return(struct ftrace_graph_ret *trace)
+/* The threshold is checked before anything is reserved in the buffer */
+static void trace_graph_duration_return(struct ftrace_graph_ret *trace)
 {
 	if (tracing_thresh &&
 	    (trace->rettime - trace->calltime < tracing_thresh))
@@ -454,9 +497,9 @@ static int graph_trace_init(struct trace_array *tr)
 	int ret;
 
 	set_graph_array(tr);
-	if (tracing_thresh)
-		ret = register_ftrace_graph(&trace_graph_thresh_return,
-					    &trace_graph_thresh_entry);
+	if (tracing_thresh || graph_duration_only)
+		ret = register_ftrace_graph(&trace_graph_duration_return,
+					    &trace_graph_duration_entry);
 	else
 		ret = register_ftrace_graph(&trace_graph_return,
 					    &trace_graph_entry);
@@ -1375,6 +1418,12 @@ func_graph_set_flag(struct trace_array *tr, u32 old_flags, u32 bit, int set)
 	if (bit == TRACE_GRAPH_GRAPH_TIME)
 		ftrace_graph_graph_time_control(set);
 
+	/* Switch the entry and return handlers of the running tracer */
+	if (bit == TRACE_GRAPH_DURATION_ONLY && graph_duration_only != !!set) {
+		graph_duration_only = !!set;
+		return graph_trace_update_thresh(tr);
+	}
+
 	return 0;
 }
 
@@ -1448,6 +1497,43 @@ static const struct file_operations graph_depth_fops = {
 	.llseek		= generic_file_llseek,
 };
 
+static ssize_t
+graph_sample_write(struct file *filp, const char __user *ubuf, size_t cnt,
+		   loff_t *ppos)
+{
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint_from_user(ubuf, cnt, 10, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(graph_sample_rate, val);
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+static ssize_t
+graph_sample_read(struct file *filp, char __user *ubuf, size_t cnt,
+		  loff_t *ppos)
+{
+	char buf[15]; /* More than enough to hold UINT_MAX + "\n"*/
+	int n;
+
+	n = sprintf(buf, "%u\n", graph_sample_rate);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, n);
+}
+
+static const struct file_operations graph_sample_fops = {
+	.open		= tracing_open_generic,
+	.write		= graph_sample_write,
+	.read		= graph_sample_read,
+	.llseek		= generic_file_llseek,
+};
+
 static __init int init_graph_tracefs(void)
 {
 	struct dentry *d_tracer;
@@ -1458,6 +1544,8 @@ static __init int init_graph_tracefs(void)
 
 	trace_create_file("max_graph_depth", 0644, d_tracer,
 			  NULL, &graph_depth_fops);
+	trace_create_file("graph_sample_rate", 0644, d_tracer,
+			  NULL, &graph_sample_fops);
 
 	return 0;
 }
@@ -0,0 +1,506 @@
+/*
+ * tracing_map - lock-free map for tracing
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+
+#include "tracing_map.h"
+#include "trace.h"
+
+/**
+ * tracing_map_update_sum - Add a value to a tracing_map_elt's sum field
+ * @elt: The tracing_map_elt
+ * @i: The index of the given sum associated with the tracing_map_elt
+ * @n: The value to add to the sum
+ *
+ * Safe to call from any context, concurrently with other updates.
+ */
+void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
+{
+	atomic64_add(n, &elt->sums[i]);
+}
+
+/**
+ * tracing_map_read_sum - Return the value of a tracing_map_elt's sum field
+ * @elt: The tracing_map_elt
+ * @i: The index of the given sum associated with the tracing_map_elt
+ */
+u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
+{
+	return (u64)atomic64_read(&elt->sums[i]);
+}
+
+int tracing_map_cmp_string(void *val_a, void *val_b)
+{
+	char *a = val_a;
+	char *b = val_b;
+
+	return strcmp(a, b);
+}
+
+int tracing_map_cmp_none(void *val_a, void *val_b)
+{
+	return 0;
+}
+
+#define DEFINE_TRACING_MAP_CMP_FN(type)					\
+static int tracing_map_cmp_##type(void *val_a, void *val_b)		\
+{									\
+	type a = *(type *)val_a;					\
+	type b = *(type *)val_b;					\
+									\
+	return (a > b) - (a < b);					\
+}
+
+DEFINE_TRACING_MAP_CMP_FN(s64);
+DEFINE_TRACING_MAP_CMP_FN(u64);
+DEFINE_TRACING_MAP_CMP_FN(s32);
+DEFINE_TRACING_MAP_CMP_FN(u32);
+DEFINE_TRACING_MAP_CMP_FN(s16);
+DEFINE_TRACING_MAP_CMP_FN(u16);
+DEFINE_TRACING_MAP_CMP_FN(s8);
+DEFINE_TRACING_MAP_CMP_FN(u8);
+
+tracing_map_cmp_fn_t tracing_map_cmp_num(int field_size,
+					 int field_is_signed)
+{
+	tracing_map_cmp_fn_t fn = tracing_map_cmp_none;
+
+	switch (field_size) {
+	case 8:
+		fn = field_is_signed ? tracing_map_cmp_s64 : tracing_map_cmp_u64;
+		break;
+	case 4:
+		fn = field_is_signed ? tracing_map_cmp_s32 : tracing_map_cmp_u32;
+		break;
+	case 2:
+		fn = field_is_signed ? tracing_map_cmp_s16 : tracing_map_cmp_u16;
+		break;
+	case 1:
+		fn = field_is_signed ? tracing_map_cmp_s8 : tracing_map_cmp_u8;
+		break;
+	}
+
+	return fn;
+}
+
+static int tracing_map_add_field(struct tracing_map *map,
+				 tracing_map_cmp_fn_t cmp_fn)
+{
+	if (map->n_fields >= TRACING_MAP_FIELDS_MAX)
+		return -EINVAL;
+
+	map->fields[map->n_fields].cmp_fn = cmp_fn;
+
+	return map->n_fields++;
+}
+
+/**
+ * tracing_map_add_sum_field - Add a field describing a tracing_map sum
+ * @map: The tracing_map
+ *
+ * Must be called before tracing_map_init().
+ *
+ * Return: The index identifying the field in the map and its elements,
+ * or -EINVAL if there are already TRACING_MAP_FIELDS_MAX fields.
+ */
+int tracing_map_add_sum_field(struct tracing_map *map)
+{
+	return tracing_map_add_field(map, NULL);
+}
+
+/**
+ * tracing_map_add_key_field - Add a field describing a tracing_map key
+ * @map: The tracing_map
+ * @offset: The offset of this part within the (compound) key
+ * @cmp_fn: The comparison function used to sort on this part of the key
+ *
+ * Must be called before tracing_map_init().
+ *
+ * Return: The index identifying the field in the map, or -EINVAL if
+ * there are already TRACING_MAP_FIELDS_MAX fields.
+ */
+int tracing_map_add_key_field(struct tracing_map *map,
+			      unsigned int offset,
+			      tracing_map_cmp_fn_t cmp_fn)
+{
+	int idx = tracing_map_add_field(map, cmp_fn);
+
+	if (idx < 0)
+		return idx;
+
+	map->fields[idx].offset = offset;
+	map->fields[idx].is_key = true;
+
+	return idx;
+}
+
+static void tracing_map_array_free(struct tracing_map_array *a)
+{
+	unsigned int i;
+
+	if (!a)
+		return;
+
+	if (a->pages) {
+		for (i = 0; i < a->n_pages; i++)
+			free_page((unsigned long)a->pages[i]);
+		kfree(a->pages);
+	}
+	kfree(a);
+}
+
+static struct tracing_map_array *tracing_map_array_alloc(unsigned int n_elts,
+							  unsigned int entry_size)
+{
+	struct tracing_map_array *a;
+	unsigned int i;
+
+	a = kzalloc(sizeof(*a), GFP_KERNEL);
+	if (!a)
+		return NULL;
+
+	a->entry_size_shift = fls(roundup_pow_of_two(entry_size) - 1);
+	a->entries_per_page = PAGE_SIZE / (1 << a->entry_size_shift);
+	a->n_pages = DIV_ROUND_UP(n_elts, a->entries_per_page);
+	a->entry_shift = fls(a->entries_per_page) - 1;
+	a->entry_mask = (1 << a->entry_shift) - 1;
+
+	a->pages = kcalloc(a->n_pages, sizeof(void *), GFP_KERNEL);
+	if (!a->pages)
+		goto free;
+
+	for (i = 0; i < a->n_pages; i++) {
+		a->pages[i] = (void *)get_zeroed_page(GFP_KERNEL);
+		if (!a->pages[i])
+			goto free;
+	}
+
+	return a;
+ free:
+	tracing_map_array_free(a);
+
+	return NULL;
+}
+
+static void tracing_map_elt_free(struct tracing_map_elt *elt)
+{
+	if (!elt)
+		return;
+
+	kfree(elt->sums);
+	kfree(elt->key);
+	kfree(elt);
+}
+
+static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
+{
+	struct tracing_map_elt *elt;
+
+	elt = kzalloc(sizeof(*elt), GFP_KERNEL);
+	if (!elt)
+		return NULL;
+
+	elt->map = map;
+
+	elt->key = kzalloc(map->key_size, GFP_KERNEL);
+	elt->sums = kcalloc(map->n_fields, sizeof(*elt->sums), GFP_KERNEL);
+	if (!elt->key || !elt->sums) {
+		tracing_map_elt_free(elt);
+		return NULL;
+	}
+
+	return elt;
+}
+
+static struct tracing_map_elt *get_free_elt(struct tracing_map *map)
+{
+	int idx;
+
+	/* Don't let next_elt wrap around once the elements are used up */
+	if (atomic_read(&map->next_elt) >= (int)map->max_elts - 1)
+		return NULL;
+
+	idx = atomic_inc_return(&map->next_elt);
+	if (idx >= map->max_elts)
+		return NULL;
+
+	return TRACING_MAP_ELT(map->elts, idx);
+}
+
+/**
+ * tracing_map_insert - Insert key and/or retrieve val from a tracing_map
+ * @map: The tracing_map to insert into
+ * @key: The key to insert, map->key_size bytes
+ *
+ * Looks up @key in the map, claiming a free element for it if it isn't
+ * there yet, and returns that element.  The caller then updates its
+ * sums with tracing_map_update_sum().
+ *
+ * This is lock-free and may be called from any context, including NMI.
+ * Two cpus inserting the same key at once race for the same slot: the
+ * loser waits for the winner to publish its element instead of
+ * creating a duplicate, though only for as many iterations as the map
+ * has slots, in case the winner is the context it interrupted.
+ *
+ * Return: the element for @key, or NULL if there are no free elements
+ * left, in which case map->drops is incremented.
+ */
+struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
+{
+	struct tracing_map_entry *entry;
+	struct tracing_map_elt *val;
+	u32 idx, key_hash, test_key;
+	unsigned int dup_try = 0;
+
+	key_hash = jhash(key, map->key_size, 0);
+	/* A zero key marks a free slot */
+	if (key_hash == 0)
+		key_hash = 1;
+
+	idx = key_hash >> (32 - (map->map_bits + 1));
+
+	while (1) {
+		idx &= (map->map_size - 1);
+		entry = TRACING_MAP_ENTRY(map->map, idx);
+		test_key = READ_ONCE(entry->key);
+
+		if (test_key && test_key == key_hash) {
+			val = lockless_dereference(entry->val);
+			if (val && !memcmp(key, val->key, map->key_size)) {
+				atomic64_inc(&map->hits);
+				return val;
+			}
+			if (unlikely(!val)) {
+				if (++dup_try > map->map_size)
+					break;
+				continue;
+			}
+		}
+
+		if (!test_key) {
+			if (!cmpxchg(&entry->key, 0, key_hash)) {
+				struct tracing_map_elt *elt;
+
+				elt = get_free_elt(map);
+				if (!elt) {
+					entry->key = 0;
+					break;
+				}
+
+				memcpy(elt->key, key, map->key_size);
+				/* The key must be there before it can match */
+				smp_wmb();
+				WRITE_ONCE(entry->val, elt);
+				atomic64_inc(&map->hits);
+
+				return elt;
+			}
+			/* Someone else took the slot, look at it again */
+			continue;
+		}
+
+		idx++;
+	}
+
+	atomic64_inc(&map->drops);
+
+	return NULL;
+}
+
+/**
+ * tracing_map_destroy - Destroy a tracing_map
+ * @map: The tracing_map to destroy
+ *
+ * Frees a tracing_map and all its elements.  The caller must make
+ * sure nothing can be inserting into it anymore.
+ */
+void tracing_map_destroy(struct tracing_map *map)
+{
+	unsigned int i;
+
+	if (!map)
+		return;
+
+	if (map->elts) {
+		for (i = 0; i < map->max_elts; i++)
+			tracing_map_elt_free(TRACING_MAP_ELT(map->elts, i));
+		tracing_map_array_free(map->elts);
+	}
+	tracing_map_array_free(map->map);
+	kfree(map);
+}
+
+/**
+ * tracing_map_create - Create a lock-free map and element pool
+ * @map_bits: The size of the map (2 ** map_bits elements)
+ * @key_size: The size of the key for the map in bytes
+ *
+ * Creates the map; fields are then added to it with
+ * tracing_map_add_sum_field() and tracing_map_add_key_field(), and
+ * tracing_map_init() preallocates its elements.  The table has twice
+ * as many slots as elements, which keeps probe sequences short.
+ *
+ * Return: the tracing_map pointer if successful, ERR_PTR if not.
+ */
+struct tracing_map *tracing_map_create(unsigned int map_bits,
+				       unsigned int key_size)
+{
+	struct tracing_map *map;
+
+	if (map_bits < TRACING_MAP_BITS_MIN ||
+	    map_bits > TRACING_MAP_BITS_MAX)
+		return ERR_PTR(-EINVAL);
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+
+	map->map_bits = map_bits;
+	map->max_elts = (1 << map_bits);
+	atomic_set(&map->next_elt, -1);
+
+	map->map_size = (1 << (map_bits + 1));
+	map->key_size = key_size;
+
+	map->map = tracing_map_array_alloc(map->map_size,
+					   sizeof(struct tracing_map_entry));
+	if (!map->map) {
+		tracing_map_destroy(map);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	return map;
+}
+
+/**
+ * tracing_map_init - Allocate and clear a map's tracing_map_elts
+ * @map: The tracing_map to initialize
+ *
+ * Preallocates all of the map's elements, once its fields are known.
+ *
+ * Return: 0 if successful, a negative error otherwise.
+ */
+int tracing_map_init(struct tracing_map *map)
+{
+	unsigned int i;
+
+	if (map->n_fields < 2)
+		return -EINVAL; /* need at least 1 key and 1 val */
+
+	map->elts = tracing_map_array_alloc(map->max_elts,
+					    sizeof(struct tracing_map_elt *));
+	if (!map->elts)
+		return -ENOMEM;
+
+	for (i = 0; i < map->max_elts; i++) {
+		TRACING_MAP_ELT(map->elts, i) = tracing_map_elt_alloc(map);
+		if (!TRACING_MAP_ELT(map->elts, i))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int cmp_entries(const void *A, const void *B)
+{
+	const struct tracing_map_sort_entry *a = A, *b = B;
+	struct tracing_map *map = a->elt->map;
+	struct tracing_map_sort_key *sort_key;
+	struct tracing_map_field *field;
+	unsigned int i;
+	u64 val_a, val_b;
+	int ret;
+
+	for (i = 0; i < map->n_sort_keys; i++) {
+		sort_key = &map->sort_keys[i];
+		field = &map->fields[sort_key->field_idx];
+
+		if (field->is_key) {
+			ret = field->cmp_fn(a->key + field->offset,
+					    b->key + field->offset);
+		} else {
+			val_a = tracing_map_read_sum(a->elt, sort_key->field_idx);
+			val_b = tracing_map_read_sum(b->elt, sort_key->field_idx);
+			ret = (val_a > val_b) - (val_a < val_b);
+		}
+
+		if (sort_key->descending)
+			ret = -ret;
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * tracing_map_sort_entries - Sort the current set of tracing_map_elts in a map
+ * @map: The tracing_map
+ * @sort_keys: The fields to sort on, most significant first
+ * @n_sort_keys: The number of sort keys
+ * @entries: outval: pointer to the array of sorted entries
+ *
+ * Collects the elements currently in the map and sorts them.  The map
+ * can still be updated meanwhile, so sums read while sorting are only
+ * a snapshot.  Calls into this function on the same map must be
+ * serialized by the caller, since the sort keys are kept in the map.
+ *
+ * Return: the number of sorted entries, or a negative error.  Free
+ * the array with tracing_map_destroy_sort_entries().
+ */
+int tracing_map_sort_entries(struct tracing_map *map,
+			     struct tracing_map_sort_key *sort_keys,
+			     unsigned int n_sort_keys,
+			     struct tracing_map_sort_entry **entries)
+{
+	struct tracing_map_sort_entry *sort_entries;
+	struct tracing_map_entry *entry;
+	struct tracing_map_elt *elt;
+	unsigned int i, n_entries = 0;
+
+	if (n_sort_keys > TRACING_MAP_SORT_KEYS_MAX)
+		return -EINVAL;
+
+	sort_entries = vmalloc(map->max_elts * sizeof(*sort_entries));
+	if (!sort_entries)
+		return -ENOMEM;
+
+	for (i = 0; i < map->map_size && n_entries < map->max_elts; i++) {
+		entry = TRACING_MAP_ENTRY(map->map, i);
+		elt = lockless_dereference(entry->val);
+		if (!READ_ONCE(entry->key) || !elt)
+			continue;
+
+		sort_entries[n_entries].key = elt->key;
+		sort_entries[n_entries].elt = elt;
+		n_entries++;
+	}
+
+	memcpy(map->sort_keys, sort_keys, n_sort_keys * sizeof(*sort_keys));
+	map->n_sort_keys = n_sort_keys;
+
+	sort(sort_entries, n_entries, sizeof(*sort_entries), cmp_entries, NULL);
+
+	*entries = sort_entries;
+
+	return n_entries;
+}
+
+void tracing_map_destroy_sort_entries(struct tracing_map_sort_entry *entries)
+{
+	vfree(entries);
+}
@@ -0,0 +1,125 @@
+#ifndef __TRACING_MAP_H
+#define __TRACING_MAP_H
+
+#define TRACING_MAP_BITS_DEFAULT	11
+#define TRACING_MAP_BITS_MAX		17
+#define TRACING_MAP_BITS_MIN		7
+
+#define TRACING_MAP_KEYS_MAX		2
+#define TRACING_MAP_VALS_MAX		3
+#define TRACING_MAP_FIELDS_MAX		(TRACING_MAP_KEYS_MAX + \
+					 TRACING_MAP_VALS_MAX)
+#define TRACING_MAP_SORT_KEYS_MAX	2
+
+typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
+
+/*
+ * A tracing_map is a lock-free hash table meant to be updated from
+ * any context a trace event can fire in, including NMI.  Everything
+ * is allocated up front by tracing_map_init(): inserting a new key
+ * claims one of max_elts preallocated elements, and once they are
+ * gone further new keys are counted in @drops instead.
+ *
+ * Each element holds a copy of its key and one sum per field, added
+ * to atomically with tracing_map_update_sum().  A key field instead
+ * describes one part of a compound key, and is only used for sorting;
+ * its sum stays zero.  Fields are referred to by the index
+ * tracing_map_add_sum_field() or tracing_map_add_key_field() returned
+ * when they were added.
+ *
+ * The table itself has twice as many slots as there are elements and
+ * uses linear probing.  Slots and elements are never freed until the
+ * map is destroyed, which is what keeps lookups lock-free.
+ */
+struct tracing_map_field {
+	tracing_map_cmp_fn_t		cmp_fn;
+	unsigned int			offset;		/* in the key */
+	bool				is_key;
+};
+
+struct tracing_map_elt {
+	struct tracing_map		*map;
+	atomic64_t			*sums;
+	void				*key;
+};
+
+struct tracing_map_entry {
+	u32				key;
+	struct tracing_map_elt		*val;
+};
+
+struct tracing_map_sort_key {
+	unsigned int			field_idx;
+	bool				descending;
+};
+
+struct tracing_map_sort_entry {
+	void				*key;
+	struct tracing_map_elt		*elt;
+};
+
+/* Preallocated arrays are built from single pages, not vmalloc */
+struct tracing_map_array {
+	unsigned int			entries_per_page;
+	unsigned int			entry_size_shift;
+	unsigned int			entry_shift;
+	unsigned int			entry_mask;
+	unsigned int			n_pages;
+	void				**pages;
+};
+
+#define TRACING_MAP_ARRAY_ELT(array, idx)				\
+	(array->pages[idx >> array->entry_shift] +			\
+	 ((idx & array->entry_mask) << array->entry_size_shift))
+
+#define TRACING_MAP_ENTRY(array, idx)					\
+	((struct tracing_map_entry *)TRACING_MAP_ARRAY_ELT(array, idx))
+
+#define TRACING_MAP_ELT(array, idx)					\
+	(*(struct tracing_map_elt **)TRACING_MAP_ARRAY_ELT(array, idx))
+
+struct tracing_map {
+	unsigned int			key_size;
+	unsigned int			map_bits;
+	unsigned int			map_size;
+	unsigned int			max_elts;
+	atomic_t			next_elt;
+	struct tracing_map_array	*elts;
+	struct tracing_map_array	*map;
+	struct tracing_map_field	fields[TRACING_MAP_FIELDS_MAX];
+	unsigned int			n_fields;
+	struct tracing_map_sort_key	sort_keys[TRACING_MAP_SORT_KEYS_MAX];
+	unsigned int			n_sort_keys;
+	atomic64_t			hits;
+	atomic64_t			drops;
+};
+
+extern struct tracing_map *tracing_map_create(unsigned int map_bits,
+					      unsigned int key_size);
+extern int tracing_map_init(struct tracing_map *map);
+extern int tracing_map_add_sum_field(struct tracing_map *map);
+extern int tracing_map_add_key_field(struct tracing_map *map,
+				     unsigned int offset,
+				     tracing_map_cmp_fn_t cmp_fn);
+extern void tracing_map_destroy(struct tracing_map *map);
+
+extern struct tracing_map_elt *
+tracing_map_insert(struct tracing_map *map, void *key);
+
+extern tracing_map_cmp_fn_t tracing_map_cmp_num(int field_size,
+						int field_is_signed);
+extern int tracing_map_cmp_string(void *val_a, void *val_b);
+extern int tracing_map_cmp_none(void *val_a, void *val_b);
+
+extern void tracing_map_update_sum(struct tracing_map_elt *elt,
+				   unsigned int i, u64 n);
+extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
+
+extern int tracing_map_sort_entries(struct tracing_map *map,
+				    struct tracing_map_sort_key *sort_keys,
+				    unsigned int n_sort_keys,
+				    struct tracing_map_sort_entry **entries);
+extern void
+tracing_map_destroy_sort_entries(struct tracing_map_sort_entry *entries);
+
+#endif /* __TRACING_MAP_H */
@@ -0,0 +1,293 @@
+/*
+ * Sharded object cache with CLOCK replacement
+ *
+ * See include/linux/clock_cache.h for the locking and reference counting
+ * rules.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/bitops.h>
+#include <linux/bug.h>
+#include <linux/clock_cache.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static inline u32 cc_hash(u64 key)
+{
+	return hash_64(key, 32);
+}
+
+static inline struct cc_shard *cc_shard(struct clock_cache *cc, u32 hash)
+{
+	if (!cc->shard_bits)
+		return cc->shards;
+	return &cc->shards[hash >> (32 - cc->shard_bits)];
+}
+
+static inline struct hlist_head *cc_bucket(struct clock_cache *cc,
+					   struct cc_shard *s, u32 hash)
+{
+	return &s->buckets[hash & ((1U << cc->bucket_bits) - 1)];
+}
+
+/*
+ * Take @e off its hash chain and out of the clock ring.  The ring is kept
+ * dense by moving the last entry into the hole; the hand is left where it
+ * is, so the moved entry is the next one it looks at.
+ */
+static void cc_unlink(struct cc_shard *s, struct cc_entry *e)
+{
+	struct cc_entry *last;
+
+	clear_bit(__CC_LINKED, &e->flags);
+	hlist_del_rcu(&e->hash);
+
+	last = s->ring[--s->nr];
+	s->ring[e->slot] = last;
+	last->slot = e->slot;
+	s->ring[s->nr] = NULL;
+}
+
+/*
+ * Advance the clock hand to the first idle entry that has not been hit
+ * since the hand last passed it, clearing referenced bits on the way, and
+ * claim it.  Two full sweeps are enough to find such an entry if there is
+ * one at all; if every entry is in use, give up.
+ */
+static struct cc_entry *cc_evict(struct cc_shard *s)
+{
+	unsigned int scan;
+
+	for (scan = 0; scan < 2 * s->nr; scan++) {
+		struct cc_entry *e;
+
+		if (s->hand >= s->nr)
+			s->hand = 0;
+		e = s->ring[s->hand];
+
+		if (atomic_read(&e->refcnt) != 1 ||
+		    test_and_clear_bit(__CC_REFERENCED, &e->flags) ||
+		    atomic_cmpxchg(&e->refcnt, 1, 0) != 1) {
+			s->hand++;
+			continue;
+		}
+
+		cc_unlink(s, e);
+		s->evictions++;
+		return e;
+	}
+
+	s->starving++;
+	return NULL;
+}
+
+static struct cc_entry *cc_find(struct hlist_head *head, u64 key)
+{
+	struct cc_entry *e;
+
+	hlist_for_each_entry_rcu(e, head, hash) {
+		if (e->key != key)
+			continue;
+		/* A zero count means the entry is being evicted: a miss */
+		if (!atomic_inc_not_zero(&e->refcnt))
+			return NULL;
+		if (!test_bit(__CC_REFERENCED, &e->flags))
+			set_bit(__CC_REFERENCED, &e->flags);
+		return e;
+	}
+	return NULL;
+}
+
+/**
+ * clock_cache_lookup - find an entry and take a reference on it
+ * @cc: the cache
+ * @key: the key to look up
+ *
+ * Lockless; may be called from any context that may call clock_cache_put().
+ * Returns the entry with an elevated reference count, or NULL on a miss.
+ */
+struct cc_entry *clock_cache_lookup(struct clock_cache *cc, u64 key)
+{
+	u32 hash = cc_hash(key);
+	struct cc_entry *e;
+
+	rcu_read_lock();
+	e = cc_find(cc_bucket(cc, cc_shard(cc, hash), hash), key);
+	rcu_read_unlock();
+
+	return e;
+}
+EXPORT_SYMBOL_GPL(clock_cache_lookup);
+
+/**
+ * clock_cache_insert - add an entry, or find the one already there
+ * @cc: the cache
+ * @new: the entry to add; owned by the caller until this returns @new
+ * @key: the key to add it under
+ *
+ * If @key is already cached, a reference on the existing entry is returned
+ * and @new is left untouched for the caller to free.  Otherwise @new is
+ * added, evicting an idle entry from the same shard if it is full, and
+ * returned with one reference for the caller on top of the cache's own.
+ *
+ * Returns ERR_PTR(-ENOSPC) if the shard is full and every entry in it is
+ * in use.
+ */
+struct cc_entry *clock_cache_insert(struct clock_cache *cc,
+				    struct cc_entry *new, u64 key)
+{
+	u32 hash = cc_hash(key);
+	struct cc_shard *s = cc_shard(cc, hash);
+	struct hlist_head *head = cc_bucket(cc, s, hash);
+	struct cc_entry *e, *victim = NULL;
+
+	spin_lock(&s->lock);
+	e = cc_find(head, key);
+	if (e)
+		goto out;
+
+	if (s->nr == cc->shard_capacity) {
+		victim = cc_evict(s);
+		if (!victim) {
+			e = ERR_PTR(-ENOSPC);
+			goto out;
+		}
+	}
+
+	new->key = key;
+	new->flags = BIT(__CC_LINKED);
+	atomic_set(&new->refcnt, 2);
+	new->slot = s->nr;
+	s->ring[s->nr++] = new;
+	hlist_add_head_rcu(&new->hash, head);
+	e = new;
+out:
+	spin_unlock(&s->lock);
+
+	if (victim)
+		cc->release(victim);
+	return e;
+}
+EXPORT_SYMBOL_GPL(clock_cache_insert);
+
+/**
+ * clock_cache_remove - stop tracking an entry
+ * @cc: the cache
+ * @e: an entry the caller holds a reference on
+ *
+ * New lookups will miss @e.  It is released once the caller and everybody
+ * else who found it before have put their references.
+ */
+void clock_cache_remove(struct clock_cache *cc, struct cc_entry *e)
+{
+	struct cc_shard *s = cc_shard(cc, cc_hash(e->key));
+	bool linked;
+
+	spin_lock(&s->lock);
+	linked = test_bit(__CC_LINKED, &e->flags);
+	if (linked)
+		cc_unlink(s, e);
+	spin_unlock(&s->lock);
+
+	/* Drop the cache's own reference */
+	if (linked)
+		clock_cache_put(cc, e);
+}
+EXPORT_SYMBOL_GPL(clock_cache_remove);
+
+/**
+ * clock_cache_create - allocate a cache
+ * @nr_entries: total number of entries to track
+ * @nr_shards: number of independently locked shards; rounded up to a
+ *	power of two, and 0 means one per possible CPU
+ * @release: called for every entry whose last reference is dropped
+ *
+ * @nr_entries is divided evenly between the shards, so a hot shard can
+ * evict while others still have room; use enough entries per shard for
+ * the hash to even out the load.  Returns NULL on allocation failure.
+ */
+struct clock_cache *clock_cache_create(unsigned int nr_entries,
+				       unsigned int nr_shards,
+				       void (*release)(struct cc_entry *e))
+{
+	struct clock_cache *cc;
+	unsigned int i;
+
+	if (!nr_shards)
+		nr_shards = num_possible_cpus();
+	nr_shards = roundup_pow_of_two(nr_shards);
+	if (!nr_entries || nr_shards > nr_entries)
+		nr_shards = 1;
+
+	cc = kzalloc(sizeof(*cc), GFP_KERNEL);
+	if (!cc)
+		return NULL;
+
+	cc->shard_bits = ilog2(nr_shards);
+	cc->shard_capacity = max(DIV_ROUND_UP(nr_entries, nr_shards), 1U);
+	cc->bucket_bits = min_t(unsigned int,
+				order_base_2(cc->shard_capacity),
+				32 - cc->shard_bits);
+	cc->release = release;
+
+	cc->shards = kcalloc(nr_shards, sizeof(*cc->shards), GFP_KERNEL);
+	if (!cc->shards)
+		goto out_free;
+
+	for (i = 0; i < nr_shards; i++) {
+		struct cc_shard *s = &cc->shards[i];
+
+		spin_lock_init(&s->lock);
+		s->ring = kcalloc(cc->shard_capacity, sizeof(*s->ring),
+				  GFP_KERNEL);
+		s->buckets = kcalloc(1U << cc->bucket_bits,
+				     sizeof(*s->buckets), GFP_KERNEL);
+		if (!s->ring || !s->buckets)
+			goto out_free;
+	}
+
+	return cc;
+
+out_free:
+	clock_cache_destroy(cc);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(clock_cache_create);
+
+/**
+ * clock_cache_destroy - release all entries and free the cache
+ * @cc: the cache
+ *
+ * The caller must have put all references it holds.
+ */
+void clock_cache_destroy(struct clock_cache *cc)
+{
+	unsigned int i;
+
+	if (cc->shards) {
+		for (i = 0; i < (1U << cc->shard_bits); i++) {
+			struct cc_shard *s = &cc->shards[i];
+
+			while (s->nr) {
+				struct cc_entry *e = s->ring[0];
+
+				cc_unlink(s, e);
+				WARN_ON(atomic_read(&e->refcnt) != 1);
+				clock_cache_put(cc, e);
+			}
+			kfree(s->buckets);
+			kfree(s->ring);
+		}
+		kfree(cc->shards);
+	}
+	kfree(cc);
+}
+EXPORT_SYMBOL_GPL(clock_cache_destroy);
+
+MODULE_DESCRIPTION("Sharded object cache with CLOCK replacement");
+MODULE_LICENSE("GPL v2");
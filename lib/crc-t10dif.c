@@ -18,6 +18,7 @@
 
 static struct crypto_shash *crct10dif_tfm;
 static struct static_key crct10dif_fallback __read_mostly;
+static typeof(crc_t10dif_accel_batch) *crct10dif_batch __read_mostly;
 
 __u16 crc_t10dif_update(__u16 crc, const unsigned char *buffer, size_t len)
 {
@@ -47,18 +48,50 @@ __u16 crc_t10dif(const unsigned char *buffer, size_t len)
 }
 EXPORT_SYMBOL(crc_t10dif);
 
+/**
+ * crc_t10dif_batch - CRC of each of several equally sized buffers
+ * @buffer:	the first buffer, the others follow it back to back
+ * @len:	size of each buffer, e.g. a sector
+ * @nr:		number of buffers
+ * @crcs:	the @nr CRCs are stored here
+ *
+ * Same as calling crc_t10dif() on each buffer, but lets an accelerated
+ * driver set up the vector unit once for all of them instead of once
+ * per buffer, which is most of the cost for sector sized buffers.
+ */
+void crc_t10dif_batch(const unsigned char *buffer, size_t len,
+		      unsigned int nr, __u16 *crcs)
+{
+	unsigned int i;
+
+	if (crct10dif_batch) {
+		crct10dif_batch(buffer, len, nr, crcs);
+		return;
+	}
+
+	for (i = 0; i < nr; i++, buffer += len)
+		crcs[i] = crc_t10dif(buffer, len);
+}
+EXPORT_SYMBOL(crc_t10dif_batch);
+
 static int __init crc_t10dif_mod_init(void)
 {
 	crct10dif_tfm = crypto_alloc_shash("crct10dif", 0, 0);
 	if (IS_ERR(crct10dif_tfm)) {
 		static_key_slow_inc(&crct10dif_fallback);
 		crct10dif_tfm = NULL;
+		return 0;
 	}
+
+	/* Loading the shash above loaded the driver providing it, if any */
+	crct10dif_batch = symbol_get(crc_t10dif_accel_batch);
 	return 0;
 }
 
 static void __exit crc_t10dif_mod_fini(void)
 {
+	if (crct10dif_batch)
+		symbol_put(crc_t10dif_accel_batch);
 	crypto_free_shash(crct10dif_tfm);
 }
 
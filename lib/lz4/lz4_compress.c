@@ -53,7 +53,8 @@ static inline int lz4_compressctx(void *ctx,
 		const char *source,
 		char *dest,
 		int isize,
-		int maxoutputsize)
+		int maxoutputsize,
+		int acceleration)
 {
 	HTYPE *hashtable = (HTYPE *)ctx;
 	const u8 *ip = (u8 *)source;
@@ -87,7 +88,7 @@ static inline int lz4_compressctx(void *ctx,
 
 	/* Main Loop */
 	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
+		int findmatchattempts = (acceleration << skipstrength) + 3;
 		const u8 *forwardip = ip;
 		const u8 *ref;
 		u8 *token;
@@ -239,7 +240,8 @@ static inline int lz4_compress64kctx(void *ctx,
 		const char *source,
 		char *dest,
 		int isize,
-		int maxoutputsize)
+		int maxoutputsize,
+		int acceleration)
 {
 	u16 *hashtable = (u16 *)ctx;
 	const u8 *ip = (u8 *) source;
@@ -268,7 +270,7 @@ static inline int lz4_compress64kctx(void *ctx,
 
 	/* Main Loop */
 	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
+		int findmatchattempts = (acceleration << skipstrength) + 3;
 		const u8 *forwardip = ip;
 		const u8 *ref;
 		u8 *token;
@@ -418,26 +420,43 @@ _last_literals:
 int lz4_compress(const unsigned char *src, size_t src_len,
 			unsigned char *dst, size_t *dst_len, void *wrkmem)
 {
-	int ret = -1;
+	*dst_len = lz4_compressbound(src_len);
+
+	return lz4_compress_fast(src, src_len, dst, dst_len, wrkmem,
+				 LZ4_ACCELERATION_DEFAULT);
+}
+EXPORT_SYMBOL(lz4_compress);
+
+int lz4_compress_fast(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem,
+			int acceleration)
+{
 	int out_len = 0;
+	int max_len = min_t(size_t, *dst_len, INT_MAX);
+
+	/*
+	 * The first miss moves the match search on by @acceleration
+	 * bytes rather than one, and the skip grows from there.
+	 */
+	acceleration = clamp(acceleration, LZ4_ACCELERATION_DEFAULT,
+			     LZ4_ACCELERATION_MAX);
 
 	if (src_len < LZ4_64KLIMIT)
 		out_len = lz4_compress64kctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
+				max_len, acceleration);
 	else
 		out_len = lz4_compressctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
+				max_len, acceleration);
 
-	if (out_len < 0)
-		goto exit;
+	/* 0 means the output did not fit in *dst_len */
+	if (out_len <= 0)
+		return -1;
 
 	*dst_len = out_len;
 
 	return 0;
-exit:
-	return ret;
 }
-EXPORT_SYMBOL(lz4_compress);
+EXPORT_SYMBOL(lz4_compress_fast);
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("LZ4 compressor");
@@ -182,6 +182,10 @@ static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
 	BYTE * const oend = op + maxoutputsize;
 	BYTE *cpy;
 
+	/* Room for up to 14 literals, an offset and an 18 byte match */
+	const BYTE *const shortiend = iend - (RUN_MASK - 1) - 2;
+	BYTE *const shortoend = oend - (RUN_MASK - 1) - (ML_MASK - 1 + MINMATCH);
+
 	/* Main Loop */
 	while (ip < iend) {
 
@@ -191,6 +195,37 @@ static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
 		/* get runlength */
 		token = *ip++;
 		length = (token >> ML_BITS);
+
+		/*
+		 * Most sequences are a few literals and a short match.  While
+		 * far enough from the end of both buffers, copy the literals
+		 * as one 16 byte block and a non-overlapping match as 18
+		 * bytes, without the per-step bounds checks below.
+		 */
+		if (length != RUN_MASK &&
+		    likely(ip < shortiend && op <= shortoend)) {
+			size_t offset;
+
+			memcpy(op, ip, 16);
+			cpy = op + length;
+			ip += length;
+			op = cpy;
+
+			length = token & ML_MASK;
+			offset = get_unaligned_le16(ip);
+			if (length != ML_MASK && offset >= 8 &&
+			    offset <= (size_t)(op - (BYTE *)dest)) {
+				ip += 2;
+				ref = op - offset;
+				memcpy(op, ref, 8);
+				memcpy(op + 8, ref + 8, 8);
+				memcpy(op + 16, ref + 16, 2);
+				op += length + MINMATCH;
+				continue;
+			}
+			goto _get_offset;
+		}
+
 		if (length == RUN_MASK) {
 			int s = 255;
 			while ((ip < iend) && (s == 255)) {
@@ -222,6 +257,7 @@ static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
 		ip -= (op - cpy);
 		op = cpy;
 
+_get_offset:
 		/* get offset */
 		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
 		ip += 2;
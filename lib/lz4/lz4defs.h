@@ -81,7 +81,6 @@ typedef struct _U64_S { u64 v; } U64_S;
 #define MAX_DISTANCE	(MAXD - 1)
 #define HASH_LOG	(MAXD_LOG - 1)
 #define HASHTABLESIZE	(1 << HASH_LOG)
-#define MAX_NB_ATTEMPTS	256
 #define OPTIMAL_ML	(int)((ML_MASK-1)+MINMATCH)
 #define LZ4_64KLIMIT	((1<<16) + (MFLIMIT - 1))
 #define HASHLOG64K	((MEMORY_USAGE - 2) + 1)
@@ -0,0 +1,282 @@
+/*
+ * Dynamic interrupt moderation for network devices
+ *
+ * See include/linux/net_dim.h for how a driver drives it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/net_dim.h>
+
+enum {
+	NET_DIM_PARKING_ON_TOP,
+	NET_DIM_PARKING_TIRED,
+	NET_DIM_GOING_RIGHT,
+	NET_DIM_GOING_LEFT,
+};
+
+enum {
+	NET_DIM_STATS_WORSE,
+	NET_DIM_STATS_SAME,
+	NET_DIM_STATS_BETTER,
+};
+
+enum {
+	NET_DIM_STEPPED,
+	NET_DIM_TOO_TIRED,
+	NET_DIM_ON_EDGE,
+};
+
+/* From the lowest delay to the most packets per interrupt */
+static const struct net_dim_cq_moder net_dim_profiles[NET_DIM_NUM_PROFILES] = {
+	{ .usec = 1,   .pkts = 256 },
+	{ .usec = 8,   .pkts = 256 },
+	{ .usec = 64,  .pkts = 256 },
+	{ .usec = 128, .pkts = 256 },
+	{ .usec = 256, .pkts = 256 },
+};
+
+/**
+ * net_dim_get_profile - the moderation to program for a profile index
+ * @ix: dim->profile_ix
+ */
+struct net_dim_cq_moder net_dim_get_profile(u8 ix)
+{
+	return net_dim_profiles[min_t(u8, ix, NET_DIM_NUM_PROFILES - 1)];
+}
+EXPORT_SYMBOL(net_dim_get_profile);
+
+/* a change of more than 10% */
+static bool net_dim_significant_diff(int val, int ref)
+{
+	return 100UL * abs(val - ref) / ref > 10;
+}
+
+static int net_dim_step(struct net_dim *dim)
+{
+	if (dim->tired == NET_DIM_NUM_PROFILES * 2)
+		return NET_DIM_TOO_TIRED;
+
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		break;
+	case NET_DIM_GOING_RIGHT:
+		if (dim->profile_ix == NET_DIM_NUM_PROFILES - 1)
+			return NET_DIM_ON_EDGE;
+		dim->profile_ix++;
+		dim->steps_right++;
+		break;
+	case NET_DIM_GOING_LEFT:
+		if (dim->profile_ix == 0)
+			return NET_DIM_ON_EDGE;
+		dim->profile_ix--;
+		dim->steps_left++;
+		break;
+	}
+
+	dim->tired++;
+	return NET_DIM_STEPPED;
+}
+
+static void net_dim_park_on_top(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left	 = 0;
+	dim->tired	 = 0;
+	dim->tune_state	 = NET_DIM_PARKING_ON_TOP;
+}
+
+static void net_dim_park_tired(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left	 = 0;
+	dim->tune_state	 = NET_DIM_PARKING_TIRED;
+}
+
+static void net_dim_exit_parking(struct net_dim *dim)
+{
+	dim->tune_state = dim->profile_ix ? NET_DIM_GOING_LEFT :
+					    NET_DIM_GOING_RIGHT;
+	net_dim_step(dim);
+}
+
+/* Past the best profile after stepping back from a worse one */
+static bool net_dim_on_top(struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		return true;
+	case NET_DIM_GOING_RIGHT:
+		return dim->steps_left > 1 && dim->steps_right == 1;
+	default: /* NET_DIM_GOING_LEFT */
+		return dim->steps_right > 1 && dim->steps_left == 1;
+	}
+}
+
+static void net_dim_turn(struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		break;
+	case NET_DIM_GOING_RIGHT:
+		dim->tune_state = NET_DIM_GOING_LEFT;
+		dim->steps_left = 0;
+		break;
+	case NET_DIM_GOING_LEFT:
+		dim->tune_state = NET_DIM_GOING_RIGHT;
+		dim->steps_right = 0;
+		break;
+	}
+}
+
+/* Throughput first, then packet rate, then fewer interrupts */
+static int net_dim_stats_compare(struct net_dim_stats *curr,
+				 struct net_dim_stats *prev)
+{
+	if (!prev->bpms)
+		return curr->bpms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (net_dim_significant_diff(curr->bpms, prev->bpms))
+		return curr->bpms > prev->bpms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	if (!prev->ppms)
+		return curr->ppms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (net_dim_significant_diff(curr->ppms, prev->ppms))
+		return curr->ppms > prev->ppms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	if (!prev->epms)
+		return NET_DIM_STATS_SAME;
+
+	if (net_dim_significant_diff(curr->epms, prev->epms))
+		return curr->epms < prev->epms ? NET_DIM_STATS_BETTER :
+						 NET_DIM_STATS_WORSE;
+
+	return NET_DIM_STATS_SAME;
+}
+
+/* Returns true if a different profile should be applied */
+static bool net_dim_decision(struct net_dim_stats *curr_stats,
+			     struct net_dim *dim)
+{
+	int prev_state = dim->tune_state;
+	int prev_ix = dim->profile_ix;
+
+	if (curr_stats->ppms <
+	    NET_DIM_SPARSE_PKTS_PER_EVENT * curr_stats->epms) {
+		dim->profile_ix = 0;
+		net_dim_park_on_top(dim);
+		dim->prev_stats = *curr_stats;
+		return dim->profile_ix != prev_ix;
+	}
+
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+		if (net_dim_stats_compare(curr_stats, &dim->prev_stats) !=
+		    NET_DIM_STATS_SAME)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_PARKING_TIRED:
+		dim->tired--;
+		if (!dim->tired)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_GOING_RIGHT:
+	case NET_DIM_GOING_LEFT:
+		if (net_dim_stats_compare(curr_stats, &dim->prev_stats) !=
+		    NET_DIM_STATS_BETTER)
+			net_dim_turn(dim);
+
+		if (net_dim_on_top(dim)) {
+			net_dim_park_on_top(dim);
+			break;
+		}
+
+		switch (net_dim_step(dim)) {
+		case NET_DIM_ON_EDGE:
+			net_dim_park_on_top(dim);
+			break;
+		case NET_DIM_TOO_TIRED:
+			net_dim_park_tired(dim);
+			break;
+		}
+		break;
+	}
+
+	/* parked on top, keep comparing against the rates that got us here */
+	if (prev_state != NET_DIM_PARKING_ON_TOP ||
+	    dim->tune_state != NET_DIM_PARKING_ON_TOP)
+		dim->prev_stats = *curr_stats;
+
+	return dim->profile_ix != prev_ix;
+}
+
+static bool net_dim_calc_stats(struct net_dim_sample *start,
+			       struct net_dim_sample *end,
+			       struct net_dim_stats *curr_stats)
+{
+	/* the counters are free running and may wrap */
+	u32 npkts   = end->pkt_ctr - start->pkt_ctr;
+	u32 nbytes  = end->byte_ctr - start->byte_ctr;
+	u16 nevents = end->event_ctr - start->event_ctr;
+	s64 delta_us = ktime_us_delta(end->time, start->time);
+
+	if (delta_us <= 0)
+		return false;
+
+	curr_stats->ppms = div64_s64((u64)npkts * USEC_PER_MSEC, delta_us);
+	curr_stats->bpms = div64_s64((u64)nbytes * USEC_PER_MSEC, delta_us);
+	curr_stats->epms = div64_s64((u64)nevents * USEC_PER_MSEC, delta_us);
+	return true;
+}
+
+/**
+ * net_dim - account a new sample and pick a profile if enough has happened
+ * @dim: the queue's moderation state
+ * @end_sample: the queue's counters now, see net_dim_sample()
+ *
+ * Called from the queue's napi poll; does nothing while a new profile is
+ * still being applied.
+ */
+void net_dim(struct net_dim *dim, struct net_dim_sample *end_sample)
+{
+	struct net_dim_stats curr_stats;
+	u16 nevents;
+
+	switch (dim->state) {
+	case NET_DIM_MEASURE_IN_PROGRESS:
+		nevents = end_sample->event_ctr - dim->start_sample.event_ctr;
+		if (nevents < NET_DIM_NEVENTS)
+			break;
+		if (net_dim_calc_stats(&dim->start_sample, end_sample,
+				       &curr_stats) &&
+		    net_dim_decision(&curr_stats, dim)) {
+			dim->state = NET_DIM_APPLY_NEW_PROFILE;
+			schedule_work(&dim->work);
+			break;
+		}
+		/* fall through */
+	case NET_DIM_START_MEASURE:
+		dim->start_sample = *end_sample;
+		dim->state = NET_DIM_MEASURE_IN_PROGRESS;
+		break;
+	case NET_DIM_APPLY_NEW_PROFILE:
+		break;
+	}
+}
+EXPORT_SYMBOL(net_dim);
+
+MODULE_DESCRIPTION("Dynamic interrupt moderation for network devices");
+MODULE_LICENSE("GPL v2");
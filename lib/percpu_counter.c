@@ -9,6 +9,7 @@
 #include <linux/cpu.h>
 #include <linux/module.h>
 #include <linux/debugobjects.h>
+#include <linux/math64.h>
 
 #ifdef CONFIG_HOTPLUG_CPU
 static LIST_HEAD(percpu_counters);
@@ -63,11 +64,13 @@ void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&fbc->lock, flags);
+	write_seqcount_begin(&fbc->fold_seq);
 	for_each_possible_cpu(cpu) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		*pcount = 0;
 	}
 	fbc->count = amount;
+	write_seqcount_end(&fbc->fold_seq);
 	raw_spin_unlock_irqrestore(&fbc->lock, flags);
 }
 EXPORT_SYMBOL(percpu_counter_set);
@@ -81,8 +84,10 @@ void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 	if (count >= batch || count <= -batch) {
 		unsigned long flags;
 		raw_spin_lock_irqsave(&fbc->lock, flags);
+		write_seqcount_begin(&fbc->fold_seq);
 		fbc->count += count;
 		__this_cpu_sub(*fbc->counters, count - amount);
+		write_seqcount_end(&fbc->fold_seq);
 		raw_spin_unlock_irqrestore(&fbc->lock, flags);
 	} else {
 		this_cpu_add(*fbc->counters, amount);
@@ -119,6 +124,7 @@ int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 
 	raw_spin_lock_init(&fbc->lock);
 	lockdep_set_class(&fbc->lock, key);
+	seqcount_init(&fbc->fold_seq);
 	fbc->count = amount;
 	fbc->counters = alloc_percpu_gfp(s32, gfp);
 	if (!fbc->counters)
@@ -183,9 +189,11 @@ static int percpu_counter_hotcpu_callback(struct notifier_block *nb,
 		unsigned long flags;
 
 		raw_spin_lock_irqsave(&fbc->lock, flags);
+		write_seqcount_begin(&fbc->fold_seq);
 		pcount = per_cpu_ptr(fbc->counters, cpu);
 		fbc->count += *pcount;
 		*pcount = 0;
+		write_seqcount_end(&fbc->fold_seq);
 		raw_spin_unlock_irqrestore(&fbc->lock, flags);
 	}
 	spin_unlock_irq(&percpu_counters_lock);
@@ -220,6 +228,68 @@ int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch)
 }
 EXPORT_SYMBOL(__percpu_counter_compare);
 
+/*
+ * Compare counter against given value, without taking fbc->lock.
+ * Return 1 if greater, 0 if equal and -1 if less, like
+ * __percpu_counter_compare().  When the rough count is too close to @rhs
+ * to tell, the per-cpu counts are added up locklessly, and the walk is
+ * repeated if a cpu folded its count into fbc->count meanwhile, so that
+ * no fold is seen twice or missed.  What is left is the error of
+ * __percpu_counter_sum() itself: the lock does not stop updates below the
+ * batch either, so both can be off by what the other cpus add during the
+ * walk, less than their batch each.  Callers that shrink the batch near
+ * @rhs with __percpu_counter_tuned_batch() keep that error below the
+ * distance to @rhs.
+ */
+int __percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs,
+				    s32 batch)
+{
+	unsigned int seq;
+	s64	count;
+	int	cpu;
+
+	count = percpu_counter_read(fbc);
+	if (abs(count - rhs) > (batch * num_online_cpus())) {
+		if (count > rhs)
+			return 1;
+		else
+			return -1;
+	}
+
+	do {
+		seq = read_seqcount_begin(&fbc->fold_seq);
+		count = fbc->count;
+		for_each_online_cpu(cpu)
+			count += READ_ONCE(*per_cpu_ptr(fbc->counters, cpu));
+	} while (read_seqcount_retry(&fbc->fold_seq, seq));
+
+	if (count > rhs)
+		return 1;
+	else if (count < rhs)
+		return -1;
+	else
+		return 0;
+}
+EXPORT_SYMBOL(__percpu_counter_compare_approx);
+
+/*
+ * Pick the batch for an update to a counter that gets compared against
+ * @threshold.  Far from @threshold this is @max_batch, so updates rarely
+ * take fbc->lock.  Closer in, it shrinks with the distance, so that the
+ * error of percpu_counter_read() stays at half of the distance and rough
+ * compares keep deciding without a full sum, down to 1 right at
+ * @threshold.  Only percpu_counter_read() is used to measure the distance.
+ */
+s32 __percpu_counter_tuned_batch(struct percpu_counter *fbc, s64 threshold,
+				 s32 max_batch)
+{
+	s64 distance = abs(percpu_counter_read(fbc) - threshold);
+	s64 batch = div_s64(distance, 2 * num_online_cpus());
+
+	return clamp_t(s64, batch, 1, max_batch);
+}
+EXPORT_SYMBOL(__percpu_counter_tuned_batch);
+
 static int __init percpu_counter_startup(void)
 {
 	compute_batch_value();
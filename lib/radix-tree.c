@@ -80,6 +80,25 @@ static inline void *indirect_to_ptr(void *ptr)
 	return (void *)((unsigned long)ptr & ~RADIX_TREE_INDIRECT_PTR);
 }
 
+/*
+ * Read the entry at @offset in @parent, following a sibling entry to the
+ * slot of the multi-order entry it belongs to.  Returns the offset of the
+ * slot actually read.
+ */
+static inline unsigned int radix_tree_descend(struct radix_tree_node *parent,
+			struct radix_tree_node **nodep, unsigned int offset)
+{
+	void **entry = rcu_dereference_raw(parent->slots[offset]);
+
+	if (radix_tree_is_sibling_entry(parent->slots + offset, entry)) {
+		offset = (void **)indirect_to_ptr(entry) - parent->slots;
+		entry = rcu_dereference_raw(parent->slots[offset]);
+	}
+
+	*nodep = (void *)entry;
+	return offset;
+}
+
 static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 {
 	return root->gfp_mask & __GFP_BITS_MASK;
@@ -358,10 +377,8 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 		node->count = 1;
 		node->parent = NULL;
 		slot = root->rnode;
-		if (newheight > 1) {
-			slot = indirect_to_ptr(slot);
-			slot->parent = node;
-		}
+		if (newheight > 1)
+			indirect_to_ptr(slot)->parent = node;
 		node->slots[0] = slot;
 		node = ptr_to_indirect(node);
 		rcu_assign_pointer(root->rnode, node);
@@ -375,39 +392,55 @@ out:
  *	__radix_tree_create	-	create a slot in a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		index occupies 2^order aligned slots
  *	@nodep:		returns node
  *	@slotp:		returns slot
  *
  *	Create, if necessary, and return the node and slot for an item
- *	at position @index in the radix tree @root.
+ *	at position @index in the radix tree @root.  For @order > 0 this
+ *	is the slot in the lowest level whose slots cover at least 2^@order
+ *	indices each; see __radix_tree_insert() for the sibling slots.
  *
  *	Until there is more than one item in the tree, no nodes are
  *	allocated and @root->rnode is used as a direct slot instead of
  *	pointing to a node, in which case *@nodep will be NULL.
  *
+ *	If the path to @index is blocked by an entry covering more indices,
+ *	*@slotp points at that entry's slot.
+ *
  *	Returns -ENOMEM, or 0 for success.
  */
 int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
-			struct radix_tree_node **nodep, void ***slotp)
+			unsigned int order, struct radix_tree_node **nodep,
+			void ***slotp)
 {
 	struct radix_tree_node *node = NULL, *slot;
+	unsigned long last = index | ((1UL << order) - 1);
 	unsigned int height, shift, offset;
 	int error;
 
-	/* Make sure the tree is high enough.  */
-	if (index > radix_tree_maxindex(root->height)) {
-		error = radix_tree_extend(root, index);
+	BUG_ON(index & ((1UL << order) - 1));
+
+	/*
+	 * Make sure the tree is high enough.  A multi-order entry has to
+	 * live in a node, so the root must be at least one level above it.
+	 */
+	if (order)
+		last = max(last, radix_tree_maxindex(order /
+					RADIX_TREE_MAP_SHIFT) + 1);
+	if (last > radix_tree_maxindex(root->height)) {
+		error = radix_tree_extend(root, last);
 		if (error)
 			return error;
 	}
 
-	slot = indirect_to_ptr(root->rnode);
+	slot = root->rnode;
 
 	height = root->height;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	shift = height * RADIX_TREE_MAP_SHIFT;
 
 	offset = 0;			/* uninitialised var warning */
-	while (height > 0) {
+	while (shift > order) {
 		if (slot == NULL) {
 			/* Have to add a child node.  */
 			if (!(slot = radix_tree_node_alloc(root)))
@@ -415,18 +448,25 @@ int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
 			slot->path = height;
 			slot->parent = node;
 			if (node) {
-				rcu_assign_pointer(node->slots[offset], slot);
+				rcu_assign_pointer(node->slots[offset],
+						   ptr_to_indirect(slot));
 				node->count++;
 				slot->path |= offset << RADIX_TREE_HEIGHT_SHIFT;
 			} else
 				rcu_assign_pointer(root->rnode, ptr_to_indirect(slot));
-		}
+		} else if (!radix_tree_is_indirect_ptr(slot) || (node &&
+			   radix_tree_is_sibling_entry(node->slots + offset,
+						       slot))) {
+			/* An entry above us already covers @index */
+			break;
+		} else
+			slot = indirect_to_ptr(slot);
 
 		/* Go a level down */
+		shift -= RADIX_TREE_MAP_SHIFT;
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 		node = slot;
 		slot = node->slots[offset];
-		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
@@ -438,33 +478,50 @@ int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
 }
 
 /**
- *	radix_tree_insert    -    insert into a radix tree
+ *	__radix_tree_insert    -    insert into a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		key covers the 2^order indices around index
  *	@item:		item to insert
  *
- *	Insert an item into the radix tree at position @index.
+ *	Insert an item into the radix tree at position @index.  With
+ *	@order > 0, @index must be aligned to 2^@order, and the item is
+ *	returned by lookups of any index in that range.  It takes a single
+ *	slot in the level above the leaves that matches @order best, plus
+ *	one sibling slot per remaining part of the range in the same node.
  */
-int radix_tree_insert(struct radix_tree_root *root,
-			unsigned long index, void *item)
+int __radix_tree_insert(struct radix_tree_root *root, unsigned long index,
+			unsigned int order, void *item)
 {
 	struct radix_tree_node *node;
+	unsigned int i, offset = 0, nr = 1;
 	void **slot;
 	int error;
 
 	BUG_ON(radix_tree_is_indirect_ptr(item));
 
-	error = __radix_tree_create(root, index, &node, &slot);
+	error = __radix_tree_create(root, index, order, &node, &slot);
 	if (error)
 		return error;
 	if (*slot != NULL)
 		return -EEXIST;
+
+	if (node) {
+		offset = slot - node->slots;
+		nr <<= order - ((node->path & RADIX_TREE_HEIGHT_MASK) - 1) *
+							RADIX_TREE_MAP_SHIFT;
+		for (i = 1; i < nr; i++)
+			if (slot[i] != NULL)
+				return -EEXIST;
+		for (i = 1; i < nr; i++)
+			rcu_assign_pointer(slot[i], ptr_to_indirect(slot));
+	}
 	rcu_assign_pointer(*slot, item);
 
 	if (node) {
-		node->count++;
-		BUG_ON(tag_get(node, 0, index & RADIX_TREE_MAP_MASK));
-		BUG_ON(tag_get(node, 1, index & RADIX_TREE_MAP_MASK));
+		node->count += nr;
+		BUG_ON(tag_get(node, 0, offset));
+		BUG_ON(tag_get(node, 1, offset));
 	} else {
 		BUG_ON(root_tag_get(root, 0));
 		BUG_ON(root_tag_get(root, 1));
@@ -472,7 +529,7 @@ int radix_tree_insert(struct radix_tree_root *root,
 
 	return 0;
 }
-EXPORT_SYMBOL(radix_tree_insert);
+EXPORT_SYMBOL(__radix_tree_insert);
 
 /**
  *	__radix_tree_lookup	-	lookup an item in a radix tree
@@ -487,12 +544,15 @@ EXPORT_SYMBOL(radix_tree_insert);
  *	Until there is more than one item in the tree, no nodes are
  *	allocated and @root->rnode is used as a direct slot instead of
  *	pointing to a node, in which case *@nodep will be NULL.
+ *
+ *	An index covered by a multi-order entry returns that entry, and
+ *	*@slotp is its canonical slot.
  */
 void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
 			  struct radix_tree_node **nodep, void ***slotp)
 {
 	struct radix_tree_node *node, *parent;
-	unsigned int height, shift;
+	unsigned int height, shift, offset;
 	void **slot;
 
 	node = rcu_dereference_raw(root->rnode);
@@ -517,16 +577,19 @@ void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
 
-	do {
+	for ( ; ; ) {
 		parent = node;
-		slot = node->slots + ((index >> shift) & RADIX_TREE_MAP_MASK);
-		node = rcu_dereference_raw(*slot);
+		offset = radix_tree_descend(parent, &node,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		slot = parent->slots + offset;
 		if (node == NULL)
 			return NULL;
+		if (!shift || !radix_tree_is_indirect_ptr(node))
+			break;
 
+		node = indirect_to_ptr(node);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
-	} while (height > 0);
+	}
 
 	if (nodep)
 		*nodep = parent;
@@ -593,24 +656,25 @@ void *radix_tree_tag_set(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag)
 {
 	unsigned int height, shift;
-	struct radix_tree_node *slot;
+	struct radix_tree_node *node, *slot;
 
 	height = root->height;
 	BUG_ON(index > radix_tree_maxindex(height));
 
-	slot = indirect_to_ptr(root->rnode);
-	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	slot = root->rnode;
+	shift = height * RADIX_TREE_MAP_SHIFT;
 
-	while (height > 0) {
+	/* Only nodes are indirect below the root, items may sit at any level */
+	while (radix_tree_is_indirect_ptr(slot)) {
 		int offset;
 
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!tag_get(slot, tag, offset))
-			tag_set(slot, tag, offset);
-		slot = slot->slots[offset];
-		BUG_ON(slot == NULL);
+		node = indirect_to_ptr(slot);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
+		offset = radix_tree_descend(node, &slot,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		BUG_ON(slot == NULL);
+		if (!tag_get(node, tag, offset))
+			tag_set(node, tag, offset);
 	}
 
 	/* set the root's tag bit */
@@ -648,16 +712,13 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		goto out;
 
 	shift = height * RADIX_TREE_MAP_SHIFT;
-	slot = indirect_to_ptr(root->rnode);
-
-	while (shift) {
-		if (slot == NULL)
-			goto out;
+	slot = root->rnode;
 
+	while (radix_tree_is_indirect_ptr(slot)) {
+		node = indirect_to_ptr(slot);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		node = slot;
-		slot = slot->slots[offset];
+		offset = radix_tree_descend(node, &slot,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
 	}
 
 	if (slot == NULL)
@@ -670,8 +731,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		if (any_tag_set(node, tag))
 			goto out;
 
-		index >>= RADIX_TREE_MAP_SHIFT;
-		offset = index & RADIX_TREE_MAP_MASK;
+		offset = node->path >> RADIX_TREE_HEIGHT_SHIFT;
 		node = node->parent;
 	}
 
@@ -724,19 +784,21 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	for ( ; ; ) {
+		struct radix_tree_node *parent = node;
 		int offset;
 
-		if (node == NULL)
+		offset = radix_tree_descend(parent, &node,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		if (!tag_get(parent, tag, offset))
 			return 0;
-
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!tag_get(node, tag, offset))
+		if (!shift)
+			return 1;
+		if (node == NULL)
 			return 0;
-		if (height == 1)
+		if (!radix_tree_is_indirect_ptr(node))
 			return 1;
-		node = rcu_dereference_raw(node->slots[offset]);
+		node = indirect_to_ptr(node);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
 	}
 }
 EXPORT_SYMBOL(radix_tree_tag_get);
@@ -780,6 +842,7 @@ void **radix_tree_next_chunk(struct radix_tree_root *root,
 		iter->index = 0;
 		iter->next_index = 1;
 		iter->tags = 1;
+		iter->shift = 0;
 		return (void **)&root->rnode;
 	} else
 		return NULL;
@@ -795,9 +858,19 @@ restart:
 
 	node = rnode;
 	while (1) {
+		struct radix_tree_node *child;
+		unsigned long canon;
+
+		/* Start a multi-order entry at its first index */
+		canon = radix_tree_descend(node, &child, offset);
+		if (canon != offset) {
+			offset = canon;
+			index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
+			index += offset << shift;
+		}
+
 		if ((flags & RADIX_TREE_ITER_TAGGED) ?
-				!test_bit(offset, node->tags[tag]) :
-				!node->slots[offset]) {
+				!test_bit(offset, node->tags[tag]) : !child) {
 			/* Hole detected */
 			if (flags & RADIX_TREE_ITER_CONTIG)
 				return NULL;
@@ -819,15 +892,27 @@ restart:
 				return NULL;
 			if (offset == RADIX_TREE_MAP_SIZE)
 				goto restart;
+			child = rcu_dereference_raw(node->slots[offset]);
 		}
 
 		/* This is leaf-node */
 		if (!shift)
 			break;
 
-		node = rcu_dereference_raw(node->slots[offset]);
-		if (node == NULL)
+		if (child == NULL)
 			goto restart;
+		if (!radix_tree_is_indirect_ptr(child)) {
+			/*
+			 * A multi-order entry above the leaves makes up a
+			 * chunk of one slot.
+			 */
+			iter->index = index & ~((1UL << shift) - 1);
+			iter->next_index = iter->index + (1UL << shift);
+			iter->tags = 1;
+			iter->shift = shift;
+			return node->slots + offset;
+		}
+		node = indirect_to_ptr(child);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 	}
@@ -835,6 +920,7 @@ restart:
 	/* Update the iterator state */
 	iter->index = index;
 	iter->next_index = (index | RADIX_TREE_MAP_MASK) + 1;
+	iter->shift = 0;
 
 	/* Construct iter->tags bit-mask from node->tags[tag] array */
 	if (flags & RADIX_TREE_ITER_TAGGED) {
@@ -924,20 +1010,20 @@ unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
 			goto next;
 		if (!tag_get(slot, iftag, offset))
 			goto next;
-		if (shift) {
+		if (radix_tree_is_indirect_ptr(slot->slots[offset])) {
 			/* Go down one level */
 			shift -= RADIX_TREE_MAP_SHIFT;
 			node = slot;
-			slot = slot->slots[offset];
+			slot = indirect_to_ptr(slot->slots[offset]);
 			continue;
 		}
 
-		/* tag the leaf */
+		/* tag the leaf, or a multi-order entry above the leaves */
 		tagged++;
 		tag_set(slot, settag, offset);
 
 		/* walk back up the path tagging interior nodes */
-		upindex = index;
+		upindex = index >> shift;
 		while (node) {
 			upindex >>= RADIX_TREE_MAP_SHIFT;
 			offset = upindex & RADIX_TREE_MAP_MASK;
@@ -1152,6 +1238,52 @@ radix_tree_gang_lookup_tag_slot(struct radix_tree_root *root, void ***results,
 }
 EXPORT_SYMBOL(radix_tree_gang_lookup_tag_slot);
 
+/**
+ *	radix_tree_gang_lookup_tag_iter - batched tagged slot lookup
+ *	@root:		radix tree root
+ *	@results:	where the results of the lookup are placed
+ *	@iter:		iterator state, set up with radix_tree_iter_init()
+ *	@cursor:	position inside the current chunk, in and out
+ *	@max_items:	place up to this many slots at *@results
+ *	@tag:		the tag index (< RADIX_TREE_MAX_TAGS)
+ *
+ *	Like radix_tree_gang_lookup_tag_slot(), but picks up where the
+ *	previous call left off instead of walking down from the root again
+ *	for every batch: a batch that ends in the middle of a leaf node
+ *	resumes at the next tagged slot of that node.  Start with
+ *
+ *		cursor = radix_tree_iter_init(&iter, first_index);
+ *
+ *	and call until it returns 0.  @cursor points into the tree, so it is
+ *	only valid while the caller holds on to the lock (or RCU read lock)
+ *	that protected the previous call.  After dropping it, reset the
+ *	cursor with "cursor = radix_tree_iter_retry(&iter)" if it is not
+ *	NULL; the next batch then starts with the first slot not yet returned.
+ */
+unsigned int
+radix_tree_gang_lookup_tag_iter(struct radix_tree_root *root, void ***results,
+		struct radix_tree_iter *iter, void ***cursor,
+		unsigned int max_items, unsigned int tag)
+{
+	unsigned flags = RADIX_TREE_ITER_TAGGED | tag;
+	void **slot = *cursor;
+	unsigned int ret = 0;
+
+	if (unlikely(!max_items))
+		return 0;
+
+	while (slot || (slot = radix_tree_next_chunk(root, iter, flags))) {
+		results[ret] = slot;
+		slot = radix_tree_next_slot(slot, iter, flags);
+		if (++ret == max_items)
+			break;
+	}
+	*cursor = slot;
+
+	return ret;
+}
+EXPORT_SYMBOL(radix_tree_gang_lookup_tag_iter);
+
 #if defined(CONFIG_SHMEM) && defined(CONFIG_SWAP)
 #include <linux/sched.h> /* for cond_resched() */
 
@@ -1163,6 +1295,7 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 {
 	unsigned int shift, height;
 	unsigned long i;
+	void *entry;
 
 	height = slot->path & RADIX_TREE_HEIGHT_MASK;
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
@@ -1170,7 +1303,15 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 	for ( ; height > 1; height--) {
 		i = (index >> shift) & RADIX_TREE_MAP_MASK;
 		for (;;) {
-			if (slot->slots[i] != NULL)
+			entry = rcu_dereference_raw(slot->slots[i]);
+			if (entry == item) {
+				/* a multi-order entry above the leaves */
+				*found_index = index & ~((1UL << shift) - 1);
+				index = 0;
+				goto out;
+			}
+			if (radix_tree_is_indirect_ptr(entry) &&
+			    !radix_tree_is_sibling_entry(slot->slots + i, entry))
 				break;
 			index &= ~((1UL << shift) - 1);
 			index += 1UL << shift;
@@ -1182,9 +1323,7 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 		}
 
 		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference_raw(slot->slots[i]);
-		if (slot == NULL)
-			goto out;
+		slot = indirect_to_ptr(entry);
 	}
 
 	/* Bottom level: check items */
@@ -1268,7 +1407,11 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		 */
 		if (to_free->count != 1)
 			break;
-		if (!to_free->slots[0])
+		slot = to_free->slots[0];
+		if (!slot)
+			break;
+		/* A multi-order entry cannot be moved up into the root */
+		if (root->height > 1 && !radix_tree_is_indirect_ptr(slot))
 			break;
 
 		/*
@@ -1278,11 +1421,8 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		 * (to_free->slots[0]), it will be safe to dereference the new
 		 * one (root->rnode) as far as dependent read barriers go.
 		 */
-		slot = to_free->slots[0];
-		if (root->height > 1) {
-			slot->parent = NULL;
-			slot = ptr_to_indirect(slot);
-		}
+		if (root->height > 1)
+			indirect_to_ptr(slot)->parent = NULL;
 		root->rnode = slot;
 		root->height--;
 
@@ -1377,7 +1517,7 @@ void *radix_tree_delete_item(struct radix_tree_root *root,
 			     unsigned long index, void *item)
 {
 	struct radix_tree_node *node;
-	unsigned int offset;
+	unsigned int offset, i;
 	void **slot;
 	void *entry;
 	int tag;
@@ -1395,7 +1535,7 @@ void *radix_tree_delete_item(struct radix_tree_root *root,
 		return entry;
 	}
 
-	offset = index & RADIX_TREE_MAP_MASK;
+	offset = slot - node->slots;
 
 	/*
 	 * Clear all tags associated with the item to be deleted.
@@ -1406,6 +1546,13 @@ void *radix_tree_delete_item(struct radix_tree_root *root,
 			radix_tree_tag_clear(root, index, tag);
 	}
 
+	/* Siblings of a multi-order entry go with it */
+	for (i = offset + 1; i < RADIX_TREE_MAP_SIZE; i++) {
+		if (node->slots[i] != ptr_to_indirect(slot))
+			break;
+		node->slots[i] = NULL;
+		node->count--;
+	}
 	node->slots[offset] = NULL;
 	node->count--;
 
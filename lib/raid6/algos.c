@@ -39,6 +39,10 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_intx32,
 #endif
 #if defined(__i386__) && !defined(__arch_um__)
+#ifdef CONFIG_AS_AVX512
+	&raid6_avx512x1,
+	&raid6_avx512x2,
+#endif
 	&raid6_mmxx1,
 	&raid6_mmxx2,
 	&raid6_sse1x1,
@@ -51,6 +55,11 @@ const struct raid6_calls * const raid6_algos[] = {
 #endif
 #endif
 #if defined(__x86_64__) && !defined(__arch_um__)
+#ifdef CONFIG_AS_AVX512
+	&raid6_avx512x1,
+	&raid6_avx512x2,
+	&raid6_avx512x4,
+#endif
 	&raid6_sse2x1,
 	&raid6_sse2x2,
 	&raid6_sse2x4,
@@ -89,6 +98,9 @@ void (*raid6_datap_recov)(int, size_t, int, void **);
 EXPORT_SYMBOL_GPL(raid6_datap_recov);
 
 const struct raid6_recov_calls *const raid6_recov_algos[] = {
+#ifdef CONFIG_AS_AVX512
+	&raid6_recov_avx512,
+#endif
 #ifdef CONFIG_AS_AVX2
 	&raid6_recov_avx2,
 #endif
@@ -101,6 +113,16 @@ const struct raid6_recov_calls *const raid6_recov_algos[] = {
 
 #ifdef __KERNEL__
 #define RAID6_TIME_JIFFIES_LG2	4
+
+/*
+ * The benchmark below keeps the cpu busy for a few jiffies per
+ * algorithm.  Its result does not change from one boot to the next, so
+ * raid6_pq.algo= on the command line (or as a module option) can name
+ * the algorithm it picked last time and skip it.
+ */
+static char *raid6_algo;
+module_param_named(algo, raid6_algo, charp, 0444);
+MODULE_PARM_DESC(algo, "Use this gen_syndrome algorithm instead of benchmarking");
 #else
 /* Need more time to be stable in userspace */
 #define RAID6_TIME_JIFFIES_LG2	9
@@ -128,6 +150,24 @@ static inline const struct raid6_recov_calls *raid6_choose_recov(void)
 	return best;
 }
 
+#ifdef __KERNEL__
+static const struct raid6_calls *raid6_find_gen(const char *name)
+{
+	const struct raid6_calls *const *algo;
+
+	for (algo = raid6_algos; *algo; algo++) {
+		if (strcmp((*algo)->name, name))
+			continue;
+		if ((*algo)->valid && !(*algo)->valid())
+			break;
+		return *algo;
+	}
+
+	pr_warn("raid6: algorithm %s is not usable, benchmarking\n", name);
+	return NULL;
+}
+#endif
+
 static inline const struct raid6_calls *raid6_choose_gen(
 	void *(*const dptrs)[(65536/PAGE_SIZE)+2], const int disks)
 {
@@ -136,6 +176,18 @@ static inline const struct raid6_calls *raid6_choose_gen(
 	const struct raid6_calls *const *algo;
 	const struct raid6_calls *best;
 
+#ifdef __KERNEL__
+	if (raid6_algo) {
+		best = raid6_find_gen(raid6_algo);
+		if (best) {
+			pr_info("raid6: using algorithm %s (not benchmarked)\n",
+				best->name);
+			raid6_call = *best;
+			return best;
+		}
+	}
+#endif
+
 	for (bestgenperf = 0, bestxorperf = 0, best = NULL, algo = raid6_algos; *algo; algo++) {
 		if (!best || (*algo)->prefer >= best->prefer) {
 			if ((*algo)->valid && !(*algo)->valid())
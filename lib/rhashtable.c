@@ -30,7 +30,9 @@
 
 #define HASH_DEFAULT_SIZE	64UL
 #define HASH_MIN_SIZE		4U
-#define BUCKET_LOCKS_PER_CPU   128UL
+
+/* Buckets per page of a nested table */
+#define RHT_NEST_SHIFT		(PAGE_SHIFT - ilog2(sizeof(void *)))
 
 static u32 head_hashfn(struct rhashtable *ht,
 		       const struct bucket_table *tbl,
@@ -50,55 +52,32 @@ EXPORT_SYMBOL_GPL(lockdep_rht_mutex_is_held);
 
 int lockdep_rht_bucket_is_held(const struct bucket_table *tbl, u32 hash)
 {
-	spinlock_t *lock = rht_bucket_lock(tbl, hash);
-
-	return (debug_locks) ? lockdep_is_held(lock) : 1;
+	if (!debug_locks)
+		return 1;
+	return bit_spin_is_locked(0, (unsigned long *)rht_bucket(tbl, hash));
 }
 EXPORT_SYMBOL_GPL(lockdep_rht_bucket_is_held);
 #else
 #define ASSERT_RHT_MUTEX(HT)
 #endif
 
-
-static int alloc_bucket_locks(struct rhashtable *ht, struct bucket_table *tbl,
-			      gfp_t gfp)
+struct rhash_head __rcu **rht_bucket_nested(const struct bucket_table *tbl,
+					    unsigned int hash)
 {
-	unsigned int i, size;
-#if defined(CONFIG_PROVE_LOCKING)
-	unsigned int nr_pcpus = 2;
-#else
-	unsigned int nr_pcpus = num_possible_cpus();
-#endif
-
-	nr_pcpus = min_t(unsigned int, nr_pcpus, 32UL);
-	size = roundup_pow_of_two(nr_pcpus * ht->p.locks_mul);
-
-	/* Never allocate more than 0.5 locks per bucket */
-	size = min_t(unsigned int, size, tbl->size >> 1);
-
-	if (sizeof(spinlock_t) != 0) {
-#ifdef CONFIG_NUMA
-		if (size * sizeof(spinlock_t) > PAGE_SIZE &&
-		    gfp == GFP_KERNEL)
-			tbl->locks = vmalloc(size * sizeof(spinlock_t));
-		else
-#endif
-		tbl->locks = kmalloc_array(size, sizeof(spinlock_t),
-					   gfp);
-		if (!tbl->locks)
-			return -ENOMEM;
-		for (i = 0; i < size; i++)
-			spin_lock_init(&tbl->locks[i]);
-	}
-	tbl->locks_mask = size - 1;
+	struct rhash_head __rcu **page;
 
-	return 0;
+	page = (struct rhash_head __rcu **)tbl->buckets[hash >> tbl->nest];
+	return &page[hash & ((1U << tbl->nest) - 1)];
 }
+EXPORT_SYMBOL_GPL(rht_bucket_nested);
 
 static void bucket_table_free(const struct bucket_table *tbl)
 {
-	if (tbl)
-		kvfree(tbl->locks);
+	unsigned int i;
+
+	if (tbl && tbl->nest)
+		for (i = 0; i < tbl->size >> tbl->nest; i++)
+			free_page((unsigned long)tbl->buckets[i]);
 
 	kvfree(tbl);
 }
@@ -108,13 +87,50 @@ static void bucket_table_free_rcu(struct rcu_head *head)
 	bucket_table_free(container_of(head, struct bucket_table, rcu));
 }
 
+/*
+ * Falls back to a two-level table when the buckets cannot be allocated
+ * in one piece: only the array of page pointers needs to be contiguous,
+ * which is 1/512th the size of a flat table with 4K pages.
+ */
+static struct bucket_table *nested_bucket_table_alloc(size_t nbuckets,
+						      gfp_t gfp)
+{
+	struct bucket_table *tbl;
+	unsigned int i, npages;
+
+	if (nbuckets < (1UL << RHT_NEST_SHIFT))
+		return NULL;
+
+	npages = nbuckets >> RHT_NEST_SHIFT;
+	tbl = kzalloc(sizeof(*tbl) + npages * sizeof(tbl->buckets[0]),
+		      gfp | __GFP_NOWARN);
+	if (tbl == NULL)
+		return NULL;
+
+	tbl->size = nbuckets;
+	tbl->nest = RHT_NEST_SHIFT;
+
+	for (i = 0; i < npages; i++) {
+		void *page = (void *)get_zeroed_page(gfp);
+
+		if (!page) {
+			/* Only free the pages allocated so far */
+			tbl->size = i << RHT_NEST_SHIFT;
+			bucket_table_free(tbl);
+			return NULL;
+		}
+		RCU_INIT_POINTER(tbl->buckets[i], page);
+	}
+
+	return tbl;
+}
+
 static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
 					       size_t nbuckets,
 					       gfp_t gfp)
 {
 	struct bucket_table *tbl = NULL;
 	size_t size;
-	int i;
 
 	size = sizeof(*tbl) + nbuckets * sizeof(tbl->buckets[0]);
 	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER) ||
@@ -122,23 +138,18 @@ static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
 		tbl = kzalloc(size, gfp | __GFP_NOWARN | __GFP_NORETRY);
 	if (tbl == NULL && gfp == GFP_KERNEL)
 		tbl = vzalloc(size);
+	if (tbl == NULL)
+		tbl = nested_bucket_table_alloc(nbuckets, gfp);
 	if (tbl == NULL)
 		return NULL;
 
+	/* Empty buckets are NULL, which the zeroed allocations give us */
 	tbl->size = nbuckets;
 
-	if (alloc_bucket_locks(ht, tbl, gfp) < 0) {
-		bucket_table_free(tbl);
-		return NULL;
-	}
-
 	INIT_LIST_HEAD(&tbl->walkers);
 
 	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
 
-	for (i = 0; i < nbuckets; i++)
-		INIT_RHT_NULLS_HEAD(tbl->buckets[i], ht, i);
-
 	return tbl;
 }
 
@@ -155,15 +166,17 @@ static struct bucket_table *rhashtable_last_table(struct rhashtable *ht,
 	return new_tbl;
 }
 
-static int rhashtable_rehash_one(struct rhashtable *ht, unsigned int old_hash)
+static int rhashtable_rehash_one(struct rhashtable *ht,
+				 struct rhash_head __rcu **bkt,
+				 unsigned int old_hash)
 {
 	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
 	struct bucket_table *new_tbl = rhashtable_last_table(ht,
 		rht_dereference_rcu(old_tbl->future_tbl, ht));
-	struct rhash_head __rcu **pprev = &old_tbl->buckets[old_hash];
+	struct rhash_head __rcu **pprev = NULL;
+	struct rhash_head __rcu **new_bkt;
 	int err = -ENOENT;
 	struct rhash_head *head, *next, *entry;
-	spinlock_t *new_bucket_lock;
 	unsigned int new_hash;
 
 	rht_for_each(entry, old_tbl, old_hash) {
@@ -180,19 +193,20 @@ static int rhashtable_rehash_one(struct rhashtable *ht, unsigned int old_hash)
 		goto out;
 
 	new_hash = head_hashfn(ht, new_tbl, entry);
+	new_bkt = rht_bucket(new_tbl, new_hash);
 
-	new_bucket_lock = rht_bucket_lock(new_tbl, new_hash);
-
-	spin_lock_nested(new_bucket_lock, SINGLE_DEPTH_NESTING);
-	head = rht_dereference_bucket(new_tbl->buckets[new_hash],
-				      new_tbl, new_hash);
+	rht_lock_nested(new_bkt);
+	head = rht_ptr(new_bkt, new_tbl, new_hash);
 
 	RCU_INIT_POINTER(entry->next, head);
 
-	rcu_assign_pointer(new_tbl->buckets[new_hash], entry);
-	spin_unlock(new_bucket_lock);
+	rht_assign_locked(new_bkt, entry);
+	rht_unlock_nested(new_bkt);
 
-	rcu_assign_pointer(*pprev, next);
+	if (pprev)
+		rcu_assign_pointer(*pprev, next);
+	else
+		rht_assign_locked(bkt, next);
 
 out:
 	return err;
@@ -202,27 +216,27 @@ static void rhashtable_rehash_chain(struct rhashtable *ht,
 				    unsigned int old_hash)
 {
 	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
-	spinlock_t *old_bucket_lock;
+	struct rhash_head __rcu **bkt = rht_bucket(old_tbl, old_hash);
 
-	old_bucket_lock = rht_bucket_lock(old_tbl, old_hash);
-
-	spin_lock_bh(old_bucket_lock);
-	while (!rhashtable_rehash_one(ht, old_hash))
+	rht_lock(bkt);
+	while (!rhashtable_rehash_one(ht, bkt, old_hash))
 		;
 	old_tbl->rehash++;
-	spin_unlock_bh(old_bucket_lock);
+	rht_unlock(bkt);
 }
 
 static int rhashtable_rehash_attach(struct rhashtable *ht,
 				    struct bucket_table *old_tbl,
 				    struct bucket_table *new_tbl)
 {
+	struct rhash_head __rcu **bkt = rht_bucket(old_tbl, 0);
+
 	/* Protect future_tbl using the first bucket lock. */
-	spin_lock_bh(old_tbl->locks);
+	rht_lock(bkt);
 
 	/* Did somebody beat us to it? */
 	if (rcu_access_pointer(old_tbl->future_tbl)) {
-		spin_unlock_bh(old_tbl->locks);
+		rht_unlock(bkt);
 		return -EEXIST;
 	}
 
@@ -234,7 +248,7 @@ static int rhashtable_rehash_attach(struct rhashtable *ht,
 	/* Ensure the new table is visible to readers. */
 	smp_wmb();
 
-	spin_unlock_bh(old_tbl->locks);
+	rht_unlock(bkt);
 
 	return 0;
 }
@@ -443,13 +457,15 @@ struct bucket_table *rhashtable_insert_slow(struct rhashtable *ht,
 					    struct rhash_head *obj,
 					    struct bucket_table *tbl)
 {
+	struct rhash_head __rcu **bkt;
 	struct rhash_head *head;
 	unsigned int hash;
 	int err;
 
 	tbl = rhashtable_last_table(ht, tbl);
 	hash = head_hashfn(ht, tbl, obj);
-	spin_lock_nested(rht_bucket_lock(tbl, hash), SINGLE_DEPTH_NESTING);
+	bkt = rht_bucket(tbl, hash);
+	rht_lock_nested(bkt);
 
 	err = -EEXIST;
 	if (key && rhashtable_lookup_fast(ht, key, ht->p))
@@ -466,16 +482,16 @@ struct bucket_table *rhashtable_insert_slow(struct rhashtable *ht,
 
 	err = 0;
 
-	head = rht_dereference_bucket(tbl->buckets[hash], tbl, hash);
+	head = rht_ptr(bkt, tbl, hash);
 
 	RCU_INIT_POINTER(obj->next, head);
 
-	rcu_assign_pointer(tbl->buckets[hash], obj);
+	rht_assign_locked(bkt, obj);
 
 	atomic_inc(&ht->nelems);
 
 exit:
-	spin_unlock(rht_bucket_lock(tbl, hash));
+	rht_unlock_nested(bkt);
 
 	if (err == 0)
 		return NULL;
@@ -486,6 +502,59 @@ exit:
 }
 EXPORT_SYMBOL_GPL(rhashtable_insert_slow);
 
+/**
+ * rhashtable_insert_bulk - insert many objects into a hash table
+ * @ht:		hash table
+ * @objs:	pointers to the hash heads inside the objects
+ * @nr:		number of objects
+ *
+ * Meant for populating a table up front.  The table is resized once to
+ * fit all @nr objects before they are inserted, instead of growing
+ * step by step and pushing insertions onto the slow path each time a
+ * resize is pending.  Like rhashtable_insert_fast() no check is made
+ * for duplicate keys.
+ *
+ * Must be called in process context.  Returns the number of objects
+ * inserted, which is less than @nr only if an insertion failed; that
+ * error is returned instead if nothing could be inserted.
+ */
+int rhashtable_insert_bulk(struct rhashtable *ht, struct rhash_head **objs,
+			   unsigned int nr)
+{
+	struct bucket_table *tbl, *new_tbl;
+	unsigned int i;
+	size_t size;
+	int err;
+
+	might_sleep();
+
+	mutex_lock(&ht->mutex);
+	tbl = rhashtable_last_table(ht, rht_dereference(ht->tbl, ht));
+	size = roundup_pow_of_two((atomic_read(&ht->nelems) + nr) * 4 / 3);
+	if (ht->p.max_size)
+		size = min_t(size_t, size, ht->p.max_size);
+
+	if (size > tbl->size) {
+		new_tbl = bucket_table_alloc(ht, size, GFP_KERNEL);
+		if (new_tbl && rhashtable_rehash_attach(ht, tbl, new_tbl))
+			bucket_table_free(new_tbl);
+		/* Also completes any rehash that was already pending */
+		while (rhashtable_rehash_table(ht) == -EAGAIN)
+			;
+	}
+	mutex_unlock(&ht->mutex);
+
+	for (i = 0; i < nr; i++) {
+		err = __rhashtable_insert_fast(ht, NULL, objs[i], ht->p);
+		if (err)
+			return i ?: err;
+		cond_resched();
+	}
+
+	return nr;
+}
+EXPORT_SYMBOL_GPL(rhashtable_insert_bulk);
+
 /**
  * rhashtable_walk_init - Initialise an iterator
  * @ht:		Table to walk over
@@ -700,7 +769,6 @@ static u32 rhashtable_jhash2(const void *key, u32 length, u32 seed)
  *	.key_offset = offsetof(struct test_obj, key),
  *	.key_len = sizeof(int),
  *	.hashfn = jhash,
- *	.nulls_base = (1U << RHT_BASE_SHIFT),
  * };
  *
  * Configuration Example 2: Variable length keys
@@ -734,9 +802,6 @@ int rhashtable_init(struct rhashtable *ht,
 	    (params->obj_hashfn && !params->obj_cmpfn))
 		return -EINVAL;
 
-	if (params->nulls_base && params->nulls_base < (1U << RHT_BASE_SHIFT))
-		return -EINVAL;
-
 	memset(ht, 0, sizeof(*ht));
 	mutex_init(&ht->mutex);
 	spin_lock_init(&ht->lock);
@@ -774,11 +839,6 @@ int rhashtable_init(struct rhashtable *ht,
 	if (!params->insecure_elasticity)
 		ht->elasticity = 16;
 
-	if (params->locks_mul)
-		ht->p.locks_mul = roundup_pow_of_two(params->locks_mul);
-	else
-		ht->p.locks_mul = BUCKET_LOCKS_PER_CPU;
-
 	ht->key_len = ht->p.key_len;
 	if (!params->hashfn) {
 		ht->p.hashfn = jhash;
@@ -833,7 +893,7 @@ void rhashtable_free_and_destroy(struct rhashtable *ht,
 		for (i = 0; i < tbl->size; i++) {
 			struct rhash_head *pos, *next;
 
-			for (pos = rht_dereference(tbl->buckets[i], ht),
+			for (pos = rht_ptr_exclusive(rht_bucket(tbl, i)),
 			     next = !rht_is_a_nulls(pos) ?
 					rht_dereference(pos->next, ht) : NULL;
 			     !rht_is_a_nulls(pos);
@@ -0,0 +1,155 @@
+/*
+ * Async copy offload benchmark
+ *
+ * Copies a set of pages with the CPU, then with async_copy_page() in
+ * batches the way TTM swapping does, and checks the result.  For each it
+ * reports the throughput, and the CPU time the loading task used for it,
+ * which is what the offload saves: while the engine copies, the task sleeps
+ * in async_copy_wait().  Without a local memcpy channel, or with
+ * async_copy.threshold=0, both runs copy with the CPU.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/async_tx.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static unsigned int nr_pages = 4096;
+module_param(nr_pages, uint, 0);
+MODULE_PARM_DESC(nr_pages, "Pages copied per pass (default: 4096)");
+
+static unsigned int passes = 16;
+module_param(passes, uint, 0);
+MODULE_PARM_DESC(passes, "Passes over the pages (default: 16)");
+
+static unsigned int batch = 32;
+module_param(batch, uint, 0);
+MODULE_PARM_DESC(batch, "Pages queued per async_copy_wait() (default: 32)");
+
+static struct page **src, **dst;
+
+static void __init run(const char *name, bool offload)
+{
+	u64 cpu_ns = current->se.sum_exec_runtime;
+	u64 bytes = (u64)nr_pages * passes * PAGE_SIZE;
+	struct async_copy ac;
+	unsigned int i, pass;
+	ktime_t start;
+	u64 usecs;
+
+	async_copy_init(&ac);
+
+	start = ktime_get();
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < nr_pages; i++) {
+			if (!offload) {
+				copy_highpage(dst[i], src[i]);
+				continue;
+			}
+			async_copy_page(&ac, dst[i], 0, src[i], 0, PAGE_SIZE);
+			if ((i + 1) % batch == 0)
+				async_copy_wait(&ac);
+		}
+		async_copy_wait(&ac);
+		cond_resched();
+	}
+	usecs = max_t(u64, ktime_us_delta(ktime_get(), start), 1);
+	cpu_ns = current->se.sum_exec_runtime - cpu_ns;
+
+	pr_info("%s: %llu MB/sec, %llu usecs of CPU for %llu usecs (%llu%%)\n",
+		name, (unsigned long long)div64_u64(bytes, usecs),
+		(unsigned long long)div_u64(cpu_ns, NSEC_PER_USEC),
+		(unsigned long long)usecs,
+		(unsigned long long)div64_u64(cpu_ns, usecs * 10));
+}
+
+static int __init check(void)
+{
+	unsigned int i;
+	int failed = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		void *s = kmap(src[i]), *d = kmap(dst[i]);
+
+		if (memcmp(s, d, PAGE_SIZE)) {
+			pr_warn("page %u differs after copy\n", i);
+			failed++;
+		}
+		memset(d, 0, PAGE_SIZE);
+		kunmap(dst[i]);
+		kunmap(src[i]);
+	}
+
+	return failed;
+}
+
+static int __init test_async_copy_init(void)
+{
+	unsigned int i;
+	int failed = 0;
+
+	batch = max(batch, 1U);
+
+	src = kcalloc(nr_pages, sizeof(*src), GFP_KERNEL);
+	dst = kcalloc(nr_pages, sizeof(*dst), GFP_KERNEL);
+	if (!src || !dst) {
+		failed = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < nr_pages; i++) {
+		src[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+		dst[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
+		if (!src[i] || !dst[i]) {
+			failed = -ENOMEM;
+			goto out;
+		}
+		prandom_bytes(kmap(src[i]), PAGE_SIZE);
+		kunmap(src[i]);
+	}
+
+	pr_info("%u pages, %u passes, batches of %u, %soffloading\n",
+		nr_pages, passes, batch,
+		async_copy_worthwhile(PAGE_SIZE) ? "" : "not ");
+
+	run("cpu", false);
+	failed += check();
+	run("offload", true);
+	failed += check();
+
+	if (failed)
+		pr_warn("%d checks FAILED\n", failed);
+	else
+		pr_info("all checks passed\n");
+	failed = failed ? -EINVAL : 0;
+out:
+	for (i = 0; i < nr_pages; i++) {
+		if (src && src[i])
+			__free_page(src[i]);
+		if (dst && dst[i])
+			__free_page(dst[i]);
+	}
+	kfree(dst);
+	kfree(src);
+	return failed;
+}
+
+static void __exit test_async_copy_exit(void)
+{
+}
+
+module_init(test_async_copy_init);
+module_exit(test_async_copy_exit);
+
+MODULE_LICENSE("GPL v2");
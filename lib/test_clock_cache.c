@@ -0,0 +1,345 @@
+/*
+ * Object cache lookup/insert throughput benchmark
+ *
+ * Spawns one thread per online CPU (bound to that CPU) which looks up keys
+ * drawn from a working set larger than the cache, inserting on a miss,
+ * once against a clock_cache and once against an lru_cache behind a
+ * single spinlock (the way drbd drives its activity log).  Reports the
+ * per-CPU and aggregate operation rate and the hit ratio of each.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/clock_cache.h>
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/lru_cache.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/semaphore.h>
+#include <linux/slab.h>
+
+static unsigned int entries = 4096;
+module_param(entries, uint, 0);
+MODULE_PARM_DESC(entries, "Number of cache entries (default: 4096)");
+
+static unsigned int keys = 8192;
+module_param(keys, uint, 0);
+MODULE_PARM_DESC(keys, "Size of the working set (default: 8192)");
+
+static unsigned int hot_percent = 80;
+module_param(hot_percent, uint, 0);
+MODULE_PARM_DESC(hot_percent, "Percentage of accesses going to the hottest 1/8 of the keys (default: 80)");
+
+static unsigned int loops = 1000000;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Accesses per thread (default: 1000000)");
+
+static unsigned int shards;
+module_param(shards, uint, 0);
+MODULE_PARM_DESC(shards, "Number of clock_cache shards (default: one per CPU)");
+
+struct test_obj {
+	struct cc_entry		cce;
+	struct lc_element	lce;
+};
+
+struct thread_data {
+	unsigned int cpu;
+	struct task_struct *task;
+	u64 nsecs;
+	unsigned long hits;
+	unsigned long fails;
+};
+
+static struct clock_cache *cc;
+static struct lru_cache *lc;
+static struct kmem_cache *lc_slab;
+static DEFINE_SPINLOCK(lc_lock);
+static bool use_lru;
+
+static struct semaphore prestart_sem;
+static struct semaphore startup_sem = __SEMAPHORE_INITIALIZER(startup_sem, 0);
+
+static void test_cc_release(struct cc_entry *e)
+{
+	kfree_rcu(container_of(e, struct test_obj, cce), cce.rcu);
+}
+
+static unsigned int test_next_key(void)
+{
+	unsigned int hot = max(keys / 8, 1U);
+
+	if (prandom_u32_max(100) < hot_percent)
+		return prandom_u32_max(hot);
+	return prandom_u32_max(keys);
+}
+
+static bool test_cc_access(unsigned int key, unsigned long *fails)
+{
+	struct test_obj *obj;
+	struct cc_entry *e;
+
+	e = clock_cache_lookup(cc, key);
+	if (e) {
+		clock_cache_put(cc, e);
+		return true;
+	}
+
+	obj = kmalloc(sizeof(*obj), GFP_KERNEL);
+	if (!obj) {
+		(*fails)++;
+		return false;
+	}
+	e = clock_cache_insert(cc, &obj->cce, key);
+	if (IS_ERR(e)) {
+		(*fails)++;
+		kfree(obj);
+		return false;
+	}
+	if (e != &obj->cce)
+		kfree(obj);
+	clock_cache_put(cc, e);
+	return false;
+}
+
+static bool test_lc_access(unsigned int key, unsigned long *fails)
+{
+	struct lc_element *e;
+	bool hit = false;
+
+	spin_lock(&lc_lock);
+	e = lc_get(lc, key);
+	if (!e) {
+		(*fails)++;
+	} else {
+		hit = e->lc_number == key;
+		if (!hit)
+			lc_committed(lc);
+		lc_put(lc, e);
+	}
+	spin_unlock(&lc_lock);
+
+	return hit;
+}
+
+static int threadfunc(void *data)
+{
+	struct thread_data *tdata = data;
+	unsigned int i;
+	ktime_t start;
+
+	up(&prestart_sem);
+	if (down_interruptible(&startup_sem))
+		pr_err("  thread[%u]: down_interruptible failed\n", tdata->cpu);
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		unsigned int key = test_next_key();
+		bool hit;
+
+		if (use_lru)
+			hit = test_lc_access(key, &tdata->fails);
+		else
+			hit = test_cc_access(key, &tdata->fails);
+		tdata->hits += hit;
+
+		if (need_resched())
+			cond_resched();
+	}
+	tdata->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void __init test_run(const char *name, struct thread_data *tdata)
+{
+	unsigned long total_ops = 0, total_hits = 0;
+	unsigned int nr_threads = 0, i, cpu;
+	u64 max_nsecs = 0;
+
+	memset(tdata, 0, nr_cpu_ids * sizeof(*tdata));
+
+	get_online_cpus();
+	sema_init(&prestart_sem, 1 - num_online_cpus());
+	for_each_online_cpu(cpu) {
+		struct thread_data *td = &tdata[nr_threads];
+
+		td->cpu = cpu;
+		td->task = kthread_create_on_node(threadfunc, td,
+						  cpu_to_node(cpu),
+						  "cache_test/%u", cpu);
+		if (IS_ERR(td->task)) {
+			pr_err("  kthread_create failed for cpu %u\n", cpu);
+			up(&prestart_sem);
+			continue;
+		}
+		kthread_bind(td->task, cpu);
+		wake_up_process(td->task);
+		nr_threads++;
+	}
+	put_online_cpus();
+
+	if (down_interruptible(&prestart_sem))
+		pr_err("  down interruptible failed\n");
+	for (i = 0; i < nr_threads; i++)
+		up(&startup_sem);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct thread_data *td = &tdata[i];
+		u64 usecs;
+
+		kthread_stop(td->task);
+
+		usecs = max_t(u64, div_u64(td->nsecs, NSEC_PER_USEC), 1);
+		pr_info("  %s cpu%u: %llu ops/sec, %lu hits, %lu failed\n",
+			name, td->cpu,
+			(unsigned long long)div64_u64((u64)loops * USEC_PER_SEC,
+						      usecs),
+			td->hits, td->fails);
+
+		total_ops += loops;
+		total_hits += td->hits;
+		max_nsecs = max(max_nsecs, td->nsecs);
+	}
+
+	if (nr_threads) {
+		u64 usecs = max_t(u64, div_u64(max_nsecs, NSEC_PER_USEC), 1);
+
+		pr_info("%s: %u threads, %llu ops/sec aggregate, %lu%% hits\n",
+			name, nr_threads,
+			(unsigned long long)div64_u64((u64)total_ops * USEC_PER_SEC,
+						      usecs),
+			total_hits * 100 / total_ops);
+	}
+}
+
+static int __init test_clock_cache_sanity(void)
+{
+	struct test_obj *obj;
+	struct cc_entry *e;
+	unsigned int i;
+
+	/* Fill the cache, then pin every entry: the next insert must fail */
+	for (i = 0; i < entries; i++) {
+		obj = kmalloc(sizeof(*obj), GFP_KERNEL);
+		if (!obj)
+			return -ENOMEM;
+		e = clock_cache_insert(cc, &obj->cce, i);
+		if (e != &obj->cce) {
+			pr_err("insert of key %u failed\n", i);
+			kfree(obj);
+			return -EINVAL;
+		}
+		clock_cache_put(cc, e);
+	}
+	for (i = 0; i < entries; i++) {
+		e = clock_cache_lookup(cc, i);
+		if (!e || e->key != i) {
+			pr_err("lookup of key %u failed\n", i);
+			return -EINVAL;
+		}
+	}
+
+	obj = kmalloc(sizeof(*obj), GFP_KERNEL);
+	if (!obj)
+		return -ENOMEM;
+	e = clock_cache_insert(cc, &obj->cce, entries);
+	if (e != ERR_PTR(-ENOSPC)) {
+		pr_err("insert into a pinned cache did not fail\n");
+		return -EINVAL;
+	}
+
+	/* Unpin and remove them all again */
+	for (i = 0; i < entries; i++) {
+		e = clock_cache_lookup(cc, i);
+		clock_cache_put(cc, e);
+		clock_cache_remove(cc, e);
+		clock_cache_put(cc, e);
+		if (clock_cache_lookup(cc, i)) {
+			pr_err("key %u still found after removal\n", i);
+			return -EINVAL;
+		}
+	}
+
+	/* With room again the insert succeeds */
+	e = clock_cache_insert(cc, &obj->cce, entries);
+	if (e != &obj->cce) {
+		pr_err("insert into an empty cache failed\n");
+		kfree(obj);
+		return -EINVAL;
+	}
+	clock_cache_put(cc, e);
+	return 0;
+}
+
+static int __init test_clock_cache_init(void)
+{
+	struct thread_data *tdata;
+	int err = -ENOMEM;
+
+	entries = max(entries, 1U);
+	keys = max(keys, 1U);
+	hot_percent = min(hot_percent, 100U);
+
+	tdata = kcalloc(nr_cpu_ids, sizeof(*tdata), GFP_KERNEL);
+	if (!tdata)
+		return -ENOMEM;
+
+	pr_info("entries=%u keys=%u hot=%u%% loops=%u\n",
+		entries, keys, hot_percent, loops);
+
+	/* A single shard, so that every entry shares the same ring */
+	cc = clock_cache_create(entries, 1, test_cc_release);
+	if (!cc)
+		goto out;
+	err = test_clock_cache_sanity();
+	clock_cache_destroy(cc);
+	if (err)
+		goto out;
+
+	err = -ENOMEM;
+	cc = clock_cache_create(entries, shards, test_cc_release);
+	if (!cc)
+		goto out;
+	test_run("clock_cache", tdata);
+	clock_cache_destroy(cc);
+
+	lc_slab = kmem_cache_create("test_lru_cache", sizeof(struct test_obj),
+				    0, 0, NULL);
+	if (!lc_slab)
+		goto out;
+	lc = lc_create("test_lru_cache", lc_slab, 1, entries,
+		       sizeof(struct test_obj),
+		       offsetof(struct test_obj, lce));
+	if (lc) {
+		use_lru = true;
+		test_run("lru_cache", tdata);
+		lc_destroy(lc);
+		err = 0;
+	}
+	kmem_cache_destroy(lc_slab);
+out:
+	kfree(tdata);
+	return err;
+}
+
+static void __exit test_clock_cache_exit(void)
+{
+}
+
+module_init(test_clock_cache_init);
+module_exit(test_clock_cache_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,164 @@
+/*
+ * Checksum selftest
+ *
+ * Checks csum_partial() and csum_and_copy_to_user() against a byte-wise
+ * reference sum for every source alignment within a cache line, a spread
+ * of destination alignments, and lengths on both sides of the cutoffs
+ * where architectures switch to their wide (e.g. AVX2) loops.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+
+#define TEST_CSUM_MAX_LEN	(2 * PAGE_SIZE)
+#define TEST_CSUM_BUF_LEN	(TEST_CSUM_MAX_LEN + 2 * L1_CACHE_BYTES)
+
+static const int lengths[] = {
+	0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+	127, 128, 129, 255, 256, 511, 512, 1023, 1024, 1025, 1087, 1500,
+	2047, 2048, 2049, 4095, 4096, 4097, 8000, TEST_CSUM_MAX_LEN,
+};
+
+static u16 csum_ref(const u8 *buf, int len, u32 init)
+{
+	u64 sum = init;
+	int i;
+
+	for (i = 0; i < len; i++) {
+#ifdef __BIG_ENDIAN
+		sum += (i & 1) ? buf[i] : (u32)buf[i] << 8;
+#else
+		sum += (i & 1) ? (u32)buf[i] << 8 : buf[i];
+#endif
+	}
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum & 0xffff;
+}
+
+static int __init test_csum_partial(const u8 *buf)
+{
+	int i, off, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+		for (off = 0; off < L1_CACHE_BYTES; off++) {
+			int len = lengths[i];
+			u32 init = prandom_u32();
+			u16 want = csum_ref(buf + off, len, init);
+			u16 got = (__force u16)csum_fold(csum_partial(buf + off,
+						len, (__force __wsum)init));
+
+			if (got != want) {
+				pr_warn("csum_partial: len %d offset %d: got %04x, want %04x\n",
+					len, off, got, want);
+				failed++;
+			}
+		}
+	}
+
+	return failed;
+}
+
+static int __init test_csum_copy_to_user(const u8 *buf, u8 *check,
+					 u8 __user *usermem)
+{
+	int i, off, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+		for (off = 0; off < L1_CACHE_BYTES; off++) {
+			int len = lengths[i];
+			int doff = (off * 7) % L1_CACHE_BYTES;
+			u32 init = prandom_u32();
+			u16 want = csum_ref(buf + off, len, init);
+			int err = 0;
+			__wsum sum;
+
+			sum = csum_and_copy_to_user(buf + off, usermem + doff,
+						    len, (__force __wsum)init,
+						    &err);
+			if (err) {
+				pr_warn("csum_and_copy_to_user: len %d offsets %d/%d: error %d\n",
+					len, off, doff, err);
+				failed++;
+				continue;
+			}
+			if ((__force u16)csum_fold(sum) != want) {
+				pr_warn("csum_and_copy_to_user: len %d offsets %d/%d: got %04x, want %04x\n",
+					len, off, doff,
+					(__force u16)csum_fold(sum), want);
+				failed++;
+			}
+			if (copy_from_user(check, usermem + doff, len) ||
+			    memcmp(check, buf + off, len)) {
+				pr_warn("csum_and_copy_to_user: len %d offsets %d/%d: data mismatch\n",
+					len, off, doff);
+				failed++;
+			}
+		}
+	}
+
+	return failed;
+}
+
+static int __init test_csum_init(void)
+{
+	unsigned long user_addr;
+	u8 *buf, *check;
+	int failed;
+
+	buf = kmalloc(TEST_CSUM_BUF_LEN, GFP_KERNEL);
+	check = kmalloc(TEST_CSUM_BUF_LEN, GFP_KERNEL);
+	if (!buf || !check) {
+		failed = -ENOMEM;
+		goto out;
+	}
+	prandom_bytes(buf, TEST_CSUM_BUF_LEN);
+
+	user_addr = vm_mmap(NULL, 0, TEST_CSUM_BUF_LEN,
+			    PROT_READ | PROT_WRITE,
+			    MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (user_addr >= (unsigned long)(TASK_SIZE)) {
+		pr_warn("Failed to allocate user memory\n");
+		failed = -ENOMEM;
+		goto out;
+	}
+
+	failed = test_csum_partial(buf);
+	failed += test_csum_copy_to_user(buf, check,
+					 (u8 __user *)user_addr);
+
+	vm_munmap(user_addr, TEST_CSUM_BUF_LEN);
+
+	if (failed)
+		pr_warn("%d checks FAILED\n", failed);
+	else
+		pr_info("all checks passed\n");
+	failed = failed ? -EINVAL : 0;
+out:
+	kfree(check);
+	kfree(buf);
+	return failed;
+}
+
+static void __exit test_csum_exit(void)
+{
+}
+
+module_init(test_csum_init);
+module_exit(test_csum_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,174 @@
+/*
+ * Flow dissector throughput benchmark
+ *
+ * Builds a few common packets and dissects each of them with the default
+ * flow_keys dissector in a loop, once walking the headers every time and
+ * once from the walk cached in the skb, the way RPS, the qdiscs, bonding
+ * and the classifiers take turns at the same skb. Checks that both give
+ * the same keys and reports the time per dissection.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/flow_dissector.h>
+
+static unsigned int loops = 1000000;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Dissections per packet and mode (default: 1000000)");
+
+struct test_packet {
+	const char *name;
+	__be16 proto;
+	u8 ip_proto;
+	bool hopopts;
+	bool frag;
+};
+
+static const struct test_packet packets[] = {
+	{ "ipv4/tcp",		htons(ETH_P_IP),   IPPROTO_TCP },
+	{ "ipv4/udp",		htons(ETH_P_IP),   IPPROTO_UDP },
+	{ "ipv4/frag",		htons(ETH_P_IP),   IPPROTO_UDP, .frag = true },
+	{ "ipv6/tcp",		htons(ETH_P_IPV6), IPPROTO_TCP },
+	{ "ipv6/udp",		htons(ETH_P_IPV6), IPPROTO_UDP },
+	{ "ipv6/hop/udp",	htons(ETH_P_IPV6), IPPROTO_UDP, .hopopts = true },
+};
+
+static struct sk_buff *build_packet(const struct test_packet *p)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(256, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	skb_reserve(skb, 64);
+	skb_reset_network_header(skb);
+	skb->protocol = p->proto;
+
+	if (p->proto == htons(ETH_P_IP)) {
+		struct iphdr *iph = (struct iphdr *)skb_put(skb, sizeof(*iph));
+
+		memset(iph, 0, sizeof(*iph));
+		iph->version = 4;
+		iph->ihl = 5;
+		iph->ttl = 64;
+		iph->protocol = p->ip_proto;
+		iph->saddr = htonl(0xc0a80001);
+		iph->daddr = htonl(0xc0a80002);
+		if (p->frag)
+			iph->frag_off = htons(IP_MF);
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)skb_put(skb,
+								  sizeof(*ip6h));
+
+		memset(ip6h, 0, sizeof(*ip6h));
+		ip6h->version = 6;
+		ip6h->hop_limit = 64;
+		ip6h->nexthdr = p->hopopts ? NEXTHDR_HOP : p->ip_proto;
+		ip6h->saddr.s6_addr32[0] = htonl(0x20010db8);
+		ip6h->saddr.s6_addr32[3] = htonl(1);
+		ip6h->daddr.s6_addr32[0] = htonl(0x20010db8);
+		ip6h->daddr.s6_addr32[3] = htonl(2);
+		if (p->hopopts) {
+			u8 *opt = skb_put(skb, 8);
+
+			memset(opt, 0, 8);
+			opt[0] = p->ip_proto;
+		}
+	}
+
+	skb_set_transport_header(skb, skb->len);
+	if (p->ip_proto == IPPROTO_TCP) {
+		struct tcphdr *th = (struct tcphdr *)skb_put(skb, sizeof(*th));
+
+		memset(th, 0, sizeof(*th));
+		th->source = htons(40000);
+		th->dest = htons(80);
+		th->doff = sizeof(*th) / 4;
+	} else {
+		struct udphdr *uh = (struct udphdr *)skb_put(skb, sizeof(*uh));
+
+		memset(uh, 0, sizeof(*uh));
+		uh->source = htons(40000);
+		uh->dest = htons(4789);
+		uh->len = htons(sizeof(*uh));
+	}
+
+	return skb;
+}
+
+static u64 run(struct sk_buff *skb, struct flow_keys *keys, bool cached)
+{
+	ktime_t start;
+	unsigned int i;
+
+	skb_clear_flow_cache(skb);
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		if (!cached)
+			skb_clear_flow_cache(skb);
+		skb_flow_dissect_flow_keys(skb, keys,
+					   FLOW_DISSECTOR_F_STOP_AT_FLOW_LABEL);
+		if (need_resched())
+			cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int __init test_flow_dissector_init(void)
+{
+	struct flow_keys walked, cached;
+	unsigned int i, failed = 0;
+
+	if (!loops)
+		loops = 1;
+
+	for (i = 0; i < ARRAY_SIZE(packets); i++) {
+		const struct test_packet *p = &packets[i];
+		struct sk_buff *skb = build_packet(p);
+		u64 walk_ns, cache_ns;
+
+		if (!skb)
+			return -ENOMEM;
+
+		walk_ns = run(skb, &walked, false);
+		cache_ns = run(skb, &cached, true);
+
+		if (memcmp(&walked, &cached, sizeof(walked))) {
+			pr_err("flow_dissector: %s: cached keys differ\n",
+			       p->name);
+			failed++;
+		}
+
+		pr_info("flow_dissector: %-14s walk %llu ns, cached %llu ns per packet%s\n",
+			p->name,
+			(unsigned long long)div_u64(walk_ns, loops),
+			(unsigned long long)div_u64(cache_ns, loops),
+			skb->flow_cache.valid ? "" : " (not cached)");
+
+		kfree_skb(skb);
+	}
+
+	return failed ? -EINVAL : 0;
+}
+
+static void __exit test_flow_dissector_exit(void)
+{
+}
+
+module_init(test_flow_dissector_init);
+module_exit(test_flow_dissector_exit);
+
+MODULE_LICENSE("GPL v2");
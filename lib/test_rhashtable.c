@@ -61,6 +61,8 @@ struct thread_data {
 	int id;
 	struct task_struct *task;
 	struct test_obj *objs;
+	s64 insert_ns;
+	s64 lookup_ns;
 };
 
 static struct test_obj array[MAX_ENTRIES];
@@ -70,7 +72,6 @@ static struct rhashtable_params test_rht_params = {
 	.key_offset = offsetof(struct test_obj, value),
 	.key_len = sizeof(int),
 	.hashfn = jhash,
-	.nulls_base = (3U << RHT_BASE_SHIFT),
 };
 
 static struct semaphore prestart_sem;
@@ -216,6 +217,54 @@ static s64 __init test_rhashtable(struct rhashtable *ht)
 
 static struct rhashtable ht;
 
+static s64 __init test_rht_bulk(void)
+{
+	struct rhash_head **objs;
+	unsigned int i;
+	s64 start, end;
+	int err;
+
+	objs = vmalloc(entries * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+
+	memset(&array, 0, sizeof(array));
+	for (i = 0; i < entries; i++) {
+		array[i].value = i * 2;
+		objs[i] = &array[i].node;
+	}
+
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err < 0) {
+		vfree(objs);
+		return err;
+	}
+
+	pr_info("  Adding %d keys in bulk\n", entries);
+	start = ktime_get_ns();
+	err = rhashtable_insert_bulk(&ht, objs, entries);
+	end = ktime_get_ns();
+
+	if (err != entries) {
+		pr_warn("Test failed: bulk insert returned %d\n", err);
+		err = err < 0 ? err : -EINVAL;
+	} else {
+		rcu_read_lock();
+		err = test_rht_lookup(&ht);
+		rcu_read_unlock();
+		test_bucket_stats(&ht);
+	}
+
+	rhashtable_destroy(&ht);
+	vfree(objs);
+
+	if (err < 0)
+		return err;
+
+	pr_info("  Duration of bulk insert: %lld ns\n", end - start);
+	return end - start;
+}
+
 static int thread_lookup_test(struct thread_data *tdata)
 {
 	int i, err = 0;
@@ -244,11 +293,13 @@ static int threadfunc(void *data)
 {
 	int i, step, err = 0, insert_fails = 0;
 	struct thread_data *tdata = data;
+	s64 start;
 
 	up(&prestart_sem);
 	if (down_interruptible(&startup_sem))
 		pr_err("  thread[%d]: down_interruptible failed\n", tdata->id);
 
+	start = ktime_get_ns();
 	for (i = 0; i < entries; i++) {
 		tdata->objs[i].value = (tdata->id << 16) | i;
 		err = rhashtable_insert_fast(&ht, &tdata->objs[i].node,
@@ -262,11 +313,14 @@ static int threadfunc(void *data)
 			goto out;
 		}
 	}
+	tdata->insert_ns = ktime_get_ns() - start;
 	if (insert_fails)
 		pr_info("  thread[%d]: %d insert failures\n",
 		        tdata->id, insert_fails);
 
+	start = ktime_get_ns();
 	err = thread_lookup_test(tdata);
+	tdata->lookup_ns = ktime_get_ns() - start;
 	if (err) {
 		pr_err("  thread[%d]: rhashtable_lookup_test failed\n",
 		       tdata->id);
@@ -304,7 +358,7 @@ out:
 static int __init test_rht_init(void)
 {
 	int i, err, started_threads = 0, failed_threads = 0;
-	u64 total_time = 0;
+	u64 total_time = 0, insert_rate, lookup_rate;
 	struct thread_data *tdata;
 	struct test_obj *objs;
 
@@ -342,6 +396,11 @@ static int __init test_rht_init(void)
 	do_div(total_time, runs);
 	pr_info("Average test time: %llu\n", total_time);
 
+	pr_info("Testing bulk insertion:\n");
+	err = test_rht_bulk();
+	if (err < 0)
+		pr_warn("Test failed: bulk insertion: %d\n", err);
+
 	if (!tcount)
 		return 0;
 
@@ -390,6 +449,21 @@ static int __init test_rht_init(void)
 	}
 	pr_info("Started %d threads, %d failed\n",
 	        started_threads, failed_threads);
+
+	/* Aggregate throughput: the sum of what each thread achieved */
+	insert_rate = lookup_rate = 0;
+	for (i = 0; i < tcount; i++) {
+		if (IS_ERR(tdata[i].task))
+			continue;
+		if (tdata[i].insert_ns > 0)
+			insert_rate += div64_u64((u64)entries * NSEC_PER_SEC,
+						 tdata[i].insert_ns);
+		if (tdata[i].lookup_ns > 0)
+			lookup_rate += div64_u64((u64)entries * NSEC_PER_SEC,
+						 tdata[i].lookup_ns);
+	}
+	pr_info("Throughput: %llu inserts/s, %llu lookups/s\n",
+		insert_rate, lookup_rate);
 	rhashtable_destroy(&ht);
 	vfree(tdata);
 	vfree(objs);
@@ -0,0 +1,185 @@
+/*
+ * Scalable bitmap get/put throughput benchmark
+ *
+ * Spawns one thread per online CPU (bound to that CPU) which allocates and
+ * frees bits from a single shared sbitmap_queue in a tight loop, the same
+ * way blk-mq submitters and completers hammer a shared tag map. Reports
+ * the per-CPU and aggregate operation rate.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/sbitmap.h>
+#include <linux/sched.h>
+#include <linux/semaphore.h>
+#include <linux/slab.h>
+
+static unsigned int depth = 128;
+module_param(depth, uint, 0);
+MODULE_PARM_DESC(depth, "Number of bits in the shared map (default: 128)");
+
+static unsigned int loops = 1000000;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Get/put pairs per thread (default: 1000000)");
+
+static unsigned int hold = 1;
+module_param(hold, uint, 0);
+MODULE_PARM_DESC(hold, "Bits each thread holds before freeing (default: 1)");
+
+static bool round_robin;
+module_param(round_robin, bool, 0);
+MODULE_PARM_DESC(round_robin, "Use strict round-robin allocation (default: off)");
+
+struct thread_data {
+	unsigned int cpu;
+	struct task_struct *task;
+	u64 nsecs;
+	unsigned long ops;
+	unsigned long fails;
+};
+
+static struct sbitmap_queue sbq;
+static struct semaphore prestart_sem;
+static struct semaphore startup_sem = __SEMAPHORE_INITIALIZER(startup_sem, 0);
+
+static int threadfunc(void *data)
+{
+	struct thread_data *tdata = data;
+	unsigned int held[16], cpu[16];
+	unsigned int i, j, n;
+	ktime_t start;
+
+	up(&prestart_sem);
+	if (down_interruptible(&startup_sem))
+		pr_err("  thread[%u]: down_interruptible failed\n", tdata->cpu);
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (n = 0; n < hold; n++) {
+			int nr = sbitmap_queue_get(&sbq, &cpu[n]);
+
+			if (nr < 0) {
+				tdata->fails++;
+				break;
+			}
+			held[n] = nr;
+		}
+		for (j = 0; j < n; j++)
+			sbitmap_queue_clear(&sbq, held[j], cpu[j]);
+		tdata->ops += n;
+
+		if (need_resched())
+			cond_resched();
+	}
+	tdata->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init test_sbitmap_init(void)
+{
+	struct thread_data *tdata;
+	unsigned long total_ops = 0;
+	unsigned int nr_threads = 0, i, cpu;
+	u64 max_nsecs = 0;
+	int err;
+
+	hold = clamp_t(unsigned int, hold, 1, 16);
+
+	err = sbitmap_queue_init_node(&sbq, depth, -1, round_robin, GFP_KERNEL,
+				      NUMA_NO_NODE);
+	if (err)
+		return err;
+
+	tdata = kcalloc(nr_cpu_ids, sizeof(*tdata), GFP_KERNEL);
+	if (!tdata) {
+		sbitmap_queue_free(&sbq);
+		return -ENOMEM;
+	}
+
+	get_online_cpus();
+	sema_init(&prestart_sem, 1 - num_online_cpus());
+	for_each_online_cpu(cpu) {
+		struct thread_data *td = &tdata[nr_threads];
+
+		td->cpu = cpu;
+		td->task = kthread_create_on_node(threadfunc, td,
+						  cpu_to_node(cpu),
+						  "sbitmap_test/%u", cpu);
+		if (IS_ERR(td->task)) {
+			pr_err("  kthread_create failed for cpu %u\n", cpu);
+			up(&prestart_sem);
+			continue;
+		}
+		kthread_bind(td->task, cpu);
+		wake_up_process(td->task);
+		nr_threads++;
+	}
+	put_online_cpus();
+
+	pr_info("sbitmap: depth=%u shift=%u words=%u hold=%u loops=%u%s\n",
+		sbq.sb.depth, sbq.sb.shift, sbq.sb.map_nr, hold, loops,
+		round_robin ? " round-robin" : "");
+
+	if (down_interruptible(&prestart_sem))
+		pr_err("  down interruptible failed\n");
+	for (i = 0; i < nr_threads; i++)
+		up(&startup_sem);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct thread_data *td = &tdata[i];
+		u64 usecs;
+
+		kthread_stop(td->task);
+
+		usecs = max_t(u64, div_u64(td->nsecs, NSEC_PER_USEC), 1);
+		pr_info("  cpu%u: %lu get/put in %llu usecs, %llu ops/sec, %lu failed gets\n",
+			td->cpu, td->ops, (unsigned long long)usecs,
+			(unsigned long long)div64_u64((u64)td->ops * USEC_PER_SEC,
+						      usecs),
+			td->fails);
+
+		total_ops += td->ops;
+		max_nsecs = max(max_nsecs, td->nsecs);
+	}
+
+	if (nr_threads) {
+		u64 usecs = max_t(u64, div_u64(max_nsecs, NSEC_PER_USEC), 1);
+
+		pr_info("sbitmap: %u threads, %llu ops/sec aggregate\n",
+			nr_threads,
+			(unsigned long long)div64_u64((u64)total_ops * USEC_PER_SEC,
+						      usecs));
+	}
+
+	if (sbitmap_any_bit_set(&sbq.sb)) {
+		pr_err("sbitmap: bits still set after test\n");
+		err = -EINVAL;
+	}
+
+	kfree(tdata);
+	sbitmap_queue_free(&sbq);
+	return err;
+}
+
+static void __exit test_sbitmap_exit(void)
+{
+}
+
+module_init(test_sbitmap_init);
+module_exit(test_sbitmap_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -47,7 +47,7 @@ static const void *find_first_bad_addr(const void *addr, size_t size)
 	return first_bad_addr;
 }
 
-static void print_error_description(struct kasan_access_info *info)
+static const char *get_shadow_bug_type(struct kasan_access_info *info)
 {
 	const char *bug_type = "unknown-crash";
 	u8 *shadow_addr;
@@ -91,6 +91,28 @@ static void print_error_description(struct kasan_access_info *info)
 		break;
 	}
 
+	return bug_type;
+}
+
+static const char *get_wild_bug_type(struct kasan_access_info *info)
+{
+	if ((unsigned long)info->access_addr < PAGE_SIZE)
+		return "null-ptr-deref";
+	else if ((unsigned long)info->access_addr < TASK_SIZE)
+		return "user-memory-access";
+	else
+		return "wild-memory-access";
+}
+
+static bool addr_has_shadow(struct kasan_access_info *info)
+{
+	return info->access_addr >=
+		kasan_shadow_to_mem((void *)KASAN_SHADOW_START);
+}
+
+static void print_error_description(struct kasan_access_info *info,
+				    const char *bug_type)
+{
 	pr_err("BUG: KASAN: %s in %pS at addr %p\n",
 		bug_type, (void *)info->ip,
 		info->access_addr);
@@ -204,6 +226,32 @@ static void print_shadow_for_address(const void *addr)
 
 static DEFINE_SPINLOCK(report_lock);
 
+/*
+ * Only the first bug gets the full report with the object, shadow and stack
+ * dumps.  The ones after it are summed up in a ratelimited line each,
+ * without taking report_lock, so that a kernel that keeps hitting a bug
+ * keeps running at a reasonable speed.  Boot with kasan_multi_shot to get
+ * every report in full.
+ */
+static unsigned long kasan_flags;
+
+#define KASAN_BIT_REPORTED	0
+#define KASAN_BIT_MULTI_SHOT	1
+
+static int __init kasan_set_multi_shot(char *str)
+{
+	set_bit(KASAN_BIT_MULTI_SHOT, &kasan_flags);
+	return 1;
+}
+__setup("kasan_multi_shot", kasan_set_multi_shot);
+
+static bool kasan_report_in_full(void)
+{
+	if (test_bit(KASAN_BIT_MULTI_SHOT, &kasan_flags))
+		return true;
+	return !test_and_set_bit(KASAN_BIT_REPORTED, &kasan_flags);
+}
+
 static void kasan_report_error(struct kasan_access_info *info)
 {
 	unsigned long flags;
@@ -213,17 +261,24 @@ static void kasan_report_error(struct kasan_access_info *info)
 	 * Make sure we don't end up in loop.
 	 */
 	kasan_disable_current();
+
+	bug_type = addr_has_shadow(info) ? get_shadow_bug_type(info) :
+					   get_wild_bug_type(info);
+
+	if (!kasan_report_in_full()) {
+		pr_err_ratelimited("BUG: KASAN: %s in %pS at addr %p, %s of size %zu by task %s/%d\n",
+			bug_type, (void *)info->ip, info->access_addr,
+			info->is_write ? "write" : "read",
+			info->access_size, current->comm,
+			task_pid_nr(current));
+		kasan_enable_current();
+		return;
+	}
+
 	spin_lock_irqsave(&report_lock, flags);
 	pr_err("================================="
 		"=================================\n");
-	if (info->access_addr <
-			kasan_shadow_to_mem((void *)KASAN_SHADOW_START)) {
-		if ((unsigned long)info->access_addr < PAGE_SIZE)
-			bug_type = "null-ptr-deref";
-		else if ((unsigned long)info->access_addr < TASK_SIZE)
-			bug_type = "user-memory-access";
-		else
-			bug_type = "wild-memory-access";
+	if (!addr_has_shadow(info)) {
 		pr_err("BUG: KASAN: %s on address %p\n",
 			bug_type, info->access_addr);
 		pr_err("%s of size %zu by task %s/%d\n",
@@ -232,7 +287,7 @@ static void kasan_report_error(struct kasan_access_info *info)
 			task_pid_nr(current));
 		dump_stack();
 	} else {
-		print_error_description(info);
+		print_error_description(info, bug_type);
 		print_address_description(info);
 		print_shadow_for_address(info->first_bad_addr);
 	}
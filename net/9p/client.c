@@ -35,6 +35,7 @@
 #include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/uio.h>
+#include <linux/workqueue.h>
 #include <net/9p/9p.h>
 #include <linux/parser.h>
 #include <net/9p/client.h>
@@ -1535,81 +1536,273 @@ error:
 }
 EXPORT_SYMBOL(p9_client_unlinkat);
 
-int
-p9_client_read(struct p9_fid *fid, u64 offset, struct iov_iter *to, int *err)
+static int p9_client_iosize(struct p9_fid *fid)
+{
+	struct p9_client *clnt = fid->clnt;
+	int rsize = fid->iounit;
+
+	if (!rsize || rsize > clnt->msize - P9_IOHDRSZ)
+		rsize = clnt->msize - P9_IOHDRSZ;
+	return rsize;
+}
+
+/*
+ * Issue a single TREAD of at most one iounit and copy the reply into @to.
+ * Returns the number of bytes read; 0 means end of file.
+ */
+static int
+p9_client_read_once(struct p9_fid *fid, u64 offset, struct iov_iter *to,
+		    int *err)
 {
 	struct p9_client *clnt = fid->clnt;
 	struct p9_req_t *req;
-	int total = 0;
+	int count = iov_iter_count(to);
+	int rsize, non_zc = 0;
+	char *dataptr;
+
 	*err = 0;
+	rsize = p9_client_iosize(fid);
+	if (count < rsize)
+		rsize = count;
 
-	p9_debug(P9_DEBUG_9P, ">>> TREAD fid %d offset %llu %d\n",
-		   fid->fid, (unsigned long long) offset, (int)iov_iter_count(to));
+	/* Don't bother zerocopy for small IO (< 1024) */
+	if (clnt->trans_mod->zc_request && rsize > 1024) {
+		/*
+		 * response header len is 11
+		 * PDU Header(7) + IO Size (4)
+		 */
+		req = p9_client_zc_rpc(clnt, P9_TREAD, to, NULL, rsize,
+				       0, 11, "dqd", fid->fid,
+				       offset, rsize);
+	} else {
+		non_zc = 1;
+		req = p9_client_rpc(clnt, P9_TREAD, "dqd", fid->fid, offset,
+				    rsize);
+	}
+	if (IS_ERR(req)) {
+		*err = PTR_ERR(req);
+		return 0;
+	}
 
-	while (iov_iter_count(to)) {
-		int count = iov_iter_count(to);
-		int rsize, non_zc = 0;
-		char *dataptr;
-			
-		rsize = fid->iounit;
-		if (!rsize || rsize > clnt->msize-P9_IOHDRSZ)
-			rsize = clnt->msize - P9_IOHDRSZ;
-
-		if (count < rsize)
-			rsize = count;
-
-		/* Don't bother zerocopy for small IO (< 1024) */
-		if (clnt->trans_mod->zc_request && rsize > 1024) {
-			/*
-			 * response header len is 11
-			 * PDU Header(7) + IO Size (4)
-			 */
-			req = p9_client_zc_rpc(clnt, P9_TREAD, to, NULL, rsize,
-					       0, 11, "dqd", fid->fid,
-					       offset, rsize);
-		} else {
-			non_zc = 1;
-			req = p9_client_rpc(clnt, P9_TREAD, "dqd", fid->fid, offset,
-					    rsize);
-		}
-		if (IS_ERR(req)) {
-			*err = PTR_ERR(req);
-			break;
-		}
+	*err = p9pdu_readf(req->rc, clnt->proto_version,
+			   "D", &count, &dataptr);
+	if (*err) {
+		trace_9p_protocol_dump(clnt, req->rc);
+		p9_free_req(clnt, req);
+		return 0;
+	}
+	if (rsize < count) {
+		pr_err("bogus RREAD count (%d > %d)\n", count, rsize);
+		count = rsize;
+	}
 
-		*err = p9pdu_readf(req->rc, clnt->proto_version,
-				   "D", &count, &dataptr);
-		if (*err) {
-			trace_9p_protocol_dump(clnt, req->rc);
-			p9_free_req(clnt, req);
-			break;
-		}
-		if (rsize < count) {
-			pr_err("bogus RREAD count (%d > %d)\n", count, rsize);
-			count = rsize;
-		}
+	p9_debug(P9_DEBUG_9P, "<<< RREAD count %d\n", count);
 
-		p9_debug(P9_DEBUG_9P, "<<< RREAD count %d\n", count);
-		if (!count) {
-			p9_free_req(clnt, req);
-			break;
+	if (non_zc && count) {
+		int n = copy_to_iter(dataptr, count, to);
+
+		if (n != count)
+			*err = -EFAULT;
+		count = n;
+	} else {
+		iov_iter_advance(to, count);
+	}
+	p9_free_req(clnt, req);
+	return count;
+}
+
+/*
+ * Issue a single TWRITE of at most one iounit from @from.  Returns the
+ * number of bytes the server accepted.
+ */
+static int
+p9_client_write_once(struct p9_fid *fid, u64 offset, struct iov_iter *from,
+		     int *err)
+{
+	struct p9_client *clnt = fid->clnt;
+	struct p9_req_t *req;
+	int count = iov_iter_count(from);
+	int rsize;
+
+	*err = 0;
+	rsize = p9_client_iosize(fid);
+	if (count < rsize)
+		rsize = count;
+
+	/* Don't bother zerocopy for small IO (< 1024) */
+	if (clnt->trans_mod->zc_request && rsize > 1024) {
+		req = p9_client_zc_rpc(clnt, P9_TWRITE, NULL, from, 0,
+				       rsize, P9_ZC_HDR_SZ, "dqd",
+				       fid->fid, offset, rsize);
+	} else {
+		req = p9_client_rpc(clnt, P9_TWRITE, "dqV", fid->fid,
+					    offset, rsize, from);
+	}
+	if (IS_ERR(req)) {
+		*err = PTR_ERR(req);
+		return 0;
+	}
+
+	*err = p9pdu_readf(req->rc, clnt->proto_version, "d", &count);
+	if (*err) {
+		trace_9p_protocol_dump(clnt, req->rc);
+		p9_free_req(clnt, req);
+		return 0;
+	}
+	if (rsize < count) {
+		pr_err("bogus RWRITE count (%d > %d)\n", count, rsize);
+		count = rsize;
+	}
+
+	p9_debug(P9_DEBUG_9P, "<<< RWRITE count %d\n", count);
+
+	p9_free_req(clnt, req);
+	iov_iter_advance(from, count);
+	return count;
+}
+
+/*
+ * Reads and writes of page cache and other kernel memory larger than one
+ * iounit are split into iounit-sized requests that are issued from
+ * several contexts at once, so up to P9_IO_MAX_INFLIGHT of them are in
+ * flight on the channel instead of one round trip per msize.  User
+ * iovecs stay on the serial path: the workers cannot touch the caller's
+ * address space.
+ */
+#define P9_IO_MAX_INFLIGHT	8
+
+static struct workqueue_struct *p9_io_wq;
+
+struct p9_io_chunk {
+	struct work_struct work;
+	struct p9_fid *fid;
+	u64 offset;
+	struct iov_iter iter;
+	size_t len;
+	int write;
+	int count;		/* bytes transferred */
+	int err;
+};
+
+static void p9_io_chunk_run(struct p9_io_chunk *chunk)
+{
+	if (chunk->write)
+		chunk->count = p9_client_write_once(chunk->fid, chunk->offset,
+						    &chunk->iter, &chunk->err);
+	else
+		chunk->count = p9_client_read_once(chunk->fid, chunk->offset,
+						   &chunk->iter, &chunk->err);
+}
+
+static void p9_io_chunk_work(struct work_struct *work)
+{
+	p9_io_chunk_run(container_of(work, struct p9_io_chunk, work));
+}
+
+static bool p9_client_can_pipeline(struct p9_fid *fid, struct iov_iter *iter)
+{
+	if (!(iter->type & (ITER_KVEC | ITER_BVEC)))
+		return false;
+	return iov_iter_count(iter) > p9_client_iosize(fid);
+}
+
+/*
+ * Returns the number of bytes transferred, or -ENOMEM if the chunk array
+ * could not be allocated and nothing was sent.  A chunk that comes back
+ * short ends the round: everything after it is sent again by the next
+ * one, which also tells end of file (a zero count) from a transport that
+ * could only map part of the chunk.
+ */
+static int
+p9_client_io_pipelined(struct p9_fid *fid, u64 offset, struct iov_iter *iter,
+		       int write, int *err)
+{
+	struct p9_io_chunk *chunks;
+	int rsize = p9_client_iosize(fid);
+	int total = 0;
+
+	chunks = kcalloc(P9_IO_MAX_INFLIGHT, sizeof(*chunks), GFP_NOFS);
+	if (!chunks)
+		return -ENOMEM;
+
+	*err = 0;
+	while (iov_iter_count(iter)) {
+		struct iov_iter pos = *iter;
+		u64 chunk_off = offset;
+		int i, nr = 0, done = 0, round = 0;
+
+		while (nr < P9_IO_MAX_INFLIGHT && iov_iter_count(&pos)) {
+			struct p9_io_chunk *chunk = &chunks[nr];
+
+			chunk->fid = fid;
+			chunk->offset = chunk_off;
+			chunk->iter = pos;
+			iov_iter_truncate(&chunk->iter, rsize);
+			chunk->len = iov_iter_count(&chunk->iter);
+			chunk->write = write;
+			chunk->count = 0;
+			chunk->err = 0;
+			iov_iter_advance(&pos, chunk->len);
+			chunk_off += chunk->len;
+			/* the first chunk is sent from this context */
+			if (nr) {
+				INIT_WORK(&chunk->work, p9_io_chunk_work);
+				queue_work(p9_io_wq, &chunk->work);
+			}
+			nr++;
 		}
 
-		if (non_zc) {
-			int n = copy_to_iter(dataptr, count, to);
-			total += n;
-			offset += n;
-			if (n != count) {
-				*err = -EFAULT;
-				p9_free_req(clnt, req);
+		p9_io_chunk_run(&chunks[0]);
+		for (i = 1; i < nr; i++)
+			flush_work(&chunks[i].work);
+
+		for (i = 0; i < nr; i++) {
+			round += chunks[i].count;
+			if (chunks[i].err) {
+				*err = chunks[i].err;
+				done = 1;
+				break;
+			}
+			if (!chunks[i].count) {
+				done = 1;
 				break;
 			}
-		} else {
-			iov_iter_advance(to, count);
-			total += count;
-			offset += count;
+			if (chunks[i].count < chunks[i].len)
+				break;
 		}
-		p9_free_req(clnt, req);
+		iov_iter_advance(iter, round);
+		total += round;
+		offset += round;
+		if (done)
+			break;
+	}
+	kfree(chunks);
+	return total;
+}
+
+int
+p9_client_read(struct p9_fid *fid, u64 offset, struct iov_iter *to, int *err)
+{
+	int total = 0;
+	*err = 0;
+
+	p9_debug(P9_DEBUG_9P, ">>> TREAD fid %d offset %llu %d\n",
+		   fid->fid, (unsigned long long) offset, (int)iov_iter_count(to));
+
+	if (p9_client_can_pipeline(fid, to)) {
+		total = p9_client_io_pipelined(fid, offset, to, 0, err);
+		if (total >= 0)
+			return total;
+		total = 0;
+	}
+
+	while (iov_iter_count(to)) {
+		int count = p9_client_read_once(fid, offset, to, err);
+
+		total += count;
+		offset += count;
+		if (*err || !count)
+			break;
 	}
 	return total;
 }
@@ -1618,8 +1811,6 @@ EXPORT_SYMBOL(p9_client_read);
 int
 p9_client_write(struct p9_fid *fid, u64 offset, struct iov_iter *from, int *err)
 {
-	struct p9_client *clnt = fid->clnt;
-	struct p9_req_t *req;
 	int total = 0;
 	*err = 0;
 
@@ -1627,44 +1818,18 @@ p9_client_write(struct p9_fid *fid, u64 offset, struct iov_iter *from, int *err)
 				fid->fid, (unsigned long long) offset,
 				iov_iter_count(from));
 
+	if (p9_client_can_pipeline(fid, from)) {
+		total = p9_client_io_pipelined(fid, offset, from, 1, err);
+		if (total >= 0)
+			return total;
+		total = 0;
+	}
+
 	while (iov_iter_count(from)) {
-		int count = iov_iter_count(from);
-		int rsize = fid->iounit;
-		if (!rsize || rsize > clnt->msize-P9_IOHDRSZ)
-			rsize = clnt->msize - P9_IOHDRSZ;
-
-		if (count < rsize)
-			rsize = count;
-
-		/* Don't bother zerocopy for small IO (< 1024) */
-		if (clnt->trans_mod->zc_request && rsize > 1024) {
-			req = p9_client_zc_rpc(clnt, P9_TWRITE, NULL, from, 0,
-					       rsize, P9_ZC_HDR_SZ, "dqd",
-					       fid->fid, offset, rsize);
-		} else {
-			req = p9_client_rpc(clnt, P9_TWRITE, "dqV", fid->fid,
-						    offset, rsize, from);
-		}
-		if (IS_ERR(req)) {
-			*err = PTR_ERR(req);
-			break;
-		}
+		int count = p9_client_write_once(fid, offset, from, err);
 
-		*err = p9pdu_readf(req->rc, clnt->proto_version, "d", &count);
-		if (*err) {
-			trace_9p_protocol_dump(clnt, req->rc);
-			p9_free_req(clnt, req);
+		if (*err)
 			break;
-		}
-		if (rsize < count) {
-			pr_err("bogus RWRITE count (%d > %d)\n", count, rsize);
-			count = rsize;
-		}
-
-		p9_debug(P9_DEBUG_9P, "<<< RWRITE count %d\n", count);
-
-		p9_free_req(clnt, req);
-		iov_iter_advance(from, count);
 		total += count;
 		offset += count;
 	}
@@ -1672,6 +1837,20 @@ p9_client_write(struct p9_fid *fid, u64 offset, struct iov_iter *from, int *err)
 }
 EXPORT_SYMBOL(p9_client_write);
 
+int p9_client_init(void)
+{
+	/* writeback goes through here, so the workers must make progress */
+	p9_io_wq = alloc_workqueue("p9-io", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!p9_io_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void p9_client_exit(void)
+{
+	destroy_workqueue(p9_io_wq);
+}
+
 struct p9_wstat *p9_client_stat(struct p9_fid *fid)
 {
 	int err;
@@ -174,6 +174,9 @@ static int __init init_p9(void)
 	int ret = 0;
 
 	p9_error_init();
+	ret = p9_client_init();
+	if (ret)
+		return ret;
 	pr_info("Installing 9P2000 support\n");
 	p9_trans_fd_init();
 
@@ -190,6 +193,7 @@ static void __exit exit_p9(void)
 	pr_info("Unloading 9P2000 support\n");
 
 	p9_trans_fd_exit();
+	p9_client_exit();
 }
 
 module_init(init_p9)
@@ -311,6 +311,50 @@ req_retry:
 	return 0;
 }
 
+/*
+ * Page cache I/O arrives as a bio_vec array of pages the caller already
+ * holds.  Hand the host as many of them as pack_sg_list_p() can describe
+ * in one go (only the first may start, and only the last may end, inside
+ * a page), rather than one page per request, and without pinning them or
+ * charging them against p9_max_pages.
+ */
+static int p9_get_bvec_pages(struct iov_iter *data, struct page ***pages,
+			     int count, size_t *offs)
+{
+	const struct bio_vec *bv = data->bvec;
+	unsigned long nr_segs = data->nr_segs;
+	size_t skip = data->iov_offset;
+	int len = 0, nr_pages = 0;
+
+	while (nr_segs && skip >= bv->bv_len) {
+		skip -= bv->bv_len;
+		bv++;
+		nr_segs--;
+	}
+	if (!nr_segs)
+		return 0;
+
+	*pages = kmalloc(sizeof(struct page *) *
+			 min_t(unsigned long, nr_segs,
+			       DIV_ROUND_UP(count, PAGE_SIZE) + 1), GFP_NOFS);
+	if (!*pages)
+		return -ENOMEM;
+
+	*offs = bv->bv_offset + skip;
+	for (; nr_segs && len < count; bv++, nr_segs--, skip = 0) {
+		size_t start = bv->bv_offset + skip;
+		size_t seg = min_t(size_t, bv->bv_len - skip, count - len);
+
+		if (nr_pages && start)
+			break;
+		(*pages)[nr_pages++] = bv->bv_page;
+		len += seg;
+		if (start + seg != PAGE_SIZE)
+			break;
+	}
+	return len;
+}
+
 static int p9_get_mapped_pages(struct virtio_chan *chan,
 			       struct page ***pages,
 			       struct iov_iter *data,
@@ -324,7 +368,10 @@ static int p9_get_mapped_pages(struct virtio_chan *chan,
 	if (!iov_iter_count(data))
 		return 0;
 
-	if (!(data->type & ITER_KVEC)) {
+	if (data->type & ITER_BVEC) {
+		*need_drop = 0;
+		return p9_get_bvec_pages(data, pages, count, offs);
+	} else if (!(data->type & ITER_KVEC)) {
 		int n;
 		/*
 		 * We allow only p9_max_pages pinned. We wait for the
@@ -119,6 +119,7 @@
 #include <linux/if_vlan.h>
 #include <linux/ip.h>
 #include <net/ip.h>
+#include <net/busy_poll.h>
 #include <net/mpls.h>
 #include <linux/ipv6.h>
 #include <linux/in.h>
@@ -137,6 +138,7 @@
 #include <linux/errqueue.h>
 #include <linux/hrtimer.h>
 #include <linux/netfilter_ingress.h>
+#include <linux/bpf.h>
 
 #include "net-sysfs.h"
 
@@ -2877,6 +2879,18 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 	qdisc_pkt_len_init(skb);
 	qdisc_calculate_pkt_len(skb, q);
+
+	if (q->flags & TCQ_F_NOLOCK) {
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			kfree_skb(skb);
+			rc = NET_XMIT_DROP;
+		} else {
+			rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+			qdisc_run(q);
+		}
+		return rc;
+	}
+
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
@@ -2974,6 +2988,17 @@ static inline int get_xps_queue(struct net_device *dev, struct sk_buff *skb)
 	struct xps_map *map;
 	int queue_index = -1;
 
+	/* symmetric steering: answer on the queue the flow comes in on */
+	if (dev->xps_symmetric) {
+		if (skb_rx_queue_recorded(skb))
+			queue_index = skb_get_rx_queue(skb);
+		else if (skb->sk && sk_fullsock(skb->sk))
+			queue_index = sk_rx_queue_get(skb->sk);
+		if (queue_index >= 0 && queue_index < dev->real_num_tx_queues)
+			return queue_index;
+		queue_index = -1;
+	}
+
 	rcu_read_lock();
 	dev_maps = rcu_dereference(dev->xps_maps);
 	if (dev_maps) {
@@ -3218,8 +3243,6 @@ static inline void ____napi_schedule(struct softnet_data *sd,
 /* One global table that all flow-based protocols share. */
 struct rps_sock_flow_table __rcu *rps_sock_flow_table __read_mostly;
 EXPORT_SYMBOL(rps_sock_flow_table);
-u32 rps_cpu_mask __read_mostly;
-EXPORT_SYMBOL(rps_cpu_mask);
 
 struct static_key rps_needed __read_mostly;
 
@@ -3313,14 +3336,16 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	if (flow_table && sock_flow_table) {
 		struct rps_dev_flow *rflow;
 		u32 next_cpu;
-		u32 ident;
+		u64 ident;
 
 		/* First check into global flow table if there is a match */
-		ident = sock_flow_table->ents[hash & sock_flow_table->mask];
-		if ((ident ^ hash) & ~rps_cpu_mask)
+		ident = READ_ONCE(sock_flow_table->ents[hash &
+							sock_flow_table->mask]);
+		if (RPS_SOCK_FLOW_ENT_HASH(ident) != hash ||
+		    RPS_SOCK_FLOW_ENT_GEN(ident) != READ_ONCE(sock_flow_table->gen))
 			goto try_rps;
 
-		next_cpu = ident & rps_cpu_mask;
+		next_cpu = RPS_SOCK_FLOW_ENT_CPU(ident);
 
 		/* OK, now we know there is a match,
 		 * we can look at the local (per receive queue) flow table
@@ -3642,6 +3667,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_atomic();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_atomic();
@@ -3824,10 +3856,17 @@ static inline int nf_ingress(struct sk_buff *skb, struct packet_type **pt_prev,
 	return 0;
 }
 
-static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
+/*
+ * When @ppt_prev is given the last matching packet_type is not called but
+ * handed back in it, together with the (possibly replaced) skb in @pskb, so
+ * that the list receive path can deliver runs of skbs to it in one go.
+ */
+static int __netif_receive_skb_core(struct sk_buff **pskb, bool pfmemalloc,
+				    struct packet_type **ppt_prev)
 {
 	struct packet_type *ptype, *pt_prev;
 	rx_handler_func_t *rx_handler;
+	struct sk_buff *skb = *pskb;
 	struct net_device *orig_dev;
 	bool deliver_exact = false;
 	int ret = NET_RX_DROP;
@@ -3960,8 +3999,13 @@ ncls:
 	if (pt_prev) {
 		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
 			goto drop;
-		else
+		if (ppt_prev) {
+			*ppt_prev = pt_prev;
+			*pskb = skb;
+			ret = NET_RX_SUCCESS;
+		} else {
 			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+		}
 	} else {
 drop:
 		atomic_long_inc(&skb->dev->rx_dropped);
@@ -3993,14 +4037,103 @@ static int __netif_receive_skb(struct sk_buff *skb)
 		 * context down to all allocation sites.
 		 */
 		current->flags |= PF_MEMALLOC;
-		ret = __netif_receive_skb_core(skb, true);
+		ret = __netif_receive_skb_core(&skb, true, NULL);
 		tsk_restore_flags(current, pflags, PF_MEMALLOC);
 	} else
-		ret = __netif_receive_skb_core(skb, false);
+		ret = __netif_receive_skb_core(&skb, false, NULL);
 
 	return ret;
 }
 
+static void __netif_receive_skb_list_ptype(struct sk_buff_head *head,
+					   struct packet_type *pt_prev,
+					   struct net_device *orig_dev)
+{
+	struct sk_buff *skb;
+
+	if (!pt_prev || skb_queue_empty(head))
+		return;
+
+	if (pt_prev->list_func) {
+		pt_prev->list_func(head, pt_prev, orig_dev);
+		return;
+	}
+	while ((skb = __skb_dequeue(head)) != NULL)
+		pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+}
+
+/*
+ * Run the whole list through the taps, ingress and rx_handlers first and
+ * only then hand consecutive skbs that ended up at the same packet_type to
+ * it as one sublist.
+ */
+static void __netif_receive_skb_list_core(struct sk_buff_head *head,
+					  bool pfmemalloc)
+{
+	struct packet_type *pt_curr = NULL;
+	struct net_device *od_curr = NULL;
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+
+	while ((skb = __skb_dequeue(head)) != NULL) {
+		struct net_device *orig_dev = skb->dev;
+		struct packet_type *pt_prev = NULL;
+
+		__netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+		if (!pt_prev)
+			continue;
+		if (pt_curr != pt_prev || od_curr != orig_dev) {
+			__netif_receive_skb_list_ptype(&sublist, pt_curr,
+						       od_curr);
+			pt_curr = pt_prev;
+			od_curr = orig_dev;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+
+	__netif_receive_skb_list_ptype(&sublist, pt_curr, od_curr);
+}
+
+static void __netif_receive_skb_sublist(struct sk_buff_head *head,
+					bool pfmemalloc)
+{
+	unsigned long pflags = current->flags;
+
+	if (skb_queue_empty(head))
+		return;
+
+	/* See __netif_receive_skb() */
+	if (pfmemalloc)
+		current->flags |= PF_MEMALLOC;
+	__netif_receive_skb_list_core(head, pfmemalloc);
+	if (pfmemalloc)
+		tsk_restore_flags(current, pflags, PF_MEMALLOC);
+}
+
+static void __netif_receive_skb_list(struct sk_buff_head *head)
+{
+	struct sk_buff_head sublist;
+	bool pfmemalloc = false;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+
+	/* PFMEMALLOC skbs are rare, split them out in runs of their own */
+	while ((skb = __skb_dequeue(head)) != NULL) {
+		bool pfm = sk_memalloc_socks() && skb_pfmemalloc(skb);
+
+		if (pfm != pfmemalloc) {
+			__netif_receive_skb_sublist(&sublist, pfmemalloc);
+			pfmemalloc = pfm;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+
+	__netif_receive_skb_sublist(&sublist, pfmemalloc);
+}
+
 static int netif_receive_skb_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -4029,6 +4162,40 @@ static int netif_receive_skb_internal(struct sk_buff *skb)
 	return ret;
 }
 
+static void netif_receive_skb_list_internal(struct sk_buff_head *head)
+{
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+
+	while ((skb = __skb_dequeue(head)) != NULL) {
+		net_timestamp_check(netdev_tstamp_prequeue, skb);
+		if (skb_defer_rx_timestamp(skb))
+			continue;
+		__skb_queue_tail(&sublist, skb);
+	}
+
+	rcu_read_lock();
+#ifdef CONFIG_RPS
+	if (static_key_false(&rps_needed)) {
+		struct sk_buff *tmp;
+
+		skb_queue_walk_safe(&sublist, skb, tmp) {
+			struct rps_dev_flow voidflow, *rflow = &voidflow;
+			int cpu = get_rps_cpu(skb->dev, skb, &rflow);
+
+			if (cpu >= 0) {
+				__skb_unlink(skb, &sublist);
+				enqueue_to_backlog(skb, cpu, &rflow->last_qtail);
+			}
+		}
+	}
+#endif
+	__netif_receive_skb_list(&sublist);
+	rcu_read_unlock();
+}
+
 /**
  *	netif_receive_skb - process receive buffer from network
  *	@skb: buffer to process
@@ -4052,6 +4219,31 @@ int netif_receive_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(netif_receive_skb);
 
+/**
+ *	netif_receive_skb_list - process many receive buffers from network
+ *	@head: list of skbs to process, empty on return
+ *
+ *	Does the same as netif_receive_skb() for each skb on the list, but
+ *	runs each stage of the receive path over the whole list before moving
+ *	on to the next. Runs of skbs for the same protocol handler are passed
+ *	to its list_func when it has one.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ */
+void netif_receive_skb_list(struct sk_buff_head *head)
+{
+	struct sk_buff *skb;
+
+	if (skb_queue_empty(head))
+		return;
+
+	skb_queue_walk(head, skb)
+		trace_netif_receive_skb_entry(skb);
+	netif_receive_skb_list_internal(head);
+}
+EXPORT_SYMBOL(netif_receive_skb_list);
+
 /* Network device is going away, flush any packets still pending
  * Called with irqs disabled.
  */
@@ -4080,7 +4272,10 @@ static void flush_backlog(void *arg)
 	}
 }
 
-static int napi_gro_complete(struct sk_buff *skb)
+/*
+ * Returns false if the skb was consumed, true if it is ready to be passed up.
+ */
+static bool napi_gro_finish(struct sk_buff *skb)
 {
 	struct packet_offload *ptype;
 	__be16 type = skb->protocol;
@@ -4091,7 +4286,7 @@ static int napi_gro_complete(struct sk_buff *skb)
 
 	if (NAPI_GRO_CB(skb)->count == 1) {
 		skb_shinfo(skb)->gso_size = 0;
-		goto out;
+		return true;
 	}
 
 	rcu_read_lock();
@@ -4107,20 +4302,29 @@ static int napi_gro_complete(struct sk_buff *skb)
 	if (err) {
 		WARN_ON(&ptype->list == head);
 		kfree_skb(skb);
-		return NET_RX_SUCCESS;
+		return false;
 	}
 
-out:
+	return true;
+}
+
+static int napi_gro_complete(struct sk_buff *skb)
+{
+	if (!napi_gro_finish(skb))
+		return NET_RX_SUCCESS;
+
 	return netif_receive_skb_internal(skb);
 }
 
 /* napi->gro_list contains packets ordered by age.
  * youngest packets at the head of it.
  * Complete skbs in reverse order to reduce latencies.
+ * The completed skbs are passed up together with netif_receive_skb_list().
  */
 void napi_gro_flush(struct napi_struct *napi, bool flush_old)
 {
 	struct sk_buff *skb, *prev = NULL;
+	struct sk_buff_head done;
 
 	/* scan list and build reverse chain */
 	for (skb = napi->gro_list; skb != NULL; skb = skb->next) {
@@ -4128,18 +4332,23 @@ void napi_gro_flush(struct napi_struct *napi, bool flush_old)
 		prev = skb;
 	}
 
+	__skb_queue_head_init(&done);
+
 	for (skb = prev; skb; skb = prev) {
 		skb->next = NULL;
 
 		if (flush_old && NAPI_GRO_CB(skb)->age == jiffies)
-			return;
+			goto out;
 
 		prev = skb->prev;
-		napi_gro_complete(skb);
+		if (napi_gro_finish(skb))
+			__skb_queue_tail(&done, skb);
 		napi->gro_count--;
 	}
 
 	napi->gro_list = NULL;
+out:
+	netif_receive_skb_list_internal(&done);
 }
 EXPORT_SYMBOL(napi_gro_flush);
 
@@ -4240,6 +4449,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
 		NAPI_GRO_CB(skb)->udp_mark = 0;
+		NAPI_GRO_CB(skb)->is_udp_l4 = 0;
 		NAPI_GRO_CB(skb)->gro_remcsum_start = 0;
 
 		/* Setup for GRO checksum validation */
@@ -4363,7 +4573,7 @@ static gro_result_t napi_skb_finish(gro_result_t ret, struct sk_buff *skb)
 			skb_dst_drop(skb);
 			kmem_cache_free(skbuff_head_cache, skb);
 		} else {
-			__kfree_skb(skb);
+			__kfree_skb_defer(skb);
 		}
 		break;
 
@@ -4650,8 +4860,14 @@ void __napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(__napi_complete);
 
-void napi_complete_done(struct napi_struct *n, int work_done)
+/*
+ * Returns false if the context stays scheduled, in which case the driver
+ * must not re-enable its interrupt: a busy poller owns it and will call
+ * ->poll() once more when it is done.
+ */
+bool napi_complete_done(struct napi_struct *n, int work_done)
 {
+	bool busy_poll = test_bit(NAPI_STATE_IN_BUSY_POLL, &n->state);
 	unsigned long flags;
 
 	/*
@@ -4659,12 +4875,12 @@ void napi_complete_done(struct napi_struct *n, int work_done)
 	 * just in case its running on a different cpu
 	 */
 	if (unlikely(test_bit(NAPI_STATE_NPSVC, &n->state)))
-		return;
+		return false;
 
 	if (n->gro_list) {
 		unsigned long timeout = 0;
 
-		if (work_done)
+		if (work_done && !busy_poll)
 			timeout = n->dev->gro_flush_timeout;
 
 		if (timeout)
@@ -4673,6 +4889,9 @@ void napi_complete_done(struct napi_struct *n, int work_done)
 		else
 			napi_gro_flush(n, false);
 	}
+	if (busy_poll)
+		return false;
+
 	if (likely(list_empty(&n->poll_list))) {
 		WARN_ON_ONCE(!test_and_clear_bit(NAPI_STATE_SCHED, &n->state));
 	} else {
@@ -4681,6 +4900,7 @@ void napi_complete_done(struct napi_struct *n, int work_done)
 		__napi_complete(n);
 		local_irq_restore(flags);
 	}
+	return true;
 }
 EXPORT_SYMBOL(napi_complete_done);
 
@@ -4698,6 +4918,120 @@ struct napi_struct *napi_by_id(unsigned int napi_id)
 }
 EXPORT_SYMBOL_GPL(napi_by_id);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+#define BUSY_POLL_BUDGET 8
+
+/*
+ * Poll a context whose driver has no ndo_busy_poll by taking it over the
+ * way its interrupt would, setting NAPI_STATE_SCHED. If the interrupt or
+ * another poller already has it, leave it to them. While we own it,
+ * napi_complete_done() leaves it scheduled, so no per-queue lock is
+ * needed against the regular NAPI poll.
+ */
+static int napi_busy_loop_own(struct napi_struct *napi,
+			      unsigned long end_time, unsigned int budget,
+			      bool (*loop_end)(void *), void *loop_end_arg)
+{
+	unsigned long val = READ_ONCE(napi->state);
+	void *have_poll_lock;
+	int rc, work = 0;
+
+	if (val & (BIT(NAPI_STATE_SCHED) | BIT(NAPI_STATE_DISABLE) |
+		   BIT(NAPI_STATE_IN_BUSY_POLL)))
+		return 0;
+	if (cmpxchg(&napi->state, val, val | BIT(NAPI_STATE_SCHED) |
+					BIT(NAPI_STATE_IN_BUSY_POLL)) != val)
+		return 0;
+
+	have_poll_lock = netpoll_poll_lock(napi);
+
+	do {
+		rc = napi->poll(napi, BUSY_POLL_BUDGET);
+		if (rc > 0) {
+			work += rc;
+			/* local bh are disabled so it is ok to use _BH */
+			NET_ADD_STATS_BH(dev_net(napi->dev),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+		}
+		cpu_relax();
+	} while (loop_end && !loop_end(loop_end_arg) &&
+		 (!budget || work < budget) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+
+	/* One more poll hands the context back: the driver completes it
+	 * and re-enables its interrupt, or we reschedule it.
+	 */
+	clear_bit(NAPI_STATE_IN_BUSY_POLL, &napi->state);
+	rc = napi->poll(napi, BUSY_POLL_BUDGET);
+	netpoll_poll_unlock(have_poll_lock);
+	if (rc == BUSY_POLL_BUDGET)
+		__napi_schedule(napi);
+
+	return work;
+}
+
+/**
+ *	napi_busy_loop - busy poll a NAPI context
+ *	@napi_id: context to poll
+ *	@end_time: busy_loop_us_clock() value to stop at, 0 for a single pass
+ *	@budget: stop after this many packets, 0 for no limit
+ *	@loop_end: stop once this returns true, may be NULL
+ *	@loop_end_arg: argument to @loop_end
+ *
+ * Used by sockets waiting for data and by event loops waiting on many
+ * sockets received through the same context. Returns the number of
+ * packets processed.
+ */
+int napi_busy_loop(unsigned int napi_id, unsigned long end_time,
+		   unsigned int budget, bool (*loop_end)(void *),
+		   void *loop_end_arg)
+{
+	const struct net_device_ops *ops;
+	struct napi_struct *napi;
+	int rc, work = 0;
+
+	/*
+	 * rcu read lock for napi hash
+	 * bh so we don't race with net_rx_action
+	 */
+	rcu_read_lock_bh();
+
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ops = napi->dev->netdev_ops;
+	if (!ops->ndo_busy_poll) {
+		work = napi_busy_loop_own(napi, end_time, budget,
+					  loop_end, loop_end_arg);
+		goto out;
+	}
+
+	do {
+		rc = ops->ndo_busy_poll(napi);
+
+		if (rc == LL_FLUSH_FAILED)
+			break; /* permanent failure */
+
+		if (rc > 0) {
+			work += rc;
+			/* local bh are disabled so it is ok to use _BH */
+			NET_ADD_STATS_BH(dev_net(napi->dev),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+		}
+		cpu_relax();
+
+	} while (loop_end && !loop_end(loop_end_arg) &&
+		 (!budget || work < budget) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+
+out:
+	rcu_read_unlock_bh();
+	return work;
+}
+EXPORT_SYMBOL(napi_busy_loop);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void napi_hash_add(struct napi_struct *napi)
 {
 	if (!test_and_set_bit(NAPI_STATE_HASHED, &napi->state)) {
@@ -6077,6 +6411,33 @@ int dev_set_mtu(struct net_device *dev, int new_mtu)
 }
 EXPORT_SYMBOL(dev_set_mtu);
 
+/**
+ *	dev_change_tx_queue_len - Change TX queue length of a netdevice
+ *	@dev: device
+ *	@new_len: new tx queue length
+ *
+ *	Also resizes the default qdiscs sized from it. Called under rtnl.
+ */
+int dev_change_tx_queue_len(struct net_device *dev, unsigned long new_len)
+{
+	unsigned int orig_len = dev->tx_queue_len;
+	int err;
+
+	if (new_len != (unsigned int)new_len)
+		return -ERANGE;
+	if (new_len == orig_len)
+		return 0;
+
+	dev->tx_queue_len = new_len;
+	err = dev_qdisc_change_tx_queue_len(dev);
+	if (err) {
+		/* qdiscs resized before the failure just keep the room */
+		dev->tx_queue_len = orig_len;
+		return err;
+	}
+	return 0;
+}
+
 /**
  *	dev_set_group - Change group this device belongs to
  *	@dev: device
@@ -6191,6 +6552,42 @@ int dev_change_proto_down(struct net_device *dev, bool proto_down)
 }
 EXPORT_SYMBOL(dev_change_proto_down);
 
+/**
+ *	dev_change_xdp_fd - set or clear a bpf program for a device rx path
+ *	@dev: device
+ *	@fd: new program fd or negative value to clear
+ *
+ *	Set or clear a bpf program for a device
+ */
+int dev_change_xdp_fd(struct net_device *dev, int fd)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct bpf_prog *prog = NULL;
+	struct netdev_xdp xdp = {};
+	int err;
+
+	if (!ops->ndo_xdp)
+		return -EOPNOTSUPP;
+	if (fd >= 0) {
+		prog = bpf_prog_get(fd);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+		if (prog->type != BPF_PROG_TYPE_XDP) {
+			bpf_prog_put(prog);
+			return -EINVAL;
+		}
+	}
+
+	xdp.command = XDP_SETUP_PROG;
+	xdp.prog = prog;
+	err = ops->ndo_xdp(dev, &xdp);
+	if (err < 0 && prog)
+		bpf_prog_put(prog);
+
+	return err;
+}
+EXPORT_SYMBOL(dev_change_xdp_fd);
+
 /**
  *	dev_new_index	-	allocate an ifindex
  *	@net: the applicable net namespace
@@ -6421,6 +6818,12 @@ static netdev_features_t netdev_fix_features(struct net_device *dev,
 #endif
 		features &= ~NETIF_F_BUSY_POLL;
 
+	/* UDP GRO for forwarding is part of GRO. */
+	if ((features & NETIF_F_GRO_UDP_FWD) && !(features & NETIF_F_GRO)) {
+		netdev_dbg(dev, "Dropping NETIF_F_GRO_UDP_FWD since no GRO feature.\n");
+		features &= ~NETIF_F_GRO_UDP_FWD;
+	}
+
 	return features;
 }
 
@@ -6680,7 +7083,7 @@ int register_netdevice(struct net_device *dev)
 	/* Transfer changeable features to wanted_features and enable
 	 * software offloads (GSO and GRO).
 	 */
-	dev->hw_features |= NETIF_F_SOFT_FEATURES;
+	dev->hw_features |= NETIF_F_SOFT_FEATURES | NETIF_F_SOFT_FEATURES_OFF;
 	dev->features |= NETIF_F_SOFT_FEATURES;
 	dev->wanted_features = dev->features & dev->hw_features;
 
@@ -13,6 +13,7 @@
 #include <linux/slab.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/jhash.h>
 #include <net/net_namespace.h>
 #include <net/sock.h>
 #include <net/fib_rules.h>
@@ -147,10 +148,14 @@ fib_rules_register(const struct fib_rules_ops *tmpl, struct net *net)
 }
 EXPORT_SYMBOL_GPL(fib_rules_register);
 
+static void fib_rules_index_replace(struct fib_rules_ops *ops,
+				    struct fib_rules_index *idx);
+
 static void fib_rules_cleanup_ops(struct fib_rules_ops *ops)
 {
 	struct fib_rule *rule, *tmp;
 
+	fib_rules_index_replace(ops, NULL);
 	list_for_each_entry_safe(rule, tmp, &ops->rules_list, list) {
 		list_del_rcu(&rule->list);
 		if (ops->delete)
@@ -194,15 +199,41 @@ out:
 	return (rule->flags & FIB_RULE_INVERT) ? !ret : ret;
 }
 
-int fib_rules_lookup(struct fib_rules_ops *ops, struct flowi *fl,
-		     int flags, struct fib_lookup_arg *arg)
+/* Returns -EAGAIN if the lookup is to go on with the next rule */
+static int fib_rule_apply(struct fib_rules_ops *ops, struct fib_rule *rule,
+			  struct flowi *fl, int flags,
+			  struct fib_lookup_arg *arg)
 {
-	struct fib_rule *rule;
 	int err;
 
-	rcu_read_lock();
+	err = ops->action(rule, fl, flags, arg);
 
-	list_for_each_entry_rcu(rule, &ops->rules_list, list) {
+	if (!err && ops->suppress && ops->suppress(rule, arg))
+		return -EAGAIN;
+
+	if (err != -EAGAIN) {
+		if ((arg->flags & FIB_LOOKUP_NOREF) ||
+		    likely(atomic_inc_not_zero(&rule->refcnt))) {
+			arg->rule = rule;
+			return err;
+		}
+		return -ESRCH;
+	}
+	return -EAGAIN;
+}
+
+/* Walks the list from its head, or from @rule if given */
+static int fib_rules_walk(struct fib_rules_ops *ops, struct fib_rule *rule,
+			  struct flowi *fl, int flags,
+			  struct fib_lookup_arg *arg)
+{
+	int err;
+
+	if (rule)
+		goto jumped;
+
+	rule = list_entry(&ops->rules_list, struct fib_rule, list);
+	list_for_each_entry_continue_rcu(rule, &ops->rules_list, list) {
 jumped:
 		if (!fib_rule_match(rule, ops, fl, flags))
 			continue;
@@ -219,24 +250,341 @@ jumped:
 			}
 		} else if (rule->action == FR_ACT_NOP)
 			continue;
-		else
-			err = ops->action(rule, fl, flags, arg);
 
-		if (!err && ops->suppress && ops->suppress(rule, arg))
+		err = fib_rule_apply(ops, rule, fl, flags, arg);
+		if (err != -EAGAIN)
+			return err;
+	}
+
+	return -ESRCH;
+}
+
+/*
+ * Rule index
+ *
+ * With many rules, most of them selecting on the input interface or the
+ * source prefix, walking the whole list for each lookup is what routing
+ * costs. The index files every rule under the (iif, source prefix) it
+ * requires, those asking for neither, or matching inverted, under a list
+ * of rules to always try. A lookup gathers the lists its flow can match,
+ * one per prefix length in use, and tries their rules in list order; the
+ * full match still decides, the index only skips rules that cannot match.
+ *
+ * The index is a snapshot of the list, replaced under RTNL whenever the
+ * rules change, and only kept for lists long enough to be worth it.
+ */
+#define FIB_RULES_INDEX_MIN	32
+#define FIB_RULES_INDEX_LISTS	16
+#define FIB_RULES_ADDR_MAX	16
+
+#define FIB_RULES_NONE		U32_MAX
+#define FIB_RULES_ALWAYS	(U32_MAX - 1)
+
+struct fib_rules_key {
+	int			iif;
+	int			plen;
+	u8			addr[FIB_RULES_ADDR_MAX];
+};
+
+struct fib_rules_index_node {
+	struct fib_rules_key	key;
+	u32			next;	/* in the hash chain */
+	u32			first;	/* rule positions, in pos[] */
+	u32			count;
+};
+
+struct fib_rules_index {
+	unsigned int		nrules;
+	struct fib_rule		**rules;	/* in list order */
+	u32			*pos;		/* always list, then per node */
+	unsigned int		nalways;
+	struct fib_rules_index_node *nodes;
+	u32			*buckets;
+	u32			hash_mask;
+	DECLARE_BITMAP(plens, FIB_RULES_ADDR_MAX * 8 + 1);
+	struct rcu_head		rcu;
+};
+
+static void fib_rules_key_init(struct fib_rules_key *key, int iif,
+			       const u8 *addr, int plen)
+{
+	memset(key, 0, sizeof(*key));
+	key->iif = iif;
+	key->plen = plen;
+	memcpy(key->addr, addr, plen / 8);
+	if (plen % 8)
+		key->addr[plen / 8] = addr[plen / 8] & (0xff << (8 - plen % 8));
+}
+
+/* Returns < 0 if @rule cannot match, 0 if it has to be always tried */
+static int fib_rules_rule_key(struct fib_rules_ops *ops,
+			      struct fib_rule *rule, struct fib_rules_key *key)
+{
+	const void *addr = NULL;
+	int plen = 0;
+
+	if (rule->flags & FIB_RULE_INVERT)
+		return 0;
+
+	/* the interface is not there (yet) */
+	if (rule->iifindex == -1)
+		return -1;
+
+	if (ops->rule_src)
+		addr = ops->rule_src(rule, &plen);
+	if (!rule->iifindex && !plen)
+		return 0;
+
+	fib_rules_key_init(key, rule->iifindex, addr, plen);
+	return 1;
+}
+
+static struct fib_rules_index_node *
+fib_rules_index_find(const struct fib_rules_index *idx,
+		     const struct fib_rules_key *key, u32 hash)
+{
+	u32 i;
+
+	for (i = idx->buckets[hash & idx->hash_mask]; i != FIB_RULES_NONE;
+	     i = idx->nodes[i].next)
+		if (!memcmp(&idx->nodes[i].key, key, sizeof(*key)))
+			return &idx->nodes[i];
+	return NULL;
+}
+
+static void fib_rules_index_free(struct fib_rules_index *idx)
+{
+	kfree(idx->buckets);
+	kfree(idx->nodes);
+	kfree(idx->pos);
+	kfree(idx->rules);
+	kfree(idx);
+}
+
+static void fib_rules_index_free_rcu(struct rcu_head *head)
+{
+	fib_rules_index_free(container_of(head, struct fib_rules_index, rcu));
+}
+
+static struct fib_rules_index *fib_rules_index_alloc(unsigned int nrules)
+{
+	unsigned int nbuckets = roundup_pow_of_two(nrules);
+	struct fib_rules_index *idx;
+
+	idx = kzalloc(sizeof(*idx), GFP_KERNEL);
+	if (!idx)
+		return NULL;
+
+	idx->rules = kcalloc(nrules, sizeof(*idx->rules), GFP_KERNEL);
+	idx->pos = kcalloc(nrules, sizeof(*idx->pos), GFP_KERNEL);
+	idx->nodes = kcalloc(nrules, sizeof(*idx->nodes), GFP_KERNEL);
+	idx->buckets = kmalloc_array(nbuckets, sizeof(*idx->buckets),
+				     GFP_KERNEL);
+	if (!idx->rules || !idx->pos || !idx->nodes || !idx->buckets) {
+		fib_rules_index_free(idx);
+		return NULL;
+	}
+
+	memset(idx->buckets, 0xff, nbuckets * sizeof(*idx->buckets));
+	idx->hash_mask = nbuckets - 1;
+	return idx;
+}
+
+static struct fib_rules_index *fib_rules_index_build(struct fib_rules_ops *ops,
+						     unsigned int nrules)
+{
+	struct fib_rules_index_node *node;
+	struct fib_rules_index *idx;
+	struct fib_rules_key key;
+	struct fib_rule *rule;
+	unsigned int i, nnodes = 0, nalways = 0, off;
+	u32 *node_of;
+
+	idx = fib_rules_index_alloc(nrules);
+	if (!idx)
+		return NULL;
+
+	node_of = kcalloc(nrules, sizeof(*node_of), GFP_KERNEL);
+	if (!node_of) {
+		fib_rules_index_free(idx);
+		return NULL;
+	}
+
+	i = 0;
+	list_for_each_entry(rule, &ops->rules_list, list) {
+		int kind = fib_rules_rule_key(ops, rule, &key);
+		u32 hash;
+
+		idx->rules[i] = rule;
+		if (kind <= 0) {
+			node_of[i++] = kind ? FIB_RULES_NONE : FIB_RULES_ALWAYS;
+			nalways += !kind;
+			continue;
+		}
+
+		hash = jhash(&key, sizeof(key), 0);
+		node = fib_rules_index_find(idx, &key, hash);
+		if (!node) {
+			node = &idx->nodes[nnodes];
+			node->key = key;
+			node->next = idx->buckets[hash & idx->hash_mask];
+			idx->buckets[hash & idx->hash_mask] = nnodes++;
+			__set_bit(key.plen, idx->plens);
+		}
+		node->count++;
+		node_of[i++] = node - idx->nodes;
+	}
+	idx->nrules = nrules;
+	idx->nalways = nalways;
+
+	/* lay the lists out behind the always one, in list order */
+	off = nalways;
+	for (i = 0; i < nnodes; i++) {
+		idx->nodes[i].first = off;
+		off += idx->nodes[i].count;
+		idx->nodes[i].count = 0;
+	}
+
+	nalways = 0;
+	for (i = 0; i < nrules; i++) {
+		if (node_of[i] == FIB_RULES_NONE)
 			continue;
+		if (node_of[i] == FIB_RULES_ALWAYS) {
+			idx->pos[nalways++] = i;
+			continue;
+		}
+		node = &idx->nodes[node_of[i]];
+		idx->pos[node->first + node->count++] = i;
+	}
 
-		if (err != -EAGAIN) {
-			if ((arg->flags & FIB_LOOKUP_NOREF) ||
-			    likely(atomic_inc_not_zero(&rule->refcnt))) {
-				arg->rule = rule;
-				goto out;
-			}
+	kfree(node_of);
+	return idx;
+}
+
+/*
+ * Writers are serialized by RTNL, but for the final cleanup, when there
+ * are none left.
+ */
+static void fib_rules_index_replace(struct fib_rules_ops *ops,
+				    struct fib_rules_index *idx)
+{
+	struct fib_rules_index *old;
+
+	old = rcu_dereference_protected(ops->index, 1);
+	rcu_assign_pointer(ops->index, idx);
+	if (old)
+		call_rcu(&old->rcu, fib_rules_index_free_rcu);
+}
+
+/* Must follow every change to the rules, before a deleted one is put */
+static void fib_rules_index_update(struct fib_rules_ops *ops)
+{
+	struct fib_rules_index *idx = NULL;
+	struct fib_rule *rule;
+	unsigned int nrules = 0;
+
+	ASSERT_RTNL();
+
+	list_for_each_entry(rule, &ops->rules_list, list)
+		nrules++;
+
+	/* without an index, lookups just walk the list */
+	if (nrules >= FIB_RULES_INDEX_MIN)
+		idx = fib_rules_index_build(ops, nrules);
+
+	fib_rules_index_replace(ops, idx);
+}
+
+static int fib_rules_index_lookup(struct fib_rules_ops *ops,
+				  const struct fib_rules_index *idx,
+				  struct flowi *fl, int flags,
+				  struct fib_lookup_arg *arg)
+{
+	struct {
+		const u32 *pos, *end;
+	} lists[FIB_RULES_INDEX_LISTS];
+	const struct fib_rules_index_node *node;
+	struct fib_rules_key key;
+	unsigned int nlists = 0, plen, i;
+	const void *src = NULL;
+	int iif, err;
+
+	if (idx->nalways) {
+		lists[0].pos = idx->pos;
+		lists[0].end = idx->pos + idx->nalways;
+		nlists++;
+	}
+
+	if (ops->flow_src)
+		src = ops->flow_src(fl, flags);
+
+	for_each_set_bit(plen, idx->plens, FIB_RULES_ADDR_MAX * 8 + 1) {
+		/* source prefixes can't match without a source */
+		if (plen && !src)
 			break;
+
+		for (iif = fl->flowi_iif; ; iif = 0) {
+			fib_rules_key_init(&key, iif, src, plen);
+			node = fib_rules_index_find(idx, &key,
+						    jhash(&key, sizeof(key), 0));
+			if (node) {
+				if (nlists == ARRAY_SIZE(lists))
+					return fib_rules_walk(ops, NULL, fl,
+							      flags, arg);
+				lists[nlists].pos = idx->pos + node->first;
+				lists[nlists].end = lists[nlists].pos +
+						    node->count;
+				nlists++;
+			}
+			if (!iif)
+				break;
 		}
 	}
 
-	err = -ESRCH;
-out:
+	for (;;) {
+		struct fib_rule *rule, *target;
+		unsigned int best = nlists;
+
+		for (i = 0; i < nlists; i++)
+			if (lists[i].pos < lists[i].end &&
+			    (best == nlists || *lists[i].pos < *lists[best].pos))
+				best = i;
+		if (best == nlists)
+			return -ESRCH;
+
+		rule = idx->rules[*lists[best].pos++];
+		if (!fib_rule_match(rule, ops, fl, flags))
+			continue;
+
+		if (rule->action == FR_ACT_GOTO) {
+			target = rcu_dereference(rule->ctarget);
+			if (target == NULL)
+				continue;
+			/* carry on from the target down the list */
+			return fib_rules_walk(ops, target, fl, flags, arg);
+		} else if (rule->action == FR_ACT_NOP)
+			continue;
+
+		err = fib_rule_apply(ops, rule, fl, flags, arg);
+		if (err != -EAGAIN)
+			return err;
+	}
+}
+
+int fib_rules_lookup(struct fib_rules_ops *ops, struct flowi *fl,
+		     int flags, struct fib_lookup_arg *arg)
+{
+	struct fib_rules_index *idx;
+	int err;
+
+	rcu_read_lock();
+
+	idx = rcu_dereference(ops->index);
+	if (idx)
+		err = fib_rules_index_lookup(ops, idx, fl, flags, arg);
+	else
+		err = fib_rules_walk(ops, NULL, fl, flags, arg);
+
 	rcu_read_unlock();
 
 	return err;
@@ -413,6 +761,7 @@ static int fib_nl_newrule(struct sk_buff *skb, struct nlmsghdr* nlh)
 	if (rule->tun_id)
 		ip_tunnel_need_metadata();
 
+	fib_rules_index_update(ops);
 	notify_rule_change(RTM_NEWRULE, rule, ops, nlh, NETLINK_CB(skb).portid);
 	flush_route_cache(ops);
 	rules_ops_put(ops);
@@ -523,6 +872,7 @@ static int fib_nl_delrule(struct sk_buff *skb, struct nlmsghdr* nlh)
 			}
 		}
 
+		fib_rules_index_update(ops);
 		notify_rule_change(RTM_DELRULE, rule, ops, nlh,
 				   NETLINK_CB(skb).portid);
 		fib_rule_put(rule);
@@ -755,20 +1105,25 @@ static int fib_rules_event(struct notifier_block *this, unsigned long event,
 
 	switch (event) {
 	case NETDEV_REGISTER:
-		list_for_each_entry(ops, &net->rules_ops, list)
+		list_for_each_entry(ops, &net->rules_ops, list) {
 			attach_rules(&ops->rules_list, dev);
+			fib_rules_index_update(ops);
+		}
 		break;
 
 	case NETDEV_CHANGENAME:
 		list_for_each_entry(ops, &net->rules_ops, list) {
 			detach_rules(&ops->rules_list, dev);
 			attach_rules(&ops->rules_list, dev);
+			fib_rules_index_update(ops);
 		}
 		break;
 
 	case NETDEV_UNREGISTER:
-		list_for_each_entry(ops, &net->rules_ops, list)
+		list_for_each_entry(ops, &net->rules_ops, list) {
 			detach_rules(&ops->rules_list, dev);
+			fib_rules_index_update(ops);
+		}
 		break;
 	}
 
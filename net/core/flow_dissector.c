@@ -19,25 +19,12 @@
 #include <net/flow_dissector.h>
 #include <scsi/fc/fc_fcoe.h>
 
-static bool dissector_uses_key(const struct flow_dissector *flow_dissector,
-			       enum flow_dissector_key_id key_id)
-{
-	return flow_dissector->used_keys & (1 << key_id);
-}
-
 static void dissector_set_key(struct flow_dissector *flow_dissector,
 			      enum flow_dissector_key_id key_id)
 {
 	flow_dissector->used_keys |= (1 << key_id);
 }
 
-static void *skb_flow_dissector_target(struct flow_dissector *flow_dissector,
-				       enum flow_dissector_key_id key_id,
-				       void *target_container)
-{
-	return ((char *) target_container) + flow_dissector->offset[key_id];
-}
-
 void skb_flow_dissector_init(struct flow_dissector *flow_dissector,
 			     const struct flow_dissector_key *key,
 			     unsigned int key_count)
@@ -102,6 +89,130 @@ __be32 __skb_flow_get_ports(const struct sk_buff *skb, int thoff, u8 ip_proto,
 }
 EXPORT_SYMBOL(__skb_flow_get_ports);
 
+/*
+ * The header walk does not depend on the keys, except that IPv4 fragments
+ * are only looked at when the addresses are wanted. So a walk done on behalf
+ * of one dissector can be reused by all that want both address families.
+ */
+static bool dissector_can_cache(const struct flow_dissector *flow_dissector)
+{
+	return dissector_uses_key(flow_dissector,
+				  FLOW_DISSECTOR_KEY_IPV4_ADDRS) &&
+	       dissector_uses_key(flow_dissector,
+				  FLOW_DISSECTOR_KEY_IPV6_ADDRS);
+}
+
+/*
+ * Fill in the keys from the walk cached in the skb. Addresses, labels and
+ * ports are read from the packet again, so rewriting them (NAT) is fine;
+ * the offsets are checked against the headers where that is cheap.
+ */
+static bool __skb_flow_dissect_cached(const struct sk_buff *skb,
+				      struct flow_dissector *flow_dissector,
+				      void *target_container,
+				      struct flow_dissector_key_control *key_control,
+				      struct flow_dissector_key_basic *key_basic,
+				      unsigned int flags)
+{
+	const struct flow_dissector_cache *fc = &skb->flow_cache;
+	struct flow_dissector_key_addrs *key_addrs;
+	struct flow_dissector_key_ports *key_ports;
+	struct flow_dissector_key_tags *key_tags;
+	int nhoff = skb_network_offset(skb);
+	int hlen = skb_headlen(skb);
+	void *data = skb->data;
+	int thoff;
+
+	if (!fc->valid || fc->nhoff != skb->network_header ||
+	    fc->proto != skb->protocol || fc->flags != flags)
+		return false;
+
+	thoff = fc->thoff - skb_headroom(skb);
+
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+
+		iph = __skb_header_pointer(skb, nhoff, sizeof(_iph), data, hlen, &_iph);
+		if (!iph || iph->protocol != fc->ip_proto ||
+		    nhoff + iph->ihl * 4 != thoff ||
+		    ip_is_fragment(iph) != !!(fc->frag & FLOW_DIS_IS_FRAGMENT))
+			return false;
+
+		key_addrs = skb_flow_dissector_target(flow_dissector,
+			      FLOW_DISSECTOR_KEY_IPV4_ADDRS, target_container);
+		memcpy(&key_addrs->v4addrs, &iph->saddr,
+		       sizeof(key_addrs->v4addrs));
+		key_control->addr_type = FLOW_DISSECTOR_KEY_IPV4_ADDRS;
+	} else {
+		const struct ipv6hdr *iph;
+		struct ipv6hdr _iph;
+
+		iph = __skb_header_pointer(skb, nhoff, sizeof(_iph), data, hlen, &_iph);
+		if (!iph || (thoff == nhoff + sizeof(*iph) &&
+			     iph->nexthdr != fc->ip_proto))
+			return false;
+
+		key_addrs = skb_flow_dissector_target(flow_dissector,
+			      FLOW_DISSECTOR_KEY_IPV6_ADDRS, target_container);
+		memcpy(&key_addrs->v6addrs, &iph->saddr,
+		       sizeof(key_addrs->v6addrs));
+		key_control->addr_type = FLOW_DISSECTOR_KEY_IPV6_ADDRS;
+
+		if (dissector_uses_key(flow_dissector,
+				       FLOW_DISSECTOR_KEY_FLOW_LABEL) &&
+		    ip6_flowlabel(iph)) {
+			key_tags = skb_flow_dissector_target(flow_dissector,
+							     FLOW_DISSECTOR_KEY_FLOW_LABEL,
+							     target_container);
+			key_tags->flow_label = ntohl(ip6_flowlabel(iph));
+		}
+	}
+
+	key_control->flags |= fc->frag;
+
+	if (fc->l4 && dissector_uses_key(flow_dissector,
+					 FLOW_DISSECTOR_KEY_PORTS)) {
+		key_ports = skb_flow_dissector_target(flow_dissector,
+						      FLOW_DISSECTOR_KEY_PORTS,
+						      target_container);
+		key_ports->ports = __skb_flow_get_ports(skb, thoff,
+							fc->ip_proto,
+							data, hlen);
+	}
+
+	key_basic->n_proto = skb->protocol;
+	key_basic->ip_proto = fc->ip_proto;
+	key_control->thoff = (u16)thoff;
+
+	return true;
+}
+
+/*
+ * Like skb->hash, the cache is filled in on the way through, also for
+ * callers that only have a const skb.
+ */
+static void skb_flow_cache_store(const struct sk_buff *skb,
+				 const struct flow_dissector_key_control *key_control,
+				 u8 ip_proto, unsigned int flags, bool l4)
+{
+	struct flow_dissector_cache *fc =
+		(struct flow_dissector_cache *)&skb->flow_cache;
+
+	BUILD_BUG_ON(FLOW_DISSECTOR_F_ALL > 0xf);
+	BUILD_BUG_ON((FLOW_DIS_IS_FRAGMENT | FLOW_DIS_FIRST_FRAG) > 0x3);
+
+	fc->nhoff = skb->network_header;
+	fc->thoff = skb_headroom(skb) + key_control->thoff;
+	fc->proto = skb->protocol;
+	fc->ip_proto = ip_proto;
+	fc->flags = flags;
+	fc->frag = key_control->flags &
+		   (FLOW_DIS_IS_FRAGMENT | FLOW_DIS_FIRST_FRAG);
+	fc->l4 = l4;
+	fc->valid = 1;
+}
+
 /**
  * __skb_flow_dissect - extract the flow_keys struct and return it
  * @skb: sk_buff to extract the flow from, can be NULL if the rest are specified
@@ -116,6 +227,9 @@ EXPORT_SYMBOL(__skb_flow_get_ports);
  * by flow_dissector from either the skbuff or a raw buffer specified by the
  * rest parameters.
  *
+ * Plain IPv4 and IPv6 walks over an skb are cached in skb->flow_cache, so
+ * that the next dissection of the same packet only reads the fields.
+ *
  * Caller must take care of zeroing target container memory.
  */
 bool __skb_flow_dissect(const struct sk_buff *skb,
@@ -131,6 +245,8 @@ bool __skb_flow_dissect(const struct sk_buff *skb,
 	struct flow_dissector_key_tags *key_tags;
 	struct flow_dissector_key_keyid *key_keyid;
 	u8 ip_proto = 0;
+	bool use_cache = false;
+	bool l4 = false;
 	bool ret = false;
 
 	if (!data) {
@@ -138,6 +254,10 @@ bool __skb_flow_dissect(const struct sk_buff *skb,
 		proto = skb->protocol;
 		nhoff = skb_network_offset(skb);
 		hlen = skb_headlen(skb);
+		use_cache = (proto == htons(ETH_P_IP) ||
+			     proto == htons(ETH_P_IPV6)) &&
+			    !(flags & ~FLOW_DISSECTOR_F_ALL) &&
+			    dissector_can_cache(flow_dissector);
 	}
 
 	/* It is ensured by skb_flow_dissector_init() that control key will
@@ -165,6 +285,11 @@ bool __skb_flow_dissect(const struct sk_buff *skb,
 		memcpy(key_eth_addrs, &eth->h_dest, sizeof(*key_eth_addrs));
 	}
 
+	if (use_cache &&
+	    __skb_flow_dissect_cached(skb, flow_dissector, target_container,
+				      key_control, key_basic, flags))
+		return true;
+
 again:
 	switch (proto) {
 	case htons(ETH_P_IP): {
@@ -480,6 +605,7 @@ ip_proto_again:
 		break;
 	}
 
+	l4 = true;
 	if (dissector_uses_key(flow_dissector,
 			       FLOW_DISSECTOR_KEY_PORTS)) {
 		key_ports = skb_flow_dissector_target(flow_dissector,
@@ -497,6 +623,11 @@ out_bad:
 	key_basic->ip_proto = ip_proto;
 	key_control->thoff = (u16)nhoff;
 
+	/* anything that went through another header is not worth caching */
+	if (ret && use_cache && proto == skb->protocol &&
+	    !(key_control->flags & FLOW_DIS_ENCAPSULATION))
+		skb_flow_cache_store(skb, key_control, ip_proto, flags, l4);
+
 	return ret;
 }
 EXPORT_SYMBOL(__skb_flow_dissect);
@@ -74,9 +74,18 @@
      is (HZ*2^EST_MAX_INTERVAL)/4 = 8sec. Shorter intervals
      are too expensive, longer ones can be implemented
      at user level painlessly.
+   * Estimators are spread over the online CPUs, each CPU has its own
+     timer per interval. Each interval is split in EST_SLOTS ticks and
+     a tick only samples the estimators of its slot, so a box with tens
+     of thousands of classes does not sample them all in one softirq.
+   * Counters are sampled without the statistics lock where they can be
+     read in one go, see est_need_stats_lock().
  */
 
 #define EST_MAX_INTERVAL	5
+#define EST_SLOTS		4
+
+struct gen_estimator_head;
 
 struct gen_estimator
 {
@@ -84,6 +93,9 @@ struct gen_estimator
 	struct gnet_stats_basic_packed	*bstats;
 	struct gnet_stats_rate_est64	*rate_est;
 	spinlock_t		*stats_lock;
+	/* bstats is cleared under it when the estimator is killed */
+	spinlock_t		lock;
+	struct gen_estimator_head *ehead;
 	int			ewma_log;
 	u32			last_packets;
 	unsigned long		avpps;
@@ -98,54 +110,127 @@ struct gen_estimator
 struct gen_estimator_head
 {
 	struct timer_list	timer;
-	struct list_head	list;
+	struct list_head	list[EST_SLOTS];
+	unsigned long		base;		/* start of the current interval */
+	unsigned int		slot;		/* slot the timer samples next */
+	unsigned int		next_slot;	/* for new estimators */
+	unsigned int		count;
+	int			idx;
 };
 
-static struct gen_estimator_head elist[EST_MAX_INTERVAL+1];
-
-/* Protects against NULL dereference */
-static DEFINE_RWLOCK(est_lock);
+static DEFINE_PER_CPU(struct gen_estimator_head, elist[EST_MAX_INTERVAL+1]);
 
-/* Protects against soft lockup during large deletion */
+/* Protects the rb tree, the lists and the timers' state */
 static struct rb_root est_root = RB_ROOT;
 static DEFINE_SPINLOCK(est_tree_lock);
+static int est_last_cpu = -1;
 
-static void est_timer(unsigned long arg)
+static unsigned long est_interval(int idx)
 {
-	int idx = (int)arg;
-	struct gen_estimator *e;
+	return (HZ/4) << idx;
+}
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(e, &elist[idx].list, list) {
-		struct gnet_stats_basic_packed b = {0};
-		unsigned long rate;
-		u64 brate;
+static unsigned long est_slot_expires(const struct gen_estimator_head *h)
+{
+	return h->base + est_interval(h->idx) * (h->slot + 1) / EST_SLOTS;
+}
 
+/*
+ * Per-CPU counters come with their own u64_stats sync. Plain ones are
+ * written under the statistics lock, but an arch that loads the 64bit byte
+ * counter in one go can read them without it; a packet counted in bytes
+ * but not yet in packets just moves to the next sample.
+ */
+static bool est_need_stats_lock(const struct gen_estimator *e)
+{
+	if (e->cpu_bstats)
+		return false;
+	return BITS_PER_LONG != 64 ||
+	       !IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS);
+}
+
+static void est_sample(struct gen_estimator *e, int idx)
+{
+	struct gnet_stats_basic_packed b = {0};
+	bool locked = est_need_stats_lock(e);
+	unsigned long rate;
+	u64 brate;
+
+	if (locked)
 		spin_lock(e->stats_lock);
-		read_lock(&est_lock);
-		if (e->bstats == NULL)
-			goto skip;
-
-		__gnet_stats_copy_basic(&b, e->cpu_bstats, e->bstats);
-
-		brate = (b.bytes - e->last_bytes)<<(7 - idx);
-		e->last_bytes = b.bytes;
-		e->avbps += (brate >> e->ewma_log) - (e->avbps >> e->ewma_log);
-		e->rate_est->bps = (e->avbps+0xF)>>5;
-
-		rate = b.packets - e->last_packets;
-		rate <<= (7 - idx);
-		e->last_packets = b.packets;
-		e->avpps += (rate >> e->ewma_log) - (e->avpps >> e->ewma_log);
-		e->rate_est->pps = (e->avpps + 0xF) >> 5;
+	spin_lock(&e->lock);
+	if (e->bstats == NULL)
+		goto skip;
+
+	__gnet_stats_copy_basic(&b, e->cpu_bstats, e->bstats);
+
+	brate = (b.bytes - e->last_bytes)<<(7 - idx);
+	e->last_bytes = b.bytes;
+	e->avbps += (brate >> e->ewma_log) - (e->avbps >> e->ewma_log);
+	e->rate_est->bps = (e->avbps+0xF)>>5;
+
+	rate = b.packets - e->last_packets;
+	rate <<= (7 - idx);
+	e->last_packets = b.packets;
+	e->avpps += (rate >> e->ewma_log) - (e->avpps >> e->ewma_log);
+	e->rate_est->pps = (e->avpps + 0xF) >> 5;
 skip:
-		read_unlock(&est_lock);
+	spin_unlock(&e->lock);
+	if (locked)
 		spin_unlock(e->stats_lock);
-	}
+}
+
+static void est_timer(unsigned long arg)
+{
+	struct gen_estimator_head *h = (struct gen_estimator_head *)arg;
+	struct gen_estimator *e;
 
-	if (!list_empty(&elist[idx].list))
-		mod_timer(&elist[idx].timer, jiffies + ((HZ/4) << idx));
+	rcu_read_lock();
+	list_for_each_entry_rcu(e, &h->list[h->slot], list)
+		est_sample(e, h->idx);
 	rcu_read_unlock();
+
+	/*
+	 * The slots are timed from the start of the interval, so that each
+	 * estimator is sampled a whole interval apart however the ticks
+	 * round.
+	 */
+	spin_lock(&est_tree_lock);
+	if (++h->slot == EST_SLOTS) {
+		h->slot = 0;
+		h->base += est_interval(h->idx);
+	}
+	if (h->count)
+		mod_timer_pinned(&h->timer, est_slot_expires(h));
+	spin_unlock(&est_tree_lock);
+}
+
+/* Called with est_tree_lock held */
+static struct gen_estimator_head *est_pick_head(int idx)
+{
+	struct gen_estimator_head *h;
+	int cpu, i;
+
+	cpu = cpumask_next(est_last_cpu, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	est_last_cpu = cpu;
+
+	h = &per_cpu(elist[idx], cpu);
+	if (!h->timer.function) {
+		for (i = 0; i < EST_SLOTS; i++)
+			INIT_LIST_HEAD(&h->list[i]);
+		h->idx = idx;
+		setup_timer(&h->timer, est_timer, (unsigned long)h);
+	}
+
+	if (!h->count++ && !timer_pending(&h->timer)) {
+		h->base = jiffies;
+		h->slot = 0;
+		h->timer.expires = est_slot_expires(h);
+		add_timer_on(&h->timer, cpu);
+	}
+	return h;
 }
 
 static void gen_add_node(struct gen_estimator *est)
@@ -196,10 +281,10 @@ struct gen_estimator *gen_find_node(const struct gnet_stats_basic_packed *bstats
  * @opt: rate estimator configuration TLV
  *
  * Creates a new rate estimator with &bstats as source and &rate_est
- * as destination. A new timer with the interval specified in the
- * configuration TLV is created. Upon each interval, the latest statistics
- * will be read from &bstats and the estimated rate will be stored in
- * &rate_est with the statistics lock grabbed during this period.
+ * as destination. Upon each interval specified in the configuration TLV,
+ * the latest statistics will be read from &bstats and the estimated rate
+ * will be stored in &rate_est. The statistics lock is only grabbed during
+ * this period where the counters can't be read without it.
  *
  * Returns 0 on success or a negative error code.
  *
@@ -237,17 +322,12 @@ int gen_new_estimator(struct gnet_stats_basic_packed *bstats,
 	est->last_packets = b.packets;
 	est->avpps = rate_est->pps<<10;
 	est->cpu_bstats = cpu_bstats;
+	spin_lock_init(&est->lock);
 
 	spin_lock_bh(&est_tree_lock);
-	if (!elist[idx].timer.function) {
-		INIT_LIST_HEAD(&elist[idx].list);
-		setup_timer(&elist[idx].timer, est_timer, idx);
-	}
-
-	if (list_empty(&elist[idx].list))
-		mod_timer(&elist[idx].timer, jiffies + ((HZ/4) << idx));
-
-	list_add_rcu(&est->list, &elist[idx].list);
+	est->ehead = est_pick_head(idx);
+	list_add_rcu(&est->list,
+		     &est->ehead->list[est->ehead->next_slot++ % EST_SLOTS]);
 	gen_add_node(est);
 	spin_unlock_bh(&est_tree_lock);
 
@@ -273,11 +353,12 @@ void gen_kill_estimator(struct gnet_stats_basic_packed *bstats,
 	while ((e = gen_find_node(bstats, rate_est))) {
 		rb_erase(&e->node, &est_root);
 
-		write_lock(&est_lock);
+		spin_lock(&e->lock);
 		e->bstats = NULL;
-		write_unlock(&est_lock);
+		spin_unlock(&e->lock);
 
 		list_del_rcu(&e->list);
+		e->ehead->count--;
 		kfree_rcu(e, e_rcu);
 	}
 	spin_unlock_bh(&est_tree_lock);
@@ -94,6 +94,13 @@ static int neigh_blackhole(struct neighbour *neigh, struct sk_buff *skb)
 	return -ENETDOWN;
 }
 
+/* Called with tbl->lock held, when @n is taken off the hash table */
+static void neigh_mark_dead(struct neighbour *n)
+{
+	n->dead = 1;
+	atomic_dec(&n->parms->entries);
+}
+
 static void neigh_cleanup_and_release(struct neighbour *neigh)
 {
 	if (neigh->parms->neigh_cleanup)
@@ -144,7 +151,7 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 				rcu_assign_pointer(*np,
 					rcu_dereference_protected(n->next,
 						  lockdep_is_held(&tbl->lock)));
-				n->dead = 1;
+				neigh_mark_dead(n);
 				shrunk	= 1;
 				write_unlock(&n->lock);
 				neigh_cleanup_and_release(n);
@@ -215,7 +222,7 @@ static void neigh_flush_dev(struct neigh_table *tbl, struct net_device *dev)
 						lockdep_is_held(&tbl->lock)));
 			write_lock(&n->lock);
 			neigh_del_timer(n);
-			n->dead = 1;
+			neigh_mark_dead(n);
 
 			if (atomic_read(&n->refcnt) != 1) {
 				/* The most unpleasant situation.
@@ -314,22 +321,22 @@ static void neigh_get_hash_rnd(u32 *x)
 	*x |= 1;
 }
 
-static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
+static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift,
+						 gfp_t gfp)
 {
 	size_t size = (1 << shift) * sizeof(struct neighbour *);
 	struct neigh_hash_table *ret;
 	struct neighbour __rcu **buckets;
 	int i;
 
-	ret = kmalloc(sizeof(*ret), GFP_ATOMIC);
+	ret = kmalloc(sizeof(*ret), gfp);
 	if (!ret)
 		return NULL;
 	if (size <= PAGE_SIZE)
-		buckets = kzalloc(size, GFP_ATOMIC);
+		buckets = kzalloc(size, gfp);
 	else
 		buckets = (struct neighbour __rcu **)
-			  __get_free_pages(GFP_ATOMIC | __GFP_ZERO,
-					   get_order(size));
+			  __get_free_pages(gfp | __GFP_ZERO, get_order(size));
 	if (!buckets) {
 		kfree(ret);
 		return NULL;
@@ -356,19 +363,16 @@ static void neigh_hash_free_rcu(struct rcu_head *head)
 	kfree(nht);
 }
 
-static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
-						unsigned long new_shift)
+static void neigh_hash_grow(struct neigh_table *tbl,
+			    struct neigh_hash_table *new_nht)
 {
 	unsigned int i, hash;
-	struct neigh_hash_table *new_nht, *old_nht;
+	struct neigh_hash_table *old_nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	old_nht = rcu_dereference_protected(tbl->nht,
 					    lockdep_is_held(&tbl->lock));
-	new_nht = neigh_hash_alloc(new_shift);
-	if (!new_nht)
-		return old_nht;
 
 	for (i = 0; i < (1 << old_nht->hash_shift); i++) {
 		struct neighbour *n, *next;
@@ -394,7 +398,41 @@ static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
 
 	rcu_assign_pointer(tbl->nht, new_nht);
 	call_rcu(&old_nht->rcu, neigh_hash_free_rcu);
-	return new_nht;
+}
+
+/*
+ * Grown from a work item rather than by the neighbour creation that finds
+ * the table too small: new entries, often created from softirq, never wait
+ * for the buckets to be allocated, and the allocation can sleep, which an
+ * order-9 one for a couple of hundred thousand entries may well need to.
+ */
+static void neigh_hash_grow_work(struct work_struct *work)
+{
+	struct neigh_table *tbl = container_of(work, struct neigh_table,
+					       grow_work);
+	struct neigh_hash_table *nht, *new_nht;
+	unsigned int shift;
+
+	rcu_read_lock_bh();
+	shift = rcu_dereference_bh(tbl->nht)->hash_shift + 1;
+	rcu_read_unlock_bh();
+
+	new_nht = neigh_hash_alloc(shift, GFP_KERNEL);
+	if (!new_nht)
+		return;
+
+	write_lock_bh(&tbl->lock);
+	nht = rcu_dereference_protected(tbl->nht,
+					lockdep_is_held(&tbl->lock));
+	if (nht->hash_shift + 1 == shift &&
+	    atomic_read(&tbl->entries) > (1 << nht->hash_shift)) {
+		neigh_hash_grow(tbl, new_nht);
+		new_nht = NULL;
+	}
+	write_unlock_bh(&tbl->lock);
+
+	if (new_nht)
+		neigh_hash_free_rcu(&new_nht->rcu);
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -494,7 +532,7 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 					lockdep_is_held(&tbl->lock));
 
 	if (atomic_read(&tbl->entries) > (1 << nht->hash_shift))
-		nht = neigh_hash_grow(tbl, nht->hash_shift + 1);
+		schedule_work(&tbl->grow_work);
 
 	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) >> (32 - nht->hash_shift);
 
@@ -516,7 +554,17 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 		}
 	}
 
+	if (NEIGH_VAR(n->parms, MAX_ENTRIES) &&
+	    atomic_read(&n->parms->entries) >= NEIGH_VAR(n->parms, MAX_ENTRIES)) {
+		net_info_ratelimited("%s: neighbor table overflow on %s!\n",
+				     tbl->id, dev->name);
+		NEIGH_CACHE_STAT_INC(tbl, table_fulls);
+		rc = ERR_PTR(-ENOBUFS);
+		goto out_tbl_unlock;
+	}
+
 	n->dead = 0;
+	atomic_inc(&n->parms->entries);
 	if (want_ref)
 		neigh_hold(n);
 	rcu_assign_pointer(n->next,
@@ -737,12 +785,17 @@ static void neigh_connect(struct neighbour *neigh)
 	neigh->output = neigh->ops->connected_output;
 }
 
+/* Entries looked at per run of the periodic GC, rounded up to a bucket */
+#define NEIGH_GC_BUDGET		1024
+
 static void neigh_periodic_work(struct work_struct *work)
 {
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
+	unsigned long interval = NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1;
+	unsigned long delay = interval;
 	struct neighbour *n;
 	struct neighbour __rcu **np;
-	unsigned int i;
+	unsigned int i, start, budget = NEIGH_GC_BUDGET;
 	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
@@ -755,7 +808,7 @@ static void neigh_periodic_work(struct work_struct *work)
 	 *	periodically recompute ReachableTime from random function
 	 */
 
-	if (time_after(jiffies, tbl->last_rand + 300 * HZ)) {
+	if (!tbl->gc_bucket && time_after(jiffies, tbl->last_rand + 300 * HZ)) {
 		struct neigh_parms *p;
 		tbl->last_rand = jiffies;
 		list_for_each_entry(p, &tbl->parms_list, list)
@@ -763,10 +816,17 @@ static void neigh_periodic_work(struct work_struct *work)
 				neigh_rand_reach_time(NEIGH_VAR(p, BASE_REACHABLE_TIME));
 	}
 
-	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
+	if (atomic_read(&tbl->entries) < tbl->gc_thresh1) {
+		tbl->gc_bucket = 0;
 		goto out;
+	}
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
+	/* A big table is walked over several runs, to bound the time each
+	 * run holds the table lock for, picking up at the bucket the last
+	 * one stopped at.
+	 */
+	start = tbl->gc_bucket;
+	for (i = start; i < (1 << nht->hash_shift) && budget; i++) {
 		np = &nht->hash_buckets[i];
 
 		while ((n = rcu_dereference_protected(*np,
@@ -788,15 +848,19 @@ static void neigh_periodic_work(struct work_struct *work)
 			    (state == NUD_FAILED ||
 			     time_after(jiffies, n->used + NEIGH_VAR(n->parms, GC_STALETIME)))) {
 				*np = n->next;
-				n->dead = 1;
+				neigh_mark_dead(n);
 				write_unlock(&n->lock);
 				neigh_cleanup_and_release(n);
+				if (budget)
+					budget--;
 				continue;
 			}
 			write_unlock(&n->lock);
 
 next_elt:
 			np = &n->next;
+			if (budget)
+				budget--;
 		}
 		/*
 		 * It's fine to release lock here, even if hash table
@@ -808,13 +872,22 @@ next_elt:
 		nht = rcu_dereference_protected(tbl->nht,
 						lockdep_is_held(&tbl->lock));
 	}
+
+	if (i < (1 << nht->hash_shift)) {
+		/* come back for the rest within the same pass */
+		tbl->gc_bucket = i;
+		delay = max_t(unsigned long, 1,
+			      div_u64((u64)interval * (i - start),
+				      1 << nht->hash_shift));
+	} else {
+		tbl->gc_bucket = 0;
+	}
 out:
 	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
 	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
 	 * BASE_REACHABLE_TIME.
 	 */
-	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
-			      NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1);
+	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work, delay);
 	write_unlock_bh(&tbl->lock);
 }
 
@@ -1440,6 +1513,7 @@ struct neigh_parms *neigh_parms_alloc(struct net_device *dev,
 	if (p) {
 		p->tbl		  = tbl;
 		atomic_set(&p->refcnt, 1);
+		atomic_set(&p->entries, 0);
 		p->reachable_time =
 				neigh_rand_reach_time(NEIGH_VAR(p, BASE_REACHABLE_TIME));
 		dev_hold(dev);
@@ -1516,7 +1590,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 		panic("cannot create neighbour proc dir entry");
 #endif
 
-	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3));
+	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3, GFP_KERNEL));
 
 	phsize = (PNEIGH_HASHMASK + 1) * sizeof(struct pneigh_entry *);
 	tbl->phash_buckets = kzalloc(phsize, GFP_KERNEL);
@@ -1532,6 +1606,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 
 	rwlock_init(&tbl->lock);
 	INIT_DEFERRABLE_WORK(&tbl->gc_work, neigh_periodic_work);
+	INIT_WORK(&tbl->grow_work, neigh_hash_grow_work);
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			tbl->parms.reachable_time);
 	setup_timer(&tbl->proxy_timer, neigh_proxy_process, (unsigned long)tbl);
@@ -1550,6 +1625,7 @@ int neigh_table_clear(int index, struct neigh_table *tbl)
 	neigh_tables[index] = NULL;
 	/* It is not clean... Fix it to unload IPv6 module safely */
 	cancel_delayed_work_sync(&tbl->gc_work);
+	cancel_work_sync(&tbl->grow_work);
 	del_timer_sync(&tbl->proxy_timer);
 	pneigh_queue_purge(&tbl->proxy_queue);
 	neigh_ifdown(tbl, NULL);
@@ -2445,7 +2521,7 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 				rcu_assign_pointer(*np,
 					rcu_dereference_protected(n->next,
 						lockdep_is_held(&tbl->lock)));
-				n->dead = 1;
+				neigh_mark_dead(n);
 			} else
 				np = &n->next;
 			write_unlock(&n->lock);
@@ -3072,6 +3148,7 @@ static struct neigh_sysctl_table {
 		NEIGH_SYSCTL_USERHZ_JIFFIES_ENTRY(ANYCAST_DELAY, "anycast_delay"),
 		NEIGH_SYSCTL_USERHZ_JIFFIES_ENTRY(PROXY_DELAY, "proxy_delay"),
 		NEIGH_SYSCTL_USERHZ_JIFFIES_ENTRY(LOCKTIME, "locktime"),
+		NEIGH_SYSCTL_ZERO_INTMAX_ENTRY(MAX_ENTRIES, "max_entries"),
 		NEIGH_SYSCTL_UNRES_QLEN_REUSED_ENTRY(QUEUE_LEN, QUEUE_LEN_BYTES, "unres_qlen"),
 		NEIGH_SYSCTL_MS_JIFFIES_REUSED_ENTRY(RETRANS_TIME_MS, RETRANS_TIME, "retrans_time_ms"),
 		NEIGH_SYSCTL_MS_JIFFIES_REUSED_ENTRY(BASE_REACHABLE_TIME_MS, BASE_REACHABLE_TIME, "base_reachable_time_ms"),
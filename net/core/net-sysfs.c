@@ -319,8 +319,7 @@ NETDEVICE_SHOW_RW(flags, fmt_hex);
 
 static int change_tx_queue_len(struct net_device *dev, unsigned long new_len)
 {
-	dev->tx_queue_len = new_len;
-	return 0;
+	return dev_change_tx_queue_len(dev, new_len);
 }
 
 static ssize_t tx_queue_len_store(struct device *dev,
@@ -351,6 +350,25 @@ static ssize_t gro_flush_timeout_store(struct device *dev,
 }
 NETDEVICE_SHOW_RW(gro_flush_timeout, fmt_ulong);
 
+#ifdef CONFIG_XPS
+static int change_xps_symmetric(struct net_device *dev, unsigned long val)
+{
+	dev->xps_symmetric = !!val;
+	return 0;
+}
+
+static ssize_t xps_symmetric_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t len)
+{
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	return netdev_store(dev, attr, buf, len, change_xps_symmetric);
+}
+NETDEVICE_SHOW_RW(xps_symmetric, fmt_dec);
+#endif
+
 static ssize_t ifalias_store(struct device *dev, struct device_attribute *attr,
 			     const char *buf, size_t len)
 {
@@ -510,6 +528,9 @@ static struct attribute *net_class_attrs[] = {
 	&dev_attr_flags.attr,
 	&dev_attr_tx_queue_len.attr,
 	&dev_attr_gro_flush_timeout.attr,
+#ifdef CONFIG_XPS
+	&dev_attr_xps_symmetric.attr,
+#endif
 	&dev_attr_phys_port_id.attr,
 	&dev_attr_phys_port_name.attr,
 	&dev_attr_phys_switch_id.attr,
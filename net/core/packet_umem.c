@@ -0,0 +1,256 @@
+/*
+ * net/core/packet_umem.c	User memory rx area of a packet socket
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Built in rather than part of af_packet, so that drivers filling a umem
+ * do not depend on the packet socket module.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/dma-mapping.h>
+#include <linux/netdevice.h>
+#include <net/packet_umem.h>
+
+static void packet_umem_unpin(struct packet_umem *umem, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		set_page_dirty_lock(umem->pages[i]);
+		put_page(umem->pages[i]);
+	}
+}
+
+/**
+ * packet_umem_create - pin a user area for UMEM receive
+ * @reg: the area, as passed to PACKET_UMEM_REG
+ *
+ * The pages count against RLIMIT_MEMLOCK of the caller's mm, as for other
+ * long term pins, unless it has CAP_IPC_LOCK. The rings are set up
+ * separately with packet_umem_set_ring().
+ */
+struct packet_umem *packet_umem_create(const struct tpacket_umem_reg *reg)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long npages, lock_limit;
+	struct packet_umem *umem;
+	unsigned int pinned;
+	long ret;
+
+	if (!is_power_of_2(reg->frame_size) || reg->frame_size < 2048 ||
+	    reg->frame_size > PAGE_SIZE ||
+	    reg->frame_headroom >= reg->frame_size)
+		return ERR_PTR(-EINVAL);
+	if (!reg->len || !PAGE_ALIGNED(reg->addr) || !PAGE_ALIGNED(reg->len) ||
+	    reg->addr + reg->len < reg->addr)
+		return ERR_PTR(-EINVAL);
+	if (reg->flags & ~(TP_UMEM_ZEROCOPY | TP_UMEM_COPY) ||
+	    (reg->flags & TP_UMEM_ZEROCOPY && reg->flags & TP_UMEM_COPY))
+		return ERR_PTR(-EINVAL);
+
+	npages = reg->len >> PAGE_SHIFT;
+	if (npages > INT_MAX / sizeof(struct page *))
+		return ERR_PTR(-EINVAL);
+
+	umem = kzalloc(sizeof(*umem), GFP_KERNEL);
+	if (!umem)
+		return ERR_PTR(-ENOMEM);
+	umem->pages = vzalloc(npages * sizeof(struct page *));
+	if (!umem->pages) {
+		kfree(umem);
+		return ERR_PTR(-ENOMEM);
+	}
+	umem->nr_pages = npages;
+	umem->size = reg->len;
+	umem->frame_size = reg->frame_size;
+	umem->headroom = reg->frame_headroom;
+	umem->flags = reg->flags;
+	spin_lock_init(&umem->lock);
+
+	down_write(&mm->mmap_sem);
+	lock_limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+	if (mm->pinned_vm + npages > lock_limit && !capable(CAP_IPC_LOCK)) {
+		ret = -ENOBUFS;
+		goto out_unlock;
+	}
+
+	for (pinned = 0; pinned < npages; pinned += ret) {
+		ret = get_user_pages(current, mm,
+				     reg->addr + ((u64)pinned << PAGE_SHIFT),
+				     npages - pinned, 1, 0,
+				     umem->pages + pinned, NULL);
+		if (ret <= 0) {
+			packet_umem_unpin(umem, pinned);
+			ret = ret ? : -EFAULT;
+			goto out_unlock;
+		}
+	}
+	mm->pinned_vm += npages;
+	up_write(&mm->mmap_sem);
+
+	atomic_inc(&mm->mm_count);
+	umem->mm = mm;
+	return umem;
+
+out_unlock:
+	up_write(&mm->mmap_sem);
+	vfree(umem->pages);
+	kfree(umem);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(packet_umem_create);
+
+/**
+ * packet_umem_destroy - unpin and free a umem
+ * @umem: umem no driver or socket uses anymore
+ */
+void packet_umem_destroy(struct packet_umem *umem)
+{
+	WARN_ON(umem->dma);
+
+	packet_umem_unpin(umem, umem->nr_pages);
+	down_write(&umem->mm->mmap_sem);
+	umem->mm->pinned_vm -= umem->nr_pages;
+	up_write(&umem->mm->mmap_sem);
+	mmdrop(umem->mm);
+
+	vfree(umem->fill.ring);
+	vfree(umem->rx.ring);
+	vfree(umem->pages);
+	kfree(umem);
+}
+EXPORT_SYMBOL_GPL(packet_umem_destroy);
+
+/**
+ * packet_umem_set_ring - allocate the fill or the rx ring
+ * @umem: umem to allocate it for
+ * @rx: the rx ring rather than the fill ring
+ * @entries: power of 2 number of entries
+ *
+ * A ring is set up once and lives as long as the umem.
+ */
+int packet_umem_set_ring(struct packet_umem *umem, bool rx,
+			 unsigned int entries)
+{
+	struct packet_umem_queue *q = rx ? &umem->rx : &umem->fill;
+	size_t entry_size = rx ? sizeof(struct tpacket_umem_desc) :
+				 sizeof(u64);
+
+	if (q->ring)
+		return -EBUSY;
+	if (!is_power_of_2(entries) || entries > PACKET_UMEM_RING_MAX)
+		return -EINVAL;
+
+	q->size = sizeof(struct tpacket_umem_ring) + entries * entry_size;
+	q->ring = vmalloc_user(q->size);
+	if (!q->ring)
+		return -ENOMEM;
+	q->entries = q->ring + 1;
+	q->mask = entries - 1;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(packet_umem_set_ring);
+
+/* Maps the ring selected by the page offset of @vma */
+int packet_umem_mmap(struct packet_umem *umem, struct vm_area_struct *vma)
+{
+	struct packet_umem_queue *q;
+
+	switch (vma->vm_pgoff) {
+	case PACKET_UMEM_PGOFF_FILL_RING >> PAGE_SHIFT:
+		q = &umem->fill;
+		break;
+	case PACKET_UMEM_PGOFF_RX_RING >> PAGE_SHIFT:
+		q = &umem->rx;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (!q->ring)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, q->ring, 0);
+}
+EXPORT_SYMBOL_GPL(packet_umem_mmap);
+
+/**
+ * packet_umem_dma_map - map the area for a device to receive into
+ * @umem: umem to map
+ * @dev: device doing the DMA
+ *
+ * For drivers accepting XDP_SETUP_UMEM, which must undo it with
+ * packet_umem_dma_unmap() before they let go of the umem.
+ */
+int packet_umem_dma_map(struct packet_umem *umem, struct device *dev)
+{
+	unsigned int i;
+
+	if (WARN_ON(umem->dma))
+		return -EBUSY;
+
+	umem->dma = vzalloc(umem->nr_pages * sizeof(dma_addr_t));
+	if (!umem->dma)
+		return -ENOMEM;
+
+	for (i = 0; i < umem->nr_pages; i++) {
+		umem->dma[i] = dma_map_page(dev, umem->pages[i], 0, PAGE_SIZE,
+					    DMA_FROM_DEVICE);
+		if (dma_mapping_error(dev, umem->dma[i]))
+			goto err;
+	}
+	umem->dma_dev = dev;
+	return 0;
+
+err:
+	while (i--)
+		dma_unmap_page(dev, umem->dma[i], PAGE_SIZE, DMA_FROM_DEVICE);
+	vfree(umem->dma);
+	umem->dma = NULL;
+	return -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(packet_umem_dma_map);
+
+void packet_umem_dma_unmap(struct packet_umem *umem)
+{
+	unsigned int i;
+
+	for (i = 0; i < umem->nr_pages; i++)
+		dma_unmap_page(umem->dma_dev, umem->dma[i], PAGE_SIZE,
+			       DMA_FROM_DEVICE);
+	vfree(umem->dma);
+	umem->dma = NULL;
+	umem->dma_dev = NULL;
+}
+EXPORT_SYMBOL_GPL(packet_umem_dma_unmap);
+
+/**
+ * packet_umem_wakeup - poll a zero copy queue that waits for chunks
+ * @umem: umem user space has put chunks on the fill ring of
+ *
+ * The driver publishes the napi context of the queue in umem->napi while
+ * it receives into the umem, and clears it before that napi context can
+ * go away, which must not happen before an RCU grace period.
+ */
+void packet_umem_wakeup(struct packet_umem *umem)
+{
+	struct napi_struct *napi;
+
+	rcu_read_lock();
+	napi = rcu_dereference(umem->napi);
+	if (napi) {
+		/* run the poll right away rather than on the next irq */
+		local_bh_disable();
+		napi_schedule(napi);
+		local_bh_enable();
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(packet_umem_wakeup);
@@ -0,0 +1,302 @@
+/*
+ * net/core/page_pool.c	Recycling pool of DMA mapped pages for rx rings
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <net/page_pool.h>
+
+struct page_pool *page_pool_create(const struct page_pool_params *params)
+{
+	struct page_pool *pool;
+
+	if (!params->pool_size || params->order > MAX_ORDER - 1)
+		return ERR_PTR(-EINVAL);
+
+	if (params->flags & PP_FLAG_DMA_MAP) {
+		if (!params->dev ||
+		    (params->dma_dir != DMA_FROM_DEVICE &&
+		     params->dma_dir != DMA_BIDIRECTIONAL))
+			return ERR_PTR(-EINVAL);
+		/* the DMA address is kept in page->private */
+		if (sizeof(dma_addr_t) > sizeof(unsigned long))
+			return ERR_PTR(-EOPNOTSUPP);
+	}
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL,
+			    params->nid == NUMA_NO_NODE ? NUMA_NO_NODE :
+							  params->nid);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	pool->p = *params;
+	pool->ring = kcalloc(params->pool_size, sizeof(*pool->ring),
+			     GFP_KERNEL);
+	pool->stats = alloc_percpu(struct page_pool_stats);
+	if (!pool->ring || !pool->stats) {
+		free_percpu(pool->stats);
+		kfree(pool->ring);
+		kfree(pool);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	spin_lock_init(&pool->ring_lock);
+	atomic_set(&pool->refcnt, 1);
+
+	return pool;
+}
+EXPORT_SYMBOL(page_pool_create);
+
+static void page_pool_free(struct page_pool *pool)
+{
+	free_percpu(pool->stats);
+	kfree(pool->ring);
+	kfree(pool);
+}
+
+static inline int page_pool_nid(struct page_pool *pool)
+{
+	return pool->p.nid == NUMA_NO_NODE ? numa_mem_id() : pool->p.nid;
+}
+
+/*
+ * Unmap a page and give it back to the page allocator. Drops the page's
+ * reference on the pool, which may be the last one.
+ */
+static void page_pool_release_page(struct page_pool *pool, struct page *page)
+{
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma_unmap_page(pool->p.dev, page_pool_get_dma_addr(page),
+			       PAGE_SIZE << pool->p.order, pool->p.dma_dir);
+		set_page_private(page, 0);
+	}
+	page->pp_magic = 0;
+	page->pp = NULL;
+	this_cpu_inc(pool->stats->release);
+
+	put_page(page);
+
+	if (atomic_dec_and_test(&pool->refcnt))
+		page_pool_free(pool);
+}
+
+static struct page *page_pool_alloc_pages_slow(struct page_pool *pool,
+					       gfp_t gfp)
+{
+	struct page *page;
+	dma_addr_t dma;
+
+	if (pool->p.order)
+		gfp |= __GFP_COMP;
+
+	page = alloc_pages_node(page_pool_nid(pool), gfp, pool->p.order);
+	if (!page)
+		return NULL;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma = dma_map_page(pool->p.dev, page, 0,
+				   PAGE_SIZE << pool->p.order,
+				   pool->p.dma_dir);
+		if (dma_mapping_error(pool->p.dev, dma)) {
+			put_page(page);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)dma);
+	}
+
+	page->pp_magic = PP_SIGNATURE;
+	page->pp = pool;
+	atomic_inc(&pool->refcnt);
+	this_cpu_inc(pool->stats->alloc_pages);
+
+	return page;
+}
+
+/*
+ * Move a batch of pages from the recycle ring into the NAPI cache and
+ * return one of them. Pages from another node are let go here, so that
+ * the queue's memory follows its interrupt around.
+ */
+static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
+{
+	int nid = page_pool_nid(pool);
+	struct page *page = NULL;
+
+	if (!READ_ONCE(pool->ring_count))
+		return NULL;
+
+	spin_lock_bh(&pool->ring_lock);
+	while (pool->ring_count &&
+	       pool->alloc.count < PP_ALLOC_CACHE_REFILL) {
+		struct page *p = pool->ring[--pool->ring_count];
+
+		if (unlikely(page_to_nid(p) != nid)) {
+			page_pool_release_page(pool, p);
+			continue;
+		}
+		pool->alloc.cache[pool->alloc.count++] = p;
+	}
+	spin_unlock_bh(&pool->ring_lock);
+
+	if (pool->alloc.count) {
+		page = pool->alloc.cache[--pool->alloc.count];
+		this_cpu_inc(pool->stats->alloc_slow);
+	}
+	return page;
+}
+
+/**
+ * page_pool_alloc_pages - get a page from the pool
+ * @pool: the rx queue's pool
+ * @gfp: allocation flags for when the pool is empty
+ *
+ * Must be called from the NAPI poll of the queue owning @pool, or with
+ * it stopped. The page comes with one reference and, for PP_FLAG_DMA_MAP
+ * pools, mapped; it is up to the driver to sync it for the device.
+ */
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp)
+{
+	struct page *page;
+
+	if (likely(pool->alloc.count)) {
+		this_cpu_inc(pool->stats->alloc_fast);
+		return pool->alloc.cache[--pool->alloc.count];
+	}
+
+	page = page_pool_refill_alloc_cache(pool);
+	if (page)
+		return page;
+
+	return page_pool_alloc_pages_slow(pool, gfp);
+}
+EXPORT_SYMBOL(page_pool_alloc_pages);
+
+/**
+ * page_pool_put_page - return a page to its pool
+ * @pool: the pool @page came from
+ * @page: the page, with the caller's reference
+ * @allow_direct: caller runs in the NAPI poll of the queue owning @pool
+ *
+ * Drops the caller's reference. The last user recycles the page, into the
+ * NAPI cache when @allow_direct and otherwise into the recycle ring. Pages
+ * that cannot be recycled, pfmemalloc ones or ones from the wrong node, are
+ * unmapped and freed.
+ */
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct)
+{
+	if (unlikely(page_count(page) != 1)) {
+		if (!put_page_testzero(page))
+			return;
+		/* lost a race with the other user, the page is ours now */
+		init_page_count(page);
+	}
+
+	if (unlikely(page_is_pfmemalloc(page) ||
+		     page_to_nid(page) != page_pool_nid(pool))) {
+		page_pool_release_page(pool, page);
+		return;
+	}
+
+	if (allow_direct && in_serving_softirq() &&
+	    pool->alloc.count < PP_ALLOC_CACHE_SIZE) {
+		pool->alloc.cache[pool->alloc.count++] = page;
+		this_cpu_inc(pool->stats->recycle_cached);
+		return;
+	}
+
+	spin_lock_bh(&pool->ring_lock);
+	if (likely(!pool->destroyed && pool->ring_count < pool->p.pool_size)) {
+		pool->ring[pool->ring_count++] = page;
+		spin_unlock_bh(&pool->ring_lock);
+		this_cpu_inc(pool->stats->recycle_ring);
+		return;
+	}
+	spin_unlock_bh(&pool->ring_lock);
+
+	if (!pool->destroyed)
+		this_cpu_inc(pool->stats->recycle_full);
+	page_pool_release_page(pool, page);
+}
+EXPORT_SYMBOL(page_pool_put_page);
+
+/**
+ * page_pool_return_skb_page - free a page of an skb marked pp_recycle
+ * @page: a head or frag page of the skb
+ *
+ * Returns false if @page does not belong to a pool, the caller then has to
+ * drop its reference the normal way.
+ */
+bool page_pool_return_skb_page(struct page *page)
+{
+	struct page *head = compound_head(page);
+
+	if (head->pp_magic != PP_SIGNATURE)
+		return false;
+
+	page_pool_put_page(head->pp, head, false);
+	return true;
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
+/**
+ * page_pool_get_stats - sum up the pool's counters
+ * @pool: pool to read
+ * @stats: counters are added to these
+ */
+void page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct page_pool_stats *pcpu =
+			per_cpu_ptr(pool->stats, cpu);
+
+		stats->alloc_fast += pcpu->alloc_fast;
+		stats->alloc_slow += pcpu->alloc_slow;
+		stats->alloc_pages += pcpu->alloc_pages;
+		stats->recycle_cached += pcpu->recycle_cached;
+		stats->recycle_ring += pcpu->recycle_ring;
+		stats->recycle_full += pcpu->recycle_full;
+		stats->release += pcpu->release;
+	}
+}
+EXPORT_SYMBOL(page_pool_get_stats);
+
+/**
+ * page_pool_destroy - release the driver's hold on a pool
+ * @pool: pool to destroy, may be NULL
+ *
+ * The queue's NAPI poll must be stopped. All cached pages are freed now;
+ * pages still out in the stack are freed as they come back, and the pool
+ * itself goes away with the last of them.
+ */
+void page_pool_destroy(struct page_pool *pool)
+{
+	if (!pool)
+		return;
+
+	while (pool->alloc.count)
+		page_pool_release_page(pool,
+				       pool->alloc.cache[--pool->alloc.count]);
+
+	spin_lock_bh(&pool->ring_lock);
+	pool->destroyed = true;
+	while (pool->ring_count)
+		page_pool_release_page(pool, pool->ring[--pool->ring_count]);
+	spin_unlock_bh(&pool->ring_lock);
+
+	if (atomic_dec_and_test(&pool->refcnt))
+		page_pool_free(pool);
+}
+EXPORT_SYMBOL(page_pool_destroy);
@@ -177,9 +177,10 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION	"2.75"
+#define VERSION	"2.76"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
+#define PKTGEN_LAT_BUCKETS 32	/* log2 ns, the last one for anything longer */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
 
 #define func_enter() pr_debug("entering %s\n", __func__);
@@ -203,6 +204,7 @@
 #define F_NODE          (1<<15)	/* Node memory alloc*/
 #define F_UDPCSUM       (1<<16)	/* Include UDP checksum */
 #define F_NO_TIMESTAMP  (1<<17)	/* Don't timestamp packets (default TS) */
+#define F_LATENCY       (1<<18)	/* Time the xmit calls into pg_thread */
 
 /* Thread control flag bits */
 #define T_STOP        (1<<0)	/* Stop run */
@@ -437,6 +439,12 @@ struct pktgen_thread {
 	wait_queue_head_t queue;
 	struct completion start_done;
 	struct pktgen_net *net;
+
+	/* Packets by ns spent in ndo_start_xmit or netif_receive_skb,
+	 * bucket b counts those under 2^b ns. Only LATENCY devices are
+	 * timed, only the thread itself writes.
+	 */
+	u64 lat_hist[PKTGEN_LAT_BUCKETS];
 };
 
 #define REMOVE 1
@@ -653,6 +661,9 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 	if (pkt_dev->flags & F_NO_TIMESTAMP)
 		seq_puts(seq, "NO_TIMESTAMP  ");
 
+	if (pkt_dev->flags & F_LATENCY)
+		seq_puts(seq, "LATENCY  ");
+
 	if (pkt_dev->flags & F_MPLS_RND)
 		seq_puts(seq,  "MPLS_RND  ");
 
@@ -1317,6 +1328,12 @@ static ssize_t pktgen_if_write(struct file *file,
 		else if (strcmp(f, "!NO_TIMESTAMP") == 0)
 			pkt_dev->flags &= ~F_NO_TIMESTAMP;
 
+		else if (strcmp(f, "LATENCY") == 0)
+			pkt_dev->flags |= F_LATENCY;
+
+		else if (strcmp(f, "!LATENCY") == 0)
+			pkt_dev->flags &= ~F_LATENCY;
+
 		else {
 			sprintf(pg_result,
 				"Flag -:%s:- unknown\nAvailable flags, (prepend ! to un-set flag):\n%s",
@@ -1325,7 +1342,7 @@ static ssize_t pktgen_if_write(struct file *file,
 				"MACSRC_RND, MACDST_RND, TXSIZE_RND, IPV6, "
 				"MPLS_RND, VID_RND, SVID_RND, FLOW_SEQ, "
 				"QUEUE_MAP_RND, QUEUE_MAP_CPU, UDPCSUM, "
-				"NO_TIMESTAMP, "
+				"NO_TIMESTAMP, LATENCY, "
 #ifdef CONFIG_XFRM
 				"IPSEC, "
 #endif
@@ -1808,6 +1825,7 @@ static int pktgen_thread_show(struct seq_file *seq, void *v)
 {
 	struct pktgen_thread *t = seq->private;
 	const struct pktgen_dev *pkt_dev;
+	int i;
 
 	BUG_ON(!t);
 
@@ -1831,6 +1849,18 @@ static int pktgen_thread_show(struct seq_file *seq, void *v)
 
 	rcu_read_unlock();
 
+	for (i = 0; i < PKTGEN_LAT_BUCKETS; i++)
+		if (t->lat_hist[i])
+			break;
+	if (i < PKTGEN_LAT_BUCKETS) {
+		seq_puts(seq, "Latency: packets by ns per xmit call\n");
+		for (; i < PKTGEN_LAT_BUCKETS; i++)
+			if (t->lat_hist[i])
+				seq_printf(seq, "  < %llu: %llu\n",
+					   1ULL << i,
+					   (unsigned long long)t->lat_hist[i]);
+	}
+
 	return 0;
 }
 
@@ -3101,8 +3131,10 @@ static void pktgen_run(struct pktgen_thread *t)
 			strcpy(pkt_dev->result, "Error starting");
 	}
 	rcu_read_unlock();
-	if (started)
+	if (started) {
+		memset(t->lat_hist, 0, sizeof(t->lat_hist));
 		t->control &= ~(T_STOP);
+	}
 }
 
 static void pktgen_stop_all_threads_ifs(struct pktgen_net *pn)
@@ -3363,12 +3395,28 @@ static void pktgen_wait_for_skb(struct pktgen_dev *pkt_dev)
 	pkt_dev->idle_acc += ktime_to_ns(ktime_sub(ktime_get(), idle_start));
 }
 
+/* Account @pkts packets sent by a call that began at @start */
+static void pktgen_record_latency(struct pktgen_dev *pkt_dev, u64 start,
+				  u64 pkts)
+{
+	u64 ns;
+
+	if (!pkts)
+		return;
+
+	ns = div64_u64(local_clock() - start, pkts);
+	pkt_dev->pg_thread->lat_hist[min_t(int, fls64(ns),
+					   PKTGEN_LAT_BUCKETS - 1)] += pkts;
+}
+
 static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 {
 	unsigned int burst = ACCESS_ONCE(pkt_dev->burst);
 	struct net_device *odev = pkt_dev->odev;
 	struct netdev_queue *txq;
 	struct sk_buff *skb;
+	u64 lat_start = 0;
+	__u64 sofar = 0;
 	int ret;
 
 	/* If device is offline, then don't send */
@@ -3405,6 +3453,11 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	if (pkt_dev->delay && pkt_dev->last_ok)
 		spin(pkt_dev, pkt_dev->next_tx);
 
+	if (pkt_dev->flags & F_LATENCY) {
+		sofar = pkt_dev->sofar;
+		lat_start = local_clock();
+	}
+
 	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE) {
 		skb = pkt_dev->skb;
 		skb->protocol = eth_type_trans(skb, skb->dev);
@@ -3484,6 +3537,9 @@ unlock:
 	HARD_TX_UNLOCK(odev, txq);
 
 out:
+	if (lat_start)
+		pktgen_record_latency(pkt_dev, lat_start,
+				      pkt_dev->sofar - sofar);
 	local_bh_enable();
 
 	/* If pkt_dev->count is zero, then run forever */
@@ -61,6 +61,7 @@ struct rtnl_link {
 	rtnl_doit_func		doit;
 	rtnl_dumpit_func	dumpit;
 	rtnl_calcit_func 	calcit;
+	unsigned int		flags;
 };
 
 static DEFINE_MUTEX(rtnl_mutex);
@@ -149,6 +150,21 @@ static rtnl_dumpit_func rtnl_get_dumpit(int protocol, int msgindex)
 	return tab[msgindex].dumpit;
 }
 
+static unsigned int rtnl_get_flags(int protocol, int msgindex)
+{
+	struct rtnl_link *tab;
+
+	if (protocol <= RTNL_FAMILY_MAX)
+		tab = rtnl_msg_handlers[protocol];
+	else
+		tab = NULL;
+
+	if (tab == NULL || tab[msgindex].dumpit == NULL)
+		tab = rtnl_msg_handlers[PF_UNSPEC];
+
+	return tab[msgindex].flags;
+}
+
 static rtnl_calcit_func rtnl_get_calcit(int protocol, int msgindex)
 {
 	struct rtnl_link *tab;
@@ -165,12 +181,13 @@ static rtnl_calcit_func rtnl_get_calcit(int protocol, int msgindex)
 }
 
 /**
- * __rtnl_register - Register a rtnetlink message type
+ * __rtnl_register_flags - Register a rtnetlink message type
  * @protocol: Protocol family or PF_UNSPEC
  * @msgtype: rtnetlink message type
  * @doit: Function pointer called for each request message
  * @dumpit: Function pointer called for each dump request (NLM_F_DUMP) message
  * @calcit: Function pointer to calc size of dump message
+ * @flags: RTNL_FLAG_* bits
  *
  * Registers the specified function pointers (at least one of them has
  * to be non-NULL) to be called whenever a request message for the
@@ -182,9 +199,9 @@ static rtnl_calcit_func rtnl_get_calcit(int protocol, int msgindex)
  *
  * Returns 0 on success or a negative error code.
  */
-int __rtnl_register(int protocol, int msgtype,
-		    rtnl_doit_func doit, rtnl_dumpit_func dumpit,
-		    rtnl_calcit_func calcit)
+int __rtnl_register_flags(int protocol, int msgtype,
+			  rtnl_doit_func doit, rtnl_dumpit_func dumpit,
+			  rtnl_calcit_func calcit, unsigned int flags)
 {
 	struct rtnl_link *tab;
 	int msgindex;
@@ -210,8 +227,19 @@ int __rtnl_register(int protocol, int msgtype,
 	if (calcit)
 		tab[msgindex].calcit = calcit;
 
+	tab[msgindex].flags |= flags;
+
 	return 0;
 }
+EXPORT_SYMBOL_GPL(__rtnl_register_flags);
+
+int __rtnl_register(int protocol, int msgtype,
+		    rtnl_doit_func doit, rtnl_dumpit_func dumpit,
+		    rtnl_calcit_func calcit)
+{
+	return __rtnl_register_flags(protocol, msgtype, doit, dumpit,
+				     calcit, 0);
+}
 EXPORT_SYMBOL_GPL(__rtnl_register);
 
 /**
@@ -234,6 +262,24 @@ void rtnl_register(int protocol, int msgtype,
 }
 EXPORT_SYMBOL_GPL(rtnl_register);
 
+/**
+ * rtnl_register_flags - Register a rtnetlink message type with flags
+ *
+ * Identical to __rtnl_register_flags() but panics on failure, see
+ * rtnl_register().
+ */
+void rtnl_register_flags(int protocol, int msgtype,
+			 rtnl_doit_func doit, rtnl_dumpit_func dumpit,
+			 rtnl_calcit_func calcit, unsigned int flags)
+{
+	if (__rtnl_register_flags(protocol, msgtype, doit, dumpit, calcit,
+				  flags) < 0)
+		panic("Unable to register rtnetlink message handler, "
+		      "protocol = %d, message type = %d\n",
+		      protocol, msgtype);
+}
+EXPORT_SYMBOL_GPL(rtnl_register_flags);
+
 /**
  * rtnl_unregister - Unregister a rtnetlink message type
  * @protocol: Protocol family or PF_UNSPEC
@@ -872,6 +918,16 @@ static size_t rtnl_port_size(const struct net_device *dev,
 		return port_self_size;
 }
 
+static size_t rtnl_xdp_size(const struct net_device *dev)
+{
+	size_t xdp_size = nla_total_size(1);	/* XDP_ATTACHED */
+
+	if (!dev->netdev_ops->ndo_xdp)
+		return 0;
+	else
+		return nla_total_size(xdp_size);	/* IFLA_XDP nest */
+}
+
 static noinline size_t if_nlmsg_size(const struct net_device *dev,
 				     u32 ext_filter_mask)
 {
@@ -906,7 +962,8 @@ static noinline size_t if_nlmsg_size(const struct net_device *dev,
 	       + nla_total_size(MAX_PHYS_ITEM_ID_LEN) /* IFLA_PHYS_PORT_ID */
 	       + nla_total_size(MAX_PHYS_ITEM_ID_LEN) /* IFLA_PHYS_SWITCH_ID */
 	       + nla_total_size(IFNAMSIZ) /* IFLA_PHYS_PORT_NAME */
-	       + nla_total_size(1); /* IFLA_PROTO_DOWN */
+	       + nla_total_size(1) /* IFLA_PROTO_DOWN */
+	       + rtnl_xdp_size(dev); /* IFLA_XDP */
 
 }
 
@@ -1024,6 +1081,33 @@ static int rtnl_phys_port_name_fill(struct sk_buff *skb, struct net_device *dev)
 	return 0;
 }
 
+static int rtnl_xdp_fill(struct sk_buff *skb, struct net_device *dev)
+{
+	struct netdev_xdp xdp_op = {};
+	struct nlattr *xdp;
+	int err;
+
+	if (!dev->netdev_ops->ndo_xdp)
+		return 0;
+	xdp = nla_nest_start(skb, IFLA_XDP);
+	if (!xdp)
+		return -EMSGSIZE;
+	xdp_op.command = XDP_QUERY_PROG;
+	err = dev->netdev_ops->ndo_xdp(dev, &xdp_op);
+	if (err)
+		goto err_cancel;
+	err = nla_put_u8(skb, IFLA_XDP_ATTACHED, xdp_op.prog_attached);
+	if (err)
+		goto err_cancel;
+
+	nla_nest_end(skb, xdp);
+	return 0;
+
+err_cancel:
+	nla_nest_cancel(skb, xdp);
+	return err;
+}
+
 static int rtnl_phys_switch_id_fill(struct sk_buff *skb, struct net_device *dev)
 {
 	int err;
@@ -1258,6 +1342,9 @@ static int rtnl_fill_ifinfo(struct sk_buff *skb, struct net_device *dev,
 	if (rtnl_phys_switch_id_fill(skb, dev))
 		goto nla_put_failure;
 
+	if (rtnl_xdp_fill(skb, dev))
+		goto nla_put_failure;
+
 	if (rtnl_fill_stats(skb, dev))
 		goto nla_put_failure;
 
@@ -1370,6 +1457,12 @@ static const struct nla_policy ifla_policy[IFLA_MAX+1] = {
 	[IFLA_PHYS_SWITCH_ID]	= { .type = NLA_BINARY, .len = MAX_PHYS_ITEM_ID_LEN },
 	[IFLA_LINK_NETNSID]	= { .type = NLA_S32 },
 	[IFLA_PROTO_DOWN]	= { .type = NLA_U8 },
+	[IFLA_XDP]		= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy ifla_xdp_policy[IFLA_XDP_MAX + 1] = {
+	[IFLA_XDP_FD]		= { .type = NLA_S32 },
+	[IFLA_XDP_ATTACHED]	= { .type = NLA_U8 },
 };
 
 static const struct nla_policy ifla_info_policy[IFLA_INFO_MAX+1] = {
@@ -1414,22 +1507,70 @@ static const struct nla_policy ifla_port_policy[IFLA_PORT_MAX+1] = {
 	[IFLA_PORT_RESPONSE]	= { .type = NLA_U16, },
 };
 
+/*
+ * Link dumps walk the devices in the order of their ifindex hash bucket,
+ * and by ifindex within a bucket, so the ifindex of the last device sent
+ * is enough to resume. Unlike a position in a bucket it stays valid when
+ * devices come and go between two parts of a dump.
+ */
+static struct net_device *rtnl_dump_next_dev(struct net *net, int ifindex)
+{
+	unsigned int h = ifindex & (NETDEV_HASHENTRIES - 1);
+	struct net_device *dev, *next;
+
+	for (; h < NETDEV_HASHENTRIES; h++, ifindex = 0) {
+		next = NULL;
+		hlist_for_each_entry_rcu(dev, &net->dev_index_head[h],
+					 index_hlist) {
+			if (dev->ifindex > ifindex &&
+			    (!next || dev->ifindex < next->ifindex))
+				next = dev;
+		}
+		if (next)
+			return next;
+	}
+	return NULL;
+}
+
+static bool rtnl_dump_dev_filtered(struct net_device *dev, int master_idx,
+				   const char *kind)
+{
+	struct net_device *master;
+
+	if (master_idx) {
+		master = netdev_master_upper_dev_get_rcu(dev);
+		if (!master || master->ifindex != master_idx)
+			return true;
+	}
+
+	if (kind && (!dev->rtnl_link_ops ||
+		     strcmp(dev->rtnl_link_ops->kind, kind)))
+		return true;
+
+	return false;
+}
+
+/*
+ * Runs without rtnl, see RTNL_FLAG_DUMP_UNLOCKED. The devices are looked up
+ * under RCU and rtnl is only taken once there is something to fill in, so
+ * filtered dumps of big tables don't hold up everybody else.
+ */
 static int rtnl_dump_ifinfo(struct sk_buff *skb, struct netlink_callback *cb)
 {
 	struct net *net = sock_net(skb->sk);
-	int h, s_h;
-	int idx = 0, s_idx;
 	struct net_device *dev;
-	struct hlist_head *head;
 	struct nlattr *tb[IFLA_MAX+1];
+	char kind_buf[MODULE_NAME_LEN];
+	const char *kind = NULL;
+	unsigned int flags = NLM_F_MULTI;
 	u32 ext_filter_mask = 0;
+	int master_idx = 0;
+	bool locked = false;
+	int ifindex;
 	int err;
 	int hdrlen;
 
-	s_h = cb->args[0];
-	s_idx = cb->args[1];
-
-	cb->seq = net->dev_base_seq;
+	ifindex = cb->args[0];
 
 	/* A hack to preserve kernel<->userspace interface.
 	 * The correct header is ifinfomsg. It is consistent with rtnl_getlink.
@@ -1445,35 +1586,84 @@ static int rtnl_dump_ifinfo(struct sk_buff *skb, struct netlink_callback *cb)
 
 		if (tb[IFLA_EXT_MASK])
 			ext_filter_mask = nla_get_u32(tb[IFLA_EXT_MASK]);
+
+		if (tb[IFLA_MASTER])
+			master_idx = nla_get_u32(tb[IFLA_MASTER]);
+
+		if (tb[IFLA_LINKINFO]) {
+			struct nlattr *linkinfo[IFLA_INFO_MAX+1];
+
+			if (nla_parse_nested(linkinfo, IFLA_INFO_MAX,
+					     tb[IFLA_LINKINFO],
+					     ifla_info_policy) >= 0 &&
+			    linkinfo[IFLA_INFO_KIND]) {
+				nla_strlcpy(kind_buf, linkinfo[IFLA_INFO_KIND],
+					    sizeof(kind_buf));
+				kind = kind_buf;
+			}
+		}
+
+		if (master_idx || kind)
+			flags |= NLM_F_DUMP_FILTERED;
+
+		if (tb[IFLA_NET_NS_PID] || tb[IFLA_NET_NS_FD]) {
+			net = rtnl_link_get_net(net, tb);
+			if (IS_ERR(net))
+				return PTR_ERR(net);
+			if (!netlink_ns_capable(cb->skb, net->user_ns,
+						CAP_NET_ADMIN)) {
+				put_net(net);
+				return -EPERM;
+			}
+		} else {
+			get_net(net);
+		}
+	} else {
+		get_net(net);
 	}
 
-	for (h = s_h; h < NETDEV_HASHENTRIES; h++, s_idx = 0) {
-		idx = 0;
-		head = &net->dev_index_head[h];
-		hlist_for_each_entry(dev, head, index_hlist) {
-			if (idx < s_idx)
-				goto cont;
-			err = rtnl_fill_ifinfo(skb, dev, RTM_NEWLINK,
-					       NETLINK_CB(cb->skb).portid,
-					       cb->nlh->nlmsg_seq, 0,
-					       NLM_F_MULTI,
-					       ext_filter_mask);
-			/* If we ran out of room on the first message,
-			 * we're in trouble
-			 */
-			WARN_ON((err == -EMSGSIZE) && (skb->len == 0));
+	cb->seq = net->dev_base_seq;
 
-			if (err < 0)
-				goto out;
+	rcu_read_lock();
+	while ((dev = rtnl_dump_next_dev(net, ifindex))) {
+		if (rtnl_dump_dev_filtered(dev, master_idx, kind)) {
+			ifindex = dev->ifindex;
+			continue;
+		}
 
-			nl_dump_check_consistent(cb, nlmsg_hdr(skb));
-cont:
-			idx++;
+		/*
+		 * Filling in a device still needs rtnl. Keep it for the rest
+		 * of this skb and look the device up again under it.
+		 */
+		if (!locked) {
+			rcu_read_unlock();
+			rtnl_lock();
+			locked = true;
+			continue;
 		}
+
+		err = rtnl_fill_ifinfo(skb, dev, RTM_NEWLINK,
+				       NETLINK_CB(cb->skb).portid,
+				       cb->nlh->nlmsg_seq, 0,
+				       flags, ext_filter_mask);
+		/* If we ran out of room on the first message,
+		 * we're in trouble
+		 */
+		WARN_ON((err == -EMSGSIZE) && (skb->len == 0));
+
+		if (err < 0)
+			break;
+
+		nl_dump_check_consistent(cb, nlmsg_hdr(skb));
+		ifindex = dev->ifindex;
 	}
-out:
-	cb->args[1] = idx;
-	cb->args[0] = h;
+	if (locked)
+		rtnl_unlock();
+	else
+		rcu_read_unlock();
+
+	cb->args[0] = ifindex;
+	put_net(net);
 
 	return skb->len;
 }
@@ -1816,7 +2006,9 @@ static int do_setlink(const struct sk_buff *skb,
 		if (dev->tx_queue_len ^ value)
 			status |= DO_SETLINK_NOTIFY;
 
-		dev->tx_queue_len = value;
+		err = dev_change_tx_queue_len(dev, value);
+		if (err)
+			goto errout;
 	}
 
 	if (tb[IFLA_OPERSTATE])
@@ -1931,6 +2123,23 @@ static int do_setlink(const struct sk_buff *skb,
 		status |= DO_SETLINK_NOTIFY;
 	}
 
+	if (tb[IFLA_XDP]) {
+		struct nlattr *xdp[IFLA_XDP_MAX + 1];
+
+		err = nla_parse_nested(xdp, IFLA_XDP_MAX, tb[IFLA_XDP],
+				       ifla_xdp_policy);
+		if (err < 0)
+			goto errout;
+
+		if (xdp[IFLA_XDP_FD]) {
+			err = dev_change_xdp_fd(dev,
+						nla_get_s32(xdp[IFLA_XDP_FD]));
+			if (err)
+				goto errout;
+			status |= DO_SETLINK_NOTIFY;
+		}
+	}
+
 errout:
 	if (status & DO_SETLINK_MODIFIED) {
 		if (status & DO_SETLINK_NOTIFY)
@@ -3377,6 +3586,7 @@ static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 		rtnl_dumpit_func dumpit;
 		rtnl_calcit_func calcit;
 		u16 min_dump_alloc = 0;
+		unsigned int flags;
 
 		dumpit = rtnl_get_dumpit(family, type);
 		if (dumpit == NULL)
@@ -3384,6 +3594,7 @@ static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 		calcit = rtnl_get_calcit(family, type);
 		if (calcit)
 			min_dump_alloc = calcit(skb, nlh);
+		flags = rtnl_get_flags(family, type);
 
 		__rtnl_unlock();
 		rtnl = net->rtnl;
@@ -3391,6 +3602,7 @@ static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 			struct netlink_dump_control c = {
 				.dump		= dumpit,
 				.min_dump_alloc	= min_dump_alloc,
+				.unlocked	= flags & RTNL_FLAG_DUMP_UNLOCKED,
 			};
 			err = netlink_dump_start(rtnl, skb, nlh, &c);
 		}
@@ -3478,8 +3690,9 @@ void __init rtnetlink_init(void)
 
 	register_netdevice_notifier(&rtnetlink_dev_notifier);
 
-	rtnl_register(PF_UNSPEC, RTM_GETLINK, rtnl_getlink,
-		      rtnl_dump_ifinfo, rtnl_calcit);
+	rtnl_register_flags(PF_UNSPEC, RTM_GETLINK, rtnl_getlink,
+			    rtnl_dump_ifinfo, rtnl_calcit,
+			    RTNL_FLAG_DUMP_UNLOCKED);
 	rtnl_register(PF_UNSPEC, RTM_SETLINK, rtnl_setlink, NULL, NULL);
 	rtnl_register(PF_UNSPEC, RTM_NEWLINK, rtnl_newlink, NULL, NULL);
 	rtnl_register(PF_UNSPEC, RTM_DELLINK, rtnl_dellink, NULL, NULL);
@@ -70,12 +70,14 @@
 #include <net/checksum.h>
 #include <net/ip6_checksum.h>
 #include <net/xfrm.h>
+#include <net/page_pool.h>
 
 #include <asm/uaccess.h>
 #include <trace/events/skb.h>
 #include <linux/highmem.h>
 #include <linux/capability.h>
 #include <linux/user_namespace.h>
+#include <linux/async_tx.h>
 
 struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
@@ -300,16 +302,12 @@ EXPORT_SYMBOL(__alloc_skb);
  *  before giving packet to stack.
  *  RX rings only contains data buffers, not full skbs.
  */
-struct sk_buff *__build_skb(void *data, unsigned int frag_size)
+static void __build_skb_around(struct sk_buff *skb, void *data,
+			       unsigned int frag_size)
 {
 	struct skb_shared_info *shinfo;
-	struct sk_buff *skb;
 	unsigned int size = frag_size ? : ksize(data);
 
-	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
-	if (!skb)
-		return NULL;
-
 	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 
 	memset(skb, 0, offsetof(struct sk_buff, tail));
@@ -327,6 +325,17 @@ struct sk_buff *__build_skb(void *data, unsigned int frag_size)
 	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
 	atomic_set(&shinfo->dataref, 1);
 	kmemcheck_annotate_variable(shinfo->destructor_arg);
+}
+
+struct sk_buff *__build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
+
+	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+
+	__build_skb_around(skb, data, frag_size);
 
 	return skb;
 }
@@ -349,8 +358,67 @@ struct sk_buff *build_skb(void *data, unsigned int frag_size)
 }
 EXPORT_SYMBOL(build_skb);
 
+#define NAPI_SKB_CACHE_SIZE	64
+#define NAPI_SKB_CACHE_BULK	16
+#define NAPI_SKB_CACHE_HALF	(NAPI_SKB_CACHE_SIZE / 2)
+
+/*
+ * Only ever touched from softirq context. Besides the page frags for rx
+ * heads it keeps skbuff_head_cache objects freed by napi_consume_skb(),
+ * which the NAPI allocations reuse before going back to the slab; both
+ * directions go to the slab in bulk.
+ */
+struct napi_alloc_cache {
+	struct page_frag_cache page;
+	unsigned int skb_count;
+	void *skb_cache[NAPI_SKB_CACHE_SIZE];
+};
+
 static DEFINE_PER_CPU(struct page_frag_cache, netdev_alloc_cache);
-static DEFINE_PER_CPU(struct page_frag_cache, napi_alloc_cache);
+static DEFINE_PER_CPU(struct napi_alloc_cache, napi_alloc_cache);
+
+static struct sk_buff *napi_skb_cache_get(void)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+
+	if (unlikely(!nc->skb_count))
+		nc->skb_count = kmem_cache_alloc_bulk(skbuff_head_cache,
+						      GFP_ATOMIC,
+						      NAPI_SKB_CACHE_BULK,
+						      nc->skb_cache);
+	if (unlikely(!nc->skb_count))
+		return NULL;
+
+	return nc->skb_cache[--nc->skb_count];
+}
+
+/**
+ * napi_build_skb - build_skb() for NAPI context
+ * @data: data buffer provided by caller
+ * @frag_size: size of data, or 0 if head was kmalloced
+ *
+ * Same as build_skb(), but takes the skb from the per-cpu NAPI cache, so
+ * may only be called from softirq context.
+ */
+struct sk_buff *napi_build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
+
+	skb = napi_skb_cache_get();
+	if (unlikely(!skb))
+		return NULL;
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	__build_skb_around(skb, data, frag_size);
+
+	if (frag_size) {
+		skb->head_frag = 1;
+		if (page_is_pfmemalloc(virt_to_head_page(data)))
+			skb->pfmemalloc = 1;
+	}
+	return skb;
+}
+EXPORT_SYMBOL(napi_build_skb);
 
 static void *__netdev_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
 {
@@ -380,9 +448,9 @@ EXPORT_SYMBOL(netdev_alloc_frag);
 
 static void *__napi_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
 {
-	struct page_frag_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
 
-	return __alloc_page_frag(nc, fragsz, gfp_mask);
+	return __alloc_page_frag(&nc->page, fragsz, gfp_mask);
 }
 
 void *napi_alloc_frag(unsigned int fragsz)
@@ -476,7 +544,7 @@ EXPORT_SYMBOL(__netdev_alloc_skb);
 struct sk_buff *__napi_alloc_skb(struct napi_struct *napi, unsigned int len,
 				 gfp_t gfp_mask)
 {
-	struct page_frag_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
 	struct sk_buff *skb;
 	void *data;
 
@@ -496,21 +564,16 @@ struct sk_buff *__napi_alloc_skb(struct napi_struct *napi, unsigned int len,
 	if (sk_memalloc_socks())
 		gfp_mask |= __GFP_MEMALLOC;
 
-	data = __alloc_page_frag(nc, len, gfp_mask);
+	data = __alloc_page_frag(&nc->page, len, gfp_mask);
 	if (unlikely(!data))
 		return NULL;
 
-	skb = __build_skb(data, len);
+	skb = napi_build_skb(data, len);
 	if (unlikely(!skb)) {
 		skb_free_frag(data);
 		return NULL;
 	}
 
-	/* use OR instead of assignment to avoid clearing of bits in mask */
-	if (nc->pfmemalloc)
-		skb->pfmemalloc = 1;
-	skb->head_frag = 1;
-
 skb_success:
 	skb_reserve(skb, NET_SKB_PAD + NET_IP_ALIGN);
 	skb->dev = napi->dev;
@@ -565,10 +628,14 @@ static void skb_free_head(struct sk_buff *skb)
 {
 	unsigned char *head = skb->head;
 
-	if (skb->head_frag)
+	if (skb->head_frag) {
+		if (skb->pp_recycle &&
+		    page_pool_return_skb_page(virt_to_head_page(head)))
+			return;
 		skb_free_frag(head);
-	else
+	} else {
 		kfree(head);
+	}
 }
 
 static void skb_release_data(struct sk_buff *skb)
@@ -581,8 +648,12 @@ static void skb_release_data(struct sk_buff *skb)
 			      &shinfo->dataref))
 		return;
 
-	for (i = 0; i < shinfo->nr_frags; i++)
+	for (i = 0; i < shinfo->nr_frags; i++) {
+		if (skb->pp_recycle &&
+		    page_pool_return_skb_page(skb_frag_page(&shinfo->frags[i])))
+			continue;
 		__skb_frag_unref(&shinfo->frags[i]);
+	}
 
 	/*
 	 * If skb buf is from userspace, we need to notify the caller
@@ -749,6 +820,71 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+static inline void _kfree_skb_defer(struct sk_buff *skb)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+
+	/* drop skb->head and call any destructors for packet */
+	skb_release_all(skb);
+
+	/* record skb to CPU local list */
+	nc->skb_cache[nc->skb_count++] = skb;
+
+#ifdef CONFIG_SLUB
+	/* SLUB writes into objects when freeing */
+	prefetchw(skb);
+#endif
+
+	/* keep half for the NAPI allocations, free the rest in one go */
+	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_HALF,
+				     nc->skb_cache + NAPI_SKB_CACHE_HALF);
+		nc->skb_count = NAPI_SKB_CACHE_HALF;
+	}
+}
+
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	_kfree_skb_defer(skb);
+}
+
+/**
+ *	napi_consume_skb - free an skbuff from NAPI context
+ *	@skb: buffer to free
+ *	@budget: NAPI budget of the caller, 0 if not called from NAPI
+ *
+ *	Same as consume_skb(), but the sk_buff itself goes to a per-cpu
+ *	cache instead of straight back to the slab. It is reused by
+ *	napi_alloc_skb() and napi_build_skb() or freed in bulk.
+ */
+void napi_consume_skb(struct sk_buff *skb, int budget)
+{
+	if (unlikely(!skb))
+		return;
+
+	/* Zero budget indicate non-NAPI context called us, like netpoll */
+	if (unlikely(!budget)) {
+		dev_consume_skb_any(skb);
+		return;
+	}
+
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	/* if reaching here SKB is ready to free */
+	trace_consume_skb(skb);
+
+	/* if SKB is a clone, don't handle this case */
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		__kfree_skb(skb);
+		return;
+	}
+
+	_kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 /* Make sure a field is enclosed inside headers_start/headers_end section */
 #define CHECK_SKB_FIELD(field) \
 	BUILD_BUG_ON(offsetof(struct sk_buff, field) <		\
@@ -978,6 +1114,8 @@ static void skb_headers_offset_update(struct sk_buff *skb, int off)
 	skb->inner_transport_header += off;
 	skb->inner_network_header += off;
 	skb->inner_mac_header += off;
+	skb->flow_cache.nhoff += off;
+	skb->flow_cache.thoff += off;
 }
 
 static void copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
@@ -1013,6 +1151,9 @@ static inline int skb_alloc_rx_flag(const struct sk_buff *skb)
  *	header is going to be modified. Use pskb_copy() instead.
  */
 
+static int skb_copy_bits_gfp(const struct sk_buff *skb, int offset, void *to,
+			     int len, gfp_t gfp_mask);
+
 struct sk_buff *skb_copy(const struct sk_buff *skb, gfp_t gfp_mask)
 {
 	int headerlen = skb_headroom(skb);
@@ -1028,7 +1169,8 @@ struct sk_buff *skb_copy(const struct sk_buff *skb, gfp_t gfp_mask)
 	/* Set the tail pointer and length */
 	skb_put(n, skb->len);
 
-	if (skb_copy_bits(skb, -headerlen, n->head, headerlen + skb->len))
+	if (skb_copy_bits_gfp(skb, -headerlen, n->head, headerlen + skb->len,
+			      gfp_mask))
 		BUG();
 
 	copy_skb_header(n, skb);
@@ -1261,8 +1403,8 @@ struct sk_buff *skb_copy_expand(const struct sk_buff *skb,
 		head_copy_off = newheadroom - head_copy_len;
 
 	/* Copy the linear header and data. */
-	if (skb_copy_bits(skb, -head_copy_len, n->head + head_copy_off,
-			  skb->len + head_copy_len))
+	if (skb_copy_bits_gfp(skb, -head_copy_len, n->head + head_copy_off,
+			      skb->len + head_copy_len, gfp_mask))
 		BUG();
 
 	copy_skb_header(n, skb);
@@ -1642,22 +1784,12 @@ pull_pages:
 }
 EXPORT_SYMBOL(__pskb_pull_tail);
 
-/**
- *	skb_copy_bits - copy bits from skb to kernel buffer
- *	@skb: source skb
- *	@offset: offset in source
- *	@to: destination buffer
- *	@len: number of bytes to copy
- *
- *	Copy the specified number of bytes from the source skb to the
- *	destination buffer.
- *
- *	CAUTION ! :
- *		If its prototype is ever changed,
- *		check arch/{*}/net/{*}.S files,
- *		since it is called from BPF assembly code.
+/*
+ * Copies the page fragments through async_copy_page() on @ac, if not NULL.
+ * @to has to be in the linear mapping then, which skb heads are.
  */
-int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
+static int __skb_copy_bits(const struct sk_buff *skb, int offset, void *to,
+			   int len, struct async_copy *ac)
 {
 	int start = skb_headlen(skb);
 	struct sk_buff *frag_iter;
@@ -1690,11 +1822,19 @@ int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 			if (copy > len)
 				copy = len;
 
-			vaddr = kmap_atomic(skb_frag_page(f));
-			memcpy(to,
-			       vaddr + f->page_offset + offset - start,
-			       copy);
-			kunmap_atomic(vaddr);
+			if (ac) {
+				async_copy_page(ac, virt_to_page(to),
+						offset_in_page(to),
+						skb_frag_page(f),
+						f->page_offset + offset - start,
+						copy);
+			} else {
+				vaddr = kmap_atomic(skb_frag_page(f));
+				memcpy(to,
+				       vaddr + f->page_offset + offset - start,
+				       copy);
+				kunmap_atomic(vaddr);
+			}
 
 			if ((len -= copy) == 0)
 				return 0;
@@ -1713,7 +1853,8 @@ int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 		if ((copy = end - offset) > 0) {
 			if (copy > len)
 				copy = len;
-			if (skb_copy_bits(frag_iter, offset - start, to, copy))
+			if (__skb_copy_bits(frag_iter, offset - start, to, copy,
+					    ac))
 				goto fault;
 			if ((len -= copy) == 0)
 				return 0;
@@ -1729,8 +1870,50 @@ int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 fault:
 	return -EFAULT;
 }
+
+/**
+ *	skb_copy_bits - copy bits from skb to kernel buffer
+ *	@skb: source skb
+ *	@offset: offset in source
+ *	@to: destination buffer
+ *	@len: number of bytes to copy
+ *
+ *	Copy the specified number of bytes from the source skb to the
+ *	destination buffer.
+ *
+ *	CAUTION ! :
+ *		If its prototype is ever changed,
+ *		check arch/{*}/net/{*}.S files,
+ *		since it is called from BPF assembly code.
+ */
+int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
+{
+	return __skb_copy_bits(skb, offset, to, len, NULL);
+}
 EXPORT_SYMBOL(skb_copy_bits);
 
+/*
+ * skb_copy_bits() for the full copies made with @gfp_mask.  If that allows
+ * sleeping, large page fragments are left to a dma engine and we sleep
+ * until it is done, instead of spending the CPU on them.
+ */
+static int skb_copy_bits_gfp(const struct sk_buff *skb, int offset, void *to,
+			     int len, gfp_t gfp_mask)
+{
+	struct async_copy ac;
+	int err;
+
+	if (!gfpflags_allow_blocking(gfp_mask) ||
+	    !async_copy_worthwhile(skb->data_len))
+		return skb_copy_bits(skb, offset, to, len);
+
+	async_copy_init(&ac);
+	err = __skb_copy_bits(skb, offset, to, len, &ac);
+	async_copy_wait(&ac);
+
+	return err;
+}
+
 /*
  * Callback from splice_to_pipe(), if we need to release some pages
  * at the end of the spd in case we error'ed out in filling the pipe.
@@ -4147,6 +4330,10 @@ bool skb_try_coalesce(struct sk_buff *to, struct sk_buff *from,
 	if (skb_has_frag_list(to) || skb_has_frag_list(from))
 		return false;
 
+	/* page_pool pages must only be freed by skbs that know about them */
+	if (to->pp_recycle != from->pp_recycle)
+		return false;
+
 	if (skb_headlen(from) != 0) {
 		struct page *page;
 		unsigned int offset;
@@ -4255,6 +4442,8 @@ unsigned int skb_gso_transport_seglen(const struct sk_buff *skb)
 			thlen += inner_tcp_hdrlen(skb);
 	} else if (likely(shinfo->gso_type & (SKB_GSO_TCPV4 | SKB_GSO_TCPV6))) {
 		thlen = tcp_hdrlen(skb);
+	} else if (shinfo->gso_type & SKB_GSO_UDP_L4) {
+		thlen = sizeof(struct udphdr);
 	}
 	/* UFO sets gso_size to the size of the fragmentation
 	 * payload, i.e. the size of the L4 (UDP) header is already
@@ -4322,6 +4511,9 @@ int skb_ensure_writable(struct sk_buff *skb, int write_len)
 	if (!pskb_may_pull(skb, write_len))
 		return -ENOMEM;
 
+	/* the headers are about to be rewritten */
+	skb_clear_flow_cache(skb);
+
 	if (!skb_cloned(skb) || skb_clone_writable(skb, write_len))
 		return 0;
 
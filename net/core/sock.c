@@ -119,6 +119,7 @@
 #include <linux/prefetch.h>
 
 #include <asm/uaccess.h>
+#include <asm/unaligned.h>
 
 #include <linux/netdevice.h>
 #include <net/protocol.h>
@@ -685,6 +686,39 @@ EXPORT_SYMBOL(sk_mc_loop);
  *	at the socket level. Everything here is generic.
  */
 
+static int sock_set_txtime(struct sock *sk, char __user *optval,
+			   unsigned int optlen)
+{
+	struct sock_txtime sk_txtime;
+
+	if (optlen != sizeof(sk_txtime))
+		return -EINVAL;
+	if (copy_from_user(&sk_txtime, optval, sizeof(sk_txtime)))
+		return -EFAULT;
+	if (sk_txtime.flags & ~SOF_TXTIME_FLAGS_MASK)
+		return -EINVAL;
+
+	switch (sk_txtime.clockid) {
+	case CLOCK_MONOTONIC:
+		break;
+	case CLOCK_REALTIME:
+	case CLOCK_TAI:
+	case CLOCK_BOOTTIME:
+		/* only the monotonic clock can't be set from under a qdisc */
+		if (!ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))
+			return -EPERM;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	sock_valbool_flag(sk, SOCK_TXTIME, true);
+	sk->sk_clockid = sk_txtime.clockid;
+	sk->sk_txtime_deadline_mode =
+		!!(sk_txtime.flags & SOF_TXTIME_DEADLINE_MODE);
+	return 0;
+}
+
 int sock_setsockopt(struct socket *sock, int level, int optname,
 		    char __user *optval, unsigned int optlen)
 {
@@ -1003,6 +1037,10 @@ set_rcvbuf:
 		sk->sk_incoming_cpu = val;
 		break;
 
+	case SO_TXTIME:
+		ret = sock_set_txtime(sk, optval, optlen);
+		break;
+
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -1035,6 +1073,7 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		int val;
 		struct linger ling;
 		struct timeval tm;
+		struct sock_txtime txtime;
 	} v;
 
 	int lv = sizeof(int);
@@ -1263,6 +1302,20 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sk->sk_incoming_cpu;
 		break;
 
+	case SO_TXTIME:
+		lv = sizeof(v.txtime);
+		v.txtime.clockid = sk->sk_clockid;
+		v.txtime.flags = sk->sk_txtime_deadline_mode ?
+				 SOF_TXTIME_DEADLINE_MODE : 0;
+		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	/* lets event loops group sockets by the context they busy poll */
+	case SO_INCOMING_NAPI_ID:
+		v.val = READ_ONCE(sk->sk_napi_id);
+		break;
+#endif
+
 	default:
 		/* We implement the SO_SNDLOWAT etc to not be settable
 		 * (1003.1g 7).
@@ -1889,27 +1942,46 @@ struct sk_buff *sock_alloc_send_skb(struct sock *sk, unsigned long size,
 }
 EXPORT_SYMBOL(sock_alloc_send_skb);
 
+/* One SOL_SOCKET control message, for callers parsing the others */
+int __sock_cmsg_send(struct sock *sk, struct msghdr *msg, struct cmsghdr *cmsg,
+		     struct sockcm_cookie *sockc)
+{
+	switch (cmsg->cmsg_type) {
+	case SO_MARK:
+		if (!ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))
+			return -EPERM;
+		if (cmsg->cmsg_len != CMSG_LEN(sizeof(u32)))
+			return -EINVAL;
+		sockc->mark = *(u32 *)CMSG_DATA(cmsg);
+		break;
+	case SCM_TXTIME:
+		if (!sock_flag(sk, SOCK_TXTIME))
+			return -EINVAL;
+		if (cmsg->cmsg_len != CMSG_LEN(sizeof(u64)))
+			return -EINVAL;
+		sockc->transmit_time = get_unaligned((u64 *)CMSG_DATA(cmsg));
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(__sock_cmsg_send);
+
 int sock_cmsg_send(struct sock *sk, struct msghdr *msg,
 		   struct sockcm_cookie *sockc)
 {
 	struct cmsghdr *cmsg;
+	int ret;
 
 	for_each_cmsghdr(cmsg, msg) {
 		if (!CMSG_OK(msg, cmsg))
 			return -EINVAL;
 		if (cmsg->cmsg_level != SOL_SOCKET)
 			continue;
-		switch (cmsg->cmsg_type) {
-		case SO_MARK:
-			if (!ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))
-				return -EPERM;
-			if (cmsg->cmsg_len != CMSG_LEN(sizeof(u32)))
-				return -EINVAL;
-			sockc->mark = *(u32 *)CMSG_DATA(cmsg);
-			break;
-		default:
-			return -EINVAL;
-		}
+		ret = __sock_cmsg_send(sk, msg, cmsg, sockc);
+		if (ret)
+			return ret;
 	}
 	return 0;
 }
@@ -2418,6 +2490,9 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 	sk->sk_max_pacing_rate = ~0U;
 	sk->sk_pacing_rate = ~0U;
 	sk->sk_incoming_cpu = -1;
+#ifdef CONFIG_XPS
+	sk->sk_rx_queue_mapping = -1;
+#endif
 	/*
 	 * Before updating sk_refcnt, we must commit prior changes to memory
 	 * (Documentation/RCU/rculist_nulls.txt for details)
@@ -31,11 +31,48 @@ static int max_skb_frags = MAX_SKB_FRAGS;
 static int net_msg_warn;	/* Unused, but still a sysctl */
 
 #ifdef CONFIG_RPS
+/*
+ * Copy the live entries of a table that is being replaced. Readers and
+ * rps_record_sock_flow() keep using @from meanwhile, updates that race
+ * with the copy are lost, which only costs a steering hint.
+ */
+static void rps_sock_flow_migrate(const struct rps_sock_flow_table *from,
+				  struct rps_sock_flow_table *to)
+{
+	u16 gen = READ_ONCE(from->gen);
+	u32 i;
+
+	to->gen = gen;
+	for (i = 0; i <= from->mask; i++) {
+		u64 ent = READ_ONCE(from->ents[i]);
+
+		if (RPS_SOCK_FLOW_ENT_GEN(ent) != gen)
+			continue;
+		to->ents[RPS_SOCK_FLOW_ENT_HASH(ent) & to->mask] = ent;
+	}
+}
+
+/* Invalidate all entries of a live table by starting a new generation. */
+static void rps_sock_flow_flush(struct rps_sock_flow_table *table)
+{
+	u16 gen = table->gen + 1;
+
+	/* on wrap around, stale entries could match again */
+	if (!gen) {
+		u32 i;
+
+		for (i = 0; i <= table->mask; i++)
+			WRITE_ONCE(table->ents[i], 0);
+		gen = 1;
+	}
+	WRITE_ONCE(table->gen, gen);
+}
+
 static int rps_sock_flow_sysctl(struct ctl_table *table, int write,
 				void __user *buffer, size_t *lenp, loff_t *ppos)
 {
 	unsigned int orig_size, size;
-	int ret, i;
+	int ret;
 	struct ctl_table tmp = {
 		.data = &size,
 		.maxlen = sizeof(size),
@@ -62,18 +99,21 @@ static int rps_sock_flow_sysctl(struct ctl_table *table, int write,
 			size = roundup_pow_of_two(size);
 			if (size != orig_size) {
 				sock_table =
-				    vmalloc(RPS_SOCK_FLOW_TABLE_SIZE(size));
+				    vzalloc(RPS_SOCK_FLOW_TABLE_SIZE(size));
 				if (!sock_table) {
 					mutex_unlock(&sock_flow_mutex);
 					return -ENOMEM;
 				}
-				rps_cpu_mask = roundup_pow_of_two(nr_cpu_ids) - 1;
 				sock_table->mask = size - 1;
-			} else
+				sock_table->gen = 1;
+				/* keep steering the flows we know about */
+				if (orig_sock_table)
+					rps_sock_flow_migrate(orig_sock_table,
+							      sock_table);
+			} else {
 				sock_table = orig_sock_table;
-
-			for (i = 0; i < size; i++)
-				sock_table->ents[i] = RPS_NO_CPU;
+				rps_sock_flow_flush(sock_table);
+			}
 		} else
 			sock_table = NULL;
 
@@ -25,6 +25,8 @@
 #include <linux/proc_fs.h>
 #include <linux/err.h>
 #include <linux/cpumask.h>
+#include <linux/jhash.h>
+#include <linux/sort.h>
 
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter_ipv4/ip_tables.h>
@@ -282,6 +284,146 @@ struct ipt_entry *ipt_next_entry(const struct ipt_entry *entry)
 	return (void *)entry + entry->next_offset;
 }
 
+/*
+ * Rule lookup index.
+ *
+ * Rules that match a single source or destination address (full mask, not
+ * inverted) can only match packets carrying that address. At translate
+ * time such rules are grouped per address in two hashes, all other rules
+ * go to a wildcard list; every list holds rule numbers in table order.
+ *
+ * ipt_do_table() evaluates rules in table order starting from wherever the
+ * last jump, return or mismatch left it. Instead of stepping to the next
+ * rule it asks the index for the first rule at or after that position that
+ * is in the packet's source list, destination list or the wildcard list.
+ * Every rule it skips would have failed ip_packet_match(), so verdicts,
+ * counters and traces are exactly those of linear evaluation.
+ *
+ * The position of the current rule is carried along as the loop steps
+ * through the table, and only looked up again after a jump or return.
+ * The next wildcard rule is precomputed for every position: on a chain of
+ * wildcard rules the index then costs one array load per rule.
+ */
+#define IPT_INDEX_MIN_ENTRIES	64
+#define IPT_INDEX_NOPOS		U32_MAX
+
+struct ipt_index_slot {
+	__be32		addr;
+	u32		first;
+	u32		len;		/* 0: empty slot */
+};
+
+struct ipt_index_hash {
+	const struct ipt_index_slot	*slots;
+	const u32			*list;
+	unsigned int			mask;
+};
+
+struct ipt_index {
+	unsigned int		num;
+	const u32		*offsets;	/* rule number -> offset */
+	const u32		*next_wild;	/* rule number -> next wildcard rule */
+	struct ipt_index_hash	src;
+	struct ipt_index_hash	dst;
+};
+
+/* Rule lists for the addresses of one packet */
+struct ipt_index_cand {
+	const u32		*src;
+	const u32		*dst;
+	unsigned int		nsrc;
+	unsigned int		ndst;
+};
+
+static const struct ipt_index_slot *
+ipt_index_find(const struct ipt_index_hash *h, __be32 addr)
+{
+	unsigned int i = jhash_1word((__force u32)addr, 0) & h->mask;
+
+	while (h->slots[i].len) {
+		if (h->slots[i].addr == addr)
+			return &h->slots[i];
+		i = (i + 1) & h->mask;
+	}
+	return NULL;
+}
+
+static void ipt_index_cand(const struct ipt_index *idx,
+			   const struct iphdr *ip, struct ipt_index_cand *c)
+{
+	const struct ipt_index_slot *slot;
+
+	c->nsrc = c->ndst = 0;
+	c->src = c->dst = NULL;
+
+	slot = ipt_index_find(&idx->src, ip->saddr);
+	if (slot) {
+		c->src = idx->src.list + slot->first;
+		c->nsrc = slot->len;
+	}
+	slot = ipt_index_find(&idx->dst, ip->daddr);
+	if (slot) {
+		c->dst = idx->dst.list + slot->first;
+		c->ndst = slot->len;
+	}
+}
+
+/* Index of the first element of the sorted @list that is not below @val */
+static inline unsigned int ipt_index_bsearch(const u32 *list, unsigned int n,
+					     u32 val)
+{
+	unsigned int lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (list[mid] < val)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static inline u32 ipt_index_next(const u32 *list, unsigned int n, u32 pos)
+{
+	unsigned int i = ipt_index_bsearch(list, n, pos);
+
+	return i < n ? list[i] : U32_MAX;
+}
+
+/*
+ * Returns the first rule at or after @e that the packet may match. *@pos is
+ * the rule number of @e, or IPT_INDEX_NOPOS after a jump, and is updated to
+ * that of the rule returned.
+ */
+static struct ipt_entry *
+ipt_index_skip(const struct ipt_index *idx, const struct ipt_index_cand *c,
+	       const void *table_base, struct ipt_entry *e, u32 *pos)
+{
+	u32 p = *pos, next;
+
+	if (p == IPT_INDEX_NOPOS) {
+		unsigned int off = (const void *)e - table_base;
+
+		p = ipt_index_bsearch(idx->offsets, idx->num, off);
+		if (unlikely(p == idx->num || idx->offsets[p] != off))
+			return e;
+		*pos = p;
+	}
+
+	next = idx->next_wild[p];
+	if (next == p)
+		return e;
+
+	next = min3(next, ipt_index_next(c->src, c->nsrc, p),
+		    ipt_index_next(c->dst, c->ndst, p));
+	if (next == U32_MAX)
+		return e;
+
+	*pos = next;
+	return get_entry(table_base, idx->offsets[next]);
+}
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff *skb,
@@ -298,6 +440,9 @@ ipt_do_table(struct sk_buff *skb,
 	struct ipt_entry *e, **jumpstack;
 	unsigned int stackidx, cpu;
 	const struct xt_table_info *private;
+	const struct ipt_index *index;
+	struct ipt_index_cand cand;
+	u32 ipos = IPT_INDEX_NOPOS;
 	struct xt_action_param acpar;
 	unsigned int addend;
 
@@ -333,6 +478,9 @@ ipt_do_table(struct sk_buff *skb,
 	smp_read_barrier_depends();
 	table_base = private->entries;
 	jumpstack  = (struct ipt_entry **)private->jumpstack[cpu];
+	index      = private->index;
+	if (index)
+		ipt_index_cand(index, ip, &cand);
 
 	/* Switch to alternate jumpstack if we're being invoked via TEE.
 	 * TEE issues XT_CONTINUE verdict on original skb so we must not
@@ -356,10 +504,14 @@ ipt_do_table(struct sk_buff *skb,
 		struct xt_counters *counter;
 
 		IP_NF_ASSERT(e);
+		if (index)
+			e = ipt_index_skip(index, &cand, table_base, e, &ipos);
 		if (!ip_packet_match(ip, indev, outdev,
 		    &e->ip, acpar.fragoff)) {
  no_match:
 			e = ipt_next_entry(e);
+			if (ipos != IPT_INDEX_NOPOS)
+				ipos++;
 			continue;
 		}
 
@@ -404,6 +556,7 @@ ipt_do_table(struct sk_buff *skb,
 						 e, stackidx);
 					e = ipt_next_entry(e);
 				}
+				ipos = IPT_INDEX_NOPOS;
 				continue;
 			}
 			if (table_base + v != ipt_next_entry(e) &&
@@ -414,6 +567,7 @@ ipt_do_table(struct sk_buff *skb,
 			}
 
 			e = get_entry(table_base, v);
+			ipos = IPT_INDEX_NOPOS;
 			continue;
 		}
 
@@ -423,9 +577,13 @@ ipt_do_table(struct sk_buff *skb,
 		verdict = t->u.kernel.target->target(skb, &acpar);
 		/* Target might have changed stuff. */
 		ip = ip_hdr(skb);
-		if (verdict == XT_CONTINUE)
+		if (verdict == XT_CONTINUE) {
+			if (index)
+				ipt_index_cand(index, ip, &cand);
 			e = ipt_next_entry(e);
-		else
+			if (ipos != IPT_INDEX_NOPOS)
+				ipos++;
+		} else
 			/* Verdict */
 			break;
 	} while (!acpar.hotdrop);
@@ -804,6 +962,161 @@ cleanup_entry(struct ipt_entry *e, struct net *net)
 	xt_percpu_counter_free(e->counters.pcnt);
 }
 
+enum {
+	IPT_INDEX_WILD,
+	IPT_INDEX_SRC,
+	IPT_INDEX_DST,
+};
+
+static unsigned int ipt_index_class(const struct ipt_ip *ip)
+{
+	if (ip->dmsk.s_addr == htonl(0xFFFFFFFF) &&
+	    !(ip->invflags & IPT_INV_DSTIP))
+		return IPT_INDEX_DST;
+	if (ip->smsk.s_addr == htonl(0xFFFFFFFF) &&
+	    !(ip->invflags & IPT_INV_SRCIP))
+		return IPT_INDEX_SRC;
+	return IPT_INDEX_WILD;
+}
+
+/* Sort keys are the address in the upper and the rule number in the lower
+ * half, so every address ends up with its rules in table order.
+ */
+static int ipt_index_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static unsigned int ipt_index_distinct(const u64 *keys, unsigned int n)
+{
+	unsigned int i, d = 0;
+
+	for (i = 0; i < n; i++)
+		if (i == 0 || keys[i] >> 32 != keys[i - 1] >> 32)
+			d++;
+	return d;
+}
+
+static void ipt_index_fill(struct ipt_index_hash *h,
+			   struct ipt_index_slot *slots, unsigned int nslots,
+			   u32 *list, const u64 *keys, unsigned int n)
+{
+	struct ipt_index_slot *slot = NULL;
+	unsigned int i, k;
+	__be32 addr;
+
+	h->slots = slots;
+	h->list = list;
+	h->mask = nslots - 1;
+
+	for (i = 0; i < n; i++) {
+		addr = htonl(keys[i] >> 32);
+		list[i] = (u32)keys[i];
+
+		if (slot && slot->addr == addr) {
+			slot->len++;
+			continue;
+		}
+
+		k = jhash_1word((__force u32)addr, 0) & h->mask;
+		while (slots[k].len)
+			k = (k + 1) & h->mask;
+
+		slot = &slots[k];
+		slot->addr = addr;
+		slot->first = i;
+		slot->len = 1;
+	}
+}
+
+/* Build the rule lookup index for a translated table. This is only an
+ * optimisation: on failure the table is evaluated linearly.
+ */
+static void ipt_index_build(struct xt_table_info *newinfo, void *entry0)
+{
+	unsigned int n = newinfo->number, nsrc = 0, ndst = 0, nwild = 0;
+	unsigned int i, ssize, dsize;
+	u64 *skeys = NULL, *dkeys = NULL;
+	struct ipt_index_slot *slots;
+	struct ipt_entry *iter;
+	struct ipt_index *idx;
+	u32 *offsets, *next_wild, *list;
+	size_t len;
+
+	if (n < IPT_INDEX_MIN_ENTRIES)
+		return;
+
+	skeys = vmalloc(n * sizeof(u64));
+	dkeys = vmalloc(n * sizeof(u64));
+	if (!skeys || !dkeys)
+		goto out;
+
+	i = 0;
+	xt_entry_foreach(iter, entry0, newinfo->size) {
+		switch (ipt_index_class(&iter->ip)) {
+		case IPT_INDEX_DST:
+			dkeys[ndst++] = (u64)ntohl(iter->ip.dst.s_addr) << 32 | i;
+			break;
+		case IPT_INDEX_SRC:
+			skeys[nsrc++] = (u64)ntohl(iter->ip.src.s_addr) << 32 | i;
+			break;
+		default:
+			nwild++;
+			break;
+		}
+		i++;
+	}
+
+	/* Nothing to skip over */
+	if (nwild == n)
+		goto out;
+
+	sort(skeys, nsrc, sizeof(u64), ipt_index_cmp, NULL);
+	sort(dkeys, ndst, sizeof(u64), ipt_index_cmp, NULL);
+
+	/* Keep the hashes at most half full */
+	ssize = roundup_pow_of_two(2 * ipt_index_distinct(skeys, nsrc) + 1);
+	dsize = roundup_pow_of_two(2 * ipt_index_distinct(dkeys, ndst) + 1);
+
+	len = sizeof(*idx) + (ssize + dsize) * sizeof(*slots) +
+	      (2 * n + nsrc + ndst) * sizeof(u32);
+	idx = kzalloc(len, GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+	if (!idx)
+		idx = vzalloc(len);
+	if (!idx)
+		goto out;
+
+	slots = (void *)(idx + 1);
+	offsets = (void *)(slots + ssize + dsize);
+	next_wild = offsets + n;
+	list = next_wild + n;
+
+	i = 0;
+	xt_entry_foreach(iter, entry0, newinfo->size) {
+		offsets[i] = (void *)iter - entry0;
+		next_wild[i] = ipt_index_class(&iter->ip) == IPT_INDEX_WILD ?
+			       i : U32_MAX;
+		i++;
+	}
+	for (i = n - 1; i > 0; i--)
+		if (next_wild[i - 1] == U32_MAX)
+			next_wild[i - 1] = next_wild[i];
+
+	idx->num = n;
+	idx->offsets = offsets;
+	idx->next_wild = next_wild;
+	ipt_index_fill(&idx->src, slots, ssize, list, skeys, nsrc);
+	ipt_index_fill(&idx->dst, slots + ssize, dsize, list + nsrc,
+		       dkeys, ndst);
+
+	newinfo->index = idx;
+out:
+	vfree(skeys);
+	vfree(dkeys);
+}
+
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
 static int
@@ -884,6 +1197,7 @@ translate_table(struct net *net, struct xt_table_info *newinfo, void *entry0,
 		return ret;
 	}
 
+	ipt_index_build(newinfo, entry0);
 	return ret;
 }
 
@@ -187,6 +187,27 @@ static int fib6_rule_match(struct fib_rule *rule, struct flowi *fl, int flags)
 	return 1;
 }
 
+static const void *fib6_rule_src(struct fib_rule *rule, int *plen)
+{
+	struct fib6_rule *r = (struct fib6_rule *) rule;
+
+	/* may match any source, see fib6_rule_match() */
+	if (rule->flags & FIB_RULE_FIND_SADDR) {
+		*plen = 0;
+		return NULL;
+	}
+
+	*plen = r->src.plen;
+	return &r->src.addr;
+}
+
+static const void *fib6_rule_flow_src(struct flowi *fl, int flags)
+{
+	if (flags & RT6_LOOKUP_F_HAS_SADDR)
+		return &fl->u.ip6.saddr;
+	return NULL;
+}
+
 static const struct nla_policy fib6_rule_policy[FRA_MAX+1] = {
 	FRA_GENERIC_POLICY,
 };
@@ -281,6 +302,8 @@ static const struct fib_rules_ops __net_initconst fib6_rules_ops_template = {
 	.addr_size		= sizeof(struct in6_addr),
 	.action			= fib6_rule_action,
 	.match			= fib6_rule_match,
+	.rule_src		= fib6_rule_src,
+	.flow_src		= fib6_rule_flow_src,
 	.suppress		= fib6_rule_suppress,
 	.configure		= fib6_rule_configure,
 	.compare		= fib6_rule_compare,
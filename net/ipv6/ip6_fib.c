@@ -28,6 +28,7 @@
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 #include <net/ipv6.h>
 #include <net/ndisc.h>
@@ -150,11 +151,150 @@ static struct fib6_node *node_alloc(void)
 	return fn;
 }
 
-static void node_free(struct fib6_node *fn)
+static void node_free_rcu(struct rcu_head *head)
 {
+	struct fib6_node *fn = container_of(head, struct fib6_node, rcu);
+
 	kmem_cache_free(fib6_node_kmem, fn);
 }
 
+/* Lockless lookups in ip6_pol_route may still be walking the node */
+static void node_free(struct fib6_node *fn)
+{
+	call_rcu(&fn->rcu, node_free_rcu);
+}
+
+/*
+ *	Stride index
+ *
+ *	The descent in fib6_lookup_1 only looks at the bits named by fn_bit,
+ *	so every node it passes through while fn_bit < FIB6_STRIDE_BITS is
+ *	fixed by the leading FIB6_STRIDE_BITS of the address. The main table
+ *	keeps an array of where that part of the descent ends, turning the
+ *	top of the walk into a single load. The tree itself is unchanged, and
+ *	backtracking still follows parent pointers to the root.
+ */
+
+#define FIB6_STRIDE_BITS	16
+#define FIB6_STRIDE_SIZE	(1U << FIB6_STRIDE_BITS)
+
+/* Route nodes in the namespace before the main table grows an index */
+#define FIB6_STRIDE_MIN_NODES	1024
+
+static u32 fib6_stride_bit(int fn_bit)
+{
+	return 1U << (FIB6_STRIDE_BITS - 1 - fn_bit);
+}
+
+/* Point every index whose bits under mask equal fixed at fn */
+static void fib6_stride_set(struct fib6_node **stride, struct fib6_node *fn,
+			    u32 fixed, u32 mask)
+{
+	u32 free = ~mask & (FIB6_STRIDE_SIZE - 1);
+	u32 sub = 0;
+
+	do {
+		WRITE_ONCE(stride[fixed | sub], fn);
+		sub = (sub - free) & free;
+	} while (sub);
+}
+
+static void fib6_stride_fill(struct fib6_node **stride, struct fib6_node *fn,
+			     u32 fixed, u32 mask)
+{
+	u32 m;
+
+	if (fn->fn_bit >= FIB6_STRIDE_BITS) {
+		fib6_stride_set(stride, fn, fixed, mask);
+		return;
+	}
+
+	m = fib6_stride_bit(fn->fn_bit);
+	if (fn->left)
+		fib6_stride_fill(stride, fn->left, fixed, mask | m);
+	else
+		fib6_stride_set(stride, fn, fixed, mask | m);
+
+	if (fn->right)
+		fib6_stride_fill(stride, fn->right, fixed | m, mask | m);
+	else
+		fib6_stride_set(stride, fn, fixed | m, mask | m);
+}
+
+/*
+ *	The children of pn changed, refresh the index entries whose descent
+ *	passes through it. Table write lock held.
+ */
+static void fib6_stride_update(struct fib6_node *pn)
+{
+	struct fib6_table *table;
+	struct fib6_node **stride;
+	struct fib6_node *fn;
+	u32 fixed = 0, mask = 0;
+
+	if (pn->fn_bit >= FIB6_STRIDE_BITS)
+		return;
+
+	for (fn = pn; !(fn->fn_flags & RTN_ROOT); fn = fn->parent) {
+		u32 m = fib6_stride_bit(fn->parent->fn_bit);
+
+		mask |= m;
+		if (fn->parent->right == fn)
+			fixed |= m;
+	}
+
+	/* Source address subtrees are not indexed */
+	if (!(fn->fn_flags & RTN_TL_ROOT))
+		return;
+
+	table = container_of(fn, struct fib6_table, tb6_root);
+	stride = rcu_dereference_protected(table->tb6_stride,
+					   lockdep_is_held(&table->tb6_lock));
+	if (stride)
+		fib6_stride_fill(stride, pn, fixed, mask);
+}
+
+static void fib6_stride_work(struct work_struct *work)
+{
+	struct fib6_table *table = container_of(work, struct fib6_table,
+						tb6_stride_work);
+	struct fib6_node **stride;
+
+	stride = vzalloc(FIB6_STRIDE_SIZE * sizeof(*stride));
+	if (!stride)
+		return;
+
+	/* Lockless lookups see either no index or a complete one */
+	fib6_table_write_lock(table);
+	if (!rcu_access_pointer(table->tb6_stride)) {
+		fib6_stride_fill(stride, &table->tb6_root, 0, 0);
+		rcu_assign_pointer(table->tb6_stride, stride);
+		stride = NULL;
+	}
+	fib6_table_write_unlock(table);
+
+	vfree(stride);
+}
+
+static struct fib6_node *fib6_stride_start(struct fib6_node *root,
+					   const struct in6_addr *addr)
+{
+	struct fib6_table *table;
+	struct fib6_node **stride;
+
+	if (!(root->fn_flags & RTN_TL_ROOT))
+		return root;
+
+	table = container_of(root, struct fib6_table, tb6_root);
+	stride = rcu_dereference_check(table->tb6_stride,
+				       lockdep_is_held(&table->tb6_lock));
+	if (!stride)
+		return root;
+
+	return READ_ONCE(stride[ntohl(addr->s6_addr32[0]) >>
+				(32 - FIB6_STRIDE_BITS)]);
+}
+
 static void rt6_rcu_free(struct rt6_info *rt)
 {
 	call_rcu(&rt->dst.rcu_head, dst_rcu_free);
@@ -179,8 +319,9 @@ static void rt6_free_pcpu(struct rt6_info *non_pcpu_rt)
 		}
 	}
 
-	free_percpu(non_pcpu_rt->rt6i_pcpu);
-	non_pcpu_rt->rt6i_pcpu = NULL;
+	/* The array itself goes in ip6_dst_destroy, after lockless readers
+	 * that found the route are done with it.
+	 */
 }
 
 static void rt6_release(struct rt6_info *rt)
@@ -200,6 +341,7 @@ static void fib6_link_table(struct net *net, struct fib6_table *tb)
 	 * tables aren't visible prior to being linked to the list.
 	 */
 	rwlock_init(&tb->tb6_lock);
+	seqcount_init(&tb->tb6_seq);
 
 	h = tb->tb6_id & (FIB6_TABLE_HASHSZ - 1);
 
@@ -556,6 +698,8 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 	else
 		pn->left  = ln;
 
+	fib6_stride_update(pn);
+
 	return ln;
 
 
@@ -662,6 +806,9 @@ insert_above:
 
 		fn->parent = ln;
 	}
+
+	fib6_stride_update(pn);
+
 	return ln;
 }
 
@@ -1043,6 +1190,14 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt,
 
 	err = fib6_add_rt2node(fn, rt, info, mxc);
 	if (!err) {
+		struct net *net = info->nl_net;
+
+		if (root == &net->ipv6.fib6_main_tbl->tb6_root &&
+		    !rcu_access_pointer(net->ipv6.fib6_main_tbl->tb6_stride) &&
+		    net->ipv6.rt6_stats->fib_route_nodes >=
+		    FIB6_STRIDE_MIN_NODES)
+			schedule_work(&net->ipv6.fib6_main_tbl->tb6_stride_work);
+
 		fib6_start_gc(info->nl_net, rt);
 		if (!(rt->rt6i_flags & RTF_CACHE))
 			fib6_prune_clones(info->nl_net, pn);
@@ -1112,7 +1267,7 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 	 *	Descend on a tree
 	 */
 
-	fn = root;
+	fn = fib6_stride_start(root, args->addr);
 
 	for (;;) {
 		struct fib6_node *next;
@@ -1129,7 +1284,11 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 	}
 
 	while (fn) {
-		if (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO) {
+		/* leaf can be briefly NULL for a lockless reader while the
+		 * last route of a node is deleted.
+		 */
+		if ((FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO) &&
+		    fn->leaf) {
 			struct rt6key *key;
 
 			key = (struct rt6key *) ((u8 *) fn->leaf +
@@ -1336,6 +1495,7 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 #endif
 			if (child)
 				child->parent = pn;
+			fib6_stride_update(pn);
 			nstate = FWS_R;
 #ifdef CONFIG_IPV6_SUBTREES
 		}
@@ -1684,10 +1844,10 @@ static void __fib6_clean_all(struct net *net,
 	for (h = 0; h < FIB6_TABLE_HASHSZ; h++) {
 		head = &net->ipv6.fib_table_hash[h];
 		hlist_for_each_entry_rcu(table, head, tb6_hlist) {
-			write_lock_bh(&table->tb6_lock);
+			fib6_table_write_lock(table);
 			fib6_clean_tree(net, &table->tb6_root,
 					func, false, sernum, arg);
-			write_unlock_bh(&table->tb6_lock);
+			fib6_table_write_unlock(table);
 		}
 	}
 	rcu_read_unlock();
@@ -1838,6 +1998,7 @@ static int __net_init fib6_net_init(struct net *net)
 	net->ipv6.fib6_main_tbl->tb6_root.fn_flags =
 		RTN_ROOT | RTN_TL_ROOT | RTN_RTINFO;
 	inet_peer_base_init(&net->ipv6.fib6_main_tbl->tb6_peers);
+	INIT_WORK(&net->ipv6.fib6_main_tbl->tb6_stride_work, fib6_stride_work);
 
 #ifdef CONFIG_IPV6_MULTIPLE_TABLES
 	net->ipv6.fib6_local_tbl = kzalloc(sizeof(*net->ipv6.fib6_local_tbl),
@@ -1876,6 +2037,9 @@ static void fib6_net_exit(struct net *net)
 	kfree(net->ipv6.fib6_local_tbl);
 #endif
 	inetpeer_invalidate_tree(&net->ipv6.fib6_main_tbl->tb6_peers);
+	cancel_work_sync(&net->ipv6.fib6_main_tbl->tb6_stride_work);
+	vfree(rcu_dereference_protected(net->ipv6.fib6_main_tbl->tb6_stride,
+					1));
 	kfree(net->ipv6.fib6_main_tbl);
 	kfree(net->ipv6.fib_table_hash);
 	kfree(net->ipv6.rt6_stats);
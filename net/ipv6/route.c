@@ -728,6 +728,10 @@ static struct rt6_info *rt6_select(struct fib6_node *fn, int oif, int strict)
 	if (!rt0)
 		fn->rr_ptr = rt0 = fn->leaf;
 
+	/* Only a lockless lookup can see a node losing its last route */
+	if (unlikely(!rt0))
+		return NULL;
+
 	match = find_rr_leaf(fn, rt0, rt0->rt6i_metric, oif, strict,
 			     &do_rr);
 
@@ -914,9 +918,9 @@ static int __ip6_ins_rt(struct rt6_info *rt, struct nl_info *info,
 	struct fib6_table *table;
 
 	table = rt->rt6i_table;
-	write_lock_bh(&table->tb6_lock);
+	fib6_table_write_lock(table);
 	err = fib6_add(&table->tb6_root, rt, info, mxc);
-	write_unlock_bh(&table->tb6_lock);
+	fib6_table_write_unlock(table);
 
 	return err;
 }
@@ -1013,7 +1017,7 @@ static struct rt6_info *rt6_make_pcpu_route(struct rt6_info *rt)
 	}
 
 	read_lock_bh(&table->tb6_lock);
-	if (rt->rt6i_pcpu) {
+	if (atomic_read(&rt->rt6i_ref)) {
 		p = this_cpu_ptr(rt->rt6i_pcpu);
 		prev = cmpxchg(p, NULL, pcpu_rt);
 		if (prev) {
@@ -1037,27 +1041,23 @@ static struct rt6_info *rt6_make_pcpu_route(struct rt6_info *rt)
 	return pcpu_rt;
 }
 
-static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
-				      struct flowi6 *fl6, int flags)
+/* Table read lock held, or rcu_read_lock() for a lockless lookup in which
+ * case NULL may be returned if the tree changed underneath.
+ */
+static struct rt6_info *ip6_pol_route_select(struct net *net,
+					     struct fib6_table *table, int oif,
+					     struct flowi6 *fl6, int strict)
 {
 	struct fib6_node *fn, *saved_fn;
 	struct rt6_info *rt;
-	int strict = 0;
-
-	strict |= flags & RT6_LOOKUP_F_IFACE;
-	if (net->ipv6.devconf_all->forwarding == 0)
-		strict |= RT6_LOOKUP_F_REACHABLE;
-
-	read_lock_bh(&table->tb6_lock);
 
 	fn = fib6_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
 	saved_fn = fn;
 
-	if (fl6->flowi6_flags & FLOWI_FLAG_SKIP_NH_OIF)
-		oif = 0;
-
 redo_rt6_select:
 	rt = rt6_select(fn, oif, strict);
+	if (unlikely(!rt))
+		return NULL;
 	if (rt->rt6i_nsiblings)
 		rt = rt6_multipath_select(rt, fl6, oif, strict);
 	if (rt == net->ipv6.ip6_null_entry) {
@@ -1072,6 +1072,75 @@ redo_rt6_select:
 		}
 	}
 
+	return rt;
+}
+
+/* Common case of ip6_pol_route without taking tb6_lock: the route is
+ * looked up under RCU and its per-cpu copy is only used if no writer
+ * touched the table meanwhile. Nodes and routes are freed after a grace
+ * period, so a racing lookup reads stale but valid memory. Anything else
+ * (no route, RTF_CACHE, missing per-cpu copy) goes the locked way.
+ */
+static struct rt6_info *ip6_pol_route_lockless(struct net *net,
+					       struct fib6_table *table,
+					       int oif, struct flowi6 *fl6,
+					       int strict)
+{
+	struct rt6_info *rt, *pcpu_rt = NULL;
+	unsigned int seq;
+
+	local_bh_disable();
+	rcu_read_lock();
+
+	/* Don't wait out a writer, the locked path will */
+	seq = raw_read_seqcount(&table->tb6_seq);
+	if (seq & 1)
+		goto out;
+
+	rt = ip6_pol_route_select(net, table, oif, fl6, strict);
+	if (!rt || rt == net->ipv6.ip6_null_entry ||
+	    (rt->rt6i_flags & RTF_CACHE) ||
+	    ((fl6->flowi6_flags & FLOWI_FLAG_KNOWN_NH) &&
+	     !(rt->rt6i_flags & RTF_GATEWAY)))
+		goto out;
+
+	pcpu_rt = rt6_get_pcpu_route(rt);
+	if (pcpu_rt && read_seqcount_retry(&table->tb6_seq, seq)) {
+		dst_release(&pcpu_rt->dst);
+		pcpu_rt = NULL;
+	}
+
+	if (pcpu_rt) {
+		rt->dst.lastuse = jiffies;
+		rt->dst.__use++;
+	}
+out:
+	rcu_read_unlock();
+	local_bh_enable();
+
+	return pcpu_rt;
+}
+
+static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
+				      struct flowi6 *fl6, int flags)
+{
+	struct rt6_info *rt;
+	int strict = 0;
+
+	strict |= flags & RT6_LOOKUP_F_IFACE;
+	if (net->ipv6.devconf_all->forwarding == 0)
+		strict |= RT6_LOOKUP_F_REACHABLE;
+
+	if (fl6->flowi6_flags & FLOWI_FLAG_SKIP_NH_OIF)
+		oif = 0;
+
+	rt = ip6_pol_route_lockless(net, table, oif, fl6, strict);
+	if (rt)
+		return rt;
+
+	read_lock_bh(&table->tb6_lock);
+
+	rt = ip6_pol_route_select(net, table, oif, fl6, strict);
 
 	if (rt == net->ipv6.ip6_null_entry || (rt->rt6i_flags & RTF_CACHE)) {
 		dst_use(&rt->dst, jiffies);
@@ -2036,9 +2105,9 @@ static int __ip6_del_rt(struct rt6_info *rt, struct nl_info *info)
 	}
 
 	table = rt->rt6i_table;
-	write_lock_bh(&table->tb6_lock);
+	fib6_table_write_lock(table);
 	err = fib6_del(rt, info);
-	write_unlock_bh(&table->tb6_lock);
+	fib6_table_write_unlock(table);
 
 out:
 	ip6_rt_put(rt);
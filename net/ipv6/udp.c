@@ -504,6 +504,9 @@ try_again:
 			ip6_datagram_recv_specific_ctl(sk, msg, skb);
 	}
 
+	if (udp_sk(sk)->gro_enabled)
+		udp_cmsg_recv(msg, sk, skb);
+
 	err = copied;
 	if (flags & MSG_TRUNC)
 		err = ulen;
@@ -624,7 +627,7 @@ void udpv6_encap_enable(void)
 }
 EXPORT_SYMBOL(udpv6_encap_enable);
 
-int udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int udpv6_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
 	int rc;
@@ -719,6 +722,53 @@ drop:
 	return -1;
 }
 
+/*
+ * Split a UDP GRO packet for a socket that did not ask for those, it
+ * raced with the socket lookup in udp6_gro_receive() or was built for
+ * forwarding.
+ */
+static struct sk_buff *udpv6_rcv_segment(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *segs;
+
+	/* the GSO cb lies after the UDP one, nothing to save and restore */
+	BUILD_BUG_ON(sizeof(struct udp_skb_cb) > SKB_SGO_CB_OFFSET);
+
+	__skb_push(skb, skb->data - skb_mac_header(skb));
+	segs = __skb_gso_segment(skb, NETIF_F_SG | NETIF_F_IPV6_CSUM, false);
+	if (IS_ERR_OR_NULL(segs)) {
+		int segs_nr = skb_shinfo(skb)->gso_segs;
+
+		atomic_add(segs_nr, &sk->sk_drops);
+		UDP6_ADD_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
+				  IS_UDPLITE(sk), segs_nr);
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	consume_skb(skb);
+	return segs;
+}
+
+int udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *next, *segs;
+
+	if (likely(!udp_unexpected_gso(sk, skb)))
+		return udpv6_queue_rcv_one_skb(sk, skb);
+
+	segs = udpv6_rcv_segment(sk, skb);
+	for (skb = segs; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		__skb_pull(skb, skb_transport_offset(skb));
+		/* no resubmission of single segments to encapsulations */
+		if (udpv6_queue_rcv_one_skb(sk, skb) > 0)
+			kfree_skb(skb);
+	}
+	return 0;
+}
+
 static bool __udp_v6_is_mcast_sock(struct net *net, struct sock *sk,
 				   __be16 loc_port, const struct in6_addr *loc_addr,
 				   __be16 rmt_port, const struct in6_addr *rmt_addr,
@@ -1101,6 +1151,24 @@ out:
 	return err;
 }
 
+/* Of the socket level control messages, UDP only takes SCM_TXTIME */
+static int udpv6_cmsg_send(struct sock *sk, struct msghdr *msg,
+			   struct sockcm_cookie *sockc)
+{
+	struct cmsghdr *cmsg;
+	int err;
+
+	for_each_cmsghdr(cmsg, msg) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_TXTIME)
+			continue;
+		err = __sock_cmsg_send(sk, msg, cmsg, sockc);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 int udpv6_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 {
 	struct ipv6_txoptions opt_space;
@@ -1112,6 +1180,7 @@ int udpv6_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 	struct ipv6_txoptions *opt = NULL;
 	struct ipv6_txoptions *opt_to_free = NULL;
 	struct ip6_flowlabel *flowlabel = NULL;
+	struct sockcm_cookie sockc = { 0 };
 	struct flowi6 fl6;
 	struct dst_entry *dst;
 	int addr_len = msg->msg_namelen;
@@ -1251,6 +1320,8 @@ do_udp_sendmsg:
 
 		err = ip6_datagram_send_ctl(sock_net(sk), sk, msg, &fl6, opt,
 					    &hlimit, &tclass, &dontfrag);
+		if (!err)
+			err = udpv6_cmsg_send(sk, msg, &sockc);
 		if (err < 0) {
 			fl6_sock_release(flowlabel);
 			return err;
@@ -1310,7 +1381,9 @@ do_udp_sendmsg:
 		goto do_confirm;
 back_from_confirm:
 
-	/* Lockless fast path for the non-corking case */
+	/* Lockless fast path for the non-corking case, the only one that
+	 * takes a transmit time
+	 */
 	if (!corkreq) {
 		struct sk_buff *skb;
 
@@ -1319,8 +1392,10 @@ back_from_confirm:
 				   &fl6, (struct rt6_info *)dst,
 				   msg->msg_flags, dontfrag);
 		err = PTR_ERR(skb);
-		if (!IS_ERR_OR_NULL(skb))
+		if (!IS_ERR_OR_NULL(skb)) {
+			skb->tstamp = ns_to_ktime(sockc.transmit_time);
 			err = udp_v6_send_skb(skb, &fl6);
+		}
 		goto release_dst;
 	}
 
@@ -1420,9 +1495,52 @@ void udpv6_destroy_sock(struct sock *sk)
 /*
  *	Socket option code for UDP
  */
+
+/* UDP_GRO is handled here, GRO is only done for UDP over IPv6. */
+static int udpv6_gro_setsockopt(struct sock *sk, char __user *optval,
+				unsigned int optlen)
+{
+	int val;
+
+	if (optlen < sizeof(int))
+		return -EINVAL;
+
+	if (get_user(val, (int __user *)optval))
+		return -EFAULT;
+
+	lock_sock(sk);
+	if (val)
+		udpv6_gro_enable();
+	udp_sk(sk)->gro_enabled = !!val;
+	release_sock(sk);
+	return 0;
+}
+
+static int udpv6_gro_getsockopt(struct sock *sk, char __user *optval,
+				int __user *optlen)
+{
+	int val, len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+
+	len = min_t(unsigned int, len, sizeof(int));
+	if (len < 0)
+		return -EINVAL;
+
+	val = udp_sk(sk)->gro_enabled;
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, &val, len))
+		return -EFAULT;
+	return 0;
+}
+
 int udpv6_setsockopt(struct sock *sk, int level, int optname,
 		     char __user *optval, unsigned int optlen)
 {
+	if (level == SOL_UDP && optname == UDP_GRO)
+		return udpv6_gro_setsockopt(sk, optval, optlen);
 	if (level == SOL_UDP  ||  level == SOL_UDPLITE)
 		return udp_lib_setsockopt(sk, level, optname, optval, optlen,
 					  udp_v6_push_pending_frames);
@@ -1433,6 +1551,8 @@ int udpv6_setsockopt(struct sock *sk, int level, int optname,
 int compat_udpv6_setsockopt(struct sock *sk, int level, int optname,
 			    char __user *optval, unsigned int optlen)
 {
+	if (level == SOL_UDP && optname == UDP_GRO)
+		return udpv6_gro_setsockopt(sk, optval, optlen);
 	if (level == SOL_UDP  ||  level == SOL_UDPLITE)
 		return udp_lib_setsockopt(sk, level, optname, optval, optlen,
 					  udp_v6_push_pending_frames);
@@ -1443,6 +1563,8 @@ int compat_udpv6_setsockopt(struct sock *sk, int level, int optname,
 int udpv6_getsockopt(struct sock *sk, int level, int optname,
 		     char __user *optval, int __user *optlen)
 {
+	if (level == SOL_UDP && optname == UDP_GRO)
+		return udpv6_gro_getsockopt(sk, optval, optlen);
 	if (level == SOL_UDP  ||  level == SOL_UDPLITE)
 		return udp_lib_getsockopt(sk, level, optname, optval, optlen);
 	return ipv6_getsockopt(sk, level, optname, optval, optlen);
@@ -1452,6 +1574,8 @@ int udpv6_getsockopt(struct sock *sk, int level, int optname,
 int compat_udpv6_getsockopt(struct sock *sk, int level, int optname,
 			    char __user *optval, int __user *optlen)
 {
+	if (level == SOL_UDP && optname == UDP_GRO)
+		return udpv6_gro_getsockopt(sk, optval, optlen);
 	if (level == SOL_UDP  ||  level == SOL_UDPLITE)
 		return udp_lib_getsockopt(sk, level, optname, optval, optlen);
 	return compat_ipv6_getsockopt(sk, level, optname, optval, optlen);
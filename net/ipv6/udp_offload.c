@@ -15,8 +15,75 @@
 #include <net/ipv6.h>
 #include <net/udp.h>
 #include <net/ip6_checksum.h>
+#include <net/addrconf.h>
 #include "ip6_offload.h"
 
+static struct static_key udpv6_gro_needed __read_mostly;
+
+/* Called by the first socket that sets UDP_GRO */
+void udpv6_gro_enable(void)
+{
+	if (!static_key_enabled(&udpv6_gro_needed))
+		static_key_slow_inc(&udpv6_gro_needed);
+}
+EXPORT_SYMBOL_GPL(udpv6_gro_enable);
+
+/*
+ * Split a UDP GRO packet back into the datagrams it was built from.
+ * uh->check holds the pseudo header sum for the whole packet, it only
+ * needs the length adjusted for each segment.
+ */
+static struct sk_buff *udp6_gso_segment(struct sk_buff *gso_skb,
+					netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	unsigned int mss;
+	struct udphdr *uh;
+	__sum16 check;
+	__be16 newlen;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (gso_skb->len <= sizeof(*uh) + mss)
+		return ERR_PTR(-EINVAL);
+
+	if (!pskb_may_pull(gso_skb, sizeof(*uh)))
+		return ERR_PTR(-EINVAL);
+
+	skb_pull(gso_skb, sizeof(*uh));
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	seg = segs;
+	uh = udp_hdr(seg);
+
+	newlen = htons(sizeof(*uh) + mss);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	for (; seg->next; seg = seg->next, uh = udp_hdr(seg)) {
+		uh->len = newlen;
+		uh->check = check;
+
+		if (seg->ip_summed != CHECKSUM_PARTIAL)
+			uh->check = gso_make_checksum(seg, ~check) ? :
+				    CSUM_MANGLED_0;
+	}
+
+	/* the last segment may be shorter than gso_size */
+	newlen = htons(skb_tail_pointer(seg) - skb_transport_header(seg) +
+		       seg->data_len);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	uh->len = newlen;
+	uh->check = check;
+
+	if (seg->ip_summed != CHECKSUM_PARTIAL)
+		uh->check = gso_make_checksum(seg, ~check) ? : CSUM_MANGLED_0;
+
+	return segs;
+}
+
 static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -39,6 +106,7 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 		int type = skb_shinfo(skb)->gso_type;
 
 		if (unlikely(type & ~(SKB_GSO_UDP |
+				      SKB_GSO_UDP_L4 |
 				      SKB_GSO_DODGY |
 				      SKB_GSO_UDP_TUNNEL |
 				      SKB_GSO_UDP_TUNNEL_CSUM |
@@ -47,8 +115,16 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 				      SKB_GSO_GRE_CSUM |
 				      SKB_GSO_IPIP |
 				      SKB_GSO_SIT) ||
-			     !(type & (SKB_GSO_UDP))))
+			     !(type & (SKB_GSO_UDP | SKB_GSO_UDP_L4))))
+			goto out;
+
+		if (type & SKB_GSO_UDP_L4) {
+			skb_shinfo(skb)->gso_segs =
+				DIV_ROUND_UP(skb->len - sizeof(struct udphdr),
+					     mss);
+			segs = NULL;
 			goto out;
+		}
 
 		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len, mss);
 
@@ -63,6 +139,8 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 	if (skb->encapsulation && skb_shinfo(skb)->gso_type &
 	    (SKB_GSO_UDP_TUNNEL|SKB_GSO_UDP_TUNNEL_CSUM))
 		segs = skb_udp_tunnel_segment(skb, features, true);
+	else if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		segs = udp6_gso_segment(skb, features);
 	else {
 		const struct ipv6hdr *ipv6h;
 		struct udphdr *uh;
@@ -126,10 +204,87 @@ out:
 	return segs;
 }
 
+/*
+ * Aggregate datagrams of one flow into a packet of gso_size segments.
+ * All but the last must be of the same length, the last may be shorter
+ * and terminates the packet.
+ */
+static struct sk_buff **udp_gro_receive_segment(struct sk_buff **head,
+						struct sk_buff *skb,
+						struct udphdr *uh)
+{
+	unsigned int off = skb_gro_offset(skb);
+	struct sk_buff **pp = NULL;
+	struct udphdr *uh2;
+	struct sk_buff *p;
+	unsigned int ulen;
+
+	/* requires non zero csum, for symmetry with GSO */
+	if (!uh->check)
+		goto flush;
+
+	/* no padded or malicious packets */
+	ulen = ntohs(uh->len);
+	if (ulen <= sizeof(*uh) || ulen != skb_gro_len(skb))
+		goto flush;
+
+	NAPI_GRO_CB(skb)->is_udp_l4 = 1;
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+
+		/* match ports only, the checksum is always non zero */
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source ||
+		    !NAPI_GRO_CB(p)->is_udp_l4) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		/*
+		 * Flush on a longer datagram. A shorter one is merged and
+		 * terminates the packet, as does hitting the size limits.
+		 */
+		if (ulen > ntohs(uh2->len) || skb_gro_receive(head, skb) ||
+		    ulen != ntohs(uh2->len) ||
+		    NAPI_GRO_CB(p)->count >= UDP_GRO_CNT_MAX)
+			pp = head;
+
+		return pp;
+	}
+
+	/* new flow, nothing to flush */
+	return NULL;
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
+static struct sock *udp6_gro_lookup_skb(struct sk_buff *skb, __be16 sport,
+					__be16 dport)
+{
+	const struct ipv6hdr *iph = skb_gro_network_header(skb);
+
+	/* UDP sockets live in the ipv6 module */
+	if (unlikely(!ipv6_stub))
+		return NULL;
+
+	return ipv6_stub->udp6_lib_lookup(dev_net(skb->dev), &iph->saddr,
+					  sport, &iph->daddr, dport,
+					  skb->dev->ifindex);
+}
+
 static struct sk_buff **udp6_gro_receive(struct sk_buff **head,
 					 struct sk_buff *skb)
 {
 	struct udphdr *uh = udp_gro_udphdr(skb);
+	bool fwd, segment;
+	struct sock *sk;
 
 	if (unlikely(!uh))
 		goto flush;
@@ -147,6 +302,22 @@ static struct sk_buff **udp6_gro_receive(struct sk_buff **head,
 
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 1;
+
+	/*
+	 * Datagrams for a socket that asked for UDP_GRO, or with no local
+	 * socket at all on devices doing UDP GRO for forwarding, are
+	 * aggregated here. Everything else may still be a tunnel.
+	 */
+	fwd = skb->dev->features & NETIF_F_GRO_UDP_FWD;
+	if (static_key_false(&udpv6_gro_needed) || fwd) {
+		sk = udp6_gro_lookup_skb(skb, uh->source, uh->dest);
+		segment = sk ? udp_sk(sk)->gro_enabled : fwd;
+		if (sk)
+			sock_put(sk);
+		if (segment)
+			return udp_gro_receive_segment(head, skb, uh);
+	}
+
 	return udp_gro_receive(head, skb, uh);
 
 flush:
@@ -159,6 +330,20 @@ static int udp6_gro_complete(struct sk_buff *skb, int nhoff)
 	const struct ipv6hdr *ipv6h = ipv6_hdr(skb);
 	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
 
+	if (NAPI_GRO_CB(skb)->is_udp_l4) {
+		uh->len = htons(skb->len - nhoff);
+		uh->check = ~udp_v6_check(skb->len - nhoff, &ipv6h->saddr,
+					  &ipv6h->daddr, 0);
+
+		skb->csum_start = (unsigned char *)uh - skb->head;
+		skb->csum_offset = offsetof(struct udphdr, check);
+		skb->ip_summed = CHECKSUM_PARTIAL;
+
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_L4;
+		return 0;
+	}
+
 	if (uh->check) {
 		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL_CSUM;
 		uh->check = ~udp_v6_check(skb->len - nhoff, &ipv6h->saddr,
@@ -8,7 +8,9 @@
 #include <linux/net.h>
 #include <linux/netdevice.h>
 #include <linux/poll.h>
+#include <linux/proc_fs.h>
 #include <linux/rculist.h>
+#include <linux/seq_file.h>
 #include <linux/skbuff.h>
 #include <linux/socket.h>
 #include <linux/uaccess.h>
@@ -41,6 +43,21 @@ static inline struct kcm_rx_msg *kcm_rx_msg(struct sk_buff *skb)
 				     offsetof(struct qdisc_skb_cb, data));
 }
 
+/* Take the RX mux lock, accounting for how often it had to be waited for */
+static void kcm_rx_lock(struct kcm_mux *mux)
+{
+	if (!spin_trylock_bh(&mux->rx_lock)) {
+		spin_lock_bh(&mux->rx_lock);
+		mux->rx_stats.rx_lock_contended++;
+	}
+	mux->rx_stats.rx_lock_acquired++;
+}
+
+static void kcm_rx_unlock(struct kcm_mux *mux)
+{
+	spin_unlock_bh(&mux->rx_lock);
+}
+
 static void report_csk_error(struct sock *csk, int err)
 {
 	csk->sk_err = EPIPE;
@@ -144,7 +161,7 @@ static void kcm_rcv_ready(struct kcm_sock *kcm)
 		/* Commit clearing of ready_rx_msg for queuing work */
 		smp_mb();
 
-		queue_work(kcm_wq, &psock->rx_work);
+		queue_work_on(psock->rx_cpu, kcm_wq, &psock->rx_work);
 	}
 
 	/* Buffer limit is okay now, add to ready list */
@@ -153,6 +170,44 @@ static void kcm_rcv_ready(struct kcm_sock *kcm)
 	kcm->rx_wait = true;
 }
 
+/* Move KCMs pushed onto rx_ready_list by kcm_rfree to the waiters list,
+ * in the order they became ready. RX mux lock held.
+ */
+static void kcm_rx_ready_drain(struct kcm_mux *mux)
+{
+	struct llist_node *list;
+	struct kcm_sock *kcm, *tmp;
+
+	list = llist_del_all(&mux->rx_ready_list);
+	if (!list)
+		return;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(kcm, tmp, list, rx_ready_node) {
+		clear_bit(0, &kcm->rx_ready_pending);
+
+		/* Clear pending before looking at the buffer state that
+		 * kcm_rfree updated ahead of setting it.
+		 */
+		smp_mb__after_atomic();
+
+		mux->rx_stats.rx_ready_deferred++;
+		kcm_rcv_ready(kcm);
+	}
+}
+
+/* Recheck rx_ready_list after publishing work for a ready KCM (a held
+ * message or ready psock), pairs with the barrier in kcm_rfree. RX mux
+ * lock held.
+ */
+static void kcm_rx_ready_recheck(struct kcm_mux *mux)
+{
+	smp_mb();
+
+	if (unlikely(!llist_empty(&mux->rx_ready_list)))
+		kcm_rx_ready_drain(mux);
+}
+
 static void kcm_rfree(struct sk_buff *skb)
 {
 	struct sock *sk = skb->sk;
@@ -168,9 +223,26 @@ static void kcm_rfree(struct sk_buff *skb)
 
 	if (!kcm->rx_wait && !kcm->rx_psock &&
 	    sk_rmem_alloc_get(sk) < sk->sk_rcvlowat) {
-		spin_lock_bh(&mux->rx_lock);
-		kcm_rcv_ready(kcm);
-		spin_unlock_bh(&mux->rx_lock);
+		/* Readers don't contend with psocks for the RX lock just to
+		 * say they have room again; the KCM is put on the waiters
+		 * list by whoever next needs one.
+		 */
+		if (test_and_set_bit(0, &kcm->rx_ready_pending))
+			return;
+
+		llist_add(&kcm->rx_ready_node, &mux->rx_ready_list);
+
+		/* Push before checking for pending messages, pairs with
+		 * kcm_rx_ready_recheck.
+		 */
+		smp_mb();
+
+		if (unlikely(!list_empty(&mux->psocks_ready) ||
+			     !skb_queue_empty(&mux->rx_hold_queue))) {
+			kcm_rx_lock(mux);
+			kcm_rx_ready_drain(mux);
+			kcm_rx_unlock(mux);
+		}
 	}
 }
 
@@ -214,8 +286,12 @@ static void requeue_rx_msgs(struct kcm_mux *mux, struct sk_buff_head *head)
 		skb->destructor = sock_rfree;
 		skb_orphan(skb);
 try_again:
+		if (list_empty(&mux->kcm_rx_waiters))
+			kcm_rx_ready_drain(mux);
+
 		if (list_empty(&mux->kcm_rx_waiters)) {
 			skb_queue_tail(&mux->rx_hold_queue, skb);
+			kcm_rx_ready_recheck(mux);
 			continue;
 		}
 
@@ -247,18 +323,22 @@ static struct kcm_sock *reserve_rx_kcm(struct kcm_psock *psock,
 	if (psock->rx_kcm)
 		return psock->rx_kcm;
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 
 	if (psock->rx_kcm) {
-		spin_unlock_bh(&mux->rx_lock);
+		kcm_rx_unlock(mux);
 		return psock->rx_kcm;
 	}
 
+	if (list_empty(&mux->kcm_rx_waiters))
+		kcm_rx_ready_drain(mux);
+
 	if (list_empty(&mux->kcm_rx_waiters)) {
 		psock->ready_rx_msg = head;
 		list_add_tail(&psock->psock_ready_list,
 			      &mux->psocks_ready);
-		spin_unlock_bh(&mux->rx_lock);
+		kcm_rx_ready_recheck(mux);
+		kcm_rx_unlock(mux);
 		return NULL;
 	}
 
@@ -270,7 +350,7 @@ static struct kcm_sock *reserve_rx_kcm(struct kcm_psock *psock,
 	psock->rx_kcm = kcm;
 	kcm->rx_psock = psock;
 
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 
 	return kcm;
 }
@@ -292,7 +372,7 @@ static void unreserve_rx_kcm(struct kcm_psock *psock,
 	if (!kcm)
 		return;
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 
 	psock->rx_kcm = NULL;
 	kcm->rx_psock = NULL;
@@ -303,7 +383,7 @@ static void unreserve_rx_kcm(struct kcm_psock *psock,
 	smp_mb();
 
 	if (unlikely(kcm->done)) {
-		spin_unlock_bh(&mux->rx_lock);
+		kcm_rx_unlock(mux);
 
 		/* Need to run kcm_done in a task since we need to qcquire
 		 * callback locks which may already be held here.
@@ -321,7 +401,7 @@ static void unreserve_rx_kcm(struct kcm_psock *psock,
 		 */
 		kcm_rcv_ready(kcm);
 	}
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 }
 
 /* Macro to invoke filter function. */
@@ -541,6 +621,9 @@ static void psock_tcp_data_ready(struct sock *sk)
 	if (unlikely(!psock || psock->rx_stopped))
 		goto out;
 
+	/* Keep follow-up rx_work on the CPU taking this socket's data */
+	psock->rx_cpu = smp_processor_id();
+
 	if (psock->ready_rx_msg)
 		goto out;
 
@@ -1202,7 +1285,7 @@ static void kcm_recv_disable(struct kcm_sock *kcm)
 	if (kcm->rx_disabled)
 		return;
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 
 	kcm->rx_disabled = 1;
 
@@ -1216,7 +1299,7 @@ static void kcm_recv_disable(struct kcm_sock *kcm)
 		requeue_rx_msgs(mux, &kcm->sk.sk_receive_queue);
 	}
 
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 }
 
 /* kcm sock lock held */
@@ -1227,12 +1310,12 @@ static void kcm_recv_enable(struct kcm_sock *kcm)
 	if (!kcm->rx_disabled)
 		return;
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 
 	kcm->rx_disabled = 0;
 	kcm_rcv_ready(kcm);
 
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 }
 
 static int kcm_setsockopt(struct socket *sock, int level, int optname,
@@ -1332,9 +1415,9 @@ static void init_kcm_sock(struct kcm_sock *kcm, struct kcm_mux *mux)
 
 	INIT_WORK(&kcm->tx_work, kcm_tx_work);
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 	kcm_rcv_ready(kcm);
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 }
 
 static int kcm_attach(struct socket *sock, struct socket *csock,
@@ -1399,7 +1482,8 @@ static int kcm_attach(struct socket *sock, struct socket *csock,
 	spin_unlock_bh(&mux->lock);
 
 	/* Schedule RX work in case there are already bytes queued */
-	queue_work(kcm_wq, &psock->rx_work);
+	psock->rx_cpu = raw_smp_processor_id();
+	queue_work_on(psock->rx_cpu, kcm_wq, &psock->rx_work);
 
 	return 0;
 }
@@ -1460,7 +1544,7 @@ static void kcm_unattach(struct kcm_psock *psock)
 		return;
 	}
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
 
 	/* Stop receiver activities. After this point psock should not be
 	 * able to get onto ready list either through callbacks or work.
@@ -1471,7 +1555,7 @@ static void kcm_unattach(struct kcm_psock *psock)
 		psock->ready_rx_msg = NULL;
 	}
 
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 
 	write_unlock_bh(&csk->sk_callback_lock);
 
@@ -1730,13 +1814,17 @@ static void kcm_done(struct kcm_sock *kcm)
 	struct sock *sk = &kcm->sk;
 	int socks_cnt;
 
-	spin_lock_bh(&mux->rx_lock);
+	kcm_rx_lock(mux);
+
+	/* Take the KCM off rx_ready_list before it can be freed */
+	kcm_rx_ready_drain(mux);
+
 	if (kcm->rx_psock) {
 		/* Cleanup in unreserve_rx_kcm */
 		WARN_ON(kcm->done);
 		kcm->rx_disabled = 1;
 		kcm->done = 1;
-		spin_unlock_bh(&mux->rx_lock);
+		kcm_rx_unlock(mux);
 		return;
 	}
 
@@ -1747,7 +1835,7 @@ static void kcm_done(struct kcm_sock *kcm)
 	/* Move any pending receive messages to other kcm sockets */
 	requeue_rx_msgs(mux, &sk->sk_receive_queue);
 
-	spin_unlock_bh(&mux->rx_lock);
+	kcm_rx_unlock(mux);
 
 	if (WARN_ON(sk_rmem_alloc_get(sk)))
 		return;
@@ -1896,6 +1984,7 @@ static int kcm_create(struct net *net, struct socket *sock,
 	INIT_LIST_HEAD(&mux->psocks);
 	INIT_LIST_HEAD(&mux->psocks_ready);
 	INIT_LIST_HEAD(&mux->psocks_avail);
+	init_llist_head(&mux->rx_ready_list);
 
 	mux->knet = knet;
 
@@ -1920,6 +2009,61 @@ static struct net_proto_family kcm_family_ops = {
 	.owner  = THIS_MODULE,
 };
 
+#ifdef CONFIG_PROC_FS
+static int kcm_stats_seq_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq->private;
+	struct kcm_net *knet = net_generic(net, kcm_net_id);
+	struct kcm_mux *mux;
+	int i = 0;
+
+	seq_printf(seq, "%-4s %-6s %-6s %-16s %-16s %-16s\n", "Mux",
+		   "KCMs", "Psocks", "RxLock", "RxLockWaits", "RxReadyDefer");
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(mux, &knet->mux_list, kcm_mux_list) {
+		seq_printf(seq, "%-4d %-6d %-6d %-16llu %-16llu %-16llu\n",
+			   i++, mux->kcm_socks_cnt, mux->psocks_cnt,
+			   mux->rx_stats.rx_lock_acquired,
+			   mux->rx_stats.rx_lock_contended,
+			   mux->rx_stats.rx_ready_deferred);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int kcm_stats_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, kcm_stats_seq_show);
+}
+
+static const struct file_operations kcm_stats_seq_fops = {
+	.owner   = THIS_MODULE,
+	.open    = kcm_stats_seq_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release_net,
+};
+
+static int kcm_proc_init_net(struct net *net)
+{
+	if (!proc_create("kcm_stats", S_IRUGO, net->proc_net,
+			 &kcm_stats_seq_fops))
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void kcm_proc_exit_net(struct net *net)
+{
+	remove_proc_entry("kcm_stats", net->proc_net);
+}
+#else
+static inline int kcm_proc_init_net(struct net *net) { return 0; }
+static inline void kcm_proc_exit_net(struct net *net) { }
+#endif
+
 static __net_init int kcm_init_net(struct net *net)
 {
 	struct kcm_net *knet = net_generic(net, kcm_net_id);
@@ -1927,13 +2071,15 @@ static __net_init int kcm_init_net(struct net *net)
 	INIT_LIST_HEAD_RCU(&knet->mux_list);
 	mutex_init(&knet->mutex);
 
-	return 0;
+	return kcm_proc_init_net(net);
 }
 
 static __net_exit void kcm_exit_net(struct net *net)
 {
 	struct kcm_net *knet = net_generic(net, kcm_net_id);
 
+	kcm_proc_exit_net(net);
+
 	/* All KCM sockets should be closed at this point, which should mean
 	 * that all multiplexors and psocks have been destroyed.
 	 */
@@ -1963,7 +2109,8 @@ static int __init kcm_init(void)
 	if (!kcm_psockp)
 		goto fail;
 
-	kcm_wq = create_singlethread_workqueue("kkcmd");
+	/* Per-CPU so that psock rx_work runs where the data arrived */
+	kcm_wq = alloc_workqueue("kkcmd", WQ_MEM_RECLAIM, 0);
 	if (!kcm_wq)
 		goto fail;
 
@@ -333,6 +333,7 @@ const struct ip_set_ext_type ip_set_extensions[] = {
 		.flag	= IPSET_FLAG_WITH_COUNTERS,
 		.len	= sizeof(struct ip_set_counter),
 		.align	= __alignof__(struct ip_set_counter),
+		.destroy = (destroyer) ip_set_counter_free,
 	},
 	[IPSET_EXT_ID_TIMEOUT] = {
 		.type	= IPSET_EXT_TIMEOUT,
@@ -384,6 +385,11 @@ ip_set_elem_len(struct ip_set *set, struct nlattr *tb[], size_t len,
 		set->extensions |= ip_set_extensions[id].type;
 		len += ip_set_extensions[id].len;
 	}
+	/* Per-cpu counters must be released with their element */
+	if ((cadt_flags & IPSET_FLAG_PCPU_COUNTERS) && SET_WITH_COUNTER(set)) {
+		set->flags |= IPSET_CREATE_FLAG_PCPU_COUNTERS;
+		set->extensions |= IPSET_EXT_DESTROY;
+	}
 	return ALIGN(len, align);
 }
 EXPORT_SYMBOL_GPL(ip_set_elem_len);
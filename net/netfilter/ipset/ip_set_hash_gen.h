@@ -822,7 +822,7 @@ overwrite_extensions:
 	mtype_data_set_flags(data, flags);
 #endif
 	if (SET_WITH_COUNTER(set))
-		ip_set_init_counter(ext_counter(data, set), ext);
+		ip_set_init_counter(set, ext_counter(data, set), ext);
 	if (SET_WITH_COMMENT(set))
 		ip_set_init_comment(ext_comment(data, set), ext);
 	if (SET_WITH_SKBINFO(set))
@@ -37,6 +37,9 @@
 #include <linux/seq_file.h>
 #include <linux/jhash.h>
 #include <linux/random.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/rculist_nulls.h>
 
 #include <net/net_namespace.h>
 #include <net/ip_vs.h>
@@ -47,20 +50,42 @@
 #endif
 
 /*
- * Connection hash size. Default is what was selected at compile time.
+ * Connection hash size. Default is what was selected at compile time,
+ * net.ipv4.vs.conn_tab_size resizes it at run time.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
 MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
 
-/* size and mask values */
+#define IP_VS_CONN_TAB_MIN_BITS	8
+#define IP_VS_CONN_TAB_MAX_BITS	24
+
+/* current size, for the user interfaces */
 int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
+
+/*
+ * The chains end in a nulls marker holding the bucket index, so that a
+ * lockless walk notices when it followed an entry that was moved to
+ * another chain. Consecutive tables flip IP_VS_CONN_NULLS_FLIP in their
+ * markers, which tells the same bucket of the old and new table apart.
+ */
+#define IP_VS_CONN_NULLS_FLIP	(1U << 30)
+
+struct ip_vs_conn_hashtab {
+	unsigned int		size;
+	unsigned int		mask;
+	unsigned int		nulls;
+	struct hlist_nulls_head	buckets[0];
+};
 
 /*
  *  Connection hash table: for input and output packets lookups of IPVS
  */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+static struct ip_vs_conn_hashtab __rcu *ip_vs_conn_tab __read_mostly;
+
+/* the table ip_vs_conn_tab_resize() is moving the entries to */
+static struct ip_vs_conn_hashtab __rcu *ip_vs_conn_resize_tab;
+static DEFINE_MUTEX(ip_vs_conn_resize_mutex);
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -72,9 +97,11 @@ static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 static unsigned int ip_vs_conn_rnd __read_mostly;
 
 /*
- *  Fine locking granularity for big connection hash table
+ *  Fine locking granularity for big connection hash table. A lock
+ *  covers the same buckets in every table, as long as tables have at
+ *  least CT_LOCKARRAY_SIZE buckets.
  */
-#define CT_LOCKARRAY_BITS  5
+#define CT_LOCKARRAY_BITS  8
 #define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
 #define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
 
@@ -94,9 +121,23 @@ struct ip_vs_aligned_lock
 static struct ip_vs_aligned_lock
 __ip_vs_conntbl_lock_array[CT_LOCKARRAY_SIZE] __cacheline_aligned;
 
+/* a resize holds this to keep all the bucket locks */
+static DEFINE_SPINLOCK(ip_vs_conntbl_lock_all);
+static bool ip_vs_conntbl_locked_all __read_mostly;
+
 static inline void ct_write_lock_bh(unsigned int key)
 {
-	spin_lock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
+	spinlock_t *lock = &__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l;
+
+	spin_lock_bh(lock);
+	if (likely(!smp_load_acquire(&ip_vs_conntbl_locked_all)))
+		return;
+
+	/* wait for the resize to finish */
+	spin_unlock(lock);
+	spin_lock(&ip_vs_conntbl_lock_all);
+	spin_lock(lock);
+	spin_unlock(&ip_vs_conntbl_lock_all);
 }
 
 static inline void ct_write_unlock_bh(unsigned int key)
@@ -104,6 +145,47 @@ static inline void ct_write_unlock_bh(unsigned int key)
 	spin_unlock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
 }
 
+static void ct_write_lock_all_bh(void)
+{
+	int i;
+
+	spin_lock_bh(&ip_vs_conntbl_lock_all);
+	WRITE_ONCE(ip_vs_conntbl_locked_all, true);
+	smp_mb(); /* set the flag before we wait for the current holders */
+	for (i = 0; i < CT_LOCKARRAY_SIZE; i++) {
+		spin_lock(&__ip_vs_conntbl_lock_array[i].l);
+		spin_unlock(&__ip_vs_conntbl_lock_array[i].l);
+	}
+}
+
+static void ct_write_unlock_all_bh(void)
+{
+	/* pairs with the ACQUIRE in ct_write_lock_bh() */
+	smp_store_release(&ip_vs_conntbl_locked_all, false);
+	spin_unlock_bh(&ip_vs_conntbl_lock_all);
+}
+
+/* With the bucket lock held the table can't be swapped under us */
+static inline struct ip_vs_conn_hashtab *ip_vs_conn_tab_locked(void)
+{
+	return rcu_dereference_protected(ip_vs_conn_tab, 1);
+}
+
+/* Lookups walk the current table @t and, while a resize moves the
+ * entries, the table they go to.
+ */
+static inline struct ip_vs_conn_hashtab *
+ip_vs_conn_next_tab(struct ip_vs_conn_hashtab *t,
+		    struct ip_vs_conn_hashtab *tab)
+{
+	struct ip_vs_conn_hashtab *next;
+
+	if (tab != t)
+		return NULL;
+	next = rcu_dereference(ip_vs_conn_resize_tab);
+	return next != t ? next : NULL;
+}
+
 
 /*
  *	Returns hash value for IPVS connection entry
@@ -114,13 +196,13 @@ static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
+		return jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
 				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+			((size_t)ipvs>>8);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
 			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		((size_t)ipvs>>8);
 }
 
 static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
@@ -130,8 +212,7 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -166,6 +247,7 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
  */
 static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 {
+	struct ip_vs_conn_hashtab *t;
 	unsigned int hash;
 	int ret;
 
@@ -181,7 +263,9 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		atomic_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
+		t = ip_vs_conn_tab_locked();
+		hlist_nulls_add_head_rcu(&cp->c_list,
+					 &t->buckets[hash & t->mask]);
 		ret = 1;
 	} else {
 		pr_err("%s(): request for already hashed, called from %pF\n",
@@ -212,7 +296,7 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 	spin_lock(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		hlist_del_rcu(&cp->c_list);
+		hlist_nulls_del_rcu(&cp->c_list);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
@@ -242,7 +326,7 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 		ret = false;
 		/* Decrease refcnt and unlink conn only if we are last user */
 		if (atomic_cmpxchg(&cp->refcnt, 1, 0) == 1) {
-			hlist_del_rcu(&cp->c_list);
+			hlist_nulls_del_rcu(&cp->c_list);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
 			ret = true;
 		}
@@ -256,6 +340,57 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 }
 
 
+/*
+ *	Finds the entry with @hash that @match accepts, @match takes the
+ *	reference. Lookups don't wait for a resize: an entry missing from
+ *	the current table may already be in the next one, and a walk that
+ *	strayed into another chain starts over. Called under RCU.
+ */
+static __always_inline struct ip_vs_conn *
+ip_vs_conn_lookup(const struct ip_vs_conn_param *p, unsigned int hash,
+		  bool (*match)(const struct ip_vs_conn_param *p,
+				struct ip_vs_conn *cp))
+{
+	struct ip_vs_conn_hashtab *t, *tab;
+	struct hlist_nulls_node *n;
+	struct ip_vs_conn *cp;
+	unsigned int bucket;
+
+restart:
+	tab = t = rcu_dereference(ip_vs_conn_tab);
+	do {
+		bucket = hash & tab->mask;
+		hlist_nulls_for_each_entry_rcu(cp, n, &tab->buckets[bucket],
+					       c_list) {
+			if (match(p, cp))
+				return cp;
+		}
+		if (get_nulls_value(n) != tab->nulls + bucket)
+			goto restart;
+		tab = ip_vs_conn_next_tab(t, tab);
+	} while (tab);
+
+	/* the tables were swapped under us, look again */
+	smp_rmb(); /* pairs with smp_wmb() in ip_vs_conn_tab_resize() */
+	if (t != rcu_access_pointer(ip_vs_conn_tab))
+		goto restart;
+
+	return NULL;
+}
+
+static inline bool ip_vs_conn_in_match(const struct ip_vs_conn_param *p,
+				       struct ip_vs_conn *cp)
+{
+	return p->cport == cp->cport && p->vport == cp->vport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
+	       ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs &&
+	       __ip_vs_conn_get(cp);
+}
+
 /*
  *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
  *  Called for pkts coming from OUTside-to-INside.
@@ -271,26 +406,10 @@ __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 	hash = ip_vs_conn_hashkey_param(p, false);
 
 	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			rcu_read_unlock();
-			return cp;
-		}
-	}
-
+	cp = ip_vs_conn_lookup(p, hash, ip_vs_conn_in_match);
 	rcu_read_unlock();
 
-	return NULL;
+	return cp;
 }
 
 struct ip_vs_conn *ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
@@ -348,6 +467,27 @@ ip_vs_conn_in_get_proto(struct netns_ipvs *ipvs, int af,
 }
 EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 
+static inline bool ip_vs_ct_in_match(const struct ip_vs_conn_param *p,
+				     struct ip_vs_conn *cp)
+{
+	if (unlikely(p->pe_data && p->pe->ct_match))
+		return cp->ipvs == p->ipvs &&
+		       p->pe == cp->pe && p->pe->ct_match(p, cp) &&
+		       __ip_vs_conn_get(cp);
+
+	return cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       /* protocol should only be IPPROTO_IP if
+		* p->vaddr is a fwmark */
+	       ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
+				p->af, p->vaddr, &cp->vaddr) &&
+	       p->vport == cp->vport && p->cport == cp->cport &&
+	       cp->flags & IP_VS_CONN_F_TEMPLATE &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs &&
+	       __ip_vs_conn_get(cp);
+}
+
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
@@ -357,35 +497,7 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 	hash = ip_vs_conn_hashkey_param(p, false);
 
 	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (cp->ipvs != p->ipvs)
-				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
-				if (__ip_vs_conn_get(cp))
-					goto out;
-			}
-			continue;
-		}
-
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
-		}
-	}
-	cp = NULL;
-
-  out:
+	cp = ip_vs_conn_lookup(p, hash, ip_vs_ct_in_match);
 	rcu_read_unlock();
 
 	IP_VS_DBG_BUF(9, "template lookup/in %s %s:%d->%s:%d %s\n",
@@ -397,6 +509,18 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 	return cp;
 }
 
+static inline bool ip_vs_conn_out_match(const struct ip_vs_conn_param *p,
+					struct ip_vs_conn *cp)
+{
+	return p->vport == cp->cport && p->cport == cp->dport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs &&
+	       __ip_vs_conn_get(cp);
+}
+
 /* Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
  * Called for pkts coming from inside-to-OUTside.
  *	p->caddr, p->cport: pkt source address (inside host)
@@ -404,7 +528,7 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
 	unsigned int hash;
-	struct ip_vs_conn *cp, *ret=NULL;
+	struct ip_vs_conn *ret;
 
 	/*
 	 *	Check for "full" addressed entries
@@ -412,22 +536,7 @@ struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 	hash = ip_vs_conn_hashkey_param(p, true);
 
 	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
-		}
-	}
-
+	ret = ip_vs_conn_lookup(p, hash, ip_vs_conn_out_match);
 	rcu_read_unlock();
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
@@ -886,7 +995,7 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		return NULL;
 	}
 
-	INIT_HLIST_NODE(&cp->c_list);
+	cp->c_list.pprev = NULL;
 	setup_timer(&cp->timer, ip_vs_conn_expire, (unsigned long)cp);
 	cp->ipvs	   = ipvs;
 	cp->af		   = p->af;
@@ -978,27 +1087,35 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
  */
 #ifdef CONFIG_PROC_FS
 struct ip_vs_iter_state {
-	struct seq_net_private	p;
-	struct hlist_head	*l;
+	struct seq_net_private		p;
+	struct ip_vs_conn_hashtab	*t;
+	unsigned int			bucket;
 };
 
 static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 {
-	int idx;
+	unsigned int idx;
 	struct ip_vs_conn *cp;
+	struct hlist_nulls_node *n;
+	struct ip_vs_conn_hashtab *t;
 	struct ip_vs_iter_state *iter = seq->private;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	t = rcu_dereference(ip_vs_conn_tab);
+	for (idx = 0; idx < t->size; idx++) {
+		hlist_nulls_for_each_entry_rcu(cp, n, &t->buckets[idx],
+					       c_list) {
 			/* __ip_vs_conn_get() is not needed by
 			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
 			 */
 			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
+				iter->t = t;
+				iter->bucket = idx;
 				return cp;
 			}
 		}
 		cond_resched_rcu();
+		/* a resize may have freed the table meanwhile */
+		t = rcu_dereference(ip_vs_conn_tab);
 	}
 
 	return NULL;
@@ -1009,7 +1126,7 @@ static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 {
 	struct ip_vs_iter_state *iter = seq->private;
 
-	iter->l = NULL;
+	iter->t = NULL;
 	rcu_read_lock();
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
@@ -1018,28 +1135,31 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
 	struct ip_vs_conn *cp = v;
 	struct ip_vs_iter_state *iter = seq->private;
-	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
+	struct ip_vs_conn_hashtab *t = iter->t;
+	struct hlist_nulls_node *e;
+	unsigned int idx;
 
 	++*pos;
 	if (v == SEQ_START_TOKEN)
 		return ip_vs_conn_array(seq, 0);
 
 	/* more on same hash chain? */
-	e = rcu_dereference(hlist_next_rcu(&cp->c_list));
-	if (e)
-		return hlist_entry(e, struct ip_vs_conn, c_list);
-
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
+	e = rcu_dereference(hlist_nulls_next_rcu(&cp->c_list));
+	if (!is_a_nulls(e))
+		return hlist_nulls_entry(e, struct ip_vs_conn, c_list);
+
+	idx = iter->bucket;
+	while (++idx < t->size) {
+		hlist_nulls_for_each_entry_rcu(cp, e, &t->buckets[idx],
+					       c_list) {
+			iter->t = t;
+			iter->bucket = idx;
 			return cp;
 		}
 		cond_resched_rcu();
+		t = rcu_dereference(ip_vs_conn_tab);
 	}
-	iter->l = NULL;
+	iter->t = NULL;
 	return NULL;
 }
 
@@ -1243,17 +1363,21 @@ static inline int todrop_entry(struct ip_vs_conn *cp)
 /* Called from keventd and must protect itself from softirqs */
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
 	struct ip_vs_conn *cp, *cp_c;
+	struct hlist_nulls_node *n;
+	struct ip_vs_conn_hashtab *t;
 
 	rcu_read_lock();
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	t = rcu_dereference(ip_vs_conn_tab);
+	for (idx = 0; idx < (t->size>>5); idx++) {
+		unsigned int hash = prandom_u32() & t->mask;
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		hlist_nulls_for_each_entry_rcu(cp, n, &t->buckets[hash],
+					       c_list) {
 			if (cp->flags & IP_VS_CONN_F_TEMPLATE)
 				/* connection template */
 				continue;
@@ -1301,8 +1425,42 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 			}
 		}
 		cond_resched_rcu();
+		t = rcu_dereference(ip_vs_conn_tab);
+	}
+	rcu_read_unlock();
+}
+
+
+/*
+ *      Calls @fn for the connections of @ipvs in the next @count buckets
+ *      from *@pos, with a reference held. Returns false once the walk
+ *      reached the end of the table. A resize in between steps may make
+ *      the walk skip or repeat some entries.
+ */
+bool ip_vs_conn_walk(struct netns_ipvs *ipvs, unsigned int *pos,
+		     unsigned int count,
+		     void (*fn)(struct netns_ipvs *ipvs, struct ip_vs_conn *cp))
+{
+	struct ip_vs_conn_hashtab *t;
+	struct hlist_nulls_node *n;
+	struct ip_vs_conn *cp;
+	bool more;
+
+	rcu_read_lock();
+	t = rcu_dereference(ip_vs_conn_tab);
+	for (; count && *pos < t->size; count--, (*pos)++) {
+		hlist_nulls_for_each_entry_rcu(cp, n, &t->buckets[*pos],
+					       c_list) {
+			if (cp->ipvs != ipvs || !__ip_vs_conn_get(cp))
+				continue;
+			fn(ipvs, cp);
+			__ip_vs_conn_put(cp);
+		}
 	}
+	more = *pos < t->size;
 	rcu_read_unlock();
+
+	return more;
 }
 
 
@@ -1311,14 +1469,18 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
  */
 static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
 	struct ip_vs_conn *cp, *cp_c;
+	struct hlist_nulls_node *n;
+	struct ip_vs_conn_hashtab *t;
 
 flush_again:
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	t = rcu_dereference(ip_vs_conn_tab);
+	for (idx = 0; idx < t->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+		hlist_nulls_for_each_entry_rcu(cp, n, &t->buckets[idx],
+					       c_list) {
 			if (cp->ipvs != ipvs)
 				continue;
 			IP_VS_DBG(4, "del connection\n");
@@ -1332,6 +1494,7 @@ flush_again:
 			}
 		}
 		cond_resched_rcu();
+		t = rcu_dereference(ip_vs_conn_tab);
 	}
 	rcu_read_unlock();
 
@@ -1363,19 +1526,108 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 	remove_proc_entry("ip_vs_conn_sync", ipvs->net->proc_net);
 }
 
+static struct ip_vs_conn_hashtab *
+ip_vs_conn_tab_alloc(unsigned int size, unsigned int nulls)
+{
+	struct ip_vs_conn_hashtab *t;
+	unsigned int idx;
+
+	t = vmalloc(sizeof(*t) + size * sizeof(t->buckets[0]));
+	if (!t)
+		return NULL;
+
+	t->size = size;
+	t->mask = size - 1;
+	t->nulls = nulls;
+	for (idx = 0; idx < size; idx++)
+		INIT_HLIST_NULLS_HEAD(&t->buckets[idx], nulls + idx);
+
+	return t;
+}
+
+static unsigned int ip_vs_conn_tab_clamp(unsigned int size)
+{
+	size = clamp_t(unsigned int, size, 1U << IP_VS_CONN_TAB_MIN_BITS,
+		       1U << IP_VS_CONN_TAB_MAX_BITS);
+	return roundup_pow_of_two(size);
+}
+
+/*
+ *	Moves all the connections to a table with @size buckets. The table
+ *	is shared by all the netns, the hash mixes in the netns_ipvs.
+ */
+int ip_vs_conn_tab_resize(unsigned int size)
+{
+	struct ip_vs_conn_hashtab *old, *t;
+	struct ip_vs_conn *cp;
+	unsigned int idx, hash;
+
+	size = ip_vs_conn_tab_clamp(size);
+
+	mutex_lock(&ip_vs_conn_resize_mutex);
+	old = rcu_dereference_protected(ip_vs_conn_tab,
+			lockdep_is_held(&ip_vs_conn_resize_mutex));
+	if (old->size == size) {
+		mutex_unlock(&ip_vs_conn_resize_mutex);
+		return 0;
+	}
+
+	t = ip_vs_conn_tab_alloc(size, old->nulls ^ IP_VS_CONN_NULLS_FLIP);
+	if (!t) {
+		mutex_unlock(&ip_vs_conn_resize_mutex);
+		return -ENOMEM;
+	}
+
+	/* Lookups keep walking the old table while the entries move, and
+	 * look in ip_vs_conn_resize_tab as well before they report a miss.
+	 * Hashing and unhashing wait for the bucket locks.
+	 */
+	ct_write_lock_all_bh();
+	rcu_assign_pointer(ip_vs_conn_resize_tab, t);
+
+	for (idx = 0; idx < old->size; idx++) {
+		while (!hlist_nulls_empty(&old->buckets[idx])) {
+			cp = hlist_nulls_entry(old->buckets[idx].first,
+					       struct ip_vs_conn, c_list);
+			hash = ip_vs_conn_hashkey_conn(cp);
+			hlist_nulls_del_rcu(&cp->c_list);
+			hlist_nulls_add_head_rcu(&cp->c_list,
+						 &t->buckets[hash & t->mask]);
+		}
+	}
+
+	rcu_assign_pointer(ip_vs_conn_tab, t);
+	smp_wmb(); /* lookups that miss ip_vs_conn_resize_tab see the swap */
+	RCU_INIT_POINTER(ip_vs_conn_resize_tab, NULL);
+	ip_vs_conn_tab_size = size;
+
+	ct_write_unlock_all_bh();
+	mutex_unlock(&ip_vs_conn_resize_mutex);
+
+	pr_info("Connection hash table resized (size=%u, memory=%ldKbytes)\n",
+		size, (long)(size * sizeof(struct hlist_nulls_head)) / 1024);
+
+	synchronize_net();
+	vfree(old);
+	return 0;
+}
+
 int __init ip_vs_conn_init(void)
 {
+	struct ip_vs_conn_hashtab *t;
 	int idx;
 
-	/* Compute size and mask */
+	/* Compute size */
+	ip_vs_conn_tab_bits = clamp(ip_vs_conn_tab_bits,
+				    IP_VS_CONN_TAB_MIN_BITS,
+				    IP_VS_CONN_TAB_MAX_BITS);
 	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
 
 	/*
 	 * Allocate the connection hash table and initialize its list heads
 	 */
-	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size * sizeof(*ip_vs_conn_tab));
-	if (!ip_vs_conn_tab)
+	t = ip_vs_conn_tab_alloc(ip_vs_conn_tab_size, 0);
+	if (!t)
 		return -ENOMEM;
 
 	/* Allocate ip_vs_conn slab cache */
@@ -1383,19 +1635,18 @@ int __init ip_vs_conn_init(void)
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
 	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+		vfree(t);
 		return -ENOMEM;
 	}
 
 	pr_info("Connection hash table configured "
 		"(size=%d, memory=%ldKbytes)\n",
 		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+		(long)(ip_vs_conn_tab_size*sizeof(struct hlist_nulls_head))/1024);
 	IP_VS_DBG(0, "Each connection entry needs %Zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
+	RCU_INIT_POINTER(ip_vs_conn_tab, t);
 
 	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
 		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
@@ -1413,5 +1664,5 @@ void ip_vs_conn_cleanup(void)
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
+	vfree(rcu_dereference_protected(ip_vs_conn_tab, 1));
 }
@@ -1681,6 +1681,47 @@ proc_do_sync_ports(struct ctl_table *table, int write,
 	return rc;
 }
 
+static int
+proc_do_conn_tab_size(struct ctl_table *table, int write,
+		      void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int val = ip_vs_conn_tab_size;
+	struct ctl_table tmp = {
+		.data = &val,
+		.maxlen = sizeof(int),
+		.mode = table->mode,
+	};
+	int rc;
+
+	rc = proc_dointvec(&tmp, write, buffer, lenp, ppos);
+	if (write && !rc && val != ip_vs_conn_tab_size) {
+		if (val <= 0)
+			return -EINVAL;
+		rc = ip_vs_conn_tab_resize(val);
+	}
+	return rc;
+}
+
+/* Writing a non-zero value resends all the connections to the backups */
+static int
+proc_do_sync_resync(struct ctl_table *table, int write,
+		    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct netns_ipvs *ipvs = table->extra2;
+	int val = 0;
+	struct ctl_table tmp = {
+		.data = &val,
+		.maxlen = sizeof(int),
+		.mode = table->mode,
+	};
+	int rc;
+
+	rc = proc_dointvec(&tmp, write, buffer, lenp, ppos);
+	if (write && !rc && val)
+		rc = ip_vs_sync_resync(ipvs);
+	return rc;
+}
+
 /*
  *	IPVS sysctl table (under the /proc/sys/net/ipv4/vs/)
  *	Do not change order or insert new entries without
@@ -1849,6 +1890,18 @@ static struct ctl_table vs_vars[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "conn_tab_size",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_do_conn_tab_size,
+	},
+	{
+		.procname	= "sync_resync",
+		.maxlen		= sizeof(int),
+		.mode		= 0200,
+		.proc_handler	= proc_do_sync_resync,
+	},
 #ifdef CONFIG_IP_VS_DEBUG
 	{
 		.procname	= "debug_level",
@@ -3859,7 +3912,8 @@ static int __net_init ip_vs_control_net_init_sysctl(struct netns_ipvs *ipvs)
 		tbl = vs_vars;
 	/* Initialize sysctl defaults */
 	for (idx = 0; idx < ARRAY_SIZE(vs_vars); idx++) {
-		if (tbl[idx].proc_handler == proc_do_defense_mode)
+		if (tbl[idx].proc_handler == proc_do_defense_mode ||
+		    tbl[idx].proc_handler == proc_do_sync_resync)
 			tbl[idx].extra2 = ipvs;
 	}
 	idx = 0;
@@ -3905,6 +3959,11 @@ static int __net_init ip_vs_control_net_init_sysctl(struct netns_ipvs *ipvs)
 	tbl[idx++].data = &ipvs->sysctl_conn_reuse_mode;
 	tbl[idx++].data = &ipvs->sysctl_schedule_icmp;
 	tbl[idx++].data = &ipvs->sysctl_ignore_tunneled;
+	/* The connection table is shared, only init_net may resize it */
+	if (!net_eq(net, &init_net))
+		tbl[idx].mode = 0444;
+	tbl[idx++].data = &ip_vs_conn_tab_size;
+	idx++;	/* sync_resync has no data */
 
 	ipvs->sysctl_hdr = register_net_sysctl(net, "net/ipv4/vs", tbl);
 	if (ipvs->sysctl_hdr == NULL) {
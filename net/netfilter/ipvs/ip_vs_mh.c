@@ -0,0 +1,475 @@
+/*
+ * IPVS:        Maglev Hashing scheduling module
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License
+ *              as published by the Free Software Foundation; either version
+ *              2 of the License, or (at your option) any later version.
+ *
+ * Changes:
+ *
+ */
+
+/*
+ * The mh algorithm assigns a preference list of all the lookup table
+ * positions to each destination and populates the table with the most
+ * preferred position of each destination, in turns. The destination
+ * for a connection is then looked up by the hash key of its source IP
+ * address, like the sh scheduler does:
+ *
+ *       n <- lookup[hash(src_ip) % M];
+ *       if (n is dead) OR
+ *          (n is overloaded) or (n.weight <= 0) then
+ *                 return NULL;
+ *
+ *       return n;
+ *
+ * M is a prime, so every (offset, skip) pair derived from the
+ * destination address walks all the positions. When a destination is
+ * added or removed, only about 1/N of the positions change hands, which
+ * keeps most clients on the same server even when the table is rebuilt
+ * on another director that never saw their connections.
+ *
+ * The weight of a destination gives its number of turns per round, so
+ * a destination gets a share of the positions proportional to it.
+ * Destinations with zero weight get no positions. The table only
+ * depends on the destinations and the order they were added in.
+ *
+ * Eisenbud et al., "Maglev: A Fast and Reliable Software Network Load
+ * Balancer", NSDI 2016.
+ *
+ */
+
+#define KMSG_COMPONENT "IPVS"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/ip.h>
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/bitops.h>
+#include <linux/gcd.h>
+#include <linux/jhash.h>
+
+#include <net/ip_vs.h>
+
+#include <net/tcp.h>
+#include <linux/udp.h>
+#include <linux/sctp.h>
+
+
+/*
+ *      IPVS MH bucket
+ */
+struct ip_vs_mh_bucket {
+	struct ip_vs_dest __rcu	*dest;	/* real server */
+};
+
+/*
+ *     for IPVS MH lookup table, the size has to be a prime
+ */
+#ifndef CONFIG_IP_VS_MH_TAB_INDEX
+#define CONFIG_IP_VS_MH_TAB_INDEX	12
+#endif
+
+static const int ip_vs_mh_primes[] = {
+	251, 509, 1021, 2039, 4093, 8191, 16381
+};
+
+#define IP_VS_MH_TAB_SIZE	ip_vs_mh_primes[CONFIG_IP_VS_MH_TAB_INDEX - 8]
+
+struct ip_vs_mh_state {
+	struct rcu_head			rcu_head;
+	struct ip_vs_mh_bucket		buckets[0];
+};
+
+/* per destination state while the table is populated */
+struct ip_vs_mh_dest_setup {
+	unsigned int		pos;	/* next preferred position */
+	unsigned int		skip;
+	int			turns;
+};
+
+/* Fixed seeds: directors that have the same destinations build the same
+ * table, so a client keeps its server when it fails over to another one.
+ */
+#define IP_VS_MH_SEED_LOOKUP	0x4d48c0deU
+#define IP_VS_MH_SEED_OFFSET	0x9e3779b9U
+#define IP_VS_MH_SEED_SKIP	0x85ebca6bU
+
+/* Helper function to determine if server is unavailable */
+static inline bool is_unavailable(struct ip_vs_dest *dest)
+{
+	return atomic_read(&dest->weight) <= 0 ||
+	       dest->flags & IP_VS_DEST_F_OVERLOAD;
+}
+
+static inline u32
+ip_vs_mh_hash(int af, const union nf_inet_addr *addr, __be16 port, u32 seed)
+{
+#ifdef CONFIG_IP_VS_IPV6
+	if (af == AF_INET6)
+		return jhash_2words(jhash(addr, 16, seed),
+				    (__force u32)port, seed);
+#endif
+	return jhash_2words((__force u32)addr->ip, (__force u32)port, seed);
+}
+
+/*
+ *	Returns the lookup table position for IPVS MH entry
+ */
+static inline unsigned int
+ip_vs_mh_hashkey(int af, const union nf_inet_addr *addr,
+		 __be16 port, unsigned int offset)
+{
+	return ip_vs_mh_hash(af, addr, port, IP_VS_MH_SEED_LOOKUP + offset) %
+		IP_VS_MH_TAB_SIZE;
+}
+
+
+/*
+ *      Get ip_vs_dest associated with supplied parameters.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+	     const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int hash = ip_vs_mh_hashkey(svc->af, addr, port, 0);
+	struct ip_vs_dest *dest = rcu_dereference(s->buckets[hash].dest);
+
+	return (!dest || is_unavailable(dest)) ? NULL : dest;
+}
+
+
+/* As ip_vs_mh_get, but with fallback if selected server is unavailable
+ *
+ * The fallback rehashes the address with another seed, so that the
+ * clients of an unavailable server spread over all the others.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+		      const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int offset, hash;
+	struct ip_vs_dest *dest;
+
+	/* first try the dest it's supposed to go to */
+	hash = ip_vs_mh_hashkey(svc->af, addr, port, 0);
+	dest = rcu_dereference(s->buckets[hash].dest);
+	if (!dest)
+		return NULL;
+	if (!is_unavailable(dest))
+		return dest;
+
+	IP_VS_DBG_BUF(6, "MH: selected unavailable server %s:%d, reselecting",
+		      IP_VS_DBG_ADDR(dest->af, &dest->addr), ntohs(dest->port));
+
+	for (offset = 1; offset < IP_VS_MH_TAB_SIZE; offset++) {
+		hash = ip_vs_mh_hashkey(svc->af, addr, port, offset);
+		dest = rcu_dereference(s->buckets[hash].dest);
+		if (!dest)
+			break;
+		if (!is_unavailable(dest))
+			return dest;
+		IP_VS_DBG_BUF(6, "MH: selected unavailable "
+			      "server %s:%d (offset %d), reselecting",
+			      IP_VS_DBG_ADDR(dest->af, &dest->addr),
+			      ntohs(dest->port), offset);
+	}
+
+	return NULL;
+}
+
+
+/*
+ *      Flush all the hash buckets of the specified table.
+ */
+static void ip_vs_mh_flush(struct ip_vs_mh_state *s)
+{
+	int i;
+	struct ip_vs_mh_bucket *b;
+	struct ip_vs_dest *dest;
+
+	b = &s->buckets[0];
+	for (i=0; i<IP_VS_MH_TAB_SIZE; i++) {
+		dest = rcu_dereference_protected(b->dest, 1);
+		if (dest) {
+			ip_vs_dest_put(dest);
+			RCU_INIT_POINTER(b->dest, NULL);
+		}
+		b++;
+	}
+}
+
+/* Turns per round of each destination: the weights divided by their
+ * greatest common divisor, scaled down until a round fits the table.
+ */
+static int ip_vs_mh_turns(struct ip_vs_service *svc,
+			  struct ip_vs_mh_dest_setup *ds)
+{
+	struct ip_vs_dest *dest;
+	int weight, g = 0, shift = 0, total;
+	int i;
+
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		weight = atomic_read(&dest->weight);
+		if (weight > 0)
+			g = g ? gcd(weight, g) : weight;
+	}
+	if (!g)
+		return 0;
+
+	do {
+		total = 0;
+		i = 0;
+		list_for_each_entry(dest, &svc->destinations, n_list) {
+			weight = atomic_read(&dest->weight);
+			if (weight > 0)
+				ds[i].turns = max((weight / g) >> shift, 1);
+			else
+				ds[i].turns = 0;
+			total += ds[i].turns;
+			i++;
+		}
+		shift++;
+	} while (total > IP_VS_MH_TAB_SIZE);
+
+	return total;
+}
+
+/*
+ *      Populate the lookup table with the current destinations.
+ */
+static int
+ip_vs_mh_reassign(struct ip_vs_mh_state *s, struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_dest_setup *ds, *dsp;
+	struct ip_vs_dest *dest, *old;
+	unsigned long *taken;
+	unsigned int c, filled;
+	int t;
+
+	if (list_empty(&svc->destinations)) {
+		ip_vs_mh_flush(s);
+		return 0;
+	}
+
+	ds = kcalloc(svc->num_dests, sizeof(*ds), GFP_KERNEL);
+	taken = kcalloc(BITS_TO_LONGS(IP_VS_MH_TAB_SIZE), sizeof(*taken),
+			GFP_KERNEL);
+	if (!ds || !taken) {
+		kfree(ds);
+		kfree(taken);
+		return -ENOMEM;
+	}
+
+	if (!ip_vs_mh_turns(svc, ds)) {
+		/* all quiesced, is_unavailable() rejects them anyway */
+		kfree(ds);
+		kfree(taken);
+		return 0;
+	}
+
+	dsp = ds;
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		dsp->pos = ip_vs_mh_hash(dest->af, &dest->addr, dest->port,
+					 IP_VS_MH_SEED_OFFSET) % IP_VS_MH_TAB_SIZE;
+		dsp->skip = ip_vs_mh_hash(dest->af, &dest->addr, dest->port,
+					  IP_VS_MH_SEED_SKIP) %
+			    (IP_VS_MH_TAB_SIZE - 1) + 1;
+		dsp++;
+	}
+
+	filled = 0;
+	while (filled < IP_VS_MH_TAB_SIZE) {
+		dsp = ds;
+		list_for_each_entry(dest, &svc->destinations, n_list) {
+			for (t = 0; t < dsp->turns &&
+				    filled < IP_VS_MH_TAB_SIZE; t++) {
+				/* the table size is a prime, so the walk
+				 * reaches every free position
+				 */
+				c = dsp->pos;
+				while (test_bit(c, taken)) {
+					c += dsp->skip;
+					if (c >= IP_VS_MH_TAB_SIZE)
+						c -= IP_VS_MH_TAB_SIZE;
+				}
+				__set_bit(c, taken);
+				dsp->pos = c + dsp->skip;
+				if (dsp->pos >= IP_VS_MH_TAB_SIZE)
+					dsp->pos -= IP_VS_MH_TAB_SIZE;
+
+				old = rcu_dereference_protected(
+						s->buckets[c].dest, 1);
+				if (old != dest) {
+					ip_vs_dest_hold(dest);
+					rcu_assign_pointer(s->buckets[c].dest,
+							   dest);
+					if (old)
+						ip_vs_dest_put(old);
+				}
+				filled++;
+			}
+			dsp++;
+		}
+	}
+
+	IP_VS_DBG(6, "MH: lookup table populated for %u destinations\n",
+		  svc->num_dests);
+
+	kfree(ds);
+	kfree(taken);
+	return 0;
+}
+
+
+static int ip_vs_mh_init_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s;
+	size_t size;
+
+	/* allocate the MH table for this service */
+	size = sizeof(struct ip_vs_mh_bucket) * IP_VS_MH_TAB_SIZE;
+	s = kzalloc(sizeof(struct ip_vs_mh_state) + size, GFP_KERNEL);
+	if (s == NULL)
+		return -ENOMEM;
+
+	svc->sched_data = s;
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) allocated for "
+		  "current service\n", size);
+
+	/* populate the lookup table with current dests */
+	return ip_vs_mh_reassign(s, svc);
+}
+
+
+static void ip_vs_mh_done_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* got to clean up lookup table here */
+	ip_vs_mh_flush(s);
+
+	/* release the table itself */
+	kfree_rcu(s, rcu_head);
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) released\n",
+		  sizeof(struct ip_vs_mh_bucket) * IP_VS_MH_TAB_SIZE);
+}
+
+
+static int ip_vs_mh_dest_changed(struct ip_vs_service *svc,
+				 struct ip_vs_dest *dest)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* repopulate the lookup table with the updated service */
+	return ip_vs_mh_reassign(s, svc);
+}
+
+
+/* Helper function to get port number */
+static inline __be16
+ip_vs_mh_get_port(const struct sk_buff *skb, struct ip_vs_iphdr *iph)
+{
+	__be16 _ports[2], *ports;
+
+	/* At this point we know that we have a valid packet of some kind.
+	 * Because ICMP packets are only guaranteed to have the first 8
+	 * bytes, let's just grab the ports.  Fortunately they're in the
+	 * same position for all three of the protocols we care about.
+	 */
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_SCTP:
+		ports = skb_header_pointer(skb, iph->len, sizeof(_ports),
+					   &_ports);
+		if (unlikely(!ports))
+			return 0;
+
+		if (likely(!ip_vs_iph_inverse(iph)))
+			return ports[0];
+		else
+			return ports[1];
+	default:
+		return 0;
+	}
+}
+
+
+/*
+ *      Maglev Hashing scheduling
+ */
+static struct ip_vs_dest *
+ip_vs_mh_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
+		  struct ip_vs_iphdr *iph)
+{
+	struct ip_vs_dest *dest;
+	struct ip_vs_mh_state *s;
+	__be16 port = 0;
+	const union nf_inet_addr *hash_addr;
+
+	hash_addr = ip_vs_iph_inverse(iph) ? &iph->daddr : &iph->saddr;
+
+	IP_VS_DBG(6, "ip_vs_mh_schedule(): Scheduling...\n");
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_PORT)
+		port = ip_vs_mh_get_port(skb, iph);
+
+	s = (struct ip_vs_mh_state *) svc->sched_data;
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_FALLBACK)
+		dest = ip_vs_mh_get_fallback(svc, s, hash_addr, port);
+	else
+		dest = ip_vs_mh_get(svc, s, hash_addr, port);
+
+	if (!dest) {
+		ip_vs_scheduler_err(svc, "no destination available");
+		return NULL;
+	}
+
+	IP_VS_DBG_BUF(6, "MH: source IP address %s --> server %s:%d\n",
+		      IP_VS_DBG_ADDR(svc->af, hash_addr),
+		      IP_VS_DBG_ADDR(dest->af, &dest->addr),
+		      ntohs(dest->port));
+
+	return dest;
+}
+
+
+/*
+ *      IPVS MH Scheduler structure
+ */
+static struct ip_vs_scheduler ip_vs_mh_scheduler =
+{
+	.name =			"mh",
+	.refcnt =		ATOMIC_INIT(0),
+	.module =		THIS_MODULE,
+	.n_list	 =		LIST_HEAD_INIT(ip_vs_mh_scheduler.n_list),
+	.init_service =		ip_vs_mh_init_svc,
+	.done_service =		ip_vs_mh_done_svc,
+	.add_dest =		ip_vs_mh_dest_changed,
+	.del_dest =		ip_vs_mh_dest_changed,
+	.upd_dest =		ip_vs_mh_dest_changed,
+	.schedule =		ip_vs_mh_schedule,
+};
+
+
+static int __init ip_vs_mh_init(void)
+{
+	return register_ip_vs_scheduler(&ip_vs_mh_scheduler);
+}
+
+
+static void __exit ip_vs_mh_cleanup(void)
+{
+	unregister_ip_vs_scheduler(&ip_vs_mh_scheduler);
+	synchronize_rcu();
+}
+
+
+module_init(ip_vs_mh_init);
+module_exit(ip_vs_mh_cleanup);
+MODULE_LICENSE("GPL");
@@ -48,6 +48,9 @@
 #include <linux/kthread.h>
 #include <linux/wait.h>
 #include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <asm/unaligned.h>		/* Used for ntoh_seq and hton_seq */
 
@@ -373,8 +376,10 @@ static inline void sb_queue_tail(struct netns_ipvs *ipvs,
 		list_add_tail(&sb->list, &ms->sync_queue);
 		if ((++ms->sync_queue_delay) == IPVS_SYNC_WAKEUP_RATE)
 			wake_up_process(ms->master_thread);
-	} else
+	} else {
+		ms->sync_dropped++;
 		ip_vs_sync_buff_release(sb);
+	}
 	spin_unlock(&ipvs->sync_lock);
 }
 
@@ -399,10 +404,25 @@ get_curr_sync_buff(struct netns_ipvs *ipvs, struct ipvs_master_sync_state *ms,
 	return sb;
 }
 
+/* Each master thread owns a range of the client flow hash, so all the
+ * messages for a flow leave in order through the same thread and port,
+ * even when the connection is recreated.
+ */
 static inline int
 select_master_thread_id(struct netns_ipvs *ipvs, struct ip_vs_conn *cp)
 {
-	return ((long) cp >> (1 + ilog2(sizeof(*cp)))) & ipvs->threads_mask;
+	u32 hash;
+
+#ifdef CONFIG_IP_VS_IPV6
+	if (cp->af == AF_INET6)
+		hash = jhash(&cp->caddr.in6, sizeof(cp->caddr.in6),
+			     (__force u32)cp->cport);
+	else
+#endif
+		hash = jhash_2words((__force u32)cp->caddr.ip,
+				    (__force u32)cp->cport, 0);
+
+	return reciprocal_scale(hash, ipvs->threads_mask + 1);
 }
 
 /*
@@ -533,8 +553,11 @@ set:
  *      Version 0 , could be switched in by sys_ctl.
  *      Add an ip_vs_conn information into the current sync_buff.
  */
+static void __ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
+			      int pkts, bool force);
+
 static void ip_vs_sync_conn_v0(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
-			       int pkts)
+			       int pkts, bool force)
 {
 	struct ip_vs_sync_mesg_v0 *m;
 	struct ip_vs_sync_conn_v0 *s;
@@ -549,7 +572,7 @@ static void ip_vs_sync_conn_v0(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
 	if (cp->flags & IP_VS_CONN_F_ONE_PACKET)
 		return;
 
-	if (!ip_vs_sync_conn_needed(ipvs, cp, pkts))
+	if (!force && !ip_vs_sync_conn_needed(ipvs, cp, pkts))
 		return;
 
 	spin_lock_bh(&ipvs->sync_buff_lock);
@@ -566,7 +589,8 @@ static void ip_vs_sync_conn_v0(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
 	if (buff) {
 		m = (struct ip_vs_sync_mesg_v0 *) buff->mesg;
 		/* Send buffer if it is for v1 */
-		if (buff->head + len > buff->end || !m->nr_conns) {
+		if (buff->head + len > buff->end || !m->nr_conns ||
+		    m->nr_conns == MAX_CONNS_PER_SYNCBUFF) {
 			sb_queue_tail(ipvs, ms);
 			ms->sync_buff = NULL;
 			buff = NULL;
@@ -605,11 +629,12 @@ static void ip_vs_sync_conn_v0(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
 	m->nr_conns++;
 	m->size = htons(ntohs(m->size) + len);
 	buff->head += len;
+	ms->sync_conns++;
 	spin_unlock_bh(&ipvs->sync_buff_lock);
 
-	/* synchronize its controller if it has */
+	/* synchronize its controller if it has, a resync walks them anyway */
 	cp = cp->control;
-	if (cp) {
+	if (cp && !force) {
 		if (cp->flags & IP_VS_CONN_F_TEMPLATE)
 			pkts = atomic_add_return(1, &cp->in_pkts);
 		else
@@ -620,10 +645,11 @@ static void ip_vs_sync_conn_v0(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
 
 /*
  *      Add an ip_vs_conn information into the current sync_buff.
- *      Called by ip_vs_in.
- *      Sending Version 1 messages
+ *      Sending Version 1 messages. With @force the connection is sent
+ *      whatever its state and rate limits, for a resync.
  */
-void ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp, int pkts)
+static void __ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp,
+			      int pkts, bool force)
 {
 	struct ip_vs_sync_mesg *m;
 	union ip_vs_sync_conn *s;
@@ -635,14 +661,14 @@ void ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp, int pkts)
 
 	/* Handle old version of the protocol */
 	if (sysctl_sync_ver(ipvs) == 0) {
-		ip_vs_sync_conn_v0(ipvs, cp, pkts);
+		ip_vs_sync_conn_v0(ipvs, cp, pkts, force);
 		return;
 	}
 	/* Do not sync ONE PACKET */
 	if (cp->flags & IP_VS_CONN_F_ONE_PACKET)
 		goto control;
 sloop:
-	if (!ip_vs_sync_conn_needed(ipvs, cp, pkts))
+	if (!force && !ip_vs_sync_conn_needed(ipvs, cp, pkts))
 		goto control;
 
 	/* Sanity checks */
@@ -686,7 +712,8 @@ sloop:
 		m = buff->mesg;
 		pad = (4 - (size_t) buff->head) & 3;
 		/* Send buffer if it is for v0 */
-		if (buff->head + len + pad > buff->end || m->reserved) {
+		if (buff->head + len + pad > buff->end || m->reserved ||
+		    m->nr_conns == MAX_CONNS_PER_SYNCBUFF) {
 			sb_queue_tail(ipvs, ms);
 			ms->sync_buff = NULL;
 			buff = NULL;
@@ -726,6 +753,7 @@ sloop:
 	s->v4.fwmark = htonl(cp->fwmark);
 	s->v4.timeout = htonl(cp->timeout / HZ);
 	m->nr_conns++;
+	ms->sync_conns++;
 
 #ifdef CONFIG_IP_VS_IPV6
 	if (cp->af == AF_INET6) {
@@ -767,9 +795,9 @@ sloop:
 	spin_unlock_bh(&ipvs->sync_buff_lock);
 
 control:
-	/* synchronize its controller if it has */
+	/* synchronize its controller if it has, a resync walks them anyway */
 	cp = cp->control;
-	if (!cp)
+	if (!cp || force)
 		return;
 	if (cp->flags & IP_VS_CONN_F_TEMPLATE)
 		pkts = atomic_add_return(1, &cp->in_pkts);
@@ -778,6 +806,87 @@ control:
 	goto sloop;
 }
 
+/*
+ *      Add an ip_vs_conn information into the current sync_buff.
+ *      Called by ip_vs_in.
+ */
+void ip_vs_sync_conn(struct netns_ipvs *ipvs, struct ip_vs_conn *cp, int pkts)
+{
+	__ip_vs_sync_conn(ipvs, cp, pkts, false);
+}
+
+static void ip_vs_sync_resync_conn(struct netns_ipvs *ipvs,
+				   struct ip_vs_conn *cp)
+{
+	__ip_vs_sync_conn(ipvs, cp, 0, true);
+}
+
+/* Leave room in the master queues for the updates of live traffic */
+static bool ip_vs_sync_resync_busy(struct netns_ipvs *ipvs)
+{
+	unsigned long limit = sysctl_sync_qlen_max(ipvs) / 2;
+	bool busy = false;
+	int id;
+
+	spin_lock_bh(&ipvs->sync_lock);
+	for (id = 0; id <= ipvs->threads_mask; id++) {
+		if (ipvs->ms[id].sync_queue_len > limit) {
+			busy = true;
+			break;
+		}
+	}
+	spin_unlock_bh(&ipvs->sync_lock);
+
+	return busy;
+}
+
+/*
+ *      Bulk resync: walk the connection table a few buckets at a time and
+ *      send every connection, at the pace the master threads drain it.
+ */
+static void ip_vs_sync_resync_work_handler(struct work_struct *work)
+{
+	struct netns_ipvs *ipvs =
+		container_of(work, struct netns_ipvs, sync_resync_work.work);
+
+	if (ip_vs_sync_resync_busy(ipvs)) {
+		schedule_delayed_work(&ipvs->sync_resync_work,
+				      max(IPVS_SYNC_SEND_DELAY, 1));
+		return;
+	}
+
+	if (ip_vs_conn_walk(ipvs, &ipvs->sync_resync_pos,
+			    IPVS_SYNC_RESYNC_BUCKETS, ip_vs_sync_resync_conn))
+		schedule_delayed_work(&ipvs->sync_resync_work, 0);
+	else
+		IP_VS_DBG(2, "sync resync of all connections done\n");
+}
+
+/*
+ *      Start a resync of all the connections, e.g. when a backup starts.
+ *      Called with sync_mutex held.
+ */
+static void __ip_vs_sync_resync(struct netns_ipvs *ipvs)
+{
+	cancel_delayed_work_sync(&ipvs->sync_resync_work);
+	ipvs->sync_resync_pos = 0;
+	schedule_delayed_work(&ipvs->sync_resync_work, 0);
+}
+
+int ip_vs_sync_resync(struct netns_ipvs *ipvs)
+{
+	int ret = -ESRCH;
+
+	mutex_lock(&ipvs->sync_mutex);
+	if (ipvs->ms) {
+		__ip_vs_sync_resync(ipvs);
+		ret = 0;
+	}
+	mutex_unlock(&ipvs->sync_mutex);
+
+	return ret;
+}
+
 /*
  *  fill_param used by version 1
  */
@@ -1708,6 +1817,7 @@ static int sync_thread_master(void *data)
 			if (unlikely(kthread_should_stop()))
 				goto done;
 		}
+		ms->sync_sent++;
 		ip_vs_sync_buff_release(sb);
 	}
 
@@ -1738,6 +1848,7 @@ static int sync_thread_backup(void *data)
 {
 	struct ip_vs_sync_thread_data *tinfo = data;
 	struct netns_ipvs *ipvs = tinfo->ipvs;
+	struct ipvs_backup_sync_state *bs = &ipvs->bs[tinfo->id];
 	int len;
 
 	pr_info("sync thread started: state = BACKUP, mcast_ifn = %s, "
@@ -1754,11 +1865,15 @@ static int sync_thread_backup(void *data)
 			len = ip_vs_receive(tinfo->sock, tinfo->buf,
 					ipvs->bcfg.sync_maxlen);
 			if (len <= 0) {
-				if (len != -EAGAIN)
+				if (len != -EAGAIN) {
+					bs->recv_errors++;
 					pr_err("receiving message error\n");
+				}
 				break;
 			}
 
+			bs->recv_mesgs++;
+			bs->recv_bytes += len;
 			ip_vs_process_message(ipvs, tinfo->buf, len);
 		}
 	}
@@ -1812,8 +1927,10 @@ int start_sync_thread(struct netns_ipvs *ipvs, struct ipvs_sync_daemon_cfg *c,
 	hlen = (AF_INET6 == c->mcast_af) ?
 	       sizeof(struct ipv6hdr) + sizeof(struct udphdr) :
 	       sizeof(struct iphdr) + sizeof(struct udphdr);
-	mtu = (state == IP_VS_STATE_BACKUP) ?
-		  clamp(dev->mtu, 1500U, 65535U) : 1500U;
+	/* Fill the link MTU, a message never carries more than
+	 * MAX_CONNS_PER_SYNCBUFF connections anyway.
+	 */
+	mtu = clamp(dev->mtu, 1500U, 65535U);
 	min_mtu = (state == IP_VS_STATE_BACKUP) ? 1024 : 1;
 
 	if (c->sync_maxlen)
@@ -1861,6 +1978,9 @@ int start_sync_thread(struct netns_ipvs *ipvs, struct ipvs_sync_daemon_cfg *c,
 				GFP_KERNEL);
 		if (!array)
 			goto out;
+		ipvs->bs = kcalloc(count, sizeof(ipvs->bs[0]), GFP_KERNEL);
+		if (!ipvs->bs)
+			goto out;
 	}
 
 	tinfo = NULL;
@@ -1908,6 +2028,10 @@ int start_sync_thread(struct netns_ipvs *ipvs, struct ipvs_sync_daemon_cfg *c,
 	ipvs->sync_state |= state;
 	spin_unlock_bh(&ipvs->sync_buff_lock);
 
+	/* bring the backups up to date with what we have */
+	if (state == IP_VS_STATE_MASTER)
+		__ip_vs_sync_resync(ipvs);
+
 	/* increase the module use count */
 	ip_vs_use_count_inc();
 
@@ -1929,13 +2053,17 @@ outtinfo:
 		else
 			kthread_stop(array[count]);
 	}
-	kfree(array);
 
 out:
+	kfree(array);
 	if (!(ipvs->sync_state & IP_VS_STATE_MASTER)) {
 		kfree(ipvs->ms);
 		ipvs->ms = NULL;
 	}
+	if (!(ipvs->sync_state & IP_VS_STATE_BACKUP)) {
+		kfree(ipvs->bs);
+		ipvs->bs = NULL;
+	}
 	return result;
 }
 
@@ -1958,6 +2086,8 @@ int stop_sync_thread(struct netns_ipvs *ipvs, int state)
 		 * progress of stopping the master sync daemon.
 		 */
 
+		cancel_delayed_work_sync(&ipvs->sync_resync_work);
+
 		spin_lock_bh(&ipvs->sync_buff_lock);
 		spin_lock(&ipvs->sync_lock);
 		ipvs->sync_state &= ~IP_VS_STATE_MASTER;
@@ -1996,6 +2126,8 @@ int stop_sync_thread(struct netns_ipvs *ipvs, int state)
 		}
 		kfree(array);
 		ipvs->backup_threads = NULL;
+		kfree(ipvs->bs);
+		ipvs->bs = NULL;
 	}
 
 	/* decrease the module use count */
@@ -2004,6 +2136,76 @@ int stop_sync_thread(struct netns_ipvs *ipvs, int state)
 	return retc;
 }
 
+#ifdef CONFIG_PROC_FS
+/*
+ *	/proc/net/ip_vs_sync_stats: Lag is the age of the oldest update
+ *	the master thread has not sent yet.
+ */
+static int ip_vs_sync_stats_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq_file_single_net(seq);
+	struct netns_ipvs *ipvs = net_ipvs(net);
+	struct ipvs_master_sync_state *ms;
+	struct ip_vs_sync_buff *sb;
+	unsigned long queued, oldest;
+	int id;
+
+	mutex_lock(&ipvs->sync_mutex);
+	if (ipvs->ms) {
+		seq_puts(seq,
+			 "Master Id    Conns Messages  Dropped Queued  Lag(ms)\n");
+		for (id = 0; id <= ipvs->threads_mask; id++) {
+			ms = &ipvs->ms[id];
+			oldest = jiffies;
+
+			spin_lock_bh(&ipvs->sync_buff_lock);
+			if (ms->sync_buff)
+				oldest = ms->sync_buff->firstuse;
+			spin_lock(&ipvs->sync_lock);
+			queued = ms->sync_queue_len;
+			if (queued) {
+				sb = list_first_entry(&ms->sync_queue,
+						      struct ip_vs_sync_buff,
+						      list);
+				oldest = sb->firstuse;
+			}
+			spin_unlock(&ipvs->sync_lock);
+			spin_unlock_bh(&ipvs->sync_buff_lock);
+
+			seq_printf(seq, "       %2d %8lu %8lu %8lu %6lu %8u\n",
+				   id, ms->sync_conns, ms->sync_sent,
+				   ms->sync_dropped, queued,
+				   jiffies_to_msecs(jiffies - oldest));
+		}
+	}
+	if (ipvs->bs) {
+		seq_puts(seq,
+			 "Backup Id Messages        Bytes   Errors\n");
+		for (id = 0; id <= ipvs->threads_mask; id++)
+			seq_printf(seq, "       %2d %8lu %12lu %8lu\n", id,
+				   ipvs->bs[id].recv_mesgs,
+				   ipvs->bs[id].recv_bytes,
+				   ipvs->bs[id].recv_errors);
+	}
+	mutex_unlock(&ipvs->sync_mutex);
+
+	return 0;
+}
+
+static int ip_vs_sync_stats_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, ip_vs_sync_stats_show);
+}
+
+static const struct file_operations ip_vs_sync_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = ip_vs_sync_stats_seq_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release_net,
+};
+#endif
+
 /*
  * Initialize data struct for each netns
  */
@@ -2012,6 +2214,10 @@ int __net_init ip_vs_sync_net_init(struct netns_ipvs *ipvs)
 	__mutex_init(&ipvs->sync_mutex, "ipvs->sync_mutex", &__ipvs_sync_key);
 	spin_lock_init(&ipvs->sync_lock);
 	spin_lock_init(&ipvs->sync_buff_lock);
+	INIT_DELAYED_WORK(&ipvs->sync_resync_work,
+			  ip_vs_sync_resync_work_handler);
+	proc_create("ip_vs_sync_stats", 0, ipvs->net->proc_net,
+		    &ip_vs_sync_stats_fops);
 	return 0;
 }
 
@@ -2028,4 +2234,5 @@ void ip_vs_sync_net_cleanup(struct netns_ipvs *ipvs)
 	if (retc && retc != -ESRCH)
 		pr_err("Failed to stop Backup Daemon\n");
 	mutex_unlock(&ipvs->sync_mutex);
+	remove_proc_entry("ip_vs_sync_stats", ipvs->net->proc_net);
 }
@@ -162,6 +162,28 @@ static inline u_int32_t hash_conntrack(const struct net *net,
 	return __hash_conntrack(tuple, net->ct.htable_size);
 }
 
+/* Snapshot the table and its size for a lockless walk. The generation
+ * only moves while a resize swaps the tables, so this doesn't wait for
+ * the entries to be rehashed.
+ */
+static unsigned int nf_conntrack_get_ht(struct net *net,
+					struct hlist_nulls_head **hash,
+					unsigned int *hsize)
+{
+	struct hlist_nulls_head *hptr;
+	unsigned int sequence, hsz;
+
+	do {
+		sequence = read_seqcount_begin(&net->ct.generation);
+		hsz = net->ct.htable_size;
+		hptr = net->ct.hash;
+	} while (read_seqcount_retry(&net->ct.generation, sequence));
+
+	*hash = hptr;
+	*hsize = hsz;
+	return sequence;
+}
+
 bool
 nf_ct_get_tuple(const struct sk_buff *skb,
 		unsigned int nhoff,
@@ -332,7 +354,6 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	pr_debug("destroy_conntrack(%p)\n", ct);
 	NF_CT_ASSERT(atomic_read(&nfct->use) == 0);
-	NF_CT_ASSERT(!timer_pending(&ct->timeout));
 
 	if (unlikely(nf_ct_is_template(ct))) {
 		nf_ct_tmpl_free(ct);
@@ -391,39 +412,35 @@ static void nf_ct_delete_from_lists(struct nf_conn *ct)
 	local_bh_enable();
 }
 
+/* Whoever sets the dying bit first owns the hash table reference. */
 bool nf_ct_delete(struct nf_conn *ct, u32 portid, int report)
 {
 	struct nf_conn_tstamp *tstamp;
 
+	if (test_and_set_bit(IPS_DYING_BIT, &ct->status))
+		return false;
+
 	tstamp = nf_conn_tstamp_find(ct);
 	if (tstamp && tstamp->stop == 0)
 		tstamp->stop = ktime_get_real_ns();
 
-	if (nf_ct_is_dying(ct))
-		goto delete;
-
 	if (nf_conntrack_event_report(IPCT_DESTROY, ct,
 				    portid, report) < 0) {
-		/* destroy event was not delivered */
+		/* destroy event was not delivered. nf_ct_put will
+		 * be done by event cache worker on redelivery.
+		 */
 		nf_ct_delete_from_lists(ct);
 		nf_conntrack_ecache_delayed_work(nf_ct_net(ct));
 		return false;
 	}
 
 	nf_conntrack_ecache_work(nf_ct_net(ct));
-	set_bit(IPS_DYING_BIT, &ct->status);
- delete:
 	nf_ct_delete_from_lists(ct);
 	nf_ct_put(ct);
 	return true;
 }
 EXPORT_SYMBOL_GPL(nf_ct_delete);
 
-static void death_by_timeout(unsigned long ul_conntrack)
-{
-	nf_ct_delete((struct nf_conn *)ul_conntrack, 0, 0);
-}
-
 static inline bool
 nf_ct_key_equal(struct nf_conntrack_tuple_hash *h,
 		const struct nf_conntrack_tuple *tuple,
@@ -439,6 +456,52 @@ nf_ct_key_equal(struct nf_conntrack_tuple_hash *h,
 	       nf_ct_is_confirmed(ct);
 }
 
+static void nf_ct_gc_expired(struct nf_conn *ct)
+{
+	if (!atomic_inc_not_zero(&ct->ct_general.use))
+		return;
+
+	if (nf_ct_should_gc(ct))
+		nf_ct_kill(ct);
+
+	nf_ct_put(ct);
+}
+
+/* Walk one hash chain, reaping expired entries on the way. Returns
+ * false if the walk ended on another chain and must be restarted.
+ */
+static bool
+nf_conntrack_find_chain(struct net *net, const struct nf_conntrack_zone *zone,
+			const struct nf_conntrack_tuple *tuple,
+			struct hlist_nulls_head *head, unsigned int bucket,
+			struct nf_conntrack_tuple_hash **found)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+
+	hlist_nulls_for_each_entry_rcu(h, n, head, hnnode) {
+		struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
+		if (nf_ct_key_equal(h, tuple, zone)) {
+			*found = h;
+			return true;
+		}
+		NF_CT_STAT_INC(net, searched);
+	}
+	*found = NULL;
+	/*
+	 * if the nulls value we got at the end of this lookup is
+	 * not the expected one, we must restart lookup.
+	 * We probably met an item that was moved to another chain.
+	 */
+	return get_nulls_value(n) == bucket;
+}
+
 /*
  * Warning :
  * - Caller must take a reference on returned object
@@ -448,35 +511,52 @@ static struct nf_conntrack_tuple_hash *
 ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 		      const struct nf_conntrack_tuple *tuple, u32 hash)
 {
+	struct hlist_nulls_head *ct_hash, *next_hash;
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_node *n;
-	unsigned int bucket = hash_bucket(hash, net);
+	unsigned int bucket, hsize, sequence;
 
 	/* Disable BHs the entire time since we normally need to disable them
 	 * at least once for the stats anyway.
 	 */
 	local_bh_disable();
 begin:
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[bucket], hnnode) {
-		if (nf_ct_key_equal(h, tuple, zone)) {
-			NF_CT_STAT_INC(net, found);
-			local_bh_enable();
-			return h;
-		}
-		NF_CT_STAT_INC(net, searched);
-	}
-	/*
-	 * if the nulls value we got at the end of this lookup is
-	 * not the expected one, we must restart lookup.
-	 * We probably met an item that was moved to another chain.
+	sequence = nf_conntrack_get_ht(net, &ct_hash, &hsize);
+	bucket = __hash_bucket(hash, hsize);
+	if (!nf_conntrack_find_chain(net, zone, tuple, &ct_hash[bucket],
+				     bucket, &h))
+		goto restart;
+	if (h)
+		goto found;
+
+	/* A resize doesn't stop lookups while it moves the entries, so an
+	 * entry missing from the current table may already be in the next.
 	 */
-	if (get_nulls_value(n) != bucket) {
-		NF_CT_STAT_INC(net, search_restart);
-		goto begin;
+	next_hash = rcu_dereference(net->ct.resize_hash);
+	if (next_hash && next_hash != ct_hash) {
+		smp_rmb(); /* pairs with rcu_assign_pointer() in resize */
+		hsize = net->ct.resize_size;
+		bucket = __hash_bucket(hash, hsize);
+		if (!nf_conntrack_find_chain(net, zone, tuple,
+					     &next_hash[bucket], bucket, &h))
+			goto restart;
+		if (h)
+			goto found;
 	}
-	local_bh_enable();
 
+	/* the tables were swapped under us, look again */
+	if (read_seqcount_retry(&net->ct.generation, sequence))
+		goto restart;
+
+	local_bh_enable();
 	return NULL;
+
+restart:
+	NF_CT_STAT_INC(net, search_restart);
+	goto begin;
+found:
+	NF_CT_STAT_INC(net, found);
+	local_bh_enable();
+	return h;
 }
 
 /* Find a connection corresponding to a tuple. */
@@ -563,7 +643,10 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 				     NF_CT_DIRECTION(h)))
 			goto out;
 
-	add_timer(&ct->timeout);
+	/* Timeout is relative to confirmation time, not original
+	 * setting time, see __nf_conntrack_confirm().
+	 */
+	ct->timeout += nfct_time_stamp;
 	smp_wmb();
 	/* The caller holds a reference to this object */
 	atomic_set(&ct->ct_general.use, 2);
@@ -656,11 +739,10 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 				     NF_CT_DIRECTION(h)))
 			goto out;
 
-	/* Timer relative to confirmation time, not original
+	/* Timeout is relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
 	   weird delay cases. */
-	ct->timeout.expires += jiffies;
-	add_timer(&ct->timeout);
+	ct->timeout += nfct_time_stamp;
 	atomic_inc(&ct->ct_general.use);
 	ct->status |= IPS_CONFIRMED;
 
@@ -673,7 +755,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		tstamp->start = ktime_to_ns(skb->tstamp);
 	}
 	/* Since the lookup is lockless, hash insertion must be done after
-	 * starting the timer and setting the CONFIRMED bit. The RCU barriers
+	 * setting the timeout and the CONFIRMED bit. The RCU barriers
 	 * guarantee that no other CPU can find the conntrack before the above
 	 * stores are visible.
 	 */
@@ -708,19 +790,27 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	struct net *net = nf_ct_net(ignored_conntrack);
 	const struct nf_conntrack_zone *zone;
 	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
+	unsigned int hash, hsize;
 	struct nf_conn *ct;
-	unsigned int hash;
 
 	zone = nf_ct_zone(ignored_conntrack);
-	hash = hash_conntrack(net, tuple);
 
 	/* Disable BHs the entire time since we need to disable them at
 	 * least once for the stats anyway.
 	 */
 	rcu_read_lock_bh();
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash], hnnode) {
+	nf_conntrack_get_ht(net, &ct_hash, &hsize);
+	hash = __hash_conntrack(tuple, hsize);
+	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash], hnnode) {
 		ct = nf_ct_tuplehash_to_ctrack(h);
+
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
 		if (ct != ignored_conntrack &&
 		    nf_ct_tuple_equal(tuple, &h->tuple) &&
 		    nf_ct_zone_equal(ct, zone, NF_CT_DIRECTION(h))) {
@@ -742,7 +832,9 @@ EXPORT_SYMBOL_GPL(nf_conntrack_tuple_taken);
    connection.  Too bad: we're in trouble anyway. */
 static noinline int early_drop(struct net *net, unsigned int _hash)
 {
-	/* Use oldest entry, which is roughly LRU */
+	/* Use oldest entry, which is roughly LRU. An expired entry the gc
+	 * worker hasn't reached yet is the best victim of all.
+	 */
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct = NULL, *tmp;
 	struct hlist_nulls_node *n;
@@ -765,7 +857,8 @@ restart:
 		hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash],
 					 hnnode) {
 			tmp = nf_ct_tuplehash_to_ctrack(h);
-			if (!test_bit(IPS_ASSURED_BIT, &tmp->status) &&
+			if ((nf_ct_is_expired(tmp) ||
+			     !test_bit(IPS_ASSURED_BIT, &tmp->status)) &&
 			    !nf_ct_is_dying(tmp) &&
 			    atomic_inc_not_zero(&tmp->ct_general.use)) {
 				ct = tmp;
@@ -786,16 +879,89 @@ restart:
 	if (!ct)
 		return dropped;
 
-	if (del_timer(&ct->timeout)) {
-		if (nf_ct_delete(ct, 0, 0)) {
-			dropped = 1;
-			NF_CT_STAT_INC_ATOMIC(net, early_drop);
-		}
+	if (nf_ct_delete(ct, 0, 0)) {
+		dropped = 1;
+		NF_CT_STAT_INC_ATOMIC(net, early_drop);
 	}
 	nf_ct_put(ct);
 	return dropped;
 }
 
+/* Each gc run scans 1/GC_MAX_BUCKETS_DIV of the table. The run interval
+ * drops to the minimum while most scanned entries turn out expired and
+ * creeps back up otherwise, so that a full scan of an idle table takes
+ * at most GC_MAX_SCAN_JIFFIES.
+ */
+#define GC_MAX_BUCKETS_DIV	128u
+#define GC_MAX_SCAN_JIFFIES	(16u * HZ)
+#define GC_EVICT_RATIO		50u
+
+static void gc_worker(struct work_struct *work)
+{
+	struct netns_ct *ctnet =
+		container_of(work, struct netns_ct, gc_dwork.work);
+	struct net *net = container_of(ctnet, struct net, ct);
+	unsigned int min_interval = max(HZ / GC_MAX_BUCKETS_DIV, 1u);
+	unsigned int max_interval = GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV;
+	unsigned int i, goal, buckets = 0, expired_count = 0;
+	unsigned int ratio, scanned = 0;
+
+	goal = max(ctnet->htable_size / GC_MAX_BUCKETS_DIV, 1u);
+	i = ctnet->gc_bucket;
+
+	do {
+		struct nf_conntrack_tuple_hash *h;
+		struct hlist_nulls_head *ct_hash;
+		struct hlist_nulls_node *n;
+		unsigned int hsize;
+		struct nf_conn *tmp;
+
+		i++;
+		rcu_read_lock();
+
+		nf_conntrack_get_ht(net, &ct_hash, &hsize);
+		if (i >= hsize)
+			i = 0;
+
+		/* A reaped entry moves to the dying list and may take the
+		 * walk with it; the rest of the chain waits for the next pass.
+		 */
+		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
+			tmp = nf_ct_tuplehash_to_ctrack(h);
+
+			scanned++;
+			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
+				nf_ct_offload_timeout(tmp);
+				continue;
+			}
+
+			if (nf_ct_is_expired(tmp)) {
+				nf_ct_gc_expired(tmp);
+				expired_count++;
+			}
+		}
+
+		rcu_read_unlock();
+		cond_resched_rcu_qs();
+	} while (++buckets < goal);
+
+	if (ctnet->gc_exiting)
+		return;
+
+	ratio = scanned ? expired_count * 100 / scanned : 0;
+	if (ratio > GC_EVICT_RATIO) {
+		ctnet->gc_interval = min_interval;
+	} else {
+		ctnet->gc_interval += min_interval;
+		if (ctnet->gc_interval > max_interval)
+			ctnet->gc_interval = max_interval;
+	}
+
+	ctnet->gc_bucket = i;
+	queue_delayed_work(system_long_wq, &ctnet->gc_dwork,
+			   ctnet->gc_interval);
+}
+
 void init_nf_conntrack_hash_rnd(void)
 {
 	unsigned int rand;
@@ -853,8 +1019,8 @@ __nf_conntrack_alloc(struct net *net,
 	/* save hash for reusing when confirming */
 	*(unsigned long *)(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev) = hash;
 	ct->status = 0;
-	/* Don't set timer yet: wait for confirmation */
-	setup_timer(&ct->timeout, death_by_timeout, (unsigned long)ct);
+	/* relative until confirmation */
+	ct->timeout = 0;
 	write_pnet(&ct->ct_net, net);
 	memset(&ct->__nfct_init_offset[0], 0,
 	       offsetof(struct nf_conn, proto) -
@@ -1232,24 +1398,23 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 			  unsigned long extra_jiffies,
 			  int do_acct)
 {
-	NF_CT_ASSERT(ct->timeout.data == (unsigned long)ct);
 	NF_CT_ASSERT(skb);
 
 	/* Only update if this is not a fixed timeout */
 	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
 		goto acct;
 
-	/* If not in hash table, timer will not be active yet */
+	/* If not in hash table, the timeout is still relative */
 	if (!nf_ct_is_confirmed(ct)) {
-		ct->timeout.expires = extra_jiffies;
+		ct->timeout = extra_jiffies;
 	} else {
-		unsigned long newtime = jiffies + extra_jiffies;
+		u32 newtime = nfct_time_stamp + extra_jiffies;
 
 		/* Only update the timeout if the new timeout is at least
-		   HZ jiffies from the old timeout. Need del_timer for race
-		   avoidance (may already be dying). */
-		if (newtime - ct->timeout.expires >= HZ)
-			mod_timer_pending(&ct->timeout, newtime);
+		   HZ jiffies from the old timeout, so that flows refreshed
+		   on every packet don't keep dirtying the cache line. */
+		if (newtime - ct->timeout >= HZ)
+			ct->timeout = newtime;
 	}
 
 acct:
@@ -1285,11 +1450,11 @@ bool __nf_ct_kill_acct(struct nf_conn *ct,
 		}
 	}
 
-	if (del_timer(&ct->timeout)) {
-		ct->timeout.function((unsigned long)ct);
-		return true;
-	}
-	return false;
+	/* not in the hash yet, nothing to kill */
+	if (!nf_ct_is_confirmed(ct))
+		return false;
+
+	return nf_ct_delete(ct, 0, 0);
 }
 EXPORT_SYMBOL_GPL(__nf_ct_kill_acct);
 
@@ -1424,11 +1589,7 @@ void nf_ct_iterate_cleanup(struct net *net,
 
 	while ((ct = get_next_corpse(net, iter, data, &bucket)) != NULL) {
 		/* Time to push up daises... */
-		if (del_timer(&ct->timeout))
-			nf_ct_delete(ct, portid, report);
-
-		/* ... else the timer will get him soon. */
-
+		nf_ct_delete(ct, portid, report);
 		nf_ct_put(ct);
 	}
 }
@@ -1509,6 +1670,11 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	 *  delete...
 	 */
 	synchronize_net();
+
+	list_for_each_entry(net, net_exit_list, exit_list) {
+		net->ct.gc_exiting = true;
+		cancel_delayed_work_sync(&net->ct.gc_dwork);
+	}
 i_see_dead_people:
 	busy = 0;
 	list_for_each_entry(net, net_exit_list, exit_list) {
@@ -1558,24 +1724,15 @@ void *nf_ct_alloc_hashtable(unsigned int *sizep, int nulls)
 }
 EXPORT_SYMBOL_GPL(nf_ct_alloc_hashtable);
 
-int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
+static DEFINE_MUTEX(nf_conntrack_resize_mutex);
+
+int nf_conntrack_hash_resize(struct net *net, unsigned int hashsize)
 {
-	int i, bucket, rc;
-	unsigned int hashsize, old_size;
+	int i, bucket;
+	unsigned int old_size;
 	struct hlist_nulls_head *hash, *old_hash;
 	struct nf_conntrack_tuple_hash *h;
-	struct nf_conn *ct;
 
-	if (current->nsproxy->net_ns != &init_net)
-		return -EOPNOTSUPP;
-
-	/* On boot, we can set this without any fancy locking. */
-	if (!nf_conntrack_htable_size)
-		return param_set_uint(val, kp);
-
-	rc = kstrtouint(val, 0, &hashsize);
-	if (rc)
-		return rc;
 	if (!hashsize)
 		return -EINVAL;
 
@@ -1583,39 +1740,72 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	if (!hash)
 		return -ENOMEM;
 
+	mutex_lock(&nf_conntrack_resize_mutex);
+	old_size = net->ct.htable_size;
+	if (old_size == hashsize) {
+		mutex_unlock(&nf_conntrack_resize_mutex);
+		nf_ct_free_hashtable(hash, hashsize);
+		return 0;
+	}
+
+	net->ct.resize_size = hashsize;
+	rcu_assign_pointer(net->ct.resize_hash, hash);
+
 	local_bh_disable();
 	nf_conntrack_all_lock();
-	write_seqcount_begin(&init_net.ct.generation);
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
+	/* Lookups keep walking the old table while the entries move, and
+	 * look in ->resize_hash as well before they report a miss. New
+	 * connections wait for the locks, so none is inserted twice.
 	 */
-
-	for (i = 0; i < init_net.ct.htable_size; i++) {
-		while (!hlist_nulls_empty(&init_net.ct.hash[i])) {
-			h = hlist_nulls_entry(init_net.ct.hash[i].first,
+	for (i = 0; i < old_size; i++) {
+		while (!hlist_nulls_empty(&net->ct.hash[i])) {
+			h = hlist_nulls_entry(net->ct.hash[i].first,
 					struct nf_conntrack_tuple_hash, hnnode);
-			ct = nf_ct_tuplehash_to_ctrack(h);
 			hlist_nulls_del_rcu(&h->hnnode);
 			bucket = __hash_conntrack(&h->tuple, hashsize);
 			hlist_nulls_add_head_rcu(&h->hnnode, &hash[bucket]);
 		}
 	}
-	old_size = init_net.ct.htable_size;
-	old_hash = init_net.ct.hash;
+	old_hash = net->ct.hash;
 
-	init_net.ct.htable_size = nf_conntrack_htable_size = hashsize;
-	init_net.ct.hash = hash;
+	write_seqcount_begin(&net->ct.generation);
+	net->ct.htable_size = hashsize;
+	net->ct.hash = hash;
+	write_seqcount_end(&net->ct.generation);
+	if (net_eq(net, &init_net))
+		nf_conntrack_htable_size = hashsize;
 
-	write_seqcount_end(&init_net.ct.generation);
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	RCU_INIT_POINTER(net->ct.resize_hash, NULL);
+	mutex_unlock(&nf_conntrack_resize_mutex);
+
+	synchronize_net();
 	nf_ct_free_hashtable(old_hash, old_size);
 	return 0;
 }
+EXPORT_SYMBOL_GPL(nf_conntrack_hash_resize);
+
+int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
+{
+	unsigned int hashsize;
+	int rc;
+
+	if (current->nsproxy->net_ns != &init_net)
+		return -EOPNOTSUPP;
+
+	/* On boot, we can set this without any fancy locking. */
+	if (!nf_conntrack_htable_size)
+		return param_set_uint(val, kp);
+
+	rc = kstrtouint(val, 0, &hashsize);
+	if (rc)
+		return rc;
+
+	return nf_conntrack_hash_resize(&init_net, hashsize);
+}
 EXPORT_SYMBOL_GPL(nf_conntrack_set_hashsize);
 
 module_param_call(hashsize, nf_conntrack_set_hashsize, param_get_uint,
@@ -1817,6 +2007,11 @@ int nf_conntrack_init_net(struct net *net)
 	ret = nf_conntrack_proto_pernet_init(net);
 	if (ret < 0)
 		goto err_proto;
+
+	INIT_DEFERRABLE_WORK(&net->ct.gc_dwork, gc_worker);
+	net->ct.gc_interval = GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV;
+	queue_delayed_work(system_long_wq, &net->ct.gc_dwork,
+			   net->ct.gc_interval);
 	return 0;
 
 err_proto:
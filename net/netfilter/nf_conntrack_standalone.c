@@ -219,11 +219,10 @@ static int ct_seq_show(struct seq_file *s, void *v)
 	NF_CT_ASSERT(l4proto);
 
 	ret = -ENOSPC;
-	seq_printf(s, "%-8s %u %-8s %u %ld ",
+	seq_printf(s, "%-8s %u %-8s %u %lu ",
 		   l3proto->name, nf_ct_l3num(ct),
 		   l4proto->name, nf_ct_protonum(ct),
-		   timer_pending(&ct->timeout)
-		   ? (long)(ct->timeout.expires - jiffies)/HZ : 0);
+		   nf_ct_expires(ct) / HZ);
 
 	if (l4proto->print_conntrack)
 		l4proto->print_conntrack(s, ct);
@@ -253,6 +252,9 @@ static int ct_seq_show(struct seq_file *s, void *v)
 	if (test_bit(IPS_ASSURED_BIT, &ct->status))
 		seq_printf(s, "[ASSURED] ");
 
+	if (test_bit(IPS_OFFLOAD_BIT, &ct->status))
+		seq_printf(s, "[OFFLOAD] ");
+
 	if (seq_has_overflowed(s))
 		goto release;
 
@@ -434,6 +436,28 @@ static int log_invalid_proto_max = 255;
 
 static struct ctl_table_header *nf_ct_netfilter_header;
 
+/* Writing nf_conntrack_buckets rehashes the table online */
+static int nf_conntrack_hash_sysctl(struct ctl_table *table, int write,
+				    void __user *buffer, size_t *lenp,
+				    loff_t *ppos)
+{
+	struct net *net = container_of((unsigned int *)table->data,
+				       struct net, ct.htable_size);
+	struct ctl_table tmp = *table;
+	int hashsize = net->ct.htable_size;
+	int ret;
+
+	tmp.data = &hashsize;
+	ret = proc_dointvec(&tmp, write, buffer, lenp, ppos);
+	if (ret < 0 || !write)
+		return ret;
+
+	if (hashsize <= 0)
+		return -EINVAL;
+
+	return nf_conntrack_hash_resize(net, hashsize);
+}
+
 static struct ctl_table nf_ct_sysctl_table[] = {
 	{
 		.procname	= "nf_conntrack_max",
@@ -453,8 +477,8 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.procname       = "nf_conntrack_buckets",
 		.data           = &init_net.ct.htable_size,
 		.maxlen         = sizeof(unsigned int),
-		.mode           = 0444,
-		.proc_handler   = proc_dointvec,
+		.mode           = 0644,
+		.proc_handler   = nf_conntrack_hash_sysctl,
 	},
 	{
 		.procname	= "nf_conntrack_checksum",
@@ -510,8 +534,10 @@ static int nf_conntrack_standalone_init_sysctl(struct net *net)
 	table[4].data = &net->ct.sysctl_log_invalid;
 
 	/* Don't export sysctls to unprivileged users */
-	if (net->user_ns != &init_user_ns)
+	if (net->user_ns != &init_user_ns) {
 		table[0].procname = NULL;
+		table[2].mode = 0444;
+	}
 
 	net->ct.sysctl_header = register_net_sysctl(net, "net/netfilter", table);
 	if (!net->ct.sysctl_header)
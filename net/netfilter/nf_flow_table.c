@@ -0,0 +1,780 @@
+/*
+ * Flow table: fast forwarding path for established conntrack entries.
+ *
+ * Once a connection has been seen in both directions and a rule asked for
+ * it to be offloaded (see nft_flow_offload.c), both of its tuples are
+ * placed in a per-netns hashtable together with the routes that the slow
+ * path already resolved. An ingress hook on the input devices then looks up
+ * every packet and, on a hit, mangles NAT, decrements the TTL and hands the
+ * packet to the neighbour layer, skipping the IP forwarding path, conntrack
+ * and the rest of the netfilter hooks.
+ *
+ * Flows that see no traffic for NF_FLOW_TIMEOUT, TCP connections that send
+ * FIN or RST, and entries whose route has gone stale are handed back to
+ * conntrack by the garbage collector.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netfilter.h>
+#include <linux/rhashtable.h>
+#include <linux/netdevice.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/jhash.h>
+#include <net/ip.h>
+#include <net/neighbour.h>
+#include <net/route.h>
+#include <net/netns/generic.h>
+#include <net/netfilter/nf_flow_table.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+
+struct nf_flow_hook {
+	struct list_head	list;
+	struct nf_hook_ops	ops;
+};
+
+struct nf_flowtable_net {
+	struct rhashtable	rhashtable;
+	struct delayed_work	gc_work;
+	struct work_struct	hook_work;
+	/* ingress hooks, added under RTNL, walked under RCU */
+	struct list_head	hooks;
+	struct net		*net;
+};
+
+static int nf_flowtable_net_id __read_mostly;
+
+static inline struct nf_flowtable_net *nf_flowtable_pernet(struct net *net)
+{
+	return net_generic(net, nf_flowtable_net_id);
+}
+
+static void
+flow_offload_fill_dir(struct flow_offload *flow, struct nf_conn *ct,
+		      struct nf_flow_route *route,
+		      enum flow_offload_tuple_dir dir)
+{
+	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
+	struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
+
+	ft->dir = dir;
+	ft->src_v4 = ctt->src.u3.in;
+	ft->dst_v4 = ctt->dst.u3.in;
+	ft->l3proto = ctt->src.l3num;
+	ft->l4proto = ctt->dst.protonum;
+	ft->src_port = ctt->src.u.tcp.port;
+	ft->dst_port = ctt->dst.u.tcp.port;
+
+	ft->iifidx = route->tuple[dir].ifindex;
+	ft->oifidx = route->tuple[!dir].ifindex;
+	ft->dst_cache = route->tuple[dir].dst;
+}
+
+struct flow_offload *
+flow_offload_alloc(struct nf_conn *ct, struct nf_flow_route *route)
+{
+	struct flow_offload *flow;
+
+	if (unlikely(nf_ct_is_dying(ct) ||
+	    !atomic_inc_not_zero(&ct->ct_general.use)))
+		return NULL;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow)
+		goto err_ct_refcnt;
+
+	if (!dst_hold_safe(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst))
+		goto err_dst_cache_original;
+
+	if (!dst_hold_safe(route->tuple[FLOW_OFFLOAD_DIR_REPLY].dst))
+		goto err_dst_cache_reply;
+
+	flow->ct = ct;
+
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_REPLY);
+
+	if (ct->status & IPS_SRC_NAT)
+		flow->flags |= FLOW_OFFLOAD_SNAT;
+	if (ct->status & IPS_DST_NAT)
+		flow->flags |= FLOW_OFFLOAD_DNAT;
+
+	return flow;
+
+err_dst_cache_reply:
+	dst_release(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+err_dst_cache_original:
+	kfree(flow);
+err_ct_refcnt:
+	nf_ct_put(ct);
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(flow_offload_alloc);
+
+void flow_offload_free(struct flow_offload *flow)
+{
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_cache);
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_cache);
+	nf_ct_put(flow->ct);
+	kfree_rcu(flow, rcu_head);
+}
+EXPORT_SYMBOL_GPL(flow_offload_free);
+
+static u32 flow_offload_hash(const void *data, u32 len, u32 seed)
+{
+	const struct flow_offload_tuple *tuple = data;
+
+	return jhash(tuple, offsetof(struct flow_offload_tuple, dir), seed);
+}
+
+static u32 flow_offload_hash_obj(const void *data, u32 len, u32 seed)
+{
+	const struct flow_offload_tuple_rhash *tuplehash = data;
+
+	return jhash(&tuplehash->tuple,
+		     offsetof(struct flow_offload_tuple, dir), seed);
+}
+
+static int flow_offload_hash_cmp(struct rhashtable_compare_arg *arg,
+				 const void *ptr)
+{
+	const struct flow_offload_tuple_rhash *x = ptr;
+	const struct flow_offload_tuple *tuple = arg->key;
+
+	if (memcmp(&x->tuple, tuple, offsetof(struct flow_offload_tuple, dir)))
+		return 1;
+
+	return 0;
+}
+
+static const struct rhashtable_params nf_flow_offload_rhash_params = {
+	.head_offset		= offsetof(struct flow_offload_tuple_rhash, node),
+	.hashfn			= flow_offload_hash,
+	.obj_hashfn		= flow_offload_hash_obj,
+	.obj_cmpfn		= flow_offload_hash_cmp,
+	.automatic_shrinking	= true,
+};
+
+static bool nf_flow_hooked(struct nf_flowtable_net *ft, int ifindex)
+{
+	struct nf_flow_hook *hook;
+	bool found = false;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(hook, &ft->hooks, list) {
+		if (hook->ops.dev->ifindex == ifindex) {
+			found = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+int flow_offload_add(struct net *net, struct flow_offload *flow)
+{
+	struct nf_flowtable_net *ft = nf_flowtable_pernet(net);
+	int err;
+
+	flow->timeout = nfct_time_stamp + NF_FLOW_TIMEOUT;
+
+	err = rhashtable_insert_fast(&ft->rhashtable,
+				     &flow->tuplehash[0].node,
+				     nf_flow_offload_rhash_params);
+	if (err < 0)
+		return err;
+
+	err = rhashtable_insert_fast(&ft->rhashtable,
+				     &flow->tuplehash[1].node,
+				     nf_flow_offload_rhash_params);
+	if (err < 0) {
+		rhashtable_remove_fast(&ft->rhashtable,
+				       &flow->tuplehash[0].node,
+				       nf_flow_offload_rhash_params);
+		return err;
+	}
+
+	nf_ct_offload_timeout(flow->ct);
+
+	if (!nf_flow_hooked(ft, flow->tuplehash[0].tuple.iifidx) ||
+	    !nf_flow_hooked(ft, flow->tuplehash[1].tuple.iifidx))
+		schedule_work(&ft->hook_work);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+struct flow_offload_tuple_rhash *
+flow_offload_lookup(struct net *net, struct flow_offload_tuple *tuple)
+{
+	struct nf_flowtable_net *ft = nf_flowtable_pernet(net);
+
+	return rhashtable_lookup_fast(&ft->rhashtable, tuple,
+				      nf_flow_offload_rhash_params);
+}
+EXPORT_SYMBOL_GPL(flow_offload_lookup);
+
+/* Conntrack state went stale while the flow bypassed it: give the entry a
+ * short grace period so that the slow path can pick the connection up again.
+ */
+static void flow_offload_fixup_ct_state(struct nf_conn *ct)
+{
+	u32 timeout;
+
+	switch (nf_ct_protonum(ct)) {
+	case IPPROTO_TCP:
+		spin_lock_bh(&ct->lock);
+		ct->proto.tcp.seen[0].td_maxwin = 0;
+		ct->proto.tcp.seen[1].td_maxwin = 0;
+		spin_unlock_bh(&ct->lock);
+		timeout = 120 * HZ;
+		break;
+	case IPPROTO_UDP:
+		timeout = 30 * HZ;
+		break;
+	default:
+		return;
+	}
+
+	ct->timeout = nfct_time_stamp + timeout;
+}
+
+static void flow_offload_del(struct nf_flowtable_net *ft,
+			     struct flow_offload *flow)
+{
+	rhashtable_remove_fast(&ft->rhashtable,
+			       &flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node,
+			       nf_flow_offload_rhash_params);
+	rhashtable_remove_fast(&ft->rhashtable,
+			       &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
+			       nf_flow_offload_rhash_params);
+
+	clear_bit(IPS_OFFLOAD_BIT, &flow->ct->status);
+	if (!nf_ct_is_dying(flow->ct))
+		flow_offload_fixup_ct_state(flow->ct);
+
+	flow_offload_free(flow);
+}
+
+static inline bool nf_flow_has_expired(const struct flow_offload *flow)
+{
+	return (__s32)(flow->timeout - nfct_time_stamp) <= 0;
+}
+
+/* Call @fn once for every flow, through its original tuple. Only the gc
+ * worker removes flows; everybody else marks them for teardown.
+ */
+static void nf_flow_table_iterate(struct nf_flowtable_net *ft,
+				  void (*fn)(struct nf_flowtable_net *ft,
+					     struct flow_offload *flow,
+					     void *data),
+				  void *data)
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct rhashtable_iter hti;
+	struct flow_offload *flow;
+
+	if (rhashtable_walk_init(&ft->rhashtable, &hti))
+		return;
+
+	rhashtable_walk_start(&hti);
+
+	while ((tuplehash = rhashtable_walk_next(&hti))) {
+		if (IS_ERR(tuplehash)) {
+			if (PTR_ERR(tuplehash) != -EAGAIN)
+				break;
+			continue;
+		}
+		if (tuplehash->tuple.dir)
+			continue;
+
+		flow = container_of(tuplehash, struct flow_offload,
+				    tuplehash[0]);
+		fn(ft, flow, data);
+	}
+
+	rhashtable_walk_stop(&hti);
+	rhashtable_walk_exit(&hti);
+}
+
+static void nf_flow_offload_gc_step(struct nf_flowtable_net *ft,
+				    struct flow_offload *flow, void *data)
+{
+	if (nf_flow_has_expired(flow) ||
+	    (flow->flags & FLOW_OFFLOAD_TEARDOWN) ||
+	    nf_ct_is_dying(flow->ct))
+		flow_offload_del(ft, flow);
+}
+
+static void nf_flow_offload_work_gc(struct work_struct *work)
+{
+	struct nf_flowtable_net *ft;
+
+	ft = container_of(work, struct nf_flowtable_net, gc_work.work);
+	nf_flow_table_iterate(ft, nf_flow_offload_gc_step, NULL);
+	queue_delayed_work(system_power_efficient_wq, &ft->gc_work, HZ);
+}
+
+static void nf_flow_offload_dev_teardown(struct nf_flowtable_net *ft,
+					 struct flow_offload *flow, void *data)
+{
+	const struct net_device *dev = data;
+	int i;
+
+	for (i = 0; i < FLOW_OFFLOAD_DIR_MAX; i++) {
+		if (!dev ||
+		    flow->tuplehash[i].tuple.iifidx == dev->ifindex ||
+		    flow->tuplehash[i].tuple.oifidx == dev->ifindex) {
+			flow_offload_teardown(flow);
+			return;
+		}
+	}
+}
+
+/* The IPv4 fast path. */
+
+struct flow_ports {
+	__be16 source, dest;
+};
+
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple)
+{
+	struct flow_ports *ports;
+	unsigned int thoff;
+	struct iphdr *iph;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	thoff = iph->ihl * 4;
+
+	/* No options, no fragments, and nothing ip_rcv() would trim or drop */
+	if (iph->version != 4 || thoff != sizeof(*iph) ||
+	    ip_is_fragment(iph) || ntohs(iph->tot_len) != skb->len ||
+	    ip_fast_csum((u8 *)iph, iph->ihl))
+		return -1;
+
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return -1;
+
+	if (!pskb_may_pull(skb, thoff + sizeof(*ports)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+
+	tuple->src_v4.s_addr	= iph->saddr;
+	tuple->dst_v4.s_addr	= iph->daddr;
+	tuple->src_port		= ports->source;
+	tuple->dst_port		= ports->dest;
+	tuple->l3proto		= AF_INET;
+	tuple->l4proto		= iph->protocol;
+	tuple->iifidx		= dev->ifindex;
+
+	return 0;
+}
+
+static void nf_flow_nat_l4_csum(struct sk_buff *skb, struct iphdr *iph,
+				unsigned int thoff, __be32 addr,
+				__be32 new_addr)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		tcph = (void *)(skb_network_header(skb) + thoff);
+		inet_proto_csum_replace4(&tcph->check, skb, addr, new_addr,
+					 true);
+		break;
+	case IPPROTO_UDP:
+		udph = (void *)(skb_network_header(skb) + thoff);
+		if (udph->check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace4(&udph->check, skb, addr,
+						 new_addr, true);
+			if (!udph->check)
+				udph->check = CSUM_MANGLED_0;
+		}
+		break;
+	}
+}
+
+static void nf_flow_nat_port_csum(struct sk_buff *skb, struct iphdr *iph,
+				  unsigned int thoff, __be16 port,
+				  __be16 new_port)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		tcph = (void *)(skb_network_header(skb) + thoff);
+		inet_proto_csum_replace2(&tcph->check, skb, port, new_port,
+					 false);
+		break;
+	case IPPROTO_UDP:
+		udph = (void *)(skb_network_header(skb) + thoff);
+		if (udph->check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace2(&udph->check, skb, port,
+						 new_port, false);
+			if (!udph->check)
+				udph->check = CSUM_MANGLED_0;
+		}
+		break;
+	}
+}
+
+static void nf_flow_nat_addr(struct sk_buff *skb, struct iphdr *iph,
+			     unsigned int thoff, __be32 *addr, __be32 new_addr)
+{
+	__be32 old_addr = *addr;
+
+	*addr = new_addr;
+	csum_replace4(&iph->check, old_addr, new_addr);
+	nf_flow_nat_l4_csum(skb, iph, thoff, old_addr, new_addr);
+}
+
+static void nf_flow_nat_port(struct sk_buff *skb, struct iphdr *iph,
+			     unsigned int thoff, __be16 *port,
+			     __be16 new_port)
+{
+	__be16 old_port = *port;
+
+	*port = new_port;
+	nf_flow_nat_port_csum(skb, iph, thoff, old_port, new_port);
+}
+
+static void nf_flow_nat_ip(const struct flow_offload *flow,
+			   struct sk_buff *skb, unsigned int thoff,
+			   enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *orig, *reply;
+	struct iphdr *iph = ip_hdr(skb);
+	struct flow_ports *ports;
+
+	orig = &flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple;
+	reply = &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple;
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+
+	if (flow->flags & FLOW_OFFLOAD_SNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_port(skb, iph, thoff, &ports->source,
+					 reply->dst_port);
+			nf_flow_nat_addr(skb, iph, thoff, &iph->saddr,
+					 reply->dst_v4.s_addr);
+		} else {
+			nf_flow_nat_port(skb, iph, thoff, &ports->dest,
+					 orig->src_port);
+			nf_flow_nat_addr(skb, iph, thoff, &iph->daddr,
+					 orig->src_v4.s_addr);
+		}
+	}
+
+	if (flow->flags & FLOW_OFFLOAD_DNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_port(skb, iph, thoff, &ports->dest,
+					 reply->src_port);
+			nf_flow_nat_addr(skb, iph, thoff, &iph->daddr,
+					 reply->src_v4.s_addr);
+		} else {
+			nf_flow_nat_port(skb, iph, thoff, &ports->source,
+					 orig->dst_port);
+			nf_flow_nat_addr(skb, iph, thoff, &iph->saddr,
+					 orig->dst_v4.s_addr);
+		}
+	}
+}
+
+static bool nf_flow_exceeds_mtu(const struct sk_buff *skb, unsigned int mtu)
+{
+	if (skb->len <= mtu)
+		return false;
+
+	if (skb_is_gso(skb) && skb_gso_network_seglen(skb) <= mtu)
+		return false;
+
+	return true;
+}
+
+static unsigned int nf_flow_offload_ip_hook(void *priv, struct sk_buff *skb,
+					    const struct nf_hook_state *state)
+{
+	struct nf_flowtable_net *ft = priv;
+	struct flow_offload_tuple_rhash *tuplehash;
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload_tuple tuple;
+	struct flow_offload *flow;
+	struct net_device *outdev;
+	unsigned int thoff, hdrsize;
+	struct dst_entry *dst;
+	struct iphdr *iph;
+	__be32 nexthop;
+	u32 timeout;
+
+	if (skb->protocol != htons(ETH_P_IP) || skb->pkt_type != PACKET_HOST)
+		return NF_ACCEPT;
+
+	memset(&tuple, 0, sizeof(tuple));
+	if (nf_flow_tuple_ip(skb, state->in, &tuple) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = rhashtable_lookup_fast(&ft->rhashtable, &tuple,
+					   nf_flow_offload_rhash_params);
+	if (!tuplehash)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
+	if (unlikely(flow->flags & FLOW_OFFLOAD_TEARDOWN ||
+		     nf_ct_is_dying(flow->ct)))
+		return NF_ACCEPT;
+
+	dst = tuplehash->tuple.dst_cache;
+	if (unlikely(dst->obsolete && !dst_check(dst, 0))) {
+		flow_offload_teardown(flow);
+		return NF_ACCEPT;
+	}
+	outdev = dst->dev;
+
+	if (unlikely(nf_flow_exceeds_mtu(skb, dst_mtu(dst))))
+		return NF_ACCEPT;
+
+	iph = ip_hdr(skb);
+	if (iph->ttl <= 1)
+		return NF_ACCEPT;
+
+	thoff = iph->ihl * 4;
+	if (iph->protocol == IPPROTO_TCP) {
+		struct tcphdr *tcph;
+
+		hdrsize = sizeof(struct tcphdr);
+		if (!pskb_may_pull(skb, thoff + hdrsize))
+			return NF_ACCEPT;
+
+		tcph = (void *)(skb_network_header(skb) + thoff);
+		if (unlikely(tcph->fin || tcph->rst)) {
+			flow_offload_teardown(flow);
+			return NF_ACCEPT;
+		}
+	} else {
+		hdrsize = sizeof(struct udphdr);
+	}
+
+	if (!skb_make_writable(skb, thoff + hdrsize))
+		return NF_DROP;
+
+	nf_flow_nat_ip(flow, skb, thoff, dir);
+	ip_decrease_ttl(ip_hdr(skb));
+
+	/* Only dirty the flow once per jiffy, both directions write here */
+	timeout = nfct_time_stamp + NF_FLOW_TIMEOUT;
+	if (flow->timeout != timeout)
+		flow->timeout = timeout;
+
+	skb->dev = outdev;
+	nexthop = rt_nexthop((struct rtable *)dst,
+			     flow->tuplehash[!dir].tuple.src_v4.s_addr);
+	skb_dst_set_noref(skb, dst);
+	neigh_xmit(NEIGH_ARP_TABLE, outdev, &nexthop, skb);
+
+	return NF_STOLEN;
+}
+
+/* Ingress hooks are registered lazily, for the input devices of the flows
+ * that are actually in the table, and dropped when the device goes away.
+ */
+#define NF_FLOW_HOOK_BATCH	16
+
+static void nf_flow_offload_work_hook(struct work_struct *work)
+{
+	struct nf_flowtable_net *ft;
+	struct flow_offload_tuple_rhash *tuplehash;
+	int ifindex[NF_FLOW_HOOK_BATCH];
+	struct rhashtable_iter hti;
+	struct nf_flow_hook *hook;
+	struct net_device *dev;
+	int i, n = 0;
+	bool more = false;
+
+	ft = container_of(work, struct nf_flowtable_net, hook_work);
+
+	if (rhashtable_walk_init(&ft->rhashtable, &hti))
+		return;
+
+	rhashtable_walk_start(&hti);
+
+	while ((tuplehash = rhashtable_walk_next(&hti))) {
+		if (IS_ERR(tuplehash)) {
+			if (PTR_ERR(tuplehash) != -EAGAIN)
+				break;
+			continue;
+		}
+		if (nf_flow_hooked(ft, tuplehash->tuple.iifidx))
+			continue;
+
+		for (i = 0; i < n; i++) {
+			if (ifindex[i] == tuplehash->tuple.iifidx)
+				break;
+		}
+		if (i < n)
+			continue;
+
+		if (n == NF_FLOW_HOOK_BATCH) {
+			more = true;
+			break;
+		}
+		ifindex[n++] = tuplehash->tuple.iifidx;
+	}
+
+	rhashtable_walk_stop(&hti);
+	rhashtable_walk_exit(&hti);
+
+	rtnl_lock();
+	for (i = 0; i < n; i++) {
+		dev = __dev_get_by_index(ft->net, ifindex[i]);
+		if (!dev || dev->reg_state != NETREG_REGISTERED ||
+		    nf_flow_hooked(ft, ifindex[i]))
+			continue;
+
+		hook = kzalloc(sizeof(*hook), GFP_KERNEL);
+		if (!hook)
+			break;
+
+		hook->ops.hook		= nf_flow_offload_ip_hook;
+		hook->ops.priv		= ft;
+		hook->ops.pf		= NFPROTO_NETDEV;
+		hook->ops.hooknum	= NF_NETDEV_INGRESS;
+		hook->ops.priority	= 0;
+		hook->ops.dev		= dev;
+
+		if (nf_register_net_hook(ft->net, &hook->ops) < 0) {
+			kfree(hook);
+			continue;
+		}
+		list_add_tail_rcu(&hook->list, &ft->hooks);
+	}
+	rtnl_unlock();
+
+	if (more)
+		schedule_work(&ft->hook_work);
+}
+
+static void nf_flow_hook_del(struct nf_flowtable_net *ft,
+			     struct nf_flow_hook *hook)
+{
+	list_del_rcu(&hook->list);
+	nf_unregister_net_hook(ft->net, &hook->ops);
+	kfree(hook);
+}
+
+/* Called under RTNL */
+static void nf_flow_table_cleanup(struct nf_flowtable_net *ft,
+				  struct net_device *dev)
+{
+	struct nf_flow_hook *hook, *next;
+
+	list_for_each_entry_safe(hook, next, &ft->hooks, list) {
+		if (!dev || hook->ops.dev == dev)
+			nf_flow_hook_del(ft, hook);
+	}
+
+	nf_flow_table_iterate(ft, nf_flow_offload_dev_teardown, dev);
+}
+
+static int nf_flow_table_netdev_event(struct notifier_block *this,
+				      unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct nf_flowtable_net *ft = nf_flowtable_pernet(dev_net(dev));
+
+	if (event != NETDEV_DOWN && event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	nf_flow_table_cleanup(ft, dev);
+	flush_delayed_work(&ft->gc_work);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nf_flow_table_netdev_notifier = {
+	.notifier_call	= nf_flow_table_netdev_event,
+};
+
+static int __net_init nf_flow_table_net_init(struct net *net)
+{
+	struct nf_flowtable_net *ft = nf_flowtable_pernet(net);
+	int err;
+
+	err = rhashtable_init(&ft->rhashtable, &nf_flow_offload_rhash_params);
+	if (err < 0)
+		return err;
+
+	ft->net = net;
+	INIT_LIST_HEAD(&ft->hooks);
+	INIT_WORK(&ft->hook_work, nf_flow_offload_work_hook);
+	INIT_DEFERRABLE_WORK(&ft->gc_work, nf_flow_offload_work_gc);
+	queue_delayed_work(system_power_efficient_wq, &ft->gc_work, HZ);
+
+	return 0;
+}
+
+static void __net_exit nf_flow_table_net_exit(struct net *net)
+{
+	struct nf_flowtable_net *ft = nf_flowtable_pernet(net);
+
+	cancel_delayed_work_sync(&ft->gc_work);
+	cancel_work_sync(&ft->hook_work);
+
+	rtnl_lock();
+	nf_flow_table_cleanup(ft, NULL);
+	rtnl_unlock();
+
+	nf_flow_table_iterate(ft, nf_flow_offload_gc_step, NULL);
+	rhashtable_destroy(&ft->rhashtable);
+}
+
+static struct pernet_operations nf_flow_table_net_ops = {
+	.init	= nf_flow_table_net_init,
+	.exit	= nf_flow_table_net_exit,
+	.id	= &nf_flowtable_net_id,
+	.size	= sizeof(struct nf_flowtable_net),
+};
+
+static int __init nf_flow_table_module_init(void)
+{
+	int err;
+
+	err = register_pernet_subsys(&nf_flow_table_net_ops);
+	if (err < 0)
+		return err;
+
+	err = register_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	if (err < 0)
+		unregister_pernet_subsys(&nf_flow_table_net_ops);
+
+	return err;
+}
+
+static void __exit nf_flow_table_module_exit(void)
+{
+	unregister_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	unregister_pernet_subsys(&nf_flow_table_net_ops);
+	rcu_barrier(); /* Wait for completion of kfree_rcu() callbacks */
+}
+
+module_init(nf_flow_table_module_init);
+module_exit(nf_flow_table_module_exit);
+
+MODULE_LICENSE("GPL");
@@ -3881,6 +3881,25 @@ static void nf_tables_commit_release(struct nft_trans *trans)
 	kfree(trans);
 }
 
+/* Let set backends that keep a separate lookup structure rebuild it, once
+ * per transaction, after all element changes have been applied.
+ */
+static void nf_tables_commit_sets(struct net *net)
+{
+	struct nft_af_info *afi;
+	struct nft_table *table;
+	struct nft_set *set;
+
+	list_for_each_entry(afi, &net->nft.af_info, list) {
+		list_for_each_entry(table, &afi->tables, list) {
+			list_for_each_entry(set, &table->sets, list) {
+				if (set->ops->commit)
+					set->ops->commit(set);
+			}
+		}
+	}
+}
+
 static int nf_tables_commit(struct sk_buff *skb)
 {
 	struct net *net = sock_net(skb->sk);
@@ -3983,6 +4002,8 @@ static int nf_tables_commit(struct sk_buff *skb)
 		}
 	}
 
+	nf_tables_commit_sets(net);
+
 	synchronize_rcu();
 
 	list_for_each_entry_safe(trans, next, &net->nft.commit_list, list) {
@@ -0,0 +1,461 @@
+/*
+ * Sorted array set backend.
+ *
+ * The control plane keeps the elements in an rbtree, exactly like
+ * nft_rbtree. On every commit the active elements are flattened into a
+ * sorted array of keys, with a parallel array of element pointers, that is
+ * published via RCU. Lookups are a lockless binary search over the keys, so
+ * a set of a few hundred thousand prefixes costs ~20 key compares on a
+ * handful of cachelines, and packets on different CPUs never contend.
+ *
+ * Interval sets are stored as start and end elements, the lookup returns
+ * the closest element whose key is not larger than the searched key and
+ * fails if that is an interval end. Keys are compared with memcmp() in
+ * network byte order, so intervals over concatenated keys match in
+ * lexicographic order: "10.0.0.0/8 . any port" and "10.1.2.3 . 1000-2000"
+ * both work, a port range across an address range does not.
+ *
+ * The array that is not published is kept as a spare and sized at insert
+ * time, so that the commit, which cannot fail, never has to allocate. If the
+ * published array is too small to become the next spare, a replacement is
+ * allocated at insert time as well.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/vmalloc.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+
+struct nft_array_data {
+	struct rcu_head			rcu;
+	unsigned int			num;
+	unsigned int			size;
+	const struct nft_set_ext	**ext;
+	u8				keys[];
+};
+
+struct nft_array {
+	spinlock_t			lock;
+	struct rb_root			root;
+	unsigned int			nodes;
+	bool				dirty;
+	struct nft_array_data __rcu	*data;
+	struct nft_array_data		*spare;
+	struct nft_array_data		*next;
+};
+
+struct nft_array_elem {
+	struct rb_node		node;
+	struct nft_set_ext	ext;
+};
+
+static inline unsigned int nft_array_stride(const struct nft_set *set)
+{
+	return round_up(set->klen, sizeof(u32));
+}
+
+static inline bool nft_array_elem_end(const struct nft_set_ext *ext)
+{
+	return nft_set_ext_exists(ext, NFT_SET_EXT_FLAGS) &&
+	       *nft_set_ext_flags(ext) & NFT_SET_ELEM_INTERVAL_END;
+}
+
+static bool nft_array_lookup(const struct nft_set *set, const u32 *key,
+			     const struct nft_set_ext **ext)
+{
+	const struct nft_array *priv = nft_set_priv(set);
+	unsigned int stride = nft_array_stride(set);
+	const struct nft_array_data *data;
+	const struct nft_set_ext *e;
+	unsigned int lo, hi, mid;
+	const u8 *k;
+
+	data = rcu_dereference(priv->data);
+	if (data == NULL)
+		return false;
+
+	/* Find the number of keys that are not larger than @key */
+	lo = 0;
+	hi = data->num;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(data->keys + mid * stride, key, set->klen) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		return false;
+
+	k = data->keys + (lo - 1) * stride;
+	e = data->ext[lo - 1];
+
+	if (!(set->flags & NFT_SET_INTERVAL) &&
+	    memcmp(k, key, set->klen))
+		return false;
+
+	if (nft_array_elem_end(e))
+		return false;
+
+	*ext = e;
+	return true;
+}
+
+static struct nft_array_data *nft_array_data_alloc(const struct nft_set *set,
+						   unsigned int size)
+{
+	struct nft_array_data *data;
+	size_t len;
+
+	len = sizeof(*data) + size * nft_array_stride(set) +
+	      size * sizeof(data->ext[0]);
+
+	data = kzalloc(len, GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+	if (data == NULL)
+		data = vzalloc(len);
+	if (data == NULL)
+		return NULL;
+
+	data->size = size;
+	data->ext = (void *)data->keys + size * nft_array_stride(set);
+	return data;
+}
+
+static void nft_array_data_free_rcu(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct nft_array_data, rcu));
+}
+
+/* Make sure the spare array, and the one that replaces it after the next
+ * commit, can hold every element in the tree plus the one being inserted.
+ * The spare was unpublished by an earlier commit, which waited for readers
+ * to go away.
+ */
+static int nft_array_reserve(const struct nft_set *set, struct nft_array *priv)
+{
+	struct nft_array_data *cur = rcu_dereference_protected(priv->data, 1);
+	struct nft_array_data *new;
+	unsigned int size;
+
+	if (priv->spare == NULL || priv->spare->size <= priv->nodes) {
+		size = max(priv->nodes + 1,
+			   priv->spare ? priv->spare->size * 2 : 16);
+		new = nft_array_data_alloc(set, size);
+		if (new == NULL)
+			return -ENOMEM;
+
+		kvfree(priv->spare);
+		priv->spare = new;
+	}
+
+	if ((cur == NULL || cur->size <= priv->nodes) &&
+	    (priv->next == NULL || priv->next->size <= priv->nodes)) {
+		new = nft_array_data_alloc(set, priv->spare->size);
+		if (new == NULL)
+			return -ENOMEM;
+
+		kvfree(priv->next);
+		priv->next = new;
+	}
+	return 0;
+}
+
+static int __nft_array_insert(const struct nft_set *set,
+			      struct nft_array_elem *new)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe;
+	struct rb_node *parent, **p;
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+	int d;
+
+	parent = NULL;
+	p = &priv->root.rb_node;
+	while (*p != NULL) {
+		parent = *p;
+		rbe = rb_entry(parent, struct nft_array_elem, node);
+		d = memcmp(nft_set_ext_key(&rbe->ext),
+			   nft_set_ext_key(&new->ext),
+			   set->klen);
+		if (d < 0)
+			p = &parent->rb_left;
+		else if (d > 0)
+			p = &parent->rb_right;
+		else {
+			if (nft_set_elem_active(&rbe->ext, genmask))
+				return -EEXIST;
+			p = &parent->rb_left;
+		}
+	}
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &priv->root);
+	priv->nodes++;
+	return 0;
+}
+
+static int nft_array_insert(const struct nft_set *set,
+			    const struct nft_set_elem *elem)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe = elem->priv;
+	int err;
+
+	/* Called with the nfnl mutex held, the lock only excludes dumps */
+	err = nft_array_reserve(set, priv);
+	if (err < 0)
+		return err;
+
+	spin_lock_bh(&priv->lock);
+	err = __nft_array_insert(set, rbe);
+	spin_unlock_bh(&priv->lock);
+
+	return err;
+}
+
+static void nft_array_remove(const struct nft_set *set,
+			     const struct nft_set_elem *elem)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe = elem->priv;
+
+	spin_lock_bh(&priv->lock);
+	rb_erase(&rbe->node, &priv->root);
+	priv->nodes--;
+	priv->dirty = true;
+	spin_unlock_bh(&priv->lock);
+}
+
+static void nft_array_activate(const struct nft_set *set,
+			       const struct nft_set_elem *elem)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe = elem->priv;
+
+	nft_set_elem_change_active(set, &rbe->ext);
+	priv->dirty = true;
+}
+
+static void *nft_array_deactivate(const struct nft_set *set,
+				  const struct nft_set_elem *elem)
+{
+	const struct nft_array *priv = nft_set_priv(set);
+	const struct rb_node *parent = priv->root.rb_node;
+	struct nft_array_elem *rbe;
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+	int d;
+
+	while (parent != NULL) {
+		rbe = rb_entry(parent, struct nft_array_elem, node);
+
+		d = memcmp(nft_set_ext_key(&rbe->ext), &elem->key.val,
+			   set->klen);
+		if (d < 0)
+			parent = parent->rb_left;
+		else if (d > 0)
+			parent = parent->rb_right;
+		else {
+			if (!nft_set_elem_active(&rbe->ext, genmask)) {
+				parent = parent->rb_left;
+				continue;
+			}
+			nft_set_elem_change_active(set, &rbe->ext);
+			return rbe;
+		}
+	}
+	return NULL;
+}
+
+/* Flatten the active elements into the spare array and publish it. The
+ * tree is ordered by descending key, so walk it backwards.
+ */
+static void nft_array_commit(const struct nft_set *set)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	unsigned int stride = nft_array_stride(set);
+	struct nft_array_data *data, *old;
+	struct nft_array_elem *rbe;
+	struct rb_node *node;
+	unsigned int n = 0;
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+
+	if (!priv->dirty)
+		return;
+
+	data = priv->spare;
+	if (WARN_ON_ONCE(data == NULL))
+		return;
+
+	for (node = rb_last(&priv->root); node != NULL; node = rb_prev(node)) {
+		rbe = rb_entry(node, struct nft_array_elem, node);
+		if (!nft_set_elem_active(&rbe->ext, genmask))
+			continue;
+
+		memcpy(data->keys + n * stride, nft_set_ext_key(&rbe->ext),
+		       set->klen);
+		data->ext[n] = &rbe->ext;
+
+		/* Adjacent intervals: the start must win over the end */
+		if (n > 0 && !nft_array_elem_end(data->ext[n - 1]) &&
+		    nft_array_elem_end(data->ext[n]) &&
+		    !memcmp(data->keys + (n - 1) * stride,
+			    data->keys + n * stride, set->klen))
+			swap(data->ext[n - 1], data->ext[n]);
+		n++;
+	}
+	data->num = n;
+
+	old = rcu_dereference_protected(priv->data, 1);
+	rcu_assign_pointer(priv->data, data);
+
+	/* nf_tables_commit() waits for a grace period before returning, the
+	 * old array is safe to refill by the time of the next transaction.
+	 */
+	if (priv->next != NULL) {
+		priv->spare = priv->next;
+		priv->next = NULL;
+		if (old != NULL)
+			call_rcu(&old->rcu, nft_array_data_free_rcu);
+	} else {
+		priv->spare = old;
+	}
+	priv->dirty = false;
+}
+
+static void nft_array_walk(const struct nft_ctx *ctx,
+			   const struct nft_set *set,
+			   struct nft_set_iter *iter)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe;
+	struct nft_set_elem elem;
+	struct rb_node *node;
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+
+	spin_lock_bh(&priv->lock);
+	for (node = rb_first(&priv->root); node != NULL; node = rb_next(node)) {
+		rbe = rb_entry(node, struct nft_array_elem, node);
+
+		if (iter->count < iter->skip)
+			goto cont;
+		if (!nft_set_elem_active(&rbe->ext, genmask))
+			goto cont;
+
+		elem.priv = rbe;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0) {
+			spin_unlock_bh(&priv->lock);
+			return;
+		}
+cont:
+		iter->count++;
+	}
+	spin_unlock_bh(&priv->lock);
+}
+
+static unsigned int nft_array_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_array);
+}
+
+static int nft_array_init(const struct nft_set *set,
+			  const struct nft_set_desc *desc,
+			  const struct nlattr * const nla[])
+{
+	struct nft_array *priv = nft_set_priv(set);
+
+	spin_lock_init(&priv->lock);
+	priv->root = RB_ROOT;
+	priv->nodes = 0;
+	priv->dirty = false;
+	RCU_INIT_POINTER(priv->data, NULL);
+	priv->spare = NULL;
+	priv->next = NULL;
+
+	if (desc->size) {
+		priv->spare = nft_array_data_alloc(set, desc->size);
+		if (priv->spare == NULL)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void nft_array_destroy(const struct nft_set *set)
+{
+	struct nft_array *priv = nft_set_priv(set);
+	struct nft_array_elem *rbe;
+	struct rb_node *node;
+
+	while ((node = priv->root.rb_node) != NULL) {
+		rb_erase(node, &priv->root);
+		rbe = rb_entry(node, struct nft_array_elem, node);
+		nft_set_elem_destroy(set, rbe);
+	}
+
+	kvfree(rcu_dereference_protected(priv->data, 1));
+	kvfree(priv->spare);
+	kvfree(priv->next);
+}
+
+static bool nft_array_estimate(const struct nft_set_desc *desc, u32 features,
+			       struct nft_set_estimate *est)
+{
+	unsigned int nsize;
+
+	/* tree node plus a key and a pointer in each of the two arrays */
+	nsize = sizeof(struct nft_array_elem) +
+		2 * (round_up(desc->klen, sizeof(u32)) + sizeof(void *));
+	if (desc->size)
+		est->size = sizeof(struct nft_array) + desc->size * nsize;
+	else
+		est->size = nsize;
+
+	est->class = NFT_SET_CLASS_O_LOG_N;
+
+	return true;
+}
+
+static struct nft_set_ops nft_array_ops __read_mostly = {
+	.privsize	= nft_array_privsize,
+	.elemsize	= offsetof(struct nft_array_elem, ext),
+	.estimate	= nft_array_estimate,
+	.init		= nft_array_init,
+	.destroy	= nft_array_destroy,
+	.insert		= nft_array_insert,
+	.remove		= nft_array_remove,
+	.deactivate	= nft_array_deactivate,
+	.activate	= nft_array_activate,
+	.commit		= nft_array_commit,
+	.lookup		= nft_array_lookup,
+	.walk		= nft_array_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_array_module_init(void)
+{
+	return nft_register_set(&nft_array_ops);
+}
+
+static void __exit nft_array_module_exit(void)
+{
+	nft_unregister_set(&nft_array_ops);
+	rcu_barrier(); /* Wait for completion of call_rcu()'s */
+}
+
+module_init(nft_array_module_init);
+module_exit(nft_array_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
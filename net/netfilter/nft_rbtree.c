@@ -241,7 +241,7 @@ static bool nft_rbtree_estimate(const struct nft_set_desc *desc, u32 features,
 	else
 		est->size = nsize;
 
-	est->class = NFT_SET_CLASS_O_LOG_N;
+	est->class = NFT_SET_CLASS_O_LOG_N_LOCKED;
 
 	return true;
 }
@@ -930,6 +930,7 @@ void xt_free_table_info(struct xt_table_info *info)
 		kvfree(info->jumpstack);
 	}
 
+	kvfree(info->index);
 	kvfree(info);
 }
 EXPORT_SYMBOL(xt_free_table_info);
@@ -1187,12 +1187,11 @@ static int __netlink_create(struct net *net, struct socket *sock,
 	sock_init_data(sock, sk);
 
 	nlk = nlk_sk(sk);
-	if (cb_mutex) {
+	mutex_init(&nlk->cb_def_mutex);
+	if (cb_mutex)
 		nlk->cb_mutex = cb_mutex;
-	} else {
+	else
 		nlk->cb_mutex = &nlk->cb_def_mutex;
-		mutex_init(nlk->cb_mutex);
-	}
 	init_waitqueue_head(&nlk->wait);
 #ifdef CONFIG_NETLINK_MMAP
 	mutex_init(&nlk->pg_vec_lock);
@@ -2778,6 +2777,30 @@ EXPORT_SYMBOL(__nlmsg_put);
  * It would be better to create kernel thread.
  */
 
+/*
+ * Unlocked dumps run under the socket's own cb_def_mutex instead of the
+ * protocol's cb_mutex. The kind of the current dump only changes with both
+ * held, so either one is enough to read it.
+ */
+static struct mutex *netlink_dump_mutex(struct netlink_sock *nlk)
+{
+	return nlk->cb_unlocked ? &nlk->cb_def_mutex : nlk->cb_mutex;
+}
+
+static struct mutex *netlink_dump_lock(struct netlink_sock *nlk)
+{
+	struct mutex *mutex;
+
+	for (;;) {
+		mutex = READ_ONCE(nlk->cb_unlocked) ? &nlk->cb_def_mutex :
+						      nlk->cb_mutex;
+		mutex_lock(mutex);
+		if (mutex == netlink_dump_mutex(nlk))
+			return mutex;
+		mutex_unlock(mutex);
+	}
+}
+
 static int netlink_dump(struct sock *sk)
 {
 	struct netlink_sock *nlk = nlk_sk(sk);
@@ -2785,11 +2808,12 @@ static int netlink_dump(struct sock *sk)
 	struct sk_buff *skb = NULL;
 	struct nlmsghdr *nlh;
 	struct module *module;
+	struct mutex *cb_mutex;
 	int len, err = -ENOBUFS;
 	int alloc_min_size;
 	int alloc_size;
 
-	mutex_lock(nlk->cb_mutex);
+	cb_mutex = netlink_dump_lock(nlk);
 	if (!nlk->cb_running) {
 		err = -EINVAL;
 		goto errout_skb;
@@ -2838,7 +2862,7 @@ static int netlink_dump(struct sock *sk)
 	len = cb->dump(skb, cb);
 
 	if (len > 0) {
-		mutex_unlock(nlk->cb_mutex);
+		mutex_unlock(cb_mutex);
 
 		if (sk_filter(sk, skb))
 			kfree_skb(skb);
@@ -2866,13 +2890,13 @@ static int netlink_dump(struct sock *sk)
 	nlk->cb_running = false;
 	module = cb->module;
 	skb = cb->skb;
-	mutex_unlock(nlk->cb_mutex);
+	mutex_unlock(cb_mutex);
 	module_put(module);
 	consume_skb(skb);
 	return 0;
 
 errout_skb:
-	mutex_unlock(nlk->cb_mutex);
+	mutex_unlock(cb_mutex);
 	kfree_skb(skb);
 	return err;
 }
@@ -2904,6 +2928,12 @@ int __netlink_dump_start(struct sock *ssk, struct sk_buff *skb,
 	}
 
 	nlk = nlk_sk(sk);
+	/*
+	 * Unlocked dumps take cb_def_mutex and then whatever locks they
+	 * need, the protocol's cb_mutex included, so it nests outside.
+	 */
+	if (nlk->cb_mutex != &nlk->cb_def_mutex)
+		mutex_lock(&nlk->cb_def_mutex);
 	mutex_lock(nlk->cb_mutex);
 	/* A dump is in progress... */
 	if (nlk->cb_running) {
@@ -2927,8 +2957,11 @@ int __netlink_dump_start(struct sock *ssk, struct sk_buff *skb,
 	cb->skb = skb;
 
 	nlk->cb_running = true;
+	nlk->cb_unlocked = control->unlocked;
 
 	mutex_unlock(nlk->cb_mutex);
+	if (nlk->cb_mutex != &nlk->cb_def_mutex)
+		mutex_unlock(&nlk->cb_def_mutex);
 
 	ret = netlink_dump(sk);
 	sock_put(sk);
@@ -2944,6 +2977,8 @@ int __netlink_dump_start(struct sock *ssk, struct sk_buff *skb,
 error_unlock:
 	sock_put(sk);
 	mutex_unlock(nlk->cb_mutex);
+	if (nlk->cb_mutex != &nlk->cb_def_mutex)
+		mutex_unlock(&nlk->cb_def_mutex);
 error_free:
 	kfree_skb(skb);
 	return ret;
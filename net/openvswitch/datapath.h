@@ -33,6 +33,7 @@
 
 #define DP_MAX_PORTS           USHRT_MAX
 #define DP_VPORT_HASH_BUCKETS  1024
+#define DP_MASKS_REBALANCE_INTERVAL (4 * HZ)
 
 #define SAMPLE_ACTION_DEPTH 3
 
@@ -133,6 +134,7 @@ struct dp_upcall_info {
 struct ovs_net {
 	struct list_head dps;
 	struct work_struct dp_notify_work;
+	struct delayed_work masks_rebalance;
 
 	/* Module reference for configuring conntrack. */
 	bool xt_label;
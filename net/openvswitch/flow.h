@@ -130,7 +130,8 @@ struct sw_flow_key_range {
 struct sw_flow_mask {
 	int ref_count;
 	struct rcu_head rcu;
-	struct list_head list;
+	unsigned long __percpu *hits;	/* Datapath lookups matched. */
+	unsigned long hits_last;	/* Sum of 'hits' at last rebalance. */
 	struct sw_flow_key_range range;
 	struct sw_flow_key key;
 };
@@ -41,12 +41,14 @@
 #include <linux/icmp.h>
 #include <linux/icmpv6.h>
 #include <linux/rculist.h>
+#include <linux/sort.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/ndisc.h>
 
 #define TBL_MIN_BUCKETS		1024
 #define REHASH_INTERVAL		(10 * 60 * HZ)
+#define MASK_ARRAY_SIZE_MIN	16
 
 static struct kmem_cache *flow_cache;
 struct kmem_cache *flow_stats_cache __read_mostly;
@@ -206,14 +208,66 @@ static struct table_instance *table_instance_alloc(int new_size)
 	return ti;
 }
 
+static struct mask_array *tbl_mask_array_alloc(int size)
+{
+	struct mask_array *new;
+
+	size = max(MASK_ARRAY_SIZE_MIN, size);
+	new = kzalloc(sizeof(struct mask_array) +
+		      sizeof(struct sw_flow_mask *) * size, GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->count = 0;
+	new->max = size;
+
+	return new;
+}
+
+static int tbl_mask_array_realloc(struct flow_table *tbl, int size)
+{
+	struct mask_array *old;
+	struct mask_array *new;
+
+	new = tbl_mask_array_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	old = ovsl_dereference(tbl->mask_array);
+	if (old) {
+		int i;
+
+		for (i = 0; i < old->count; i++)
+			RCU_INIT_POINTER(new->masks[i],
+					 ovsl_dereference(old->masks[i]));
+		new->count = old->count;
+	}
+
+	rcu_assign_pointer(tbl->mask_array, new);
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
 int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti, *ufid_ti;
+	struct mask_cache_entry __percpu *mc;
+	struct mask_array *ma;
 
-	ti = table_instance_alloc(TBL_MIN_BUCKETS);
+	mc = __alloc_percpu(sizeof(struct mask_cache_entry) * MC_HASH_ENTRIES,
+			    __alignof__(struct mask_cache_entry));
+	if (!mc)
+		return -ENOMEM;
+
+	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
+	if (!ma)
+		goto free_mask_cache;
 
+	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ti)
-		return -ENOMEM;
+		goto free_mask_array;
 
 	ufid_ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ufid_ti)
@@ -221,7 +275,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 
 	rcu_assign_pointer(table->ti, ti);
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
-	INIT_LIST_HEAD(&table->mask_list);
+	rcu_assign_pointer(table->mask_array, ma);
+	table->mask_cache = mc;
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -229,6 +284,10 @@ int ovs_flow_tbl_init(struct flow_table *table)
 
 free_ti:
 	__table_instance_destroy(ti);
+free_mask_array:
+	kfree(ma);
+free_mask_cache:
+	free_percpu(mc);
 	return -ENOMEM;
 }
 
@@ -284,8 +343,19 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 {
 	struct table_instance *ti = rcu_dereference_raw(table->ti);
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
+	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
+	int i;
 
 	table_instance_destroy(ti, ufid_ti, false);
+
+	for (i = 0; i < ma->count; i++) {
+		struct sw_flow_mask *mask = rcu_dereference_raw(ma->masks[i]);
+
+		free_percpu(mask->hits);
+		kfree(mask);
+	}
+	kfree(ma);
+	free_percpu(table->mask_cache);
 }
 
 struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *ti,
@@ -488,41 +558,128 @@ static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 	return NULL;
 }
 
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-				    const struct sw_flow_key *key,
-				    u32 *n_mask_hit)
+/* Try the mask at '*index' first, then every other mask in array order.
+ * On a match '*index' is updated to the mask that hit.
+ */
+static struct sw_flow *flow_lookup(struct table_instance *ti,
+				   const struct mask_array *ma,
+				   const struct sw_flow_key *key,
+				   u32 *n_mask_hit, u32 *index)
 {
-	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
 	struct sw_flow_mask *mask;
 	struct sw_flow *flow;
+	int i;
+
+	if (likely(*index < ma->max)) {
+		mask = rcu_dereference_ovsl(ma->masks[*index]);
+		if (mask) {
+			(*n_mask_hit)++;
+			flow = masked_flow_lookup(ti, key, mask);
+			if (flow) {
+				this_cpu_inc(*mask->hits);
+				return flow;
+			}
+		}
+	}
+
+	for (i = 0; i < ma->max; i++) {
+		if (i == *index)
+			continue;
+
+		mask = rcu_dereference_ovsl(ma->masks[i]);
+		if (unlikely(!mask))
+			break;
 
-	*n_mask_hit = 0;
-	list_for_each_entry_rcu(mask, &tbl->mask_list, list) {
 		(*n_mask_hit)++;
 		flow = masked_flow_lookup(ti, key, mask);
-		if (flow)  /* Found */
+		if (flow) { /* Found */
+			this_cpu_inc(*mask->hits);
+			*index = i;
 			return flow;
+		}
 	}
+
 	return NULL;
 }
 
+/* Must be called with rcu_read_lock and bottom halves disabled, the mask
+ * cache is per-CPU.  A zero 'skb_hash' bypasses the cache.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+				    const struct sw_flow_key *key,
+				    u32 skb_hash,
+				    u32 *n_mask_hit)
+{
+	struct mask_array *ma = rcu_dereference(tbl->mask_array);
+	struct table_instance *ti = rcu_dereference(tbl->ti);
+	struct mask_cache_entry *entries, *ce;
+	struct sw_flow *flow;
+	u32 hash;
+	int seg;
+
+	*n_mask_hit = 0;
+	if (unlikely(!skb_hash)) {
+		u32 mask_index = 0;
+
+		return flow_lookup(ti, ma, key, n_mask_hit, &mask_index);
+	}
+
+	ce = NULL;
+	hash = skb_hash;
+	entries = this_cpu_ptr(tbl->mask_cache);
+
+	for (seg = 0; seg < MC_HASH_SEGS; seg++) {
+		struct mask_cache_entry *e;
+
+		e = &entries[hash & (MC_HASH_ENTRIES - 1)];
+		if (e->skb_hash == skb_hash) {
+			flow = flow_lookup(ti, ma, key, n_mask_hit,
+					   &e->mask_index);
+			if (!flow)
+				e->skb_hash = 0;
+			return flow;
+		}
+
+		/* Replace the entry with the smallest hash, which makes
+		 * unused (zero) entries go first.
+		 */
+		if (!ce || e->skb_hash < ce->skb_hash)
+			ce = e;
+
+		hash >>= MC_HASH_SHIFT;
+	}
+
+	/* Cache miss, do full lookup. */
+	flow = flow_lookup(ti, ma, key, n_mask_hit, &ce->mask_index);
+	if (flow)
+		ce->skb_hash = skb_hash;
+
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
-	u32 __always_unused n_mask_hit;
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct mask_array *ma = rcu_dereference_ovsl(tbl->mask_array);
+	u32 n_mask_hit = 0;
+	u32 index = 0;
 
-	return ovs_flow_tbl_lookup_stats(tbl, key, &n_mask_hit);
+	return flow_lookup(ti, ma, key, &n_mask_hit, &index);
 }
 
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
 					  const struct sw_flow_match *match)
 {
 	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
-	struct sw_flow_mask *mask;
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
 	struct sw_flow *flow;
+	int i;
 
 	/* Always called under ovs-mutex. */
-	list_for_each_entry(mask, &tbl->mask_list, list) {
+	for (i = 0; i < ma->count; i++) {
+		struct sw_flow_mask *mask = ovsl_dereference(ma->masks[i]);
+
 		flow = masked_flow_lookup(ti, match->key, mask);
 		if (flow && ovs_identifier_is_key(&flow->id) &&
 		    ovs_flow_cmp_unmasked_key(flow, match))
@@ -573,13 +730,81 @@ struct sw_flow *ovs_flow_tbl_lookup_ufid(struct flow_table *tbl,
 
 int ovs_flow_tbl_num_masks(const struct flow_table *table)
 {
+	struct mask_array *ma = rcu_dereference_ovsl(table->mask_array);
+
+	return READ_ONCE(ma->count);
+}
+
+struct mask_rank {
+	unsigned long hits;
+	int index;
 	struct sw_flow_mask *mask;
-	int num = 0;
+};
 
-	list_for_each_entry(mask, &table->mask_list, list)
-		num++;
+static int mask_rank_cmp(const void *a, const void *b)
+{
+	const struct mask_rank *ra = a, *rb = b;
+
+	if (ra->hits != rb->hits)
+		return ra->hits > rb->hits ? -1 : 1;
 
-	return num;
+	return ra->index - rb->index;
+}
+
+/* Reorder the mask array so that the masks hit most since the last call
+ * are probed first.  Must be called with OVS mutex held.
+ */
+void ovs_flow_tbl_masks_rebalance(struct flow_table *table)
+{
+	struct mask_array *ma = ovsl_dereference(table->mask_array);
+	struct mask_array *new;
+	struct mask_rank *rank;
+	bool sorted = true;
+	int i;
+
+	if (ma->count < 2)
+		return;
+
+	rank = kmalloc_array(ma->count, sizeof(*rank), GFP_KERNEL);
+	if (!rank)
+		return;
+
+	for (i = 0; i < ma->count; i++) {
+		struct sw_flow_mask *mask = ovsl_dereference(ma->masks[i]);
+		unsigned long hits = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			hits += *per_cpu_ptr(mask->hits, cpu);
+
+		rank[i].hits = hits - mask->hits_last;
+		rank[i].index = i;
+		rank[i].mask = mask;
+		mask->hits_last = hits;
+
+		if (i && rank[i].hits > rank[i - 1].hits)
+			sorted = false;
+	}
+
+	if (sorted)
+		goto out;
+
+	new = tbl_mask_array_alloc(ma->max);
+	if (!new)
+		goto out;
+
+	sort(rank, ma->count, sizeof(*rank), mask_rank_cmp, NULL);
+	for (i = 0; i < ma->count; i++)
+		RCU_INIT_POINTER(new->masks[i], rank[i].mask);
+	new->count = ma->count;
+
+	/* Cached mask indexes now point at other masks; that only costs the
+	 * first probe of a cached lookup until the entry is refreshed.
+	 */
+	rcu_assign_pointer(table->mask_array, new);
+	kfree_rcu(ma, rcu);
+out:
+	kfree(rank);
 }
 
 static struct table_instance *table_instance_expand(struct table_instance *ti,
@@ -588,21 +813,55 @@ static struct table_instance *table_instance_expand(struct table_instance *ti,
 	return table_instance_rehash(ti, ti->n_buckets * 2, ufid);
 }
 
-/* Remove 'mask' from the mask list, if it is not needed any more. */
+static void mask_free_rcu(struct rcu_head *rcu)
+{
+	struct sw_flow_mask *mask = container_of(rcu, struct sw_flow_mask, rcu);
+
+	free_percpu(mask->hits);
+	kfree(mask);
+}
+
+static void tbl_mask_array_del_mask(struct flow_table *tbl,
+				    struct sw_flow_mask *mask)
+{
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int i;
+
+	for (i = 0; i < ma->count; i++)
+		if (mask == ovsl_dereference(ma->masks[i]))
+			break;
+
+	if (WARN_ON(i == ma->count))
+		return;
+
+	/* Keep the array packed by moving the last mask into the hole.  A
+	 * concurrent reader that already passed the hole may miss the moved
+	 * mask, which only results in an extra upcall.
+	 */
+	ma->count--;
+	rcu_assign_pointer(ma->masks[i], ovsl_dereference(ma->masks[ma->count]));
+	RCU_INIT_POINTER(ma->masks[ma->count], NULL);
+
+	call_rcu(&mask->rcu, mask_free_rcu);
+
+	/* Shrink the array if it is mostly unused. */
+	if (ma->max >= (MASK_ARRAY_SIZE_MIN * 2) && ma->count <= (ma->max / 3))
+		tbl_mask_array_realloc(tbl, ma->max / 2);
+}
+
+/* Remove 'mask' from the mask array, if it is not needed any more. */
 static void flow_mask_remove(struct flow_table *tbl, struct sw_flow_mask *mask)
 {
 	if (mask) {
 		/* ovs-lock is required to protect mask-refcount and
-		 * mask list.
+		 * mask array.
 		 */
 		ASSERT_OVSL();
 		BUG_ON(!mask->ref_count);
 		mask->ref_count--;
 
-		if (!mask->ref_count) {
-			list_del_rcu(&mask->list);
-			kfree_rcu(mask, rcu);
-		}
+		if (!mask->ref_count)
+			tbl_mask_array_del_mask(tbl, mask);
 	}
 }
 
@@ -631,8 +890,16 @@ static struct sw_flow_mask *mask_alloc(void)
 	struct sw_flow_mask *mask;
 
 	mask = kmalloc(sizeof(*mask), GFP_KERNEL);
-	if (mask)
-		mask->ref_count = 1;
+	if (!mask)
+		return NULL;
+
+	mask->hits = alloc_percpu(unsigned long);
+	if (!mask->hits) {
+		kfree(mask);
+		return NULL;
+	}
+	mask->hits_last = 0;
+	mask->ref_count = 1;
 
 	return mask;
 }
@@ -651,11 +918,12 @@ static bool mask_equal(const struct sw_flow_mask *a,
 static struct sw_flow_mask *flow_mask_find(const struct flow_table *tbl,
 					   const struct sw_flow_mask *mask)
 {
-	struct list_head *ml;
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int i;
+
+	for (i = 0; i < ma->count; i++) {
+		struct sw_flow_mask *m = ovsl_dereference(ma->masks[i]);
 
-	list_for_each(ml, &tbl->mask_list) {
-		struct sw_flow_mask *m;
-		m = container_of(ml, struct sw_flow_mask, list);
 		if (mask_equal(mask, m))
 			return m;
 	}
@@ -663,7 +931,29 @@ static struct sw_flow_mask *flow_mask_find(const struct flow_table *tbl,
 	return NULL;
 }
 
-/* Add 'mask' into the mask list, if it is not already there. */
+static int tbl_mask_array_add_mask(struct flow_table *tbl,
+				   struct sw_flow_mask *new)
+{
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int err;
+
+	if (ma->count >= ma->max) {
+		err = tbl_mask_array_realloc(tbl, ma->max + MASK_ARRAY_SIZE_MIN);
+		if (err)
+			return err;
+
+		ma = ovsl_dereference(tbl->mask_array);
+	}
+
+	BUG_ON(ovsl_dereference(ma->masks[ma->count]));
+
+	rcu_assign_pointer(ma->masks[ma->count], new);
+	ma->count++;
+
+	return 0;
+}
+
+/* Add 'mask' into the mask array, if it is not already there. */
 static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			    const struct sw_flow_mask *new)
 {
@@ -676,7 +966,11 @@ static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			return -ENOMEM;
 		mask->key = new->key;
 		mask->range = new->range;
-		list_add_rcu(&mask->list, &tbl->mask_list);
+		if (tbl_mask_array_add_mask(tbl, mask)) {
+			free_percpu(mask->hits);
+			kfree(mask);
+			return -ENOMEM;
+		}
 	} else {
 		BUG_ON(!mask->ref_count);
 		mask->ref_count++;
@@ -93,6 +93,7 @@
 #include <net/inet_common.h>
 #endif
 #include <linux/bpf.h>
+#include <net/packet_umem.h>
 
 #include "internal.h"
 
@@ -409,6 +410,9 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		break;
 	case TPACKET_V3:
+		h.h3->tp_status = status;
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		break;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -432,6 +436,8 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		return h.h2->tp_status;
 	case TPACKET_V3:
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		return h.h3->tp_status;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -476,6 +482,9 @@ static __u32 __packet_set_timestamp(struct packet_sock *po, void *frame,
 		h.h2->tp_nsec = ts.tv_nsec;
 		break;
 	case TPACKET_V3:
+		h.h3->tp_sec = ts.tv_sec;
+		h.h3->tp_nsec = ts.tv_nsec;
+		break;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -2088,6 +2097,64 @@ drop:
 	return 0;
 }
 
+/*
+ * UMEM receive without driver support: copy the frames of the bound queue
+ * into the next chunk from the fill ring. Zero copy queues never get here,
+ * their frames do not enter the stack.
+ */
+static int packet_rcv_umem(struct sk_buff *skb, struct net_device *dev,
+			   struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct sock *sk = pt->af_packet_priv;
+	struct packet_umem *umem = pkt_sk(sk)->umem;
+	u8 *skb_head = skb->data;
+	int skb_len = skb->len;
+	unsigned int snaplen;
+	bool queued;
+	void *data;
+	u64 addr;
+
+	if (skb->pkt_type == PACKET_LOOPBACK ||
+	    skb->pkt_type == PACKET_OUTGOING)
+		goto drop;
+	if ((skb_rx_queue_recorded(skb) ? skb_get_rx_queue(skb) : 0) !=
+	    umem->queue_id)
+		goto drop;
+	if (!net_eq(dev_net(dev), sock_net(sk)))
+		goto drop;
+
+	skb->dev = dev;
+	if (dev->header_ops)
+		skb_push(skb, skb->data - skb_mac_header(skb));
+
+	snaplen = run_filter(skb, sk, skb->len);
+	if (!snaplen)
+		goto drop_n_restore;
+	snaplen = min3(snaplen, skb->len, umem->frame_size - umem->headroom);
+
+	spin_lock(&umem->lock);
+	queued = packet_umem_rx_has_room(umem) &&
+		 packet_umem_fill_get(umem, &addr);
+	if (queued) {
+		addr += umem->headroom;
+		data = kmap_atomic(umem->pages[addr >> PAGE_SHIFT]);
+		skb_copy_bits(skb, 0, data + offset_in_page(addr), snaplen);
+		kunmap_atomic(data);
+		packet_umem_rx_put(umem, addr, snaplen);
+		packet_umem_rx_flush(umem);
+	} else {
+		umem->rx_dropped++;
+	}
+	spin_unlock(&umem->lock);
+
+drop_n_restore:
+	skb->data = skb_head;
+	skb->len = skb_len;
+drop:
+	consume_skb(skb);
+	return 0;
+}
+
 static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		       struct packet_type *pt, struct net_device *orig_dev)
 {
@@ -2360,6 +2427,14 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	skb_shinfo(skb)->destructor_arg = ph.raw;
 
 	switch (po->tp_version) {
+	case TPACKET_V3:
+		/* TX frames are not chained, each one sits in its own slot */
+		if (unlikely(ph.h3->tp_next_offset != 0)) {
+			pr_warn_once("variable sized slot not supported");
+			return -EINVAL;
+		}
+		tp_len = ph.h3->tp_len;
+		break;
 	case TPACKET_V2:
 		tp_len = ph.h2->tp_len;
 		break;
@@ -2381,6 +2456,9 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 		off_max = po->tx_ring.frame_size - tp_len;
 		if (sock->type == SOCK_DGRAM) {
 			switch (po->tp_version) {
+			case TPACKET_V3:
+				off = ph.h3->tp_net;
+				break;
 			case TPACKET_V2:
 				off = ph.h2->tp_net;
 				break;
@@ -2390,6 +2468,9 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 			}
 		} else {
 			switch (po->tp_version) {
+			case TPACKET_V3:
+				off = ph.h3->tp_mac;
+				break;
 			case TPACKET_V2:
 				off = ph.h2->tp_mac;
 				break;
@@ -2669,6 +2750,7 @@ static int packet_snd(struct socket *sock, struct msghdr *msg, size_t len)
 		goto out_unlock;
 
 	sockc.mark = sk->sk_mark;
+	sockc.transmit_time = 0;
 	if (msg->msg_controllen) {
 		err = sock_cmsg_send(sk, msg, &sockc);
 		if (unlikely(err))
@@ -2780,6 +2862,7 @@ static int packet_snd(struct socket *sock, struct msghdr *msg, size_t len)
 	skb->dev = dev;
 	skb->priority = sk->sk_priority;
 	skb->mark = sockc.mark;
+	skb->tstamp = ns_to_ktime(sockc.transmit_time);
 
 	packet_pick_tx_queue(dev, skb);
 
@@ -2831,6 +2914,12 @@ static int packet_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 
+	/* an empty send kicks a zero copy queue waiting for fill entries */
+	if (po->umem && !len) {
+		packet_umem_wakeup(po->umem);
+		return 0;
+	}
+
 	if (po->tx_ring.pg_vec)
 		return tpacket_snd(po, msg);
 	else
@@ -2842,6 +2931,48 @@ static int packet_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
  *	to 'closed' state and remove our protocol entry in the device list.
  */
 
+/*
+ *	Stop zero copy receive into a umem, if the driver does it, and let
+ *	go of its device. Called under rtnl.
+ */
+
+static void packet_umem_unbind(struct packet_umem *umem)
+{
+	struct net_device *dev = umem->dev;
+
+	if (!dev)
+		return;
+
+	if (umem->zerocopy) {
+		struct netdev_xdp xdp = { .command = XDP_SETUP_UMEM };
+
+		xdp.umem.queue_id = umem->queue_id;
+		WARN_ON(dev->netdev_ops->ndo_xdp(dev, &xdp));
+		umem->zerocopy = false;
+	}
+	umem->dev = NULL;
+	dev_put(dev);
+}
+
+static void packet_umem_dev_unregister(struct net *net, struct net_device *dev)
+{
+	struct sock *sk;
+
+	/* the driver may sleep to stop its queue, so not under rcu */
+	mutex_lock(&net->packet.sklist_lock);
+	sk_for_each(sk, &net->packet.sklist) {
+		struct packet_umem *umem = READ_ONCE(pkt_sk(sk)->umem);
+
+		if (umem && umem->dev == dev) {
+			packet_umem_unbind(umem);
+			sk->sk_err = ENETDOWN;
+			if (!sock_flag(sk, SOCK_DEAD))
+				sk->sk_error_report(sk);
+		}
+	}
+	mutex_unlock(&net->packet.sklist_lock);
+}
+
 static int packet_release(struct socket *sock)
 {
 	struct sock *sk = sock->sk;
@@ -2873,6 +3004,12 @@ static int packet_release(struct socket *sock)
 	}
 	spin_unlock(&po->bind_lock);
 
+	if (po->umem) {
+		rtnl_lock();
+		packet_umem_unbind(po->umem);
+		rtnl_unlock();
+	}
+
 	packet_flush_mclist(sk);
 
 	if (po->rx_ring.pg_vec) {
@@ -2891,6 +3028,10 @@ static int packet_release(struct socket *sock)
 	/*
 	 *	Now the socket is dead. No more input will appear.
 	 */
+	if (po->umem) {
+		packet_umem_destroy(po->umem);
+		po->umem = NULL;
+	}
 	sock_orphan(sk);
 	sock->sk = NULL;
 
@@ -2994,6 +3135,63 @@ out_unlock:
 	return ret;
 }
 
+/*
+ *	Bind a UMEM socket to its rx queue of a device: zero copy if the
+ *	driver takes the umem, else through a hook copying from the stack.
+ */
+
+static int packet_umem_bind(struct sock *sk, int ifindex)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct packet_umem *umem = po->umem;
+	struct net_device *dev;
+	bool zerocopy = false;
+	int err;
+
+	lock_sock(sk);
+	rtnl_lock();
+	err = -EBUSY;
+	if (umem->dev)
+		goto out;
+	err = -EINVAL;
+	if (!umem->fill.ring || !umem->rx.ring)
+		goto out;
+	err = -ENODEV;
+	dev = __dev_get_by_index(sock_net(sk), ifindex);
+	if (!dev)
+		goto out;
+
+	err = -EOPNOTSUPP;
+	if (!(umem->flags & TP_UMEM_COPY) && dev->netdev_ops->ndo_xdp) {
+		struct netdev_xdp xdp = { .command = XDP_SETUP_UMEM };
+
+		xdp.umem.umem = umem;
+		xdp.umem.queue_id = umem->queue_id;
+		err = dev->netdev_ops->ndo_xdp(dev, &xdp);
+		zerocopy = !err;
+	}
+	if (err && umem->flags & TP_UMEM_ZEROCOPY)
+		goto out;
+
+	dev_hold(dev);
+	umem->dev = dev;
+	umem->zerocopy = zerocopy;
+	err = 0;
+out:
+	rtnl_unlock();
+	release_sock(sk);
+	if (err || zerocopy)
+		return err;
+
+	err = packet_do_bind(sk, NULL, ifindex, htons(ETH_P_ALL));
+	if (err) {
+		rtnl_lock();
+		packet_umem_unbind(umem);
+		rtnl_unlock();
+	}
+	return err;
+}
+
 /*
  *	Bind a packet socket to a device
  */
@@ -3029,6 +3227,9 @@ static int packet_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len
 	if (sll->sll_family != AF_PACKET)
 		return -EINVAL;
 
+	if (pkt_sk(sk)->umem)
+		return packet_umem_bind(sk, sll->sll_ifindex);
+
 	return packet_do_bind(sk, NULL, sll->sll_ifindex,
 			      sll->sll_protocol ? : pkt_sk(sk)->num);
 }
@@ -3550,6 +3751,8 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 			return -EINVAL;
 		if (pkt_sk(sk)->has_vnet_hdr)
 			return -EINVAL;
+		if (po->umem)
+			return -EBUSY;
 		if (copy_from_user(&req_u.req, optval, len))
 			return -EFAULT;
 		return packet_set_ring(sk, &req_u, 0,
@@ -3673,9 +3876,68 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 			return -EINVAL;
 		if (copy_from_user(&val, optval, sizeof(val)))
 			return -EFAULT;
+		if (po->umem)
+			return -EBUSY;
 
 		return fanout_add(sk, val & 0xffff, val >> 16);
 	}
+	case PACKET_UMEM_REG:
+	{
+		struct tpacket_umem_reg reg;
+		struct packet_umem *umem;
+
+		if (optlen < sizeof(reg))
+			return -EINVAL;
+		if (sock->type != SOCK_RAW)
+			return -EINVAL;
+		if (copy_from_user(&reg, optval, sizeof(reg)))
+			return -EFAULT;
+
+		lock_sock(sk);
+		if (po->umem || po->running || po->fanout ||
+		    po->rx_ring.pg_vec || po->tx_ring.pg_vec) {
+			ret = -EBUSY;
+		} else {
+			umem = packet_umem_create(&reg);
+			if (IS_ERR(umem)) {
+				ret = PTR_ERR(umem);
+			} else {
+				umem->sk = sk;
+				po->prot_hook.func = packet_rcv_umem;
+				WRITE_ONCE(po->umem, umem);
+				ret = 0;
+			}
+		}
+		release_sock(sk);
+		return ret;
+	}
+	case PACKET_UMEM_FILL_RING:
+	case PACKET_UMEM_RX_RING:
+	case PACKET_UMEM_QUEUE:
+	{
+		unsigned int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+
+		lock_sock(sk);
+		if (!po->umem) {
+			ret = -EINVAL;
+		} else if (po->umem->dev) {
+			ret = -EBUSY;
+		} else if (optname == PACKET_UMEM_QUEUE) {
+			ret = val > U16_MAX ? -EINVAL : 0;
+			if (!ret)
+				po->umem->queue_id = val;
+		} else {
+			ret = packet_umem_set_ring(po->umem,
+					optname == PACKET_UMEM_RX_RING, val);
+		}
+		release_sock(sk);
+		return ret;
+	}
 	case PACKET_FANOUT_DATA:
 	{
 		if (!po->fanout)
@@ -3723,6 +3985,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	void *data = &val;
 	union tpacket_stats_u st;
 	struct tpacket_rollover_stats rstats;
+	struct tpacket_umem_stats ustats;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -3750,6 +4013,15 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 			data = &st.stats1;
 		}
 
+		break;
+	case PACKET_UMEM_STATISTICS:
+		if (!po->umem)
+			return -EINVAL;
+		ustats.rx_packets = po->umem->rx_packets;
+		ustats.rx_dropped = po->umem->rx_dropped;
+		ustats.fill_invalid = po->umem->fill_invalid;
+		data = &ustats;
+		lv = sizeof(ustats);
 		break;
 	case PACKET_AUXDATA:
 		val = po->auxdata;
@@ -3874,6 +4146,9 @@ static int packet_notifier(struct notifier_block *this,
 		}
 	}
 	rcu_read_unlock();
+
+	if (msg == NETDEV_UNREGISTER)
+		packet_umem_dev_unregister(net, dev);
 	return NOTIFY_DONE;
 }
 
@@ -3944,6 +4219,8 @@ static unsigned int packet_poll(struct file *file, struct socket *sock,
 			TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
+	if (po->umem && packet_umem_rx_pending(po->umem))
+		mask |= POLLIN | POLLRDNORM;
 	if (po->pressure && __packet_rcv_has_room(po, NULL) == ROOM_NORMAL)
 		po->pressure = 0;
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
@@ -4067,11 +4344,13 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	/* Added to avoid minimal code churn */
 	struct tpacket_req *req = &req_u->req;
 
-	/* Opening a Tx-ring is NOT supported in TPACKET_V3 */
-	if (!closing && tx_ring && (po->tp_version > TPACKET_V2)) {
-		WARN(1, "Tx-ring is not supported.\n");
+	/* A TPACKET_V3 Tx-ring is a plain array of frames, there is no block
+	 * retire timer or private area to set up.
+	 */
+	if (!closing && tx_ring && (po->tp_version > TPACKET_V2) &&
+	    (req_u->req3.tp_retire_blk_tov || req_u->req3.tp_sizeof_priv ||
+	     req_u->req3.tp_feature_req_word))
 		goto out;
-	}
 
 	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
 	rb_queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
@@ -4131,9 +4410,7 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 			goto out;
 		switch (po->tp_version) {
 		case TPACKET_V3:
-		/* Transmit path is not supported. We checked
-		 * it above but just being paranoid
-		 */
+			/* Block-based layout is only used for receive */
 			if (!tx_ring)
 				init_prb_bdqc(po, rb, pg_vec, req_u);
 			break;
@@ -4216,6 +4493,9 @@ static int packet_mmap(struct file *file, struct socket *sock,
 	int err = -EINVAL;
 	int i;
 
+	if (po->umem)
+		return packet_umem_mmap(po->umem, vma);
+
 	if (vma->vm_pgoff)
 		return -EINVAL;
 
@@ -120,6 +120,7 @@ struct packet_sock {
 	struct packet_rollover	*rollover;
 	struct packet_mclist	*mclist;
 	atomic_t		mapped;
+	struct packet_umem	*umem;		/* UMEM receive mode	*/
 	enum tpacket_versions	tp_version;
 	unsigned int		tp_hdrlen;
 	unsigned int		tp_reserve;
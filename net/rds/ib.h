@@ -27,6 +27,10 @@
 
 #define RDS_IB_RECYCLE_BATCH_COUNT	32
 
+/* Bounds and sampling period for the adaptive receive posting depth */
+#define RDS_IB_RECV_TARGET_MIN		64
+#define RDS_IB_RECV_TARGET_INTERVAL	(HZ / 10)
+
 #define RDS_IB_WC_MAX			32
 #define RDS_IB_SEND_OP			BIT_ULL(63)
 
@@ -152,6 +156,10 @@ struct rds_ib_connection {
 	u64			i_ack_recv;	/* last ACK received */
 	struct rds_ib_refill_cache i_cache_incs;
 	struct rds_ib_refill_cache i_cache_frags;
+	u32			i_recv_target;	/* receives to keep posted */
+	u32			i_recv_completions;
+	u32			i_recv_trim;	/* cached frags to release */
+	unsigned long		i_recv_target_stamp;
 
 	/* sending acks */
 	unsigned long		i_ack_flags;
@@ -247,6 +255,8 @@ struct rds_ib_statistics {
 	uint64_t	s_ib_rx_ring_empty;
 	uint64_t	s_ib_rx_refill_from_cq;
 	uint64_t	s_ib_rx_refill_from_thread;
+	uint64_t	s_ib_rx_target_grow;
+	uint64_t	s_ib_rx_target_shrink;
 	uint64_t	s_ib_rx_alloc_limit;
 	uint64_t	s_ib_rx_credit_updates;
 	uint64_t	s_ib_ack_sent;
@@ -387,7 +397,7 @@ u32 rds_ib_ring_alloc(struct rds_ib_work_ring *ring, u32 val, u32 *pos);
 void rds_ib_ring_free(struct rds_ib_work_ring *ring, u32 val);
 void rds_ib_ring_unalloc(struct rds_ib_work_ring *ring, u32 val);
 int rds_ib_ring_empty(struct rds_ib_work_ring *ring);
-int rds_ib_ring_low(struct rds_ib_work_ring *ring);
+u32 rds_ib_ring_used(struct rds_ib_work_ring *ring);
 u32 rds_ib_ring_oldest(struct rds_ib_work_ring *ring);
 u32 rds_ib_ring_completed(struct rds_ib_work_ring *ring, u32 wr_id, u32 oldest);
 extern wait_queue_head_t rds_ib_ring_empty_wait;
@@ -817,6 +817,10 @@ void rds_ib_conn_shutdown(struct rds_connection *conn)
 
 	rds_ib_ring_init(&ic->i_send_ring, rds_ib_sysctl_max_send_wr);
 	rds_ib_ring_init(&ic->i_recv_ring, rds_ib_sysctl_max_recv_wr);
+	ic->i_recv_target = RDS_IB_RECV_TARGET_MIN;
+	ic->i_recv_completions = 0;
+	ic->i_recv_trim = 0;
+	ic->i_recv_target_stamp = jiffies;
 
 	if (ic->i_ibinc) {
 		rds_inc_put(&ic->i_ibinc->ii_inc);
@@ -863,6 +867,10 @@ int rds_ib_conn_alloc(struct rds_connection *conn, gfp_t gfp)
 	 */
 	rds_ib_ring_init(&ic->i_send_ring, rds_ib_sysctl_max_send_wr);
 	rds_ib_ring_init(&ic->i_recv_ring, rds_ib_sysctl_max_recv_wr);
+	ic->i_recv_target = RDS_IB_RECV_TARGET_MIN;
+	ic->i_recv_completions = 0;
+	ic->i_recv_trim = 0;
+	ic->i_recv_target_stamp = jiffies;
 
 	ic->conn = conn;
 	conn->c_transport_data = ic;
@@ -365,6 +365,82 @@ static void release_refill(struct rds_connection *conn)
 		wake_up_all(&conn->c_waitq);
 }
 
+/*
+ * Release frags the refill cache no longer needs after the posting target
+ * shrank.  Only frags that already made it back to the ready list are
+ * considered; anything still sitting on the percpu lists is picked up by
+ * the next refill.  Called with the refill lock held.
+ */
+static void rds_ib_recv_trim_cache(struct rds_ib_connection *ic)
+{
+	struct list_head *cache_item;
+	struct rds_page_frag *frag;
+
+	while (ic->i_recv_trim) {
+		cache_item = rds_ib_recv_cache_get(&ic->i_cache_frags);
+		if (!cache_item)
+			break;
+		frag = container_of(cache_item, struct rds_page_frag,
+				    f_cache_entry);
+		put_page(sg_page(&frag->f_sg));
+		kmem_cache_free(rds_ib_frag_slab, frag);
+		ic->i_recv_trim--;
+	}
+	ic->i_recv_trim = 0;
+}
+
+/*
+ * Connections only keep i_recv_target receives posted instead of the whole
+ * ring, so idle connections don't each pin a full ring worth of pages.  The
+ * target doubles when the ring runs dry or a whole target's worth of
+ * receives completes within one interval, and halves when less than a
+ * quarter of it was used.  All of this runs from the recv completion path,
+ * which is serialized per connection.
+ */
+static u32 rds_ib_recv_target(struct rds_ib_connection *ic)
+{
+	return min(ic->i_recv_target, ic->i_recv_ring.w_nr);
+}
+
+static int rds_ib_recv_ring_low(struct rds_ib_connection *ic)
+{
+	return rds_ib_ring_used(&ic->i_recv_ring) <= rds_ib_recv_target(ic) / 2;
+}
+
+static void rds_ib_recv_target_grow(struct rds_ib_connection *ic)
+{
+	if (ic->i_recv_target >= ic->i_recv_ring.w_nr)
+		return;
+
+	ic->i_recv_target = min(ic->i_recv_target * 2, ic->i_recv_ring.w_nr);
+	ic->i_recv_completions = 0;
+	ic->i_recv_target_stamp = jiffies;
+	rds_ib_stats_inc(s_ib_rx_target_grow);
+}
+
+static void rds_ib_recv_target_update(struct rds_ib_connection *ic)
+{
+	u32 target = rds_ib_recv_target(ic);
+
+	ic->i_recv_completions++;
+	if (time_before(jiffies, ic->i_recv_target_stamp +
+			RDS_IB_RECV_TARGET_INTERVAL)) {
+		if (ic->i_recv_completions >= target)
+			rds_ib_recv_target_grow(ic);
+		return;
+	}
+
+	if (ic->i_recv_completions < target / 4 &&
+	    target > RDS_IB_RECV_TARGET_MIN) {
+		ic->i_recv_target = max_t(u32, target / 2,
+					  RDS_IB_RECV_TARGET_MIN);
+		ic->i_recv_trim += target - ic->i_recv_target;
+		rds_ib_stats_inc(s_ib_rx_target_shrink);
+	}
+	ic->i_recv_completions = 0;
+	ic->i_recv_target_stamp = jiffies;
+}
+
 /*
  * This tries to allocate and post unused work requests after making sure that
  * they have all the allocations they need to queue received fragments into
@@ -390,6 +466,7 @@ void rds_ib_recv_refill(struct rds_connection *conn, int prefill, gfp_t gfp)
 		return;
 
 	while ((prefill || rds_conn_up(conn)) &&
+	       rds_ib_ring_used(&ic->i_recv_ring) < rds_ib_recv_target(ic) &&
 	       rds_ib_ring_alloc(&ic->i_recv_ring, 1, &pos)) {
 		if (pos >= ic->i_recv_ring.w_nr) {
 			printk(KERN_NOTICE "Argh - ring alloc returned pos=%u\n",
@@ -429,6 +506,9 @@ void rds_ib_recv_refill(struct rds_connection *conn, int prefill, gfp_t gfp)
 	if (ret)
 		rds_ib_ring_unalloc(&ic->i_recv_ring, 1);
 
+	if (ic->i_recv_trim)
+		rds_ib_recv_trim_cache(ic);
+
 	release_refill(conn);
 
 	/* if we're called from the softirq handler, we'll be GFP_NOWAIT.
@@ -438,11 +518,11 @@ void rds_ib_recv_refill(struct rds_connection *conn, int prefill, gfp_t gfp)
 	 *
 	 * if we're called from krdsd, we'll be GFP_KERNEL.  In this case
 	 * we might have raced with the softirq code while we had the refill
-	 * lock held.  Use rds_ib_ring_low() instead of ring_empty to decide
-	 * if we should requeue.
+	 * lock held.  Use rds_ib_recv_ring_low() instead of ring_empty to
+	 * decide if we should requeue.
 	 */
 	if (rds_conn_up(conn) &&
-	    ((can_wait && rds_ib_ring_low(&ic->i_recv_ring)) ||
+	    ((can_wait && rds_ib_recv_ring_low(ic)) ||
 	    rds_ib_ring_empty(&ic->i_recv_ring))) {
 		queue_delayed_work(rds_wq, &conn->c_recv_w, 1);
 	}
@@ -1001,10 +1081,14 @@ void rds_ib_recv_cqe_handler(struct rds_ib_connection *ic,
 	/* If we ever end up with a really empty receive ring, we're
 	 * in deep trouble, as the sender will definitely see RNR
 	 * timeouts. */
-	if (rds_ib_ring_empty(&ic->i_recv_ring))
+	if (rds_ib_ring_empty(&ic->i_recv_ring)) {
 		rds_ib_stats_inc(s_ib_rx_ring_empty);
+		rds_ib_recv_target_grow(ic);
+	}
+
+	rds_ib_recv_target_update(ic);
 
-	if (rds_ib_ring_low(&ic->i_recv_ring))
+	if (rds_ib_recv_ring_low(ic))
 		rds_ib_recv_refill(conn, 0, GFP_NOWAIT);
 }
 
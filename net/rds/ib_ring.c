@@ -135,9 +135,9 @@ int rds_ib_ring_empty(struct rds_ib_work_ring *ring)
 	return __rds_ib_ring_empty(ring);
 }
 
-int rds_ib_ring_low(struct rds_ib_work_ring *ring)
+u32 rds_ib_ring_used(struct rds_ib_work_ring *ring)
 {
-	return __rds_ib_ring_used(ring) <= (ring->w_nr >> 1);
+	return __rds_ib_ring_used(ring);
 }
 
 /*
@@ -54,6 +54,8 @@ static const char *const rds_ib_stat_names[] = {
 	"ib_rx_ring_empty",
 	"ib_rx_refill_from_cq",
 	"ib_rx_refill_from_thread",
+	"ib_rx_target_grow",
+	"ib_rx_target_shrink",
 	"ib_rx_alloc_limit",
 	"ib_rx_credit_updates",
 	"ib_ack_sent",
@@ -656,6 +656,36 @@ errout:
 	return -1;
 }
 
+/**
+ * tcf_action_stats_update - add packets handled elsewhere to an action
+ * @a: the action
+ * @bytes: bytes since the last update
+ * @packets: packets since the last update
+ * @lastuse: jiffies of the last packet, 0 when unknown
+ *
+ * Used by classifiers whose filters run in hardware to fold the device's
+ * counters into the actions, so that they dump as if run in software.
+ */
+void tcf_action_stats_update(struct tc_action *a, u64 bytes, u32 packets,
+			     unsigned long lastuse)
+{
+	struct tcf_common *p = a->priv;
+
+	if (p->cpu_bstats) {
+		preempt_disable();
+		_bstats_cpu_update(this_cpu_ptr(p->cpu_bstats), bytes, packets);
+		preempt_enable();
+	} else {
+		spin_lock_bh(&p->tcfc_lock);
+		_bstats_update(&p->tcfc_bstats, bytes, packets);
+		spin_unlock_bh(&p->tcfc_lock);
+	}
+	if (lastuse &&
+	    time_after(lastuse, (unsigned long)p->tcfc_tm.lastuse))
+		p->tcfc_tm.lastuse = lastuse;
+}
+EXPORT_SYMBOL(tcf_action_stats_update);
+
 static int
 tca_get_fill(struct sk_buff *skb, struct list_head *actions, u32 portid, u32 seq,
 	     u16 flags, int event, int bind, int ref)
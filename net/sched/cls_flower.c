@@ -13,6 +13,9 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/rhashtable.h>
+#include <linux/list_sort.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
 
 #include <linux/if_ether.h>
 #include <linux/in6.h>
@@ -41,20 +44,46 @@ struct fl_flow_mask_range {
 	unsigned short int end;
 };
 
+/* Filters are grouped by mask, each mask has a hash table of the masked
+ * keys of its filters. Packets are looked up in one mask after the other,
+ * the most hit first, until one matches. Which filter matches a packet
+ * that two filters with different masks both match is not defined, such
+ * filters want different priorities.
+ */
 struct fl_flow_mask {
 	struct fl_flow_key key;
 	struct fl_flow_mask_range range;
-	struct rcu_head	rcu;
+	struct flow_dissector dissector;	/* for offloading the filters */
+	struct rhashtable ht;
+	struct rhashtable_params ht_params;
+	struct list_head list;		/* in cls_fl_head.masks */
+	unsigned int refcnt;		/* filters using the mask */
+	u64 __percpu *hits;
+	u64 last_hits;
+	u64 rate;			/* hits in the last reorder interval */
+	union {
+		struct rcu_head	rcu;
+		struct work_struct work;
+	};
 };
 
-struct cls_fl_head {
-	struct rhashtable ht;
-	struct fl_flow_mask mask;
+/* The masks fl_classify() probes, in that order, replaced as a whole */
+struct fl_mask_array {
 	struct flow_dissector dissector;
+	struct fl_flow_mask_range range;	/* covers all the masks */
+	unsigned int count;
+	struct rcu_head rcu;
+	struct fl_flow_mask *masks[0];
+};
+
+#define FL_MASK_REORDER_INTERVAL	HZ
+
+struct cls_fl_head {
+	struct fl_mask_array __rcu *mask_array;
+	struct list_head masks;
 	u32 hgen;
-	bool mask_assigned;
 	struct list_head filters;
-	struct rhashtable_params ht_params;
+	struct delayed_work reorder_work;
 	struct rcu_head rcu;
 };
 
@@ -64,8 +93,10 @@ struct cls_fl_filter {
 	struct tcf_exts exts;
 	struct tcf_result res;
 	struct fl_flow_key key;
+	struct fl_flow_mask *mask;
 	struct list_head list;
 	u32 handle;
+	u32 flags;			/* TCA_CLS_FLAGS_* */
 	struct rcu_head	rcu;
 };
 
@@ -110,39 +141,52 @@ static void fl_set_masked_key(struct fl_flow_key *mkey, struct fl_flow_key *key,
 }
 
 static void fl_clear_masked_range(struct fl_flow_key *key,
-				  struct fl_flow_mask *mask)
+				  const struct fl_flow_mask_range *range)
 {
-	memset(fl_key_get_start(key, mask), 0, fl_mask_range(mask));
+	memset((u8 *) key + range->start, 0, range->end - range->start);
 }
 
 static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 		       struct tcf_result *res)
 {
 	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
+	struct fl_mask_array *ma = rcu_dereference_bh(head->mask_array);
 	struct cls_fl_filter *f;
 	struct fl_flow_key skb_key;
 	struct fl_flow_key skb_mkey;
+	unsigned int i;
+
+	if (!ma)
+		return -1;
 
-	fl_clear_masked_range(&skb_key, &head->mask);
+	/* the packet is dissected once, for everything any mask looks at */
+	fl_clear_masked_range(&skb_key, &ma->range);
 	skb_key.indev_ifindex = skb->skb_iif;
 	/* skb_flow_dissect() does not set n_proto in case an unknown protocol,
 	 * so do it rather here.
 	 */
 	skb_key.basic.n_proto = skb->protocol;
-	skb_flow_dissect(skb, &head->dissector, &skb_key, 0);
+	skb_flow_dissect(skb, &ma->dissector, &skb_key, 0);
 
-	fl_set_masked_key(&skb_mkey, &skb_key, &head->mask);
+	for (i = 0; i < ma->count; i++) {
+		struct fl_flow_mask *mask = ma->masks[i];
 
-	f = rhashtable_lookup_fast(&head->ht,
-				   fl_key_get_start(&skb_mkey, &head->mask),
-				   head->ht_params);
-	if (f) {
-		*res = f->res;
-		return tcf_exts_exec(skb, &f->exts, res);
+		fl_set_masked_key(&skb_mkey, &skb_key, mask);
+
+		f = rhashtable_lookup_fast(&mask->ht,
+					   fl_key_get_start(&skb_mkey, mask),
+					   mask->ht_params);
+		if (f) {
+			this_cpu_inc(*mask->hits);
+			*res = f->res;
+			return tcf_exts_exec(skb, &f->exts, res);
+		}
 	}
 	return -1;
 }
 
+static void fl_reorder_masks(struct work_struct *work);
+
 static int fl_init(struct tcf_proto *tp)
 {
 	struct cls_fl_head *head;
@@ -152,6 +196,8 @@ static int fl_init(struct tcf_proto *tp)
 		return -ENOBUFS;
 
 	INIT_LIST_HEAD_RCU(&head->filters);
+	INIT_LIST_HEAD(&head->masks);
+	INIT_DELAYED_WORK(&head->reorder_work, fl_reorder_masks);
 	rcu_assign_pointer(tp->root, head);
 
 	return 0;
@@ -165,6 +211,94 @@ static void fl_destroy_filter(struct rcu_head *head)
 	kfree(f);
 }
 
+/* Filters are only offloaded from the ingress qdisc of their device */
+static struct net_device *fl_hw_dev(struct tcf_proto *tp, u32 flags)
+{
+	struct net_device *dev = qdisc_dev(tp->q);
+
+	if (!(tp->q->flags & TCQ_F_INGRESS) || !tc_should_offload(dev, flags))
+		return NULL;
+	return dev;
+}
+
+/*
+ * Returns an error only for a filter that must not run in software, any
+ * other filter just stays in software when the device does not take it.
+ */
+static int fl_hw_replace_filter(struct tcf_proto *tp, struct cls_fl_filter *f)
+{
+	struct net_device *dev = fl_hw_dev(tp, f->flags);
+	struct tc_cls_flower_offload offload = {0};
+	int err;
+
+	/* the device only sees its own packets and can't match on indev */
+	if (dev && f->mask->key.indev_ifindex &&
+	    f->key.indev_ifindex != dev->ifindex)
+		dev = NULL;
+	if (!dev)
+		return tc_skip_sw(f->flags) ? -EOPNOTSUPP : 0;
+
+	offload.command = TC_CLSFLOWER_REPLACE;
+	offload.cookie = (unsigned long)f;
+	offload.dissector = &f->mask->dissector;
+	offload.mask = &f->mask->key;
+	offload.key = &f->mkey;
+	offload.exts = &f->exts;
+
+	err = dev->netdev_ops->ndo_setup_tc_flower(dev, &offload);
+	if (!err)
+		f->flags |= TCA_CLS_FLAGS_IN_HW;
+
+	return tc_skip_sw(f->flags) ? err : 0;
+}
+
+static void fl_hw_destroy_filter(struct tcf_proto *tp, struct cls_fl_filter *f)
+{
+	struct net_device *dev = qdisc_dev(tp->q);
+	struct tc_cls_flower_offload offload = {0};
+
+	if (!(f->flags & TCA_CLS_FLAGS_IN_HW))
+		return;
+
+	offload.command = TC_CLSFLOWER_DESTROY;
+	offload.cookie = (unsigned long)f;
+
+	dev->netdev_ops->ndo_setup_tc_flower(dev, &offload);
+	f->flags &= ~TCA_CLS_FLAGS_IN_HW;
+}
+
+/* Pull the packets the device matched into the filter's actions */
+static void fl_hw_update_stats(struct tcf_proto *tp, struct cls_fl_filter *f)
+{
+	struct net_device *dev = qdisc_dev(tp->q);
+	struct tc_cls_flower_offload offload = {0};
+
+	if (!(f->flags & TCA_CLS_FLAGS_IN_HW))
+		return;
+
+	offload.command = TC_CLSFLOWER_STATS;
+	offload.cookie = (unsigned long)f;
+	offload.exts = &f->exts;
+
+	dev->netdev_ops->ndo_setup_tc_flower(dev, &offload);
+}
+
+static void fl_mask_put(struct cls_fl_head *head, struct fl_flow_mask *mask);
+
+static void __fl_delete(struct tcf_proto *tp, struct cls_fl_filter *f)
+{
+	struct cls_fl_head *head = rtnl_dereference(tp->root);
+
+	if (!tc_skip_sw(f->flags))
+		rhashtable_remove_fast(&f->mask->ht, &f->ht_node,
+				       f->mask->ht_params);
+	fl_hw_destroy_filter(tp, f);
+	list_del_rcu(&f->list);
+	fl_mask_put(head, f->mask);
+	tcf_unbind_filter(tp, &f->res);
+	call_rcu(&f->rcu, fl_destroy_filter);
+}
+
 static bool fl_destroy(struct tcf_proto *tp, bool force)
 {
 	struct cls_fl_head *head = rtnl_dereference(tp->root);
@@ -173,13 +307,10 @@ static bool fl_destroy(struct tcf_proto *tp, bool force)
 	if (!force && !list_empty(&head->filters))
 		return false;
 
-	list_for_each_entry_safe(f, next, &head->filters, list) {
-		list_del_rcu(&f->list);
-		call_rcu(&f->rcu, fl_destroy_filter);
-	}
+	list_for_each_entry_safe(f, next, &head->filters, list)
+		__fl_delete(tp, f);
+	cancel_delayed_work_sync(&head->reorder_work);
 	RCU_INIT_POINTER(tp->root, NULL);
-	if (head->mask_assigned)
-		rhashtable_destroy(&head->ht);
 	kfree_rcu(head, rcu);
 	return true;
 }
@@ -218,6 +349,7 @@ static const struct nla_policy fl_policy[TCA_FLOWER_MAX + 1] = {
 	[TCA_FLOWER_KEY_TCP_DST]	= { .type = NLA_U16 },
 	[TCA_FLOWER_KEY_UDP_SRC]	= { .type = NLA_U16 },
 	[TCA_FLOWER_KEY_UDP_DST]	= { .type = NLA_U16 },
+	[TCA_FLOWER_FLAGS]		= { .type = NLA_U32 },
 };
 
 static void fl_set_key_val(struct nlattr **tb,
@@ -317,14 +449,13 @@ static const struct rhashtable_params fl_ht_params = {
 	.automatic_shrinking = true,
 };
 
-static int fl_init_hashtable(struct cls_fl_head *head,
-			     struct fl_flow_mask *mask)
+static int fl_init_hashtable(struct fl_flow_mask *mask)
 {
-	head->ht_params = fl_ht_params;
-	head->ht_params.key_len = fl_mask_range(mask);
-	head->ht_params.key_offset += mask->range.start;
+	mask->ht_params = fl_ht_params;
+	mask->ht_params.key_len = fl_mask_range(mask);
+	mask->ht_params.key_offset += mask->range.start;
 
-	return rhashtable_init(&head->ht, &head->ht_params);
+	return rhashtable_init(&mask->ht, &mask->ht_params);
 }
 
 #define FL_KEY_MEMBER_OFFSET(member) offsetof(struct fl_flow_key, member)
@@ -332,9 +463,9 @@ static int fl_init_hashtable(struct cls_fl_head *head,
 #define FL_KEY_MEMBER_END_OFFSET(member)					\
 	(FL_KEY_MEMBER_OFFSET(member) + FL_KEY_MEMBER_SIZE(member))
 
-#define FL_KEY_IN_RANGE(mask, member)						\
-        (FL_KEY_MEMBER_OFFSET(member) <= (mask)->range.end &&			\
-         FL_KEY_MEMBER_END_OFFSET(member) >= (mask)->range.start)
+#define FL_KEY_IN_RANGE(range, member)						\
+        (FL_KEY_MEMBER_OFFSET(member) <= (range)->end &&			\
+         FL_KEY_MEMBER_END_OFFSET(member) >= (range)->start)
 
 #define FL_KEY_SET(keys, cnt, id, member)					\
 	do {									\
@@ -343,56 +474,205 @@ static int fl_init_hashtable(struct cls_fl_head *head,
 		cnt++;								\
 	} while(0);
 
-#define FL_KEY_SET_IF_IN_RANGE(mask, keys, cnt, id, member)			\
+#define FL_KEY_SET_IF_IN_RANGE(range, keys, cnt, id, member)			\
 	do {									\
-		if (FL_KEY_IN_RANGE(mask, member))				\
+		if (FL_KEY_IN_RANGE(range, member))				\
 			FL_KEY_SET(keys, cnt, id, member);			\
 	} while(0);
 
-static void fl_init_dissector(struct cls_fl_head *head,
-			      struct fl_flow_mask *mask)
+static void fl_init_dissector(struct flow_dissector *dissector,
+			      const struct fl_flow_mask_range *range)
 {
 	struct flow_dissector_key keys[FLOW_DISSECTOR_KEY_MAX];
 	size_t cnt = 0;
 
 	FL_KEY_SET(keys, cnt, FLOW_DISSECTOR_KEY_CONTROL, control);
 	FL_KEY_SET(keys, cnt, FLOW_DISSECTOR_KEY_BASIC, basic);
-	FL_KEY_SET_IF_IN_RANGE(mask, keys, cnt,
+	FL_KEY_SET_IF_IN_RANGE(range, keys, cnt,
 			       FLOW_DISSECTOR_KEY_ETH_ADDRS, eth);
-	FL_KEY_SET_IF_IN_RANGE(mask, keys, cnt,
+	FL_KEY_SET_IF_IN_RANGE(range, keys, cnt,
 			       FLOW_DISSECTOR_KEY_IPV4_ADDRS, ipv4);
-	FL_KEY_SET_IF_IN_RANGE(mask, keys, cnt,
+	FL_KEY_SET_IF_IN_RANGE(range, keys, cnt,
 			       FLOW_DISSECTOR_KEY_IPV6_ADDRS, ipv6);
-	FL_KEY_SET_IF_IN_RANGE(mask, keys, cnt,
+	FL_KEY_SET_IF_IN_RANGE(range, keys, cnt,
 			       FLOW_DISSECTOR_KEY_PORTS, tp);
 
-	skb_flow_dissector_init(&head->dissector, keys, cnt);
+	skb_flow_dissector_init(dissector, keys, cnt);
 }
 
-static int fl_check_assign_mask(struct cls_fl_head *head,
-				struct fl_flow_mask *mask)
+/* Publish the masks on head->masks, in the list's order, to the readers */
+static int fl_publish_masks(struct cls_fl_head *head, gfp_t gfp)
 {
+	struct fl_mask_array *old = rtnl_dereference(head->mask_array);
+	struct fl_mask_array *ma = NULL;
+	struct fl_flow_mask *mask;
+	unsigned int count = 0;
+
+	list_for_each_entry(mask, &head->masks, list)
+		count++;
+
+	if (count) {
+		ma = kzalloc(sizeof(*ma) + count * sizeof(ma->masks[0]), gfp);
+		if (!ma)
+			return -ENOMEM;
+
+		ma->range.start = sizeof(struct fl_flow_key);
+		list_for_each_entry(mask, &head->masks, list) {
+			ma->masks[ma->count++] = mask;
+			ma->range.start = min(ma->range.start, mask->range.start);
+			ma->range.end = max(ma->range.end, mask->range.end);
+		}
+		fl_init_dissector(&ma->dissector, &ma->range);
+	}
+
+	rcu_assign_pointer(head->mask_array, ma);
+	if (old)
+		kfree_rcu(old, rcu);
+
+	if (count > 1)
+		schedule_delayed_work(&head->reorder_work,
+				      FL_MASK_REORDER_INTERVAL);
+	return 0;
+}
+
+static u64 fl_mask_hits(const struct fl_flow_mask *mask)
+{
+	u64 hits = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		hits += *per_cpu_ptr(mask->hits, cpu);
+	return hits;
+}
+
+static int fl_mask_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	const struct fl_flow_mask *ma = list_entry(a, struct fl_flow_mask, list);
+	const struct fl_flow_mask *mb = list_entry(b, struct fl_flow_mask, list);
+
+	if (ma->rate == mb->rate)
+		return 0;
+	return ma->rate < mb->rate ? 1 : -1;
+}
+
+/* Move the masks that matched most in the last interval to the front */
+static void fl_reorder_masks(struct work_struct *work)
+{
+	struct cls_fl_head *head = container_of(to_delayed_work(work),
+						struct cls_fl_head,
+						reorder_work);
+	struct fl_mask_array *ma;
+	struct fl_flow_mask *mask;
+	bool changed = false;
+	unsigned int i = 0;
+
+	/* fl_destroy() cancels us with the rtnl held */
+	if (!rtnl_trylock()) {
+		schedule_delayed_work(&head->reorder_work, HZ / 10);
+		return;
+	}
+
+	list_for_each_entry(mask, &head->masks, list) {
+		u64 hits = fl_mask_hits(mask);
+
+		mask->rate = hits - mask->last_hits;
+		mask->last_hits = hits;
+	}
+	list_sort(NULL, &head->masks, fl_mask_cmp);
+
+	/* the array always holds the masks on the list, in some order */
+	ma = rtnl_dereference(head->mask_array);
+	list_for_each_entry(mask, &head->masks, list) {
+		if (ma->masks[i++] != mask) {
+			changed = true;
+			break;
+		}
+	}
+
+	/* publishing reschedules us */
+	if (!changed || fl_publish_masks(head, GFP_KERNEL))
+		if (ma && ma->count > 1)
+			schedule_delayed_work(&head->reorder_work,
+					      FL_MASK_REORDER_INTERVAL);
+	rtnl_unlock();
+}
+
+static void fl_mask_free_work(struct work_struct *work)
+{
+	struct fl_flow_mask *mask = container_of(work, struct fl_flow_mask,
+						 work);
+
+	rhashtable_destroy(&mask->ht);
+	free_percpu(mask->hits);
+	kfree(mask);
+}
+
+static void fl_mask_free_rcu(struct rcu_head *rcu)
+{
+	struct fl_flow_mask *mask = container_of(rcu, struct fl_flow_mask, rcu);
+
+	/* rhashtable_destroy() sleeps */
+	INIT_WORK(&mask->work, fl_mask_free_work);
+	schedule_work(&mask->work);
+}
+
+static void fl_mask_put(struct cls_fl_head *head, struct fl_flow_mask *mask)
+{
+	if (--mask->refcnt)
+		return;
+
+	list_del(&mask->list);
+	fl_publish_masks(head, GFP_KERNEL | __GFP_NOFAIL);
+	call_rcu(&mask->rcu, fl_mask_free_rcu);
+}
+
+/* Find the mask equal to @tmpl or add it, with a reference either way */
+static struct fl_flow_mask *fl_mask_get(struct cls_fl_head *head,
+					struct fl_flow_mask *tmpl)
+{
+	struct fl_flow_mask *mask;
 	int err;
 
-	if (head->mask_assigned) {
-		if (!fl_mask_eq(&head->mask, mask))
-			return -EINVAL;
-		else
-			return 0;
+	list_for_each_entry(mask, &head->masks, list) {
+		if (fl_mask_eq(mask, tmpl)) {
+			mask->refcnt++;
+			return mask;
+		}
+	}
+
+	mask = kzalloc(sizeof(*mask), GFP_KERNEL);
+	if (!mask)
+		return ERR_PTR(-ENOBUFS);
+
+	mask->key = tmpl->key;
+	mask->range = tmpl->range;
+	fl_init_dissector(&mask->dissector, &mask->range);
+	mask->refcnt = 1;
+	mask->hits = alloc_percpu(u64);
+	if (!mask->hits) {
+		err = -ENOBUFS;
+		goto errout;
 	}
 
-	/* Mask is not assigned yet. So assign it and init hashtable
-	 * according to that.
-	 */
-	err = fl_init_hashtable(head, mask);
+	err = fl_init_hashtable(mask);
 	if (err)
-		return err;
-	memcpy(&head->mask, mask, sizeof(head->mask));
-	head->mask_assigned = true;
+		goto errout;
 
-	fl_init_dissector(head, mask);
+	/* new masks start at the back, the reorder work moves them up */
+	list_add_tail(&mask->list, &head->masks);
+	err = fl_publish_masks(head, GFP_KERNEL);
+	if (err) {
+		list_del(&mask->list);
+		rhashtable_destroy(&mask->ht);
+		goto errout;
+	}
 
-	return 0;
+	return mask;
+
+errout:
+	free_percpu(mask->hits);
+	kfree(mask);
+	return ERR_PTR(err);
 }
 
 static int fl_set_parms(struct net *net, struct tcf_proto *tp,
@@ -459,6 +739,7 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 	struct cls_fl_filter *fnew;
 	struct nlattr *tb[TCA_FLOWER_MAX + 1];
 	struct fl_flow_mask mask = {};
+	struct fl_flow_mask *m;
 	int err;
 
 	if (!tca[TCA_OPTIONS])
@@ -486,26 +767,52 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 	}
 	fnew->handle = handle;
 
+	if (tb[TCA_FLOWER_FLAGS]) {
+		fnew->flags = nla_get_u32(tb[TCA_FLOWER_FLAGS]);
+		if (!tc_flags_valid(fnew->flags)) {
+			err = -EINVAL;
+			goto errout;
+		}
+	}
+
 	err = fl_set_parms(net, tp, fnew, &mask, base, tb, tca[TCA_RATE], ovr);
 	if (err)
 		goto errout;
 
-	err = fl_check_assign_mask(head, &mask);
-	if (err)
+	m = fl_mask_get(head, &mask);
+	if (IS_ERR(m)) {
+		err = PTR_ERR(m);
 		goto errout;
+	}
+	fnew->mask = m;
 
-	err = rhashtable_insert_fast(&head->ht, &fnew->ht_node,
-				     head->ht_params);
-	if (err)
+	err = fl_hw_replace_filter(tp, fnew);
+	if (err) {
+		fl_mask_put(head, m);
 		goto errout;
-	if (fold)
-		rhashtable_remove_fast(&head->ht, &fold->ht_node,
-				       head->ht_params);
+	}
+
+	if (!tc_skip_sw(fnew->flags)) {
+		err = rhashtable_insert_fast(&m->ht, &fnew->ht_node,
+					     m->ht_params);
+		if (err) {
+			fl_hw_destroy_filter(tp, fnew);
+			fl_mask_put(head, m);
+			goto errout;
+		}
+	}
+	if (fold) {
+		if (!tc_skip_sw(fold->flags))
+			rhashtable_remove_fast(&fold->mask->ht, &fold->ht_node,
+					       fold->mask->ht_params);
+		fl_hw_destroy_filter(tp, fold);
+	}
 
 	*arg = (unsigned long) fnew;
 
 	if (fold) {
 		list_replace_rcu(&fold->list, &fnew->list);
+		fl_mask_put(head, fold->mask);
 		tcf_unbind_filter(tp, &fold->res);
 		call_rcu(&fold->rcu, fl_destroy_filter);
 	} else {
@@ -521,14 +828,7 @@ errout:
 
 static int fl_delete(struct tcf_proto *tp, unsigned long arg)
 {
-	struct cls_fl_head *head = rtnl_dereference(tp->root);
-	struct cls_fl_filter *f = (struct cls_fl_filter *) arg;
-
-	rhashtable_remove_fast(&head->ht, &f->ht_node,
-			       head->ht_params);
-	list_del_rcu(&f->list);
-	tcf_unbind_filter(tp, &f->res);
-	call_rcu(&f->rcu, fl_destroy_filter);
+	__fl_delete(tp, (struct cls_fl_filter *) arg);
 	return 0;
 }
 
@@ -571,7 +871,6 @@ static int fl_dump_key_val(struct sk_buff *skb,
 static int fl_dump(struct net *net, struct tcf_proto *tp, unsigned long fh,
 		   struct sk_buff *skb, struct tcmsg *t)
 {
-	struct cls_fl_head *head = rtnl_dereference(tp->root);
 	struct cls_fl_filter *f = (struct cls_fl_filter *) fh;
 	struct nlattr *nest;
 	struct fl_flow_key *key, *mask;
@@ -590,7 +889,7 @@ static int fl_dump(struct net *net, struct tcf_proto *tp, unsigned long fh,
 		goto nla_put_failure;
 
 	key = &f->key;
-	mask = &head->mask.key;
+	mask = &f->mask->key;
 
 	if (mask->indev_ifindex) {
 		struct net_device *dev;
@@ -651,6 +950,14 @@ static int fl_dump(struct net *net, struct tcf_proto *tp, unsigned long fh,
 				  sizeof(key->tp.dst))))
 		goto nla_put_failure;
 
+	if (nla_put_u64(skb, TCA_FLOWER_MASK_HITS, fl_mask_hits(f->mask)))
+		goto nla_put_failure;
+
+	if (f->flags && nla_put_u32(skb, TCA_FLOWER_FLAGS, f->flags))
+		goto nla_put_failure;
+
+	fl_hw_update_stats(tp, f);
+
 	if (tcf_exts_dump(skb, &f->exts))
 		goto nla_put_failure;
 
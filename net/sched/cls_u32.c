@@ -40,6 +40,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/skbuff.h>
 #include <linux/bitmap.h>
+#include <linux/filter.h>
 #include <net/netlink.h>
 #include <net/act_api.h>
 #include <net/pkt_cls.h>
@@ -64,6 +65,8 @@ struct tc_u_knode {
 	u32 __percpu		*pcpu_success;
 #endif
 	struct tcf_proto	*tp;
+	u32			flags;
+	struct bpf_prog		*prog;	/* the keys, see u32_compile_knode() */
 	struct rcu_head		rcu;
 	/* The 'sel' field MUST be the last field in structure to allow for
 	 * tc_u32_keys allocated at end of structure.
@@ -141,6 +144,23 @@ next_knode:
 		}
 #endif
 
+		/* Compiled keys only hold in the root table */
+		if (n->prog && !sdepth) {
+			r = BPF_PROG_RUN(n->prog, skb);
+			if (r) {
+#ifdef CONFIG_CLS_U32_PERF
+				for (j = 0; j < r - 1; j++)
+					__this_cpu_inc(n->pf->kcnts[j]);
+#endif
+				if (r <= n->sel.nkeys) {
+					n = rcu_dereference_bh(n->next);
+					goto next_knode;
+				}
+				goto keys_matched;
+			}
+			/* some header not linear, walk the keys below */
+		}
+
 		for (i = n->sel.nkeys; i > 0; i--, key++) {
 			int toff = off + key->off + (off2 & key->offmask);
 			__be32 *data, hdata;
@@ -161,6 +181,7 @@ next_knode:
 #endif
 		}
 
+keys_matched:
 		ht = rcu_dereference_bh(n->ht_down);
 		if (!ht) {
 check_terminal:
@@ -358,6 +379,8 @@ static int u32_destroy_key(struct tcf_proto *tp,
 			   bool free_pf)
 {
 	tcf_exts_destroy(&n->exts);
+	if (n->prog)
+		bpf_prog_free(n->prog);
 	if (n->ht_down)
 		n->ht_down->refcnt--;
 #ifdef CONFIG_CLS_U32_PERF
@@ -587,8 +610,77 @@ static const struct nla_policy u32_policy[TCA_U32_MAX + 1] = {
 	[TCA_U32_SEL]		= { .len = sizeof(struct tc_u32_sel) },
 	[TCA_U32_INDEV]		= { .type = NLA_STRING, .len = IFNAMSIZ },
 	[TCA_U32_MARK]		= { .len = sizeof(struct tc_u32_mark) },
+	[TCA_U32_FLAGS]		= { .type = NLA_U32 },
 };
 
+/*
+ * Turn the keys of a root table knode into an eBPF program, JITed where
+ * the JIT is on. In the root table the keys are relative to the network
+ * header and off2 is 0, so they load from SKF_NET_OFF + key->off. The
+ * program returns 1 + the number of leading keys that matched, or 0 when
+ * a header is not in the linear area; u32_classify() then walks the keys
+ * the usual way. Knodes it cannot handle just stay uncompiled.
+ */
+static void u32_compile_knode(struct tcf_proto *tp, struct tc_u_knode *n)
+{
+	struct tc_u32_key *key = n->sel.keys;
+	struct bpf_insn *insn;
+	struct bpf_prog *fp;
+	unsigned int len;
+	int i;
+
+	if (!(n->flags & TCA_U32_FLAGS_COMPILE) ||
+	    rtnl_dereference(n->ht_up) != rtnl_dereference(tp->root))
+		return;
+
+	for (i = 0; i < n->sel.nkeys; i++)
+		if (key[i].offmask || key[i].off < 0 ||
+		    key[i].off > -SKF_NET_OFF - 4)
+			return;
+
+	len = 1 + n->sel.nkeys * 6 + 2;
+	fp = bpf_prog_alloc(bpf_prog_size(len), 0);
+	if (!fp)
+		return;
+
+	insn = fp->insnsi;
+	/* LD_ABS takes the skb from R6 */
+	*insn++ = BPF_MOV64_REG(BPF_REG_6, BPF_REG_1);
+	for (i = 0; i < n->sel.nkeys; i++, key++) {
+		/* loads come back in host order, 0 from a failed one */
+		*insn++ = BPF_LD_ABS(BPF_W, SKF_NET_OFF + key->off);
+		*insn++ = BPF_ALU32_IMM(BPF_XOR, BPF_REG_0, ntohl(key->val));
+		*insn++ = BPF_ALU32_IMM(BPF_AND, BPF_REG_0, ntohl(key->mask));
+		*insn++ = BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2);
+		*insn++ = BPF_MOV32_IMM(BPF_REG_0, 1 + i);
+		*insn++ = BPF_EXIT_INSN();
+	}
+	*insn++ = BPF_MOV32_IMM(BPF_REG_0, 1 + n->sel.nkeys);
+	*insn++ = BPF_EXIT_INSN();
+	fp->len = len;
+
+	if (bpf_prog_select_runtime(fp)) {
+		bpf_prog_free(fp);
+		return;
+	}
+	n->prog = fp;
+}
+
+static int u32_set_flags(struct tc_u_knode *n, struct nlattr **tb)
+{
+	u32 flags;
+
+	if (!tb[TCA_U32_FLAGS])
+		return 0;
+
+	flags = nla_get_u32(tb[TCA_U32_FLAGS]);
+	if (flags & ~TCA_U32_FLAGS_COMPILE)
+		return -EINVAL;
+
+	n->flags = flags;
+	return 0;
+}
+
 static int u32_set_parms(struct net *net, struct tcf_proto *tp,
 			 unsigned long base, struct tc_u_hnode *ht,
 			 struct tc_u_knode *n, struct nlattr **tb,
@@ -715,6 +807,7 @@ static struct tc_u_knode *u32_init_knode(struct tcf_proto *tp,
 	new->pcpu_success = n->pcpu_success;
 #endif
 	new->tp = tp;
+	new->flags = n->flags;
 	memcpy(&new->sel, s, sizeof(*s) + s->nkeys*sizeof(struct tc_u32_key));
 
 	tcf_exts_init(&new->exts, TCA_U32_ACT, TCA_U32_POLICE);
@@ -757,15 +850,18 @@ static int u32_change(struct net *net, struct sk_buff *in_skb,
 		if (!new)
 			return -ENOMEM;
 
-		err = u32_set_parms(net, tp, base,
-				    rtnl_dereference(n->ht_up), new, tb,
-				    tca[TCA_RATE], ovr);
+		err = u32_set_flags(new, tb);
+		if (!err)
+			err = u32_set_parms(net, tp, base,
+					    rtnl_dereference(n->ht_up), new, tb,
+					    tca[TCA_RATE], ovr);
 
 		if (err) {
 			u32_destroy_key(tp, new, false);
 			return err;
 		}
 
+		u32_compile_knode(tp, new);
 		u32_replace_knode(tp, tp_c, new);
 		tcf_unbind_filter(tp, &n->res);
 		call_rcu(&n->rcu, u32_delete_key_rcu);
@@ -832,6 +928,12 @@ static int u32_change(struct net *net, struct sk_buff *in_skb,
 	if (n == NULL)
 		return -ENOBUFS;
 
+	err = u32_set_flags(n, tb);
+	if (err) {
+		kfree(n);
+		return err;
+	}
+
 #ifdef CONFIG_CLS_U32_PERF
 	size = sizeof(struct tc_u32_pcnt) + s->nkeys * sizeof(u64);
 	n->pf = __alloc_percpu(size, __alignof__(struct tc_u32_pcnt));
@@ -869,6 +971,8 @@ static int u32_change(struct net *net, struct sk_buff *in_skb,
 		struct tc_u_knode __rcu **ins;
 		struct tc_u_knode *pins;
 
+		u32_compile_knode(tp, n);
+
 		ins = &ht->ht[TC_U32_HASH(handle)];
 		for (pins = rtnl_dereference(*ins); pins;
 		     ins = &pins->next, pins = rtnl_dereference(*ins))
@@ -1000,6 +1104,11 @@ static int u32_dump(struct net *net, struct tcf_proto *tp, unsigned long fh,
 		}
 #endif
 
+		if (n->flags &&
+		    nla_put_u32(skb, TCA_U32_FLAGS, n->flags |
+				(n->prog ? TCA_U32_FLAGS_COMPILED : 0)))
+			goto nla_put_failure;
+
 		if (tcf_exts_dump(skb, &n->exts) < 0)
 			goto nla_put_failure;
 
@@ -0,0 +1,384 @@
+/*
+ * net/sched/sch_etf.c	Earliest TxTime First queueing discipline.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Packets carry the time they are to be sent at in skb->tstamp, set by
+ * sockets that enabled SO_TXTIME through an SCM_TXTIME cmsg. They are kept
+ * sorted by that time and each is handed to the device @delta ns ahead of
+ * it, which should cover the time the stack and the driver take to put it
+ * on the wire. Packets whose time has already passed are dropped.
+ *
+ * With offload on, the device holds every packet until its txtime by
+ * itself and @delta only has to cover the time the device needs to fetch
+ * it. In deadline mode the txtime is a deadline: packets are sent as soon
+ * as possible, in txtime order.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/rbtree.h>
+#include <linux/skbuff.h>
+#include <linux/posix-timers.h>
+#include <net/netlink.h>
+#include <net/sch_generic.h>
+#include <net/pkt_sched.h>
+#include <net/sock.h>
+
+struct etf_sched_data {
+	bool		offload;
+	bool		deadline_mode;
+	bool		skip_sock_check;
+	int		clockid;
+	int		queue;
+	s32		delta;		/* in ns */
+	ktime_t		last;		/* txtime of the last packet dequeued */
+	struct rb_root	head;
+	struct qdisc_watchdog watchdog;
+	ktime_t		(*get_time)(void);
+	struct tc_etf_xstats stats;
+};
+
+/*
+ * skb->rbnode shares its storage with skb->tstamp, the txtime is kept in
+ * the cb while the packet is queued and put back on dequeue.
+ */
+struct etf_skb_cb {
+	ktime_t		txtime;
+};
+
+static inline struct etf_skb_cb *etf_skb_cb(struct sk_buff *skb)
+{
+	qdisc_cb_private_validate(skb, sizeof(struct etf_skb_cb));
+	return (struct etf_skb_cb *)qdisc_skb_cb(skb)->data;
+}
+
+static inline struct sk_buff *etf_rb_to_skb(struct rb_node *rb)
+{
+	return container_of(rb, struct sk_buff, rbnode);
+}
+
+static const struct nla_policy etf_policy[TCA_ETF_MAX + 1] = {
+	[TCA_ETF_PARMS]	= { .len = sizeof(struct tc_etf_qopt) },
+};
+
+static bool etf_packet_valid(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct sock *sk = skb->sk;
+	ktime_t txtime = skb->tstamp;
+
+	if (q->skip_sock_check)
+		goto skip;
+
+	if (!sk || !sk_fullsock(sk))
+		return false;
+
+	if (!sock_flag(sk, SOCK_TXTIME))
+		return false;
+
+	/* The socket's clock and mode must match the qdisc's, or the txtime
+	 * means something else than what we are going to do with it.
+	 */
+	if (sk->sk_clockid != q->clockid)
+		return false;
+
+	if (sk->sk_txtime_deadline_mode != q->deadline_mode)
+		return false;
+
+skip:
+	if (ktime_before(txtime, q->get_time()) ||
+	    ktime_before(txtime, q->last))
+		return false;
+
+	return true;
+}
+
+static struct sk_buff *etf_peek(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct rb_node *p = rb_first(&q->head);
+
+	return p ? etf_rb_to_skb(p) : NULL;
+}
+
+static void etf_reset_watchdog(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb = etf_peek(sch);
+	ktime_t next;
+
+	if (!skb) {
+		qdisc_watchdog_cancel(&q->watchdog);
+		return;
+	}
+
+	next = ktime_sub_ns(etf_skb_cb(skb)->txtime, q->delta);
+	qdisc_watchdog_schedule_ns(&q->watchdog, ktime_to_ns(next), true);
+}
+
+static int etf_enqueue(struct sk_buff *nskb, struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct rb_node **p = &q->head.rb_node, *parent = NULL;
+	ktime_t txtime = nskb->tstamp;
+
+	if (unlikely(sch->q.qlen >= sch->limit))
+		return qdisc_reshape_fail(nskb, sch);
+
+	if (!etf_packet_valid(sch, nskb)) {
+		q->stats.invalid++;
+		return qdisc_drop(nskb, sch);
+	}
+
+	while (*p) {
+		struct sk_buff *skb;
+
+		parent = *p;
+		skb = etf_rb_to_skb(parent);
+		if (ktime_compare(txtime, etf_skb_cb(skb)->txtime) >= 0)
+			p = &parent->rb_right;
+		else
+			p = &parent->rb_left;
+	}
+	etf_skb_cb(nskb)->txtime = txtime;
+	rb_link_node(&nskb->rbnode, parent, p);
+	rb_insert_color(&nskb->rbnode, &q->head);
+
+	qdisc_qstats_backlog_inc(sch, nskb);
+	sch->q.qlen++;
+
+	/* the new packet may be the first one now */
+	etf_reset_watchdog(sch);
+
+	return NET_XMIT_SUCCESS;
+}
+
+static void etf_erase(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	rb_erase(&skb->rbnode, &q->head);
+	skb->next = NULL;
+	skb->prev = NULL;
+	skb->tstamp = etf_skb_cb(skb)->txtime;
+
+	qdisc_qstats_backlog_dec(sch, skb);
+	sch->q.qlen--;
+}
+
+static struct sk_buff *etf_dequeue(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	unsigned int dropped = 0, dropped_len = 0;
+	struct sk_buff *skb;
+	ktime_t now;
+
+	now = q->get_time();
+	while ((skb = etf_peek(sch)) &&
+	       ktime_before(etf_skb_cb(skb)->txtime, now)) {
+		etf_erase(sch, skb);
+		dropped++;
+		dropped_len += qdisc_pkt_len(skb);
+		q->stats.late++;
+		qdisc_drop(skb, sch);
+	}
+	if (dropped)
+		qdisc_tree_reduce_backlog(sch, dropped, dropped_len);
+
+	if (!skb)
+		goto out;
+
+	if (!q->deadline_mode &&
+	    ktime_after(ktime_sub_ns(etf_skb_cb(skb)->txtime, q->delta), now)) {
+		skb = NULL;
+		goto out;
+	}
+
+	etf_erase(sch, skb);
+	q->last = skb->tstamp;
+	qdisc_bstats_update(sch, skb);
+	qdisc_unthrottled(sch);
+out:
+	etf_reset_watchdog(sch);
+	return skb;
+}
+
+static int etf_enable_offload(struct net_device *dev,
+			      struct etf_sched_data *q, bool enable)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+
+	if (!ops->ndo_setup_launchtime)
+		return -EOPNOTSUPP;
+
+	return ops->ndo_setup_launchtime(dev, q->queue, enable);
+}
+
+static int etf_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	struct nlattr *tb[TCA_ETF_MAX + 1];
+	struct tc_etf_qopt *qopt;
+	int err;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_ETF_MAX, opt, etf_policy);
+	if (err < 0)
+		return err;
+
+	if (!tb[TCA_ETF_PARMS])
+		return -EINVAL;
+
+	qopt = nla_data(tb[TCA_ETF_PARMS]);
+	if (qopt->flags & ~(TC_ETF_DEADLINE_MODE_ON | TC_ETF_OFFLOAD_ON |
+			    TC_ETF_SKIP_SOCK_CHECK))
+		return -EINVAL;
+
+	switch (qopt->clockid) {
+	case CLOCK_MONOTONIC:
+		q->get_time = ktime_get;
+		break;
+	case CLOCK_REALTIME:
+		q->get_time = ktime_get_real;
+		break;
+	case CLOCK_BOOTTIME:
+		q->get_time = ktime_get_boottime;
+		break;
+	case CLOCK_TAI:
+		q->get_time = ktime_get_clocktai;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	q->clockid = qopt->clockid;
+	q->delta = qopt->delta;
+	q->deadline_mode = !!(qopt->flags & TC_ETF_DEADLINE_MODE_ON);
+	q->skip_sock_check = !!(qopt->flags & TC_ETF_SKIP_SOCK_CHECK);
+	q->queue = sch->dev_queue - netdev_get_tx_queue(dev, 0);
+	q->head = RB_ROOT;
+	q->last = ktime_set(0, 0);
+	sch->limit = qdisc_dev(sch)->tx_queue_len ? : 1;
+
+	if (qopt->flags & TC_ETF_OFFLOAD_ON) {
+		/* launch time is per hardware queue, under mq or mqprio */
+		if (sch->parent == TC_H_ROOT)
+			return -EOPNOTSUPP;
+		err = etf_enable_offload(dev, q, true);
+		if (err < 0)
+			return err;
+		q->offload = true;
+	}
+
+	qdisc_watchdog_init_clockid(&q->watchdog, sch, q->clockid);
+
+	return 0;
+}
+
+static void etf_purge(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct rb_node *p = rb_first(&q->head);
+
+	while (p) {
+		struct sk_buff *skb = etf_rb_to_skb(p);
+
+		p = rb_next(p);
+		rb_erase(&skb->rbnode, &q->head);
+		kfree_skb(skb);
+	}
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+}
+
+static void etf_reset(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+	etf_purge(sch);
+	q->last = ktime_set(0, 0);
+}
+
+static void etf_destroy(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+	etf_purge(sch);
+
+	if (q->offload)
+		etf_enable_offload(qdisc_dev(sch), q, false);
+}
+
+static int etf_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct tc_etf_qopt opt = { };
+	struct nlattr *nest;
+
+	nest = nla_nest_start(skb, TCA_OPTIONS);
+	if (!nest)
+		goto nla_put_failure;
+
+	opt.delta = q->delta;
+	opt.clockid = q->clockid;
+	if (q->offload)
+		opt.flags |= TC_ETF_OFFLOAD_ON;
+	if (q->deadline_mode)
+		opt.flags |= TC_ETF_DEADLINE_MODE_ON;
+	if (q->skip_sock_check)
+		opt.flags |= TC_ETF_SKIP_SOCK_CHECK;
+
+	if (nla_put(skb, TCA_ETF_PARMS, sizeof(opt), &opt))
+		goto nla_put_failure;
+
+	return nla_nest_end(skb, nest);
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+static int etf_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	return gnet_stats_copy_app(d, &q->stats, sizeof(q->stats));
+}
+
+static struct Qdisc_ops etf_qdisc_ops __read_mostly = {
+	.id		=	"etf",
+	.priv_size	=	sizeof(struct etf_sched_data),
+	.enqueue	=	etf_enqueue,
+	.dequeue	=	etf_dequeue,
+	.peek		=	etf_peek,
+	.init		=	etf_init,
+	.reset		=	etf_reset,
+	.destroy	=	etf_destroy,
+	.dump		=	etf_dump,
+	.dump_stats	=	etf_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init etf_module_init(void)
+{
+	return register_qdisc(&etf_qdisc_ops);
+}
+
+static void __exit etf_module_exit(void)
+{
+	unregister_qdisc(&etf_qdisc_ops);
+}
+module_init(etf_module_init)
+module_exit(etf_module_exit)
+MODULE_LICENSE("GPL");
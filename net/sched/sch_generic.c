@@ -26,6 +26,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/if_vlan.h>
+#include <linux/ptr_ring.h>
 #include <net/sch_generic.h>
 #include <net/pkt_sched.h>
 #include <net/dst.h>
@@ -43,18 +44,38 @@ EXPORT_SYMBOL(default_qdisc_ops);
  * - enqueue, dequeue are serialized via qdisc root lock
  * - ingress filtering is also serialized via qdisc root lock
  * - updates to tree and tree walking are only done under the rtnl mutex.
+ *
+ * TCQ_F_NOLOCK root qdiscs do their own serialization of enqueue; dequeue
+ * is serialized by __QDISC_STATE_RUNNING alone, and q->gso_skb belongs to
+ * the CPU holding it.
  */
 
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
 	q->gso_skb = skb;
-	q->qstats.requeues++;
-	q->q.qlen++;	/* it's still part of the queue */
+	if (q->flags & TCQ_F_NOLOCK) {
+		qdisc_qstats_cpu_requeues_inc(q);
+		qdisc_qstats_cpu_qlen_inc(q);
+	} else {
+		q->qstats.requeues++;
+		q->q.qlen++;	/* it's still part of the queue */
+	}
 	__netif_schedule(q);
 
 	return 0;
 }
 
+/*
+ * What the runner reports back as the queue length. A TCQ_F_NOLOCK qdisc
+ * can't tell without summing up every CPU, so let the next dequeue find out.
+ */
+static inline int qdisc_restart_qlen(const struct Qdisc *q)
+{
+	if (q->flags & TCQ_F_NOLOCK)
+		return 1;
+	return qdisc_qlen(q);
+}
+
 static void try_bulk_dequeue_skb(struct Qdisc *q,
 				 struct sk_buff *skb,
 				 const struct netdev_queue *txq,
@@ -92,7 +113,10 @@ static struct sk_buff *dequeue_skb(struct Qdisc *q, bool *validate,
 		txq = skb_get_tx_queue(txq->dev, skb);
 		if (!netif_xmit_frozen_or_stopped(txq)) {
 			q->gso_skb = NULL;
-			q->q.qlen--;
+			if (q->flags & TCQ_F_NOLOCK)
+				qdisc_qstats_cpu_qlen_dec(q);
+			else
+				q->q.qlen--;
 		} else
 			skb = NULL;
 		/* skb in gso_skb were already validated */
@@ -124,7 +148,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		kfree_skb_list(skb);
 		net_warn_ratelimited("Dead loop on netdevice %s, fix it urgently!\n",
 				     dev_queue->dev->name);
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else {
 		/*
 		 * Another cpu is holding lock, requeue & delay xmits for
@@ -140,7 +164,8 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 /*
  * Transmit possibly several skbs, and handle the return status as
  * required. Holding the __QDISC___STATE_RUNNING bit guarantees that
- * only one CPU can execute this function.
+ * only one CPU can execute this function. @root_lock is NULL for
+ * TCQ_F_NOLOCK qdiscs.
  *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
@@ -153,7 +178,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 	int ret = NETDEV_TX_BUSY;
 
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (root_lock)
+		spin_unlock(root_lock);
 
 	/* Note that we validate skb (GSO, checksum, ...) outside of locks */
 	if (validate)
@@ -166,14 +192,16 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 
 		HARD_TX_UNLOCK(dev, txq);
 	} else {
-		spin_lock(root_lock);
-		return qdisc_qlen(q);
+		if (root_lock)
+			spin_lock(root_lock);
+		return qdisc_restart_qlen(q);
 	}
-	spin_lock(root_lock);
+	if (root_lock)
+		spin_lock(root_lock);
 
 	if (dev_xmit_complete(ret)) {
 		/* Driver sent out skb successfully or skb was consumed */
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
 		ret = handle_dev_cpu_collision(skb, txq, q);
@@ -193,7 +221,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH, or with
+ * just BH disabled for TCQ_F_NOLOCK qdiscs.
  *
  * __QDISC___STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -224,7 +253,7 @@ static inline int qdisc_restart(struct Qdisc *q, int *packets)
 	if (unlikely(!skb))
 		return 0;
 
-	root_lock = qdisc_lock(q);
+	root_lock = (q->flags & TCQ_F_NOLOCK) ? NULL : qdisc_lock(q);
 	dev = qdisc_dev(q);
 	txq = skb_get_tx_queue(dev, skb);
 
@@ -236,6 +265,12 @@ void __qdisc_run(struct Qdisc *q)
 	int quota = weight_p;
 	int packets;
 
+	if (q->flags & TCQ_F_NOLOCK) {
+		/* whatever is queued before this shows up below */
+		clear_bit(__QDISC_STATE_MISSED, &q->state);
+		smp_mb__after_atomic();
+	}
+
 	while (qdisc_restart(q, &packets)) {
 		/*
 		 * Ordered by possible occurrence: Postpone processing if
@@ -450,85 +485,128 @@ static const u8 prio2band[TC_PRIO_MAX + 1] = {
 
 /*
  * Private data for a pfifo_fast scheduler containing:
- * 	- queues for the three band
- * 	- bitmap indicating which of the bands contain skbs
+ * 	- a ring per band, so that at the root of a transmit queue the
+ * 	  qdisc can run without its lock (TCQ_F_NOLOCK)
+ * 	- the number of packets in all bands, which together may hold
+ * 	  tx_queue_len packets as the skb lists they replace did
  */
 struct pfifo_fast_priv {
-	u32 bitmap;
-	struct sk_buff_head q[PFIFO_FAST_BANDS];
+	struct ptr_ring q[PFIFO_FAST_BANDS];
+	atomic_t qlen;
 };
 
-/*
- * Convert a bitmap to the first band number where an skb is queued, where:
- * 	bitmap=0 means there are no skbs on any band.
- * 	bitmap=1 means there is an skb on band 0.
- *	bitmap=7 means there are skbs on all 3 bands, etc.
- */
-static const int bitmap2band[] = {-1, 0, 1, 0, 2, 0, 1, 0};
-
-static inline struct sk_buff_head *band2list(struct pfifo_fast_priv *priv,
-					     int band)
+static inline struct ptr_ring *band2list(struct pfifo_fast_priv *priv,
+					 int band)
 {
 	return priv->q + band;
 }
 
 static int pfifo_fast_enqueue(struct sk_buff *skb, struct Qdisc *qdisc)
 {
-	if (skb_queue_len(&qdisc->q) < qdisc_dev(qdisc)->tx_queue_len) {
-		int band = prio2band[skb->priority & TC_PRIO_MAX];
-		struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-		struct sk_buff_head *list = band2list(priv, band);
+	int band = prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct ptr_ring *list = band2list(priv, band);
+
+	if (unlikely(atomic_inc_return(&priv->qlen) >
+		     qdisc_dev(qdisc)->tx_queue_len))
+		goto drop;
 
-		priv->bitmap |= (1 << band);
+	/* account first, the skb is the dequeuer's once it is in the ring */
+	if (qdisc_is_percpu_stats(qdisc)) {
+		qdisc_qstats_cpu_backlog_inc(qdisc, skb);
+		qdisc_qstats_cpu_qlen_inc(qdisc);
+	} else {
+		qdisc_qstats_backlog_inc(qdisc, skb);
 		qdisc->q.qlen++;
-		return __qdisc_enqueue_tail(skb, qdisc, list);
 	}
 
+	if (likely(!ptr_ring_produce(list, skb)))
+		return NET_XMIT_SUCCESS;
+
+	if (qdisc_is_percpu_stats(qdisc)) {
+		qdisc_qstats_cpu_backlog_dec(qdisc, skb);
+		qdisc_qstats_cpu_qlen_dec(qdisc);
+	} else {
+		qdisc_qstats_backlog_dec(qdisc, skb);
+		qdisc->q.qlen--;
+	}
+drop:
+	atomic_dec(&priv->qlen);
+	if (qdisc_is_percpu_stats(qdisc)) {
+		qdisc_qstats_cpu_drop(qdisc);
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
+	}
 	return qdisc_drop(skb, qdisc);
 }
 
 static struct sk_buff *pfifo_fast_dequeue(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
+	struct sk_buff *skb = NULL;
+	int band;
 
-	if (likely(band >= 0)) {
-		struct sk_buff_head *list = band2list(priv, band);
-		struct sk_buff *skb = __qdisc_dequeue_head(qdisc, list);
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++) {
+		struct ptr_ring *list = band2list(priv, band);
 
-		qdisc->q.qlen--;
-		if (skb_queue_empty(list))
-			priv->bitmap &= ~(1 << band);
+		if (__ptr_ring_empty(list))
+			continue;
+		skb = ptr_ring_consume(list);
+	}
 
-		return skb;
+	if (likely(skb)) {
+		atomic_dec(&priv->qlen);
+		if (qdisc_is_percpu_stats(qdisc)) {
+			qdisc_qstats_cpu_backlog_dec(qdisc, skb);
+			qdisc_bstats_cpu_update(qdisc, skb);
+			qdisc_qstats_cpu_qlen_dec(qdisc);
+		} else {
+			qdisc_qstats_backlog_dec(qdisc, skb);
+			qdisc_bstats_update(qdisc, skb);
+			qdisc->q.qlen--;
+		}
 	}
 
-	return NULL;
+	return skb;
 }
 
+/* The dequeuer is alone: under the qdisc lock or holding the runner bit */
 static struct sk_buff *pfifo_fast_peek(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
+	struct sk_buff *skb = NULL;
+	int band;
 
-	if (band >= 0) {
-		struct sk_buff_head *list = band2list(priv, band);
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++)
+		skb = __ptr_ring_peek(band2list(priv, band));
 
-		return skb_peek(list);
-	}
-
-	return NULL;
+	return skb;
 }
 
 static void pfifo_fast_reset(struct Qdisc *qdisc)
 {
-	int prio;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band, i;
+
+	/* no runner is left, see dev_deactivate_many() */
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		struct ptr_ring *list = band2list(priv, band);
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__qdisc_reset_queue(qdisc, band2list(priv, prio));
+		while ((skb = __ptr_ring_consume(list)) != NULL)
+			kfree_skb(skb);
+	}
+	atomic_set(&priv->qlen, 0);
 
-	priv->bitmap = 0;
+	if (qdisc_is_percpu_stats(qdisc)) {
+		for_each_possible_cpu(i) {
+			struct gnet_stats_queue *q;
+
+			q = per_cpu_ptr(qdisc->cpu_qstats, i);
+			q->backlog = 0;
+			q->qlen = 0;
+		}
+	}
 	qdisc->qstats.backlog = 0;
 	qdisc->q.qlen = 0;
 }
@@ -546,19 +624,53 @@ nla_put_failure:
 	return -1;
 }
 
+static void pfifo_fast_destroy(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		ptr_ring_cleanup(band2list(priv, band), NULL);
+}
+
 static int pfifo_fast_init(struct Qdisc *qdisc, struct nlattr *opt)
 {
-	int prio;
+	unsigned int qlen = qdisc_dev(qdisc)->tx_queue_len;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int band, err;
+
+	/* any band may have to hold all of tx_queue_len */
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		err = ptr_ring_init(band2list(priv, band), qlen, GFP_KERNEL);
+		if (err) {
+			pfifo_fast_destroy(qdisc);
+			return err;
+		}
+	}
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__skb_queue_head_init(band2list(priv, prio));
+	atomic_set(&priv->qlen, 0);
 
 	/* Can by-pass the queue discipline */
 	qdisc->flags |= TCQ_F_CAN_BYPASS;
 	return 0;
 }
 
+static int pfifo_fast_change_tx_queue_len(struct Qdisc *qdisc,
+					  unsigned int new_len)
+{
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int band, err;
+
+	/* dev_deactivate() has emptied the rings, nothing to destroy */
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		err = ptr_ring_resize(band2list(priv, band), new_len,
+				      GFP_KERNEL, NULL);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 	.id		=	"pfifo_fast",
 	.priv_size	=	sizeof(struct pfifo_fast_priv),
@@ -566,8 +678,11 @@ struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 	.dequeue	=	pfifo_fast_dequeue,
 	.peek		=	pfifo_fast_peek,
 	.init		=	pfifo_fast_init,
+	.destroy	=	pfifo_fast_destroy,
 	.reset		=	pfifo_fast_reset,
 	.dump		=	pfifo_fast_dump,
+	.change_tx_queue_len =	pfifo_fast_change_tx_queue_len,
+	.root_flags	=	TCQ_F_NOLOCK,
 	.owner		=	THIS_MODULE,
 };
 
@@ -657,6 +772,78 @@ void qdisc_reset(struct Qdisc *qdisc)
 }
 EXPORT_SYMBOL(qdisc_reset);
 
+/**
+ * qdisc_root_nolock - let a new transmit queue root run without its lock
+ * @qdisc: qdisc about to be attached to a transmit queue
+ *
+ * Switches qdiscs that support it (Qdisc_ops.root_flags) to TCQ_F_NOLOCK
+ * and per-CPU statistics. Only a root qualifies, classful parents read the
+ * q.qlen of their children under their own lock. On allocation failure, or
+ * if @qdisc is already in use, it just stays as it is.
+ */
+void qdisc_root_nolock(struct Qdisc *qdisc)
+{
+	if (!(qdisc->ops->root_flags & TCQ_F_NOLOCK) ||
+	    qdisc->flags & (TCQ_F_NOLOCK | TCQ_F_CPUSTATS))
+		return;
+
+	/* an estimator keeps reading the plain counters */
+	if (qdisc->q.qlen || qdisc->gso_skb ||
+	    gen_estimator_active(&qdisc->bstats, &qdisc->rate_est))
+		return;
+
+	qdisc->cpu_bstats = netdev_alloc_pcpu_stats(struct gnet_stats_basic_cpu);
+	qdisc->cpu_qstats = alloc_percpu(struct gnet_stats_queue);
+	if (!qdisc->cpu_bstats || !qdisc->cpu_qstats) {
+		free_percpu(qdisc->cpu_bstats);
+		free_percpu(qdisc->cpu_qstats);
+		qdisc->cpu_bstats = NULL;
+		qdisc->cpu_qstats = NULL;
+		return;
+	}
+
+	qdisc->flags |= TCQ_F_NOLOCK | TCQ_F_CPUSTATS;
+}
+EXPORT_SYMBOL(qdisc_root_nolock);
+
+/**
+ * qdisc_stats_add - add up the statistics of a qdisc
+ * @qdisc: qdisc to read, per-CPU statistics or not
+ * @bstats: basic statistics to add to
+ * @qstats: queue statistics to add to, except for qlen
+ *
+ * Used by qdiscs reporting for the ones at their transmit queues, which
+ * may be TCQ_F_NOLOCK; see qdisc_qlen_sum() for the queue length.
+ */
+void qdisc_stats_add(const struct Qdisc *qdisc,
+		     struct gnet_stats_basic_packed *bstats,
+		     struct gnet_stats_queue *qstats)
+{
+	int i;
+
+	if (!qdisc_is_percpu_stats(qdisc)) {
+		bstats->bytes += qdisc->bstats.bytes;
+		bstats->packets += qdisc->bstats.packets;
+		qstats->backlog += qdisc->qstats.backlog;
+		qstats->drops += qdisc->qstats.drops;
+		qstats->requeues += qdisc->qstats.requeues;
+		qstats->overlimits += qdisc->qstats.overlimits;
+		return;
+	}
+
+	__gnet_stats_copy_basic(bstats, qdisc->cpu_bstats, NULL);
+	for_each_possible_cpu(i) {
+		const struct gnet_stats_queue *q;
+
+		q = per_cpu_ptr(qdisc->cpu_qstats, i);
+		qstats->backlog += q->backlog;
+		qstats->drops += q->drops;
+		qstats->requeues += q->requeues;
+		qstats->overlimits += q->overlimits;
+	}
+}
+EXPORT_SYMBOL(qdisc_stats_add);
+
 static void qdisc_rcu_free(struct rcu_head *head)
 {
 	struct Qdisc *qdisc = container_of(head, struct Qdisc, rcu_head);
@@ -743,6 +930,7 @@ static void attach_one_default_qdisc(struct net_device *dev,
 	}
 	if (!netif_is_multiqueue(dev))
 		qdisc->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+	qdisc_root_nolock(qdisc);
 	dev_queue->qdisc_sleeping = qdisc;
 }
 
@@ -827,12 +1015,27 @@ static void dev_deactivate_queue(struct net_device *dev,
 			set_bit(__QDISC_STATE_DEACTIVATED, &qdisc->state);
 
 		rcu_assign_pointer(dev_queue->qdisc, qdisc_default);
-		qdisc_reset(qdisc);
+		/* a lockless runner may still be at it, see below */
+		if (!(qdisc->flags & TCQ_F_NOLOCK))
+			qdisc_reset(qdisc);
 
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 }
 
+static void dev_reset_nolock_queue(struct net_device *dev,
+				   struct netdev_queue *dev_queue,
+				   void *_unused)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_lock_bh(qdisc_lock(qdisc));
+		qdisc_reset(qdisc);
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+}
+
 static bool some_qdisc_is_busy(struct net_device *dev)
 {
 	unsigned int i;
@@ -891,9 +1094,11 @@ void dev_deactivate_many(struct list_head *head)
 		synchronize_net();
 
 	/* Wait for outstanding qdisc_run calls. */
-	list_for_each_entry(dev, head, close_list)
+	list_for_each_entry(dev, head, close_list) {
 		while (some_qdisc_is_busy(dev))
 			yield();
+		netdev_for_each_tx_queue(dev, dev_reset_nolock_queue, NULL);
+	}
 }
 
 void dev_deactivate(struct net_device *dev)
@@ -906,6 +1111,42 @@ void dev_deactivate(struct net_device *dev)
 }
 EXPORT_SYMBOL(dev_deactivate);
 
+static int qdisc_change_tx_queue_len(struct net_device *dev,
+				     struct netdev_queue *dev_queue)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+	const struct Qdisc_ops *ops = qdisc->ops;
+
+	if (ops->change_tx_queue_len)
+		return ops->change_tx_queue_len(qdisc, dev->tx_queue_len);
+	return 0;
+}
+
+/*
+ * Let the default qdiscs of @dev follow a new dev->tx_queue_len.  Called
+ * under rtnl; the device is deactivated meanwhile, so the qdiscs are empty
+ * and nobody runs them.
+ */
+int dev_qdisc_change_tx_queue_len(struct net_device *dev)
+{
+	bool up = dev->flags & IFF_UP;
+	unsigned int i;
+	int ret = 0;
+
+	if (up)
+		dev_deactivate(dev);
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		ret = qdisc_change_tx_queue_len(dev, &dev->_tx[i]);
+		if (ret)
+			break;
+	}
+
+	if (up)
+		dev_activate(dev);
+	return ret;
+}
+
 static void dev_init_scheduler_queue(struct net_device *dev,
 				     struct netdev_queue *dev_queue,
 				     void *_qdisc)
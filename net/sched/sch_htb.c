@@ -37,6 +37,8 @@
 #include <linux/rbtree.h>
 #include <linux/workqueue.h>
 #include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/atomic.h>
 #include <net/netlink.h>
 #include <net/sch_generic.h>
 #include <net/pkt_sched.h>
@@ -69,6 +71,33 @@ static int htb_rate_est = 0; /* htb classes have a default rate estimator */
 module_param(htb_rate_est, int, 0640);
 MODULE_PARM_DESC(htb_rate_est, "setup a default rate estimator (4sec 16sec) for htb classes");
 
+/*
+ * Shared mode (TCA_HTB_SHARED): with an htb qdisc at each transmit queue
+ * of an mq root, the classes of the same minor in all of them enforce one
+ * set of rates. Each queue dequeues and shapes on its own, under its own
+ * lock, but the classes draw their tokens, in batches, from pools they
+ * share; the pools get refilled with time instead of the classes.
+ */
+#define HTB_SHARED_BATCH	(64 * 1024)	/* bytes drawn at once */
+
+struct htb_shared_class {
+	/* tokens in ns, as for htb_class; go negative only by a batch */
+	atomic64_t		tokens ____cacheline_aligned_in_smp;
+	atomic64_t		ctokens;
+	atomic64_t		t_c;		/* last refill */
+	s64			buffer, cbuffer;
+
+	/* the rest is under RTNL */
+	struct hlist_node	hnode ____cacheline_aligned_in_smp;
+	struct net_device	*dev;
+	u32			major;		/* handle of the mq root */
+	u32			minor;
+	int			refcnt;
+	struct list_head	members;	/* htb_class.shared_list */
+};
+
+static DEFINE_HASHTABLE(htb_shared_hash, 6);
+
 /* used internaly to keep status of single class */
 enum htb_cmode {
 	HTB_CANT_SEND,		/* class can't send and can't borrow */
@@ -103,6 +132,12 @@ struct htb_class {
 	u32			prio;		/* these two are used only by leaves... */
 	int			quantum;	/* but stored for parent-to-leaf return */
 
+	/* TCA_HTB_SHARED only */
+	struct htb_shared_class	*shared;
+	struct list_head	shared_list;
+	struct Qdisc		*sch;
+	s64			batch, cbatch;	/* drawn from the pools at once */
+
 	struct tcf_proto __rcu	*filter_list;	/* class attached filters */
 	int			filter_cnt;
 	int			refcnt;		/* usage count of this class */
@@ -151,6 +186,7 @@ struct htb_sched {
 	struct Qdisc_class_hash clhash;
 	int			defcls;		/* class where unclassified flows go to */
 	int			rate2quantum;	/* quant = rate / rate2quantum */
+	bool			shared;		/* TCA_HTB_SHARED */
 
 	/* filters for qdisc itself */
 	struct tcf_proto __rcu	*filter_list;
@@ -605,6 +641,67 @@ static int htb_enqueue(struct sk_buff *skb, struct Qdisc *sch)
 	return NET_XMIT_SUCCESS;
 }
 
+static void htb_shared_add(atomic64_t *v, s64 diff, s64 max)
+{
+	s64 old, new;
+
+	do {
+		old = atomic64_read(v);
+		if (old >= max)
+			return;
+		new = min(old + diff, max);
+	} while (atomic64_cmpxchg(v, old, new) != old);
+}
+
+/* Takes what there is of @want, or nothing if the pool is in debt */
+static s64 htb_shared_take(atomic64_t *v, s64 want)
+{
+	s64 old, take;
+
+	do {
+		old = atomic64_read(v);
+		if (old <= 0)
+			return 0;
+		take = min(old, want);
+	} while (atomic64_cmpxchg(v, old, old - take) != old);
+
+	return take;
+}
+
+/*
+ * Tops up the tokens of a shared class from the pools, refilling those
+ * first, and returns the time difference the caller should credit on top,
+ * which is none: shared classes are never refilled with time themselves.
+ */
+static s64 htb_shared_fill(struct htb_class *cl, s64 now)
+{
+	struct htb_shared_class *sh = cl->shared;
+	s64 last = atomic64_read(&sh->t_c);
+
+	if (now > last && atomic64_cmpxchg(&sh->t_c, last, now) == last) {
+		s64 diff = min_t(s64, now - last, cl->mbuffer);
+
+		htb_shared_add(&sh->tokens, diff, READ_ONCE(sh->buffer));
+		htb_shared_add(&sh->ctokens, diff, READ_ONCE(sh->cbuffer));
+	}
+
+	if (cl->tokens < cl->batch)
+		cl->tokens += htb_shared_take(&sh->tokens,
+					      cl->batch - cl->tokens);
+	if (cl->ctokens < cl->cbatch)
+		cl->ctokens += htb_shared_take(&sh->ctokens,
+					       cl->cbatch - cl->ctokens);
+	return 0;
+}
+
+/* Time since @cl was last charged, to be credited to its tokens */
+static inline s64 htb_class_diff(struct htb_sched *q, struct htb_class *cl)
+{
+	if (cl->shared)
+		return htb_shared_fill(cl, q->now);
+	return min_t(s64, q->now - cl->t_c, cl->mbuffer);
+}
+
 static inline void htb_accnt_tokens(struct htb_class *cl, int bytes, s64 diff)
 {
 	s64 toks = diff + cl->tokens;
@@ -650,7 +747,7 @@ static void htb_charge_class(struct htb_sched *q, struct htb_class *cl,
 	s64 diff;
 
 	while (cl) {
-		diff = min_t(s64, q->now - cl->t_c, cl->mbuffer);
+		diff = htb_class_diff(q, cl);
 		if (cl->level >= level) {
 			if (cl->level == level)
 				cl->xstats.lends++;
@@ -710,7 +807,7 @@ static s64 htb_do_events(struct htb_sched *q, const int level,
 			return cl->pq_key;
 
 		htb_safe_rb_erase(p, wait_pq);
-		diff = min_t(s64, q->now - cl->t_c, cl->mbuffer);
+		diff = htb_class_diff(q, cl);
 		htb_change_class_mode(q, cl, &diff);
 		if (cl->cmode != HTB_CAN_SEND)
 			htb_add_to_wait_tree(q, cl, diff);
@@ -1007,6 +1104,7 @@ static const struct nla_policy htb_policy[TCA_HTB_MAX + 1] = {
 	[TCA_HTB_DIRECT_QLEN] = { .type = NLA_U32 },
 	[TCA_HTB_RATE64] = { .type = NLA_U64 },
 	[TCA_HTB_CEIL64] = { .type = NLA_U64 },
+	[TCA_HTB_SHARED] = { .type = NLA_FLAG },
 };
 
 static void htb_work_func(struct work_struct *work)
@@ -1058,6 +1156,18 @@ static int htb_init(struct Qdisc *sch, struct nlattr *opt)
 		q->rate2quantum = 1;
 	q->defcls = gopt->defcls;
 
+	if (tb[TCA_HTB_SHARED]) {
+		struct Qdisc *root;
+
+		/* one htb per transmit queue, see htb_shared_class */
+		root = qdisc_lookup(qdisc_dev(sch), TC_H_MAJ(sch->parent));
+		if (!root || !(root->flags & TCQ_F_MQROOT)) {
+			qdisc_class_hash_destroy(&q->clhash);
+			return -EOPNOTSUPP;
+		}
+		q->shared = true;
+	}
+
 	return 0;
 }
 
@@ -1083,6 +1193,8 @@ static int htb_dump(struct Qdisc *sch, struct sk_buff *skb)
 	if (nla_put(skb, TCA_HTB_INIT, sizeof(gopt), &gopt) ||
 	    nla_put_u32(skb, TCA_HTB_DIRECT_QLEN, q->direct_qlen))
 		goto nla_put_failure;
+	if (q->shared && nla_put_flag(skb, TCA_HTB_SHARED))
+		goto nla_put_failure;
 
 	return nla_nest_end(skb, nest);
 
@@ -1135,12 +1247,56 @@ nla_put_failure:
 	return -1;
 }
 
+/*
+ * A shared class reports for itself at all the queues, what's left in the
+ * pools included. The other queues' counters are read without their locks.
+ */
+static int htb_dump_shared_class_stats(struct htb_class *cl,
+				       struct gnet_dump *d)
+{
+	struct htb_shared_class *sh = cl->shared;
+	struct gnet_stats_basic_packed bstats = { 0 };
+	struct gnet_stats_queue qstats = { 0 };
+	struct tc_htb_xstats xstats = { 0 };
+	struct htb_class *m;
+	s64 tokens, ctokens;
+	__u32 qlen = 0;
+
+	tokens = atomic64_read(&sh->tokens);
+	ctokens = atomic64_read(&sh->ctokens);
+	list_for_each_entry(m, &sh->members, shared_list) {
+		if (!m->level && m->un.leaf.q)
+			qlen += READ_ONCE(m->un.leaf.q->q.qlen);
+		bstats.bytes += READ_ONCE(m->bstats.bytes);
+		bstats.packets += READ_ONCE(m->bstats.packets);
+		qstats.drops += READ_ONCE(m->qstats.drops);
+		qstats.overlimits += READ_ONCE(m->qstats.overlimits);
+		xstats.lends += READ_ONCE(m->xstats.lends);
+		xstats.borrows += READ_ONCE(m->xstats.borrows);
+		xstats.giants += READ_ONCE(m->xstats.giants);
+		tokens += READ_ONCE(m->tokens);
+		ctokens += READ_ONCE(m->ctokens);
+	}
+	xstats.tokens = PSCHED_NS2TICKS(tokens);
+	xstats.ctokens = PSCHED_NS2TICKS(ctokens);
+
+	if (gnet_stats_copy_basic(d, NULL, &bstats) < 0 ||
+	    gnet_stats_copy_rate_est(d, NULL, &cl->rate_est) < 0 ||
+	    gnet_stats_copy_queue(d, NULL, &qstats, qlen) < 0)
+		return -1;
+
+	return gnet_stats_copy_app(d, &xstats, sizeof(xstats));
+}
+
 static int
 htb_dump_class_stats(struct Qdisc *sch, unsigned long arg, struct gnet_dump *d)
 {
 	struct htb_class *cl = (struct htb_class *)arg;
 	__u32 qlen = 0;
 
+	if (cl->shared)
+		return htb_dump_shared_class_stats(cl, d);
+
 	if (!cl->level && cl->un.leaf.q)
 		qlen = cl->un.leaf.q->q.qlen;
 	cl->xstats.tokens = PSCHED_NS2TICKS(cl->tokens);
@@ -1218,18 +1374,91 @@ static void htb_parent_to_leaf(struct htb_sched *q, struct htb_class *cl,
 	memset(&parent->un.inner, 0, sizeof(parent->un.inner));
 	INIT_LIST_HEAD(&parent->un.leaf.drop_list);
 	parent->un.leaf.q = new_q ? new_q : &noop_qdisc;
-	parent->tokens = parent->buffer;
-	parent->ctokens = parent->cbuffer;
+	parent->tokens = parent->shared ? 0 : parent->buffer;
+	parent->ctokens = parent->shared ? 0 : parent->cbuffer;
 	parent->t_c = ktime_get_ns();
 	parent->cmode = HTB_CAN_SEND;
 }
 
+static struct htb_shared_class *htb_shared_get(struct Qdisc *sch, u32 classid)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	u32 major = TC_H_MAJ(sch->parent);
+	u32 minor = TC_H_MIN(classid);
+	struct htb_shared_class *sh;
+
+	ASSERT_RTNL();
+	hash_for_each_possible(htb_shared_hash, sh, hnode, major | minor) {
+		if (sh->dev == dev && sh->major == major && sh->minor == minor) {
+			sh->refcnt++;
+			return sh;
+		}
+	}
+
+	sh = kzalloc(sizeof(*sh), GFP_KERNEL);
+	if (!sh)
+		return NULL;
+	sh->dev = dev;
+	sh->major = major;
+	sh->minor = minor;
+	sh->refcnt = 1;
+	INIT_LIST_HEAD(&sh->members);
+	atomic64_set(&sh->t_c, ktime_get_ns());
+	hash_add(htb_shared_hash, &sh->hnode, major | minor);
+	return sh;
+}
+
+static void htb_shared_put(struct htb_class *cl)
+{
+	struct htb_shared_class *sh = cl->shared;
+
+	ASSERT_RTNL();
+	list_del(&cl->shared_list);
+	if (--sh->refcnt)
+		return;
+	hash_del(&sh->hnode);
+	kfree(sh);
+}
+
+/*
+ * The last configuration of a class goes for all its queues: tokens are
+ * transmission time, the pools only make sense at a single rate.
+ */
+static void htb_shared_configure(struct htb_class *cl, bool new_pool)
+{
+	struct htb_shared_class *sh = cl->shared;
+	struct htb_class *m;
+
+	ASSERT_RTNL();
+	WRITE_ONCE(sh->buffer, cl->buffer);
+	WRITE_ONCE(sh->cbuffer, cl->cbuffer);
+	if (new_pool) {
+		atomic64_set(&sh->tokens, cl->buffer);
+		atomic64_set(&sh->ctokens, cl->cbuffer);
+	}
+
+	list_for_each_entry(m, &sh->members, shared_list) {
+		if (m == cl)
+			continue;
+		sch_tree_lock(m->sch);
+		m->rate = cl->rate;
+		m->ceil = cl->ceil;
+		m->buffer = cl->buffer;
+		m->cbuffer = cl->cbuffer;
+		m->batch = cl->batch;
+		m->cbatch = cl->cbatch;
+		sch_tree_unlock(m->sch);
+	}
+}
+
 static void htb_destroy_class(struct Qdisc *sch, struct htb_class *cl)
 {
 	if (!cl->level) {
 		WARN_ON(!cl->un.leaf.q);
 		qdisc_destroy(cl->un.leaf.q);
 	}
+	if (cl->shared)
+		htb_shared_put(cl);
 	gen_kill_estimator(&cl->bstats, &cl->rate_est);
 	tcf_destroy_chain(&cl->filter_list);
 	kfree(cl);
@@ -1338,6 +1567,7 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 	struct nlattr *tb[TCA_HTB_MAX + 1];
 	struct tc_htb_opt *hopt;
 	u64 rate64, ceil64;
+	bool new_pool = false;
 
 	/* extract all subattrs from opt attr */
 	if (!opt)
@@ -1397,12 +1627,25 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 		if (!cl)
 			goto failure;
 
+		if (q->shared) {
+			cl->shared = htb_shared_get(sch, classid);
+			if (!cl->shared) {
+				kfree(cl);
+				goto failure;
+			}
+			new_pool = list_empty(&cl->shared->members);
+			list_add_tail(&cl->shared_list, &cl->shared->members);
+			cl->sch = sch;
+		}
+
 		if (htb_rate_est || tca[TCA_RATE]) {
 			err = gen_new_estimator(&cl->bstats, NULL,
 						&cl->rate_est,
 						qdisc_root_sleeping_lock(sch),
 						tca[TCA_RATE] ? : &est.nla);
 			if (err) {
+				if (cl->shared)
+					htb_shared_put(cl);
 				kfree(cl);
 				goto failure;
 			}
@@ -1450,8 +1693,10 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 		cl->parent = parent;
 
 		/* set class to be in HTB_CAN_SEND state */
-		cl->tokens = PSCHED_TICKS2NS(hopt->buffer);
-		cl->ctokens = PSCHED_TICKS2NS(hopt->cbuffer);
+		if (!cl->shared) {
+			cl->tokens = PSCHED_TICKS2NS(hopt->buffer);
+			cl->ctokens = PSCHED_TICKS2NS(hopt->cbuffer);
+		}
 		cl->mbuffer = 60ULL * NSEC_PER_SEC;	/* 1min */
 		cl->t_c = ktime_get_ns();
 		cl->cmode = HTB_CAN_SEND;
@@ -1508,9 +1753,18 @@ static int htb_change_class(struct Qdisc *sch, u32 classid,
 
 	cl->buffer = PSCHED_TICKS2NS(hopt->buffer);
 	cl->cbuffer = PSCHED_TICKS2NS(hopt->cbuffer);
+	if (cl->shared) {
+		cl->batch = min_t(s64, cl->buffer,
+				  psched_l2t_ns(&cl->rate, HTB_SHARED_BATCH));
+		cl->cbatch = min_t(s64, cl->cbuffer,
+				   psched_l2t_ns(&cl->ceil, HTB_SHARED_BATCH));
+	}
 
 	sch_tree_unlock(sch);
 
+	if (cl->shared)
+		htb_shared_configure(cl, new_pool);
+
 	qdisc_class_hash_grow(sch, &q->clhash);
 
 	*arg = (unsigned long)cl;
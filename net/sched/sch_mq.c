@@ -64,6 +64,7 @@ static int mq_init(struct Qdisc *sch, struct nlattr *opt)
 			goto err;
 		priv->qdiscs[ntx] = qdisc;
 		qdisc->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+		qdisc_root_nolock(qdisc);
 	}
 
 	sch->flags |= TCQ_F_MQROOT;
@@ -109,13 +110,8 @@ static int mq_dump(struct Qdisc *sch, struct sk_buff *skb)
 	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
 		qdisc = netdev_get_tx_queue(dev, ntx)->qdisc_sleeping;
 		spin_lock_bh(qdisc_lock(qdisc));
-		sch->q.qlen		+= qdisc->q.qlen;
-		sch->bstats.bytes	+= qdisc->bstats.bytes;
-		sch->bstats.packets	+= qdisc->bstats.packets;
-		sch->qstats.backlog	+= qdisc->qstats.backlog;
-		sch->qstats.drops	+= qdisc->qstats.drops;
-		sch->qstats.requeues	+= qdisc->qstats.requeues;
-		sch->qstats.overlimits	+= qdisc->qstats.overlimits;
+		sch->q.qlen += qdisc_qlen_sum(qdisc);
+		qdisc_stats_add(qdisc, &sch->bstats, &sch->qstats);
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 	return 0;
@@ -155,8 +151,10 @@ static int mq_graft(struct Qdisc *sch, unsigned long cl, struct Qdisc *new,
 		dev_deactivate(dev);
 
 	*old = dev_graft_qdisc(dev_queue, new);
-	if (new)
+	if (new) {
 		new->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+		qdisc_root_nolock(new);
+	}
 	if (dev->flags & IFF_UP)
 		dev_activate(dev);
 	return 0;
@@ -197,10 +195,17 @@ static int mq_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 			       struct gnet_dump *d)
 {
 	struct netdev_queue *dev_queue = mq_queue_get(sch, cl);
+	struct gnet_stats_basic_cpu __percpu *cpu_bstats = NULL;
+	struct gnet_stats_queue __percpu *cpu_qstats = NULL;
 
 	sch = dev_queue->qdisc_sleeping;
-	if (gnet_stats_copy_basic(d, NULL, &sch->bstats) < 0 ||
-	    gnet_stats_copy_queue(d, NULL, &sch->qstats, sch->q.qlen) < 0)
+	if (qdisc_is_percpu_stats(sch)) {
+		cpu_bstats = sch->cpu_bstats;
+		cpu_qstats = sch->cpu_qstats;
+	}
+	if (gnet_stats_copy_basic(d, cpu_bstats, &sch->bstats) < 0 ||
+	    gnet_stats_copy_queue(d, cpu_qstats, &sch->qstats,
+				  qdisc_qlen_sum(sch)) < 0)
 		return -1;
 	return 0;
 }
@@ -560,6 +560,15 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
+	if (args->nconnect > 1 && args->bc_xprt == NULL) {
+		int err = xprt_create_extra_transports(xprt, &xprtargs,
+						       args->nconnect - 1);
+		if (err) {
+			xprt_put(xprt);
+			return ERR_PTR(err);
+		}
+	}
+
 	return rpc_create_xprt(args, xprt);
 }
 EXPORT_SYMBOL_GPL(rpc_create);
@@ -1364,8 +1373,14 @@ EXPORT_SYMBOL_GPL(rpc_get_timeout);
 void rpc_force_rebind(struct rpc_clnt *clnt)
 {
 	if (clnt->cl_autobind) {
+		struct rpc_xprt *xprt;
+		unsigned int i;
+
 		rcu_read_lock();
-		xprt_clear_bound(rcu_dereference(clnt->cl_xprt));
+		xprt = rcu_dereference(clnt->cl_xprt);
+		xprt_clear_bound(xprt);
+		for (i = 0; i < xprt->nr_extra_xprts; i++)
+			xprt_clear_bound(xprt->extra_xprts[i]);
 		rcu_read_unlock();
 	}
 }
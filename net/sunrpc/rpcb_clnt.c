@@ -689,6 +689,12 @@ void rpcb_getport_async(struct rpc_task *task)
 	} while (xprt == NULL);
 	rcu_read_unlock();
 
+	/* With nconnect the request may be on one of the extra connections */
+	if (task->tk_rqstp && task->tk_rqstp->rq_xprt != xprt) {
+		xprt_put(xprt);
+		xprt = xprt_get(task->tk_rqstp->rq_xprt);
+	}
+
 	dprintk("RPC: %5u %s(%s, %u, %u, %d)\n",
 		task->tk_pid, __func__,
 		xprt->servername, clnt->cl_prog, clnt->cl_vers, xprt->prot);
@@ -215,8 +215,14 @@ void rpc_print_iostats(struct seq_file *seq, struct rpc_clnt *clnt)
 
 	rcu_read_lock();
 	xprt = rcu_dereference(clnt->cl_xprt);
-	if (xprt)
+	if (xprt) {
+		unsigned int i;
+
 		xprt->ops->print_stats(xprt, seq);
+		for (i = 0; i < xprt->nr_extra_xprts; i++)
+			xprt->extra_xprts[i]->ops->print_stats(
+						xprt->extra_xprts[i], seq);
+	}
 	rcu_read_unlock();
 
 	seq_printf(seq, "\tper-op statistics\n");
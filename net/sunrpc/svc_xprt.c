@@ -39,6 +39,9 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	Transports are enqueued onto svc_pool->sp_xprts_new and idle
+ *	threads found on svc_pool->sp_idle_threads without it; both lists
+ *	are only ever consumed with sp_lock held.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	The "service mutex" protects svc_serv->sv_nrthread.
@@ -319,12 +322,75 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+static bool svc_pool_has_xprts(struct svc_pool *pool)
+{
+	return !list_empty(&pool->sp_sockets) ||
+	       !llist_empty(&pool->sp_xprts_new);
+}
+
+/*
+ * Wake the most recently idled thread in @pool, if there is one.  Threads
+ * take themselves off sp_idle_threads once they run again, so all we do
+ * here is peek at the head of the list.  Must be called under
+ * rcu_read_lock() as the thread may exit as soon as it is woken.
+ */
+static struct svc_rqst *svc_pool_wake_idle_thread(struct svc_pool *pool)
+{
+	struct llist_node *ln = READ_ONCE(pool->sp_idle_threads.first);
+	struct svc_rqst *rqstp;
+
+	if (!ln)
+		return NULL;
+
+	rqstp = llist_entry(ln, struct svc_rqst, rq_idle);
+	wake_up_process(rqstp->rq_task);
+	return rqstp;
+}
+
+/*
+ * Take @rqstp back off its pool's idle list.  Entries are only ever added
+ * at the head and only the owning thread removes its own entry, with
+ * sp_lock held, so everything behind the head is stable here and only the
+ * head itself can race with a concurrent llist_add().
+ */
+static void svc_pool_idle_remove(struct svc_pool *pool, struct svc_rqst *rqstp)
+{
+	struct llist_node *node = &rqstp->rq_idle;
+	struct llist_node *first, *prev;
+
+	spin_lock_bh(&pool->sp_lock);
+	first = READ_ONCE(pool->sp_idle_threads.first);
+	if (first == node) {
+		first = cmpxchg(&pool->sp_idle_threads.first, node, node->next);
+		if (first == node)
+			goto out;
+	}
+	for (prev = first; prev->next != node; prev = prev->next)
+		;
+	prev->next = node->next;
+out:
+	spin_unlock_bh(&pool->sp_lock);
+}
+
+/*
+ * Move transports enqueued since the last call over to sp_sockets, oldest
+ * first.  Called with sp_lock held.
+ */
+static void svc_pool_splice_xprts(struct svc_pool *pool)
+{
+	struct llist_node *first = llist_del_all(&pool->sp_xprts_new);
+	struct svc_xprt *xprt, *tmp;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(xprt, tmp, first, xpt_ready_node)
+		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
+}
+
 void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
-	struct svc_rqst	*rqstp = NULL;
+	struct svc_rqst	*rqstp;
 	int cpu;
-	bool queued = false;
 
 	if (!svc_xprt_has_something_to_do(xprt))
 		goto out;
@@ -345,61 +411,29 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 
 	atomic_long_inc(&pool->sp_stats.packets);
 
-redo_search:
-	/* find a thread for this xprt */
-	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* Do a lockless check first */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-
-		/*
-		 * Once the xprt has been queued, it can only be dequeued by
-		 * the task that intends to service it. All we can do at that
-		 * point is to try to wake this thread back up so that it can
-		 * do so.
-		 */
-		if (!queued) {
-			spin_lock_bh(&rqstp->rq_lock);
-			if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags)) {
-				/* already busy, move on... */
-				spin_unlock_bh(&rqstp->rq_lock);
-				continue;
-			}
-
-			/* this one will do */
-			rqstp->rq_xprt = xprt;
-			svc_xprt_get(xprt);
-			spin_unlock_bh(&rqstp->rq_lock);
-		}
-		rcu_read_unlock();
+	/*
+	 * The transport always goes through the queue; the thread we wake
+	 * dequeues it itself.  llist_add() implies a full barrier, which
+	 * pairs with the one in svc_get_next_xprt(): either we see the
+	 * thread on sp_idle_threads or it sees the transport before it
+	 * goes to sleep.
+	 */
+	dprintk("svc: transport %p put into queue\n", xprt);
+	xprt->xpt_qtime = ktime_get();
+	llist_add(&xprt->xpt_ready_node, &pool->sp_xprts_new);
 
+	rcu_read_lock();
+	rqstp = svc_pool_wake_idle_thread(pool);
+	if (rqstp)
 		atomic_long_inc(&pool->sp_stats.threads_woken);
-		wake_up_process(rqstp->rq_task);
-		put_cpu();
-		goto out;
-	}
+	else
+		atomic_long_inc(&pool->sp_stats.sockets_queued);
+	trace_svc_xprt_do_enqueue(xprt, rqstp);
 	rcu_read_unlock();
-
-	/*
-	 * We didn't find an idle thread to use, so we need to queue the xprt.
-	 * Do so and then search again. If we find one, we can't hook this one
-	 * up to it directly but we can wake the thread up in the hopes that it
-	 * will pick it up once it searches for a xprt to service.
-	 */
-	if (!queued) {
-		queued = true;
-		dprintk("svc: transport %p put into queue\n", xprt);
-		spin_lock_bh(&pool->sp_lock);
-		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-		pool->sp_stats.sockets_queued++;
-		spin_unlock_bh(&pool->sp_lock);
-		goto redo_search;
-	}
-	rqstp = NULL;
 	put_cpu();
+	return;
 out:
-	trace_svc_xprt_do_enqueue(xprt, rqstp);
+	trace_svc_xprt_do_enqueue(xprt, NULL);
 }
 EXPORT_SYMBOL_GPL(svc_xprt_do_enqueue);
 
@@ -422,21 +456,38 @@ EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
+	s64 delta;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_pool_has_xprts(pool))
 		goto out;
 
 	spin_lock_bh(&pool->sp_lock);
+	svc_pool_splice_xprts(pool);
 	if (likely(!list_empty(&pool->sp_sockets))) {
 		xprt = list_first_entry(&pool->sp_sockets,
 					struct svc_xprt, xpt_ready);
 		list_del_init(&xprt->xpt_ready);
 		svc_xprt_get(xprt);
 
+		delta = ktime_us_delta(ktime_get(), xprt->xpt_qtime);
+		pool->sp_stats.queue_time += delta;
+		if (delta > pool->sp_stats.queue_time_max)
+			pool->sp_stats.queue_time_max = delta;
+
 		dprintk("svc: transport %p dequeued, inuse=%d\n",
 			xprt, atomic_read(&xprt->xpt_ref.refcount));
 	}
 	spin_unlock_bh(&pool->sp_lock);
+
+	/* Several enqueuers may have woken the same thread; pass the
+	 * remaining work on to another one.
+	 */
+	if (xprt && svc_pool_has_xprts(pool)) {
+		rcu_read_lock();
+		if (svc_pool_wake_idle_thread(pool))
+			atomic_long_inc(&pool->sp_stats.threads_woken);
+		rcu_read_unlock();
+	}
 out:
 	trace_svc_xprt_dequeue(xprt);
 	return xprt;
@@ -513,14 +564,11 @@ void svc_wake_up(struct svc_serv *serv)
 	pool = &serv->sv_pools[0];
 
 	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* skip any that aren't queued */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-		rcu_read_unlock();
+	rqstp = svc_pool_wake_idle_thread(pool);
+	if (rqstp) {
 		dprintk("svc: daemon %p woken up.\n", rqstp);
-		wake_up_process(rqstp->rq_task);
 		trace_svc_wake_up(rqstp->rq_task->pid);
+		rcu_read_unlock();
 		return;
 	}
 	rcu_read_unlock();
@@ -649,7 +697,7 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 		return false;
 
 	/* was a socket queued? */
-	if (!list_empty(&pool->sp_sockets))
+	if (svc_pool_has_xprts(pool))
 		return false;
 
 	/* are we shutting down? */
@@ -696,7 +744,8 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	 */
 	set_current_state(TASK_INTERRUPTIBLE);
 	clear_bit(RQ_BUSY, &rqstp->rq_flags);
-	smp_mb();
+	/* implies a full barrier, see svc_xprt_do_enqueue() */
+	llist_add(&rqstp->rq_idle, &pool->sp_idle_threads);
 
 	if (likely(rqst_should_sleep(rqstp)))
 		time_left = schedule_timeout(timeout);
@@ -705,13 +754,14 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 
 	try_to_freeze();
 
-	spin_lock_bh(&rqstp->rq_lock);
+	svc_pool_idle_remove(pool, rqstp);
 	set_bit(RQ_BUSY, &rqstp->rq_flags);
-	spin_unlock_bh(&rqstp->rq_lock);
 
-	xprt = rqstp->rq_xprt;
-	if (xprt != NULL)
+	xprt = svc_xprt_dequeue(pool);
+	if (xprt) {
+		rqstp->rq_xprt = xprt;
 		return xprt;
+	}
 
 	if (!time_left)
 		atomic_long_inc(&pool->sp_stats.threads_timedout);
@@ -1024,6 +1074,7 @@ static struct svc_xprt *svc_dequeue_net(struct svc_serv *serv, struct net *net)
 		pool = &serv->sv_pools[i];
 
 		spin_lock_bh(&pool->sp_lock);
+		svc_pool_splice_xprts(pool);
 		list_for_each_entry_safe(xprt, tmp, &pool->sp_sockets, xpt_ready) {
 			if (xprt->xpt_net != net)
 				continue;
@@ -1336,16 +1387,18 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	struct svc_pool *pool = p;
 
 	if (p == SEQ_START_TOKEN) {
-		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout\n");
+		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout queue-time-us queue-time-max-us\n");
 		return 0;
 	}
 
-	seq_printf(m, "%u %lu %lu %lu %lu\n",
+	seq_printf(m, "%u %lu %lu %lu %lu %llu %llu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
-		pool->sp_stats.sockets_queued,
+		(unsigned long)atomic_long_read(&pool->sp_stats.sockets_queued),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
-		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout),
+		(unsigned long long)pool->sp_stats.queue_time,
+		(unsigned long long)pool->sp_stats.queue_time_max);
 
 	return 0;
 }
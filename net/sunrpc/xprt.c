@@ -1170,6 +1170,22 @@ void xprt_free(struct rpc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(xprt_free);
 
+/*
+ * Choose the connection a new request goes out on.  Once the slot is
+ * allocated the request stays on that connection (req->rq_xprt) for
+ * retransmits, so replies are always matched on the right socket.
+ */
+static struct rpc_xprt *xprt_pick(struct rpc_xprt *xprt)
+{
+	unsigned int nr = xprt->nr_extra_xprts;
+	unsigned int i;
+
+	if (!nr)
+		return xprt;
+	i = (unsigned int)atomic_inc_return(&xprt->next_xprt) % (nr + 1);
+	return i ? xprt->extra_xprts[i - 1] : xprt;
+}
+
 /**
  * xprt_reserve - allocate an RPC request slot
  * @task: RPC task requesting a slot allocation
@@ -1189,7 +1205,7 @@ void xprt_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_pick(rcu_dereference(task->tk_client->cl_xprt));
 	if (!xprt_throttle_congested(xprt, task))
 		xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
@@ -1215,7 +1231,7 @@ void xprt_retry_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_pick(rcu_dereference(task->tk_client->cl_xprt));
 	xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
 }
@@ -1388,6 +1404,48 @@ out:
 	return xprt;
 }
 
+/**
+ * xprt_create_extra_transports - open more connections to the same server
+ * @xprt: transport that will own the new connections
+ * @args: the arguments @xprt itself was created with
+ * @nr: number of additional connections
+ *
+ * Must be called before @xprt is handed to an rpc_clnt.  The new
+ * transports inherit @xprt's reserved port setting and are released
+ * together with it.
+ */
+int xprt_create_extra_transports(struct rpc_xprt *xprt,
+				 struct xprt_create *args,
+				 unsigned int nr)
+{
+	struct rpc_xprt **extra;
+	unsigned int i;
+
+	extra = kcalloc(nr, sizeof(*extra), GFP_KERNEL);
+	if (extra == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		extra[i] = xprt_create_transport(args);
+		if (IS_ERR(extra[i])) {
+			int err = PTR_ERR(extra[i]);
+
+			while (i--)
+				xprt_put(extra[i]);
+			kfree(extra);
+			return err;
+		}
+		extra[i]->resvport = xprt->resvport;
+	}
+
+	xprt->extra_xprts = extra;
+	xprt->nr_extra_xprts = nr;
+	atomic_set(&xprt->next_xprt, 0);
+	dprintk("RPC:       transport %p has %u extra connections\n", xprt, nr);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xprt_create_extra_transports);
+
 /**
  * xprt_destroy - destroy an RPC transport, killing off all requests.
  * @xprt: transport to destroy
@@ -1395,8 +1453,14 @@ out:
  */
 static void xprt_destroy(struct rpc_xprt *xprt)
 {
+	unsigned int i;
+
 	dprintk("RPC:       destroying transport %p\n", xprt);
 
+	for (i = 0; i < xprt->nr_extra_xprts; i++)
+		xprt_put(xprt->extra_xprts[i]);
+	kfree(xprt->extra_xprts);
+
 	/* Exclude transport connect/disconnect handlers */
 	wait_on_bit_lock(&xprt->state, XPRT_LOCKED, TASK_UNINTERRUPTIBLE);
 
@@ -509,6 +509,11 @@ xprt_rdma_allocate(struct rpc_task *task, size_t size)
 		goto out_sendbuf;
 	if (size > req->rl_sendbuf->rg_size)
 		goto out_sendbuf;
+	/* The inline thresholds are renegotiated on every connect */
+	if (RPCRDMA_INLINE_READ_THRESHOLD(task->tk_rqstp) +
+	    RPCRDMA_INLINE_WRITE_THRESHOLD(task->tk_rqstp) >
+	    req->rl_sendbuf->rg_size)
+		goto out_sendbuf;
 
 out:
 	dprintk("RPC:       %s: size %zd, request 0x%p\n", __func__, size, req);
@@ -272,6 +272,33 @@ rpcrdma_flush_cqs(struct rpcrdma_ep *ep)
 		rpcrdma_sendcq_process_wc(&wc);
 }
 
+/*
+ * Use the smaller of our own inline buffers and what the server
+ * advertised in its accept.
+ */
+static void
+rpcrdma_update_connect_private(struct rpcrdma_xprt *r_xprt,
+			       struct rdma_conn_param *param)
+{
+	struct rpcrdma_create_data_internal *cdata = &r_xprt->rx_data;
+	const struct rpcrdma_connect_private *pmsg = param->private_data;
+	struct rpcrdma_ep *ep = &r_xprt->rx_ep;
+	unsigned int rsize, wsize;
+
+	rsize = RPCRDMA_V1_DEF_INLINE_SIZE;
+	wsize = RPCRDMA_V1_DEF_INLINE_SIZE;
+	if (pmsg && param->private_data_len >= sizeof(*pmsg) &&
+	    pmsg->cp_magic == rpcrdma_cmp_magic) {
+		rsize = rpcrdma_decode_buffer_size(pmsg->cp_send_size);
+		wsize = rpcrdma_decode_buffer_size(pmsg->cp_recv_size);
+	}
+
+	cdata->inline_rsize = min(rsize, ep->rep_inline_recv);
+	cdata->inline_wsize = min(wsize, ep->rep_inline_send);
+	dprintk("RPC:       %s: max send %u, max recv %u\n",
+		__func__, cdata->inline_wsize, cdata->inline_rsize);
+}
+
 static int
 rpcrdma_conn_upcall(struct rdma_cm_id *id, struct rdma_cm_event *event)
 {
@@ -305,6 +332,7 @@ rpcrdma_conn_upcall(struct rdma_cm_id *id, struct rdma_cm_event *event)
 		break;
 	case RDMA_CM_EVENT_ESTABLISHED:
 		connstate = 1;
+		rpcrdma_update_connect_private(xprt, &event->param.conn);
 		ib_query_qp(ia->ri_id->qp, attr,
 			    IB_QP_MAX_QP_RD_ATOMIC | IB_QP_MAX_DEST_RD_ATOMIC,
 			    iattr);
@@ -664,9 +692,18 @@ rpcrdma_ep_create(struct rpcrdma_ep *ep, struct rpcrdma_ia *ia,
 
 	/* Initialize cma parameters */
 
-	/* RPC/RDMA does not use private data */
-	ep->rep_remote_cma.private_data = NULL;
-	ep->rep_remote_cma.private_data_len = 0;
+	/* Tell the server how large our inline buffers are */
+	ep->rep_inline_send = cdata->inline_wsize;
+	ep->rep_inline_recv = cdata->inline_rsize;
+	ep->rep_cm_private.cp_magic = rpcrdma_cmp_magic;
+	ep->rep_cm_private.cp_version = RPCRDMA_CMP_VERSION;
+	ep->rep_cm_private.cp_flags = 0;
+	ep->rep_cm_private.cp_send_size =
+			rpcrdma_encode_buffer_size(cdata->inline_wsize);
+	ep->rep_cm_private.cp_recv_size =
+			rpcrdma_encode_buffer_size(cdata->inline_rsize);
+	ep->rep_remote_cma.private_data = &ep->rep_cm_private;
+	ep->rep_remote_cma.private_data_len = sizeof(ep->rep_cm_private);
 
 	/* Client offers RDMA Read but does not initiate */
 	ep->rep_remote_cma.initiator_depth = 0;
@@ -1372,7 +1409,9 @@ rpcrdma_max_segments(struct rpcrdma_xprt *r_xprt)
 	struct rpcrdma_create_data_internal *cdata = &r_xprt->rx_data;
 	int bytes, segments;
 
+	/* The server may turn out to support only the protocol default */
 	bytes = min_t(unsigned int, cdata->inline_wsize, cdata->inline_rsize);
+	bytes = min_t(unsigned int, bytes, RPCRDMA_V1_DEF_INLINE_SIZE);
 	bytes -= RPCRDMA_HDRLEN_MIN;
 	if (bytes < sizeof(struct rpcrdma_segment) * 2) {
 		pr_warn("RPC:       %s: inline threshold too small\n",
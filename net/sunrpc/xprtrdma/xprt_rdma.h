@@ -86,6 +86,9 @@ struct rpcrdma_ep {
 	struct rdma_conn_param	rep_remote_cma;
 	struct sockaddr_storage	rep_remote_addr;
 	struct delayed_work	rep_connect_worker;
+	struct rpcrdma_connect_private	rep_cm_private;
+	unsigned int		rep_inline_send;	/* local buffer sizes */
+	unsigned int		rep_inline_recv;
 };
 
 /*
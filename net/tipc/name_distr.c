@@ -171,8 +171,11 @@ static void named_distribute(struct net *net, struct sk_buff_head *list,
 	struct publication *publ;
 	struct sk_buff *skb = NULL;
 	struct distr_item *item = NULL;
-	uint msg_dsz = (tipc_node_get_mtu(net, dnode, 0) / ITEM_SIZE) *
-			ITEM_SIZE;
+	/* Fill each message up to, but not beyond, the link MTU so the
+	 * bulk goes out unfragmented.
+	 */
+	uint msg_dsz = ((tipc_node_get_mtu(net, dnode, 0) - INT_H_SIZE) /
+			ITEM_SIZE) * ITEM_SIZE;
 	uint msg_rem = msg_dsz;
 
 	list_for_each_entry(publ, pls, local_list) {
@@ -393,6 +396,7 @@ void tipc_named_rcv(struct net *net, struct sk_buff_head *inputq)
 	uint count;
 	u32 node;
 	struct sk_buff *skb;
+	bool updated;
 	int mtype;
 
 	spin_lock_bh(&tn->nametbl_lock);
@@ -403,13 +407,22 @@ void tipc_named_rcv(struct net *net, struct sk_buff_head *inputq)
 		item = (struct distr_item *)msg_data(msg);
 		count = msg_data_sz(msg) / ITEM_SIZE;
 		node = msg_orignode(msg);
+		updated = false;
 		while (count--) {
-			if (!tipc_update_nametbl(net, item, node, mtype))
+			if (tipc_update_nametbl(net, item, node, mtype))
+				updated = true;
+			else
 				tipc_named_add_backlog(item, mtype, node);
 			item++;
 		}
 		kfree_skb(skb);
-		tipc_named_process_backlog(net);
+
+		/* Deferred updates can only succeed once something changed;
+		 * rescanning the backlog for every message of a bulk
+		 * transfer makes cluster join quadratic.
+		 */
+		if (updated)
+			tipc_named_process_backlog(net);
 	}
 	spin_unlock_bh(&tn->nametbl_lock);
 }
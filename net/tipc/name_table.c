@@ -60,6 +60,7 @@ tipc_nl_name_table_policy[TIPC_NLA_NAME_TABLE_MAX + 1] = {
  * @node_list_size: number of entries in "node_list"
  * @cluster_list_size: number of entries in "cluster_list"
  * @zone_list_size: number of entries in "zone_list"
+ * @rcu: RCU callback head used for deferred freeing
  *
  * Note: The zone list always contains at least one entry, since all
  *       publications of the associated name sequence belong to it.
@@ -72,6 +73,7 @@ struct name_info {
 	u32 node_list_size;
 	u32 cluster_list_size;
 	u32 zone_list_size;
+	struct rcu_head rcu;
 };
 
 /**
@@ -86,6 +88,21 @@ struct sub_seq {
 	struct name_info *info;
 };
 
+/**
+ * struct sub_seq_block - storage for a sub-sequence array
+ * @rcu: RCU callback head used for deferred freeing
+ * @size: number of sub-sequences the array has room for
+ * @sseqs: the array itself
+ *
+ * Lockless name translation may still be searching an array that has
+ * been replaced, so arrays are freed after an RCU grace period.
+ */
+struct sub_seq_block {
+	struct rcu_head rcu;
+	u32 size;
+	struct sub_seq sseqs[];
+};
+
 /**
  * struct name_seq - container for all published instances of a name type
  * @type: 32 bit 'type' value for name sequence
@@ -96,6 +113,8 @@ struct sub_seq {
  * @ns_list: links to adjacent name sequences in hash chain
  * @subscriptions: list of subscriptions for this 'type'
  * @lock: spinlock controlling access to publication lists of all sub-sequences
+ * @seqc: sequence count bumped under @lock by every change, lets name
+ *        translation read the sub-sequences without taking @lock
  * @rcu: RCU callback head used for deferred freeing
  */
 struct name_seq {
@@ -106,6 +125,7 @@ struct name_seq {
 	struct hlist_node ns_list;
 	struct list_head subscriptions;
 	spinlock_t lock;
+	seqcount_t seqc;
 	struct rcu_head rcu;
 };
 
@@ -143,7 +163,28 @@ static struct publication *publ_create(u32 type, u32 lower, u32 upper,
  */
 static struct sub_seq *tipc_subseq_alloc(u32 cnt)
 {
-	return kcalloc(cnt, sizeof(struct sub_seq), GFP_ATOMIC);
+	struct sub_seq_block *blk;
+
+	blk = kzalloc(sizeof(*blk) + cnt * sizeof(struct sub_seq), GFP_ATOMIC);
+	if (!blk)
+		return NULL;
+
+	blk->size = cnt;
+	return blk->sseqs;
+}
+
+/**
+ * tipc_subseq_free - free a sub-sequence array once no reader can see it
+ */
+static void tipc_subseq_free(struct sub_seq *sseqs)
+{
+	struct sub_seq_block *blk;
+
+	if (!sseqs)
+		return;
+
+	blk = container_of(sseqs, struct sub_seq_block, sseqs[0]);
+	kfree_rcu(blk, rcu);
 }
 
 /**
@@ -159,11 +200,12 @@ static struct name_seq *tipc_nameseq_create(u32 type, struct hlist_head *seq_hea
 	if (!nseq || !sseq) {
 		pr_warn("Name sequence creation failed, no memory\n");
 		kfree(nseq);
-		kfree(sseq);
+		tipc_subseq_free(sseq);
 		return NULL;
 	}
 
 	spin_lock_init(&nseq->lock);
+	seqcount_init(&nseq->seqc);
 	nseq->type = type;
 	nseq->sseqs = sseq;
 	nseq->alloc = 1;
@@ -177,15 +219,21 @@ static struct name_seq *tipc_nameseq_create(u32 type, struct hlist_head *seq_hea
  * nameseq_find_subseq - find sub-sequence (if any) matching a name instance
  *
  * Very time-critical, so binary searches through sub-sequence array.
+ * Also used without the lock by name translation, hence the bound on
+ * the size of the array actually read.
  */
 static struct sub_seq *nameseq_find_subseq(struct name_seq *nseq,
 					   u32 instance)
 {
-	struct sub_seq *sseqs = nseq->sseqs;
+	struct sub_seq *sseqs = READ_ONCE(nseq->sseqs);
+	struct sub_seq_block *blk;
 	int low = 0;
-	int high = nseq->first_free - 1;
+	int high = READ_ONCE(nseq->first_free);
 	int mid;
 
+	blk = container_of(sseqs, struct sub_seq_block, sseqs[0]);
+	high = min_t(int, high, blk->size) - 1;
+
 	while (low <= high) {
 		mid = (low + high) / 2;
 		if (instance < sseqs[mid].lower)
@@ -282,7 +330,7 @@ static struct publication *tipc_nameseq_insert_publ(struct net *net,
 			}
 			memcpy(sseqs, nseq->sseqs,
 			       nseq->alloc * sizeof(struct sub_seq));
-			kfree(nseq->sseqs);
+			tipc_subseq_free(nseq->sseqs);
 			nseq->sseqs = sseqs;
 			nseq->alloc *= 2;
 		}
@@ -392,7 +440,7 @@ found:
 
 	/* Contract subseq list if no more publications for that subseq */
 	if (list_empty(&info->zone_list)) {
-		kfree(info);
+		kfree_rcu(info, rcu);
 		free = &nseq->sseqs[nseq->first_free--];
 		memmove(sseq, sseq + 1, (free - (sseq + 1)) * sizeof(*sseq));
 		removed_subseq = 1;
@@ -479,8 +527,10 @@ struct publication *tipc_nametbl_insert_publ(struct net *net, u32 type,
 		return NULL;
 
 	spin_lock_bh(&seq->lock);
+	write_seqcount_begin(&seq->seqc);
 	publ = tipc_nameseq_insert_publ(net, seq, type, lower, upper,
 					scope, node, port, key);
+	write_seqcount_end(&seq->seqc);
 	spin_unlock_bh(&seq->lock);
 	return publ;
 }
@@ -496,10 +546,12 @@ struct publication *tipc_nametbl_remove_publ(struct net *net, u32 type,
 		return NULL;
 
 	spin_lock_bh(&seq->lock);
+	write_seqcount_begin(&seq->seqc);
 	publ = tipc_nameseq_remove_publ(net, seq, lower, node, ref, key);
+	write_seqcount_end(&seq->seqc);
 	if (!seq->first_free && list_empty(&seq->subscriptions)) {
 		hlist_del_init_rcu(&seq->ns_list);
-		kfree(seq->sseqs);
+		tipc_subseq_free(seq->sseqs);
 		spin_unlock_bh(&seq->lock);
 		kfree_rcu(seq, rcu);
 		return publ;
@@ -508,6 +560,56 @@ struct publication *tipc_nametbl_remove_publ(struct net *net, u32 type,
 	return publ;
 }
 
+/**
+ * tipc_nameinfo_select - pick the publication to translate a name to
+ * @head: set to the list the publication was taken from
+ *
+ * Callers without the name sequence lock may see lists changing under
+ * them; the result is then discarded through the sequence count.
+ */
+static struct publication *tipc_nameinfo_select(struct net *net,
+						struct name_info *info,
+						u32 destnode,
+						struct list_head **head)
+{
+	struct tipc_net *tn = net_generic(net, tipc_net_id);
+	struct list_head *first;
+
+	/* Closest-First Algorithm */
+	if (likely(!destnode)) {
+		if (!list_empty(&info->node_list))
+			goto node;
+		if (!list_empty(&info->cluster_list))
+			goto cluster;
+		goto zone;
+	}
+
+	/* Round-Robin Algorithm */
+	if (destnode == tn->own_addr)
+		goto node;
+	if (in_own_cluster_exact(net, destnode))
+		goto cluster;
+
+zone:
+	*head = &info->zone_list;
+	first = READ_ONCE((*head)->next);
+	if (first == *head)
+		return NULL;
+	return list_entry(first, struct publication, zone_list);
+cluster:
+	*head = &info->cluster_list;
+	first = READ_ONCE((*head)->next);
+	if (first == *head)
+		return NULL;
+	return list_entry(first, struct publication, cluster_list);
+node:
+	*head = &info->node_list;
+	first = READ_ONCE((*head)->next);
+	if (first == *head)
+		return NULL;
+	return list_entry(first, struct publication, node_list);
+}
+
 /**
  * tipc_nametbl_translate - perform name translation
  *
@@ -525,10 +627,11 @@ u32 tipc_nametbl_translate(struct net *net, u32 type, u32 instance,
 			   u32 *destnode)
 {
 	struct tipc_net *tn = net_generic(net, tipc_net_id);
+	struct list_head *head = NULL, *link = NULL;
 	struct sub_seq *sseq;
-	struct name_info *info;
 	struct publication *publ;
 	struct name_seq *seq;
+	unsigned int start;
 	u32 ref = 0;
 	u32 node = 0;
 
@@ -539,58 +642,38 @@ u32 tipc_nametbl_translate(struct net *net, u32 type, u32 instance,
 	seq = nametbl_find_seq(net, type);
 	if (unlikely(!seq))
 		goto not_found;
-	spin_lock_bh(&seq->lock);
-	sseq = nameseq_find_subseq(seq, instance);
-	if (unlikely(!sseq))
-		goto no_match;
-	info = sseq->info;
 
-	/* Closest-First Algorithm */
-	if (likely(!*destnode)) {
-		if (!list_empty(&info->node_list)) {
-			publ = list_first_entry(&info->node_list,
-						struct publication,
-						node_list);
-			list_move_tail(&publ->node_list,
-				       &info->node_list);
-		} else if (!list_empty(&info->cluster_list)) {
-			publ = list_first_entry(&info->cluster_list,
-						struct publication,
-						cluster_list);
-			list_move_tail(&publ->cluster_list,
-				       &info->cluster_list);
-		} else {
-			publ = list_first_entry(&info->zone_list,
-						struct publication,
-						zone_list);
-			list_move_tail(&publ->zone_list,
-				       &info->zone_list);
-		}
-	}
+	/* Translate without the name sequence lock, retrying if the
+	 * sub-sequences or their publications changed meanwhile.
+	 */
+	do {
+		start = read_seqcount_begin(&seq->seqc);
+		ref = 0;
+		node = 0;
+		link = NULL;
+		sseq = nameseq_find_subseq(seq, instance);
+		if (unlikely(!sseq))
+			continue;
+		publ = tipc_nameinfo_select(net, READ_ONCE(sseq->info),
+					    *destnode, &head);
+		if (!publ)
+			continue;
+		ref = publ->ref;
+		node = publ->node;
+		link = READ_ONCE(head->next);
+	} while (read_seqcount_retry(&seq->seqc, start));
 
-	/* Round-Robin Algorithm */
-	else if (*destnode == tn->own_addr) {
-		if (list_empty(&info->node_list))
-			goto no_match;
-		publ = list_first_entry(&info->node_list, struct publication,
-					node_list);
-		list_move_tail(&publ->node_list, &info->node_list);
-	} else if (in_own_cluster_exact(net, *destnode)) {
-		if (list_empty(&info->cluster_list))
-			goto no_match;
-		publ = list_first_entry(&info->cluster_list, struct publication,
-					cluster_list);
-		list_move_tail(&publ->cluster_list, &info->cluster_list);
-	} else {
-		publ = list_first_entry(&info->zone_list, struct publication,
-					zone_list);
-		list_move_tail(&publ->zone_list, &info->zone_list);
+	/* Rotate the chosen publication to the back of its list for load
+	 * sharing. Under contention another translation will do it.
+	 */
+	if (link && spin_trylock_bh(&seq->lock)) {
+		if (head->next == link) {
+			write_seqcount_begin(&seq->seqc);
+			list_move_tail(link, head);
+			write_seqcount_end(&seq->seqc);
+		}
+		spin_unlock_bh(&seq->lock);
 	}
-
-	ref = publ->ref;
-	node = publ->node;
-no_match:
-	spin_unlock_bh(&seq->lock);
 not_found:
 	rcu_read_unlock();
 	*destnode = node;
@@ -755,7 +838,7 @@ void tipc_nametbl_unsubscribe(struct tipc_subscription *s)
 		list_del_init(&s->nameseq_list);
 		if (!seq->first_free && list_empty(&seq->subscriptions)) {
 			hlist_del_init_rcu(&seq->ns_list);
-			kfree(seq->sseqs);
+			tipc_subseq_free(seq->sseqs);
 			spin_unlock_bh(&seq->lock);
 			kfree_rcu(seq, rcu);
 		} else {
@@ -798,6 +881,7 @@ static void tipc_purge_publications(struct net *net, struct name_seq *seq)
 	struct name_info *info;
 
 	spin_lock_bh(&seq->lock);
+	write_seqcount_begin(&seq->seqc);
 	sseq = seq->sseqs;
 	info = sseq->info;
 	list_for_each_entry_safe(publ, safe, &info->zone_list, zone_list) {
@@ -805,8 +889,9 @@ static void tipc_purge_publications(struct net *net, struct name_seq *seq)
 					 publ->ref, publ->key);
 		kfree_rcu(publ, rcu);
 	}
+	write_seqcount_end(&seq->seqc);
 	hlist_del_init_rcu(&seq->ns_list);
-	kfree(seq->sseqs);
+	tipc_subseq_free(seq->sseqs);
 	spin_unlock_bh(&seq->lock);
 
 	kfree_rcu(seq, rcu);
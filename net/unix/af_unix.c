@@ -1643,11 +1643,12 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
 	int data_len = 0;
 	int sk_locked;
 
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, &scm, false);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(scm.fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out;
@@ -1848,11 +1849,12 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	int max_level;
 	int data_len;
 
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, &scm, false);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(scm.fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out_err;
@@ -2245,6 +2247,31 @@ struct unix_stream_read_state {
 	unsigned int splice_flags;
 };
 
+/* Unlink and free up to 'n' fully consumed skbs from the head of the
+ * receive queue with one acquisition of the queue lock.  Only a reader
+ * holding u->iolock removes skbs, so the consumed ones are still at the
+ * head.
+ */
+static void unix_stream_drop_consumed(struct sock *sk, unsigned int n)
+{
+	struct sk_buff_head *queue = &sk->sk_receive_queue;
+	struct sk_buff_head list;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_irqsave(&queue->lock, flags);
+	while (n-- && (skb = skb_peek(queue)) != NULL && !unix_skb_len(skb)) {
+		__skb_unlink(skb, queue);
+		__skb_queue_tail(&list, skb);
+	}
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	while ((skb = __skb_dequeue(&list)) != NULL)
+		consume_skb(skb);
+}
+
 static int unix_stream_read_generic(struct unix_stream_read_state *state)
 {
 	struct scm_cookie scm;
@@ -2261,6 +2288,7 @@ static int unix_stream_read_generic(struct unix_stream_read_state *state)
 	int skip;
 	size_t size = state->size;
 	unsigned int last_len;
+	unsigned int consumed = 0;
 
 	if (unlikely(sk->sk_state != TCP_ESTABLISHED)) {
 		err = -EINVAL;
@@ -2321,6 +2349,16 @@ again:
 				break;
 			}
 
+			/* Give the writer its buffer space back before
+			 * sleeping, and never wait on a 'last' that is
+			 * about to be freed.
+			 */
+			if (consumed) {
+				unix_stream_drop_consumed(sk, consumed);
+				consumed = 0;
+				continue;
+			}
+
 			mutex_unlock(&u->iolock);
 
 			timeo = unix_stream_data_wait(sk, timeo, last,
@@ -2407,8 +2445,10 @@ unlock:
 			if (unix_skb_len(skb))
 				break;
 
-			skb_unlink(skb, &sk->sk_receive_queue);
-			consume_skb(skb);
+			/* Left on the queue, skipped as empty by the peek
+			 * above and unlinked in a batch later.
+			 */
+			consumed++;
 
 			if (scm.fp)
 				break;
@@ -2435,6 +2475,8 @@ unlock:
 		}
 	} while (size);
 
+	if (consumed)
+		unix_stream_drop_consumed(sk, consumed);
 	mutex_unlock(&u->iolock);
 	if (state->msg)
 		scm_recv(sock, state->msg, &scm, flags);
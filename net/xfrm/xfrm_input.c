@@ -15,9 +15,16 @@
 #include <net/xfrm.h>
 #include <net/ip_tunnels.h>
 #include <net/ip6_tunnel.h>
+#include <net/gro_cells.h>
 
 static struct kmem_cache *secpath_cachep __read_mostly;
 
+/* Decapsulated tunnel packets are aggregated by GRO on the CPU that
+ * finished decrypting them.
+ */
+static struct gro_cells gro_cells;
+static struct net_device xfrm_napi_dev;
+
 static DEFINE_SPINLOCK(xfrm_input_afinfo_lock);
 static struct xfrm_input_afinfo __rcu *xfrm_input_afinfo[NPROTO];
 
@@ -179,6 +186,20 @@ int xfrm_prepare_input(struct xfrm_state *x, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(xfrm_prepare_input);
 
+static int xfrm_replay_precheck(struct xfrm_state *x, struct sk_buff *skb,
+				__be32 seq)
+{
+	unsigned int start;
+	int err;
+
+	do {
+		start = read_seqcount_begin(&x->replay_seq);
+		err = x->repl->check(x, skb, seq);
+	} while (read_seqcount_retry(&x->replay_seq, start));
+
+	return err;
+}
+
 int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 {
 	struct net *net = dev_net(skb->dev);
@@ -253,34 +274,29 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 
 		skb->sp->xvec[skb->sp->len++] = x;
 
-		spin_lock(&x->lock);
-
-		if (unlikely(x->km.state != XFRM_STATE_VALID)) {
+		/* Screen the packet without x->lock so that packets of one
+		 * SA can be decrypted on several CPUs at once.  The verdict
+		 * that counts is taken under x->lock after decryption.
+		 */
+		if (unlikely(READ_ONCE(x->km.state) != XFRM_STATE_VALID)) {
 			if (x->km.state == XFRM_STATE_ACQ)
 				XFRM_INC_STATS(net, LINUX_MIB_XFRMACQUIREERROR);
 			else
 				XFRM_INC_STATS(net,
 					       LINUX_MIB_XFRMINSTATEINVALID);
-			goto drop_unlock;
+			goto drop;
 		}
 
 		if ((x->encap ? x->encap->encap_type : 0) != encap_type) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEMISMATCH);
-			goto drop_unlock;
+			goto drop;
 		}
 
-		if (x->repl->check(x, skb, seq)) {
+		if (xfrm_replay_precheck(x, skb, seq)) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATESEQERROR);
-			goto drop_unlock;
-		}
-
-		if (xfrm_state_check_expire(x)) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEEXPIRED);
-			goto drop_unlock;
+			goto drop;
 		}
 
-		spin_unlock(&x->lock);
-
 		if (xfrm_tunnel_check(skb, x, family)) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEMODEERROR);
 			goto drop;
@@ -315,12 +331,24 @@ resume:
 		/* only the first xfrm gets the encap type */
 		encap_type = 0;
 
-		if (async && x->repl->recheck(x, skb, seq)) {
+		if (unlikely(x->km.state != XFRM_STATE_VALID)) {
+			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEINVALID);
+			goto drop_unlock;
+		}
+
+		if (x->repl->recheck(x, skb, seq)) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATESEQERROR);
 			goto drop_unlock;
 		}
 
+		if (xfrm_state_check_expire(x)) {
+			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEEXPIRED);
+			goto drop_unlock;
+		}
+
+		write_seqcount_begin(&x->replay_seq);
 		x->repl->advance(x, seq);
+		write_seqcount_end(&x->replay_seq);
 
 		x->curlft.bytes += skb->len;
 		x->curlft.packets++;
@@ -371,7 +399,7 @@ resume:
 
 	if (decaps) {
 		skb_dst_drop(skb);
-		netif_rx(skb);
+		gro_cells_receive(&gro_cells, skb);
 		return 0;
 	} else {
 		return x->inner_mode->afinfo->transport_finish(skb, async);
@@ -394,6 +422,13 @@ EXPORT_SYMBOL(xfrm_input_resume);
 
 void __init xfrm_input_init(void)
 {
+	int err;
+
+	init_dummy_netdev(&xfrm_napi_dev);
+	err = gro_cells_init(&gro_cells, &xfrm_napi_dev);
+	if (err)
+		gro_cells.cells = NULL;
+
 	secpath_cachep = kmem_cache_create("secpath_cache",
 					   sizeof(struct sec_path),
 					   0, SLAB_HWCACHE_ALIGN|SLAB_PANIC,
@@ -290,6 +290,7 @@ struct xfrm_policy *xfrm_policy_alloc(struct net *net, gfp_t gfp)
 		INIT_LIST_HEAD(&policy->walk.all);
 		INIT_HLIST_NODE(&policy->bydst);
 		INIT_HLIST_NODE(&policy->byidx);
+		INIT_HLIST_NODE(&policy->bybin);
 		rwlock_init(&policy->lock);
 		atomic_set(&policy->refcnt, 1);
 		skb_queue_head_init(&policy->polq.hold_queue);
@@ -406,6 +407,202 @@ static struct hlist_head *policy_hash_direct(struct net *net,
 	return net->xfrm.policy_bydst[dir].table + hash;
 }
 
+/* Inexact policies are also indexed by the prefix lengths of their
+ * selector.  A bin holds the policies of one (family, prefixlen_d,
+ * prefixlen_s) class, hashed by their masked addresses, so a lookup costs
+ * one probe per class in use instead of a walk over every inexact policy.
+ * Chains keep the order of the inexact list: priority, then age.
+ *
+ * If memory for a bin runs out the direction falls back to the linear
+ * walk until its inexact list is empty or the hash is rebuilt.
+ */
+struct xfrm_pol_inexact_bin {
+	struct hlist_node	node;
+	unsigned short		family;
+	u8			dbits;
+	u8			sbits;
+	unsigned int		count;
+	unsigned int		hmask;
+	struct hlist_head	*table;
+};
+
+#define XFRM_POL_BIN_MIN_HSIZE	16
+#define XFRM_POL_BIN_MAX_HSIZE	8192
+
+static struct hlist_head *
+xfrm_pol_bin_chain(const struct xfrm_pol_inexact_bin *bin,
+		   const xfrm_address_t *daddr, const xfrm_address_t *saddr)
+{
+	unsigned int h;
+
+	if (bin->family == AF_INET)
+		h = __xfrm4_dpref_spref_hash(daddr, saddr, bin->dbits, bin->sbits);
+	else
+		h = __xfrm6_dpref_spref_hash(daddr, saddr, bin->dbits, bin->sbits);
+
+	return bin->table + (h & bin->hmask);
+}
+
+/* Does inexact policy 'a' take precedence over 'b'?  Policies from the
+ * bydst hash win ties against inexact ones.
+ */
+static bool xfrm_pol_inexact_before(const struct xfrm_policy *a,
+				    const struct xfrm_policy *b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	if (hlist_unhashed(&b->bybin))
+		return false;
+	return a->pos < b->pos;
+}
+
+static void xfrm_pol_bin_add(struct xfrm_pol_inexact_bin *bin,
+			     struct xfrm_policy *policy)
+{
+	struct hlist_node *newpos = NULL;
+	struct hlist_head *chain;
+	struct xfrm_policy *pol;
+
+	chain = xfrm_pol_bin_chain(bin, &policy->selector.daddr,
+				   &policy->selector.saddr);
+	hlist_for_each_entry(pol, chain, bybin) {
+		if (xfrm_pol_inexact_before(policy, pol))
+			break;
+		newpos = &pol->bybin;
+	}
+	if (newpos)
+		hlist_add_behind(&policy->bybin, newpos);
+	else
+		hlist_add_head(&policy->bybin, chain);
+}
+
+static void xfrm_pol_bin_grow(struct xfrm_pol_inexact_bin *bin)
+{
+	unsigned int nsize = (bin->hmask + 1) * 2;
+	unsigned int ohmask = bin->hmask;
+	struct hlist_head *otable = bin->table;
+	struct hlist_head *ntable;
+	unsigned int i;
+
+	if (nsize > XFRM_POL_BIN_MAX_HSIZE)
+		return;
+
+	ntable = kcalloc(nsize, sizeof(*ntable), GFP_ATOMIC | __GFP_NOWARN);
+	if (!ntable)
+		return;
+
+	bin->table = ntable;
+	bin->hmask = nsize - 1;
+	for (i = 0; i <= ohmask; i++) {
+		while (!hlist_empty(otable + i)) {
+			struct xfrm_policy *pol;
+
+			pol = hlist_entry(otable[i].first, struct xfrm_policy,
+					  bybin);
+			hlist_del(&pol->bybin);
+			xfrm_pol_bin_add(bin, pol);
+		}
+	}
+	kfree(otable);
+}
+
+static struct xfrm_pol_inexact_bin *
+xfrm_pol_bin_find(struct net *net, const struct xfrm_policy *pol, int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+
+	hlist_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], node) {
+		if (bin->family == pol->family &&
+		    bin->dbits == pol->selector.prefixlen_d &&
+		    bin->sbits == pol->selector.prefixlen_s)
+			return bin;
+	}
+	return NULL;
+}
+
+static void xfrm_pol_bin_free(struct xfrm_pol_inexact_bin *bin)
+{
+	hlist_del(&bin->node);
+	kfree(bin->table);
+	kfree(bin);
+}
+
+static void xfrm_pol_bins_free(struct net *net, int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry_safe(bin, tmp,
+				  &net->xfrm.policy_inexact_bins[dir], node)
+		xfrm_pol_bin_free(bin);
+}
+
+static void xfrm_pol_bins_disable(struct net *net, int dir)
+{
+	struct xfrm_policy *pol;
+
+	xfrm_pol_bins_free(net, dir);
+	hlist_for_each_entry(pol, &net->xfrm.policy_inexact[dir], bydst)
+		INIT_HLIST_NODE(&pol->bybin);
+	net->xfrm.policy_inexact_binned[dir] = false;
+}
+
+/* Called with xfrm_policy_lock held for writing, once 'policy' has been
+ * added to the inexact list of 'dir'.
+ */
+static void xfrm_pol_inexact_link(struct net *net, struct xfrm_policy *policy,
+				  int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+
+	if (!net->xfrm.policy_inexact_binned[dir])
+		return;
+
+	bin = xfrm_pol_bin_find(net, policy, dir);
+	if (!bin) {
+		bin = kzalloc(sizeof(*bin), GFP_ATOMIC);
+		if (!bin)
+			goto disable;
+		bin->table = kcalloc(XFRM_POL_BIN_MIN_HSIZE,
+				     sizeof(struct hlist_head), GFP_ATOMIC);
+		if (!bin->table) {
+			kfree(bin);
+			goto disable;
+		}
+		bin->family = policy->family;
+		bin->dbits = policy->selector.prefixlen_d;
+		bin->sbits = policy->selector.prefixlen_s;
+		bin->hmask = XFRM_POL_BIN_MIN_HSIZE - 1;
+		hlist_add_head(&bin->node, &net->xfrm.policy_inexact_bins[dir]);
+	}
+
+	if (bin->count > bin->hmask)
+		xfrm_pol_bin_grow(bin);
+
+	xfrm_pol_bin_add(bin, policy);
+	bin->count++;
+	return;
+
+disable:
+	xfrm_pol_bins_disable(net, dir);
+}
+
+static void xfrm_pol_inexact_unlink(struct net *net, struct xfrm_policy *pol,
+				    int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+
+	if (!hlist_unhashed(&pol->bybin)) {
+		bin = xfrm_pol_bin_find(net, pol, dir);
+		hlist_del_init(&pol->bybin);
+		if (!--bin->count)
+			xfrm_pol_bin_free(bin);
+	}
+
+	if (hlist_empty(&net->xfrm.policy_inexact[dir]))
+		net->xfrm.policy_inexact_binned[dir] = true;
+}
+
 static void xfrm_dst_hash_transfer(struct net *net,
 				   struct hlist_head *list,
 				   struct hlist_head *ndsttable,
@@ -605,6 +802,8 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 	/* reset the bydst and inexact table in all directions */
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
 		INIT_HLIST_HEAD(&net->xfrm.policy_inexact[dir]);
+		xfrm_pol_bins_free(net, dir);
+		net->xfrm.policy_inexact_binned[dir] = true;
 		hmask = net->xfrm.policy_bydst[dir].hmask;
 		odst = net->xfrm.policy_bydst[dir].table;
 		for (i = hmask; i >= 0; i--)
@@ -627,9 +826,9 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 	/* re-insert all policies by order of creation */
 	list_for_each_entry_reverse(policy, &net->xfrm.policy_all, walk.all) {
 		newpos = NULL;
+		dir = xfrm_policy_id2dir(policy->index);
 		chain = policy_hash_bysel(net, &policy->selector,
-					  policy->family,
-					  xfrm_policy_id2dir(policy->index));
+					  policy->family, dir);
 		hlist_for_each_entry(pol, chain, bydst) {
 			if (policy->priority >= pol->priority)
 				newpos = &pol->bydst;
@@ -640,6 +839,10 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 			hlist_add_behind(&policy->bydst, newpos);
 		else
 			hlist_add_head(&policy->bydst, chain);
+
+		INIT_HLIST_NODE(&policy->bybin);
+		if (chain == &net->xfrm.policy_inexact[dir])
+			xfrm_pol_inexact_link(net, policy, dir);
 	}
 
 	write_unlock_bh(&net->xfrm.xfrm_policy_lock);
@@ -781,6 +984,9 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 		hlist_add_behind(&policy->bydst, newpos);
 	else
 		hlist_add_head(&policy->bydst, chain);
+	policy->pos = net->xfrm.policy_pos++;
+	if (chain == &net->xfrm.policy_inexact[dir])
+		xfrm_pol_inexact_link(net, policy, dir);
 	__xfrm_policy_link(policy, dir);
 	atomic_inc(&net->xfrm.flow_cache_genid);
 
@@ -1088,6 +1294,43 @@ static int xfrm_policy_match(const struct xfrm_policy *pol,
 	return ret;
 }
 
+/* Find the inexact policy that takes precedence over 'ret', the best
+ * match so far, if there is one.
+ */
+static struct xfrm_policy *
+xfrm_policy_inexact_lookup(struct net *net, u8 type, const struct flowi *fl,
+			   u16 family, u8 dir, struct xfrm_policy *ret)
+{
+	const xfrm_address_t *daddr = xfrm_flowi_daddr(fl, family);
+	const xfrm_address_t *saddr = xfrm_flowi_saddr(fl, family);
+	struct xfrm_pol_inexact_bin *bin;
+	struct xfrm_policy *pol;
+	int ret_err = 0;
+	int err;
+
+	hlist_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], node) {
+		if (bin->family != family)
+			continue;
+
+		hlist_for_each_entry(pol, xfrm_pol_bin_chain(bin, daddr, saddr),
+				     bybin) {
+			if (ret && !xfrm_pol_inexact_before(pol, ret))
+				break;
+
+			err = xfrm_policy_match(pol, fl, type, family, dir);
+			if (err == -ESRCH)
+				continue;
+
+			/* The linear walk would have stopped here too. */
+			ret = pol;
+			ret_err = err;
+			break;
+		}
+	}
+
+	return ret_err ? ERR_PTR(ret_err) : ret;
+}
+
 static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 						     const struct flowi *fl,
 						     u16 family, u8 dir)
@@ -1121,22 +1364,29 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 			break;
 		}
 	}
-	chain = &net->xfrm.policy_inexact[dir];
-	hlist_for_each_entry(pol, chain, bydst) {
-		if ((pol->priority >= priority) && ret)
-			break;
+	if (net->xfrm.policy_inexact_binned[dir]) {
+		ret = xfrm_policy_inexact_lookup(net, type, fl, family, dir,
+						 ret);
+		if (IS_ERR(ret))
+			goto fail;
+	} else {
+		chain = &net->xfrm.policy_inexact[dir];
+		hlist_for_each_entry(pol, chain, bydst) {
+			if ((pol->priority >= priority) && ret)
+				break;
 
-		err = xfrm_policy_match(pol, fl, type, family, dir);
-		if (err) {
-			if (err == -ESRCH)
-				continue;
-			else {
-				ret = ERR_PTR(err);
-				goto fail;
+			err = xfrm_policy_match(pol, fl, type, family, dir);
+			if (err) {
+				if (err == -ESRCH)
+					continue;
+				else {
+					ret = ERR_PTR(err);
+					goto fail;
+				}
+			} else {
+				ret = pol;
+				break;
 			}
-		} else {
-			ret = pol;
-			break;
 		}
 	}
 
@@ -1273,6 +1523,8 @@ static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
 	if (!hlist_unhashed(&pol->bydst)) {
 		hlist_del(&pol->bydst);
 		hlist_del(&pol->byidx);
+		if (dir < XFRM_POLICY_MAX)
+			xfrm_pol_inexact_unlink(net, pol, dir);
 	}
 
 	list_del_init(&pol->walk.all);
@@ -2507,7 +2759,9 @@ int __xfrm_policy_check(struct sock *sk, int dir, struct sk_buff *skb,
 		}
 	}
 
-	if (!pol) {
+	if (!pol && !net->xfrm.sysctl_policy_flowcache) {
+		pol = __xfrm_policy_lookup(net, &fl, family, dir);
+	} else if (!pol) {
 		struct flow_cache_object *flo;
 
 		flo = flow_cache_lookup(net, &fl, family, fl_dir,
@@ -2960,6 +3214,8 @@ static int __net_init xfrm_policy_init(struct net *net)
 		net->xfrm.policy_count[dir] = 0;
 		net->xfrm.policy_count[XFRM_POLICY_MAX + dir] = 0;
 		INIT_HLIST_HEAD(&net->xfrm.policy_inexact[dir]);
+		INIT_HLIST_HEAD(&net->xfrm.policy_inexact_bins[dir]);
+		net->xfrm.policy_inexact_binned[dir] = true;
 
 		htab = &net->xfrm.policy_bydst[dir];
 		htab->table = xfrm_hash_alloc(sz);
@@ -3014,6 +3270,7 @@ static void xfrm_policy_fini(struct net *net)
 		struct xfrm_policy_hash *htab;
 
 		WARN_ON(!hlist_empty(&net->xfrm.policy_inexact[dir]));
+		WARN_ON(!hlist_empty(&net->xfrm.policy_inexact_bins[dir]));
 
 		htab = &net->xfrm.policy_bydst[dir];
 		sz = (htab->hmask + 1) * sizeof(struct hlist_head);
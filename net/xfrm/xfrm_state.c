@@ -493,6 +493,7 @@ struct xfrm_state *xfrm_state_alloc(struct net *net)
 		x->inner_mode = NULL;
 		x->inner_mode_iaf = NULL;
 		spin_lock_init(&x->lock);
+		seqcount_init(&x->replay_seq);
 	}
 	return x;
 }
@@ -493,6 +493,7 @@ static void xfrm_update_ae_params(struct xfrm_state *x, struct nlattr **attrs,
 	struct nlattr *et = attrs[XFRMA_ETIMER_THRESH];
 	struct nlattr *rt = attrs[XFRMA_REPLAY_THRESH];
 
+	write_seqcount_begin(&x->replay_seq);
 	if (re) {
 		struct xfrm_replay_state_esn *replay_esn;
 		replay_esn = nla_data(re);
@@ -508,6 +509,7 @@ static void xfrm_update_ae_params(struct xfrm_state *x, struct nlattr **attrs,
 		memcpy(&x->replay, replay, sizeof(*replay));
 		memcpy(&x->preplay, replay, sizeof(*replay));
 	}
+	write_seqcount_end(&x->replay_seq);
 
 	if (lt) {
 		struct xfrm_lifetime_cur *ltime;
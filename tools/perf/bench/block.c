@@ -0,0 +1,198 @@
+/*
+ * block.c
+ *
+ * dio: direct IO through the block layer
+ *
+ * Each thread keeps one O_DIRECT read (or with --write, write) of
+ * --block-size bytes in flight against the device, so --depth threads
+ * keep that many requests queued.  Pointed at a null_blk device
+ * (modprobe null_blk), this measures the submission and completion cost
+ * of the block layer and blk-mq rather than that of any hardware.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static const char *path		= "/dev/nullb0";
+static unsigned int depth	= 1;
+static unsigned int block_size	= 4096;
+static unsigned int nsecs	= 5;
+static bool do_write, sequential, scale, silent;
+static volatile bool done;
+
+static int fd;
+static u64 nr_blocks;
+
+struct worker {
+	int		nr;
+	pthread_t	thread;
+	unsigned long	ops;
+	unsigned long	errors;
+};
+
+static const struct option options[] = {
+	OPT_STRING(  'f', "file",	&path,		"path", "Block device or file to do IO to (default: /dev/nullb0)"),
+	OPT_UINTEGER('d', "depth",	&depth,		"Number of IOs in flight, one per thread"),
+	OPT_UINTEGER('b', "block-size",	&block_size,	"IO size in bytes"),
+	OPT_UINTEGER('r', "runtime",	&nsecs,		"Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 'w', "write",	&do_write,	"Write instead of read, destroys the device contents"),
+	OPT_BOOLEAN( 's', "sequential",	&sequential,	"Sequential instead of random offsets"),
+	OPT_BOOLEAN( 'c', "scale",	&scale,		"Run with depths 1, 2, 4, ... up to --depth"),
+	OPT_BOOLEAN( 'S', "silent",	&silent,	"Silent mode: do not display per thread results"),
+	OPT_END()
+};
+
+static const char * const bench_block_dio_usage[] = {
+	"perf bench block dio <options>",
+	NULL
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->nr;
+	/* sequential streams start spread out over the device */
+	u64 block = w->nr * (nr_blocks / depth);
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, block_size))
+		err(EXIT_FAILURE, "posix_memalign");
+	memset(buf, 0x5a, block_size);
+
+	while (!done) {
+		off_t off;
+		ssize_t ret;
+
+		if (sequential)
+			block = (block + 1) % nr_blocks;
+		else
+			block = (((u64)rand_r(&seed) << 31) ^ rand_r(&seed)) % nr_blocks;
+		off = block * block_size;
+
+		if (do_write)
+			ret = pwrite(fd, buf, block_size, off);
+		else
+			ret = pread(fd, buf, block_size, off);
+		if (ret == (ssize_t)block_size)
+			w->ops++;
+		else
+			w->errors++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void run(unsigned int nr)
+{
+	struct timeval start, end, runtime;
+	struct stats throughput_stats;
+	unsigned long total = 0, errors = 0;
+	struct worker *workers;
+	unsigned int i;
+	double usecs;
+
+	workers = calloc(nr, sizeof(*workers));
+	if (!workers)
+		err(EXIT_FAILURE, "calloc");
+
+	done = false;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		workers[i].nr = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(nsecs);
+	done = true;
+
+	for (i = 0; i < nr; i++)
+		pthread_join(workers[i].thread, NULL);
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+	usecs = runtime.tv_sec * 1000000.0 + runtime.tv_usec;
+
+	init_stats(&throughput_stats);
+	for (i = 0; i < nr; i++) {
+		update_stats(&throughput_stats, workers[i].ops * 1000000.0 / usecs);
+		total += workers[i].ops;
+		errors += workers[i].errors;
+		if (!silent && bench_format == BENCH_FORMAT_DEFAULT)
+			printf("[thread %3d] %lu IOPS\n", i,
+			       (unsigned long)(workers[i].ops * 1000000.0 / usecs));
+	}
+	free(workers);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("depth %3u: %.0f IOPS, %.2f MB/sec, %.3f usecs/IO",
+		       nr, total * 1000000.0 / usecs,
+		       (double)total * block_size / usecs,
+		       total ? usecs * nr / total : 0.0);
+		if (errors)
+			printf(", %lu failed", errors);
+		printf("\n");
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%u %.0f\n", nr, total * 1000000.0 / usecs);
+		break;
+	default:
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+}
+
+int bench_block_dio(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	unsigned int nr;
+	off_t size;
+
+	argc = parse_options(argc, argv, options, bench_block_dio_usage, 0);
+	if (argc || !depth || !block_size || block_size % 512) {
+		usage_with_options(bench_block_dio_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	fd = open(path, (do_write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+	if (fd < 0) {
+		/* not fatal for 'perf bench all' on machines without null_blk */
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	size = lseek(fd, 0, SEEK_END);
+	nr_blocks = size > 0 ? size / block_size : 0;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s is smaller than one block\n", path);
+		close(fd);
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %s direct %ss of %u bytes on %s for %u secs\n\n",
+		       sequential ? "sequential" : "random",
+		       do_write ? "write" : "read", block_size, path, nsecs);
+
+	nr = scale ? 1 : depth;
+	for (;;) {
+		run(nr);
+		if (nr >= depth)
+			break;
+		nr = min(nr * 2, depth);
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * epoll.c
+ *
+ * wait: wakeup storms through epoll
+ *
+ * Writer threads signal a set of eventfds as fast as they can.  Waiter
+ * threads sit in epoll_wait() on them and consume every event they are
+ * handed.  By default all the waiters share one epoll instance, so every
+ * signal goes through the same ready list and wait queue.  With --multiq
+ * each waiter gets its own instance, watching its own share of the
+ * eventfds.  The count of events consumed per second shows how
+ * ep_poll_callback() and the wakeups scale with the number of waiters.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static unsigned int nwaiters;
+static unsigned int nwriters	= 1;
+static unsigned int nfds	= 64;
+static unsigned int nsecs	= 5;
+static bool edge, multiq, scale, silent;
+static volatile bool done;
+
+static int *fds;
+static int *epfds;
+
+struct worker {
+	int		nr;
+	pthread_t	thread;
+	unsigned long	ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",	&nwaiters,	"Number of waiter threads (default: number of CPUs)"),
+	OPT_UINTEGER('w', "writers",	&nwriters,	"Number of writer threads"),
+	OPT_UINTEGER('f', "fds",	&nfds,		"Number of eventfds"),
+	OPT_UINTEGER('r', "runtime",	&nsecs,		"Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 'e', "edge",	&edge,		"Use edge triggered events"),
+	OPT_BOOLEAN( 'm', "multiq",	&multiq,	"One epoll instance per waiter instead of a shared one"),
+	OPT_BOOLEAN( 'c', "scale",	&scale,		"Run with 1, 2, 4, ... waiters up to --threads"),
+	OPT_BOOLEAN( 'S', "silent",	&silent,	"Silent mode: do not display per thread results"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static void *waiter_fn(void *arg)
+{
+	struct worker *w = arg;
+	int epfd = epfds[multiq ? w->nr : 0];
+	struct epoll_event ev;
+	u64 val;
+
+	while (!done) {
+		/* time out now and then to notice the end of the run */
+		if (epoll_wait(epfd, &ev, 1, 100) != 1)
+			continue;
+		/* another waiter may have consumed it already */
+		if (read(fds[ev.data.u32], &val, sizeof(val)) == sizeof(val))
+			w->ops++;
+	}
+
+	return NULL;
+}
+
+static void *writer_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i = w->nr;
+	u64 val = 1;
+
+	while (!done) {
+		if (write(fds[i], &val, sizeof(val)) == sizeof(val))
+			w->ops++;
+		i += nwriters;
+		if (i >= nfds)
+			i = w->nr;
+	}
+
+	return NULL;
+}
+
+static void run(unsigned int nr)
+{
+	struct timeval start, end, runtime;
+	struct stats throughput_stats;
+	struct worker *waiters, *writers;
+	unsigned long total = 0, signals = 0;
+	unsigned int i, nr_ep = multiq ? nr : 1;
+	double usecs;
+
+	waiters = calloc(nr, sizeof(*waiters));
+	writers = calloc(nwriters, sizeof(*writers));
+	fds = calloc(nfds, sizeof(*fds));
+	epfds = calloc(nr_ep, sizeof(*epfds));
+	if (!waiters || !writers || !fds || !epfds)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nr_ep; i++) {
+		epfds[i] = epoll_create1(0);
+		if (epfds[i] < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	for (i = 0; i < nfds; i++) {
+		struct epoll_event ev = {
+			.events	  = EPOLLIN | (edge ? EPOLLET : 0),
+			.data.u32 = i,
+		};
+
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0)
+			err(EXIT_FAILURE, "eventfd");
+		if (epoll_ctl(epfds[i % nr_ep], EPOLL_CTL_ADD, fds[i], &ev))
+			err(EXIT_FAILURE, "epoll_ctl");
+	}
+
+	done = false;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		waiters[i].nr = i;
+		if (pthread_create(&waiters[i].thread, NULL, waiter_fn, &waiters[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	for (i = 0; i < nwriters; i++) {
+		writers[i].nr = i;
+		if (pthread_create(&writers[i].thread, NULL, writer_fn, &writers[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(nsecs);
+	done = true;
+
+	for (i = 0; i < nwriters; i++) {
+		pthread_join(writers[i].thread, NULL);
+		signals += writers[i].ops;
+	}
+	for (i = 0; i < nr; i++)
+		pthread_join(waiters[i].thread, NULL);
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+	usecs = runtime.tv_sec * 1000000.0 + runtime.tv_usec;
+
+	init_stats(&throughput_stats);
+	for (i = 0; i < nr; i++) {
+		update_stats(&throughput_stats, waiters[i].ops * 1000000.0 / usecs);
+		total += waiters[i].ops;
+		if (!silent && bench_format == BENCH_FORMAT_DEFAULT)
+			printf("[thread %3d] %lu events/sec\n", i,
+			       (unsigned long)(waiters[i].ops * 1000000.0 / usecs));
+	}
+
+	for (i = 0; i < nfds; i++)
+		close(fds[i]);
+	for (i = 0; i < nr_ep; i++)
+		close(epfds[i]);
+	free(epfds);
+	free(fds);
+	free(writers);
+	free(waiters);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT: {
+		double avg = avg_stats(&throughput_stats);
+
+		printf("%3u waiters: %.0f events/sec per waiter (+- %.2f%%), %.0f total, %.0f signals/sec\n",
+		       nr, avg,
+		       rel_stddev_stats(stddev_stats(&throughput_stats), avg),
+		       total * 1000000.0 / usecs, signals * 1000000.0 / usecs);
+		break;
+	}
+	case BENCH_FORMAT_SIMPLE:
+		printf("%u %.0f\n", nr, total * 1000000.0 / usecs);
+		break;
+	default:
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	unsigned int nr;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || !nfds || !nwriters) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nwaiters)
+		nwaiters = sysconf(_SC_NPROCESSORS_ONLN);
+	nwriters = min(nwriters, nfds);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u writers signalling %u %s triggered eventfds through %s for %u secs\n\n",
+		       nwriters, nfds, edge ? "edge" : "level",
+		       multiq ? "one epoll instance per waiter" :
+				"a shared epoll instance",
+		       nsecs);
+
+	nr = scale ? 1 : nwaiters;
+	for (;;) {
+		run(nr);
+		if (nr >= nwaiters)
+			break;
+		nr = min(nr * 2, nwaiters);
+	}
+
+	return 0;
+}
@@ -10,3 +10,7 @@ MEMCPY_FN(__memcpy,
 MEMCPY_FN(memcpy_erms,
 	"x86-64-movsb",
 	"movsb-based memcpy() in arch/x86/lib/memcpy_64.S")
+
+MEMCPY_FN(memcpy_erms_sized,
+	"x86-64-movsb-sized",
+	"movsb-based memcpy() in arch/x86/lib/memcpy_64.S, unrolled below 64 bytes")
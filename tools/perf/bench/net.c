@@ -0,0 +1,345 @@
+/*
+ * net.c
+ *
+ * tcp, udp, unix: round trips over loopback sockets
+ *
+ * Each client thread sends a message to its own server thread and waits
+ * for it to be echoed back, for --runtime seconds.  This measures the per
+ * message cost of the socket layer, the protocol and the loopback device,
+ * and with --scale how that holds up as pairs are added across the CPUs.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+enum net_proto {
+	NET_TCP,
+	NET_UDP,
+	NET_UNIX,
+};
+
+static const char * const proto_names[] = {
+	[NET_TCP]	= "tcp",
+	[NET_UDP]	= "udp",
+	[NET_UNIX]	= "unix",
+};
+
+static unsigned int npairs;
+static unsigned int nsecs	= 5;
+static unsigned int msg_size	= 64;
+static bool bind_cpus, scale, silent;
+static volatile bool done;
+
+struct pair {
+	int		nr;
+	int		client_fd;
+	int		server_fd;
+	pthread_t	client;
+	pthread_t	server;
+	unsigned long	ops;
+	unsigned long	lost;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('p', "pairs",	&npairs,	"Number of client/server thread pairs (default: number of CPUs)"),
+	OPT_UINTEGER('r', "runtime",	&nsecs,		"Specify runtime (in seconds)"),
+	OPT_UINTEGER('s', "size",	&msg_size,	"Message size in bytes"),
+	OPT_BOOLEAN( 'b', "bind",	&bind_cpus,	"Run both threads of pair N on CPU N"),
+	OPT_BOOLEAN( 'c', "scale",	&scale,		"Run with 1, 2, 4, ... pairs up to --pairs"),
+	OPT_BOOLEAN( 'S', "silent",	&silent,	"Silent mode: do not display per pair results"),
+	OPT_END()
+};
+
+static const char * const bench_net_usage[] = {
+	"perf bench net <tcp|udp|unix> <options>",
+	NULL
+};
+
+/* Stream sockets may return short counts, datagrams come in one piece */
+static int xfer(int fd, char *buf, bool out)
+{
+	size_t len = 0;
+
+	while (len < msg_size) {
+		ssize_t ret;
+
+		if (out)
+			ret = send(fd, buf + len, msg_size - len, 0);
+		else
+			ret = recv(fd, buf + len, msg_size - len, 0);
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			return -EPIPE;
+		len += ret;
+	}
+
+	return 0;
+}
+
+static void bind_thread(int nr)
+{
+	unsigned int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cpu;
+
+	if (!bind_cpus)
+		return;
+
+	CPU_ZERO(&cpu);
+	CPU_SET(nr % ncpus, &cpu);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu))
+		err(EXIT_FAILURE, "pthread_setaffinity_np");
+}
+
+static void *server_fn(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = malloc(msg_size);
+
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+	bind_thread(p->nr);
+
+	/* until the main thread shuts the socket down */
+	while (!xfer(p->server_fd, buf, false) &&
+	       !xfer(p->server_fd, buf, true))
+		;
+
+	free(buf);
+	return NULL;
+}
+
+static void *client_fn(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = malloc(msg_size);
+	int ret;
+
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+	memset(buf, 0x5a, msg_size);
+	bind_thread(p->nr);
+
+	while (!done) {
+		ret = xfer(p->client_fd, buf, true);
+		if (!ret)
+			ret = xfer(p->client_fd, buf, false);
+		/* a datagram got dropped, the receive timed out */
+		if (ret == -EAGAIN) {
+			p->lost++;
+			continue;
+		}
+		if (ret) {
+			warnx("pair %d: %s", p->nr, strerror(-ret));
+			break;
+		}
+		p->ops++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void setup_tcp(struct pair *p)
+{
+	struct sockaddr_in addr = {
+		.sin_family	 = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int one = 1;
+	int lfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, len) ||
+	    listen(lfd, 1) || getsockname(lfd, (struct sockaddr *)&addr, &len))
+		err(EXIT_FAILURE, "tcp listen");
+
+	p->client_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (p->client_fd < 0 ||
+	    connect(p->client_fd, (struct sockaddr *)&addr, len))
+		err(EXIT_FAILURE, "tcp connect");
+	p->server_fd = accept(lfd, NULL, NULL);
+	if (p->server_fd < 0)
+		err(EXIT_FAILURE, "tcp accept");
+	close(lfd);
+
+	setsockopt(p->client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	setsockopt(p->server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void setup_udp(struct pair *p)
+{
+	struct sockaddr_in caddr = {
+		.sin_family	 = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	struct sockaddr_in saddr = caddr;
+	struct timeval tv = { .tv_usec = 100000, };
+	socklen_t len = sizeof(caddr);
+
+	p->client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	p->server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (p->client_fd < 0 || p->server_fd < 0 ||
+	    bind(p->client_fd, (struct sockaddr *)&caddr, len) ||
+	    bind(p->server_fd, (struct sockaddr *)&saddr, len) ||
+	    getsockname(p->client_fd, (struct sockaddr *)&caddr, &len) ||
+	    getsockname(p->server_fd, (struct sockaddr *)&saddr, &len) ||
+	    connect(p->client_fd, (struct sockaddr *)&saddr, len) ||
+	    connect(p->server_fd, (struct sockaddr *)&caddr, len))
+		err(EXIT_FAILURE, "udp setup");
+
+	/* don't wait forever for an echo that was dropped */
+	setsockopt(p->client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void setup_unix(struct pair *p)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		err(EXIT_FAILURE, "socketpair");
+	p->client_fd = fds[0];
+	p->server_fd = fds[1];
+}
+
+static void run(enum net_proto proto, unsigned int nr)
+{
+	struct timeval start, end, runtime;
+	struct stats throughput_stats;
+	unsigned long total = 0, lost = 0;
+	struct pair *pairs;
+	double usecs;
+	unsigned int i;
+
+	pairs = calloc(nr, sizeof(*pairs));
+	if (!pairs)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nr; i++) {
+		pairs[i].nr = i;
+		switch (proto) {
+		case NET_TCP:
+			setup_tcp(&pairs[i]);
+			break;
+		case NET_UDP:
+			setup_udp(&pairs[i]);
+			break;
+		case NET_UNIX:
+			setup_unix(&pairs[i]);
+			break;
+		}
+	}
+
+	done = false;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&pairs[i].server, NULL, server_fn, &pairs[i]) ||
+		    pthread_create(&pairs[i].client, NULL, client_fn, &pairs[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(nsecs);
+	done = true;
+
+	for (i = 0; i < nr; i++)
+		pthread_join(pairs[i].client, NULL);
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+	usecs = runtime.tv_sec * 1000000.0 + runtime.tv_usec;
+
+	init_stats(&throughput_stats);
+	for (i = 0; i < nr; i++) {
+		struct pair *p = &pairs[i];
+
+		shutdown(p->server_fd, SHUT_RDWR);
+		pthread_join(p->server, NULL);
+		close(p->server_fd);
+		close(p->client_fd);
+
+		update_stats(&throughput_stats, p->ops * 1000000.0 / usecs);
+		total += p->ops;
+		lost += p->lost;
+		if (!silent && bench_format == BENCH_FORMAT_DEFAULT)
+			printf("[pair %3d] %lu round trips/sec\n", p->nr,
+			       (unsigned long)(p->ops * 1000000.0 / usecs));
+	}
+	free(pairs);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT: {
+		double avg = avg_stats(&throughput_stats);
+
+		printf("%s %3u pairs: %.0f round trips/sec per pair (+- %.2f%%), %.0f total, %.3f usecs/round trip",
+		       proto_names[proto], nr, avg,
+		       rel_stddev_stats(stddev_stats(&throughput_stats), avg),
+		       total * 1000000.0 / usecs,
+		       total ? usecs * nr / total : 0.0);
+		if (lost)
+			printf(", %lu lost", lost);
+		printf("\n");
+		break;
+	}
+	case BENCH_FORMAT_SIMPLE:
+		printf("%u %.0f\n", nr, total * 1000000.0 / usecs);
+		break;
+	default:
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+}
+
+static int bench_net(int argc, const char **argv, enum net_proto proto)
+{
+	unsigned int nr;
+
+	argc = parse_options(argc, argv, options, bench_net_usage, 0);
+	if (argc || !msg_size) {
+		usage_with_options(bench_net_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!npairs)
+		npairs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %s round trips of %u bytes over loopback for %u secs\n\n",
+		       proto_names[proto], msg_size, nsecs);
+
+	nr = scale ? 1 : npairs;
+	for (;;) {
+		run(proto, nr);
+		if (nr >= npairs)
+			break;
+		nr = min(nr * 2, npairs);
+	}
+
+	return 0;
+}
+
+int bench_net_tcp(int argc, const char **argv, const char *prefix __maybe_unused)
+{
+	return bench_net(argc, argv, NET_TCP);
+}
+
+int bench_net_udp(int argc, const char **argv, const char *prefix __maybe_unused)
+{
+	return bench_net(argc, argv, NET_UDP);
+}
+
+int bench_net_unix(int argc, const char **argv, const char *prefix __maybe_unused)
+{
+	return bench_net(argc, argv, NET_UNIX);
+}
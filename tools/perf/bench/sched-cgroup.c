@@ -0,0 +1,274 @@
+/*
+ *
+ * sched-cgroup.c
+ *
+ * cgroup: Benchmark for switching between cgroups with perf events
+ *
+ * Two processes bound to one cpu ping-pong over a pipe like in the pipe
+ * benchmark, each from its own perf_event cgroup, so every context switch
+ * is also a cgroup switch.  The loop is timed once as is and once with a
+ * cgroup event open on that cpu for each of the created cgroups, and the
+ * difference is the cost the events add to a switch.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../util/cgroup.h"
+#include "../util/cloexec.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 100000
+static int			loops = LOOPS_DEFAULT;
+
+#define NR_CGROUPS_DEFAULT 100
+static int			nr_cgroups_opt = NR_CGROUPS_DEFAULT;
+
+static int			cpu;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops"),
+	OPT_INTEGER('n', "nr-cgroups",	&nr_cgroups_opt, "Specify number of monitored cgroups (at least 2)"),
+	OPT_INTEGER('c', "cpu",		&cpu,		"Specify the cpu to switch on"),
+	OPT_END()
+};
+
+static const char * const bench_sched_cgroup_usage[] = {
+	"perf bench sched cgroup <options>",
+	NULL
+};
+
+static char mnt[PATH_MAX + 1];
+
+static int cgroup_path(char *buf, int i)
+{
+	if (i < 0)
+		return scnprintf(buf, PATH_MAX, "%s", mnt);
+
+	return scnprintf(buf, PATH_MAX, "%s/perf-bench-%d-%d",
+			 mnt, (int)getpid(), i);
+}
+
+static int cgroup_enter(int i)
+{
+	char path[PATH_MAX + 1], pid[16];
+	int fd, len, ret;
+
+	len = cgroup_path(path, i);
+	scnprintf(path + len, PATH_MAX - len, "/tasks");
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = scnprintf(pid, sizeof(pid), "%d", (int)getpid());
+	ret = write(fd, pid, len) == len ? 0 : -errno;
+	close(fd);
+
+	return ret;
+}
+
+static void bind_to_cpu(void)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	BUG_ON(sched_setaffinity(0, sizeof(mask), &mask));
+}
+
+static void worker(int nr, int pipe_read, int pipe_write)
+{
+	int m = 0, i;
+	int __maybe_unused ret;
+
+	bind_to_cpu();
+	BUG_ON(cgroup_enter(nr));
+
+	for (i = 0; i < loops; i++) {
+		if (!nr) {
+			ret = read(pipe_read, &m, sizeof(int));
+			BUG_ON(ret != sizeof(int));
+			ret = write(pipe_write, &m, sizeof(int));
+			BUG_ON(ret != sizeof(int));
+		} else {
+			ret = write(pipe_write, &m, sizeof(int));
+			BUG_ON(ret != sizeof(int));
+			ret = read(pipe_read, &m, sizeof(int));
+			BUG_ON(ret != sizeof(int));
+		}
+	}
+}
+
+/* Returns the time the ping-pong between cgroups 0 and 1 took, in usecs */
+static unsigned long long run_switches(void)
+{
+	int pipe_1[2], pipe_2[2], wait_stat;
+	struct timeval start, stop, diff;
+	pid_t pid, retpid __maybe_unused;
+
+	BUG_ON(pipe(pipe_1));
+	BUG_ON(pipe(pipe_2));
+
+	gettimeofday(&start, NULL);
+
+	pid = fork();
+	BUG_ON(pid < 0);
+
+	if (!pid) {
+		worker(0, pipe_1[0], pipe_2[1]);
+		exit(0);
+	}
+	worker(1, pipe_2[0], pipe_1[1]);
+
+	retpid = waitpid(pid, &wait_stat, 0);
+	BUG_ON(retpid != pid || !WIFEXITED(wait_stat));
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	close(pipe_1[0]);
+	close(pipe_1[1]);
+	close(pipe_2[0]);
+	close(pipe_2[1]);
+
+	/* Back to the root cgroup, so that ours can be removed */
+	BUG_ON(cgroup_enter(-1));
+
+	return diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+static int open_cgroup_event(int cgroup_fd)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.config		= PERF_COUNT_HW_CPU_CYCLES,
+		.size		= sizeof(attr),
+	};
+	int fd;
+
+	fd = sys_perf_event_open(&attr, cgroup_fd, cpu, -1,
+				 PERF_FLAG_PID_CGROUP |
+				 perf_event_open_cloexec_flag());
+	if (fd >= 0)
+		return fd;
+
+	/* No cycles counter, a software event still takes the same path */
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_CPU_CLOCK;
+	return sys_perf_event_open(&attr, cgroup_fd, cpu, -1,
+				   PERF_FLAG_PID_CGROUP |
+				   perf_event_open_cloexec_flag());
+}
+
+int bench_sched_cgroup(int argc, const char **argv,
+		       const char *prefix __maybe_unused)
+{
+	unsigned long long base_usec, events_usec;
+	char path[PATH_MAX + 1];
+	int *cgroup_fds, *event_fds;
+	int i, nr_created = 0, ret = -1;
+
+	argc = parse_options(argc, argv, options, bench_sched_cgroup_usage, 0);
+
+	if (nr_cgroups_opt < 2 || loops <= 0) {
+		usage_with_options(bench_sched_cgroup_usage, options);
+		return -1;
+	}
+
+	if (cgroupfs_find_mountpoint(mnt, sizeof(mnt))) {
+		fprintf(stderr, "no perf_event cgroup hierarchy is mounted\n");
+		return -1;
+	}
+
+	cgroup_fds = calloc(nr_cgroups_opt, sizeof(int));
+	event_fds = calloc(nr_cgroups_opt, sizeof(int));
+	BUG_ON(!cgroup_fds || !event_fds);
+
+	for (i = 0; i < nr_cgroups_opt; i++)
+		cgroup_fds[i] = event_fds[i] = -1;
+
+	for (i = 0; i < nr_cgroups_opt; i++, nr_created++) {
+		cgroup_path(path, i);
+		if (mkdir(path, 0755)) {
+			fprintf(stderr, "cannot create %s: %s\n",
+				path, strerror(errno));
+			goto out;
+		}
+		cgroup_fds[i] = open(path, O_RDONLY);
+		if (cgroup_fds[i] < 0) {
+			nr_created++;
+			goto out;
+		}
+	}
+
+	base_usec = run_switches();
+
+	for (i = 0; i < nr_cgroups_opt; i++) {
+		event_fds[i] = open_cgroup_event(cgroup_fds[i]);
+		if (event_fds[i] < 0) {
+			fprintf(stderr, "cannot open cgroup event: %s\n",
+				strerror(errno));
+			goto out;
+		}
+	}
+
+	events_usec = run_switches();
+	ret = 0;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d pipe round trips between two cgroups on cpu %d\n",
+		       loops, cpu);
+		printf("# with a cgroup event open in %d cgroups\n\n",
+		       nr_cgroups_opt);
+
+		/* Each round trip is two context switches */
+		printf(" %14lf usecs/switch without events\n",
+		       (double)base_usec / (2.0 * loops));
+		printf(" %14lf usecs/switch with events\n",
+		       (double)events_usec / (2.0 * loops));
+		printf(" %14lf usecs/switch added by the events\n",
+		       ((double)events_usec - (double)base_usec) / (2.0 * loops));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n",
+		       ((double)events_usec - (double)base_usec) / (2.0 * loops));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+out:
+	for (i = 0; i < nr_cgroups_opt; i++) {
+		if (event_fds[i] >= 0)
+			close(event_fds[i]);
+		if (cgroup_fds[i] >= 0)
+			close(cgroup_fds[i]);
+	}
+	for (i = 0; i < nr_created; i++) {
+		cgroup_path(path, i);
+		rmdir(path);
+	}
+	free(event_fds);
+	free(cgroup_fds);
+
+	return ret;
+}
@@ -13,6 +13,9 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  net   ... Loopback socket performance
+ *  epoll ... epoll wakeup performance
+ *  block ... Block layer direct IO performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -44,6 +47,7 @@ static struct bench numa_benchmarks[] = {
 static struct bench sched_benchmarks[] = {
 	{ "messaging",	"Benchmark for scheduling and IPC",		bench_sched_messaging	},
 	{ "pipe",	"Benchmark for pipe() between two processes",	bench_sched_pipe	},
+	{ "cgroup",	"Benchmark for cgroup perf event switching",	bench_sched_cgroup	},
 	{ "all",	"Run all scheduler benchmarks",		NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -66,6 +70,26 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench net_benchmarks[] = {
+	{ "tcp",	"Benchmark for loopback TCP round trips",	bench_net_tcp		},
+	{ "udp",	"Benchmark for loopback UDP round trips",	bench_net_udp		},
+	{ "unix",	"Benchmark for unix stream socket round trips",	bench_net_unix		},
+	{ "all",	"Run all networking benchmarks",		NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench epoll_benchmarks[] = {
+	{ "wait",	"Benchmark for epoll wakeups on eventfds",	bench_epoll_wait	},
+	{ "all",	"Run all epoll benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench block_benchmarks[] = {
+	{ "dio",	"Benchmark for direct IO, e.g. to null_blk",	bench_block_dio		},
+	{ "all",	"Run all block layer benchmarks",		NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -79,6 +103,9 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "net",	"Loopback socket benchmarks",			net_benchmarks		},
+	{ "epoll",	"epoll wakeup benchmarks",			epoll_benchmarks	},
+	{ "block",	"Block layer benchmarks",			block_benchmarks	},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
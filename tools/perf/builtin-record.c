@@ -35,8 +35,24 @@
 
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
+struct record;
+
+/*
+ * With --threads each reader thread owns every nr_threads'th ring buffer,
+ * runs on the CPUs those buffers belong to and writes what it drains at
+ * file offsets reserved from rec->bytes_written, so that the copies out of
+ * the buffers and the writes no longer all go through the main thread.
+ */
+struct record_thread {
+	pthread_t		thread;
+	struct record		*rec;
+	int			idx;
+	int			err;
+	cpu_set_t		mask;
+};
 
 struct record {
 	struct perf_tool	tool;
@@ -51,10 +67,45 @@ struct record {
 	bool			no_buildid;
 	bool			no_buildid_cache;
 	unsigned long long	samples;
+	unsigned int		threads;
+	unsigned int		nr_threads;
+	struct record_thread	*thread_data;
+	off_t			thread_base;
+	pthread_mutex_t		thread_lock;
+	pthread_cond_t		thread_start;
+	pthread_cond_t		thread_done;
+	unsigned int		thread_round;
+	unsigned int		threads_pending;
+	bool			threads_stop;
 };
 
+static int record__pwrite(struct record *rec, void *bf, size_t size)
+{
+	int fd = perf_data_file__fd(rec->session->file);
+	off_t off = rec->thread_base +
+		    __sync_fetch_and_add(&rec->bytes_written, size);
+
+	while (size) {
+		ssize_t ret = pwrite(fd, bf, size, off);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("failed to write perf data, error: %m\n");
+			return -1;
+		}
+		bf += ret;
+		off += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
 static int record__write(struct record *rec, void *bf, size_t size)
 {
+	if (rec->nr_threads)
+		return record__pwrite(rec, bf, size);
+
 	if (perf_data_file__write(rec->session->file, bf, size) < 0) {
 		pr_err("failed to write perf data, error: %m\n");
 		return -1;
@@ -86,7 +137,10 @@ static int record__mmap_read(struct record *rec, int idx)
 	if (old == head)
 		return 0;
 
-	rec->samples++;
+	if (rec->nr_threads)
+		__sync_fetch_and_add(&rec->samples, 1);
+	else
+		rec->samples++;
 
 	size = head - old;
 
@@ -399,12 +453,152 @@ static struct perf_event_header finished_round_event = {
 	.type = PERF_RECORD_FINISHED_ROUND,
 };
 
+static void *record__thread(void *arg)
+{
+	struct record_thread *t = arg;
+	struct record *rec = t->rec;
+	unsigned int round = 0;
+	int i;
+
+	if (CPU_COUNT(&t->mask) &&
+	    sched_setaffinity(0, sizeof(t->mask), &t->mask) < 0)
+		pr_debug("failed to bind reader thread %d: %m\n", t->idx);
+
+	pthread_mutex_lock(&rec->thread_lock);
+	for (;;) {
+		while (rec->thread_round == round && !rec->threads_stop)
+			pthread_cond_wait(&rec->thread_start, &rec->thread_lock);
+		if (rec->threads_stop)
+			break;
+		round = rec->thread_round;
+		pthread_mutex_unlock(&rec->thread_lock);
+
+		for (i = t->idx; i < rec->evlist->nr_mmaps; i += rec->nr_threads) {
+			if (rec->evlist->mmap[i].base &&
+			    record__mmap_read(rec, i) != 0) {
+				t->err = -1;
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&rec->thread_lock);
+		if (--rec->threads_pending == 0)
+			pthread_cond_signal(&rec->thread_done);
+	}
+	pthread_mutex_unlock(&rec->thread_lock);
+
+	return NULL;
+}
+
+static int record__start_threads(struct record *rec)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	unsigned int nr = min(rec->threads, (unsigned int)evlist->nr_mmaps);
+	off_t pos;
+	int i;
+
+	if (nr < 2)
+		return 0;
+
+	pos = lseek(perf_data_file__fd(&rec->file), 0, SEEK_CUR);
+	if (pos == -1)
+		return -1;
+
+	rec->thread_data = zalloc(nr * sizeof(*rec->thread_data));
+	if (!rec->thread_data)
+		return -ENOMEM;
+
+	for (i = 0; i < evlist->nr_mmaps; i++) {
+		struct record_thread *t = &rec->thread_data[i % nr];
+
+		/* per-cpu buffers are indexed like evlist->cpus */
+		if (!cpu_map__empty(evlist->cpus) &&
+		    evlist->cpus->map[i] < CPU_SETSIZE)
+			CPU_SET(evlist->cpus->map[i], &t->mask);
+	}
+
+	pthread_mutex_init(&rec->thread_lock, NULL);
+	pthread_cond_init(&rec->thread_start, NULL);
+	pthread_cond_init(&rec->thread_done, NULL);
+	rec->thread_base = pos - rec->bytes_written;
+	rec->thread_round = 0;
+	rec->threads_stop = false;
+	rec->nr_threads = nr;
+
+	for (i = 0; i < (int)nr; i++) {
+		struct record_thread *t = &rec->thread_data[i];
+
+		t->rec = rec;
+		t->idx = i;
+		if (pthread_create(&t->thread, NULL, record__thread, t)) {
+			pr_err("failed to create reader thread %d\n", i);
+			/* only join the threads that exist */
+			rec->nr_threads = i;
+			return -1;
+		}
+	}
+
+	pr_debug("reading %d ring buffers with %u threads\n",
+		 evlist->nr_mmaps, nr);
+	return 0;
+}
+
+static void record__stop_threads(struct record *rec)
+{
+	unsigned int i;
+
+	if (!rec->thread_data)
+		return;
+
+	pthread_mutex_lock(&rec->thread_lock);
+	rec->threads_stop = true;
+	pthread_cond_broadcast(&rec->thread_start);
+	pthread_mutex_unlock(&rec->thread_lock);
+
+	for (i = 0; i < rec->nr_threads; i++)
+		pthread_join(rec->thread_data[i].thread, NULL);
+
+	/* back to plain write()s, continuing after what the threads wrote */
+	lseek(perf_data_file__fd(&rec->file),
+	      rec->thread_base + rec->bytes_written, SEEK_SET);
+	rec->nr_threads = 0;
+	zfree(&rec->thread_data);
+	pthread_cond_destroy(&rec->thread_done);
+	pthread_cond_destroy(&rec->thread_start);
+	pthread_mutex_destroy(&rec->thread_lock);
+}
+
+/* Have every reader thread drain its buffers once and wait for them */
+static int record__mmap_read_threads(struct record *rec)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&rec->thread_lock);
+	rec->threads_pending = rec->nr_threads;
+	rec->thread_round++;
+	pthread_cond_broadcast(&rec->thread_start);
+	while (rec->threads_pending)
+		pthread_cond_wait(&rec->thread_done, &rec->thread_lock);
+	pthread_mutex_unlock(&rec->thread_lock);
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		if (rec->thread_data[i].err)
+			return -1;
+	}
+	return 0;
+}
+
 static int record__mmap_read_all(struct record *rec)
 {
 	u64 bytes_written = rec->bytes_written;
 	int i;
 	int rc = 0;
 
+	if (rec->nr_threads) {
+		rc = record__mmap_read_threads(rec);
+		goto out_round;
+	}
+
 	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
 		struct auxtrace_mmap *mm = &rec->evlist->mmap[i].auxtrace_mmap;
 
@@ -422,6 +616,10 @@ static int record__mmap_read_all(struct record *rec)
 		}
 	}
 
+out_round:
+	if (rc)
+		goto out;
+
 	/*
 	 * Mark the round finished in case we wrote
 	 * at least one event.
@@ -666,6 +864,15 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		perf_evlist__enable(rec->evlist);
 	}
 
+	if (rec->threads) {
+		if (file->is_pipe || rec->opts.full_auxtrace) {
+			pr_warning("WARNING: --threads is not supported with pipe output or AUX area tracing, reading from one thread\n");
+		} else if (record__start_threads(rec) < 0) {
+			err = -1;
+			goto out_child;
+		}
+	}
+
 	auxtrace_snapshot_enabled = 1;
 	for (;;) {
 		unsigned long long hits = rec->samples;
@@ -728,6 +935,8 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		fprintf(stderr, "[ perf record: Woken up %ld times to write data ]\n", waking);
 
 out_child:
+	record__stop_threads(rec);
+
 	if (forks) {
 		int exit_status;
 
@@ -1113,6 +1322,8 @@ struct option __record_options[] = {
 			"per thread proc mmap processing timeout in ms"),
 	OPT_BOOLEAN(0, "switch-events", &record.opts.record_switch_events,
 		    "Record context switch events"),
+	OPT_UINTEGER(0, "threads", &record.threads,
+		     "number of threads reading the ring buffers, bound to their CPUs"),
 #ifdef HAVE_LIBBPF_SUPPORT
 	OPT_STRING(0, "clang-path", &llvm_param.clang_path, "clang path",
 		   "clang binary to use for compiling BPF scriptlets"),
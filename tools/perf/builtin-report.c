@@ -63,6 +63,7 @@ struct report {
 	u64			nr_entries;
 	u64			queue_size;
 	int			socket_filter;
+	unsigned int		symbol_threads;
 	DECLARE_BITMAP(cpu_bitmap, MAX_NR_CPUS);
 };
 
@@ -783,6 +784,8 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "Show callgraph from reference event"),
 	OPT_INTEGER(0, "socket-filter", &report.socket_filter,
 		    "only show processor socket that match with this filter"),
+	OPT_UINTEGER(0, "symbol-threads", &report.symbol_threads,
+		     "load the symbols of the recorded DSOs upfront with this many threads"),
 	OPT_END()
 	};
 	struct perf_data_file file = {
@@ -941,6 +944,10 @@ repeat:
 	if (symbol__init(&session->header.env) < 0)
 		goto error;
 
+	if (report.symbol_threads &&
+	    machine__load_dsos(&session->machines.host, report.symbol_threads) < 0)
+		pr_debug("Failed to preload the DSO symbols, loading them on demand\n");
+
 	if (argc) {
 		/*
 		 * Special case: if there's an argument left then assume that
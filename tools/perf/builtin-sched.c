@@ -11,6 +11,7 @@
 #include "util/session.h"
 #include "util/tool.h"
 #include "util/cloexec.h"
+#include "util/stat.h"
 
 #include "util/parse-options.h"
 #include "util/trace-event.h"
@@ -173,6 +174,27 @@ struct perf_sched {
 	struct list_head sort_list, cmp_pid;
 	bool force;
 	bool skip_merge;
+	/* timehist */
+	bool summary;
+	bool summary_only;
+	bool show_wakeups;
+	u64 hist_time;
+};
+
+/*
+ * Per task scheduling times for timehist, hung off thread->priv.  They
+ * are all derived from sched_switch and sched_wakeup alone.
+ */
+struct thread_runtime {
+	u64 last_time;		/* time the task was last switched out */
+	u64 ready_to_run;	/* time of the wakeup, 0 when not pending */
+	u64 dt_run;		/* run time of the last slice */
+	u64 dt_wait;		/* time sleeping before the wakeup */
+	u64 dt_delay;		/* time from the wakeup until on a CPU */
+	u64 total_run_time;
+	u64 total_delay;
+	u64 max_delay;
+	struct stats run_stats;
 };
 
 static u64 get_nsecs(void)
@@ -1326,6 +1348,226 @@ again:
 	}
 }
 
+static struct thread_runtime *thread__get_runtime(struct thread *thread)
+{
+	struct thread_runtime *r = thread__priv(thread);
+
+	if (r == NULL) {
+		r = zalloc(sizeof(*r));
+		if (r == NULL)
+			return NULL;
+		init_stats(&r->run_stats);
+		thread__set_priv(thread, r);
+	}
+
+	return r;
+}
+
+static void timehist_print_time(u64 t)
+{
+	printf("%15.6f ", (double)t / NSEC_PER_SEC);
+}
+
+static void timehist_header(struct perf_sched *sched)
+{
+	printf("%15s %6s  %-24s  %9s  %9s  %9s\n",
+	       "time", "cpu", "task name [tid]", "wait time", "sch delay",
+	       "run time");
+	printf("%15s %6s  %-24s  %9s  %9s  %9s\n",
+	       "", "", "", "(msec)", "(msec)", "(msec)");
+	printf("%.15s %.6s  %.24s  %.9s  %.9s  %.9s\n",
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line);
+
+	sched->hist_time = 0;
+}
+
+static void timehist_print_task(struct thread *thread, int cpu, u64 t,
+				struct thread_runtime *r)
+{
+	char name[64];
+
+	scnprintf(name, sizeof(name), "%s[%d]", thread__comm_str(thread),
+		  thread->tid);
+	timehist_print_time(t);
+	printf("[%04d]  %-24s  %9.3f  %9.3f  %9.3f\n", cpu, name,
+	       (double)r->dt_wait / NSEC_PER_MSEC,
+	       (double)r->dt_delay / NSEC_PER_MSEC,
+	       (double)r->dt_run / NSEC_PER_MSEC);
+}
+
+/*
+ * The task being switched out at @t got on this CPU at @tprev, the CPU's
+ * previous switch.  If it had been woken up, it waited on the runqueue
+ * from the wakeup until @tprev, and before that it slept since it was
+ * last switched out.
+ */
+static void timehist_update_runtime(struct thread_runtime *r, u64 t, u64 tprev)
+{
+	r->dt_run = r->dt_wait = r->dt_delay = 0;
+
+	if (tprev) {
+		r->dt_run = t - tprev;
+		if (r->ready_to_run && r->ready_to_run <= tprev) {
+			r->dt_delay = tprev - r->ready_to_run;
+			if (r->last_time && r->last_time <= r->ready_to_run)
+				r->dt_wait = r->ready_to_run - r->last_time;
+		}
+	}
+
+	update_stats(&r->run_stats, r->dt_run);
+	r->total_run_time += r->dt_run;
+	r->total_delay += r->dt_delay;
+	if (r->dt_delay > r->max_delay)
+		r->max_delay = r->dt_delay;
+
+	r->last_time = t;
+	r->ready_to_run = 0;
+}
+
+static int timehist_switch_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 prev_pid = perf_evsel__intval(evsel, sample, "prev_pid");
+	int cpu = sample->cpu, err = -1;
+	struct thread_runtime *r;
+	struct thread *thread;
+	u64 tprev;
+
+	if (cpu >= MAX_CPUS || cpu < 0) {
+		pr_debug("Invalid cpu %d\n", cpu);
+		return 0;
+	}
+
+	tprev = sched->cpu_last_switched[cpu];
+	sched->cpu_last_switched[cpu] = sample->time;
+
+	/* idle is one task for all the CPUs, its times mean nothing */
+	if (prev_pid == 0)
+		return 0;
+
+	thread = machine__findnew_thread(machine, -1, prev_pid);
+	if (thread == NULL)
+		return -1;
+	r = thread__get_runtime(thread);
+	if (r == NULL)
+		goto out_put;
+
+	sched->nr_timestamps++;
+	if (tprev > sample->time) {
+		sched->nr_unordered_timestamps++;
+		tprev = 0;
+	}
+	timehist_update_runtime(r, sample->time, tprev);
+
+	if (!sched->summary_only &&
+	    (sched->profile_cpu == -1 || sched->profile_cpu == cpu)) {
+		if (!sched->hist_time)
+			timehist_header(sched);
+		timehist_print_task(thread, cpu, sample->time, r);
+		sched->hist_time = sample->time;
+	}
+	err = 0;
+out_put:
+	thread__put(thread);
+	return err;
+}
+
+static int timehist_wakeup_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct thread_runtime *r;
+	struct thread *thread;
+	int err = -1;
+
+	thread = machine__findnew_thread(machine, -1, pid);
+	if (thread == NULL)
+		return -1;
+	r = thread__get_runtime(thread);
+	if (r == NULL)
+		goto out_put;
+
+	/* only the first wakeup counts, the task may already be runnable */
+	if (r->ready_to_run == 0)
+		r->ready_to_run = sample->time;
+
+	if (sched->show_wakeups && !sched->summary_only) {
+		if (!sched->hist_time)
+			timehist_header(sched);
+		timehist_print_time(sample->time);
+		printf("[%04d]  %-24s  awakened: %s[%d]\n", sample->cpu, "",
+		       thread__comm_str(thread), thread->tid);
+		sched->hist_time = sample->time;
+	}
+	err = 0;
+out_put:
+	thread__put(thread);
+	return err;
+}
+
+struct timehist_totals {
+	u64 run_time;
+	u64 nr_switches;
+	u64 nr_tasks;
+};
+
+static int timehist_print_thread_summary(struct thread *thread, void *priv)
+{
+	struct thread_runtime *r = thread__priv(thread);
+	struct timehist_totals *totals = priv;
+	char name[64];
+	double mean;
+
+	if (r == NULL || r->run_stats.n == 0)
+		return 0;
+
+	scnprintf(name, sizeof(name), "%s[%d]", thread__comm_str(thread),
+		  thread->tid);
+	mean = avg_stats(&r->run_stats);
+	printf("  %-24s  %8" PRIu64 "  %12.3f  %9.3f  %9.3f  %9.3f  %6.2f%%\n",
+	       name, (u64)r->run_stats.n,
+	       (double)r->total_run_time / NSEC_PER_MSEC,
+	       mean / NSEC_PER_MSEC,
+	       (double)r->total_delay / r->run_stats.n / NSEC_PER_MSEC,
+	       (double)r->max_delay / NSEC_PER_MSEC,
+	       rel_stddev_stats(stddev_stats(&r->run_stats), mean));
+
+	totals->run_time += r->total_run_time;
+	totals->nr_switches += r->run_stats.n;
+	totals->nr_tasks++;
+	return 0;
+}
+
+static void timehist_print_summary(struct perf_session *session)
+{
+	struct timehist_totals totals = { .run_time = 0, };
+
+	printf("\nRuntime summary\n");
+	printf("  %-24s  %8s  %12s  %9s  %9s  %9s  %7s\n",
+	       "comm[tid]", "switches", "run time", "mean run", "avg delay",
+	       "max delay", "stddev");
+	printf("  %-24s  %8s  %12s  %9s  %9s  %9s  %7s\n",
+	       "", "", "(msec)", "(msec)", "(msec)", "(msec)", "");
+	printf("  %.24s  %.8s  %.12s  %.9s  %.9s  %.9s  %.7s\n",
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line);
+
+	machine__for_each_thread(&session->machines.host,
+				 timehist_print_thread_summary, &totals);
+
+	printf("\n  Total number of unique tasks: %" PRIu64 "\n", totals.nr_tasks);
+	printf("  Total number of context switches: %" PRIu64 "\n",
+	       totals.nr_switches);
+	printf("  Total run time (msec): %.3f\n",
+	       (double)totals.run_time / NSEC_PER_MSEC);
+}
+
 static int process_sched_wakeup_event(struct perf_tool *tool,
 				      struct perf_evsel *evsel,
 				      struct perf_sample *sample,
@@ -1686,6 +1928,63 @@ static int perf_sched__map(struct perf_sched *sched)
 	return 0;
 }
 
+/*
+ * Unlike latency and map, timehist only needs sched_switch and
+ * sched_wakeup, so it also works on a much lighter capture than
+ * 'perf sched record' makes, e.g.:
+ *
+ *   perf record -a -e sched:sched_switch -e sched:sched_wakeup
+ */
+static int perf_sched__timehist(struct perf_sched *sched)
+{
+	const struct perf_evsel_str_handler handlers[] = {
+		{ "sched:sched_switch",	      process_sched_switch_event, },
+		{ "sched:sched_wakeup",	      process_sched_wakeup_event, },
+		{ "sched:sched_wakeup_new",   process_sched_wakeup_event, },
+	};
+	struct perf_session *session;
+	struct perf_data_file file = {
+		.path = input_name,
+		.mode = PERF_DATA_MODE_READ,
+		.force = sched->force,
+	};
+	int err = -1;
+
+	session = perf_session__new(&file, false, &sched->tool);
+	if (session == NULL)
+		return -ENOMEM;
+
+	symbol__init(&session->header.env);
+
+	if (perf_session__set_tracepoints_handlers(session, handlers))
+		goto out;
+
+	if (!perf_evlist__find_tracepoint_by_name(session->evlist,
+						  "sched:sched_switch")) {
+		pr_err("No sched_switch events found. Have you run 'perf sched record'?\n");
+		goto out;
+	}
+
+	setup_pager();
+
+	err = perf_session__process_events(session);
+	if (err) {
+		pr_err("Failed to process events, error %d", err);
+		goto out;
+	}
+
+	sched->nr_events      = session->evlist->stats.nr_events[0];
+	sched->nr_lost_events = session->evlist->stats.total_lost;
+	sched->nr_lost_chunks = session->evlist->stats.nr_events[PERF_RECORD_LOST];
+
+	if (sched->summary)
+		timehist_print_summary(session);
+	print_bad_events(sched);
+out:
+	perf_session__delete(session);
+	return err;
+}
+
 static int perf_sched__replay(struct perf_sched *sched)
 {
 	unsigned long i;
@@ -1835,12 +2134,32 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf sched latency [<options>]",
 		NULL
 	};
+	const struct option timehist_options[] = {
+	OPT_BOOLEAN('s', "summary", &sched.summary_only,
+		    "Show only the per task summary"),
+	OPT_BOOLEAN('S', "with-summary", &sched.summary,
+		    "Show the per task summary after the events"),
+	OPT_BOOLEAN('w', "wakeups", &sched.show_wakeups, "Show wakeup events"),
+	OPT_INTEGER('C', "CPU", &sched.profile_cpu,
+		    "Only show the switches on this CPU"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('f', "force", &sched.force, "don't complain, do it"),
+	OPT_END()
+	};
 	const char * const replay_usage[] = {
 		"perf sched replay [<options>]",
 		NULL
 	};
+	const char * const timehist_usage[] = {
+		"perf sched timehist [<options>]",
+		NULL
+	};
 	const char *const sched_subcommands[] = { "record", "latency", "map",
-						  "replay", "script", NULL };
+						  "replay", "script",
+						  "timehist", NULL };
 	const char *sched_usage[] = {
 		NULL,
 		NULL
@@ -1859,6 +2178,10 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.switch_event	    = replay_switch_event,
 		.fork_event	    = replay_fork_event,
 	};
+	struct trace_sched_handler timehist_ops  = {
+		.wakeup_event	    = timehist_wakeup_event,
+		.switch_event	    = timehist_switch_event,
+	};
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(sched.curr_pid); i++)
@@ -1898,6 +2221,17 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 				usage_with_options(replay_usage, replay_options);
 		}
 		return perf_sched__replay(&sched);
+	} else if (!strcmp(argv[0], "timehist")) {
+		sched.tp_handler = &timehist_ops;
+		if (argc) {
+			argc = parse_options(argc, argv, timehist_options,
+					     timehist_usage, 0);
+			if (argc)
+				usage_with_options(timehist_usage, timehist_options);
+		}
+		if (sched.summary_only)
+			sched.summary = true;
+		return perf_sched__timehist(&sched);
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
@@ -31,6 +31,7 @@ static bool			system_wide;
 static bool			print_flags;
 static bool			nanosecs;
 static const char		*cpu_list;
+static unsigned int		symbol_threads;
 static DECLARE_BITMAP(cpu_bitmap, MAX_NR_CPUS);
 
 unsigned int scripting_max_stack = PERF_MAX_STACK_DEPTH;
@@ -1795,6 +1796,8 @@ int cmd_script(int argc, const char **argv, const char *prefix __maybe_unused)
 			"Enable symbol demangling"),
 	OPT_BOOLEAN(0, "demangle-kernel", &symbol_conf.demangle_kernel,
 			"Enable kernel symbol demangling"),
+	OPT_UINTEGER(0, "symbol-threads", &symbol_threads,
+		     "load the symbols of the recorded DSOs upfront with this many threads"),
 
 	OPT_END()
 	};
@@ -1993,6 +1996,10 @@ int cmd_script(int argc, const char **argv, const char *prefix __maybe_unused)
 	if (symbol__init(&session->header.env) < 0)
 		goto out_delete;
 
+	if (symbol_threads &&
+	    machine__load_dsos(&session->machines.host, symbol_threads) < 0)
+		pr_debug("Failed to preload the DSO symbols, loading them on demand\n");
+
 	script.session = session;
 	script__setup_sample_type(&script);
 
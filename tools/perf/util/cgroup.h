@@ -15,5 +15,6 @@ struct cgroup_sel {
 extern int nr_cgroups; /* number of explicit cgroups defined */
 extern void close_cgroup(struct cgroup_sel *cgrp);
 extern int parse_cgroups(const struct option *opt, const char *str, int unset);
+extern int cgroupfs_find_mountpoint(char *buf, size_t maxlen);
 
 #endif /* __CGROUP_H__ */
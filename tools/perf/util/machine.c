@@ -897,6 +897,97 @@ int machine__load_vmlinux_path(struct machine *machine, enum map_type type,
 	return ret;
 }
 
+struct dsos_loader {
+	struct dso	**dsos;
+	int		nr;
+	int		next;
+	symbol_filter_t	filter;
+};
+
+static void *dsos_loader__thread(void *arg)
+{
+	struct dsos_loader *loader = arg;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&loader->next, 1)) < loader->nr) {
+		struct dso *dso = loader->dsos[i];
+		struct map *map = map__new2(0, dso, MAP__FUNCTION);
+
+		if (map == NULL)
+			continue;
+		/* dso__load() serializes on dso->lock, a later map__load() finds it loaded */
+		dso__load(dso, map, loader->filter);
+		map__put(map);
+	}
+
+	return NULL;
+}
+
+/*
+ * Load the symbols of the user space DSOs known so far, i.e. those from the
+ * build-id table in the header, from @nr_threads threads, instead of one at
+ * a time on the first sample that hits each of them while processing the
+ * events.  Kernel and module DSOs are left alone: they need the kernel maps
+ * set up by the event stream.
+ */
+int machine__load_dsos(struct machine *machine, int nr_threads)
+{
+	struct dsos_loader loader = {
+		.filter = machine->symbol_filter,
+	};
+	pthread_t *threads;
+	struct dso *dso;
+	int i, nr = 0, err = 0;
+
+	pthread_rwlock_rdlock(&machine->dsos.lock);
+	list_for_each_entry(dso, &machine->dsos.head, node)
+		nr++;
+	loader.dsos = calloc(nr, sizeof(*loader.dsos));
+	if (loader.dsos == NULL) {
+		pthread_rwlock_unlock(&machine->dsos.lock);
+		return -ENOMEM;
+	}
+	list_for_each_entry(dso, &machine->dsos.head, node) {
+		if (dso->kernel || dso->long_name[0] == '[' ||
+		    is_kernel_module(dso->long_name,
+				     PERF_RECORD_MISC_CPUMODE_UNKNOWN) ||
+		    dso__loaded(dso, MAP__FUNCTION))
+			continue;
+		loader.dsos[loader.nr++] = dso__get(dso);
+	}
+	pthread_rwlock_unlock(&machine->dsos.lock);
+
+	if (loader.nr == 0)
+		goto out_put;
+	if (nr_threads > loader.nr)
+		nr_threads = loader.nr;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (threads == NULL) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, dsos_loader__thread, &loader))
+			break;
+	}
+	/* whatever the threads didn't get to is loaded on demand */
+	if (i == 0)
+		err = -1;
+	nr_threads = i;
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+out_put:
+	for (i = 0; i < loader.nr; i++)
+		dso__put(loader.dsos[i]);
+	free(loader.dsos);
+	return err;
+}
+
 static void map_groups__fixup_end(struct map_groups *mg)
 {
 	int i;
@@ -0,0 +1,62 @@
+#!/bin/bash
+# Compare zram write throughput with async_write off and on, for each
+# of the lzo and lz4 compressors. Needs root and the zram module; all
+# pages of a run are written by a single dd, which is the case the
+# per-cpu write workers are meant for.
+#
+# usage: zram_async_bench.sh [size in MB, default 1024]
+
+size_mb=${1:-1024}
+streams=$(nproc)
+data=$(mktemp /tmp/zram_bench.XXXXXX)
+
+cleanup()
+{
+	rm -f "$data"
+}
+trap cleanup EXIT
+
+if [ $(id -u) -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit 1
+fi
+
+if [ ! -d /sys/class/zram-control ]; then
+	modprobe zram num_devices=0 || exit 1
+fi
+
+# roughly 3:1 compressible, like anonymous memory tends to be
+head -c $((size_mb / 4))M /dev/urandom | base64 -w 0 | head -c ${size_mb}M > "$data"
+
+run()
+{
+	local alg=$1 async=$2 dev id start end
+
+	id=$(cat /sys/class/zram-control/hot_add) || return 1
+	dev=/sys/block/zram$id
+
+	if ! echo $alg > $dev/comp_algorithm 2>/dev/null ||
+	   ! echo $async > $dev/async_write 2>/dev/null; then
+		echo "$alg async_write=$async: not supported, skipped"
+		echo $id > /sys/class/zram-control/hot_remove
+		return 1
+	fi
+	echo $streams > $dev/max_comp_streams
+	echo $((size_mb * 2))M > $dev/disksize
+
+	start=$(date +%s%N)
+	dd if="$data" of=/dev/zram$id bs=1M oflag=direct 2>/dev/null
+	end=$(date +%s%N)
+
+	printf "%-4s async_write=%d: %6d MB/s\n" $alg $async \
+		$((size_mb * 1000000000 / (end - start)))
+
+	echo 1 > $dev/reset
+	echo $id > /sys/class/zram-control/hot_remove
+}
+
+for alg in lzo lz4; do
+	for async in 0 1; do
+		run $alg $async
+	done
+done
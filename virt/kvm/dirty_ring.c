@@ -0,0 +1,146 @@
+/*
+ * KVM dirty ring implementation
+ *
+ * Per-vcpu rings of dirtied guest frames that userspace harvests through
+ * mmap() instead of fetching and scanning the whole dirty bitmap of every
+ * memslot on each pass.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_dirty_ring.h>
+
+int __weak kvm_cpu_dirty_log_size(void)
+{
+	return 0;
+}
+
+u32 kvm_dirty_ring_get_rsvd_entries(void)
+{
+	return KVM_DIRTY_RING_RSVD_ENTRIES + kvm_cpu_dirty_log_size();
+}
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	ring->dirty_gfns = vzalloc(size);
+	if (!ring->dirty_gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->soft_limit = ring->size - kvm_dirty_ring_get_rsvd_entries();
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+
+	return 0;
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->dirty_gfns);
+	ring->dirty_gfns = NULL;
+}
+
+/*
+ * Returns false if the ring is completely full, which only happens when
+ * the vcpu dirtied more pages than the reserved entries allow for without
+ * getting back to the soft limit check; the caller falls back to the
+ * dirty bitmap then.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	if (ring->dirty_index - READ_ONCE(ring->reset_index) >= ring->size)
+		return false;
+
+	entry = &ring->dirty_gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* Userspace may consume the entry as soon as it sees the flag */
+	smp_wmb();
+	WRITE_ONCE(entry->flags, KVM_DIRTY_GFN_F_DIRTY);
+	WRITE_ONCE(ring->dirty_index, ring->dirty_index + 1);
+
+	return true;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
+}
+
+static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset,
+				unsigned long mask)
+{
+	struct kvm_memory_slot *memslot;
+	int as_id, id;
+
+	as_id = slot >> 16;
+	id = (u16)slot;
+	if (as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return;
+
+	memslot = id_to_memslot(__kvm_memslots(kvm, as_id), id);
+	if (!(memslot->flags & KVM_MEM_LOG_DIRTY_PAGES) ||
+	    offset + __fls(mask) >= memslot->npages)
+		return;
+
+	KVM_MMU_LOCK(kvm);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	KVM_MMU_UNLOCK(kvm);
+}
+
+/*
+ * Hand the entries userspace has marked for reset back to the producer
+ * and write-protect their pages again.  Entries usually come in runs of
+ * nearby frames of one slot, so they are batched into the same masks
+ * the bitmap interface uses.  Called with kvm->slots_lock held; the
+ * caller flushes TLBs if anything was reset.  Returns the number of
+ * entries reset.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	unsigned long mask = 0;
+	int count = 0;
+
+	while (ring->reset_index != READ_ONCE(ring->dirty_index)) {
+		struct kvm_dirty_gfn *entry;
+
+		entry = &ring->dirty_gfns[ring->reset_index & (ring->size - 1)];
+		if (!(READ_ONCE(entry->flags) & KVM_DIRTY_GFN_F_RESET))
+			break;
+
+		next_slot = READ_ONCE(entry->slot);
+		next_offset = READ_ONCE(entry->offset);
+
+		/* The producer may reuse the entry once the index moves */
+		WRITE_ONCE(entry->flags, 0);
+		smp_wmb();
+		WRITE_ONCE(ring->reset_index, ring->reset_index + 1);
+		count++;
+
+		if (mask) {
+			if (next_slot == cur_slot && next_offset >= cur_offset &&
+			    next_offset - cur_offset < BITS_PER_LONG) {
+				mask |= 1UL << (next_offset - cur_offset);
+				continue;
+			}
+			kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		}
+
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+
+	if (mask)
+		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+
+	return count;
+}
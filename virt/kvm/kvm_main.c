@@ -49,6 +49,8 @@
 #include <linux/slab.h>
 #include <linux/sort.h>
 #include <linux/bsearch.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
 
 #include <asm/processor.h>
 #include <asm/io.h>
@@ -119,6 +121,9 @@ EXPORT_SYMBOL_GPL(kvm_rebooting);
 
 static bool largepages_enabled = true;
 
+/* The vcpu loaded on this cpu, if any; see kvm_get_running_vcpu() */
+static DEFINE_PER_CPU(struct kvm_vcpu *, kvm_running_vcpu);
+
 bool kvm_is_reserved_pfn(pfn_t pfn)
 {
 	if (pfn_valid(pfn))
@@ -137,6 +142,7 @@ int vcpu_load(struct kvm_vcpu *vcpu)
 	if (mutex_lock_killable(&vcpu->mutex))
 		return -EINTR;
 	cpu = get_cpu();
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
 	put_cpu();
@@ -149,11 +155,31 @@ void vcpu_put(struct kvm_vcpu *vcpu)
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
 	mutex_unlock(&vcpu->mutex);
 }
 EXPORT_SYMBOL_GPL(vcpu_put);
 
+/*
+ * The vcpu the current task has loaded, or NULL when not called from a
+ * vcpu thread between vcpu_load() and vcpu_put().  Interrupts may hit a
+ * vcpu thread, so they never get to see its vcpu.
+ */
+static struct kvm_vcpu *kvm_get_running_vcpu(void)
+{
+	struct kvm_vcpu *vcpu;
+
+	if (in_interrupt())
+		return NULL;
+
+	preempt_disable();
+	vcpu = __this_cpu_read(kvm_running_vcpu);
+	preempt_enable();
+
+	return vcpu;
+}
+
 static void ack_flush(void *_completed)
 {
 }
@@ -262,6 +288,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 {
 	put_pid(vcpu->pid);
 	kvm_arch_vcpu_uninit(vcpu);
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
@@ -298,7 +325,7 @@ static void kvm_mmu_notifier_invalidate_page(struct mmu_notifier *mn,
 	 * is going to be freed.
 	 */
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 
 	kvm->mmu_notifier_seq++;
 	need_tlb_flush = kvm_unmap_hva(kvm, address) | kvm->tlbs_dirty;
@@ -306,7 +333,7 @@ static void kvm_mmu_notifier_invalidate_page(struct mmu_notifier *mn,
 	if (need_tlb_flush)
 		kvm_flush_remote_tlbs(kvm);
 
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 
 	kvm_arch_mmu_notifier_invalidate_page(kvm, address);
 
@@ -322,10 +349,10 @@ static void kvm_mmu_notifier_change_pte(struct mmu_notifier *mn,
 	int idx;
 
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	kvm->mmu_notifier_seq++;
 	kvm_set_spte_hva(kvm, address, pte);
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 	srcu_read_unlock(&kvm->srcu, idx);
 }
 
@@ -338,7 +365,7 @@ static void kvm_mmu_notifier_invalidate_range_start(struct mmu_notifier *mn,
 	int need_tlb_flush = 0, idx;
 
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	/*
 	 * The count increase must become visible at unlock time as no
 	 * spte can be established without taking the mmu_lock and
@@ -351,7 +378,7 @@ static void kvm_mmu_notifier_invalidate_range_start(struct mmu_notifier *mn,
 	if (need_tlb_flush)
 		kvm_flush_remote_tlbs(kvm);
 
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 	srcu_read_unlock(&kvm->srcu, idx);
 }
 
@@ -362,7 +389,7 @@ static void kvm_mmu_notifier_invalidate_range_end(struct mmu_notifier *mn,
 {
 	struct kvm *kvm = mmu_notifier_to_kvm(mn);
 
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	/*
 	 * This sequence increase will notify the kvm page fault that
 	 * the page that is going to be mapped in the spte could have
@@ -376,7 +403,7 @@ static void kvm_mmu_notifier_invalidate_range_end(struct mmu_notifier *mn,
 	 * in conjunction with the smp_rmb in mmu_notifier_retry().
 	 */
 	kvm->mmu_notifier_count--;
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 
 	BUG_ON(kvm->mmu_notifier_count < 0);
 }
@@ -390,13 +417,13 @@ static int kvm_mmu_notifier_clear_flush_young(struct mmu_notifier *mn,
 	int young, idx;
 
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 
 	young = kvm_age_hva(kvm, start, end);
 	if (young)
 		kvm_flush_remote_tlbs(kvm);
 
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 	srcu_read_unlock(&kvm->srcu, idx);
 
 	return young;
@@ -411,7 +438,7 @@ static int kvm_mmu_notifier_clear_young(struct mmu_notifier *mn,
 	int young, idx;
 
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	/*
 	 * Even though we do not flush TLB, this will still adversely
 	 * affect performance on pre-Haswell Intel EPT, where there is
@@ -426,7 +453,7 @@ static int kvm_mmu_notifier_clear_young(struct mmu_notifier *mn,
 	 * more sophisticated heuristic later.
 	 */
 	young = kvm_age_hva(kvm, start, end);
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 	srcu_read_unlock(&kvm->srcu, idx);
 
 	return young;
@@ -440,9 +467,9 @@ static int kvm_mmu_notifier_test_young(struct mmu_notifier *mn,
 	int young, idx;
 
 	idx = srcu_read_lock(&kvm->srcu);
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	young = kvm_test_age_hva(kvm, address);
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 	srcu_read_unlock(&kvm->srcu, idx);
 
 	return young;
@@ -549,9 +576,10 @@ static struct kvm *kvm_create_vm(unsigned long type)
 	if (!kvm)
 		return ERR_PTR(-ENOMEM);
 
-	spin_lock_init(&kvm->mmu_lock);
+	KVM_MMU_LOCK_INIT(kvm);
 	atomic_inc(&current->mm->mm_count);
 	kvm->mm = current->mm;
+	kvm->userspace_pid = task_pid_nr(current);
 	kvm_eventfd_init(kvm);
 	mutex_init(&kvm->lock);
 	mutex_init(&kvm->irq_lock);
@@ -864,6 +892,7 @@ int __kvm_set_memory_region(struct kvm *kvm,
 	new = old = *slot;
 
 	new.id = id;
+	new.as_id = as_id;
 	new.base_gfn = base_gfn;
 	new.npages = npages;
 	new.flags = mem->flags;
@@ -1111,7 +1140,7 @@ int kvm_get_dirty_log_protect(struct kvm *kvm,
 	dirty_bitmap_buffer = dirty_bitmap + n / sizeof(long);
 	memset(dirty_bitmap_buffer, 0, n);
 
-	spin_lock(&kvm->mmu_lock);
+	KVM_MMU_LOCK(kvm);
 	*is_dirty = false;
 	for (i = 0; i < n / sizeof(long); i++) {
 		unsigned long mask;
@@ -1132,7 +1161,7 @@ int kvm_get_dirty_log_protect(struct kvm *kvm,
 		}
 	}
 
-	spin_unlock(&kvm->mmu_lock);
+	KVM_MMU_UNLOCK(kvm);
 
 	r = -EFAULT;
 	if (copy_to_user(log->dirty_bitmap, dirty_bitmap_buffer, n))
@@ -1930,6 +1959,22 @@ static void mark_page_dirty_in_slot(struct kvm_memory_slot *memslot,
 {
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
+		struct kvm_vcpu *vcpu = kvm_get_running_vcpu();
+
+		/*
+		 * Pages dirtied by a vcpu of the VM owning @memslot go to
+		 * that vcpu's ring if it has one; anything else, or an
+		 * overflowing ring, falls back to the bitmap.
+		 */
+		if (vcpu && vcpu->dirty_ring.size &&
+		    id_to_memslot(__kvm_memslots(vcpu->kvm, memslot->as_id),
+				  memslot->id) == memslot) {
+			u32 slot = (memslot->as_id << 16) | memslot->id;
+
+			if (!WARN_ON_ONCE(!kvm_dirty_ring_push(&vcpu->dirty_ring,
+							       slot, rel_gfn)))
+				return;
+		}
 
 		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
@@ -1953,7 +1998,15 @@ void kvm_vcpu_mark_page_dirty(struct kvm_vcpu *vcpu, gfn_t gfn)
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_mark_page_dirty);
 
-static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
+static unsigned int kvm_max_halt_poll_ns(struct kvm *kvm)
+{
+	if (READ_ONCE(kvm->override_halt_poll_ns))
+		return READ_ONCE(kvm->max_halt_poll_ns);
+
+	return halt_poll_ns;
+}
+
+static void grow_halt_poll_ns(struct kvm_vcpu *vcpu, unsigned int max)
 {
 	int old, val;
 
@@ -1964,8 +2017,8 @@ static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
 	else
 		val *= halt_poll_ns_grow;
 
-	if (val > halt_poll_ns)
-		val = halt_poll_ns;
+	if (val > max)
+		val = max;
 
 	vcpu->halt_poll_ns = val;
 	trace_kvm_halt_poll_ns_grow(vcpu->vcpu_id, val, old);
@@ -1999,18 +2052,31 @@ static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
 	return 0;
 }
 
+static inline void halt_hist_add(u64 *hist, u64 ns)
+{
+	hist[ns ? min_t(int, ilog2(ns), KVM_HALT_HIST_BUCKETS - 1) : 0]++;
+}
+
 /*
  * The vCPU has executed a HLT instruction with in-kernel mode enabled.
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
+	unsigned int max_poll_ns = kvm_max_halt_poll_ns(vcpu->kvm);
 	ktime_t start, cur;
 	DEFINE_WAIT(wait);
-	bool waited = false;
+	bool waited = false, polled = false, overcommitted = false;
 	u64 block_ns;
 
 	start = cur = ktime_get();
-	if (vcpu->halt_poll_ns) {
+	/*
+	 * Polling only pays off when nothing else wants this cpu; with
+	 * other tasks runnable it just steals their time.
+	 */
+	if (vcpu->halt_poll_ns && !single_task_running()) {
+		overcommitted = true;
+		vcpu->halt_hist.poll_skipped++;
+	} else if (vcpu->halt_poll_ns) {
 		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
 
 		++vcpu->stat.halt_attempted_poll;
@@ -2021,10 +2087,15 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 			 */
 			if (kvm_vcpu_check_block(vcpu) < 0) {
 				++vcpu->stat.halt_successful_poll;
+				polled = true;
 				goto out;
 			}
 			cur = ktime_get();
 		} while (single_task_running() && ktime_before(cur, stop));
+
+		overcommitted = ktime_before(cur, stop);
+		halt_hist_add(vcpu->halt_hist.poll_fail,
+			      ktime_to_ns(cur) - ktime_to_ns(start));
 	}
 
 	kvm_arch_vcpu_blocking(vcpu);
@@ -2046,16 +2117,25 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 out:
 	block_ns = ktime_to_ns(cur) - ktime_to_ns(start);
 
-	if (halt_poll_ns) {
-		if (block_ns <= vcpu->halt_poll_ns)
+	if (polled)
+		halt_hist_add(vcpu->halt_hist.poll_success, block_ns);
+	else
+		halt_hist_add(vcpu->halt_hist.wakeup, block_ns);
+
+	if (max_poll_ns) {
+		/* the cpu is overcommitted, back off and don't grow */
+		if (overcommitted || !single_task_running()) {
+			if (vcpu->halt_poll_ns)
+				shrink_halt_poll_ns(vcpu);
+		} else if (block_ns <= vcpu->halt_poll_ns)
 			;
 		/* we had a long block, shrink polling */
-		else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
+		else if (vcpu->halt_poll_ns && block_ns > max_poll_ns)
 			shrink_halt_poll_ns(vcpu);
 		/* we had a short halt and our poll time is too small */
-		else if (vcpu->halt_poll_ns < halt_poll_ns &&
-			block_ns < halt_poll_ns)
-			grow_halt_poll_ns(vcpu);
+		else if (vcpu->halt_poll_ns < max_poll_ns &&
+			block_ns < max_poll_ns)
+			grow_halt_poll_ns(vcpu, max_poll_ns);
 	} else
 		vcpu->halt_poll_ns = 0;
 
@@ -2199,6 +2279,14 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_on_spin);
 
+static bool kvm_page_in_dirty_ring(struct kvm *kvm, unsigned long pgoff)
+{
+	return KVM_DIRTY_LOG_PAGE_OFFSET && kvm->dirty_ring_size &&
+	       pgoff >= KVM_DIRTY_LOG_PAGE_OFFSET &&
+	       pgoff < KVM_DIRTY_LOG_PAGE_OFFSET +
+		       kvm->dirty_ring_size / PAGE_SIZE;
+}
+
 static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct kvm_vcpu *vcpu = vma->vm_file->private_data;
@@ -2214,6 +2302,9 @@ static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	else if (vmf->pgoff == KVM_COALESCED_MMIO_PAGE_OFFSET)
 		page = virt_to_page(vcpu->kvm->coalesced_mmio_ring);
 #endif
+	else if (kvm_page_in_dirty_ring(vcpu->kvm, vmf->pgoff))
+		page = kvm_dirty_ring_get_page(&vcpu->dirty_ring,
+				vmf->pgoff - KVM_DIRTY_LOG_PAGE_OFFSET);
 	else
 		return kvm_arch_vcpu_fault(vcpu, vmf);
 	get_page(page);
@@ -2227,6 +2318,15 @@ static const struct vm_operations_struct kvm_vcpu_vm_ops = {
 
 static int kvm_vcpu_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct kvm_vcpu *vcpu = file->private_data;
+	unsigned long pages = vma_pages(vma);
+
+	/* Userspace writes the reset flags, so the ring must be shared */
+	if ((kvm_page_in_dirty_ring(vcpu->kvm, vma->vm_pgoff) ||
+	     kvm_page_in_dirty_ring(vcpu->kvm, vma->vm_pgoff + pages - 1)) &&
+	    !(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
 	vma->vm_ops = &kvm_vcpu_vm_ops;
 	return 0;
 }
@@ -2296,6 +2396,13 @@ static int kvm_vm_ioctl_create_vcpu(struct kvm *kvm, u32 id)
 
 	BUG_ON(kvm->vcpus[atomic_read(&kvm->online_vcpus)]);
 
+	if (kvm->dirty_ring_size) {
+		r = kvm_dirty_ring_alloc(&vcpu->dirty_ring,
+					 kvm->dirty_ring_size);
+		if (r)
+			goto unlock_vcpu_destroy;
+	}
+
 	/* Now it's all set up, let userspace reach it */
 	kvm_get_kvm(kvm);
 	r = create_vcpu_fd(vcpu);
@@ -2732,6 +2839,7 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #endif
 	case KVM_CAP_IOEVENTFD_ANY_LENGTH:
 	case KVM_CAP_CHECK_EXTENSION_VM:
+	case KVM_CAP_HALT_POLL:
 		return 1;
 #ifdef CONFIG_HAVE_KVM_IRQ_ROUTING
 	case KVM_CAP_IRQ_ROUTING:
@@ -2740,6 +2848,10 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #if KVM_ADDRESS_SPACE_NUM > 1
 	case KVM_CAP_MULTI_ADDRESS_SPACE:
 		return KVM_ADDRESS_SPACE_NUM;
+#endif
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_CAP_DIRTY_LOG_RING:
+		return KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn);
 #endif
 	default:
 		break;
@@ -2747,6 +2859,55 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 	return kvm_vm_ioctl_check_extension(kvm, arg);
 }
 
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u32 size)
+{
+	u32 entries = size / sizeof(struct kvm_dirty_gfn);
+	int r;
+
+	if (!KVM_DIRTY_LOG_PAGE_OFFSET)
+		return -EINVAL;
+
+	/* Whole pages of entries, with room above the reserved ones */
+	if (!is_power_of_2(size) || size < PAGE_SIZE ||
+	    entries <= kvm_dirty_ring_get_rsvd_entries() ||
+	    entries > KVM_DIRTY_RING_MAX_ENTRIES)
+		return -EINVAL;
+
+	mutex_lock(&kvm->lock);
+	if (atomic_read(&kvm->online_vcpus))
+		r = -EINVAL;
+	else if (kvm->dirty_ring_size)
+		r = -EBUSY;
+	else {
+		kvm->dirty_ring_size = size;
+		r = 0;
+	}
+	mutex_unlock(&kvm->lock);
+
+	return r;
+}
+
+static int kvm_vm_ioctl_reset_dirty_rings(struct kvm *kvm)
+{
+	struct kvm_vcpu *vcpu;
+	int i, cleared = 0;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+	kvm_for_each_vcpu(i, vcpu, kvm)
+		cleared += kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+	mutex_unlock(&kvm->slots_lock);
+
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	return cleared;
+}
+#endif
+
 static long kvm_vm_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -2904,6 +3065,40 @@ out_free_irq_routing:
 	case KVM_CHECK_EXTENSION:
 		r = kvm_vm_ioctl_check_extension_generic(kvm, arg);
 		break;
+	case KVM_ENABLE_CAP: {
+		struct kvm_enable_cap cap;
+
+		r = -EFAULT;
+		if (copy_from_user(&cap, argp, sizeof(cap)))
+			goto out;
+		switch (cap.cap) {
+		case KVM_CAP_HALT_POLL:
+			r = -EINVAL;
+			if (cap.flags)
+				goto out;
+			WRITE_ONCE(kvm->max_halt_poll_ns, cap.args[0]);
+			WRITE_ONCE(kvm->override_halt_poll_ns, true);
+			r = 0;
+			break;
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+		case KVM_CAP_DIRTY_LOG_RING:
+			r = -EINVAL;
+			if (cap.flags)
+				goto out;
+			r = kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap.args[0]);
+			break;
+#endif
+		default:
+			/* Everything else is up to the architecture */
+			r = kvm_arch_vm_ioctl(filp, ioctl, arg);
+		}
+		break;
+	}
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_RESET_DIRTY_RINGS:
+		r = kvm_vm_ioctl_reset_dirty_rings(kvm);
+		break;
+#endif
 	default:
 		r = kvm_arch_vm_ioctl(filp, ioctl, arg);
 	}
@@ -3445,6 +3640,61 @@ static const struct file_operations *stat_fops[] = {
 	[KVM_STAT_VM]   = &vm_stat_fops,
 };
 
+static void halt_hist_show(struct seq_file *m, struct kvm *kvm, int id,
+			   const char *kind, u64 *hist)
+{
+	int i;
+
+	seq_printf(m, "%d %d %s", kvm->userspace_pid, id, kind);
+	for (i = 0; i < KVM_HALT_HIST_BUCKETS; i++)
+		seq_printf(m, " %llu", hist[i]);
+	seq_putc(m, '\n');
+}
+
+/*
+ * One line per vcpu and kind: creator pid, vcpu id, kind and the number
+ * of halts whose duration fell into each power-of-two bucket of ns.
+ */
+static int halt_poll_hist_show(struct seq_file *m, void *v)
+{
+	struct kvm_vcpu *vcpu;
+	struct kvm *kvm;
+	int i;
+
+	spin_lock(&kvm_lock);
+	list_for_each_entry(kvm, &vm_list, vm_list) {
+		kvm_for_each_vcpu(i, vcpu, kvm) {
+			struct kvm_halt_hist *h = &vcpu->halt_hist;
+
+			halt_hist_show(m, kvm, vcpu->vcpu_id, "poll_success",
+				       h->poll_success);
+			halt_hist_show(m, kvm, vcpu->vcpu_id, "poll_fail",
+				       h->poll_fail);
+			halt_hist_show(m, kvm, vcpu->vcpu_id, "wakeup",
+				       h->wakeup);
+			seq_printf(m, "%d %d poll_skipped %llu\n",
+				   kvm->userspace_pid, vcpu->vcpu_id,
+				   h->poll_skipped);
+		}
+	}
+	spin_unlock(&kvm_lock);
+	return 0;
+}
+
+static int halt_poll_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, halt_poll_hist_show, NULL);
+}
+
+static const struct file_operations halt_poll_hist_fops = {
+	.open		= halt_poll_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *halt_poll_hist_dentry;
+
 static int kvm_init_debug(void)
 {
 	int r = -EEXIST;
@@ -3462,6 +3712,12 @@ static int kvm_init_debug(void)
 			goto out_dir;
 	}
 
+	halt_poll_hist_dentry = debugfs_create_file("halt_poll_histogram",
+						    0444, kvm_debugfs_dir,
+						    NULL, &halt_poll_hist_fops);
+	if (halt_poll_hist_dentry == NULL)
+		goto out_dir;
+
 	return 0;
 
 out_dir:
@@ -3476,6 +3732,7 @@ static void kvm_exit_debug(void)
 
 	for (p = debugfs_entries; p->name; ++p)
 		debugfs_remove(p->dentry);
+	debugfs_remove(halt_poll_hist_dentry);
 	debugfs_remove(kvm_debugfs_dir);
 }
 
@@ -3512,6 +3769,7 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 	if (vcpu->preempted)
 		vcpu->preempted = false;
 
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	kvm_arch_sched_in(vcpu, cpu);
 
 	kvm_arch_vcpu_load(vcpu, cpu);
@@ -3525,6 +3783,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 	if (current->state == TASK_RUNNING)
 		vcpu->preempted = true;
 	kvm_arch_vcpu_put(vcpu);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
 int kvm_init(void *opaque, unsigned vcpu_size, unsigned vcpu_align,